@@ -18,6 +18,8 @@ QuicBatchingMode getQuicBatchingMode(uint32_t val) {
       return QuicBatchingMode::BATCHING_MODE_GSO;
     case static_cast<uint32_t>(QuicBatchingMode::BATCHING_MODE_SENDMMSG):
       return QuicBatchingMode::BATCHING_MODE_SENDMMSG;
+    case static_cast<uint32_t>(QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO):
+      return QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO;
       // no default
   }
 
@@ -56,12 +58,20 @@ std::string writeDataReasonString(WriteDataReason reason) {
       return "StreamWindowUpdate";
     case WriteDataReason::CONN_WINDOW_UPDATE:
       return "ConnWindowUpdate";
+    case WriteDataReason::STREAM_LIMIT_UPDATE:
+      return "StreamLimitUpdate";
     case WriteDataReason::SIMPLE:
       return "Simple";
     case WriteDataReason::RESET:
       return "Reset";
     case WriteDataReason::PATHCHALLENGE:
       return "PathChallenge";
+    case WriteDataReason::DATAGRAM:
+      return "Datagram";
+    case WriteDataReason::PATH_MTU_PROBE:
+      return "PathMtuProbe";
+    case WriteDataReason::REPAIR:
+      return "Repair";
     case WriteDataReason::NO_WRITE:
       return "NoWrite";
   }
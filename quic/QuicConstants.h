@@ -91,6 +91,10 @@ enum class FrameType : uint8_t {
   PATH_RESPONSE = 0x1B,
   CONNECTION_CLOSE = 0x1C,
   APPLICATION_CLOSE = 0x1D,
+  DATAGRAM = 0x30,
+  DATAGRAM_LEN = 0x31,
+  ACK_FREQUENCY = 0xAF, // draft-ietf-quic-ack-frequency, subject to change
+  REPAIR = 0xFD, // XOR forward error correction, subject to change
   MIN_STREAM_DATA = 0xFE, // subject to change (https://fburl.com/qpr)
   EXPIRED_STREAM_DATA = 0xFF, // subject to change (https://fburl.com/qpr)
 };
@@ -192,6 +196,21 @@ using TransportPartialReliabilitySetting = bool;
 
 constexpr uint16_t kPartialReliabilityParameterId = 0xFF00; // subject to change
 
+// Whether partial reliability is built in. When it is compiled out, neither
+// end offers it, whatever the transport settings say.
+#ifdef MVFST_NO_PARTIAL_RELIABILITY
+constexpr bool kPartialReliabilityBuilt = false;
+#else
+constexpr bool kPartialReliabilityBuilt = true;
+#endif
+
+// min_ack_delay of draft-ietf-quic-ack-frequency, in microseconds. Sending it
+// tells the peer that ACK_FREQUENCY frames are understood.
+constexpr uint16_t kMinAckDelayParameterId = 0xFF02; // subject to change
+
+// Sent with a value of 1 to tell the peer that REPAIR frames are understood.
+constexpr uint16_t kFecParameterId = 0xFF03; // subject to change
+
 constexpr uint32_t kDrainFactor = 3;
 
 // batching mode
@@ -199,6 +218,7 @@ enum class QuicBatchingMode : uint32_t {
   BATCHING_MODE_NONE = 0,
   BATCHING_MODE_GSO = 1,
   BATCHING_MODE_SENDMMSG = 2,
+  BATCHING_MODE_SENDMMSG_GSO = 3,
 };
 
 QuicBatchingMode getQuicBatchingMode(uint32_t val);
@@ -207,6 +227,47 @@ QuicBatchingMode getQuicBatchingMode(uint32_t val);
 // by BATCHING_MODE_GSO
 constexpr uint32_t kDefaultQuicMaxBatchSize = 16;
 
+// default number of datagrams the server worker reads per socket wakeup when
+// recvmmsg based batched reads are enabled
+constexpr uint32_t kDefaultQuicMaxRecvBatchSize = 16;
+
+// upper bound for the recvmmsg batch size, the per batch message headers are
+// kept on the stack
+constexpr uint32_t kMaxQuicRecvBatchSize = 64;
+
+// Packets routed from the other workers that a server worker queues before
+// it drops them, when its event loop falls behind.
+constexpr size_t kMaxForwardedPacketsQueued = 4096;
+
+// size of each receive buffer when UDP GRO is enabled, large enough for the
+// biggest buffer the kernel can coalesce
+constexpr size_t kMaxGROBufferSize = 65535;
+
+// max size of a GSO send, the largest UDP payload of an IPv4 datagram. The
+// kernel fails the whole send with EMSGSIZE beyond it, which large packets
+// reach before the max number of segments.
+constexpr size_t kMaxGSOBufferSize = 65507;
+
+// how often the server worker samples the receive buffer occupancy of its
+// socket, with recvQueueStats
+constexpr std::chrono::milliseconds kRecvBufferSampleInterval{100};
+
+// packets the kernel drops within kRecvBufferGrowthInterval before the server
+// worker doubles the receive buffer of its socket, see maxRecvBufferSize
+constexpr uint64_t kRecvBufferGrowthDrops = 64;
+constexpr std::chrono::seconds kRecvBufferGrowthInterval{1};
+
+// max number of MSG_ZEROCOPY sends waiting for their completion on a socket,
+// later sends are copied until the kernel catches up
+constexpr size_t kMaxZeroCopyPendingBuffers = 1024;
+
+// max number of packets whose header protection masks are computed together
+constexpr size_t kMaxHeaderProtectionBatchSize = 16;
+
+// Batches of kMaxHeaderProtectionBatchSize packets of a connection that are
+// encrypted on a helper thread while the worker builds the next one.
+constexpr size_t kEncryptionPipelineDepth = 2;
+
 // rfc6298:
 constexpr int kRttAlpha = 8;
 constexpr int kRttBeta = 4;
@@ -220,6 +281,40 @@ constexpr std::chrono::microseconds kGranularity = 10000us;
 
 constexpr uint32_t kReorderingThreshold = 3;
 
+// Cap of the reordering threshold when adaptiveReordering widens it.
+constexpr uint32_t kMaxReorderingThreshold = 20;
+
+// With adaptiveReordering, packets may be reordered by up to this many eighths
+// of the RTT, on top of the RTT, before they are declared lost.
+constexpr uint8_t kMaxReorderingWindowMult = 8;
+
+// Loss events without a spurious loss after which a widened reordering window
+// goes back to its default, like RACK does after 16 recoveries.
+constexpr uint16_t kReorderingWindowResetLossEvents = 16;
+
+// Number of packets declared lost that are remembered to find out whether
+// later acks make the losses spurious.
+constexpr size_t kMaxRecentlyLostPackets = 64;
+
+// RTTs for which a packet declared lost is remembered.
+constexpr uint8_t kRecentlyLostPacketLifetimeRtts = 2;
+
+// Path MTU probes of a size that are lost before the size is taken to be too
+// large for the path, MAX_PROBES of RFC 8899.
+constexpr uint8_t kPathMtuMaxProbes = 3;
+
+// The path MTU search stops once the largest acked probe size is within this
+// many bytes of the smallest size known to be too large.
+constexpr uint64_t kPathMtuSearchGranularity = 20;
+
+// Lost packets larger than the base packet size, with none acked since, after
+// which the path is taken to black hole them.
+constexpr uint32_t kPathMtuBlackHoleThreshold = 8;
+
+// How long after the path MTU search converged it starts over, since the
+// path may have changed, PMTU_RAISE_TIMER of RFC 8899.
+constexpr std::chrono::seconds kDefaultPathMtuRaiseInterval = 600s;
+
 constexpr auto kPacketToSendForPTO = 2;
 
 // Maximum number of packets to write per writeConnectionDataToSocket call.
@@ -231,10 +326,26 @@ constexpr uint64_t kDefaultMaxBurstPackets = 10;
 // but the notifications can get delayed if the event loop is busy
 // this is subject to testing but I would suggest a value >= 200usec
 constexpr std::chrono::microseconds kDefaultPacingTimerTickInterval{1000};
+// Calendar slots of the worker's PacingScheduler, one per timer tick
+constexpr size_t kDefaultPacingSchedulerSlots = 1024;
+// Fewest packets per burst of the default quantum of TokenBucketPacer
+constexpr uint64_t kMinPacerQuantumPackets = 2;
+// Credit of TokenBucketPacer that a late pacing timer can release at once, in
+// quanta
+constexpr uint64_t kPacerMaxCreditQuanta = 2;
 
 // Congestion control:
 constexpr std::chrono::microseconds::rep kPersistentCongestionThreshold = 3;
-enum class CongestionControlType : uint8_t { Cubic, NewReno, Copa, BBR, None };
+enum class CongestionControlType : uint8_t {
+  Cubic,
+  NewReno,
+  Copa,
+  BBR,
+  BBR2,
+  Prague,
+  StaticRate,
+  None
+};
 // This is an approximation of a small enough number for cwnd to be blocked.
 constexpr size_t kBlockedSizeBytes = 20;
 
@@ -261,6 +372,22 @@ constexpr std::chrono::microseconds kDelayIncreaseUpperBound(8);
 // Hystart's lower bound for DelayIncrease
 constexpr std::chrono::microseconds kDelayIncreaseLowerBound(2);
 
+/* HyStart++ (RFC 9406): */
+// RTT samples needed in a round before its min RTT is compared to the last
+constexpr uint8_t kHystartPlusPlusRttSamples = 8;
+// Bounds of the min RTT increase that ends slow start, which is otherwise
+// the last min RTT divided by kHystartPlusPlusMinRttDivisor
+constexpr std::chrono::microseconds kHystartPlusPlusMinRttThresh = 4ms;
+constexpr std::chrono::microseconds kHystartPlusPlusMaxRttThresh = 16ms;
+constexpr uint8_t kHystartPlusPlusMinRttDivisor = 8;
+// The cwnd grows this many times slower in conservative slow start
+constexpr uint64_t kHystartPlusPlusCssGrowthDivisor = 4;
+// Round trips in conservative slow start before slow start is exited
+constexpr uint8_t kHystartPlusPlusCssRounds = 5;
+// Most a single ack grows the cwnd by when the connection is not paced, the
+// L of the RFC. Paced connections have no such limit.
+constexpr uint64_t kHystartPlusPlusUnpacedBurstInMss = 8;
+
 /* Cubic */
 // Default cwnd reduction factor:
 constexpr double kDefaultCubicReductionFactor = 0.8;
@@ -276,12 +403,64 @@ constexpr float kDefaultLastMaxReductionFactor = 0.85f;
 // Default flow control window for HTTP/2 + 1K for headers
 constexpr uint64_t kDefaultStreamWindowSize = (64 + 1) * 1024;
 constexpr uint64_t kDefaultConnectionWindowSize = 1024 * 1024;
+// How large autotuning lets the receive windows grow by default.
+constexpr uint64_t kDefaultMaxAutotuneStreamWindowSize = 16 * 1024 * 1024;
+constexpr uint64_t kDefaultMaxAutotuneConnectionWindowSize = 24 * 1024 * 1024;
+
+// Bytes of a file written with writeFile() that are read into the write
+// buffer of its stream at a time, and released buffers of that size that a
+// transport keeps for the next reads.
+constexpr uint64_t kDefaultFileWriteChunkSize = 64 * 1024;
+constexpr size_t kMaxCachedFileWriteBuffers = 8;
+
+// Subnets a SharedCongestionManager keeps before dropping those whose
+// connections are all gone
+constexpr size_t kSharedCongestionGroupsPruneSize = 64;
+
+// How often a connection asks its CongestionControlPolicy which congestion
+// controller it should use
+constexpr std::chrono::seconds kCongestionControlPolicyInterval{1};
+// The default ack time between two samples of the metrics history
+constexpr std::chrono::milliseconds kDefaultMetricsHistoryInterval{100};
+// Bytes a connection sends before PathCongestionControlPolicy judges its path
+constexpr uint64_t kPathPolicyMinBytesSent = 1000 * 1000;
+// Bandwidth delay product and loss rate from which PathCongestionControlPolicy
+// moves a connection to BBR
+constexpr uint64_t kPathPolicyHighBdpBytes = 1000 * 1000;
+constexpr double kPathPolicyHighLossRate = 0.02;
+
+// DATAGRAM frames buffered in each direction before the oldest are dropped
+constexpr size_t kDefaultMaxDatagramsBuffered = 75;
+// Room for the largest short header (1 + 20 bytes of connection id + 4 of
+// packet number), a 16 byte AEAD tag, and the type and 2 byte length of a
+// DATAGRAM frame, when sizing the datagrams that fit in a packet.
+constexpr uint64_t kMaxDatagramPacketOverhead = 44;
+
+// STREAM frames that a REPAIR frame protects at most
+constexpr uint64_t kDefaultFecGroupSize = 4;
+// REPAIR frames waiting to be sent before the oldest are dropped
+constexpr size_t kMaxPendingRepairFrames = 8;
+// Received STREAM frames kept to rebuild a lost one from a REPAIR frame
+constexpr size_t kMaxFecReceivedFrames = 64;
+// Room for the largest short header and a 16 byte AEAD tag, when sizing the
+// REPAIR frames that fit in a packet.
+constexpr uint64_t kMaxRepairPacketOverhead = 41;
+
+// A MAX_DATA frame rides along with the MAX_STREAM_DATA frames of a packet
+// once it would move the connection window by 1 / kMaxDataPiggybackDivisor
+// of its size, before it is due on its own.
+constexpr uint64_t kMaxDataPiggybackDivisor = 4;
 
 /* Stream Limits */
 constexpr uint64_t kDefaultMaxStreamsBidirectional = 2048;
 constexpr uint64_t kDefaultMaxStreamsUnidirectional = 2048;
 constexpr uint64_t kMaxStreamId = 1ull << 62;
 constexpr uint64_t kMaxMaxStreams = 1ull << 60;
+// The credit of the closed streams of the peer is granted back in batches of
+// the streams it opens in kStreamCreditBatchRtts rtts, but no fewer than
+// 1 / kMinStreamCreditBatchDivisor of the streams it may have open at once.
+constexpr uint64_t kStreamCreditBatchRtts = 2;
+constexpr uint64_t kMinStreamCreditBatchDivisor = 8;
 
 /* Idle timeout parameters */
 // Default idle timeout to advertise.
@@ -311,12 +490,51 @@ constexpr double kAckTimerFactor = 0.25;
 constexpr std::chrono::microseconds kMaxAckTimeout = 25000us;
 // min ack timeout: 10ms
 constexpr std::chrono::microseconds kMinAckTimeout = 10000us;
+// Smallest ack delay advertised to a peer that may send ACK_FREQUENCY frames,
+// which is the granularity of the ack timer.
+constexpr std::chrono::microseconds kDefaultMinAckDelay = 1000us;
 
 constexpr uint64_t kAckPurgingThresh = 10;
 
+// Default maximum number of ack ranges written in an ack frame and kept in
+// the ack state. The ranges of the largest packet numbers are kept.
+constexpr uint64_t kDefaultMaxAckBlocks = 64;
+
+// Number of ack blocks of a received ack frame that are stored without
+// allocating.
+constexpr size_t kNumInlineReadAckBlocks = 8;
+
+// Connections a server worker closes per event loop iteration when it closes
+// all of them incrementally.
+constexpr size_t kMaxConnectionsClosedPerLoop = 128;
+
+// Event loop iterations of a server worker between two samples of their busy
+// time, which drive its overload level. The samples are smoothed with a
+// weight of 1 / kOverloadLoopTimeAlpha.
+constexpr uint32_t kOverloadLoopSampleRate = 8;
+constexpr int kOverloadLoopTimeAlpha = 8;
+
+// Maximum number of CertificateVerify signatures handed to a batch signer at
+// once.
+constexpr size_t kDefaultMaxSignatureBatchSize = 8;
+
+// Freed transports and connection states whose memory each thread keeps for
+// the next connections.
+constexpr size_t kMaxCachedConnectionBlocks = 64;
+
 // Default number of packets to buffer if keys are not present.
 constexpr uint32_t kDefaultMaxBufferedPackets = 20;
 
+// Default number of bytes of the packets a server worker buffers for all its
+// connections while their keys are not present.
+constexpr uint64_t kDefaultMaxPendingPacketBytes = 4 * 1024 * 1024;
+
+// Size of the slabs that buffered packets are packed into.
+constexpr size_t kPendingPacketSlabSize = 64 * 1024;
+
+// The largest state of a connection that is handed off to another process.
+constexpr size_t kMaxConnectionHandoffStateSize = 1024;
+
 // Default exponent to use while computing ack delay.
 constexpr uint64_t kDefaultAckDelayExponent = 3;
 constexpr uint64_t kMaxAckDelayExponent = 20;
@@ -344,6 +562,16 @@ constexpr uint32_t kRequiredMaxEarlyDataSize = 0xffffffff;
 // and 16 bytes of the token and 16 bytes of randomness
 constexpr uint16_t kMinStatelessPacketSize = 13 + 16 + 16;
 
+// Stateless reset tokens a server worker keeps, by connection id.
+constexpr size_t kMaxCachedStatelessResetTokens = 1024;
+
+// Stateless resets that copy their random bytes from the same pool before it
+// is refilled.
+constexpr size_t kStatelessResetRandomPoolUses = 64;
+
+// Shards of the persistent PSK cache, each with its own lock.
+constexpr size_t kDefaultPskCacheShards = 16;
+
 constexpr std::chrono::milliseconds kHappyEyeballsV4Delay = 100ms;
 
 constexpr std::chrono::milliseconds kHappyEyeballsConnAttemptDelayWithCache =
@@ -365,11 +593,127 @@ constexpr uint32_t kMaxNumMigrationsAllowed = 6;
 
 constexpr auto kExpectedNumOfParamsInTheTicket = 8;
 
+// Default number of decoded app tokens kept by an AppTokenCache.
+constexpr size_t kDefaultAppTokenCacheSize = 4096;
+
+// Default number of subnets a CongestionStateCache keeps the state of.
+constexpr size_t kDefaultCongestionStateCacheSize = 4096;
+
+// How long the congestion state of a subnet is used to warm start new
+// connections after it was recorded.
+constexpr std::chrono::seconds kDefaultCongestionStateMaxAge = 600s;
+
+// Prefix lengths of the subnets that congestion state is shared within.
+constexpr uint8_t kCongestionStateIPv4PrefixLen = 24;
+constexpr uint8_t kCongestionStateIPv6PrefixLen = 64;
+
+// Upper bound of the initial cwnd of a warm started connection, in MSS.
+constexpr uint64_t kMaxWarmStartCwndInMss = 100;
+
+// A resumed connection jumps to this fraction of the BDP in its ticket, so
+// that it does not overshoot if the path got worse since.
+constexpr uint64_t kResumedCongestionStateCwndDivisor = 2;
+
+// Congestion state in tickets older than this is ignored.
+constexpr std::chrono::seconds kMaxResumedCongestionStateAge = 3600s;
+
+// The server issues a second ticket with its congestion state once its cwnd
+// has grown to this many times the initial one.
+constexpr uint64_t kCongestionStateTicketCwndGrowth = 2;
+
 constexpr auto kStatelessResetTokenSecretLength = 32;
 
+constexpr auto kRetryTokenSecretLength = 32;
+
+// Length of the MAC that authenticates a Retry token.
+constexpr auto kRetryTokenMacLength = 16;
+
+// How often the key that Retry tokens are minted with changes. Tokens minted
+// with the previous key are still accepted.
+constexpr std::chrono::seconds kRetryTokenKeyRotationInterval = 10s;
+
+// Default layout of a StrikeRegisterReplayCache: the ClientHellos seen in the
+// last kDefaultReplayCacheNumBuckets intervals of
+// kDefaultReplayCacheBucketInterval are remembered, each interval in a bloom
+// filter of kDefaultReplayCacheBitsPerBucket bits set by
+// kDefaultReplayCacheNumHashes hashes. With these values a bucket uses 2MB,
+// and a bucket holding a million ClientHellos has a false positive rate of
+// about 0.2%. A false positive only makes the connection fall back to 1-RTT.
+constexpr std::chrono::seconds kDefaultReplayCacheBucketInterval = 10s;
+constexpr size_t kDefaultReplayCacheNumBuckets = 6;
+constexpr size_t kDefaultReplayCacheBitsPerBucket = 1 << 24;
+constexpr size_t kDefaultReplayCacheNumHashes = 4;
+
+// Slots of the timing wheel of the server keepalives, which is as long as
+// the keepalive interval. Keepalives are up to a slot late or early.
+constexpr size_t kKeepaliveWheelSlots = 16;
+
+// Size of the PING packets sent as keepalives. It leaves room for the header
+// protection sample with any packet number length.
+constexpr uint64_t kKeepalivePacketSize = 48;
+
 // default capability of QUIC partial reliability
 constexpr TransportPartialReliabilitySetting kDefaultPartialReliability = false;
 
+// Order in which the stream frame scheduler writes the writable streams.
+enum class StreamSchedulingPolicy : uint8_t {
+  // Cycle through the streams in stream id order.
+  RoundRobin,
+  // Write the most urgent streams first, round-robin among streams of the
+  // same urgency.
+  StrictPriority,
+  // Share the connection between streams in proportion to their weight,
+  // using deficit counters.
+  WeightedRoundRobin,
+  // HTTP/3 style priorities. Write the most urgent streams first. Within an
+  // urgency, write non-incremental streams one after the other in stream id
+  // order, then round-robin among the incremental streams.
+  Urgency,
+};
+
+// Urgency of streams that were not given a priority. Lower is more urgent.
+constexpr uint8_t kDefaultStreamUrgency = 3;
+constexpr uint8_t kMaxStreamUrgency = 7;
+
+// Weight of streams that were not given a priority.
+constexpr uint16_t kDefaultStreamWeight = 16;
+constexpr uint16_t kMaxStreamWeight = 256;
+
+// Bytes a stream may write per unit of weight in a round of weighted
+// round-robin scheduling.
+constexpr uint64_t kStreamSchedulingQuantum = 64;
+
+// Bytes a stream with a send rate limit may write at once by default.
+constexpr uint64_t kDefaultStreamSendRateBurstBytes = 16 * 1024;
+
+// Size of the buffers that small stream writes are copied into, see
+// streamWriteCoalescingThreshold.
+constexpr size_t kStreamWriteCoalescingBufferSize = 4096;
+
+// States of closed streams kept per connection to be reused by new streams.
+constexpr size_t kMaxRecycledStreamStates = 32;
+
+// Log2 buckets of the histograms of the built-in transport stats.
+constexpr size_t kTransportStatsHistogramBuckets = 64;
+
+// ECN codepoints, carried in the two low bits of the IP TOS or traffic class
+// field.
+enum class EcnCodepoint : uint8_t {
+  NotEct = 0,
+  Ect1 = 1,
+  Ect0 = 2,
+  Ce = 3,
+};
+
+constexpr uint8_t kEcnMask = 0x03;
+
+// L4S congestion controllers mark their packets ECT(1), which L4S queues tell
+// apart from classic ECN traffic.
+inline EcnCodepoint ecnMarkingFor(CongestionControlType type) {
+  return type == CongestionControlType::Prague ? EcnCodepoint::Ect1
+                                               : EcnCodepoint::Ect0;
+}
+
 enum class ZeroRttSourceTokenMatchingPolicy : uint8_t {
   REJECT_IF_NO_EXACT_MATCH,
   LIMIT_IF_NO_EXACT_MATCH,
@@ -412,9 +756,13 @@ enum class WriteDataReason {
   BLOCKED,
   STREAM_WINDOW_UPDATE,
   CONN_WINDOW_UPDATE,
+  STREAM_LIMIT_UPDATE,
   SIMPLE,
   RESET,
   PATHCHALLENGE,
+  DATAGRAM,
+  PATH_MTU_PROBE,
+  REPAIR,
 };
 
 enum class NoWriteReason {
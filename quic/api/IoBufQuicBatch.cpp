@@ -8,6 +8,7 @@
 
 #include <quic/api/IoBufQuicBatch.h>
 
+#include <quic/api/QuicSocketTimestamps.h>
 #include <quic/happyeyeballs/QuicHappyEyeballsFunctions.h>
 
 namespace quic {
@@ -31,20 +32,21 @@ bool IOBufQuicBatch::write(
   // see if we need to flush the prev buffer(s)
   if (batchWriter_->needsFlush(encodedSize)) {
     // continue even if we get an error here
-    flush();
+    flush(FlushReason::SIZE_MISMATCH);
   }
 
   // try to append the new buffers
+  pktBatched_++;
   if (batchWriter_->append(std::move(buf), encodedSize)) {
     // return if we get an error here
-    return flush();
+    return flush(batchWriter_->getAppendFlushReason());
   }
 
   return true;
 }
 
-bool IOBufQuicBatch::flush() {
-  bool ret = flushInternal();
+bool IOBufQuicBatch::flush(FlushReason reason) {
+  bool ret = flushInternal(reason);
   reset();
 
   return ret;
@@ -57,12 +59,17 @@ void IOBufQuicBatch::setContinueOnNetworkUnreachable(
 
 void IOBufQuicBatch::reset() {
   batchWriter_->reset();
+  pktBatched_ = 0;
 }
 
 bool IOBufQuicBatch::isNetworkUnreachable(int err) {
   return err == EHOSTUNREACH || err == ENETUNREACH;
 }
 
+bool IOBufQuicBatch::isWouldBlock(int err) {
+  return err == EAGAIN || err == EWOULDBLOCK;
+}
+
 bool IOBufQuicBatch::isRetriableError(int err) {
   if (err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS ||
       err == EMSGSIZE) {
@@ -79,15 +86,21 @@ bool IOBufQuicBatch::isRetriableError(int err) {
   return false;
 }
 
-bool IOBufQuicBatch::flushInternal() {
+bool IOBufQuicBatch::flushInternal(FlushReason reason) {
   if (batchWriter_->empty()) {
     return true;
   }
 
+  auto batchBytes = batchWriter_->size();
   bool written = false;
+  bool wouldBlock = false;
   if (happyEyeballsState_.shouldWriteToFirstSocket) {
     auto consumed = batchWriter_->write(sock_, peerAddress_);
     written = (consumed >= 0);
+    if (written && conn_.txTimestamper) {
+      conn_.txTimestamper->onBatchWritten(Clock::now());
+    }
+    wouldBlock = consumed < 0 && isWouldBlock(errno);
     happyEyeballsState_.shouldWriteToFirstSocket =
         (consumed >= 0 || isRetriableError(errno));
 
@@ -113,6 +126,7 @@ bool IOBufQuicBatch::flushInternal() {
 
     // written is marked true if either socket write succeeds
     written |= (consumed >= 0);
+    wouldBlock |= consumed < 0 && isWouldBlock(errno);
     happyEyeballsState_.shouldWriteToSecondSocket =
         (consumed >= 0 || isRetriableError(errno));
     if (!happyEyeballsState_.shouldWriteToSecondSocket) {
@@ -137,6 +151,16 @@ bool IOBufQuicBatch::flushInternal() {
         TransportErrorCode::INTERNAL_ERROR);
   }
 
+  if (wouldBlock) {
+    QUIC_STATS(conn_.infoCallback, onWriteWouldBlock);
+  }
+  if (conn_.qLogger) {
+    conn_.qLogger->addWriteBatch(
+        pktBatched_,
+        batchBytes,
+        QuicTransportStatsCallback::toString(reason),
+        wouldBlock);
+  }
   if (!written) {
     // This can happen normally, so ignore for now. Now we treat EAGAIN same
     // as a loss to avoid looping.
@@ -146,6 +170,12 @@ bool IOBufQuicBatch::flushInternal() {
 
   // Reset the deadline after successful write
   conn_.continueOnNetworkUnreachableDeadline = folly::none;
+  QUIC_STATS(conn_.infoCallback, onWriteBatch, pktBatched_, batchBytes, reason);
+  if (conn_.infoCallback) {
+    batchWriter_->visitGSOBuffers([this](size_t numSegments) {
+      conn_.infoCallback->onGSOWrite(numSegments);
+    });
+  }
 
   return true; // success, not done yet
 }
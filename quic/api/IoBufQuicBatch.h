@@ -14,6 +14,8 @@
 namespace quic {
 class IOBufQuicBatch {
  public:
+  using FlushReason = QuicTransportStatsCallback::WriteBatchFlushReason;
+
   IOBufQuicBatch(
       std::unique_ptr<BatchWriter>&& batchWriter,
       folly::AsyncUDPSocket& sock,
@@ -26,7 +28,7 @@ class IOBufQuicBatch {
   // returns true if it succeeds and false if the loop should end
   bool write(std::unique_ptr<folly::IOBuf>&& buf, size_t encodedSize);
 
-  bool flush();
+  bool flush(FlushReason reason = FlushReason::END_OF_WRITE);
 
   FOLLY_ALWAYS_INLINE uint64_t getPktSent() const {
     return pktSent_;
@@ -38,10 +40,13 @@ class IOBufQuicBatch {
   void reset();
 
   // flushes the internal buffers
-  bool flushInternal();
+  bool flushInternal(FlushReason reason);
 
   bool isNetworkUnreachable(int err);
 
+  // Returns whether the write failed because the socket buffer is full.
+  bool isWouldBlock(int err);
+
   /**
    * Returns whether or not the errno can be retried later.
    */
@@ -53,6 +58,8 @@ class IOBufQuicBatch {
   QuicConnectionStateBase& conn_;
   QuicConnectionStateBase::HappyEyeballsState& happyEyeballsState_;
   uint64_t pktSent_{0};
+  // Packets in the batch that has not been flushed yet
+  size_t pktBatched_{0};
   bool continueOnNetworkUnreachable_{false};
 };
 
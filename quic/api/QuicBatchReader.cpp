@@ -0,0 +1,341 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicBatchReader.h>
+
+#include <quic/api/QuicSocketTimestamps.h>
+
+#include <folly/net/NetOps.h>
+#include <folly/portability/Sockets.h>
+
+#include <array>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#if defined(__linux__) && !defined(UDP_GRO)
+#define UDP_GRO 104
+#endif
+
+#if defined(__linux__) && !defined(SO_RXQ_OVFL)
+#define SO_RXQ_OVFL 40
+#endif
+
+#if defined(__linux__) && !defined(SO_MEMINFO)
+#define SO_MEMINFO 55
+#endif
+
+namespace quic {
+
+QuicBatchReader::QuicBatchReader(
+    size_t maxDatagrams,
+    size_t bufSize,
+    bool groEnabled,
+    bool ecnEnabled,
+    bool timestampsEnabled,
+    bool packetInfoEnabled,
+    bool rxQueueOverflowEnabled)
+    : maxDatagrams_(std::max<size_t>(
+          1,
+          std::min<size_t>(maxDatagrams, kMaxQuicRecvBatchSize))),
+      bufSize_(bufSize),
+      groEnabled_(groEnabled),
+      ecnEnabled_(ecnEnabled),
+      timestampsEnabled_(timestampsEnabled),
+      packetInfoEnabled_(packetInfoEnabled),
+      rxQueueOverflowEnabled_(rxQueueOverflowEnabled) {}
+
+void QuicBatchReader::splitCoalescedBuffer(
+    std::unique_ptr<folly::IOBuf> data,
+    size_t segmentSize,
+    folly::FunctionRef<void(std::unique_ptr<folly::IOBuf>)> onSegment) {
+  CHECK_GT(segmentSize, 0);
+  DCHECK(!data->isChained());
+  while (data->length() > segmentSize) {
+    auto segment = data->cloneOne();
+    segment->trimEnd(segment->length() - segmentSize);
+    data->trimStart(segmentSize);
+    onSegment(std::move(segment));
+  }
+  if (data->length() > 0) {
+    onSegment(std::move(data));
+  }
+}
+
+bool QuicBatchReader::enableGRO(FOLLY_MAYBE_UNUSED folly::NetworkSocket fd) {
+#ifdef __linux__
+  int val = 1;
+  return folly::netops::setsockopt(fd, SOL_UDP, UDP_GRO, &val, sizeof(val)) ==
+      0;
+#else
+  return false;
+#endif
+}
+
+bool QuicBatchReader::enableBusyPoll(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED std::chrono::microseconds timeout) {
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+  int val = timeout.count();
+  return folly::netops::setsockopt(
+             fd, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool QuicBatchReader::enableEcn(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED sa_family_t family) {
+#ifdef __linux__
+  int val = 1;
+  if (family == AF_INET6) {
+    // IPv4 mapped peers of a dual stack socket still report IP_TOS.
+    folly::netops::setsockopt(fd, IPPROTO_IP, IP_RECVTOS, &val, sizeof(val));
+    return folly::netops::setsockopt(
+               fd, IPPROTO_IPV6, IPV6_RECVTCLASS, &val, sizeof(val)) == 0;
+  }
+  return folly::netops::setsockopt(
+             fd, IPPROTO_IP, IP_RECVTOS, &val, sizeof(val)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool QuicBatchReader::enablePacketInfo(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED sa_family_t family) {
+#ifdef __linux__
+  int val = 1;
+  if (family == AF_INET6) {
+    // IPv4 mapped peers of a dual stack socket still report IP_PKTINFO.
+    folly::netops::setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &val, sizeof(val));
+    return folly::netops::setsockopt(
+               fd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &val, sizeof(val)) == 0;
+  }
+  return folly::netops::setsockopt(
+             fd, IPPROTO_IP, IP_PKTINFO, &val, sizeof(val)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool QuicBatchReader::enableRxQueueOverflow(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd) {
+#ifdef __linux__
+  int val = 1;
+  return folly::netops::setsockopt(
+             fd, SOL_SOCKET, SO_RXQ_OVFL, &val, sizeof(val)) == 0;
+#else
+  return false;
+#endif
+}
+
+folly::Optional<QuicBatchReader::RecvBufferUsage>
+QuicBatchReader::getRecvBufferUsage(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd) {
+#ifdef __linux__
+  // The first two of the SK_MEMINFO_VARS counters are the bytes allocated
+  // to the receive queue and the receive buffer size. Newer kernels have
+  // more of them, which are cut off.
+  std::array<uint32_t, 9> memInfo{};
+  socklen_t len = sizeof(memInfo);
+  if (folly::netops::getsockopt(
+          fd, SOL_SOCKET, SO_MEMINFO, memInfo.data(), &len) != 0 ||
+      len < 2 * sizeof(uint32_t)) {
+    return folly::none;
+  }
+  RecvBufferUsage usage;
+  usage.usedBytes = memInfo[0];
+  usage.size = memInfo[1];
+  return usage;
+#else
+  return folly::none;
+#endif
+}
+
+folly::Optional<uint64_t> QuicBatchReader::growRecvBuffer(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED uint64_t maxSize) {
+#ifdef __linux__
+  auto getSize = [fd]() -> uint64_t {
+    int size = 0;
+    socklen_t len = sizeof(size);
+    auto ret =
+        folly::netops::getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &len);
+    return ret == 0 && size > 0 ? static_cast<uint64_t>(size) : 0;
+  };
+  auto size = getSize();
+  if (size == 0 || size >= maxSize) {
+    return folly::none;
+  }
+  // The kernel doubles the value it is given, so the size it reports is
+  // what doubles the buffer.
+  int val = static_cast<int>(std::min(size * 2, maxSize) / 2);
+  if (folly::netops::setsockopt(
+          fd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) != 0) {
+    return folly::none;
+  }
+  auto newSize = getSize();
+  if (newSize <= size) {
+    // Capped by net.core.rmem_max.
+    return folly::none;
+  }
+  return newSize;
+#else
+  return folly::none;
+#endif
+}
+
+bool QuicBatchReader::isTransientReadError(int err) {
+  return err == ENOBUFS || err == ENOMEM || err == ECONNREFUSED ||
+      err == EHOSTUNREACH || err == ENETUNREACH;
+}
+
+#ifdef __linux__
+int QuicBatchReader::recvmmsg(
+    folly::NetworkSocket fd,
+    struct mmsghdr* msgs,
+    unsigned int vlen) {
+  return ::recvmmsg(fd.toFd(), msgs, vlen, MSG_DONTWAIT, nullptr);
+}
+#endif
+
+int QuicBatchReader::read(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED OnDatagram onDatagram) {
+#ifdef __linux__
+  // Packets from the previous batches may still be held by the transports,
+  // in which case only their buffers are replaced.
+  for (size_t i = 0; i < maxDatagrams_; ++i) {
+    if (!bufs_[i] || bufs_[i]->isShared()) {
+      bufs_[i] = allocator_ ? allocator_->getBuffer(bufSize_)
+                            : folly::IOBuf::create(bufSize_);
+      bufs_[i]->append(bufSize_);
+    }
+  }
+
+  std::array<struct mmsghdr, kMaxQuicRecvBatchSize> msgs;
+  std::array<struct iovec, kMaxQuicRecvBatchSize> iovecs;
+  std::array<struct sockaddr_storage, kMaxQuicRecvBatchSize> addrs;
+  // Room for the GRO segment size, the TOS or traffic class, the timestamps,
+  // the destination address and the drop count.
+  constexpr size_t kControlSize = 2 * CMSG_SPACE(sizeof(int)) +
+      CMSG_SPACE(sizeof(scm_timestamping)) +
+      CMSG_SPACE(sizeof(struct in6_pktinfo)) + CMSG_SPACE(sizeof(uint32_t));
+  std::array<std::array<char, kControlSize>, kMaxQuicRecvBatchSize> controls;
+  const bool hasControl = groEnabled_ || ecnEnabled_ || timestampsEnabled_ ||
+      packetInfoEnabled_ || rxQueueOverflowEnabled_;
+  for (size_t i = 0; i < maxDatagrams_; ++i) {
+    iovecs[i].iov_base = bufs_[i]->writableData();
+    iovecs[i].iov_len = bufSize_;
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_name = &addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    if (hasControl) {
+      msgs[i].msg_hdr.msg_control = controls[i].data();
+      msgs[i].msg_hdr.msg_controllen = kControlSize;
+    }
+  }
+
+  int numMsgs;
+  do {
+    numMsgs = recvmmsg(fd, msgs.data(), maxDatagrams_);
+  } while (numMsgs < 0 && errno == EINTR);
+  if (numMsgs < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    if (isTransientReadError(errno)) {
+      VLOG(4) << "Transient error reading batch, errno=" << errno;
+      return 0;
+    }
+    return -1;
+  }
+  for (int i = 0; i < numMsgs; ++i) {
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      VLOG(4) << "Dropping truncated datagram in batch";
+      continue;
+    }
+    folly::SocketAddress peer;
+    try {
+      peer.setFromSockaddr(
+          reinterpret_cast<struct sockaddr*>(&addrs[i]),
+          msgs[i].msg_hdr.msg_namelen);
+    } catch (const std::exception& ex) {
+      VLOG(4) << "Dropping datagram with invalid peer address " << ex.what();
+      continue;
+    }
+    size_t segmentSize = 0;
+    EcnCodepoint ecn = EcnCodepoint::NotEct;
+    folly::Optional<TimePoint> receiveTime;
+    folly::Optional<folly::IPAddress> localAddress;
+    if (hasControl) {
+      for (auto cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg != nullptr;
+           cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+          int gso;
+          memcpy(&gso, CMSG_DATA(cmsg), sizeof(gso));
+          segmentSize = static_cast<size_t>(gso);
+        } else if (
+            cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS) {
+          // IP_TOS is a single byte, unlike IPV6_TCLASS.
+          uint8_t tos;
+          memcpy(&tos, CMSG_DATA(cmsg), sizeof(tos));
+          ecn = static_cast<EcnCodepoint>(tos & kEcnMask);
+        } else if (
+            cmsg->cmsg_level == IPPROTO_IPV6 &&
+            cmsg->cmsg_type == IPV6_TCLASS) {
+          int tclass;
+          memcpy(&tclass, CMSG_DATA(cmsg), sizeof(tclass));
+          ecn = static_cast<EcnCodepoint>(tclass & kEcnMask);
+        } else if (
+            cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_TIMESTAMPING) {
+          receiveTime = parseKernelTimestamp(*cmsg);
+        } else if (
+            cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO) {
+          struct in_pktinfo info;
+          memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+          localAddress = folly::IPAddress(info.ipi_addr);
+        } else if (
+            cmsg->cmsg_level == IPPROTO_IPV6 &&
+            cmsg->cmsg_type == IPV6_PKTINFO) {
+          struct in6_pktinfo info;
+          memcpy(&info, CMSG_DATA(cmsg), sizeof(info));
+          localAddress = folly::IPAddress(info.ipi6_addr);
+        } else if (
+            cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+          // Only there once the kernel dropped a datagram.
+          memcpy(&rxQueueDrops_, CMSG_DATA(cmsg), sizeof(rxQueueDrops_));
+        }
+      }
+    }
+    auto data = bufs_[i]->cloneOne();
+    data->trimEnd(data->length() - msgs[i].msg_len);
+    if (segmentSize > 0 && data->length() > segmentSize) {
+      splitCoalescedBuffer(
+          std::move(data), segmentSize, [&](std::unique_ptr<folly::IOBuf> seg) {
+            onDatagram(peer, std::move(seg), ecn, receiveTime, localAddress);
+          });
+    } else {
+      onDatagram(peer, std::move(data), ecn, receiveTime, localAddress);
+    }
+  }
+  return numMsgs;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+} // namespace quic
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/IPAddress.h>
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/IOBuf.h>
+#include <folly/net/NetworkSocket.h>
+#include <folly/portability/Sockets.h>
+#include <quic/QuicConstants.h>
+#include <quic/common/BufferAllocator.h>
+
+#include <array>
+
+namespace quic {
+
+/**
+ * Reads a batch of datagrams from a UDP socket with a single recvmmsg call.
+ * Every message of a batch is received into a buffer of its own, which is
+ * handed out without copying and reused by the next reads once it was
+ * released, so only the datagrams that are still held cost an allocation.
+ * If UDP GRO is enabled on the socket the coalesced buffers are split back
+ * into individual datagrams, again without copying.
+ */
+class QuicBatchReader {
+ public:
+  // receiveTime is the kernel receive time of the datagram, if timestamps
+  // are enabled and the kernel reported one. localAddress is the destination
+  // address of the datagram, if packet info is enabled.
+  using OnDatagram = folly::FunctionRef<void(
+      const folly::SocketAddress& peer,
+      std::unique_ptr<folly::IOBuf> data,
+      EcnCodepoint ecn,
+      folly::Optional<TimePoint> receiveTime,
+      const folly::Optional<folly::IPAddress>& localAddress)>;
+
+  /**
+   * maxDatagrams is the number of messages passed to recvmmsg and is capped
+   * at kMaxQuicRecvBatchSize. bufSize is the space provided for each of them.
+   * With GRO enabled bufSize should be large enough to hold a full coalesced
+   * buffer. With ECN enabled the ECN codepoint of every datagram is read
+   * from its IP_TOS or IPV6_TCLASS ancillary data, otherwise it is NotEct.
+   * With timestamps enabled the receive time of every datagram is read from
+   * its SCM_TIMESTAMPING ancillary data, see enableRxTimestamps. With packet
+   * info enabled the destination address of every datagram is read from its
+   * IP_PKTINFO or IPV6_PKTINFO ancillary data, see enablePacketInfo. With
+   * receive queue overflow enabled the count of the datagrams the kernel
+   * dropped is read from their SO_RXQ_OVFL ancillary data, see
+   * rxQueueDrops.
+   */
+  QuicBatchReader(
+      size_t maxDatagrams,
+      size_t bufSize,
+      bool groEnabled,
+      bool ecnEnabled = false,
+      bool timestampsEnabled = false,
+      bool packetInfoEnabled = false,
+      bool rxQueueOverflowEnabled = false);
+
+  virtual ~QuicBatchReader() = default;
+
+  /**
+   * Reads once from the socket and invokes onDatagram for every datagram, in
+   * the order they were received. Truncated datagrams are dropped.
+   * Returns the number of messages read, 0 if the socket had nothing to read
+   * or hit a transient error, see isTransientReadError, and -1 on error, in
+   * which case errno is set. Interrupted reads are retried.
+   */
+  int read(folly::NetworkSocket fd, OnDatagram onDatagram);
+
+  size_t getMaxDatagrams() const {
+    return maxDatagrams_;
+  }
+
+  bool groEnabled() const {
+    return groEnabled_;
+  }
+
+  bool ecnEnabled() const {
+    return ecnEnabled_;
+  }
+
+  bool timestampsEnabled() const {
+    return timestampsEnabled_;
+  }
+
+  bool packetInfoEnabled() const {
+    return packetInfoEnabled_;
+  }
+
+  bool rxQueueOverflowEnabled() const {
+    return rxQueueOverflowEnabled_;
+  }
+
+  /**
+   * The number of datagrams the kernel dropped on the socket so far because
+   * its receive buffer was full, as of the last datagram read. It wraps
+   * around at 2^32.
+   */
+  uint32_t rxQueueDrops() const {
+    return rxQueueDrops_;
+  }
+
+  /**
+   * Makes read take the buffers from allocator, which has to outlive the
+   * reader, instead of the global allocator.
+   */
+  void setBufferAllocator(BufferAllocator* allocator) {
+    allocator_ = allocator;
+  }
+
+  /**
+   * Splits a buffer that the kernel coalesced with GRO into segments of
+   * segmentSize bytes. Only the last segment may be shorter.
+   */
+  static void splitCoalescedBuffer(
+      std::unique_ptr<folly::IOBuf> data,
+      size_t segmentSize,
+      folly::FunctionRef<void(std::unique_ptr<folly::IOBuf>)> onSegment);
+
+  /**
+   * Enables UDP GRO on the socket. Returns false if the platform or the
+   * kernel does not support it.
+   */
+  static bool enableGRO(folly::NetworkSocket fd);
+
+  /**
+   * Sets SO_BUSY_POLL, so that reads of the socket poll the device queue for
+   * up to the timeout when it is empty. Returns false if the platform or the
+   * kernel does not support it.
+   */
+  static bool enableBusyPoll(
+      folly::NetworkSocket fd,
+      std::chrono::microseconds timeout);
+
+  /**
+   * Asks for the TOS or traffic class of the received datagrams as ancillary
+   * data, depending on the address family of the socket. Returns false if the
+   * platform or the kernel does not support it.
+   */
+  static bool enableEcn(folly::NetworkSocket fd, sa_family_t family);
+
+  /**
+   * Asks for the destination address of the received datagrams as ancillary
+   * data, depending on the address family of the socket, so that a socket
+   * bound to the wildcard address knows which of the local addresses the
+   * peer sent to. Returns false if the platform or the kernel does not
+   * support it.
+   */
+  static bool enablePacketInfo(folly::NetworkSocket fd, sa_family_t family);
+
+  /**
+   * Turns on SO_RXQ_OVFL, so that the datagrams carry the count of the ones
+   * the kernel dropped. Returns false if the platform or the kernel does not
+   * support it.
+   */
+  static bool enableRxQueueOverflow(folly::NetworkSocket fd);
+
+  struct RecvBufferUsage {
+    // bytes of the datagrams waiting to be read, with the kernel overhead
+    uint64_t usedBytes{0};
+    // as SO_RCVBUF reports it, twice the size that was set
+    uint64_t size{0};
+  };
+
+  /**
+   * Reads the receive buffer occupancy of the socket with SO_MEMINFO. Returns
+   * none if the platform or the kernel does not support it.
+   */
+  static folly::Optional<RecvBufferUsage> getRecvBufferUsage(
+      folly::NetworkSocket fd);
+
+  /**
+   * Doubles the receive buffer of the socket, up to maxSize as SO_RCVBUF
+   * reports it. Returns the new size, or none if it could not grow.
+   */
+  static folly::Optional<uint64_t> growRecvBuffer(
+      folly::NetworkSocket fd,
+      uint64_t maxSize);
+
+  /**
+   * Whether a read that failed with err may succeed later on the same socket,
+   * like when the kernel is short of memory or reports an ICMP error of an
+   * earlier send. The socket should not be closed for those.
+   */
+  static bool isTransientReadError(int err);
+
+ protected:
+#ifdef __linux__
+  virtual int
+  recvmmsg(folly::NetworkSocket fd, struct mmsghdr* msgs, unsigned int vlen);
+#endif
+
+ private:
+  size_t maxDatagrams_;
+  size_t bufSize_;
+  bool groEnabled_;
+  bool ecnEnabled_;
+  bool timestampsEnabled_;
+  bool packetInfoEnabled_;
+  bool rxQueueOverflowEnabled_;
+  uint32_t rxQueueDrops_{0};
+  BufferAllocator* allocator_{nullptr};
+  std::array<std::unique_ptr<folly::IOBuf>, kMaxQuicRecvBatchSize> bufs_;
+};
+
+} // namespace quic
@@ -7,13 +7,116 @@
  */
 
 #include <quic/api/QuicBatchWriter.h>
+#include <quic/state/StateData.h>
+
+#include <folly/portability/Sockets.h>
+
+#include <array>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
+
+#if defined(__linux__) && !defined(UDP_SEGMENT)
+#define UDP_SEGMENT 103
+#endif
+
+#if defined(__linux__) && !defined(SO_ZEROCOPY)
+#define SO_ZEROCOPY 60
+#endif
+
+#if defined(__linux__) && !defined(MSG_ZEROCOPY)
+#define MSG_ZEROCOPY 0x4000000
+#endif
+
+#if defined(__linux__) && !defined(SO_EE_ORIGIN_ZEROCOPY)
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+
+#if defined(__linux__) && !defined(SO_TXTIME)
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
 
 namespace quic {
+namespace {
+// Kernel limit on the number of segments in a single GSO buffer.
+constexpr size_t kMaxGSOSegments = 64;
+
+void appendToIovecs(
+    const folly::IOBuf& buf,
+    std::vector<struct iovec>& iovecs) {
+  auto curr = &buf;
+  do {
+    if (curr->length() > 0) {
+      struct iovec iov;
+      iov.iov_base = const_cast<uint8_t*>(curr->data());
+      iov.iov_len = curr->length();
+      iovecs.push_back(iov);
+    }
+    curr = curr->next();
+  } while (curr != &buf);
+}
+
+#ifdef __linux__
+// Same layout as struct sock_txtime, which older headers lack.
+struct TxTimeConfig {
+  clockid_t clockid;
+  uint32_t flags;
+};
+
+// Room for the IP_PKTINFO or IPV6_PKTINFO of a message.
+constexpr size_t kPacketInfoSpace = CMSG_SPACE(sizeof(struct in6_pktinfo));
+
+// Appends the ancillary data that makes the kernel send msg from source to
+// the control data msg already has. Without control data msg gets control,
+// otherwise its control data has to be followed by kPacketInfoSpace bytes.
+void appendPacketInfo(
+    struct msghdr& msg,
+    char* control,
+    const folly::IPAddress& source) {
+  if (!msg.msg_control) {
+    msg.msg_control = control;
+    msg.msg_controllen = 0;
+  }
+  auto cm = reinterpret_cast<struct cmsghdr*>(
+      static_cast<char*>(msg.msg_control) + msg.msg_controllen);
+  if (source.isV4()) {
+    struct in_pktinfo info;
+    memset(&info, 0, sizeof(info));
+    info.ipi_spec_dst = source.asV4().toAddr();
+    cm->cmsg_level = IPPROTO_IP;
+    cm->cmsg_type = IP_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(info));
+    memcpy(CMSG_DATA(cm), &info, sizeof(info));
+    msg.msg_controllen += CMSG_SPACE(sizeof(info));
+  } else {
+    struct in6_pktinfo info;
+    memset(&info, 0, sizeof(info));
+    info.ipi6_addr = source.asV6().toAddr();
+    cm->cmsg_level = IPPROTO_IPV6;
+    cm->cmsg_type = IPV6_PKTINFO;
+    cm->cmsg_len = CMSG_LEN(sizeof(info));
+    memcpy(CMSG_DATA(cm), &info, sizeof(info));
+    msg.msg_controllen += CMSG_SPACE(sizeof(info));
+  }
+}
+#endif
+} // namespace
+
 // BatchWriter
 bool BatchWriter::needsFlush(size_t /*unused*/) {
   return false;
 }
 
+BatchWriter::FlushReason BatchWriter::getAppendFlushReason() const {
+  return FlushReason::MAX_BUFS;
+}
+
+void BatchWriter::visitGSOBuffers(
+    folly::FunctionRef<void(size_t)> /*unused*/) const {}
+
 // SinglePacketBatchWriter
 void SinglePacketBatchWriter::reset() {
   buf_.reset();
@@ -46,8 +149,10 @@ void GSOPacketBatchWriter::reset() {
 
 bool GSOPacketBatchWriter::needsFlush(size_t size) {
   // if we get a buffer with a size that is greater
-  // than the prev one we need to flush
-  return (prevSize_ && (size > prevSize_));
+  // than the prev one we need to flush, as we do when the GSO buffer would
+  // be larger than a UDP datagram, which large packets reach before maxBufs_
+  return (prevSize_ && (size > prevSize_)) ||
+      prevSize_ * currBufs_ + size > kMaxGSOBufferSize;
 }
 
 bool GSOPacketBatchWriter::append(
@@ -71,11 +176,13 @@ bool GSOPacketBatchWriter::append(
   // see if we've added a different size
   if (size != prevSize_) {
     CHECK_LT(size, prevSize_);
+    flushReason_ = FlushReason::SIZE_MISMATCH;
     return true;
   }
 
   // reached max buffers
   if (FOLLY_UNLIKELY(currBufs_ == maxBufs_)) {
+    flushReason_ = FlushReason::MAX_BUFS;
     return true;
   }
 
@@ -83,6 +190,18 @@ bool GSOPacketBatchWriter::append(
   return false;
 }
 
+GSOPacketBatchWriter::FlushReason GSOPacketBatchWriter::getAppendFlushReason()
+    const {
+  return flushReason_;
+}
+
+void GSOPacketBatchWriter::visitGSOBuffers(
+    folly::FunctionRef<void(size_t)> visitor) const {
+  if (currBufs_ > 1) {
+    visitor(currBufs_);
+  }
+}
+
 ssize_t GSOPacketBatchWriter::write(
     folly::AsyncUDPSocket& sock,
     const folly::SocketAddress& address) {
@@ -149,11 +268,539 @@ ssize_t SendmmsgPacketBatchWriter::write(
   return 0;
 }
 
+// SendmmsgGSOPacketBatchWriter
+SendmmsgGSOPacketBatchWriter::SendmmsgGSOPacketBatchWriter(
+    size_t maxBufs,
+    bool gsoEnabled)
+    : maxBufs_(maxBufs), gsoEnabled_(gsoEnabled) {
+  chains_.reserve(maxBufs);
+}
+
+bool SendmmsgGSOPacketBatchWriter::empty() const {
+  return !currSize_;
+}
+
+size_t SendmmsgGSOPacketBatchWriter::size() const {
+  return currSize_;
+}
+
+void SendmmsgGSOPacketBatchWriter::reset() {
+  chains_.clear();
+  currBufs_ = 0;
+  currSize_ = 0;
+}
+
+bool SendmmsgGSOPacketBatchWriter::append(
+    std::unique_ptr<folly::IOBuf>&& buf,
+    size_t size) {
+  CHECK_LT(currBufs_, maxBufs_);
+  bool canExtend = gsoEnabled_ && !chains_.empty() && !chains_.back().closed &&
+      size <= chains_.back().segmentSize &&
+      chains_.back().numSegments < kMaxGSOSegments &&
+      chains_.back().segmentSize * chains_.back().numSegments + size <=
+          kMaxGSOBufferSize;
+  if (canExtend) {
+    auto& chain = chains_.back();
+    chain.buf->prependChain(std::move(buf));
+    chain.numSegments++;
+    // a smaller packet has to be the last one of the GSO buffer
+    chain.closed = size < chain.segmentSize;
+  } else {
+    GSOChain chain;
+    chain.buf = std::move(buf);
+    chain.segmentSize = size;
+    chain.numSegments = 1;
+    chains_.push_back(std::move(chain));
+  }
+  currBufs_++;
+  currSize_ += size;
+
+  // reached max buffers
+  if (FOLLY_UNLIKELY(currBufs_ == maxBufs_)) {
+    return true;
+  }
+
+  // does not need to be flushed yet
+  return false;
+}
+
+void SendmmsgGSOPacketBatchWriter::visitGSOBuffers(
+    folly::FunctionRef<void(size_t)> visitor) const {
+  for (const auto& chain : chains_) {
+    if (chain.numSegments > 1) {
+      visitor(chain.numSegments);
+    }
+  }
+}
+
+ssize_t SendmmsgGSOPacketBatchWriter::write(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address) {
+  CHECK_GT(chains_.size(), 0);
+  if (chains_.size() == 1 && !source_) {
+    auto& chain = chains_[0];
+    return (chain.numSegments > 1)
+        ? sock.writeGSO(address, chain.buf, static_cast<int>(chain.segmentSize))
+        : sock.write(address, chain.buf);
+  }
+#ifdef __linux__
+  struct sockaddr_storage addrStorage;
+  socklen_t addrLen = address.getAddress(&addrStorage);
+  constexpr size_t kControlSize =
+      CMSG_SPACE(sizeof(uint16_t)) + kPacketInfoSpace;
+
+  size_t numIovecs = 0;
+  for (const auto& chain : chains_) {
+    numIovecs += chain.buf->countChainElements();
+  }
+  std::vector<struct iovec> iovecs;
+  iovecs.reserve(numIovecs);
+  std::vector<struct mmsghdr> msgs(chains_.size());
+  std::vector<std::array<char, kControlSize>> controls(chains_.size());
+  for (size_t i = 0; i < chains_.size(); ++i) {
+    auto& chain = chains_[i];
+    auto& msg = msgs[i].msg_hdr;
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    size_t firstIovec = iovecs.size();
+    appendToIovecs(*chain.buf, iovecs);
+    msg.msg_name = &addrStorage;
+    msg.msg_namelen = addrLen;
+    msg.msg_iov = iovecs.data() + firstIovec;
+    msg.msg_iovlen = iovecs.size() - firstIovec;
+    if (chain.numSegments > 1) {
+      msg.msg_control = controls[i].data();
+      msg.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+      struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+      cm->cmsg_level = SOL_UDP;
+      cm->cmsg_type = UDP_SEGMENT;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segmentSize = static_cast<uint16_t>(chain.segmentSize);
+      memcpy(CMSG_DATA(cm), &segmentSize, sizeof(segmentSize));
+    }
+    if (source_) {
+      appendPacketInfo(msg, controls[i].data(), *source_);
+    }
+  }
+
+  int ret = ::sendmmsg(
+      sock.getNetworkSocket().toFd(), msgs.data(), msgs.size(), 0);
+  if (ret <= 0) {
+    return ret;
+  }
+
+  if (static_cast<size_t>(ret) == msgs.size()) {
+    return currSize_;
+  }
+
+  // this is a partial write - we just need to
+  // return a different number than currSize_
+  return 0;
+#else
+  // no sendmmsg, write the GSO buffers one by one
+  ssize_t written = 0;
+  for (auto& chain : chains_) {
+    auto ret = (chain.numSegments > 1)
+        ? sock.writeGSO(address, chain.buf, static_cast<int>(chain.segmentSize))
+        : sock.write(address, chain.buf);
+    if (ret <= 0) {
+      return written ? 0 : ret;
+    }
+    written += ret;
+  }
+  return written == static_cast<ssize_t>(currSize_) ? written : 0;
+#endif
+}
+
+// EgressBatcher
+EgressBatcher::EgressBatcher(
+    folly::EventBase* evb,
+    folly::AsyncUDPSocket& sock,
+    size_t maxBatchSize)
+    : evb_(evb), sock_(sock), maxBatchSize_(std::max<size_t>(1, maxBatchSize)) {
+  packets_.reserve(maxBatchSize_);
+}
+
+EgressBatcher::~EgressBatcher() {
+  cancelLoopCallback();
+}
+
+ssize_t EgressBatcher::write(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address,
+    std::unique_ptr<folly::IOBuf> buf,
+    const folly::Optional<folly::IPAddress>& source) {
+  if (sock.getNetworkSocket() != sock_.getNetworkSocket()) {
+    return sock.write(address, buf);
+  }
+  auto size = buf->computeChainDataLength();
+  packets_.push_back(QueuedPacket{address, std::move(buf), source});
+  if (packets_.size() >= maxBatchSize_) {
+    flush();
+  } else if (!isLoopCallbackScheduled()) {
+    // Writes usually happen from the transports' write loopers, which are loop
+    // callbacks themselves, so flush within this loop iteration.
+    evb_->runInLoop(this, true /* thisIteration */);
+  }
+  return size;
+}
+
+void EgressBatcher::runLoopCallback() noexcept {
+  flush();
+}
+
+void EgressBatcher::flush() {
+  if (packets_.empty()) {
+    return;
+  }
+  cancelLoopCallback();
+  if (packets_.size() == 1 && !packets_[0].source) {
+    sock_.write(packets_[0].address, packets_[0].buf);
+    packets_.clear();
+    return;
+  }
+#ifdef __linux__
+  size_t numIovecs = 0;
+  for (const auto& packet : packets_) {
+    numIovecs += packet.buf->countChainElements();
+  }
+  std::vector<struct iovec> iovecs;
+  iovecs.reserve(numIovecs);
+  std::vector<struct mmsghdr> msgs(packets_.size());
+  std::vector<struct sockaddr_storage> addrs(packets_.size());
+  std::vector<std::array<char, kPacketInfoSpace>> controls(packets_.size());
+  for (size_t i = 0; i < packets_.size(); ++i) {
+    auto& msg = msgs[i].msg_hdr;
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    size_t firstIovec = iovecs.size();
+    appendToIovecs(*packets_[i].buf, iovecs);
+    msg.msg_name = &addrs[i];
+    msg.msg_namelen = packets_[i].address.getAddress(&addrs[i]);
+    msg.msg_iov = iovecs.data() + firstIovec;
+    msg.msg_iovlen = iovecs.size() - firstIovec;
+    if (packets_[i].source) {
+      appendPacketInfo(msg, controls[i].data(), *packets_[i].source);
+    }
+  }
+  size_t sent = 0;
+  while (sent < msgs.size()) {
+    int ret = ::sendmmsg(
+        sock_.getNetworkSocket().toFd(),
+        msgs.data() + sent,
+        msgs.size() - sent,
+        0);
+    if (ret <= 0) {
+      // The transports already consider these packets sent, the ones we
+      // could not write are handled like any other loss.
+      VLOG(4) << "EgressBatcher dropped " << (msgs.size() - sent)
+              << " packets, err=" << folly::errnoStr(errno);
+      break;
+    }
+    sent += ret;
+  }
+#else
+  for (auto& packet : packets_) {
+    sock_.write(packet.address, packet.buf);
+  }
+#endif
+  packets_.clear();
+}
+
+// EgressBatcherBatchWriter
+void EgressBatcherBatchWriter::reset() {
+  buf_.reset();
+}
+
+bool EgressBatcherBatchWriter::append(
+    std::unique_ptr<folly::IOBuf>&& buf,
+    size_t /*unused*/) {
+  buf_ = std::move(buf);
+
+  // hand it over to the batcher right away
+  return true;
+}
+
+ssize_t EgressBatcherBatchWriter::write(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address) {
+  DCHECK(buf_);
+  return batcher_.write(sock, address, std::move(buf_), source_);
+}
+
+// ZeroCopySender
+ZeroCopySender::ZeroCopySender(folly::AsyncUDPSocket& sock)
+    : fd_(sock.getNetworkSocket()), enabled_(enableZeroCopy(fd_)) {}
+
+bool ZeroCopySender::enableZeroCopy(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd) {
+#ifdef __linux__
+  int val = 1;
+  return ::setsockopt(fd.toFd(), SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)) ==
+      0;
+#else
+  return false;
+#endif
+}
+
+ssize_t ZeroCopySender::write(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf,
+    int gso) {
+#ifdef __linux__
+  if (enabled_ && sock.getNetworkSocket() == fd_) {
+    if (!pending_.empty()) {
+      reapCompletions();
+    }
+    if (pending_.size() < kMaxZeroCopyPendingBuffers) {
+      std::vector<struct iovec> iovecs;
+      iovecs.reserve(buf->countChainElements());
+      appendToIovecs(*buf, iovecs);
+      struct sockaddr_storage addr;
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_name = &addr;
+      msg.msg_namelen = address.getAddress(&addr);
+      msg.msg_iov = iovecs.data();
+      msg.msg_iovlen = iovecs.size();
+      char control[CMSG_SPACE(sizeof(uint16_t))];
+      if (gso > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_UDP;
+        cm->cmsg_type = UDP_SEGMENT;
+        cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        auto segSize = static_cast<uint16_t>(gso);
+        memcpy(CMSG_DATA(cm), &segSize, sizeof(segSize));
+      }
+      ssize_t ret = ::sendmsg(fd_.toFd(), &msg, MSG_ZEROCOPY);
+      if (ret >= 0) {
+        // Keep the memory alive, even after the caller drops buf, until the
+        // kernel is done with it.
+        pending_.emplace(nextId_++, buf->clone());
+        return ret;
+      }
+      if (errno != ENOBUFS) {
+        return ret;
+      }
+      // Out of optmem for the pinned pages, copy this one.
+    }
+  }
+#endif
+  return gso > 0 ? sock.writeGSO(address, buf, gso) : sock.write(address, buf);
+}
+
+void ZeroCopySender::reapCompletions() {
+#ifdef __linux__
+  // Room for a sock_extended_err followed by the offender address.
+  char control[128];
+  while (!pending_.empty()) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd_.toFd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      return;
+    }
+    for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      onErrMessage(*cm);
+    }
+  }
+#endif
+}
+
+bool ZeroCopySender::onErrMessage(FOLLY_MAYBE_UNUSED const cmsghdr& cmsg) {
+#ifdef __linux__
+  if ((cmsg.cmsg_level != SOL_IP || cmsg.cmsg_type != IP_RECVERR) &&
+      (cmsg.cmsg_level != SOL_IPV6 || cmsg.cmsg_type != IPV6_RECVERR)) {
+    return false;
+  }
+  const auto serr =
+      reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(&cmsg));
+  if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+    return false;
+  }
+  release(serr->ee_info, serr->ee_data);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ZeroCopySender::release(uint32_t lo, uint32_t hi) {
+  if (lo <= hi) {
+    pending_.erase(pending_.lower_bound(lo), pending_.upper_bound(hi));
+    return;
+  }
+  // the range wrapped around
+  pending_.erase(pending_.lower_bound(lo), pending_.end());
+  pending_.erase(pending_.begin(), pending_.upper_bound(hi));
+}
+
+// ZeroCopyGSOPacketBatchWriter
+bool ZeroCopyGSOPacketBatchWriter::append(
+    std::unique_ptr<folly::IOBuf>&& buf,
+    size_t size) {
+  if (GSOPacketBatchWriter::append(std::move(buf), size)) {
+    return true;
+  }
+  // also covers maxBufs_ == 1, used when the socket has no GSO support
+  flushReason_ = FlushReason::MAX_BUFS;
+  return currBufs_ >= maxBufs_;
+}
+
+ssize_t ZeroCopyGSOPacketBatchWriter::write(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address) {
+  return sender_.write(
+      sock, address, buf_, currBufs_ > 1 ? static_cast<int>(prevSize_) : 0);
+}
+
+// TxTimePacketBatchWriter
+TxTimePacketBatchWriter::TxTimePacketBatchWriter(size_t maxBufs, Pacer& pacer)
+    : pacer_(pacer), maxBufs_(maxBufs) {
+  bufs_.reserve(maxBufs);
+  txTimes_.reserve(maxBufs);
+}
+
+bool TxTimePacketBatchWriter::enableTxTime(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd) {
+#ifdef __linux__
+  // steady_clock is CLOCK_MONOTONIC, which is also what fq expects
+  TxTimeConfig config{CLOCK_MONOTONIC, 0};
+  return ::setsockopt(
+             fd.toFd(), SOL_SOCKET, SO_TXTIME, &config, sizeof(config)) == 0;
+#else
+  return false;
+#endif
+}
+
+bool TxTimePacketBatchWriter::empty() const {
+  return !currSize_;
+}
+
+size_t TxTimePacketBatchWriter::size() const {
+  return currSize_;
+}
+
+void TxTimePacketBatchWriter::reset() {
+  bufs_.clear();
+  txTimes_.clear();
+  currSize_ = 0;
+}
+
+bool TxTimePacketBatchWriter::append(
+    std::unique_ptr<folly::IOBuf>&& buf,
+    size_t size) {
+  CHECK_LT(bufs_.size(), maxBufs_);
+  bufs_.emplace_back(std::move(buf));
+  txTimes_.emplace_back(pacer_.getPacketTxTime(Clock::now()));
+  currSize_ += size;
+
+  // reached max buffers
+  return bufs_.size() == maxBufs_;
+}
+
+ssize_t TxTimePacketBatchWriter::write(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address) {
+  CHECK_GT(bufs_.size(), 0);
+#ifdef __linux__
+  constexpr size_t kControlSize =
+      CMSG_SPACE(sizeof(uint64_t)) + kPacketInfoSpace;
+  size_t numIovecs = 0;
+  for (const auto& buf : bufs_) {
+    numIovecs += buf->countChainElements();
+  }
+  std::vector<struct iovec> iovecs;
+  iovecs.reserve(numIovecs);
+  std::vector<struct mmsghdr> msgs(bufs_.size());
+  std::vector<char> control(bufs_.size() * kControlSize);
+  struct sockaddr_storage addr;
+  socklen_t addrLen = address.getAddress(&addr);
+  for (size_t i = 0; i < bufs_.size(); ++i) {
+    auto& msg = msgs[i].msg_hdr;
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    size_t firstIovec = iovecs.size();
+    appendToIovecs(*bufs_[i], iovecs);
+    msg.msg_name = &addr;
+    msg.msg_namelen = addrLen;
+    msg.msg_iov = iovecs.data() + firstIovec;
+    msg.msg_iovlen = iovecs.size() - firstIovec;
+    if (txTimes_[i]) {
+      msg.msg_control = control.data() + i * kControlSize;
+      msg.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+      struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+      cm->cmsg_level = SOL_SOCKET;
+      cm->cmsg_type = SCM_TXTIME;
+      cm->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+      uint64_t txTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              txTimes_[i]->time_since_epoch())
+                              .count();
+      memcpy(CMSG_DATA(cm), &txTimeNs, sizeof(txTimeNs));
+    }
+    if (source_) {
+      appendPacketInfo(msg, control.data() + i * kControlSize, *source_);
+    }
+  }
+  int ret = ::sendmmsg(
+      sock.getNetworkSocket().toFd(), msgs.data(), msgs.size(), 0);
+#else
+  int ret = sock.writem(address, bufs_.data(), bufs_.size());
+#endif
+  if (ret <= 0) {
+    return ret;
+  }
+
+  if (static_cast<size_t>(ret) == bufs_.size()) {
+    return currSize_;
+  }
+
+  // this is a partial write - we just need to
+  // return a different number than currSize_
+  return 0;
+}
+
 // BatchWriterFactory
 std::unique_ptr<BatchWriter> BatchWriterFactory::makeBatchWriter(
     folly::AsyncUDPSocket& sock,
     const quic::QuicBatchingMode& batchingMode,
-    uint32_t batchSize) {
+    uint32_t batchSize,
+    EgressBatcher* egressBatcher,
+    ZeroCopySender* zeroCopySender,
+    Pacer* txTimePacer,
+    const folly::Optional<folly::IPAddress>& sourceAddress) {
+  // The egress batcher knows nothing of departure times, so the packets of
+  // a connection paced with SO_TXTIME are not handed to it.
+  if (txTimePacer) {
+    auto writer =
+        std::make_unique<TxTimePacketBatchWriter>(batchSize, *txTimePacer);
+    if (sourceAddress) {
+      writer->setSourceAddress(*sourceAddress);
+    }
+    return writer;
+  }
+  if (egressBatcher) {
+    return std::make_unique<EgressBatcherBatchWriter>(
+        *egressBatcher, sourceAddress);
+  }
+  if (sourceAddress) {
+    // Only sendmmsg takes the source address, on a message of its own.
+    bool gso = sock.getGSO() >= 0 &&
+        (batchingMode == quic::QuicBatchingMode::BATCHING_MODE_GSO ||
+         batchingMode == quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO);
+    auto writer = std::make_unique<SendmmsgGSOPacketBatchWriter>(
+        batchingMode == quic::QuicBatchingMode::BATCHING_MODE_NONE ? 1
+                                                                   : batchSize,
+        gso);
+    writer->setSourceAddress(*sourceAddress);
+    return writer;
+  }
+  if (zeroCopySender && zeroCopySender->enabled()) {
+    // a GSO batch of one packet is sent as a regular packet
+    return std::make_unique<ZeroCopyGSOPacketBatchWriter>(
+        sock.getGSO() >= 0 ? batchSize : 1, *zeroCopySender);
+  }
   switch (batchingMode) {
     case quic::QuicBatchingMode::BATCHING_MODE_NONE:
       return std::make_unique<SinglePacketBatchWriter>();
@@ -166,10 +813,61 @@ std::unique_ptr<BatchWriter> BatchWriterFactory::makeBatchWriter(
     }
     case quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG:
       return std::make_unique<SendmmsgPacketBatchWriter>(batchSize);
+    case quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO: {
+      if (sock.getGSO() >= 0) {
+        return std::make_unique<SendmmsgGSOPacketBatchWriter>(batchSize);
+      }
+
+      return std::make_unique<SendmmsgPacketBatchWriter>(batchSize);
+    }
       // no default so we can catch missing case at compile time
   }
 
   folly::assume_unreachable();
 }
 
+ssize_t writeFromSource(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf,
+    const folly::Optional<folly::IPAddress>& source) {
+#ifdef __linux__
+  if (source) {
+    std::vector<struct iovec> iovecs;
+    iovecs.reserve(buf->countChainElements());
+    appendToIovecs(*buf, iovecs);
+    struct sockaddr_storage addr;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &addr;
+    msg.msg_namelen = address.getAddress(&addr);
+    msg.msg_iov = iovecs.data();
+    msg.msg_iovlen = iovecs.size();
+    char control[kPacketInfoSpace];
+    appendPacketInfo(msg, control, *source);
+    return ::sendmsg(sock.getNetworkSocket().toFd(), &msg, 0);
+  }
+#endif
+  return sock.write(address, buf);
+}
+
+bool setEcnMarking(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED sa_family_t family,
+    FOLLY_MAYBE_UNUSED EcnCodepoint ecn) {
+#ifdef __linux__
+  // The DSCP bits are left at zero.
+  int tos = static_cast<int>(ecn);
+  if (family == AF_INET6) {
+    // IPv4 mapped peers of a dual stack socket still use IP_TOS.
+    ::setsockopt(fd.toFd(), IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    return ::setsockopt(
+               fd.toFd(), IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)) == 0;
+  }
+  return ::setsockopt(fd.toFd(), IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == 0;
+#else
+  return false;
+#endif
+}
+
 } // namespace quic
@@ -8,13 +8,22 @@
 
 #pragma once
 
+#include <folly/Function.h>
 #include <folly/io/IOBuf.h>
 #include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/io/async/EventBase.h>
 #include <quic/QuicConstants.h>
+#include <quic/state/QuicTransportStatsCallback.h>
+
+#include <map>
 
 namespace quic {
+struct Pacer;
+
 class BatchWriter {
  public:
+  using FlushReason = QuicTransportStatsCallback::WriteBatchFlushReason;
+
   BatchWriter() = default;
   virtual ~BatchWriter() = default;
 
@@ -37,6 +46,14 @@ class BatchWriter {
   virtual ssize_t write(
       folly::AsyncUDPSocket& sock,
       const folly::SocketAddress& address) = 0;
+
+  // why the last append that returned true needs a flush
+  virtual FlushReason getAppendFlushReason() const;
+
+  // calls visitor with the number of segments of each GSO buffer the next
+  // write sends, packets sent on their own are not GSO buffers
+  virtual void visitGSOBuffers(
+      folly::FunctionRef<void(size_t numSegments)> visitor) const;
 };
 
 class IOBufBatchWriter : public BatchWriter {
@@ -79,14 +96,18 @@ class GSOPacketBatchWriter : public IOBufBatchWriter {
   ssize_t write(
       folly::AsyncUDPSocket& sock,
       const folly::SocketAddress& address) override;
+  FlushReason getAppendFlushReason() const override;
+  void visitGSOBuffers(
+      folly::FunctionRef<void(size_t numSegments)> visitor) const override;
 
- private:
+ protected:
   // max number of buffer chains we can accumulate before we need to flush
   size_t maxBufs_{1};
   // current number of buffer chains  appended the buf_
   size_t currBufs_{0};
   // size of the previous buffer chain appended to the buf_
   size_t prevSize_{0};
+  FlushReason flushReason_{FlushReason::MAX_BUFS};
 };
 
 class SendmmsgPacketBatchWriter : public BatchWriter {
@@ -113,12 +134,300 @@ class SendmmsgPacketBatchWriter : public BatchWriter {
   std::vector<std::unique_ptr<folly::IOBuf>> bufs_;
 };
 
+/**
+ * Groups consecutive packets of the same size into GSO buffers and sends all
+ * of them with a single sendmmsg call. Each GSO buffer ends at the first
+ * packet that is smaller than the ones before it, the next packet starts a
+ * new buffer. Without GSO every packet is a message of its own.
+ */
+class SendmmsgGSOPacketBatchWriter : public BatchWriter {
+ public:
+  explicit SendmmsgGSOPacketBatchWriter(size_t maxBufs, bool gsoEnabled = true);
+  ~SendmmsgGSOPacketBatchWriter() override = default;
+
+  /**
+   * Sends the packets from source, one of the addresses of a socket bound to
+   * the wildcard address.
+   */
+  void setSourceAddress(const folly::IPAddress& source) {
+    source_ = source;
+  }
+
+  bool empty() const override;
+
+  size_t size() const override;
+
+  void reset() override;
+  bool append(std::unique_ptr<folly::IOBuf>&& buf, size_t size) override;
+  ssize_t write(
+      folly::AsyncUDPSocket& sock,
+      const folly::SocketAddress& address) override;
+
+  // number of messages the next write will pass to sendmmsg
+  size_t numMessages() const {
+    return chains_.size();
+  }
+
+  void visitGSOBuffers(
+      folly::FunctionRef<void(size_t numSegments)> visitor) const override;
+
+ private:
+  struct GSOChain {
+    std::unique_ptr<folly::IOBuf> buf;
+    // size of every packet but the last one in the chain
+    size_t segmentSize{0};
+    size_t numSegments{0};
+    // set once a smaller packet ended the chain
+    bool closed{false};
+  };
+
+  // max number of packets we can accumulate before we need to flush
+  size_t maxBufs_{1};
+  bool gsoEnabled_{true};
+  // current number of packets in all the chains
+  size_t currBufs_{0};
+  // size of data in all the chains
+  size_t currSize_{0};
+  std::vector<GSOChain> chains_;
+  folly::Optional<folly::IPAddress> source_;
+};
+
+/**
+ * Collects the packets written by all the connections sharing a socket during
+ * an event loop iteration and sends them with as few sendmmsg calls as
+ * possible at the end of the iteration, or earlier once maxBatchSize packets
+ * are queued. Packets for other sockets are written right away, since their
+ * sockets could go away before the flush.
+ */
+class EgressBatcher : public folly::EventBase::LoopCallback {
+ public:
+  EgressBatcher(
+      folly::EventBase* evb,
+      folly::AsyncUDPSocket& sock,
+      size_t maxBatchSize);
+
+  ~EgressBatcher() override;
+
+  /**
+   * Queues the packet to be sent to address, from source if it is set.
+   * Returns the number of bytes accepted, or the result of the socket write
+   * when the packet cannot be batched.
+   */
+  ssize_t write(
+      folly::AsyncUDPSocket& sock,
+      const folly::SocketAddress& address,
+      std::unique_ptr<folly::IOBuf> buf,
+      const folly::Optional<folly::IPAddress>& source = folly::none);
+
+  /**
+   * Sends all the queued packets.
+   */
+  void flush();
+
+  size_t numQueuedPackets() const {
+    return packets_.size();
+  }
+
+  // folly::EventBase::LoopCallback
+  void runLoopCallback() noexcept override;
+
+ private:
+  struct QueuedPacket {
+    folly::SocketAddress address;
+    std::unique_ptr<folly::IOBuf> buf;
+    folly::Optional<folly::IPAddress> source;
+  };
+
+  folly::EventBase* evb_;
+  folly::AsyncUDPSocket& sock_;
+  size_t maxBatchSize_;
+  std::vector<QueuedPacket> packets_;
+};
+
+/**
+ * Hands every packet over to an EgressBatcher. The batcher takes care of the
+ * actual socket write.
+ */
+class EgressBatcherBatchWriter : public IOBufBatchWriter {
+ public:
+  explicit EgressBatcherBatchWriter(
+      EgressBatcher& batcher,
+      folly::Optional<folly::IPAddress> source = folly::none)
+      : batcher_(batcher), source_(std::move(source)) {}
+  ~EgressBatcherBatchWriter() override = default;
+
+  void reset() override;
+  bool append(std::unique_ptr<folly::IOBuf>&& buf, size_t /*unused*/) override;
+  ssize_t write(
+      folly::AsyncUDPSocket& sock,
+      const folly::SocketAddress& address) override;
+
+ private:
+  EgressBatcher& batcher_;
+  folly::Optional<folly::IPAddress> source_;
+};
+
+/**
+ * Sends packets with MSG_ZEROCOPY on a single socket. The kernel reads the
+ * packet memory after sendmsg returns, so every sent buffer is kept until the
+ * kernel reports its completion on the socket error queue. The error queue
+ * is drained by the sender itself before each write.
+ */
+class ZeroCopySender {
+ public:
+  explicit ZeroCopySender(folly::AsyncUDPSocket& sock);
+
+  /**
+   * Turns on SO_ZEROCOPY for fd. Returns false if the kernel does not support
+   * it.
+   */
+  static bool enableZeroCopy(folly::NetworkSocket fd);
+
+  /**
+   * Sends buf to address, as a GSO buffer of gso sized segments if gso is
+   * positive. Falls back to a regular copying write when sock is not the
+   * socket of the sender, zero copy is not available, or too many buffers
+   * are still waiting for their completion.
+   */
+  ssize_t write(
+      folly::AsyncUDPSocket& sock,
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf,
+      int gso);
+
+  /**
+   * Releases the buffers of all the sends the kernel has completed.
+   */
+  void reapCompletions();
+
+  /**
+   * Releases the buffers of the sends that cmsg, read from the error queue of
+   * the socket by someone else, reports as completed. Returns false if cmsg
+   * is not a zero copy completion.
+   */
+  bool onErrMessage(const cmsghdr& cmsg);
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  size_t numPendingBuffers() const {
+    return pending_.size();
+  }
+
+ private:
+  // releases the buffers of the sends with ids in [lo, hi]
+  void release(uint32_t lo, uint32_t hi);
+
+  folly::NetworkSocket fd_;
+  bool enabled_{false};
+  // id the kernel gives to the next successful zero copy send
+  uint32_t nextId_{0};
+  std::map<uint32_t, std::unique_ptr<folly::IOBuf>> pending_;
+};
+
+/**
+ * GSOPacketBatchWriter that sends through a ZeroCopySender.
+ */
+class ZeroCopyGSOPacketBatchWriter : public GSOPacketBatchWriter {
+ public:
+  ZeroCopyGSOPacketBatchWriter(size_t maxBufs, ZeroCopySender& sender)
+      : GSOPacketBatchWriter(maxBufs), sender_(sender) {}
+  ~ZeroCopyGSOPacketBatchWriter() override = default;
+
+  bool append(std::unique_ptr<folly::IOBuf>&& buf, size_t size) override;
+  ssize_t write(
+      folly::AsyncUDPSocket& sock,
+      const folly::SocketAddress& address) override;
+
+ private:
+  ZeroCopySender& sender_;
+};
+
+/**
+ * Sends the packets with one sendmmsg call, each stamped with the departure
+ * time the pacer gave it when it was appended. The kernel holds the packets
+ * back until then.
+ */
+class TxTimePacketBatchWriter : public BatchWriter {
+ public:
+  TxTimePacketBatchWriter(size_t maxBufs, Pacer& pacer);
+  ~TxTimePacketBatchWriter() override = default;
+
+  /**
+   * Turns on SO_TXTIME for fd, with the steady clock the pacer uses. Returns
+   * false if the kernel does not support it.
+   */
+  static bool enableTxTime(folly::NetworkSocket fd);
+
+  /**
+   * Sends the packets from source, one of the addresses of a socket bound to
+   * the wildcard address.
+   */
+  void setSourceAddress(const folly::IPAddress& source) {
+    source_ = source;
+  }
+
+  bool empty() const override;
+
+  size_t size() const override;
+
+  void reset() override;
+  bool append(std::unique_ptr<folly::IOBuf>&& buf, size_t size) override;
+  ssize_t write(
+      folly::AsyncUDPSocket& sock,
+      const folly::SocketAddress& address) override;
+
+ private:
+  Pacer& pacer_;
+  // max number of buffer chains we can accumulate before we need to flush
+  size_t maxBufs_{1};
+  // size of data in all the buffers
+  size_t currSize_{0};
+  std::vector<std::unique_ptr<folly::IOBuf>> bufs_;
+  std::vector<folly::Optional<TimePoint>> txTimes_;
+  folly::Optional<folly::IPAddress> source_;
+};
+
 class BatchWriterFactory {
  public:
+  /**
+   * If txTimePacer is set, the packets are stamped with their departure
+   * times. Otherwise, if egressBatcher is set the packets are handed to it
+   * and the batching mode is ignored. Otherwise, if sourceAddress is set, the
+   * packets are sent from it with sendmmsg, batched with GSO when the
+   * batching mode and the socket allow it. Otherwise, if zeroCopySender is
+   * set, the packets are batched with GSO when available and sent with
+   * MSG_ZEROCOPY.
+   */
   static std::unique_ptr<BatchWriter> makeBatchWriter(
       folly::AsyncUDPSocket& sock,
       const quic::QuicBatchingMode& batchingMode,
-      uint32_t batchSize);
+      uint32_t batchSize,
+      EgressBatcher* egressBatcher = nullptr,
+      ZeroCopySender* zeroCopySender = nullptr,
+      Pacer* txTimePacer = nullptr,
+      const folly::Optional<folly::IPAddress>& sourceAddress = folly::none);
 };
 
+/**
+ * Writes a single packet to address, from source if it is set, like
+ * sock.write otherwise.
+ */
+ssize_t writeFromSource(
+    folly::AsyncUDPSocket& sock,
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf,
+    const folly::Optional<folly::IPAddress>& source);
+
+/**
+ * Marks every packet sent on fd with the given ECN codepoint, by setting the
+ * ECN bits of IP_TOS or IPV6_TCLASS depending on the address family of the
+ * socket. Returns false if the option could not be set.
+ */
+bool setEcnMarking(
+    folly::NetworkSocket fd,
+    sa_family_t family,
+    EcnCodepoint ecn);
+
 } // namespace quic
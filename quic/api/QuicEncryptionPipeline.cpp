@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicEncryptionPipeline.h>
+
+#include <folly/system/ThreadName.h>
+#include <glog/logging.h>
+
+#include <functional>
+
+namespace quic {
+
+EncryptionPipeline::Lane::Lane(size_t ringSize)
+    : capacity_(ringSize),
+      batches_(ringSize + 1),
+      results_(ringSize + 1),
+      thread_([this] { run(); }) {
+  CHECK_GT(ringSize, 0);
+}
+
+EncryptionPipeline::Lane::~Lane() {
+  while (numPending_ > 0) {
+    try {
+      waitForOldest();
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "Encryption batch failed: " << ex.what();
+    }
+  }
+  stop_ = true;
+  batchesAvailable_.post();
+  thread_.join();
+}
+
+void EncryptionPipeline::Lane::submit(Batch&& batch) {
+  CHECK_LT(numPending_, capacity_);
+  CHECK(batches_.write(std::move(batch)));
+  numPending_++;
+  batchesAvailable_.post();
+}
+
+void EncryptionPipeline::Lane::waitForOldest() {
+  CHECK_GT(numPending_, 0);
+  resultsAvailable_.wait();
+  std::exception_ptr error;
+  CHECK(results_.read(error));
+  numPending_--;
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+void EncryptionPipeline::Lane::run() {
+  folly::setThreadName("QuicEncrypt");
+  while (true) {
+    batchesAvailable_.wait();
+    auto batch = batches_.frontPtr();
+    if (!batch) {
+      // Woken up to stop.
+      DCHECK(stop_);
+      return;
+    }
+    std::exception_ptr error;
+    try {
+      (*batch)();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    batches_.popFront();
+    // There is a result slot for every batch slot.
+    CHECK(results_.write(std::move(error)));
+    resultsAvailable_.post();
+  }
+}
+
+EncryptionPipeline::EncryptionPipeline(size_t numThreads, size_t ringSize) {
+  CHECK_GT(numThreads, 0);
+  for (size_t i = 0; i < numThreads; ++i) {
+    lanes_.push_back(std::make_unique<Lane>(ringSize));
+  }
+}
+
+EncryptionPipeline::Lane& EncryptionPipeline::getLane(const void* owner) {
+  return *lanes_[std::hash<const void*>()(owner) % lanes_.size()];
+}
+
+} // namespace quic
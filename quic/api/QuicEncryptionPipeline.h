@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/ProducerConsumerQueue.h>
+#include <folly/synchronization/LifoSem.h>
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace quic {
+
+/**
+ * Helper threads that encrypt the packets of the connections of a worker
+ * while the worker builds the next ones.
+ *
+ * Each thread has a lane: a ring of batches the worker submits and a ring of
+ * their results the worker takes back, both single producer and single
+ * consumer. A connection always uses the same lane, so its batches run one at
+ * a time and in order, which is what lets them use the connection's ciphers
+ * without locking: nothing but the lane may touch the ciphers until the
+ * worker took the results of all the batches it submitted.
+ */
+class EncryptionPipeline {
+ public:
+  using Batch = folly::Function<void()>;
+
+  class Lane {
+   public:
+    explicit Lane(size_t ringSize);
+    ~Lane();
+
+    /**
+     * Runs batch on the thread of the lane. There has to be room, see
+     * numPending.
+     */
+    void submit(Batch&& batch);
+
+    /**
+     * Blocks until the oldest batch submitted ran, and rethrows what it threw.
+     */
+    void waitForOldest();
+
+    /**
+     * The number of batches submitted whose results were not taken.
+     */
+    size_t numPending() const {
+      return numPending_;
+    }
+
+    size_t capacity() const {
+      return capacity_;
+    }
+
+   private:
+    void run();
+
+    // ProducerConsumerQueue keeps one slot empty.
+    size_t capacity_;
+    size_t numPending_{0};
+    std::atomic<bool> stop_{false};
+    folly::ProducerConsumerQueue<Batch> batches_;
+    folly::ProducerConsumerQueue<std::exception_ptr> results_;
+    folly::LifoSem batchesAvailable_;
+    folly::LifoSem resultsAvailable_;
+    std::thread thread_;
+  };
+
+  explicit EncryptionPipeline(size_t numThreads, size_t ringSize);
+
+  /**
+   * The lane of the connection owner.
+   */
+  Lane& getLane(const void* owner);
+
+  size_t numLanes() const {
+    return lanes_.size();
+  }
+
+ private:
+  std::vector<std::unique_ptr<Lane>> lanes_;
+};
+
+} // namespace quic
@@ -58,7 +58,13 @@ folly::Optional<PacketNum> AckScheduler::writeAcksImpl(
            ? std::chrono::duration_cast<std::chrono::microseconds>(
                  ackingTime - receivedTime)
            : 0us);
-  AckFrameMetaData meta(ackState_.acks, ackDelay, ackDelayExponentToUse);
+  AckFrameMetaData meta(
+      ackState_.acks,
+      ackDelay,
+      ackDelayExponentToUse,
+      &ackState_.ackBlocksCache,
+      conn_.transportSettings.maxAckBlocks,
+      &ackState_.ecnCounts);
   auto ackWriteResult = writeAckFrame(meta, builder);
   if (!ackWriteResult) {
     return folly::none;
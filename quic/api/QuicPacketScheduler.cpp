@@ -8,6 +8,10 @@
 
 #include <quic/api/QuicPacketScheduler.h>
 
+#include <folly/ScopeGuard.h>
+
+#include <algorithm>
+
 namespace quic {
 
 bool hasAcksToSchedule(const AckState& ackState) {
@@ -29,6 +33,21 @@ folly::Optional<PacketNum> largestAckToSend(const AckState& ackState) {
   return ackState.acks.back().end;
 }
 
+namespace {
+
+// The bytes the stream could write now, without the connection window.
+uint64_t getSendableBytes(const QuicStreamState& stream) {
+  uint64_t sendableLen = std::min<uint64_t>(
+      getSendStreamFlowControlBytesWire(stream),
+      stream.writeBuffer.chainLength());
+  if (stream.sendRateLimit) {
+    sendableLen = std::min(sendableLen, stream.sendRateLimit->tokens);
+  }
+  return sendableLen;
+}
+
+} // namespace
+
 // Schedulers
 
 FrameScheduler::Builder::Builder(
@@ -81,6 +100,16 @@ FrameScheduler::Builder& FrameScheduler::Builder::simpleFrames() {
   return *this;
 }
 
+FrameScheduler::Builder& FrameScheduler::Builder::datagramFrames() {
+  datagramFrameScheduler_ = true;
+  return *this;
+}
+
+FrameScheduler::Builder& FrameScheduler::Builder::repairFrames() {
+  repairFrameScheduler_ = true;
+  return *this;
+}
+
 FrameScheduler FrameScheduler::Builder::build() && {
   auto scheduler = FrameScheduler(name_);
   if (retransmissionScheduler_) {
@@ -109,6 +138,12 @@ FrameScheduler FrameScheduler::Builder::build() && {
   if (simpleFrameScheduler_) {
     scheduler.simpleFrameScheduler_.emplace(SimpleFrameScheduler(conn_));
   }
+  if (datagramFrameScheduler_) {
+    scheduler.datagramFrameScheduler_.emplace(DatagramFrameScheduler(conn_));
+  }
+  if (repairFrameScheduler_) {
+    scheduler.repairFrameScheduler_.emplace(RepairFrameScheduler(conn_));
+  }
   return scheduler;
 }
 
@@ -127,6 +162,7 @@ FrameScheduler::scheduleFramesForPacket(
   // We cannot return early if the writablyBytes dropps to 0 here, since pure
   // acks can skip writableBytes entirely.
   PacketBuilderWrapper wrapper(builder, writableBytes);
+  auto originalSpace = builder.remainingSpaceInPkt();
   auto ackMode = hasImmediateData() ? AckMode::Immediate : AckMode::Pending;
   bool cryptoDataWritten = false;
   bool rstWritten = false;
@@ -157,6 +193,17 @@ FrameScheduler::scheduleFramesForPacket(
   if (blockedScheduler_ && blockedScheduler_->hasPendingBlockedFrames()) {
     blockedScheduler_->writeBlockedFrames(wrapper);
   }
+  // Datagrams go ahead of the stream data, they are worthless once late.
+  if (datagramFrameScheduler_ &&
+      datagramFrameScheduler_->hasPendingDatagramFrames()) {
+    datagramFrameScheduler_->writeDatagramFrames(wrapper);
+  }
+  // Repair frames are only of use before the loss of what they protect is
+  // detected.
+  if (repairFrameScheduler_ &&
+      repairFrameScheduler_->hasPendingRepairFrames()) {
+    repairFrameScheduler_->writeRepairFrames(wrapper);
+  }
   if (retransmissionScheduler_ && retransmissionScheduler_->hasPendingData()) {
     retransmissionScheduler_->writeRetransmissionStreams(wrapper);
   }
@@ -167,6 +214,14 @@ FrameScheduler::scheduleFramesForPacket(
       simpleFrameScheduler_->hasPendingSimpleFrames()) {
     simpleFrameScheduler_->writeSimpleFrames(wrapper);
   }
+  // What is left does not fit, it goes into the next packet. Acks alone
+  // would not make the next packet full-size either.
+  if (builder.padsToFill() && builder.remainingSpaceInPkt() < originalSpace &&
+      wrapper.remainingSpaceInPkt() > 0 && hasImmediateData()) {
+    PaddingFrame paddingFrame;
+    paddingFrame.numFrames = wrapper.remainingSpaceInPkt();
+    writeFrame(std::move(paddingFrame), wrapper);
+  }
   return std::make_pair(folly::none, std::move(builder).buildPacket());
 }
 
@@ -185,7 +240,11 @@ bool FrameScheduler::hasImmediateData() const {
        windowUpdateScheduler_->hasPendingWindowUpdates()) ||
       (blockedScheduler_ && blockedScheduler_->hasPendingBlockedFrames()) ||
       (simpleFrameScheduler_ &&
-       simpleFrameScheduler_->hasPendingSimpleFrames());
+       simpleFrameScheduler_->hasPendingSimpleFrames()) ||
+      (datagramFrameScheduler_ &&
+       datagramFrameScheduler_->hasPendingDatagramFrames()) ||
+      (repairFrameScheduler_ &&
+       repairFrameScheduler_->hasPendingRepairFrames());
 }
 
 std::string FrameScheduler::name() const {
@@ -234,6 +293,17 @@ StreamFrameScheduler::StreamFrameScheduler(const QuicConnectionStateBase& conn)
 
 void StreamFrameScheduler::writeStreams(PacketBuilderInterface& builder) {
   uint64_t connWritableBytes = getSendConnFlowControlBytesWire(conn_);
+  switch (conn_.transportSettings.streamSchedulingPolicy) {
+    case StreamSchedulingPolicy::RoundRobin:
+      break;
+    case StreamSchedulingPolicy::StrictPriority:
+    case StreamSchedulingPolicy::Urgency:
+      writeStreamsByPriority(builder, connWritableBytes);
+      return;
+    case StreamSchedulingPolicy::WeightedRoundRobin:
+      writeStreamsByWeight(builder, connWritableBytes);
+      return;
+  }
   MiddleStartingIterationWrapper wrapper(
       conn_.streamManager->writableStreams(),
       conn_.schedulingState.lastScheduledStream);
@@ -252,49 +322,160 @@ bool StreamFrameScheduler::hasPendingData() const {
       getSendConnFlowControlBytesWire(conn_) > 0;
 }
 
-bool StreamFrameScheduler::writeNextStreamFrame(
+void StreamFrameScheduler::writeStreamsByPriority(
     PacketBuilderInterface& builder,
-    StreamFrameScheduler::WritableStreamItr& writableStreamItr,
-    uint64_t& connWritableBytes) {
-  if (builder.remainingSpaceInPkt() == 0) {
-    return false;
+    uint64_t connWritableBytes) {
+  if (connWritableBytes == 0) {
+    return;
+  }
+  bool byUrgency = conn_.transportSettings.streamSchedulingPolicy ==
+      StreamSchedulingPolicy::Urgency;
+  auto& schedulingState = conn_.schedulingState;
+  // The wrapper refers to the start, so only move it once done.
+  StreamId nextStream = schedulingState.lastScheduledStream;
+  SCOPE_EXIT {
+    schedulingState.lastScheduledStream = nextStream;
+  };
+  // Writes all the sendable data of the stream. Returns false once the
+  // packet or the connection window is full.
+  auto writeStream = [&](StreamId id, bool roundRobin) {
+    auto stream = conn_.streamManager->findStream(id);
+    CHECK(stream);
+    auto dataLen = writeStreamFrame(builder, *stream, connWritableBytes);
+    if (!dataLen) {
+      return false;
+    }
+    if (roundRobin) {
+      nextStream = id + 1;
+    }
+    connWritableBytes -= *dataLen;
+    return *dataLen == getSendableBytes(*stream) && connWritableBytes > 0;
+  };
+  for (uint8_t urgency = 0; urgency <= kMaxStreamUrgency; ++urgency) {
+    const auto& sequential =
+        conn_.streamManager->writableSequentialStreamsWithUrgency(urgency);
+    if (byUrgency) {
+      for (auto id : sequential) {
+        if (!writeStream(id, false)) {
+          return;
+        }
+      }
+    }
+    // Streams of the same urgency take turns, starting after the stream
+    // written last.
+    MiddleStartingIterationWrapper wrapper(
+        conn_.streamManager->writableStreamsWithUrgency(urgency),
+        schedulingState.lastScheduledStream);
+    for (auto itr = wrapper.cbegin(); itr != wrapper.cend(); ++itr) {
+      if (byUrgency && sequential.contains(*itr)) {
+        // Already written above.
+        continue;
+      }
+      if (!writeStream(*itr, true)) {
+        return;
+      }
+    }
   }
-  auto stream = conn_.streamManager->findStream(*writableStreamItr);
-  CHECK(stream);
+}
+
+void StreamFrameScheduler::writeStreamsByWeight(
+    PacketBuilderInterface& builder,
+    uint64_t connWritableBytes) {
+  auto& schedulingState = conn_.schedulingState;
+  MiddleStartingIterationWrapper wrapper(
+      conn_.streamManager->writableStreams(),
+      schedulingState.lastScheduledStream);
+  // The wrapper refers to the start, so only move it once done.
+  StreamId nextStream = schedulingState.lastScheduledStream;
+  for (auto itr = wrapper.cbegin(); itr != wrapper.cend(); ++itr) {
+    if (connWritableBytes == 0) {
+      break;
+    }
+    auto stream = conn_.streamManager->findStream(*itr);
+    CHECK(stream);
+    if (stream->schedulingDeficit == 0) {
+      // The stream's turn in a new round.
+      stream->schedulingDeficit =
+          stream->priority.weight * kStreamSchedulingQuantum;
+    }
+    auto dataLen = writeStreamFrame(
+        builder,
+        *stream,
+        std::min(connWritableBytes, stream->schedulingDeficit));
+    if (!dataLen) {
+      // Out of room in the packet, the stream goes on in the next one.
+      nextStream = stream->id;
+      break;
+    }
+    connWritableBytes -= *dataLen;
+    stream->schedulingDeficit -= *dataLen;
+    if (*dataLen == getSendableBytes(*stream)) {
+      // No more to write, so nothing to carry over to the next round.
+      stream->schedulingDeficit = 0;
+    } else if (stream->schedulingDeficit > 0) {
+      // Out of room in the packet, the stream goes on in the next one.
+      nextStream = stream->id;
+      break;
+    }
+    nextStream = stream->id + 1;
+  }
+  schedulingState.lastScheduledStream = nextStream;
+}
 
+folly::Optional<uint64_t> StreamFrameScheduler::writeStreamFrame(
+    PacketBuilderInterface& builder,
+    QuicStreamState& stream,
+    uint64_t maxBytes) {
+  if (builder.remainingSpaceInPkt() == 0) {
+    return folly::none;
+  }
   // hasWritableData is the condition which has to be satisfied for the
   // stream to be in writableList
-  DCHECK(stream->hasWritableData());
+  DCHECK(stream.hasWritableData());
 
   uint64_t flowControlLen =
-      std::min(getSendStreamFlowControlBytesWire(*stream), connWritableBytes);
-  uint64_t bufferLen = stream->writeBuffer.chainLength();
+      std::min(getSendStreamFlowControlBytesWire(stream), maxBytes);
+  if (stream.sendRateLimit) {
+    // New data waits for the tokens of the stream.
+    flowControlLen = std::min(flowControlLen, stream.sendRateLimit->tokens);
+  }
+  uint64_t bufferLen = stream.writeBuffer.chainLength();
   bool canWriteFin =
-      stream->finalWriteOffset.hasValue() && bufferLen <= flowControlLen;
+      stream.finalWriteOffset.hasValue() && bufferLen <= flowControlLen;
   auto dataLen = writeStreamFrameHeader(
       builder,
-      stream->id,
-      stream->currentWriteOffset,
+      stream.id,
+      stream.currentWriteOffset,
       bufferLen,
       flowControlLen,
       canWriteFin);
   if (!dataLen) {
-    return false;
+    return folly::none;
   }
-  writeStreamFrameData(builder, stream->writeBuffer, *dataLen);
-  VLOG(4) << "Wrote stream frame stream=" << stream->id
-          << " offset=" << stream->currentWriteOffset
+  writeStreamFrameData(builder, stream.writeBuffer, *dataLen);
+  VLOG(4) << "Wrote stream frame stream=" << stream.id
+          << " offset=" << stream.currentWriteOffset
           << " bytesWritten=" << *dataLen
           << " finWritten=" << (canWriteFin && *dataLen == bufferLen) << " "
           << conn_;
+  return dataLen;
+}
+
+bool StreamFrameScheduler::writeNextStreamFrame(
+    PacketBuilderInterface& builder,
+    StreamFrameScheduler::WritableStreamItr& writableStreamItr,
+    uint64_t& connWritableBytes) {
+  auto stream = conn_.streamManager->findStream(*writableStreamItr);
+  CHECK(stream);
+  auto dataLen = writeStreamFrame(builder, *stream, connWritableBytes);
+  if (!dataLen) {
+    return false;
+  }
   connWritableBytes -= dataLen.value();
-  // bytesWritten < min(flowControlBytes, writeBuffer) means that we haven't
-  // written all writable bytes in this stream due to running out of room in the
-  // packet.
-  if (*dataLen ==
-      std::min<uint64_t>(
-          getSendStreamFlowControlBytesWire(*stream),
-          stream->writeBuffer.chainLength())) {
+  // bytesWritten < min(flowControlBytes, writeBuffer, tokens) means that we
+  // haven't written all writable bytes in this stream due to running out of
+  // room in the packet.
+  if (*dataLen == getSendableBytes(*stream)) {
     ++writableStreamItr;
   }
   return true;
@@ -355,18 +536,64 @@ bool SimpleFrameScheduler::writeSimpleFrames(PacketBuilderInterface& builder) {
   return framesWritten;
 }
 
+DatagramFrameScheduler::DatagramFrameScheduler(
+    const QuicConnectionStateBase& conn)
+    : conn_(conn) {}
+
+bool DatagramFrameScheduler::hasPendingDatagramFrames() const {
+  return !conn_.datagramState.writeBuffer.empty();
+}
+
+bool DatagramFrameScheduler::writeDatagramFrames(
+    PacketBuilderInterface& builder) {
+  bool framesWritten = false;
+  for (const auto& datagram : conn_.datagramState.writeBuffer) {
+    auto bytesWritten = writeDatagramFrame(
+        datagram ? datagram->clone() : nullptr, builder);
+    if (!bytesWritten) {
+      break;
+    }
+    framesWritten = true;
+  }
+  return framesWritten;
+}
+
+RepairFrameScheduler::RepairFrameScheduler(
+    const QuicConnectionStateBase& conn)
+    : conn_(conn) {}
+
+bool RepairFrameScheduler::hasPendingRepairFrames() const {
+  return !conn_.fecState.pendingRepairs.empty();
+}
+
+bool RepairFrameScheduler::writeRepairFrames(PacketBuilderInterface& builder) {
+  bool framesWritten = false;
+  for (const auto& repairFrame : conn_.fecState.pendingRepairs) {
+    if (!writeRepairFrame(repairFrame, builder)) {
+      break;
+    }
+    framesWritten = true;
+  }
+  return framesWritten;
+}
+
 WindowUpdateScheduler::WindowUpdateScheduler(
     const QuicConnectionStateBase& conn)
     : conn_(conn) {}
 
 bool WindowUpdateScheduler::hasPendingWindowUpdates() const {
   return conn_.streamManager->hasWindowUpdates() ||
-      conn_.pendingEvents.connWindowUpdate;
+      conn_.pendingEvents.connWindowUpdate ||
+      conn_.streamManager->hasStreamLimitUpdates();
 }
 
 void WindowUpdateScheduler::writeWindowUpdates(
     PacketBuilderInterface& builder) {
-  if (conn_.pendingEvents.connWindowUpdate) {
+  // The connection window update saves a packet of its own later on when it
+  // leaves with the stream updates.
+  if (conn_.pendingEvents.connWindowUpdate ||
+      (conn_.streamManager->hasWindowUpdates() &&
+       shouldPiggybackConnWindowUpdate(conn_))) {
     auto maxDataFrame = generateMaxDataFrame(conn_);
     auto maximumData = maxDataFrame.maximumData;
     auto bytes = writeFrame(std::move(maxDataFrame), builder);
@@ -388,6 +615,18 @@ void WindowUpdateScheduler::writeWindowUpdates(
     VLOG(4) << "Wrote max_stream_data stream=" << stream->id
             << " maximumData=" << maximumData << " " << conn_;
   }
+  for (bool bidirectional : {true, false}) {
+    auto maxStreamsFrame =
+        conn_.streamManager->streamLimitUpdate(bidirectional);
+    if (!maxStreamsFrame) {
+      continue;
+    }
+    auto maxStreams = maxStreamsFrame->maxStreams;
+    if (writeFrame(std::move(*maxStreamsFrame), builder)) {
+      VLOG(4) << "Wrote max_streams=" << maxStreams
+              << " bidirectional=" << bidirectional << " " << conn_;
+    }
+  }
 }
 
 BlockedScheduler::BlockedScheduler(const QuicConnectionStateBase& conn)
@@ -517,34 +756,30 @@ CloningScheduler::scheduleFramesForPacket(
     return frameScheduler_.scheduleFramesForPacket(
         std::move(builder), writableBytes);
   }
+  auto builderPnSpace = folly::variant_match(
+      builder.getPacketHeader(),
+      [](const auto& h) { return h.getPacketNumberSpace(); });
+  if (builderPnSpace != PacketNumberSpace::AppData) {
+    // Only AppData packets are cloned, and a clone has to be sent in the same
+    // packet number space.
+    return std::make_pair(folly::none, folly::none);
+  }
   // Look for an outstanding packet that's no larger than the writableBytes
   for (auto iter = conn_.outstandingPackets.rbegin();
        iter != conn_.outstandingPackets.rend();
        ++iter) {
+    // Check the cheap conditions first, so that packets which can't be cloned
+    // don't cost a packet builder each.
     auto opPnSpace = folly::variant_match(
         iter->packet.header,
         [](const auto& h) { return h.getPacketNumberSpace(); });
     if (opPnSpace != PacketNumberSpace::AppData) {
       continue;
     }
-    // Reusing the RegularQuicPacketBuilder throughout loop bodies will lead to
-    // frames belong to different original packets being written into the same
-    // clone packet. So re-create a RegularQuicPacketBuilder every time.
-    // TODO: We can avoid the copy & rebuild of the header by creating an
-    // independent header builder.
-    auto builderPnSpace = folly::variant_match(
-        builder.getPacketHeader(),
-        [](const auto& h) { return h.getPacketNumberSpace(); });
-    CHECK_EQ(builderPnSpace, PacketNumberSpace::AppData);
-    RegularQuicPacketBuilder regularBuilder(
-        conn_.udpSendPacketLen,
-        builder.getPacketHeader(),
-        getAckState(conn_, builderPnSpace).largestAckedByPeer,
-        conn_.version.value_or(*conn_.originalVersion));
-    PacketRebuilder rebuilder(regularBuilder, conn_);
     // We shouldn't clone Handshake packet. For PureAcks, cloning them bring
-    // perf down as shown by load test.
-    if (iter->isHandshake || iter->pureAck) {
+    // perf down as shown by load test. Path MTU probes are larger than the
+    // packets the clone would go into.
+    if (iter->isHandshake || iter->pureAck || iter->isPathMtuProbe) {
       continue;
     }
     // If the packet is already a clone that has been processed, we don't clone
@@ -561,6 +796,18 @@ CloningScheduler::scheduleFramesForPacket(
       continue;
     }
 
+    // Reusing the RegularQuicPacketBuilder throughout loop bodies will lead to
+    // frames belong to different original packets being written into the same
+    // clone packet. So re-create a RegularQuicPacketBuilder every time.
+    // TODO: We can avoid the copy & rebuild of the header by creating an
+    // independent header builder.
+    RegularQuicPacketBuilder regularBuilder(
+        conn_.udpSendPacketLen,
+        builder.getPacketHeader(),
+        getAckState(conn_, builderPnSpace).largestAckedByPeer,
+        conn_.version.value_or(*conn_.originalVersion));
+    PacketRebuilder rebuilder(regularBuilder, conn_);
+
     // Rebuilder will write the rest of frames
     auto rebuildResult = rebuilder.rebuildFromPacket(*iter);
     if (rebuildResult) {
@@ -17,6 +17,7 @@
 #include <quic/codec/Types.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/state/QuicStreamFunctions.h>
+#include <quic/state/StreamIdSet.h>
 
 namespace quic {
 
@@ -87,13 +88,14 @@ class StreamFrameScheduler {
    */
   class MiddleStartingIterationWrapper {
    public:
-    using MapType = std::set<StreamId>;
+    using MapType = StreamIdSet;
 
     class MiddleStartingIterator
         : public boost::iterator_facade<
               MiddleStartingIterator,
               const MiddleStartingIterationWrapper::MapType::value_type,
-              boost::forward_traversal_tag> {
+              boost::forward_traversal_tag,
+              MiddleStartingIterationWrapper::MapType::value_type> {
       friend class boost::iterator_core_access;
 
      public:
@@ -106,10 +108,15 @@ class StreamFrameScheduler {
           const MapType::key_type& start)
           : streams_(streams) {
         itr_ = streams_->lower_bound(start);
-        checkForWrapAround();
+        if (itr_ == streams_->cend()) {
+          // Nothing from start onwards, so begin with the smallest id. Only an
+          // empty set begins wrapped around, at its end.
+          itr_ = streams_->cbegin();
+          wrappedAround_ = streams_->empty();
+        }
       }
 
-      const MapType::value_type& dereference() const {
+      MapType::value_type dereference() const {
         return *itr_;
       }
 
@@ -172,6 +179,32 @@ class StreamFrameScheduler {
       WritableStreamItr& writableStreamItr,
       uint64_t& connWritableBytes);
 
+  /**
+   * Writes the streams in the order of their priority, for the
+   * StrictPriority and Urgency policies.
+   */
+  void writeStreamsByPriority(
+      PacketBuilderInterface& builder,
+      uint64_t connWritableBytes);
+
+  /**
+   * Writes the streams with deficit round-robin over their weights.
+   */
+  void writeStreamsByWeight(
+      PacketBuilderInterface& builder,
+      uint64_t connWritableBytes);
+
+  /**
+   * Writes a frame with at most maxBytes of data of the stream.
+   *
+   * Return: the number of bytes written, or none if there was no room for
+   *   the frame.
+   */
+  folly::Optional<uint64_t> writeStreamFrame(
+      PacketBuilderInterface& builder,
+      QuicStreamState& stream,
+      uint64_t maxBytes);
+
   const QuicConnectionStateBase& conn_;
 };
 
@@ -241,6 +274,38 @@ class SimpleFrameScheduler {
   const QuicConnectionStateBase& conn_;
 };
 
+/*
+ * Writes the queued DATAGRAM frames, oldest first. Their buffers are cloned
+ * into the packet, and the queue is only popped once the packet is sent.
+ */
+class DatagramFrameScheduler {
+ public:
+  explicit DatagramFrameScheduler(const QuicConnectionStateBase& conn);
+
+  bool hasPendingDatagramFrames() const;
+
+  bool writeDatagramFrames(PacketBuilderInterface& builder);
+
+ private:
+  const QuicConnectionStateBase& conn_;
+};
+
+/*
+ * Writes the queued REPAIR frames, oldest first. Like datagrams, they are
+ * only popped once the packet is sent.
+ */
+class RepairFrameScheduler {
+ public:
+  explicit RepairFrameScheduler(const QuicConnectionStateBase& conn);
+
+  bool hasPendingRepairFrames() const;
+
+  bool writeRepairFrames(PacketBuilderInterface& builder);
+
+ private:
+  const QuicConnectionStateBase& conn_;
+};
+
 class WindowUpdateScheduler {
  public:
   explicit WindowUpdateScheduler(const QuicConnectionStateBase& conn);
@@ -319,6 +384,8 @@ class FrameScheduler : public QuicPacketScheduler {
     Builder& blockedFrames();
     Builder& cryptoFrames();
     Builder& simpleFrames();
+    Builder& datagramFrames();
+    Builder& repairFrames();
 
     FrameScheduler build() &&;
 
@@ -337,6 +404,8 @@ class FrameScheduler : public QuicPacketScheduler {
     bool blockedScheduler_{false};
     bool cryptoStreamScheduler_{false};
     bool simpleFrameScheduler_{false};
+    bool datagramFrameScheduler_{false};
+    bool repairFrameScheduler_{false};
   };
 
   explicit FrameScheduler(const std::string& name);
@@ -365,6 +434,8 @@ class FrameScheduler : public QuicPacketScheduler {
   folly::Optional<BlockedScheduler> blockedScheduler_;
   folly::Optional<CryptoStreamScheduler> cryptoStreamScheduler_;
   folly::Optional<SimpleFrameScheduler> simpleFrameScheduler_;
+  folly::Optional<DatagramFrameScheduler> datagramFrameScheduler_;
+  folly::Optional<RepairFrameScheduler> repairFrameScheduler_;
   std::string name_;
 };
 
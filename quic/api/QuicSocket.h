@@ -14,6 +14,7 @@
 #include <quic/QuicConstants.h>
 #include <quic/codec/Types.h>
 #include <quic/state/StateData.h>
+#include <quic/state/TransportMetricsHistory.h>
 
 #include <chrono>
 
@@ -93,10 +94,13 @@ class QuicSocket {
     std::chrono::microseconds mrtt{0us};
     uint64_t writableBytes{0};
     uint64_t congestionWindow{0};
+    // see ConnectionMetrics::deliveryRate
+    uint64_t deliveryRate{0};
     uint64_t pacingBurstSize{0};
     std::chrono::microseconds pacingInterval{0us};
     uint32_t packetsRetransmitted{0};
     uint32_t timeoutBasedLoss{0};
+    uint32_t spuriousLoss{0};
     std::chrono::microseconds pto{0us};
     uint64_t bytesSent{0};
     uint64_t bytesAcked{0};
@@ -106,6 +110,18 @@ class QuicSocket {
     uint32_t totalPTOCount{0};
     PacketNum largestPacketAckedByPeer{0};
     PacketNum largestPacketSent{0};
+    uint64_t udpSendPacketLen{0};
+    uint32_t pathMtuProbesSent{0};
+    uint32_t pathMtuBlackHoles{0};
+    ConnectionMemoryUsage memoryUsage;
+    // only counted with TransportSettings::cpuAccounting
+    ConnectionCpuUsage cpuUsage;
+    // only counted with TransportSettings::allocationAccounting
+    ConnectionAllocationUsage allocationUsage;
+    // only counted with TransportSettings::trackDeliveryLatency
+    DeliveryLatency deliveryLatency;
+    // see QuicConnectionStateBase::totalAmplificationBlockedTime
+    std::chrono::microseconds amplificationBlockedTime{0us};
   };
 
   /**
@@ -121,6 +137,9 @@ class QuicSocket {
 
     // Is the stream head-of-line blocked?
     bool isHolb{false};
+
+    // only counted with TransportSettings::trackDeliveryLatency
+    DeliveryLatency deliveryLatency;
   };
 
   /**
@@ -359,6 +378,22 @@ class QuicSocket {
 
   virtual const TransportSettings& getTransportSettings() const = 0;
 
+  /**
+   * Switches the connection to a congestion controller of the type. Once
+   * the connection has been acked, the new controller starts with the cwnd
+   * and the bytes in flight of the old one. The RTT estimates belong to the
+   * connection, and carry over as they are.
+   */
+  virtual void setCongestionControl(CongestionControlType type) = 0;
+
+  /**
+   * Sets the rate of the StaticRate congestion controller, in bytes per
+   * second, from the next packet sent on. The cap of a connection can also
+   * be set before it starts, with staticRateBytesPerSec in its transport
+   * settings.
+   */
+  virtual void setStaticSendRate(uint64_t bytesPerSec) = 0;
+
   /**
    * Is partial reliability supported.
    */
@@ -390,6 +425,23 @@ class QuicSocket {
             error) noexcept = 0;
   };
 
+  /**
+   * A read callback in push mode. Rather than being told with readAvailable()
+   * that there is data and later calling read(), it is handed the data of
+   * its stream as soon as the stream is readable, together with whether it
+   * reached EOF. Flow control is updated as the data is handed over, as if
+   * it was read. Pausing the callback stops the data until it is resumed,
+   * and readError() is called as for any other read callback.
+   */
+  class StreamDataCallback : public ReadCallback {
+   public:
+    ~StreamDataCallback() override = default;
+
+    void readAvailable(StreamId /* id */) noexcept final {}
+
+    virtual void onStreamData(StreamId id, Buf data, bool eof) noexcept = 0;
+  };
+
   /**
    * Set the read callback for the given stream.  Note that read callback is
    * expected to be set all the time. Removing read callback indicates that
@@ -399,6 +451,38 @@ class QuicSocket {
       StreamId id,
       ReadCallback* cb) = 0;
 
+  /**
+   * Callback for the readiness of many streams at once, for applications
+   * with so many streams that a call per stream adds up.
+   */
+  class StreamsReadyCallback {
+   public:
+    virtual ~StreamsReadyCallback() = default;
+
+    /**
+     * Called once per read loop with the streams that readAvailable() of
+     * their read callback would have been called for otherwise. The read
+     * callbacks still have to be set, and paused ones are left out.
+     */
+    virtual void readAvailable(
+        folly::Range<const StreamId*> streamIds) noexcept = 0;
+
+    /**
+     * Called with the streams waiting on notifyPendingWriteOnStream() that
+     * became writable together, because connection flow control opened up.
+     * They are no longer pending, and onStreamWriteReady() of their write
+     * callback is not called.
+     */
+    virtual void writeReady(
+        folly::Range<const StreamId*> streamIds) noexcept = 0;
+  };
+
+  /**
+   * Sets a callback that the readiness of the streams is batched into, or
+   * nullptr to go back to the callbacks of each stream.
+   */
+  virtual void setStreamsReadyCallback(StreamsReadyCallback* callback) = 0;
+
   /**
    * Convenience function that sets the read callbacks of all streams to be
    * nullptr.
@@ -464,6 +548,25 @@ class QuicSocket {
       StreamId id,
       size_t maxLen) = 0;
 
+  struct StreamReadData {
+    StreamId id;
+    Buf data;
+    bool eof;
+  };
+
+  /**
+   * Reads all the readable streams that have a read callback which is not
+   * paused, up to maxLen bytes from each, in one call. If maxLen is 0, all
+   * the available bytes are returned. Like read(), the data of a stream is
+   * the chain of the buffers it was received in, without any copy, so that
+   * it can be written out to another socket as is.
+   *
+   * The streams that have an error are left to readError() of their read
+   * callback.
+   */
+  virtual folly::Expected<std::vector<StreamReadData>, LocalErrorCode>
+  readAll(size_t maxLen) = 0;
+
   /**
    * ===== Peek/Consume API =====
    */
@@ -487,7 +590,7 @@ class QuicSocket {
    * };
    */
 
-  using PeekIterator = std::deque<StreamBuffer>::const_iterator;
+  using PeekIterator = StreamBufferList::const_iterator;
   class PeekCallback {
    public:
     virtual ~PeekCallback() = default;
@@ -621,6 +724,20 @@ class QuicSocket {
   virtual folly::Expected<folly::Optional<uint64_t>, LocalErrorCode>
   sendDataRejected(StreamId id, uint64_t offset) = 0;
 
+  /**
+   * Expire the data written on the stream from now on once it is older than
+   * expiry, as if sendDataExpired had been called with its end offset, unless
+   * it was all acked by then. The expired data of all the streams is skipped
+   * at the next write, with one ExpiredStreamDataFrame per stream. Stale
+   * media can then be dropped without the app keeping a timer per stream.
+   *
+   * Passing folly::none stops expiring the data written afterwards, the data
+   * already written still expires.
+   */
+  virtual folly::Expected<folly::Unit, LocalErrorCode> setStreamDataExpiry(
+      StreamId id,
+      folly::Optional<std::chrono::milliseconds> expiry) = 0;
+
   /**
    * ===== Write API =====
    */
@@ -785,6 +902,127 @@ class QuicSocket {
       bool cork,
       DeliveryCallback* cb = nullptr) = 0;
 
+  /**
+   * Write length bytes of the file fd from offset to the given stream, then
+   * the eof if set. Instead of the whole file being buffered, it is read
+   * into the write buffer of the stream at most
+   * TransportSettings::fileWriteChunkSize bytes at a time, as flow control
+   * and the send buffer space make room, so that many large files can be
+   * sent at once in bounded memory.
+   *
+   * The caller keeps ownership of fd, which has to stay open until the
+   * delivery callback is called or the stream is reset. No other write is
+   * accepted on the stream until the file is read. If reading the file
+   * fails, the stream is reset.
+   */
+  virtual folly::Expected<folly::Unit, LocalErrorCode> writeFile(
+      StreamId id,
+      int fd,
+      uint64_t offset,
+      uint64_t length,
+      bool eof,
+      DeliveryCallback* cb = nullptr) = 0;
+
+  /**
+   * Writes are not sent when they are made, but once per loop by the write
+   * looper, so that the writes to all the streams in a loop go out together
+   * in full packets. This sends what is buffered now instead, for the writes
+   * that cannot wait for the end of the loop. Pacing still applies.
+   */
+  virtual folly::Expected<folly::Unit, LocalErrorCode> flushWrites() = 0;
+
+  /**
+   * ===== Datagram API =====
+   *
+   * Unreliable DATAGRAM frames (RFC 9221). Datagrams are only received if
+   * TransportSettings::maxDatagramFrameSize is advertised, and only sent if
+   * the peer advertised the same.
+   */
+
+  class DatagramCallback {
+   public:
+    virtual ~DatagramCallback() = default;
+
+    /**
+     * Called after a read loop that received datagrams, which are waiting
+     * in readDatagrams().
+     */
+    virtual void onDatagramsAvailable() noexcept = 0;
+  };
+
+  /**
+   * Sets the callback to be told of received datagrams, nullptr to unset
+   * it.
+   */
+  virtual void setDatagramCallback(DatagramCallback* cb) = 0;
+
+  /**
+   * Largest datagram that writeDatagram() accepts, 0 if the peer does not
+   * accept datagrams.
+   */
+  virtual uint64_t getDatagramSizeLimit() const = 0;
+
+  /**
+   * Queues a datagram to be sent in a DATAGRAM frame of its own. The buffer
+   * goes into the packet as is, without being copied. Datagrams are never
+   * retransmitted, and once TransportSettings::datagramWriteBufferSize of
+   * them wait to be sent, the oldest is dropped.
+   */
+  virtual folly::Expected<folly::Unit, LocalErrorCode> writeDatagram(
+      Buf buf) = 0;
+
+  /**
+   * Returns the received datagrams, oldest first, at most atMost of them
+   * unless it is 0.
+   */
+  virtual folly::Expected<std::vector<Buf>, LocalErrorCode> readDatagrams(
+      size_t atMost = 0) = 0;
+
+  /**
+   * ===== Metrics API =====
+   *
+   * The estimates of the path that the transport keeps anyway, pushed to the
+   * application as they change, so that it can adapt its send rate, e.g. the
+   * bitrate of a video, without polling getTransportInfo().
+   */
+
+  struct ConnectionMetrics {
+    // The bandwidth estimate of the congestion controller if it has one,
+    // otherwise the congestion window per smoothed rtt, in bytes per second
+    uint64_t deliveryRate{0};
+    std::chrono::microseconds minRtt{0us};
+    std::chrono::microseconds srtt{0us};
+    uint64_t congestionWindow{0};
+    uint64_t bytesInFlight{0};
+  };
+
+  class MetricsCallback {
+   public:
+    virtual ~MetricsCallback() = default;
+
+    virtual void onMetrics(const ConnectionMetrics& metrics) noexcept = 0;
+  };
+
+  /**
+   * Sets the callback to be given the metrics of the connection, nullptr to
+   * unset it. The metrics are checked after each read loop, as only acks
+   * move them, and reported on the first check, then once interval has
+   * passed since the last report, or once the delivery rate or the srtt
+   * moved by more than the fraction changeThreshold from it. Either of the
+   * two triggers is off when it is 0.
+   */
+  virtual void setMetricsCallback(
+      MetricsCallback* cb,
+      std::chrono::milliseconds interval,
+      double changeThreshold = 0) = 0;
+
+  /**
+   * The last samples of the metrics, oldest first, kept with
+   * TransportSettings::metricsHistorySize. The history is also given to the
+   * stats callback when the connection closes.
+   */
+  virtual std::vector<TransportMetricsSample> getMetricsHistory() const = 0;
+
   /**
    * Register a callback to be invoked when the peer has acknowledged the
    * given offset on the given stream
@@ -843,6 +1081,18 @@ class QuicSocket {
       PingCallback* callback,
       std::chrono::milliseconds pingTimeout) = 0;
 
+  /**
+   * Ask the peer to ack every packetTolerance retransmittable packets, or
+   * after maxAckDelay, whichever comes first. If ignoreOrder is set the peer
+   * does not ack out of order packets immediately. A new request replaces
+   * the previous one. Fails with INVALID_OPERATION if the peer does not
+   * support ACK_FREQUENCY frames.
+   */
+  virtual folly::Expected<folly::Unit, LocalErrorCode> requestAckFrequency(
+      uint64_t packetTolerance,
+      std::chrono::microseconds maxAckDelay,
+      bool ignoreOrder) = 0;
+
   /**
    * Get information on the state of the quic connection. Should only be used
    * for logging.
@@ -883,5 +1133,25 @@ class QuicSocket {
    * createStream() or receiving onNewBidirectionalStream()
    */
   virtual folly::Optional<LocalErrorCode> setControlStream(StreamId id) = 0;
+
+  /**
+   * Set the scheduling priority of a stream. How the priority is used depends
+   * on TransportSettings::streamSchedulingPolicy: streams with a lower urgency
+   * are written first, incremental streams of the same urgency take turns,
+   * and weights set the share of each stream with weighted round-robin.
+   */
+  virtual folly::Optional<LocalErrorCode> setStreamPriority(
+      StreamId id,
+      StreamPriority priority) = 0;
+
+  /**
+   * Limit the rate at which the stream writes new data to bytesPerSec, in
+   * bursts of at most burstBytes, whatever the congestion window allows.
+   * Retransmissions are not limited. A rate of 0 removes the limit.
+   */
+  virtual folly::Optional<LocalErrorCode> setStreamSendRateLimit(
+      StreamId id,
+      uint64_t bytesPerSec,
+      uint64_t burstBytes = kDefaultStreamSendRateBurstBytes) = 0;
 };
 } // namespace quic
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicSocketTimestamps.h>
+
+#include <folly/net/NetOps.h>
+#include <quic/state/StateData.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace quic {
+
+namespace {
+// Batches whose timestamps did not come back, because the device does not
+// report them or the error queue overflowed, are forgotten after this many.
+constexpr size_t kMaxPendingTxTimestamps = 1024;
+constexpr std::chrono::seconds kMaxKernelTimestampAge{1};
+} // namespace
+
+bool enableRxTimestamps(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED bool hardware) {
+#ifdef __linux__
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (hardware) {
+    flags |= SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+  }
+  return folly::netops::setsockopt(
+             fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#else
+  return false;
+#endif
+}
+
+folly::Optional<TimePoint> kernelTimeToTimePoint(
+    const struct timespec& kernelTime,
+    TimePoint now,
+    std::chrono::system_clock::time_point realNow) {
+  if (kernelTime.tv_sec == 0 && kernelTime.tv_nsec == 0) {
+    return folly::none;
+  }
+  auto sinceEpoch = std::chrono::seconds(kernelTime.tv_sec) +
+      std::chrono::nanoseconds(kernelTime.tv_nsec);
+  auto age = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 realNow.time_since_epoch()) -
+      sinceEpoch;
+  if (age < std::chrono::nanoseconds::zero() || age > kMaxKernelTimestampAge) {
+    return folly::none;
+  }
+  return now - std::chrono::duration_cast<TimePoint::duration>(age);
+}
+
+folly::Optional<TimePoint> parseKernelTimestamp(
+    FOLLY_MAYBE_UNUSED const struct cmsghdr& cmsg) {
+#ifdef __linux__
+  if (cmsg.cmsg_level != SOL_SOCKET || cmsg.cmsg_type != SCM_TIMESTAMPING) {
+    return folly::none;
+  }
+  struct scm_timestamping timestamps;
+  memcpy(&timestamps, CMSG_DATA(&cmsg), sizeof(timestamps));
+  auto now = Clock::now();
+  auto realNow = std::chrono::system_clock::now();
+  // ts[0] is the software timestamp and ts[2] the raw hardware one.
+  if (auto hardwareTime =
+          kernelTimeToTimePoint(timestamps.ts[2], now, realNow)) {
+    return hardwareTime;
+  }
+  return kernelTimeToTimePoint(timestamps.ts[0], now, realNow);
+#else
+  return folly::none;
+#endif
+}
+
+folly::Optional<TimePoint> getLastReceiveTime(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED struct timespec& lastKernelTime) {
+#if defined(__linux__) && defined(SIOCGSTAMPNS)
+  // The first call turns the timestamps on, and fails.
+  struct timespec kernelTime;
+  if (::ioctl(fd.toFd(), SIOCGSTAMPNS, &kernelTime) != 0 ||
+      (kernelTime.tv_sec == lastKernelTime.tv_sec &&
+       kernelTime.tv_nsec == lastKernelTime.tv_nsec)) {
+    return folly::none;
+  }
+  lastKernelTime = kernelTime;
+  return kernelTimeToTimePoint(
+      kernelTime, Clock::now(), std::chrono::system_clock::now());
+#else
+  return folly::none;
+#endif
+}
+
+TxTimestamper::TxTimestamper(folly::AsyncUDPSocket& sock, bool hardware)
+    : fd_(sock.getNetworkSocket()),
+      enabled_(enableTxTimestamps(fd_, hardware)),
+      lastWriteTime_(Clock::now()) {}
+
+bool TxTimestamper::enableTxTimestamps(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED bool hardware) {
+#ifdef __linux__
+  // Only the timestamps and the id come back, not the packet.
+  int flags = SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+  if (hardware) {
+    flags |= SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+  } else {
+    flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  }
+  return folly::netops::setsockopt(
+             fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#else
+  return false;
+#endif
+}
+
+void TxTimestamper::onBatchWritten(TimePoint writeTime) {
+  if (!enabled_) {
+    return;
+  }
+  pending_.push_back(SentBatch{nextId_++, lastWriteTime_, writeTime});
+  lastWriteTime_ = writeTime;
+  if (pending_.size() > kMaxPendingTxTimestamps) {
+    pending_.pop_front();
+  }
+}
+
+bool TxTimestamper::onErrMessage(
+    FOLLY_MAYBE_UNUSED QuicConnectionStateBase& conn,
+    FOLLY_MAYBE_UNUSED const struct cmsghdr& cmsg) {
+#ifdef __linux__
+  if (cmsg.cmsg_level == SOL_SOCKET && cmsg.cmsg_type == SCM_TIMESTAMPING) {
+    reportedTime_ = parseKernelTimestamp(cmsg);
+    return true;
+  }
+  if ((cmsg.cmsg_level != SOL_IP || cmsg.cmsg_type != IP_RECVERR) &&
+      (cmsg.cmsg_level != SOL_IPV6 || cmsg.cmsg_type != IPV6_RECVERR)) {
+    return false;
+  }
+  const auto serr =
+      reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(&cmsg));
+  if (serr->ee_errno != ENOMSG ||
+      serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+    return false;
+  }
+  auto sentTime = std::move(reportedTime_);
+  reportedTime_ = folly::none;
+  if (serr->ee_info == SCM_TSTAMP_SND && sentTime) {
+    onTimestamp(conn, serr->ee_data, *sentTime);
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void TxTimestamper::reapTimestamps(
+    FOLLY_MAYBE_UNUSED QuicConnectionStateBase& conn) {
+#ifdef __linux__
+  if (!enabled_) {
+    return;
+  }
+  // Room for the timestamps and a sock_extended_err with the offender
+  // address.
+  char control[256];
+  while (true) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(fd_.toFd(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      return;
+    }
+    for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      onErrMessage(conn, *cm);
+    }
+  }
+#endif
+}
+
+void TxTimestamper::onTimestamp(
+    QuicConnectionStateBase& conn,
+    uint32_t id,
+    TimePoint sentTime) {
+  // The batches before it will not get a timestamp anymore. The ids wrap
+  // around.
+  while (!pending_.empty() &&
+         static_cast<int32_t>(id - pending_.front().id) > 0) {
+    pending_.pop_front();
+  }
+  if (pending_.empty() || pending_.front().id != id) {
+    return;
+  }
+  auto batch = pending_.front();
+  pending_.pop_front();
+  for (auto it = conn.outstandingPackets.rbegin();
+       it != conn.outstandingPackets.rend() && it->time > batch.after;
+       ++it) {
+    // The packet waited in user space, or in the qdisc, for this long.
+    if (it->time <= batch.upTo && it->time < sentTime) {
+      it->time = sentTime;
+    }
+  }
+}
+
+} // namespace quic
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/net/NetworkSocket.h>
+#include <folly/portability/Sockets.h>
+#include <quic/QuicConstants.h>
+
+#include <chrono>
+#include <ctime>
+#include <deque>
+
+namespace quic {
+
+struct QuicConnectionStateBase;
+
+/**
+ * Turns on SO_TIMESTAMPING receive timestamps for fd, read from the
+ * SCM_TIMESTAMPING ancillary data of each datagram. hardware asks for the NIC
+ * timestamps too, which are used when the device has them. Returns false if
+ * the platform or the kernel does not support it.
+ */
+bool enableRxTimestamps(folly::NetworkSocket fd, bool hardware);
+
+/**
+ * Converts a CLOCK_REALTIME time of the kernel to a TimePoint, given the time
+ * of both clocks now. None if it is in the future or older than a second,
+ * as raw hardware timestamps are not necessarily on CLOCK_REALTIME.
+ */
+folly::Optional<TimePoint> kernelTimeToTimePoint(
+    const struct timespec& kernelTime,
+    TimePoint now,
+    std::chrono::system_clock::time_point realNow);
+
+/**
+ * The time of an SCM_TIMESTAMPING control message: the hardware timestamp
+ * if there is a plausible one, otherwise the software one.
+ */
+folly::Optional<TimePoint> parseKernelTimestamp(const struct cmsghdr& cmsg);
+
+/**
+ * The kernel receive time of the last datagram read from fd, with
+ * SIOCGSTAMPNS, for sockets that are read without ancillary data. Only
+ * software timestamps are available this way, and none at all once the
+ * socket reports software timestamps with SO_TIMESTAMPING. lastKernelTime
+ * is the time this returned before, so that a time the kernel did not
+ * update is not returned twice.
+ */
+folly::Optional<TimePoint> getLastReceiveTime(
+    folly::NetworkSocket fd,
+    struct timespec& lastKernelTime);
+
+/**
+ * Moves the send times of the outstanding packets of a connection to the
+ * times the kernel handed them to the device, or the NIC sent them with
+ * hardware timestamps. The kernel gives every send call on the socket the
+ * next id, so the socket must only be written to by this connection, one
+ * batch per send call. The timestamps come on the error queue of the
+ * socket, as a SCM_TIMESTAMPING message followed by the sock_extended_err
+ * with the id.
+ */
+class TxTimestamper {
+ public:
+  TxTimestamper(folly::AsyncUDPSocket& sock, bool hardware);
+
+  /**
+   * Turns on the SO_TIMESTAMPING send timestamps of fd, with the ids of
+   * their send calls. Returns false if the platform or the kernel does not
+   * support it.
+   */
+  static bool enableTxTimestamps(folly::NetworkSocket fd, bool hardware);
+
+  bool enabled() const {
+    return enabled_;
+  }
+
+  /**
+   * Called right after a batch was passed to the kernel. The batch is made of
+   * the packets sent since the previous one.
+   */
+  void onBatchWritten(TimePoint writeTime);
+
+  /**
+   * Handles a control message of the error queue, for sockets whose error
+   * queue is read by the AsyncUDPSocket. The timestamps are applied to the
+   * outstanding packets of conn. Returns false for the messages that are not
+   * about timestamps.
+   */
+  bool onErrMessage(QuicConnectionStateBase& conn, const struct cmsghdr& cmsg);
+
+  /**
+   * Reads the error queue of the socket until it is empty, for sockets
+   * whose error queue nobody else reads.
+   */
+  void reapTimestamps(QuicConnectionStateBase& conn);
+
+  size_t numPendingBatches() const {
+    return pending_.size();
+  }
+
+ private:
+  struct SentBatch {
+    uint32_t id;
+    // The packets of the batch were sent in (after, upTo].
+    TimePoint after;
+    TimePoint upTo;
+  };
+
+  void onTimestamp(
+      QuicConnectionStateBase& conn,
+      uint32_t id,
+      TimePoint sentTime);
+
+  folly::NetworkSocket fd_;
+  bool enabled_{false};
+  // id the kernel gives to the next send call
+  uint32_t nextId_{0};
+  TimePoint lastWriteTime_;
+  // Of the SCM_TIMESTAMPING message waiting for its id
+  folly::Optional<TimePoint> reportedTime_;
+  std::deque<SentBatch> pending_;
+};
+
+} // namespace quic
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicStreamAwaiter.h>
+
+#include <algorithm>
+
+namespace quic {
+
+QuicStreamAwaiter::QuicStreamAwaiter(QuicSocket& sock, StreamId id)
+    : sock_(sock), id_(id) {}
+
+QuicStreamAwaiter::~QuicStreamAwaiter() {
+  DCHECK(!writeContinuation_) << "destroyed with a pending write";
+  DCHECK(!deliveryContinuation_) << "destroyed with a pending delivery";
+  if (readCallbackSet_) {
+    sock_.setReadCallback(id_, nullptr);
+  }
+}
+
+void QuicStreamAwaiter::read(size_t maxLen, ReadContinuation cont) {
+  DCHECK(!readContinuation_);
+  readContinuation_ = std::move(cont);
+  readMaxLen_ = maxLen;
+  if (!readCallbackSet_) {
+    auto result = sock_.setReadCallback(id_, this);
+    if (result.hasError()) {
+      finishRead(folly::makeUnexpected(QuicErrorCode(result.error())));
+      return;
+    }
+    readCallbackSet_ = true;
+  } else {
+    sock_.resumeRead(id_);
+  }
+  // The data may have arrived while no read was pending.
+  tryRead();
+}
+
+void QuicStreamAwaiter::tryRead() {
+  auto result = sock_.read(id_, readMaxLen_);
+  if (result.hasError()) {
+    finishRead(folly::makeUnexpected(QuicErrorCode(result.error())));
+    return;
+  }
+  auto& data = result.value().first;
+  bool eof = result.value().second;
+  if ((!data || data->empty()) && !eof) {
+    // Nothing yet, wait for readAvailable.
+    return;
+  }
+  finishRead(std::move(result.value()));
+}
+
+void QuicStreamAwaiter::finishRead(ReadResult result) {
+  auto cont = std::move(readContinuation_);
+  readContinuation_ = nullptr;
+  if (readCallbackSet_) {
+    // Resumed by the next read.
+    sock_.pauseRead(id_);
+  }
+  cont(std::move(result));
+}
+
+void QuicStreamAwaiter::readAvailable(StreamId /* id */) noexcept {
+  if (readContinuation_) {
+    tryRead();
+  }
+}
+
+void QuicStreamAwaiter::readError(
+    StreamId /* id */,
+    std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+        error) noexcept {
+  if (readContinuation_) {
+    finishRead(folly::makeUnexpected(std::move(error.first)));
+  }
+}
+
+void QuicStreamAwaiter::write(Buf data, bool eof, Continuation cont) {
+  DCHECK(!writeContinuation_);
+  writeContinuation_ = std::move(cont);
+  pendingWrite_.append(std::move(data));
+  pendingEof_ = eof;
+  auto result = sock_.notifyPendingWriteOnStream(id_, this);
+  if (result.hasError()) {
+    pendingWrite_.move();
+    finishWrite(folly::makeUnexpected(QuicErrorCode(result.error())));
+  }
+}
+
+void QuicStreamAwaiter::onStreamWriteReady(
+    StreamId /* id */,
+    uint64_t maxToSend) noexcept {
+  if (!writeContinuation_) {
+    return;
+  }
+  auto len = std::min<uint64_t>(maxToSend, pendingWrite_.chainLength());
+  auto data = pendingWrite_.splitAtMost(len);
+  bool done = pendingWrite_.empty();
+  auto result =
+      sock_.writeChain(id_, std::move(data), done && pendingEof_, false);
+  if (result.hasError()) {
+    pendingWrite_.move();
+    finishWrite(folly::makeUnexpected(QuicErrorCode(result.error())));
+    return;
+  }
+  if (result.value()) {
+    // The transport did not take all of it, the rest goes first next time.
+    auto rest = pendingWrite_.move();
+    pendingWrite_.append(std::move(result.value()));
+    pendingWrite_.append(std::move(rest));
+    done = false;
+  }
+  if (done) {
+    finishWrite(folly::unit);
+    return;
+  }
+  auto notifyResult = sock_.notifyPendingWriteOnStream(id_, this);
+  if (notifyResult.hasError()) {
+    pendingWrite_.move();
+    finishWrite(folly::makeUnexpected(QuicErrorCode(notifyResult.error())));
+  }
+}
+
+void QuicStreamAwaiter::onStreamWriteError(
+    StreamId /* id */,
+    std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+        error) noexcept {
+  if (writeContinuation_) {
+    pendingWrite_.move();
+    finishWrite(folly::makeUnexpected(std::move(error.first)));
+  }
+}
+
+void QuicStreamAwaiter::finishWrite(
+    folly::Expected<folly::Unit, QuicErrorCode> result) {
+  auto cont = std::move(writeContinuation_);
+  writeContinuation_ = nullptr;
+  cont(std::move(result));
+}
+
+void QuicStreamAwaiter::waitForDelivery(uint64_t offset, Continuation cont) {
+  DCHECK(!deliveryContinuation_);
+  deliveryContinuation_ = std::move(cont);
+  auto result = sock_.registerDeliveryCallback(id_, offset, this);
+  if (result.hasError()) {
+    finishDelivery(folly::makeUnexpected(QuicErrorCode(result.error())));
+  }
+}
+
+void QuicStreamAwaiter::onDeliveryAck(
+    StreamId /* id */,
+    uint64_t /* offset */,
+    std::chrono::microseconds /* rtt */) {
+  if (deliveryContinuation_) {
+    finishDelivery(folly::unit);
+  }
+}
+
+void QuicStreamAwaiter::onCanceled(StreamId /* id */, uint64_t /* offset */) {
+  if (deliveryContinuation_) {
+    finishDelivery(
+        folly::makeUnexpected(QuicErrorCode(LocalErrorCode::STREAM_CLOSED)));
+  }
+}
+
+void QuicStreamAwaiter::finishDelivery(
+    folly::Expected<folly::Unit, QuicErrorCode> result) {
+  auto cont = std::move(deliveryContinuation_);
+  deliveryContinuation_ = nullptr;
+  cont(std::move(result));
+}
+
+} // namespace quic
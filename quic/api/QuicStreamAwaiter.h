@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Expected.h>
+#include <folly/Function.h>
+#include <folly/io/IOBufQueue.h>
+#include <quic/api/QuicSocket.h>
+
+namespace quic {
+
+/**
+ * Turns the read, write and delivery callbacks of a stream into one shot
+ * operations that invoke a continuation once they complete, for apps that
+ * suspend a coroutine or a fiber on each operation. The adapter is its own
+ * read, write and delivery callback and keeps a single continuation of each
+ * kind, so an operation does not allocate as long as its continuation fits
+ * the inline storage of folly::Function, as a coroutine handle or a small
+ * lambda does.
+ *
+ * At most one read, one write and one wait for delivery can be pending at a
+ * time. Continuations are invoked on the event base of the socket and may
+ * start the next operation. The adapter has to outlive its pending writes
+ * and waits for delivery, which can only be ended by resetting the stream
+ * or closing the socket.
+ */
+class QuicStreamAwaiter : private QuicSocket::ReadCallback,
+                          private QuicSocket::WriteCallback,
+                          private QuicSocket::DeliveryCallback {
+ public:
+  using ReadResult = folly::Expected<std::pair<Buf, bool>, QuicErrorCode>;
+  using ReadContinuation = folly::Function<void(ReadResult)>;
+  using Continuation =
+      folly::Function<void(folly::Expected<folly::Unit, QuicErrorCode>)>;
+
+  QuicStreamAwaiter(QuicSocket& sock, StreamId id);
+
+  ~QuicStreamAwaiter() override;
+
+  QuicStreamAwaiter(const QuicStreamAwaiter&) = delete;
+  QuicStreamAwaiter& operator=(const QuicStreamAwaiter&) = delete;
+
+  StreamId getStreamId() const {
+    return id_;
+  }
+
+  /**
+   * Reads up to maxLen bytes, as QuicSocket::read does, once there is data
+   * or the EOF to read. Reading is paused while no read is pending.
+   */
+  void read(size_t maxLen, ReadContinuation cont);
+
+  /**
+   * Writes data and eof as the flow control and the buffer space of the
+   * transport allow, a chunk each time the stream is ready for writing.
+   * Completes once all of it was handed to the transport.
+   */
+  void write(Buf data, bool eof, Continuation cont);
+
+  /**
+   * Completes once the peer acked offset, as with a DeliveryCallback, or with
+   * an error once it never will.
+   */
+  void waitForDelivery(uint64_t offset, Continuation cont);
+
+  bool readPending() const {
+    return static_cast<bool>(readContinuation_);
+  }
+
+  bool writePending() const {
+    return static_cast<bool>(writeContinuation_);
+  }
+
+  bool deliveryPending() const {
+    return static_cast<bool>(deliveryContinuation_);
+  }
+
+ private:
+  // ReadCallback
+  void readAvailable(StreamId id) noexcept override;
+  void readError(
+      StreamId id,
+      std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+          error) noexcept override;
+
+  // WriteCallback
+  void onStreamWriteReady(StreamId id, uint64_t maxToSend) noexcept override;
+  void onStreamWriteError(
+      StreamId id,
+      std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+          error) noexcept override;
+
+  // DeliveryCallback
+  void onDeliveryAck(
+      StreamId id,
+      uint64_t offset,
+      std::chrono::microseconds rtt) override;
+  void onCanceled(StreamId id, uint64_t offset) override;
+
+  void tryRead();
+  void finishRead(ReadResult result);
+  void finishWrite(folly::Expected<folly::Unit, QuicErrorCode> result);
+  void finishDelivery(folly::Expected<folly::Unit, QuicErrorCode> result);
+
+  QuicSocket& sock_;
+  const StreamId id_;
+  bool readCallbackSet_{false};
+  size_t readMaxLen_{0};
+  ReadContinuation readContinuation_;
+  // The data of the pending write that was not handed to the transport yet.
+  folly::IOBufQueue pendingWrite_{folly::IOBufQueue::cacheChainLength()};
+  bool pendingEof_{false};
+  Continuation writeContinuation_;
+  Continuation deliveryContinuation_;
+};
+
+} // namespace quic
@@ -8,13 +8,20 @@
 
 #include <quic/api/QuicTransportBase.h>
 
+#include <folly/FileUtil.h>
 #include <folly/ScopeGuard.h>
 #include <quic/api/LoopDetectorCallback.h>
 #include <quic/api/QuicTransportFunctions.h>
+#include <quic/common/LoopTime.h>
 #include <quic/common/TimeUtil.h>
 #include <quic/congestion_control/Pacer.h>
 #include <quic/logging/QLoggerConstants.h>
 #include <quic/loss/QuicLossFunctions.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/CpuAccounting.h>
+#include <quic/state/DatagramHandlers.h>
+#include <quic/state/KeyUpdate.h>
+#include <quic/state/QPRFunctions.h>
 #include <quic/state/QuicPacingFunctions.h>
 #include <quic/state/QuicStateFunctions.h>
 #include <quic/state/QuicStreamFunctions.h>
@@ -22,6 +29,8 @@
 #include <quic/state/SimpleFrameFunctions.h>
 #include <quic/state/stream/StreamStateMachine.h>
 
+#include <cmath>
+
 namespace quic {
 
 QuicTransportBase::QuicTransportBase(
@@ -32,6 +41,7 @@ QuicTransportBase::QuicTransportBase(
       lossTimeout_(this),
       ackTimeout_(this),
       pathValidationTimeout_(this),
+      streamRateLimitTimeout_(this),
       idleTimeout_(this),
       drainTimeout_(this),
       readLooper_(new FunctionLooper(
@@ -62,12 +72,107 @@ void QuicTransportBase::setPacingTimer(
   }
 }
 
+void QuicTransportBase::setPacingScheduler(
+    PacingScheduler::SharedPtr pacingScheduler) noexcept {
+  writeLooper_->setPacingScheduler(std::move(pacingScheduler));
+}
+
+void QuicTransportBase::setLoopHealthMonitor(
+    LoopHealthMonitor::SharedPtr loopHealthMonitor) noexcept {
+  loopHealthMonitor_ = std::move(loopHealthMonitor);
+}
+
+void QuicTransportBase::submitWrite(
+    StreamId id,
+    Buf data,
+    bool eof,
+    DeliveryCallback* cb) {
+  Submission submission;
+  submission.type = Submission::Type::Write;
+  submission.id = id;
+  submission.data = std::move(data);
+  submission.eof = eof;
+  submission.deliveryCallback = cb;
+  enqueueSubmission(std::move(submission));
+}
+
+void QuicTransportBase::submitCreateStream(
+    bool bidirectional,
+    SubmittedStreamCallback cb) {
+  Submission submission;
+  submission.type = Submission::Type::CreateStream;
+  submission.bidirectional = bidirectional;
+  submission.streamCallback = std::move(cb);
+  enqueueSubmission(std::move(submission));
+}
+
+void QuicTransportBase::submitClose(
+    folly::Optional<std::pair<QuicErrorCode, std::string>> error) {
+  Submission submission;
+  submission.type = Submission::Type::Close;
+  submission.closeError = std::move(error);
+  enqueueSubmission(std::move(submission));
+}
+
+void QuicTransportBase::enqueueSubmission(Submission submission) {
+  submissions_.enqueue(std::move(submission));
+  if (submissionsScheduled_.exchange(true)) {
+    // Picked up by the callback already scheduled.
+    return;
+  }
+  getEventBase()->runInEventBaseThread(
+      [self = sharedGuard()] { self->applySubmissions(); });
+}
+
+void QuicTransportBase::applySubmissions() noexcept {
+  DCHECK(getEventBase()->isInEventBaseThread());
+  // Cleared first, a call queued after the last dequeue below schedules
+  // another run.
+  submissionsScheduled_.store(false);
+  Submission submission;
+  while (submissions_.try_dequeue(submission)) {
+    switch (submission.type) {
+      case Submission::Type::Write: {
+        auto result = writeChain(
+            submission.id,
+            std::move(submission.data),
+            submission.eof,
+            false,
+            submission.deliveryCallback);
+        if (result.hasError()) {
+          VLOG(4) << "Submitted write failed streamId=" << submission.id
+                  << " error=" << toString(result.error()) << " " << *this;
+        }
+        break;
+      }
+      case Submission::Type::CreateStream: {
+        auto streamId = submission.bidirectional
+            ? createBidirectionalStream()
+            : createUnidirectionalStream();
+        if (submission.streamCallback) {
+          submission.streamCallback(std::move(streamId));
+        }
+        break;
+      }
+      case Submission::Type::Close:
+        close(std::move(submission.closeError));
+        break;
+    }
+  }
+}
+
 void QuicTransportBase::setCongestionControllerFactory(
     std::shared_ptr<CongestionControllerFactory> ccFactory) {
   CHECK(ccFactory);
   ccFactory_ = ccFactory;
 }
 
+void QuicTransportBase::setCongestionControlPolicy(
+    std::shared_ptr<CongestionControlPolicy> policy) {
+  ccPolicy_ = std::move(policy);
+  lastCongestionControlPolicyTime_ = folly::none;
+}
+
 folly::EventBase* QuicTransportBase::getEventBase() const {
   return evb_.load();
 }
@@ -250,6 +355,11 @@ void QuicTransportBase::closeImpl(
         totalCryptoDataRecvd);
   }
 
+  if (!metricsHistory_.empty()) {
+    QUIC_STATS(
+        conn_->infoCallback, onMetricsHistory, metricsHistory_.samples());
+  }
+
   // TODO: truncate the error code string to be 1MSS only.
   closeState_ = CloseState::CLOSED;
   updatePacingOnClose(*conn_);
@@ -315,6 +425,9 @@ void QuicTransportBase::closeImpl(
   if (pathValidationTimeout_.isScheduled()) {
     pathValidationTimeout_.cancelTimeout();
   }
+  if (streamRateLimitTimeout_.isScheduled()) {
+    streamRateLimitTimeout_.cancelTimeout();
+  }
   if (idleTimeout_.isScheduled()) {
     idleTimeout_.cancelTimeout();
   }
@@ -331,11 +444,11 @@ void QuicTransportBase::closeImpl(
 
   // Clear out all the streams, we don't need them any more. When the peer
   // receives the conn close they will implicitly reset all the streams.
-  QUIC_STATS_FOR_EACH(
-      conn_->streamManager->streams().cbegin(),
-      conn_->streamManager->streams().cend(),
-      conn_->infoCallback,
-      onQuicStreamClosed);
+  if (conn_->infoCallback) {
+    conn_->streamManager->streamStateForEach([&](QuicStreamState&) {
+      QUIC_STATS(conn_->infoCallback, onQuicStreamClosed);
+    });
+  }
   conn_->streamManager->clearOpenStreams();
 
   // Clear out all the pending events.
@@ -474,14 +587,33 @@ QuicTransportBase::getStreamWriteBufferedBytes(StreamId id) const {
  * client proposed ciphers, etc.
  */
 
+namespace {
+// The bandwidth estimate of the controller, or the window per srtt.
+uint64_t getDeliveryRate(
+    const CongestionController& controller,
+    uint64_t congestionWindow,
+    std::chrono::microseconds srtt) {
+  auto deliveryRate = controller.getBandwidthEstimate();
+  if (deliveryRate == 0 && srtt.count() > 0) {
+    deliveryRate = congestionWindow *
+        std::chrono::microseconds(std::chrono::seconds(1)).count() /
+        srtt.count();
+  }
+  return deliveryRate;
+}
+} // namespace
+
 QuicSocket::TransportInfo QuicTransportBase::getTransportInfo() const {
   uint64_t writableBytes = std::numeric_limits<uint64_t>::max();
   uint64_t congestionWindow = std::numeric_limits<uint64_t>::max();
+  uint64_t deliveryRate = 0;
   uint64_t burstSize = 0;
   std::chrono::microseconds pacingInterval = 0ms;
   if (conn_->congestionController) {
     writableBytes = conn_->congestionController->getWritableBytes();
     congestionWindow = conn_->congestionController->getCongestionWindow();
+    deliveryRate = getDeliveryRate(
+        *conn_->congestionController, congestionWindow, conn_->lossState.srtt);
     if (isConnectionPaced(*conn_)) {
       burstSize = conn_->pacer->getCachedWriteBatchSize();
       pacingInterval = conn_->pacer->getTimeUntilNextWrite();
@@ -494,10 +626,12 @@ QuicSocket::TransportInfo QuicTransportBase::getTransportInfo() const {
   transportInfo.mrtt = conn_->lossState.mrtt;
   transportInfo.writableBytes = writableBytes;
   transportInfo.congestionWindow = congestionWindow;
+  transportInfo.deliveryRate = deliveryRate;
   transportInfo.pacingBurstSize = burstSize;
   transportInfo.pacingInterval = pacingInterval;
   transportInfo.packetsRetransmitted = conn_->lossState.rtxCount;
   transportInfo.timeoutBasedLoss = conn_->lossState.timeoutBasedRtxCount;
+  transportInfo.spuriousLoss = conn_->lossState.spuriousLossCount;
   transportInfo.totalBytesRetransmitted =
       conn_->lossState.totalBytesRetransmitted;
   transportInfo.pto = calculatePTO(*conn_);
@@ -509,9 +643,22 @@ QuicSocket::TransportInfo QuicTransportBase::getTransportInfo() const {
   transportInfo.largestPacketAckedByPeer =
       conn_->ackStates.appDataAckState.largestAckedByPeer;
   transportInfo.largestPacketSent = conn_->lossState.largestSent;
+  transportInfo.udpSendPacketLen = conn_->udpSendPacketLen;
+  transportInfo.pathMtuProbesSent = conn_->pathMtuState.probesSent;
+  transportInfo.pathMtuBlackHoles = conn_->pathMtuState.blackHoles;
+  transportInfo.memoryUsage = getMemoryUsage();
+  transportInfo.cpuUsage = conn_->cpuUsage;
+  transportInfo.allocationUsage = conn_->allocationUsage;
+  transportInfo.deliveryLatency = conn_->deliveryLatency;
+  transportInfo.amplificationBlockedTime =
+      conn_->totalAmplificationBlockedTime;
   return transportInfo;
 }
 
+ConnectionMemoryUsage QuicTransportBase::getMemoryUsage() const {
+  return getConnectionMemoryUsage(*conn_);
+}
+
 folly::Optional<std::string> QuicTransportBase::getAppProtocol() const {
   return conn_->handshakeLayer->getApplicationProtocol();
 }
@@ -606,6 +753,11 @@ folly::Expected<folly::Unit, LocalErrorCode> QuicTransportBase::setReadCallback(
   return setReadCallbackInternal(id, cb);
 }
 
+void QuicTransportBase::setStreamsReadyCallback(
+    StreamsReadyCallback* callback) {
+  streamsReadyCallback_ = callback;
+}
+
 void QuicTransportBase::unsetAllReadCallbacks() {
   for (auto& streamCallbackPair : readCallbacks_) {
     setReadCallbackInternal(streamCallbackPair.first, nullptr);
@@ -619,9 +771,15 @@ void QuicTransportBase::unsetAllPeekCallbacks() {
 }
 
 void QuicTransportBase::unsetAllDeliveryCallbacks() {
-  auto deliveryCallbacksCopy = deliveryCallbacks_;
-  for (auto& streamCallbackPair : deliveryCallbacksCopy) {
-    cancelDeliveryCallbacksForStream(streamCallbackPair.first);
+  // Cancelling the callbacks of a stream erases them, only the stream ids
+  // are copied rather than all the callbacks.
+  std::vector<StreamId> streamIds;
+  streamIds.reserve(deliveryCallbacks_.size());
+  for (const auto& streamCallbackPair : deliveryCallbacks_) {
+    streamIds.push_back(streamCallbackPair.first);
+  }
+  for (auto streamId : streamIds) {
+    cancelDeliveryCallbacksForStream(streamId);
   }
 }
 
@@ -645,6 +803,7 @@ QuicTransportBase::setReadCallbackInternal(
     return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
   } else {
     readCb = cb;
+    readCbIt->second.streamDataCb = dynamic_cast<StreamDataCallback*>(cb);
     if (readCb == nullptr) {
       return stopSending(id, GenericApplicationErrorCode::NO_ERROR);
     }
@@ -712,6 +871,7 @@ void QuicTransportBase::invokeReadDataAndCallbacks() {
     self->updateWriteLooper(true);
   };
   auto readableListCopy = self->conn_->streamManager->readableStreams();
+  std::vector<StreamId> readyStreams;
   for (const auto& streamId : readableListCopy) {
     auto callback = self->readCallbacks_.find(streamId);
     if (callback == self->readCallbacks_.end()) {
@@ -737,11 +897,35 @@ void QuicTransportBase::invokeReadDataAndCallbacks() {
           streamId, std::make_pair(*stream->streamReadError, folly::none));
     } else if (
         readCb && callback->second.resumed && stream->hasReadableData()) {
+      if (auto streamDataCb = callback->second.streamDataCb) {
+        // Push mode, read all of the data on behalf of the callback.
+        auto result = self->read(streamId, 0);
+        if (result.hasError()) {
+          // The read closed the transport.
+          return;
+        }
+        VLOG(10) << "pushing stream data to read callback on stream="
+                 << streamId << " eof=" << result->second << " " << *this;
+        streamDataCb->onStreamData(
+            streamId, std::move(result->first), result->second);
+        continue;
+      }
+      if (streamsReadyCallback_) {
+        readyStreams.push_back(streamId);
+        continue;
+      }
       VLOG(10) << "invoking read callbacks on stream=" << streamId << " "
                << *this;
       readCb->readAvailable(streamId);
     }
   }
+  if (!readyStreams.empty() && streamsReadyCallback_ &&
+      closeState_ == CloseState::OPEN) {
+    VLOG(10) << "invoking read callbacks on streams=" << readyStreams.size()
+             << " " << *this;
+    streamsReadyCallback_->readAvailable(folly::Range<const StreamId*>(
+        readyStreams.data(), readyStreams.size()));
+  }
 }
 
 void QuicTransportBase::updateReadLooper() {
@@ -1066,6 +1250,43 @@ QuicTransportBase::sendDataRejected(StreamId id, uint64_t offset) {
   return folly::makeExpected<LocalErrorCode>(newOffset);
 }
 
+folly::Expected<folly::Unit, LocalErrorCode>
+QuicTransportBase::setStreamDataExpiry(
+    StreamId id,
+    folly::Optional<std::chrono::milliseconds> expiry) {
+  if (!conn_->partialReliabilityEnabled) {
+    return folly::makeUnexpected(LocalErrorCode::APP_ERROR);
+  }
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  if (isReceivingStream(conn_->nodeType, id)) {
+    return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+  }
+  auto stream = conn_->streamManager->getStream(id);
+  if (!stream) {
+    return folly::makeUnexpected(LocalErrorCode::STREAM_NOT_EXISTS);
+  }
+  if (!stream->dataExpiry) {
+    if (!expiry) {
+      return folly::unit;
+    }
+    stream->dataExpiry = std::make_unique<QuicStreamState::DataExpiryState>();
+  }
+  stream->dataExpiry->expiry = expiry;
+  return folly::unit;
+}
+
+void QuicTransportBase::expireStreamData() {
+  if (!conn_->partialReliabilityEnabled ||
+      conn_->streamManager->expiringStreams().empty()) {
+    return;
+  }
+  for (const auto& expired : quic::expireStreamData(*conn_, LoopTime::now())) {
+    cancelDeliveryCallbacksForStream(expired.first, expired.second);
+  }
+}
+
 void QuicTransportBase::updatePeekLooper() {
   if (closeState_ != CloseState::OPEN) {
     VLOG(10) << "Stopping peek looper " << *this;
@@ -1110,6 +1331,12 @@ void QuicTransportBase::updateWriteLooper(bool thisIteration) {
     writeLooper_->stop();
     return;
   }
+  // Once the write is scheduled for this loop, the calls that add data to it
+  // need not look at the connection again, the write looper does when it
+  // runs and stops itself if there is nothing to write.
+  if (thisIteration && writeLooper_->isLoopCallbackScheduled()) {
+    return;
+  }
   // TODO: Also listens to write event from libevent. Only schedule write when
   // the socket itself is writable.
   auto writeDataReason = shouldWriteData(*conn_);
@@ -1118,12 +1345,16 @@ void QuicTransportBase::updateWriteLooper(bool thisIteration) {
              << " running write looper thisIteration=" << thisIteration << " "
              << *this;
     writeLooper_->run(thisIteration);
+    if (loopHealthMonitor_ && !writeReadyTime_) {
+      writeReadyTime_ = Clock::now();
+    }
     conn_->debugState.needsWriteLoopDetect =
         (conn_->loopDetectorCallback != nullptr);
   } else {
     VLOG(10) << nodeToString(conn_->nodeType) << " stopping write looper "
              << *this;
     writeLooper_->stop();
+    writeReadyTime_ = folly::none;
     conn_->debugState.needsWriteLoopDetect = false;
     conn_->debugState.currentEmptyLoopCount = 0;
   }
@@ -1254,6 +1485,61 @@ folly::Expected<std::pair<Buf, bool>, LocalErrorCode> QuicTransportBase::read(
   }
 }
 
+folly::Expected<std::vector<QuicSocket::StreamReadData>, LocalErrorCode>
+QuicTransportBase::readAll(size_t maxLen) {
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  SCOPE_EXIT {
+    checkForClosedStream();
+    updateReadLooper();
+    updatePeekLooper(); // read can affect "peek" API
+    updateWriteLooper(true);
+  };
+  std::vector<StreamReadData> streamsData;
+  try {
+    // Reading the streams takes them out of the readable ones.
+    auto readableListCopy = conn_->streamManager->readableStreams();
+    for (const auto& streamId : readableListCopy) {
+      auto callback = readCallbacks_.find(streamId);
+      if (callback == readCallbacks_.end() || !callback->second.readCb ||
+          !callback->second.resumed) {
+        continue;
+      }
+      auto stream = conn_->streamManager->getStream(streamId);
+      if (!stream || stream->streamReadError || !stream->hasReadableData()) {
+        continue;
+      }
+      auto result = readDataFromQuicStream(*stream, maxLen);
+      if (result.second) {
+        VLOG(10) << "Delivered eof to app for stream=" << stream->id << " "
+                 << *this;
+        callback->second.deliveredEOM = true;
+      }
+      streamsData.push_back(
+          StreamReadData{streamId, std::move(result.first), result.second});
+    }
+    return folly::makeExpected<LocalErrorCode>(std::move(streamsData));
+  } catch (const QuicTransportException& ex) {
+    VLOG(4) << "readAll() error " << ex.what() << " " << *this;
+    closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+    return folly::makeUnexpected(LocalErrorCode::TRANSPORT_ERROR);
+  } catch (const QuicInternalException& ex) {
+    VLOG(4) << __func__ << " " << ex.what() << " " << *this;
+    closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+    return folly::makeUnexpected(ex.errorCode());
+  } catch (const std::exception& ex) {
+    VLOG(4) << "readAll() error " << ex.what() << " " << *this;
+    closeImpl(std::make_pair(
+        QuicErrorCode(TransportErrorCode::INTERNAL_ERROR),
+        std::string(ex.what())));
+    return folly::makeUnexpected(LocalErrorCode::INTERNAL_ERROR);
+  }
+}
+
 folly::Expected<folly::Unit, LocalErrorCode> QuicTransportBase::peek(
     StreamId id,
     const folly::Function<void(StreamId id, const folly::Range<PeekIterator>&)
@@ -1399,6 +1685,12 @@ void QuicTransportBase::processCallbacksAfterNetworkData() {
     }
   }
   conn_->streamManager->clearNewPeerStreams();
+  if (conn_->datagramState.readAvailable && closeState_ == CloseState::OPEN) {
+    conn_->datagramState.readAvailable = false;
+    if (datagramCallback_) {
+      datagramCallback_->onDatagramsAvailable();
+    }
+  }
   // TODO: we're currently assuming that canceling write callbacks will not
   // cause reset of random streams. Maybe get rid of that assumption later.
   for (auto pendingResetIt = conn_->pendingEvents.resets.begin();
@@ -1410,17 +1702,26 @@ void QuicTransportBase::processCallbacksAfterNetworkData() {
   auto deliverableStreamId = conn_->streamManager->popDeliverable();
   while (closeState_ == CloseState::OPEN && deliverableStreamId.hasValue()) {
     auto streamId = *deliverableStreamId;
+    if (deliveryCallbacks_.count(streamId) == 0) {
+      // Most acked streams have no callbacks waiting.
+      deliverableStreamId = conn_->streamManager->popDeliverable();
+      continue;
+    }
     auto stream = conn_->streamManager->getStream(streamId);
     // stream shouldn't be cleaned as long as it's still on deliveryList
     DCHECK(stream);
+    // No acks are processed while the callbacks run, so what is delivered
+    // does not change. As the callbacks are sorted by offset, only those
+    // that are invoked and the first one after them are looked at.
+    auto minOffsetToDeliver = getStreamNextOffsetToDeliver(*stream);
 
     while (closeState_ == CloseState::OPEN) {
+      // A callback may cancel the others, so look them up again each time.
       auto deliveryCallbacksForAckedStream = deliveryCallbacks_.find(streamId);
       if (deliveryCallbacksForAckedStream == deliveryCallbacks_.end() ||
           deliveryCallbacksForAckedStream->second.empty()) {
         break;
       }
-      auto minOffsetToDeliver = getStreamNextOffsetToDeliver(*stream);
       if (deliveryCallbacksForAckedStream->second.front().first >
           minOffsetToDeliver) {
         break;
@@ -1501,6 +1802,7 @@ void QuicTransportBase::processCallbacksAfterNetworkData() {
     // on the streams now. TODO: maybe do this only when we know connection
     // flow control changed.
     auto writeCallbackIt = pendingWriteCallbacks_.begin();
+    std::vector<StreamId> readyStreams;
 
     // If we were closed, we would have errored out the callbacks which would
     // invalidate iterators, so just ignore all other calls.
@@ -1518,9 +1820,18 @@ void QuicTransportBase::processCallbacksAfterNetworkData() {
       auto maxStreamWritable = maxWritableOnStream(*stream);
       if (maxStreamWritable != 0) {
         pendingWriteCallbacks_.erase(streamId);
+        if (streamsReadyCallback_) {
+          readyStreams.push_back(streamId);
+          continue;
+        }
         wcb->onStreamWriteReady(streamId, maxStreamWritable);
       }
     }
+    if (!readyStreams.empty() && streamsReadyCallback_ &&
+        closeState_ == CloseState::OPEN) {
+      streamsReadyCallback_->writeReady(folly::Range<const StreamId*>(
+          readyStreams.data(), readyStreams.size()));
+    }
   }
 }
 
@@ -1528,39 +1839,85 @@ void QuicTransportBase::onNetworkData(
     const folly::SocketAddress& peer,
     NetworkData&& networkData) noexcept {
   FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  ScopedLoopTime loopTime;
+  ScopedCpuAccounting cpuAccounting(*conn_, ConnectionCpuUsage::Phase::Read);
+  ScopedAllocationAccounting allocationAccounting(
+      *conn_, ConnectionAllocationUsage::Phase::Read);
   SCOPE_EXIT {
-    checkForClosedStream();
-    updateReadLooper();
-    updatePeekLooper();
-    updateWriteLooper(true);
+    if (!networkDataTrainAckVersion_) {
+      checkForClosedStream();
+      updateReadLooper();
+      updatePeekLooper();
+      updateWriteLooper(true);
+    }
   };
+  if (loopHealthMonitor_) {
+    loopHealthMonitor_->onSample(
+        LoopHealthMonitor::Metric::ReadDelay,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - networkData.receiveTimePoint));
+  }
   try {
     if (networkData.data) {
       conn_->lossState.totalBytesRecvd +=
           networkData.data->computeChainDataLength();
     }
-    auto originalAckVersion = currentAckStateVersion(*conn_);
-    onReadData(peer, std::move(networkData));
-    processCallbacksAfterNetworkData();
-    if (closeState_ != CloseState::CLOSED) {
-      if (currentAckStateVersion(*conn_) != originalAckVersion) {
-        setIdleTimer();
-        conn_->receivedNewPacketBeforeWrite = true;
+    if (networkDataTrainAckVersion_) {
+      if (conn_->transportSettings.batchHeaderProtectionRemoval) {
+        networkDataTrain_.emplace_back(peer, std::move(networkData));
+        return;
       }
-      // Reading data could process an ack and change the loss timer.
-      setLossDetectionAlarm(*conn_, *self);
-      // Reading data could change the state of the acks which could change the
-      // ack timer. But we need to call scheduleAckTimeout() for it to take
-      // effect.
-      scheduleAckTimeout();
-      // Received data could contain valid path response, in which case
-      // path validation timeout should be canceled
-      schedulePathValidationTimeout();
-    } else {
-      // In the closed state, we would want to write a close if possible however
-      // the write looper will not be set.
-      writeSocketData();
+      // The rest waits for the end of the train.
+      onReadData(peer, std::move(networkData));
+      return;
     }
+    auto originalAckVersion = currentAckStateVersion(*conn_);
+    onReadData(peer, std::move(networkData));
+    onNetworkDataProcessed(originalAckVersion);
+  } catch (const QuicTransportException& ex) {
+    VLOG(4) << __func__ << " " << ex.what() << " " << *this;
+    return closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+  } catch (const QuicInternalException& ex) {
+    VLOG(4) << __func__ << " " << ex.what() << " " << *this;
+    return closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+  } catch (const QuicApplicationException& ex) {
+    VLOG(4) << __func__ << " " << ex.what() << " " << *this;
+    return closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+  } catch (const std::exception& ex) {
+    VLOG(4) << __func__ << " " << ex.what() << " " << *this;
+    return closeImpl(std::make_pair(
+        QuicErrorCode(TransportErrorCode::INTERNAL_ERROR),
+        std::string(ex.what())));
+  }
+}
+
+void QuicTransportBase::beginNetworkDataTrain() noexcept {
+  DCHECK(!networkDataTrainAckVersion_);
+  networkDataTrainAckVersion_ = currentAckStateVersion(*conn_);
+}
+
+void QuicTransportBase::endNetworkDataTrain() noexcept {
+  if (!networkDataTrainAckVersion_) {
+    return;
+  }
+  FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  ScopedCpuAccounting cpuAccounting(*conn_, ConnectionCpuUsage::Phase::Read);
+  ScopedAllocationAccounting allocationAccounting(
+      *conn_, ConnectionAllocationUsage::Phase::Read);
+  auto originalAckVersion = *networkDataTrainAckVersion_;
+  networkDataTrainAckVersion_ = folly::none;
+  SCOPE_EXIT {
+    checkForClosedStream();
+    updateReadLooper();
+    updatePeekLooper();
+    updateWriteLooper(true);
+  };
+  try {
+    processNetworkDataTrain();
+    onNetworkDataProcessed(originalAckVersion);
   } catch (const QuicTransportException& ex) {
     VLOG(4) << __func__ << " " << ex.what() << " " << *this;
     return closeImpl(
@@ -1581,17 +1938,83 @@ void QuicTransportBase::onNetworkData(
   }
 }
 
+void QuicTransportBase::processNetworkDataTrain() {
+  if (networkDataTrain_.empty()) {
+    return;
+  }
+  auto train = std::move(networkDataTrain_);
+  networkDataTrain_.clear();
+  if (conn_->readCodec) {
+    std::vector<const folly::IOBuf*> packets;
+    packets.reserve(train.size());
+    for (const auto& packet : train) {
+      packets.push_back(packet.second.data.get());
+    }
+    conn_->readCodec->prepareShortHeaderMasks(packets);
+  }
+  SCOPE_EXIT {
+    // The masks only match the samples of this train.
+    if (conn_->readCodec) {
+      conn_->readCodec->clearShortHeaderMasks();
+    }
+  };
+  for (auto& packet : train) {
+    if (closeState_ == CloseState::CLOSED) {
+      return;
+    }
+    onReadData(packet.first, std::move(packet.second));
+  }
+}
+
+void QuicTransportBase::onNetworkDataProcessed(
+    AckStateVersion originalAckVersion) {
+  processCallbacksAfterNetworkData();
+  if (closeState_ != CloseState::CLOSED) {
+    updateKeyPhaseOnRead(*conn_);
+    maybeDiscardHandshakeSpaces(*conn_);
+    // Acks and window updates may have made room for more of the files.
+    pullFileWrites();
+    maybeApplyCongestionControlPolicy();
+    maybeReportMetrics();
+    maybeSampleMetrics();
+    if (currentAckStateVersion(*conn_) != originalAckVersion) {
+      setIdleTimer();
+      conn_->receivedNewPacketBeforeWrite = true;
+    }
+    // Reading data could process an ack and change the loss timer.
+    setLossDetectionAlarm(*conn_, *this);
+    // Reading data could change the state of the acks which could change the
+    // ack timer. But we need to call scheduleAckTimeout() for it to take
+    // effect.
+    scheduleAckTimeout();
+    // Received data could contain valid path response, in which case
+    // path validation timeout should be canceled
+    schedulePathValidationTimeout();
+  } else {
+    // In the closed state, we would want to write a close if possible however
+    // the write looper will not be set.
+    writeSocketData();
+  }
+}
+
 void QuicTransportBase::setIdleTimer() {
   if (closeState_ == CloseState::CLOSED) {
     return;
   }
-  if (idleTimeout_.isScheduled()) {
-    idleTimeout_.cancelTimeout();
+  auto idleTimeout = conn_->transportSettings.idleTimeout;
+  if (idleTimeout <= std::chrono::milliseconds::zero()) {
+    if (idleTimeout_.isScheduled()) {
+      idleTimeout_.cancelTimeout();
+    }
+    return;
   }
-  if (conn_->transportSettings.idleTimeout >
-      std::chrono::milliseconds::zero()) {
-    getEventBase()->timer().scheduleTimeout(
-        &idleTimeout_, conn_->transportSettings.idleTimeout);
+  // This is called for most of the packets that are sent or received. The
+  // timeout is only rescheduled when the deadline moves earlier, later
+  // deadlines are picked up once it fires.
+  idleDeadline_ = LoopTime::now() + idleTimeout;
+  if (!idleTimeout_.isScheduled() ||
+      idleTimeout_.getTimeRemaining() > idleTimeout) {
+    getEventBase()->timer().scheduleTimeout(&idleTimeout_, idleTimeout);
   }
 }
 
@@ -1732,20 +2155,50 @@ QuicTransportBase::notifyPendingWriteOnStream(StreamId id, WriteCallback* wcb) {
   return folly::unit;
 }
 
-uint64_t QuicTransportBase::maxWritableOnStream(const QuicStreamState& stream) {
+uint64_t QuicTransportBase::maxWritableOnStream(QuicStreamState& stream) {
   auto connWritableBytes = maxWritableOnConn();
   auto streamFlowControlBytes = getSendStreamFlowControlBytesAPI(stream);
   auto flowControlAllowedBytes =
       std::min(streamFlowControlBytes, connWritableBytes);
-  return flowControlAllowedBytes;
+  auto bufferedBytes = stream.writeBuffer.chainLength();
+  const auto& settings = conn_->transportSettings;
+  if (stream.writeBufferAboveHighWatermark) {
+    if (bufferedBytes > settings.streamWriteBufferLowWatermark) {
+      return 0;
+    }
+    stream.writeBufferAboveHighWatermark = false;
+  }
+  auto bufferHighWatermark = settings.streamWriteBufferHighWatermark;
+  auto streamBufferSpace = bufferedBytes >= bufferHighWatermark
+      ? 0
+      : bufferHighWatermark - bufferedBytes;
+  return std::min(flowControlAllowedBytes, streamBufferSpace);
 }
 
 uint64_t QuicTransportBase::maxWritableOnConn() {
   auto connWritableBytes = getSendConnFlowControlBytesAPI(*conn_);
+  if (connBufferAboveHighWatermark_) {
+    if (conn_->flowControlState.sumCurStreamBufferLen >
+        conn_->transportSettings.connWriteBufferLowWatermark) {
+      return 0;
+    }
+    connBufferAboveHighWatermark_ = false;
+  }
   auto availableBufferSpace = bufferSpaceAvailable();
   return std::min(connWritableBytes, availableBufferSpace);
 }
 
+void QuicTransportBase::updateWriteBufferWatermarks(QuicStreamState& stream) {
+  const auto& settings = conn_->transportSettings;
+  if (stream.writeBuffer.chainLength() >=
+      settings.streamWriteBufferHighWatermark) {
+    stream.writeBufferAboveHighWatermark = true;
+  }
+  if (bufferSpaceAvailable() == 0) {
+    connBufferAboveHighWatermark_ = true;
+  }
+}
+
 QuicSocket::WriteResult QuicTransportBase::writeChain(
     StreamId id,
     Buf data,
@@ -1769,6 +2222,10 @@ QuicSocket::WriteResult QuicTransportBase::writeChain(
     if (!stream || !stream->writable()) {
       return folly::makeUnexpected(LocalErrorCode::STREAM_CLOSED);
     }
+    if (fileWrites_.count(id)) {
+      // The data would land in the middle of the file.
+      return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+    }
     // Register DeliveryCallback for the data + eof offset.
     if (cb) {
       auto dataLength =
@@ -1780,6 +2237,7 @@ QuicSocket::WriteResult QuicTransportBase::writeChain(
       }
     }
     writeDataToQuicStream(*stream, std::move(data), eof);
+    updateWriteBufferWatermarks(*stream);
     updateWriteLooper(true);
   } catch (const QuicTransportException& ex) {
     VLOG(4) << __func__ << " streamId=" << id << " " << ex.what() << " "
@@ -1804,6 +2262,289 @@ QuicSocket::WriteResult QuicTransportBase::writeChain(
   return nullptr;
 }
 
+folly::Expected<folly::Unit, LocalErrorCode> QuicTransportBase::flushWrites() {
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  if (shouldWriteData(*conn_) == WriteDataReason::NO_WRITE) {
+    return folly::unit;
+  }
+  pacedWriteDataToSocket(false);
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  return folly::unit;
+}
+
+folly::Expected<folly::Unit, LocalErrorCode> QuicTransportBase::writeFile(
+    StreamId id,
+    int fd,
+    uint64_t offset,
+    uint64_t length,
+    bool eof,
+    DeliveryCallback* cb) {
+  if (isReceivingStream(conn_->nodeType, id)) {
+    return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+  }
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  try {
+    if (!conn_->streamManager->streamExists(id)) {
+      return folly::makeUnexpected(LocalErrorCode::STREAM_NOT_EXISTS);
+    }
+    auto stream = conn_->streamManager->getStream(id);
+    if (!stream || !stream->writable()) {
+      return folly::makeUnexpected(LocalErrorCode::STREAM_CLOSED);
+    }
+    if (fileWrites_.count(id)) {
+      return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+    }
+    auto dataLength = length + (eof ? 1 : 0);
+    if (cb && dataLength) {
+      registerDeliveryCallback(
+          id, getLargestWriteOffsetSeen(*stream) + dataLength - 1, cb);
+    }
+    if (length == 0) {
+      writeDataToQuicStream(*stream, nullptr, eof);
+    } else {
+      fileWrites_.emplace(id, FileWrite{fd, offset, length, eof});
+      pullFileWrites();
+    }
+    updateWriteLooper(true);
+  } catch (const QuicTransportException& ex) {
+    VLOG(4) << __func__ << " streamId=" << id << " " << ex.what() << " "
+            << *this;
+    closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+    return folly::makeUnexpected(LocalErrorCode::TRANSPORT_ERROR);
+  } catch (const QuicInternalException& ex) {
+    VLOG(4) << __func__ << " streamId=" << id << " " << ex.what() << " "
+            << *this;
+    closeImpl(
+        std::make_pair(QuicErrorCode(ex.errorCode()), std::string(ex.what())));
+    return folly::makeUnexpected(ex.errorCode());
+  } catch (const std::exception& ex) {
+    VLOG(4) << __func__ << " streamId=" << id << " " << ex.what() << " "
+            << *this;
+    closeImpl(std::make_pair(
+        QuicErrorCode(TransportErrorCode::INTERNAL_ERROR),
+        std::string(ex.what())));
+    return folly::makeUnexpected(LocalErrorCode::INTERNAL_ERROR);
+  }
+  return folly::unit;
+}
+
+void QuicTransportBase::pullFileWrites() {
+  if (fileWrites_.empty()) {
+    return;
+  }
+  auto chunkSize = conn_->transportSettings.fileWriteChunkSize;
+  if (!fileBufferPool_ || fileBufferPool_->getBufferSize() != chunkSize) {
+    fileBufferPool_ =
+        std::make_unique<BufferPool>(chunkSize, kMaxCachedFileWriteBuffers);
+  }
+  std::vector<StreamId> failedStreams;
+  auto it = fileWrites_.begin();
+  while (it != fileWrites_.end()) {
+    auto stream = conn_->streamManager->findStream(it->first);
+    if (!stream || !stream->writable()) {
+      it = fileWrites_.erase(it);
+      continue;
+    }
+    auto& fileWrite = it->second;
+    auto bufferedBytes = stream->writeBuffer.chainLength();
+    auto toRead = std::min<uint64_t>(
+        {fileWrite.remaining,
+         chunkSize - std::min<uint64_t>(chunkSize, bufferedBytes),
+         maxWritableOnStream(*stream)});
+    if (toRead == 0) {
+      ++it;
+      continue;
+    }
+    auto buf = fileBufferPool_->getBuffer();
+    auto bytesRead = folly::preadFull(
+        fileWrite.fd, buf->writableTail(), toRead, fileWrite.offset);
+    if (bytesRead <= 0) {
+      LOG(ERROR) << "Failed to read file for stream=" << it->first
+                 << " offset=" << fileWrite.offset << " errno=" << errno
+                 << " " << *this;
+      failedStreams.push_back(it->first);
+      it = fileWrites_.erase(it);
+      continue;
+    }
+    buf->append(bytesRead);
+    fileWrite.offset += bytesRead;
+    fileWrite.remaining -= bytesRead;
+    bool done = fileWrite.remaining == 0;
+    writeDataToQuicStream(*stream, std::move(buf), done && fileWrite.eof);
+    updateWriteBufferWatermarks(*stream);
+    if (done) {
+      it = fileWrites_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto streamId : failedStreams) {
+    resetStream(streamId, GenericApplicationErrorCode::UNKNOWN);
+  }
+}
+
+void QuicTransportBase::setDatagramCallback(DatagramCallback* cb) {
+  datagramCallback_ = cb;
+}
+
+void QuicTransportBase::setMetricsCallback(
+    MetricsCallback* cb,
+    std::chrono::milliseconds interval,
+    double changeThreshold) {
+  metricsCallback_ = cb;
+  metricsInterval_ = interval;
+  metricsChangeThreshold_ = changeThreshold;
+  lastMetrics_ = folly::none;
+}
+
+QuicSocket::ConnectionMetrics QuicTransportBase::getConnectionMetrics() const {
+  ConnectionMetrics metrics;
+  metrics.minRtt = conn_->lossState.mrtt;
+  metrics.srtt = conn_->lossState.srtt;
+  if (!conn_->congestionController) {
+    return metrics;
+  }
+  const auto& controller = *conn_->congestionController;
+  metrics.congestionWindow = controller.getCongestionWindow();
+  // The controllers allow writing what their window has left over the bytes
+  // in flight.
+  auto writableBytes = controller.getWritableBytes();
+  metrics.bytesInFlight = metrics.congestionWindow > writableBytes
+      ? metrics.congestionWindow - writableBytes
+      : 0;
+  metrics.deliveryRate =
+      getDeliveryRate(controller, metrics.congestionWindow, metrics.srtt);
+  return metrics;
+}
+
+void QuicTransportBase::maybeApplyCongestionControlPolicy() {
+  if (!ccPolicy_ || closeState_ != CloseState::OPEN) {
+    return;
+  }
+  auto now = Clock::now();
+  if (lastCongestionControlPolicyTime_ &&
+      now - *lastCongestionControlPolicyTime_ <
+          kCongestionControlPolicyInterval) {
+    return;
+  }
+  lastCongestionControlPolicyTime_ = now;
+  auto type = ccPolicy_->selectCongestionController(*conn_);
+  if (type) {
+    setCongestionControl(*type);
+  }
+}
+
+void QuicTransportBase::maybeReportMetrics() {
+  if (!metricsCallback_ || closeState_ != CloseState::OPEN) {
+    return;
+  }
+  auto now = Clock::now();
+  auto metrics = getConnectionMetrics();
+  bool report = !lastMetrics_.hasValue() ||
+      (metricsInterval_.count() > 0 &&
+       now - lastMetricsTime_ >= metricsInterval_);
+  if (!report && metricsChangeThreshold_ > 0) {
+    auto changed = [&](double last, double current) {
+      return std::abs(current - last) > last * metricsChangeThreshold_;
+    };
+    report = changed(lastMetrics_->deliveryRate, metrics.deliveryRate) ||
+        changed(lastMetrics_->srtt.count(), metrics.srtt.count());
+  }
+  if (!report) {
+    return;
+  }
+  lastMetrics_ = metrics;
+  lastMetricsTime_ = now;
+  metricsCallback_->onMetrics(metrics);
+}
+
+void QuicTransportBase::maybeSampleMetrics() {
+  const auto& settings = conn_->transportSettings;
+  const auto& lastAckedTime = conn_->lossState.lastAckedTime;
+  if (settings.metricsHistorySize == 0 || closeState_ != CloseState::OPEN ||
+      !lastAckedTime) {
+    return;
+  }
+  metricsHistory_.setCapacity(settings.metricsHistorySize);
+  auto newest = metricsHistory_.newest();
+  if (newest &&
+      (*lastAckedTime <= newest->time ||
+       *lastAckedTime - newest->time < settings.metricsHistoryInterval)) {
+    return;
+  }
+  auto metrics = getConnectionMetrics();
+  TransportMetricsSample sample;
+  sample.time = *lastAckedTime;
+  sample.srtt = metrics.srtt;
+  sample.lrtt = conn_->lossState.lrtt;
+  sample.congestionWindow = metrics.congestionWindow;
+  sample.bytesInFlight = metrics.bytesInFlight;
+  sample.deliveryRate = metrics.deliveryRate;
+  sample.packetsRetransmitted = conn_->lossState.rtxCount;
+  metricsHistory_.add(sample);
+}
+
+std::vector<TransportMetricsSample> QuicTransportBase::getMetricsHistory()
+    const {
+  return metricsHistory_.samples();
+}
+
+uint64_t QuicTransportBase::getDatagramSizeLimit() const {
+  return quic::getDatagramSizeLimit(*conn_);
+}
+
+folly::Expected<folly::Unit, LocalErrorCode> QuicTransportBase::writeDatagram(
+    Buf buf) {
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  auto sizeLimit = getDatagramSizeLimit();
+  if (sizeLimit == 0) {
+    return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+  }
+  if (buf && buf->computeChainDataLength() > sizeLimit) {
+    return folly::makeUnexpected(LocalErrorCode::INVALID_WRITE_DATA);
+  }
+  auto& writeBuffer = conn_->datagramState.writeBuffer;
+  auto maxBuffered = conn_->transportSettings.datagramWriteBufferSize;
+  if (maxBuffered == 0) {
+    return folly::unit;
+  }
+  if (writeBuffer.size() >= maxBuffered) {
+    VLOG(10) << "Dropping oldest datagram to send " << *this;
+    writeBuffer.pop_front();
+  }
+  writeBuffer.push_back(std::move(buf));
+  updateWriteLooper(true);
+  return folly::unit;
+}
+
+folly::Expected<std::vector<Buf>, LocalErrorCode>
+QuicTransportBase::readDatagrams(size_t atMost) {
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  auto& readBuffer = conn_->datagramState.readBuffer;
+  auto numDatagrams =
+      atMost == 0 ? readBuffer.size() : std::min(atMost, readBuffer.size());
+  std::vector<Buf> datagrams;
+  datagrams.reserve(numDatagrams);
+  for (size_t i = 0; i < numDatagrams; i++) {
+    datagrams.push_back(std::move(readBuffer.front()));
+    readBuffer.pop_front();
+  }
+  return datagrams;
+}
+
 folly::Expected<folly::Unit, LocalErrorCode>
 QuicTransportBase::registerDeliveryCallback(
     StreamId id,
@@ -1820,18 +2561,21 @@ QuicTransportBase::registerDeliveryCallback(
     return folly::makeUnexpected(LocalErrorCode::STREAM_NOT_EXISTS);
   }
   if (cb) {
-    if (deliveryCallbacks_.find(id) == deliveryCallbacks_.end()) {
-      deliveryCallbacks_[id].emplace_back(offset, cb);
+    auto& streamDeliveryCallbacks = deliveryCallbacks_[id];
+    // Keep DeliveryCallbacks for the same stream sorted by offsets. Apps
+    // mostly register them in the order they write, which only appends.
+    if (streamDeliveryCallbacks.empty() ||
+        streamDeliveryCallbacks.back().first <= offset) {
+      streamDeliveryCallbacks.emplace_back(offset, cb);
     } else {
-      // Keep DeliveryCallbacks for the same stream sorted by offsets:
       auto pos = std::upper_bound(
-          deliveryCallbacks_[id].begin(),
-          deliveryCallbacks_[id].end(),
+          streamDeliveryCallbacks.begin(),
+          streamDeliveryCallbacks.end(),
           offset,
           [&](uint64_t o, const std::pair<uint64_t, DeliveryCallback*>& p) {
             return o < p.first;
           });
-      deliveryCallbacks_[id].emplace(pos, offset, cb);
+      streamDeliveryCallbacks.emplace(pos, offset, cb);
     }
     auto stream = CHECK_NOTNULL(conn_->streamManager->getStream(id));
     auto minOffsetToDelivery = getStreamNextOffsetToDeliver(*stream);
@@ -1993,10 +2737,31 @@ void QuicTransportBase::sendPing(
     PingCallback* /*callback*/,
     std::chrono::milliseconds /*pingTimeout*/) {}
 
+folly::Expected<folly::Unit, LocalErrorCode>
+QuicTransportBase::requestAckFrequency(
+    uint64_t packetTolerance,
+    std::chrono::microseconds maxAckDelay,
+    bool ignoreOrder) {
+  if (closeState_ != CloseState::OPEN) {
+    return folly::makeUnexpected(LocalErrorCode::CONNECTION_CLOSED);
+  }
+  if (packetTolerance == 0) {
+    return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+  }
+  if (!quic::requestAckFrequency(
+          *conn_, packetTolerance, maxAckDelay, ignoreOrder)) {
+    return folly::makeUnexpected(LocalErrorCode::INVALID_OPERATION);
+  }
+  updateWriteLooper(true);
+  return folly::unit;
+}
+
 void QuicTransportBase::lossTimeoutExpired() noexcept {
   CHECK_NE(closeState_, CloseState::CLOSED);
   // onLossDetectionAlarm will set packetToSend in pending events
   FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  ScopedCpuAccounting cpuAccounting(
+      *conn_, ConnectionCpuUsage::Phase::LossTimeout);
   try {
     onLossDetectionAlarm(*conn_, markPacketLoss);
     // TODO: remove this trace when Pacing is ready to land
@@ -2025,6 +2790,8 @@ void QuicTransportBase::ackTimeoutExpired() noexcept {
   CHECK_NE(closeState_, CloseState::CLOSED);
   VLOG(10) << __func__ << " " << *this;
   FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  ScopedCpuAccounting cpuAccounting(
+      *conn_, ConnectionCpuUsage::Phase::AckTimeout);
   updateAckStateOnAckTimeout(*conn_);
   pacedWriteDataToSocket(false);
 }
@@ -2043,7 +2810,32 @@ void QuicTransportBase::pathValidationTimeoutExpired() noexcept {
       std::string("Path validation timed out")));
 }
 
+void QuicTransportBase::streamRateLimitTimeoutExpired() noexcept {
+  VLOG(10) << __func__ << " " << *this;
+  FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  auto now = Clock::now();
+  // Refilling takes the stream out of the set once it has tokens again, which
+  // leaves the iterators of the set valid.
+  for (auto id : conn_->streamManager->rateLimitedStreams()) {
+    auto stream = conn_->streamManager->findStream(id);
+    if (stream) {
+      refillStreamSendRate(*stream, now);
+    }
+  }
+  updateWriteLooper(true);
+  scheduleStreamRateLimitTimeout();
+}
+
 void QuicTransportBase::idleTimeoutExpired(bool drain) noexcept {
+  if (drain) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+        idleDeadline_ - Clock::now());
+    if (remaining > std::chrono::milliseconds::zero()) {
+      // There was activity since the timeout was scheduled.
+      getEventBase()->timer().scheduleTimeout(&idleTimeout_, remaining);
+      return;
+    }
+  }
   VLOG(4) << __func__ << " " << *this;
   FOLLY_MAYBE_UNUSED auto self = sharedGuard();
   // idle timeout is expired, just close the connection and drain or
@@ -2076,6 +2868,10 @@ void QuicTransportBase::scheduleAckTimeout() {
           kAckTimerFactor * conn_->lossState.srtt);
       auto timeout =
           timeMax(kMinAckTimeout, timeMin(kMaxAckTimeout, factoredRtt));
+      if (conn_->ackFrequency) {
+        // The peer told us how long it is willing to wait for an ack.
+        timeout = conn_->ackFrequency->updateMaxAckDelay;
+      }
       auto timeoutMs =
           std::chrono::duration_cast<std::chrono::milliseconds>(timeout);
       VLOG(10) << __func__ << " timeout=" << timeoutMs.count() << "ms"
@@ -2115,6 +2911,42 @@ void QuicTransportBase::schedulePathValidationTimeout() {
   }
 }
 
+void QuicTransportBase::scheduleStreamRateLimitTimeout() {
+  if (closeState_ == CloseState::CLOSED) {
+    return;
+  }
+  const auto& rateLimitedStreams = conn_->streamManager->rateLimitedStreams();
+  if (rateLimitedStreams.empty()) {
+    if (streamRateLimitTimeout_.isScheduled()) {
+      streamRateLimitTimeout_.cancelTimeout();
+    }
+    return;
+  }
+  folly::Optional<TimePoint> refillTime;
+  for (auto id : rateLimitedStreams) {
+    auto stream = conn_->streamManager->findStream(id);
+    if (stream && stream->sendRateLimit) {
+      // Waking up for less than a packet would only write small packets.
+      auto streamRefillTime =
+          getStreamSendRateRefillTime(*stream, conn_->udpSendPacketLen);
+      if (!refillTime || streamRefillTime < *refillTime) {
+        refillTime = streamRefillTime;
+      }
+    }
+  }
+  if (!refillTime) {
+    return;
+  }
+  // Rounded up, as the timer would otherwise fire before the tokens are in.
+  auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+      *refillTime - Clock::now());
+  auto timeoutMs = timeMax(
+      std::chrono::milliseconds((remaining.count() + 999) / 1000),
+      std::chrono::milliseconds(1));
+  VLOG(10) << __func__ << " timeout=" << timeoutMs.count() << "ms " << *this;
+  getEventBase()->timer().scheduleTimeout(&streamRateLimitTimeout_, timeoutMs);
+}
+
 void QuicTransportBase::cancelLossTimeout() {
   if (lossTimeout_.isScheduled()) {
     lossTimeout_.cancelTimeout();
@@ -2191,10 +3023,18 @@ void QuicTransportBase::cancelAllAppCallbacks(
 }
 
 void QuicTransportBase::writeSocketData() {
+  ScopedLoopTime loopTime;
+  ScopedCpuAccounting cpuAccounting(*conn_, ConnectionCpuUsage::Phase::Write);
+  ScopedAllocationAccounting allocationAccounting(
+      *conn_, ConnectionAllocationUsage::Phase::Write);
   if (socket_) {
     auto packetsBefore = conn_->outstandingPackets.size();
+    // Stale data is skipped rather than sent or retransmitted.
+    expireStreamData();
     writeData();
     if (closeState_ != CloseState::CLOSED) {
+      // What was written made room for more of the files.
+      pullFileWrites();
       setLossDetectionAlarm(*conn_, *this);
       auto packetsAfter = conn_->outstandingPackets.size();
       bool packetWritten = (packetsAfter > packetsBefore);
@@ -2239,6 +3079,7 @@ void QuicTransportBase::writeSocketData() {
   // effect.
   scheduleAckTimeout();
   schedulePathValidationTimeout();
+  scheduleStreamRateLimitTimeout();
   updateWriteLooper(false);
 }
 
@@ -2275,8 +3116,7 @@ void QuicTransportBase::cancelDeliveryCallbacks(
 }
 
 void QuicTransportBase::cancelDeliveryCallbacks(
-    const std::unordered_map<
-        StreamId,
+    const StreamIdMap<
         std::deque<std::pair<uint64_t, QuicSocket::DeliveryCallback*>>>&
         deliveryCallbacks) {
   for (auto iter = deliveryCallbacks.begin(); iter != deliveryCallbacks.end();
@@ -2290,12 +3130,18 @@ void QuicTransportBase::setTransportSettings(
   conn_->transportSettings = std::move(transportSettings);
   setCongestionControl(transportSettings.defaultCongestionController);
   if (conn_->transportSettings.pacingEnabled) {
-    conn_->pacer = std::make_unique<DefaultPacer>(
-        *conn_,
-        transportSettings.defaultCongestionController ==
-                CongestionControlType::BBR
-            ? kMinCwndInMssForBbr
-            : conn_->transportSettings.minCwndInMss);
+    auto ccType = transportSettings.defaultCongestionController;
+    auto minCwndInMss = ccType == CongestionControlType::BBR ||
+            ccType == CongestionControlType::BBR2
+        ? kMinCwndInMssForBbr
+        : conn_->transportSettings.minCwndInMss;
+    if (conn_->transportSettings.pacingUseTxTime) {
+      conn_->pacer = std::make_unique<TxTimePacer>(*conn_, minCwndInMss);
+    } else if (conn_->transportSettings.pacingUseTokenBucket) {
+      conn_->pacer = std::make_unique<TokenBucketPacer>(*conn_, minCwndInMss);
+    } else {
+      conn_->pacer = std::make_unique<DefaultPacer>(*conn_, minCwndInMss);
+    }
   }
 }
 
@@ -2309,14 +3155,52 @@ bool QuicTransportBase::isPartiallyReliableTransport() const {
 
 void QuicTransportBase::setCongestionControl(CongestionControlType type) {
   DCHECK(conn_);
+  if (conn_->congestionController &&
+      type == conn_->congestionController->type()) {
+    return;
+  }
+  CHECK(ccFactory_);
   if (!conn_->congestionController ||
-      type != conn_->congestionController->type()) {
-    CHECK(ccFactory_);
+      conn_->lossState.totalBytesAcked == 0) {
     conn_->congestionController =
         ccFactory_->makeCongestionController(*conn_, type);
+    return;
+  }
+  // The new controller takes over the cwnd the old one has found, instead
+  // of starting the path over, and the packets it has in flight.
+  auto initCwndInMss = std::max(
+      conn_->congestionController->getCongestionWindow() /
+          conn_->udpSendPacketLen,
+      conn_->transportSettings.minCwndInMss);
+  auto initCwndBytes = initCwndInMss * conn_->udpSendPacketLen;
+  auto congestionController = ccFactory_->makeCongestionControllerFromCwnd(
+      *conn_, type, initCwndBytes);
+  if (congestionController) {
+    for (const auto& packet : conn_->outstandingPackets) {
+      if (!packet.pureAck && !packet.isPathMtuProbe) {
+        congestionController->onPacketSent(packet);
+      }
+    }
+  }
+  VLOG(4) << __func__ << " switched from type="
+          << static_cast<int>(conn_->congestionController->type())
+          << " to type=" << static_cast<int>(type) << " " << *this;
+  conn_->congestionController = std::move(congestionController);
+  if (conn_->congestionController && conn_->pacer) {
+    conn_->pacer->refreshPacingRate(
+        conn_->congestionController->getCongestionWindow(),
+        conn_->lossState.srtt);
   }
 }
 
+void QuicTransportBase::setStaticSendRate(uint64_t bytesPerSec) {
+  DCHECK(conn_);
+  VLOG(4) << __func__ << " rate=" << bytesPerSec << " " << *this;
+  // The controller reads it from the settings, and paces at the new rate
+  // from its next packet.
+  conn_->transportSettings.staticRateBytesPerSec = bytesPerSec;
+}
+
 bool QuicTransportBase::isDetachable() {
   // only the client is detachable.
   return conn_->nodeType == QuicNodeType::Client;
@@ -2333,6 +3217,7 @@ void QuicTransportBase::attachEventBase(folly::EventBase* evb) {
 
   scheduleAckTimeout();
   schedulePathValidationTimeout();
+  scheduleStreamRateLimitTimeout();
   setIdleTimer();
 
   readLooper_->attachEventBase(evb);
@@ -2351,9 +3236,15 @@ void QuicTransportBase::detachEventBase() {
   }
   connWriteCallback_ = nullptr;
   pendingWriteCallbacks_.clear();
+  fileWrites_.clear();
+  datagramCallback_ = nullptr;
+  metricsCallback_ = nullptr;
+  conn_->datagramState.readBuffer.clear();
+  conn_->datagramState.writeBuffer.clear();
   lossTimeout_.cancelTimeout();
   ackTimeout_.cancelTimeout();
   pathValidationTimeout_.cancelTimeout();
+  streamRateLimitTimeout_.cancelTimeout();
   idleTimeout_.cancelTimeout();
   drainTimeout_.cancelTimeout();
   readLooper_->detachEventBase();
@@ -2372,6 +3263,44 @@ folly::Optional<LocalErrorCode> QuicTransportBase::setControlStream(
   return folly::none;
 }
 
+folly::Optional<LocalErrorCode> QuicTransportBase::setStreamPriority(
+    StreamId id,
+    StreamPriority priority) {
+  if (closeState_ != CloseState::OPEN) {
+    return LocalErrorCode::CONNECTION_CLOSED;
+  }
+  if (!conn_->streamManager->streamExists(id)) {
+    return LocalErrorCode::STREAM_NOT_EXISTS;
+  }
+  if (priority.urgency > kMaxStreamUrgency || priority.weight == 0 ||
+      priority.weight > kMaxStreamWeight) {
+    return LocalErrorCode::INVALID_OPERATION;
+  }
+  auto stream = CHECK_NOTNULL(conn_->streamManager->getStream(id));
+  conn_->streamManager->setStreamPriority(*stream, priority);
+  return folly::none;
+}
+
+folly::Optional<LocalErrorCode> QuicTransportBase::setStreamSendRateLimit(
+    StreamId id,
+    uint64_t bytesPerSec,
+    uint64_t burstBytes) {
+  if (closeState_ != CloseState::OPEN) {
+    return LocalErrorCode::CONNECTION_CLOSED;
+  }
+  if (!conn_->streamManager->streamExists(id)) {
+    return LocalErrorCode::STREAM_NOT_EXISTS;
+  }
+  if (isReceivingStream(conn_->nodeType, id)) {
+    return LocalErrorCode::INVALID_OPERATION;
+  }
+  auto stream = CHECK_NOTNULL(conn_->streamManager->getStream(id));
+  quic::setStreamSendRateLimit(*stream, bytesPerSec, burstBytes, Clock::now());
+  updateWriteLooper(true);
+  scheduleStreamRateLimitTimeout();
+  return folly::none;
+}
+
 void QuicTransportBase::runOnEvbAsync(
     folly::Function<void(std::shared_ptr<QuicTransportBase>)> func) {
   auto evb = getEventBase();
@@ -2387,8 +3316,18 @@ void QuicTransportBase::runOnEvbAsync(
       true);
 }
 
-void QuicTransportBase::pacedWriteDataToSocket(bool /* fromTimer */) {
+void QuicTransportBase::pacedWriteDataToSocket(bool fromTimer) {
   FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  if (writeReadyTime_) {
+    // A write from the pacing timer waited for the pacer, not the loop.
+    if (loopHealthMonitor_ && !fromTimer) {
+      loopHealthMonitor_->onSample(
+          LoopHealthMonitor::Metric::WriteDelay,
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              Clock::now() - *writeReadyTime_));
+    }
+    writeReadyTime_ = folly::none;
+  }
 
   if (!isConnectionPaced(*conn_)) {
     // Not paced and connection is still open, normal write. Even if pacing is
@@ -2423,8 +3362,10 @@ QuicTransportBase::getStreamTransportInfo(StreamId id) const {
     // by the stream existence check, but might as well check this.
     return folly::makeUnexpected(LocalErrorCode::STREAM_CLOSED);
   }
-  return StreamTransportInfo{
-      stream->totalHolbTime, stream->holbCount, bool(stream->lastHolbTime)};
+  return StreamTransportInfo{stream->totalHolbTime,
+                             stream->holbCount,
+                             bool(stream->lastHolbTime),
+                             stream->deliveryLatency};
 }
 
 void QuicTransportBase::describe(std::ostream& os) const {
@@ -9,17 +9,21 @@
 #pragma once
 
 #include <folly/ExceptionWrapper.h>
+#include <folly/concurrency/UnboundedQueue.h>
 #include <folly/io/async/AsyncUDPSocket.h>
 #include <folly/io/async/HHWheelTimer.h>
 #include <quic/QuicException.h>
 #include <quic/api/QuicSocket.h>
+#include <quic/common/BufferPool.h>
 #include <quic/common/FunctionLooper.h>
+#include <quic/common/LoopHealthMonitor.h>
 #include <quic/common/Timers.h>
 #include <quic/congestion_control/CongestionControllerFactory.h>
 #include <quic/congestion_control/Copa.h>
 #include <quic/congestion_control/NewReno.h>
 #include <quic/congestion_control/QuicCubic.h>
 #include <quic/state/StateData.h>
+#include <quic/state/StreamIdMap.h>
 
 namespace quic {
 
@@ -43,6 +47,42 @@ class QuicTransportBase : public QuicSocket {
 
   void setPacingTimer(TimerHighRes::SharedPtr pacingTimer) noexcept;
 
+  void setPacingScheduler(PacingScheduler::SharedPtr pacingScheduler) noexcept;
+
+  /**
+   * Reports how long the packets of the connection wait to be processed, and
+   * how long its writes wait to run once it is ready to write, to the
+   * monitor of the event loop.
+   */
+  void setLoopHealthMonitor(
+      LoopHealthMonitor::SharedPtr loopHealthMonitor) noexcept;
+
+  /**
+   * Thread safe counterparts of writeChain, createBidirectionalStream,
+   * createUnidirectionalStream and close, for apps that produce data on
+   * other threads than the event base of the transport. The calls are
+   * queued and applied in order on the event base, all the calls queued
+   * meanwhile in a single callback. They must not race with
+   * detachEventBase or attachEventBase.
+   *
+   * A submitted write that fails is dropped, the failure of its stream or of
+   * the connection is reported through the usual callbacks. cb, if set, is
+   * registered as it would be by writeChain.
+   */
+  void submitWrite(
+      StreamId id,
+      Buf data,
+      bool eof,
+      DeliveryCallback* cb = nullptr);
+
+  // Invoked on the event base with the new stream or the error creating it.
+  using SubmittedStreamCallback =
+      folly::Function<void(folly::Expected<StreamId, LocalErrorCode>)>;
+  void submitCreateStream(bool bidirectional, SubmittedStreamCallback cb);
+
+  void submitClose(
+      folly::Optional<std::pair<QuicErrorCode, std::string>> error);
+
   folly::EventBase* getEventBase() const override;
 
   folly::Optional<ConnectionId> getClientConnectionId() const override;
@@ -81,6 +121,12 @@ class QuicTransportBase : public QuicSocket {
 
   TransportInfo getTransportInfo() const override;
 
+  /**
+   * Returns the memory held by the buffers and the packet state of the
+   * connection. This walks all the streams and outstanding packets.
+   */
+  virtual ConnectionMemoryUsage getMemoryUsage() const;
+
   folly::Expected<StreamTransportInfo, LocalErrorCode> getStreamTransportInfo(
       StreamId id) const override;
 
@@ -108,6 +154,7 @@ class QuicTransportBase : public QuicSocket {
   folly::Expected<folly::Unit, LocalErrorCode> setReadCallback(
       StreamId id,
       ReadCallback* cb) override;
+  void setStreamsReadyCallback(StreamsReadyCallback* callback) override;
   void unsetAllReadCallbacks() override;
   void unsetAllPeekCallbacks() override;
   void unsetAllDeliveryCallbacks() override;
@@ -121,6 +168,9 @@ class QuicTransportBase : public QuicSocket {
       StreamId id,
       size_t maxLen) override;
 
+  folly::Expected<std::vector<StreamReadData>, LocalErrorCode> readAll(
+      size_t maxLen) override;
+
   folly::Expected<folly::Unit, LocalErrorCode> setPeekCallback(
       StreamId id,
       PeekCallback* cb) override;
@@ -158,6 +208,10 @@ class QuicTransportBase : public QuicSocket {
       StreamId id,
       uint64_t offset) override;
 
+  folly::Expected<folly::Unit, LocalErrorCode> setStreamDataExpiry(
+      StreamId id,
+      folly::Optional<std::chrono::milliseconds> expiry) override;
+
   folly::Expected<StreamId, LocalErrorCode> createBidirectionalStream(
       bool replaySafe = true) override;
   folly::Expected<StreamId, LocalErrorCode> createUnidirectionalStream(
@@ -183,6 +237,32 @@ class QuicTransportBase : public QuicSocket {
       bool cork,
       DeliveryCallback* cb = nullptr) override;
 
+  folly::Expected<folly::Unit, LocalErrorCode> writeFile(
+      StreamId id,
+      int fd,
+      uint64_t offset,
+      uint64_t length,
+      bool eof,
+      DeliveryCallback* cb = nullptr) override;
+
+  folly::Expected<folly::Unit, LocalErrorCode> flushWrites() override;
+
+  void setDatagramCallback(DatagramCallback* cb) override;
+
+  uint64_t getDatagramSizeLimit() const override;
+
+  folly::Expected<folly::Unit, LocalErrorCode> writeDatagram(Buf buf) override;
+
+  folly::Expected<std::vector<Buf>, LocalErrorCode> readDatagrams(
+      size_t atMost = 0) override;
+
+  void setMetricsCallback(
+      MetricsCallback* cb,
+      std::chrono::milliseconds interval,
+      double changeThreshold = 0) override;
+
+  std::vector<TransportMetricsSample> getMetricsHistory() const override;
+
   folly::Expected<folly::Unit, LocalErrorCode> registerDeliveryCallback(
       StreamId id,
       uint64_t offset,
@@ -201,6 +281,11 @@ class QuicTransportBase : public QuicSocket {
   void sendPing(PingCallback* callback, std::chrono::milliseconds pingTimeout)
       override;
 
+  folly::Expected<folly::Unit, LocalErrorCode> requestAckFrequency(
+      uint64_t packetTolerance,
+      std::chrono::microseconds maxAckDelay,
+      bool ignoreOrder) override;
+
   const QuicConnectionStateBase* getState() const override {
     return conn_.get();
   }
@@ -211,6 +296,17 @@ class QuicTransportBase : public QuicSocket {
       const folly::SocketAddress& peer,
       NetworkData&& data) noexcept;
 
+  /**
+   * The packets given to onNetworkData until endNetworkDataTrain are
+   * decrypted and their frames applied as they come, but the callbacks, the
+   * loss, ack and idle timers and the write looper are only updated once, at
+   * the end of the train. With batchHeaderProtectionRemoval the packets are
+   * held until the end of the train instead, so that the header protection
+   * masks of all of them are computed at once.
+   */
+  virtual void beginNetworkDataTrain() noexcept;
+  virtual void endNetworkDataTrain() noexcept;
+
   virtual void setSupportedVersions(const std::vector<QuicVersion>& versions);
 
   void setConnectionCallback(ConnectionCallback* callback) final;
@@ -228,6 +324,15 @@ class QuicTransportBase : public QuicSocket {
 
   folly::Optional<LocalErrorCode> setControlStream(StreamId id) override;
 
+  folly::Optional<LocalErrorCode> setStreamPriority(
+      StreamId id,
+      StreamPriority priority) override;
+
+  folly::Optional<LocalErrorCode> setStreamSendRateLimit(
+      StreamId id,
+      uint64_t bytesPerSec,
+      uint64_t burstBytes = kDefaultStreamSendRateBurstBytes) override;
+
   /**
    * Invoke onCanceled for all the delivery callbacks in the deliveryCallbacks
    * passed in. This is supposed to be a copy of the real deque of the delivery
@@ -244,8 +349,7 @@ class QuicTransportBase : public QuicSocket {
    * callbacks of the transport, so there is no need to erase anything from it.
    */
   static void cancelDeliveryCallbacks(
-      const std::unordered_map<
-          StreamId,
+      const StreamIdMap<
           std::deque<std::pair<uint64_t, QuicSocket::DeliveryCallback*>>>&
           deliveryCallbacks);
 
@@ -261,6 +365,13 @@ class QuicTransportBase : public QuicSocket {
   virtual void setCongestionControllerFactory(
       std::shared_ptr<CongestionControllerFactory> factory);
 
+  /**
+   * Set the policy that switches the congestion controller of the
+   * connection as its path is observed, nullptr for none.
+   */
+  void setCongestionControlPolicy(
+      std::shared_ptr<CongestionControlPolicy> policy);
+
   /**
    * Retrieve the transport settings
    */
@@ -388,6 +499,27 @@ class QuicTransportBase : public QuicSocket {
     QuicTransportBase* transport_;
   };
 
+  class StreamRateLimitTimeout : public folly::HHWheelTimer::Callback {
+   public:
+    ~StreamRateLimitTimeout() override = default;
+
+    explicit StreamRateLimitTimeout(QuicTransportBase* transport)
+        : transport_(transport) {}
+
+    void timeoutExpired() noexcept override {
+      transport_->streamRateLimitTimeoutExpired();
+    }
+
+    virtual void callbackCanceled() noexcept override {
+      // ignore. this usually means that the eventbase is dying, so we will be
+      // canceled anyway
+      return;
+    }
+
+   private:
+    QuicTransportBase* transport_;
+  };
+
   class IdleTimeout : public folly::HHWheelTimer::Callback {
    public:
     ~IdleTimeout() override = default;
@@ -432,7 +564,9 @@ class QuicTransportBase : public QuicSocket {
   bool isLossTimeoutScheduled() const;
 
   // If you don't set it, the default is Cubic
-  void setCongestionControl(CongestionControlType type);
+  void setCongestionControl(CongestionControlType type) override;
+
+  void setStaticSendRate(uint64_t bytesPerSec) override;
 
   void describe(std::ostream& os) const;
 
@@ -453,9 +587,13 @@ class QuicTransportBase : public QuicSocket {
 
  protected:
   void processCallbacksAfterNetworkData();
+  void onNetworkDataProcessed(AckStateVersion originalAckVersion);
+  void processNetworkDataTrain();
   void invokeReadDataAndCallbacks();
   void invokePeekDataAndCallbacks();
   void invokeDataExpiredCallbacks();
+  // Expires the data of the streams with a data expiry that is past it.
+  void expireStreamData();
   void invokeDataRejectedCallbacks();
   void updateReadLooper();
   void updatePeekLooper();
@@ -494,6 +632,31 @@ class QuicTransportBase : public QuicSocket {
    */
   void writeSocketData();
 
+  /**
+   * Reads the next chunk of the files written with writeFile() into the
+   * write buffers of their streams, as far as flow control allows.
+   */
+  void pullFileWrites();
+
+  QuicSocket::ConnectionMetrics getConnectionMetrics() const;
+
+  /**
+   * Switches to the congestion controller the policy picks, at most once
+   * per kCongestionControlPolicyInterval.
+   */
+  void maybeApplyCongestionControlPolicy();
+
+  /**
+   * Gives the metrics to the metrics callback if one of its triggers fired.
+   */
+  void maybeReportMetrics();
+
+  /**
+   * Adds a sample of the metrics to the history if an ack came in at least
+   * metricsHistoryInterval after the one of the last sample.
+   */
+  void maybeSampleMetrics();
+
   /**
    * A wrapper around writeSocketData
    *
@@ -513,18 +676,23 @@ class QuicTransportBase : public QuicSocket {
    */
   void pacedWriteDataToSocket(bool fromTimer);
 
-  uint64_t maxWritableOnStream(const QuicStreamState&);
+  uint64_t maxWritableOnStream(QuicStreamState&);
   uint64_t maxWritableOnConn();
+  // Notes the write buffers that reached their high watermark after a write.
+  void updateWriteBufferWatermarks(QuicStreamState& stream);
 
   void lossTimeoutExpired() noexcept;
   void ackTimeoutExpired() noexcept;
   void pathValidationTimeoutExpired() noexcept;
+  void streamRateLimitTimeoutExpired() noexcept;
   void idleTimeoutExpired(bool drain) noexcept;
   void drainTimeoutExpired() noexcept;
 
   void setIdleTimer();
   void scheduleAckTimeout();
   void schedulePathValidationTimeout();
+  // Wakes the writes up once a rate limited stream can write a packet again.
+  void scheduleStreamRateLimitTimeout();
 
   std::atomic<folly::EventBase*> evb_;
   std::unique_ptr<folly::AsyncUDPSocket> socket_;
@@ -534,10 +702,14 @@ class QuicTransportBase : public QuicSocket {
 
   struct ReadCallbackData {
     ReadCallback* readCb;
+    // Set when readCb is in push mode.
+    StreamDataCallback* streamDataCb;
     bool resumed{true};
     bool deliveredEOM{false};
 
-    ReadCallbackData(ReadCallback* readCallback) : readCb(readCallback) {}
+    ReadCallbackData(ReadCallback* readCallback)
+        : readCb(readCallback),
+          streamDataCb(dynamic_cast<StreamDataCallback*>(readCallback)) {}
   };
 
   struct PeekCallbackData {
@@ -561,35 +733,92 @@ class QuicTransportBase : public QuicSocket {
     DataRejectedCallbackData(DataRejectedCallback* cb) : dataRejectedCb(cb) {}
   };
 
-  // Map of streamID to tupl
-  std::unordered_map<StreamId, ReadCallbackData> readCallbacks_;
-  std::unordered_map<StreamId, PeekCallbackData> peekCallbacks_;
-  std::unordered_map<
-      StreamId,
-      std::deque<std::pair<uint64_t, DeliveryCallback*>>>
+  // Callbacks of each stream, indexed by stream id like the streams are, so
+  // that dispatching to them does not need a hash lookup.
+  StreamIdMap<ReadCallbackData> readCallbacks_;
+  StreamIdMap<PeekCallbackData> peekCallbacks_;
+  StreamIdMap<std::deque<std::pair<uint64_t, DeliveryCallback*>>>
       deliveryCallbacks_;
-  std::unordered_map<StreamId, DataExpiredCallbackData> dataExpiredCallbacks_;
-  std::unordered_map<StreamId, DataRejectedCallbackData> dataRejectedCallbacks_;
+  StreamIdMap<DataExpiredCallbackData> dataExpiredCallbacks_;
+  StreamIdMap<DataRejectedCallbackData> dataRejectedCallbacks_;
 
   WriteCallback* connWriteCallback_{nullptr};
+  StreamsReadyCallback* streamsReadyCallback_{nullptr};
+  DatagramCallback* datagramCallback_{nullptr};
+  MetricsCallback* metricsCallback_{nullptr};
+  std::chrono::milliseconds metricsInterval_{0};
+  double metricsChangeThreshold_{0};
+  // The metrics of the last report, and when it was made
+  folly::Optional<ConnectionMetrics> lastMetrics_;
+  TimePoint lastMetricsTime_;
+  TransportMetricsHistory metricsHistory_;
   std::map<StreamId, WriteCallback*> pendingWriteCallbacks_;
+  // Whether the buffered bytes reached totalBufferSpaceAvailable, and have
+  // yet to drain down to connWriteBufferLowWatermark.
+  bool connBufferAboveHighWatermark_{false};
+
+  struct FileWrite {
+    int fd;
+    uint64_t offset;
+    uint64_t remaining;
+    bool eof;
+  };
+
+  // Files written with writeFile() that are not fully read yet
+  std::unordered_map<StreamId, FileWrite> fileWrites_;
+  // The buffers the chunks of those files are read into
+  std::unique_ptr<BufferPool> fileBufferPool_;
+
+  // Calls of the submit functions from other threads, each queued as a
+  // Submission until the event base applies them.
+  struct Submission {
+    enum class Type { Write, CreateStream, Close };
+    Type type{Type::Write};
+    StreamId id{0};
+    Buf data;
+    bool eof{false};
+    DeliveryCallback* deliveryCallback{nullptr};
+    bool bidirectional{false};
+    SubmittedStreamCallback streamCallback;
+    folly::Optional<std::pair<QuicErrorCode, std::string>> closeError;
+  };
+  void enqueueSubmission(Submission submission);
+  void applySubmissions() noexcept;
+  // Many producers, the event base as the only consumer.
+  folly::UMPSCQueue<Submission, false /* MayBlock */> submissions_;
+  // Whether a callback applying the submissions is pending.
+  std::atomic<bool> submissionsScheduled_{false};
+
   CloseState closeState_{CloseState::OPEN};
   bool transportReadyNotified_{false};
 
   LossTimeout lossTimeout_;
   AckTimeout ackTimeout_;
   PathValidationTimeout pathValidationTimeout_;
+  StreamRateLimitTimeout streamRateLimitTimeout_;
   IdleTimeout idleTimeout_;
+  // The idle timeout only closes the connection once this has passed.
+  // Activity pushes it back without rescheduling the timeout.
+  TimePoint idleDeadline_;
   DrainTimeout drainTimeout_;
   FunctionLooper::Ptr readLooper_;
   FunctionLooper::Ptr peekLooper_;
   FunctionLooper::Ptr writeLooper_;
+  // The ack state version when the current packet train began, if any.
+  folly::Optional<AckStateVersion> networkDataTrainAckVersion_;
+  // The packets held until the end of the train.
+  std::vector<std::pair<folly::SocketAddress, NetworkData>> networkDataTrain_;
+  LoopHealthMonitor::SharedPtr loopHealthMonitor_;
+  // When the write looper was started, only kept with a loop health monitor
+  folly::Optional<TimePoint> writeReadyTime_;
 
   // TODO: This is silly. We need a better solution.
   // Uninitialied local address as a fallback answer when socket isn't bound.
   folly::SocketAddress localFallbackAddress;
   // CongestionController factory
   std::shared_ptr<CongestionControllerFactory> ccFactory_{nullptr};
+  std::shared_ptr<CongestionControlPolicy> ccPolicy_;
+  folly::Optional<TimePoint> lastCongestionControlPolicyTime_;
 
   folly::Function<bool(const folly::Optional<std::string>&, const Buf&) const>
       earlyDataAppParamsValidator_;
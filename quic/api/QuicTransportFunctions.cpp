@@ -9,22 +9,34 @@
 #include <quic/api/QuicTransportFunctions.h>
 
 #include <folly/Overload.h>
+#include <folly/ScopeGuard.h>
 #include <quic/QuicConstants.h>
 #include <quic/QuicException.h>
 #include <quic/api/IoBufQuicBatch.h>
+#include <quic/api/QuicEncryptionPipeline.h>
 #include <quic/api/QuicTransportFunctions.h>
 #include <quic/codec/QuicPacketBuilder.h>
 #include <quic/codec/QuicWriteCodec.h>
 #include <quic/codec/Types.h>
+#include <quic/common/LoopTime.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/happyeyeballs/QuicHappyEyeballsFunctions.h>
 #include <quic/logging/QuicLogger.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/FecHandlers.h>
+#include <quic/state/KeyUpdate.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/QuicStateFunctions.h>
 #include <quic/state/QuicStreamFunctions.h>
 #include <quic/state/SimpleFrameFunctions.h>
 
 namespace {
 
+// Room a packet needs for anything but its header and tag.
+constexpr size_t kMinimumPacketDataSize = std::max(
+    quic::kLongHeaderHeaderSize + quic::kCipherOverheadHeuristic,
+    sizeof(quic::Sample));
+
 std::string optionalToString(
     const folly::Optional<quic::PacketNum>& packetNum) {
   if (!packetNum) {
@@ -98,16 +110,8 @@ void handleNewStreamDataWritten(
   stream.currentWriteOffset += frameLen;
   auto bufWritten = stream.writeBuffer.split(folly::to<size_t>(frameLen));
   stream.currentWriteOffset += frameFin ? 1 : 0;
-  auto insertIt = std::upper_bound(
-      stream.retransmissionBuffer.begin(),
-      stream.retransmissionBuffer.end(),
-      originalOffset,
-      [](const auto& offset, const auto& compare) {
-        // TODO: huh? why isn't this a >= ?
-        return compare.offset > offset;
-      });
-  stream.retransmissionBuffer.emplace(
-      insertIt, std::move(bufWritten), originalOffset, frameFin);
+  stream.retransmissionBuffer.insert(
+      StreamBuffer(std::move(bufWritten), originalOffset, frameFin));
 }
 
 void handleRetransmissionWritten(
@@ -118,10 +122,7 @@ void handleRetransmissionWritten(
     bool frameFin,
     PacketNum packetNum) {
   conn.lossState.totalBytesRetransmitted += frameLen;
-  auto lossBufferIter = std::find_if(
-      stream.lossBuffer.begin(),
-      stream.lossBuffer.end(),
-      [&](const auto& buffer) { return frameOffset == buffer.offset; });
+  auto lossBufferIter = stream.lossBuffer.find(frameOffset);
   CHECK(lossBufferIter != stream.lossBuffer.end());
   VLOG(10) << nodeToString(conn.nodeType) << " sent retransmission"
            << " packetNum=" << packetNum << " " << conn;
@@ -129,23 +130,14 @@ void handleRetransmissionWritten(
   Buf bufWritten;
   if (frameLen == bufferLen && frameFin == lossBufferIter->eof) {
     // The buffer is entirely retransmitted
-    bufWritten = lossBufferIter->data.move();
-    stream.lossBuffer.erase(lossBufferIter);
+    bufWritten = stream.lossBuffer.extract(lossBufferIter).data.move();
   } else {
     lossBufferIter->offset += frameLen;
     bufWritten = lossBufferIter->data.split(frameLen);
+    stream.lossBuffer.onDataTrimmed(frameLen);
   }
-  stream.retransmissionBuffer.emplace(
-      std::upper_bound(
-          stream.retransmissionBuffer.begin(),
-          stream.retransmissionBuffer.end(),
-          frameOffset,
-          [](const auto& offsetIn, const auto& buffer) {
-            return offsetIn < buffer.offset;
-          }),
-      std::move(bufWritten),
-      frameOffset,
-      frameFin);
+  stream.retransmissionBuffer.insert(
+      StreamBuffer(std::move(bufWritten), frameOffset, frameFin));
 }
 
 /**
@@ -169,16 +161,15 @@ bool handleStreamWritten(
   }
 
   // If the data is in retx buffer, this is a clone write
-  auto retxBufferIter = std::find_if(
-      stream.retransmissionBuffer.begin(),
-      stream.retransmissionBuffer.end(),
-      [&](const auto& buffer) {
-        return frameOffset == buffer.offset &&
-            frameLen == buffer.data.chainLength() && frameFin == buffer.eof;
-      });
-  if (retxBufferIter != stream.retransmissionBuffer.end()) {
-    conn.lossState.totalStreamBytesCloned += frameLen;
-    return false;
+  for (auto retxBufferIter = stream.retransmissionBuffer.find(frameOffset);
+       retxBufferIter != stream.retransmissionBuffer.end() &&
+       retxBufferIter->offset == frameOffset;
+       ++retxBufferIter) {
+    if (frameLen == retxBufferIter->data.chainLength() &&
+        frameFin == retxBufferIter->eof) {
+      conn.lossState.totalStreamBytesCloned += frameLen;
+      return false;
+    }
   }
 
   // If it's neither new data nor clone data, then it is a retransmission and
@@ -194,7 +185,8 @@ void updateConnection(
     folly::Optional<PacketEvent> packetEvent,
     RegularQuicWritePacket packet,
     TimePoint sentTime,
-    uint32_t encodedSize) {
+    uint32_t encodedSize,
+    bool isPathMtuProbe) {
   auto packetNum = folly::variant_match(
       packet.header, [](const auto& h) { return h.getPacketSequenceNum(); });
   bool retransmittable = false; // AckFrame and PaddingFrame are not retx-able.
@@ -207,6 +199,8 @@ void updateConnection(
            << " in space=" << packetNumberSpace << " size=" << encodedSize
            << " " << conn;
   if (conn.qLogger) {
+    ScopedAllocationAccounting loggingAccounting(
+        conn, ConnectionAllocationUsage::Subsystem::Logging);
     conn.qLogger->addPacket(packet, encodedSize);
   }
   for (const auto& frame : packet.frames) {
@@ -227,7 +221,11 @@ void updateConnection(
           if (newStreamDataWritten) {
             updateFlowControlOnWriteToSocket(*stream, writeStreamFrame.len);
             maybeWriteBlockAfterSocketWrite(*stream);
+            // Only new data takes tokens, retransmissions are not limited.
+            consumeStreamSendRate(*stream, writeStreamFrame.len, sentTime);
+            updateDeliveryLatencyOnSent(*stream, sentTime);
             conn.streamManager->updateWritableStreams(*stream);
+            onStreamFrameSent(conn, *stream, writeStreamFrame);
           }
           conn.streamManager->updateLossStreams(*stream);
         },
@@ -304,6 +302,13 @@ void updateConnection(
           onStreamWindowUpdateSent(
               *stream, packetNum, maxStreamDataFrame.maximumData, sentTime);
         },
+        [&](const MaxStreamsFrame& maxStreamsFrame) {
+          retransmittable = true;
+          VLOG(10) << nodeToString(conn.nodeType)
+                   << " sent max streams=" << maxStreamsFrame.maxStreams
+                   << " packetNum=" << packetNum << " " << conn;
+          conn.streamManager->onStreamLimitUpdateSent(maxStreamsFrame);
+        },
         [&](const StreamDataBlockedFrame& streamBlockedFrame) {
           VLOG(10) << nodeToString(conn.nodeType)
                    << " sent blocked stream frame packetNum=" << packetNum
@@ -320,6 +325,24 @@ void updateConnection(
           //    ack packets should not count towards the window either
           // 2. Of course we do not want to retransmit the ACK frames.
         },
+        [&](const WriteDatagramFrame&) {
+          // Datagrams are never retransmitted, but they still elicit acks
+          // and count towards the congestion window.
+          retransmittable = true;
+          // The scheduler writes the datagrams from the front of the queue.
+          auto& writeBuffer = conn.datagramState.writeBuffer;
+          if (!writeBuffer.empty()) {
+            writeBuffer.pop_front();
+          }
+        },
+        [&](const WriteRepairFrame&) {
+          // Like datagrams, repair frames are never retransmitted.
+          retransmittable = true;
+          auto& pendingRepairs = conn.fecState.pendingRepairs;
+          if (!pendingRepairs.empty()) {
+            pendingRepairs.pop_front();
+          }
+        },
         [&](const QuicSimpleFrame& simpleFrame) {
           retransmittable = true;
           // We don't want this triggered for cloned frames.
@@ -330,6 +353,11 @@ void updateConnection(
         [&](const auto&) { retransmittable = true; });
   }
 
+  folly::variant_match(
+      packet.header,
+      [&](const ShortHeader&) { onKeyPhasePacketWritten(conn, packetNum); },
+      [](const auto&) {});
+
   // TODO: Now pureAck is equivalent to non retransmittable packet. This might
   // change in the future.
   auto pureAck = !retransmittable;
@@ -343,6 +371,8 @@ void updateConnection(
   pkt.isAppLimited = conn.congestionController
       ? conn.congestionController->isAppLimited()
       : false;
+  pkt.ecnMarked = conn.ecnState == QuicConnectionStateBase::EcnState::Enabled;
+  pkt.isPathMtuProbe = isPathMtuProbe;
   if (conn.lossState.lastAckedTime.hasValue() &&
       conn.lossState.lastAckedPacketSentTime.hasValue()) {
     pkt.lastAckedPacketInfo.emplace(
@@ -372,7 +402,9 @@ void updateConnection(
       (int)pureAck,
       pkt.isAppLimited);
   conn.lossState.largestSent = std::max(conn.lossState.largestSent, packetNum);
-  if (conn.congestionController && !pureAck) {
+  if (conn.congestionController && !pureAck && !isPathMtuProbe) {
+    ScopedAllocationAccounting congestionControlAccounting(
+        conn, ConnectionAllocationUsage::Subsystem::CongestionControl);
     conn.congestionController->onPacketSent(pkt);
     // An approximation of the app being blocked. The app
     // technically might not have bytes to write.
@@ -401,16 +433,7 @@ void updateConnection(
     ++conn.lossState.timeoutBasedRtxCount;
   }
 
-  auto packetIt = std::lower_bound(
-      conn.outstandingPackets.begin(),
-      conn.outstandingPackets.end(),
-      packetNum,
-      [&](const auto& packetWithTime, const auto& val) {
-        return folly::variant_match(
-            packetWithTime.packet.header,
-            [&val](const auto& h) { return h.getPacketSequenceNum() < val; });
-      });
-  conn.outstandingPackets.insert(packetIt, std::move(pkt));
+  conn.outstandingPackets.insert(std::move(pkt));
 
   auto opCount = conn.outstandingPackets.size();
   DCHECK_GE(opCount, conn.outstandingPureAckPacketsCount);
@@ -464,14 +487,13 @@ HeaderBuilder LongHeaderBuilder(LongHeader::Types packetType) {
   };
 }
 
-HeaderBuilder ShortHeaderBuilder() {
-  return [](const ConnectionId& /* srcConnId */,
-            const ConnectionId& dstConnId,
-            PacketNum packetNum,
-            QuicVersion,
-            Buf) {
-    return ShortHeader(ProtectionType::KeyPhaseZero, dstConnId, packetNum);
-  };
+HeaderBuilder ShortHeaderBuilder(ProtectionType keyPhase) {
+  return [keyPhase](
+             const ConnectionId& /* srcConnId */,
+             const ConnectionId& dstConnId,
+             PacketNum packetNum,
+             QuicVersion,
+             Buf) { return ShortHeader(keyPhase, dstConnId, packetNum); };
 }
 
 uint64_t writeQuicDataToSocket(
@@ -483,7 +505,7 @@ uint64_t writeQuicDataToSocket(
     const PacketNumberCipher& headerCipher,
     QuicVersion version,
     uint64_t packetLimit) {
-  auto builder = ShortHeaderBuilder();
+  auto builder = ShortHeaderBuilder(connection.keyUpdateState.writePhase);
   // TODO: In FrameScheduler, Retx is prioritized over new data. We should
   // add a flag to the Scheduler to control the priority between them and see
   // which way is better.
@@ -511,6 +533,18 @@ uint64_t writeQuicDataToSocket(
         aead,
         headerCipher,
         version);
+    if (!written && connection.pathMtuState.probePacketNum) {
+      // The path MTU probe can't be cloned into a smaller packet, a PING gets
+      // it acked or declared lost.
+      written = writePingToSocket(
+          sock,
+          connection,
+          dstConnId,
+          aead,
+          headerCipher,
+          connection.udpSendPacketLen,
+          false);
+    }
     connection.pendingEvents.numProbePackets = 0;
   }
   FrameScheduler scheduler = std::move(FrameScheduler::Builder(
@@ -525,7 +559,9 @@ uint64_t writeQuicDataToSocket(
                                            .windowUpdateFrames()
                                            .blockedFrames()
                                            .cryptoFrames()
-                                           .simpleFrames())
+                                           .simpleFrames()
+                                           .datagramFrames()
+                                           .repairFrames())
                                  .build();
   written += writeConnectionDataToSocket(
       sock,
@@ -540,6 +576,17 @@ uint64_t writeQuicDataToSocket(
       aead,
       headerCipher,
       version);
+  auto now = LoopTime::now();
+  if (written < packetLimit && shouldSendPathMtuProbe(connection, now)) {
+    written += writePingToSocket(
+        sock,
+        connection,
+        dstConnId,
+        aead,
+        headerCipher,
+        getNextPathMtuProbeSize(connection, now),
+        true);
+  }
   VLOG_IF(10, written > 0) << nodeToString(connection.nodeType)
                            << " written data to socket packets=" << written
                            << " " << connection;
@@ -602,7 +649,7 @@ uint64_t writeQuicDataExceptCryptoStreamToSocket(
     const PacketNumberCipher& headerCipher,
     QuicVersion version,
     uint64_t packetLimit) {
-  auto builder = ShortHeaderBuilder();
+  auto builder = ShortHeaderBuilder(connection.keyUpdateState.writePhase);
   uint64_t written = 0;
   if (connection.pendingEvents.numProbePackets) {
     auto probeScheduler = std::move(FrameScheduler::Builder(
@@ -639,7 +686,9 @@ uint64_t writeQuicDataExceptCryptoStreamToSocket(
                                            .resetFrames()
                                            .windowUpdateFrames()
                                            .blockedFrames()
-                                           .simpleFrames())
+                                           .simpleFrames()
+                                           .datagramFrames()
+                                           .repairFrames())
                                  .build();
   written += writeConnectionDataToSocket(
       socket,
@@ -727,6 +776,7 @@ void writeCloseCommon(
       std::move(header),
       getAckState(connection, pnSpace).largestAckedByPeer,
       connection.version.value_or(*connection.originalVersion));
+  packetBuilder.setBufferAllocator(connection.bufferAllocator);
   packetBuilder.setCipherOverhead(aead.getCipherOverhead());
   size_t written = 0;
   if (!closeDetails) {
@@ -758,15 +808,14 @@ void writeCloseCommon(
     return;
   }
   auto packet = std::move(packetBuilder).buildPacket();
-  auto body =
-      aead.encrypt(std::move(packet.body), packet.header.get(), packetNum);
+  auto body = aead.encryptInPlace(
+      std::move(packet.body), packet.header.get(), packetNum);
   HeaderForm headerForm = folly::variant_match(
       header,
       [](const ShortHeader&) { return HeaderForm::Short; },
       [](const LongHeader&) { return HeaderForm::Long; });
   encryptPacketHeader(headerForm, *packet.header, *body, headerCipher);
-  auto packetBuf = std::move(packet.header);
-  packetBuf->prependChain(std::move(body));
+  auto packetBuf = joinPacket(std::move(packet.header), std::move(body));
   auto packetSize = packetBuf->computeChainDataLength();
   if (connection.qLogger) {
     connection.qLogger->addPacket(packet.packet, packetSize);
@@ -786,7 +835,8 @@ void writeCloseCommon(
   // TODO: Do not increase pn if write fails
   increaseNextPacketNum(connection, pnSpace);
   // best effort writing to the socket, ignore any errors.
-  auto ret = sock.write(connection.peerAddress, packetBuf);
+  auto ret = writeFromSource(
+      sock, connection.peerAddress, packetBuf, connection.localAddress);
   connection.lossState.totalBytesSent += packetSize;
   if (ret < 0) {
     VLOG(4) << "Error writing connection close " << folly::errnoStr(errno)
@@ -835,7 +885,7 @@ void writeShortClose(
     const Aead& aead,
     const PacketNumberCipher& headerCipher) {
   auto header = ShortHeader(
-      ProtectionType::KeyPhaseZero,
+      connection.keyUpdateState.writePhase,
       connId,
       getNextPacketNum(connection, PacketNumberSpace::AppData));
   writeCloseCommon(
@@ -847,12 +897,11 @@ void writeShortClose(
       headerCipher);
 }
 
-void encryptPacketHeader(
-    HeaderForm headerForm,
-    folly::IOBuf& header,
-    folly::IOBuf& encryptedBody,
-    const PacketNumberCipher& headerCipher) {
-  // Header encryption.
+namespace {
+
+Sample getHeaderProtectionSample(
+    const folly::IOBuf& header,
+    const folly::IOBuf& encryptedBody) {
   auto packetNumberLength = parsePacketNumberLength(header.data()[0]);
   Sample sample;
   size_t sampleBytesToUse = kMaxPacketNumEncodingSize - packetNumberLength;
@@ -862,19 +911,187 @@ void encryptPacketHeader(
   sampleCursor.skip(sampleBytesToUse);
   CHECK(sampleCursor.canAdvance(sample.size())) << "Not enough sample bytes";
   sampleCursor.pull(sample.data(), sample.size());
+  return sample;
+}
 
+std::pair<folly::MutableByteRange, folly::MutableByteRange>
+getHeaderProtectionRanges(folly::IOBuf& header) {
+  auto packetNumberLength = parsePacketNumberLength(header.data()[0]);
   // This should already be a single buffer.
   header.coalesce();
-  folly::MutableByteRange initialByteRange(header.writableData(), 1);
-  folly::MutableByteRange packetNumByteRange(
-      header.writableData() + header.length() - packetNumberLength,
-      packetNumberLength);
+  return std::make_pair(
+      folly::MutableByteRange(header.writableData(), 1),
+      folly::MutableByteRange(
+          header.writableData() + header.length() - packetNumberLength,
+          packetNumberLength));
+}
+
+// A packet whose body is encrypted but whose header is not protected yet.
+// Packets that go through the encryption pipeline are still plaintext.
+struct EncryptedPacket {
+  HeaderForm headerForm;
+  Buf header;
+  Buf body;
+  PacketNum packetNum{0};
+};
+
+std::unique_ptr<BatchWriter> makeBatchWriter(
+    folly::AsyncUDPSocket& sock,
+    QuicConnectionStateBase& connection) {
+  // The factory looks for GSO on the socket it is given. While happy eyeballs
+  // races, the batch may only go to the second socket, or it goes to both, in
+  // which case it is sent with sendmmsg unless both of them have GSO.
+  auto batchingMode = connection.transportSettings.batchingMode;
+  auto gsoSock = &sock;
+  const auto& happyEyeballsState = connection.happyEyeballsState;
+  if (happyEyeballsState.secondSocket &&
+      happyEyeballsState.shouldWriteToSecondSocket) {
+    if (!happyEyeballsState.shouldWriteToFirstSocket) {
+      gsoSock = happyEyeballsState.secondSocket.get();
+    } else if (
+        (batchingMode == QuicBatchingMode::BATCHING_MODE_GSO ||
+         batchingMode == QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO) &&
+        (sock.getGSO() < 0 || happyEyeballsState.secondSocket->getGSO() < 0)) {
+      batchingMode = QuicBatchingMode::BATCHING_MODE_SENDMMSG;
+    }
+  }
+  return BatchWriterFactory::makeBatchWriter(
+      *gsoSock,
+      batchingMode,
+      connection.transportSettings.maxBatchSize,
+      connection.egressBatcher,
+      connection.zeroCopySender,
+      connection.transportSettings.pacingUseTxTime &&
+              isConnectionPaced(connection)
+          ? connection.pacer.get()
+          : nullptr,
+      connection.localAddress);
+}
+
+/**
+ * Protects the headers of all the packets, computing all their masks with a
+ * single call into the header cipher.
+ */
+void protectPacketHeaders(
+    std::vector<EncryptedPacket>& packets,
+    const PacketNumberCipher& headerCipher) {
+  if (packets.empty()) {
+    return;
+  }
+  std::array<Sample, kMaxHeaderProtectionBatchSize> samples;
+  std::array<HeaderProtectionMask, kMaxHeaderProtectionBatchSize> masks;
+  CHECK_LE(packets.size(), samples.size());
+  for (size_t i = 0; i < packets.size(); ++i) {
+    samples[i] =
+        getHeaderProtectionSample(*packets[i].header, *packets[i].body);
+  }
+  headerCipher.batchMask(
+      folly::Range<const Sample*>(samples.data(), packets.size()),
+      masks.data());
+  for (size_t i = 0; i < packets.size(); ++i) {
+    auto ranges = getHeaderProtectionRanges(*packets[i].header);
+    if (packets[i].headerForm == HeaderForm::Short) {
+      headerCipher.encryptShortHeaderWithMask(
+          masks[i], ranges.first, ranges.second);
+    } else {
+      headerCipher.encryptLongHeaderWithMask(
+          masks[i], ranges.first, ranges.second);
+    }
+  }
+}
+
+/**
+ * Encrypts the plaintext bodies of the packets and protects their headers.
+ * This is what the encryption pipeline runs on its helper threads.
+ */
+void encryptPackets(
+    std::vector<EncryptedPacket>& packets,
+    const Aead& aead,
+    const PacketNumberCipher& headerCipher) {
+  for (auto& packet : packets) {
+    packet.body = aead.encryptInPlace(
+        std::move(packet.body), packet.header.get(), packet.packetNum);
+  }
+  protectPacketHeaders(packets, headerCipher);
+}
+
+/**
+ * Writes packets whose headers are protected to the batch. Returns false if
+ * a write failed, the remaining packets are dropped.
+ *
+ * The first packet shares the datagram of the pending coalesced packets when
+ * it fits. If holdLast is set and the last packet is a long header packet
+ * with room left in its datagram, it becomes the pending coalesced packet
+ * instead of being written.
+ */
+bool writeProtectedPackets(
+    std::vector<EncryptedPacket>& packets,
+    IOBufQuicBatch& ioBufBatch,
+    QuicConnectionStateBase& connection,
+    bool holdLast = false) {
+  SCOPE_EXIT {
+    packets.clear();
+  };
+  for (size_t i = 0; i < packets.size(); ++i) {
+    auto packetBuf =
+        joinPacket(std::move(packets[i].header), std::move(packets[i].body));
+    auto encodedSize = packetBuf->computeChainDataLength();
+    // update stats
+    QUIC_STATS(connection.infoCallback, onWrite, encodedSize);
+    QUIC_STATS(connection.infoCallback, onPacketSent);
+    if (connection.pendingCoalescedPackets) {
+      auto pending = std::move(connection.pendingCoalescedPackets);
+      auto pendingSize = pending->computeChainDataLength();
+      if (pendingSize + encodedSize <= connection.udpSendPacketLen) {
+        pending->prependChain(std::move(packetBuf));
+        packetBuf = std::move(pending);
+        encodedSize += pendingSize;
+      } else if (!ioBufBatch.write(std::move(pending), pendingSize)) {
+        return false;
+      }
+    }
+    if (holdLast && i + 1 == packets.size() &&
+        packets[i].headerForm == HeaderForm::Long &&
+        encodedSize < connection.udpSendPacketLen) {
+      connection.pendingCoalescedPackets = std::move(packetBuf);
+      break;
+    }
+    if (!ioBufBatch.write(std::move(packetBuf), encodedSize)) {
+      // it is because a flush() call failed
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Protects the headers of the packets and writes them to the batch, see
+ * writeProtectedPackets.
+ */
+bool writeEncryptedPackets(
+    std::vector<EncryptedPacket>& packets,
+    const PacketNumberCipher& headerCipher,
+    IOBufQuicBatch& ioBufBatch,
+    QuicConnectionStateBase& connection,
+    bool holdLast = false) {
+  protectPacketHeaders(packets, headerCipher);
+  return writeProtectedPackets(packets, ioBufBatch, connection, holdLast);
+}
+
+} // namespace
+
+void encryptPacketHeader(
+    HeaderForm headerForm,
+    folly::IOBuf& header,
+    folly::IOBuf& encryptedBody,
+    const PacketNumberCipher& headerCipher) {
+  // Header encryption.
+  auto sample = getHeaderProtectionSample(header, encryptedBody);
+  auto ranges = getHeaderProtectionRanges(header);
   if (headerForm == HeaderForm::Short) {
-    headerCipher.encryptShortHeader(
-        sample, initialByteRange, packetNumByteRange);
+    headerCipher.encryptShortHeader(sample, ranges.first, ranges.second);
   } else {
-    headerCipher.encryptLongHeader(
-        sample, initialByteRange, packetNumByteRange);
+    headerCipher.encryptLongHeader(sample, ranges.first, ranges.second);
   }
 }
 
@@ -896,13 +1113,8 @@ uint64_t writeConnectionDataToSocket(
            << " writing data using scheduler=" << scheduler.name() << " "
            << connection;
 
-  auto batchWriter = BatchWriterFactory::makeBatchWriter(
-      sock,
-      connection.transportSettings.batchingMode,
-      connection.transportSettings.maxBatchSize);
-
   IOBufQuicBatch ioBufBatch(
-      std::move(batchWriter),
+      makeBatchWriter(sock, connection),
       sock,
       connection.peerAddress,
       connection,
@@ -915,7 +1127,97 @@ uint64_t writeConnectionDataToSocket(
   if (!scheduler.hasData()) {
     connection.debugState.noWriteReason = NoWriteReason::EMPTY_SCHEDULER;
   }
-  while (scheduler.hasData() && ioBufBatch.getPktSent() < packetLimit) {
+  // Long header packets that do not fill their datagram wait for the packets
+  // of the next encryption level.
+  bool coalescePackets = connection.transportSettings.coalescePackets;
+  // Packets are encrypted as they are built, and their headers are protected
+  // in batches right before they are written.
+  std::vector<EncryptedPacket> encryptedPackets;
+  encryptedPackets.reserve(std::min<uint64_t>(
+      packetLimit, static_cast<uint64_t>(kMaxHeaderProtectionBatchSize)));
+  // Unless the batches of 1-RTT packets go to a helper thread to be
+  // encrypted there while the next batch is built. Only the thread of the
+  // lane may touch the ciphers until all the batches are back.
+  EncryptionPipeline::Lane* pipelineLane = nullptr;
+  if (connection.encryptionPipeline &&
+      &aead == connection.oneRttWriteCipher.get() &&
+      connection.lossState.totalBytesSent >=
+          connection.transportSettings.encryptionPipelineMinBytesSent) {
+    pipelineLane = &connection.encryptionPipeline->getLane(&connection);
+  }
+  std::deque<std::unique_ptr<std::vector<EncryptedPacket>>> pipelinedBatches;
+  size_t numPipelinedPackets = 0;
+  const uint64_t cipherOverhead = aead.getCipherOverhead();
+  const auto batchingMode = connection.transportSettings.batchingMode;
+  bool padGSOSegments = connection.transportSettings.padGSOSegments &&
+      &aead == connection.oneRttWriteCipher.get() &&
+      (batchingMode == QuicBatchingMode::BATCHING_MODE_GSO ||
+       batchingMode == QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO ||
+       connection.transportSettings.zeroCopySend);
+  SCOPE_EXIT {
+    // The packets of the batches that were not written are dropped, as when a
+    // write fails.
+    while (!pipelinedBatches.empty()) {
+      try {
+        pipelineLane->waitForOldest();
+      } catch (const std::exception& ex) {
+        LOG(ERROR) << "Encryption failed: " << ex.what() << " " << connection;
+      }
+      pipelinedBatches.pop_front();
+    }
+  };
+  auto writeOldestBatch = [&](bool holdLast) {
+    // The batch is done with once waited for, even if it threw.
+    auto batch = std::move(pipelinedBatches.front());
+    pipelinedBatches.pop_front();
+    numPipelinedPackets -= batch->size();
+    pipelineLane->waitForOldest();
+    return writeProtectedPackets(*batch, ioBufBatch, connection, holdLast);
+  };
+  auto submitBatch = [&] {
+    if (pipelinedBatches.size() == kEncryptionPipelineDepth &&
+        !writeOldestBatch(false)) {
+      return false;
+    }
+    auto batch = std::make_unique<std::vector<EncryptedPacket>>(
+        std::move(encryptedPackets));
+    encryptedPackets.clear();
+    encryptedPackets.reserve(kMaxHeaderProtectionBatchSize);
+    pipelineLane->submit([packets = batch.get(), &aead, &headerCipher] {
+      encryptPackets(*packets, aead, headerCipher);
+    });
+    numPipelinedPackets += batch->size();
+    pipelinedBatches.push_back(std::move(batch));
+    return true;
+  };
+  // Writes a full batch, leaving the next batches to be built.
+  auto writeBatch = [&] {
+    if (!pipelineLane) {
+      return writeEncryptedPackets(
+          encryptedPackets, headerCipher, ioBufBatch, connection);
+    }
+    return submitBatch();
+  };
+  // Writes all the packets built.
+  auto writeAllPackets = [&](bool holdLast) {
+    if (!pipelineLane) {
+      return writeEncryptedPackets(
+          encryptedPackets, headerCipher, ioBufBatch, connection, holdLast);
+    }
+    if (!encryptedPackets.empty() && !submitBatch()) {
+      return false;
+    }
+    while (!pipelinedBatches.empty()) {
+      if (!writeOldestBatch(holdLast && pipelinedBatches.size() == 1)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  while (scheduler.hasData() &&
+         ioBufBatch.getPktSent() + numPipelinedPackets +
+                 encryptedPackets.size() <
+             packetLimit) {
     auto packetNum = getNextPacketNum(connection, pnSpace);
     auto header = builder(
         srcConnId,
@@ -925,7 +1227,6 @@ uint64_t writeConnectionDataToSocket(
         token ? token->clone() : nullptr);
     uint32_t writableBytes = folly::to<uint32_t>(std::min<uint64_t>(
         connection.udpSendPacketLen, writableBytesFunc(connection)));
-    uint64_t cipherOverhead = aead.getCipherOverhead();
     if (writableBytes < cipherOverhead) {
       writableBytes = 0;
     } else {
@@ -936,42 +1237,66 @@ uint64_t writeConnectionDataToSocket(
         std::move(header),
         getAckState(connection, pnSpace).largestAckedByPeer,
         connection.version.value_or(*connection.originalVersion));
+    pktBuilder.setBufferAllocator(connection.bufferAllocator);
     pktBuilder.setCipherOverhead(cipherOverhead);
-    auto result =
-        scheduler.scheduleFramesForPacket(std::move(pktBuilder), writableBytes);
+    pktBuilder.setZeroCopyInsert(
+        connection.transportSettings.zeroCopyStreamData);
+    // Padding is of no use to a packet that is smaller for the cwnd, or that
+    // the packet limit makes the last one.
+    pktBuilder.setPadToFill(
+        padGSOSegments &&
+        writableBytes + cipherOverhead == connection.udpSendPacketLen &&
+        ioBufBatch.getPktSent() + numPipelinedPackets +
+                encryptedPackets.size() + 1 <
+            packetLimit);
+    // Building the packet is counted to the codec, though the scheduler
+    // also reads the streams and the ack state.
+    auto result = [&] {
+      ScopedAllocationAccounting codecAccounting(
+          connection, ConnectionAllocationUsage::Subsystem::Codec);
+      return scheduler.scheduleFramesForPacket(
+          std::move(pktBuilder), writableBytes);
+    }();
     auto& packet = result.second;
     if (!packet || packet->packet.frames.empty()) {
+      if (!writeAllPackets(coalescePackets)) {
+        connection.debugState.noWriteReason = NoWriteReason::SOCKET_FAILURE;
+        return ioBufBatch.getPktSent();
+      }
       ioBufBatch.flush();
       connection.debugState.noWriteReason = NoWriteReason::NO_FRAME;
       return ioBufBatch.getPktSent();
     }
     if (!packet->body) {
       // No more space remaining.
+      if (!writeAllPackets(coalescePackets)) {
+        connection.debugState.noWriteReason = NoWriteReason::SOCKET_FAILURE;
+        return ioBufBatch.getPktSent();
+      }
       ioBufBatch.flush();
       connection.debugState.noWriteReason = NoWriteReason::NO_BODY;
       return ioBufBatch.getPktSent();
     }
-    auto body =
-        aead.encrypt(std::move(packet->body), packet->header.get(), packetNum);
+    // The body is encrypted later on the helper thread when pipelined.
+    auto body = [&] {
+      if (pipelineLane) {
+        return std::move(packet->body);
+      }
+      ScopedAllocationAccounting codecAccounting(
+          connection, ConnectionAllocationUsage::Subsystem::Codec);
+      return aead.encryptInPlace(
+          std::move(packet->body), packet->header.get(), packetNum);
+    }();
 
     HeaderForm headerForm = folly::variant_match(
         packet->packet.header,
         [](const LongHeader&) { return HeaderForm::Long; },
         [](const ShortHeader&) { return HeaderForm::Short; });
-    encryptPacketHeader(headerForm, *packet->header, *body, headerCipher);
-
-    auto packetBuf = std::move(packet->header);
-    packetBuf->prependChain(std::move(body));
-    auto encodedSize = packetBuf->computeChainDataLength();
-
-    bool ret = ioBufBatch.write(std::move(packetBuf), encodedSize);
-
-    if (ret) {
-      // update stats and connection
-      QUIC_STATS(connection.infoCallback, onWrite, encodedSize);
-      QUIC_STATS(connection.infoCallback, onPacketSent);
-    }
+    auto encodedSize = packet->header->computeChainDataLength() +
+        body->computeChainDataLength() + (pipelineLane ? cipherOverhead : 0);
 
+    // The packet number has to move on before the next packet is built, so
+    // the connection is updated before the packet is actually written.
     updateConnection(
         connection,
         std::move(result.first),
@@ -979,18 +1304,109 @@ uint64_t writeConnectionDataToSocket(
         Clock::now(),
         folly::to<uint32_t>(encodedSize));
 
-    // if ioBufBatch.write returns false
-    // it is because a flush() call failed
-    if (!ret) {
+    encryptedPackets.push_back(EncryptedPacket{
+        headerForm, std::move(packet->header), std::move(body), packetNum});
+    if (encryptedPackets.size() == kMaxHeaderProtectionBatchSize &&
+        !writeBatch()) {
       connection.debugState.noWriteReason = NoWriteReason::SOCKET_FAILURE;
       return ioBufBatch.getPktSent();
     }
   }
 
+  if (!writeAllPackets(coalescePackets)) {
+    connection.debugState.noWriteReason = NoWriteReason::SOCKET_FAILURE;
+    return ioBufBatch.getPktSent();
+  }
   ioBufBatch.flush();
   return ioBufBatch.getPktSent();
 }
 
+void writeCoalescedPacketsToSocket(
+    folly::AsyncUDPSocket& sock,
+    QuicConnectionStateBase& connection) {
+  if (!connection.pendingCoalescedPackets) {
+    return;
+  }
+  IOBufQuicBatch ioBufBatch(
+      makeBatchWriter(sock, connection),
+      sock,
+      connection.peerAddress,
+      connection,
+      connection.happyEyeballsState);
+  ioBufBatch.setContinueOnNetworkUnreachable(
+      connection.transportSettings.continueOnNetworkUnreachable);
+  auto buf = std::move(connection.pendingCoalescedPackets);
+  auto encodedSize = buf->computeChainDataLength();
+  if (ioBufBatch.write(std::move(buf), encodedSize)) {
+    ioBufBatch.flush();
+  }
+}
+
+uint64_t writePingToSocket(
+    folly::AsyncUDPSocket& sock,
+    QuicConnectionStateBase& connection,
+    const ConnectionId& dstConnId,
+    const Aead& aead,
+    const PacketNumberCipher& headerCipher,
+    uint64_t packetSize,
+    bool isPathMtuProbe) {
+  auto cipherOverhead = aead.getCipherOverhead();
+  if (packetSize <= cipherOverhead) {
+    return 0;
+  }
+  auto packetNum = getNextPacketNum(connection, PacketNumberSpace::AppData);
+  RegularQuicPacketBuilder pktBuilder(
+      folly::to<uint32_t>(packetSize - cipherOverhead),
+      ShortHeader(connection.keyUpdateState.writePhase, dstConnId, packetNum),
+      getAckState(connection, PacketNumberSpace::AppData).largestAckedByPeer,
+      connection.version.value_or(*connection.originalVersion));
+  pktBuilder.setBufferAllocator(connection.bufferAllocator);
+  pktBuilder.setCipherOverhead(cipherOverhead);
+  if (!writeFrame(PingFrame(), pktBuilder)) {
+    return 0;
+  }
+  // A single frame stands for all the padding, rather than one per byte.
+  PaddingFrame paddingFrame;
+  paddingFrame.numFrames = pktBuilder.remainingSpaceInPkt();
+  if (paddingFrame.numFrames) {
+    writeFrame(paddingFrame, pktBuilder);
+  }
+  auto packet = std::move(pktBuilder).buildPacket();
+  auto body = aead.encryptInPlace(
+      std::move(packet.body), packet.header.get(), packetNum);
+  auto encodedSize =
+      packet.header->computeChainDataLength() + body->computeChainDataLength();
+  updateConnection(
+      connection,
+      folly::none,
+      std::move(packet.packet),
+      Clock::now(),
+      folly::to<uint32_t>(encodedSize),
+      isPathMtuProbe);
+  if (isPathMtuProbe) {
+    onPathMtuProbeSent(connection, packetNum, encodedSize);
+  }
+
+  IOBufQuicBatch ioBufBatch(
+      makeBatchWriter(sock, connection),
+      sock,
+      connection.peerAddress,
+      connection,
+      connection.happyEyeballsState);
+  ioBufBatch.setContinueOnNetworkUnreachable(
+      connection.transportSettings.continueOnNetworkUnreachable);
+  std::vector<EncryptedPacket> encryptedPackets;
+  encryptedPackets.push_back(EncryptedPacket{
+      HeaderForm::Short, std::move(packet.header), std::move(body)});
+  // A probe that is too large for the socket fails with EMSGSIZE, which is
+  // then handled like its loss.
+  if (writeEncryptedPackets(
+          encryptedPackets, headerCipher, ioBufBatch, connection)) {
+    ioBufBatch.flush();
+  }
+  return ioBufBatch.getPktSent();
+}
+
 uint64_t writeProbingDataToSocket(
     folly::AsyncUDPSocket& sock,
     QuicConnectionStateBase& connection,
@@ -1035,23 +1451,26 @@ WriteDataReason shouldWriteData(const QuicConnectionStateBase& conn) {
              << conn;
     return WriteDataReason::ACK;
   }
-  const size_t minimumDataSize = std::max(
-      kLongHeaderHeaderSize + kCipherOverheadHeuristic, sizeof(Sample));
-  if (conn.writableBytesLimit &&
-      (*conn.writableBytesLimit <= conn.lossState.totalBytesSent ||
-       *conn.writableBytesLimit - conn.lossState.totalBytesSent <=
-           minimumDataSize)) {
+  if (isWritableBytesLimitReached(conn)) {
     QUIC_STATS(conn.infoCallback, onCwndBlocked);
     return WriteDataReason::NO_WRITE;
   }
   if (conn.congestionController &&
-      conn.congestionController->getWritableBytes() <= minimumDataSize) {
+      conn.congestionController->getWritableBytes() <=
+          kMinimumPacketDataSize) {
     QUIC_STATS(conn.infoCallback, onCwndBlocked);
     return WriteDataReason::NO_WRITE;
   }
   return hasNonAckDataToWrite(conn);
 }
 
+bool isWritableBytesLimitReached(const QuicConnectionStateBase& conn) {
+  return conn.writableBytesLimit &&
+      (*conn.writableBytesLimit <= conn.lossState.totalBytesSent ||
+       *conn.writableBytesLimit - conn.lossState.totalBytesSent <=
+           kMinimumPacketDataSize);
+}
+
 bool hasAckDataToWrite(const QuicConnectionStateBase& conn) {
   // hasAcksToSchedule tells us whether we have acks.
   // needsToSendAckImmediately tells us when to schedule the acks. If we don't
@@ -1092,6 +1511,9 @@ WriteDataReason hasNonAckDataToWrite(const QuicConnectionStateBase& conn) {
   if (conn.pendingEvents.connWindowUpdate) {
     return WriteDataReason::CONN_WINDOW_UPDATE;
   }
+  if (conn.streamManager->hasStreamLimitUpdates()) {
+    return WriteDataReason::STREAM_LIMIT_UPDATE;
+  }
   if (conn.streamManager->hasBlocked()) {
     return WriteDataReason::BLOCKED;
   }
@@ -1108,6 +1530,17 @@ WriteDataReason hasNonAckDataToWrite(const QuicConnectionStateBase& conn) {
   if ((conn.pendingEvents.pathChallenge != folly::none)) {
     return WriteDataReason::PATHCHALLENGE;
   }
+  if (!conn.datagramState.writeBuffer.empty() && conn.oneRttWriteCipher) {
+    return WriteDataReason::DATAGRAM;
+  }
+  if (!conn.fecState.pendingRepairs.empty() && conn.oneRttWriteCipher) {
+    return WriteDataReason::REPAIR;
+  }
+  if (conn.pathMtuState.phase !=
+          QuicConnectionStateBase::PathMtuState::Phase::Disabled &&
+      shouldSendPathMtuProbe(conn, LoopTime::now())) {
+    return WriteDataReason::PATH_MTU_PROBE;
+  }
   return WriteDataReason::NO_WRITE;
 }
 } // namespace quic
@@ -96,6 +96,11 @@ uint64_t writeZeroRttDataToSocket(
  * TODO: We should probably split "should" and "can" into two APIs.
  */
 WriteDataReason shouldWriteData(const QuicConnectionStateBase& conn);
+
+/**
+ * Returns whether writableBytesLimit leaves no room for another packet.
+ */
+bool isWritableBytesLimitReached(const QuicConnectionStateBase& conn);
 bool hasAckDataToWrite(const QuicConnectionStateBase& conn);
 WriteDataReason hasNonAckDataToWrite(const QuicConnectionStateBase& conn);
 
@@ -136,14 +141,16 @@ bool handleStreamWritten(
     PacketNumberSpace packetNumberSpace);
 
 /**
- * Update the connection state after sending a new packet.
+ * Update the connection state after sending a new packet. Path MTU probes
+ * are not passed to the congestion controller.
  */
 void updateConnection(
     QuicConnectionStateBase& conn,
     folly::Optional<PacketEvent> packetEvent,
     RegularQuicWritePacket packet,
     TimePoint time,
-    uint32_t encodedSize);
+    uint32_t encodedSize,
+    bool isPathMtuProbe = false);
 
 uint64_t congestionControlWritableBytes(const QuicConnectionStateBase& conn);
 
@@ -231,7 +238,30 @@ uint64_t writeProbingDataToSocket(
     const PacketNumberCipher& headerCipher,
     QuicVersion version);
 
+/**
+ * Writes a short header packet with a PING frame, padded to packetSize.
+ * Returns the number of packets written, 0 if the packet could not be built.
+ */
+uint64_t writePingToSocket(
+    folly::AsyncUDPSocket& sock,
+    QuicConnectionStateBase& connection,
+    const ConnectionId& dstConnId,
+    const Aead& aead,
+    const PacketNumberCipher& headerCipher,
+    uint64_t packetSize,
+    bool isPathMtuProbe);
+
+/**
+ * Sends the long header packets that are waiting to be coalesced with the
+ * packets of the next encryption level. Transports call this once they have
+ * written all encryption levels.
+ */
+void writeCoalescedPacketsToSocket(
+    folly::AsyncUDPSocket& sock,
+    QuicConnectionStateBase& connection);
+
 HeaderBuilder LongHeaderBuilder(LongHeader::Types packetType);
-HeaderBuilder ShortHeaderBuilder();
+HeaderBuilder ShortHeaderBuilder(
+    ProtectionType keyPhase = ProtectionType::KeyPhaseZero);
 
 } // namespace quic
@@ -8,6 +8,7 @@
 
 #include <quic/api/IoBufQuicBatch.h>
 #include <gtest/gtest.h>
+#include <quic/api/test/MockQuicStats.h>
 #include <quic/client/state/ClientStateMachine.h>
 #include <quic/state/StateData.h>
 
@@ -82,5 +83,32 @@ TEST(QuicBatch, TestBatchingNoFlush) {
 TEST(QuicBatch, TestBatching) {
   RunTest(kMaxBufs);
 }
+
+TEST(QuicBatch, TestBatchStats) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  folly::SocketAddress peerAddress{"127.0.0.1", 1234};
+  QuicClientConnectionState conn;
+  MockQuicStats stats;
+  conn.infoCallback = &stats;
+  QuicConnectionStateBase::HappyEyeballsState happyEyeballsState;
+  IOBufQuicBatch ioBufBatch(
+      std::make_unique<TestPacketBatchWriter>(kMaxBufs),
+      sock,
+      peerAddress,
+      conn,
+      happyEyeballsState);
+
+  using FlushReason = IOBufQuicBatch::FlushReason;
+  EXPECT_CALL(
+      stats, onWriteBatch(kMaxBufs, kMaxBufs * 4, FlushReason::MAX_BUFS))
+      .Times(2);
+  EXPECT_CALL(stats, onWriteBatch(5, 5 * 4, FlushReason::END_OF_WRITE));
+  EXPECT_CALL(stats, onWriteWouldBlock()).Times(0);
+  for (size_t i = 0; i < 2 * kMaxBufs + 5; i++) {
+    CHECK(ioBufBatch.write(folly::IOBuf::copyBuffer("Test"), 4));
+  }
+  CHECK(ioBufBatch.flush());
+}
 } // namespace testing
 } // namespace quic
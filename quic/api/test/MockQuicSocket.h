@@ -79,10 +79,13 @@ class MockQuicSocket : public QuicSocket {
       setStreamFlowControlWindow,
       folly::Expected<folly::Unit, LocalErrorCode>(StreamId, uint64_t));
   MOCK_METHOD1(setTransportSettings, void(TransportSettings));
+  MOCK_METHOD1(setCongestionControl, void(CongestionControlType));
+  MOCK_METHOD1(setStaticSendRate, void(uint64_t));
   MOCK_CONST_METHOD0(isPartiallyReliableTransport, bool());
   MOCK_METHOD2(
       setReadCallback,
       folly::Expected<folly::Unit, LocalErrorCode>(StreamId, ReadCallback*));
+  MOCK_METHOD1(setStreamsReadyCallback, void(StreamsReadyCallback*));
   MOCK_METHOD1(setConnectionCallback, void(ConnectionCallback*));
   void setEarlyDataAppParamsFunctions(
       folly::Function<bool(const folly::Optional<std::string>&, const Buf&)
@@ -115,6 +118,24 @@ class MockQuicSocket : public QuicSocket {
   using ReadResult =
       folly::Expected<std::pair<folly::IOBuf*, bool>, LocalErrorCode>;
   MOCK_METHOD2(readNaked, ReadResult(StreamId, size_t));
+  folly::Expected<std::vector<StreamReadData>, LocalErrorCode> readAll(
+      size_t maxRead) override {
+    auto res = readAllNaked(maxRead);
+    if (res.hasError()) {
+      return folly::makeUnexpected(res.error());
+    }
+    std::vector<StreamReadData> streamsData;
+    for (auto& streamData : res.value()) {
+      streamsData.push_back(StreamReadData{std::get<0>(streamData),
+                                           Buf(std::get<1>(streamData)),
+                                           std::get<2>(streamData)});
+    }
+    return streamsData;
+  }
+  using ReadAllResult = folly::Expected<
+      std::vector<std::tuple<StreamId, folly::IOBuf*, bool>>,
+      LocalErrorCode>;
+  MOCK_METHOD1(readAllNaked, ReadAllResult(size_t));
   MOCK_METHOD1(
       createBidirectionalStream,
       folly::Expected<StreamId, LocalErrorCode>(bool));
@@ -151,6 +172,47 @@ class MockQuicSocket : public QuicSocket {
   MOCK_METHOD5(
       writeChain,
       WriteResult(StreamId, SharedBuf, bool, bool, DeliveryCallback*));
+  MOCK_METHOD0(flushWrites, folly::Expected<folly::Unit, LocalErrorCode>());
+  MOCK_METHOD6(
+      writeFile,
+      folly::Expected<folly::Unit, LocalErrorCode>(
+          StreamId,
+          int,
+          uint64_t,
+          uint64_t,
+          bool,
+          DeliveryCallback*));
+  MOCK_METHOD1(setDatagramCallback, void(DatagramCallback*));
+  MOCK_METHOD3(
+      setMetricsCallback,
+      void(MetricsCallback*, std::chrono::milliseconds, double));
+  MOCK_CONST_METHOD0(
+      getMetricsHistory,
+      std::vector<TransportMetricsSample>());
+  MOCK_CONST_METHOD0(getDatagramSizeLimit, uint64_t());
+  folly::Expected<folly::Unit, LocalErrorCode> writeDatagram(
+      Buf buf) override {
+    SharedBuf sharedBuf(buf.release());
+    return writeDatagram(sharedBuf);
+  }
+  MOCK_METHOD1(
+      writeDatagram,
+      folly::Expected<folly::Unit, LocalErrorCode>(SharedBuf));
+  folly::Expected<std::vector<Buf>, LocalErrorCode> readDatagrams(
+      size_t atMost) override {
+    auto res = readDatagramsNaked(atMost);
+    if (res.hasError()) {
+      return folly::makeUnexpected(res.error());
+    }
+    std::vector<Buf> datagrams;
+    for (auto datagram : res.value()) {
+      datagrams.push_back(Buf(datagram));
+    }
+    return datagrams;
+  }
+  using ReadDatagramsResult =
+      folly::Expected<std::vector<folly::IOBuf*>, LocalErrorCode>;
+  MOCK_METHOD1(readDatagramsNaked, ReadDatagramsResult(size_t));
   MOCK_METHOD3(
       registerDeliveryCallback,
       folly::Expected<folly::Unit, LocalErrorCode>(
@@ -168,11 +230,23 @@ class MockQuicSocket : public QuicSocket {
       maybeResetStreamFromReadError,
       folly::Expected<folly::Unit, LocalErrorCode>(StreamId, QuicErrorCode));
   MOCK_METHOD2(sendPing, void(PingCallback*, std::chrono::milliseconds));
+  MOCK_METHOD3(
+      requestAckFrequency,
+      folly::Expected<folly::Unit, LocalErrorCode>(
+          uint64_t,
+          std::chrono::microseconds,
+          bool));
   MOCK_CONST_METHOD0(getState, const QuicConnectionStateBase*());
   MOCK_METHOD0(isDetachable, bool());
   MOCK_METHOD1(attachEventBase, void(folly::EventBase*));
   MOCK_METHOD0(detachEventBase, void());
   MOCK_METHOD1(setControlStream, folly::Optional<LocalErrorCode>(StreamId));
+  MOCK_METHOD2(
+      setStreamPriority,
+      folly::Optional<LocalErrorCode>(StreamId, StreamPriority));
+  MOCK_METHOD3(
+      setStreamSendRateLimit,
+      folly::Optional<LocalErrorCode>(StreamId, uint64_t, uint64_t));
 
   MOCK_METHOD2(
       setPeekCallback,
@@ -228,6 +302,12 @@ class MockQuicSocket : public QuicSocket {
           StreamId,
           uint64_t offset));
 
+  MOCK_METHOD2(
+      setStreamDataExpiry,
+      folly::Expected<folly::Unit, LocalErrorCode>(
+          StreamId,
+          folly::Optional<std::chrono::milliseconds>));
+
   ConnectionCallback* cb_;
 
   folly::Function<bool(const folly::Optional<std::string>&, const Buf&)>
@@ -39,8 +39,41 @@ class MockQuicStats : public QuicTransportStatsCallback {
   MOCK_METHOD0(onStreamFlowControlBlocked, void());
   MOCK_METHOD0(onCwndBlocked, void());
   MOCK_METHOD0(onPTO, void());
+  MOCK_METHOD0(onSpuriousLoss, void());
   MOCK_METHOD1(onRead, void(size_t));
   MOCK_METHOD1(onWrite, void(size_t));
+  MOCK_METHOD4(
+      onHandshakeDone,
+      void(
+          std::chrono::microseconds,
+          std::chrono::microseconds,
+          uint64_t,
+          uint64_t));
+  MOCK_METHOD0(onRetrySent, void());
+  MOCK_METHOD1(
+      onSlowStartExit,
+      void(QuicTransportStatsCallback::SlowStartExitReason));
+  MOCK_METHOD1(onRttSample, void(std::chrono::microseconds));
+  MOCK_METHOD1(onCwndSample, void(uint64_t));
+  MOCK_METHOD3(
+      onWriteBatch,
+      void(
+          size_t,
+          size_t,
+          QuicTransportStatsCallback::WriteBatchFlushReason));
+  MOCK_METHOD2(
+      onStreamWriteDelivered,
+      void(std::chrono::microseconds, std::chrono::microseconds));
+  MOCK_METHOD1(onGSOWrite, void(size_t));
+  MOCK_METHOD1(onAmplificationBlocked, void(std::chrono::microseconds));
+  MOCK_METHOD1(
+      onMetricsHistory,
+      void(const std::vector<TransportMetricsSample>&));
+  MOCK_METHOD0(onWriteWouldBlock, void());
+  MOCK_METHOD1(onReadBatch, void(size_t));
+  MOCK_METHOD1(onKernelPacketsDropped, void(uint64_t));
+  MOCK_METHOD2(onRecvBufferOccupancy, void(uint64_t, uint64_t));
+  MOCK_METHOD1(onLoopBusyTime, void(std::chrono::microseconds));
 };
 
 class MockQuicStatsFactory : public QuicTransportStatsCallbackFactory {
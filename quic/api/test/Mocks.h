@@ -63,6 +63,35 @@ class MockReadCallback : public QuicSocket::ReadCallback {
           std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>));
 };
 
+class MockStreamsReadyCallback : public QuicSocket::StreamsReadyCallback {
+ public:
+  ~MockStreamsReadyCallback() override = default;
+  GMOCK_METHOD1_(
+      ,
+      noexcept,
+      ,
+      readAvailable,
+      void(folly::Range<const StreamId*>));
+  GMOCK_METHOD1_(, noexcept, , writeReady, void(folly::Range<const StreamId*>));
+};
+
+class MockDatagramCallback : public QuicSocket::DatagramCallback {
+ public:
+  ~MockDatagramCallback() override = default;
+  GMOCK_METHOD0_(, noexcept, , onDatagramsAvailable, void());
+};
+
+class MockMetricsCallback : public QuicSocket::MetricsCallback {
+ public:
+  ~MockMetricsCallback() override = default;
+  GMOCK_METHOD1_(
+      ,
+      noexcept,
+      ,
+      onMetrics,
+      void(const QuicSocket::ConnectionMetrics&));
+};
+
 class MockPeekCallback : public QuicSocket::PeekCallback {
  public:
   ~MockPeekCallback() override = default;
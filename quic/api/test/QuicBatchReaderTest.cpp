@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicBatchReader.h>
+#include <quic/api/QuicSocketTimestamps.h>
+#include <quic/state/StateData.h>
+
+#include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+
+namespace quic {
+namespace testing {
+
+TEST(QuicBatchReader, SplitCoalescedBuffer) {
+  std::string str(1000, 'a');
+  str.append(1000, 'b');
+  str.append(500, 'c');
+  auto buf = folly::IOBuf::copyBuffer(str);
+  std::vector<std::unique_ptr<folly::IOBuf>> segments;
+  QuicBatchReader::splitCoalescedBuffer(
+      std::move(buf), 1000, [&](std::unique_ptr<folly::IOBuf> segment) {
+        segments.push_back(std::move(segment));
+      });
+  ASSERT_EQ(segments.size(), 3);
+  EXPECT_EQ(segments[0]->moveToFbString(), std::string(1000, 'a'));
+  EXPECT_EQ(segments[1]->moveToFbString(), std::string(1000, 'b'));
+  EXPECT_EQ(segments[2]->moveToFbString(), std::string(500, 'c'));
+}
+
+TEST(QuicBatchReader, SplitCoalescedBufferExactMultiple) {
+  auto buf = folly::IOBuf::copyBuffer(std::string(300, 'x'));
+  size_t numSegments = 0;
+  QuicBatchReader::splitCoalescedBuffer(
+      std::move(buf), 100, [&](std::unique_ptr<folly::IOBuf> segment) {
+        EXPECT_EQ(segment->length(), 100);
+        numSegments++;
+      });
+  EXPECT_EQ(numSegments, 3);
+}
+
+#ifdef __linux__
+TEST(QuicBatchReader, ReadBatch) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.setReuseAddr(false);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.setReuseAddr(false);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  constexpr size_t kNumPackets = 5;
+  for (size_t i = 0; i < kNumPackets; ++i) {
+    client.write(
+        server.address(), folly::IOBuf::copyBuffer(std::string(i + 1, 'q')));
+  }
+
+  QuicBatchReader reader(
+      kDefaultQuicMaxRecvBatchSize, kDefaultUDPReadBufferSize, false);
+  std::vector<std::unique_ptr<folly::IOBuf>> packets;
+  auto onDatagram = [&](const folly::SocketAddress& peer,
+                        std::unique_ptr<folly::IOBuf> data,
+                        EcnCodepoint ecn,
+                        folly::Optional<TimePoint> receiveTime,
+                        const folly::Optional<folly::IPAddress>& local) {
+    EXPECT_EQ(peer, client.address());
+    EXPECT_EQ(ecn, EcnCodepoint::NotEct);
+    EXPECT_FALSE(receiveTime.hasValue());
+    EXPECT_FALSE(local.hasValue());
+    packets.push_back(std::move(data));
+  };
+  while (packets.size() < kNumPackets) {
+    ASSERT_GE(reader.read(server.getNetworkSocket(), onDatagram), 0);
+  }
+  for (size_t i = 0; i < kNumPackets; ++i) {
+    EXPECT_EQ(packets[i]->length(), i + 1);
+  }
+  // Nothing left to read.
+  EXPECT_EQ(reader.read(server.getNetworkSocket(), onDatagram), 0);
+}
+
+class CountingBufferAllocator : public BufferAllocator {
+ public:
+  std::unique_ptr<folly::IOBuf> getBuffer(size_t size) override {
+    numBuffers++;
+    return folly::IOBuf::create(size);
+  }
+
+  size_t numBuffers{0};
+};
+
+TEST(QuicBatchReader, ReplacesOnlyHeldBuffers) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  constexpr size_t kMaxDatagrams = 4;
+  QuicBatchReader reader(kMaxDatagrams, kDefaultUDPReadBufferSize, false);
+  CountingBufferAllocator allocator;
+  reader.setBufferAllocator(&allocator);
+  std::vector<std::unique_ptr<folly::IOBuf>> held;
+  auto onDatagram = [&](const folly::SocketAddress&,
+                        std::unique_ptr<folly::IOBuf> data,
+                        EcnCodepoint,
+                        folly::Optional<TimePoint>,
+                        const folly::Optional<folly::IPAddress>&) {
+    // Only the first datagram of every batch is held.
+    if (data->length() == strlen("held")) {
+      held.push_back(std::move(data));
+    }
+  };
+  auto readBatch = [&](size_t numPackets) {
+    client.write(server.address(), folly::IOBuf::copyBuffer("held"));
+    for (size_t i = 1; i < numPackets; ++i) {
+      client.write(server.address(), folly::IOBuf::copyBuffer("dropped"));
+    }
+    size_t numRead = 0;
+    while (numRead < numPackets) {
+      int ret = reader.read(server.getNetworkSocket(), onDatagram);
+      ASSERT_GE(ret, 0);
+      numRead += ret;
+    }
+  };
+
+  readBatch(kMaxDatagrams);
+  EXPECT_EQ(allocator.numBuffers, kMaxDatagrams);
+  readBatch(kMaxDatagrams);
+  EXPECT_EQ(allocator.numBuffers, kMaxDatagrams + 1);
+  held.clear();
+  readBatch(kMaxDatagrams);
+  EXPECT_EQ(allocator.numBuffers, kMaxDatagrams + 1);
+}
+
+// Fails the first reads with the given errno.
+class FailingBatchReader : public QuicBatchReader {
+ public:
+  FailingBatchReader(int err, size_t failures)
+      : QuicBatchReader(
+            kDefaultQuicMaxRecvBatchSize,
+            kDefaultUDPReadBufferSize,
+            false),
+        err_(err),
+        failures_(failures) {}
+
+  size_t calls{0};
+
+ protected:
+  int recvmmsg(
+      folly::NetworkSocket fd,
+      struct mmsghdr* msgs,
+      unsigned int vlen) override {
+    if (calls++ < failures_) {
+      errno = err_;
+      return -1;
+    }
+    return QuicBatchReader::recvmmsg(fd, msgs, vlen);
+  }
+
+ private:
+  int err_;
+  size_t failures_;
+};
+
+TEST(QuicBatchReader, ReadErrors) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  size_t numPackets = 0;
+  auto onDatagram = [&](const folly::SocketAddress&,
+                        std::unique_ptr<folly::IOBuf>,
+                        EcnCodepoint,
+                        folly::Optional<TimePoint>,
+                        const folly::Optional<folly::IPAddress>&) {
+    numPackets++;
+  };
+
+  // Interrupted reads are retried right away.
+  client.write(server.address(), folly::IOBuf::copyBuffer("hello"));
+  FailingBatchReader interrupted(EINTR, 2);
+  int ret = 0;
+  while (ret == 0) {
+    ret = interrupted.read(server.getNetworkSocket(), onDatagram);
+  }
+  EXPECT_EQ(ret, 1);
+  EXPECT_EQ(numPackets, 1);
+  EXPECT_GE(interrupted.calls, 3);
+
+  // Transient errors read nothing, the socket stays usable.
+  FailingBatchReader noBufs(ENOBUFS, 1);
+  EXPECT_EQ(noBufs.read(server.getNetworkSocket(), onDatagram), 0);
+  client.write(server.address(), folly::IOBuf::copyBuffer("world"));
+  ret = 0;
+  while (ret == 0) {
+    ret = noBufs.read(server.getNetworkSocket(), onDatagram);
+  }
+  EXPECT_EQ(ret, 1);
+  EXPECT_EQ(numPackets, 2);
+
+  FailingBatchReader badFd(EBADF, 1);
+  EXPECT_EQ(badFd.read(server.getNetworkSocket(), onDatagram), -1);
+  EXPECT_EQ(errno, EBADF);
+  EXPECT_EQ(numPackets, 2);
+}
+
+TEST(QuicBatchReader, ReadKernelTimestamps) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.setReuseAddr(false);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.setReuseAddr(false);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  if (!enableRxTimestamps(server.getNetworkSocket(), false)) {
+    return;
+  }
+
+  auto beforeSend = Clock::now();
+  client.write(server.address(), folly::IOBuf::copyBuffer("timestamped"));
+  QuicBatchReader reader(
+      kDefaultQuicMaxRecvBatchSize,
+      kDefaultUDPReadBufferSize,
+      false,
+      false,
+      true);
+  folly::Optional<TimePoint> receiveTime;
+  size_t numPackets = 0;
+  while (numPackets == 0) {
+    ASSERT_GE(
+        reader.read(
+            server.getNetworkSocket(),
+            [&](const folly::SocketAddress&,
+                std::unique_ptr<folly::IOBuf>,
+                EcnCodepoint,
+                folly::Optional<TimePoint> time,
+                const folly::Optional<folly::IPAddress>&) {
+              receiveTime = time;
+              numPackets++;
+            }),
+        0);
+  }
+  ASSERT_TRUE(receiveTime.hasValue());
+  // The clocks are converted with some error.
+  EXPECT_GE(*receiveTime, beforeSend - std::chrono::milliseconds(1));
+  EXPECT_LE(*receiveTime, Clock::now());
+}
+
+TEST(QuicBatchReader, ReadPacketInfo) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.setReuseAddr(false);
+  server.bind(folly::SocketAddress("0.0.0.0", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.setReuseAddr(false);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  if (!QuicBatchReader::enablePacketInfo(server.getNetworkSocket(), AF_INET)) {
+    return;
+  }
+
+  client.write(
+      folly::SocketAddress("127.0.0.1", server.address().getPort()),
+      folly::IOBuf::copyBuffer("to a wildcard socket"));
+  QuicBatchReader reader(
+      kDefaultQuicMaxRecvBatchSize,
+      kDefaultUDPReadBufferSize,
+      false,
+      false,
+      false,
+      true);
+  folly::Optional<folly::IPAddress> localAddress;
+  size_t numPackets = 0;
+  while (numPackets == 0) {
+    ASSERT_GE(
+        reader.read(
+            server.getNetworkSocket(),
+            [&](const folly::SocketAddress&,
+                std::unique_ptr<folly::IOBuf>,
+                EcnCodepoint,
+                folly::Optional<TimePoint>,
+                const folly::Optional<folly::IPAddress>& local) {
+              localAddress = local;
+              numPackets++;
+            }),
+        0);
+  }
+  ASSERT_TRUE(localAddress.hasValue());
+  EXPECT_EQ(folly::IPAddress("127.0.0.1"), *localAddress);
+}
+
+TEST(QuicBatchReader, RecvBufferUsageAndGrowth) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.setReuseAddr(false);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.setReuseAddr(false);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  auto usage = QuicBatchReader::getRecvBufferUsage(server.getNetworkSocket());
+  if (!usage) {
+    return;
+  }
+  EXPECT_EQ(0, usage->usedBytes);
+  EXPECT_GT(usage->size, 0);
+
+  client.write(
+      folly::SocketAddress("127.0.0.1", server.address().getPort()),
+      folly::IOBuf::copyBuffer("queued"));
+  while (usage->usedBytes == 0) {
+    usage = QuicBatchReader::getRecvBufferUsage(server.getNetworkSocket());
+    ASSERT_TRUE(usage.hasValue());
+  }
+
+  // Growing never goes past the bound. It may not grow at all when the
+  // buffer is at net.core.rmem_max already.
+  auto size = usage->size;
+  EXPECT_FALSE(
+      QuicBatchReader::growRecvBuffer(server.getNetworkSocket(), size));
+  auto grown =
+      QuicBatchReader::growRecvBuffer(server.getNetworkSocket(), size * 2);
+  if (grown) {
+    EXPECT_GT(*grown, size);
+    EXPECT_LE(*grown, size * 2);
+  }
+}
+
+TEST(QuicSocketTimestamps, TxTimestamps) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket server(&evb);
+  server.setReuseAddr(false);
+  server.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket client(&evb);
+  client.setReuseAddr(false);
+  client.bind(folly::SocketAddress("127.0.0.1", 0));
+  TxTimestamper timestamper(client, false);
+  if (!timestamper.enabled()) {
+    return;
+  }
+
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  auto sentTime = Clock::now();
+  conn.outstandingPackets.emplace_back(
+      RegularQuicWritePacket(ShortHeader(
+          ProtectionType::KeyPhaseZero,
+          ConnectionId(std::vector<uint8_t>(8, 0x11)),
+          1)),
+      sentTime,
+      100,
+      false,
+      false,
+      100);
+  client.write(server.address(), folly::IOBuf::copyBuffer("timestamped"));
+  timestamper.onBatchWritten(Clock::now());
+  EXPECT_EQ(1, timestamper.numPendingBatches());
+  auto deadline = Clock::now() + std::chrono::seconds(1);
+  while (timestamper.numPendingBatches() > 0 && Clock::now() < deadline) {
+    timestamper.reapTimestamps(conn);
+  }
+  EXPECT_EQ(0, timestamper.numPendingBatches());
+  EXPECT_GE(conn.outstandingPackets.front().time, sentTime);
+}
+#endif
+
+TEST(QuicSocketTimestamps, KernelTimeToTimePoint) {
+  auto now = Clock::now();
+  auto realNow = std::chrono::system_clock::now();
+  auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        realNow.time_since_epoch()) -
+      std::chrono::milliseconds(3);
+  struct timespec kernelTime;
+  kernelTime.tv_sec = sinceEpoch.count() / 1000000000;
+  kernelTime.tv_nsec = sinceEpoch.count() % 1000000000;
+  auto time = kernelTimeToTimePoint(kernelTime, now, realNow);
+  ASSERT_TRUE(time.hasValue());
+  EXPECT_EQ(now - std::chrono::milliseconds(3), *time);
+
+  // In the future, long ago or not set at all
+  kernelTime.tv_sec += 1;
+  EXPECT_FALSE(kernelTimeToTimePoint(kernelTime, now, realNow).hasValue());
+  kernelTime.tv_sec -= 10;
+  EXPECT_FALSE(kernelTimeToTimePoint(kernelTime, now, realNow).hasValue());
+  kernelTime.tv_sec = 0;
+  kernelTime.tv_nsec = 0;
+  EXPECT_FALSE(kernelTimeToTimePoint(kernelTime, now, realNow).hasValue());
+}
+
+} // namespace testing
+} // namespace quic
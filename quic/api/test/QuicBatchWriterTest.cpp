@@ -6,10 +6,16 @@
  *
  */
 
+#include <quic/api/QuicBatchReader.h>
 #include <quic/api/QuicBatchWriter.h>
+#include <quic/state/test/Mocks.h>
 
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <thread>
+#include <vector>
+
 namespace quic {
 namespace testing {
 
@@ -90,6 +96,9 @@ TEST(QuicBatchWriter, TestBatchingGSOLastSmallPacket) {
       EXPECT_FALSE(batchWriter->needsFlush(kStrLenLT));
       CHECK(batchWriter->append(std::move(buf), kStrLenLT));
       CHECK_EQ(batchWriter->size(), kStrLen + kStrLenLT);
+      EXPECT_EQ(
+          BatchWriter::FlushReason::SIZE_MISMATCH,
+          batchWriter->getAppendFlushReason());
       batchWriter->reset();
     }
   }
@@ -159,6 +168,34 @@ TEST(QuicBatchWriter, TestBatchingGSOBatchNum) {
   }
 }
 
+TEST(QuicBatchWriter, TestBatchingGSOMaxDatagramSize) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  auto batchWriter = quic::BatchWriterFactory::makeBatchWriter(
+      sock,
+      quic::QuicBatchingMode::BATCHING_MODE_GSO,
+      quic::kDefaultQuicMaxBatchSize);
+  CHECK(batchWriter);
+  if (sock.getGSO() >= 0) {
+    // large packets fill a datagram before the max batch size is reached
+    constexpr size_t kLargePacketLen = 9000;
+    std::string strTest(kLargePacketLen, 'A');
+    size_t size = 0;
+    while (size + kLargePacketLen <= quic::kMaxGSOBufferSize) {
+      EXPECT_FALSE(batchWriter->needsFlush(kLargePacketLen));
+      EXPECT_FALSE(batchWriter->append(
+          folly::IOBuf::copyBuffer(strTest), kLargePacketLen));
+      size += kLargePacketLen;
+    }
+    CHECK_EQ(batchWriter->size(), size);
+    EXPECT_TRUE(batchWriter->needsFlush(kLargePacketLen));
+    batchWriter->reset();
+  }
+}
+
 TEST(QuicBatchWriter, TestBatchingSendmmsg) {
   folly::EventBase evb;
   folly::AsyncUDPSocket sock(&evb);
@@ -192,5 +229,307 @@ TEST(QuicBatchWriter, TestBatchingSendmmsg) {
   }
 }
 
+TEST(QuicBatchWriter, TestBatchingSendmmsgGSO) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  auto batchWriter = quic::BatchWriterFactory::makeBatchWriter(
+      sock, quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO, kBatchNum);
+  CHECK(batchWriter);
+  // if GSO is not available, we fall back to plain sendmmsg
+  if (sock.getGSO() < 0) {
+    EXPECT_TRUE(
+        dynamic_cast<SendmmsgPacketBatchWriter*>(batchWriter.get()) !=
+        nullptr);
+  }
+}
+
+TEST(QuicBatchWriter, TestBatchingSendmmsgGSOGrouping) {
+  SendmmsgGSOPacketBatchWriter batchWriter(kBatchNum * 3);
+  std::string strTest(kStrLen, 'A');
+  std::string strTestLT(kStrLenLT, 'A');
+  std::string strTestGT(kStrLenGT, 'A');
+
+  // same size packets go in the same GSO buffer
+  for (auto i = 0; i < kBatchNum; i++) {
+    EXPECT_FALSE(
+        batchWriter.append(folly::IOBuf::copyBuffer(strTest), kStrLen));
+  }
+  EXPECT_EQ(batchWriter.numMessages(), 1);
+  // a smaller one terminates it
+  EXPECT_FALSE(
+      batchWriter.append(folly::IOBuf::copyBuffer(strTestLT), kStrLenLT));
+  EXPECT_EQ(batchWriter.numMessages(), 1);
+  // the next one needs a new GSO buffer
+  EXPECT_FALSE(
+      batchWriter.append(folly::IOBuf::copyBuffer(strTest), kStrLen));
+  EXPECT_EQ(batchWriter.numMessages(), 2);
+  // so does a bigger one
+  EXPECT_FALSE(
+      batchWriter.append(folly::IOBuf::copyBuffer(strTestGT), kStrLenGT));
+  EXPECT_EQ(batchWriter.numMessages(), 3);
+  EXPECT_EQ(
+      batchWriter.size(),
+      kBatchNum * kStrLen + kStrLenLT + kStrLen + kStrLenGT);
+  // no flush needed before any append
+  EXPECT_FALSE(batchWriter.needsFlush(kStrLenGT));
+  // the packets sent on their own are not GSO buffers
+  std::vector<size_t> gsoSegments;
+  batchWriter.visitGSOBuffers(
+      [&](size_t numSegments) { gsoSegments.push_back(numSegments); });
+  EXPECT_EQ(gsoSegments, std::vector<size_t>({kBatchNum + 1}));
+
+  batchWriter.reset();
+  EXPECT_TRUE(batchWriter.empty());
+  EXPECT_EQ(batchWriter.numMessages(), 0);
+}
+
+TEST(QuicBatchWriter, TestBatchingSendmmsgGSOBatchNum) {
+  SendmmsgGSOPacketBatchWriter batchWriter(kBatchNum);
+  std::string strTest(kStrLen, 'A');
+  for (auto i = 0; i < kBatchNum - 1; i++) {
+    EXPECT_FALSE(
+        batchWriter.append(folly::IOBuf::copyBuffer(strTest), kStrLen));
+  }
+  EXPECT_TRUE(batchWriter.append(folly::IOBuf::copyBuffer(strTest), kStrLen));
+}
+
+TEST(QuicBatchWriter, TestEgressBatcherFlushOnLoop) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket peer(&evb);
+  peer.setReuseAddr(false);
+  peer.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  EgressBatcher batcher(&evb, sock, kBatchNum * 2);
+  std::string strTest(kStrLen, 'A');
+  for (auto i = 0; i < kBatchNum; i++) {
+    auto batchWriter = quic::BatchWriterFactory::makeBatchWriter(
+        sock, quic::QuicBatchingMode::BATCHING_MODE_NONE, 1, &batcher);
+    CHECK(batchWriter->append(folly::IOBuf::copyBuffer(strTest), kStrLen));
+    EXPECT_EQ(batchWriter->write(sock, peer.address()), kStrLen);
+  }
+  EXPECT_EQ(batcher.numQueuedPackets(), kBatchNum);
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(batcher.numQueuedPackets(), 0);
+
+  QuicBatchReader reader(kBatchNum * 2, kDefaultUDPReadBufferSize, false);
+  size_t numPackets = 0;
+  while (numPackets < kBatchNum) {
+    ASSERT_GE(
+        reader.read(
+            peer.getNetworkSocket(),
+            [&](const folly::SocketAddress& from,
+                std::unique_ptr<folly::IOBuf> data,
+                EcnCodepoint,
+                folly::Optional<TimePoint>,
+                const folly::Optional<folly::IPAddress>&) {
+              EXPECT_EQ(from, sock.address());
+              EXPECT_EQ(data->length(), kStrLen);
+              numPackets++;
+            }),
+        0);
+  }
+}
+
+TEST(QuicBatchWriter, TestTxTimeOverEgressBatcher) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  EgressBatcher batcher(&evb, sock, kBatchNum);
+  ::testing::NiceMock<quic::test::MockPacer> pacer;
+  auto batchWriter = quic::BatchWriterFactory::makeBatchWriter(
+      sock,
+      quic::QuicBatchingMode::BATCHING_MODE_NONE,
+      kBatchNum,
+      &batcher,
+      nullptr,
+      &pacer);
+  CHECK(batchWriter);
+  // The departure times would be lost in the egress batcher.
+  CHECK(dynamic_cast<quic::TxTimePacketBatchWriter*>(batchWriter.get()));
+}
+
+TEST(QuicBatchWriter, TestEgressBatcherFlushWhenFull) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  EgressBatcher batcher(&evb, sock, kBatchNum);
+  std::string strTest(kStrLen, 'A');
+  for (auto i = 0; i < kBatchNum - 1; i++) {
+    batcher.write(sock, sock.address(), folly::IOBuf::copyBuffer(strTest));
+  }
+  EXPECT_EQ(batcher.numQueuedPackets(), kBatchNum - 1);
+  batcher.write(sock, sock.address(), folly::IOBuf::copyBuffer(strTest));
+  EXPECT_EQ(batcher.numQueuedPackets(), 0);
+}
+
+TEST(QuicBatchWriter, TestEgressBatcherOtherSocket) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket otherSock(&evb);
+  otherSock.setReuseAddr(false);
+  otherSock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  EgressBatcher batcher(&evb, sock, kBatchNum);
+  std::string strTest(kStrLen, 'A');
+  // packets for a socket that is not the batcher's one are not queued
+  EXPECT_EQ(
+      batcher.write(
+          otherSock, sock.address(), folly::IOBuf::copyBuffer(strTest)),
+      kStrLen);
+  EXPECT_EQ(batcher.numQueuedPackets(), 0);
+}
+
+TEST(QuicBatchWriter, TestZeroCopySend) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  ZeroCopySender sender(sock);
+  if (!sender.enabled()) {
+    return;
+  }
+  auto batchWriter = quic::BatchWriterFactory::makeBatchWriter(
+      sock,
+      quic::QuicBatchingMode::BATCHING_MODE_NONE,
+      kBatchNum,
+      nullptr,
+      &sender);
+  CHECK(batchWriter);
+  CHECK(dynamic_cast<quic::ZeroCopyGSOPacketBatchWriter*>(batchWriter.get()));
+
+  std::string strTest(kStrLen, 'A');
+  batchWriter->append(folly::IOBuf::copyBuffer(strTest), kStrLen);
+  EXPECT_EQ(batchWriter->write(sock, sock.address()), kStrLen);
+  batchWriter->reset();
+  // the buffer stays around until the kernel completes the send, which
+  // happens right away on loopback
+  EXPECT_LE(sender.numPendingBuffers(), 1);
+  for (int i = 0; i < 100 && sender.numPendingBuffers() > 0; ++i) {
+    sender.reapCompletions();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(sender.numPendingBuffers(), 0);
+}
+
+TEST(QuicBatchWriter, TestZeroCopyCompletionsFromErrMessages) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  ZeroCopySender sender(sock);
+  if (!sender.enabled()) {
+    return;
+  }
+  class ForwardingErrMessageCallback
+      : public folly::AsyncUDPSocket::ErrMessageCallback {
+   public:
+    explicit ForwardingErrMessageCallback(ZeroCopySender& sender)
+        : sender_(sender) {}
+
+    void errMessage(const cmsghdr& cmsg) noexcept override {
+      sender_.onErrMessage(cmsg);
+    }
+
+    void errMessageError(const folly::AsyncSocketException&) noexcept override {
+    }
+
+   private:
+    ZeroCopySender& sender_;
+  };
+  ForwardingErrMessageCallback errMessageCallback(sender);
+  sock.setErrMessageCallback(&errMessageCallback);
+
+  std::string strTest(kStrLen, 'A');
+  auto buf = folly::IOBuf::copyBuffer(strTest);
+  EXPECT_EQ(sender.write(sock, sock.address(), buf, 0), kStrLen);
+  // The completion wakes up the socket, without another write.
+  for (int i = 0; i < 100 && sender.numPendingBuffers() > 0; ++i) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(sender.numPendingBuffers(), 0);
+  sock.setErrMessageCallback(nullptr);
+}
+
+TEST(QuicBatchWriter, TestZeroCopySendOtherSocket) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("127.0.0.1", 0));
+  folly::AsyncUDPSocket otherSock(&evb);
+  otherSock.setReuseAddr(false);
+  otherSock.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  ZeroCopySender sender(sock);
+  std::string strTest(kStrLen, 'A');
+  auto buf = folly::IOBuf::copyBuffer(strTest);
+  // writes on other sockets are regular copying writes
+  EXPECT_EQ(sender.write(otherSock, sock.address(), buf, 0), kStrLen);
+  EXPECT_EQ(sender.numPendingBuffers(), 0);
+}
+
+TEST(QuicBatchWriter, TestSendFromSourceAddress) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket sock(&evb);
+  sock.setReuseAddr(false);
+  sock.bind(folly::SocketAddress("0.0.0.0", 0));
+  folly::AsyncUDPSocket peer(&evb);
+  peer.setReuseAddr(false);
+  peer.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  // Every address of 127.0.0.0/8 is local.
+  folly::IPAddress source("127.0.0.2");
+  std::string strTest(kStrLen, 'A');
+  auto batchWriter = quic::BatchWriterFactory::makeBatchWriter(
+      sock,
+      quic::QuicBatchingMode::BATCHING_MODE_SENDMMSG,
+      kBatchNum,
+      nullptr,
+      nullptr,
+      nullptr,
+      source);
+  for (auto i = 0; i < kBatchNum; i++) {
+    batchWriter->append(folly::IOBuf::copyBuffer(strTest), kStrLen);
+  }
+  EXPECT_EQ(batchWriter->write(sock, peer.address()), kBatchNum * kStrLen);
+  EXPECT_GT(
+      writeFromSource(
+          sock, peer.address(), folly::IOBuf::copyBuffer(strTest), source),
+      0);
+
+  QuicBatchReader reader(kBatchNum * 2, kDefaultUDPReadBufferSize, false);
+  size_t numPackets = 0;
+  while (numPackets < kBatchNum + 1) {
+    ASSERT_GE(
+        reader.read(
+            peer.getNetworkSocket(),
+            [&](const folly::SocketAddress& from,
+                std::unique_ptr<folly::IOBuf> data,
+                EcnCodepoint,
+                folly::Optional<TimePoint>,
+                const folly::Optional<folly::IPAddress>&) {
+              EXPECT_EQ(from.getIPAddress(), source);
+              EXPECT_EQ(from.getPort(), sock.address().getPort());
+              EXPECT_EQ(data->length(), kStrLen);
+              numPackets++;
+            }),
+        0);
+  }
+}
+
 } // namespace testing
 } // namespace quic
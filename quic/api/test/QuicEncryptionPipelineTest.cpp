@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicEncryptionPipeline.h>
+
+#include <folly/portability/GTest.h>
+
+#include <stdexcept>
+#include <thread>
+
+using namespace quic;
+
+TEST(EncryptionPipelineTest, BatchesRunInOrderOffTheCaller) {
+  EncryptionPipeline pipeline(2, 4);
+  auto& lane = pipeline.getLane(&pipeline);
+  EXPECT_EQ(&lane, &pipeline.getLane(&pipeline));
+  EXPECT_EQ(4, lane.capacity());
+
+  std::vector<int> order;
+  std::thread::id laneThread;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      lane.submit([&order, &laneThread, i] {
+        laneThread = std::this_thread::get_id();
+        order.push_back(i);
+      });
+    }
+    EXPECT_EQ(4, lane.numPending());
+    while (lane.numPending() > 0) {
+      lane.waitForOldest();
+    }
+    EXPECT_NE(std::this_thread::get_id(), laneThread);
+  }
+  EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3}), order);
+}
+
+TEST(EncryptionPipelineTest, ErrorsAreRethrownInOrder) {
+  EncryptionPipeline pipeline(1, 3);
+  auto& lane = pipeline.getLane(nullptr);
+  bool ran = false;
+  lane.submit([] {});
+  lane.submit([] { throw std::runtime_error("encryption failed"); });
+  lane.submit([&ran] { ran = true; });
+  lane.waitForOldest();
+  EXPECT_THROW(lane.waitForOldest(), std::runtime_error);
+  lane.waitForOldest();
+  EXPECT_TRUE(ran);
+  EXPECT_EQ(0, lane.numPending());
+}
+
+TEST(EncryptionPipelineTest, DestroyWithPendingBatches) {
+  bool ran = false;
+  {
+    EncryptionPipeline pipeline(1, 2);
+    pipeline.getLane(nullptr).submit([&ran] { ran = true; });
+  }
+  EXPECT_TRUE(ran);
+}
@@ -90,6 +90,39 @@ namespace test {
 class QuicPacketSchedulerTest : public Test {
  public:
   QuicVersion version{QuicVersion::MVFST};
+
+  StreamId createStreamWithData(
+      QuicServerConnectionState& conn,
+      size_t len,
+      StreamPriority priority) {
+    auto stream = conn.streamManager->createNextBidirectionalStream().value();
+    stream->flowControlState.peerAdvertisedMaxOffset = 100000;
+    stream->priority = priority;
+    writeDataToQuicStream(*stream, buildRandomInputData(len), false);
+    return stream->id;
+  }
+
+  // Schedules the streams of the connection into a new packet and returns
+  // the stream frames written.
+  std::vector<WriteStreamFrame> writeStreamsIntoPacket(
+      QuicServerConnectionState& conn) {
+    ShortHeader shortHeader(
+        ProtectionType::KeyPhaseZero,
+        getTestConnectionId(),
+        getNextPacketNum(conn, PacketNumberSpace::AppData));
+    RegularQuicPacketBuilder builder(
+        conn.udpSendPacketLen,
+        std::move(shortHeader),
+        conn.ackStates.appDataAckState.largestAckedByPeer);
+    StreamFrameScheduler scheduler(conn);
+    scheduler.writeStreams(builder);
+    auto packet = std::move(builder).buildPacket();
+    std::vector<WriteStreamFrame> frames;
+    for (auto& frame : all_frames<WriteStreamFrame>(packet.packet.frames)) {
+      frames.push_back(frame);
+    }
+    return frames;
+  }
 };
 
 TEST_F(QuicPacketSchedulerTest, NoopScheduler) {
@@ -263,6 +296,34 @@ TEST_F(QuicPacketSchedulerTest, StreamFrameSchedulerExists) {
   EXPECT_LT(builder.remainingSpaceInPkt(), originalSpace);
 }
 
+TEST_F(QuicPacketSchedulerTest, WindowUpdatesCarryMaxData) {
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(10);
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  conn.flowControlState.windowSize = 1000;
+  conn.flowControlState.advertisedMaxOffset = 1000;
+  // Not due on its own yet, a quarter of the window was read.
+  conn.flowControlState.sumCurReadOffset = 250;
+
+  WindowUpdateScheduler scheduler(conn);
+  ShortHeader shortHeader(
+      ProtectionType::KeyPhaseZero,
+      getTestConnectionId(),
+      getNextPacketNum(conn, PacketNumberSpace::AppData));
+  RegularQuicPacketBuilder builder(
+      conn.udpSendPacketLen,
+      std::move(shortHeader),
+      conn.ackStates.appDataAckState.largestAckedByPeer);
+  conn.streamManager->queueWindowUpdate(stream->id);
+  scheduler.writeWindowUpdates(builder);
+  auto packet = std::move(builder).buildPacket().packet;
+  ASSERT_EQ(packet.frames.size(), 2);
+  auto maxData = boost::get<MaxDataFrame>(&packet.frames[0]);
+  ASSERT_NE(maxData, nullptr);
+  EXPECT_EQ(maxData->maximumData, 1250);
+  EXPECT_NE(boost::get<MaxStreamDataFrame>(&packet.frames[1]), nullptr);
+}
+
 TEST_F(QuicPacketSchedulerTest, StreamFrameNoSpace) {
   QuicServerConnectionState conn;
   conn.streamManager->setMaxLocalBidirectionalStreams(10);
@@ -305,6 +366,153 @@ TEST_F(QuicPacketSchedulerTest, StreamFrameSchedulerStreamNotExists) {
   EXPECT_EQ(builder.remainingSpaceInPkt(), originalSpace);
 }
 
+TEST_F(QuicPacketSchedulerTest, StreamFrameSchedulerStrictPriority) {
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(10);
+  conn.flowControlState.peerAdvertisedMaxOffset = 100000;
+  conn.transportSettings.streamSchedulingPolicy =
+      StreamSchedulingPolicy::StrictPriority;
+  auto bulk = createStreamWithData(conn, 2000, StreamPriority(5, true, 16));
+  auto control1 =
+      createStreamWithData(conn, 2000, StreamPriority(0, true, 16));
+  auto control2 =
+      createStreamWithData(conn, 2000, StreamPriority(0, true, 16));
+
+  // The urgent streams take turns and preempt the bulk stream.
+  auto frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].streamId, control1);
+  frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].streamId, control2);
+  frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].streamId, control1);
+
+  conn.streamManager->setStreamPriority(
+      *conn.streamManager->getStream(control1), StreamPriority(7, true, 16));
+  conn.streamManager->setStreamPriority(
+      *conn.streamManager->getStream(control2), StreamPriority(7, true, 16));
+  frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 1);
+  EXPECT_EQ(frames[0].streamId, bulk);
+}
+
+TEST_F(QuicPacketSchedulerTest, StreamFrameSchedulerUrgency) {
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(10);
+  conn.flowControlState.peerAdvertisedMaxOffset = 100000;
+  conn.transportSettings.streamSchedulingPolicy =
+      StreamSchedulingPolicy::Urgency;
+  createStreamWithData(conn, 100, StreamPriority(3, true, 16));
+  auto first = createStreamWithData(conn, 100, StreamPriority(3, false, 16));
+  auto second = createStreamWithData(conn, 2000, StreamPriority(3, false, 16));
+
+  // Non-incremental streams go first in stream id order, and the second one
+  // fills the rest of the packet.
+  auto frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[0].streamId, first);
+  EXPECT_EQ(frames[1].streamId, second);
+}
+
+TEST_F(QuicPacketSchedulerTest, StreamFrameSchedulerWeightedRoundRobin) {
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(10);
+  conn.flowControlState.peerAdvertisedMaxOffset = 100000;
+  conn.transportSettings.streamSchedulingPolicy =
+      StreamSchedulingPolicy::WeightedRoundRobin;
+  auto light = createStreamWithData(conn, 5000, StreamPriority(3, false, 1));
+  auto heavy = createStreamWithData(conn, 5000, StreamPriority(3, false, 16));
+
+  auto frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[0].streamId, light);
+  EXPECT_EQ(frames[0].len, kStreamSchedulingQuantum);
+  EXPECT_EQ(frames[1].streamId, heavy);
+  EXPECT_EQ(frames[1].len, 16 * kStreamSchedulingQuantum);
+  EXPECT_EQ(conn.streamManager->getStream(light)->schedulingDeficit, 0);
+  EXPECT_EQ(conn.streamManager->getStream(heavy)->schedulingDeficit, 0);
+}
+
+TEST_F(QuicPacketSchedulerTest, StreamFrameSchedulerSendRateLimit) {
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(10);
+  conn.flowControlState.peerAdvertisedMaxOffset = 100000;
+  conn.transportSettings.streamSchedulingPolicy =
+      StreamSchedulingPolicy::StrictPriority;
+  auto limited = createStreamWithData(conn, 2000, StreamPriority(3, true, 16));
+  auto other = createStreamWithData(conn, 2000, StreamPriority(3, true, 16));
+  setStreamSendRateLimit(
+      *conn.streamManager->getStream(limited), 1000, 100, Clock::now());
+
+  // The limited stream writes its tokens, and the other one fills the rest
+  // of the packet.
+  auto frames = writeStreamsIntoPacket(conn);
+  ASSERT_EQ(frames.size(), 2);
+  EXPECT_EQ(frames[0].streamId, limited);
+  EXPECT_EQ(frames[0].len, 100);
+  EXPECT_EQ(frames[1].streamId, other);
+  EXPECT_GT(frames[1].len, 100);
+}
+
+TEST_F(QuicPacketSchedulerTest, PadToFillWhenMoreDataRemains) {
+  QuicServerConnectionState conn;
+  conn.datagramState.maxWriteFrameSize = kDefaultUDPSendPacketLen;
+  // The second datagram does not fit next to the first one.
+  conn.datagramState.writeBuffer.push_back(buildRandomInputData(700));
+  conn.datagramState.writeBuffer.push_back(buildRandomInputData(900));
+  auto scheduler = std::move(FrameScheduler::Builder(
+                                 conn,
+                                 EncryptionLevel::AppData,
+                                 PacketNumberSpace::AppData,
+                                 "frame")
+                                 .datagramFrames())
+                       .build();
+  auto schedulePacket = [&](bool padToFill) {
+    ShortHeader shortHeader(
+        ProtectionType::KeyPhaseZero,
+        getTestConnectionId(),
+        getNextPacketNum(conn, PacketNumberSpace::AppData));
+    RegularQuicPacketBuilder builder(
+        conn.udpSendPacketLen,
+        std::move(shortHeader),
+        conn.ackStates.appDataAckState.largestAckedByPeer);
+    builder.setPadToFill(padToFill);
+    auto packet = std::move(
+        scheduler
+            .scheduleFramesForPacket(std::move(builder), conn.udpSendPacketLen)
+            .second.value());
+    EXPECT_NE(
+        boost::get<WriteDatagramFrame>(&packet.packet.frames[0]), nullptr);
+    return packet;
+  };
+
+  auto packet = schedulePacket(false);
+  EXPECT_EQ(packet.packet.frames.size(), 1);
+  EXPECT_LT(
+      packet.header->computeChainDataLength() +
+          packet.body->computeChainDataLength(),
+      conn.udpSendPacketLen);
+
+  packet = schedulePacket(true);
+  EXPECT_EQ(
+      packet.header->computeChainDataLength() +
+          packet.body->computeChainDataLength(),
+      conn.udpSendPacketLen);
+  ASSERT_EQ(packet.packet.frames.size(), 2);
+  EXPECT_GT(boost::get<PaddingFrame>(packet.packet.frames[1]).numFrames, 1);
+
+  // Nothing is left after the last packet, it keeps its size.
+  conn.datagramState.writeBuffer.pop_front();
+  packet = schedulePacket(true);
+  EXPECT_LT(
+      packet.header->computeChainDataLength() +
+          packet.body->computeChainDataLength(),
+      conn.udpSendPacketLen);
+  EXPECT_EQ(packet.packet.frames.size(), 1);
+}
+
 TEST_F(QuicPacketSchedulerTest, CloningSchedulerTest) {
   QuicClientConnectionState conn;
   FrameScheduler noopScheduler("frame");
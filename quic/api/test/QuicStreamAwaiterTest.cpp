@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/api/QuicStreamAwaiter.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include <quic/api/test/MockQuicSocket.h>
+#include <quic/api/test/Mocks.h>
+
+using namespace quic;
+using namespace testing;
+
+namespace {
+
+constexpr StreamId kStreamId = 4;
+
+std::pair<folly::IOBuf*, bool> readResult(const std::string& str, bool eof) {
+  return std::pair<folly::IOBuf*, bool>(
+      folly::IOBuf::copyBuffer(str).release(), eof);
+}
+
+} // namespace
+
+class QuicStreamAwaiterTest : public Test {
+ protected:
+  folly::EventBase evb;
+  MockConnectionCallback connCallback;
+  MockQuicSocket sock{&evb, connCallback};
+};
+
+TEST_F(QuicStreamAwaiterTest, ReadWaitsForData) {
+  QuicSocket::ReadCallback* readCb = nullptr;
+  EXPECT_CALL(sock, setReadCallback(kStreamId, _))
+      .WillOnce(DoAll(SaveArg<1>(&readCb), Return(folly::unit)));
+  EXPECT_CALL(sock, readNaked(kStreamId, 100))
+      .WillOnce(Return(readResult("", false)))
+      .WillOnce(Return(readResult("hello", false)));
+  EXPECT_CALL(sock, pauseRead(kStreamId)).WillOnce(Return(folly::unit));
+
+  QuicStreamAwaiter awaiter(sock, kStreamId);
+  std::string received;
+  awaiter.read(100, [&](QuicStreamAwaiter::ReadResult result) {
+    ASSERT_TRUE(result.hasValue());
+    received = result->first->moveToFbString().toStdString();
+  });
+  EXPECT_TRUE(awaiter.readPending());
+  ASSERT_NE(readCb, nullptr);
+  readCb->readAvailable(kStreamId);
+  EXPECT_FALSE(awaiter.readPending());
+  EXPECT_EQ(received, "hello");
+
+  // The next read resumes reading, and completes at once with the EOF.
+  EXPECT_CALL(sock, resumeRead(kStreamId)).WillOnce(Return(folly::unit));
+  EXPECT_CALL(sock, readNaked(kStreamId, 100))
+      .WillOnce(Return(readResult("", true)));
+  EXPECT_CALL(sock, pauseRead(kStreamId)).WillOnce(Return(folly::unit));
+  bool eof = false;
+  awaiter.read(100, [&](QuicStreamAwaiter::ReadResult result) {
+    eof = result->second;
+  });
+  EXPECT_TRUE(eof);
+  EXPECT_CALL(sock, setReadCallback(kStreamId, nullptr))
+      .WillOnce(Return(folly::unit));
+}
+
+TEST_F(QuicStreamAwaiterTest, ReadError) {
+  QuicSocket::ReadCallback* readCb = nullptr;
+  EXPECT_CALL(sock, setReadCallback(kStreamId, _))
+      .WillOnce(DoAll(SaveArg<1>(&readCb), Return(folly::unit)))
+      .WillOnce(Return(folly::unit));
+  EXPECT_CALL(sock, readNaked(kStreamId, _))
+      .WillOnce(Return(readResult("", false)));
+  EXPECT_CALL(sock, pauseRead(kStreamId)).WillOnce(Return(folly::unit));
+
+  QuicStreamAwaiter awaiter(sock, kStreamId);
+  folly::Optional<QuicErrorCode> error;
+  awaiter.read(100, [&](QuicStreamAwaiter::ReadResult result) {
+    error = result.error();
+  });
+  readCb->readError(
+      kStreamId,
+      std::make_pair(LocalErrorCode::CONNECTION_RESET, folly::none));
+  ASSERT_TRUE(error.hasValue());
+  EXPECT_EQ(
+      boost::get<LocalErrorCode>(*error), LocalErrorCode::CONNECTION_RESET);
+}
+
+TEST_F(QuicStreamAwaiterTest, WriteInChunks) {
+  QuicSocket::WriteCallback* writeCb = nullptr;
+  EXPECT_CALL(sock, notifyPendingWriteOnStream(kStreamId, _))
+      .Times(2)
+      .WillRepeatedly(DoAll(SaveArg<1>(&writeCb), Return(folly::unit)));
+  QuicStreamAwaiter awaiter(sock, kStreamId);
+  bool done = false;
+  awaiter.write(
+      folly::IOBuf::copyBuffer("hello world"),
+      true,
+      [&](folly::Expected<folly::Unit, QuicErrorCode> result) {
+        EXPECT_TRUE(result.hasValue());
+        done = true;
+      });
+  ASSERT_NE(writeCb, nullptr);
+
+  // The first chunk is all the transport can take, the eof goes last.
+  EXPECT_CALL(sock, writeChain(kStreamId, _, false, false, nullptr))
+      .WillOnce(Invoke(
+          [](auto, auto data, auto, auto, auto) -> MockQuicSocket::WriteResult {
+            EXPECT_EQ(data->computeChainDataLength(), 5);
+            return nullptr;
+          }));
+  writeCb->onStreamWriteReady(kStreamId, 5);
+  EXPECT_FALSE(done);
+  EXPECT_CALL(sock, writeChain(kStreamId, _, true, false, nullptr))
+      .WillOnce(Invoke(
+          [](auto, auto data, auto, auto, auto) -> MockQuicSocket::WriteResult {
+            EXPECT_EQ(data->computeChainDataLength(), 6);
+            return nullptr;
+          }));
+  writeCb->onStreamWriteReady(kStreamId, 100);
+  EXPECT_TRUE(done);
+  EXPECT_FALSE(awaiter.writePending());
+}
+
+TEST_F(QuicStreamAwaiterTest, WaitForDelivery) {
+  QuicSocket::DeliveryCallback* deliveryCb = nullptr;
+  EXPECT_CALL(sock, registerDeliveryCallback(kStreamId, 10, _))
+      .Times(2)
+      .WillRepeatedly(DoAll(SaveArg<2>(&deliveryCb), Return(folly::unit)));
+  QuicStreamAwaiter awaiter(sock, kStreamId);
+  folly::Optional<bool> delivered;
+  auto cont = [&](folly::Expected<folly::Unit, QuicErrorCode> result) {
+    delivered = result.hasValue();
+  };
+  awaiter.waitForDelivery(10, cont);
+  deliveryCb->onDeliveryAck(kStreamId, 10, std::chrono::microseconds(100));
+  ASSERT_TRUE(delivered.hasValue());
+  EXPECT_TRUE(*delivered);
+
+  delivered = folly::none;
+  awaiter.waitForDelivery(10, cont);
+  deliveryCb->onCanceled(kStreamId, 10);
+  ASSERT_TRUE(delivered.hasValue());
+  EXPECT_FALSE(*delivered);
+  EXPECT_FALSE(awaiter.deliveryPending());
+}
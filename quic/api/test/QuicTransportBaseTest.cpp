@@ -6,6 +6,7 @@
  *
  */
 
+#include <quic/api/test/MockQuicStats.h>
 #include <quic/api/test/Mocks.h>
 
 #include <folly/portability/GMock.h>
@@ -20,6 +21,8 @@
 
 #include <folly/io/async/test/MockAsyncUDPSocket.h>
 
+#include <thread>
+
 using namespace testing;
 using namespace folly;
 
@@ -412,6 +415,24 @@ TEST_F(QuicTransportImplTest, WriteAckPacketUnsetsLooper) {
   EXPECT_FALSE(transport->writeLooper()->isLoopCallbackScheduled());
 }
 
+TEST_F(QuicTransportImplTest, LoopHealthMonitorReadDelay) {
+  LoopHealthMonitor::Thresholds thresholds;
+  thresholds.readDelay = std::chrono::milliseconds(5);
+  auto monitor = std::make_shared<LoopHealthMonitor>(thresholds);
+  transport->setLoopHealthMonitor(monitor);
+  auto stream = transport->createBidirectionalStream().value();
+  auto buf = encodeStreamBuffer(
+      stream, StreamBuffer(folly::IOBuf::copyBuffer("data"), 0));
+  auto receiveTime = Clock::now() - std::chrono::milliseconds(20);
+  SocketAddress addr("127.0.0.1", 1000);
+  transport->onNetworkData(addr, NetworkData(std::move(buf), receiveTime));
+  const auto& reads =
+      monitor->getHistogram(LoopHealthMonitor::Metric::ReadDelay);
+  EXPECT_EQ(1, reads.count);
+  EXPECT_GE(reads.sum, 20000);
+  EXPECT_EQ(1, monitor->getNumAlerts(LoopHealthMonitor::Metric::ReadDelay));
+}
+
 TEST_F(QuicTransportImplTest, ReadCallbackDataAvailable) {
   auto stream1 = transport->createBidirectionalStream().value();
   auto stream2 = transport->createBidirectionalStream().value();
@@ -566,6 +587,99 @@ TEST_F(QuicTransportImplTest, ReadCallbackPauseResume) {
   transport.reset();
 }
 
+class TestStreamDataCallback : public QuicSocket::StreamDataCallback {
+ public:
+  ~TestStreamDataCallback() override = default;
+
+  void onStreamData(StreamId id, Buf data, bool eof) noexcept override {
+    EXPECT_EQ(id, expectedId);
+    received += data ? data->moveToFbString().toStdString() : "";
+    eofReceived = eof;
+    numCalls++;
+  }
+
+  void readError(
+      StreamId,
+      std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>) noexcept
+      override {}
+
+  StreamId expectedId{0};
+  std::string received;
+  bool eofReceived{false};
+  size_t numCalls{0};
+};
+
+TEST_F(QuicTransportImplTest, StreamDataCallbackPushesData) {
+  auto stream = transport->createBidirectionalStream().value();
+  TestStreamDataCallback streamDataCb;
+  streamDataCb.expectedId = stream;
+  transport->setReadCallback(stream, &streamDataCb);
+
+  transport->addDataToStream(
+      stream, StreamBuffer(folly::IOBuf::copyBuffer("hello "), 0));
+  transport->driveReadCallbacks();
+  EXPECT_EQ(streamDataCb.numCalls, 1);
+  EXPECT_EQ(streamDataCb.received, "hello ");
+  EXPECT_FALSE(streamDataCb.eofReceived);
+  auto streamState =
+      transport->getConnectionState().streamManager->getStream(stream);
+  EXPECT_EQ(streamState->currentReadOffset, 6);
+  EXPECT_FALSE(streamState->hasReadableData());
+
+  // Nothing new to hand over.
+  transport->driveReadCallbacks();
+  EXPECT_EQ(streamDataCb.numCalls, 1);
+
+  transport->pauseRead(stream);
+  transport->addDataToStream(
+      stream, StreamBuffer(folly::IOBuf::copyBuffer("world"), 6, true));
+  transport->driveReadCallbacks();
+  EXPECT_EQ(streamDataCb.numCalls, 1);
+
+  transport->resumeRead(stream);
+  transport->driveReadCallbacks();
+  EXPECT_EQ(streamDataCb.numCalls, 2);
+  EXPECT_EQ(streamDataCb.received, "hello world");
+  EXPECT_TRUE(streamDataCb.eofReceived);
+
+  transport->driveReadCallbacks();
+  EXPECT_EQ(streamDataCb.numCalls, 2);
+  transport.reset();
+}
+
+TEST_F(QuicTransportImplTest, StreamsReadAvailableBatched) {
+  auto stream1 = transport->createBidirectionalStream().value();
+  auto stream2 = transport->createBidirectionalStream().value();
+  auto stream3 = transport->createBidirectionalStream().value();
+  MockReadCallback readCb;
+  MockStreamsReadyCallback streamsReadyCb;
+  transport->setStreamsReadyCallback(&streamsReadyCb);
+  transport->setReadCallback(stream1, &readCb);
+  transport->setReadCallback(stream2, &readCb);
+  transport->setReadCallback(stream3, &readCb);
+  transport->pauseRead(stream3);
+  for (auto stream : {stream1, stream2, stream3}) {
+    transport->addDataToStream(
+        stream, StreamBuffer(folly::IOBuf::copyBuffer("stream data"), 0));
+  }
+
+  EXPECT_CALL(readCb, readAvailable(_)).Times(0);
+  EXPECT_CALL(streamsReadyCb, readAvailable(_))
+      .WillOnce(Invoke([&](folly::Range<const StreamId*> streamIds) {
+        std::vector<StreamId> ids(streamIds.begin(), streamIds.end());
+        std::sort(ids.begin(), ids.end());
+        EXPECT_EQ(ids, std::vector<StreamId>({stream1, stream2}));
+      }));
+  transport->driveReadCallbacks();
+
+  // Without the batched callback the streams get their own calls again.
+  transport->setStreamsReadyCallback(nullptr);
+  EXPECT_CALL(readCb, readAvailable(stream1));
+  EXPECT_CALL(readCb, readAvailable(stream2));
+  transport->driveReadCallbacks();
+  transport.reset();
+}
+
 TEST_F(QuicTransportImplTest, ReadCallbackNoCallbackSet) {
   auto stream1 = transport->createBidirectionalStream().value();
 
@@ -618,6 +732,51 @@ TEST_F(QuicTransportImplTest, ReadData) {
   transport.reset();
 }
 
+TEST_F(QuicTransportImplTest, ReadAll) {
+  auto stream1 = transport->createBidirectionalStream().value();
+  auto stream2 = transport->createBidirectionalStream().value();
+  auto stream3 = transport->createBidirectionalStream().value();
+  MockReadCallback readCb1;
+  MockReadCallback readCb2;
+  MockReadCallback readCb3;
+  transport->setReadCallback(stream1, &readCb1);
+  transport->setReadCallback(stream2, &readCb2);
+  transport->setReadCallback(stream3, &readCb3);
+  transport->pauseRead(stream3);
+  auto readData1 = folly::IOBuf::copyBuffer("actual stream data");
+  auto readData2 = folly::IOBuf::copyBuffer("more stream data");
+  transport->addDataToStream(stream1, StreamBuffer(readData1->clone(), 0));
+  transport->addDataToStream(
+      stream2, StreamBuffer(readData2->clone(), 0, true));
+  transport->addDataToStream(
+      stream3, StreamBuffer(folly::IOBuf::copyBuffer("paused"), 0));
+
+  auto streamsData = transport->readAll(0);
+  ASSERT_FALSE(streamsData.hasError());
+  ASSERT_EQ(streamsData->size(), 2);
+  IOBufEqualTo eq;
+  for (const auto& streamData : *streamsData) {
+    if (streamData.id == stream1) {
+      EXPECT_TRUE(eq(*streamData.data, *readData1));
+      // The received buffer is handed over as is.
+      EXPECT_EQ(streamData.data->data(), readData1->data());
+      EXPECT_FALSE(streamData.eof);
+    } else {
+      EXPECT_EQ(streamData.id, stream2);
+      EXPECT_TRUE(eq(*streamData.data, *readData2));
+      EXPECT_TRUE(streamData.eof);
+    }
+  }
+
+  // Only the paused stream is left to read.
+  EXPECT_CALL(readCb1, readAvailable(_)).Times(0);
+  EXPECT_CALL(readCb2, readAvailable(_)).Times(0);
+  EXPECT_CALL(readCb3, readAvailable(_)).Times(0);
+  transport->driveReadCallbacks();
+  EXPECT_TRUE(transport->readAll(0)->empty());
+  transport.reset();
+}
+
 // TODO The finest copypasta around. We need a better story for parameterizing
 // unidirectional vs. bidirectional.
 TEST_F(QuicTransportImplTest, UnidirectionalReadData) {
@@ -1047,9 +1206,7 @@ TEST_F(QuicTransportImplTest, CancelAllDeliveryCallbacksDeque) {
 
 TEST_F(QuicTransportImplTest, CancelAllDeliveryCallbacksMap) {
   MockDeliveryCallback mockedDeliveryCallback1, mockedDeliveryCallback2;
-  std::unordered_map<
-      StreamId,
-      std::deque<std::pair<uint64_t, QuicSocket::DeliveryCallback*>>>
+  StreamIdMap<std::deque<std::pair<uint64_t, QuicSocket::DeliveryCallback*>>>
       callbacks;
   callbacks[0x123].emplace_back(0, &mockedDeliveryCallback1);
   callbacks[0x135].emplace_back(100, &mockedDeliveryCallback2);
@@ -1086,6 +1243,29 @@ TEST_F(QuicTransportImplTest, DeliveryCallbackUnsetAll) {
   transport->close(folly::none);
 }
 
+TEST_F(QuicTransportImplTest, RequestAckFrequency) {
+  auto& conn = transport->getConnectionState();
+  EXPECT_EQ(
+      LocalErrorCode::INVALID_OPERATION,
+      transport->requestAckFrequency(10, 20ms, false).error());
+  EXPECT_TRUE(conn.pendingEvents.frames.empty());
+
+  conn.peerMinAckDelay = 1ms;
+  EXPECT_EQ(
+      LocalErrorCode::INVALID_OPERATION,
+      transport->requestAckFrequency(0, 20ms, false).error());
+  EXPECT_FALSE(transport->requestAckFrequency(10, 20ms, false).hasError());
+  ASSERT_EQ(conn.pendingEvents.frames.size(), 1);
+  EXPECT_EQ(
+      boost::get<AckFrequencyFrame>(conn.pendingEvents.frames.front()),
+      AckFrequencyFrame(0, 10, 20ms, false));
+
+  transport->close(folly::none);
+  EXPECT_EQ(
+      LocalErrorCode::CONNECTION_CLOSED,
+      transport->requestAckFrequency(10, 20ms, false).error());
+}
+
 TEST_F(QuicTransportImplTest, DeliveryCallbackUnsetOne) {
   auto stream1 = transport->createBidirectionalStream().value();
   auto stream2 = transport->createBidirectionalStream().value();
@@ -1452,6 +1632,39 @@ TEST_F(QuicTransportImplTest, AsyncStreamFlowControlWrite) {
   EXPECT_TRUE(streamState->latestMaxStreamDataPacket.hasValue());
 }
 
+TEST_F(QuicTransportImplTest, SubmitFromOtherThread) {
+  transport->transportConn->oneRttWriteCipher = test::createNoOpAead();
+  transport->setServerConnectionId();
+  folly::Optional<StreamId> stream;
+  std::thread producer([&] {
+    transport->submitCreateStream(
+        true, [&](auto streamId) { stream = streamId.value(); });
+  });
+  producer.join();
+  // Nothing is applied outside of the event base.
+  EXPECT_FALSE(stream.hasValue());
+  evb->loopOnce();
+  ASSERT_TRUE(stream.hasValue());
+
+  producer = std::thread([&] {
+    transport->submitWrite(*stream, folly::IOBuf::copyBuffer("Hey"), false);
+    transport->submitWrite(*stream, folly::IOBuf::copyBuffer(" you"), true);
+  });
+  producer.join();
+  auto streamState =
+      transport->transportConn->streamManager->getStream(*stream);
+  EXPECT_FALSE(streamState->finalWriteOffset.hasValue());
+  evb->loopOnce();
+  EXPECT_EQ(streamState->finalWriteOffset, 7);
+
+  producer = std::thread([&] { transport->submitClose(folly::none); });
+  producer.join();
+  evb->loopOnce();
+  EXPECT_EQ(
+      transport->createBidirectionalStream().error(),
+      LocalErrorCode::CONNECTION_CLOSED);
+}
+
 TEST_F(QuicTransportImplTest, ExceptionInWriteLooperDoesNotCrash) {
   auto stream = transport->createBidirectionalStream().value();
   transport->setReadCallback(stream, nullptr);
@@ -1538,6 +1751,24 @@ TEST_P(QuicTransportImplTestUniBidi, AppIdleTestOnlyControlStreams) {
   transport->closeStream(ctrlStream2);
 }
 
+TEST_F(QuicTransportImplTest, SetStreamPriority) {
+  auto stream = transport->createBidirectionalStream().value();
+  StreamPriority priority(0, true, 32);
+  EXPECT_EQ(folly::none, transport->setStreamPriority(stream, priority));
+  auto& conn = transport->getConnectionState();
+  EXPECT_EQ(conn.streamManager->getStream(stream)->priority, priority);
+
+  EXPECT_EQ(
+      LocalErrorCode::INVALID_OPERATION,
+      transport->setStreamPriority(stream, StreamPriority(8, false, 16)));
+  EXPECT_EQ(
+      LocalErrorCode::INVALID_OPERATION,
+      transport->setStreamPriority(stream, StreamPriority(3, false, 0)));
+  EXPECT_EQ(
+      LocalErrorCode::STREAM_NOT_EXISTS,
+      transport->setStreamPriority(stream + 4, priority));
+}
+
 TEST_F(QuicTransportImplTest, UnidirectionalInvalidReadFuncs) {
   auto stream = transport->createUnidirectionalStream().value();
   EXPECT_THROW(
@@ -2428,5 +2659,195 @@ TEST_F(QuicTransportImplTest, CloseFromCancelDeliveryCallbacksForStream) {
   transport->cancelDeliveryCallbacksForStream(stream1);
 }
 
+TEST_F(QuicTransportImplTest, MetricsCallbackOnChange) {
+  auto& conn = transport->getConnectionState();
+  auto mockCongestionController =
+      std::make_unique<NiceMock<MockCongestionController>>();
+  auto rawCongestionController = mockCongestionController.get();
+  conn.congestionController = std::move(mockCongestionController);
+  conn.lossState.srtt = 100ms;
+  conn.lossState.mrtt = 80ms;
+  ON_CALL(*rawCongestionController, getCongestionWindow())
+      .WillByDefault(Return(20000));
+  ON_CALL(*rawCongestionController, getWritableBytes())
+      .WillByDefault(Return(5000));
+  auto stream = transport->createBidirectionalStream().value();
+
+  MockMetricsCallback metricsCb;
+  transport->setMetricsCallback(&metricsCb, 0ms, 0.1);
+  EXPECT_CALL(metricsCb, onMetrics(_))
+      .WillOnce(Invoke([](const QuicSocket::ConnectionMetrics& metrics) {
+        // The window per srtt without a bandwidth estimate.
+        EXPECT_EQ(200000, metrics.deliveryRate);
+        EXPECT_EQ(80ms, metrics.minRtt);
+        EXPECT_EQ(100ms, metrics.srtt);
+        EXPECT_EQ(20000, metrics.congestionWindow);
+        EXPECT_EQ(15000, metrics.bytesInFlight);
+      }));
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 0));
+  Mock::VerifyAndClearExpectations(&metricsCb);
+
+  // Changes within the threshold are not reported.
+  conn.lossState.srtt = 105ms;
+  EXPECT_CALL(metricsCb, onMetrics(_)).Times(0);
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 4));
+  Mock::VerifyAndClearExpectations(&metricsCb);
+
+  ON_CALL(*rawCongestionController, getBandwidthEstimate())
+      .WillByDefault(Return(500000));
+  EXPECT_CALL(
+      metricsCb,
+      onMetrics(Field(&QuicSocket::ConnectionMetrics::deliveryRate, 500000)));
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 8));
+  Mock::VerifyAndClearExpectations(&metricsCb);
+
+  transport->setMetricsCallback(nullptr, 0ms);
+  conn.lossState.srtt = 500ms;
+  EXPECT_CALL(metricsCb, onMetrics(_)).Times(0);
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 12));
+}
+
+class TestCongestionControlPolicy : public CongestionControlPolicy {
+ public:
+  folly::Optional<CongestionControlType> selectCongestionController(
+      const QuicConnectionStateBase&) override {
+    calls++;
+    return type;
+  }
+
+  folly::Optional<CongestionControlType> type;
+  size_t calls{0};
+};
+
+TEST_F(QuicTransportImplTest, SetCongestionControlKeepsState) {
+  auto& conn = transport->getConnectionState();
+  transport->setCongestionControllerFactory(
+      std::make_shared<DefaultCongestionControllerFactory>());
+  auto mockCongestionController =
+      std::make_unique<NiceMock<MockCongestionController>>();
+  ON_CALL(*mockCongestionController, type())
+      .WillByDefault(Return(CongestionControlType::Cubic));
+  ON_CALL(*mockCongestionController, getCongestionWindow())
+      .WillByDefault(Return(50 * conn.udpSendPacketLen));
+  conn.congestionController = std::move(mockCongestionController);
+  conn.lossState.totalBytesAcked = 1000;
+  conn.outstandingPackets.push_back(makeTestingWritePacket(1, 1000, 1000));
+  conn.outstandingPackets.push_back(
+      makeTestingWritePacket(2, 100, 1100, true /* pureAck */));
+  auto initCwndInMss = conn.transportSettings.initCwndInMss;
+
+  transport->setCongestionControl(CongestionControlType::NewReno);
+  ASSERT_EQ(
+      CongestionControlType::NewReno, conn.congestionController->type());
+  EXPECT_EQ(
+      50 * conn.udpSendPacketLen,
+      conn.congestionController->getCongestionWindow());
+  EXPECT_EQ(
+      50 * conn.udpSendPacketLen - 1000,
+      conn.congestionController->getWritableBytes());
+  EXPECT_EQ(initCwndInMss, conn.transportSettings.initCwndInMss);
+}
+
+TEST_F(QuicTransportImplTest, CongestionControlPolicy) {
+  auto& conn = transport->getConnectionState();
+  transport->setCongestionControllerFactory(
+      std::make_shared<DefaultCongestionControllerFactory>());
+  transport->setCongestionControl(CongestionControlType::Cubic);
+  auto policy = std::make_shared<TestCongestionControlPolicy>();
+  transport->setCongestionControlPolicy(policy);
+  auto stream = transport->createBidirectionalStream().value();
+
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 0));
+  EXPECT_EQ(1, policy->calls);
+  EXPECT_EQ(CongestionControlType::Cubic, conn.congestionController->type());
+
+  // The policy is only asked again after kCongestionControlPolicyInterval.
+  policy->type = CongestionControlType::NewReno;
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 4));
+  EXPECT_EQ(1, policy->calls);
+  transport->setCongestionControlPolicy(policy);
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 8));
+  EXPECT_EQ(2, policy->calls);
+  EXPECT_EQ(
+      CongestionControlType::NewReno, conn.congestionController->type());
+}
+
+TEST_F(QuicTransportImplTest, MetricsCallbackOnInterval) {
+  auto& conn = transport->getConnectionState();
+  conn.congestionController =
+      std::make_unique<NiceMock<MockCongestionController>>();
+  auto stream = transport->createBidirectionalStream().value();
+
+  MockMetricsCallback metricsCb;
+  transport->setMetricsCallback(&metricsCb, 1h);
+  EXPECT_CALL(metricsCb, onMetrics(_)).Times(1);
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 0));
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 4));
+  Mock::VerifyAndClearExpectations(&metricsCb);
+
+  transport->setMetricsCallback(&metricsCb, 1ms);
+  EXPECT_CALL(metricsCb, onMetrics(_)).Times(2);
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 8));
+  std::this_thread::sleep_for(2ms);
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 12));
+}
+
+TEST_F(QuicTransportImplTest, MetricsHistory) {
+  auto& conn = transport->getConnectionState();
+  conn.transportSettings.metricsHistorySize = 2;
+  conn.transportSettings.metricsHistoryInterval = 10ms;
+  conn.congestionController =
+      std::make_unique<NiceMock<MockCongestionController>>();
+  auto stream = transport->createBidirectionalStream().value();
+  transport->addDataToStream(
+      stream, StreamBuffer(IOBuf::copyBuffer("data"), 0));
+  // Nothing is sampled before an ack.
+  EXPECT_TRUE(transport->getMetricsHistory().empty());
+
+  auto ackTime = Clock::now();
+  uint64_t offset = 4;
+  auto ack = [&](TimePoint time, std::chrono::microseconds srtt) {
+    conn.lossState.lastAckedTime = time;
+    conn.lossState.srtt = srtt;
+    transport->addDataToStream(
+        stream, StreamBuffer(IOBuf::copyBuffer("data"), offset));
+    offset += 4;
+  };
+  ack(ackTime, 10ms);
+  EXPECT_EQ(1, transport->getMetricsHistory().size());
+  // Acks within the interval of the last sample are not sampled.
+  ack(ackTime + 5ms, 20ms);
+  EXPECT_EQ(1, transport->getMetricsHistory().size());
+  ack(ackTime + 20ms, 30ms);
+  conn.lossState.rtxCount = 3;
+  ack(ackTime + 40ms, 40ms);
+
+  auto history = transport->getMetricsHistory();
+  ASSERT_EQ(2, history.size());
+  EXPECT_EQ(ackTime + 20ms, history[0].time);
+  EXPECT_EQ(30ms, history[0].srtt);
+  EXPECT_EQ(0, history[0].packetsRetransmitted);
+  EXPECT_EQ(ackTime + 40ms, history[1].time);
+  EXPECT_EQ(40ms, history[1].srtt);
+  EXPECT_EQ(3, history[1].packetsRetransmitted);
+
+  NiceMock<MockQuicStats> stats;
+  conn.infoCallback = &stats;
+  EXPECT_CALL(stats, onMetricsHistory(SizeIs(2)));
+  transport->closeNow(folly::none);
+  conn.infoCallback = nullptr;
+}
+
 } // namespace test
 } // namespace quic
@@ -9,12 +9,14 @@
 #include <quic/api/QuicTransportFunctions.h>
 
 #include <folly/io/async/test/MockAsyncUDPSocket.h>
+#include <quic/api/QuicEncryptionPipeline.h>
 #include <quic/api/test/MockQuicStats.h>
 #include <quic/api/test/Mocks.h>
 #include <quic/common/test/TestUtils.h>
 #include <quic/logging/FileQLogger.h>
 #include <quic/logging/QLoggerConstants.h>
 #include <quic/server/state/ServerStateMachine.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/test/Mocks.h>
 
 #include <gtest/gtest.h>
@@ -1202,7 +1204,7 @@ TEST_F(QuicTransportFunctionsTest, NothingWritten) {
 
 template <class FrameType>
 const FrameType& getFirstFrameInOutstandingPackets(
-    const std::deque<OutstandingPacket>& outstandingPackets) {
+    const OutstandingPackets& outstandingPackets) {
   for (const auto& packet : outstandingPackets) {
     for (const auto& frame : packet.packet.frames) {
       auto decodedFrame = boost::get<FrameType>(&frame);
@@ -1302,6 +1304,56 @@ TEST_F(QuicTransportFunctionsTest, WriteProbingNewData) {
   EXPECT_FALSE(stream1->retransmissionBuffer.empty());
 }
 
+TEST_F(QuicTransportFunctionsTest, WritePathMtuProbe) {
+  auto conn = createConn();
+  conn->transportSettings.pathMtuDiscovery = true;
+  conn->oneRttWriteCipher = test::createNoOpAead();
+  startPathMtuDiscovery(*conn, 4096);
+  EXPECT_EQ(WriteDataReason::PATH_MTU_PROBE, hasNonAckDataToWrite(*conn));
+  auto mockCongestionController = std::make_unique<MockCongestionController>();
+  auto rawCongestionController = mockCongestionController.get();
+  conn->congestionController = std::move(mockCongestionController);
+  EventBase evb;
+  auto socket = std::make_unique<folly::test::MockAsyncUDPSocket>(&evb);
+  auto rawSocket = socket.get();
+
+  auto probeSize = conn->pathMtuState.searchLow +
+      (conn->pathMtuState.searchHigh - conn->pathMtuState.searchLow + 1) / 2;
+  EXPECT_CALL(*rawCongestionController, onPacketSent(_)).Times(0);
+  EXPECT_CALL(*rawSocket, write(_, _))
+      .WillOnce(Invoke([&](const SocketAddress&,
+                           const std::unique_ptr<folly::IOBuf>& iobuf) {
+        auto len = iobuf->computeChainDataLength();
+        EXPECT_EQ(probeSize - aead->getCipherOverhead(), len);
+        return len;
+      }));
+  EXPECT_EQ(
+      1,
+      writeQuicDataToSocket(
+          *rawSocket,
+          *conn,
+          *conn->clientConnectionId,
+          *conn->serverConnectionId,
+          *aead,
+          *headerCipher,
+          getVersion(*conn),
+          conn->transportSettings.writeConnectionDataPacketsLimit));
+  ASSERT_EQ(1, conn->outstandingPackets.size());
+  const auto& probe = *conn->outstandingPackets.begin();
+  EXPECT_TRUE(probe.isPathMtuProbe);
+  EXPECT_FALSE(probe.pureAck);
+  // The ping and a single frame for all of the padding
+  EXPECT_EQ(2, probe.packet.frames.size());
+  EXPECT_EQ(
+      folly::variant_match(
+          probe.packet.header,
+          [](const auto& h) { return h.getPacketSequenceNum(); }),
+      *conn->pathMtuState.probePacketNum);
+  EXPECT_EQ(1, conn->pathMtuState.probesSent);
+  EXPECT_EQ(WriteDataReason::NO_WRITE, hasNonAckDataToWrite(*conn));
+  EXPECT_EQ(kDefaultUDPSendPacketLen, conn->udpSendPacketLen);
+}
+
 TEST_F(QuicTransportFunctionsTest, WriteProbingOldData) {
   auto conn = createConn();
   conn->congestionController.reset();
@@ -1500,6 +1552,130 @@ TEST_F(QuicTransportFunctionsTest, TestCryptoWritingIsHandshakeInOutstanding) {
                   ->isHandshake);
 }
 
+TEST_F(QuicTransportFunctionsTest, CoalesceInitialWithShortHeaderPacket) {
+  auto conn = createConn();
+  conn->transportSettings.coalescePackets = true;
+  writeDataToQuicStream(
+      conn->cryptoState->initialStream, buildRandomInputData(200));
+  auto stream = conn->streamManager->createNextBidirectionalStream().value();
+  writeDataToQuicStream(*stream, buildRandomInputData(100), true);
+  EventBase evb;
+  auto socket = std::make_unique<folly::test::MockAsyncUDPSocket>(&evb);
+  auto rawSocket = socket.get();
+
+  // The Initial packet waits for the next encryption level.
+  EXPECT_CALL(*rawSocket, write(_, _)).Times(0);
+  EXPECT_EQ(
+      0,
+      writeCryptoAndAckDataToSocket(
+          *rawSocket,
+          *conn,
+          *conn->clientConnectionId,
+          *conn->serverConnectionId,
+          LongHeader::Types::Initial,
+          *conn->initialWriteCipher,
+          *conn->initialHeaderCipher,
+          getVersion(*conn),
+          conn->transportSettings.writeConnectionDataPacketsLimit));
+  ASSERT_TRUE(conn->pendingCoalescedPackets);
+  auto initialSize = conn->pendingCoalescedPackets->computeChainDataLength();
+  EXPECT_EQ(1, conn->outstandingPackets.size());
+
+  size_t datagramSize = 0;
+  EXPECT_CALL(*rawSocket, write(_, _))
+      .WillOnce(Invoke([&](const SocketAddress&,
+                           const std::unique_ptr<folly::IOBuf>& iobuf) {
+        datagramSize = iobuf->computeChainDataLength();
+        return datagramSize;
+      }));
+  EXPECT_EQ(
+      1,
+      writeQuicDataToSocket(
+          *rawSocket,
+          *conn,
+          *conn->clientConnectionId,
+          *conn->serverConnectionId,
+          *aead,
+          *headerCipher,
+          getVersion(*conn),
+          conn->transportSettings.writeConnectionDataPacketsLimit));
+  EXPECT_FALSE(conn->pendingCoalescedPackets);
+  EXPECT_EQ(2, conn->outstandingPackets.size());
+  EXPECT_GT(datagramSize, initialSize);
+  EXPECT_LE(datagramSize, conn->udpSendPacketLen);
+}
+
+TEST_F(QuicTransportFunctionsTest, WriteWithEncryptionPipeline) {
+  EncryptionPipeline pipeline(1, kEncryptionPipelineDepth);
+  // A few batches of packets, and a last one that is not full.
+  const uint64_t packetLimit = kMaxHeaderProtectionBatchSize * 2 + 5;
+  auto data = buildRandomInputData(kDefaultUDPSendPacketLen * packetLimit);
+  EventBase evb;
+  // The same packets are written with and without the pipeline.
+  auto writePackets = [&](EncryptionPipeline* encryptionPipeline) {
+    auto conn = createConn();
+    conn->congestionController.reset();
+    conn->oneRttWriteCipher = createNoOpAead();
+    conn->encryptionPipeline = encryptionPipeline;
+    auto stream = conn->streamManager->createNextBidirectionalStream().value();
+    writeDataToQuicStream(*stream, data->clone(), true);
+    folly::test::MockAsyncUDPSocket socket(&evb);
+    std::vector<std::string> datagrams;
+    EXPECT_CALL(socket, write(_, _))
+        .WillRepeatedly(Invoke([&](const SocketAddress&,
+                                   const std::unique_ptr<folly::IOBuf>& buf) {
+          datagrams.push_back(buf->clone()->moveToFbString().toStdString());
+          return buf->computeChainDataLength();
+        }));
+    auto written = writeQuicDataToSocket(
+        socket,
+        *conn,
+        *conn->clientConnectionId,
+        *conn->serverConnectionId,
+        *conn->oneRttWriteCipher,
+        *headerCipher,
+        getVersion(*conn),
+        packetLimit);
+    EXPECT_EQ(written, datagrams.size());
+    EXPECT_EQ(written, conn->outstandingPackets.size());
+    return datagrams;
+  };
+  auto datagrams = writePackets(nullptr);
+  EXPECT_EQ(packetLimit, datagrams.size());
+  EXPECT_EQ(datagrams, writePackets(&pipeline));
+  EXPECT_EQ(0, pipeline.getLane(nullptr).numPending());
+}
+
+TEST_F(QuicTransportFunctionsTest, WriteCoalescedPacketsWithoutNextLevel) {
+  auto conn = createConn();
+  conn->transportSettings.coalescePackets = true;
+  writeDataToQuicStream(
+      conn->cryptoState->initialStream, buildRandomInputData(200));
+  EventBase evb;
+  auto socket = std::make_unique<folly::test::MockAsyncUDPSocket>(&evb);
+  auto rawSocket = socket.get();
+  EXPECT_CALL(*rawSocket, write(_, _)).Times(0);
+  writeCryptoAndAckDataToSocket(
+      *rawSocket,
+      *conn,
+      *conn->clientConnectionId,
+      *conn->serverConnectionId,
+      LongHeader::Types::Initial,
+      *conn->initialWriteCipher,
+      *conn->initialHeaderCipher,
+      getVersion(*conn),
+      conn->transportSettings.writeConnectionDataPacketsLimit);
+  ASSERT_TRUE(conn->pendingCoalescedPackets);
+
+  EXPECT_CALL(*rawSocket, write(_, _))
+      .WillOnce(Invoke([&](const SocketAddress&,
+                           const std::unique_ptr<folly::IOBuf>& iobuf) {
+        return iobuf->computeChainDataLength();
+      }));
+  writeCoalescedPacketsToSocket(*rawSocket, *conn);
+  EXPECT_FALSE(conn->pendingCoalescedPackets);
+}
+
 TEST_F(QuicTransportFunctionsTest, WritePureAckWhenNoWritableBytes) {
   auto conn = createConn();
   auto mockCongestionController = std::make_unique<MockCongestionController>();
@@ -9,7 +9,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <folly/FileUtil.h>
 #include <folly/Random.h>
+#include <folly/experimental/TestUtil.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBufQueue.h>
 #include <folly/io/async/test/MockAsyncUDPSocket.h>
@@ -479,6 +481,33 @@ TEST_F(QuicTransportTest, WriteSmall) {
   EXPECT_EQ(WriteDataReason::NO_WRITE, shouldWriteData(conn));
 }
 
+TEST_F(QuicTransportTest, WritesInALoopShareAPacket) {
+  auto stream1 = transport_->createBidirectionalStream().value();
+  auto stream2 = transport_->createBidirectionalStream().value();
+  EXPECT_CALL(*socket_, write(_, _)).WillOnce(Invoke(bufLength));
+  transport_->writeChain(stream1, buildRandomInputData(20), false, false);
+  transport_->writeChain(stream2, buildRandomInputData(20), false, false);
+  loopForWrites();
+  EXPECT_EQ(
+      WriteDataReason::NO_WRITE,
+      shouldWriteData(transport_->getConnectionState()));
+}
+
+TEST_F(QuicTransportTest, FlushWrites) {
+  auto stream = transport_->createBidirectionalStream().value();
+  EXPECT_TRUE(transport_->flushWrites().hasValue());
+  EXPECT_CALL(*socket_, write(_, _)).WillOnce(Invoke(bufLength));
+  transport_->writeChain(stream, buildRandomInputData(20), false, false);
+  EXPECT_TRUE(transport_->flushWrites().hasValue());
+  Mock::VerifyAndClearExpectations(socket_);
+  EXPECT_EQ(
+      WriteDataReason::NO_WRITE,
+      shouldWriteData(transport_->getConnectionState()));
+  // The write looper that was scheduled finds nothing left.
+  EXPECT_CALL(*socket_, write(_, _)).Times(0);
+  loopForWrites();
+}
+
 TEST_F(QuicTransportTest, WriteLarge) {
   // Testing writing a large buffer that would span multiple packets
   constexpr int NumFullPackets = 3;
@@ -514,6 +543,83 @@ TEST_F(QuicTransportTest, WriteLarge) {
   EXPECT_EQ(WriteDataReason::NO_WRITE, shouldWriteData(conn));
 }
 
+TEST_F(QuicTransportTest, WriteFile) {
+  auto& conn = transport_->getConnectionState();
+  conn.transportSettings.fileWriteChunkSize = 1000;
+  auto stream = transport_->createBidirectionalStream().value();
+  auto buf = buildRandomInputData(3 * kDefaultUDPSendPacketLen + 20);
+  buf->coalesce();
+  folly::test::TemporaryFile file;
+  // The file data starts after a header that is not sent.
+  ASSERT_EQ(folly::writeFull(file.fd(), "header", 6), 6);
+  ASSERT_EQ(
+      folly::writeFull(file.fd(), buf->data(), buf->length()),
+      static_cast<ssize_t>(buf->length()));
+
+  ASSERT_FALSE(
+      transport_->writeFile(stream, file.fd(), 6, buf->length(), true)
+          .hasError());
+  auto streamState = conn.streamManager->getStream(stream);
+  EXPECT_EQ(streamState->writeBuffer.chainLength(), 1000);
+  // Other data would land in the middle of the file.
+  auto res =
+      transport_->writeChain(stream, IOBuf::copyBuffer("x"), false, false);
+  ASSERT_TRUE(res.hasError());
+  EXPECT_EQ(res.error(), LocalErrorCode::INVALID_OPERATION);
+
+  EXPECT_CALL(*socket_, write(_, _)).WillRepeatedly(Invoke(bufLength));
+  for (int i = 0; i < 8; i++) {
+    loopForWrites();
+  }
+  verifyCorrectness(conn, 0, stream, *buf, true);
+}
+
+TEST_F(QuicTransportTest, WriteDatagram) {
+  auto& conn = transport_->getConnectionState();
+  auto res = transport_->writeDatagram(IOBuf::copyBuffer("datagram"));
+  ASSERT_TRUE(res.hasError());
+  EXPECT_EQ(res.error(), LocalErrorCode::INVALID_OPERATION);
+
+  conn.datagramState.maxWriteFrameSize = 100;
+  conn.transportSettings.datagramWriteBufferSize = 2;
+  EXPECT_EQ(97, transport_->getDatagramSizeLimit());
+  res = transport_->writeDatagram(buildRandomInputData(98));
+  ASSERT_TRUE(res.hasError());
+  EXPECT_EQ(res.error(), LocalErrorCode::INVALID_WRITE_DATA);
+
+  // The oldest datagram is dropped once the queue is full.
+  auto datagram1 = IOBuf::copyBuffer("datagram1");
+  auto datagram2 = IOBuf::copyBuffer("datagram2");
+  ASSERT_FALSE(
+      transport_->writeDatagram(IOBuf::copyBuffer("dropped")).hasError());
+  ASSERT_FALSE(transport_->writeDatagram(datagram1->clone()).hasError());
+  ASSERT_FALSE(transport_->writeDatagram(datagram2->clone()).hasError());
+  ASSERT_EQ(2, conn.datagramState.writeBuffer.size());
+  EXPECT_EQ(WriteDataReason::DATAGRAM, shouldWriteData(conn));
+
+  EXPECT_CALL(*socket_, write(_, _)).WillOnce(Invoke(bufLength));
+  loopForWrites();
+  EXPECT_TRUE(conn.datagramState.writeBuffer.empty());
+  ASSERT_EQ(1, conn.outstandingPackets.size());
+  std::vector<WriteDatagramFrame> frames;
+  for (const auto& frame : conn.outstandingPackets.back().packet.frames) {
+    auto datagramFrame = boost::get<WriteDatagramFrame>(&frame);
+    if (datagramFrame) {
+      frames.push_back(*datagramFrame);
+    }
+  }
+  EXPECT_EQ(
+      frames,
+      std::vector<WriteDatagramFrame>(
+          {WriteDatagramFrame(datagram1->length()),
+           WriteDatagramFrame(datagram2->length())}));
+  EXPECT_FALSE(conn.outstandingPackets.back().pureAck);
+
+  // A lost datagram is not sent again.
+  markPacketLoss(conn, conn.outstandingPackets.back().packet, false, 0);
+  EXPECT_EQ(WriteDataReason::NO_WRITE, shouldWriteData(conn));
+}
+
 TEST_F(QuicTransportTest, WriteMultipleTimes) {
   auto stream = transport_->createBidirectionalStream().value();
   auto buf = buildRandomInputData(20);
@@ -1841,6 +1947,35 @@ TEST_F(QuicTransportTest, InvokeDeliveryCallbacksAllDelivered) {
   transport_->onNetworkData(addr, std::move(emptyData));
 }
 
+TEST_F(QuicTransportTest, InvokeDeliveryCallbacksInOffsetOrder) {
+  MockDeliveryCallback mockedDeliveryCallback;
+  auto stream = transport_->createBidirectionalStream().value();
+  auto buf = buildRandomInputData(100);
+  EXPECT_CALL(*socket_, write(_, _)).WillRepeatedly(Invoke(bufLength));
+  transport_->registerDeliveryCallback(stream, 20, &mockedDeliveryCallback);
+  transport_->registerDeliveryCallback(stream, 80, &mockedDeliveryCallback);
+  transport_->registerDeliveryCallback(stream, 50, &mockedDeliveryCallback);
+  transport_->registerDeliveryCallback(stream, 80, &mockedDeliveryCallback);
+  transport_->writeChain(stream, buf->clone(), true, false);
+  loopForWrites();
+
+  auto& conn = transport_->getConnectionState();
+  // Faking a delivery:
+  conn.streamManager->addDeliverable(stream);
+  conn.lossState.srtt = 100us;
+  auto streamState = conn.streamManager->getStream(stream);
+  streamState->retransmissionBuffer.clear();
+
+  folly::SocketAddress addr;
+  NetworkData emptyData;
+  InSequence dummy;
+  EXPECT_CALL(mockedDeliveryCallback, onDeliveryAck(stream, 20, 100us));
+  EXPECT_CALL(mockedDeliveryCallback, onDeliveryAck(stream, 50, 100us));
+  EXPECT_CALL(mockedDeliveryCallback, onDeliveryAck(stream, 80, 100us))
+      .Times(2);
+  transport_->onNetworkData(addr, std::move(emptyData));
+}
+
 TEST_F(QuicTransportTest, InvokeDeliveryCallbacksPartialDelivered) {
   MockDeliveryCallback mockedDeliveryCallback1, mockedDeliveryCallback2;
   auto stream = transport_->createBidirectionalStream().value();
@@ -2119,6 +2254,38 @@ TEST_F(
       NetworkData(IOBuf::copyBuffer("fake data"), Clock::now()));
 }
 
+TEST_F(QuicTransportTest, NotifyPendingWriteStreamWatermarks) {
+  TransportSettings transportSettings;
+  transportSettings.streamWriteBufferHighWatermark = 1000;
+  transportSettings.streamWriteBufferLowWatermark = 200;
+  transport_->setTransportSettings(transportSettings);
+
+  auto streamId = transport_->createBidirectionalStream().value();
+  auto& conn = transport_->getConnectionState();
+  auto stream = conn.streamManager->getStream(streamId);
+  transport_->writeChain(streamId, buildRandomInputData(1000), false, false);
+  EXPECT_EQ(1000, transport_->getStreamWriteBufferedBytes(streamId).value());
+
+  EXPECT_CALL(writeCallback_, onStreamWriteReady(streamId, _)).Times(0);
+  transport_->notifyPendingWriteOnStream(streamId, &writeCallback_);
+  transport_->onNetworkData(
+      SocketAddress("::1", 10000),
+      NetworkData(IOBuf::copyBuffer("fake data"), Clock::now()));
+
+  // Above the low watermark the stream is still not write ready.
+  stream->writeBuffer.trimStart(500);
+  transport_->onNetworkData(
+      SocketAddress("::1", 10000),
+      NetworkData(IOBuf::copyBuffer("fake data"), Clock::now()));
+  Mock::VerifyAndClearExpectations(&writeCallback_);
+
+  EXPECT_CALL(writeCallback_, onStreamWriteReady(streamId, 800));
+  stream->writeBuffer.trimStart(300);
+  transport_->onNetworkData(
+      SocketAddress("::1", 10000),
+      NetworkData(IOBuf::copyBuffer("fake data"), Clock::now()));
+}
+
 TEST_F(QuicTransportTest, NotifyPendingWriteStreamAsyncConnBlocked) {
   auto streamId = transport_->createBidirectionalStream().value();
   auto& conn = transport_->getConnectionState();
@@ -2149,6 +2316,39 @@ TEST_F(QuicTransportTest, NotifyPendingWriteStreamAsyncConnBlocked) {
       NetworkData(IOBuf::copyBuffer("fake data"), Clock::now()));
 }
 
+TEST_F(QuicTransportTest, StreamsWriteReadyBatched) {
+  auto streamId1 = transport_->createBidirectionalStream().value();
+  auto streamId2 = transport_->createBidirectionalStream().value();
+  auto& conn = transport_->getConnectionState();
+  MockStreamsReadyCallback streamsReadyCb;
+  transport_->setStreamsReadyCallback(&streamsReadyCb);
+
+  auto stream1 = conn.streamManager->getStream(streamId1);
+  updateFlowControlOnWriteToStream(
+      *stream1, conn.flowControlState.peerAdvertisedMaxOffset);
+  MockWriteCallback writeCallback2;
+  EXPECT_CALL(writeCallback_, onStreamWriteReady(_, _)).Times(0);
+  EXPECT_CALL(writeCallback2, onStreamWriteReady(_, _)).Times(0);
+  transport_->notifyPendingWriteOnStream(streamId1, &writeCallback_);
+  transport_->notifyPendingWriteOnStream(streamId2, &writeCallback2);
+  evb_.loop();
+
+  EXPECT_CALL(streamsReadyCb, writeReady(_))
+      .WillOnce(Invoke([&](folly::Range<const StreamId*> streamIds) {
+        EXPECT_EQ(
+            std::vector<StreamId>(streamIds.begin(), streamIds.end()),
+            std::vector<StreamId>({streamId1, streamId2}));
+      }));
+  handleConnWindowUpdate(
+      conn,
+      MaxDataFrame(conn.flowControlState.peerAdvertisedMaxOffset + 1000),
+      10);
+  transport_->onNetworkData(
+      SocketAddress("::1", 10000),
+      NetworkData(IOBuf::copyBuffer("fake data"), Clock::now()));
+  transport_->setStreamsReadyCallback(nullptr);
+}
+
 TEST_F(QuicTransportTest, NotifyPendingWriteStreamAsyncStreamBlocked) {
   auto streamId = transport_->createBidirectionalStream().value();
   auto& conn = transport_->getConnectionState();
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/client/QuicClientConnectionPool.h>
+
+#include <algorithm>
+
+namespace quic {
+
+QuicClientConnectionPool::PooledConnection::PooledConnection(
+    QuicClientConnectionPool& poolIn,
+    Key keyIn,
+    std::shared_ptr<QuicClientTransport> transportIn)
+    : pool(poolIn), key(std::move(keyIn)), transport(std::move(transportIn)) {}
+
+void QuicClientConnectionPool::PooledConnection::onNewBidirectionalStream(
+    StreamId id) noexcept {
+  if (!removed) {
+    pool.onPeerStream(*this, id);
+  }
+}
+
+void QuicClientConnectionPool::PooledConnection::onNewUnidirectionalStream(
+    StreamId id) noexcept {
+  if (!removed) {
+    pool.onPeerStream(*this, id);
+  }
+}
+
+void QuicClientConnectionPool::PooledConnection::onStopSending(
+    StreamId id,
+    ApplicationErrorCode error) noexcept {
+  VLOG(4) << "Pooled connection got stop sending on stream=" << id
+          << " error=" << error << " " << *transport;
+}
+
+void QuicClientConnectionPool::PooledConnection::onConnectionEnd() noexcept {
+  if (!removed) {
+    pool.removeConnection(
+        *this,
+        std::make_pair(
+            QuicErrorCode(LocalErrorCode::CONNECT_FAILED),
+            std::string("Connection ended before it was ready")));
+  }
+}
+
+void QuicClientConnectionPool::PooledConnection::onConnectionError(
+    std::pair<QuicErrorCode, std::string> error) noexcept {
+  if (!removed) {
+    pool.removeConnection(*this, std::move(error));
+  }
+}
+
+void QuicClientConnectionPool::PooledConnection::onTransportReady() noexcept {
+  if (!removed) {
+    ready = true;
+    pool.serveWaiters(*this);
+  }
+}
+
+QuicClientConnectionPool::QuicClientConnectionPool(
+    folly::EventBase* evb,
+    TransportFactory transportFactory,
+    std::shared_ptr<QuicPskCache> pskCache,
+    size_t maxConnectionsPerKey)
+    : evb_(evb),
+      transportFactory_(std::move(transportFactory)),
+      pskCache_(
+          pskCache ? std::move(pskCache)
+                   : std::make_shared<BasicQuicPskCache>()),
+      maxConnectionsPerKey_(std::max<size_t>(maxConnectionsPerKey, 1)) {}
+
+QuicClientConnectionPool::~QuicClientConnectionPool() {
+  auto groups = std::move(groups_);
+  groups_.clear();
+  for (auto& group : groups) {
+    for (auto& conn : group.second.connections) {
+      conn->removed = true;
+      conn->transport->closeNow(folly::none);
+    }
+  }
+  for (auto& group : groups) {
+    for (auto callback : group.second.waiters) {
+      callback->onConnectError(std::make_pair(
+          QuicErrorCode(LocalErrorCode::SHUTTING_DOWN),
+          std::string("Connection pool destroyed")));
+    }
+  }
+}
+
+void QuicClientConnectionPool::getConnection(
+    const std::string& hostname,
+    const std::string& alpn,
+    ConnectCallback* callback) {
+  DCHECK(evb_->isInEventBaseThread());
+  Key key(hostname, alpn);
+  auto& group = groups_[key];
+  PooledConnection* best = nullptr;
+  for (auto& conn : group.connections) {
+    if (!conn->ready || !conn->transport->good()) {
+      continue;
+    }
+    if (!best ||
+        conn->transport->getNumOpenableBidirectionalStreams() >
+            best->transport->getNumOpenableBidirectionalStreams()) {
+      best = conn.get();
+    }
+  }
+  bool canGrow = group.connections.size() < maxConnectionsPerKey_;
+  if (best &&
+      (best->transport->getNumOpenableBidirectionalStreams() > 0 ||
+       !canGrow)) {
+    callback->onConnectSuccess(best->transport);
+    return;
+  }
+  group.waiters.push_back(callback);
+  if (canGrow && !hasConnecting(group)) {
+    connect(key);
+  }
+}
+
+void QuicClientConnectionPool::cancel(ConnectCallback* callback) {
+  for (auto& group : groups_) {
+    auto& waiters = group.second.waiters;
+    waiters.erase(
+        std::remove(waiters.begin(), waiters.end(), callback), waiters.end());
+  }
+}
+
+void QuicClientConnectionPool::prewarm(
+    const std::string& hostname,
+    const std::string& alpn,
+    size_t numConnections) {
+  DCHECK(evb_->isInEventBaseThread());
+  Key key(hostname, alpn);
+  auto target = std::min(numConnections, maxConnectionsPerKey_);
+  // Bounded by the count up front, as a connect that fails right away takes
+  // its connection out again.
+  for (auto i = groups_[key].connections.size(); i < target; ++i) {
+    connect(key);
+  }
+}
+
+size_t QuicClientConnectionPool::numConnections(
+    const std::string& hostname,
+    const std::string& alpn) const {
+  auto it = groups_.find(Key(hostname, alpn));
+  return it == groups_.end() ? 0 : it->second.connections.size();
+}
+
+void QuicClientConnectionPool::setPeerStreamCallback(
+    PeerStreamCallback callback) {
+  peerStreamCallback_ = std::move(callback);
+}
+
+void QuicClientConnectionPool::closeAll() {
+  auto groups = std::move(groups_);
+  groups_.clear();
+  for (auto& group : groups) {
+    for (auto& conn : group.second.connections) {
+      conn->removed = true;
+      conn->transport->closeGracefully();
+    }
+  }
+  for (auto& group : groups) {
+    for (auto callback : group.second.waiters) {
+      callback->onConnectError(std::make_pair(
+          QuicErrorCode(LocalErrorCode::SHUTTING_DOWN),
+          std::string("Connection pool closed")));
+    }
+  }
+  // A connection may be closed from one of its own callbacks.
+  evb_->runInLoop([groups = std::move(groups)]() {});
+}
+
+bool QuicClientConnectionPool::hasConnecting(const ConnectionGroup& group) {
+  return std::any_of(
+      group.connections.begin(),
+      group.connections.end(),
+      [](const auto& conn) { return !conn->ready; });
+}
+
+void QuicClientConnectionPool::connect(const Key& key) {
+  auto transport = transportFactory_(key.first, key.second);
+  if (!transport) {
+    if (!hasConnecting(groups_[key])) {
+      failWaiters(
+          key,
+          std::make_pair(
+              QuicErrorCode(LocalErrorCode::CONNECT_FAILED),
+              std::string("No transport for the connection")));
+    }
+    return;
+  }
+  transport->setPskCache(pskCache_);
+  auto& group = groups_[key];
+  group.connections.push_back(
+      std::make_unique<PooledConnection>(*this, key, transport));
+  // The connection may be gone by the time start returns.
+  transport->start(group.connections.back().get());
+}
+
+void QuicClientConnectionPool::onPeerStream(
+    PooledConnection& conn,
+    StreamId id) {
+  if (peerStreamCallback_) {
+    peerStreamCallback_(*conn.transport, id);
+    return;
+  }
+  if (conn.transport->isBidirectionalStream(id)) {
+    conn.transport->resetStream(id, GenericApplicationErrorCode::UNKNOWN);
+  }
+  conn.transport->stopSending(id, GenericApplicationErrorCode::UNKNOWN);
+}
+
+void QuicClientConnectionPool::serveWaiters(PooledConnection& conn) {
+  // A callback may close the connection or call into the pool, so the
+  // waiters are looked up again each time.
+  while (!conn.removed && conn.transport->good()) {
+    auto it = groups_.find(conn.key);
+    if (it == groups_.end() || it->second.waiters.empty()) {
+      return;
+    }
+    auto callback = it->second.waiters.front();
+    it->second.waiters.pop_front();
+    callback->onConnectSuccess(conn.transport);
+  }
+}
+
+void QuicClientConnectionPool::removeConnection(
+    PooledConnection& conn,
+    std::pair<QuicErrorCode, std::string> error) {
+  conn.removed = true;
+  auto key = conn.key;
+  bool wasReady = conn.ready;
+  auto it = groups_.find(key);
+  CHECK(it != groups_.end());
+  auto& connections = it->second.connections;
+  auto connIt = std::find_if(
+      connections.begin(), connections.end(), [&](const auto& pooled) {
+        return pooled.get() == &conn;
+      });
+  CHECK(connIt != connections.end());
+  auto removed = std::move(*connIt);
+  connections.erase(connIt);
+  // This is called from a callback of the connection.
+  evb_->runInLoop([removed = std::move(removed)]() {});
+  if (!wasReady && !hasConnecting(it->second)) {
+    failWaiters(key, error);
+    return;
+  }
+  if (connections.empty() && it->second.waiters.empty()) {
+    groups_.erase(it);
+  }
+}
+
+void QuicClientConnectionPool::failWaiters(
+    const Key& key,
+    const std::pair<QuicErrorCode, std::string>& error) {
+  auto it = groups_.find(key);
+  while (it != groups_.end() && !it->second.waiters.empty()) {
+    auto callback = it->second.waiters.front();
+    it->second.waiters.pop_front();
+    callback->onConnectError(error);
+    it = groups_.find(key);
+  }
+  if (it != groups_.end() && it->second.connections.empty()) {
+    groups_.erase(it);
+  }
+}
+
+} // namespace quic
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/client/QuicClientTransport.h>
+#include <quic/client/handshake/QuicPskCache.h>
+
+#include <folly/Function.h>
+#include <folly/hash/Hash.h>
+#include <folly/io/async/EventBase.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace quic {
+
+/**
+ * A pool of client connections keyed by host and ALPN, so that the RPCs of a
+ * client go over the connections that are already up instead of each doing a
+ * handshake.
+ *
+ * A request is given the ready connection with the most streams left to open.
+ * If there is none a connection is started, unless one is on its way, in
+ * which case the request waits for it along with the others. Connections
+ * share a PSK cache, so once the first handshake with a host is done the
+ * later ones resume, and with 0-RTT they are ready as soon as they can send
+ * early data. prewarm() starts connections ahead of the requests.
+ *
+ * The pool has to be used and destroyed on the thread of its EventBase.
+ */
+class QuicClientConnectionPool {
+ public:
+  /**
+   * Makes a transport for the host and ALPN that is set up to connect, with
+   * its hostname, peer address and fizz context. The pool sets the PSK cache
+   * and starts it.
+   */
+  using TransportFactory = folly::Function<std::shared_ptr<QuicClientTransport>(
+      const std::string& hostname,
+      const std::string& alpn)>;
+
+  /**
+   * Called with the streams the peer opens on a pooled connection. Without
+   * one they are reset.
+   */
+  using PeerStreamCallback =
+      folly::Function<void(QuicClientTransport& transport, StreamId id)>;
+
+  class ConnectCallback {
+   public:
+    virtual ~ConnectCallback() = default;
+
+    /**
+     * The connection may not be replay safe yet, in which case what is
+     * written with replaySafe false goes out as 0-RTT data.
+     */
+    virtual void onConnectSuccess(
+        std::shared_ptr<QuicClientTransport> transport) noexcept = 0;
+
+    virtual void onConnectError(
+        std::pair<QuicErrorCode, std::string> error) noexcept = 0;
+  };
+
+  QuicClientConnectionPool(
+      folly::EventBase* evb,
+      TransportFactory transportFactory,
+      std::shared_ptr<QuicPskCache> pskCache = nullptr,
+      size_t maxConnectionsPerKey = 1);
+
+  ~QuicClientConnectionPool();
+
+  /**
+   * Calls back with a connection to the host, right away if one is ready.
+   */
+  void getConnection(
+      const std::string& hostname,
+      const std::string& alpn,
+      ConnectCallback* callback);
+
+  /**
+   * Stops a callback that is waiting for a connection from being called.
+   * The connection it waited for is kept for the next requests.
+   */
+  void cancel(ConnectCallback* callback);
+
+  /**
+   * Starts connections to the host until there are numConnections of them,
+   * up to maxConnectionsPerKey.
+   */
+  void prewarm(
+      const std::string& hostname,
+      const std::string& alpn,
+      size_t numConnections);
+
+  size_t numConnections(const std::string& hostname, const std::string& alpn)
+      const;
+
+  void setPeerStreamCallback(PeerStreamCallback callback);
+
+  /**
+   * Closes the connections gracefully, so that the streams that are open
+   * finish, and fails the callbacks that are waiting.
+   */
+  void closeAll();
+
+ private:
+  using Key = std::pair<std::string, std::string>;
+
+  class PooledConnection : public QuicSocket::ConnectionCallback {
+   public:
+    PooledConnection(
+        QuicClientConnectionPool& pool,
+        Key key,
+        std::shared_ptr<QuicClientTransport> transport);
+
+    ~PooledConnection() override = default;
+
+    void onNewBidirectionalStream(StreamId id) noexcept override;
+
+    void onNewUnidirectionalStream(StreamId id) noexcept override;
+
+    void onStopSending(StreamId id, ApplicationErrorCode error) noexcept
+        override;
+
+    void onConnectionEnd() noexcept override;
+
+    void onConnectionError(
+        std::pair<QuicErrorCode, std::string> error) noexcept override;
+
+    void onTransportReady() noexcept override;
+
+    QuicClientConnectionPool& pool;
+    const Key key;
+    std::shared_ptr<QuicClientTransport> transport;
+    bool ready{false};
+    bool removed{false};
+  };
+
+  struct ConnectionGroup {
+    std::vector<std::unique_ptr<PooledConnection>> connections;
+    std::deque<ConnectCallback*> waiters;
+  };
+
+  static bool hasConnecting(const ConnectionGroup& group);
+
+  void connect(const Key& key);
+
+  void onPeerStream(PooledConnection& conn, StreamId id);
+
+  void serveWaiters(PooledConnection& conn);
+
+  void removeConnection(
+      PooledConnection& conn,
+      std::pair<QuicErrorCode, std::string> error);
+
+  void failWaiters(
+      const Key& key,
+      const std::pair<QuicErrorCode, std::string>& error);
+
+  folly::EventBase* evb_;
+  TransportFactory transportFactory_;
+  std::shared_ptr<QuicPskCache> pskCache_;
+  size_t maxConnectionsPerKey_;
+  PeerStreamCallback peerStreamCallback_;
+  std::unordered_map<Key, ConnectionGroup, folly::hasher<Key>> groups_;
+};
+
+} // namespace quic
@@ -8,8 +8,10 @@
 
 #include <quic/client/QuicClientTransport.h>
 
+#include <folly/ScopeGuard.h>
 #include <folly/portability/Sockets.h>
 
+#include <quic/api/QuicBatchReader.h>
 #include <quic/api/QuicTransportFunctions.h>
 #include <quic/client/handshake/ClientTransportParametersExtension.h>
 #include <quic/client/state/ClientStateMachine.h>
@@ -19,6 +21,10 @@
 #include <quic/logging/QLoggerConstants.h>
 #include <quic/loss/QuicLossFunctions.h>
 #include <quic/state/AckHandlers.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/DatagramHandlers.h>
+#include <quic/state/FecHandlers.h>
+#include <quic/state/KeyUpdate.h>
 #include <quic/state/QuicPacingFunctions.h>
 
 namespace fsp = folly::portability::sockets;
@@ -95,8 +101,11 @@ void QuicClientTransport::processPacketData(
   if (packetSize == 0) {
     return;
   }
-  auto parsedPacket =
-      conn_->readCodec->parsePacket(packetQueue, conn_->ackStates);
+  auto parsedPacket = [&] {
+    ScopedAllocationAccounting codecAccounting(
+        *conn_, ConnectionAllocationUsage::Subsystem::Codec);
+    return conn_->readCodec->parsePacket(packetQueue, conn_->ackStates);
+  }();
   bool parseSuccess = folly::variant_match(
       parsedPacket,
       [&](QuicPacket&) { return true; },
@@ -123,8 +132,17 @@ void QuicClientTransport::processPacketData(
   }
 
   if (happyEyeballsEnabled_) {
+    bool racing = !conn_->happyEyeballsState.finished;
     happyEyeballsOnDataReceived(
         *conn_, happyEyeballsConnAttemptDelayTimeout_, socket_, peer);
+    if (racing && happyEyeballsCache_ && hostname_) {
+      happyEyeballsCache_->putFamily(
+          *hostname_, conn_->peerAddress.getFamily());
+    }
+    if (racing) {
+      // The socket that won is the only one written from now on.
+      setUpZeroCopySend();
+    }
   }
 
   auto& packet = boost::get<QuicPacket>(parsedPacket);
@@ -133,6 +151,12 @@ void QuicClientTransport::processPacketData(
     VLOG(4) << "Got version negotiation packet from peer=" << peer
             << " versions=" << std::hex << versionNegotiation->versions << " "
             << *this;
+    if (serverInfoCache_ && hostname_) {
+      // The next connection to the host starts with a version it supports.
+      auto serverInfo = cachedServerInfo_.value_or(CachedServerInfo());
+      serverInfo.supportedVersions = versionNegotiation->versions;
+      serverInfoCache_->putServerInfo(*hostname_, std::move(serverInfo));
+    }
 
     throw QuicInternalException(
         "Received version negotiation packet",
@@ -284,8 +308,11 @@ void QuicClientTransport::processPacketData(
         "Invalid connection id", TransportErrorCode::PROTOCOL_VIOLATION);
   }
   auto& ackState = getAckState(*conn_, pnSpace);
-  auto outOfOrder =
-      updateLargestReceivedPacketNum(ackState, packetNum, receiveTimePoint);
+  auto outOfOrder = updateLargestReceivedPacketNum(
+      ackState,
+      packetNum,
+      receiveTimePoint,
+      conn_->transportSettings.maxAckBlocks);
 
   bool pktHasRetransmittableData = false;
   bool pktHasCryptoData = false;
@@ -306,7 +333,9 @@ void QuicClientTransport::processPacketData(
                 auto outstandingProtectionType = folly::variant_match(
                     outstandingPacket.packet.header,
                     [](const auto& h) { return h.getProtectionType(); });
-                if (outstandingProtectionType == ProtectionType::KeyPhaseZero) {
+                if (outstandingProtectionType ==
+                        ProtectionType::KeyPhaseZero ||
+                    outstandingProtectionType == ProtectionType::KeyPhaseOne) {
                   // If we received an ack for data that we sent in 1-rtt from
                   // the server, we can assume that the server had successfully
                   // derived the 1-rtt keys and hence received the client
@@ -361,6 +390,9 @@ void QuicClientTransport::processPacketData(
                       processCryptoStreamAck(
                           *cryptoStream, frame.offset, frame.len);
                     },
+                    [&](const QuicSimpleFrame& frame) {
+                      updateSimpleFrameOnAck(*conn_, frame);
+                    },
                     [&](const auto& /* frame */) {
                       // Ignore other frames.
                     });
@@ -377,7 +409,9 @@ void QuicClientTransport::processPacketData(
           if (!stream) {
             return;
           }
-          invokeStreamReceiveStateMachine(*conn_, *stream, std::move(frame));
+          if (!receiveInOrderStreamData(*stream, frame)) {
+            invokeStreamReceiveStateMachine(*conn_, *stream, std::move(frame));
+          }
         },
         [&](ReadCryptoFrame& cryptoFrame) {
           pktHasRetransmittableData = true;
@@ -404,7 +438,10 @@ void QuicClientTransport::processPacketData(
                      << *conn_;
             return;
           }
-          invokeStreamReceiveStateMachine(*conn_, *stream, std::move(frame));
+          onStreamFrameReceived(*conn_, frame);
+          if (!receiveInOrderStreamData(*stream, frame)) {
+            invokeStreamReceiveStateMachine(*conn_, *stream, std::move(frame));
+          }
         },
         [&](MaxDataFrame& connWindowUpdate) {
           VLOG(10) << "Client received max data offset="
@@ -493,6 +530,19 @@ void QuicClientTransport::processPacketData(
               "Peer closed", TransportErrorCode::NO_ERROR);
         },
         [&](PaddingFrame&) {},
+        [&](ReadDatagramFrame& datagramFrame) {
+          VLOG(10) << "Client received datagram packetNum=" << packetNum
+                   << " " << *this;
+          pktHasRetransmittableData = true;
+          handleDatagram(*conn_, datagramFrame);
+        },
+        [&](RepairFrame& repairFrame) {
+          VLOG(10) << "Client received repair frame stream="
+                   << repairFrame.streamId << " packetNum=" << packetNum
+                   << " " << *this;
+          pktHasRetransmittableData = true;
+          handleRepairFrame(*conn_, repairFrame);
+        },
         [&](QuicSimpleFrame& simpleFrame) {
           pktHasRetransmittableData = true;
           updateSimpleFrameOnPacketReceived(
@@ -506,7 +556,11 @@ void QuicClientTransport::processPacketData(
       *getCryptoStream(*conn_->cryptoState, encryptionLevel));
   auto handshakeLayer = clientConn_->clientHandshakeLayer;
   if (cryptoData) {
-    handshakeLayer->doHandshake(std::move(cryptoData), encryptionLevel);
+    {
+      ScopedAllocationAccounting handshakeAccounting(
+          *conn_, ConnectionAllocationUsage::Phase::Handshake);
+      handshakeLayer->doHandshake(std::move(cryptoData), encryptionLevel);
+    }
     auto handshakeWriteCipher = handshakeLayer->getHandshakeWriteCipher();
     auto handshakeReadCipher = handshakeLayer->getHandshakeReadCipher();
     auto handshakeReadHeaderCipher =
@@ -589,8 +643,22 @@ void QuicClientTransport::processPacketData(
       auto maxStreamsUni = getIntegerParameter(
           TransportParameterId::initial_max_streams_uni,
           serverParams->parameters);
+      CachedServerInfo serverInfo;
+      serverInfo.supportedVersions = serverParams->supported_versions;
+      serverInfo.maxRecvPacketSize =
+          getIntegerParameter(
+              TransportParameterId::max_packet_size, serverParams->parameters)
+              .value_or(0);
+      serverInfo.partialReliability =
+          getIntegerParameter(
+              static_cast<TransportParameterId>(kPartialReliabilityParameterId),
+              serverParams->parameters)
+              .value_or(0) != 0;
       processServerInitialParams(
           *clientConn_, std::move(*serverParams), packetNum);
+      if (serverInfoCache_ && hostname_) {
+        serverInfoCache_->putServerInfo(*hostname_, std::move(serverInfo));
+      }
 
       cacheServerInitialParams(
           conn_->flowControlState.peerAdvertisedMaxOffset,
@@ -639,7 +707,12 @@ void QuicClientTransport::processPacketData(
   if (protectionLevel == ProtectionType::KeyPhaseZero ||
       protectionLevel == ProtectionType::KeyPhaseOne) {
     DCHECK(conn_->oneRttWriteCipher);
-    clientConn_->clientHandshakeLayer->onRecvOneRttProtectedData();
+    bool established =
+        handshakeLayer->getPhase() == ClientHandshake::Phase::Established;
+    handshakeLayer->onRecvOneRttProtectedData();
+    if (!established) {
+      reportHandshakeDone(*conn_, handshakeLayer->getHandshakeTimings());
+    }
     conn_->readCodec->onHandshakeDone(receiveTimePoint);
   }
   updateAckSendStateOnRecvPacket(
@@ -664,6 +737,15 @@ void QuicClientTransport::onReadData(
     return;
   }
   processUDPData(peer, std::move(networkData));
+  if (conn_->ecnState == QuicConnectionStateBase::EcnState::Failed &&
+      conn_->transportSettings.enableEcn) {
+    // The acks failed ECN validation, stop marking the packets.
+    setEcnMarking(
+        socket_->getNetworkSocket(),
+        socket_->address().getFamily(),
+        EcnCodepoint::NotEct);
+    conn_->transportSettings.enableEcn = false;
+  }
   if (!transportReadyNotified_ && hasWriteCipher()) {
     transportReadyNotified_ = true;
     CHECK_NOTNULL(connCallback_)->onTransportReady();
@@ -675,8 +757,12 @@ void QuicClientTransport::onReadData(
   if (connCallback_ && !replaySafeNotified_ && conn_->oneRttWriteCipher) {
     replaySafeNotified_ = true;
     // We don't need this any more. Also unset it so that we don't allow random
-    // middleboxes to shutdown our connection once we have crypto keys.
-    socket_->setErrMessageCallback(nullptr);
+    // middleboxes to shutdown our connection once we have crypto keys. The
+    // zero copy completions and the send timestamps still come through it,
+    // errMessage() then ignores the ICMP errors.
+    if (!zeroCopySender_ && !txTimestamper_) {
+      socket_->setErrMessageCallback(nullptr);
+    }
     connCallback_->onReplaySafe();
   }
 }
@@ -725,6 +811,10 @@ void QuicClientTransport::writeData() {
       (isConnectionPaced(*conn_)
            ? conn_->pacer->updateAndGetWriteBatchSize(Clock::now())
            : conn_->transportSettings.writeConnectionDataPacketsLimit);
+  // Send the packets left over for coalescing once all levels are written.
+  SCOPE_EXIT {
+    writeCoalescedPacketsToSocket(*socket_, *conn_);
+  };
   CryptoStreamScheduler initialScheduler(
       *conn_, *getCryptoStream(*conn_->cryptoState, EncryptionLevel::Initial));
   CryptoStreamScheduler handshakeScheduler(
@@ -784,6 +874,7 @@ void QuicClientTransport::writeData() {
   if (!packetLimit) {
     return;
   }
+  maybeInitiateKeyUpdate(*conn_);
   if (conn_->oneRttWriteCipher) {
     CHECK(clientConn_->oneRttWriteHeaderCipher);
     writeQuicDataExceptCryptoStreamToSocket(
@@ -863,6 +954,9 @@ void QuicClientTransport::startCryptoHandshake() {
 
   // Add partial reliability parameter to customTransportParameters_.
   setPartialReliabilityTransportParameter();
+  setAckFrequencyTransportParameter();
+  setDatagramTransportParameter();
+  setFecTransportParameter();
 
   auto paramsExtension = std::make_shared<ClientTransportParametersExtension>(
       folly::none,
@@ -875,13 +969,19 @@ void QuicClientTransport::startCryptoHandshake() {
       conn_->transportSettings.maxRecvPacketSize,
       customTransportParameters_);
   auto handshakeLayer = clientConn_->clientHandshakeLayer;
-  handshakeLayer->connect(
-      ctx_,
-      verifier_,
-      hostname_,
-      std::move(cachedPsk),
-      std::move(paramsExtension),
-      this);
+  handshakeLayer->setCertificateCompression(
+      conn_->transportSettings.certificateCompression);
+  {
+    ScopedAllocationAccounting handshakeAccounting(
+        *conn_, ConnectionAllocationUsage::Phase::Handshake);
+    handshakeLayer->connect(
+        ctx_,
+        verifier_,
+        hostname_,
+        std::move(cachedPsk),
+        std::move(paramsExtension),
+        this);
+  }
 
   auto zeroRttWriteCipher = handshakeLayer->getZeroRttWriteCipher();
   auto zeroRttWriteHeaderCipher = handshakeLayer->getZeroRttWriteHeaderCipher();
@@ -905,6 +1005,12 @@ void QuicClientTransport::startCryptoHandshake() {
         transportParams.initialMaxStreamsBidi,
         transportParams.initialMaxStreamsUni);
     updateTransportParamsFromCachedEarlyParams(*clientConn_, transportParams);
+#ifndef MVFST_NO_PARTIAL_RELIABILITY
+    if (cachedServerInfo_ && cachedServerInfo_->partialReliability &&
+        conn_->transportSettings.partialReliabilityEnabled) {
+      conn_->partialReliabilityEnabled = true;
+    }
+#endif
   }
   writeSocketData();
   if (!transportReadyNotified_ && clientConn_->zeroRttWriteCipher) {
@@ -997,6 +1103,16 @@ bool QuicClientTransport::isTLSResumed() const {
 void QuicClientTransport::errMessage(
     FOLLY_MAYBE_UNUSED const cmsghdr& cmsg) noexcept {
 #ifdef FOLLY_HAVE_MSG_ERRQUEUE
+  if (txTimestamper_ && txTimestamper_->onErrMessage(*conn_, cmsg)) {
+    return;
+  }
+  // The socket reads the error queue before the sender gets to it.
+  if (zeroCopySender_ && zeroCopySender_->onErrMessage(cmsg)) {
+    return;
+  }
+  if (replaySafeNotified_) {
+    return;
+  }
   if ((cmsg.cmsg_level == SOL_IP && cmsg.cmsg_type == IP_RECVERR) ||
       (cmsg.cmsg_level == SOL_IPV6 && cmsg.cmsg_type == IPV6_RECVERR)) {
     const struct sock_extended_err* serr =
@@ -1021,7 +1137,16 @@ void QuicClientTransport::errMessage(
 void QuicClientTransport::getReadBuffer(void** buf, size_t* len) noexcept {
   DCHECK(conn_) << "trying to receive packets without a connection";
   auto readBufferSize = conn_->transportSettings.maxRecvPacketSize;
-  readBuffer_ = folly::IOBuf::create(readBufferSize);
+  if (conn_->transportSettings.readBufferPoolSize > 0) {
+    if (!readBufferPool_ ||
+        readBufferPool_->getBufferSize() != readBufferSize) {
+      readBufferPool_ = std::make_unique<BufferPool>(
+          readBufferSize, conn_->transportSettings.readBufferPoolSize);
+    }
+    readBuffer_ = readBufferPool_->getBuffer();
+  } else {
+    readBuffer_ = folly::IOBuf::create(readBufferSize);
+  }
   *buf = readBuffer_->writableData();
   *len = readBufferSize;
 }
@@ -1031,9 +1156,12 @@ void QuicClientTransport::onDataAvailable(
     size_t len,
     bool truncated) noexcept {
   VLOG(10) << "Got data from socket peer=" << server << " len=" << len;
-  // TODO: we can get better receive time accuracy than this, with
-  // SO_TIMESTAMP or SIOCGSTAMP.
   auto packetReceiveTime = Clock::now();
+  if (conn_->transportSettings.kernelTimestamps && !happyEyeballsEnabled_) {
+    packetReceiveTime =
+        getLastReceiveTime(socket_->getNetworkSocket(), lastKernelReceiveTime_)
+            .value_or(packetReceiveTime);
+  }
   Buf data = std::move(readBuffer_);
   if (truncated) {
     // This is an error, drop the packet.
@@ -1061,23 +1189,70 @@ void QuicClientTransport::
   happyEyeballsStartSecondSocket(conn_->happyEyeballsState);
 }
 
+void QuicClientTransport::setUpKernelTimestamps() {
+  const auto& settings = conn_->transportSettings;
+  // The receive times are read with SIOCGSTAMPNS, which the software send
+  // timestamps would make the kernel stop keeping, so the send times only
+  // come from the NIC. They are matched to the batches by the order of the
+  // send calls, which needs one call per batch.
+  if (settings.hardwareTimestamps &&
+      (settings.batchingMode == QuicBatchingMode::BATCHING_MODE_NONE ||
+       settings.batchingMode == QuicBatchingMode::BATCHING_MODE_GSO) &&
+      !zeroCopySender_ && !settings.pacingUseTxTime) {
+    txTimestamper_ = std::make_unique<TxTimestamper>(*socket_, true);
+    if (txTimestamper_->enabled()) {
+      conn_->txTimestamper = txTimestamper_.get();
+    } else {
+      txTimestamper_.reset();
+    }
+  }
+  // Turns the receive timestamps on.
+  getLastReceiveTime(socket_->getNetworkSocket(), lastKernelReceiveTime_);
+}
+
+void QuicClientTransport::setUpZeroCopySend() {
+  if (!conn_->transportSettings.zeroCopySend || zeroCopySender_) {
+    return;
+  }
+  zeroCopySender_ = std::make_unique<ZeroCopySender>(*socket_);
+  if (zeroCopySender_->enabled()) {
+    conn_->zeroCopySender = zeroCopySender_.get();
+  } else {
+    zeroCopySender_.reset();
+  }
+}
+
 void QuicClientTransport::start(ConnectionCallback* cb) {
   if (happyEyeballsEnabled_) {
-    // TODO Supply v4 delay amount from somewhere when we want to tune this
+    if (happyEyeballsCachedFamily_ == AF_UNSPEC && happyEyeballsCache_ &&
+        hostname_) {
+      happyEyeballsCachedFamily_ =
+          happyEyeballsCache_->getFamily(*hostname_).value_or(AF_UNSPEC);
+    }
+    auto connAttemptDelay =
+        conn_->transportSettings.happyEyeballsConnAttemptDelay.value_or(
+            happyEyeballsCachedFamily_ == AF_UNSPEC
+                ? kHappyEyeballsV4Delay
+                : kHappyEyeballsConnAttemptDelayWithCache);
     startHappyEyeballs(
         *conn_,
         evb_,
         happyEyeballsCachedFamily_,
         happyEyeballsConnAttemptDelayTimeout_,
-        happyEyeballsCachedFamily_ == AF_UNSPEC
-            ? kHappyEyeballsV4Delay
-            : kHappyEyeballsConnAttemptDelayWithCache,
+        connAttemptDelay,
         this,
         this);
   }
 
   CHECK(conn_->peerAddress.isInitialized());
 
+  if (serverInfoCache_ && hostname_) {
+    cachedServerInfo_ = serverInfoCache_->getServerInfo(*hostname_);
+    if (cachedServerInfo_) {
+      updateStateFromCachedServerInfo(*clientConn_, *cachedServerInfo_);
+    }
+  }
+
   if (!ctx_) {
     ctx_ = std::make_shared<const fizz::client::FizzClientContext>();
   }
@@ -1094,6 +1269,37 @@ void QuicClientTransport::start(ConnectionCallback* cb) {
   try {
     happyEyeballsSetUpSocket(
         *socket_, conn_->peerAddress, conn_->transportSettings, this, this);
+    if (conn_->transportSettings.pacingEnabled &&
+        conn_->transportSettings.pacingUseTxTime &&
+        (happyEyeballsEnabled_ ||
+         !TxTimePacketBatchWriter::enableTxTime(socket_->getNetworkSocket()))) {
+      // Happy eyeballs could move us to a second socket, fall back to timer
+      // based pacing.
+      auto transportSettings = conn_->transportSettings;
+      transportSettings.pacingUseTxTime = false;
+      setTransportSettings(std::move(transportSettings));
+    }
+    if (!happyEyeballsEnabled_) {
+      setUpZeroCopySend();
+    }
+    if (conn_->transportSettings.kernelTimestamps && !happyEyeballsEnabled_) {
+      setUpKernelTimestamps();
+    }
+    if (conn_->transportSettings.busyPollBudget.count() > 0) {
+      QuicBatchReader::enableBusyPoll(
+          socket_->getNetworkSocket(), conn_->transportSettings.busyPollBudget);
+    }
+    // Happy eyeballs could move us to a second socket, which is not marked.
+    auto ecnMarking =
+        ecnMarkingFor(conn_->transportSettings.defaultCongestionController);
+    if (conn_->transportSettings.enableEcn && !happyEyeballsEnabled_ &&
+        setEcnMarking(
+            socket_->getNetworkSocket(),
+            socket_->address().getFamily(),
+            ecnMarking)) {
+      conn_->ecnState = QuicConnectionStateBase::EcnState::Enabled;
+      conn_->ecnMarking = ecnMarking;
+    }
     startCryptoHandshake();
   } catch (const QuicTransportException& ex) {
     runOnEvbAsync([ex](auto self) {
@@ -1146,6 +1352,16 @@ void QuicClientTransport::setHappyEyeballsCachedFamily(
   happyEyeballsCachedFamily_ = cachedFamily;
 }
 
+void QuicClientTransport::setHappyEyeballsCache(
+    std::shared_ptr<QuicHappyEyeballsCache> happyEyeballsCache) {
+  happyEyeballsCache_ = std::move(happyEyeballsCache);
+}
+
+void QuicClientTransport::setServerInfoCache(
+    std::shared_ptr<QuicServerInfoCache> serverInfoCache) {
+  serverInfoCache_ = std::move(serverInfoCache);
+}
+
 void QuicClientTransport::addNewSocket(
     std::unique_ptr<folly::AsyncUDPSocket> socket) {
   happyEyeballsAddSocket(*conn_, std::move(socket));
@@ -1202,7 +1418,8 @@ bool QuicClientTransport::setCustomTransportParameter(
 
 void QuicClientTransport::setPartialReliabilityTransportParameter() {
   uint64_t partialReliabilitySetting = 0;
-  if (conn_->transportSettings.partialReliabilityEnabled) {
+  if (kPartialReliabilityBuilt &&
+      conn_->transportSettings.partialReliabilityEnabled) {
     partialReliabilitySetting = 1;
   }
   auto partialReliabilityCustomParam =
@@ -1214,6 +1431,52 @@ void QuicClientTransport::setPartialReliabilityTransportParameter() {
   }
 }
 
+void QuicClientTransport::setAckFrequencyTransportParameter() {
+  if (!conn_->transportSettings.ackFrequencyEnabled) {
+    return;
+  }
+  auto minAckDelayCustomParam =
+      std::make_unique<CustomIntegralTransportParameter>(
+          kMinAckDelayParameterId, kDefaultMinAckDelay.count());
+
+  if (!setCustomTransportParameter(std::move(minAckDelayCustomParam))) {
+    LOG(ERROR) << "failed to set min ack delay transport setting";
+  }
+}
+
+void QuicClientTransport::setFecTransportParameter() {
+  if (!conn_->transportSettings.fecEnabled) {
+    return;
+  }
+  auto fecCustomParam =
+      std::make_unique<CustomIntegralTransportParameter>(kFecParameterId, 1);
+
+  if (!setCustomTransportParameter(std::move(fecCustomParam))) {
+    LOG(ERROR) << "failed to set fec transport setting";
+  }
+}
+
+void QuicClientTransport::setDatagramTransportParameter() {
+  if (conn_->transportSettings.maxDatagramFrameSize == 0) {
+    return;
+  }
+  // The parameter is not in the private range that
+  // setCustomTransportParameter() accepts.
+  auto it = std::find_if(
+      customTransportParameters_.begin(),
+      customTransportParameters_.end(),
+      [](const TransportParameter& param) {
+        return param.parameter ==
+            TransportParameterId::max_datagram_frame_size;
+      });
+  if (it != customTransportParameters_.end()) {
+    return;
+  }
+  customTransportParameters_.push_back(encodeIntegerParameter(
+      TransportParameterId::max_datagram_frame_size,
+      conn_->transportSettings.maxDatagramFrameSize));
+}
+
 void QuicClientTransport::closeTransport() {
   happyEyeballsConnAttemptDelayTimeout_.cancelTimeout();
 }
@@ -1225,6 +1488,7 @@ void QuicClientTransport::unbindConnection() {
 void QuicClientTransport::setSupportedVersions(
     const std::vector<QuicVersion>& versions) {
   conn_->originalVersion = versions.at(0);
+  conn_->supportedVersions = versions;
   auto params = conn_->readCodec->getCodecParameters();
   params.version = conn_->originalVersion.value();
   conn_->readCodec->setCodecParameters(params);
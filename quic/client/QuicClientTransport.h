@@ -12,9 +12,14 @@
 #include <folly/SocketAddress.h>
 #include <folly/io/async/AsyncUDPSocket.h>
 #include <folly/net/NetOps.h>
+#include <quic/api/QuicBatchWriter.h>
+#include <quic/api/QuicSocketTimestamps.h>
 #include <quic/api/QuicTransportBase.h>
 #include <quic/client/handshake/QuicPskCache.h>
+#include <quic/client/handshake/QuicServerInfoCache.h>
 #include <quic/client/state/ClientStateMachine.h>
+#include <quic/common/BufferPool.h>
+#include <quic/happyeyeballs/QuicHappyEyeballsCache.h>
 
 namespace quic {
 
@@ -77,6 +82,21 @@ class QuicClientTransport
   void setHappyEyeballsEnabled(bool happyEyeballsEnabled);
   virtual void setHappyEyeballsCachedFamily(sa_family_t cachedFamily);
 
+  /**
+   * Set the cache that remembers which address family won happy eyeballs for
+   * the hostname. It is used when no family is set with
+   * setHappyEyeballsCachedFamily.
+   */
+  void setHappyEyeballsCache(
+      std::shared_ptr<QuicHappyEyeballsCache> happyEyeballsCache);
+
+  /**
+   * Set the cache that remembers the versions and transport parameters of
+   * the server for the hostname, so that the connection starts with a
+   * version the server supports without a PSK to resume.
+   */
+  void setServerInfoCache(std::shared_ptr<QuicServerInfoCache> serverInfoCache);
+
   /**
    * Set the cache that remembers psk and server transport parameters from
    * last connection. This is useful for session resumption and 0-rtt.
@@ -162,6 +182,10 @@ class QuicClientTransport
 
   void startCryptoHandshake();
 
+  void setUpKernelTimestamps();
+
+  void setUpZeroCopySend();
+
   void happyEyeballsConnAttemptDelayTimeoutExpired() noexcept;
 
   // From ClientHandshake::HandshakeCallback
@@ -169,6 +193,15 @@ class QuicClientTransport
       fizz::client::NewCachedPsk& newCachedPsk) noexcept override;
 
   Buf readBuffer_;
+  // Recycles readBuffer_ once the packet it carried has been processed.
+  std::unique_ptr<BufferPool> readBufferPool_;
+  // Only set when zeroCopySend is enabled, once happy eyeballs is done.
+  std::unique_ptr<ZeroCopySender> zeroCopySender_;
+  // Only set when kernelTimestamps is enabled with hardware timestamps and
+  // the socket is written with one send call per batch.
+  std::unique_ptr<TxTimestamper> txTimestamper_;
+  // Kernel receive time of the last packet, with kernelTimestamps
+  struct timespec lastKernelReceiveTime_ {};
   folly::Optional<std::string> hostname_;
   std::shared_ptr<const fizz::client::FizzClientContext> ctx_;
   std::shared_ptr<const fizz::CertificateVerifier> verifier_;
@@ -190,6 +223,9 @@ class QuicClientTransport
   folly::Optional<QuicCachedPsk> getPsk();
   void removePsk();
   void setPartialReliabilityTransportParameter();
+  void setAckFrequencyTransportParameter();
+  void setDatagramTransportParameter();
+  void setFecTransportParameter();
 
  private:
   bool replaySafeNotified_{false};
@@ -198,7 +234,10 @@ class QuicClientTransport
   std::shared_ptr<QuicClientTransport> selfOwning_;
   bool happyEyeballsEnabled_{false};
   sa_family_t happyEyeballsCachedFamily_{AF_UNSPEC};
+  std::shared_ptr<QuicHappyEyeballsCache> happyEyeballsCache_;
   std::shared_ptr<QuicPskCache> pskCache_;
+  std::shared_ptr<QuicServerInfoCache> serverInfoCache_;
+  folly::Optional<CachedServerInfo> cachedServerInfo_;
   QuicClientConnectionState* clientConn_;
   std::vector<TransportParameter> customTransportParameters_;
 };
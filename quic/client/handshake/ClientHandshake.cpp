@@ -8,6 +8,8 @@
 
 #include <quic/client/handshake/ClientHandshake.h>
 
+#include <fizz/compression/CertDecompressionManager.h>
+#include <fizz/compression/ZlibCertificateDecompressor.h>
 #include <fizz/protocol/Protocol.h>
 #include <quic/handshake/FizzBridge.h>
 #include <quic/handshake/FizzCryptoFactory.h>
@@ -18,6 +20,10 @@ namespace quic {
 ClientHandshake::ClientHandshake(QuicCryptoState& cryptoState)
     : cryptoState_(cryptoState), visitor_(*this) {}
 
+void ClientHandshake::setCertificateCompression(bool certificateCompression) {
+  certificateCompression_ = certificateCompression;
+}
+
 void ClientHandshake::connect(
     std::shared_ptr<const fizz::client::FizzClientContext> context,
     std::shared_ptr<const fizz::CertificateVerifier> verifier,
@@ -29,10 +35,21 @@ void ClientHandshake::connect(
   callback_ = callback;
   auto ctx = std::make_shared<fizz::client::FizzClientContext>(*context);
   ctx->setFactory(std::make_shared<QuicFizzFactory>());
-  ctx->setSupportedCiphers({fizz::CipherSuite::TLS_AES_128_GCM_SHA256});
+  ctx->setSupportedCiphers(getPreferredCipherSuites());
   ctx->setCompatibilityMode(false);
   // Since Draft-17, EOED should not be sent
   ctx->setOmitEarlyRecordLayer(true);
+  if (certificateCompression_) {
+    // The decompressors are stateless, so every connection shares them.
+    static auto decompressionManager = [] {
+      auto manager = std::make_shared<fizz::CertDecompressionManager>();
+      manager->setDecompressors(
+          {std::make_shared<fizz::ZlibCertificateDecompressor>()});
+      return manager;
+    }();
+    ctx->setCertDecompressionManager(decompressionManager);
+  }
+  timings_.startTime = Clock::now();
   processActions(machine_.processConnect(
       state_,
       std::move(ctx),
@@ -40,6 +57,9 @@ void ClientHandshake::connect(
       std::move(hostname),
       std::move(cachedPsk),
       transportParams));
+  timings_.processingTime +=
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - *timings_.startTime);
 }
 
 void ClientHandshake::doHandshake(
@@ -75,6 +95,7 @@ void ClientHandshake::doHandshake(
   // Get the current buffer type the transport is accepting.
   waitForData_ = false;
   while (!waitForData_) {
+    auto processingStart = Clock::now();
     switch (state_.readRecordLayer()->getEncryptionLevel()) {
       case fizz::EncryptionLevel::Plaintext:
         processActions(machine_.processSocketData(state_, initialReadBuf_));
@@ -87,6 +108,9 @@ void ClientHandshake::doHandshake(
         processActions(machine_.processSocketData(state_, appDataReadBuf_));
         break;
     }
+    timings_.processingTime +=
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - processingStart);
     if (error_) {
       error_.throw_exception();
     }
@@ -175,6 +199,7 @@ ClientHandshake::getZeroRttWriteHeaderCipher() {
 void ClientHandshake::onRecvOneRttProtectedData() {
   if (phase_ != Phase::Established) {
     phase_ = Phase::Established;
+    timings_.establishedTime = Clock::now();
   }
 }
 
@@ -182,6 +207,10 @@ ClientHandshake::Phase ClientHandshake::getPhase() const {
   return phase_;
 }
 
+const HandshakeTimings& ClientHandshake::getHandshakeTimings() const {
+  return timings_;
+}
+
 folly::Optional<ServerTransportParameters>
 ClientHandshake::getServerTransportParams() {
   return transportParams_->getServerTransportParams();
@@ -210,6 +239,22 @@ const folly::Optional<std::string>& ClientHandshake::getApplicationProtocol()
   }
 }
 
+std::unique_ptr<Aead> ClientHandshake::getNextOneRttReadCipher() {
+  if (oneRttReadSecret_.empty()) {
+    return nullptr;
+  }
+  return deriveNextOneRttAead(
+      *state_.context()->getFactory(), *state_.cipher(), oneRttReadSecret_);
+}
+
+std::unique_ptr<Aead> ClientHandshake::getNextOneRttWriteCipher() {
+  if (oneRttWriteSecret_.empty()) {
+    return nullptr;
+  }
+  return deriveNextOneRttAead(
+      *state_.context()->getFactory(), *state_.cipher(), oneRttWriteSecret_);
+}
+
 void ClientHandshake::computeOneRttCipher(
     const fizz::client::ReportHandshakeSuccess& handshakeSuccess) {
   // The 1-rtt handshake should have succeeded if we know that the early
@@ -231,6 +276,7 @@ void ClientHandshake::computeOneRttCipher(
   // ClientCleartext. We assume that by the time we get the data for the QUIC
   // stream, the server would have also acked all the client initial packets.
   phase_ = Phase::OneRttKeysDerived;
+  timings_.keysDerivedTime = Clock::now();
 }
 
 void ClientHandshake::computeZeroRttCipher() {
@@ -350,7 +396,7 @@ void ClientHandshake::ActionMoveVisitor::operator()(
                     kQuicIVLabel));
             client_.zeroRttWriteHeaderCipher_ =
                 cryptoFactory.makePacketNumberCipher(
-                    folly::range(secretAvailable.secret.secret));
+                    folly::range(secretAvailable.secret.secret), cipher);
             break;
           }
           default:
@@ -366,7 +412,8 @@ void ClientHandshake::ActionMoveVisitor::operator()(
             kQuicKeyLabel,
             kQuicIVLabel);
         auto headerCipher = cryptoFactory.makePacketNumberCipher(
-            folly::range(secretAvailable.secret.secret));
+            folly::range(secretAvailable.secret.secret),
+            *client_.state_.cipher());
         switch (handshakeSecrets) {
           case fizz::HandshakeSecrets::ClientHandshakeTraffic:
             client_.handshakeWriteCipher_ = FizzAead::wrap(std::move(aead));
@@ -387,15 +434,18 @@ void ClientHandshake::ActionMoveVisitor::operator()(
             kQuicKeyLabel,
             kQuicIVLabel);
         auto appHeaderCipher = cryptoFactory.makePacketNumberCipher(
-            folly::range(secretAvailable.secret.secret));
+            folly::range(secretAvailable.secret.secret),
+            *client_.state_.cipher());
         switch (appSecrets) {
           case fizz::AppTrafficSecrets::ClientAppTraffic:
             client_.oneRttWriteCipher_ = FizzAead::wrap(std::move(aead));
             client_.oneRttWriteHeaderCipher_ = std::move(appHeaderCipher);
+            client_.oneRttWriteSecret_ = secretAvailable.secret.secret;
             break;
           case fizz::AppTrafficSecrets::ServerAppTraffic:
             client_.oneRttReadCipher_ = FizzAead::wrap(std::move(aead));
             client_.oneRttReadHeaderCipher_ = std::move(appHeaderCipher);
+            client_.oneRttReadSecret_ = secretAvailable.secret.secret;
             break;
         }
       },
@@ -40,6 +40,12 @@ class ClientHandshake : public Handshake {
 
   explicit ClientHandshake(QuicCryptoState& cryptoState);
 
+  /**
+   * Accepts certificates compressed with zlib from the server. Must be called
+   * before connect.
+   */
+  void setCertificateCompression(bool certificateCompression);
+
   /**
    * Initiate the handshake with the supplied parameters.
    */
@@ -129,6 +135,12 @@ class ClientHandshake : public Handshake {
 
   Phase getPhase() const;
 
+  /**
+   * Returns when the handshake reached each phase and how long fizz spent
+   * processing it so far.
+   */
+  const HandshakeTimings& getHandshakeTimings() const;
+
   /**
    * Was the TLS connection resumed or not.
    */
@@ -151,6 +163,9 @@ class ClientHandshake : public Handshake {
    */
   const folly::Optional<std::string>& getApplicationProtocol() const override;
 
+  std::unique_ptr<Aead> getNextOneRttReadCipher() override;
+  std::unique_ptr<Aead> getNextOneRttWriteCipher() override;
+
   /**
    * Returns the negotiated transport parameters chosen by the server
    */
@@ -182,6 +197,8 @@ class ClientHandshake : public Handshake {
   // Represents the packet type that should be used to write the data currently
   // in the stream.
   Phase phase_{Phase::Initial};
+  HandshakeTimings timings_;
+  bool certificateCompression_{false};
 
   std::unique_ptr<Aead> handshakeWriteCipher_;
   std::unique_ptr<Aead> handshakeReadCipher_;
@@ -189,6 +206,10 @@ class ClientHandshake : public Handshake {
   std::unique_ptr<Aead> oneRttWriteCipher_;
   std::unique_ptr<Aead> zeroRttWriteCipher_;
 
+  // The 1-RTT traffic secrets, of the last key phase derived.
+  std::vector<uint8_t> oneRttReadSecret_;
+  std::vector<uint8_t> oneRttWriteSecret_;
+
   std::unique_ptr<PacketNumberCipher> oneRttReadHeaderCipher_;
   std::unique_ptr<PacketNumberCipher> oneRttWriteHeaderCipher_;
   std::unique_ptr<PacketNumberCipher> handshakeReadHeaderCipher_;
@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/client/handshake/PersistentQuicPskCache.h>
+
+#include <fizz/client/PskSerializationUtils.h>
+#include <fizz/record/Types.h>
+#include <folly/FileUtil.h>
+#include <folly/hash/Hash.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+#include <folly/system/MemoryMapping.h>
+
+namespace quic {
+
+namespace {
+// Bumped whenever the encoding changes, so that a process does not misread
+// the snapshot of another version.
+constexpr uint8_t kPskSnapshotVersion = 1;
+constexpr size_t kPskSnapshotGrowth = 4096;
+
+void writeString(const std::string& str, folly::io::Appender& out) {
+  fizz::detail::writeBuf<uint32_t>(
+      folly::IOBuf::wrapBuffer(str.data(), str.size()), out);
+}
+
+std::string readString(folly::io::Cursor& cursor) {
+  Buf buf;
+  fizz::detail::readBuf<uint32_t>(buf, cursor);
+  auto range = buf->coalesce();
+  return std::string(range.begin(), range.end());
+}
+
+void writePsk(
+    const std::string& identity,
+    const QuicCachedPsk& psk,
+    folly::io::Appender& out) {
+  writeString(identity, out);
+  writeString(fizz::client::serializePsk(psk.cachedPsk), out);
+  const auto& params = psk.transportParams;
+  fizz::detail::write(static_cast<uint32_t>(params.negotiatedVersion), out);
+  for (auto value :
+       {params.idleTimeout,
+        params.maxRecvPacketSize,
+        params.initialMaxData,
+        params.initialMaxStreamDataBidiLocal,
+        params.initialMaxStreamDataBidiRemote,
+        params.initialMaxStreamDataUni,
+        params.initialMaxStreamsBidi,
+        params.initialMaxStreamsUni}) {
+    fizz::detail::write<uint64_t>(value, out);
+  }
+  writeString(psk.appParams, out);
+}
+
+QuicCachedPsk readPsk(folly::io::Cursor& cursor, const fizz::Factory& factory) {
+  QuicCachedPsk psk;
+  psk.cachedPsk = fizz::client::deserializePsk(readString(cursor), factory);
+  auto& params = psk.transportParams;
+  uint32_t version;
+  fizz::detail::read(version, cursor);
+  params.negotiatedVersion = static_cast<QuicVersion>(version);
+  for (auto field :
+       {&params.idleTimeout,
+        &params.maxRecvPacketSize,
+        &params.initialMaxData,
+        &params.initialMaxStreamDataBidiLocal,
+        &params.initialMaxStreamDataBidiRemote,
+        &params.initialMaxStreamDataUni,
+        &params.initialMaxStreamsBidi,
+        &params.initialMaxStreamsUni}) {
+    fizz::detail::read(*field, cursor);
+  }
+  psk.appParams = readString(cursor);
+  return psk;
+}
+} // namespace
+
+PersistentQuicPskCache::PersistentQuicPskCache(
+    size_t maxEntries,
+    size_t numShards,
+    std::shared_ptr<fizz::Factory> factory)
+    : factory_(std::move(factory)) {
+  numShards = std::max<size_t>(numShards, 1);
+  auto maxEntriesPerShard =
+      std::max<size_t>((maxEntries + numShards - 1) / numShards, 1);
+  for (size_t i = 0; i < numShards; ++i) {
+    shards_.push_back(std::make_unique<Shard>(maxEntriesPerShard));
+  }
+}
+
+PersistentQuicPskCache::Shard& PersistentQuicPskCache::getShard(
+    const std::string& identity) const {
+  return *shards_[folly::Hash()(identity) % shards_.size()];
+}
+
+folly::Optional<QuicCachedPsk> PersistentQuicPskCache::getPsk(
+    const std::string& identity) {
+  auto& shard = getShard(identity);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  auto it = shard.cache.find(identity);
+  if (it == shard.cache.end()) {
+    return folly::none;
+  }
+  return it->second;
+}
+
+void PersistentQuicPskCache::putPsk(
+    const std::string& identity,
+    QuicCachedPsk psk) {
+  auto& shard = getShard(identity);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  shard.cache.set(identity, std::move(psk));
+}
+
+void PersistentQuicPskCache::removePsk(const std::string& identity) {
+  auto& shard = getShard(identity);
+  std::lock_guard<std::mutex> guard(shard.mutex);
+  shard.cache.erase(identity);
+}
+
+size_t PersistentQuicPskCache::size() const {
+  size_t size = 0;
+  for (const auto& shard : shards_) {
+    std::lock_guard<std::mutex> guard(shard->mutex);
+    size += shard->cache.size();
+  }
+  return size;
+}
+
+bool PersistentQuicPskCache::saveSnapshot(const std::string& path) const {
+  auto buf = folly::IOBuf::create(kPskSnapshotGrowth);
+  folly::io::Appender appender(buf.get(), kPskSnapshotGrowth);
+  fizz::detail::write(kPskSnapshotVersion, appender);
+  try {
+    for (const auto& shard : shards_) {
+      std::lock_guard<std::mutex> guard(shard->mutex);
+      // Least recently used first, so that loading the snapshot leaves the
+      // most recently used PSKs the last to be evicted.
+      for (auto it = shard->cache.rbegin(); it != shard->cache.rend(); ++it) {
+        writePsk(it->first, it->second, appender);
+      }
+    }
+    folly::writeFileAtomic(path, buf->coalesce(), 0600);
+  } catch (const std::exception& ex) {
+    LOG(ERROR) << "Failed to save the PSK snapshot to " << path << ": "
+               << ex.what();
+    return false;
+  }
+  return true;
+}
+
+size_t PersistentQuicPskCache::loadSnapshot(const std::string& path) {
+  std::unique_ptr<folly::MemoryMapping> mapping;
+  try {
+    mapping = std::make_unique<folly::MemoryMapping>(path.c_str());
+  } catch (const std::exception& ex) {
+    VLOG(2) << "No PSK snapshot at " << path << ": " << ex.what();
+    return 0;
+  }
+  auto data = mapping->range();
+  if (data.empty()) {
+    return 0;
+  }
+  auto buf = folly::IOBuf::wrapBuffer(data);
+  folly::io::Cursor cursor(buf.get());
+  auto now = std::chrono::system_clock::now();
+  size_t loaded = 0;
+  try {
+    uint8_t version;
+    fizz::detail::read(version, cursor);
+    if (version != kPskSnapshotVersion) {
+      LOG(WARNING) << "Ignoring PSK snapshot " << path << " of version "
+                   << static_cast<int>(version);
+      return 0;
+    }
+    while (!cursor.isAtEnd()) {
+      auto identity = readString(cursor);
+      auto psk = readPsk(cursor, *factory_);
+      if (psk.cachedPsk.ticketExpirationTime <= now) {
+        continue;
+      }
+      putPsk(identity, std::move(psk));
+      ++loaded;
+    }
+  } catch (const std::exception& ex) {
+    LOG(WARNING) << "PSK snapshot " << path << " is corrupt after " << loaded
+                 << " PSKs: " << ex.what();
+  }
+  return loaded;
+}
+
+} // namespace quic
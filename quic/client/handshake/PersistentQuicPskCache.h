@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+#include <quic/client/handshake/QuicPskCache.h>
+
+#include <fizz/protocol/Factory.h>
+#include <folly/container/EvictingCacheMap.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace quic {
+
+/**
+ * A PSK cache that can be shared by the clients on all threads, and saved to
+ * and loaded from a file so that a restarted process resumes with 0-RTT
+ * rather than doing a full handshake with each of its peers again.
+ *
+ * The cache is split into shards by identity, each with its own lock and
+ * each evicting its least recently used PSKs once it holds its share of
+ * maxEntries.
+ */
+class PersistentQuicPskCache : public QuicPskCache {
+ public:
+  explicit PersistentQuicPskCache(
+      size_t maxEntries,
+      size_t numShards = kDefaultPskCacheShards,
+      std::shared_ptr<fizz::Factory> factory =
+          std::make_shared<fizz::Factory>());
+
+  ~PersistentQuicPskCache() override = default;
+
+  folly::Optional<QuicCachedPsk> getPsk(const std::string& identity) override;
+
+  void putPsk(const std::string& identity, QuicCachedPsk psk) override;
+
+  void removePsk(const std::string& identity) override;
+
+  size_t size() const;
+
+  /**
+   * Writes the PSKs to the file, replacing it atomically. The file holds the
+   * resumption secrets, so it is only readable by the owner. Returns false
+   * if it could not be written.
+   */
+  bool saveSnapshot(const std::string& path) const;
+
+  /**
+   * Adds the PSKs of a snapshot that have not expired, mapping the file
+   * rather than reading it. A truncated or corrupt file adds the PSKs up to
+   * where it went bad. Returns the number of PSKs added.
+   */
+  size_t loadSnapshot(const std::string& path);
+
+ private:
+  struct Shard {
+    explicit Shard(size_t maxEntries) : cache(maxEntries) {}
+
+    mutable std::mutex mutex;
+    folly::EvictingCacheMap<std::string, QuicCachedPsk> cache;
+  };
+
+  Shard& getShard(const std::string& identity) const;
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+  std::shared_ptr<fizz::Factory> factory_;
+};
+
+} // namespace quic
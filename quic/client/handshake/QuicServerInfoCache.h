@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+
+#include <folly/Optional.h>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace quic {
+
+/**
+ * What the client learned about a server on its last connection that is of
+ * use before the next handshake is done, when there is no PSK to resume.
+ */
+struct CachedServerInfo {
+  // the versions the server supports, from its transport parameters or its
+  // last version negotiation packet
+  std::vector<QuicVersion> supportedVersions;
+  // the max_packet_size of the server, 0 if it is not known
+  uint64_t maxRecvPacketSize{0};
+  bool partialReliability{false};
+};
+
+/**
+ * Remembers the versions and transport parameters of a host, so that the
+ * next connection to it starts with a version the server supports and sizes
+ * its first flight for the server.
+ */
+class QuicServerInfoCache {
+ public:
+  virtual ~QuicServerInfoCache() = default;
+
+  virtual folly::Optional<CachedServerInfo> getServerInfo(
+      const std::string&) = 0;
+  virtual void putServerInfo(const std::string&, CachedServerInfo) = 0;
+};
+
+/**
+ * Basic cache that stores the server info in a hash map. There is no bound
+ * on the size of this cache.
+ */
+class BasicQuicServerInfoCache : public QuicServerInfoCache {
+ public:
+  ~BasicQuicServerInfoCache() override = default;
+
+  folly::Optional<CachedServerInfo> getServerInfo(
+      const std::string& host) override {
+    auto result = cache_.find(host);
+    if (result != cache_.end()) {
+      return result->second;
+    }
+    return folly::none;
+  }
+
+  void putServerInfo(const std::string& host, CachedServerInfo info) override {
+    cache_[host] = std::move(info);
+  }
+
+ private:
+  std::unordered_map<std::string, CachedServerInfo> cache_;
+};
+
+} // namespace quic
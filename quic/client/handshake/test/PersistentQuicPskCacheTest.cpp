@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/client/handshake/PersistentQuicPskCache.h>
+
+#include <folly/FileUtil.h>
+#include <folly/experimental/TestUtil.h>
+#include <gtest/gtest.h>
+
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+namespace {
+QuicCachedPsk makePsk(
+    const std::string& secret,
+    std::chrono::system_clock::time_point expiration =
+        std::chrono::system_clock::now() + 1h) {
+  QuicCachedPsk quicCachedPsk;
+  auto& psk = quicCachedPsk.cachedPsk;
+  psk.psk = std::string("psk");
+  psk.secret = secret;
+  psk.type = fizz::PskType::Resumption;
+  psk.version = fizz::ProtocolVersion::tls_1_3;
+  psk.cipher = fizz::CipherSuite::TLS_AES_128_GCM_SHA256;
+  psk.alpn = std::string("h3");
+  psk.ticketAgeAdd = 1;
+  psk.ticketIssueTime = std::chrono::system_clock::now();
+  psk.ticketExpirationTime = expiration;
+  psk.ticketHandshakeTime = std::chrono::system_clock::now();
+  psk.maxEarlyDataSize = 2;
+
+  auto& params = quicCachedPsk.transportParams;
+  params.negotiatedVersion = QuicVersion::MVFST;
+  params.idleTimeout = 1;
+  params.maxRecvPacketSize = 2;
+  params.initialMaxData = 3;
+  params.initialMaxStreamDataBidiLocal = 4;
+  params.initialMaxStreamDataBidiRemote = 5;
+  params.initialMaxStreamDataUni = 6;
+  params.initialMaxStreamsBidi = 7;
+  params.initialMaxStreamsUni = 8;
+  quicCachedPsk.appParams = "app";
+  return quicCachedPsk;
+}
+} // namespace
+
+TEST(PersistentQuicPskCacheTest, PutGetRemove) {
+  PersistentQuicPskCache cache(10);
+  EXPECT_FALSE(cache.getPsk("host").hasValue());
+  cache.putPsk("host", makePsk("secret"));
+  auto psk = cache.getPsk("host");
+  ASSERT_TRUE(psk.hasValue());
+  EXPECT_EQ(psk->cachedPsk.secret, "secret");
+  cache.putPsk("host", makePsk("other"));
+  EXPECT_EQ(cache.getPsk("host")->cachedPsk.secret, "other");
+  EXPECT_EQ(cache.size(), 1);
+  cache.removePsk("host");
+  EXPECT_FALSE(cache.getPsk("host").hasValue());
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(PersistentQuicPskCacheTest, EvictLeastRecentlyUsed) {
+  PersistentQuicPskCache cache(2, 1);
+  cache.putPsk("a", makePsk("a"));
+  cache.putPsk("b", makePsk("b"));
+  EXPECT_TRUE(cache.getPsk("a").hasValue());
+  cache.putPsk("c", makePsk("c"));
+  EXPECT_TRUE(cache.getPsk("a").hasValue());
+  EXPECT_FALSE(cache.getPsk("b").hasValue());
+  EXPECT_TRUE(cache.getPsk("c").hasValue());
+}
+
+TEST(PersistentQuicPskCacheTest, SnapshotRoundTrip) {
+  folly::test::TemporaryDirectory dir;
+  auto path = (dir.path() / "psks").string();
+  {
+    PersistentQuicPskCache cache(10);
+    cache.putPsk("host1", makePsk("secret1"));
+    cache.putPsk("host2", makePsk("secret2"));
+    cache.putPsk("expired", makePsk("old", std::chrono::system_clock::now()));
+    ASSERT_TRUE(cache.saveSnapshot(path));
+  }
+  PersistentQuicPskCache cache(10);
+  EXPECT_EQ(cache.loadSnapshot(path), 2);
+  EXPECT_FALSE(cache.getPsk("expired").hasValue());
+  auto psk = cache.getPsk("host2");
+  ASSERT_TRUE(psk.hasValue());
+  auto expected = makePsk("secret2");
+  EXPECT_EQ(psk->cachedPsk.psk, expected.cachedPsk.psk);
+  EXPECT_EQ(psk->cachedPsk.secret, expected.cachedPsk.secret);
+  EXPECT_EQ(psk->cachedPsk.cipher, expected.cachedPsk.cipher);
+  EXPECT_EQ(psk->cachedPsk.alpn, expected.cachedPsk.alpn);
+  EXPECT_EQ(psk->cachedPsk.maxEarlyDataSize, 2);
+  EXPECT_EQ(psk->transportParams.negotiatedVersion, QuicVersion::MVFST);
+  EXPECT_EQ(psk->transportParams.idleTimeout, 1);
+  EXPECT_EQ(psk->transportParams.initialMaxData, 3);
+  EXPECT_EQ(psk->transportParams.initialMaxStreamsUni, 8);
+  EXPECT_EQ(psk->appParams, "app");
+}
+
+TEST(PersistentQuicPskCacheTest, LoadMissingSnapshot) {
+  folly::test::TemporaryDirectory dir;
+  PersistentQuicPskCache cache(10);
+  EXPECT_EQ(cache.loadSnapshot((dir.path() / "missing").string()), 0);
+}
+
+TEST(PersistentQuicPskCacheTest, LoadTruncatedSnapshot) {
+  folly::test::TemporaryDirectory dir;
+  auto path = (dir.path() / "psks").string();
+  PersistentQuicPskCache cache(10, 1);
+  cache.putPsk("host1", makePsk("secret1"));
+  cache.putPsk("host2", makePsk("secret2"));
+  ASSERT_TRUE(cache.saveSnapshot(path));
+  std::string contents;
+  ASSERT_TRUE(folly::readFile(path.c_str(), contents));
+  contents.resize(contents.size() - 1);
+  ASSERT_TRUE(folly::writeFile(contents, path.c_str()));
+
+  PersistentQuicPskCache loaded(10);
+  EXPECT_EQ(loaded.loadSnapshot(path), 1);
+  EXPECT_TRUE(loaded.getPsk("host1").hasValue());
+  EXPECT_FALSE(loaded.getPsk("host2").hasValue());
+}
+
+TEST(PersistentQuicPskCacheTest, LoadOtherVersion) {
+  folly::test::TemporaryDirectory dir;
+  auto path = (dir.path() / "psks").string();
+  PersistentQuicPskCache cache(10);
+  cache.putPsk("host", makePsk("secret"));
+  ASSERT_TRUE(cache.saveSnapshot(path));
+  std::string contents;
+  ASSERT_TRUE(folly::readFile(path.c_str(), contents));
+  contents[0] ^= 0xff;
+  ASSERT_TRUE(folly::writeFile(contents, path.c_str()));
+  EXPECT_EQ(PersistentQuicPskCache(10).loadSnapshot(path), 0);
+}
+
+} // namespace test
+} // namespace quic
@@ -13,9 +13,12 @@
 #include <quic/congestion_control/QuicCubic.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/handshake/TransportParameters.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/QuicStateFunctions.h>
 #include <quic/state/StateData.h>
 
+#include <algorithm>
+
 namespace quic {
 
 std::unique_ptr<QuicClientConnectionState> undoAllClientStateCommon(
@@ -85,6 +88,14 @@ void processServerInitialParams(
   auto partialReliability = getIntegerParameter(
       static_cast<TransportParameterId>(kPartialReliabilityParameterId),
       serverParams.parameters);
+  auto minAckDelay = getIntegerParameter(
+      static_cast<TransportParameterId>(kMinAckDelayParameterId),
+      serverParams.parameters);
+  auto maxDatagramFrameSize = getIntegerParameter(
+      TransportParameterId::max_datagram_frame_size, serverParams.parameters);
+  auto fec = getIntegerParameter(
+      static_cast<TransportParameterId>(kFecParameterId),
+      serverParams.parameters);
 
   if (!packetSize || *packetSize == 0) {
     packetSize = kDefaultMaxUDPPayload;
@@ -131,14 +142,24 @@ void processServerInitialParams(
   if (conn.transportSettings.canIgnorePathMTU) {
     conn.udpSendPacketLen = *packetSize;
   }
+  startPathMtuDiscovery(conn, *packetSize);
 
-  if (partialReliability && *partialReliability != 0 &&
-      conn.transportSettings.partialReliabilityEnabled) {
-    conn.partialReliabilityEnabled = true;
-  }
+#ifndef MVFST_NO_PARTIAL_RELIABILITY
+  // Assigned rather than set, as 0-RTT may have assumed it from the cache.
+  conn.partialReliabilityEnabled = partialReliability &&
+      *partialReliability != 0 &&
+      conn.transportSettings.partialReliabilityEnabled;
+#endif
   VLOG(10) << "conn.partialReliabilityEnabled="
            << conn.partialReliabilityEnabled;
 
+  if (minAckDelay && conn.transportSettings.ackFrequencyEnabled) {
+    conn.peerMinAckDelay = std::chrono::microseconds(*minAckDelay);
+  }
+  conn.datagramState.maxWriteFrameSize = maxDatagramFrameSize.value_or(0);
+  conn.fecState.enabled =
+      conn.transportSettings.fecEnabled && fec.value_or(0) == 1;
+
   conn.statelessResetToken = std::move(statelessResetToken);
   // Update the existing streams, because we allow streams to be created before
   // the connection is established.
@@ -175,6 +196,27 @@ void updateTransportParamsFromCachedEarlyParams(
       transportParams.initialMaxStreamsUni);
 }
 
+void updateStateFromCachedServerInfo(
+    QuicClientConnectionState& conn,
+    const CachedServerInfo& serverInfo) {
+  auto version = std::find_first_of(
+      conn.supportedVersions.begin(),
+      conn.supportedVersions.end(),
+      serverInfo.supportedVersions.begin(),
+      serverInfo.supportedVersions.end());
+  if (version != conn.supportedVersions.end() &&
+      *version != conn.originalVersion) {
+    conn.originalVersion = *version;
+    auto params = conn.readCodec->getCodecParameters();
+    params.version = *version;
+    conn.readCodec->setCodecParameters(params);
+  }
+  if (conn.transportSettings.canIgnorePathMTU &&
+      serverInfo.maxRecvPacketSize >= kMinMaxUDPPayload) {
+    conn.udpSendPacketLen = serverInfo.maxRecvPacketSize;
+  }
+}
+
 void ClientInvalidStateHandler(QuicClientConnectionState& state) {
   state.state = ClientStates::Error();
 }
@@ -10,6 +10,7 @@
 
 #include <folly/io/async/AsyncSocketException.h>
 #include <quic/client/handshake/ClientHandshake.h>
+#include <quic/client/handshake/QuicServerInfoCache.h>
 #include <quic/congestion_control/QuicCubic.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/handshake/TransportParameters.h>
@@ -63,7 +64,7 @@ struct QuicClientConnectionState : public QuicConnectionStateBase {
 
   QuicClientConnectionState() : QuicConnectionStateBase(QuicNodeType::Client) {
     state = ClientStates::Handshaking();
-    cryptoState = std::make_unique<QuicCryptoState>();
+    cryptoState = std::make_unique<QuicCryptoState>(&cryptoBufferBytes);
     congestionController = std::make_unique<Cubic>(*this);
     // TODO: this is wrong, it should be the handshake finish time. But i need
     // a relatively sane time now to make the timestamps all sane.
@@ -104,4 +105,14 @@ void updateTransportParamsFromCachedEarlyParams(
     QuicClientConnectionState& conn,
     const CachedServerTransportParameters& transportParams);
 
+/**
+ * Called before the first Initial is written. The first of the supported
+ * versions that the server supports becomes the original version, and when
+ * the path MTU can be ignored the first flight is sized with the
+ * max_packet_size of the server.
+ */
+void updateStateFromCachedServerInfo(
+    QuicClientConnectionState& conn,
+    const CachedServerInfo& serverInfo);
+
 } // namespace quic
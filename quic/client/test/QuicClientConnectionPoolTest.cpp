@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/client/QuicClientConnectionPool.h>
+
+#include <folly/io/async/test/MockAsyncUDPSocket.h>
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+namespace {
+class FakeClientTransport : public QuicClientTransport {
+ public:
+  FakeClientTransport(
+      folly::EventBase* evb,
+      std::unique_ptr<folly::AsyncUDPSocket> socket)
+      : QuicClientTransport(evb, std::move(socket)) {}
+
+  void start(ConnectionCallback* cb) override {
+    callback = cb;
+  }
+
+  bool good() const override {
+    return isGood;
+  }
+
+  uint64_t getNumOpenableBidirectionalStreams() const override {
+    return openableStreams;
+  }
+
+  void becomeReady() {
+    isGood = true;
+    callback->onTransportReady();
+  }
+
+  ConnectionCallback* callback{nullptr};
+  bool isGood{false};
+  uint64_t openableStreams{100};
+};
+
+class MockConnectCallback : public QuicClientConnectionPool::ConnectCallback {
+ public:
+  GMOCK_METHOD1_(
+      ,
+      noexcept,
+      ,
+      onConnectSuccess,
+      void(std::shared_ptr<QuicClientTransport>));
+  GMOCK_METHOD1_(
+      ,
+      noexcept,
+      ,
+      onConnectError,
+      void(std::pair<QuicErrorCode, std::string>));
+};
+} // namespace
+
+class QuicClientConnectionPoolTest : public Test {
+ public:
+  void SetUp() override {
+    pool = std::make_unique<QuicClientConnectionPool>(
+        &evb,
+        [this](const std::string&, const std::string&) {
+          auto transport = std::make_shared<FakeClientTransport>(
+              &evb, std::make_unique<folly::test::MockAsyncUDPSocket>(&evb));
+          transports.push_back(transport);
+          return transport;
+        },
+        nullptr,
+        2);
+  }
+
+  void TearDown() override {
+    pool.reset();
+    evb.loopOnce();
+  }
+
+  folly::EventBase evb;
+  std::vector<std::shared_ptr<FakeClientTransport>> transports;
+  std::unique_ptr<QuicClientConnectionPool> pool;
+};
+
+TEST_F(QuicClientConnectionPoolTest, CoalesceConnects) {
+  MockConnectCallback cb1, cb2;
+  pool->getConnection("host", "h3", &cb1);
+  pool->getConnection("host", "h3", &cb2);
+  ASSERT_EQ(transports.size(), 1);
+  std::shared_ptr<QuicClientTransport> transport = transports[0];
+  EXPECT_CALL(cb1, onConnectSuccess(transport));
+  EXPECT_CALL(cb2, onConnectSuccess(transport));
+  transports[0]->becomeReady();
+}
+
+TEST_F(QuicClientConnectionPoolTest, ReuseReadyConnection) {
+  MockConnectCallback cb;
+  pool->getConnection("host", "h3", &cb);
+  EXPECT_CALL(cb, onConnectSuccess(_)).Times(2);
+  transports[0]->becomeReady();
+  pool->getConnection("host", "h3", &cb);
+  EXPECT_EQ(transports.size(), 1);
+  EXPECT_EQ(pool->numConnections("host", "h3"), 1);
+}
+
+TEST_F(QuicClientConnectionPoolTest, KeyedByHostAndAlpn) {
+  MockConnectCallback cb;
+  pool->getConnection("host", "h3", &cb);
+  pool->getConnection("host", "hq", &cb);
+  pool->getConnection("other", "h3", &cb);
+  EXPECT_EQ(transports.size(), 3);
+  EXPECT_EQ(pool->numConnections("host", "h3"), 1);
+  EXPECT_EQ(pool->numConnections("host", "hq"), 1);
+  EXPECT_CALL(cb, onConnectError(_)).Times(3);
+  pool.reset();
+}
+
+TEST_F(QuicClientConnectionPoolTest, NewConnectionWhenStreamsRunOut) {
+  MockConnectCallback cb;
+  EXPECT_CALL(cb, onConnectSuccess(_)).Times(2);
+  pool->getConnection("host", "h3", &cb);
+  transports[0]->becomeReady();
+  transports[0]->openableStreams = 0;
+  pool->getConnection("host", "h3", &cb);
+  ASSERT_EQ(transports.size(), 2);
+  transports[1]->becomeReady();
+
+  // At the limit the connection with the most streams is used anyway.
+  transports[1]->openableStreams = 0;
+  std::shared_ptr<QuicClientTransport> transport = transports[0];
+  transports[0]->openableStreams = 1;
+  EXPECT_CALL(cb, onConnectSuccess(transport));
+  pool->getConnection("host", "h3", &cb);
+  EXPECT_EQ(transports.size(), 2);
+}
+
+TEST_F(QuicClientConnectionPoolTest, ConnectErrorFailsWaiters) {
+  MockConnectCallback cb1, cb2;
+  pool->getConnection("host", "h3", &cb1);
+  pool->getConnection("host", "h3", &cb2);
+  EXPECT_CALL(cb1, onConnectError(_));
+  EXPECT_CALL(cb2, onConnectError(_));
+  transports[0]->callback->onConnectionError(std::make_pair(
+      QuicErrorCode(LocalErrorCode::CONNECT_FAILED), std::string("failed")));
+  EXPECT_EQ(pool->numConnections("host", "h3"), 0);
+}
+
+TEST_F(QuicClientConnectionPoolTest, ReadyConnectionEnds) {
+  MockConnectCallback cb;
+  EXPECT_CALL(cb, onConnectSuccess(_));
+  pool->getConnection("host", "h3", &cb);
+  transports[0]->becomeReady();
+  transports[0]->callback->onConnectionEnd();
+  EXPECT_EQ(pool->numConnections("host", "h3"), 0);
+  pool->getConnection("host", "h3", &cb);
+  EXPECT_EQ(transports.size(), 2);
+  EXPECT_CALL(cb, onConnectError(_));
+  pool.reset();
+}
+
+TEST_F(QuicClientConnectionPoolTest, Cancel) {
+  MockConnectCallback cb1, cb2;
+  pool->getConnection("host", "h3", &cb1);
+  pool->getConnection("host", "h3", &cb2);
+  pool->cancel(&cb1);
+  EXPECT_CALL(cb1, onConnectSuccess(_)).Times(0);
+  EXPECT_CALL(cb2, onConnectSuccess(_));
+  transports[0]->becomeReady();
+}
+
+TEST_F(QuicClientConnectionPoolTest, Prewarm) {
+  pool->prewarm("host", "h3", 5);
+  EXPECT_EQ(transports.size(), 2);
+  EXPECT_EQ(pool->numConnections("host", "h3"), 2);
+  transports[1]->becomeReady();
+
+  MockConnectCallback cb;
+  std::shared_ptr<QuicClientTransport> transport = transports[1];
+  EXPECT_CALL(cb, onConnectSuccess(transport));
+  pool->getConnection("host", "h3", &cb);
+  EXPECT_EQ(transports.size(), 2);
+}
+
+TEST_F(QuicClientConnectionPoolTest, CloseAllFailsWaiters) {
+  MockConnectCallback cb;
+  pool->getConnection("host", "h3", &cb);
+  EXPECT_CALL(cb, onConnectError(_));
+  pool->closeAll();
+  EXPECT_EQ(pool->numConnections("host", "h3"), 0);
+}
+
+} // namespace test
+} // namespace quic
@@ -19,6 +19,8 @@
 #include <folly/io/Cursor.h>
 #include <folly/io/async/ScopedEventBaseThread.h>
 #include <folly/io/async/test/MockAsyncUDPSocket.h>
+#include <quic/api/QuicBatchWriter.h>
+#include <quic/api/QuicSocketTimestamps.h>
 #include <quic/client/handshake/test/MockQuicPskCache.h>
 #include <quic/codec/DefaultConnectionIdAlgo.h>
 #include <quic/common/test/TestUtils.h>
@@ -31,6 +33,10 @@
 #include <quic/samples/echo/EchoHandler.h>
 #include <quic/samples/echo/EchoServer.h>
 
+#ifdef FOLLY_HAVE_MSG_ERRQUEUE
+#include <linux/errqueue.h>
+#endif
+
 using namespace testing;
 using namespace folly;
 using namespace quic::samples;
@@ -79,13 +85,11 @@ class TestingQuicClientTransport : public QuicClientTransport {
     return *dynamic_cast<QuicClientConnectionState*>(conn_.get());
   }
 
-  const std::unordered_map<StreamId, ReadCallbackData>& getReadCallbacks()
-      const {
+  const StreamIdMap<ReadCallbackData>& getReadCallbacks() const {
     return readCallbacks_;
   }
 
-  const std::unordered_map<
-      StreamId,
+  const StreamIdMap<
       std::deque<std::pair<uint64_t, QuicSocket::DeliveryCallback*>>>&
   getDeliveryCallbacks() const {
     return deliveryCallbacks_;
@@ -103,6 +107,10 @@ class TestingQuicClientTransport : public QuicClientTransport {
     return idleTimeout_;
   }
 
+  auto& idleDeadline() {
+    return idleDeadline_;
+  }
+
   auto& lossTimeout() {
     return lossTimeout_;
   }
@@ -1622,6 +1630,28 @@ TEST_F(QuicClientTransportTest, AddNewPeerAddressSetsPacketSize) {
   client->closeNow(folly::none);
 }
 
+TEST_F(QuicClientTransportTest, StartWithCachedServerInfo) {
+  auto serverInfoCache = std::make_shared<BasicQuicServerInfoCache>();
+  CachedServerInfo serverInfo;
+  serverInfo.supportedVersions = {MVFST2, QuicVersion::QUIC_DRAFT};
+  serverInfo.maxRecvPacketSize = 1400;
+  serverInfoCache->putServerInfo("TestHost", serverInfo);
+  client->getNonConstConn().transportSettings.canIgnorePathMTU = true;
+  client->addNewPeerAddress(serverAddr);
+  client->setHostname("TestHost");
+  client->setServerInfoCache(serverInfoCache);
+  EXPECT_CALL(*sock, write(_, _))
+      .WillRepeatedly(Invoke([&](const SocketAddress&,
+                                 const std::unique_ptr<folly::IOBuf>& buf) {
+        return buf->computeChainDataLength();
+      }));
+  client->start(&clientConnCallback);
+  // The most preferred version of the client that the server supports.
+  EXPECT_EQ(QuicVersion::QUIC_DRAFT, *client->getConn().originalVersion);
+  EXPECT_EQ(1400, client->getConn().udpSendPacketLen);
+  client->closeNow(folly::none);
+}
+
 TEST_F(QuicClientTransportTest, SocketClosedDuringOnTransportReady) {
   class ConnectionCallbackThatWritesOnTransportReady
       : public QuicSocket::ConnectionCallback {
@@ -2285,6 +2315,60 @@ class QuicClientTransportHappyEyeballsTest : public QuicClientTransportTest {
     EXPECT_FALSE(conn.happyEyeballsState.shouldWriteToSecondSocket);
   }
 
+  void secondWinRacingInitials(
+      const SocketAddress& firstAddress,
+      const SocketAddress& secondAddress) {
+    auto& conn = client->getConn();
+    TransportSettings settings;
+    settings.happyEyeballsConnAttemptDelay = 0ms;
+    client->setTransportSettings(settings);
+    client->setHostname("TestHost");
+    auto happyEyeballsCache = std::make_shared<BasicQuicHappyEyeballsCache>();
+    client->setHappyEyeballsCache(happyEyeballsCache);
+
+    // The first Initial goes out on both sockets without waiting.
+    EXPECT_CALL(*sock, write(firstAddress, _));
+    EXPECT_CALL(*secondSock, write(secondAddress, _))
+        .WillOnce(Invoke([&](const SocketAddress&,
+                             const std::unique_ptr<folly::IOBuf>& buf) {
+          socketWrites.push_back(buf->clone());
+          return buf->computeChainDataLength();
+        }));
+    client->start(&clientConnCallback);
+    setConnectionIds();
+    EXPECT_EQ(conn.peerAddress, firstAddress);
+    EXPECT_EQ(conn.happyEyeballsState.secondPeerAddress, secondAddress);
+    EXPECT_FALSE(client->happyEyeballsConnAttemptDelayTimeout().isScheduled());
+    EXPECT_TRUE(conn.happyEyeballsState.shouldWriteToFirstSocket);
+    EXPECT_TRUE(conn.happyEyeballsState.shouldWriteToSecondSocket);
+    EXPECT_EQ(socketWrites.size(), 1);
+    EXPECT_TRUE(
+        verifyLongHeader(*socketWrites.at(0), LongHeader::Types::Initial));
+
+    socketWrites.clear();
+
+    EXPECT_FALSE(conn.happyEyeballsState.finished);
+    EXPECT_CALL(clientConnCallback, onTransportReady());
+    EXPECT_CALL(clientConnCallback, onReplaySafe());
+    EXPECT_CALL(*sock, write(_, _)).Times(0);
+    EXPECT_CALL(*sock, pauseRead());
+    EXPECT_CALL(*sock, close());
+    EXPECT_CALL(*secondSock, write(secondAddress, _))
+        .Times(AtLeast(1))
+        .WillRepeatedly(Invoke([&](const SocketAddress&,
+                                   const std::unique_ptr<folly::IOBuf>& buf) {
+          socketWrites.push_back(buf->clone());
+          return buf->computeChainDataLength();
+        }));
+    performFakeHandshake(secondAddress);
+    EXPECT_TRUE(conn.happyEyeballsState.finished);
+    EXPECT_FALSE(conn.happyEyeballsState.shouldWriteToSecondSocket);
+    EXPECT_EQ(conn.peerAddress, secondAddress);
+    // The next connection to the host tries the winning family first.
+    EXPECT_EQ(
+        secondAddress.getFamily(), happyEyeballsCache->getFamily("TestHost"));
+  }
+
  protected:
   folly::test::MockAsyncUDPSocket* secondSock;
   SocketAddress serverAddrV4{"127.0.0.1", 443};
@@ -2431,6 +2515,36 @@ TEST_F(
   fatalWriteErrorOnBothAfterSecondStarts(serverAddrV4, serverAddrV6);
 }
 
+TEST_F(QuicClientTransportHappyEyeballsTest, V6FirstAndV4WinRacingInitials) {
+  secondWinRacingInitials(serverAddrV6, serverAddrV4);
+}
+
+TEST_F(QuicClientTransportHappyEyeballsTest, V4FirstAndV6WinRacingInitials) {
+  client->setHappyEyeballsCachedFamily(AF_INET);
+  secondWinRacingInitials(serverAddrV4, serverAddrV6);
+}
+
+TEST_F(QuicClientTransportHappyEyeballsTest, CachedFamilyFromCache) {
+  auto happyEyeballsCache = std::make_shared<BasicQuicHappyEyeballsCache>();
+  happyEyeballsCache->putFamily("TestHost", AF_INET);
+  client->setHostname("TestHost");
+  client->setHappyEyeballsCache(happyEyeballsCache);
+  firstWinBeforeSecondStart(serverAddrV4, serverAddrV6);
+}
+
+TEST_F(QuicClientTransportHappyEyeballsTest, StaggeredConnAttemptDelay) {
+  TransportSettings settings;
+  settings.happyEyeballsConnAttemptDelay = 20ms;
+  client->setTransportSettings(settings);
+  EXPECT_CALL(*sock, write(serverAddrV6, _));
+  EXPECT_CALL(*secondSock, write(_, _)).Times(0);
+  client->start(&clientConnCallback);
+  EXPECT_TRUE(client->happyEyeballsConnAttemptDelayTimeout().isScheduled());
+  EXPECT_LE(
+      client->happyEyeballsConnAttemptDelayTimeout().getTimeRemaining(), 20ms);
+  EXPECT_FALSE(client->getConn().happyEyeballsState.shouldWriteToSecondSocket);
+}
+
 class QuicClientTransportAfterStartTest : public QuicClientTransportTest {
  public:
   void SetUp() override {
@@ -2458,6 +2572,31 @@ class QuicClientTransportAfterStartTest : public QuicClientTransportTest {
   std::string hostname_{"TestHost"};
 };
 
+class QuicClientTransportServerInfoCacheTest
+    : public QuicClientTransportAfterStartTest {
+ public:
+  void SetUp() override {
+    client->setServerInfoCache(serverInfoCache_);
+    QuicClientTransportAfterStartTest::SetUp();
+  }
+
+ protected:
+  std::shared_ptr<BasicQuicServerInfoCache> serverInfoCache_{
+      std::make_shared<BasicQuicServerInfoCache>()};
+};
+
+TEST_F(QuicClientTransportServerInfoCacheTest, CachesServerTransportParams) {
+  auto serverInfo = serverInfoCache_->getServerInfo(hostname_);
+  ASSERT_TRUE(serverInfo);
+  EXPECT_EQ(
+      serverInfo->supportedVersions,
+      std::vector<QuicVersion>({QuicVersion::MVFST, QuicVersion::QUIC_DRAFT}));
+  EXPECT_EQ(
+      serverInfo->maxRecvPacketSize, mockClientHandshake->maxRecvPacketSize);
+  EXPECT_FALSE(serverInfo->partialReliability);
+  client->close(folly::none);
+}
+
 class QuicClientTransportVersionAndRetryTest
     : public QuicClientTransportAfterStartTest {
  public:
@@ -2809,6 +2948,179 @@ TEST_F(QuicClientTransportAfterStartTest, CloseConnectionWithNoStreamPending) {
       socketWrites, *makeEncryptedCodec()));
 }
 
+#ifdef FOLLY_HAVE_MSG_ERRQUEUE
+TEST_F(QuicClientTransportAfterStartTest, IcmpErrorIgnoredAfterReplaySafe) {
+  char control[CMSG_SPACE(sizeof(struct sock_extended_err))] = {};
+  auto cmsg = reinterpret_cast<struct cmsghdr*>(control);
+  cmsg->cmsg_level = SOL_IP;
+  cmsg->cmsg_type = IP_RECVERR;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(struct sock_extended_err));
+  auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(cmsg));
+  serr->ee_errno = ECONNREFUSED;
+  serr->ee_origin = SO_EE_ORIGIN_ICMP;
+  client->errMessage(*cmsg);
+  eventbase_->loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_FALSE(client->isClosed());
+}
+
+// The mock socket hands the descriptor of a real one to the zero copy sender
+// of the client, and no descriptor afterwards, so that the client keeps
+// writing through the mock while the test can send with MSG_ZEROCOPY.
+class QuicClientTransportZeroCopyTest
+    : public QuicClientTransportAfterStartTest {
+ public:
+  void SetUp() override {
+    zeroCopySock_.setReuseAddr(false);
+    zeroCopySock_.bind(folly::SocketAddress("127.0.0.1", 0));
+    zeroCopySupported_ =
+        ZeroCopySender::enableZeroCopy(zeroCopySock_.getNetworkSocket());
+    EXPECT_CALL(*sock, getNetworkSocket())
+        .WillOnce(Return(zeroCopySock_.getNetworkSocket()))
+        .WillRepeatedly(Return(folly::NetworkSocket()));
+    auto transportSettings = client->getTransportSettings();
+    transportSettings.zeroCopySend = true;
+    client->setTransportSettings(transportSettings);
+    QuicClientTransportAfterStartTest::SetUp();
+  }
+
+  void setUpSocketExpectations() override {
+    EXPECT_CALL(*sock, setReuseAddr(false));
+    EXPECT_CALL(*sock, bind(_));
+    EXPECT_CALL(*sock, dontFragment(true));
+    EXPECT_CALL(*sock, setErrMessageCallback(client.get()));
+    EXPECT_CALL(*sock, resumeRead(client.get()));
+    // The completions of the sends come through the callback.
+    EXPECT_CALL(*sock, setErrMessageCallback(nullptr))
+        .Times(zeroCopySupported_ ? 0 : 1);
+    EXPECT_CALL(*sock, write(_, _)).Times(AtLeast(1));
+  }
+
+ protected:
+  // Reads the error queue of the socket into the client, as the socket does
+  // for its error message callback.
+  void deliverErrMessages() {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (::recvmsg(
+            zeroCopySock_.getNetworkSocket().toFd(),
+            &msg,
+            MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+      return;
+    }
+    for (auto cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+      client->errMessage(*cm);
+    }
+  }
+
+  folly::AsyncUDPSocket zeroCopySock_{eventbase_.get()};
+  bool zeroCopySupported_{false};
+};
+
+TEST_F(QuicClientTransportZeroCopyTest, CompletionsAfterReplaySafe) {
+  auto sender = client->getConn().zeroCopySender;
+  if (!zeroCopySupported_) {
+    EXPECT_EQ(sender, nullptr);
+    return;
+  }
+  ASSERT_NE(sender, nullptr);
+  auto buf = IOBuf::copyBuffer("zero copy");
+  EXPECT_EQ(
+      sender->write(zeroCopySock_, zeroCopySock_.address(), buf, 0),
+      buf->length());
+  // Nothing is written afterwards, the completion has to come through the
+  // error message callback.
+  for (int i = 0; i < 100 && sender->numPendingBuffers() > 0; ++i) {
+    deliverErrMessages();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(sender->numPendingBuffers(), 0);
+  EXPECT_FALSE(client->isClosed());
+}
+
+// The mock socket hands out the descriptor of a real one, on which the
+// client turns the hardware send timestamps on.
+class QuicClientTransportTxTimestampsTest
+    : public QuicClientTransportAfterStartTest {
+ public:
+  void SetUp() override {
+    timestampedSock_.setReuseAddr(false);
+    timestampedSock_.bind(folly::SocketAddress("127.0.0.1", 0));
+    timestampsSupported_ = TxTimestamper::enableTxTimestamps(
+        timestampedSock_.getNetworkSocket(), true);
+    ON_CALL(*sock, getNetworkSocket())
+        .WillByDefault(Return(timestampedSock_.getNetworkSocket()));
+    auto transportSettings = client->getTransportSettings();
+    transportSettings.kernelTimestamps = true;
+    transportSettings.hardwareTimestamps = true;
+    client->setTransportSettings(transportSettings);
+    QuicClientTransportAfterStartTest::SetUp();
+  }
+
+  void setUpSocketExpectations() override {
+    EXPECT_CALL(*sock, setReuseAddr(false));
+    EXPECT_CALL(*sock, bind(_));
+    EXPECT_CALL(*sock, dontFragment(true));
+    EXPECT_CALL(*sock, setErrMessageCallback(client.get()));
+    EXPECT_CALL(*sock, resumeRead(client.get()));
+    // The send timestamps come through the callback.
+    EXPECT_CALL(*sock, setErrMessageCallback(nullptr))
+        .Times(timestampsSupported_ ? 0 : 1);
+    EXPECT_CALL(*sock, write(_, _)).Times(AtLeast(1));
+  }
+
+ protected:
+  folly::AsyncUDPSocket timestampedSock_{eventbase_.get()};
+  bool timestampsSupported_{false};
+};
+
+TEST_F(QuicClientTransportTxTimestampsTest, TimestampsAfterReplaySafe) {
+  auto timestamper = client->getConn().txTimestamper;
+  if (!timestampsSupported_) {
+    EXPECT_EQ(timestamper, nullptr);
+    return;
+  }
+  ASSERT_NE(timestamper, nullptr);
+  auto streamId = client->createBidirectionalStream().value();
+  client->writeChain(streamId, IOBuf::copyBuffer("hello"), false, false);
+  eventbase_->loopOnce(EVLOOP_NONBLOCK);
+  ASSERT_GT(timestamper->numPendingBatches(), 0);
+
+  // A hardware timestamp of a send after all the batches so far, as the
+  // socket reads it from its error queue.
+  char tsControl[CMSG_SPACE(sizeof(struct scm_timestamping))] = {};
+  auto tsCmsg = reinterpret_cast<struct cmsghdr*>(tsControl);
+  tsCmsg->cmsg_level = SOL_SOCKET;
+  tsCmsg->cmsg_type = SCM_TIMESTAMPING;
+  tsCmsg->cmsg_len = CMSG_LEN(sizeof(struct scm_timestamping));
+  struct scm_timestamping timestamps;
+  memset(&timestamps, 0, sizeof(timestamps));
+  auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()) -
+      std::chrono::milliseconds(1);
+  timestamps.ts[2].tv_sec = sinceEpoch.count() / 1000000000;
+  timestamps.ts[2].tv_nsec = sinceEpoch.count() % 1000000000;
+  memcpy(CMSG_DATA(tsCmsg), &timestamps, sizeof(timestamps));
+  client->errMessage(*tsCmsg);
+
+  char idControl[CMSG_SPACE(sizeof(struct sock_extended_err))] = {};
+  auto idCmsg = reinterpret_cast<struct cmsghdr*>(idControl);
+  idCmsg->cmsg_level = SOL_IP;
+  idCmsg->cmsg_type = IP_RECVERR;
+  idCmsg->cmsg_len = CMSG_LEN(sizeof(struct sock_extended_err));
+  auto serr = reinterpret_cast<struct sock_extended_err*>(CMSG_DATA(idCmsg));
+  serr->ee_errno = ENOMSG;
+  serr->ee_origin = SO_EE_ORIGIN_TIMESTAMPING;
+  serr->ee_info = SCM_TSTAMP_SND;
+  serr->ee_data = 1 << 20;
+  client->errMessage(*idCmsg);
+  EXPECT_EQ(timestamper->numPendingBatches(), 0);
+  EXPECT_FALSE(client->isClosed());
+}
+#endif
+
 class QuicClientTransportAfterStartTestClose
     : public QuicClientTransportAfterStartTest,
       public testing::WithParamInterface<bool> {};
@@ -3212,6 +3524,7 @@ TEST_F(QuicClientTransportAfterStartTest, IdleTimerResetNoOutstandingPackets) {
 TEST_F(QuicClientTransportAfterStartTest, IdleTimeoutExpired) {
   EXPECT_CALL(*sock, close());
   socketWrites.clear();
+  client->idleDeadline() = Clock::now();
   client->idleTimeout().timeoutExpired();
 
   EXPECT_FALSE(client->idleTimeout().isScheduled());
@@ -3231,6 +3544,7 @@ TEST_F(QuicClientTransportAfterStartTest, RecvDataAfterIdleTimeout) {
   auto qLogger = std::make_shared<FileQLogger>();
   client->getNonConstConn().qLogger = qLogger;
   EXPECT_CALL(*sock, close());
+  client->idleDeadline() = Clock::now();
   client->idleTimeout().timeoutExpired();
 
   socketWrites.clear();
@@ -3726,6 +4040,27 @@ TEST_F(
   client->close(folly::none);
 }
 
+TEST_F(
+    QuicClientTransportVersionAndRetryTest,
+    VersionNegotiationPacketCachesVersions) {
+  auto serverInfoCache = std::make_shared<BasicQuicServerInfoCache>();
+  client->setServerInfoCache(serverInfoCache);
+  loopForWrites();
+
+  auto packet = VersionNegotiationPacketBuilder(
+                    *client->getConn().initialDestinationConnectionId,
+                    *originalConnId,
+                    {MVFST2, QuicVersion::QUIC_DRAFT})
+                    .buildPacket();
+  EXPECT_THROW(deliverData(packet.second->coalesce()), std::runtime_error);
+  auto serverInfo = serverInfoCache->getServerInfo(hostname_);
+  ASSERT_TRUE(serverInfo);
+  EXPECT_EQ(
+      serverInfo->supportedVersions,
+      std::vector<QuicVersion>({MVFST2, QuicVersion::QUIC_DRAFT}));
+  client->close(folly::none);
+}
+
 TEST_F(QuicClientTransportVersionAndRetryTest, UnencryptedStreamData) {
   StreamId streamId = *client->createBidirectionalStream();
   auto expected = IOBuf::copyBuffer("hello");
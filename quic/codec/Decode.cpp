@@ -12,9 +12,14 @@
 #include <quic/codec/PacketNumber.h>
 #include <quic/codec/QuicInteger.h>
 
+#include <algorithm>
+#include <array>
+
 namespace {
 // Minimum required length (in bytes) for the destination connection-id
 constexpr size_t kMinInitialDestinationConnIdLength = 8;
+// Number of ack blocks whose gap and length are decoded in one batch.
+constexpr size_t kAckBlocksPerDecodeBatch = 16;
 
 template <class T>
 inline std::string toHex(
@@ -135,28 +140,30 @@ ReadAckFrame decodeAckFrame(
   frame.largestAcked = largestAcked;
   frame.ackDelay = std::chrono::microseconds(adjustedAckDelay);
   frame.ackBlocks.emplace_back(currentPacketNum, largestAcked);
-  for (uint64_t numBlocks = 0; numBlocks < additionalAckBlocks->first;
-       ++numBlocks) {
-    auto currentGap = decodeQuicInteger(cursor);
-    if (UNLIKELY(!currentGap)) {
+  // The gaps and lengths of the blocks are decoded in batches. The batch
+  // size bounds the stack used, as the block count comes from the peer.
+  std::array<uint64_t, 2 * kAckBlocksPerDecodeBatch> gapsAndLens;
+  uint64_t remainingBlocks = additionalAckBlocks->first;
+  while (remainingBlocks > 0) {
+    size_t numBlocks = std::min<uint64_t>(
+        remainingBlocks, static_cast<uint64_t>(kAckBlocksPerDecodeBatch));
+    size_t decoded =
+        decodeQuicIntegers(cursor, gapsAndLens.data(), 2 * numBlocks);
+    if (UNLIKELY(decoded < 2 * numBlocks)) {
       throw QuicTransportException(
-          "Bad gap",
+          decoded % 2 == 0 ? "Bad gap" : "Bad block len",
           quic::TransportErrorCode::FRAME_ENCODING_ERROR,
           quic::FrameType::ACK);
     }
-    auto blockLen = decodeQuicInteger(cursor);
-    if (UNLIKELY(!blockLen)) {
-      throw QuicTransportException(
-          "Bad block len",
-          quic::TransportErrorCode::FRAME_ENCODING_ERROR,
-          quic::FrameType::ACK);
+    for (size_t i = 0; i < decoded; i += 2) {
+      PacketNum nextEndPacket =
+          nextAckedPacketGap(currentPacketNum, gapsAndLens[i]);
+      currentPacketNum = nextAckedPacketLen(nextEndPacket, gapsAndLens[i + 1]);
+      // We don't need to add the entry when the block length is zero since
+      // we already would have processed it in the previous iteration.
+      frame.ackBlocks.emplace_back(currentPacketNum, nextEndPacket);
     }
-    PacketNum nextEndPacket =
-        nextAckedPacketGap(currentPacketNum, currentGap->first);
-    currentPacketNum = nextAckedPacketLen(nextEndPacket, blockLen->first);
-    // We don't need to add the entry when the block length is zero since we
-    // already would have processed it in the previous iteration.
-    frame.ackBlocks.emplace_back(currentPacketNum, nextEndPacket);
+    remainingBlocks -= numBlocks;
   }
   return frame;
 }
@@ -165,9 +172,7 @@ ReadAckFrame decodeAckFrameWithECN(
     folly::io::Cursor& cursor,
     const PacketHeader& header,
     const CodecParameters& params) {
-  // TODO this is incomplete
   auto readAckFrame = decodeAckFrame(cursor, header, params);
-  // TODO we simply ignore ECN blocks in ACK-ECN frames for now.
   auto ect_0 = decodeQuicInteger(cursor);
   if (UNLIKELY(!ect_0)) {
     throw QuicTransportException(
@@ -189,6 +194,10 @@ ReadAckFrame decodeAckFrameWithECN(
         quic::TransportErrorCode::FRAME_ENCODING_ERROR,
         quic::FrameType::ACK_ECN);
   }
+  readAckFrame.ecnCounts.emplace();
+  readAckFrame.ecnCounts->ect0 = ect_0->first;
+  readAckFrame.ecnCounts->ect1 = ect_1->first;
+  readAckFrame.ecnCounts->ce = ect_ce->first;
   return readAckFrame;
 }
 
@@ -339,13 +348,13 @@ ReadStreamFrame decodeStreamFrame(
   }
   Buf data;
   if (dataLength.hasValue()) {
-    if (cursor.totalLength() < dataLength->first) {
+    if (!cursor.canAdvance(dataLength->first)) {
       throw QuicTransportException(
           "Length mismatch",
           quic::TransportErrorCode::FRAME_ENCODING_ERROR,
           quic::FrameType::STREAM);
     }
-    // If dataLength > data's actual length then the cursor will throw.
+    // The data is a clone sharing the decrypted packet buffer, not a copy.
     cursor.clone(data, dataLength->first);
   } else {
     // Missing Data Length field doesn't mean no data. It means the rest of the
@@ -545,6 +554,126 @@ PathResponseFrame decodePathResponseFrame(folly::io::Cursor& cursor) {
   return PathResponseFrame(pathData);
 }
 
+AckFrequencyFrame decodeAckFrequencyFrame(folly::io::Cursor& cursor) {
+  auto sequenceNumber = decodeQuicInteger(cursor);
+  if (UNLIKELY(!sequenceNumber)) {
+    throw QuicTransportException(
+        "Invalid sequence number",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::ACK_FREQUENCY);
+  }
+  auto packetTolerance = decodeQuicInteger(cursor);
+  if (UNLIKELY(!packetTolerance)) {
+    throw QuicTransportException(
+        "Invalid packet tolerance",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::ACK_FREQUENCY);
+  }
+  auto updateMaxAckDelay = decodeQuicInteger(cursor);
+  if (UNLIKELY(!updateMaxAckDelay)) {
+    throw QuicTransportException(
+        "Invalid update max ack delay",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::ACK_FREQUENCY);
+  }
+  if (!cursor.canAdvance(sizeof(uint8_t))) {
+    throw QuicTransportException(
+        "Not enough input bytes to read ignore order",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::ACK_FREQUENCY);
+  }
+  auto ignoreOrder = cursor.readBE<uint8_t>();
+  if (ignoreOrder > 1) {
+    throw QuicTransportException(
+        "Invalid ignore order",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::ACK_FREQUENCY);
+  }
+  return AckFrequencyFrame(
+      sequenceNumber->first,
+      packetTolerance->first,
+      std::chrono::microseconds(updateMaxAckDelay->first),
+      ignoreOrder == 1);
+}
+
+ReadDatagramFrame decodeDatagramFrame(
+    folly::io::Cursor& cursor,
+    bool hasLength) {
+  size_t length = cursor.totalLength();
+  if (hasLength) {
+    auto dataLength = decodeQuicInteger(cursor);
+    if (UNLIKELY(!dataLength)) {
+      throw QuicTransportException(
+          "Invalid datagram length",
+          quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+          quic::FrameType::DATAGRAM_LEN);
+    }
+    if (cursor.totalLength() < dataLength->first) {
+      throw QuicTransportException(
+          "Length mismatch",
+          quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+          quic::FrameType::DATAGRAM_LEN);
+    }
+    length = dataLength->first;
+  }
+  Buf data;
+  cursor.clone(data, length);
+  return ReadDatagramFrame(std::move(data));
+}
+
+RepairFrame decodeRepairFrame(folly::io::Cursor& cursor) {
+  auto streamId = decodeQuicInteger(cursor);
+  auto fin = decodeQuicInteger(cursor);
+  auto numFrames = decodeQuicInteger(cursor);
+  if (UNLIKELY(!streamId || !fin || !numFrames)) {
+    throw QuicTransportException(
+        "Invalid repair frame header",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::REPAIR);
+  }
+  // Each protected frame takes at least two bytes.
+  if (fin->first > 1 || numFrames->first == 0 ||
+      numFrames->first > cursor.totalLength() / 2) {
+    throw QuicTransportException(
+        "Invalid repair frame header",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::REPAIR);
+  }
+  std::vector<FecProtectedFrame> frames;
+  frames.reserve(numFrames->first);
+  uint64_t maxLength = 0;
+  for (uint64_t i = 0; i < numFrames->first; i++) {
+    auto offset = decodeQuicInteger(cursor);
+    auto length = decodeQuicInteger(cursor);
+    if (UNLIKELY(!offset || !length)) {
+      throw QuicTransportException(
+          "Invalid protected frame",
+          quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+          quic::FrameType::REPAIR);
+    }
+    frames.emplace_back(offset->first, length->first);
+    maxLength = std::max(maxLength, length->first);
+  }
+  auto dataLength = decodeQuicInteger(cursor);
+  if (UNLIKELY(!dataLength)) {
+    throw QuicTransportException(
+        "Invalid repair length",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::REPAIR);
+  }
+  if (dataLength->first != maxLength ||
+      cursor.totalLength() < dataLength->first) {
+    throw QuicTransportException(
+        "Length mismatch",
+        quic::TransportErrorCode::FRAME_ENCODING_ERROR,
+        quic::FrameType::REPAIR);
+  }
+  Buf data;
+  cursor.clone(data, dataLength->first);
+  return RepairFrame(
+      streamId->first, std::move(frames), fin->first == 1, std::move(data));
+}
+
 ConnectionCloseFrame decodeConnectionCloseFrame(
     folly::io::Cursor& cursor,
     const CodecParameters& params) {
@@ -738,6 +867,14 @@ QuicFrame parseFrame(
         return QuicFrame(decodeConnectionCloseFrame(cursor, params));
       case FrameType::APPLICATION_CLOSE:
         return QuicFrame(decodeApplicationCloseFrame(cursor, params));
+      case FrameType::DATAGRAM:
+        return QuicFrame(decodeDatagramFrame(cursor, false));
+      case FrameType::DATAGRAM_LEN:
+        return QuicFrame(decodeDatagramFrame(cursor, true));
+      case FrameType::ACK_FREQUENCY:
+        return QuicFrame(decodeAckFrequencyFrame(cursor));
+      case FrameType::REPAIR:
+        return QuicFrame(decodeRepairFrame(cursor));
       case FrameType::MIN_STREAM_DATA:
         return QuicFrame(decodeMinStreamDataFrame(cursor));
       case FrameType::EXPIRED_STREAM_DATA:
@@ -759,13 +896,57 @@ QuicFrame parseFrame(
 
 // Parse packet
 
+/**
+ * Skips the padding bytes at the cursor, scanning the buffers directly, and
+ * returns the number of bytes skipped.
+ */
+static size_t skipPadding(folly::io::Cursor& cursor) {
+  size_t skipped = 0;
+  while (!cursor.isAtEnd()) {
+    auto data = cursor.peekBytes();
+    auto end = std::find_if(
+        data.begin(), data.end(), [](uint8_t byte) { return byte != 0; });
+    size_t runLength = end - data.begin();
+    cursor.skip(runLength);
+    skipped += runLength;
+    if (end != data.end()) {
+      break;
+    }
+  }
+  return skipped;
+}
+
 static std::vector<QuicFrame> framesDecodeHelper(
     folly::io::Cursor& cursor,
     const PacketHeader& header,
     const CodecParameters& params) {
   std::vector<QuicFrame> frames;
-  while (cursor.totalLength()) {
+  while (!cursor.isAtEnd()) {
+    // Padding usually fills the rest of the packet, so skip each run of it
+    // without going through parseFrame one byte at a time.
+    size_t paddingBytes = skipPadding(cursor);
+    if (paddingBytes > 0) {
+      auto lastPadding =
+          frames.empty() ? nullptr : boost::get<PaddingFrame>(&frames.back());
+      if (lastPadding) {
+        lastPadding->numFrames += paddingBytes;
+      } else {
+        PaddingFrame padding;
+        padding.numFrames = paddingBytes;
+        frames.push_back(padding);
+      }
+      continue;
+    }
     auto frame = parseFrame(cursor, header, params);
+    // A padding frame type that is not minimally encoded is still parsed
+    // here, and is folded into the run before it.
+    if (boost::get<PaddingFrame>(&frame) && !frames.empty()) {
+      auto lastPadding = boost::get<PaddingFrame>(&frames.back());
+      if (lastPadding) {
+        lastPadding->numFrames++;
+        continue;
+      }
+    }
     frames.push_back(std::move(frame));
   }
   return frames;
@@ -1042,24 +1223,27 @@ folly::Expected<ParsedLongHeader, TransportErrorCode> parseLongHeaderVariants(
 }
 
 folly::Expected<ShortHeaderInvariant, TransportErrorCode>
-parseShortHeaderInvariants(uint8_t initialByte, folly::io::Cursor& cursor) {
+parseShortHeaderInvariants(
+    uint8_t initialByte,
+    folly::io::Cursor& cursor,
+    size_t dstConnIdSize) {
   if (getHeaderForm(initialByte) != HeaderForm::Short) {
     VLOG(5) << "Bad header form bit";
     return folly::makeUnexpected(TransportErrorCode::FRAME_ENCODING_ERROR);
   }
-  // TODO(t39154014, yangchi): read the length from the connection state in
-  // draft-17
-  if (!cursor.canAdvance(kDefaultConnectionIdSize)) {
+  if (dstConnIdSize > kMaxConnectionIdSize ||
+      !cursor.canAdvance(dstConnIdSize)) {
     VLOG(5) << "Not enough input bytes for ConnectionId";
     return folly::makeUnexpected(TransportErrorCode::FRAME_ENCODING_ERROR);
   }
-  ConnectionId connId(cursor, kDefaultConnectionIdSize);
+  ConnectionId connId(cursor, dstConnIdSize);
   return ShortHeaderInvariant(std::move(connId));
 }
 
 folly::Expected<ShortHeader, TransportErrorCode> parseShortHeader(
     uint8_t initialByte,
-    folly::io::Cursor& cursor) {
+    folly::io::Cursor& cursor,
+    size_t dstConnIdSize) {
   if (getHeaderForm(initialByte) != HeaderForm::Short) {
     VLOG(5) << "Bad header form bit";
     return folly::makeUnexpected(TransportErrorCode::FRAME_ENCODING_ERROR);
@@ -1074,7 +1258,8 @@ folly::Expected<ShortHeader, TransportErrorCode> parseShortHeader(
     // Specs asks this to be PROTOCOL_VIOLATION
     return folly::makeUnexpected(TransportErrorCode::PROTOCOL_VIOLATION);
   }
-  auto invariant = parseShortHeaderInvariants(initialByte, cursor);
+  auto invariant =
+      parseShortHeaderInvariants(initialByte, cursor, dstConnIdSize);
   if (!invariant) {
     VLOG(5) << "Error parsing short header invariant";
     return folly::makeUnexpected(TransportErrorCode::FRAME_ENCODING_ERROR);
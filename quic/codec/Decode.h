@@ -120,6 +120,22 @@ PathChallengeFrame decodePathChallengeFrame(folly::io::Cursor& cursor);
 
 PathResponseFrame decodePathResponseFrame(folly::io::Cursor& cursor);
 
+AckFrequencyFrame decodeAckFrequencyFrame(folly::io::Cursor& cursor);
+
+/**
+ * Decodes a DATAGRAM frame. Without a length field the datagram runs to the
+ * end of the packet.
+ */
+ReadDatagramFrame decodeDatagramFrame(
+    folly::io::Cursor& cursor,
+    bool hasLength);
+
+/**
+ * Decodes a REPAIR frame. The repair data is as long as the longest
+ * protected frame.
+ */
+RepairFrame decodeRepairFrame(folly::io::Cursor& cursor);
+
 ReadAckFrame decodeAckFrame(
     folly::io::Cursor& cursor,
     const PacketHeader& header,
@@ -200,9 +216,13 @@ folly::Expected<ParsedLongHeader, TransportErrorCode> parseLongHeaderVariants(
     folly::io::Cursor& cursor);
 
 folly::Expected<ShortHeaderInvariant, TransportErrorCode>
-parseShortHeaderInvariants(uint8_t initialByte, folly::io::Cursor& cursor);
+parseShortHeaderInvariants(
+    uint8_t initialByte,
+    folly::io::Cursor& cursor,
+    size_t dstConnIdSize = kDefaultConnectionIdSize);
 
 folly::Expected<ShortHeader, TransportErrorCode> parseShortHeader(
     uint8_t initialByte,
-    folly::io::Cursor& cursor);
+    folly::io::Cursor& cursor,
+    size_t dstConnIdSize = kDefaultConnectionIdSize);
 } // namespace quic
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/codec/EncryptedConnectionIdAlgo.h>
+
+#include <folly/Random.h>
+#include <quic/QuicConstants.h>
+#include <quic/QuicException.h>
+
+#include <openssl/evp.h>
+
+namespace {
+constexpr uint8_t kShortVersionBitsMask = 0xc0;
+constexpr uint32_t kHalfBlockMask = 0x0fffffff;
+constexpr size_t kHalfBlockBits = 28;
+constexpr uint8_t kNumFeistelRounds = 4;
+constexpr size_t kAesBlockSize = 16;
+
+uint64_t readBlock(const quic::ConnectionId& connId) {
+  uint64_t block = 0;
+  for (size_t i = 1; i < quic::kDefaultConnectionIdSize; ++i) {
+    block = (block << 8) | connId.data()[i];
+  }
+  return block;
+}
+
+void writeBlock(quic::ConnectionId& connId, uint64_t block) {
+  for (size_t i = quic::kDefaultConnectionIdSize - 1; i > 0; --i) {
+    connId.data()[i] = block & 0xff;
+    block >>= 8;
+  }
+}
+} // namespace
+
+namespace quic {
+
+EncryptedConnectionIdAlgo::EncryptedConnectionIdAlgo(folly::ByteRange key) {
+  if (key.size() != kConnectionIdKeyLength) {
+    throw std::runtime_error("Invalid connection id key length");
+  }
+  encryptCtx_.reset(EVP_CIPHER_CTX_new());
+  if (encryptCtx_ == nullptr) {
+    throw std::runtime_error("Unable to allocate an EVP_CIPHER_CTX object");
+  }
+  if (EVP_EncryptInit_ex(
+          encryptCtx_.get(), EVP_aes_128_ecb(), nullptr, key.data(), nullptr) !=
+      1) {
+    throw std::runtime_error("Init error");
+  }
+}
+
+bool EncryptedConnectionIdAlgo::canParse(const ConnectionId& id) const {
+  return id.size() == kDefaultConnectionIdSize &&
+      (id.data()[0] & kShortVersionBitsMask) >> 6 == kEncryptedShortVersionId;
+}
+
+ServerConnectionIdParams EncryptedConnectionIdAlgo::parseConnectionId(
+    const ConnectionId& id) {
+  if (id.size() != kDefaultConnectionIdSize) {
+    throw QuicInternalException(
+        "ConnectionId has the wrong size for routing info",
+        LocalErrorCode::INTERNAL_ERROR);
+  }
+  uint8_t firstByte = id.data()[0];
+  uint64_t block = readBlock(id);
+  uint32_t left = (block >> kHalfBlockBits) & kHalfBlockMask;
+  uint32_t right = block & kHalfBlockMask;
+  for (uint8_t round = kNumFeistelRounds; round > 0; --round) {
+    if ((round - 1) % 2 == 0) {
+      left ^= roundFunction(round - 1, firstByte, right);
+    } else {
+      right ^= roundFunction(round - 1, firstByte, left);
+    }
+  }
+  // hostId:16 | workerId:8 | processId:1 | random:3 in the left half.
+  return ServerConnectionIdParams(
+      (firstByte & kShortVersionBitsMask) >> 6,
+      static_cast<uint16_t>(left >> 12),
+      (left >> 3) & 0x1,
+      (left >> 4) & 0xff);
+}
+
+ConnectionId EncryptedConnectionIdAlgo::encodeConnectionId(
+    const ServerConnectionIdParams& params) {
+  std::vector<uint8_t> connIdData(kDefaultConnectionIdSize);
+  folly::Random::secureRandom(connIdData.data(), connIdData.size());
+  ConnectionId connId(std::move(connIdData));
+  uint8_t firstByte = (kEncryptedShortVersionId << 6) |
+      (connId.data()[0] & ~kShortVersionBitsMask);
+  connId.data()[0] = firstByte;
+  uint64_t random = readBlock(connId);
+  uint32_t left = (static_cast<uint32_t>(params.hostId) << 12) |
+      (static_cast<uint32_t>(params.workerId) << 4) |
+      ((params.processId & 0x1) << 3) | ((random >> kHalfBlockBits) & 0x7);
+  uint32_t right = random & kHalfBlockMask;
+  for (uint8_t round = 0; round < kNumFeistelRounds; ++round) {
+    if (round % 2 == 0) {
+      left ^= roundFunction(round, firstByte, right);
+    } else {
+      right ^= roundFunction(round, firstByte, left);
+    }
+  }
+  writeBlock(
+      connId,
+      (static_cast<uint64_t>(left) << kHalfBlockBits) |
+          static_cast<uint64_t>(right));
+  return connId;
+}
+
+uint32_t EncryptedConnectionIdAlgo::roundFunction(
+    uint8_t round,
+    uint8_t firstByte,
+    uint32_t half) const {
+  std::array<uint8_t, kAesBlockSize> in{};
+  std::array<uint8_t, kAesBlockSize> out;
+  in[0] = round;
+  in[1] = firstByte;
+  in[2] = (half >> 24) & 0xff;
+  in[3] = (half >> 16) & 0xff;
+  in[4] = (half >> 8) & 0xff;
+  in[5] = half & 0xff;
+  int outLen = 0;
+  if (EVP_EncryptUpdate(
+          encryptCtx_.get(), out.data(), &outLen, in.data(), in.size()) != 1 ||
+      static_cast<size_t>(outLen) != out.size()) {
+    throw std::runtime_error("Encryption error");
+  }
+  return ((static_cast<uint32_t>(out[0]) << 24) |
+          (static_cast<uint32_t>(out[1]) << 16) |
+          (static_cast<uint32_t>(out[2]) << 8) | out[3]) &
+      kHalfBlockMask;
+}
+
+EncryptedConnectionIdAlgoFactory::EncryptedConnectionIdAlgoFactory(
+    folly::ByteRange key) {
+  if (key.size() != kConnectionIdKeyLength) {
+    throw std::runtime_error("Invalid connection id key length");
+  }
+  std::copy(key.begin(), key.end(), key_.begin());
+}
+
+} // namespace quic
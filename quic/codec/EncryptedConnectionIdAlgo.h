@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Range.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+#include <quic/codec/ConnectionIdAlgo.h>
+
+#include <array>
+
+namespace quic {
+
+// Short version of the connection ids whose routing info is encrypted. A
+// load balancer that does not have the key routes them by default.
+constexpr uint8_t kEncryptedShortVersionId = 0x2;
+
+constexpr size_t kConnectionIdKeyLength = 16;
+
+/**
+ * Connection ids whose routing info is encrypted, so that the connection ids
+ * a client uses cannot be linked to each other by the routing bits they
+ * share, in the manner of the QUIC-LB block cipher algorithm.
+ *
+ * The first byte has the short version in its first 2 bits and 6 random
+ * bits, in the clear. The next 7 bytes are the host id (16 bits), the worker
+ * id (8 bits), the process id (1 bit) and 31 random bits, encrypted as one
+ * 56 bit block with a 4 round Feistel network. The round function is a
+ * single AES-128 block of the round number, the first byte and the half of
+ * the block being mixed in. Encoding and parsing a connection id are then 4
+ * AES blocks each, which AES-NI makes cheap enough to do for every packet.
+ *
+ * Anything holding the key, the server workers as well as a load balancer in
+ * front of them, can parse the routing info of a connection id. A server
+ * using these cannot steer packets to the workers with
+ * ConnectionIdSteering, which reads the routing bits in the clear. The
+ * EVP context is not shared between threads, so every worker needs its own
+ * instance.
+ */
+class EncryptedConnectionIdAlgo : public ConnectionIdAlgo {
+ public:
+  explicit EncryptedConnectionIdAlgo(folly::ByteRange key);
+
+  ~EncryptedConnectionIdAlgo() override = default;
+
+  bool canParse(const ConnectionId& id) const override;
+
+  ServerConnectionIdParams parseConnectionId(const ConnectionId& id) override;
+
+  ConnectionId encodeConnectionId(
+      const ServerConnectionIdParams& params) override;
+
+ private:
+  // The 28 bits of AES this round xors into the other half of the block.
+  uint32_t roundFunction(uint8_t round, uint8_t firstByte, uint32_t half)
+      const;
+
+  folly::ssl::EvpCipherCtxUniquePtr encryptCtx_;
+};
+
+class EncryptedConnectionIdAlgoFactory : public ConnectionIdAlgoFactory {
+ public:
+  explicit EncryptedConnectionIdAlgoFactory(folly::ByteRange key);
+
+  ~EncryptedConnectionIdAlgoFactory() override = default;
+
+  std::unique_ptr<ConnectionIdAlgo> make() override {
+    return std::make_unique<EncryptedConnectionIdAlgo>(folly::range(key_));
+  }
+
+ private:
+  std::array<uint8_t, kConnectionIdKeyLength> key_;
+};
+
+} // namespace quic
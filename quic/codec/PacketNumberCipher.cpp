@@ -7,6 +7,7 @@
  */
 
 #include <quic/codec/PacketNumberCipher.h>
+#include <folly/Conv.h>
 #include <quic/codec/Decode.h>
 
 #include <quic/codec/Types.h>
@@ -14,15 +15,30 @@
 namespace quic {
 
 constexpr size_t kAES128KeyLength = 16;
+constexpr size_t kChaCha20KeyLength = 32;
 
-void PacketNumberCipher::decipherHeader(
-    folly::ByteRange sample,
+namespace {
+void applyHeaderMask(
+    const HeaderProtectionMask& headerMask,
     folly::MutableByteRange initialByte,
     folly::MutableByteRange packetNumberBytes,
-    uint8_t initialByteMask,
-    uint8_t /* packetNumLengthMask */) const {
+    uint8_t initialByteMask) {
+  // Mask size should be > packet number length + 1.
+  DCHECK_GE(headerMask.size(), kMaxPacketNumEncodingSize + 1);
+  size_t packetNumLength = parsePacketNumberLength(*initialByte.data());
+  initialByte.data()[0] ^= headerMask.data()[0] & initialByteMask;
+  for (size_t i = 0; i < packetNumLength; ++i) {
+    packetNumberBytes.data()[i] ^= headerMask.data()[i + 1];
+  }
+}
+
+// The packet number length is only known once the initial byte is unmasked.
+void removeHeaderMask(
+    const HeaderProtectionMask& headerMask,
+    folly::MutableByteRange initialByte,
+    folly::MutableByteRange packetNumberBytes,
+    uint8_t initialByteMask) {
   CHECK_EQ(packetNumberBytes.size(), kMaxPacketNumEncodingSize);
-  HeaderProtectionMask headerMask = mask(sample);
   // Mask size should be > packet number length + 1.
   DCHECK_GE(headerMask.size(), 5);
   initialByte.data()[0] ^= headerMask.data()[0] & initialByteMask;
@@ -31,6 +47,17 @@ void PacketNumberCipher::decipherHeader(
     packetNumberBytes.data()[i] ^= headerMask.data()[i + 1];
   }
 }
+} // namespace
+
+void PacketNumberCipher::decipherHeader(
+    folly::ByteRange sample,
+    folly::MutableByteRange initialByte,
+    folly::MutableByteRange packetNumberBytes,
+    uint8_t initialByteMask,
+    uint8_t /* packetNumLengthMask */) const {
+  removeHeaderMask(
+      mask(sample), initialByte, packetNumberBytes, initialByteMask);
+}
 
 void PacketNumberCipher::cipherHeader(
     folly::ByteRange sample,
@@ -38,16 +65,42 @@ void PacketNumberCipher::cipherHeader(
     folly::MutableByteRange packetNumberBytes,
     uint8_t initialByteMask,
     uint8_t /* packetNumLengthMask */) const {
-  HeaderProtectionMask headerMask = mask(sample);
-  // Mask size should be > packet number length + 1.
-  DCHECK_GE(headerMask.size(), kMaxPacketNumEncodingSize + 1);
-  size_t packetNumLength = parsePacketNumberLength(*initialByte.data());
-  initialByte.data()[0] ^= headerMask.data()[0] & initialByteMask;
-  for (size_t i = 0; i < packetNumLength; ++i) {
-    packetNumberBytes.data()[i] ^= headerMask.data()[i + 1];
+  applyHeaderMask(
+      mask(sample), initialByte, packetNumberBytes, initialByteMask);
+}
+
+void PacketNumberCipher::batchMask(
+    folly::Range<const Sample*> samples,
+    HeaderProtectionMask* masks) const {
+  for (size_t i = 0; i < samples.size(); ++i) {
+    masks[i] = mask(folly::range(samples[i]));
   }
 }
 
+void PacketNumberCipher::encryptLongHeaderWithMask(
+    const HeaderProtectionMask& headerMask,
+    folly::MutableByteRange initialByte,
+    folly::MutableByteRange packetNumberBytes) const {
+  applyHeaderMask(
+      headerMask, initialByte, packetNumberBytes, LongHeader::kTypeBitsMask);
+}
+
+void PacketNumberCipher::encryptShortHeaderWithMask(
+    const HeaderProtectionMask& headerMask,
+    folly::MutableByteRange initialByte,
+    folly::MutableByteRange packetNumberBytes) const {
+  applyHeaderMask(
+      headerMask, initialByte, packetNumberBytes, ShortHeader::kTypeBitsMask);
+}
+
+void PacketNumberCipher::decryptShortHeaderWithMask(
+    const HeaderProtectionMask& headerMask,
+    folly::MutableByteRange initialByte,
+    folly::MutableByteRange packetNumberBytes) const {
+  removeHeaderMask(
+      headerMask, initialByte, packetNumberBytes, ShortHeader::kTypeBitsMask);
+}
+
 void PacketNumberCipher::decryptLongHeader(
     folly::ByteRange sample,
     folly::MutableByteRange initialByte,
@@ -125,7 +178,70 @@ HeaderProtectionMask Aes128PacketNumberCipher::mask(
   return outMask;
 }
 
+void Aes128PacketNumberCipher::batchMask(
+    folly::Range<const Sample*> samples,
+    HeaderProtectionMask* masks) const {
+  static_assert(
+      sizeof(Sample) == sizeof(HeaderProtectionMask),
+      "One mask per sample block");
+  if (samples.empty()) {
+    return;
+  }
+  int inLen = folly::to<int>(samples.size() * sizeof(Sample));
+  int outLen = 0;
+  if (EVP_EncryptUpdate(
+          encryptCtx_.get(),
+          masks[0].data(),
+          &outLen,
+          samples[0].data(),
+          inLen) != 1 ||
+      outLen != inLen) {
+    throw std::runtime_error("Encryption error");
+  }
+}
+
 size_t Aes128PacketNumberCipher::keyLength() const {
   return kAES128KeyLength;
 }
+
+void ChaCha20PacketNumberCipher::setKey(folly::ByteRange key) {
+  encryptCtx_.reset(EVP_CIPHER_CTX_new());
+  if (encryptCtx_ == nullptr) {
+    throw std::runtime_error("Unable to allocate an EVP_CIPHER_CTX object");
+  }
+  if (EVP_EncryptInit_ex(
+          encryptCtx_.get(), EVP_chacha20(), nullptr, key.data(), nullptr) !=
+      1) {
+    throw std::runtime_error("Init error");
+  }
+}
+
+HeaderProtectionMask ChaCha20PacketNumberCipher::mask(
+    folly::ByteRange sample) const {
+  HeaderProtectionMask outMask;
+  CHECK_EQ(sample.size(), outMask.size());
+  // The OpenSSL IV of ChaCha20 is the little endian counter followed by the
+  // nonce, which is the sample as it is. The key schedule is kept.
+  if (EVP_EncryptInit_ex(
+          encryptCtx_.get(), nullptr, nullptr, nullptr, sample.data()) != 1) {
+    throw std::runtime_error("Init error");
+  }
+  // The mask is the keystream, the encryption of zeros.
+  const HeaderProtectionMask zeros{};
+  int outLen = 0;
+  if (EVP_EncryptUpdate(
+          encryptCtx_.get(),
+          outMask.data(),
+          &outLen,
+          zeros.data(),
+          zeros.size()) != 1 ||
+      static_cast<HeaderProtectionMask::size_type>(outLen) != outMask.size()) {
+    throw std::runtime_error("Encryption error");
+  }
+  return outMask;
+}
+
+size_t ChaCha20PacketNumberCipher::keyLength() const {
+  return kChaCha20KeyLength;
+}
 } // namespace quic
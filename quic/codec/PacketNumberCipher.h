@@ -25,6 +25,40 @@ class PacketNumberCipher {
 
   virtual HeaderProtectionMask mask(folly::ByteRange sample) const = 0;
 
+  /**
+   * Computes the masks of several samples, masks should have room for one
+   * mask per sample. The default implementation calls mask for every sample,
+   * ciphers that can compute them all with a single call should override
+   * this.
+   */
+  virtual void batchMask(
+      folly::Range<const Sample*> samples,
+      HeaderProtectionMask* masks) const;
+
+  /**
+   * Encrypts a long header with a mask computed beforehand by batchMask.
+   */
+  void encryptLongHeaderWithMask(
+      const HeaderProtectionMask& headerMask,
+      folly::MutableByteRange initialByte,
+      folly::MutableByteRange packetNumberBytes) const;
+
+  /**
+   * Encrypts a short header with a mask computed beforehand by batchMask.
+   */
+  void encryptShortHeaderWithMask(
+      const HeaderProtectionMask& headerMask,
+      folly::MutableByteRange initialByte,
+      folly::MutableByteRange packetNumberBytes) const;
+
+  /**
+   * Decrypts a short header with a mask computed beforehand by batchMask.
+   */
+  void decryptShortHeaderWithMask(
+      const HeaderProtectionMask& headerMask,
+      folly::MutableByteRange initialByte,
+      folly::MutableByteRange packetNumberBytes) const;
+
   /**
    * Decrypts a long header from a sample.
    * sample should be 16 bytes long.
@@ -96,6 +130,32 @@ class Aes128PacketNumberCipher : public PacketNumberCipher {
 
   HeaderProtectionMask mask(folly::ByteRange sample) const override;
 
+  // ECB encrypts every block independently, so all the samples go through one
+  // EVP_EncryptUpdate call and AES-NI can pipeline the blocks.
+  void batchMask(
+      folly::Range<const Sample*> samples,
+      HeaderProtectionMask* masks) const override;
+
+  size_t keyLength() const override;
+
+ private:
+  folly::ssl::EvpCipherCtxUniquePtr encryptCtx_;
+};
+
+/**
+ * Header protection of TLS_CHACHA20_POLY1305_SHA256, RFC 9001 section 5.4.4.
+ * The sample is the block counter and nonce of ChaCha20 and the mask is the
+ * keystream it starts with. It is the faster of the two on CPUs without AES
+ * instructions, where OpenSSL runs ChaCha20 with NEON or SSE instead.
+ */
+class ChaCha20PacketNumberCipher : public PacketNumberCipher {
+ public:
+  ~ChaCha20PacketNumberCipher() override = default;
+
+  void setKey(folly::ByteRange key) override;
+
+  HeaderProtectionMask mask(folly::ByteRange sample) const override;
+
   size_t keyLength() const override;
 
  private:
@@ -15,6 +15,7 @@
 #include <folly/io/IOBuf.h>
 
 #include <array>
+#include <cstring>
 
 namespace quic {
 
@@ -52,6 +53,13 @@ struct ConnectionId {
 
 struct ConnectionIdHash {
   size_t operator()(const ConnectionId& connId) const {
+    // The ids the server chooses have the size of the ones made by
+    // DefaultConnectionIdAlgo, and are hashed as a single word.
+    if (connId.size() == sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, connId.data(), sizeof(word));
+      return folly::hash::twang_mix64(word);
+    }
     return folly::hash::fnv32_buf(connId.data(), connId.size());
   }
 };
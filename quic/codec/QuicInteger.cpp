@@ -8,6 +8,7 @@
 
 #include <quic/codec/QuicInteger.h>
 #include <folly/Conv.h>
+#include <folly/Likely.h>
 
 namespace quic {
 
@@ -53,9 +54,72 @@ folly::Expected<size_t, TransportErrorCode> encodeQuicInteger(
   return folly::makeUnexpected(TransportErrorCode::INTERNAL_ERROR);
 }
 
+folly::Optional<std::pair<uint64_t, size_t>> decodeQuicInteger(
+    folly::ByteRange data,
+    uint64_t atMost) {
+  if (data.empty()) {
+    return folly::none;
+  }
+  size_t length = decodeQuicIntegerLength(data[0]);
+  if (length > data.size() || length > atMost) {
+    return folly::none;
+  }
+  uint64_t result;
+  if (data.size() >= sizeof(uint64_t)) {
+    // Load 8 bytes at once and shift out the ones past the integer, so that
+    // decoding does not branch on the length of the integer.
+    result = folly::Endian::big(folly::loadUnaligned<uint64_t>(data.data())) >>
+        (64 - 8 * length);
+  } else {
+    result = 0;
+    for (size_t i = 0; i < length; ++i) {
+      result = (result << 8) | data[i];
+    }
+  }
+  // Clear the 2 bits of the length.
+  result &= (uint64_t(1) << (8 * length - 2)) - 1;
+  return std::make_pair(result, length);
+}
+
+size_t decodeQuicIntegers(
+    folly::io::Cursor& cursor,
+    uint64_t* values,
+    size_t count) {
+  size_t decoded = 0;
+  while (decoded < count) {
+    auto data = cursor.peekBytes();
+    size_t consumed = 0;
+    while (decoded < count) {
+      auto value = decodeQuicInteger(data.subpiece(consumed));
+      if (!value) {
+        break;
+      }
+      values[decoded++] = value->first;
+      consumed += value->second;
+    }
+    cursor.skip(consumed);
+    if (decoded == count) {
+      break;
+    }
+    // The next integer spans two buffers, or there is not enough data left.
+    auto value = decodeQuicInteger(cursor);
+    if (!value) {
+      break;
+    }
+    values[decoded++] = value->first;
+  }
+  return decoded;
+}
+
 folly::Optional<std::pair<uint64_t, size_t>> decodeQuicInteger(
     folly::io::Cursor& cursor,
     uint64_t atMost) {
+  auto fastResult = decodeQuicInteger(cursor.peekBytes(), atMost);
+  if (LIKELY(fastResult.hasValue())) {
+    cursor.skip(fastResult->second);
+    return fastResult;
+  }
+  // The integer is not within the current buffer, or cannot be read at all.
   size_t numBytes = 0;
   size_t advanceLen = 0;
   uint64_t result = 0;
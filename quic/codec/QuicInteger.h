@@ -38,6 +38,28 @@ folly::Optional<std::pair<uint64_t, size_t>> decodeQuicInteger(
     folly::io::Cursor& cursor,
     uint64_t atMost = std::numeric_limits<uint64_t>::max());
 
+/**
+ * Reads an integer from the start of a contiguous range of bytes and returns
+ * a pair with the integer and the number of bytes read, or folly::none if
+ * there are not enough bytes to read the int. The cursor version uses this
+ * whenever the integer is within the current buffer of the cursor.
+ */
+folly::Optional<std::pair<uint64_t, size_t>> decodeQuicInteger(
+    folly::ByteRange data,
+    uint64_t atMost = std::numeric_limits<uint64_t>::max());
+
+/**
+ * Reads up to count consecutive integers out of the cursor into values, and
+ * returns the number of integers read. Reading stops at the first integer
+ * that cannot be read, and the cursor is advanced past the ones that were
+ * read. Integers are decoded straight from the buffers of the cursor, and
+ * the cursor is only used for the integers that span two buffers.
+ */
+size_t decodeQuicIntegers(
+    folly::io::Cursor& cursor,
+    uint64_t* values,
+    size_t count);
+
 /**
  * Returns the length of a quic integer given the first byte
  */
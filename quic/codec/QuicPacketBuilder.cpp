@@ -10,11 +10,16 @@
 
 #include <folly/Random.h>
 #include <quic/codec/PacketNumber.h>
+#include <quic/common/BufferAllocator.h>
 
 namespace {
 
 // maximum length of packet length.
 constexpr auto kMaxPacketLenSize = sizeof(uint16_t);
+
+// The packet length is a QUIC integer, which takes up to 4 bytes for any
+// length a packet builder can write.
+constexpr auto kMaxPacketLenEncodingSize = sizeof(uint32_t);
 } // namespace
 
 namespace quic {
@@ -179,6 +184,14 @@ void RegularQuicPacketBuilder::appendBytes(
 
 void RegularQuicPacketBuilder::insert(std::unique_ptr<folly::IOBuf> buf) {
   remainingBytes_ -= buf->computeChainDataLength();
+  if (cipherOverhead_ > 0 && !zeroCopyInsert_) {
+    // Keep the body in the single buffer set up by setCipherOverhead, so that
+    // it can be encrypted in place.
+    for (auto range : *buf) {
+      bodyAppender_.push(range.data(), range.size());
+    }
+    return;
+  }
   bodyAppender_.insert(std::move(buf));
 }
 
@@ -277,12 +290,56 @@ const PacketHeader& RegularQuicPacketBuilder::getPacketHeader() const {
 
 void RegularQuicPacketBuilder::setCipherOverhead(uint8_t overhead) noexcept {
   cipherOverhead_ = overhead;
+  if (outputQueue_.empty()) {
+    // Write the whole body into one buffer with room for the aead tag at its
+    // end, so the packet can be encrypted without another allocation, and
+    // with room for the header in front of it, so that joinPacket can put
+    // the header there instead of chaining another buffer.
+    size_t headroom = getHeaderBytes();
+    if (packetNumberEncoding_ && packet_.header.type() == typeid(LongHeader) &&
+        boost::get<LongHeader>(packet_.header).getHeaderType() !=
+            LongHeader::Types::Retry) {
+      // The length and the packet number are only written by buildPacket.
+      headroom += kMaxPacketLenEncodingSize + packetNumberEncoding_->length;
+    }
+    size_t bodySize = headroom + remainingBytes_ + cipherOverhead_;
+    auto body = bufferAllocator_ ? bufferAllocator_->getBuffer(bodySize)
+                                 : folly::IOBuf::create(bodySize);
+    body->advance(headroom);
+    outputQueue_.append(std::move(body));
+    bodyAppender_.reset(&outputQueue_, kAppenderGrowthSize);
+  }
+}
+
+void RegularQuicPacketBuilder::setBufferAllocator(
+    BufferAllocator* allocator) noexcept {
+  bufferAllocator_ = allocator;
+}
+
+void RegularQuicPacketBuilder::setZeroCopyInsert(
+    bool zeroCopyInsert) noexcept {
+  zeroCopyInsert_ = zeroCopyInsert;
+}
+
+void RegularQuicPacketBuilder::setPadToFill(bool padToFill) noexcept {
+  padToFill_ = padToFill;
 }
 
 QuicVersion RegularQuicPacketBuilder::getVersion() const {
   return version_;
 }
 
+Buf joinPacket(Buf header, Buf body) {
+  if (!header->isChained() && !body->isChained() && !body->isShared() &&
+      body->headroom() >= header->length()) {
+    body->prepend(header->length());
+    memcpy(body->writableData(), header->data(), header->length());
+    return body;
+  }
+  header->prependChain(std::move(body));
+  return header;
+}
+
 StatelessResetPacketBuilder::StatelessResetPacketBuilder(
     uint16_t maxPacketSize,
     const StatelessResetToken& resetToken) {
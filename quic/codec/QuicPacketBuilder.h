@@ -15,6 +15,8 @@
 
 namespace quic {
 
+class BufferAllocator;
+
 // We reserve 2 bytes for packet length in the long headers
 constexpr auto kReservedPacketLenSize = sizeof(uint16_t);
 
@@ -120,8 +122,39 @@ class RegularQuicPacketBuilder : public PacketBuilderInterface {
    */
   bool canBuildPacket() const noexcept;
 
+  /**
+   * Also makes the builder write the body into a single buffer with enough
+   * tailroom for the cipher overhead, so that it can be encrypted in place,
+   * and enough headroom for the header, see joinPacket. Should be called
+   * before anything is written to the body.
+   */
   void setCipherOverhead(uint8_t overhead) noexcept;
 
+  /**
+   * Makes setCipherOverhead take the body buffer from allocator instead of
+   * the global allocator. Should be called before setCipherOverhead.
+   */
+  void setBufferAllocator(BufferAllocator* allocator) noexcept;
+
+  /**
+   * Makes insert chain the buffers into the body instead of copying them,
+   * even when the body is set up for in-place encryption. The AEAD then reads
+   * the plaintext from the inserted buffers and writes the ciphertext into a
+   * new buffer, so the data is only copied once, by the cipher.
+   */
+  void setZeroCopyInsert(bool zeroCopyInsert) noexcept;
+
+  /**
+   * Makes the FrameScheduler fill the rest of the packet with padding when
+   * it has more to send than the packet could take, so that the packets of a
+   * write but the last are of the same size and can share a GSO buffer.
+   */
+  void setPadToFill(bool padToFill) noexcept;
+
+  bool padsToFill() const noexcept {
+    return padToFill_;
+  }
+
   QuicVersion getVersion() const override;
 
  private:
@@ -142,10 +175,22 @@ class RegularQuicPacketBuilder : public PacketBuilderInterface {
   folly::io::QueueAppender headerAppender_;
   folly::io::QueueAppender bodyAppender_;
   uint32_t cipherOverhead_{0};
+  BufferAllocator* bufferAllocator_{nullptr};
+  bool zeroCopyInsert_{false};
+  bool padToFill_{false};
   folly::Optional<PacketNumEncodingResult> packetNumberEncoding_;
   QuicVersion version_;
 };
 
+/**
+ * Joins the header and the encrypted body of a packet into the buffer that is
+ * written to the socket. When the body was built with headroom for the header,
+ * see RegularQuicPacketBuilder::setCipherOverhead, the header is copied in
+ * front of it and the packet is a single buffer. Otherwise the body is chained
+ * after the header.
+ */
+Buf joinPacket(Buf header, Buf body);
+
 class VersionNegotiationPacketBuilder {
  public:
   explicit VersionNegotiationPacketBuilder(
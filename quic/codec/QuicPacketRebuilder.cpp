@@ -56,24 +56,25 @@ folly::Optional<PacketEvent> PacketRebuilder::rebuildFromPacket(
     const QuicWriteFrame& frame = *iter;
     writeSuccess = folly::variant_match(
         frame,
-        [&](const WriteAckFrame& ackFrame) {
-          uint64_t ackDelayExponent = folly::variant_match(
-              builder_.getPacketHeader(),
-              [](const LongHeader&) { return kDefaultAckDelayExponent; },
-              [&](const auto&) {
-                return conn_.transportSettings.ackDelayExponent;
-              });
-          AckFrameMetaData meta(
-              ackFrame.ackBlocks, ackFrame.ackDelay, ackDelayExponent);
-          auto ackWriteResult = writeAckFrame(meta, builder_);
-          return ackWriteResult.hasValue();
+        [&](const WriteAckFrame&) {
+          // The acks in the original packet are stale by now, and the ack
+          // scheduler writes the current ones whenever they are due. Cloning
+          // them would only spend the probe's bytes on old ranges.
+          return true;
         },
         [&](const WriteStreamFrame& streamFrame) {
           auto stream = conn_.streamManager->getStream(streamFrame.streamId);
           if (stream && retransmittable(*stream)) {
-            auto streamData = cloneRetransmissionBuffer(streamFrame, stream);
-            auto bufferLen =
-                streamData ? streamData->computeChainDataLength() : 0;
+            auto buffer = findRetransmissionBuffer(streamFrame, stream);
+            if (streamFrame.len && !buffer) {
+              // The data is no longer in the retransmission buffer, so it
+              // was already acked through another packet. Skip it and clone
+              // the rest.
+              return true;
+            }
+            // The length of the buffer is cached, unlike the one of a clone
+            // of its chain.
+            auto bufferLen = streamFrame.len ? buffer->data.chainLength() : 0;
             auto dataLen = writeStreamFrameHeader(
                 builder_,
                 streamFrame.streamId,
@@ -83,7 +84,11 @@ folly::Optional<PacketEvent> PacketRebuilder::rebuildFromPacket(
                 streamFrame.fin);
             bool ret = dataLen.hasValue() && *dataLen == streamFrame.len;
             if (ret) {
-              writeStreamFrameData(builder_, std::move(streamData), *dataLen);
+              // Only clone the data once it is known to fit.
+              writeStreamFrameData(
+                  builder_,
+                  bufferLen ? buffer->data.front()->clone() : nullptr,
+                  *dataLen);
               notPureAck = true;
               return true;
             }
@@ -100,8 +105,9 @@ folly::Optional<PacketEvent> PacketRebuilder::rebuildFromPacket(
           // so they are not clonable
           CHECK(!packet.isHandshake);
           folly::variant_match(packet.packet.header, [](const auto& header) {
-            // key update not supported
-            CHECK(header.getProtectionType() == ProtectionType::KeyPhaseZero);
+            CHECK(
+                header.getProtectionType() == ProtectionType::KeyPhaseZero ||
+                header.getProtectionType() == ProtectionType::KeyPhaseOne);
           });
           auto& stream = conn_.cryptoState->oneRttStream;
           auto buf = cloneCryptoRetransmissionBuffer(cryptoFrame, stream);
@@ -138,9 +144,29 @@ folly::Optional<PacketEvent> PacketRebuilder::rebuildFromPacket(
           notPureAck |= ret;
           return true;
         },
+        [&](const MaxStreamsFrame& maxStreamsFrame) {
+          // The limit only grows, the clone carries the latest one.
+          auto bidirectional = maxStreamsFrame.isForBidirectional;
+          MaxStreamsFrame latestFrame(
+              conn_.streamManager->remoteStreamLimit(bidirectional),
+              bidirectional);
+          auto ret = 0 != writeFrame(std::move(latestFrame), builder_);
+          notPureAck |= ret;
+          return ret;
+        },
         [&](const PaddingFrame& paddingFrame) {
           return writeFrame(paddingFrame, builder_) != 0;
         },
+        [&](const WriteDatagramFrame&) {
+          // Datagrams are unreliable, their payload is not kept to be sent
+          // again.
+          return true;
+        },
+        [&](const WriteRepairFrame&) {
+          // The repair data is not kept either, the protected frames are
+          // cloned themselves.
+          return true;
+        },
         [&](const QuicSimpleFrame& simpleFrame) {
           auto updatedSimpleFrame =
               updateSimpleFrameOnPacketClone(conn_, simpleFrame);
@@ -182,13 +208,7 @@ Buf PacketRebuilder::cloneCryptoRetransmissionBuffer(
    * lost packet.
    */
   DCHECK(frame.len) << "WriteCryptoFrame cloning: frame is empty. " << conn_;
-  auto iter = std::lower_bound(
-      stream.retransmissionBuffer.begin(),
-      stream.retransmissionBuffer.end(),
-      frame.offset,
-      [](const auto& buffer, const auto& targetOffset) {
-        return buffer.offset < targetOffset;
-      });
+  auto iter = stream.retransmissionBuffer.lower_bound(frame.offset);
 
   // If the crypto stream is canceled somehow, just skip cloning this frame
   if (iter == stream.retransmissionBuffer.end()) {
@@ -201,7 +221,7 @@ Buf PacketRebuilder::cloneCryptoRetransmissionBuffer(
   return iter->data.front()->clone();
 }
 
-Buf PacketRebuilder::cloneRetransmissionBuffer(
+const StreamBuffer* PacketRebuilder::findRetransmissionBuffer(
     const WriteStreamFrame& frame,
     const QuicStreamState* stream) {
   /**
@@ -218,19 +238,13 @@ Buf PacketRebuilder::cloneRetransmissionBuffer(
    */
   DCHECK(stream);
   DCHECK(retransmittable(*stream));
-  auto iter = std::lower_bound(
-      stream->retransmissionBuffer.begin(),
-      stream->retransmissionBuffer.end(),
-      frame.offset,
-      [](const auto& buffer, const auto& targetOffset) {
-        return buffer.offset < targetOffset;
-      });
+  auto iter = stream->retransmissionBuffer.lower_bound(frame.offset);
   if (iter != stream->retransmissionBuffer.end()) {
     if (ackFrameMatchesRetransmitBuffer(*stream, frame, *iter)) {
       DCHECK(!frame.len || !iter->data.empty())
           << "WriteStreamFrame cloning: frame is not empty but StreamBuffer has"
           << " empty data. " << conn_;
-      return (frame.len ? iter->data.front()->clone() : nullptr);
+      return &*iter;
     }
   }
   return nullptr;
@@ -51,7 +51,11 @@ class PacketRebuilder {
       const WriteCryptoFrame& frame,
       const QuicCryptoStream& stream);
 
-  Buf cloneRetransmissionBuffer(
+  /**
+   * Returns the buffer in the retransmission buffer of the stream that holds
+   * the data of the frame, or nullptr if it is no longer there.
+   */
+  const StreamBuffer* findRetransmissionBuffer(
       const WriteStreamFrame& frame,
       const QuicStreamState* stream);
 
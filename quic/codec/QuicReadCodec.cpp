@@ -16,6 +16,41 @@ quic::ConnectionId zeroConnId() {
   std::vector<uint8_t> zeroData(quic::kDefaultConnectionIdSize, 0);
   return quic::ConnectionId(zeroData);
 }
+
+// Copies the header out of the packet instead of splitting it off, which
+// would leave the ciphertext in a shared buffer that cannot be decrypted in
+// place.
+std::unique_ptr<folly::IOBuf> copyAssociatedData(
+    const folly::IOBuf& packet,
+    size_t aadLen) {
+  auto headerData = folly::IOBuf::create(aadLen);
+  folly::io::Cursor cursor(&packet);
+  cursor.pull(headerData->writableData(), aadLen);
+  headerData->append(aadLen);
+  return headerData;
+}
+
+// The coalesced packets of a datagram are split off as slices of the same
+// buffer, which the aead sees as shared, so it would decrypt each of them
+// into a new buffer. The slices never overlap, so a slice gets a buffer of
+// its own over the same memory instead, that keeps the datagram alive and is
+// decrypted in place.
+std::unique_ptr<folly::IOBuf> unshareCoalescedPacket(
+    std::unique_ptr<folly::IOBuf> packet) {
+  if (!packet || packet->isChained() || !packet->isManagedOne() ||
+      !packet->isSharedOne()) {
+    return packet;
+  }
+  auto data = packet->writableData();
+  auto length = packet->length();
+  return folly::IOBuf::takeOwnership(
+      data,
+      length,
+      [](void* /* buf */, void* userData) {
+        delete static_cast<folly::IOBuf*>(userData);
+      },
+      packet.release());
+}
 } // namespace
 
 namespace quic {
@@ -82,7 +117,8 @@ CodecResult QuicReadCodec::parseLongHeaderPacket(
     queue.clear();
     return CodecResult(folly::none);
   }
-  auto currentPacketData = queue.split(currentPacketLen);
+  auto currentPacketData =
+      unshareCoalescedPacket(queue.split(currentPacketLen));
   cursor.reset(currentPacketData.get());
   cursor.skip(packetNumberOffset);
   // Sample starts after the max packet number size. This ensures that we
@@ -180,10 +216,11 @@ CodecResult QuicReadCodec::parseLongHeaderPacket(
       initialByteRange.data()[0], packetNumberByteRange, expectedNextPacketNum);
 
   longHeader.setPacketNumber(packetNum.first);
+  size_t aadLen = packetNumberOffset + packetNum.second;
+  auto headerData = copyAssociatedData(*currentPacketData, aadLen);
   folly::IOBufQueue decryptQueue{folly::IOBufQueue::cacheChainLength()};
   decryptQueue.append(std::move(currentPacketData));
-  size_t aadLen = packetNumberOffset + packetNum.second;
-  auto headerData = decryptQueue.split(aadLen);
+  decryptQueue.trimStart(aadLen);
   // parsing verifies that packetLength >= packet number length.
   auto encryptedData = decryptQueue.splitAtMost(
       parsedLongHeader->packetLength.packetLength - packetNum.second);
@@ -195,7 +232,7 @@ CodecResult QuicReadCodec::parseLongHeaderPacket(
   }
 
   Buf decrypted;
-  auto decryptAttempt = cipher->tryDecrypt(
+  auto decryptAttempt = cipher->tryDecryptInPlace(
       std::move(encryptedData), headerData.get(), packetNum.first);
   if (!decryptAttempt) {
     VLOG(4) << "Unable to decrypt packet=" << packetNum.first
@@ -232,7 +269,6 @@ CodecResult QuicReadCodec::parsePacket(
     return parseLongHeaderPacket(queue, ackStates);
   }
   // Short header:
-  // TODO: support key phase one.
   if (!oneRttReadCipher_ || !oneRttHeaderCipher_) {
     VLOG(4) << nodeToString(nodeType_) << " cannot read key phase zero packet";
     VLOG(20) << "cannot read data="
@@ -242,8 +278,8 @@ CodecResult QuicReadCodec::parsePacket(
         CipherUnavailable(queue.move(), 0, ProtectionType::KeyPhaseZero));
   }
 
-  // TODO: allow other connid lengths from the state.
-  size_t packetNumberOffset = 1 + kDefaultConnectionIdSize;
+  size_t dstConnIdSize = shortHeaderConnIdSize();
+  size_t packetNumberOffset = 1 + dstConnIdSize;
   PacketNum expectedNextPacketNum =
       ackStates.appDataAckState.largestReceivedPacketNum
       ? (1 + *ackStates.appDataAckState.largestReceivedPacketNum)
@@ -265,29 +301,51 @@ CodecResult QuicReadCodec::parsePacket(
   folly::ByteRange sampleByteRange(
       data->writableData() + sampleOffset, sample.size());
 
-  oneRttHeaderCipher_->decryptShortHeader(
-      sampleByteRange, initialByteRange, packetNumberByteRange);
+  const HeaderProtectionMask* headerMask = nullptr;
+  if (!shortHeaderMasks_.empty()) {
+    memcpy(sample.data(), sampleByteRange.data(), sample.size());
+    headerMask = findShortHeaderMask(sample);
+  }
+  if (headerMask) {
+    oneRttHeaderCipher_->decryptShortHeaderWithMask(
+        *headerMask, initialByteRange, packetNumberByteRange);
+  } else {
+    oneRttHeaderCipher_->decryptShortHeader(
+        sampleByteRange, initialByteRange, packetNumberByteRange);
+  }
   std::pair<PacketNum, size_t> packetNum = parsePacketNumber(
       initialByteRange.data()[0], packetNumberByteRange, expectedNextPacketNum);
-  auto shortHeader = parseShortHeader(initialByteRange.data()[0], cursor);
+  auto shortHeader =
+      parseShortHeader(initialByteRange.data()[0], cursor, dstConnIdSize);
   if (!shortHeader) {
     VLOG(10) << "Dropping packet, cannot parse " << connIdToHex();
     return folly::none;
   }
   shortHeader->setPacketNumber(packetNum.first);
-  if (shortHeader->getProtectionType() == ProtectionType::KeyPhaseOne) {
-    VLOG(4) << nodeToString(nodeType_) << " cannot read key phase one packet "
-            << connIdToHex();
-    return folly::none;
+  const Aead* oneRttReadCipher = oneRttReadCipher_.get();
+  bool nextKeyPhase = false;
+  if (shortHeader->getProtectionType() != keyPhase_) {
+    if (previousOneRttReadCipher_ && keyPhaseFirstPacketNum_ &&
+        packetNum.first < *keyPhaseFirstPacketNum_) {
+      oneRttReadCipher = previousOneRttReadCipher_.get();
+    } else if (nextOneRttReadCipher_) {
+      oneRttReadCipher = nextOneRttReadCipher_.get();
+      nextKeyPhase = true;
+    } else {
+      VLOG(4) << nodeToString(nodeType_) << " cannot read key phase "
+              << toString(shortHeader->getProtectionType()) << " packet "
+              << connIdToHex();
+      return folly::none;
+    }
   }
 
-  // Back in the queue so we can split.
-  // TODO: this will share the buffer. We should be able to supply an unshared
-  // buffer.
-  queue.append(std::move(data));
   size_t aadLen = packetNumberOffset + packetNum.second;
-  auto headerData = queue.split(aadLen);
-  auto encryptedData = queue.move();
+  auto headerData = copyAssociatedData(*data, aadLen);
+  // Back in the queue so we can trim the header off.
+  queue.append(std::move(data));
+  queue.trimStart(aadLen);
+  // The packets coalesced before this one may still hold on to the datagram.
+  auto encryptedData = unshareCoalescedPacket(queue.move());
   if (!encryptedData) {
     // There should normally be some integrity tag at least in the data,
     // however allowing the aead to process the data even if the tag is not
@@ -311,7 +369,7 @@ CodecResult QuicReadCodec::parsePacket(
         encryptedDataLength - sizeof(StatelessResetToken));
     statelessTokenCursor.pull(token->data(), token->size());
   }
-  auto decryptAttempt = oneRttReadCipher_->tryDecrypt(
+  auto decryptAttempt = oneRttReadCipher->tryDecryptInPlace(
       std::move(encryptedData), headerData.get(), packetNum.first);
   if (!decryptAttempt) {
     // Can't return the data now, already consumed it to try decrypting it.
@@ -329,6 +387,15 @@ CodecResult QuicReadCodec::parsePacket(
     // TODO better way of handling this (tests break without this)
     decrypted = folly::IOBuf::create(0);
   }
+  if (nextKeyPhase) {
+    VLOG(4) << nodeToString(nodeType_) << " key phase moved to "
+            << toString(shortHeader->getProtectionType()) << " "
+            << connIdToHex();
+    previousOneRttReadCipher_ = std::move(oneRttReadCipher_);
+    oneRttReadCipher_ = std::move(nextOneRttReadCipher_);
+    keyPhase_ = shortHeader->getProtectionType();
+    keyPhaseFirstPacketNum_ = packetNum.first;
+  }
 
   folly::io::Cursor packetCursor(decrypted.get());
   return decodeRegularPacket(std::move(*shortHeader), params_, packetCursor);
@@ -338,6 +405,14 @@ const Aead* QuicReadCodec::getOneRttReadCipher() const {
   return oneRttReadCipher_.get();
 }
 
+const Aead* QuicReadCodec::getNextOneRttReadCipher() const {
+  return nextOneRttReadCipher_.get();
+}
+
+ProtectionType QuicReadCodec::getKeyPhase() const {
+  return keyPhase_;
+}
+
 const Aead* QuicReadCodec::getZeroRttReadCipher() const {
   return zeroRttReadCipher_.get();
 }
@@ -365,6 +440,11 @@ void QuicReadCodec::setOneRttReadCipher(
   oneRttReadCipher_ = std::move(oneRttReadCipher);
 }
 
+void QuicReadCodec::setNextOneRttReadCipher(
+    std::unique_ptr<Aead> nextOneRttReadCipher) {
+  nextOneRttReadCipher_ = std::move(nextOneRttReadCipher);
+}
+
 void QuicReadCodec::setZeroRttReadCipher(
     std::unique_ptr<Aead> zeroRttReadCipher) {
   if (nodeType_ == QuicNodeType::Client) {
@@ -387,6 +467,7 @@ void QuicReadCodec::setInitialHeaderCipher(
 void QuicReadCodec::setOneRttHeaderCipher(
     std::unique_ptr<PacketNumberCipher> oneRttHeaderCipher) {
   oneRttHeaderCipher_ = std::move(oneRttHeaderCipher);
+  clearShortHeaderMasks();
 }
 
 void QuicReadCodec::setZeroRttHeaderCipher(
@@ -446,6 +527,58 @@ folly::Optional<TimePoint> QuicReadCodec::getHandshakeDoneTime() {
   return handshakeDoneTime_;
 }
 
+void QuicReadCodec::prepareShortHeaderMasks(
+    const std::vector<const folly::IOBuf*>& packets) {
+  clearShortHeaderMasks();
+  if (!oneRttHeaderCipher_) {
+    return;
+  }
+  size_t sampleOffset =
+      1 + shortHeaderConnIdSize() + kMaxPacketNumEncodingSize;
+  for (const auto packet : packets) {
+    // Same as parsePacket, the sample has to be in the first buffer.
+    if (!packet || packet->length() < sampleOffset + sizeof(Sample) ||
+        getHeaderForm(packet->data()[0]) != HeaderForm::Short) {
+      continue;
+    }
+    shortHeaderSamples_.emplace_back();
+    memcpy(
+        shortHeaderSamples_.back().data(),
+        packet->data() + sampleOffset,
+        sizeof(Sample));
+  }
+  shortHeaderMasks_.resize(shortHeaderSamples_.size());
+  oneRttHeaderCipher_->batchMask(
+      folly::Range<const Sample*>(
+          shortHeaderSamples_.data(), shortHeaderSamples_.size()),
+      shortHeaderMasks_.data());
+}
+
+void QuicReadCodec::clearShortHeaderMasks() {
+  shortHeaderSamples_.clear();
+  shortHeaderMasks_.clear();
+  nextShortHeaderMask_ = 0;
+}
+
+size_t QuicReadCodec::shortHeaderConnIdSize() const {
+  const auto& connId = nodeType_ == QuicNodeType::Server
+      ? serverConnectionId_
+      : clientConnectionId_;
+  return connId ? connId->size() : kDefaultConnectionIdSize;
+}
+
+const HeaderProtectionMask* QuicReadCodec::findShortHeaderMask(
+    const Sample& sample) {
+  for (size_t i = 0; i < shortHeaderSamples_.size(); ++i) {
+    size_t index = (nextShortHeaderMask_ + i) % shortHeaderSamples_.size();
+    if (shortHeaderSamples_[index] == sample) {
+      nextShortHeaderMask_ = index + 1;
+      return &shortHeaderMasks_[index];
+    }
+  }
+  return nullptr;
+}
+
 std::string QuicReadCodec::connIdToHex() {
   static ConnectionId zeroConn = zeroConnId();
   const auto& serverId = serverConnectionId_.value_or(zeroConn);
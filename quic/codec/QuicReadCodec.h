@@ -58,6 +58,7 @@ class QuicReadCodec {
       const AckStates& ackStates);
 
   const Aead* getOneRttReadCipher() const;
+  const Aead* getNextOneRttReadCipher() const;
   const Aead* getZeroRttReadCipher() const;
   const Aead* getHandshakeReadCipher() const;
 
@@ -74,6 +75,20 @@ class QuicReadCodec {
 
   void setInitialReadCipher(std::unique_ptr<Aead> initialReadCipher);
   void setOneRttReadCipher(std::unique_ptr<Aead> oneRttReadCipher);
+
+  /**
+   * The cipher of the next key phase. The first packet with the other key
+   * phase bit that it decrypts makes it the 1-RTT read cipher, the previous
+   * one is kept for the packets of the old key phase that arrive late. A new
+   * next cipher should be set after that, so that the one after does not
+   * have to be derived when its packets arrive.
+   */
+  void setNextOneRttReadCipher(std::unique_ptr<Aead> nextOneRttReadCipher);
+
+  /**
+   * The key phase of the 1-RTT read cipher.
+   */
+  ProtectionType getKeyPhase() const;
   void setZeroRttReadCipher(std::unique_ptr<Aead> zeroRttReadCipher);
   void setHandshakeReadCipher(std::unique_ptr<Aead> handshakeReadCipher);
 
@@ -99,6 +114,21 @@ class QuicReadCodec {
 
   folly::Optional<TimePoint> getHandshakeDoneTime();
 
+  /**
+   * Computes the header protection masks of the short header packets among
+   * packets with a single batchMask call of the 1-RTT header cipher, to be
+   * used by parsePacket when it reads them. The masks of the previous call
+   * are dropped. A mask only depends on the header protection key and the
+   * sample, which do not change with the key phase.
+   */
+  void prepareShortHeaderMasks(const std::vector<const folly::IOBuf*>& packets);
+
+  /**
+   * Drops the masks of prepareShortHeaderMasks, once the packets they were
+   * prepared for are read.
+   */
+  void clearShortHeaderMasks();
+
  private:
   CodecResult parseLongHeaderPacket(
       folly::IOBufQueue& queue,
@@ -106,6 +136,13 @@ class QuicReadCodec {
 
   std::string connIdToHex();
 
+  // The length of the destination connection ID of the short header packets
+  // read, which is the one of our own connection ID.
+  size_t shortHeaderConnIdSize() const;
+
+  // The mask prepared for the sample, if there is one.
+  const HeaderProtectionMask* findShortHeaderMask(const Sample& sample);
+
   QuicNodeType nodeType_;
 
   CodecParameters params_;
@@ -116,6 +153,13 @@ class QuicReadCodec {
   std::unique_ptr<Aead> initialReadCipher_;
 
   std::unique_ptr<Aead> oneRttReadCipher_;
+  std::unique_ptr<Aead> nextOneRttReadCipher_;
+  std::unique_ptr<Aead> previousOneRttReadCipher_;
+  ProtectionType keyPhase_{ProtectionType::KeyPhaseZero};
+  // The first packet read with the current key phase after a key update.
+  // The packets before it with the other key phase are from the previous
+  // one.
+  folly::Optional<PacketNum> keyPhaseFirstPacketNum_;
   std::unique_ptr<Aead> zeroRttReadCipher_;
   std::unique_ptr<Aead> handshakeReadCipher_;
 
@@ -126,6 +170,11 @@ class QuicReadCodec {
 
   folly::Optional<StatelessResetToken> statelessResetToken_;
   folly::Optional<TimePoint> handshakeDoneTime_;
+
+  std::vector<Sample> shortHeaderSamples_;
+  std::vector<HeaderProtectionMask> shortHeaderMasks_;
+  // The packets are usually read in the order their masks were prepared in.
+  size_t nextShortHeaderMask_{0};
 };
 
 } // namespace quic
@@ -25,6 +25,28 @@ bool packetSpaceCheck(uint64_t limit, size_t require);
 bool packetSpaceCheck(uint64_t limit, size_t require) {
   return (folly::to<uint64_t>(require) <= limit);
 }
+
+/**
+ * Returns the largest data length, at most dataLen, that fits in space bytes
+ * together with the varint length field encoding it. Returns 0 if no data
+ * fits.
+ */
+uint64_t maxStreamDataLenWithLength(uint64_t dataLen, uint64_t space) {
+  uint64_t maxDataLen = 0;
+  for (auto limit :
+       {quic::kOneByteLimit,
+        quic::kTwoByteLimit,
+        quic::kFourByteLimit,
+        quic::kEightByteLimit}) {
+    size_t lengthSize = *quic::getQuicIntegerSize(limit);
+    if (space <= lengthSize) {
+      break;
+    }
+    maxDataLen =
+        std::max(maxDataLen, std::min({dataLen, limit, space - lengthSize}));
+  }
+  return maxDataLen;
+}
 } // namespace
 
 namespace quic {
@@ -64,43 +86,37 @@ folly::Optional<uint64_t> writeStreamFrameHeader(
   // buffer, how much flow control we have, and the remaining size in the
   // packet. If the amount we want to send is >= the remaining packet size after
   // the header so far we can omit the length field and consume the rest of the
-  // packet. If it is not then we need to use the minimal varint encoding
-  // possible to avoid sending not-full packets.
+  // packet. If it is not then we send as much as fits along with the length
+  // field, using the minimal varint encoding of the final length. The size of
+  // the length field depends on the amount of data, so truncating the data to
+  // fit can allow a shorter length field and in turn a few more bytes of data.
   // Note: we don't bother with one potential optimization, which is writing
   // a zero length fin-only stream frame and omitting the length field.
   uint64_t dataLen = std::min(writeBufferLen, flowControlLen);
   uint64_t dataLenLen = 0;
-  if (dataLen > 0 && dataLen >= builder.remainingSpaceInPkt() - headerSize) {
+  uint64_t spaceLeft = builder.remainingSpaceInPkt() - headerSize;
+  if (dataLen > 0 && dataLen >= spaceLeft) {
     // We can fill this entire packet with the rest of this stream frame.
-    dataLen = builder.remainingSpaceInPkt() - headerSize;
+    dataLen = spaceLeft;
   } else {
-    if (dataLen <= kOneByteLimit - 1) {
-      dataLenLen = 1;
-    } else if (dataLen <= kTwoByteLimit - 2) {
-      dataLenLen = 2;
-    } else if (dataLen <= kFourByteLimit - 4) {
-      dataLenLen = 4;
-    } else if (dataLen <= kEightByteLimit - 8) {
-      dataLenLen = 8;
-    } else {
+    if (dataLen > 0) {
+      dataLen = maxStreamDataLenWithLength(dataLen, spaceLeft);
+      if (dataLen == 0) {
+        VLOG(4) << "No space in packet for stream header. stream=" << id
+                << " remaining=" << builder.remainingSpaceInPkt();
+        return folly::none;
+      }
+    }
+    auto dataLenSize = getQuicIntegerSize(dataLen);
+    if (dataLenSize.hasError()) {
       // This should never really happen as dataLen is bounded by the remaining
       // space in the packet which should be << kEightByteLimit.
       throw QuicInternalException(
           "Stream frame length too large.", LocalErrorCode::INTERNAL_ERROR);
     }
-  }
-  if (dataLenLen > 0) {
-    if (dataLen != 0 &&
-        headerSize + dataLenLen >= builder.remainingSpaceInPkt()) {
-      VLOG(4) << "No space in packet for stream header. stream=" << id
-              << " remaining=" << builder.remainingSpaceInPkt();
-      return folly::none;
-    }
     // We have to encode the actual data length in the header.
+    dataLenLen = *dataLenSize;
     headerSize += dataLenLen;
-    if (builder.remainingSpaceInPkt() < dataLen + headerSize) {
-      dataLen = builder.remainingSpaceInPkt() - headerSize;
-    }
   }
   bool shouldSetFin = fin && dataLen == writeBufferLen;
   if (dataLen == 0 && !shouldSetFin) {
@@ -195,15 +211,74 @@ writeCryptoFrame(uint64_t offsetIn, Buf data, PacketBuilderInterface& builder) {
   return WriteCryptoFrame(offsetIn, lengthVarInt.getValue());
 }
 
+size_t writeDatagramFrame(Buf data, PacketBuilderInterface& builder) {
+  QuicInteger intFrameType(static_cast<uint8_t>(FrameType::DATAGRAM_LEN));
+  uint64_t dataLength = data ? data->computeChainDataLength() : 0;
+  QuicInteger lengthVarInt(dataLength);
+  auto datagramFrameSize =
+      intFrameType.getSize() + lengthVarInt.getSize() + dataLength;
+  if (!packetSpaceCheck(builder.remainingSpaceInPkt(), datagramFrameSize)) {
+    // no space left in packet
+    return size_t(0);
+  }
+  builder.write(intFrameType);
+  builder.write(lengthVarInt);
+  if (data) {
+    builder.insert(std::move(data));
+  }
+  builder.appendFrame(WriteDatagramFrame(dataLength));
+  return datagramFrameSize;
+}
+
+size_t writeRepairFrame(
+    const RepairFrame& repairFrame,
+    PacketBuilderInterface& builder) {
+  QuicInteger intFrameType(static_cast<uint8_t>(FrameType::REPAIR));
+  QuicInteger streamIdInt(repairFrame.streamId);
+  QuicInteger finInt(repairFrame.fin ? 1 : 0);
+  QuicInteger numFramesInt(repairFrame.frames.size());
+  uint64_t dataLength =
+      repairFrame.data ? repairFrame.data->computeChainDataLength() : 0;
+  QuicInteger lengthVarInt(dataLength);
+  auto repairFrameSize = intFrameType.getSize() + streamIdInt.getSize() +
+      finInt.getSize() + numFramesInt.getSize() + lengthVarInt.getSize() +
+      dataLength;
+  for (const auto& frame : repairFrame.frames) {
+    repairFrameSize += QuicInteger(frame.offset).getSize() +
+        QuicInteger(frame.len).getSize();
+  }
+  if (!packetSpaceCheck(builder.remainingSpaceInPkt(), repairFrameSize)) {
+    // no space left in packet
+    return size_t(0);
+  }
+  builder.write(intFrameType);
+  builder.write(streamIdInt);
+  builder.write(finInt);
+  builder.write(numFramesInt);
+  for (const auto& frame : repairFrame.frames) {
+    builder.write(QuicInteger(frame.offset));
+    builder.write(QuicInteger(frame.len));
+  }
+  builder.write(lengthVarInt);
+  if (repairFrame.data) {
+    builder.insert(repairFrame.data->clone());
+  }
+  builder.appendFrame(WriteRepairFrame(
+      repairFrame.streamId, repairFrame.frames.size(), dataLength));
+  return repairFrameSize;
+}
+
 size_t fillFrameWithAckBlocks(
     const IntervalSet<PacketNum>& ackBlocks,
     WriteAckFrame& ackFrame,
-    uint64_t bytesLimit);
+    uint64_t bytesLimit,
+    uint64_t maxAdditionalAckBlocks);
 
 size_t fillFrameWithAckBlocks(
     const IntervalSet<PacketNum>& ackBlocks,
     WriteAckFrame& ackFrame,
-    uint64_t bytesLimit) {
+    uint64_t bytesLimit,
+    uint64_t maxAdditionalAckBlocks) {
   PacketNum currentSeqNum = ackBlocks.crbegin()->start;
 
   // starts off with 0 which is what we assumed the initial ack block to be for
@@ -211,7 +286,9 @@ size_t fillFrameWithAckBlocks(
   size_t numAdditionalAckBlocks = 0;
   QuicInteger previousNumAckBlockInt(numAdditionalAckBlocks);
 
-  for (auto blockItr = ackBlocks.crbegin() + 1; blockItr != ackBlocks.crend();
+  for (auto blockItr = ackBlocks.crbegin() + 1;
+       blockItr != ackBlocks.crend() &&
+       numAdditionalAckBlocks < maxAdditionalAckBlocks;
        ++blockItr) {
     const auto& currBlock = *blockItr;
     // These must be true because of the properties of the interval set.
@@ -236,6 +313,26 @@ size_t fillFrameWithAckBlocks(
   return numAdditionalAckBlocks;
 }
 
+/**
+ * Encodes the gaps and lengths of the additional ack blocks in ackFrame, which
+ * follow the largest block of ackBlocks.
+ */
+static void encodeAckBlocks(
+    const IntervalSet<PacketNum>& ackBlocks,
+    const WriteAckFrame& ackFrame,
+    folly::io::QueueAppender& appender) {
+  PacketNum currentSeqNum = ackBlocks.back().start;
+  for (auto it = ackFrame.ackBlocks.crbegin(); it != ackFrame.ackBlocks.crend();
+       ++it) {
+    CHECK_GE(currentSeqNum, it->end + 2);
+    QuicInteger gapInt(currentSeqNum - it->end - 2);
+    QuicInteger currentBlockLenInt(it->end - it->start);
+    gapInt.encode(appender);
+    currentBlockLenInt.encode(appender);
+    currentSeqNum = it->start;
+  }
+}
+
 folly::Optional<AckFrameWriteResult> writeAckFrame(
     const quic::AckFrameMetaData& ackFrameMetaData,
     PacketBuilderInterface& builder) {
@@ -265,38 +362,75 @@ folly::Optional<AckFrameWriteResult> writeAckFrame(
   QuicInteger ackDelayInt(encodedAckDelay);
   QuicInteger minAdditionalAckBlockCount(0);
 
+  bool withEcn =
+      ackFrameMetaData.ecnCounts && !ackFrameMetaData.ecnCounts->empty();
+  QuicInteger ect0Int(withEcn ? ackFrameMetaData.ecnCounts->ect0 : 0);
+  QuicInteger ect1Int(withEcn ? ackFrameMetaData.ecnCounts->ect1 : 0);
+  QuicInteger ceInt(withEcn ? ackFrameMetaData.ecnCounts->ce : 0);
+
   // Required fields are Type, LargestAcked, AckDelay, AckBlockCount,
-  // firstAckBlockLength
-  QuicInteger encodedintFrameType(static_cast<uint8_t>(FrameType::ACK));
+  // firstAckBlockLength, and the ECN counts of an ACK_ECN frame.
+  QuicInteger encodedintFrameType(
+      static_cast<uint8_t>(withEcn ? FrameType::ACK_ECN : FrameType::ACK));
   auto headerSize = encodedintFrameType.getSize() +
       largestAckedPacketInt.getSize() + ackDelayInt.getSize() +
       minAdditionalAckBlockCount.getSize() + firstAckBlockLengthInt.getSize();
+  if (withEcn) {
+    headerSize += ect0Int.getSize() + ect1Int.getSize() + ceInt.getSize();
+  }
   if (spaceLeft < headerSize) {
     return folly::none;
   }
   spaceLeft -= headerSize;
 
-  auto numAdditionalAckBlocks =
-      fillFrameWithAckBlocks(ackFrameMetaData.ackBlocks, ackFrame, spaceLeft);
+  // Without a cache to keep, the blocks are encoded into a local one.
+  AckBlocksCache localCache;
+  auto cache = ackFrameMetaData.cache ? ackFrameMetaData.cache : &localCache;
+  // The largest block is always written.
+  uint64_t maxAckBlocks = std::max<uint64_t>(ackFrameMetaData.maxAckBlocks, 1);
+  bool cacheHit = cache->encodedBlocks &&
+      cache->prefixVersion == ackFrameMetaData.ackBlocks.prefixVersion() &&
+      cache->maxAckBlocks == maxAckBlocks &&
+      (cache->bytesLimit == spaceLeft ||
+       (cache->complete && cache->bytesUsed <= spaceLeft));
+  size_t numAdditionalAckBlocks;
+  if (cacheHit) {
+    ackFrame.ackBlocks = cache->ackBlocks;
+    numAdditionalAckBlocks = ackFrame.ackBlocks.size();
+  } else {
+    numAdditionalAckBlocks = fillFrameWithAckBlocks(
+        ackFrameMetaData.ackBlocks, ackFrame, spaceLeft, maxAckBlocks - 1);
+  }
 
   QuicInteger numAdditionalAckBlocksInt(numAdditionalAckBlocks);
+  if (!cacheHit) {
+    folly::IOBufQueue encodedBlocks{folly::IOBufQueue::cacheChainLength()};
+    folly::io::QueueAppender appender(&encodedBlocks, kAppenderGrowthSize);
+    encodeAckBlocks(ackFrameMetaData.ackBlocks, ackFrame, appender);
+    cache->prefixVersion = ackFrameMetaData.ackBlocks.prefixVersion();
+    cache->bytesLimit = spaceLeft;
+    cache->maxAckBlocks = maxAckBlocks;
+    cache->bytesUsed = encodedBlocks.chainLength() +
+        numAdditionalAckBlocksInt.getSize() -
+        minAdditionalAckBlockCount.getSize();
+    cache->complete =
+        numAdditionalAckBlocks + 1 == ackFrameMetaData.ackBlocks.size();
+    cache->ackBlocks = ackFrame.ackBlocks;
+    cache->encodedBlocks = encodedBlocks.empty() ? folly::IOBuf::create(0)
+                                                 : encodedBlocks.move();
+    cache->encodedBlocks->coalesce();
+  }
   builder.write(encodedintFrameType);
   builder.write(largestAckedPacketInt);
   builder.write(ackDelayInt);
   builder.write(numAdditionalAckBlocksInt);
   builder.write(firstAckBlockLengthInt);
 
-  PacketNum currentSeqNum = ackFrameMetaData.ackBlocks.back().start;
-  for (auto it = ackFrame.ackBlocks.crbegin(); it != ackFrame.ackBlocks.crend();
-       ++it) {
-    CHECK_GE(currentSeqNum, it->end + 2);
-    PacketNum gap = currentSeqNum - it->end - 2;
-    PacketNum currBlockLen = it->end - it->start;
-    QuicInteger gapInt(gap);
-    QuicInteger currentBlockLenInt(currBlockLen);
-    builder.write(gapInt);
-    builder.write(currentBlockLenInt);
-    currentSeqNum = it->start;
+  builder.push(cache->encodedBlocks->data(), cache->encodedBlocks->length());
+  if (withEcn) {
+    builder.write(ect0Int);
+    builder.write(ect1Int);
+    builder.write(ceInt);
   }
   // also the largest ack block since we already accounted for the space to
   // write to it.
@@ -434,6 +568,28 @@ size_t writeSimpleFrame(
         }
         // no space left in packet
         return size_t(0);
+      },
+      [&](AckFrequencyFrame& ackFrequencyFrame) {
+        QuicInteger frameType(static_cast<uint8_t>(FrameType::ACK_FREQUENCY));
+        QuicInteger sequenceNumber(ackFrequencyFrame.sequenceNumber);
+        QuicInteger packetTolerance(ackFrequencyFrame.packetTolerance);
+        QuicInteger updateMaxAckDelay(
+            ackFrequencyFrame.updateMaxAckDelay.count());
+        auto ackFrequencyFrameSize = frameType.getSize() +
+            sequenceNumber.getSize() + packetTolerance.getSize() +
+            updateMaxAckDelay.getSize() + sizeof(uint8_t);
+        if (packetSpaceCheck(spaceLeft, ackFrequencyFrameSize)) {
+          builder.write(frameType);
+          builder.write(sequenceNumber);
+          builder.write(packetTolerance);
+          builder.write(updateMaxAckDelay);
+          builder.writeBE(
+              static_cast<uint8_t>(ackFrequencyFrame.ignoreOrder ? 1 : 0));
+          builder.appendFrame(std::move(ackFrequencyFrame));
+          return ackFrequencyFrameSize;
+        }
+        // no space left in packet
+        return size_t(0);
       });
 }
 
@@ -446,10 +602,13 @@ size_t writeFrame(QuicWriteFrame&& frame, PacketBuilderInterface& builder) {
       frame,
       [&](PaddingFrame& paddingFrame) {
         QuicInteger intFrameType(static_cast<uint8_t>(FrameType::PADDING));
-        if (packetSpaceCheck(spaceLeft, intFrameType.getSize())) {
-          builder.write(intFrameType);
+        size_t paddingSize = intFrameType.getSize() * paddingFrame.numFrames;
+        if (packetSpaceCheck(spaceLeft, paddingSize)) {
+          for (uint64_t i = 0; i < paddingFrame.numFrames; ++i) {
+            builder.write(intFrameType);
+          }
           builder.appendFrame(std::move(paddingFrame));
-          return intFrameType.getSize();
+          return paddingSize;
         }
         return size_t(0);
       },
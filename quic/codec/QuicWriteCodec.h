@@ -12,9 +12,32 @@
 #include <quic/codec/Types.h>
 #include <quic/common/IntervalSet.h>
 #include <chrono>
+#include <limits>
 
 namespace quic {
 
+/**
+ * The additional ack blocks of the last ack frame written from an interval
+ * set, already encoded. They only depend on the intervals before the largest
+ * one and on the start of the largest one, so they are reused as long as the
+ * prefixVersion of the interval set does not change.
+ */
+struct AckBlocksCache {
+  uint64_t prefixVersion{kDefaultIntervalSetVersion};
+  // Space that was left for the additional blocks when they were encoded.
+  uint64_t bytesLimit{0};
+  // Space the additional blocks took, including the growth of the count.
+  uint64_t bytesUsed{0};
+  // Maximum number of blocks that could be written.
+  uint64_t maxAckBlocks{0};
+  // Whether all the blocks fit in bytesLimit and maxAckBlocks.
+  bool complete{false};
+  WriteAckBlocks ackBlocks;
+  // The gaps and lengths of the additional blocks, or null if nothing is
+  // cached yet.
+  Buf encodedBlocks;
+};
+
 struct AckFrameMetaData {
   // Ack blocks. There must be at least 1 ACK block to send.
   const IntervalSet<PacketNum>& ackBlocks;
@@ -22,14 +45,29 @@ struct AckFrameMetaData {
   std::chrono::microseconds ackDelay;
   // The ack delay exponent to use.
   uint8_t ackDelayExponent;
+  // Where the encoded ack blocks of ackBlocks are kept between frames, if
+  // anywhere.
+  AckBlocksCache* cache;
+  // Maximum number of blocks to write, including the largest one. The blocks
+  // of the largest packet numbers are written first.
+  uint64_t maxAckBlocks;
+  // ECN counts of the received packets. An ACK_ECN frame is written instead
+  // of an ACK frame if any of them is set.
+  const EcnCounts* ecnCounts;
 
   AckFrameMetaData(
       const IntervalSet<PacketNum>& acksIn,
       std::chrono::microseconds ackDelayIn,
-      uint8_t ackDelayExponentIn)
+      uint8_t ackDelayExponentIn,
+      AckBlocksCache* cacheIn = nullptr,
+      uint64_t maxAckBlocksIn = std::numeric_limits<uint64_t>::max(),
+      const EcnCounts* ecnCountsIn = nullptr)
       : ackBlocks(acksIn),
         ackDelay(ackDelayIn),
-        ackDelayExponent(ackDelayExponentIn) {}
+        ackDelayExponent(ackDelayExponentIn),
+        cache(cacheIn),
+        maxAckBlocks(maxAckBlocksIn),
+        ecnCounts(ecnCountsIn) {}
 };
 
 struct AckFrameWriteResult {
@@ -110,6 +148,24 @@ void writeStreamFrameData(
 folly::Optional<WriteCryptoFrame>
 writeCryptoFrame(uint64_t offsetIn, Buf data, PacketBuilderInterface& builder);
 
+/**
+ * Write a DATAGRAM frame with a length field into builder. Datagrams cannot
+ * be split, so nothing is written unless the whole payload fits.
+ *
+ * Return: the number of bytes written, 0 if the datagram did not fit.
+ */
+size_t writeDatagramFrame(Buf data, PacketBuilderInterface& builder);
+
+/**
+ * Write a REPAIR frame into builder. The repair data is cloned into the
+ * packet, and nothing is written unless all of it fits.
+ *
+ * Return: the number of bytes written, 0 if the frame did not fit.
+ */
+size_t writeRepairFrame(
+    const RepairFrame& repairFrame,
+    PacketBuilderInterface& builder);
+
 /**
  * Write a AckFrame into builder
  *
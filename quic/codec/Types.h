@@ -14,6 +14,7 @@
 #include <folly/Overload.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
+#include <folly/small_vector.h>
 #include <quic/QuicConstants.h>
 #include <quic/QuicException.h>
 #include <quic/codec/QuicConnectionId.h>
@@ -44,6 +45,11 @@ constexpr uint8_t kHeaderFormMask = 0x80;
 constexpr auto kMaxPacketNumEncodingSize = 4;
 
 struct PaddingFrame {
+  // Number of consecutive padding bytes this frame stands for. A run of
+  // padding that is read is decoded into a single frame, and a frame that is
+  // written writes this many bytes.
+  uint64_t numFrames{1};
+
   bool operator==(const PaddingFrame& /*rhs*/) const {
     return true;
   }
@@ -69,6 +75,11 @@ struct AckBlock {
       : startPacket(start), endPacket(end) {}
 };
 
+// The ack blocks of a received ack frame only live while the frame is
+// processed, so the first few are kept inline to avoid an allocation for every
+// ack that is read.
+using ReadAckBlocks = folly::small_vector<AckBlock, kNumInlineReadAckBlocks>;
+
 /**
  0                   1                   2                   3
  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
@@ -89,12 +100,30 @@ struct AckBlock {
  |                    Additional ACK Block (i)                 ...
  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  */
+// Number of packets received with each ECN codepoint, as carried in the
+// ACK_ECN frame.
+struct EcnCounts {
+  uint64_t ect0{0};
+  uint64_t ect1{0};
+  uint64_t ce{0};
+
+  bool empty() const {
+    return ect0 == 0 && ect1 == 0 && ce == 0;
+  }
+
+  bool operator==(const EcnCounts& rhs) const {
+    return ect0 == rhs.ect0 && ect1 == rhs.ect1 && ce == rhs.ce;
+  }
+};
+
 struct ReadAckFrame {
   PacketNum largestAcked;
   std::chrono::microseconds ackDelay{0us};
   // Should have at least 1 block.
   // These are ordered in descending order by start packet.
-  std::vector<AckBlock> ackBlocks;
+  ReadAckBlocks ackBlocks;
+  // Only set for ACK_ECN frames.
+  folly::Optional<EcnCounts> ecnCounts;
 
   bool operator==(const ReadAckFrame& /*rhs*/) const {
     // Can't compare ackBlocks, function is just here to appease compiler.
@@ -102,8 +131,13 @@ struct ReadAckFrame {
   }
 };
 
+// A copy of the ack blocks is kept in every outstanding packet that carries an
+// ack, so they are stored in a vector, which is much smaller than a deque and
+// keeps QuicWriteFrame small.
+using WriteAckBlocks = IntervalSet<PacketNum, 1, std::vector>;
+
 struct WriteAckFrame {
-  IntervalSet<PacketNum> ackBlocks;
+  WriteAckBlocks ackBlocks;
   // Delay in sending ack from time that packet was received.
   std::chrono::microseconds ackDelay{0us};
 
@@ -226,6 +260,135 @@ struct ReadNewTokenFrame {
   }
 };
 
+// Unreliable DATAGRAM frame, see RFC 9221.
+struct ReadDatagramFrame {
+  Buf data;
+
+  explicit ReadDatagramFrame(Buf dataIn) : data(std::move(dataIn)) {}
+
+  // Stuff stored in a variant type needs to be copyable.
+  ReadDatagramFrame(const ReadDatagramFrame& other) {
+    if (other.data) {
+      data = other.data->clone();
+    }
+  }
+
+  ReadDatagramFrame(ReadDatagramFrame&& other) noexcept
+      : data(std::move(other.data)) {}
+
+  ReadDatagramFrame& operator=(const ReadDatagramFrame& other) {
+    if (other.data) {
+      data = other.data->clone();
+    }
+    return *this;
+  }
+
+  ReadDatagramFrame& operator=(ReadDatagramFrame&& other) {
+    data = std::move(other.data);
+    return *this;
+  }
+
+  bool operator==(const ReadDatagramFrame& other) const {
+    folly::IOBufEqualTo eq;
+    return eq(data, other.data);
+  }
+};
+
+// Datagrams are never retransmitted, so the written frame only keeps the
+// length of its payload.
+struct WriteDatagramFrame {
+  uint64_t len;
+
+  explicit WriteDatagramFrame(uint64_t lenIn) : len(lenIn) {}
+
+  bool operator==(const WriteDatagramFrame& rhs) const {
+    return len == rhs.len;
+  }
+};
+
+// A STREAM frame that a REPAIR frame protects.
+struct FecProtectedFrame {
+  uint64_t offset;
+  uint64_t len;
+
+  FecProtectedFrame(uint64_t offsetIn, uint64_t lenIn)
+      : offset(offsetIn), len(lenIn) {}
+
+  bool operator==(const FecProtectedFrame& rhs) const {
+    return offset == rhs.offset && len == rhs.len;
+  }
+};
+
+/**
+ * REPAIR frame of the XOR forward error correction extension. The data is
+ * the XOR of the data of the protected STREAM frames of the stream, each
+ * padded with zeros to the length of the longest, so that any one of them
+ * can be rebuilt from the others.
+ *
+ * Type (i), Stream ID (i), Fin (i), Frame Count (i),
+ * [Offset (i), Length (i)] ..., Repair Length (i), Repair Data (...)
+ *
+ * Fin is 1 when the last protected frame has the FIN bit.
+ */
+struct RepairFrame {
+  StreamId streamId;
+  std::vector<FecProtectedFrame> frames;
+  bool fin;
+  Buf data;
+
+  RepairFrame(
+      StreamId streamIdIn,
+      std::vector<FecProtectedFrame> framesIn,
+      bool finIn,
+      Buf dataIn)
+      : streamId(streamIdIn),
+        frames(std::move(framesIn)),
+        fin(finIn),
+        data(std::move(dataIn)) {}
+
+  // Stuff stored in a variant type needs to be copyable.
+  RepairFrame(const RepairFrame& other)
+      : streamId(other.streamId), frames(other.frames), fin(other.fin) {
+    if (other.data) {
+      data = other.data->clone();
+    }
+  }
+
+  RepairFrame(RepairFrame&& other) noexcept = default;
+
+  RepairFrame& operator=(const RepairFrame& other) {
+    streamId = other.streamId;
+    frames = other.frames;
+    fin = other.fin;
+    data = other.data ? other.data->clone() : nullptr;
+    return *this;
+  }
+
+  RepairFrame& operator=(RepairFrame&& other) = default;
+
+  bool operator==(const RepairFrame& other) const {
+    folly::IOBufEqualTo eq;
+    return streamId == other.streamId && frames == other.frames &&
+        fin == other.fin && eq(data, other.data);
+  }
+};
+
+// Repair frames are never retransmitted, so the written frame only keeps
+// what it protects.
+struct WriteRepairFrame {
+  StreamId streamId;
+  uint64_t numFrames;
+  uint64_t len;
+
+  WriteRepairFrame(StreamId streamIdIn, uint64_t numFramesIn, uint64_t lenIn)
+      : streamId(streamIdIn), numFrames(numFramesIn), len(lenIn) {}
+
+  bool operator==(const WriteRepairFrame& rhs) const {
+    return streamId == rhs.streamId && numFrames == rhs.numFrames &&
+        len == rhs.len;
+  }
+};
+
 /**
  The structure of the stream frame used for writes.
  0                   1                   2                   3
@@ -495,6 +658,33 @@ struct PathChallengeFrame {
   }
 };
 
+// Asks the peer to ack every packetTolerance ack eliciting packets and to
+// delay acks by at most updateMaxAckDelay, see draft-ietf-quic-ack-frequency.
+struct AckFrequencyFrame {
+  uint64_t sequenceNumber;
+  uint64_t packetTolerance;
+  std::chrono::microseconds updateMaxAckDelay;
+  // Whether the peer should not ack out of order packets immediately.
+  bool ignoreOrder;
+
+  AckFrequencyFrame(
+      uint64_t sequenceNumberIn,
+      uint64_t packetToleranceIn,
+      std::chrono::microseconds updateMaxAckDelayIn,
+      bool ignoreOrderIn)
+      : sequenceNumber(sequenceNumberIn),
+        packetTolerance(packetToleranceIn),
+        updateMaxAckDelay(updateMaxAckDelayIn),
+        ignoreOrder(ignoreOrderIn) {}
+
+  bool operator==(const AckFrequencyFrame& rhs) const {
+    return sequenceNumber == rhs.sequenceNumber &&
+        packetTolerance == rhs.packetTolerance &&
+        updateMaxAckDelay == rhs.updateMaxAckDelay &&
+        ignoreOrder == rhs.ignoreOrder;
+  }
+};
+
 struct PathResponseFrame {
   uint64_t pathData;
 
@@ -564,7 +754,8 @@ using QuicSimpleFrame = boost::variant<
     ExpiredStreamDataFrame,
     PathChallengeFrame,
     PathResponseFrame,
-    NewConnectionIdFrame>;
+    NewConnectionIdFrame,
+    AckFrequencyFrame>;
 
 // Types of frames that can be read.
 using QuicFrame = boost::variant<
@@ -583,6 +774,8 @@ using QuicFrame = boost::variant<
     ReadStreamFrame,
     ReadCryptoFrame,
     ReadNewTokenFrame,
+    ReadDatagramFrame,
+    RepairFrame,
     QuicSimpleFrame,
     NoopFrame>;
 
@@ -602,6 +795,8 @@ using QuicWriteFrame = boost::variant<
     WriteAckFrame,
     WriteStreamFrame,
     WriteCryptoFrame,
+    WriteDatagramFrame,
+    WriteRepairFrame,
     QuicSimpleFrame>;
 
 enum class HeaderForm : bool {
@@ -0,0 +1,541 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <glog/logging.h>
+#include <quic/codec/Decode.h>
+#include <quic/codec/PacketNumberCipher.h>
+#include <quic/codec/QuicHeaderCodec.h>
+#include <quic/codec/QuicInteger.h>
+#include <quic/codec/QuicPacketBuilder.h>
+#include <quic/codec/QuicWriteCodec.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+using namespace quic;
+
+namespace {
+
+constexpr StreamId kStreamId = 4;
+constexpr PacketNum kPacketNum = 1000;
+constexpr size_t kStreamDataLen = 1000;
+// The UDP payload of a 9000 byte MTU IPv6 path, as in datacenters.
+constexpr uint32_t kJumboPacketLen = 8952;
+// Enough integers that the loop over them dominates.
+constexpr size_t kNumIntegers = 1000;
+
+ConnectionId makeConnectionId() {
+  return ConnectionId(std::vector<uint8_t>(kDefaultConnectionIdSize, 0x11));
+}
+
+PacketHeader makeHeader() {
+  return ShortHeader(
+      ProtectionType::KeyPhaseZero, makeConnectionId(), kPacketNum);
+}
+
+RegularQuicPacketBuilder makeBuilder(
+    uint32_t packetLen = kDefaultUDPSendPacketLen) {
+  RegularQuicPacketBuilder builder(
+      packetLen, makeHeader(), 0, QuicVersion::MVFST);
+  builder.setCipherOverhead(kCipherOverheadHeuristic);
+  return builder;
+}
+
+// Acks numBlocks blocks of 10 packets, with gaps of 2 packets.
+IntervalSet<PacketNum> makeAcks(size_t numBlocks) {
+  IntervalSet<PacketNum> acks;
+  for (size_t i = 0; i < numBlocks; i++) {
+    acks.insert(kPacketNum + i * 12, kPacketNum + i * 12 + 9);
+  }
+  return acks;
+}
+
+void writeAck(PacketBuilderInterface& builder, size_t numBlocks) {
+  auto acks = makeAcks(numBlocks);
+  AckFrameMetaData meta(
+      acks, std::chrono::microseconds(100), kDefaultAckDelayExponent);
+  CHECK(writeAckFrame(meta, builder));
+}
+
+void writeStream(PacketBuilderInterface& builder) {
+  auto dataLen = writeStreamFrameHeader(
+      builder, kStreamId, 10000, kStreamDataLen, kStreamDataLen, false);
+  CHECK(dataLen);
+  writeStreamFrameData(
+      builder,
+      folly::IOBuf::copyBuffer(std::string(kStreamDataLen, 'a')),
+      *dataLen);
+}
+
+void writeSingleAck(PacketBuilderInterface& builder) {
+  writeAck(builder, 1);
+}
+
+void writeManyAcks(PacketBuilderInterface& builder) {
+  writeAck(builder, 32);
+}
+
+void writeCrypto(PacketBuilderInterface& builder) {
+  CHECK(writeCryptoFrame(
+      0, folly::IOBuf::copyBuffer(std::string(kStreamDataLen, 'a')), builder));
+}
+
+void writeRstStream(PacketBuilderInterface& builder) {
+  writeFrame(RstStreamFrame(kStreamId, 1, 10000), builder);
+}
+
+void writeConnectionClose(PacketBuilderInterface& builder) {
+  writeFrame(
+      ConnectionCloseFrame(TransportErrorCode::PROTOCOL_VIOLATION, "error"),
+      builder);
+}
+
+void writeMaxData(PacketBuilderInterface& builder) {
+  writeFrame(MaxDataFrame(1000000), builder);
+}
+
+void writeMaxStreamData(PacketBuilderInterface& builder) {
+  writeFrame(MaxStreamDataFrame(kStreamId, 1000000), builder);
+}
+
+void writeMaxStreams(PacketBuilderInterface& builder) {
+  writeFrame(MaxStreamsFrame(100, true), builder);
+}
+
+void writePing(PacketBuilderInterface& builder) {
+  writeFrame(PingFrame(), builder);
+}
+
+void writeDataBlocked(PacketBuilderInterface& builder) {
+  writeFrame(DataBlockedFrame(1000000), builder);
+}
+
+void writeStreamDataBlocked(PacketBuilderInterface& builder) {
+  writeFrame(StreamDataBlockedFrame(kStreamId, 1000000), builder);
+}
+
+void writeStopSending(PacketBuilderInterface& builder) {
+  writeFrame(QuicSimpleFrame(StopSendingFrame(kStreamId, 1)), builder);
+}
+
+// A data packet as the server sends them: an ack and a full stream frame.
+void writeDataPacket(PacketBuilderInterface& builder) {
+  writeAck(builder, 4);
+  writeMaxData(builder);
+  writeStream(builder);
+}
+
+// A packet padded to its full size, as the client initial packets and the
+// path MTU probes are.
+void writePaddedPacket(PacketBuilderInterface& builder) {
+  writeSingleAck(builder);
+  PaddingFrame padding;
+  padding.numFrames = builder.remainingSpaceInPkt();
+  CHECK(writeFrame(std::move(padding), builder));
+}
+
+using FrameWriter = void (*)(PacketBuilderInterface&);
+
+RegularQuicPacketBuilder::Packet buildPacket(FrameWriter writer) {
+  auto builder = makeBuilder();
+  writer(builder);
+  return std::move(builder).buildPacket();
+}
+
+Buf packetToBuf(const RegularQuicPacketBuilder::Packet& packet) {
+  auto buf = packet.header->clone();
+  buf->prependChain(packet.body->clone());
+  buf->coalesce();
+  return buf;
+}
+
+// The data of buf in numBuffers buffers of about the same size, as a
+// payload that is not one contiguous buffer.
+Buf splitBuf(const folly::IOBuf& buf, size_t numBuffers) {
+  Buf chain;
+  size_t len = buf.length();
+  size_t pieceLen = (len + numBuffers - 1) / numBuffers;
+  for (size_t offset = 0; offset < len; offset += pieceLen) {
+    auto piece = folly::IOBuf::copyBuffer(
+        buf.data() + offset, std::min(pieceLen, len - offset));
+    if (chain) {
+      chain->prependChain(std::move(piece));
+    } else {
+      chain = std::move(piece);
+    }
+  }
+  return chain;
+}
+
+// Decodes the packet body written by writer, in numBuffers buffers.
+void decodePacket(size_t iters, FrameWriter writer, size_t numBuffers) {
+  Buf body;
+  PacketHeader header = makeHeader();
+  CodecParameters params(kDefaultAckDelayExponent, QuicVersion::MVFST);
+  BENCHMARK_SUSPEND {
+    body = buildPacket(writer).body;
+    body->coalesce();
+    if (numBuffers > 1) {
+      body = splitBuf(*body, numBuffers);
+    }
+  }
+  for (size_t i = 0; i < iters; i++) {
+    folly::io::Cursor cursor(body.get());
+    auto packet = decodeRegularPacket(PacketHeader(header), params, cursor);
+    folly::doNotOptimizeAway(packet);
+  }
+}
+
+void parseFrames(size_t iters, FrameWriter writer) {
+  Buf body;
+  PacketHeader header = makeHeader();
+  CodecParameters params(kDefaultAckDelayExponent, QuicVersion::MVFST);
+  BENCHMARK_SUSPEND {
+    body = buildPacket(writer).body;
+    body->coalesce();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    folly::io::Cursor cursor(body.get());
+    auto frame = parseFrame(cursor, header, params);
+    folly::doNotOptimizeAway(frame);
+  }
+}
+
+// Writes the frames in a packet until it is full, then starts another one,
+// so that the builders are mostly set up outside of the measurement.
+void writeFrames(size_t iters, FrameWriter writer) {
+  folly::Optional<RegularQuicPacketBuilder> builder;
+  uint32_t frameSize = 0;
+  BENCHMARK_SUSPEND {
+    builder = makeBuilder();
+    auto remaining = builder->remainingSpaceInPkt();
+    writer(*builder);
+    frameSize = remaining - builder->remainingSpaceInPkt();
+    builder = makeBuilder();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    if (builder->remainingSpaceInPkt() < frameSize) {
+      BENCHMARK_SUSPEND {
+        builder = makeBuilder();
+      }
+    }
+    writer(*builder);
+  }
+}
+
+void writeAcks(size_t iters, size_t numBlocks) {
+  folly::Optional<RegularQuicPacketBuilder> builder;
+  IntervalSet<PacketNum> acks;
+  BENCHMARK_SUSPEND {
+    acks = makeAcks(numBlocks);
+    builder = makeBuilder();
+  }
+  AckFrameMetaData meta(
+      acks, std::chrono::microseconds(100), kDefaultAckDelayExponent);
+  for (size_t i = 0; i < iters; i++) {
+    auto result = writeAckFrame(meta, *builder);
+    if (!result) {
+      BENCHMARK_SUSPEND {
+        builder = makeBuilder();
+      }
+    }
+  }
+}
+
+std::vector<uint64_t> makeIntegers() {
+  // A mix of the four encoded lengths
+  std::vector<uint64_t> values;
+  for (size_t i = 0; i < kNumIntegers; i++) {
+    switch (i % 4) {
+      case 0:
+        values.push_back(i % 64);
+        break;
+      case 1:
+        values.push_back(1000 + i);
+        break;
+      case 2:
+        values.push_back(100000 + i);
+        break;
+      default:
+        values.push_back(10000000000 + i);
+        break;
+    }
+  }
+  return values;
+}
+
+// The header ciphers are given room for the longest packet number.
+constexpr size_t kPacketNumberBytes = kMaxPacketNumEncodingSize;
+
+std::unique_ptr<PacketNumberCipher> makeCipher() {
+  auto cipher = std::make_unique<Aes128PacketNumberCipher>();
+  std::vector<uint8_t> key(cipher->keyLength(), 0x22);
+  cipher->setKey(folly::range(key));
+  return cipher;
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(parseFrames, Ack, writeSingleAck)
+BENCHMARK_NAMED_PARAM(parseFrames, Ack32Blocks, writeManyAcks)
+BENCHMARK_NAMED_PARAM(parseFrames, Stream, writeStream)
+BENCHMARK_NAMED_PARAM(parseFrames, Crypto, writeCrypto)
+BENCHMARK_NAMED_PARAM(parseFrames, RstStream, writeRstStream)
+BENCHMARK_NAMED_PARAM(parseFrames, ConnectionClose, writeConnectionClose)
+BENCHMARK_NAMED_PARAM(parseFrames, MaxData, writeMaxData)
+BENCHMARK_NAMED_PARAM(parseFrames, MaxStreamData, writeMaxStreamData)
+BENCHMARK_NAMED_PARAM(parseFrames, MaxStreams, writeMaxStreams)
+BENCHMARK_NAMED_PARAM(parseFrames, Ping, writePing)
+BENCHMARK_NAMED_PARAM(parseFrames, DataBlocked, writeDataBlocked)
+BENCHMARK_NAMED_PARAM(parseFrames, StreamDataBlocked, writeStreamDataBlocked)
+BENCHMARK_NAMED_PARAM(parseFrames, StopSending, writeStopSending)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(DecodeRegularPacket, iters) {
+  Buf body;
+  PacketHeader header = makeHeader();
+  CodecParameters params(kDefaultAckDelayExponent, QuicVersion::MVFST);
+  BENCHMARK_SUSPEND {
+    body = buildPacket(writeDataPacket).body;
+    body->coalesce();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    folly::io::Cursor cursor(body.get());
+    auto packet = decodeRegularPacket(PacketHeader(header), params, cursor);
+    folly::doNotOptimizeAway(packet);
+  }
+}
+
+BENCHMARK_NAMED_PARAM(decodePacket, Data, writeDataPacket, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(decodePacket, DataIn4Buffers, writeDataPacket, 4)
+BENCHMARK_NAMED_PARAM(decodePacket, Padded, writePaddedPacket, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(
+    decodePacket,
+    PaddedIn4Buffers,
+    writePaddedPacket,
+    4)
+
+// The padded packet decoded a frame at a time, as decodeRegularPacket did
+// before it skipped padding runs, against decodeRegularPacket.
+BENCHMARK(ParsePaddedPacketPerFrame, iters) {
+  Buf body;
+  PacketHeader header = makeHeader();
+  CodecParameters params(kDefaultAckDelayExponent, QuicVersion::MVFST);
+  BENCHMARK_SUSPEND {
+    body = buildPacket(writePaddedPacket).body;
+    body->coalesce();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    folly::io::Cursor cursor(body.get());
+    std::vector<QuicFrame> frames;
+    while (!cursor.isAtEnd()) {
+      frames.push_back(parseFrame(cursor, header, params));
+    }
+    folly::doNotOptimizeAway(frames);
+  }
+}
+
+BENCHMARK_RELATIVE(DecodePaddedPacket, iters) {
+  decodePacket(iters, writePaddedPacket, 1);
+}
+
+BENCHMARK(ParseShortHeader, iters) {
+  Buf packet;
+  BENCHMARK_SUSPEND {
+    packet = packetToBuf(buildPacket(writeDataPacket));
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto result = parseHeader(*packet);
+    folly::doNotOptimizeAway(result);
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(writeFrames, RstStream, writeRstStream)
+BENCHMARK_NAMED_PARAM(writeFrames, MaxData, writeMaxData)
+BENCHMARK_NAMED_PARAM(writeFrames, MaxStreamData, writeMaxStreamData)
+BENCHMARK_NAMED_PARAM(writeFrames, StopSending, writeStopSending)
+
+BENCHMARK_NAMED_PARAM(writeAcks, OneBlock, 1)
+BENCHMARK_NAMED_PARAM(writeAcks, 32Blocks, 32)
+
+BENCHMARK(WriteStreamFrameHeader, iters) {
+  folly::Optional<RegularQuicPacketBuilder> builder;
+  BENCHMARK_SUSPEND {
+    builder = makeBuilder();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    // Only the headers are written, so that many fit in a packet.
+    if (builder->remainingSpaceInPkt() < 32) {
+      BENCHMARK_SUSPEND {
+        builder = makeBuilder();
+      }
+    }
+    auto dataLen = writeStreamFrameHeader(
+        *builder, kStreamId, i, kStreamDataLen, kStreamDataLen, false);
+    folly::doNotOptimizeAway(dataLen);
+  }
+}
+
+BENCHMARK(WriteStreamFrame, iters) {
+  folly::Optional<RegularQuicPacketBuilder> builder;
+  Buf data;
+  BENCHMARK_SUSPEND {
+    data = folly::IOBuf::copyBuffer(std::string(kStreamDataLen, 'a'));
+  }
+  for (size_t i = 0; i < iters; i++) {
+    // One frame per packet, as for bulk data
+    BENCHMARK_SUSPEND {
+      builder = makeBuilder();
+    }
+    auto dataLen = writeStreamFrameHeader(
+        *builder, kStreamId, i, kStreamDataLen, kStreamDataLen, false);
+    writeStreamFrameData(*builder, data->clone(), *dataLen);
+  }
+}
+
+// Builds packets of packetLen that are filled with stream data, so that the
+// time per byte of the default and the jumbo packets can be compared.
+void buildFullPacket(size_t iters, uint32_t packetLen) {
+  Buf data;
+  BENCHMARK_SUSPEND {
+    data = folly::IOBuf::copyBuffer(std::string(packetLen, 'a'));
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto builder = makeBuilder(packetLen);
+    auto dataLen = writeStreamFrameHeader(
+        builder, kStreamId, i * packetLen, packetLen, packetLen, false);
+    writeStreamFrameData(builder, data->clone(), *dataLen);
+    auto packet = std::move(builder).buildPacket();
+    folly::doNotOptimizeAway(packet);
+  }
+}
+
+BENCHMARK_NAMED_PARAM(buildFullPacket, Default, kDefaultUDPSendPacketLen)
+BENCHMARK_NAMED_PARAM(buildFullPacket, Jumbo, kJumboPacketLen)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(EncodeQuicInteger, iters) {
+  std::vector<uint64_t> values;
+  folly::IOBufQueue queue;
+  BENCHMARK_SUSPEND {
+    values = makeIntegers();
+  }
+  for (size_t i = 0; i < iters; i += kNumIntegers) {
+    BENCHMARK_SUSPEND {
+      queue.move();
+    }
+    folly::io::QueueAppender appender(&queue, kNumIntegers * 8);
+    for (auto value : values) {
+      auto result = encodeQuicInteger(value, appender);
+      folly::doNotOptimizeAway(result);
+    }
+  }
+}
+
+BENCHMARK(DecodeQuicIntegerCursor, iters) {
+  Buf encoded;
+  BENCHMARK_SUSPEND {
+    folly::IOBufQueue queue;
+    folly::io::QueueAppender appender(&queue, kNumIntegers * 8);
+    for (auto value : makeIntegers()) {
+      encodeQuicInteger(value, appender);
+    }
+    encoded = queue.move();
+    encoded->coalesce();
+  }
+  for (size_t i = 0; i < iters; i += kNumIntegers) {
+    folly::io::Cursor cursor(encoded.get());
+    for (size_t j = 0; j < kNumIntegers; j++) {
+      auto result = decodeQuicInteger(cursor);
+      folly::doNotOptimizeAway(result);
+    }
+  }
+}
+
+BENCHMARK(DecodeQuicIntegerRange, iters) {
+  Buf encoded;
+  BENCHMARK_SUSPEND {
+    folly::IOBufQueue queue;
+    folly::io::QueueAppender appender(&queue, kNumIntegers * 8);
+    for (auto value : makeIntegers()) {
+      encodeQuicInteger(value, appender);
+    }
+    encoded = queue.move();
+    encoded->coalesce();
+  }
+  for (size_t i = 0; i < iters; i += kNumIntegers) {
+    auto range = encoded->coalesce();
+    for (size_t j = 0; j < kNumIntegers; j++) {
+      auto result = decodeQuicInteger(range);
+      range.advance(result->second);
+      folly::doNotOptimizeAway(result);
+    }
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(PacketNumberCipherMask, iters) {
+  std::unique_ptr<PacketNumberCipher> cipher;
+  Sample sample{};
+  BENCHMARK_SUSPEND {
+    cipher = makeCipher();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    sample[0] = static_cast<uint8_t>(i);
+    auto mask = cipher->mask(folly::range(sample));
+    folly::doNotOptimizeAway(mask);
+  }
+}
+
+BENCHMARK(PacketNumberCipherBatchMask, iters) {
+  // One sample per packet of a full GSO batch
+  constexpr size_t kNumSamples = 16;
+  std::unique_ptr<PacketNumberCipher> cipher;
+  std::array<Sample, kNumSamples> samples{};
+  std::array<HeaderProtectionMask, kNumSamples> masks;
+  BENCHMARK_SUSPEND {
+    cipher = makeCipher();
+  }
+  for (size_t i = 0; i < iters; i += kNumSamples) {
+    samples[0][0] = static_cast<uint8_t>(i);
+    cipher->batchMask(folly::range(samples), masks.data());
+    folly::doNotOptimizeAway(masks);
+  }
+}
+
+BENCHMARK(PacketNumberCipherEncryptShortHeader, iters) {
+  std::unique_ptr<PacketNumberCipher> cipher;
+  Sample sample{};
+  uint8_t initialByte = 0x43;
+  std::array<uint8_t, kPacketNumberBytes> packetNumber{};
+  BENCHMARK_SUSPEND {
+    cipher = makeCipher();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    sample[0] = static_cast<uint8_t>(i);
+    cipher->encryptShortHeader(
+        folly::range(sample),
+        folly::MutableByteRange(&initialByte, 1),
+        folly::range(packetNumber));
+    folly::doNotOptimizeAway(initialByte);
+  }
+}
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
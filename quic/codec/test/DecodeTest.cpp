@@ -219,6 +219,29 @@ TEST_F(DecodeTest, ValidAckFrame) {
   EXPECT_EQ(ackFrame.ackDelay.count(), 100 << kDefaultAckDelayExponent);
 }
 
+TEST_F(DecodeTest, ValidAckEcnFrame) {
+  folly::IOBufQueue ackEcnFrame;
+  ackEcnFrame.append(createAckFrame(
+      QuicInteger(1000), QuicInteger(100), QuicInteger(0), QuicInteger(10)));
+  folly::io::QueueAppender wcursor(&ackEcnFrame, 10);
+  QuicInteger(7).encode(wcursor);
+  QuicInteger(0).encode(wcursor);
+  QuicInteger(3).encode(wcursor);
+  auto result = ackEcnFrame.move();
+  folly::io::Cursor cursor(result.get());
+  auto ackFrame = decodeAckFrameWithECN(
+      cursor,
+      makeHeader(),
+      CodecParameters(kDefaultAckDelayExponent, QuicVersion::MVFST));
+  EXPECT_EQ(ackFrame.ackBlocks.size(), 1);
+  EXPECT_EQ(ackFrame.largestAcked, 1000);
+  ASSERT_TRUE(ackFrame.ecnCounts.hasValue());
+  EXPECT_EQ(ackFrame.ecnCounts->ect0, 7);
+  EXPECT_EQ(ackFrame.ecnCounts->ect1, 0);
+  EXPECT_EQ(ackFrame.ecnCounts->ce, 3);
+  EXPECT_TRUE(cursor.isAtEnd());
+}
+
 TEST_F(DecodeTest, AckFrameLargestAckExceedsRange) {
   // An integer larger than the representable range of quic integer.
   QuicInteger largestAcked(std::numeric_limits<uint64_t>::max());
@@ -534,6 +557,21 @@ TEST_F(DecodeTest, StreamDecodeSuccess) {
   EXPECT_TRUE(decodedFrame.fin);
 }
 
+TEST_F(DecodeTest, StreamDataSharesPacketBuffer) {
+  QuicInteger streamId(10);
+  QuicInteger length(5);
+  auto streamType = StreamTypeField::Builder().setLength().build();
+  auto streamFrame = createStreamFrame(
+      streamId, folly::none, length, folly::IOBuf::copyBuffer("hello"));
+  auto packetData = streamFrame->coalesce();
+  folly::io::Cursor cursor(streamFrame.get());
+  auto decodedFrame = decodeStreamFrame(cursor, streamType);
+  ASSERT_FALSE(decodedFrame.data->isChained());
+  EXPECT_GE(decodedFrame.data->data(), packetData.begin());
+  EXPECT_LE(decodedFrame.data->tail(), packetData.end());
+  EXPECT_EQ("hello", decodedFrame.data->moveToFbString().toStdString());
+}
+
 TEST_F(DecodeTest, StreamLengthStreamIdInvalid) {
   QuicInteger streamId(std::numeric_limits<uint64_t>::max());
   auto streamType =
@@ -611,6 +649,37 @@ TEST_F(DecodeTest, PaddingFrameTest) {
   decodePaddingFrame(cursor);
 }
 
+TEST_F(DecodeTest, PaddingRunDecodedAsOneFrame) {
+  // Two runs of padding around a ping frame.
+  auto buf = folly::IOBuf::copyBuffer(
+      std::string{0x00, 0x00, 0x00, 0x01, 0x00, 0x00});
+  folly::io::Cursor cursor(buf.get());
+  auto packet = decodeRegularPacket(
+      makeHeader(),
+      CodecParameters(kDefaultAckDelayExponent, QuicVersion::MVFST),
+      cursor);
+  ASSERT_EQ(3, packet.frames.size());
+  EXPECT_EQ(3, boost::get<PaddingFrame>(packet.frames[0]).numFrames);
+  EXPECT_NO_THROW(boost::get<PingFrame>(packet.frames[1]));
+  EXPECT_EQ(2, boost::get<PaddingFrame>(packet.frames[2]).numFrames);
+}
+
+TEST_F(DecodeTest, PaddingRunAcrossBuffers) {
+  auto buf = folly::IOBuf::copyBuffer(std::string{0x01, 0x00, 0x00});
+  buf->prependChain(folly::IOBuf::copyBuffer(std::string(5, 0x00)));
+  buf->prependChain(folly::IOBuf::copyBuffer(std::string{0x00, 0x01}));
+  folly::io::Cursor cursor(buf.get());
+  ShortHeader header(ProtectionType::KeyPhaseZero, getTestConnectionId(), 1);
+  auto packet = decodeRegularPacket(
+      PacketHeader(std::move(header)),
+      CodecParameters(kDefaultAckDelayExponent, QuicVersion::MVFST),
+      cursor);
+  ASSERT_EQ(3, packet.frames.size());
+  EXPECT_NO_THROW(boost::get<PingFrame>(packet.frames[0]));
+  EXPECT_EQ(8, boost::get<PaddingFrame>(packet.frames[1]).numFrames);
+  EXPECT_NO_THROW(boost::get<PingFrame>(packet.frames[2]));
+}
+
 std::unique_ptr<folly::IOBuf> createNewTokenFrame(
     folly::Optional<QuicInteger> tokenLength = folly::none,
     Buf token = nullptr) {
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/codec/EncryptedConnectionIdAlgo.h>
+
+#include <folly/portability/GTest.h>
+#include <quic/codec/DefaultConnectionIdAlgo.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+namespace {
+const std::array<uint8_t, kConnectionIdKeyLength> kKey{
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10};
+}
+
+TEST(EncryptedConnectionIdAlgoTest, EncodeParse) {
+  EncryptedConnectionIdAlgo algo(folly::range(kKey));
+  for (uint16_t hostId : {0, 1, 0x1234, 0xffff}) {
+    for (uint8_t workerId : {0, 7, 0xff}) {
+      for (uint8_t processId : {0, 1}) {
+        ServerConnectionIdParams params(hostId, processId, workerId);
+        auto connId = algo.encodeConnectionId(params);
+        EXPECT_EQ(kDefaultConnectionIdSize, connId.size());
+        EXPECT_TRUE(algo.canParse(connId));
+        auto parsed = algo.parseConnectionId(connId);
+        EXPECT_EQ(kEncryptedShortVersionId, parsed.version);
+        EXPECT_EQ(hostId, parsed.hostId);
+        EXPECT_EQ(workerId, parsed.workerId);
+        EXPECT_EQ(processId, parsed.processId);
+      }
+    }
+  }
+}
+
+TEST(EncryptedConnectionIdAlgoTest, RoutingBitsNotInTheClear) {
+  EncryptedConnectionIdAlgo algo(folly::range(kKey));
+  ServerConnectionIdParams params(0x1234, 1, 5);
+  auto connId = algo.encodeConnectionId(params);
+  auto otherConnId = algo.encodeConnectionId(params);
+  EXPECT_NE(connId, otherConnId);
+  // The encrypted bytes of two ids with the same routing info differ.
+  EXPECT_NE(
+      0, memcmp(connId.data() + 1, otherConnId.data() + 1, connId.size() - 1));
+}
+
+TEST(EncryptedConnectionIdAlgoTest, OtherKey) {
+  EncryptedConnectionIdAlgo algo(folly::range(kKey));
+  auto otherKey = kKey;
+  otherKey[0] ^= 0xff;
+  EncryptedConnectionIdAlgo otherAlgo(folly::range(otherKey));
+  size_t mismatches = 0;
+  for (uint8_t workerId = 0; workerId < 16; ++workerId) {
+    ServerConnectionIdParams params(0x1234, 0, workerId);
+    auto parsed = otherAlgo.parseConnectionId(algo.encodeConnectionId(params));
+    if (parsed.hostId != params.hostId || parsed.workerId != workerId) {
+      ++mismatches;
+    }
+  }
+  EXPECT_GT(mismatches, 0);
+}
+
+TEST(EncryptedConnectionIdAlgoTest, CanParse) {
+  EncryptedConnectionIdAlgo algo(folly::range(kKey));
+  DefaultConnectionIdAlgo defaultAlgo;
+  ServerConnectionIdParams params(0x1234, 0, 1);
+  EXPECT_FALSE(algo.canParse(defaultAlgo.encodeConnectionId(params)));
+  EXPECT_FALSE(defaultAlgo.canParse(algo.encodeConnectionId(params)));
+  EXPECT_FALSE(algo.canParse(ConnectionId(std::vector<uint8_t>{0x80, 1, 2})));
+}
+
+TEST(EncryptedConnectionIdAlgoTest, InvalidKey) {
+  std::vector<uint8_t> key(8);
+  EXPECT_THROW(
+      EncryptedConnectionIdAlgo{folly::range(key)}, std::runtime_error);
+  EXPECT_THROW(
+      EncryptedConnectionIdAlgoFactory{folly::range(key)}, std::runtime_error);
+}
+
+TEST(EncryptedConnectionIdAlgoTest, Factory) {
+  EncryptedConnectionIdAlgoFactory factory(folly::range(kKey));
+  auto algo = factory.make();
+  auto otherAlgo = factory.make();
+  ServerConnectionIdParams params(0x4321, 1, 3);
+  auto parsed = otherAlgo->parseConnectionId(algo->encodeConnectionId(params));
+  EXPECT_EQ(0x4321, parsed.hostId);
+  EXPECT_EQ(1, parsed.processId);
+  EXPECT_EQ(3, parsed.workerId);
+}
+
+} // namespace test
+} // namespace quic
@@ -112,6 +112,126 @@ TEST_P(LongPacketNumberCipherTest, TestEncrypt) {
   EXPECT_EQ(folly::hexlify(initialByte), GetParam().initialByte);
 }
 
+TEST_P(LongPacketNumberCipherTest, TestEncryptWithBatchMask) {
+  auto key = folly::unhexlify(GetParam().key);
+  cipher_.setKey(folly::range(key));
+  std::array<uint8_t, 1> initialByte;
+  std::array<uint8_t, 4> packetNumberBytes;
+  std::array<Sample, 3> samples;
+  std::array<HeaderProtectionMask, 3> masks;
+
+  auto initialByteString = folly::unhexlify(GetParam().decryptedInitialByte);
+  auto sampleString = folly::unhexlify(GetParam().sample);
+  auto packetNumberBytesString =
+      folly::unhexlify(GetParam().decryptedPacketNumberBytes);
+  for (auto& sample : samples) {
+    memcpy(sample.data(), sampleString.data(), sample.size());
+  }
+  cipher_.batchMask(
+      folly::Range<const Sample*>(samples.data(), samples.size()),
+      masks.data());
+
+  for (const auto& headerMask : masks) {
+    EXPECT_EQ(headerMask, cipher_.mask(folly::range(samples[0])));
+    memcpy(initialByte.data(), initialByteString.data(), initialByte.size());
+    memcpy(
+        packetNumberBytes.data(),
+        packetNumberBytesString.data(),
+        packetNumberBytes.size());
+    cipher_.encryptLongHeaderWithMask(
+        headerMask, folly::range(initialByte), folly::range(packetNumberBytes));
+
+    EXPECT_EQ(folly::hexlify(packetNumberBytes), GetParam().packetNumberBytes);
+    EXPECT_EQ(folly::hexlify(initialByte), GetParam().initialByte);
+  }
+}
+
+TEST(ShortPacketNumberCipherTest, TestDecryptWithBatchMask) {
+  Aes128PacketNumberCipher cipher;
+  auto key = folly::unhexlify("0edd982a6ac527f2eddcbb7348dea5d7");
+  cipher.setKey(folly::range(key));
+  auto sampleString = folly::unhexlify("c4c2a2303d297e3c519bf6b22386e3d0");
+  // Short header with a two byte packet number.
+  const std::array<uint8_t, 1> plainInitialByte{{0x41}};
+  const std::array<uint8_t, 4> plainPacketNumberBytes{{0x5f, 0x01, 0, 0}};
+
+  std::array<Sample, 2> samples;
+  std::array<std::array<uint8_t, 1>, 2> initialBytes;
+  std::array<std::array<uint8_t, 4>, 2> packetNumberBytes;
+  for (size_t i = 0; i < samples.size(); ++i) {
+    memcpy(samples[i].data(), sampleString.data(), samples[i].size());
+    samples[i][0] = static_cast<uint8_t>(i);
+    initialBytes[i] = plainInitialByte;
+    packetNumberBytes[i] = plainPacketNumberBytes;
+    cipher.encryptShortHeader(
+        folly::range(samples[i]),
+        folly::range(initialBytes[i]),
+        folly::range(packetNumberBytes[i]));
+  }
+
+  std::array<HeaderProtectionMask, 2> masks;
+  cipher.batchMask(
+      folly::Range<const Sample*>(samples.data(), samples.size()),
+      masks.data());
+  for (size_t i = 0; i < samples.size(); ++i) {
+    auto initialByte = initialBytes[i];
+    auto packetNumber = packetNumberBytes[i];
+    cipher.decryptShortHeader(
+        folly::range(samples[i]),
+        folly::range(initialByte),
+        folly::range(packetNumber));
+    EXPECT_EQ(plainInitialByte, initialByte);
+    EXPECT_EQ(plainPacketNumberBytes, packetNumber);
+
+    cipher.decryptShortHeaderWithMask(
+        masks[i],
+        folly::range(initialBytes[i]),
+        folly::range(packetNumberBytes[i]));
+    EXPECT_EQ(plainInitialByte, initialBytes[i]);
+    EXPECT_EQ(plainPacketNumberBytes, packetNumberBytes[i]);
+  }
+}
+
+// RFC 9001 appendix A.5.
+TEST(ChaCha20PacketNumberCipherTest, TestShortHeader) {
+  ChaCha20PacketNumberCipher cipher;
+  auto key = folly::unhexlify(
+      "25a282b9e82f06f21f488917a4fc8f1b73573685608597d0efcb076b0ab7a7a4");
+  ASSERT_EQ(cipher.keyLength(), key.size());
+  cipher.setKey(folly::range(key));
+  auto sampleString = folly::unhexlify("5e5cd55c41f69080575d7999c25a5bfb");
+  Sample sample;
+  memcpy(sample.data(), sampleString.data(), sample.size());
+  EXPECT_EQ(
+      "aefefe7d03",
+      folly::hexlify(
+          folly::range(cipher.mask(folly::range(sample))).subpiece(0, 5)));
+
+  std::array<uint8_t, 1> initialByte{{0x42}};
+  std::array<uint8_t, 4> packetNumberBytes{{0x00, 0xbf, 0xf4, 0x00}};
+  cipher.encryptShortHeader(
+      folly::range(sample),
+      folly::range(initialByte),
+      folly::range(packetNumberBytes));
+  EXPECT_EQ("4c", folly::hexlify(initialByte));
+  EXPECT_EQ("fe418900", folly::hexlify(packetNumberBytes));
+
+  // Masks are independent of the samples that came before.
+  std::array<Sample, 2> samples{{sample, sample}};
+  samples[0][0] ^= 1;
+  std::array<HeaderProtectionMask, 2> masks;
+  cipher.batchMask(
+      folly::Range<const Sample*>(samples.data(), samples.size()),
+      masks.data());
+  EXPECT_EQ(masks[1], cipher.mask(folly::range(sample)));
+  EXPECT_NE(masks[0], masks[1]);
+
+  cipher.decryptShortHeaderWithMask(
+      masks[1], folly::range(initialByte), folly::range(packetNumberBytes));
+  EXPECT_EQ("42", folly::hexlify(initialByte));
+  EXPECT_EQ("00bff400", folly::hexlify(packetNumberBytes));
+}
+
 INSTANTIATE_TEST_CASE_P(
     LongPacketNumberCipherTests,
     LongPacketNumberCipherTest,
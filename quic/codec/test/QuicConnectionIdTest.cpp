@@ -61,5 +61,23 @@ INSTANTIATE_TEST_CASE_P(
         (ConnectionIdLengthParams){4, 18, 0x1F},
         (ConnectionIdLengthParams){18, 18, 0xFF}));
 
+TEST(ConnectionIdHashTest, EqualIdsHashEqual) {
+  ConnectionIdHash hash;
+  for (size_t len : {4, 8, 18}) {
+    std::vector<uint8_t> data(len);
+    for (size_t i = 0; i < len; i++) {
+      data[i] = static_cast<uint8_t>(i);
+    }
+    ConnectionId connId(data);
+    EXPECT_EQ(hash(connId), hash(ConnectionId(data)));
+    // Every byte counts.
+    for (size_t i = 0; i < len; i++) {
+      auto other = data;
+      other[i] ^= 0x80;
+      EXPECT_NE(hash(connId), hash(ConnectionId(other)));
+    }
+  }
+}
+
 } // namespace test
 } // namespace quic
@@ -72,6 +72,50 @@ TEST_P(QuicIntegerDecodeTest, DecodeAtMost) {
   }
 }
 
+TEST_P(QuicIntegerDecodeTest, DecodeRange) {
+  std::string encodedBytes = folly::unhexlify(GetParam().hexEncoded);
+  if (GetParam().error) {
+    EXPECT_FALSE(
+        decodeQuicInteger(folly::ByteRange(folly::StringPiece(encodedBytes)))
+            .hasValue());
+    return;
+  }
+  // With and without bytes after the integer, which take different paths.
+  for (auto suffix : {std::string(), std::string(8, '\xff')}) {
+    auto data = encodedBytes + suffix;
+    auto decodedValue =
+        decodeQuicInteger(folly::ByteRange(folly::StringPiece(data)));
+    ASSERT_TRUE(decodedValue.hasValue());
+    EXPECT_EQ(decodedValue->first, GetParam().decoded);
+    EXPECT_EQ(decodedValue->second, GetParam().encodedLength);
+  }
+}
+
+TEST(QuicIntegerTest, DecodeIntegersAcrossBuffers) {
+  std::vector<uint64_t> expected = {
+      37, 15293, 494878333, 151288809941952652, 5, 16000};
+  IOBufQueue queue;
+  folly::io::QueueAppender appender(&queue, 10);
+  for (auto value : expected) {
+    encodeQuicInteger(value, appender);
+  }
+  auto encoded = queue.move()->moveToFbString().toStdString();
+  // Split the data at every position so that every integer spans two buffers
+  // at some point.
+  for (size_t split = 1; split < encoded.size(); ++split) {
+    auto buf = IOBuf::copyBuffer(encoded.substr(0, split));
+    buf->prependChain(IOBuf::copyBuffer(encoded.substr(split)));
+    folly::io::Cursor cursor(buf.get());
+    std::vector<uint64_t> values(expected.size() + 1);
+    EXPECT_EQ(
+        decodeQuicIntegers(cursor, values.data(), values.size()),
+        expected.size());
+    values.pop_back();
+    EXPECT_EQ(values, expected);
+    EXPECT_TRUE(cursor.isAtEnd());
+  }
+}
+
 TEST_P(QuicIntegerEncodeTest, Encode) {
   IOBufQueue queue;
   folly::io::QueueAppender appender(&queue, 10);
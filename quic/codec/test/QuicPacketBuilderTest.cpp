@@ -13,6 +13,7 @@
 #include <quic/codec/QuicReadCodec.h>
 #include <quic/codec/Types.h>
 #include <quic/codec/test/Mocks.h>
+#include <quic/common/BufferAllocator.h>
 #include <quic/common/test/TestUtils.h>
 #include <quic/handshake/FizzCryptoFactory.h>
 #include <quic/handshake/HandshakeLayer.h>
@@ -327,6 +328,107 @@ TEST_F(QuicPacketBuilderTest, TestPaddingAccountsForCipherOverhead) {
       expectedOutputSize - cipherOverhead);
 }
 
+TEST_F(QuicPacketBuilderTest, BodyReadyForInPlaceEncryption) {
+  auto connId = getTestConnectionId();
+  PacketNum pktNum = 222;
+  PacketNum largestAckedPacketNum = 0;
+
+  size_t cipherOverhead = 16;
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen,
+      PacketHeader(ShortHeader(ProtectionType::KeyPhaseZero, connId, pktNum)),
+      largestAckedPacketNum);
+  builder.setCipherOverhead(cipherOverhead);
+  auto data = folly::IOBuf::copyBuffer("stream");
+  data->prependChain(folly::IOBuf::copyBuffer("data"));
+  builder.writeBE(static_cast<uint8_t>(0));
+  builder.insert(data->clone());
+  auto builtOut = std::move(builder).buildPacket();
+  // One unshared buffer, with room for the tag.
+  EXPECT_FALSE(builtOut.body->isChained());
+  EXPECT_FALSE(builtOut.body->isShared());
+  EXPECT_GE(builtOut.body->tailroom(), cipherOverhead);
+  EXPECT_EQ(
+      builtOut.body->computeChainDataLength(),
+      1 + data->computeChainDataLength());
+}
+
+TEST_F(QuicPacketBuilderTest, BodyFromBufferAllocator) {
+  HugePageBufferAllocator allocator(HugePageBufferAllocator::kSlabSize);
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen,
+      PacketHeader(ShortHeader(
+          ProtectionType::KeyPhaseZero, getTestConnectionId(), 222)),
+      0);
+  builder.setBufferAllocator(&allocator);
+  builder.setCipherOverhead(16);
+  builder.writeBE(static_cast<uint8_t>(0));
+  auto builtOut = std::move(builder).buildPacket();
+  EXPECT_EQ(allocator.numSlabs(), 1);
+  size_t bufSize = builtOut.body->capacity();
+  size_t cached = allocator.numCachedBuffers(bufSize);
+  builtOut.body.reset();
+  EXPECT_EQ(allocator.numCachedBuffers(bufSize), cached + 1);
+}
+
+TEST_F(QuicPacketBuilderTest, ZeroCopyInsert) {
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen,
+      PacketHeader(ShortHeader(
+          ProtectionType::KeyPhaseZero, getTestConnectionId(), 222)),
+      0);
+  builder.setCipherOverhead(16);
+  builder.setZeroCopyInsert(true);
+  auto data = folly::IOBuf::copyBuffer("stream data");
+  builder.writeBE(static_cast<uint8_t>(0));
+  builder.insert(data->clone());
+  auto builtOut = std::move(builder).buildPacket();
+  // The data is referenced rather than copied into the body.
+  EXPECT_TRUE(builtOut.body->isChained());
+  EXPECT_EQ(data->data(), builtOut.body->next()->data());
+  EXPECT_EQ(
+      builtOut.body->computeChainDataLength(),
+      1 + data->computeChainDataLength());
+}
+
+TEST_F(QuicPacketBuilderTest, JoinPacketIntoSingleBuffer) {
+  LongHeader header(
+      LongHeader::Types::Handshake,
+      getTestConnectionId(0),
+      getTestConnectionId(1),
+      10,
+      QuicVersion::QUIC_DRAFT);
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen, std::move(header), 0, QuicVersion::QUIC_DRAFT);
+  builder.setCipherOverhead(16);
+  writeFrame(PingFrame(), builder);
+  auto builtOut = std::move(builder).buildPacket();
+  auto expected = builtOut.header->clone();
+  expected->prependChain(builtOut.body->clone());
+  auto packetBuf =
+      joinPacket(std::move(builtOut.header), std::move(builtOut.body));
+  EXPECT_FALSE(packetBuf->isChained());
+  folly::IOBufEqualTo eq;
+  EXPECT_TRUE(eq(*expected, *packetBuf));
+}
+
+TEST_F(QuicPacketBuilderTest, JoinPacketWithoutHeadroom) {
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen,
+      PacketHeader(ShortHeader(
+          ProtectionType::KeyPhaseZero, getTestConnectionId(), 10)),
+      0);
+  writeFrame(PingFrame(), builder);
+  auto builtOut = std::move(builder).buildPacket();
+  auto headerLength = builtOut.header->length();
+  auto bodyLength = builtOut.body->computeChainDataLength();
+  auto packetBuf =
+      joinPacket(std::move(builtOut.header), std::move(builtOut.body));
+  EXPECT_TRUE(packetBuf->isChained());
+  EXPECT_EQ(headerLength, packetBuf->length());
+  EXPECT_EQ(headerLength + bodyLength, packetBuf->computeChainDataLength());
+}
+
 TEST_F(QuicPacketBuilderTest, TestPaddingRespectsRemainingBytes) {
   auto connId = getTestConnectionId();
   PacketNum pktNum = 222;
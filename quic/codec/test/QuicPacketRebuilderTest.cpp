@@ -113,8 +113,8 @@ TEST_F(QuicPacketRebuilderTest, RebuildPacket) {
   auto outstanding = makeDummyOutstandingPacket(packet1.packet, 1000);
   EXPECT_TRUE(rebuilder.rebuildFromPacket(outstanding).hasValue());
   auto packet2 = std::move(regularBuilder2).buildPacket();
-  // rebuilder writes frames to regularBuilder2
-  EXPECT_EQ(packet1.packet.frames.size(), packet2.packet.frames.size());
+  // rebuilder writes frames to regularBuilder2, except for the stale ack
+  EXPECT_EQ(packet1.packet.frames.size(), packet2.packet.frames.size() + 1);
   auto expectedConnFlowControlValue = std::max(
       conn.flowControlState.sumCurReadOffset + conn.flowControlState.windowSize,
       conn.flowControlState.advertisedMaxOffset);
@@ -134,10 +134,6 @@ TEST_F(QuicPacketRebuilderTest, RebuildPacket) {
           EXPECT_EQ(4321, maxStreamFrame.maxStreams);
         },
         [](const PingFrame& ping) { EXPECT_EQ(PingFrame(), ping); },
-        [](const WriteAckFrame& ack) {
-          EXPECT_EQ(Interval<PacketNum>(10, 100), ack.ackBlocks.front());
-          EXPECT_EQ(Interval<PacketNum>(200, 1000), ack.ackBlocks.back());
-        },
         [&buf, &streamId](const WriteStreamFrame& streamFrame) {
           EXPECT_EQ(streamId, streamFrame.streamId);
           EXPECT_EQ(0, streamFrame.offset);
@@ -198,6 +194,42 @@ TEST_F(QuicPacketRebuilderTest, RebuildAfterResetStream) {
   EXPECT_FALSE(rebuilder.rebuildFromPacket(outstanding).hasValue());
 }
 
+TEST_F(QuicPacketRebuilderTest, RebuildSkipsAckedStreamData) {
+  ShortHeader shortHeader(
+      ProtectionType::KeyPhaseZero, getTestConnectionId(), 0);
+  RegularQuicPacketBuilder regularBuilder1(
+      kDefaultUDPSendPacketLen, shortHeader, 0 /* largestAcked */);
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(10);
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  auto streamId = stream->id;
+  auto buf = folly::IOBuf::copyBuffer("Acked somewhere else.");
+  MaxDataFrame maxDataFrame(1000);
+  writeStreamFrameHeader(
+      regularBuilder1,
+      streamId,
+      0,
+      buf->computeChainDataLength(),
+      buf->computeChainDataLength(),
+      false);
+  writeStreamFrameData(
+      regularBuilder1, buf->clone(), buf->computeChainDataLength());
+  writeFrame(maxDataFrame, regularBuilder1);
+  auto packet1 = std::move(regularBuilder1).buildPacket();
+  ASSERT_EQ(2, packet1.packet.frames.size());
+  // The stream data isn't in the retransmission buffer, as if another packet
+  // carrying it was acked.
+
+  RegularQuicPacketBuilder regularBuilder2(
+      kDefaultUDPSendPacketLen, shortHeader, 0 /* largestAcked */);
+  PacketRebuilder rebuilder(regularBuilder2, conn);
+  auto outstanding = makeDummyOutstandingPacket(packet1.packet, 1000);
+  EXPECT_TRUE(rebuilder.rebuildFromPacket(outstanding).hasValue());
+  auto packet2 = std::move(regularBuilder2).buildPacket();
+  ASSERT_EQ(1, packet2.packet.frames.size());
+  EXPECT_TRUE(boost::get<MaxDataFrame>(&packet2.packet.frames.front()));
+}
+
 TEST_F(QuicPacketRebuilderTest, FinOnlyStreamRebuild) {
   ShortHeader shortHeader(
       ProtectionType::KeyPhaseZero, getTestConnectionId(), 0);
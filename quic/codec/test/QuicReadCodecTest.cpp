@@ -298,6 +298,47 @@ TEST_F(QuicReadCodecTest, ZeroRttPacketWithZeroRttCipher) {
   EXPECT_TRUE(parseSuccess(packet));
 }
 
+TEST_F(QuicReadCodecTest, CoalescedPacketsDecryptedInPlace) {
+  auto connId = getTestConnectionId();
+  StreamId streamId = 2;
+  auto data = folly::IOBuf::copyBuffer("hello");
+  auto datagram = folly::IOBuf::create(0);
+  for (PacketNum packetNum : {1, 2}) {
+    auto streamPacket = createStreamPacket(
+        connId,
+        connId,
+        packetNum,
+        streamId,
+        *data,
+        0 /* cipherOverhead */,
+        0 /* largestAcked */,
+        std::make_pair(LongHeader::Types::ZeroRtt, QuicVersion::MVFST));
+    datagram->prependChain(packetToBuf(streamPacket));
+  }
+  // One buffer for the whole datagram, as it comes off the socket.
+  datagram->coalesce();
+  auto datagramData = datagram->data();
+  auto datagramEnd = datagram->tail();
+
+  auto zeroRttAead = createNoOpAead();
+  EXPECT_CALL(*zeroRttAead, _tryDecrypt(_, _, _))
+      .Times(2)
+      .WillRepeatedly(Invoke([&](auto& buf, auto, auto) {
+        EXPECT_FALSE(buf->isChained());
+        EXPECT_FALSE(buf->isShared());
+        EXPECT_GE(buf->data(), datagramData);
+        EXPECT_LE(buf->tail(), datagramEnd);
+        return folly::Optional<std::unique_ptr<folly::IOBuf>>(std::move(buf));
+      }));
+  auto codec = makeEncryptedCodec(connId, nullptr, std::move(zeroRttAead));
+  AckStates ackStates;
+  auto packetQueue = bufToQueue(std::move(datagram));
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  EXPECT_FALSE(packetQueue.empty());
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  EXPECT_TRUE(packetQueue.empty());
+}
+
 TEST_F(QuicReadCodecTest, KeyPhaseOnePacket) {
   auto connId = getTestConnectionId();
   PacketNum packetNum = 12321;
@@ -322,6 +363,176 @@ TEST_F(QuicReadCodecTest, KeyPhaseOnePacket) {
   EXPECT_FALSE(parseSuccess(packet));
 }
 
+TEST_F(QuicReadCodecTest, KeyPhaseOnePacketWithNextCipher) {
+  auto connId = getTestConnectionId();
+  PacketNum packetNum = 12321;
+  StreamId streamId = 2;
+
+  auto data = folly::IOBuf::copyBuffer("hello");
+  auto streamPacket = createStreamPacket(
+      connId,
+      connId,
+      packetNum,
+      streamId,
+      *data,
+      0 /* cipherOverhead */,
+      0 /* largestAcked */,
+      folly::none,
+      true,
+      ProtectionType::KeyPhaseOne);
+  auto currentAead = std::make_unique<MockAead>();
+  EXPECT_CALL(*currentAead, _tryDecrypt(_, _, _)).Times(0);
+  auto codec = makeEncryptedCodec(connId, std::move(currentAead));
+  codec->setNextOneRttReadCipher(createNoOpAead());
+  auto nextAead = codec->getNextOneRttReadCipher();
+
+  AckStates ackStates;
+  auto packetQueue = bufToQueue(packetToBuf(streamPacket));
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  EXPECT_EQ(ProtectionType::KeyPhaseOne, codec->getKeyPhase());
+  EXPECT_EQ(nextAead, codec->getOneRttReadCipher());
+  EXPECT_EQ(nullptr, codec->getNextOneRttReadCipher());
+}
+
+TEST_F(QuicReadCodecTest, ReorderedPacketAfterKeyUpdate) {
+  auto connId = getTestConnectionId();
+  StreamId streamId = 2;
+  auto data = folly::IOBuf::copyBuffer("hello");
+  auto makePacket = [&](PacketNum packetNum, ProtectionType keyPhase) {
+    return packetToBuf(createStreamPacket(
+        connId,
+        connId,
+        packetNum,
+        streamId,
+        *data,
+        0 /* cipherOverhead */,
+        0 /* largestAcked */,
+        folly::none,
+        true,
+        keyPhase));
+  };
+  auto codec = makeEncryptedCodec(connId, createNoOpAead());
+  codec->setNextOneRttReadCipher(createNoOpAead());
+
+  AckStates ackStates;
+  auto packetQueue = bufToQueue(makePacket(10, ProtectionType::KeyPhaseOne));
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+
+  // A packet sent before the update is still read with the old keys.
+  packetQueue = bufToQueue(makePacket(9, ProtectionType::KeyPhaseZero));
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  EXPECT_EQ(ProtectionType::KeyPhaseOne, codec->getKeyPhase());
+
+  // A packet sent after it in key phase zero needs the next keys, which are
+  // not there yet.
+  packetQueue = bufToQueue(makePacket(11, ProtectionType::KeyPhaseZero));
+  EXPECT_FALSE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  packetQueue = bufToQueue(makePacket(12, ProtectionType::KeyPhaseOne));
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+}
+
+TEST_F(QuicReadCodecTest, NextKeyPhaseDecryptFail) {
+  auto connId = getTestConnectionId();
+  auto data = folly::IOBuf::copyBuffer("hello");
+  auto streamPacket = createStreamPacket(
+      connId,
+      connId,
+      12321,
+      2,
+      *data,
+      0 /* cipherOverhead */,
+      0 /* largestAcked */,
+      folly::none,
+      true,
+      ProtectionType::KeyPhaseOne);
+  auto nextAead = std::make_unique<MockAead>();
+  EXPECT_CALL(*nextAead, _tryDecrypt(_, _, _))
+      .WillOnce(Invoke([](auto&, const auto, auto) { return folly::none; }));
+  auto codec = makeEncryptedCodec(connId, createNoOpAead());
+  codec->setNextOneRttReadCipher(std::move(nextAead));
+
+  AckStates ackStates;
+  auto packetQueue = bufToQueue(packetToBuf(streamPacket));
+  EXPECT_FALSE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  // The key phase only moves once a packet decrypts with the next keys.
+  EXPECT_EQ(ProtectionType::KeyPhaseZero, codec->getKeyPhase());
+  EXPECT_NE(nullptr, codec->getNextOneRttReadCipher());
+}
+
+TEST_F(QuicReadCodecTest, PreparedShortHeaderMasks) {
+  auto connId = getTestConnectionId();
+  std::vector<Buf> packets;
+  for (StreamId streamId = 0; streamId < 3; ++streamId) {
+    // Different data for different samples.
+    auto data =
+        folly::IOBuf::copyBuffer(folly::to<std::string>(streamId, "hello"));
+    packets.push_back(packetToBuf(createStreamPacket(
+        connId,
+        connId,
+        streamId + 1,
+        streamId * 4,
+        *data,
+        0 /* cipherOverhead */,
+        0 /* largestAcked */)));
+  }
+  auto codec = makeEncryptedCodec(connId, createNoOpAead());
+  auto headerCipher = std::make_unique<MockPacketNumberCipher>();
+  // One mask for each of the prepared packets and one for the last packet,
+  // which parsePacket computes itself.
+  EXPECT_CALL(*headerCipher, mask(_))
+      .Times(3)
+      .WillRepeatedly(Return(HeaderProtectionMask{}));
+  codec->setOneRttHeaderCipher(std::move(headerCipher));
+  codec->prepareShortHeaderMasks({packets[1].get(), packets[0].get()});
+
+  AckStates ackStates;
+  for (auto& packet : packets) {
+    auto packetQueue = bufToQueue(std::move(packet));
+    EXPECT_TRUE(parseSuccess(codec->parsePacket(packetQueue, ackStates)));
+  }
+}
+
+TEST_F(QuicReadCodecTest, ShortHeaderMasksWithShortConnectionId) {
+  auto clientConnId = getTestConnectionId();
+  ConnectionId serverConnId(std::vector<uint8_t>{1, 2, 3, 4});
+  std::vector<Buf> packets;
+  for (StreamId streamId = 0; streamId < 2; ++streamId) {
+    auto data =
+        folly::IOBuf::copyBuffer(folly::to<std::string>(streamId, "hello"));
+    packets.push_back(packetToBuf(createStreamPacket(
+        clientConnId,
+        serverConnId,
+        streamId + 1,
+        streamId * 4,
+        *data,
+        0 /* cipherOverhead */,
+        0 /* largestAcked */)));
+  }
+  auto codec = makeEncryptedCodec(clientConnId, createNoOpAead());
+  codec->setServerConnectionId(serverConnId);
+  auto headerCipher = std::make_unique<MockPacketNumberCipher>();
+  // The prepared mask is found for the first packet, the second one is read
+  // after the masks are cleared.
+  EXPECT_CALL(*headerCipher, mask(_))
+      .Times(2)
+      .WillRepeatedly(Return(HeaderProtectionMask{}));
+  codec->setOneRttHeaderCipher(std::move(headerCipher));
+  codec->prepareShortHeaderMasks({packets[0].get()});
+
+  AckStates ackStates;
+  auto firstQueue = bufToQueue(std::move(packets[0]));
+  EXPECT_TRUE(parseSuccess(codec->parsePacket(firstQueue, ackStates)));
+  codec->clearShortHeaderMasks();
+  auto secondQueue = bufToQueue(std::move(packets[1]));
+  auto res = codec->parsePacket(secondQueue, ackStates);
+  ASSERT_TRUE(parseSuccess(res));
+  auto regularPacket =
+      boost::get<RegularQuicPacket>(boost::get<QuicPacket>(res));
+  EXPECT_EQ(
+      serverConnId,
+      boost::get<ShortHeader>(regularPacket.header).getConnectionId());
+}
+
 TEST_F(QuicReadCodecTest, FailToDecryptLeadsToReset) {
   auto connId = getTestConnectionId();
   auto aead = std::make_unique<MockAead>();
@@ -400,6 +400,59 @@ TEST_F(QuicWriteCodecTest, WriteStreamSpaceForOneByte) {
   EXPECT_TRUE(folly::IOBufEqualTo()(inputBuf, decodedStreamFrame.data));
 }
 
+TEST_F(QuicWriteCodecTest, WriteStreamFrameShorterLengthFillsPacket) {
+  // 1 byte for type
+  // 1 byte for stream id
+  // => 2 bytes, and 64 bytes left for the length and the data
+  MockQuicPacketBuilder pktBuilder;
+  pktBuilder.remaining_ = 66;
+  setupCommonExpects(pktBuilder);
+  auto inputBuf = buildRandomInputData(63);
+
+  StreamId streamId = 1;
+  uint64_t offset = 0;
+  bool fin = false;
+  // 63 bytes of data with a 1 byte length fill the packet exactly, while a 2
+  // byte length would leave room for only 62.
+  auto dataLen =
+      writeStreamFrameHeader(pktBuilder, streamId, offset, 63, 63, fin);
+  ASSERT_TRUE(dataLen);
+  EXPECT_EQ(*dataLen, 63);
+  writeStreamFrameData(pktBuilder, inputBuf->clone(), *dataLen);
+  EXPECT_EQ(pktBuilder.remainingSpaceInPkt(), 0);
+  auto builtOut = std::move(pktBuilder).buildPacket();
+  auto regularPacket = builtOut.first;
+  auto wireBuf = std::move(builtOut.second);
+  folly::io::Cursor cursor(wireBuf.get());
+  auto decodedStreamFrame = boost::get<ReadStreamFrame>(quic::parseFrame(
+      cursor,
+      regularPacket.header,
+      CodecParameters(kDefaultAckDelayExponent, QuicVersion::MVFST)));
+  EXPECT_EQ(decodedStreamFrame.streamId, streamId);
+  EXPECT_EQ(decodedStreamFrame.data->computeChainDataLength(), 63);
+  EXPECT_TRUE(cursor.isAtEnd());
+}
+
+TEST_F(QuicWriteCodecTest, WriteStreamFrameTruncatedToShorterLength) {
+  // 1 byte for type
+  // 1 byte for stream id
+  // => 2 bytes, and 16385 bytes left for the length and the data
+  MockQuicPacketBuilder pktBuilder;
+  pktBuilder.remaining_ = 16387;
+  setupCommonExpects(pktBuilder);
+
+  StreamId streamId = 1;
+  uint64_t offset = 0;
+  bool fin = false;
+  // 16384 bytes need a 4 byte length which does not fit, so the data is
+  // truncated to the largest length that fits with a 2 byte length.
+  auto dataLen =
+      writeStreamFrameHeader(pktBuilder, streamId, offset, 16384, 16384, fin);
+  ASSERT_TRUE(dataLen);
+  EXPECT_EQ(*dataLen, kTwoByteLimit);
+  EXPECT_EQ(pktBuilder.remainingSpaceInPkt(), kTwoByteLimit);
+}
+
 TEST_F(QuicWriteCodecTest, WriteFinToEmptyPacket) {
   MockQuicPacketBuilder pktBuilder;
   setupCommonExpects(pktBuilder);
@@ -657,6 +710,106 @@ TEST_F(QuicWriteCodecTest, WriteSimpleAckFrame) {
   EXPECT_EQ(decodedAckFrame.ackBlocks[1].endPacket, 400);
 }
 
+TEST_F(QuicWriteCodecTest, WriteAckFrameWithCache) {
+  IntervalSet<PacketNum> ackBlocks = {{501, 1000}, {101, 400}, {10, 20}};
+  AckBlocksCache cache;
+  auto writeAndDecode = [&]() {
+    MockQuicPacketBuilder pktBuilder;
+    setupCommonExpects(pktBuilder);
+    AckFrameMetaData meta(ackBlocks, 111us, kDefaultAckDelayExponent, &cache);
+    auto result = *writeAckFrame(meta, pktBuilder);
+    EXPECT_EQ(ackBlocks.size(), result.ackBlocksWritten);
+    auto builtOut = std::move(pktBuilder).buildPacket();
+    WriteAckFrame ackFrame =
+        boost::get<WriteAckFrame>(builtOut.first.frames.back());
+    EXPECT_EQ(ackBlocks.size(), ackFrame.ackBlocks.size());
+    auto wireBuf = std::move(builtOut.second);
+    folly::io::Cursor cursor(wireBuf.get());
+    return boost::get<ReadAckFrame>(parseQuicFrame(cursor));
+  };
+
+  auto decodedAckFrame = writeAndDecode();
+  auto encodedBlocks = cache.encodedBlocks.get();
+  ASSERT_NE(nullptr, encodedBlocks);
+  ASSERT_EQ(3, decodedAckFrame.ackBlocks.size());
+  EXPECT_EQ(101, decodedAckFrame.ackBlocks[1].startPacket);
+  EXPECT_EQ(20, decodedAckFrame.ackBlocks[2].endPacket);
+
+  // Acking more packets in order reuses the encoded blocks.
+  ackBlocks.insert(1001, 1010);
+  decodedAckFrame = writeAndDecode();
+  EXPECT_EQ(encodedBlocks, cache.encodedBlocks.get());
+  EXPECT_EQ(1010, decodedAckFrame.largestAcked);
+  ASSERT_EQ(3, decodedAckFrame.ackBlocks.size());
+  EXPECT_EQ(501, decodedAckFrame.ackBlocks[0].startPacket);
+  EXPECT_EQ(400, decodedAckFrame.ackBlocks[1].endPacket);
+  EXPECT_EQ(10, decodedAckFrame.ackBlocks[2].startPacket);
+
+  // Any other change encodes them again.
+  ackBlocks.insert(450);
+  decodedAckFrame = writeAndDecode();
+  EXPECT_EQ(4, decodedAckFrame.ackBlocks.size());
+  EXPECT_EQ(450, decodedAckFrame.ackBlocks[1].startPacket);
+}
+
+TEST_F(QuicWriteCodecTest, WriteAckFrameMaxAckBlocks) {
+  MockQuicPacketBuilder pktBuilder;
+  setupCommonExpects(pktBuilder);
+  IntervalSet<PacketNum> ackBlocks = {{501, 1000}, {101, 400}, {10, 20}};
+  AckFrameMetaData meta(ackBlocks, 111us, kDefaultAckDelayExponent, nullptr, 2);
+  auto result = *writeAckFrame(meta, pktBuilder);
+  EXPECT_EQ(2, result.ackBlocksWritten);
+  auto builtOut = std::move(pktBuilder).buildPacket();
+  auto wireBuf = std::move(builtOut.second);
+  folly::io::Cursor cursor(wireBuf.get());
+  auto decodedAckFrame = boost::get<ReadAckFrame>(parseQuicFrame(cursor));
+  // The newest blocks are written.
+  ASSERT_EQ(2, decodedAckFrame.ackBlocks.size());
+  EXPECT_EQ(501, decodedAckFrame.ackBlocks[0].startPacket);
+  EXPECT_EQ(101, decodedAckFrame.ackBlocks[1].startPacket);
+}
+
+TEST_F(QuicWriteCodecTest, WriteAckEcnFrame) {
+  MockQuicPacketBuilder pktBuilder;
+  setupCommonExpects(pktBuilder);
+  IntervalSet<PacketNum> ackBlocks = {{501, 1000}, {101, 400}};
+  EcnCounts ecnCounts;
+  ecnCounts.ect0 = 100;
+  ecnCounts.ce = 2;
+  AckFrameMetaData meta(
+      ackBlocks,
+      111us,
+      kDefaultAckDelayExponent,
+      nullptr,
+      std::numeric_limits<uint64_t>::max(),
+      &ecnCounts);
+  // The 11 bytes of the ack frame, and 2 bytes for ECT(0), 1 byte for ECT(1)
+  // and 1 byte for CE.
+  auto result = *writeAckFrame(meta, pktBuilder);
+  EXPECT_EQ(15, result.bytesWritten);
+  auto builtOut = std::move(pktBuilder).buildPacket();
+  auto wireBuf = std::move(builtOut.second);
+  folly::io::Cursor cursor(wireBuf.get());
+  auto decodedAckFrame = boost::get<ReadAckFrame>(parseQuicFrame(cursor));
+  EXPECT_EQ(decodedAckFrame.largestAcked, 1000);
+  EXPECT_EQ(decodedAckFrame.ackBlocks.size(), 2);
+  ASSERT_TRUE(decodedAckFrame.ecnCounts.hasValue());
+  EXPECT_EQ(ecnCounts, *decodedAckFrame.ecnCounts);
+
+  // Without any ECN codepoint received, a plain ack frame is written.
+  MockQuicPacketBuilder plainBuilder;
+  setupCommonExpects(plainBuilder);
+  EcnCounts noCounts;
+  AckFrameMetaData plainMeta(
+      ackBlocks,
+      111us,
+      kDefaultAckDelayExponent,
+      nullptr,
+      std::numeric_limits<uint64_t>::max(),
+      &noCounts);
+  EXPECT_EQ(11, writeAckFrame(plainMeta, plainBuilder)->bytesWritten);
+}
+
 TEST_F(QuicWriteCodecTest, WriteAckFrameWillSaveAckDelay) {
   MockQuicPacketBuilder pktBuilder;
   setupCommonExpects(pktBuilder);
@@ -1427,6 +1580,99 @@ TEST_F(QuicWriteCodecTest, WritePathChallenge) {
   EXPECT_TRUE(cursor.isAtEnd());
 }
 
+TEST_F(QuicWriteCodecTest, WriteAckFrequency) {
+  MockQuicPacketBuilder pktBuilder;
+  setupCommonExpects(pktBuilder);
+
+  AckFrequencyFrame ackFrequency(1, 10, 25000us, true);
+  auto bytesWritten = writeSimpleFrame(ackFrequency, pktBuilder);
+  // type (2) + sequence number (1) + tolerance (1) + delay (4) + order (1)
+  EXPECT_EQ(bytesWritten, 9);
+
+  auto builtOut = std::move(pktBuilder).buildPacket();
+
+  auto regularPacket = builtOut.first;
+  auto result = boost::get<AckFrequencyFrame>(
+      boost::get<QuicSimpleFrame>(regularPacket.frames[0]));
+  EXPECT_EQ(result, ackFrequency);
+
+  auto wireBuf = std::move(builtOut.second);
+  folly::io::Cursor cursor(wireBuf.get());
+  auto wireSimpleFrame = boost::get<QuicSimpleFrame>(parseQuicFrame(cursor));
+  EXPECT_EQ(boost::get<AckFrequencyFrame>(wireSimpleFrame), ackFrequency);
+  EXPECT_TRUE(cursor.isAtEnd());
+}
+
+TEST_F(QuicWriteCodecTest, WriteDatagram) {
+  MockQuicPacketBuilder pktBuilder;
+  setupCommonExpects(pktBuilder);
+
+  auto data = folly::IOBuf::copyBuffer("datagram");
+  auto bytesWritten = writeDatagramFrame(data->clone(), pktBuilder);
+  // type (1) + length (1) + data (8)
+  EXPECT_EQ(bytesWritten, 10);
+
+  auto builtOut = std::move(pktBuilder).buildPacket();
+  auto regularPacket = builtOut.first;
+  EXPECT_EQ(
+      boost::get<WriteDatagramFrame>(regularPacket.frames[0]),
+      WriteDatagramFrame(8));
+
+  auto wireBuf = std::move(builtOut.second);
+  folly::io::Cursor cursor(wireBuf.get());
+  auto wireDatagram = boost::get<ReadDatagramFrame>(parseQuicFrame(cursor));
+  EXPECT_TRUE(folly::IOBufEqualTo()(wireDatagram.data, data));
+  EXPECT_TRUE(cursor.isAtEnd());
+}
+
+TEST_F(QuicWriteCodecTest, NoSpaceForDatagram) {
+  MockQuicPacketBuilder pktBuilder;
+  pktBuilder.remaining_ = 9;
+  setupCommonExpects(pktBuilder);
+  // Datagrams are not split across packets.
+  EXPECT_EQ(
+      0, writeDatagramFrame(folly::IOBuf::copyBuffer("datagram"), pktBuilder));
+}
+
+TEST_F(QuicWriteCodecTest, WriteRepair) {
+  MockQuicPacketBuilder pktBuilder;
+  setupCommonExpects(pktBuilder);
+
+  RepairFrame repairFrame(
+      4,
+      {FecProtectedFrame(0, 3), FecProtectedFrame(3, 2)},
+      true,
+      folly::IOBuf::copyBuffer("abc"));
+  auto bytesWritten = writeRepairFrame(repairFrame, pktBuilder);
+  // type (2) + stream id (1) + fin (1) + count (1) + frames (4) + length (1)
+  // + data (3)
+  EXPECT_EQ(bytesWritten, 13);
+
+  auto builtOut = std::move(pktBuilder).buildPacket();
+  auto regularPacket = builtOut.first;
+  EXPECT_EQ(
+      boost::get<WriteRepairFrame>(regularPacket.frames[0]),
+      WriteRepairFrame(4, 2, 3));
+
+  auto wireBuf = std::move(builtOut.second);
+  folly::io::Cursor cursor(wireBuf.get());
+  auto wireRepair = boost::get<RepairFrame>(parseQuicFrame(cursor));
+  EXPECT_EQ(wireRepair, repairFrame);
+  EXPECT_TRUE(cursor.isAtEnd());
+}
+
+TEST_F(QuicWriteCodecTest, NoSpaceForRepair) {
+  MockQuicPacketBuilder pktBuilder;
+  pktBuilder.remaining_ = 12;
+  setupCommonExpects(pktBuilder);
+  RepairFrame repairFrame(
+      4,
+      {FecProtectedFrame(0, 3), FecProtectedFrame(3, 2)},
+      true,
+      folly::IOBuf::copyBuffer("abc"));
+  EXPECT_EQ(0, writeRepairFrame(repairFrame, pktBuilder));
+}
+
 TEST_F(QuicWriteCodecTest, WritePathResponse) {
   MockQuicPacketBuilder pktBuilder;
   setupCommonExpects(pktBuilder);
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/AllocationCounter.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// Trivial, so that reading them never allocates.
+thread_local uint64_t threadAllocations = 0;
+thread_local uint64_t threadAllocatedBytes = 0;
+
+#ifdef MVFST_COUNT_ALLOCATIONS
+inline void countAllocation(size_t size) {
+  threadAllocations++;
+  threadAllocatedBytes += size;
+}
+#endif
+} // namespace
+
+namespace quic {
+
+uint64_t getThreadAllocations() {
+  return threadAllocations;
+}
+
+uint64_t getThreadAllocatedBytes() {
+  return threadAllocatedBytes;
+}
+
+bool allocationCountingEnabled() {
+#ifdef MVFST_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+} // namespace quic
+
+#ifdef MVFST_COUNT_ALLOCATIONS
+
+// The replacements are in this file so that they are linked in with the
+// counters the transport reads.
+#ifdef __GLIBC__
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) __THROW {
+  countAllocation(size);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size) __THROW {
+  countAllocation(num * size);
+  return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size) __THROW {
+  countAllocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) __THROW {
+  countAllocation(size);
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr || size == 0 ? 0 : ENOMEM;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) __THROW {
+  countAllocation(size);
+  return __libc_memalign(alignment, size);
+}
+
+} // extern "C"
+
+#else
+
+void* operator new(size_t size) {
+  countAllocation(size);
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  countAllocation(size);
+  return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  std::free(ptr);
+}
+
+#endif
+
+#endif
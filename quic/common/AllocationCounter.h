@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace quic {
+
+/**
+ * Heap allocations the calling thread has made so far, and the bytes they
+ * asked for. They are only counted when mvfst is built with
+ * MVFST_COUNT_ALLOCATIONS, which replaces the malloc family with glibc and
+ * operator new elsewhere. Otherwise both stay 0.
+ */
+uint64_t getThreadAllocations();
+uint64_t getThreadAllocatedBytes();
+
+bool allocationCountingEnabled();
+
+} // namespace quic
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace quic {
+
+/**
+ * Keeps the memory of freed objects of one type, one cache per thread, and
+ * hands it out again to the next objects of that type the thread allocates.
+ * It is for large objects that are made and dropped at a high rate, like the
+ * transport and the state of every connection a server worker accepts.
+ *
+ * Each cache holds blocks of a single size, the first size freed on its
+ * thread, and up to kMaxCachedConnectionBlocks of them. Blocks of another
+ * size, and blocks freed once the cache is full, go straight back to the
+ * allocator. A block freed on another thread goes to that thread's cache.
+ * Tag tells the types apart.
+ */
+template <typename Tag>
+class BlockCache {
+ public:
+  static void* allocate(size_t size) {
+    auto blocks = threadBlocks();
+    if (blocks && blocks->size == size && !blocks->free.empty()) {
+      auto block = blocks->free.back();
+      blocks->free.pop_back();
+      return block;
+    }
+    return ::operator new(size);
+  }
+
+  static void deallocate(void* block, size_t size) noexcept {
+    auto blocks = threadBlocks();
+    if (blocks && blocks->size == 0) {
+      blocks->size = size;
+    }
+    if (blocks && blocks->size == size &&
+        blocks->free.size() < kMaxCachedConnectionBlocks) {
+      blocks->free.push_back(block);
+      return;
+    }
+    ::operator delete(block);
+  }
+
+  /**
+   * Number of free blocks cached by the calling thread.
+   */
+  static size_t numCachedBlocks() {
+    auto blocks = threadBlocks();
+    return blocks ? blocks->free.size() : 0;
+  }
+
+ private:
+  struct Blocks {
+    size_t size{0};
+    std::vector<void*> free;
+
+    // So that caching a block does not allocate.
+    Blocks() {
+      free.reserve(kMaxCachedConnectionBlocks);
+    }
+
+    ~Blocks() {
+      alive() = false;
+      for (auto block : free) {
+        ::operator delete(block);
+      }
+    }
+  };
+
+  // Whether the cache of the thread is still there, objects may be freed by
+  // the destructors of other thread locals after it.
+  static bool& alive() {
+    static thread_local bool threadAlive = true;
+    return threadAlive;
+  }
+
+  static Blocks* threadBlocks() {
+    if (!alive()) {
+      return nullptr;
+    }
+    static thread_local Blocks blocks;
+    return &blocks;
+  }
+};
+
+/**
+ * An allocator that takes its memory from BlockCache<Tag>, for
+ * std::allocate_shared.
+ */
+template <typename T, typename Tag>
+struct BlockCacheAllocator {
+  using value_type = T;
+
+  BlockCacheAllocator() = default;
+
+  template <typename U>
+  /* implicit */ BlockCacheAllocator(const BlockCacheAllocator<U, Tag>&) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(BlockCache<Tag>::allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n) noexcept {
+    BlockCache<Tag>::deallocate(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const BlockCacheAllocator<U, Tag>&) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(const BlockCacheAllocator<U, Tag>&) const {
+    return false;
+  }
+};
+
+} // namespace quic
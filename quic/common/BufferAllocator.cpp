@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/BufferAllocator.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace quic {
+
+constexpr size_t HugePageBufferAllocator::kSlabSize;
+constexpr std::array<size_t, 4> HugePageBufferAllocator::kSizeClasses;
+
+struct HugePageBufferAllocator::Slab {
+  void* mem{nullptr};
+  // Whether the slab is backed by reserved huge pages.
+  bool hugeTlb{false};
+};
+
+// The user data of the buffers of the size class.
+struct HugePageBufferAllocator::SizeClass {
+  Core* core{nullptr};
+  size_t bufSize{0};
+  // Guarded by the lock of the core.
+  std::vector<void*> freeList;
+};
+
+// Shared between the allocator and the buffers it handed out. Deleted by
+// whichever of them goes away last.
+struct HugePageBufferAllocator::Core {
+  explicit Core(uint64_t maxBytesIn) : maxBytes(maxBytesIn) {
+    for (size_t i = 0; i < kSizeClasses.size(); ++i) {
+      sizeClasses[i].core = this;
+      sizeClasses[i].bufSize = kSizeClasses[i];
+    }
+  }
+
+  const uint64_t maxBytes;
+  mutable std::mutex lock;
+  // All the fields below are guarded by lock.
+  std::array<SizeClass, kSizeClasses.size()> sizeClasses;
+  std::vector<Slab> slabs;
+  // Bytes of the slabs allocated or being allocated.
+  uint64_t slabBytes{0};
+  size_t outstanding{0};
+  bool allocatorAlive{true};
+};
+
+HugePageBufferAllocator::HugePageBufferAllocator(uint64_t maxBytes)
+    : core_(new Core(maxBytes)) {}
+
+HugePageBufferAllocator::~HugePageBufferAllocator() {
+  bool deleteCore = false;
+  {
+    std::lock_guard<std::mutex> guard(core_->lock);
+    core_->allocatorAlive = false;
+    deleteCore = core_->outstanding == 0;
+  }
+  if (deleteCore) {
+    for (const auto& slab : core_->slabs) {
+      freeSlab(slab);
+    }
+    delete core_;
+  }
+}
+
+HugePageBufferAllocator::Slab HugePageBufferAllocator::allocateSlab() {
+  Slab slab;
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+  void* mem = mmap(
+      nullptr,
+      kSlabSize,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+      -1,
+      0);
+  if (mem != MAP_FAILED) {
+    slab.mem = mem;
+    slab.hugeTlb = true;
+    return slab;
+  }
+#endif
+  // No reserved huge pages left. A transparent huge page needs a region
+  // aligned to its size, so map twice as much and trim both ends.
+  constexpr size_t kMapSize = 2 * kSlabSize;
+  void* raw = mmap(
+      nullptr,
+      kMapSize,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (raw == MAP_FAILED) {
+    return slab;
+  }
+  auto begin = reinterpret_cast<uintptr_t>(raw);
+  auto aligned = (begin + kSlabSize - 1) & ~(uintptr_t(kSlabSize) - 1);
+  if (aligned > begin) {
+    munmap(raw, aligned - begin);
+  }
+  auto end = begin + kMapSize;
+  if (end > aligned + kSlabSize) {
+    munmap(
+        reinterpret_cast<void*>(aligned + kSlabSize),
+        end - aligned - kSlabSize);
+  }
+  slab.mem = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+  madvise(slab.mem, kSlabSize, MADV_HUGEPAGE);
+#endif
+#else
+  slab.mem = malloc(kSlabSize);
+#endif
+  return slab;
+}
+
+void HugePageBufferAllocator::freeSlab(const Slab& slab) {
+#ifdef __linux__
+  munmap(slab.mem, kSlabSize);
+#else
+  free(slab.mem);
+#endif
+}
+
+std::unique_ptr<folly::IOBuf> HugePageBufferAllocator::getBuffer(
+    size_t size) {
+  SizeClass* sizeClass = nullptr;
+  for (auto& candidate : core_->sizeClasses) {
+    if (candidate.bufSize >= size) {
+      sizeClass = &candidate;
+      break;
+    }
+  }
+  if (!sizeClass) {
+    return folly::IOBuf::create(size);
+  }
+  void* buf = nullptr;
+  bool newSlab = false;
+  {
+    std::lock_guard<std::mutex> guard(core_->lock);
+    if (!sizeClass->freeList.empty()) {
+      buf = sizeClass->freeList.back();
+      sizeClass->freeList.pop_back();
+      core_->outstanding++;
+    } else if (core_->slabBytes + kSlabSize <= core_->maxBytes) {
+      core_->slabBytes += kSlabSize;
+      newSlab = true;
+    }
+  }
+  if (newSlab) {
+    // Mapped without the lock, so that buffers can be released meanwhile.
+    auto slab = allocateSlab();
+    std::lock_guard<std::mutex> guard(core_->lock);
+    if (!slab.mem) {
+      core_->slabBytes -= kSlabSize;
+    } else {
+      core_->slabs.push_back(slab);
+      auto data = static_cast<uint8_t*>(slab.mem);
+      size_t numBufs = kSlabSize / sizeClass->bufSize;
+      sizeClass->freeList.reserve(sizeClass->freeList.size() + numBufs);
+      // Backwards, so that the buffers are handed out in address order.
+      for (size_t i = numBufs; i > 0; --i) {
+        sizeClass->freeList.push_back(data + (i - 1) * sizeClass->bufSize);
+      }
+      buf = sizeClass->freeList.back();
+      sizeClass->freeList.pop_back();
+      core_->outstanding++;
+    }
+  }
+  if (!buf) {
+    return folly::IOBuf::create(size);
+  }
+  return folly::IOBuf::takeOwnership(
+      buf,
+      sizeClass->bufSize,
+      0,
+      &HugePageBufferAllocator::releaseBuffer,
+      sizeClass);
+}
+
+size_t HugePageBufferAllocator::numSlabs() const {
+  std::lock_guard<std::mutex> guard(core_->lock);
+  return core_->slabs.size();
+}
+
+size_t HugePageBufferAllocator::numHugeTlbSlabs() const {
+  std::lock_guard<std::mutex> guard(core_->lock);
+  size_t num = 0;
+  for (const auto& slab : core_->slabs) {
+    num += slab.hugeTlb ? 1 : 0;
+  }
+  return num;
+}
+
+size_t HugePageBufferAllocator::numCachedBuffers(size_t size) const {
+  std::lock_guard<std::mutex> guard(core_->lock);
+  for (const auto& sizeClass : core_->sizeClasses) {
+    if (sizeClass.bufSize >= size) {
+      return sizeClass.freeList.size();
+    }
+  }
+  return 0;
+}
+
+void HugePageBufferAllocator::releaseBuffer(void* buf, void* userData) {
+  auto sizeClass = static_cast<SizeClass*>(userData);
+  auto core = sizeClass->core;
+  bool deleteCore = false;
+  {
+    std::lock_guard<std::mutex> guard(core->lock);
+    core->outstanding--;
+    sizeClass->freeList.push_back(buf);
+    deleteCore = !core->allocatorAlive && core->outstanding == 0;
+  }
+  if (deleteCore) {
+    for (const auto& slab : core->slabs) {
+      freeSlab(slab);
+    }
+    delete core;
+  }
+}
+
+} // namespace quic
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+#include <array>
+
+namespace quic {
+
+/**
+ * Where the packet buffers of a server worker and its connections come from.
+ * Buffers may be released on any thread, and may outlive their allocator.
+ */
+class BufferAllocator {
+ public:
+  virtual ~BufferAllocator() = default;
+
+  /**
+   * Returns an empty IOBuf with at least size bytes of tailroom.
+   */
+  virtual std::unique_ptr<folly::IOBuf> getBuffer(size_t size) = 0;
+};
+
+/**
+ * Carves buffers of a few size classes, suited to QUIC packets, out of 2MB
+ * slabs backed by huge pages, so that the packets of a worker are spread
+ * over few TLB entries and do not go through the global allocator. Released
+ * buffers go back to the free list of their size class. Slabs are only
+ * freed with the allocator, once all their buffers were released.
+ *
+ * Slabs are taken from the reserved huge pages of the system if there are
+ * any left, otherwise they are aligned regular pages the kernel is asked to
+ * back with transparent huge pages. Buffers larger than the largest size
+ * class, and buffers that would take the slabs over maxBytes, come from
+ * folly::IOBuf::create instead.
+ */
+class HugePageBufferAllocator : public BufferAllocator {
+ public:
+  static constexpr size_t kSlabSize = 2 * 1024 * 1024;
+  // A full size packet on most paths, an Ethernet MTU, a jumbo frame and a
+  // GSO or GRO batch.
+  static constexpr std::array<size_t, 4> kSizeClasses = {
+      {1280, 1536, 9216, 64 * 1024}};
+
+  /**
+   * At most maxBytes of slabs are allocated.
+   */
+  explicit HugePageBufferAllocator(uint64_t maxBytes);
+
+  ~HugePageBufferAllocator() override;
+
+  HugePageBufferAllocator(const HugePageBufferAllocator&) = delete;
+  HugePageBufferAllocator& operator=(const HugePageBufferAllocator&) = delete;
+
+  std::unique_ptr<folly::IOBuf> getBuffer(size_t size) override;
+
+  /**
+   * Number of slabs currently allocated, and how many of them are backed by
+   * reserved huge pages.
+   */
+  size_t numSlabs() const;
+  size_t numHugeTlbSlabs() const;
+
+  /**
+   * Number of released buffers in the free list of the size class of size.
+   */
+  size_t numCachedBuffers(size_t size) const;
+
+ private:
+  struct Core;
+  struct SizeClass;
+  struct Slab;
+
+  static void releaseBuffer(void* buf, void* userData);
+
+  static Slab allocateSlab();
+  static void freeSlab(const Slab& slab);
+
+  Core* core_;
+};
+
+} // namespace quic
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/BufferPool.h>
+
+#include <mutex>
+#include <vector>
+
+namespace quic {
+
+// Shared between the pool and the buffers it handed out. Deleted by whichever
+// of them goes away last.
+struct BufferPool::Core {
+  Core(size_t bufSizeIn, size_t maxCachedIn)
+      : bufSize(bufSizeIn), maxCached(maxCachedIn) {
+    freeList.reserve(maxCached);
+  }
+
+  const size_t bufSize;
+  const size_t maxCached;
+  mutable std::mutex lock;
+  // All the fields below are guarded by lock.
+  std::vector<void*> freeList;
+  size_t outstanding{0};
+  bool poolAlive{true};
+};
+
+BufferPool::BufferPool(size_t bufSize, size_t maxCached)
+    : core_(new Core(bufSize, maxCached)) {}
+
+BufferPool::~BufferPool() {
+  bool deleteCore = false;
+  {
+    std::lock_guard<std::mutex> guard(core_->lock);
+    core_->poolAlive = false;
+    for (auto buf : core_->freeList) {
+      free(buf);
+    }
+    core_->freeList.clear();
+    deleteCore = core_->outstanding == 0;
+  }
+  if (deleteCore) {
+    delete core_;
+  }
+}
+
+std::unique_ptr<folly::IOBuf> BufferPool::getBuffer() {
+  void* buf = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(core_->lock);
+    if (!core_->freeList.empty()) {
+      buf = core_->freeList.back();
+      core_->freeList.pop_back();
+    }
+    core_->outstanding++;
+  }
+  if (!buf) {
+    buf = malloc(core_->bufSize);
+    if (!buf) {
+      {
+        std::lock_guard<std::mutex> guard(core_->lock);
+        core_->outstanding--;
+      }
+      throw std::bad_alloc();
+    }
+  }
+  return folly::IOBuf::takeOwnership(
+      buf, core_->bufSize, 0, &BufferPool::releaseBuffer, core_);
+}
+
+size_t BufferPool::getBufferSize() const {
+  return core_->bufSize;
+}
+
+size_t BufferPool::numCachedBuffers() const {
+  std::lock_guard<std::mutex> guard(core_->lock);
+  return core_->freeList.size();
+}
+
+void BufferPool::releaseBuffer(void* buf, void* userData) {
+  auto core = static_cast<Core*>(userData);
+  bool deleteCore = false;
+  {
+    std::lock_guard<std::mutex> guard(core->lock);
+    core->outstanding--;
+    if (core->poolAlive && core->freeList.size() < core->maxCached) {
+      core->freeList.push_back(buf);
+      buf = nullptr;
+    }
+    deleteCore = !core->poolAlive && core->outstanding == 0;
+  }
+  if (buf) {
+    free(buf);
+  }
+  if (deleteCore) {
+    delete core;
+  }
+}
+
+} // namespace quic
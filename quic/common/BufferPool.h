@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+namespace quic {
+
+/**
+ * A pool of fixed size buffers. Buffers are handed out as IOBufs which give
+ * their memory back to the pool instead of freeing it once the last reference
+ * to them is dropped. Buffers may be released on any thread, and the pool may
+ * be destroyed while some of its buffers are still in use, in which case their
+ * memory is freed when they are released.
+ */
+class BufferPool {
+ public:
+  /**
+   * bufSize is the capacity of every buffer. At most maxCached released
+   * buffers are kept around for reuse, the rest are freed.
+   */
+  BufferPool(size_t bufSize, size_t maxCached);
+
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  /**
+   * Returns an empty IOBuf with bufSize bytes of tailroom.
+   */
+  std::unique_ptr<folly::IOBuf> getBuffer();
+
+  size_t getBufferSize() const;
+
+  /**
+   * Number of released buffers currently cached by the pool.
+   */
+  size_t numCachedBuffers() const;
+
+ private:
+  struct Core;
+
+  static void releaseBuffer(void* buf, void* userData);
+
+  Core* core_;
+};
+
+} // namespace quic
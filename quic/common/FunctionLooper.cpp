@@ -23,6 +23,12 @@ void FunctionLooper::setPacingTimer(
   pacingTimer_ = std::move(pacingTimer);
 }
 
+void FunctionLooper::setPacingScheduler(
+    PacingScheduler::SharedPtr pacingScheduler) noexcept {
+  cancelPacingTimeout();
+  pacingScheduler_ = std::move(pacingScheduler);
+}
+
 void FunctionLooper::setPacingFunction(
     folly::Function<std::chrono::microseconds()>&& pacingFunc) {
   pacingFunc_ = std::move(pacingFunc);
@@ -48,16 +54,33 @@ void FunctionLooper::commonLoopBody(bool fromTimer) noexcept {
 }
 
 bool FunctionLooper::schedulePacingTimeout(bool /* fromTimer */) noexcept {
-  if (pacingFunc_ && pacingTimer_ && !isScheduled()) {
+  if (pacingFunc_ && isPacing() && !isPacingTimeoutScheduled()) {
     auto nextPacingTime = (*pacingFunc_)();
     if (nextPacingTime != 0us) {
-      pacingTimer_->scheduleTimeout(this, nextPacingTime);
+      if (pacingScheduler_) {
+        pacingScheduler_->scheduleTimeout(this, nextPacingTime);
+      } else {
+        pacingTimer_->scheduleTimeout(this, nextPacingTime);
+      }
       return true;
     }
   }
   return false;
 }
 
+bool FunctionLooper::isPacing() const noexcept {
+  return pacingTimer_ || pacingScheduler_;
+}
+
+bool FunctionLooper::isPacingTimeoutScheduled() const noexcept {
+  return isScheduled() || isPacingScheduled();
+}
+
+void FunctionLooper::cancelPacingTimeouts() noexcept {
+  cancelTimeout();
+  cancelPacingTimeout();
+}
+
 void FunctionLooper::runLoopCallback() noexcept {
   folly::DelayedDestruction::DestructorGuard dg(this);
   commonLoopBody(false);
@@ -68,12 +91,12 @@ void FunctionLooper::run(bool thisIteration) noexcept {
   running_ = true;
   // Caller can call run() in func_. But if we are in pacing mode, we should
   // prevent such loop.
-  if (pacingTimer_ && inLoopBody_) {
+  if (isPacing() && inLoopBody_) {
     VLOG(4) << __func__ << ": " << type_
             << " in loop body and using pacing - not rescheduling";
     return;
   }
-  if (isLoopCallbackScheduled() || isScheduled()) {
+  if (isLoopCallbackScheduled() || isPacingTimeoutScheduled()) {
     VLOG(10) << __func__ << ": " << type_ << " already scheduled";
     return;
   }
@@ -84,7 +107,7 @@ void FunctionLooper::stop() noexcept {
   VLOG(10) << __func__ << ": " << type_;
   running_ = false;
   cancelLoopCallback();
-  cancelTimeout();
+  cancelPacingTimeouts();
 }
 
 bool FunctionLooper::isRunning() const {
@@ -102,7 +125,7 @@ void FunctionLooper::detachEventBase() {
   VLOG(10) << __func__ << ": " << type_;
   DCHECK(evb_ && evb_->isInEventBaseThread());
   stop();
-  cancelTimeout();
+  cancelPacingTimeouts();
   evb_ = nullptr;
 }
 
@@ -115,8 +138,16 @@ void FunctionLooper::callbackCanceled() noexcept {
   return;
 }
 
+void FunctionLooper::pacingTimeoutExpired() noexcept {
+  folly::DelayedDestruction::DestructorGuard dg(this);
+  commonLoopBody(true);
+}
+
 folly::Optional<std::chrono::microseconds>
 FunctionLooper::getTimerTickInterval() noexcept {
+  if (pacingScheduler_) {
+    return pacingScheduler_->getTickInterval();
+  }
   if (pacingTimer_) {
     return pacingTimer_->getTickInterval();
   }
@@ -11,6 +11,7 @@
 
 #include <folly/Function.h>
 #include <folly/io/async/EventBase.h>
+#include <quic/common/PacingScheduler.h>
 #include <quic/common/Timers.h>
 
 namespace quic {
@@ -29,7 +30,8 @@ std::ostream& operator<<(std::ostream& /* out */, const LooperType& /*rhs*/);
  */
 class FunctionLooper : public folly::EventBase::LoopCallback,
                        public folly::DelayedDestruction,
-                       public TimerHighRes::Callback {
+                       public TimerHighRes::Callback,
+                       public PacingScheduler::Callback {
  public:
   using Ptr =
       std::unique_ptr<FunctionLooper, folly::DelayedDestruction::Destructor>;
@@ -41,6 +43,12 @@ class FunctionLooper : public folly::EventBase::LoopCallback,
 
   void setPacingTimer(TimerHighRes::SharedPtr pacingTimer) noexcept;
 
+  /**
+   * Paces through the worker's scheduler instead of a timeout of its own on
+   * the pacing timer, when set.
+   */
+  void setPacingScheduler(PacingScheduler::SharedPtr pacingScheduler) noexcept;
+
   void runLoopCallback() noexcept override;
 
   /**
@@ -79,17 +87,23 @@ class FunctionLooper : public folly::EventBase::LoopCallback,
 
   void callbackCanceled() noexcept override;
 
+  void pacingTimeoutExpired() noexcept override;
+
   folly::Optional<std::chrono::microseconds> getTimerTickInterval() noexcept;
 
  private:
   ~FunctionLooper() override = default;
   void commonLoopBody(bool fromTimer) noexcept;
   bool schedulePacingTimeout(bool fromTimer) noexcept;
+  bool isPacing() const noexcept;
+  bool isPacingTimeoutScheduled() const noexcept;
+  void cancelPacingTimeouts() noexcept;
 
   folly::EventBase* evb_;
   folly::Function<void(bool)> func_;
   folly::Optional<folly::Function<std::chrono::microseconds()>> pacingFunc_;
   TimerHighRes::SharedPtr pacingTimer_;
+  PacingScheduler::SharedPtr pacingScheduler_;
   bool running_{false};
   bool inLoopBody_{false};
   const LooperType type_;
@@ -32,10 +32,12 @@ void IntervalSet<T, Unit, Container>::insert(
   auto endIt = intersectionRange.second;
   if (firstIt == endIt) {
     insertVersion_++;
+    prefixVersion_++;
     container_type::insert(firstIt, std::move(interval));
     return;
   }
   // Merge from first to last
+  auto originalStart = firstIt->start;
   auto originalDifference = firstIt->end - firstIt->start;
   auto last = std::prev(endIt);
   firstIt->start = std::min(interval.start, firstIt->start);
@@ -43,6 +45,10 @@ void IntervalSet<T, Unit, Container>::insert(
   auto newDifference = firstIt->end - firstIt->start;
   if (newDifference > originalDifference) {
     insertVersion_++;
+    if (firstIt != last || endIt != container_type::end() ||
+        firstIt->start != originalStart) {
+      prefixVersion_++;
+    }
   }
   container_type::erase(std::next(firstIt), endIt);
 }
@@ -60,6 +66,7 @@ void IntervalSet<T, Unit, Container>::withdraw(
     // No intersection, doesn't need to do anything
     return;
   }
+  prefixVersion_++;
   auto erasureStart = first;
   auto erasureEnd = end;
   auto last = std::prev(end);
@@ -135,4 +142,12 @@ template <
 uint64_t IntervalSet<T, Unit, Container>::insertVersion() const {
   return insertVersion_;
 }
+
+template <
+    typename T,
+    T Unit,
+    template <typename I, typename = std::allocator<I>> class Container>
+uint64_t IntervalSet<T, Unit, Container>::prefixVersion() const {
+  return prefixVersion_;
+}
 } // namespace quic
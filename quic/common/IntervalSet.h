@@ -15,11 +15,21 @@
 #include <stdexcept>
 
 #include <folly/Likely.h>
+#include <folly/small_vector.h>
 
 namespace quic {
 
 constexpr uint64_t kDefaultIntervalSetVersion = 0;
 
+// Number of intervals an IntervalSet holds without allocating. Ack state
+// rarely has more than a few ranges of received packets at a time.
+constexpr size_t kIntervalSetInlineCapacity = 4;
+
+// The default container of IntervalSet. It matches the container signature
+// IntervalSet expects, the allocator argument is ignored.
+template <typename I, typename = std::allocator<I>>
+using InlineIntervalVector = folly::small_vector<I, kIntervalSetInlineCapacity>;
+
 template <typename T, T Unit = (T)1>
 struct Interval {
   T start;
@@ -53,7 +63,7 @@ template <
     typename T,
     T Unit = (T)1,
     template <typename I, typename = std::allocator<I>> class Container =
-        std::deque>
+        InlineIntervalVector>
 class IntervalSet : private Container<Interval<T, Unit>> {
  public:
   using interval_type = Interval<T, Unit>;
@@ -82,18 +92,40 @@ class IntervalSet : private Container<Interval<T, Unit>> {
    */
   uint64_t insertVersion() const;
 
+  /**
+   * The version changes whenever the intervals change, except when the last
+   * interval only grows towards larger values, which is what adding packet
+   * numbers in order does. Anything derived from all the intervals but the
+   * end of the last one stays valid while this version does not change.
+   */
+  uint64_t prefixVersion() const;
+
   using container_type::back;
   using container_type::cbegin;
   using container_type::cend;
-  using container_type::clear;
   using container_type::crbegin;
   using container_type::crend;
   using container_type::empty;
   using container_type::front;
-  using container_type::pop_back;
-  using container_type::pop_front;
   using container_type::size;
 
+  void clear() {
+    prefixVersion_++;
+    container_type::clear();
+  }
+
+  void pop_back() {
+    prefixVersion_++;
+    container_type::pop_back();
+  }
+
+  // Not a using-declaration so that containers without pop_front, like
+  // std::vector, can be used as well.
+  void pop_front() {
+    prefixVersion_++;
+    container_type::erase(container_type::begin());
+  }
+
  private:
   /**
    * Helper function to find the intersecting range in this interval set
@@ -105,6 +137,7 @@ class IntervalSet : private Container<Interval<T, Unit>> {
   auto intersectingRange(const interval_type& interval) -> decltype(auto);
 
   uint64_t insertVersion_{kDefaultIntervalSetVersion};
+  uint64_t prefixVersion_{kDefaultIntervalSetVersion};
 };
 } // namespace quic
 #include <quic/common/IntervalSet-inl.h>
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/LoopHealthMonitor.h>
+
+#include <glog/logging.h>
+
+namespace quic {
+
+LoopHealthMonitor::LoopHealthMonitor(
+    Thresholds thresholds,
+    AlertCallback alertCallback)
+    : thresholds_(thresholds), alertCallback_(std::move(alertCallback)) {}
+
+void LoopHealthMonitor::onSample(
+    Metric metric,
+    std::chrono::microseconds value) {
+  auto index = static_cast<size_t>(metric);
+  DCHECK_LT(index, histograms_.size());
+  // Clocks of different threads can make a wait look negative.
+  if (value.count() < 0) {
+    value = std::chrono::microseconds::zero();
+  }
+  histograms_[index].add(value.count());
+  auto threshold = thresholdOf(metric);
+  if (threshold.count() > 0 && value > threshold) {
+    numAlerts_[index]++;
+    VLOG(4) << "Loop health alert metric=" << toString(metric)
+            << " value=" << value.count() << "us";
+    if (alertCallback_) {
+      alertCallback_(metric, value);
+    }
+  }
+}
+
+const TransportStatsHistogram& LoopHealthMonitor::getHistogram(
+    Metric metric) const {
+  return histograms_[static_cast<size_t>(metric)];
+}
+
+uint64_t LoopHealthMonitor::getNumAlerts(Metric metric) const {
+  return numAlerts_[static_cast<size_t>(metric)];
+}
+
+std::chrono::microseconds LoopHealthMonitor::thresholdOf(Metric metric) const {
+  switch (metric) {
+    case Metric::LoopBusyTime:
+      return thresholds_.loopBusyTime;
+    case Metric::ReadDelay:
+      return thresholds_.readDelay;
+    case Metric::WriteDelay:
+      return thresholds_.writeDelay;
+    case Metric::MAX:
+      break;
+  }
+  return std::chrono::microseconds::zero();
+}
+
+const char* LoopHealthMonitor::toString(Metric metric) {
+  switch (metric) {
+    case Metric::LoopBusyTime:
+      return "LOOP_BUSY_TIME";
+    case Metric::ReadDelay:
+      return "READ_DELAY";
+    case Metric::WriteDelay:
+      return "WRITE_DELAY";
+    case Metric::MAX:
+      return "MAX";
+  }
+  return "UNKNOWN";
+}
+
+} // namespace quic
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <quic/common/TransportStatsHistogram.h>
+
+#include <array>
+#include <chrono>
+#include <memory>
+
+namespace quic {
+
+/**
+ * Health of the event loop of a worker, as seen by its connections: how long
+ * the loop iterations are busy, how long received packets wait before a
+ * connection processes them, and how long a connection that is ready to
+ * write waits for its write to run. The waits are the queueing inside the
+ * worker, which the peers see as added latency.
+ *
+ * Each sample goes to a histogram of its metric. A sample above the
+ * threshold of its metric is also passed to the alert callback. The monitor
+ * is only used from the thread of its event base.
+ */
+class LoopHealthMonitor {
+ public:
+  using SharedPtr = std::shared_ptr<LoopHealthMonitor>;
+
+  enum class Metric : uint8_t {
+    LoopBusyTime,
+    ReadDelay,
+    WriteDelay,
+    // NOTE: MAX should always be at the end
+    MAX
+  };
+
+  // 0 disables the alerts of a metric.
+  struct Thresholds {
+    std::chrono::microseconds loopBusyTime{0};
+    std::chrono::microseconds readDelay{0};
+    std::chrono::microseconds writeDelay{0};
+  };
+
+  using AlertCallback =
+      folly::Function<void(Metric metric, std::chrono::microseconds value)>;
+
+  explicit LoopHealthMonitor(
+      Thresholds thresholds,
+      AlertCallback alertCallback = nullptr);
+
+  void onSample(Metric metric, std::chrono::microseconds value);
+
+  const TransportStatsHistogram& getHistogram(Metric metric) const;
+
+  // Samples that were above the threshold of the metric
+  uint64_t getNumAlerts(Metric metric) const;
+
+  static const char* toString(Metric metric);
+
+ private:
+  std::chrono::microseconds thresholdOf(Metric metric) const;
+
+  Thresholds thresholds_;
+  AlertCallback alertCallback_;
+  std::array<TransportStatsHistogram, static_cast<size_t>(Metric::MAX)>
+      histograms_;
+  std::array<uint64_t, static_cast<size_t>(Metric::MAX)> numAlerts_{};
+};
+
+} // namespace quic
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+
+namespace quic {
+
+/**
+ * The time of the read or write being processed on this thread. Reading a
+ * batch of packets or writing a connection looks up the clock once, and the
+ * code that only needs a coarse time, such as flow control updates, stream
+ * expiry or idle deadlines, shares it through LoopTime::now() instead of
+ * calling Clock::now() again. That also makes those times the same for all
+ * the packets of a batch.
+ *
+ * Sent and receive times, RTT samples and pacing keep using Clock::now().
+ */
+class LoopTime {
+ public:
+  /**
+   * The time of the current read or write, or Clock::now() outside of one.
+   */
+  static TimePoint now() {
+    auto time = current();
+    return time != TimePoint() ? time : Clock::now();
+  }
+
+ private:
+  friend class ScopedLoopTime;
+
+  static TimePoint& current() {
+    static thread_local TimePoint time;
+    return time;
+  }
+};
+
+/**
+ * Sets the time returned by LoopTime::now() for its lifetime. Nested scopes
+ * keep the time of the outermost one, so that the connections of a batch
+ * share the time it was read at.
+ */
+class ScopedLoopTime {
+ public:
+  explicit ScopedLoopTime(TimePoint time = TimePoint())
+      : outermost_(LoopTime::current() == TimePoint()) {
+    if (outermost_) {
+      LoopTime::current() = time != TimePoint() ? time : Clock::now();
+    }
+  }
+
+  ~ScopedLoopTime() {
+    if (outermost_) {
+      LoopTime::current() = TimePoint();
+    }
+  }
+
+  ScopedLoopTime(const ScopedLoopTime&) = delete;
+  ScopedLoopTime& operator=(const ScopedLoopTime&) = delete;
+
+ private:
+  bool outermost_;
+};
+
+} // namespace quic
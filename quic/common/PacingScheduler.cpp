@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/PacingScheduler.h>
+
+#include <glog/logging.h>
+
+namespace quic {
+
+PacingScheduler::Callback::~Callback() {
+  cancelPacingTimeout();
+}
+
+bool PacingScheduler::Callback::isPacingScheduled() const noexcept {
+  return scheduler_ != nullptr;
+}
+
+void PacingScheduler::Callback::cancelPacingTimeout() noexcept {
+  if (scheduler_) {
+    scheduler_->cancel(this);
+  }
+}
+
+PacingScheduler::PacingScheduler(
+    TimerHighRes::SharedPtr timer,
+    size_t numSlots)
+    : timer_(std::move(timer)),
+      tickInterval_(timer_->getTickInterval()),
+      slots_(numSlots),
+      start_(Clock::now()) {
+  CHECK_GE(numSlots, 2);
+  CHECK_GT(tickInterval_.count(), 0);
+}
+
+PacingScheduler::~PacingScheduler() {
+  for (auto& slot : slots_) {
+    for (auto callback : slot) {
+      callback->scheduler_ = nullptr;
+    }
+  }
+  cancelTimeout();
+}
+
+void PacingScheduler::scheduleTimeout(
+    Callback* callback,
+    std::chrono::microseconds timeout) {
+  callback->cancelPacingTimeout();
+  auto now = Clock::now();
+  if (numScheduled_ == 0) {
+    currentTick_ = std::max(currentTick_, tickOf(now));
+  }
+  auto dueTime =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - start_) +
+      timeout;
+  uint64_t dueTick =
+      (dueTime.count() + tickInterval_.count() - 1) / tickInterval_.count();
+  dueTick = std::min(
+      std::max(dueTick, currentTick_ + 1), currentTick_ + slots_.size() - 1);
+  auto& slot = slots_[dueTick % slots_.size()];
+  callback->scheduler_ = this;
+  callback->slot_ = dueTick % slots_.size();
+  callback->index_ = slot.size();
+  slot.push_back(callback);
+  ++numScheduled_;
+  if (!draining_ && (!wakeupTick_ || dueTick < *wakeupTick_)) {
+    scheduleWakeup(dueTick);
+  }
+}
+
+std::chrono::microseconds PacingScheduler::getTickInterval() const {
+  return tickInterval_;
+}
+
+void PacingScheduler::setDrainCallback(folly::Function<void()> drainCallback) {
+  drainCallback_ = std::move(drainCallback);
+}
+
+size_t PacingScheduler::numScheduled() const {
+  return numScheduled_;
+}
+
+void PacingScheduler::timeoutExpired() noexcept {
+  wakeupTick_.clear();
+  auto nowTick = tickOf(Clock::now());
+  bool ranCallbacks = false;
+  draining_ = true;
+  while (numScheduled_ > 0 && currentTick_ <= nowTick) {
+    auto& slot = slots_[currentTick_ % slots_.size()];
+    // The callbacks may cancel or reschedule each other, so they are taken
+    // off the slot one at a time.
+    while (!slot.empty()) {
+      auto callback = slot.back();
+      slot.pop_back();
+      callback->scheduler_ = nullptr;
+      --numScheduled_;
+      ranCallbacks = true;
+      callback->pacingTimeoutExpired();
+    }
+    ++currentTick_;
+  }
+  draining_ = false;
+  if (ranCallbacks && drainCallback_) {
+    drainCallback_();
+  }
+  scheduleNextWakeup();
+}
+
+void PacingScheduler::cancel(Callback* callback) noexcept {
+  DCHECK_EQ(this, callback->scheduler_);
+  auto& slot = slots_[callback->slot_];
+  DCHECK_EQ(callback, slot[callback->index_]);
+  auto last = slot.back();
+  slot[callback->index_] = last;
+  last->index_ = callback->index_;
+  slot.pop_back();
+  callback->scheduler_ = nullptr;
+  --numScheduled_;
+  if (numScheduled_ == 0 && !draining_) {
+    wakeupTick_.clear();
+    cancelTimeout();
+  }
+}
+
+uint64_t PacingScheduler::tickOf(TimePoint time) const {
+  if (time <= start_) {
+    return 0;
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(time - start_) /
+      tickInterval_;
+}
+
+void PacingScheduler::scheduleWakeup(uint64_t tick) {
+  wakeupTick_ = tick;
+  auto wakeupTime = start_ + tick * tickInterval_;
+  auto now = Clock::now();
+  auto delay = std::chrono::microseconds::zero();
+  if (wakeupTime > now) {
+    delay =
+        std::chrono::duration_cast<std::chrono::microseconds>(wakeupTime - now);
+    if (now + delay < wakeupTime) {
+      ++delay;
+    }
+  }
+  if (isScheduled()) {
+    cancelTimeout();
+  }
+  timer_->scheduleTimeout(this, delay);
+}
+
+void PacingScheduler::scheduleNextWakeup() {
+  if (numScheduled_ == 0) {
+    return;
+  }
+  auto tick = currentTick_;
+  while (slots_[tick % slots_.size()].empty()) {
+    ++tick;
+  }
+  scheduleWakeup(tick);
+}
+
+} // namespace quic
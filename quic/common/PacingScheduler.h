@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <quic/QuicConstants.h>
+#include <quic/common/Timers.h>
+
+#include <memory>
+#include <vector>
+
+namespace quic {
+
+/**
+ * Pacing wakeups shared by all the connections of a worker. The connections
+ * are kept in a calendar queue with one slot per timer tick, ordered by the
+ * time of their next paced write, and a single timeout on the worker's timer
+ * is scheduled for the next slot that is not empty. Each wakeup drains every
+ * slot that is due, then calls the drain callback once, so that the packets
+ * of all those connections can leave together through the egress batcher.
+ *
+ * Timeouts further away than the number of slots are clamped to the last
+ * slot, pacing intervals are far shorter than that.
+ */
+class PacingScheduler : public TimerHighRes::Callback {
+ public:
+  using SharedPtr = std::shared_ptr<PacingScheduler>;
+
+  class Callback {
+   public:
+    virtual ~Callback();
+
+    virtual void pacingTimeoutExpired() noexcept = 0;
+
+    bool isPacingScheduled() const noexcept;
+
+    void cancelPacingTimeout() noexcept;
+
+   private:
+    friend class PacingScheduler;
+
+    PacingScheduler* scheduler_{nullptr};
+    // Calendar slot of the callback and its position in it
+    size_t slot_{0};
+    size_t index_{0};
+  };
+
+  explicit PacingScheduler(
+      TimerHighRes::SharedPtr timer,
+      size_t numSlots = kDefaultPacingSchedulerSlots);
+
+  ~PacingScheduler() override;
+
+  /**
+   * Schedules the callback to run after the timeout, rounded up to a tick.
+   * A callback that is already scheduled is moved.
+   */
+  void scheduleTimeout(Callback* callback, std::chrono::microseconds timeout);
+
+  std::chrono::microseconds getTickInterval() const;
+
+  // Called after each wakeup that ran callbacks.
+  void setDrainCallback(folly::Function<void()> drainCallback);
+
+  size_t numScheduled() const;
+
+  // TimerHighRes::Callback
+  void timeoutExpired() noexcept override;
+
+  void callbackCanceled() noexcept override {}
+
+ private:
+  void cancel(Callback* callback) noexcept;
+  uint64_t tickOf(TimePoint time) const;
+  void scheduleWakeup(uint64_t tick);
+  void scheduleNextWakeup();
+
+  TimerHighRes::SharedPtr timer_;
+  std::chrono::microseconds tickInterval_;
+  std::vector<std::vector<Callback*>> slots_;
+  // Time of tick 0
+  TimePoint start_;
+  // The next tick to drain. Every scheduled callback is due in one of the
+  // slots_.size() ticks from there.
+  uint64_t currentTick_{0};
+  folly::Optional<uint64_t> wakeupTick_;
+  size_t numScheduled_{0};
+  // Wakeups are only scheduled once the due callbacks have all run.
+  bool draining_{false};
+  folly::Function<void()> drainCallback_;
+};
+
+} // namespace quic
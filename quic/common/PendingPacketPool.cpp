@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/PendingPacketPool.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+
+namespace quic {
+
+// Shared between the pool and the slabs it allocated. Deleted by whichever of
+// them goes away last.
+struct PendingPacketPool::Core {
+  Core(size_t slabSizeIn, uint64_t maxBytesIn)
+      : slabSize(slabSizeIn), maxBytes(maxBytesIn) {}
+
+  const size_t slabSize;
+  const uint64_t maxBytes;
+  mutable std::mutex lock;
+  // All the fields below are guarded by lock.
+  uint64_t bufferedBytes{0};
+  size_t numSlabs{0};
+  bool poolAlive{true};
+};
+
+// The packets of a slab follow it in the same allocation, each of them
+// preceded by its PacketHeader.
+struct PendingPacketPool::Slab {
+  Slab(Core* coreIn, size_t capacityIn) : core(coreIn), capacity(capacityIn) {}
+
+  uint8_t* data() {
+    return reinterpret_cast<uint8_t*>(this + 1);
+  }
+
+  Core* const core;
+  const size_t capacity;
+  // Only touched by the pool.
+  size_t used{0};
+  // One for every packet held, plus one while the pool packs packets into
+  // the slab. Guarded by the lock of the core.
+  size_t refs{1};
+};
+
+struct PendingPacketPool::PacketHeader {
+  Slab* slab;
+  size_t length;
+};
+
+namespace {
+size_t alignedSize(size_t size) {
+  constexpr size_t kAlign = alignof(std::max_align_t);
+  return (size + kAlign - 1) / kAlign * kAlign;
+}
+} // namespace
+
+PendingPacketPool::PendingPacketPool(size_t slabSize, uint64_t maxBytes)
+    : core_(new Core(slabSize, maxBytes)) {}
+
+PendingPacketPool::~PendingPacketPool() {
+  bool freeSlab = false;
+  bool deleteCore = false;
+  {
+    std::lock_guard<std::mutex> guard(core_->lock);
+    core_->poolAlive = false;
+    if (currentSlab_) {
+      freeSlab = releaseSlabLocked(currentSlab_);
+    }
+    deleteCore = core_->numSlabs == 0;
+  }
+  if (freeSlab) {
+    currentSlab_->~Slab();
+    free(currentSlab_);
+  }
+  if (deleteCore) {
+    delete core_;
+  }
+}
+
+bool PendingPacketPool::releaseSlabLocked(Slab* slab) {
+  if (--slab->refs > 0) {
+    return false;
+  }
+  slab->core->numSlabs--;
+  return true;
+}
+
+std::unique_ptr<folly::IOBuf> PendingPacketPool::copyPacket(
+    const folly::IOBuf& packet) {
+  size_t length = packet.computeChainDataLength();
+  size_t needed = alignedSize(sizeof(PacketHeader)) + alignedSize(length);
+  Slab* oldSlab = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(core_->lock);
+    if (core_->bufferedBytes + length > core_->maxBytes) {
+      return nullptr;
+    }
+    if (currentSlab_ && currentSlab_->refs == 1) {
+      // All the packets of the slab were released, start over.
+      currentSlab_->used = 0;
+    }
+    if (currentSlab_ &&
+        currentSlab_->capacity - currentSlab_->used < needed) {
+      if (releaseSlabLocked(currentSlab_)) {
+        oldSlab = currentSlab_;
+      }
+      currentSlab_ = nullptr;
+    }
+    if (!currentSlab_) {
+      size_t capacity = std::max(core_->slabSize, needed);
+      void* mem = malloc(sizeof(Slab) + capacity);
+      if (!mem) {
+        throw std::bad_alloc();
+      }
+      currentSlab_ = new (mem) Slab(core_, capacity);
+      core_->numSlabs++;
+    }
+    currentSlab_->refs++;
+    core_->bufferedBytes += length;
+  }
+  if (oldSlab) {
+    oldSlab->~Slab();
+    free(oldSlab);
+  }
+  uint8_t* start = currentSlab_->data() + currentSlab_->used;
+  currentSlab_->used += needed;
+  auto header = new (start) PacketHeader{currentSlab_, length};
+  uint8_t* data = start + alignedSize(sizeof(PacketHeader));
+  size_t offset = 0;
+  for (auto range : packet) {
+    memcpy(data + offset, range.data(), range.size());
+    offset += range.size();
+  }
+  return folly::IOBuf::takeOwnership(
+      data, length, length, &PendingPacketPool::releasePacket, header);
+}
+
+uint64_t PendingPacketPool::getBufferedBytes() const {
+  std::lock_guard<std::mutex> guard(core_->lock);
+  return core_->bufferedBytes;
+}
+
+size_t PendingPacketPool::numSlabs() const {
+  std::lock_guard<std::mutex> guard(core_->lock);
+  return core_->numSlabs;
+}
+
+void PendingPacketPool::releasePacket(void* /* buf */, void* userData) {
+  auto header = static_cast<PacketHeader*>(userData);
+  auto slab = header->slab;
+  auto core = slab->core;
+  bool freeSlab = false;
+  bool deleteCore = false;
+  {
+    std::lock_guard<std::mutex> guard(core->lock);
+    core->bufferedBytes -= header->length;
+    freeSlab = releaseSlabLocked(slab);
+    deleteCore = !core->poolAlive && core->numSlabs == 0;
+  }
+  if (freeSlab) {
+    slab->~Slab();
+    free(slab);
+  }
+  if (deleteCore) {
+    delete core;
+  }
+}
+
+} // namespace quic
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/io/IOBuf.h>
+
+namespace quic {
+
+/**
+ * Holds copies of packets that cannot be read yet, trimmed to their length
+ * and packed into shared slabs rather than each keeping a whole receive
+ * buffer alive. The bytes of all the packets held at a time are capped, so
+ * the pool bounds the memory of the packets buffered by all the connections
+ * sharing it. Packets may be released on any thread, and the pool may be
+ * destroyed while some of them are still in use, in which case their slabs
+ * are freed once they are released.
+ */
+class PendingPacketPool {
+ public:
+  /**
+   * slabSize is the capacity of the slabs the packets are packed into. At
+   * most maxBytes of packet data are held at a time.
+   */
+  PendingPacketPool(size_t slabSize, uint64_t maxBytes);
+
+  ~PendingPacketPool();
+
+  PendingPacketPool(const PendingPacketPool&) = delete;
+  PendingPacketPool& operator=(const PendingPacketPool&) = delete;
+
+  /**
+   * Returns a copy of packet in pool memory, or nullptr if holding it would
+   * take the pool over maxBytes.
+   */
+  std::unique_ptr<folly::IOBuf> copyPacket(const folly::IOBuf& packet);
+
+  /**
+   * Bytes of the packets currently held.
+   */
+  uint64_t getBufferedBytes() const;
+
+  /**
+   * Number of slabs currently allocated.
+   */
+  size_t numSlabs() const;
+
+ private:
+  struct Core;
+  struct Slab;
+  struct PacketHeader;
+
+  static void releasePacket(void* buf, void* userData);
+
+  // Drops a reference to slab. Has to be called with the lock of the core
+  // held, returns whether slab has to be freed.
+  static bool releaseSlabLocked(Slab* slab);
+
+  Core* core_;
+  // The slab the next packets are packed into.
+  Slab* currentSlab_{nullptr};
+};
+
+} // namespace quic
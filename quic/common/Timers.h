@@ -15,6 +15,17 @@
 #endif
 
 namespace quic {
+/**
+ * The timers of the transport come in two precisions, on wheels of folly
+ * rather than a wheel of their own:
+ * - TimerHighRes, a hierarchical wheel with a microsecond tick, for pacing.
+ *   With QUIC_USE_TIMERFD_TIMEOUT_MGR it runs on its own timerfd, and a
+ *   worker shares one between its connections through PacingScheduler.
+ * - The millisecond HHWheelTimer of the event base, for the coarse
+ *   timeouts: loss, ack, idle and drain.
+ * QuicTimersBenchmark compares the schedule, cancel and fire throughput of
+ * the two with PacingScheduler's.
+ */
 #ifdef QUIC_USE_TIMERFD_TIMEOUT_MGR
 class TimerFDTimerHighRes : public folly::DelayedDestruction {
  public:
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/TransportStatsHistogram.h>
+
+#include <folly/lang/Bits.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace quic {
+
+size_t TransportStatsHistogram::bucketOf(uint64_t value) noexcept {
+  return std::min<size_t>(
+      folly::findLastSet(value), kTransportStatsHistogramBuckets - 1);
+}
+
+void TransportStatsHistogram::add(uint64_t value) noexcept {
+  buckets[bucketOf(value)]++;
+  count++;
+  sum += value;
+}
+
+void TransportStatsHistogram::merge(const TransportStatsHistogram& other) {
+  for (size_t i = 0; i < buckets.size(); i++) {
+    buckets[i] += other.buckets[i];
+  }
+  count += other.count;
+  sum += other.sum;
+}
+
+uint64_t TransportStatsHistogram::percentile(double pct) const {
+  // Sum the buckets rather than use count, they may have been read at
+  // slightly different times.
+  uint64_t total = 0;
+  for (auto bucket : buckets) {
+    total += bucket;
+  }
+  if (total == 0) {
+    return 0;
+  }
+  auto rank = std::max<uint64_t>(
+      1,
+      static_cast<uint64_t>(
+          std::ceil(std::max(0.0, std::min(pct, 100.0)) / 100.0 * total)));
+  uint64_t seen = 0;
+  size_t bucket = 0;
+  for (; bucket < buckets.size() - 1; bucket++) {
+    seen += buckets[bucket];
+    if (seen >= rank) {
+      break;
+    }
+  }
+  if (bucket == 0) {
+    return 0;
+  }
+  if (bucket == buckets.size() - 1) {
+    return std::numeric_limits<uint64_t>::max();
+  }
+  return (uint64_t(1) << bucket) - 1;
+}
+
+} // namespace quic
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+
+#include <array>
+
+namespace quic {
+
+/**
+ * Log2 histogram: bucket 0 counts the zeros and bucket i the values in
+ * [2^(i-1), 2^i), the last bucket also counts everything larger.
+ */
+struct TransportStatsHistogram {
+  std::array<uint64_t, kTransportStatsHistogramBuckets> buckets{};
+  uint64_t count{0};
+  uint64_t sum{0};
+
+  void add(uint64_t value) noexcept;
+
+  void merge(const TransportStatsHistogram& other);
+
+  // Upper bound of the bucket holding the given percentile in [0, 100],
+  // 0 when the histogram is empty.
+  uint64_t percentile(double pct) const;
+
+  static size_t bucketOf(uint64_t value) noexcept;
+};
+
+} // namespace quic
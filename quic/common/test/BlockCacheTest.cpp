@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/BlockCache.h>
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace quic;
+
+namespace {
+struct Object {
+  char data[512];
+};
+
+template <int N>
+struct Tag {};
+} // namespace
+
+TEST(BlockCache, ReuseFreedBlock) {
+  using Cache = BlockCache<Tag<0>>;
+  auto block = Cache::allocate(sizeof(Object));
+  EXPECT_EQ(Cache::numCachedBlocks(), 0);
+  Cache::deallocate(block, sizeof(Object));
+  EXPECT_EQ(Cache::numCachedBlocks(), 1);
+  EXPECT_EQ(Cache::allocate(sizeof(Object)), block);
+  EXPECT_EQ(Cache::numCachedBlocks(), 0);
+  Cache::deallocate(block, sizeof(Object));
+}
+
+TEST(BlockCache, OtherSizeNotCached) {
+  using Cache = BlockCache<Tag<1>>;
+  auto block = Cache::allocate(sizeof(Object));
+  auto other = Cache::allocate(2 * sizeof(Object));
+  Cache::deallocate(block, sizeof(Object));
+  Cache::deallocate(other, 2 * sizeof(Object));
+  EXPECT_EQ(Cache::numCachedBlocks(), 1);
+  // A block of the cached size is not handed out for another size.
+  other = Cache::allocate(2 * sizeof(Object));
+  EXPECT_EQ(Cache::numCachedBlocks(), 1);
+  Cache::deallocate(other, 2 * sizeof(Object));
+}
+
+TEST(BlockCache, CacheIsBounded) {
+  using Cache = BlockCache<Tag<2>>;
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < kMaxCachedConnectionBlocks + 10; i++) {
+    blocks.push_back(Cache::allocate(sizeof(Object)));
+  }
+  for (auto block : blocks) {
+    Cache::deallocate(block, sizeof(Object));
+  }
+  EXPECT_EQ(Cache::numCachedBlocks(), kMaxCachedConnectionBlocks);
+}
+
+TEST(BlockCache, PerThread) {
+  using Cache = BlockCache<Tag<3>>;
+  auto block = Cache::allocate(sizeof(Object));
+  std::thread([&] {
+    Cache::deallocate(block, sizeof(Object));
+    EXPECT_EQ(Cache::numCachedBlocks(), 1);
+  }).join();
+  EXPECT_EQ(Cache::numCachedBlocks(), 0);
+}
+
+TEST(BlockCache, AllocateShared) {
+  using Allocator = BlockCacheAllocator<Object, Tag<4>>;
+  auto object = std::allocate_shared<Object>(Allocator());
+  auto address = object.get();
+  EXPECT_EQ(BlockCache<Tag<4>>::numCachedBlocks(), 0);
+  object.reset();
+  EXPECT_EQ(BlockCache<Tag<4>>::numCachedBlocks(), 1);
+  object = std::allocate_shared<Object>(Allocator());
+  EXPECT_EQ(object.get(), address);
+  EXPECT_EQ(BlockCache<Tag<4>>::numCachedBlocks(), 0);
+}
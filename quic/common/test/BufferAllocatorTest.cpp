@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/QuicConstants.h>
+#include <quic/common/BufferAllocator.h>
+
+#include <gtest/gtest.h>
+
+using namespace quic;
+
+namespace {
+constexpr uint64_t kTwoSlabs = 2 * HugePageBufferAllocator::kSlabSize;
+} // namespace
+
+TEST(HugePageBufferAllocator, SizeClasses) {
+  HugePageBufferAllocator allocator(kTwoSlabs);
+  auto buf = allocator.getBuffer(1200);
+  EXPECT_EQ(buf->length(), 0);
+  EXPECT_EQ(buf->tailroom(), 1280);
+  auto gsoBuf = allocator.getBuffer(kMaxGSOBufferSize);
+  EXPECT_EQ(gsoBuf->tailroom(), 64 * 1024);
+  EXPECT_EQ(allocator.numSlabs(), 2);
+}
+
+TEST(HugePageBufferAllocator, ReuseReleasedBuffer) {
+  HugePageBufferAllocator allocator(kTwoSlabs);
+  auto buf = allocator.getBuffer(1500);
+  const uint8_t* data = buf->data();
+  size_t cached = allocator.numCachedBuffers(1500);
+  buf.reset();
+  EXPECT_EQ(allocator.numCachedBuffers(1500), cached + 1);
+  auto buf2 = allocator.getBuffer(1400);
+  EXPECT_EQ(buf2->data(), data);
+  EXPECT_EQ(allocator.numSlabs(), 1);
+}
+
+TEST(HugePageBufferAllocator, ReleaseAfterLastClone) {
+  HugePageBufferAllocator allocator(kTwoSlabs);
+  auto buf = allocator.getBuffer(1000);
+  buf->append(10);
+  size_t cached = allocator.numCachedBuffers(1000);
+  auto clone = buf->clone();
+  buf.reset();
+  EXPECT_EQ(allocator.numCachedBuffers(1000), cached);
+  clone.reset();
+  EXPECT_EQ(allocator.numCachedBuffers(1000), cached + 1);
+}
+
+TEST(HugePageBufferAllocator, Fallback) {
+  HugePageBufferAllocator allocator(HugePageBufferAllocator::kSlabSize);
+  // Larger than the largest size class.
+  auto buf = allocator.getBuffer(100 * 1024);
+  EXPECT_GE(buf->tailroom(), 100 * 1024);
+  EXPECT_EQ(allocator.numSlabs(), 0);
+  auto small = allocator.getBuffer(1000);
+  EXPECT_EQ(allocator.numSlabs(), 1);
+  // A second class would take the slabs over maxBytes.
+  auto jumbo = allocator.getBuffer(9000);
+  EXPECT_GE(jumbo->tailroom(), 9000);
+  EXPECT_EQ(allocator.numSlabs(), 1);
+}
+
+TEST(HugePageBufferAllocator, OutliveAllocator) {
+  auto allocator = std::make_unique<HugePageBufferAllocator>(kTwoSlabs);
+  auto buf = allocator->getBuffer(1000);
+  buf->append(5);
+  allocator.reset();
+  // The buffer is still valid, its slab is freed on release.
+  EXPECT_EQ(buf->length(), 5);
+  buf.reset();
+}
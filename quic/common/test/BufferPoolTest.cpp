@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/BufferPool.h>
+
+#include <gtest/gtest.h>
+
+using namespace quic;
+
+TEST(BufferPool, GetBuffer) {
+  BufferPool pool(100, 2);
+  auto buf = pool.getBuffer();
+  EXPECT_EQ(buf->length(), 0);
+  EXPECT_GE(buf->tailroom(), 100);
+  EXPECT_EQ(pool.getBufferSize(), 100);
+}
+
+TEST(BufferPool, ReuseReleasedBuffer) {
+  BufferPool pool(100, 2);
+  auto buf = pool.getBuffer();
+  const uint8_t* data = buf->data();
+  EXPECT_EQ(pool.numCachedBuffers(), 0);
+  buf.reset();
+  EXPECT_EQ(pool.numCachedBuffers(), 1);
+  auto buf2 = pool.getBuffer();
+  EXPECT_EQ(buf2->data(), data);
+  EXPECT_EQ(pool.numCachedBuffers(), 0);
+}
+
+TEST(BufferPool, ReleaseAfterLastClone) {
+  BufferPool pool(100, 2);
+  auto buf = pool.getBuffer();
+  buf->append(10);
+  auto clone = buf->clone();
+  buf.reset();
+  EXPECT_EQ(pool.numCachedBuffers(), 0);
+  clone.reset();
+  EXPECT_EQ(pool.numCachedBuffers(), 1);
+}
+
+TEST(BufferPool, MaxCached) {
+  BufferPool pool(100, 2);
+  auto buf1 = pool.getBuffer();
+  auto buf2 = pool.getBuffer();
+  auto buf3 = pool.getBuffer();
+  buf1.reset();
+  buf2.reset();
+  buf3.reset();
+  EXPECT_EQ(pool.numCachedBuffers(), 2);
+}
+
+TEST(BufferPool, OutlivePool) {
+  auto pool = std::make_unique<BufferPool>(100, 2);
+  auto buf = pool->getBuffer();
+  buf->append(5);
+  pool.reset();
+  // The buffer is still valid and is freed on release.
+  EXPECT_EQ(buf->length(), 5);
+  buf.reset();
+}
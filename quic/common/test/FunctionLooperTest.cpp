@@ -231,6 +231,46 @@ TEST(FunctionLooperTest, KeepPacing) {
   looper->stop();
 }
 
+TEST(FunctionLooperTest, PacingThroughScheduler) {
+  EventBase evb;
+  TimerHighRes::SharedPtr pacingTimer(TimerHighRes::newTimer(&evb, 1ms));
+  auto scheduler = std::make_shared<PacingScheduler>(pacingTimer);
+  std::vector<bool> fromTimerVec;
+  auto func = [&](bool fromTimer) { fromTimerVec.push_back(fromTimer); };
+  bool stopPacing = false;
+  auto pacingFunc = [&]() -> auto {
+    if (stopPacing) {
+      return std::chrono::milliseconds::zero();
+    }
+    return 1ms;
+  };
+  FunctionLooper::Ptr looper(
+      new FunctionLooper(&evb, std::move(func), LooperType::ReadLooper));
+  looper->setPacingTimer(pacingTimer);
+  looper->setPacingScheduler(scheduler);
+  looper->setPacingFunction(std::move(pacingFunc));
+  looper->run();
+  evb.loopOnce();
+  EXPECT_EQ(1, fromTimerVec.size());
+  EXPECT_FALSE(fromTimerVec.back());
+  EXPECT_FALSE(looper->isScheduled());
+  EXPECT_TRUE(looper->isPacingScheduled());
+
+  stopPacing = true;
+  looper->cancelPacingTimeout();
+  looper->pacingTimeoutExpired();
+  EXPECT_EQ(2, fromTimerVec.size());
+  EXPECT_TRUE(fromTimerVec.back());
+  EXPECT_FALSE(looper->isPacingScheduled());
+
+  stopPacing = false;
+  evb.loopOnce();
+  EXPECT_TRUE(looper->isPacingScheduled());
+  looper->stop();
+  EXPECT_FALSE(looper->isPacingScheduled());
+  EXPECT_EQ(0, scheduler->numScheduled());
+}
+
 TEST(FunctionLooperTest, TimerTickSize) {
   EventBase evb;
   TimerHighRes::SharedPtr pacingTimer(TimerHighRes::newTimer(&evb, 123ms));
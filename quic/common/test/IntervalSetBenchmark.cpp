@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <quic/common/IntervalSet.h>
+
+#include <cstdint>
+#include <deque>
+
+namespace {
+
+using PacketNumSet = quic::IntervalSet<uint64_t>;
+// The container of IntervalSet before it stored its intervals inline, to
+// compare with.
+using DequePacketNumSet = quic::IntervalSet<uint64_t, 1, std::deque>;
+
+// A set of numIntervals intervals of one point, every other point from 0.
+template <typename Set = PacketNumSet>
+Set makeGappedSet(size_t numIntervals) {
+  Set set;
+  for (uint64_t i = 0; i < numIntervals; i++) {
+    set.insert(2 * i);
+  }
+  return set;
+}
+
+// Packet numbers received in order, as the acks of a clean path. Each insert
+// grows the last interval.
+template <typename Set>
+void insertInOrderImpl(size_t iters, size_t numIntervals) {
+  Set set;
+  uint64_t next = 0;
+  BENCHMARK_SUSPEND {
+    set = makeGappedSet<Set>(numIntervals);
+    next = 2 * numIntervals;
+  }
+  for (size_t i = 0; i < iters; i++) {
+    set.insert(next++);
+  }
+  folly::doNotOptimizeAway(set.size());
+}
+
+void insertInOrder(size_t iters, size_t numIntervals) {
+  insertInOrderImpl<PacketNumSet>(iters, numIntervals);
+}
+
+void insertInOrderDeque(size_t iters, size_t numIntervals) {
+  insertInOrderImpl<DequePacketNumSet>(iters, numIntervals);
+}
+
+// A gap before each packet number, as after losses. Each insert adds an
+// interval at the end, and the oldest one is withdrawn to keep numIntervals,
+// as the ack state does once the peer acked its acks.
+template <typename Set>
+void insertWithGapsImpl(size_t iters, size_t numIntervals) {
+  Set set;
+  uint64_t next = 0;
+  BENCHMARK_SUSPEND {
+    set = makeGappedSet<Set>(numIntervals);
+    next = 2 * numIntervals;
+  }
+  for (size_t i = 0; i < iters; i++) {
+    set.insert(next);
+    set.withdraw({0, next - 2 * numIntervals});
+    next += 2;
+  }
+  folly::doNotOptimizeAway(set.size());
+}
+
+void insertWithGaps(size_t iters, size_t numIntervals) {
+  insertWithGapsImpl<PacketNumSet>(iters, numIntervals);
+}
+
+void insertWithGapsDeque(size_t iters, size_t numIntervals) {
+  insertWithGapsImpl<DequePacketNumSet>(iters, numIntervals);
+}
+
+// A set built and dropped for a few packet numbers with numIntervals - 1
+// gaps, as the ack blocks of a written ack or the set of a new stream. This
+// is where storing the intervals inline saves the allocations.
+template <typename Set>
+void shortLivedSetImpl(size_t iters, size_t numIntervals) {
+  for (size_t i = 0; i < iters; i++) {
+    Set set;
+    for (uint64_t j = 0; j < numIntervals; j++) {
+      set.insert(i + 2 * j);
+    }
+    folly::doNotOptimizeAway(set.size());
+  }
+}
+
+void shortLivedSet(size_t iters, size_t numIntervals) {
+  shortLivedSetImpl<PacketNumSet>(iters, numIntervals);
+}
+
+void shortLivedSetDeque(size_t iters, size_t numIntervals) {
+  shortLivedSetImpl<DequePacketNumSet>(iters, numIntervals);
+}
+
+// Reordered packet numbers that fill the gaps, from the oldest one. Each
+// insert merges two intervals at the front.
+void fillGapsFromFront(size_t iters, size_t numIntervals) {
+  PacketNumSet set;
+  uint64_t gap = 0;
+  for (size_t i = 0; i < iters; i++) {
+    BENCHMARK_SUSPEND {
+      if (set.size() <= 1) {
+        set = makeGappedSet(numIntervals);
+        gap = 1;
+      }
+    }
+    set.insert(gap);
+    gap += 2;
+  }
+  folly::doNotOptimizeAway(set.size());
+}
+
+// The same, from the newest gap, so that the merges are at the end.
+void fillGapsFromBack(size_t iters, size_t numIntervals) {
+  PacketNumSet set;
+  uint64_t gap = 0;
+  for (size_t i = 0; i < iters; i++) {
+    BENCHMARK_SUSPEND {
+      if (set.size() <= 1) {
+        set = makeGappedSet(numIntervals);
+        gap = 2 * numIntervals - 3;
+      }
+    }
+    set.insert(gap);
+    gap -= 2;
+  }
+  folly::doNotOptimizeAway(set.size());
+}
+
+// A withdraw that removes all but the newest interval at once, as when the
+// peer acks an ack after a long period of loss.
+void withdrawPrefix(size_t iters, size_t numIntervals) {
+  PacketNumSet set;
+  for (size_t i = 0; i < iters; i++) {
+    BENCHMARK_SUSPEND {
+      set = makeGappedSet(numIntervals);
+    }
+    set.withdraw({0, 2 * numIntervals - 4});
+  }
+  folly::doNotOptimizeAway(set.size());
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(insertInOrderDeque, 4Intervals, 4)
+BENCHMARK_RELATIVE_NAMED_PARAM(insertInOrder, 4Intervals, 4)
+BENCHMARK_NAMED_PARAM(insertInOrderDeque, 64Intervals, 64)
+BENCHMARK_RELATIVE_NAMED_PARAM(insertInOrder, 64Intervals, 64)
+BENCHMARK_NAMED_PARAM(insertInOrderDeque, 1024Intervals, 1024)
+BENCHMARK_RELATIVE_NAMED_PARAM(insertInOrder, 1024Intervals, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(insertWithGapsDeque, 4Intervals, 4)
+BENCHMARK_RELATIVE_NAMED_PARAM(insertWithGaps, 4Intervals, 4)
+BENCHMARK_NAMED_PARAM(insertWithGapsDeque, 64Intervals, 64)
+BENCHMARK_RELATIVE_NAMED_PARAM(insertWithGaps, 64Intervals, 64)
+BENCHMARK_NAMED_PARAM(insertWithGapsDeque, 1024Intervals, 1024)
+BENCHMARK_RELATIVE_NAMED_PARAM(insertWithGaps, 1024Intervals, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(shortLivedSetDeque, 1Interval, 1)
+BENCHMARK_RELATIVE_NAMED_PARAM(shortLivedSet, 1Interval, 1)
+BENCHMARK_NAMED_PARAM(shortLivedSetDeque, 4Intervals, 4)
+BENCHMARK_RELATIVE_NAMED_PARAM(shortLivedSet, 4Intervals, 4)
+BENCHMARK_NAMED_PARAM(shortLivedSetDeque, 8Intervals, 8)
+BENCHMARK_RELATIVE_NAMED_PARAM(shortLivedSet, 8Intervals, 8)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(fillGapsFromFront, 4Intervals, 4)
+BENCHMARK_NAMED_PARAM(fillGapsFromFront, 64Intervals, 64)
+BENCHMARK_NAMED_PARAM(fillGapsFromFront, 1024Intervals, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(fillGapsFromBack, 4Intervals, 4)
+BENCHMARK_NAMED_PARAM(fillGapsFromBack, 64Intervals, 64)
+BENCHMARK_NAMED_PARAM(fillGapsFromBack, 1024Intervals, 1024)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(withdrawPrefix, 4Intervals, 4)
+BENCHMARK_NAMED_PARAM(withdrawPrefix, 64Intervals, 64)
+BENCHMARK_NAMED_PARAM(withdrawPrefix, 1024Intervals, 1024)
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
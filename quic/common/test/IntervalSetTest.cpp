@@ -169,6 +169,32 @@ TEST(IntervalSet, insertVersionDoesNotChange) {
   EXPECT_EQ(version2, version1);
 }
 
+TEST(IntervalSet, prefixVersion) {
+  IntervalSet<int> set;
+  set.insert(1, 2);
+  set.insert(5, 6);
+  auto version = set.prefixVersion();
+  // Growing the last interval towards larger values keeps the version.
+  set.insert(7);
+  set.insert(6, 10);
+  EXPECT_EQ(version, set.prefixVersion());
+  // Anything else changes it.
+  set.insert(4);
+  EXPECT_GT(set.prefixVersion(), version);
+  version = set.prefixVersion();
+  set.insert(12);
+  EXPECT_GT(set.prefixVersion(), version);
+  version = set.prefixVersion();
+  set.insert(3);
+  EXPECT_GT(set.prefixVersion(), version);
+  version = set.prefixVersion();
+  set.withdraw({1, 1});
+  EXPECT_GT(set.prefixVersion(), version);
+  version = set.prefixVersion();
+  set.clear();
+  EXPECT_GT(set.prefixVersion(), version);
+}
+
 TEST(IntervalSet, withdrawBeforeFront) {
   IntervalSet<int> set;
   set.insert(4, 5);
@@ -302,3 +328,34 @@ TEST(IntervalSet, withdrawWithOverflow) {
   auto interval = set.front();
   EXPECT_EQ(interval, Interval<int>(3, 5));
 }
+
+TEST(IntervalSet, vectorContainer) {
+  IntervalSet<int, 1, std::vector> set;
+  set.insert(10, 12);
+  set.insert(1, 2);
+  set.insert(5, 6);
+  set.insert(3, 4);
+  EXPECT_EQ(2, set.size());
+  EXPECT_EQ(set.front(), Interval<int>(1, 6));
+  EXPECT_EQ(set.back(), Interval<int>(10, 12));
+  set.withdraw({4, 4});
+  EXPECT_EQ(3, set.size());
+  set.pop_front();
+  EXPECT_EQ(set.front(), Interval<int>(5, 6));
+}
+
+TEST(IntervalSet, growPastInlineCapacity) {
+  IntervalSet<int> set;
+  for (int i = 0; i < 4 * static_cast<int>(kIntervalSetInlineCapacity); i++) {
+    set.insert(i * 3, i * 3 + 1);
+  }
+  EXPECT_EQ(4 * kIntervalSetInlineCapacity, set.size());
+  EXPECT_EQ(set.front(), Interval<int>(0, 1));
+  // Filling the gaps merges everything back into one interval.
+  for (int i = 0; i < 4 * static_cast<int>(kIntervalSetInlineCapacity); i++) {
+    set.insert(i * 3 + 2);
+  }
+  EXPECT_EQ(1, set.size());
+  set.withdraw({0, 2});
+  EXPECT_EQ(set.front().start, 3);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/LoopHealthMonitor.h>
+
+#include <folly/portability/GTest.h>
+
+#include <vector>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+using Metric = LoopHealthMonitor::Metric;
+
+TEST(LoopHealthMonitorTest, AlertsAboveThreshold) {
+  LoopHealthMonitor::Thresholds thresholds;
+  thresholds.readDelay = 5ms;
+  std::vector<std::pair<Metric, std::chrono::microseconds>> alerts;
+  LoopHealthMonitor monitor(
+      thresholds, [&](Metric metric, std::chrono::microseconds value) {
+        alerts.emplace_back(metric, value);
+      });
+
+  monitor.onSample(Metric::ReadDelay, 1ms);
+  monitor.onSample(Metric::ReadDelay, 5ms);
+  monitor.onSample(Metric::ReadDelay, 20ms);
+  // No threshold for the others
+  monitor.onSample(Metric::WriteDelay, 1s);
+  monitor.onSample(Metric::LoopBusyTime, 1s);
+
+  ASSERT_EQ(1, alerts.size());
+  EXPECT_EQ(Metric::ReadDelay, alerts[0].first);
+  EXPECT_EQ(20ms, alerts[0].second);
+  EXPECT_EQ(1, monitor.getNumAlerts(Metric::ReadDelay));
+  EXPECT_EQ(0, monitor.getNumAlerts(Metric::WriteDelay));
+
+  const auto& reads = monitor.getHistogram(Metric::ReadDelay);
+  EXPECT_EQ(3, reads.count);
+  EXPECT_EQ(26000, reads.sum);
+  EXPECT_EQ(1, reads.buckets[TransportStatsHistogram::bucketOf(20000)]);
+  EXPECT_EQ(1, monitor.getHistogram(Metric::WriteDelay).count);
+  EXPECT_EQ(1, monitor.getHistogram(Metric::LoopBusyTime).count);
+}
+
+TEST(LoopHealthMonitorTest, NegativeSample) {
+  LoopHealthMonitor::Thresholds thresholds;
+  thresholds.writeDelay = 1us;
+  LoopHealthMonitor monitor(thresholds);
+  monitor.onSample(Metric::WriteDelay, -10us);
+  const auto& writes = monitor.getHistogram(Metric::WriteDelay);
+  EXPECT_EQ(1, writes.count);
+  EXPECT_EQ(0, writes.sum);
+  EXPECT_EQ(1, writes.buckets[0]);
+  EXPECT_EQ(0, monitor.getNumAlerts(Metric::WriteDelay));
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/LoopTime.h>
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace quic {
+namespace test {
+
+TEST(LoopTimeTest, NowOutsideOfScope) {
+  auto before = Clock::now();
+  auto now = LoopTime::now();
+  EXPECT_GE(now, before);
+  EXPECT_LE(now, Clock::now());
+}
+
+TEST(LoopTimeTest, ScopesShareTheOutermostTime) {
+  auto time = Clock::now() - std::chrono::seconds(1);
+  {
+    ScopedLoopTime loopTime(time);
+    EXPECT_EQ(time, LoopTime::now());
+    {
+      ScopedLoopTime nested;
+      EXPECT_EQ(time, LoopTime::now());
+    }
+    EXPECT_EQ(time, LoopTime::now());
+  }
+  EXPECT_GT(LoopTime::now(), time);
+
+  {
+    ScopedLoopTime loopTime;
+    auto scopeTime = LoopTime::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    EXPECT_EQ(scopeTime, LoopTime::now());
+    // The time is per thread.
+    TimePoint otherThreadTime;
+    std::thread([&] { otherThreadTime = LoopTime::now(); }).join();
+    EXPECT_GT(otherThreadTime, scopeTime);
+  }
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/PacingScheduler.h>
+#include <gtest/gtest.h>
+
+#include <folly/io/async/EventBase.h>
+
+#include <thread>
+
+using namespace std;
+using namespace folly;
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+class CountingCallback : public PacingScheduler::Callback {
+ public:
+  void pacingTimeoutExpired() noexcept override {
+    expired++;
+    if (onExpired) {
+      onExpired();
+    }
+  }
+
+  size_t expired{0};
+  folly::Function<void()> onExpired;
+};
+
+TEST(PacingSchedulerTest, DrainDueCallbacksInOneWakeup) {
+  EventBase evb;
+  auto scheduler =
+      std::make_shared<PacingScheduler>(TimerHighRes::newTimer(&evb, 1ms));
+  size_t drains = 0;
+  scheduler->setDrainCallback([&] { drains++; });
+  CountingCallback first, second, third;
+  scheduler->scheduleTimeout(&first, 1ms);
+  scheduler->scheduleTimeout(&second, 1ms);
+  scheduler->scheduleTimeout(&third, 0us);
+  EXPECT_EQ(3, scheduler->numScheduled());
+  EXPECT_TRUE(first.isPacingScheduled());
+
+  // All of them are due by the time the loop gets to the timer.
+  std::this_thread::sleep_for(5ms);
+  evb.loop();
+  EXPECT_EQ(1, first.expired);
+  EXPECT_EQ(1, second.expired);
+  EXPECT_EQ(1, third.expired);
+  EXPECT_FALSE(first.isPacingScheduled());
+  EXPECT_EQ(0, scheduler->numScheduled());
+  EXPECT_EQ(1, drains);
+}
+
+TEST(PacingSchedulerTest, CancelAndReschedule) {
+  EventBase evb;
+  auto scheduler =
+      std::make_shared<PacingScheduler>(TimerHighRes::newTimer(&evb, 1ms));
+  CountingCallback first, second, third;
+  scheduler->scheduleTimeout(&first, 1ms);
+  scheduler->scheduleTimeout(&second, 1ms);
+  scheduler->scheduleTimeout(&third, 1ms);
+  first.cancelPacingTimeout();
+  EXPECT_FALSE(first.isPacingScheduled());
+  EXPECT_TRUE(third.isPacingScheduled());
+  EXPECT_EQ(2, scheduler->numScheduled());
+
+  // Moving a scheduled callback does not run it twice.
+  scheduler->scheduleTimeout(&second, 3ms);
+  EXPECT_EQ(2, scheduler->numScheduled());
+  // A callback can reschedule itself.
+  bool rescheduled = false;
+  third.onExpired = [&] {
+    if (!rescheduled) {
+      rescheduled = true;
+      scheduler->scheduleTimeout(&third, 1ms);
+    }
+  };
+  evb.loop();
+  EXPECT_EQ(0, first.expired);
+  EXPECT_EQ(1, second.expired);
+  EXPECT_EQ(2, third.expired);
+  EXPECT_EQ(0, scheduler->numScheduled());
+}
+
+TEST(PacingSchedulerTest, DestroyedCallbackIsCanceled) {
+  EventBase evb;
+  auto scheduler =
+      std::make_shared<PacingScheduler>(TimerHighRes::newTimer(&evb, 1ms));
+  CountingCallback callback;
+  {
+    CountingCallback destroyed;
+    scheduler->scheduleTimeout(&destroyed, 1ms);
+    scheduler->scheduleTimeout(&callback, 1ms);
+  }
+  EXPECT_EQ(1, scheduler->numScheduled());
+  evb.loop();
+  EXPECT_EQ(1, callback.expired);
+}
+
+} // namespace test
+} // namespace quic
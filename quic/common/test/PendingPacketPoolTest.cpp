@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/common/PendingPacketPool.h>
+
+#include <gtest/gtest.h>
+
+using namespace quic;
+
+namespace {
+std::unique_ptr<folly::IOBuf> makePacket(size_t length) {
+  auto packet = folly::IOBuf::create(4096);
+  memset(packet->writableData(), 'a', length);
+  packet->append(length);
+  return packet;
+}
+} // namespace
+
+TEST(PendingPacketPool, CopyIsTrimmed) {
+  PendingPacketPool pool(1000, 10000);
+  auto packet = makePacket(100);
+  auto copy = pool.copyPacket(*packet);
+  ASSERT_TRUE(copy);
+  EXPECT_EQ(copy->length(), 100);
+  EXPECT_EQ(copy->capacity(), 100);
+  EXPECT_EQ(copy->moveToFbString(), packet->moveToFbString());
+  EXPECT_EQ(pool.getBufferedBytes(), 100);
+}
+
+TEST(PendingPacketPool, CopyChain) {
+  PendingPacketPool pool(1000, 10000);
+  auto packet = folly::IOBuf::copyBuffer("hello ");
+  packet->prependChain(folly::IOBuf::copyBuffer("world"));
+  auto copy = pool.copyPacket(*packet);
+  ASSERT_TRUE(copy);
+  EXPECT_FALSE(copy->isChained());
+  EXPECT_EQ(copy->moveToFbString(), "hello world");
+}
+
+TEST(PendingPacketPool, PacketsShareSlabs) {
+  PendingPacketPool pool(1000, 10000);
+  auto packet = makePacket(100);
+  auto copy1 = pool.copyPacket(*packet);
+  auto copy2 = pool.copyPacket(*packet);
+  EXPECT_EQ(pool.numSlabs(), 1);
+  std::vector<std::unique_ptr<folly::IOBuf>> copies;
+  for (size_t i = 0; i < 10; i++) {
+    copies.push_back(pool.copyPacket(*packet));
+  }
+  EXPECT_EQ(pool.numSlabs(), 2);
+  copies.clear();
+  EXPECT_EQ(pool.numSlabs(), 2);
+  copy1.reset();
+  copy2.reset();
+  // The slab the full one was replaced with stays for the next packets.
+  EXPECT_EQ(pool.numSlabs(), 1);
+  EXPECT_EQ(pool.getBufferedBytes(), 0);
+}
+
+TEST(PendingPacketPool, ReuseEmptySlab) {
+  PendingPacketPool pool(1000, 10000);
+  auto packet = makePacket(400);
+  for (size_t i = 0; i < 10; i++) {
+    auto copy = pool.copyPacket(*packet);
+    ASSERT_TRUE(copy);
+  }
+  EXPECT_EQ(pool.numSlabs(), 1);
+}
+
+TEST(PendingPacketPool, PacketLargerThanSlab) {
+  PendingPacketPool pool(100, 10000);
+  auto packet = makePacket(1000);
+  auto copy = pool.copyPacket(*packet);
+  ASSERT_TRUE(copy);
+  EXPECT_EQ(copy->length(), 1000);
+}
+
+TEST(PendingPacketPool, MaxBytes) {
+  PendingPacketPool pool(1000, 250);
+  auto packet = makePacket(100);
+  auto copy1 = pool.copyPacket(*packet);
+  auto copy2 = pool.copyPacket(*packet);
+  EXPECT_TRUE(copy1);
+  EXPECT_TRUE(copy2);
+  EXPECT_FALSE(pool.copyPacket(*packet));
+  copy1.reset();
+  EXPECT_TRUE(pool.copyPacket(*packet));
+}
+
+TEST(PendingPacketPool, OutlivePool) {
+  auto pool = std::make_unique<PendingPacketPool>(1000, 10000);
+  auto packet = makePacket(100);
+  auto copy = pool->copyPacket(*packet);
+  pool.reset();
+  EXPECT_EQ(copy->length(), 100);
+  copy.reset();
+}
@@ -18,11 +18,11 @@
 #include <quic/server/handshake/StatelessResetGenerator.h>
 
 namespace {
-std::deque<quic::OutstandingPacket>::reverse_iterator
+quic::OutstandingPackets::reverse_iterator
 getPreviousOutstandingPacket(
     quic::QuicConnectionStateBase& conn,
     quic::PacketNumberSpace packetNumberSpace,
-    std::deque<quic::OutstandingPacket>::reverse_iterator from) {
+    quic::OutstandingPackets::reverse_iterator from) {
   return std::find_if(
       from, conn.outstandingPackets.rend(), [=](const auto& op) {
         return packetNumberSpace ==
@@ -531,7 +531,7 @@ void updateAckState(
       pkHasCryptoData);
 }
 
-std::deque<OutstandingPacket>::reverse_iterator getLastOutstandingPacket(
+OutstandingPackets::reverse_iterator getLastOutstandingPacket(
     QuicConnectionStateBase& conn,
     PacketNumberSpace packetNumberSpace) {
   return getPreviousOutstandingPacket(
@@ -582,8 +582,8 @@ CongestionController::AckEvent makeAck(
   ack.ackedBytes = ackedSize;
   ack.ackTime = ackedTime;
   ack.largestAckedPacket = seq;
-  ack.ackedPackets.emplace_back(
-      std::move(packet), sentTime, ackedSize, false, false, ackedSize);
+  ack.ackedPackets.emplace_back(OutstandingPacket(
+      std::move(packet), sentTime, ackedSize, false, false, ackedSize));
   return ack;
 }
 
@@ -123,6 +123,8 @@ bool isState(const S& s) {
       [](const auto&) { return false; });
 }
 
+std::shared_ptr<fizz::SelfCert> readCert();
+
 std::shared_ptr<fizz::server::FizzServerContext> createServerCtx();
 
 void setupCtxWithTestCert(fizz::server::FizzServerContext& ctx);
@@ -208,7 +210,7 @@ OutstandingPacket* findOutstandingPacket(
     QuicConnectionStateBase& conn,
     Match match) {
   auto helper =
-      [&](std::deque<OutstandingPacket>& packets) -> OutstandingPacket* {
+      [&](OutstandingPackets& packets) -> OutstandingPacket* {
     for (auto& packet : packets) {
       if (match(packet)) {
         return &packet;
@@ -219,7 +221,7 @@ OutstandingPacket* findOutstandingPacket(
   return helper(conn.outstandingPackets);
 }
 
-std::deque<OutstandingPacket>::reverse_iterator getLastOutstandingPacket(
+OutstandingPackets::reverse_iterator getLastOutstandingPacket(
     QuicConnectionStateBase& conn,
     PacketNumberSpace packetNumberSpace);
 
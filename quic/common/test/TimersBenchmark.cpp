@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/EventBase.h>
+#include <quic/common/PacingScheduler.h>
+#include <quic/common/Timers.h>
+
+#include <memory>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Enough callbacks for a worker's worth of connections to spread over the
+// wheel slots.
+constexpr size_t kNumCallbacks = 1000;
+
+class CountingTimeout : public quic::TimerHighRes::Callback {
+ public:
+  void timeoutExpired() noexcept override {
+    expired++;
+  }
+
+  void callbackCanceled() noexcept override {}
+
+  size_t expired{0};
+};
+
+class CountingWheelTimeout : public folly::HHWheelTimer::Callback {
+ public:
+  void timeoutExpired() noexcept override {
+    expired++;
+  }
+
+  void callbackCanceled() noexcept override {}
+
+  size_t expired{0};
+};
+
+class CountingPacingTimeout : public quic::PacingScheduler::Callback {
+ public:
+  void pacingTimeoutExpired() noexcept override {
+    expired++;
+  }
+
+  size_t expired{0};
+};
+
+} // namespace
+
+// The pacing timer used by the connections, with one timeout each.
+BENCHMARK(TimerHighResScheduleCancel, iters) {
+  folly::EventBase evb;
+  quic::TimerHighRes::SharedPtr timer;
+  std::unique_ptr<CountingTimeout[]> timeouts;
+  BENCHMARK_SUSPEND {
+    timer = quic::TimerHighRes::newTimer(
+        &evb, quic::kDefaultPacingTimerTickInterval);
+    timeouts = std::make_unique<CountingTimeout[]>(kNumCallbacks);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto& timeout = timeouts[i % kNumCallbacks];
+    timer->scheduleTimeout(&timeout, std::chrono::microseconds(i % 5000));
+    if (i % 2) {
+      timeout.cancelTimeout();
+    }
+  }
+  BENCHMARK_SUSPEND {
+    for (size_t j = 0; j < kNumCallbacks; j++) {
+      timeouts[j].cancelTimeout();
+    }
+  }
+}
+
+BENCHMARK(TimerHighResFire, iters) {
+  folly::EventBase evb;
+  quic::TimerHighRes::SharedPtr timer;
+  std::unique_ptr<CountingTimeout[]> timeouts;
+  BENCHMARK_SUSPEND {
+    timer = quic::TimerHighRes::newTimer(
+        &evb, quic::kDefaultPacingTimerTickInterval);
+    timeouts = std::make_unique<CountingTimeout[]>(kNumCallbacks);
+  }
+  for (size_t i = 0; i < iters; i += kNumCallbacks) {
+    for (size_t j = 0; j < kNumCallbacks; j++) {
+      timer->scheduleTimeout(&timeouts[j], 0us);
+    }
+    evb.loop();
+  }
+}
+
+// The millisecond timer of the event base, used by the loss, ack, idle and
+// drain timeouts.
+BENCHMARK(HHWheelTimerScheduleCancel, iters) {
+  folly::EventBase evb;
+  std::unique_ptr<CountingWheelTimeout[]> timeouts;
+  BENCHMARK_SUSPEND {
+    timeouts = std::make_unique<CountingWheelTimeout[]>(kNumCallbacks);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto& timeout = timeouts[i % kNumCallbacks];
+    evb.timer().scheduleTimeout(
+        &timeout, std::chrono::milliseconds(i % 30000));
+    if (i % 2) {
+      timeout.cancelTimeout();
+    }
+  }
+  BENCHMARK_SUSPEND {
+    for (size_t j = 0; j < kNumCallbacks; j++) {
+      timeouts[j].cancelTimeout();
+    }
+  }
+}
+
+// The worker's PacingScheduler on top of a single timeout of the pacing
+// timer.
+BENCHMARK(PacingSchedulerScheduleCancel, iters) {
+  folly::EventBase evb;
+  std::shared_ptr<quic::PacingScheduler> scheduler;
+  std::unique_ptr<CountingPacingTimeout[]> timeouts;
+  BENCHMARK_SUSPEND {
+    scheduler = std::make_shared<quic::PacingScheduler>(
+        quic::TimerHighRes::newTimer(
+            &evb, quic::kDefaultPacingTimerTickInterval));
+    timeouts = std::make_unique<CountingPacingTimeout[]>(kNumCallbacks);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto& timeout = timeouts[i % kNumCallbacks];
+    scheduler->scheduleTimeout(&timeout, std::chrono::microseconds(i % 5000));
+    if (i % 2) {
+      timeout.cancelPacingTimeout();
+    }
+  }
+  BENCHMARK_SUSPEND {
+    for (size_t j = 0; j < kNumCallbacks; j++) {
+      timeouts[j].cancelPacingTimeout();
+    }
+  }
+}
+
+BENCHMARK(PacingSchedulerFire, iters) {
+  folly::EventBase evb;
+  std::shared_ptr<quic::PacingScheduler> scheduler;
+  std::unique_ptr<CountingPacingTimeout[]> timeouts;
+  BENCHMARK_SUSPEND {
+    scheduler = std::make_shared<quic::PacingScheduler>(
+        quic::TimerHighRes::newTimer(
+            &evb, quic::kDefaultPacingTimerTickInterval));
+    timeouts = std::make_unique<CountingPacingTimeout[]>(kNumCallbacks);
+  }
+  for (size_t i = 0; i < iters; i += kNumCallbacks) {
+    for (size_t j = 0; j < kNumCallbacks; j++) {
+      scheduler->scheduleTimeout(&timeouts[j], 0us);
+    }
+    evb.loop();
+  }
+}
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
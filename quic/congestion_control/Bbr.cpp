@@ -30,12 +30,13 @@ namespace quic {
 
 BbrCongestionController::BbrCongestionController(
     QuicConnectionStateBase& conn,
-    const BbrConfig& config)
+    const BbrConfig& config,
+    folly::Optional<uint64_t> initCwndBytes)
     : conn_(conn),
       config_(config),
-      cwnd_(conn.udpSendPacketLen * conn.transportSettings.initCwndInMss),
-      initialCwnd_(
-          conn.udpSendPacketLen * conn.transportSettings.initCwndInMss),
+      cwnd_(initCwndBytes.value_or(
+          conn.udpSendPacketLen * conn.transportSettings.initCwndInMss)),
+      initialCwnd_(cwnd_),
       recoveryWindow_(
           conn.udpSendPacketLen * conn.transportSettings.maxCwndInMss),
       // TODO: experiment with longer window len for ack aggregation filter
@@ -70,6 +71,11 @@ void BbrCongestionController::setBandwidthSampler(
 }
 
 void BbrCongestionController::onPacketLoss(const LossEvent& loss) {
+  if (!inRecovery()) {
+    undoState_ = UndoState{endOfRecovery_, loss.lossTime, loss.lostPackets};
+  } else if (undoState_) {
+    undoState_->lostPackets += loss.lostPackets;
+  }
   endOfRecovery_ = Clock::now();
 
   if (!inRecovery()) {
@@ -97,6 +103,7 @@ void BbrCongestionController::onPacketLoss(const LossEvent& loss) {
       : conn_.udpSendPacketLen * kMinCwndInMssForBbr;
 
   if (loss.persistentCongestion) {
+    undoState_ = folly::none;
     recoveryWindow_ = conn_.udpSendPacketLen * kMinCwndInMssForBbr;
     if (conn_.qLogger) {
       conn_.qLogger->addCongestionMetricUpdate(
@@ -116,6 +123,32 @@ void BbrCongestionController::onPacketLoss(const LossEvent& loss) {
   }
 }
 
+void BbrCongestionController::onSpuriousLoss(TimePoint lossTime) {
+  // Only a loss of the current recovery can be undone.
+  if (!inRecovery() || !undoState_ || lossTime < undoState_->lossTime) {
+    return;
+  }
+  DCHECK_GT(undoState_->lostPackets, 0);
+  if (--undoState_->lostPackets > 0) {
+    return;
+  }
+  // The model is not changed by losses, leaving the recovery window is all
+  // there is to undo.
+  recoveryState_ = BbrCongestionController::RecoveryState::NOT_RECOVERY;
+  endOfRecovery_ = undoState_->endOfRecovery;
+  undoState_ = folly::none;
+  VLOG(10) << __func__ << " undo loss cwnd=" << getCongestionWindow() << " "
+           << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        inflightBytes_,
+        getCongestionWindow(),
+        kCongestionSpuriousLossUndo,
+        bbrStateToString(state_),
+        bbrRecoveryStateToString(recoveryState_));
+  }
+}
+
 void BbrCongestionController::onPacketSent(const OutstandingPacket& packet) {
   if (!inflightBytes_ && isAppLimited()) {
     exitingQuiescene_ = true;
@@ -197,6 +230,7 @@ void BbrCongestionController::onPacketAcked(
     }
     if (ack.ackedPackets.back().time > *endOfRecovery_) {
       recoveryState_ = BbrCongestionController::RecoveryState::NOT_RECOVERY;
+      undoState_ = folly::none;
     } else {
       updateRecoveryWindowWithAck(ack.ackedBytes);
     }
@@ -540,6 +574,10 @@ bool BbrCongestionController::isAppLimited() const noexcept {
   return bandwidthSampler_ ? bandwidthSampler_->isAppLimited() : false;
 }
 
+uint64_t BbrCongestionController::getBandwidthEstimate() const noexcept {
+  return bandwidth() * std::chrono::microseconds(std::chrono::seconds(1));
+}
+
 uint64_t BbrCongestionController::getCongestionWindow() const noexcept {
   if (state_ == BbrCongestionController::BbrState::ProbeRtt) {
     if (config_.largeProbeRttCwnd) {
@@ -585,7 +623,7 @@ void BbrCongestionController::onRemoveBytesFromInflight(
   subtractAndCheckUnderflow(inflightBytes_, bytesToRemove);
 }
 
-std::string bbrStateToString(BbrCongestionController::BbrState state) {
+folly::StringPiece bbrStateToString(BbrCongestionController::BbrState state) {
   switch (state) {
     case BbrCongestionController::BbrState::Startup:
       return "Startup";
@@ -599,7 +637,7 @@ std::string bbrStateToString(BbrCongestionController::BbrState state) {
   return "BadBbrState";
 }
 
-std::string bbrRecoveryStateToString(
+folly::StringPiece bbrRecoveryStateToString(
     BbrCongestionController::RecoveryState recoveryState) {
   switch (recoveryState) {
     case BbrCongestionController::RecoveryState::NOT_RECOVERY:
@@ -163,7 +163,8 @@ class BbrCongestionController : public CongestionController {
   // TODO: i may move the configuration into a separate function
   BbrCongestionController(
       QuicConnectionStateBase& conn,
-      const BbrConfig& config);
+      const BbrConfig& config,
+      folly::Optional<uint64_t> initCwndBytes = folly::none);
 
   // TODO: these should probably come in as part of a builder. but I'm not sure
   // if the sampler interface is here to stay atm, so bear with me
@@ -198,6 +199,10 @@ class BbrCongestionController : public CongestionController {
 
   bool isAppLimited() const noexcept override;
 
+  void onSpuriousLoss(TimePoint lossTime) override;
+
+  uint64_t getBandwidthEstimate() const noexcept override;
+
   // TODO: some of these do not have to be in public API.
   bool inRecovery() const noexcept;
   BbrState state() const noexcept;
@@ -275,6 +280,16 @@ class BbrCongestionController : public CongestionController {
   // When a packet with send time later than endOfRecovery_ is acked, the
   // connection is no longer in recovery
   folly::Optional<TimePoint> endOfRecovery_;
+  // The state before the loss that started the current recovery, restored
+  // if all the packets lost during the recovery are acked after all.
+  struct UndoState {
+    folly::Optional<TimePoint> endOfRecovery;
+    // lossTime of the loss event that started the recovery
+    TimePoint lossTime;
+    // Packets lost during the recovery that are not known to be spurious
+    uint64_t lostPackets;
+  };
+  folly::Optional<UndoState> undoState_;
   // Cwnd in bytes
   uint64_t cwnd_;
   // Initial cwnd in bytes
@@ -336,8 +351,8 @@ class BbrCongestionController : public CongestionController {
 
 std::ostream& operator<<(std::ostream& os, const BbrCongestionController& bbr);
 
-std::string bbrStateToString(BbrCongestionController::BbrState state);
+folly::StringPiece bbrStateToString(BbrCongestionController::BbrState state);
 
-std::string bbrRecoveryStateToString(
+folly::StringPiece bbrRecoveryStateToString(
     BbrCongestionController::RecoveryState recoveryState);
 } // namespace quic
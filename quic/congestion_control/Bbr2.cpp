@@ -0,0 +1,578 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/Bbr2.h>
+#include <folly/Random.h>
+#include <quic/QuicConstants.h>
+#include <quic/congestion_control/CongestionControlFunctions.h>
+#include <quic/logging/QLoggerConstants.h>
+#include <quic/logging/QuicLogger.h>
+
+using namespace std::chrono_literals;
+
+namespace quic {
+
+Bbr2CongestionController::Bbr2CongestionController(
+    QuicConnectionStateBase& conn,
+    folly::Optional<uint64_t> initCwndBytes)
+    : conn_(conn),
+      cwnd_(initCwndBytes.value_or(
+          conn.udpSendPacketLen * conn.transportSettings.initCwndInMss)),
+      initialCwnd_(cwnd_) {}
+
+void Bbr2CongestionController::setConnectionEmulation(uint8_t) noexcept {
+  /* unsupported for BBR */
+}
+
+CongestionControlType Bbr2CongestionController::type() const noexcept {
+  return CongestionControlType::BBR2;
+}
+
+void Bbr2CongestionController::setRttSampler(
+    std::unique_ptr<BbrCongestionController::MinRttSampler> sampler) noexcept {
+  minRttSampler_ = std::move(sampler);
+}
+
+void Bbr2CongestionController::setBandwidthSampler(
+    std::unique_ptr<BbrCongestionController::BandwidthSampler>
+        sampler) noexcept {
+  bandwidthSampler_ = std::move(sampler);
+}
+
+bool Bbr2CongestionController::updateRoundTripCounter(
+    TimePoint largestAckedSentTime) noexcept {
+  if (largestAckedSentTime > endOfRoundTrip_) {
+    roundTripCounter_++;
+    endOfRoundTrip_ = Clock::now();
+    return true;
+  }
+  return false;
+}
+
+void Bbr2CongestionController::onPacketSent(const OutstandingPacket& packet) {
+  addAndCheckOverflow(inflightBytes_, packet.encodedSize);
+}
+
+void Bbr2CongestionController::onPacketAckOrLoss(
+    folly::Optional<AckEvent> ackEvent,
+    folly::Optional<LossEvent> lossEvent) {
+  auto prevInflightBytes = inflightBytes_;
+  if (ackEvent) {
+    subtractAndCheckUnderflow(inflightBytes_, ackEvent->ackedBytes);
+  }
+  if (lossEvent) {
+    subtractAndCheckUnderflow(inflightBytes_, lossEvent->lostBytes);
+    onPacketLoss(*lossEvent, prevInflightBytes);
+  }
+  if (ackEvent && ackEvent->largestAckedPacket.hasValue()) {
+    CHECK(!ackEvent->ackedPackets.empty());
+    onPacketAcked(*ackEvent, prevInflightBytes);
+  }
+}
+
+void Bbr2CongestionController::onPacketLoss(
+    const LossEvent& loss,
+    uint64_t prevInflightBytes) {
+  roundLostBytes_ += loss.lostBytes;
+  roundLossEvents_++;
+
+  if (loss.persistentCongestion) {
+    inflightLo_ = conn_.udpSendPacketLen * kMinCwndInMssForBbr;
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          inflightBytes_,
+          getCongestionWindow(),
+          kPersistentCongestion,
+          bbr2StateToString(state_));
+    }
+  }
+
+  if (isProbingBw() && lossTooHigh()) {
+    // Probing has put more in flight than the path can take without excessive
+    // loss. What was in flight when the loss was detected is the new upper
+    // bound, and we stop probing right away.
+    inflightHi_ = std::max<uint64_t>(
+        prevInflightBytes, calculateBdp(1.0) * kBbr2Beta);
+    transitToProbeBwDown(loss.lossTime);
+  }
+  updateCwnd(0);
+}
+
+void Bbr2CongestionController::onPacketAcked(
+    const AckEvent& ack,
+    uint64_t prevInflightBytes) {
+  if (ack.mrttSample && minRttSampler_) {
+    minRttSampler_->newRttSample(ack.mrttSample.value(), ack.ackTime);
+  }
+
+  bool newRoundTrip = updateRoundTripCounter(ack.ackedPackets.back().time);
+  bool lastAckedPacketAppLimited = ack.ackedPackets.back().isAppLimited;
+  if (bandwidthSampler_) {
+    bool wasAppLimited = bandwidthSampler_->isAppLimited();
+    bandwidthSampler_->onPacketAcked(ack, roundTripCounter_);
+    if (wasAppLimited && !bandwidthSampler_->isAppLimited()) {
+      if (conn_.pacer) {
+        conn_.pacer->setAppLimited(false);
+      }
+    }
+  }
+
+  roundAckedBytes_ += ack.ackedBytes;
+  roundAckedPackets_ += ack.ackedPackets.size();
+  roundCeMarkedPackets_ += ack.ecnCeMarked;
+  if (newRoundTrip) {
+    onRoundTripEnd(ack.ackTime, lastAckedPacketAppLimited);
+  }
+
+  checkStartupDone();
+  if (state_ == State::Drain && inflightBytes_ <= calculateBdp(1.0)) {
+    transitToProbeBwDown(ack.ackTime);
+  }
+  if (inProbeBw()) {
+    updateProbeBwState(ack.ackTime, prevInflightBytes, newRoundTrip);
+  }
+  checkProbeRtt(ack.ackTime, newRoundTrip);
+
+  updateCwnd(ack.ackedBytes);
+  updatePacing();
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        inflightBytes_,
+        getCongestionWindow(),
+        kCongestionPacketAck,
+        bbr2StateToString(state_));
+  }
+}
+
+bool Bbr2CongestionController::lossTooHigh() const noexcept {
+  return roundLostBytes_ > 0 &&
+      roundLostBytes_ >
+      (roundAckedBytes_ + roundLostBytes_) * kBbr2LossThreshold;
+}
+
+bool Bbr2CongestionController::ecnTooHigh() const noexcept {
+  return roundCeMarkedPackets_ > 0 &&
+      roundCeMarkedPackets_ > roundAckedPackets_ * kBbr2EcnThreshold;
+}
+
+void Bbr2CongestionController::onRoundTripEnd(
+    TimePoint ackTime,
+    bool appLimitedSample) {
+  bool ecnMarked = ecnTooHigh();
+  bool lossy = lossTooHigh() || ecnMarked;
+  if (state_ == State::Startup && !btlbwFound_) {
+    if (!appLimitedSample) {
+      auto bandwidthTarget =
+          previousStartupBandwidth_ * kExpectedStartupGrowth;
+      auto realBandwidth = bandwidth();
+      if (realBandwidth >= bandwidthTarget) {
+        previousStartupBandwidth_ = realBandwidth;
+        slowStartupRoundCounter_ = 0;
+      } else if (++slowStartupRoundCounter_ >= kStartupSlowGrowRoundLimit) {
+        btlbwFound_ = true;
+      }
+    }
+    if ((lossy && roundLossEvents_ >= kBbr2StartupFullLossCount) ||
+        ecnMarked) {
+      // Startup overshot the path. What was delivered in this round trip, or
+      // the BDP if it's larger, is the upper bound on inflight.
+      btlbwFound_ = true;
+      inflightHi_ = std::max(calculateBdp(1.0), roundAckedBytes_);
+    }
+  } else if (isProbingBw() && ecnMarked) {
+    // Like loss, the marks say probing went past what the bottleneck queue
+    // takes, so what was delivered in this round trip is the upper bound.
+    inflightHi_ =
+        std::max<uint64_t>(roundAckedBytes_, calculateBdp(1.0) * kBbr2Beta);
+    transitToProbeBwDown(ackTime);
+  } else if (state_ != State::Startup && !isProbingBw() && lossy) {
+    // Back off the lower bounds multiplicatively, but not below what was
+    // actually delivered in this round trip.
+    inflightLo_ = std::max<uint64_t>(
+        roundAckedBytes_, (inflightLo_ ? *inflightLo_ : cwnd_) * kBbr2Beta);
+    auto currentBandwidthLo = bandwidthLo_ ? *bandwidthLo_ : bandwidth();
+    if (currentBandwidthLo) {
+      Bandwidth latestBandwidth;
+      if (ackTime > roundStart_) {
+        latestBandwidth = Bandwidth(
+            roundAckedBytes_,
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                ackTime - roundStart_));
+      }
+      bandwidthLo_ =
+          std::max(latestBandwidth, currentBandwidthLo * kBbr2Beta);
+    }
+  }
+  roundStart_ = ackTime;
+  roundAckedBytes_ = 0;
+  roundLostBytes_ = 0;
+  roundLossEvents_ = 0;
+  roundAckedPackets_ = 0;
+  roundCeMarkedPackets_ = 0;
+}
+
+void Bbr2CongestionController::checkStartupDone() noexcept {
+  if (state_ == State::Startup && btlbwFound_) {
+    transitToDrain();
+  }
+}
+
+void Bbr2CongestionController::updateProbeBwState(
+    TimePoint ackTime,
+    uint64_t prevInflightBytes,
+    bool newRoundTrip) {
+  switch (state_) {
+    case State::ProbeBwDown:
+      if (isTimeToProbeBw(ackTime)) {
+        transitToProbeBwRefill();
+      } else if (inflightBytes_ <= inflightWithHeadroom()) {
+        transitToProbeBwCruise();
+      }
+      break;
+    case State::ProbeBwCruise:
+      if (isTimeToProbeBw(ackTime)) {
+        transitToProbeBwRefill();
+      }
+      break;
+    case State::ProbeBwRefill:
+      // Spend one round trip at the unbounded model so the pipe is full
+      // before probing above it.
+      if (roundTripCounter_ > probeBwStateRound_) {
+        transitToProbeBwUp(ackTime);
+      }
+      break;
+    case State::ProbeBwUp:
+      if (newRoundTrip && inflightHi_ &&
+          prevInflightBytes + conn_.udpSendPacketLen >= *inflightHi_) {
+        // We are using all of inflight_hi without too much loss, so raise
+        // it, faster every round trip.
+        *inflightHi_ += probeUpIncrement_;
+        probeUpIncrement_ *= 2;
+      }
+      if (ackTime - probeBwStateStart_ > minRtt() &&
+          prevInflightBytes >= calculateBdp(kBbr2ProbeBwUpPacingGain)) {
+        transitToProbeBwDown(ackTime);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+bool Bbr2CongestionController::isTimeToProbeBw(TimePoint ackTime) const
+    noexcept {
+  if (ackTime - probeBwStateStart_ >= probeWait_) {
+    return true;
+  }
+  // Probe at least as often as a Reno flow would grow its cwnd by the BDP, so
+  // that we aren't starved when sharing a bottleneck with one.
+  uint64_t maxRounds = std::min(
+      kBbr2MaxRoundsBetweenProbes,
+      calculateBdp(1.0) / conn_.udpSendPacketLen);
+  return roundTripCounter_ - lastProbeRound_ >=
+      std::max<uint64_t>(maxRounds, 1);
+}
+
+bool Bbr2CongestionController::isProbingBw() const noexcept {
+  return state_ == State::ProbeBwRefill || state_ == State::ProbeBwUp;
+}
+
+bool Bbr2CongestionController::inProbeBw() const noexcept {
+  return state_ == State::ProbeBwDown || state_ == State::ProbeBwCruise ||
+      isProbingBw();
+}
+
+uint64_t Bbr2CongestionController::inflightWithHeadroom() const noexcept {
+  auto bdp = calculateBdp(1.0);
+  if (!inflightHi_) {
+    return bdp;
+  }
+  return std::min<uint64_t>(bdp, *inflightHi_ * kBbr2Headroom);
+}
+
+void Bbr2CongestionController::checkProbeRtt(
+    TimePoint ackTime,
+    bool newRoundTrip) {
+  if (state_ != State::ProbeRtt && minRttSampler_ &&
+      minRttSampler_->minRttExpired()) {
+    transitToProbeRtt();
+  }
+  if (state_ != State::ProbeRtt) {
+    return;
+  }
+  // Same as BBRv1: wait for inflightBytes_ to reach the ProbeRtt cwnd, then
+  // stay there for max(1 RTT Round, kProbeRttDuration).
+  if (!earliestTimeToExitProbeRtt_ && inflightBytes_ <= probeRttCwnd()) {
+    earliestTimeToExitProbeRtt_ = ackTime + kProbeRttDuration;
+    probeRttRound_ = folly::none;
+  } else if (earliestTimeToExitProbeRtt_ && newRoundTrip) {
+    if (!probeRttRound_) {
+      probeRttRound_ = roundTripCounter_;
+    } else if (
+        roundTripCounter_ > *probeRttRound_ &&
+        *earliestTimeToExitProbeRtt_ < ackTime) {
+      exitProbeRtt(ackTime);
+    }
+  }
+}
+
+void Bbr2CongestionController::transitToDrain() noexcept {
+  state_ = State::Drain;
+  pacingGain_ = kBbr2DrainPacingGain;
+  cwndGain_ = kBbr2StartupCwndGain;
+}
+
+void Bbr2CongestionController::transitToProbeBwDown(TimePoint eventTime) {
+  state_ = State::ProbeBwDown;
+  pacingGain_ = kBbr2ProbeBwDownPacingGain;
+  cwndGain_ = kBbr2CwndGain;
+  probeBwStateStart_ = eventTime;
+  probeBwStateRound_ = roundTripCounter_;
+  lastProbeRound_ = roundTripCounter_;
+  // Randomize the wait so that flows sharing a bottleneck don't all probe at
+  // the same time.
+  probeWait_ = kBbr2MinProbeWait +
+      std::chrono::milliseconds(
+                   folly::Random::rand32(kBbr2ProbeWaitRandomness.count()));
+}
+
+void Bbr2CongestionController::transitToProbeBwCruise() noexcept {
+  state_ = State::ProbeBwCruise;
+  pacingGain_ = 1.0f;
+}
+
+void Bbr2CongestionController::transitToProbeBwRefill() noexcept {
+  state_ = State::ProbeBwRefill;
+  pacingGain_ = 1.0f;
+  probeBwStateRound_ = roundTripCounter_;
+  // The lower bounds only hold until the next probe.
+  inflightLo_ = folly::none;
+  bandwidthLo_ = folly::none;
+  probeUpIncrement_ = conn_.udpSendPacketLen;
+}
+
+void Bbr2CongestionController::transitToProbeBwUp(
+    TimePoint eventTime) noexcept {
+  state_ = State::ProbeBwUp;
+  pacingGain_ = kBbr2ProbeBwUpPacingGain;
+  probeBwStateStart_ = eventTime;
+  probeBwStateRound_ = roundTripCounter_;
+}
+
+void Bbr2CongestionController::transitToProbeRtt() noexcept {
+  state_ = State::ProbeRtt;
+  pacingGain_ = 1.0f;
+  priorCwnd_ = cwnd_;
+  earliestTimeToExitProbeRtt_ = folly::none;
+  probeRttRound_ = folly::none;
+  if (bandwidthSampler_) {
+    bandwidthSampler_->onAppLimited();
+  }
+}
+
+void Bbr2CongestionController::exitProbeRtt(TimePoint eventTime) {
+  if (minRttSampler_) {
+    minRttSampler_->timestampMinRtt(eventTime);
+  }
+  inflightLo_ = folly::none;
+  bandwidthLo_ = folly::none;
+  cwnd_ = std::max(cwnd_, priorCwnd_);
+  if (btlbwFound_) {
+    transitToProbeBwDown(eventTime);
+    transitToProbeBwCruise();
+  } else {
+    state_ = State::Startup;
+    pacingGain_ = kBbr2StartupPacingGain;
+    cwndGain_ = kBbr2StartupCwndGain;
+  }
+}
+
+std::chrono::microseconds Bbr2CongestionController::minRtt() const noexcept {
+  return minRttSampler_ ? minRttSampler_->minRtt() : 0us;
+}
+
+Bandwidth Bbr2CongestionController::bandwidth() const noexcept {
+  auto maxBandwidth =
+      bandwidthSampler_ ? bandwidthSampler_->getBandwidth() : Bandwidth();
+  if (bandwidthLo_ && *bandwidthLo_ < maxBandwidth) {
+    return *bandwidthLo_;
+  }
+  return maxBandwidth;
+}
+
+uint64_t Bbr2CongestionController::calculateBdp(float gain) const noexcept {
+  auto bandwidthEst = bandwidth();
+  auto minRttEst = minRtt();
+  if (!bandwidthEst || minRttEst == 0us) {
+    return gain * initialCwnd_;
+  }
+  uint64_t bdp = bandwidthEst * minRttEst;
+  return bdp * gain;
+}
+
+uint64_t Bbr2CongestionController::probeRttCwnd() const noexcept {
+  return std::max<uint64_t>(
+      calculateBdp(kBbr2ProbeRttCwndGain),
+      conn_.udpSendPacketLen * kMinCwndInMssForBbr);
+}
+
+void Bbr2CongestionController::updateCwnd(uint64_t ackedBytes) noexcept {
+  if (state_ != State::ProbeRtt) {
+    auto targetCwnd = calculateBdp(cwndGain_);
+    if (btlbwFound_) {
+      cwnd_ = std::min(targetCwnd, cwnd_ + ackedBytes);
+    } else if (
+        cwnd_ < targetCwnd || conn_.lossState.totalBytesAcked < initialCwnd_) {
+      cwnd_ += ackedBytes;
+    }
+  }
+
+  // Bound the cwnd by the loss model. inflight_hi only applies once in
+  // ProbeBw, with headroom left for other flows while cruising.
+  uint64_t cap = std::numeric_limits<uint64_t>::max();
+  if (inflightHi_) {
+    if (state_ == State::ProbeBwCruise || state_ == State::ProbeRtt) {
+      cap = inflightWithHeadroom();
+    } else if (inProbeBw()) {
+      cap = *inflightHi_;
+    }
+  }
+  if (inflightLo_) {
+    cap = std::min(cap, *inflightLo_);
+  }
+  cwnd_ = boundedCwnd(
+      std::min(cwnd_, cap),
+      conn_.udpSendPacketLen,
+      conn_.transportSettings.maxCwndInMss,
+      kMinCwndInMssForBbr);
+}
+
+void Bbr2CongestionController::updatePacing() noexcept {
+  if (!conn_.pacer) {
+    return;
+  }
+  auto bandwidthEstimate = bandwidth();
+  if (!bandwidthEstimate) {
+    return;
+  }
+  auto mrtt = minRtt();
+  uint64_t targetPacingWindow = bandwidthEstimate * pacingGain_ * mrtt;
+  if (btlbwFound_) {
+    pacingWindow_ = targetPacingWindow;
+  } else if (
+      !pacingWindow_ &&
+      conn_.lossState.mrtt != std::chrono::microseconds::max() &&
+      conn_.lossState.mrtt != 0us &&
+      conn_.lossState.mrtt >= conn_.transportSettings.pacingTimerTickInterval) {
+    pacingWindow_ = initialCwnd_;
+    mrtt = conn_.lossState.mrtt;
+  } else {
+    pacingWindow_ = std::max(pacingWindow_, targetPacingWindow);
+  }
+  conn_.pacer->refreshPacingRate(pacingWindow_, mrtt);
+}
+
+void Bbr2CongestionController::setAppIdle(
+    bool idle,
+    TimePoint /* eventTime */) noexcept {
+  if (conn_.qLogger) {
+    conn_.qLogger->addAppIdleUpdate(kAppIdle, idle);
+  }
+}
+
+void Bbr2CongestionController::setAppLimited() {
+  if (inflightBytes_ > getCongestionWindow()) {
+    return;
+  }
+  if (bandwidthSampler_) {
+    bandwidthSampler_->onAppLimited();
+  }
+  if (conn_.pacer) {
+    conn_.pacer->setAppLimited(true);
+  }
+}
+
+bool Bbr2CongestionController::isAppLimited() const noexcept {
+  return bandwidthSampler_ ? bandwidthSampler_->isAppLimited() : false;
+}
+
+uint64_t Bbr2CongestionController::getBandwidthEstimate() const noexcept {
+  return bandwidth() * std::chrono::microseconds(std::chrono::seconds(1));
+}
+
+uint64_t Bbr2CongestionController::getCongestionWindow() const noexcept {
+  if (state_ == State::ProbeRtt) {
+    return std::min(cwnd_, probeRttCwnd());
+  }
+  return cwnd_;
+}
+
+uint64_t Bbr2CongestionController::getWritableBytes() const noexcept {
+  return getCongestionWindow() > inflightBytes_
+      ? getCongestionWindow() - inflightBytes_
+      : 0;
+}
+
+void Bbr2CongestionController::onRemoveBytesFromInflight(
+    uint64_t bytesToRemove) {
+  subtractAndCheckUnderflow(inflightBytes_, bytesToRemove);
+}
+
+Bbr2CongestionController::State Bbr2CongestionController::state() const
+    noexcept {
+  return state_;
+}
+
+folly::Optional<uint64_t> Bbr2CongestionController::inflightHi() const
+    noexcept {
+  return inflightHi_;
+}
+
+folly::Optional<uint64_t> Bbr2CongestionController::inflightLo() const
+    noexcept {
+  return inflightLo_;
+}
+
+folly::StringPiece bbr2StateToString(Bbr2CongestionController::State state) {
+  switch (state) {
+    case Bbr2CongestionController::State::Startup:
+      return "Startup";
+    case Bbr2CongestionController::State::Drain:
+      return "Drain";
+    case Bbr2CongestionController::State::ProbeBwDown:
+      return "ProbeBwDown";
+    case Bbr2CongestionController::State::ProbeBwCruise:
+      return "ProbeBwCruise";
+    case Bbr2CongestionController::State::ProbeBwRefill:
+      return "ProbeBwRefill";
+    case Bbr2CongestionController::State::ProbeBwUp:
+      return "ProbeBwUp";
+    case Bbr2CongestionController::State::ProbeRtt:
+      return "ProbeRtt";
+  }
+  return "BadBbr2State";
+}
+
+std::ostream& operator<<(
+    std::ostream& os,
+    const Bbr2CongestionController& bbr) {
+  os << "Bbr2: state=" << bbr2StateToString(bbr.state_)
+     << ", cwnd=" << bbr.cwnd_ << ", pacingWindow_=" << bbr.pacingWindow_
+     << ", pacingGain_=" << bbr.pacingGain_
+     << ", minRtt=" << bbr.minRtt().count()
+     << "us, bandwidth=" << bbr.bandwidth();
+  if (bbr.inflightHi_) {
+    os << ", inflightHi=" << *bbr.inflightHi_;
+  }
+  if (bbr.inflightLo_) {
+    os << ", inflightLo=" << *bbr.inflightLo_;
+  }
+  return os;
+}
+
+} // namespace quic
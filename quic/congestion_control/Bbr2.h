@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/congestion_control/Bbr.h>
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+// Pacing gain during Startup
+constexpr float kBbr2StartupPacingGain = 2.77f; // 4ln(2)
+// Cwnd gain during Startup
+constexpr float kBbr2StartupCwndGain = 2.0f;
+// Pacing gain during Drain
+constexpr float kBbr2DrainPacingGain = 1.0f / kBbr2StartupPacingGain;
+// Cwnd gain after Startup
+constexpr float kBbr2CwndGain = 2.0f;
+// Pacing gain of ProbeBwDown
+constexpr float kBbr2ProbeBwDownPacingGain = 0.9f;
+// Pacing gain of ProbeBwUp
+constexpr float kBbr2ProbeBwUpPacingGain = 1.25f;
+// A round trip with a larger share of its bytes lost has too much inflight
+constexpr float kBbr2LossThreshold = 0.02f;
+// A round trip with a larger share of its packets CE marked has too much
+// inflight
+constexpr float kBbr2EcnThreshold = 0.5f;
+// Multiplicative decrease of the inflight and bandwidth bounds on loss
+constexpr float kBbr2Beta = 0.7f;
+// Share of inflight_hi used while cruising, leaving room for other flows
+constexpr float kBbr2Headroom = 0.85f;
+// Number of loss events in a lossy round trip that end Startup
+constexpr uint32_t kBbr2StartupFullLossCount = 8;
+// Cwnd during ProbeRtt, as a fraction of the BDP
+constexpr float kBbr2ProbeRttCwndGain = 0.5f;
+// How often to ProbeRtt. This is also the expiration of the min rtt sample.
+constexpr std::chrono::seconds kBbr2ProbeRttInterval{5};
+// Bandwidth is probed at most this many round trips apart
+constexpr uint64_t kBbr2MaxRoundsBetweenProbes = 63;
+// Bandwidth is probed at least every kBbr2MinProbeWait plus a random time of
+// up to kBbr2ProbeWaitRandomness
+constexpr std::chrono::milliseconds kBbr2MinProbeWait{2000};
+constexpr std::chrono::milliseconds kBbr2ProbeWaitRandomness{1000};
+
+/**
+ * BBRv2, as described in draft-cardwell-iccrg-bbr-congestion-control-02.
+ *
+ * On top of the BBRv1 model of bottleneck bandwidth and min rtt, it keeps
+ * bounds on the inflight bytes and the bandwidth that come from loss: a round
+ * trip that loses more than kBbr2LossThreshold of its bytes lowers
+ * inflight_lo and bw_lo, and loss while probing for bandwidth sets
+ * inflight_hi. ProbeBw cycles through Down, Cruise, Refill and Up, and only
+ * probes above inflight_hi every few seconds or round trips.
+ *
+ * The CE marks reported in AckEvent count like loss: a round trip with more
+ * than kBbr2EcnThreshold of its acked packets CE marked ends Startup, sets
+ * inflight_hi while probing and lowers the lower bounds otherwise.
+ */
+class Bbr2CongestionController : public CongestionController {
+ public:
+  explicit Bbr2CongestionController(
+      QuicConnectionStateBase& conn,
+      folly::Optional<uint64_t> initCwndBytes = folly::none);
+
+  void setRttSampler(
+      std::unique_ptr<BbrCongestionController::MinRttSampler> sampler) noexcept;
+  void setBandwidthSampler(
+      std::unique_ptr<BbrCongestionController::BandwidthSampler>
+          sampler) noexcept;
+
+  enum class State : uint8_t {
+    Startup,
+    Drain,
+    ProbeBwDown,
+    ProbeBwCruise,
+    ProbeBwRefill,
+    ProbeBwUp,
+    ProbeRtt,
+  };
+
+  void onRemoveBytesFromInflight(uint64_t bytesToRemove) override;
+  void onPacketSent(const OutstandingPacket&) override;
+  void onPacketAckOrLoss(
+      folly::Optional<AckEvent> ackEvent,
+      folly::Optional<LossEvent> lossEvent) override;
+  uint64_t getWritableBytes() const noexcept override;
+
+  uint64_t getCongestionWindow() const noexcept override;
+  void setConnectionEmulation(uint8_t) noexcept override;
+  CongestionControlType type() const noexcept override;
+  void setAppIdle(bool idle, TimePoint eventTime) noexcept override;
+  void setAppLimited() override;
+
+  bool isAppLimited() const noexcept override;
+
+  uint64_t getBandwidthEstimate() const noexcept override;
+
+  State state() const noexcept;
+  folly::Optional<uint64_t> inflightHi() const noexcept;
+  folly::Optional<uint64_t> inflightLo() const noexcept;
+
+ private:
+  /* prevInflightBytes: the inflightBytes_ value before the current
+   *                    onPacketAckOrLoss invocation.
+   */
+  void onPacketAcked(const AckEvent& ack, uint64_t prevInflightBytes);
+  void onPacketLoss(const LossEvent& loss, uint64_t prevInflightBytes);
+
+  /*
+   * Return if we are at the start of a new round trip.
+   */
+  bool updateRoundTripCounter(TimePoint largestAckedSentTime) noexcept;
+  /**
+   * Apply the loss and delivery of the round trip that just ended, and start
+   * a new one.
+   *
+   * appLimitedSample: whether the last acked packet was sent app-limited.
+   */
+  void onRoundTripEnd(TimePoint ackTime, bool appLimitedSample);
+  // Whether the current round trip has lost too many bytes
+  bool lossTooHigh() const noexcept;
+  bool ecnTooHigh() const noexcept;
+
+  void checkStartupDone() noexcept;
+  void updateProbeBwState(
+      TimePoint ackTime,
+      uint64_t prevInflightBytes,
+      bool newRoundTrip);
+  bool isTimeToProbeBw(TimePoint ackTime) const noexcept;
+  bool isProbingBw() const noexcept;
+  bool inProbeBw() const noexcept;
+  // Inflight target while cruising, leaving headroom below inflight_hi
+  uint64_t inflightWithHeadroom() const noexcept;
+  void checkProbeRtt(TimePoint ackTime, bool newRoundTrip);
+
+  void transitToDrain() noexcept;
+  void transitToProbeBwDown(TimePoint eventTime);
+  void transitToProbeBwCruise() noexcept;
+  void transitToProbeBwRefill() noexcept;
+  void transitToProbeBwUp(TimePoint eventTime) noexcept;
+  void transitToProbeRtt() noexcept;
+  void exitProbeRtt(TimePoint eventTime);
+
+  uint64_t calculateBdp(float gain) const noexcept;
+  uint64_t probeRttCwnd() const noexcept;
+  void updateCwnd(uint64_t ackedBytes) noexcept;
+  void updatePacing() noexcept;
+  std::chrono::microseconds minRtt() const noexcept;
+  // The bandwidth model: the max bandwidth bounded by bw_lo
+  Bandwidth bandwidth() const noexcept;
+
+  QuicConnectionStateBase& conn_;
+  State state_{State::Startup};
+
+  // Number of round trips the connection has witnessed
+  uint64_t roundTripCounter_{0};
+  // When a packet with send time later than endOfRoundTrip_ is acked, the
+  // current round strip is ended.
+  TimePoint endOfRoundTrip_;
+  // Start of the current round trip, and the bytes acked, lost and the number
+  // of loss events in it.
+  TimePoint roundStart_;
+  uint64_t roundAckedBytes_{0};
+  uint64_t roundLostBytes_{0};
+  uint32_t roundLossEvents_{0};
+  uint64_t roundAckedPackets_{0};
+  uint64_t roundCeMarkedPackets_{0};
+
+  // Cwnd in bytes
+  uint64_t cwnd_;
+  // Initial cwnd in bytes
+  uint64_t initialCwnd_;
+  // Cwnd before ProbeRtt, restored when leaving it
+  uint64_t priorCwnd_{0};
+  // inflight bytes
+  uint64_t inflightBytes_{0};
+  // Number of bytes we expect to send over on RTT when paced write.
+  uint64_t pacingWindow_{0};
+
+  float cwndGain_{kBbr2StartupCwndGain};
+  float pacingGain_{kBbr2StartupPacingGain};
+
+  // Whether we have found the bottleneck link bandwidth
+  bool btlbwFound_{false};
+  Bandwidth previousStartupBandwidth_;
+  // Counter of continuous round trips in Startup that bandwidth isn't growing
+  // fast enough
+  uint8_t slowStartupRoundCounter_{0};
+
+  // Upper bound on inflight, set by loss while probing for bandwidth.
+  folly::Optional<uint64_t> inflightHi_;
+  // Lower bounds on inflight and bandwidth, set by loss outside of probing
+  // and reset every time we probe.
+  folly::Optional<uint64_t> inflightLo_;
+  folly::Optional<Bandwidth> bandwidthLo_;
+
+  // Start of the current ProbeBwDown or ProbeBwUp state. Cruise and Refill
+  // don't reset it, so the wait before the next probe counts from Down.
+  TimePoint probeBwStateStart_;
+  // Round trip count at the start of the current ProbeBw state
+  uint64_t probeBwStateRound_{0};
+  // Round trip count at the start of the last ProbeBwDown
+  uint64_t lastProbeRound_{0};
+  // Wall clock time to wait after ProbeBwDown before probing again
+  std::chrono::milliseconds probeWait_{kBbr2MinProbeWait};
+  // How much inflight_hi grows by in the next round trip of ProbeBwUp
+  uint64_t probeUpIncrement_{0};
+
+  // Once in ProbeRtt state, we cannot exit ProbeRtt before at least we spend
+  // some duration with low inflight bytes. earliestTimeToExitProbeRtt_ is that
+  // time point.
+  folly::Optional<TimePoint> earliestTimeToExitProbeRtt_;
+  // We also cannot exit ProbeRtt if are not at least at the low inflight bytes
+  // mode for one RTT round. probeRttRound_ tracks that.
+  folly::Optional<uint64_t> probeRttRound_;
+
+  std::unique_ptr<BbrCongestionController::MinRttSampler> minRttSampler_;
+  std::unique_ptr<BbrCongestionController::BandwidthSampler>
+      bandwidthSampler_;
+
+  friend std::ostream& operator<<(
+      std::ostream& os,
+      const Bbr2CongestionController& bbr);
+};
+
+std::ostream& operator<<(
+    std::ostream& os,
+    const Bbr2CongestionController& bbr);
+
+folly::StringPiece bbr2StateToString(Bbr2CongestionController::State state);
+} // namespace quic
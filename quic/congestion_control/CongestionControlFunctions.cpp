@@ -54,4 +54,42 @@ PacingRate calculatePacingRate(
         .setBurstSize(burstPerInterval)
         .build();
 }
+
+CwndValidator::CwndValidator(const QuicConnectionStateBase& conn)
+    : conn_(conn) {}
+
+uint64_t CwndValidator::onPacketSent(
+    const OutstandingPacket& packet,
+    uint64_t inflightBytes,
+    uint64_t cwndBytes) {
+  auto srtt = conn_.lossState.srtt == 0us ? conn_.transportSettings.initialRtt
+                                          : conn_.lossState.srtt;
+  if (inflightBytes == 0 && lastSendTime_ &&
+      packet.time - *lastSendTime_ > srtt + 4 * conn_.lossState.rttvar) {
+    cwndBytes = std::min(
+        cwndBytes,
+        boundedCwnd(
+            conn_.transportSettings.initCwndInMss * conn_.udpSendPacketLen,
+            conn_.udpSendPacketLen,
+            conn_.transportSettings.maxCwndInMss,
+            conn_.transportSettings.minCwndInMss));
+    lastPeriodInflightBytes_ = 0;
+    periodInflightBytes_ = 0;
+    periodStart_ = packet.time;
+  }
+  lastSendTime_ = packet.time;
+  if (packet.time - periodStart_ > srtt) {
+    lastPeriodInflightBytes_ = periodInflightBytes_;
+    periodInflightBytes_ = 0;
+    periodStart_ = packet.time;
+  }
+  periodInflightBytes_ =
+      std::max(periodInflightBytes_, inflightBytes + packet.encodedSize);
+  return cwndBytes;
+}
+
+bool CwndValidator::isCwndValidated(uint64_t cwndBytes) const noexcept {
+  return 2 * std::max(periodInflightBytes_, lastPeriodInflightBytes_) >=
+      cwndBytes;
+}
 } // namespace quic
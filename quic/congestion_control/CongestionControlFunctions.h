@@ -27,6 +27,48 @@ PacingRate calculatePacingRate(
     uint64_t minCwndInMss,
     std::chrono::microseconds rtt);
 
+/**
+ * Congestion window validation after RFC 7661, for the controllers that
+ * enable it with TransportSettings::cwndValidation.
+ *
+ * The window is validated while the connection uses at least half of it,
+ * as seen by the largest bytes in flight over the last two rtts. Acks must
+ * not grow a window that is not validated, as they say nothing about
+ * whether the path can carry it; otherwise a connection that only sends
+ * small requests builds a window that its first large response then
+ * bursts into. Once the connection went idle for longer than an RTO, the
+ * window is stale, and restarts at no more than the initial window (RFC
+ * 2861).
+ */
+class CwndValidator {
+ public:
+  explicit CwndValidator(const QuicConnectionStateBase& conn);
+
+  /**
+   * Called with each packet sent, before it is counted in inflightBytes.
+   * Returns the window to use from then on, which is less than cwndBytes
+   * if the connection restarts after idle.
+   */
+  uint64_t onPacketSent(
+      const OutstandingPacket& packet,
+      uint64_t inflightBytes,
+      uint64_t cwndBytes);
+
+  /**
+   * Whether acks may grow the window.
+   */
+  bool isCwndValidated(uint64_t cwndBytes) const noexcept;
+
+ private:
+  const QuicConnectionStateBase& conn_;
+  folly::Optional<TimePoint> lastSendTime_;
+  // The largest bytes in flight during the current and the last period of
+  // an srtt
+  TimePoint periodStart_;
+  uint64_t periodInflightBytes_{0};
+  uint64_t lastPeriodInflightBytes_{0};
+};
+
 template <class T1, class T2>
 void addAndCheckOverflow(T1& value, const T2& toAdd) {
   if (UNLIKELY(std::numeric_limits<T1>::max() - toAdd < value)) {
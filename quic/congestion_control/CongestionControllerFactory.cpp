@@ -9,42 +9,132 @@
 #include <quic/congestion_control/CongestionControllerFactory.h>
 
 #include <quic/congestion_control/Bbr.h>
+#include <quic/congestion_control/Bbr2.h>
 #include <quic/congestion_control/BbrBandwidthSampler.h>
 #include <quic/congestion_control/BbrRttSampler.h>
 #include <quic/congestion_control/Copa.h>
 #include <quic/congestion_control/NewReno.h>
+#include <quic/congestion_control/Prague.h>
 #include <quic/congestion_control/QuicCubic.h>
+#include <quic/congestion_control/StaticRate.h>
 
+#include <limits>
 #include <memory>
 
 namespace quic {
+std::unique_ptr<CongestionController>
+CongestionControllerFactory::makeCongestionControllerFromCwnd(
+    QuicConnectionStateBase& conn,
+    CongestionControlType type,
+    uint64_t /* initCwndBytes */) {
+  return makeCongestionController(conn, type);
+}
+
 std::unique_ptr<CongestionController>
 DefaultCongestionControllerFactory::makeCongestionController(
     QuicConnectionStateBase& conn,
     CongestionControlType type) {
+  return make(conn, type, folly::none);
+}
+
+std::unique_ptr<CongestionController>
+DefaultCongestionControllerFactory::makeCongestionControllerFromCwnd(
+    QuicConnectionStateBase& conn,
+    CongestionControlType type,
+    uint64_t initCwndBytes) {
+  return make(conn, type, initCwndBytes);
+}
+
+std::unique_ptr<CongestionController> DefaultCongestionControllerFactory::make(
+    QuicConnectionStateBase& conn,
+    CongestionControlType type,
+    folly::Optional<uint64_t> initCwndBytes) {
   std::unique_ptr<CongestionController> congestionController;
   switch (type) {
     case CongestionControlType::NewReno:
-      congestionController = std::make_unique<NewReno>(conn);
+      congestionController = std::make_unique<NewReno>(conn, initCwndBytes);
       break;
     case CongestionControlType::Cubic:
-      congestionController = std::make_unique<Cubic>(conn);
+      congestionController = std::make_unique<Cubic>(
+          conn,
+          std::numeric_limits<uint64_t>::max(),
+          true /* tcpFriendly */,
+          false /* ackTrain */,
+          false /* spreadAcrossRtt */,
+          initCwndBytes);
       break;
     case CongestionControlType::Copa:
-      congestionController = std::make_unique<Copa>(conn);
+      congestionController = std::make_unique<Copa>(conn, initCwndBytes);
       break;
     case CongestionControlType::BBR: {
       BbrCongestionController::BbrConfig config;
-      auto bbr = std::make_unique<BbrCongestionController>(conn, config);
+      auto bbr = std::make_unique<BbrCongestionController>(
+          conn, config, initCwndBytes);
       bbr->setRttSampler(std::make_unique<BbrRttSampler>(
           std::chrono::seconds(kDefaultRttSamplerExpiration)));
       bbr->setBandwidthSampler(std::make_unique<BbrBandwidthSampler>(conn));
       congestionController = std::move(bbr);
       break;
     }
+    case CongestionControlType::BBR2: {
+      auto bbr2 =
+          std::make_unique<Bbr2CongestionController>(conn, initCwndBytes);
+      bbr2->setRttSampler(
+          std::make_unique<BbrRttSampler>(kBbr2ProbeRttInterval));
+      bbr2->setBandwidthSampler(std::make_unique<BbrBandwidthSampler>(conn));
+      congestionController = std::move(bbr2);
+      break;
+    }
+    case CongestionControlType::Prague:
+      congestionController = std::make_unique<Prague>(conn, initCwndBytes);
+      break;
+    case CongestionControlType::StaticRate:
+      congestionController = std::make_unique<StaticRate>(conn);
+      break;
     case CongestionControlType::None:
       break;
   }
   return congestionController;
 }
+
+PathCongestionControlPolicy::PathCongestionControlPolicy(
+    uint64_t highBdpBytes,
+    double highLossRate)
+    : highBdpBytes_(highBdpBytes), highLossRate_(highLossRate) {}
+
+folly::Optional<CongestionControlType>
+PathCongestionControlPolicy::selectCongestionController(
+    const QuicConnectionStateBase& conn) {
+  if (!conn.congestionController ||
+      conn.lossState.totalBytesSent < kPathPolicyMinBytesSent ||
+      conn.lossState.mrtt == std::chrono::microseconds::max() ||
+      conn.lossState.srtt == 0us) {
+    return folly::none;
+  }
+  const auto& controller = *conn.congestionController;
+  auto type = controller.type();
+  if (type != CongestionControlType::Cubic &&
+      type != CongestionControlType::BBR) {
+    return folly::none;
+  }
+  // Without a bandwidth estimate, the cwnd is what the path carries per
+  // srtt.
+  auto bandwidth = controller.getBandwidthEstimate();
+  uint64_t bdpBytes = bandwidth
+      ? bandwidth * conn.lossState.mrtt.count() /
+          std::chrono::microseconds(std::chrono::seconds(1)).count()
+      : controller.getCongestionWindow() * conn.lossState.mrtt.count() /
+          conn.lossState.srtt.count();
+  auto lossRate = static_cast<double>(conn.lossState.totalBytesRetransmitted) /
+      conn.lossState.totalBytesSent;
+  if (type == CongestionControlType::Cubic &&
+      (bdpBytes >= highBdpBytes_ || lossRate >= highLossRate_)) {
+    return CongestionControlType::BBR;
+  }
+  if (type == CongestionControlType::BBR && bdpBytes < highBdpBytes_ / 2 &&
+      lossRate < highLossRate_ / 2) {
+    return CongestionControlType::Cubic;
+  }
+  return folly::none;
+}
 } // namespace quic
@@ -10,6 +10,8 @@
 
 #include <quic/QuicConstants.h>
 
+#include <folly/Optional.h>
+
 #include <memory>
 
 namespace quic {
@@ -28,6 +30,18 @@ class CongestionControllerFactory {
   virtual std::unique_ptr<CongestionController> makeCongestionController(
       QuicConnectionStateBase& conn,
       CongestionControlType type) = 0;
+
+  /**
+   * Makes the controller a connection switches to, which starts from
+   * initCwndBytes, the cwnd the previous controller found, rather than from
+   * the initial cwnd of the transport settings. Factories that do not
+   * override it make the controller from the settings.
+   */
+  virtual std::unique_ptr<CongestionController>
+  makeCongestionControllerFromCwnd(
+      QuicConnectionStateBase& conn,
+      CongestionControlType type,
+      uint64_t initCwndBytes);
 };
 
 class DefaultCongestionControllerFactory : public CongestionControllerFactory {
@@ -37,6 +51,59 @@ class DefaultCongestionControllerFactory : public CongestionControllerFactory {
   std::unique_ptr<CongestionController> makeCongestionController(
       QuicConnectionStateBase& conn,
       CongestionControlType type) override;
+
+  std::unique_ptr<CongestionController> makeCongestionControllerFromCwnd(
+      QuicConnectionStateBase& conn,
+      CongestionControlType type,
+      uint64_t initCwndBytes) override;
+
+ private:
+  std::unique_ptr<CongestionController> make(
+      QuicConnectionStateBase& conn,
+      CongestionControlType type,
+      folly::Optional<uint64_t> initCwndBytes);
+};
+
+/**
+ * Picks the congestion controller of a connection from what it observed of
+ * its path. The transport asks once every kCongestionControlPolicyInterval,
+ * and switches its controller, keeping the cwnd and the bytes in flight,
+ * to the type returned.
+ */
+class CongestionControlPolicy {
+ public:
+  virtual ~CongestionControlPolicy() = default;
+
+  /**
+   * Returns the controller the connection should use, or none to keep the
+   * one it has.
+   */
+  virtual folly::Optional<CongestionControlType> selectCongestionController(
+      const QuicConnectionStateBase& conn) = 0;
+};
+
+/**
+ * Moves connections that use Cubic to BBR once their bandwidth delay product
+ * or their loss rate is high, as Cubic leaves such paths underused, and back
+ * to Cubic once both are below half of that, so that a connection near the
+ * thresholds does not flip between the two. The loss rate is that of the
+ * bytes retransmitted to those sent. Connections that use other controllers
+ * are left alone.
+ */
+class PathCongestionControlPolicy : public CongestionControlPolicy {
+ public:
+  explicit PathCongestionControlPolicy(
+      uint64_t highBdpBytes = kPathPolicyHighBdpBytes,
+      double highLossRate = kPathPolicyHighLossRate);
+
+  ~PathCongestionControlPolicy() override = default;
+
+  folly::Optional<CongestionControlType> selectCongestionController(
+      const QuicConnectionStateBase& conn) override;
+
+ private:
+  const uint64_t highBdpBytes_;
+  const double highLossRate_;
 };
 
 } // namespace quic
@@ -16,21 +16,26 @@ namespace quic {
 
 using namespace std::chrono;
 
-Copa::Copa(QuicConnectionStateBase& conn)
+Copa::Copa(
+    QuicConnectionStateBase& conn,
+    folly::Optional<uint64_t> initCwndBytes)
     : conn_(conn),
-      cwndBytes_(conn.transportSettings.initCwndInMss * conn.udpSendPacketLen),
+      cwndBytes_(initCwndBytes.value_or(
+          conn.transportSettings.initCwndInMss * conn.udpSendPacketLen)),
       isSlowStart_(true),
       minRTTFilter_(kMinRTTWindowLength.count(), 0us, 0),
       standingRTTFilter_(
           100000, /*100ms*/
           0us,
-          0) {
+          0),
+      maxRTTFilter_(kMinRTTWindowLength.count(), 0us, 0) {
   VLOG(10) << __func__ << " writable=" << getWritableBytes()
            << " cwnd=" << cwndBytes_ << " inflight=" << bytesInFlight_ << " "
            << conn_;
   if (conn_.transportSettings.latencyFactor.hasValue()) {
     latencyFactor_ = conn_.transportSettings.latencyFactor.value();
   }
+  latencyFactorInverse_ = 1 / latencyFactor_;
 }
 
 void Copa::onRemoveBytesFromInflight(uint64_t bytes) {
@@ -190,6 +195,11 @@ void Copa::onPacketAcked(const AckEvent& ack) {
            << " estimated queuing delay microsec =" << delayInMicroSec << " "
            << conn_;
 
+  if (conn_.transportSettings.copaModeSwitching) {
+    updateMode(rttMin, microseconds(rttStandingMicroSec), ack);
+  }
+  auto latencyFactor = getLatencyFactor();
+
   bool increaseCwnd = false;
   if (delayInMicroSec == 0) {
     // taking care of inf targetRate case here, this happens in beginning where
@@ -197,7 +207,7 @@ void Copa::onPacketAcked(const AckEvent& ack) {
     increaseCwnd = true;
   } else {
     auto targetRate = (1.0 * conn_.udpSendPacketLen * 1000000) /
-        (latencyFactor_ * delayInMicroSec);
+        (latencyFactor * delayInMicroSec);
     auto currentRate = (1.0 * cwndBytes_ * 1000000) / rttStandingMicroSec;
 
     VLOG(10) << __func__ << " estimated target rate=" << targetRate
@@ -235,7 +245,7 @@ void Copa::onPacketAcked(const AckEvent& ack) {
       }
       uint64_t addition = (ack.ackedPackets.size() * conn_.udpSendPacketLen *
                            conn_.udpSendPacketLen * velocityState_.velocity) /
-          (latencyFactor_ * cwndBytes_);
+          (latencyFactor * cwndBytes_);
       VLOG(10) << __func__ << " increasing cwnd from=" << cwndBytes_ << " by "
                << addition << " " << conn_;
       addAndCheckOverflow(cwndBytes_, addition);
@@ -251,7 +261,7 @@ void Copa::onPacketAcked(const AckEvent& ack) {
     }
     uint64_t reduction = (ack.ackedPackets.size() * conn_.udpSendPacketLen *
                           conn_.udpSendPacketLen * velocityState_.velocity) /
-        (latencyFactor_ * cwndBytes_);
+        (latencyFactor * cwndBytes_);
     VLOG(10) << __func__ << " decreasing cwnd from=" << cwndBytes_ << " by "
              << reduction << " " << conn_;
     isSlowStart_ = false;
@@ -262,11 +272,69 @@ void Copa::onPacketAcked(const AckEvent& ack) {
             cwndBytes_ -
                 conn_.transportSettings.minCwndInMss * conn_.udpSendPacketLen));
   }
-  if (conn_.pacer) {
-    conn_.pacer->refreshPacingRate(cwndBytes_ * 2, conn_.lossState.srtt);
+  refreshPacingRate();
+}
+
+/**
+ * A flow that does not react to delay keeps the queue from draining. So if
+ * the standing queueing delay has not come down to nearly zero, compared to
+ * the max queueing delay of the last few rtts, for kCopaCompetitiveModeRtts,
+ * Copa competes with the flow instead of yielding to it.
+ */
+void Copa::updateMode(
+    microseconds rttMin,
+    microseconds rttStanding,
+    const AckEvent& ack) {
+  maxRTTFilter_.SetWindowLength(
+      kCopaMaxRTTWindowInRtts * conn_.lossState.srtt.count());
+  maxRTTFilter_.Update(
+      conn_.lossState.lrtt,
+      duration_cast<microseconds>(ack.ackTime.time_since_epoch()).count());
+  auto maxQueueingDelay = maxRTTFilter_.GetBest() - rttMin;
+  auto queueingDelay = rttStanding - rttMin;
+  if (!lastQueueEmptyTime_ ||
+      queueingDelay.count() <=
+          kCopaNearlyEmptyQueue * maxQueueingDelay.count()) {
+    lastQueueEmptyTime_ = ack.ackTime;
+  }
+  bool competitive = ack.ackTime - *lastQueueEmptyTime_ >
+      conn_.lossState.srtt * kCopaCompetitiveModeRtts;
+  if (competitive != competitiveMode_) {
+    VLOG(10) << __func__ << " competitive mode " << competitiveMode_ << " -> "
+             << competitive << " queueing delay=" << queueingDelay.count()
+             << " max queueing delay=" << maxQueueingDelay.count() << " "
+             << conn_;
+    competitiveMode_ = competitive;
+    latencyFactorInverse_ = 1 / latencyFactor_;
+    lastLatencyFactorReduction_ = folly::none;
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          bytesInFlight_,
+          getCongestionWindow(),
+          competitive ? kCopaCompetitiveMode : kCopaDefaultMode);
+    }
+  } else if (competitiveMode_) {
+    // One more every cwnd acked, as long as there is no loss.
+    latencyFactorInverse_ += 1.0 * ack.ackedBytes / cwndBytes_;
   }
 }
 
+void Copa::refreshPacingRate() {
+  if (!conn_.pacer) {
+    return;
+  }
+  auto rtt = conn_.lossState.srtt;
+  if (conn_.transportSettings.copaModeSwitching) {
+    // The standing rtt is the rtt the cwnd is sized for, srtt lags behind
+    // it, which matters once the cwnd changes with the mode.
+    auto rttStanding = standingRTTFilter_.GetBest();
+    if (rttStanding.count() > 0) {
+      rtt = rttStanding;
+    }
+  }
+  conn_.pacer->refreshPacingRate(cwndBytes_ * kCopaPacingGain, rtt);
+}
+
 void Copa::onPacketLoss(const LossEvent& loss) {
   VLOG(10) << __func__ << " lostBytes=" << loss.lostBytes
            << " lostPackets=" << loss.lostPackets << " cwnd=" << cwndBytes_
@@ -277,6 +345,15 @@ void Copa::onPacketLoss(const LossEvent& loss) {
   }
   DCHECK(loss.largestLostPacketNum.hasValue());
   subtractAndCheckUnderflow(bytesInFlight_, loss.lostBytes);
+  if (competitiveMode_ &&
+      (!lastLatencyFactorReduction_ ||
+       loss.lossTime - *lastLatencyFactorReduction_ > conn_.lossState.srtt)) {
+    latencyFactorInverse_ =
+        std::max(latencyFactorInverse_ / 2, 1 / latencyFactor_);
+    lastLatencyFactorReduction_ = loss.lossTime;
+    VLOG(10) << __func__ << " latencyFactor=" << getLatencyFactor() << " "
+             << conn_;
+  }
   if (loss.persistentCongestion) {
     // TODO See if we should go to slowStart here
     VLOG(10) << __func__ << " writable=" << getWritableBytes()
@@ -287,9 +364,7 @@ void Copa::onPacketLoss(const LossEvent& loss) {
           bytesInFlight_, getCongestionWindow(), kPersistentCongestion);
     }
     cwndBytes_ = conn_.transportSettings.minCwndInMss * conn_.udpSendPacketLen;
-    if (conn_.pacer) {
-      conn_.pacer->refreshPacingRate(cwndBytes_ * 2, conn_.lossState.srtt);
-    }
+    refreshPacingRate();
   }
 }
 
@@ -309,6 +384,14 @@ bool Copa::inSlowStart() {
   return isSlowStart_;
 }
 
+bool Copa::inCompetitiveMode() const noexcept {
+  return competitiveMode_;
+}
+
+double Copa::getLatencyFactor() const noexcept {
+  return competitiveMode_ ? 1 / latencyFactorInverse_ : latencyFactor_;
+}
+
 CongestionControlType Copa::type() const noexcept {
   return CongestionControlType::Copa;
 }
@@ -19,6 +19,14 @@ namespace quic {
 
 using namespace std::chrono_literals;
 constexpr std::chrono::microseconds kMinRTTWindowLength{10s};
+// With copaModeSwitching, Copa is in its competitive mode when the queueing
+// delay has not come down to kCopaNearlyEmptyQueue of its max, over the last
+// kCopaMaxRTTWindowInRtts, for kCopaCompetitiveModeRtts.
+constexpr uint32_t kCopaCompetitiveModeRtts{5};
+constexpr uint32_t kCopaMaxRTTWindowInRtts{4};
+constexpr double kCopaNearlyEmptyQueue{0.1};
+// Copa paces at this gain over cwnd / standing rtt.
+constexpr uint64_t kCopaPacingGain{2};
 
 /**
  * Algorithm description https://fb.quip.com/kgubABy1yuYR
@@ -28,7 +36,9 @@ constexpr std::chrono::microseconds kMinRTTWindowLength{10s};
 
 class Copa : public CongestionController {
  public:
-  explicit Copa(QuicConnectionStateBase& conn);
+  explicit Copa(
+      QuicConnectionStateBase& conn,
+      folly::Optional<uint64_t> initCwndBytes = folly::none);
   void onRemoveBytesFromInflight(uint64_t) override;
   void onPacketSent(const OutstandingPacket& packet) override;
   void onPacketAckOrLoss(folly::Optional<AckEvent>, folly::Optional<LossEvent>)
@@ -40,6 +50,12 @@ class Copa : public CongestionController {
 
   bool inSlowStart();
 
+  bool inCompetitiveMode() const noexcept;
+
+  // The latencyFactor in use, either the configured one or the one the
+  // competitive mode has adapted.
+  double getLatencyFactor() const noexcept;
+
   uint64_t getBytesInFlight() const noexcept;
 
   void setConnectionEmulation(uint8_t) noexcept override;
@@ -50,6 +66,11 @@ class Copa : public CongestionController {
  private:
   void onPacketAcked(const AckEvent&);
   void onPacketLoss(const LossEvent&);
+  void updateMode(
+      std::chrono::microseconds rttMin,
+      std::chrono::microseconds rttStanding,
+      const AckEvent& ack);
+  void refreshPacingRate();
 
   struct VelocityState {
     uint64_t velocity{1};
@@ -91,6 +112,13 @@ class Copa : public CongestionController {
       uint64_t>
       standingRTTFilter_; // To get min RTT over srtt/2
 
+  WindowedFilter<
+      std::chrono::microseconds,
+      MaxFilter<std::chrono::microseconds>,
+      uint64_t,
+      uint64_t>
+      maxRTTFilter_; // To get max RTT over kCopaMaxRTTWindowInRtts
+
   VelocityState velocityState_;
   /**
    * latencyFactor_ determines how latency sensitive the algorithm is. Lower
@@ -98,5 +126,15 @@ class Copa : public CongestionController {
    * it will minimize delay at expense of throughput.
    */
   double latencyFactor_{0.50};
+  /**
+   * In competitive mode, 1 / latencyFactor goes up by one every rtt, and is
+   * halved on loss at most once per rtt, but not below 1 / latencyFactor_.
+   * A Copa flow behind a buffer-filling flow then grows its cwnd like the
+   * latter does, instead of draining the queue for it.
+   */
+  bool competitiveMode_{false};
+  double latencyFactorInverse_;
+  folly::Optional<TimePoint> lastQueueEmptyTime_;
+  folly::Optional<TimePoint> lastLatencyFactorReduction_;
 };
 } // namespace quic
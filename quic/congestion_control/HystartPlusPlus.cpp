@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/HystartPlusPlus.h>
+
+namespace quic {
+
+HystartPlusPlus::HystartPlusPlus(QuicConnectionStateBase& conn)
+    : conn_(conn) {}
+
+uint64_t HystartPlusPlus::onAckEvent(
+    const CongestionController::AckEvent& ack) {
+  DCHECK(!ack.ackedPackets.empty());
+  if (phase_ == Phase::Exited) {
+    return 0;
+  }
+  if (!roundEndTarget_ || ack.ackedPackets.back().time > *roundEndTarget_) {
+    startRound(ack.ackTime);
+    if (phase_ == Phase::ConservativeSlowStart &&
+        ++cssRoundCount_ >= kHystartPlusPlusCssRounds) {
+      VLOG(10) << __func__ << " exit slow start after CSS rounds " << conn_;
+      phase_ = Phase::Exited;
+      return 0;
+    }
+  }
+
+  uint64_t growth = ack.ackedBytes;
+  if (!conn_.pacer) {
+    growth = std::min(
+        growth, kHystartPlusPlusUnpacedBurstInMss * conn_.udpSendPacketLen);
+  }
+  if (phase_ == Phase::ConservativeSlowStart) {
+    growth /= kHystartPlusPlusCssGrowthDivisor;
+  }
+
+  if (ack.mrttSample) {
+    currentRoundMinRtt_ = std::min(
+        currentRoundMinRtt_.value_or(*ack.mrttSample), *ack.mrttSample);
+    rttSampleCount_++;
+  }
+  if (rttSampleCount_ < kHystartPlusPlusRttSamples || !currentRoundMinRtt_) {
+    return growth;
+  }
+  if (phase_ == Phase::SlowStart && lastRoundMinRtt_) {
+    auto rttThresh = std::max(
+        kHystartPlusPlusMinRttThresh,
+        std::min(
+            kHystartPlusPlusMaxRttThresh,
+            *lastRoundMinRtt_ / kHystartPlusPlusMinRttDivisor));
+    if (*currentRoundMinRtt_ >= *lastRoundMinRtt_ + rttThresh) {
+      VLOG(10) << __func__ << " enter CSS minRtt="
+               << currentRoundMinRtt_->count()
+               << "us lastMinRtt=" << lastRoundMinRtt_->count() << "us "
+               << conn_;
+      cssBaselineMinRtt_ = currentRoundMinRtt_;
+      cssRoundCount_ = 0;
+      phase_ = Phase::ConservativeSlowStart;
+    }
+  } else if (
+      phase_ == Phase::ConservativeSlowStart &&
+      *currentRoundMinRtt_ < *cssBaselineMinRtt_) {
+    // The RTT increase was spurious.
+    VLOG(10) << __func__ << " resume slow start " << conn_;
+    cssBaselineMinRtt_ = folly::none;
+    phase_ = Phase::SlowStart;
+  }
+  return growth;
+}
+
+void HystartPlusPlus::startRound(TimePoint roundEndTarget) noexcept {
+  roundEndTarget_ = roundEndTarget;
+  lastRoundMinRtt_ = currentRoundMinRtt_;
+  currentRoundMinRtt_ = folly::none;
+  rttSampleCount_ = 0;
+}
+
+HystartPlusPlus::Phase HystartPlusPlus::phase() const noexcept {
+  return phase_;
+}
+
+void HystartPlusPlus::reset() noexcept {
+  phase_ = Phase::SlowStart;
+  roundEndTarget_ = folly::none;
+  currentRoundMinRtt_ = folly::none;
+  lastRoundMinRtt_ = folly::none;
+  rttSampleCount_ = 0;
+  cssBaselineMinRtt_ = folly::none;
+  cssRoundCount_ = 0;
+}
+
+} // namespace quic
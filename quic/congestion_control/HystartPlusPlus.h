@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/state/StateData.h>
+
+#include <folly/Optional.h>
+
+namespace quic {
+
+/**
+ * HyStart++ (RFC 9406), the slow start of the congestion controllers that
+ * enable it with TransportSettings::hystartPlusPlus.
+ *
+ * Once the min RTT of a round trip has grown by more than an eighth of the
+ * last one, the cwnd grows four times slower, in conservative slow start
+ * (CSS), instead of slow start being exited right away. If the min RTT goes
+ * back below the one that started CSS, the increase was jitter, and slow
+ * start resumes. Slow start is only exited after five round trips in CSS.
+ * Jittery paths such as Wi-Fi, where a single RTT increase is often
+ * spurious, are then less likely to leave slow start too early.
+ */
+class HystartPlusPlus {
+ public:
+  enum class Phase : uint8_t {
+    SlowStart,
+    ConservativeSlowStart,
+    Exited,
+  };
+
+  explicit HystartPlusPlus(QuicConnectionStateBase& conn);
+
+  /**
+   * Returns how many bytes the cwnd grows by for an ack received in slow
+   * start. The controller should exit slow start once the phase is Exited.
+   */
+  uint64_t onAckEvent(const CongestionController::AckEvent& ack);
+
+  Phase phase() const noexcept;
+
+  // Starts over, for a controller that goes back to slow start.
+  void reset() noexcept;
+
+ private:
+  void startRound(TimePoint roundEndTarget) noexcept;
+
+  QuicConnectionStateBase& conn_;
+  Phase phase_{Phase::SlowStart};
+  // Acks of packets sent after this time end the current round trip.
+  folly::Optional<TimePoint> roundEndTarget_;
+  folly::Optional<std::chrono::microseconds> currentRoundMinRtt_;
+  folly::Optional<std::chrono::microseconds> lastRoundMinRtt_;
+  uint8_t rttSampleCount_{0};
+  // The min RTT that started CSS
+  folly::Optional<std::chrono::microseconds> cssBaselineMinRtt_;
+  uint8_t cssRoundCount_{0};
+};
+
+} // namespace quic
@@ -14,10 +14,15 @@ namespace quic {
 
 constexpr int kRenoLossReductionFactorShift = 1;
 
-NewReno::NewReno(QuicConnectionStateBase& conn)
+NewReno::NewReno(
+    QuicConnectionStateBase& conn,
+    folly::Optional<uint64_t> initCwndBytes)
     : conn_(conn),
       ssthresh_(std::numeric_limits<uint32_t>::max()),
-      cwndBytes_(conn.transportSettings.initCwndInMss * conn.udpSendPacketLen) {
+      cwndBytes_(initCwndBytes.value_or(
+          conn.transportSettings.initCwndInMss * conn.udpSendPacketLen)),
+      hystartPlusPlus_(conn),
+      cwndValidator_(conn) {
   cwndBytes_ = boundedCwnd(
       cwndBytes_,
       conn_.udpSendPacketLen,
@@ -37,6 +42,22 @@ void NewReno::onRemoveBytesFromInflight(uint64_t bytes) {
 }
 
 void NewReno::onPacketSent(const OutstandingPacket& packet) {
+  if (conn_.transportSettings.cwndValidation) {
+    auto restartCwndBytes =
+        cwndValidator_.onPacketSent(packet, bytesInFlight_, cwndBytes_);
+    if (restartCwndBytes < cwndBytes_) {
+      // Slow start back up to most of the stale cwnd, as in RFC 2861.
+      ssthresh_ = std::max(ssthresh_, cwndBytes_ / 4 * 3);
+      cwndBytes_ = restartCwndBytes;
+      hystartPlusPlus_.reset();
+      VLOG(10) << __func__ << " idle restart cwnd=" << cwndBytes_
+               << " ssthresh=" << ssthresh_ << " " << conn_;
+      if (conn_.qLogger) {
+        conn_.qLogger->addCongestionMetricUpdate(
+            bytesInFlight_, getCongestionWindow(), kCongestionIdleRestart);
+      }
+    }
+  }
   addAndCheckOverflow(bytesInFlight_, packet.encodedSize);
   VLOG(10) << __func__ << " writable=" << getWritableBytes()
            << " cwnd=" << cwndBytes_ << " inflight=" << bytesInFlight_
@@ -61,8 +82,32 @@ void NewReno::onAckEvent(const AckEvent& ack) {
     conn_.qLogger->addCongestionMetricUpdate(
         bytesInFlight_, getCongestionWindow(), kCongestionPacketAck);
   }
-  for (const auto& packet : ack.ackedPackets) {
-    onPacketAcked(packet);
+  if (conn_.transportSettings.cwndValidation &&
+      !cwndValidator_.isCwndValidated(cwndBytes_)) {
+    // The acks of a connection that does not use its cwnd do not grow it.
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          bytesInFlight_, getCongestionWindow(), kCwndNotValidated);
+    }
+    return;
+  }
+  if (conn_.transportSettings.hystartPlusPlus && inSlowStart() &&
+      (!endOfRecovery_ || ack.ackedPackets.back().time >= *endOfRecovery_)) {
+    addAndCheckOverflow(cwndBytes_, hystartPlusPlus_.onAckEvent(ack));
+    if (hystartPlusPlus_.phase() == HystartPlusPlus::Phase::Exited) {
+      ssthresh_ = cwndBytes_;
+      VLOG(10) << __func__ << " exit slow start, ssthresh=" << ssthresh_
+               << " " << conn_;
+      QUIC_STATS(
+          conn_.infoCallback,
+          onSlowStartExit,
+          QuicTransportStatsCallback::SlowStartExitReason::
+              CONSERVATIVE_SLOW_START);
+    }
+  } else {
+    for (const auto& packet : ack.ackedPackets) {
+      onPacketAcked(packet);
+    }
   }
   cwndBytes_ = boundedCwnd(
       cwndBytes_,
@@ -71,18 +116,17 @@ void NewReno::onAckEvent(const AckEvent& ack) {
       conn_.transportSettings.minCwndInMss);
 }
 
-void NewReno::onPacketAcked(const OutstandingPacket& packet) {
+void NewReno::onPacketAcked(const AckPacket& packet) {
   if (endOfRecovery_ && packet.time < *endOfRecovery_) {
     return;
   }
   if (cwndBytes_ < ssthresh_) {
     addAndCheckOverflow(cwndBytes_, packet.encodedSize);
   } else {
-    // TODO: I think this may be a bug in the specs. We should use
-    // conn_.udpSendPacketLen for the cwnd calculation. But I need to
-    // check how Linux handles this.
+    // One packet of the current size per cwnd acked, so that the increase
+    // keeps up once the path MTU is raised above the default.
     uint64_t additionFactor =
-        (kDefaultUDPSendPacketLen * packet.encodedSize) / cwndBytes_;
+        (conn_.udpSendPacketLen * packet.encodedSize) / cwndBytes_;
     addAndCheckOverflow(cwndBytes_, additionFactor);
   }
 }
@@ -105,6 +149,14 @@ void NewReno::onPacketLoss(const LossEvent& loss) {
       loss.largestLostSentTime.hasValue());
   subtractAndCheckUnderflow(bytesInFlight_, loss.lostBytes);
   if (!endOfRecovery_ || *endOfRecovery_ < *loss.largestLostSentTime) {
+    if (inSlowStart()) {
+      QUIC_STATS(
+          conn_.infoCallback,
+          onSlowStartExit,
+          QuicTransportStatsCallback::SlowStartExitReason::LOSS);
+    }
+    undoState_ = UndoState{
+        cwndBytes_, ssthresh_, endOfRecovery_, loss.lossTime, loss.lostPackets};
     endOfRecovery_ = Clock::now();
     cwndBytes_ = (cwndBytes_ >> kRenoLossReductionFactorShift);
     cwndBytes_ = boundedCwnd(
@@ -119,6 +171,9 @@ void NewReno::onPacketLoss(const LossEvent& loss) {
              << " writable=" << getWritableBytes() << " cwnd=" << cwndBytes_
              << " inflight=" << bytesInFlight_ << " " << conn_;
   } else {
+    if (undoState_) {
+      undoState_->lostPackets += loss.lostPackets;
+    }
     VLOG(10) << __func__ << " packetNum=" << *loss.largestLostPacketNum
              << " writable=" << getWritableBytes() << " cwnd=" << cwndBytes_
              << " inflight=" << bytesInFlight_ << " " << conn_;
@@ -137,6 +192,30 @@ void NewReno::onPacketLoss(const LossEvent& loss) {
           bytesInFlight_, getCongestionWindow(), kPersistentCongestion);
     }
     cwndBytes_ = conn_.transportSettings.minCwndInMss * conn_.udpSendPacketLen;
+    // Back to slow start, which starts over.
+    hystartPlusPlus_.reset();
+    undoState_ = folly::none;
+  }
+}
+
+void NewReno::onSpuriousLoss(TimePoint lossTime) {
+  if (!undoState_ || lossTime < undoState_->lossTime) {
+    return;
+  }
+  DCHECK_GT(undoState_->lostPackets, 0);
+  if (--undoState_->lostPackets > 0) {
+    return;
+  }
+  // The cwnd may have grown back since the reduction.
+  cwndBytes_ = std::max(cwndBytes_, undoState_->cwndBytes);
+  ssthresh_ = std::max(ssthresh_, undoState_->ssthresh);
+  endOfRecovery_ = undoState_->endOfRecovery;
+  undoState_ = folly::none;
+  VLOG(10) << __func__ << " undo loss cwnd=" << cwndBytes_
+           << " ssthresh=" << ssthresh_ << " " << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kCongestionSpuriousLossUndo);
   }
 }
 
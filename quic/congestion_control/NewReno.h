@@ -9,6 +9,8 @@
 #pragma once
 
 #include <quic/QuicException.h>
+#include <quic/congestion_control/CongestionControlFunctions.h>
+#include <quic/congestion_control/HystartPlusPlus.h>
 #include <quic/state/StateData.h>
 
 #include <limits>
@@ -17,7 +19,9 @@ namespace quic {
 
 class NewReno : public CongestionController {
  public:
-  explicit NewReno(QuicConnectionStateBase& conn);
+  explicit NewReno(
+      QuicConnectionStateBase& conn,
+      folly::Optional<uint64_t> initCwndBytes = folly::none);
   void onRemoveBytesFromInflight(uint64_t) override;
   void onPacketSent(const OutstandingPacket& packet) override;
   void onPacketAckOrLoss(folly::Optional<AckEvent>, folly::Optional<LossEvent>)
@@ -37,10 +41,12 @@ class NewReno : public CongestionController {
 
   bool isAppLimited() const noexcept override;
 
+  void onSpuriousLoss(TimePoint lossTime) override;
+
  private:
   void onPacketLoss(const LossEvent&);
   void onAckEvent(const AckEvent&);
-  void onPacketAcked(const OutstandingPacket&);
+  void onPacketAcked(const AckPacket&);
 
  private:
   QuicConnectionStateBase& conn_;
@@ -48,5 +54,21 @@ class NewReno : public CongestionController {
   uint64_t ssthresh_;
   uint64_t cwndBytes_;
   folly::Optional<TimePoint> endOfRecovery_;
+  // The state before the last cwnd reduction, restored if all the packets
+  // lost since then are acked after all.
+  struct UndoState {
+    uint64_t cwndBytes;
+    uint64_t ssthresh;
+    folly::Optional<TimePoint> endOfRecovery;
+    // lossTime of the loss event that reduced the cwnd
+    TimePoint lossTime;
+    // Packets lost since the reduction that are not known to be spurious
+    uint64_t lostPackets;
+  };
+  folly::Optional<UndoState> undoState_;
+  // Slow start when hystartPlusPlus is set
+  HystartPlusPlus hystartPlusPlus_;
+  // Used with TransportSettings::cwndValidation
+  CwndValidator cwndValidator_;
 };
 } // namespace quic
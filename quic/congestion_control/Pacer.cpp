@@ -13,6 +13,24 @@
 
 namespace quic {
 
+namespace {
+// Fractional bits of the fixed-point nanoseconds of TokenBucketPacer
+constexpr uint8_t kPacerFixedPointShift = 16;
+} // namespace
+
+uint64_t tickScaledPacerQuantum(
+    const QuicConnectionStateBase& conn,
+    uint64_t cwndInPackets,
+    std::chrono::microseconds rtt) {
+  DCHECK_GT(rtt.count(), 0);
+  uint64_t tick = conn.transportSettings.pacingTimerTickInterval.count();
+  uint64_t packetsPerTick =
+      (cwndInPackets * tick + rtt.count() - 1) / rtt.count();
+  return std::min(
+      conn.transportSettings.maxBurstPackets,
+      std::max(kMinPacerQuantumPackets, packetsPerTick));
+}
+
 DefaultPacer::DefaultPacer(
     const QuicConnectionStateBase& conn,
     uint64_t minCwndInMss)
@@ -90,4 +108,192 @@ void DefaultPacer::setAppLimited(bool limited) {
   appLimited_ = limited;
 }
 
+folly::Optional<TimePoint> DefaultPacer::getPacketTxTime(
+    TimePoint /* currentTime */) {
+  return folly::none;
+}
+
+TxTimePacer::TxTimePacer(
+    const QuicConnectionStateBase& conn,
+    uint64_t minCwndInMss)
+    : conn_(conn),
+      minCwndInMss_(minCwndInMss),
+      batchSize_(conn.transportSettings.writeConnectionDataPacketsLimit) {}
+
+void TxTimePacer::refreshPacingRate(
+    uint64_t cwndBytes,
+    std::chrono::microseconds rtt) {
+  uint64_t cwndInPackets =
+      std::max(minCwndInMss_, cwndBytes / conn_.udpSendPacketLen);
+  // The kernel does the spacing, so there is no timer tick to round to and
+  // one write loop can hand the whole cwnd over.
+  batchSize_ = std::max(
+      cwndInPackets, conn_.transportSettings.writeConnectionDataPacketsLimit);
+  packetInterval_ = rtt / cwndInPackets;
+  if (conn_.qLogger) {
+    conn_.qLogger->addPacingMetricUpdate(
+        batchSize_,
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            packetInterval_));
+  }
+  QUIC_TRACE(
+      pacing_update,
+      conn_,
+      std::chrono::duration_cast<std::chrono::microseconds>(packetInterval_)
+          .count(),
+      (uint64_t)batchSize_);
+}
+
+void TxTimePacer::onPacedWriteScheduled(TimePoint /* currentTime */) {}
+
+std::chrono::microseconds TxTimePacer::getTimeUntilNextWrite() const {
+  return 0us;
+}
+
+uint64_t TxTimePacer::updateAndGetWriteBatchSize(TimePoint /* currentTime */) {
+  return getCachedWriteBatchSize();
+}
+
+uint64_t TxTimePacer::getCachedWriteBatchSize() const {
+  return appLimited_ ? conn_.transportSettings.writeConnectionDataPacketsLimit
+                     : batchSize_;
+}
+
+void TxTimePacer::setAppLimited(bool limited) {
+  appLimited_ = limited;
+}
+
+folly::Optional<TimePoint> TxTimePacer::getPacketTxTime(
+    TimePoint currentTime) {
+  if (appLimited_ || packetInterval_ == std::chrono::nanoseconds::zero()) {
+    nextTxTime_.clear();
+    return folly::none;
+  }
+  if (!nextTxTime_ || *nextTxTime_ < currentTime) {
+    // Idle since the last packet, don't let the gap turn into a burst.
+    nextTxTime_ = currentTime;
+  }
+  auto txTime = *nextTxTime_;
+  *nextTxTime_ += std::chrono::duration_cast<Clock::duration>(packetInterval_);
+  return txTime;
+}
+
+TokenBucketPacer::TokenBucketPacer(
+    const QuicConnectionStateBase& conn,
+    uint64_t minCwndInMss)
+    : conn_(conn),
+      minCwndInMss_(minCwndInMss),
+      quantum_(conn.transportSettings.writeConnectionDataPacketsLimit),
+      quantumPolicy_(tickScaledPacerQuantum),
+      cachedBatchSize_(conn.transportSettings.writeConnectionDataPacketsLimit) {
+}
+
+void TokenBucketPacer::refreshPacingRate(
+    uint64_t cwndBytes,
+    std::chrono::microseconds rtt) {
+  if (rtt == 0us || rtt < conn_.transportSettings.pacingTimerTickInterval) {
+    packetInterval_ = 0;
+    quantum_ = conn_.transportSettings.writeConnectionDataPacketsLimit;
+    credit_ = 0;
+    lastRefillTime_.clear();
+    cachedBatchSize_ = quantum_;
+    return;
+  }
+  uint64_t cwndInPackets =
+      std::max(minCwndInMss_, cwndBytes / conn_.udpSendPacketLen);
+  uint64_t rttNanos =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(rtt).count();
+  packetInterval_ = std::max<uint64_t>(
+      (rttNanos << kPacerFixedPointShift) / cwndInPackets, 1);
+  quantum_ =
+      std::max<uint64_t>(quantumPolicy_(conn_, cwndInPackets, rtt), 1);
+  credit_ = std::min(credit_, maxCredit());
+  cachedBatchSize_ = quantum_;
+  auto burstInterval = std::chrono::microseconds(
+      ((quantum_ * packetInterval_) >> kPacerFixedPointShift) / 1000);
+  if (conn_.qLogger) {
+    conn_.qLogger->addPacingMetricUpdate(quantum_, burstInterval);
+  }
+  QUIC_TRACE(
+      pacing_update, conn_, burstInterval.count(), (uint64_t)quantum_);
+}
+
+void TokenBucketPacer::onPacedWriteScheduled(TimePoint currentTime) {
+  if (!appLimited_ && packetInterval_ != 0) {
+    refillCredit(currentTime);
+  }
+}
+
+std::chrono::microseconds TokenBucketPacer::getTimeUntilNextWrite() const {
+  uint64_t burstCredit = quantum_ * packetInterval_;
+  if (appLimited_ || packetInterval_ == 0 || credit_ >= burstCredit) {
+    return 0us;
+  }
+  uint64_t missingNanos = (burstCredit - credit_ +
+                           (uint64_t(1) << kPacerFixedPointShift) - 1) >>
+      kPacerFixedPointShift;
+  return std::chrono::microseconds((missingNanos + 999) / 1000);
+}
+
+uint64_t TokenBucketPacer::updateAndGetWriteBatchSize(TimePoint currentTime) {
+  if (appLimited_) {
+    cachedBatchSize_ = conn_.transportSettings.writeConnectionDataPacketsLimit;
+    return cachedBatchSize_;
+  }
+  if (packetInterval_ == 0) {
+    return quantum_;
+  }
+  refillCredit(currentTime);
+  // The credit that does not make a whole packet is kept for the next burst.
+  cachedBatchSize_ = credit_ / packetInterval_;
+  credit_ -= cachedBatchSize_ * packetInterval_;
+  return cachedBatchSize_;
+}
+
+void TokenBucketPacer::setQuantumPolicy(PacerQuantumPolicy quantumPolicy) {
+  quantumPolicy_ = std::move(quantumPolicy);
+}
+
+uint64_t TokenBucketPacer::getCachedWriteBatchSize() const {
+  return cachedBatchSize_;
+}
+
+void TokenBucketPacer::setAppLimited(bool limited) {
+  appLimited_ = limited;
+  if (limited) {
+    // The first burst after that starts with a full quantum.
+    lastRefillTime_.clear();
+  }
+}
+
+folly::Optional<TimePoint> TokenBucketPacer::getPacketTxTime(
+    TimePoint /* currentTime */) {
+  return folly::none;
+}
+
+void TokenBucketPacer::refillCredit(TimePoint currentTime) noexcept {
+  if (!lastRefillTime_) {
+    credit_ = quantum_ * packetInterval_;
+    lastRefillTime_ = currentTime;
+    return;
+  }
+  if (currentTime <= *lastRefillTime_) {
+    return;
+  }
+  uint64_t elapsedNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              currentTime - *lastRefillTime_)
+                              .count();
+  // Bounded first, so that long idle times cannot overflow the shift.
+  auto maxCreditNanos = maxCredit() >> kPacerFixedPointShift;
+  credit_ = std::min(
+      credit_ +
+          (std::min(elapsedNanos, maxCreditNanos) << kPacerFixedPointShift),
+      maxCredit());
+  lastRefillTime_ = currentTime;
+}
+
+uint64_t TokenBucketPacer::maxCredit() const noexcept {
+  return quantum_ * packetInterval_ * kPacerMaxCreditQuanta;
+}
+
 } // namespace quic
@@ -22,6 +22,26 @@ using PacingRateCalculator = folly::Function<PacingRate(
     uint64_t minCwndInMss,
     std::chrono::microseconds rtt)>;
 
+/**
+ * Returns the number of packets TokenBucketPacer releases per burst, for a
+ * connection pacing cwndInPackets per rtt.
+ */
+using PacerQuantumPolicy = folly::Function<uint64_t(
+    const QuicConnectionStateBase&,
+    uint64_t cwndInPackets,
+    std::chrono::microseconds rtt)>;
+
+/**
+ * The default PacerQuantumPolicy: the packets sent at the pacing rate during
+ * a pacing timer tick, so that faster flows send larger bursts instead of
+ * waking up more often. Bounded by kMinPacerQuantumPackets and
+ * maxBurstPackets.
+ */
+uint64_t tickScaledPacerQuantum(
+    const QuicConnectionStateBase& conn,
+    uint64_t cwndInPackets,
+    std::chrono::microseconds rtt);
+
 class DefaultPacer : public Pacer {
  public:
   explicit DefaultPacer(
@@ -43,6 +63,8 @@ class DefaultPacer : public Pacer {
 
   void setAppLimited(bool limited) override;
 
+  folly::Optional<TimePoint> getPacketTxTime(TimePoint currentTime) override;
+
  private:
   const QuicConnectionStateBase& conn_;
   uint64_t minCwndInMss_;
@@ -53,4 +75,87 @@ class DefaultPacer : public Pacer {
   uint64_t cachedBatchSize_;
   bool appLimited_{false};
 };
+
+/**
+ * Pacer that lets a write loop send up to a whole cwnd at once, and spaces
+ * the packets out by handing their departure times to the kernel. The
+ * socket needs SO_TXTIME and an fq qdisc on the egress interface.
+ */
+class TxTimePacer : public Pacer {
+ public:
+  TxTimePacer(const QuicConnectionStateBase& conn, uint64_t minCwndInMss);
+
+  void refreshPacingRate(uint64_t cwndBytes, std::chrono::microseconds rtt)
+      override;
+
+  void onPacedWriteScheduled(TimePoint currentTime) override;
+
+  std::chrono::microseconds getTimeUntilNextWrite() const override;
+
+  uint64_t updateAndGetWriteBatchSize(TimePoint currentTime) override;
+
+  uint64_t getCachedWriteBatchSize() const override;
+
+  void setAppLimited(bool limited) override;
+
+  folly::Optional<TimePoint> getPacketTxTime(TimePoint currentTime) override;
+
+ private:
+  const QuicConnectionStateBase& conn_;
+  uint64_t minCwndInMss_;
+  uint64_t batchSize_;
+  // time between the departures of two consecutive packets
+  std::chrono::nanoseconds packetInterval_{0};
+  folly::Optional<TimePoint> nextTxTime_;
+  bool appLimited_{false};
+};
+
+/**
+ * Pacer that earns sending credit at the pacing rate, as a token bucket kept
+ * in fixed-point nanoseconds. A burst of the quantum the PacerQuantumPolicy
+ * picks is released once enough credit is earned. A pacing timer that fires
+ * late releases the extra packets it owes, and the fraction of a packet left
+ * over is carried to the next burst, so neither timer slop nor rounding
+ * changes the rate. The credit is capped at kPacerMaxCreditQuanta quanta, so
+ * a long stall does not turn into a large burst.
+ */
+class TokenBucketPacer : public Pacer {
+ public:
+  TokenBucketPacer(const QuicConnectionStateBase& conn, uint64_t minCwndInMss);
+
+  void refreshPacingRate(uint64_t cwndBytes, std::chrono::microseconds rtt)
+      override;
+
+  void onPacedWriteScheduled(TimePoint currentTime) override;
+
+  std::chrono::microseconds getTimeUntilNextWrite() const override;
+
+  uint64_t updateAndGetWriteBatchSize(TimePoint currentTime) override;
+
+  void setQuantumPolicy(PacerQuantumPolicy quantumPolicy);
+
+  uint64_t getCachedWriteBatchSize() const override;
+
+  void setAppLimited(bool limited) override;
+
+  folly::Optional<TimePoint> getPacketTxTime(TimePoint currentTime) override;
+
+ private:
+  void refillCredit(TimePoint currentTime) noexcept;
+  uint64_t maxCredit() const noexcept;
+
+  const QuicConnectionStateBase& conn_;
+  uint64_t minCwndInMss_;
+  // Packets per burst
+  uint64_t quantum_;
+  // Nanoseconds between two packets at the pacing rate, in fixed point. Zero
+  // when the connection cannot be paced.
+  uint64_t packetInterval_{0};
+  // Sending time earned and not spent yet, in fixed-point nanoseconds
+  uint64_t credit_{0};
+  folly::Optional<TimePoint> lastRefillTime_;
+  PacerQuantumPolicy quantumPolicy_;
+  uint64_t cachedBatchSize_;
+  bool appLimited_{false};
+};
 } // namespace quic
@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/Prague.h>
+#include <quic/congestion_control/CongestionControlFunctions.h>
+#include <quic/logging/QLoggerConstants.h>
+
+namespace quic {
+
+constexpr int kPragueLossReductionFactorShift = 1;
+
+Prague::Prague(
+    QuicConnectionStateBase& conn,
+    folly::Optional<uint64_t> initCwndBytes)
+    : conn_(conn),
+      ssthresh_(std::numeric_limits<uint64_t>::max()),
+      cwndBytes_(initCwndBytes.value_or(
+          conn.transportSettings.initCwndInMss * conn.udpSendPacketLen)) {
+  cwndBytes_ = boundedCwnd(
+      cwndBytes_,
+      conn_.udpSendPacketLen,
+      conn_.transportSettings.maxCwndInMss,
+      conn_.transportSettings.minCwndInMss);
+}
+
+void Prague::onRemoveBytesFromInflight(uint64_t bytes) {
+  subtractAndCheckUnderflow(bytesInFlight_, bytes);
+  VLOG(10) << __func__ << " writable=" << getWritableBytes()
+           << " cwnd=" << cwndBytes_ << " inflight=" << bytesInFlight_ << " "
+           << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kRemoveInflight);
+  }
+}
+
+void Prague::onPacketSent(const OutstandingPacket& packet) {
+  addAndCheckOverflow(bytesInFlight_, packet.encodedSize);
+  VLOG(10) << __func__ << " writable=" << getWritableBytes()
+           << " cwnd=" << cwndBytes_ << " inflight=" << bytesInFlight_
+           << " packetNum="
+           << folly::variant_match(
+                  packet.packet.header,
+                  [](auto& h) { return h.getPacketSequenceNum(); })
+           << " " << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kCongestionPacketSent);
+  }
+}
+
+void Prague::onAckEvent(const AckEvent& ack) {
+  DCHECK(ack.largestAckedPacket.hasValue() && !ack.ackedPackets.empty());
+  subtractAndCheckUnderflow(bytesInFlight_, ack.ackedBytes);
+  VLOG(10) << __func__ << " writable=" << getWritableBytes()
+           << " cwnd=" << cwndBytes_ << " inflight=" << bytesInFlight_
+           << " ceMarked=" << ack.ecnCeMarked << " alpha=" << alpha_ << " "
+           << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kCongestionPacketAck);
+  }
+  roundAckedPackets_ += ack.ackedPackets.size();
+  roundCeMarkedPackets_ += ack.ecnCeMarked;
+  TimePoint largestAckedSentTime = ack.ackedPackets.front().time;
+  for (const auto& packet : ack.ackedPackets) {
+    largestAckedSentTime = std::max(largestAckedSentTime, packet.time);
+  }
+  if (!roundStart_ || largestAckedSentTime > *roundStart_) {
+    onRoundTripEnd(ack.ackTime);
+  }
+
+  if (ack.ecnCeMarked > 0 && ceReductionRound_ != roundCount_) {
+    // The queue is building up, back off in proportion to how many packets
+    // have been marked lately.
+    ceReductionRound_ = roundCount_;
+    cwndBytes_ = boundedCwnd(
+        static_cast<uint64_t>(cwndBytes_ * (1 - alpha_ / 2)),
+        conn_.udpSendPacketLen,
+        conn_.transportSettings.maxCwndInMss,
+        conn_.transportSettings.minCwndInMss);
+    // This causes us to exit slow start.
+    ssthresh_ = cwndBytes_;
+    VLOG(10) << __func__ << " CE reduction cwnd=" << cwndBytes_
+             << " alpha=" << alpha_ << " " << conn_;
+  } else {
+    for (const auto& packet : ack.ackedPackets) {
+      onPacketAcked(packet);
+    }
+  }
+  cwndBytes_ = boundedCwnd(
+      cwndBytes_,
+      conn_.udpSendPacketLen,
+      conn_.transportSettings.maxCwndInMss,
+      conn_.transportSettings.minCwndInMss);
+  updatePacing();
+}
+
+void Prague::onRoundTripEnd(TimePoint ackTime) noexcept {
+  if (roundStart_ && roundAckedPackets_ > 0) {
+    float markedFraction = std::min(
+        1.0f, static_cast<float>(roundCeMarkedPackets_) / roundAckedPackets_);
+    alpha_ =
+        (1 - kPragueAlphaGain) * alpha_ + kPragueAlphaGain * markedFraction;
+  }
+  roundStart_ = ackTime;
+  roundCount_++;
+  roundAckedPackets_ = 0;
+  roundCeMarkedPackets_ = 0;
+}
+
+void Prague::onPacketAcked(const AckPacket& packet) {
+  if (endOfRecovery_ && packet.time < *endOfRecovery_) {
+    return;
+  }
+  if (cwndBytes_ < ssthresh_) {
+    addAndCheckOverflow(cwndBytes_, packet.encodedSize);
+  } else {
+    uint64_t additionFactor =
+        (conn_.udpSendPacketLen * packet.encodedSize) / cwndBytes_;
+    addAndCheckOverflow(cwndBytes_, additionFactor);
+  }
+}
+
+void Prague::onPacketAckOrLoss(
+    folly::Optional<AckEvent> ackEvent,
+    folly::Optional<LossEvent> lossEvent) {
+  if (lossEvent) {
+    onPacketLoss(*lossEvent);
+  }
+  if (ackEvent && ackEvent->largestAckedPacket.hasValue()) {
+    onAckEvent(*ackEvent);
+  }
+}
+
+void Prague::onPacketLoss(const LossEvent& loss) {
+  DCHECK(
+      loss.largestLostPacketNum.hasValue() &&
+      loss.largestLostSentTime.hasValue());
+  subtractAndCheckUnderflow(bytesInFlight_, loss.lostBytes);
+  if (!endOfRecovery_ || *endOfRecovery_ < *loss.largestLostSentTime) {
+    endOfRecovery_ = Clock::now();
+    cwndBytes_ = (cwndBytes_ >> kPragueLossReductionFactorShift);
+    cwndBytes_ = boundedCwnd(
+        cwndBytes_,
+        conn_.udpSendPacketLen,
+        conn_.transportSettings.maxCwndInMss,
+        conn_.transportSettings.minCwndInMss);
+    // This causes us to exit slow start.
+    ssthresh_ = cwndBytes_;
+    VLOG(10) << __func__ << " exit slow start, ssthresh=" << ssthresh_
+             << " packetNum=" << *loss.largestLostPacketNum
+             << " writable=" << getWritableBytes() << " cwnd=" << cwndBytes_
+             << " inflight=" << bytesInFlight_ << " " << conn_;
+  } else {
+    VLOG(10) << __func__ << " packetNum=" << *loss.largestLostPacketNum
+             << " writable=" << getWritableBytes() << " cwnd=" << cwndBytes_
+             << " inflight=" << bytesInFlight_ << " " << conn_;
+  }
+
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kCongestionPacketLoss);
+  }
+  if (loss.persistentCongestion) {
+    VLOG(10) << __func__ << " writable=" << getWritableBytes()
+             << " cwnd=" << cwndBytes_ << " inflight=" << bytesInFlight_ << " "
+             << conn_;
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          bytesInFlight_, getCongestionWindow(), kPersistentCongestion);
+    }
+    cwndBytes_ = conn_.transportSettings.minCwndInMss * conn_.udpSendPacketLen;
+  }
+  updatePacing();
+}
+
+void Prague::updatePacing() noexcept {
+  if (conn_.pacer) {
+    auto gain = inSlowStart() ? kPragueSlowStartPacingGain : kPraguePacingGain;
+    conn_.pacer->refreshPacingRate(cwndBytes_ * gain, conn_.lossState.srtt);
+  }
+}
+
+uint64_t Prague::getWritableBytes() const noexcept {
+  if (bytesInFlight_ > cwndBytes_) {
+    return 0;
+  } else {
+    return cwndBytes_ - bytesInFlight_;
+  }
+}
+
+uint64_t Prague::getCongestionWindow() const noexcept {
+  return cwndBytes_;
+}
+
+bool Prague::inSlowStart() const noexcept {
+  return cwndBytes_ < ssthresh_;
+}
+
+float Prague::getAlpha() const noexcept {
+  return alpha_;
+}
+
+CongestionControlType Prague::type() const noexcept {
+  return CongestionControlType::Prague;
+}
+
+void Prague::setConnectionEmulation(uint8_t) noexcept {}
+
+uint64_t Prague::getBytesInFlight() const noexcept {
+  return bytesInFlight_;
+}
+
+void Prague::setAppIdle(bool, TimePoint) noexcept { /* unsupported */
+}
+
+void Prague::setAppLimited() { /* unsupported */
+}
+
+bool Prague::isAppLimited() const noexcept {
+  return false; // unsupported
+}
+
+} // namespace quic
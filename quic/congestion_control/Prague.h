@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicException.h>
+#include <quic/state/StateData.h>
+
+#include <limits>
+
+namespace quic {
+
+// Gain of the moving average of the fraction of CE marked packets
+constexpr float kPragueAlphaGain = 1.0f / 16;
+// The fraction starts high, so that the first marks are taken seriously
+constexpr float kPragueInitialAlpha = 1.0f;
+// Pacing gains during and after slow start
+constexpr float kPragueSlowStartPacingGain = 2.0f;
+constexpr float kPraguePacingGain = 1.25f;
+
+/**
+ * A scalable congestion controller for L4S, after TCP Prague.
+ *
+ * Its packets are marked ECT(1), which L4S queues mark CE as soon as they
+ * start to build up. Like DCTCP, it keeps alpha, a moving average of the
+ * fraction of packets that are CE marked per round trip, and reduces the cwnd
+ * by alpha / 2 at most once per round trip in which some packets are marked.
+ * The few marks a shallow queue gives are then enough to keep the flow at the
+ * link rate with little queueing. Outside of the marks it grows like Reno,
+ * and falls back to halving the cwnd on loss.
+ */
+class Prague : public CongestionController {
+ public:
+  explicit Prague(
+      QuicConnectionStateBase& conn,
+      folly::Optional<uint64_t> initCwndBytes = folly::none);
+  void onRemoveBytesFromInflight(uint64_t) override;
+  void onPacketSent(const OutstandingPacket& packet) override;
+  void onPacketAckOrLoss(folly::Optional<AckEvent>, folly::Optional<LossEvent>)
+      override;
+
+  uint64_t getWritableBytes() const noexcept override;
+  uint64_t getCongestionWindow() const noexcept override;
+  void setConnectionEmulation(uint8_t) noexcept override;
+  void setAppIdle(bool, TimePoint) noexcept override;
+  void setAppLimited() override;
+
+  CongestionControlType type() const noexcept override;
+
+  bool inSlowStart() const noexcept;
+
+  uint64_t getBytesInFlight() const noexcept;
+
+  bool isAppLimited() const noexcept override;
+
+  float getAlpha() const noexcept;
+
+ private:
+  void onPacketLoss(const LossEvent&);
+  void onAckEvent(const AckEvent&);
+  void onPacketAcked(const AckPacket&);
+  // Updates alpha with the marks of the round trip that just ended.
+  void onRoundTripEnd(TimePoint ackTime) noexcept;
+  void updatePacing() noexcept;
+
+ private:
+  QuicConnectionStateBase& conn_;
+  uint64_t bytesInFlight_{0};
+  uint64_t ssthresh_;
+  uint64_t cwndBytes_;
+  folly::Optional<TimePoint> endOfRecovery_;
+
+  float alpha_{kPragueInitialAlpha};
+  // Packets sent after the start of the current round trip end it when they
+  // are acked.
+  folly::Optional<TimePoint> roundStart_;
+  uint64_t roundCount_{0};
+  // Packets acked and reported CE marked in the current round trip
+  uint64_t roundAckedPackets_{0};
+  uint64_t roundCeMarkedPackets_{0};
+  // Round trip in which the cwnd was last reduced because of CE marks
+  folly::Optional<uint64_t> ceReductionRound_;
+};
+} // namespace quic
@@ -18,14 +18,18 @@ Cubic::Cubic(
     uint64_t initSsthresh,
     bool tcpFriendly,
     bool ackTrain,
-    bool spreadAcrossRtt)
+    bool spreadAcrossRtt,
+    folly::Optional<uint64_t> initCwndBytes)
     : conn_(conn),
       inflightBytes_(0),
       ssthresh_(initSsthresh),
+      cwndValidator_(conn),
+      hystartPlusPlus_(conn),
       spreadAcrossRtt_(spreadAcrossRtt) {
   cwndBytes_ = std::min(
       conn.transportSettings.maxCwndInMss * conn.udpSendPacketLen,
-      conn.transportSettings.initCwndInMss * conn.udpSendPacketLen);
+      initCwndBytes.value_or(
+          conn.transportSettings.initCwndInMss * conn.udpSendPacketLen));
   steadyState_.tcpFriendly = tcpFriendly;
   steadyState_.estRenoCwnd = cwndBytes_;
   hystartState_.ackTrain = ackTrain;
@@ -63,6 +67,7 @@ void Cubic::onPersistentCongestion() {
   quiescenceStart_ = folly::none;
   hystartState_.found = Cubic::HystartFound::No;
   hystartState_.inRttRound = false;
+  hystartPlusPlus_.reset();
 
   state_ = CubicStates::Hystart;
 
@@ -78,7 +83,7 @@ void Cubic::onPersistentCongestion() {
         inflightBytes_,
         getCongestionWindow(),
         kPersistentCongestion,
-        cubicStateToString(state_).str());
+        cubicStateToString(state_));
   }
 }
 
@@ -89,9 +94,72 @@ void Cubic::onPacketSent(const OutstandingPacket& packet) {
         "Cubic: inflightBytes_ overflow",
         LocalErrorCode::INFLIGHT_BYTES_OVERFLOW);
   }
+  if (conn_.transportSettings.cwndValidation) {
+    auto restartCwndBytes =
+        cwndValidator_.onPacketSent(packet, inflightBytes_, cwndBytes_);
+    if (restartCwndBytes < cwndBytes_) {
+      onIdleRestart(restartCwndBytes);
+    }
+  }
   inflightBytes_ += packet.encodedSize;
 }
 
+void Cubic::onIdleRestart(uint64_t restartCwndBytes) {
+  // Slow start back up to most of the stale cwnd, as in RFC 2861.
+  ssthresh_ = std::max(ssthresh_, cwndBytes_ / 4 * 3);
+  cwndBytes_ = restartCwndBytes;
+  steadyState_.lastReductionTime = folly::none;
+  steadyState_.lastMaxCwndBytes = folly::none;
+  hystartState_.found = Cubic::HystartFound::No;
+  hystartState_.inRttRound = false;
+  hystartPlusPlus_.reset();
+  nonValidatedStart_ = folly::none;
+  state_ = CubicStates::Hystart;
+  if (conn_.pacer) {
+    // The pacer spreads the restart window instead of it going out at once.
+    conn_.pacer->refreshPacingRate(
+        cwndBytes_ * pacingGain(), conn_.lossState.srtt);
+  }
+  VLOG(10) << __func__ << " cwnd=" << cwndBytes_ << " ssthresh=" << ssthresh_
+           << " " << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        inflightBytes_,
+        getCongestionWindow(),
+        kCongestionIdleRestart,
+        cubicStateToString(state_));
+  }
+}
+
+bool Cubic::isCwndValidated(TimePoint ackTime) noexcept {
+  if (!conn_.transportSettings.cwndValidation) {
+    return true;
+  }
+  if (!cwndValidator_.isCwndValidated(cwndBytes_)) {
+    if (!nonValidatedStart_) {
+      nonValidatedStart_ = ackTime;
+    }
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          inflightBytes_,
+          getCongestionWindow(),
+          kCwndNotValidated,
+          cubicStateToString(state_));
+    }
+    return false;
+  }
+  // Like app idle time, the time the cwnd did not grow does not count to
+  // the cubic growth.
+  if (nonValidatedStart_ && *nonValidatedStart_ <= ackTime &&
+      steadyState_.lastReductionTime) {
+    *steadyState_.lastReductionTime +=
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            ackTime - *nonValidatedStart_);
+  }
+  nonValidatedStart_ = folly::none;
+  return true;
+}
+
 void Cubic::onPacketLoss(const LossEvent& loss) {
   quiescenceStart_ = folly::none;
   DCHECK(
@@ -103,8 +171,21 @@ void Cubic::onPacketLoss(const LossEvent& loss) {
   // as it was already accounted for in a recovery period.
   if (*loss.largestLostSentTime >=
       recoveryState_.endOfRecovery.value_or(*loss.largestLostSentTime)) {
+    recoveryState_.undoState = UndoState{cwndBytes_,
+                                         ssthresh_,
+                                         state_,
+                                         steadyState_,
+                                         recoveryState_.endOfRecovery,
+                                         loss.lossTime,
+                                         loss.lostPackets};
     recoveryState_.endOfRecovery = Clock::now();
     cubicReduction(loss.lossTime);
+    if (state_ == CubicStates::Hystart) {
+      QUIC_STATS(
+          conn_.infoCallback,
+          onSlowStartExit,
+          QuicTransportStatsCallback::SlowStartExitReason::LOSS);
+    }
     if (state_ == CubicStates::Hystart || state_ == CubicStates::Steady) {
       state_ = CubicStates::FastRecovery;
     }
@@ -125,25 +206,61 @@ void Cubic::onPacketLoss(const LossEvent& loss) {
           inflightBytes_,
           getCongestionWindow(),
           kCubicLoss,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
 
   } else {
+    if (recoveryState_.undoState) {
+      recoveryState_.undoState->lostPackets += loss.lostPackets;
+    }
     QUIC_TRACE(fst_trace, conn_, "cubic_skip_loss");
     if (conn_.qLogger) {
       conn_.qLogger->addCongestionMetricUpdate(
           inflightBytes_,
           getCongestionWindow(),
           kCubicSkipLoss,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
   }
 
   if (loss.persistentCongestion) {
+    recoveryState_.undoState = folly::none;
     onPersistentCongestion();
   }
 }
 
+void Cubic::onSpuriousLoss(TimePoint lossTime) {
+  // Only a loss of the current recovery can be undone.
+  if (state_ != CubicStates::FastRecovery || !recoveryState_.undoState ||
+      lossTime < recoveryState_.undoState->lossTime) {
+    return;
+  }
+  DCHECK_GT(recoveryState_.undoState->lostPackets, 0);
+  if (--recoveryState_.undoState->lostPackets > 0) {
+    return;
+  }
+  auto undoState = std::move(*recoveryState_.undoState);
+  recoveryState_.undoState = folly::none;
+  cwndBytes_ = undoState.cwndBytes;
+  ssthresh_ = undoState.ssthresh;
+  state_ = undoState.state;
+  steadyState_ = undoState.steadyState;
+  recoveryState_.endOfRecovery = undoState.endOfRecovery;
+  VLOG(10) << __func__ << " undo loss cwnd=" << cwndBytes_
+           << " state=" << cubicStateToString(state_) << " " << conn_;
+  if (conn_.pacer) {
+    conn_.pacer->refreshPacingRate(
+        cwndBytes_ * pacingGain(), conn_.lossState.srtt);
+  }
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        inflightBytes_,
+        getCongestionWindow(),
+        kCongestionSpuriousLossUndo,
+        cubicStateToString(state_));
+  }
+}
+
 void Cubic::onRemoveBytesFromInflight(uint64_t bytes) {
   DCHECK_LE(bytes, inflightBytes_);
   inflightBytes_ -= bytes;
@@ -159,7 +276,7 @@ void Cubic::onRemoveBytesFromInflight(uint64_t bytes) {
         inflightBytes_,
         getCongestionWindow(),
         kRemoveInflight,
-        cubicStateToString(state_).str());
+        cubicStateToString(state_));
   }
 }
 
@@ -322,7 +439,7 @@ int64_t Cubic::calculateCubicCwndDelta(TimePoint ackTime) noexcept {
         inflightBytes_,
         getCongestionWindow(),
         kCubicSteadyCwnd,
-        cubicStateToString(state_).str());
+        cubicStateToString(state_));
   }
   return delta;
 }
@@ -403,16 +520,20 @@ void Cubic::onPacketAcked(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kCubicSkipAck,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
     return;
   }
   switch (state_) {
     case CubicStates::Hystart:
-      onPacketAckedInHystart(ack);
+      if (isCwndValidated(ack.ackTime)) {
+        onPacketAckedInHystart(ack);
+      }
       break;
     case CubicStates::Steady:
-      onPacketAckedInSteady(ack);
+      if (isCwndValidated(ack.ackTime)) {
+        onPacketAckedInSteady(ack);
+      }
       break;
     case CubicStates::FastRecovery:
       onPacketAckedInRecovery(ack);
@@ -429,7 +550,7 @@ void Cubic::onPacketAcked(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kCwndNoChange,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
   }
   QUIC_TRACE(
@@ -444,7 +565,7 @@ void Cubic::onPacketAcked(const AckEvent& ack) {
         inflightBytes_,
         getCongestionWindow(),
         kCongestionPacketAck,
-        cubicStateToString(state_).str());
+        cubicStateToString(state_));
   }
 }
 
@@ -506,6 +627,10 @@ float Cubic::pacingGain() const noexcept {
 }
 
 void Cubic::onPacketAckedInHystart(const AckEvent& ack) {
+  if (conn_.transportSettings.hystartPlusPlus) {
+    onPacketAckedInHystartPlusPlus(ack);
+    return;
+  }
   if (!hystartState_.inRttRound) {
     startHystartRttRound(ack.ackTime);
   }
@@ -538,17 +663,15 @@ void Cubic::onPacketAckedInHystart(const AckEvent& ack) {
                << (*exitReason == Cubic::ExitReason::SSTHRESH
                        ? "cwnd > ssthresh"
                        : "found exit point");
-      hystartState_.inRttRound = false;
-      ssthresh_ = cwndBytes_;
-      /* Now we exit slow start, reset currSampledRtt to be maximal value so
-       * that next time we go back to slow start, we won't be using a very old
-       * sampled RTT as the lastSampledRtt:
-       */
-      hystartState_.currSampledRtt = folly::none;
-      steadyState_.lastMaxCwndBytes = folly::none;
-      steadyState_.lastReductionTime = folly::none;
-      quiescenceStart_ = folly::none;
-      state_ = CubicStates::Steady;
+      if (*exitReason == Cubic::ExitReason::SSTHRESH) {
+        exitHystart(QuicTransportStatsCallback::SlowStartExitReason::SSTHRESH);
+      } else if (
+          hystartState_.found == Cubic::HystartFound::FoundByAckTrainMethod) {
+        exitHystart(QuicTransportStatsCallback::SlowStartExitReason::ACK_TRAIN);
+      } else {
+        exitHystart(
+            QuicTransportStatsCallback::SlowStartExitReason::DELAY_INCREASE);
+      }
     } else {
       // No exit yet, but we may still need to end this RTT round
       VLOG(20) << "Cubic Hystart, mayEndHystartRttRound, largestAckedPacketNum="
@@ -633,6 +756,40 @@ void Cubic::onPacketAckedInHystart(const AckEvent& ack) {
   }
 }
 
+void Cubic::onPacketAckedInHystartPlusPlus(const AckEvent& ack) {
+  auto growth = hystartPlusPlus_.onAckEvent(ack);
+  addAndCheckOverflow(cwndBytes_, growth);
+  cwndBytes_ = boundedCwnd(
+      cwndBytes_,
+      conn_.udpSendPacketLen,
+      conn_.transportSettings.maxCwndInMss,
+      conn_.transportSettings.minCwndInMss);
+  VLOG(15) << "Cubic HyStart++ increase cwnd=" << cwndBytes_ << ", by "
+           << growth;
+  if (cwndBytes_ >= ssthresh_) {
+    exitHystart(QuicTransportStatsCallback::SlowStartExitReason::SSTHRESH);
+  } else if (hystartPlusPlus_.phase() == HystartPlusPlus::Phase::Exited) {
+    exitHystart(QuicTransportStatsCallback::SlowStartExitReason::
+                    CONSERVATIVE_SLOW_START);
+  }
+}
+
+void Cubic::exitHystart(
+    QuicTransportStatsCallback::SlowStartExitReason reason) {
+  QUIC_STATS(conn_.infoCallback, onSlowStartExit, reason);
+  hystartState_.inRttRound = false;
+  ssthresh_ = cwndBytes_;
+  /* Now we exit slow start, reset currSampledRtt to be maximal value so
+   * that next time we go back to slow start, we won't be using a very old
+   * sampled RTT as the lastSampledRtt:
+   */
+  hystartState_.currSampledRtt = folly::none;
+  steadyState_.lastMaxCwndBytes = folly::none;
+  steadyState_.lastReductionTime = folly::none;
+  quiescenceStart_ = folly::none;
+  state_ = CubicStates::Steady;
+}
+
 /**
  * Note: The Cubic paper, and linux/chromium implementation differ on the
  * definition of "time to origin", or the variable K in the paper. In the paper,
@@ -655,7 +812,7 @@ void Cubic::onPacketAckedInSteady(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kAckInQuiescence,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
     return;
   }
@@ -676,7 +833,7 @@ void Cubic::onPacketAckedInSteady(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kResetTimeToOrigin,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
     steadyState_.timeToOrigin = 0.0;
     steadyState_.lastMaxCwndBytes = cwndBytes_;
@@ -697,7 +854,7 @@ void Cubic::onPacketAckedInSteady(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kResetLastReductionTime,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
   }
   uint64_t newCwnd = calculateCubicCwnd(calculateCubicCwndDelta(ack.ackTime));
@@ -727,7 +884,7 @@ void Cubic::onPacketAckedInSteady(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kRenoCwndEstimation,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
   }
 }
@@ -736,6 +893,7 @@ void Cubic::onPacketAckedInRecovery(const AckEvent& ack) {
   CHECK_EQ(cwndBytes_, ssthresh_);
   if (isRecovered(ack.ackedPackets.back().time)) {
     state_ = CubicStates::Steady;
+    recoveryState_.undoState = folly::none;
 
     // We do a Cubic cwnd pre-calculation here so that all Ack events from
     // this point on in the Steady state will only increase cwnd. We can check
@@ -753,7 +911,7 @@ void Cubic::onPacketAckedInRecovery(const AckEvent& ack) {
           inflightBytes_,
           getCongestionWindow(),
           kPacketAckedInRecovery,
-          cubicStateToString(state_).str());
+          cubicStateToString(state_));
     }
   }
 }
@@ -10,6 +10,7 @@
 
 #include <quic/QuicException.h>
 #include <quic/congestion_control/CongestionControlFunctions.h>
+#include <quic/congestion_control/HystartPlusPlus.h>
 #include <quic/logging/QuicLogger.h>
 #include <quic/state/StateData.h>
 
@@ -52,6 +53,8 @@ class Cubic : public CongestionController {
    * tcpFriendly:       if cubic cwnd calculation should be friendly to Reno TCP
    * spreadacrossRtt:   if the pacing bursts should be spread across RTT or all
    *                    close to the beginning of an RTT round
+   * initCwndBytes:     the initial cwnd, instead of the one of the transport
+   *                    settings
    */
   // TODO: We haven't experimented with setting ackTrain and tcpFriendly
   explicit Cubic(
@@ -59,7 +62,8 @@ class Cubic : public CongestionController {
       uint64_t initSsthresh = std::numeric_limits<uint64_t>::max(),
       bool tcpFriendly = true,
       bool ackTrain = false,
-      bool spreadAcrossRtt = false);
+      bool spreadAcrossRtt = false,
+      folly::Optional<uint64_t> initCwndBytes = folly::none);
 
   class CubicBuilder {
    public:
@@ -101,6 +105,8 @@ class Cubic : public CongestionController {
 
   bool isAppLimited() const noexcept override;
 
+  void onSpuriousLoss(TimePoint lossTime) override;
+
   CongestionControlType type() const noexcept override;
 
  protected:
@@ -110,12 +116,17 @@ class Cubic : public CongestionController {
   bool isAppIdle() const noexcept;
   void onPacketAcked(const AckEvent& ack);
   void onPacketAckedInHystart(const AckEvent& ack);
+  void onPacketAckedInHystartPlusPlus(const AckEvent& ack);
+  void exitHystart(QuicTransportStatsCallback::SlowStartExitReason reason);
   void onPacketAckedInSteady(const AckEvent& ack);
   void onPacketAckedInRecovery(const AckEvent& ack);
 
   void onPacketLoss(const LossEvent& loss);
   void onPacketLossInRecovery(const LossEvent& loss);
   void onPersistentCongestion();
+  void onIdleRestart(uint64_t restartCwndBytes);
+  // Whether the ack may grow the cwnd, see CwndValidator.
+  bool isCwndValidated(TimePoint ackTime) noexcept;
 
   float pacingGain() const noexcept;
 
@@ -181,15 +192,37 @@ class Cubic : public CongestionController {
     float tcpEstimationIncreaseFactor;
   };
 
+  // The state before the loss that started the current recovery, restored
+  // if all the packets lost during the recovery are acked after all.
+  struct UndoState {
+    uint64_t cwndBytes;
+    uint64_t ssthresh;
+    CubicStates state;
+    SteadyState steadyState;
+    folly::Optional<TimePoint> endOfRecovery;
+    // lossTime of the loss event that started the recovery
+    TimePoint lossTime;
+    // Packets lost during the recovery that are not known to be spurious
+    uint64_t lostPackets;
+  };
+
   struct RecoveryState {
     // The time point after which Quic will no longer be in current recovery
     folly::Optional<TimePoint> endOfRecovery;
+    folly::Optional<UndoState> undoState;
   };
 
   // if quiescenceStart_ has a value, then the connection is app limited
   folly::Optional<TimePoint> quiescenceStart_;
 
+  // Used with TransportSettings::cwndValidation. nonValidatedStart_ is set
+  // while the cwnd is not validated.
+  CwndValidator cwndValidator_;
+  folly::Optional<TimePoint> nonValidatedStart_;
+
   HystartState hystartState_;
+  // Used instead of hystartState_ when hystartPlusPlus is set
+  HystartPlusPlus hystartPlusPlus_;
   SteadyState steadyState_;
   RecoveryState recoveryState_;
 
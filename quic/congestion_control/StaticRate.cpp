@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/StaticRate.h>
+#include <quic/congestion_control/CongestionControlFunctions.h>
+#include <quic/logging/QLoggerConstants.h>
+
+namespace quic {
+
+StaticRate::StaticRate(QuicConnectionStateBase& conn) : conn_(conn) {}
+
+void StaticRate::onRemoveBytesFromInflight(uint64_t bytes) {
+  subtractAndCheckUnderflow(bytesInFlight_, bytes);
+  VLOG(10) << __func__ << " writable=" << getWritableBytes()
+           << " cwnd=" << getCongestionWindow()
+           << " inflight=" << bytesInFlight_ << " " << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kRemoveInflight);
+  }
+}
+
+void StaticRate::onPacketSent(const OutstandingPacket& packet) {
+  addAndCheckOverflow(bytesInFlight_, packet.encodedSize);
+  // The rate may have been changed since the last packet.
+  updatePacing();
+  VLOG(10) << __func__ << " writable=" << getWritableBytes()
+           << " cwnd=" << getCongestionWindow()
+           << " inflight=" << bytesInFlight_ << " " << conn_;
+  if (conn_.qLogger) {
+    conn_.qLogger->addCongestionMetricUpdate(
+        bytesInFlight_, getCongestionWindow(), kCongestionPacketSent);
+  }
+}
+
+void StaticRate::onPacketAckOrLoss(
+    folly::Optional<AckEvent> ack,
+    folly::Optional<LossEvent> loss) {
+  if (loss) {
+    subtractAndCheckUnderflow(bytesInFlight_, loss->lostBytes);
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          bytesInFlight_, getCongestionWindow(), kCongestionPacketLoss);
+    }
+  }
+  if (ack && ack->largestAckedPacket.hasValue()) {
+    subtractAndCheckUnderflow(bytesInFlight_, ack->ackedBytes);
+    if (conn_.qLogger) {
+      conn_.qLogger->addCongestionMetricUpdate(
+          bytesInFlight_, getCongestionWindow(), kCongestionPacketAck);
+    }
+  }
+  VLOG(10) << __func__ << " writable=" << getWritableBytes()
+           << " cwnd=" << getCongestionWindow()
+           << " inflight=" << bytesInFlight_ << " " << conn_;
+}
+
+void StaticRate::updatePacing() noexcept {
+  auto rate = conn_.transportSettings.staticRateBytesPerSec;
+  if (!conn_.pacer || rate == 0 || (pacedRate_ && *pacedRate_ == rate)) {
+    return;
+  }
+  pacedRate_ = rate;
+  conn_.pacer->refreshPacingRate(
+      rate * kStaticRatePacingPeriod.count() / 1000000,
+      kStaticRatePacingPeriod);
+}
+
+uint64_t StaticRate::getWritableBytes() const noexcept {
+  auto cwndBytes = getCongestionWindow();
+  if (bytesInFlight_ > cwndBytes) {
+    return 0;
+  } else {
+    return cwndBytes - bytesInFlight_;
+  }
+}
+
+uint64_t StaticRate::getCongestionWindow() const noexcept {
+  const auto& transportSettings = conn_.transportSettings;
+  auto maxCwndBytes = transportSettings.maxCwndInMss * conn_.udpSendPacketLen;
+  auto rate = transportSettings.staticRateBytesPerSec;
+  if (!transportSettings.staticRateCwndGuard || rate == 0 ||
+      conn_.lossState.srtt == 0us) {
+    return maxCwndBytes;
+  }
+  return boundedCwnd(
+      rate * kStaticRateCwndGuardRtts * conn_.lossState.srtt.count() / 1000000,
+      conn_.udpSendPacketLen,
+      transportSettings.maxCwndInMss,
+      transportSettings.minCwndInMss);
+}
+
+CongestionControlType StaticRate::type() const noexcept {
+  return CongestionControlType::StaticRate;
+}
+
+void StaticRate::setConnectionEmulation(uint8_t) noexcept {}
+
+uint64_t StaticRate::getBytesInFlight() const noexcept {
+  return bytesInFlight_;
+}
+
+void StaticRate::setAppIdle(bool, TimePoint) noexcept { /* unsupported */
+}
+
+void StaticRate::setAppLimited() { /* unsupported */
+}
+
+bool StaticRate::isAppLimited() const noexcept {
+  return false; // unsupported
+}
+
+uint64_t StaticRate::getBandwidthEstimate() const {
+  return conn_.transportSettings.staticRateBytesPerSec;
+}
+
+} // namespace quic
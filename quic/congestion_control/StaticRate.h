@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicException.h>
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+// With the cwnd guard, the cwnd is what the rate sends in this many srtts.
+constexpr uint64_t kStaticRateCwndGuardRtts = 2;
+// The pacer is given the rate as the bytes sent over this period.
+constexpr std::chrono::microseconds kStaticRatePacingPeriod{1000 * 1000};
+
+/**
+ * Sends at the rate the operator sets in
+ * TransportSettings::staticRateBytesPerSec, or with
+ * QuicSocket::setStaticSendRate, for links whose bandwidth is provisioned
+ * rather than discovered. It paces at that rate, so pacingEnabled has to be
+ * set, and does not react to loss or delay.
+ *
+ * Its cwnd is maxCwndInMss. With staticRateCwndGuard, it is what the rate
+ * sends in kStaticRateCwndGuardRtts srtts instead, bounded by maxCwndInMss,
+ * so that a path slower than the rate does not build up a queue of
+ * maxCwndInMss.
+ */
+class StaticRate : public CongestionController {
+ public:
+  explicit StaticRate(QuicConnectionStateBase& conn);
+  void onRemoveBytesFromInflight(uint64_t) override;
+  void onPacketSent(const OutstandingPacket& packet) override;
+  void onPacketAckOrLoss(folly::Optional<AckEvent>, folly::Optional<LossEvent>)
+      override;
+
+  uint64_t getWritableBytes() const noexcept override;
+  uint64_t getCongestionWindow() const noexcept override;
+  void setConnectionEmulation(uint8_t) noexcept override;
+  void setAppIdle(bool, TimePoint) noexcept override;
+  void setAppLimited() override;
+
+  CongestionControlType type() const noexcept override;
+
+  uint64_t getBytesInFlight() const noexcept;
+
+  bool isAppLimited() const noexcept override;
+
+  uint64_t getBandwidthEstimate() const override;
+
+ private:
+  void updatePacing() noexcept;
+
+  QuicConnectionStateBase& conn_;
+  uint64_t bytesInFlight_{0};
+  // The rate the pacer was last given
+  folly::Optional<uint64_t> pacedRate_;
+};
+} // namespace quic
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/Bbr2.h>
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+namespace {
+CongestionController::LossEvent makeLoss(uint64_t lostBytes) {
+  CongestionController::LossEvent loss;
+  loss.lostBytes = lostBytes;
+  loss.lostPackets = 1;
+  return loss;
+}
+} // namespace
+
+class Bbr2Test : public Test {};
+
+TEST_F(Bbr2Test, InitStates) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  Bbr2CongestionController bbr(conn);
+  EXPECT_EQ(CongestionControlType::BBR2, bbr.type());
+  EXPECT_EQ("Startup", bbr2StateToString(bbr.state()));
+  EXPECT_EQ(
+      1000 * conn.transportSettings.initCwndInMss, bbr.getCongestionWindow());
+  EXPECT_EQ(bbr.getWritableBytes(), bbr.getCongestionWindow());
+  EXPECT_FALSE(bbr.inflightHi().hasValue());
+  EXPECT_FALSE(bbr.inflightLo().hasValue());
+}
+
+TEST_F(Bbr2Test, FactoryMakesBbr2) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  DefaultCongestionControllerFactory factory;
+  auto cc = factory.makeCongestionController(conn, CongestionControlType::BBR2);
+  ASSERT_NE(nullptr, cc);
+  EXPECT_EQ(CongestionControlType::BBR2, cc->type());
+}
+
+TEST_F(Bbr2Test, LossSetsInflightBounds) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  Bbr2CongestionController bbr(conn);
+  auto initCwnd = bbr.getCongestionWindow();
+  PacketNum packetNum = 0;
+  bbr.onPacketSent(makeTestingWritePacket(packetNum, 20000, 20000));
+
+  // The first ack always ends a round trip.
+  auto sentTime = Clock::now();
+  bbr.onPacketAckOrLoss(
+      makeAck(packetNum++, 1000, sentTime + 1ms, sentTime), folly::none);
+  EXPECT_EQ(Bbr2CongestionController::State::Startup, bbr.state());
+
+  // A round trip with lots of loss events and a high loss rate ends Startup,
+  // and sets inflight_hi. Without bandwidth samples the BDP is the initial
+  // cwnd, which the inflight is already down to, so Drain ends right away.
+  for (uint32_t i = 0; i < kBbr2StartupFullLossCount; i++) {
+    bbr.onPacketAckOrLoss(folly::none, makeLoss(1000));
+  }
+  sentTime = Clock::now() + 1ms;
+  bbr.onPacketAckOrLoss(
+      makeAck(packetNum++, 1000, sentTime + 1ms, sentTime), folly::none);
+  EXPECT_EQ(Bbr2CongestionController::State::ProbeBwDown, bbr.state());
+  ASSERT_TRUE(bbr.inflightHi().hasValue());
+  EXPECT_EQ(initCwnd, *bbr.inflightHi());
+  EXPECT_EQ(*bbr.inflightHi(), bbr.getCongestionWindow());
+  EXPECT_FALSE(bbr.inflightLo().hasValue());
+
+  // A lossy round trip outside of probing lowers inflight_lo and the cwnd.
+  auto cwnd = bbr.getCongestionWindow();
+  bbr.onPacketAckOrLoss(folly::none, makeLoss(1000));
+  sentTime = Clock::now() + 2ms;
+  bbr.onPacketAckOrLoss(
+      makeAck(packetNum++, 1000, sentTime + 1ms, sentTime), folly::none);
+  ASSERT_TRUE(bbr.inflightLo().hasValue());
+  EXPECT_EQ((uint64_t)(cwnd * kBbr2Beta), *bbr.inflightLo());
+  EXPECT_EQ(*bbr.inflightLo(), bbr.getCongestionWindow());
+  // Inflight is now below the headroom of inflight_hi.
+  EXPECT_EQ(Bbr2CongestionController::State::ProbeBwCruise, bbr.state());
+}
+
+TEST_F(Bbr2Test, CeMarksSetInflightBounds) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  Bbr2CongestionController bbr(conn);
+  auto initCwnd = bbr.getCongestionWindow();
+  PacketNum packetNum = 0;
+  bbr.onPacketSent(makeTestingWritePacket(packetNum, 20000, 20000));
+
+  auto sentTime = Clock::now();
+  bbr.onPacketAckOrLoss(
+      makeAck(packetNum++, 1000, sentTime + 1ms, sentTime), folly::none);
+  EXPECT_EQ(Bbr2CongestionController::State::Startup, bbr.state());
+
+  // A round trip with most of its packets CE marked ends Startup like a
+  // lossy one, without any loss.
+  sentTime = Clock::now() + 1ms;
+  auto ack = makeAck(packetNum++, 1000, sentTime + 1ms, sentTime);
+  ack.ecnCeMarked = 1;
+  bbr.onPacketAckOrLoss(ack, folly::none);
+  EXPECT_EQ(Bbr2CongestionController::State::ProbeBwDown, bbr.state());
+  ASSERT_TRUE(bbr.inflightHi().hasValue());
+  EXPECT_EQ(initCwnd, *bbr.inflightHi());
+  EXPECT_FALSE(bbr.inflightLo().hasValue());
+
+  // Outside of probing they lower inflight_lo.
+  auto cwnd = bbr.getCongestionWindow();
+  sentTime = Clock::now() + 2ms;
+  ack = makeAck(packetNum++, 1000, sentTime + 1ms, sentTime);
+  ack.ecnCeMarked = 1;
+  bbr.onPacketAckOrLoss(ack, folly::none);
+  ASSERT_TRUE(bbr.inflightLo().hasValue());
+  EXPECT_EQ((uint64_t)(cwnd * kBbr2Beta), *bbr.inflightLo());
+}
+
+} // namespace test
+} // namespace quic
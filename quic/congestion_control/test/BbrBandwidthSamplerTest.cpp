@@ -53,7 +53,7 @@ TEST_F(BbrBandwidthSamplerTest, RateCalculation) {
     packet.lastAckedPacketInfo.emplace(
         lastAckedPacketSentTime, lastAckedPacketAckTime, 0, 0);
     packet.time = ackTime - 50us;
-    ackEvent.ackedPackets.push_back(packet);
+    ackEvent.ackedPackets.emplace_back(packet);
   }
 
   sampler.onPacketAcked(ackEvent, 0);
@@ -75,7 +75,7 @@ TEST_F(BbrBandwidthSamplerTest, SampleExpiration) {
   packet.lastAckedPacketInfo.emplace(
       lastAckedPacketSentTime, lastAckedPacketAckTime, 1000, 1000);
   packet.time = ackTime - 50us;
-  ackEvent.ackedPackets.push_back(packet);
+  ackEvent.ackedPackets.emplace_back(packet);
   sampler.onPacketAcked(ackEvent, 0);
   auto firstBandwidthSample = sampler.getBandwidth();
 
@@ -87,7 +87,7 @@ TEST_F(BbrBandwidthSamplerTest, SampleExpiration) {
   CongestionController::AckEvent ackEvent2;
   ackEvent2.ackTime = ackTime2;
   packet2.time = ackTime + 110us;
-  ackEvent2.ackedPackets.push_back(packet2);
+  ackEvent2.ackedPackets.emplace_back(packet2);
   sampler.onPacketAcked(ackEvent2, kBandwidthWindowLength / 4 + 1);
   auto secondBandwidthSample = sampler.getBandwidth();
   EXPECT_EQ(firstBandwidthSample, sampler.getBandwidth());
@@ -100,7 +100,7 @@ TEST_F(BbrBandwidthSamplerTest, SampleExpiration) {
   CongestionController::AckEvent ackEvent3;
   ackEvent3.ackTime = ackTime3;
   packet3.time = ackTime + 210us;
-  ackEvent3.ackedPackets.push_back(packet3);
+  ackEvent3.ackedPackets.emplace_back(packet3);
   sampler.onPacketAcked(ackEvent3, kBandwidthWindowLength / 2 + 1);
   EXPECT_EQ(firstBandwidthSample, sampler.getBandwidth());
 
@@ -112,7 +112,7 @@ TEST_F(BbrBandwidthSamplerTest, SampleExpiration) {
   CongestionController::AckEvent ackEvent4;
   ackEvent4.ackTime = ackTime4;
   packet4.time = ackTime + 310us;
-  ackEvent4.ackedPackets.push_back(packet4);
+  ackEvent4.ackedPackets.emplace_back(packet4);
   sampler.onPacketAcked(ackEvent4, kBandwidthWindowLength + 1);
   // The bandwidth we got from packet1 has expired. Packet2 should have
   // generated the current max:
@@ -132,7 +132,7 @@ TEST_F(BbrBandwidthSamplerTest, AppLimited) {
   ackEvent.largestAckedPacket = ++conn.lossState.largestSent;
   auto packet =
       makeTestingWritePacket(*ackEvent.largestAckedPacket, 1000, 1000, false);
-  ackEvent.ackedPackets.push_back(std::move(packet));
+  ackEvent.ackedPackets.emplace_back(packet);
   sampler.onPacketAcked(ackEvent, 0);
   EXPECT_FALSE(sampler.isAppLimited());
 
@@ -167,7 +167,7 @@ TEST_F(BbrBandwidthSamplerTest, AppLimitedOutstandingPacket) {
   packet.lastAckedPacketInfo.emplace(
       lastAckedPacketSentTime, lastAckedPacketAckTime, 0, 0);
   packet.time = ackTime - 50us;
-  ackEvent.ackedPackets.push_back(packet);
+  ackEvent.ackedPackets.emplace_back(packet);
   // AppLimited packet, but sample is larger than current best
   sampler.onPacketAcked(ackEvent, 0);
   EXPECT_LT(0, sampler.getBandwidth().bytes);
@@ -181,7 +181,7 @@ TEST_F(BbrBandwidthSamplerTest, AppLimitedOutstandingPacket) {
   CongestionController::AckEvent ackEvent1;
   ackEvent1.ackedBytes = 1000;
   ackEvent1.ackTime = ackTime + 2000us;
-  ackEvent1.ackedPackets.push_back(packet1);
+  ackEvent1.ackedPackets.emplace_back(packet1);
   // AppLImited packet, bandwidth sampler is less than current best
   sampler.onPacketAcked(ackEvent1, 0);
   EXPECT_EQ(bandwidth, sampler.getBandwidth());
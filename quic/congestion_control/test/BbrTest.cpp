@@ -151,6 +151,28 @@ TEST_F(BbrTest, Recovery) {
   EXPECT_FALSE(bbr.inRecovery());
 }
 
+TEST_F(BbrTest, SpuriousLossUndo) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  BbrCongestionController::BbrConfig config;
+  BbrCongestionController bbr(conn, config);
+  auto packet = makeTestingWritePacket(0, 1000, 1000);
+  bbr.onPacketSent(packet);
+  bbr.onPacketSent(makeTestingWritePacket(1, 10000, 11000));
+  auto cwnd = bbr.getCongestionWindow();
+
+  CongestionController::LossEvent loss;
+  loss.addLostPacket(packet);
+  auto lossTime = loss.lossTime;
+  bbr.onPacketAckOrLoss(folly::none, std::move(loss));
+  EXPECT_TRUE(bbr.inRecovery());
+  EXPECT_GT(cwnd, bbr.getCongestionWindow());
+
+  bbr.onSpuriousLoss(lossTime);
+  EXPECT_FALSE(bbr.inRecovery());
+  EXPECT_EQ(cwnd, bbr.getCongestionWindow());
+}
+
 TEST_F(BbrTest, StartupCwnd) {
   QuicConnectionStateBase conn(QuicNodeType::Client);
   conn.udpSendPacketLen = 1000;
@@ -549,6 +571,20 @@ TEST_F(BbrTest, AppLimited) {
   EXPECT_TRUE(bbr.isAppLimited());
 }
 
+TEST_F(BbrTest, BandwidthEstimate) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  BbrCongestionController::BbrConfig config;
+  BbrCongestionController bbr(conn, config);
+  EXPECT_EQ(0, bbr.getBandwidthEstimate());
+
+  auto mockBandwidthSampler = std::make_unique<MockBandwidthSampler>();
+  auto rawBandwidthSampler = mockBandwidthSampler.get();
+  bbr.setBandwidthSampler(std::move(mockBandwidthSampler));
+  EXPECT_CALL(*rawBandwidthSampler, getBandwidth())
+      .WillOnce(Return(Bandwidth(5000, 10ms)));
+  EXPECT_EQ(500000, bbr.getBandwidthEstimate());
+}
+
 TEST_F(BbrTest, AppLimitedIgnored) {
   QuicConnectionStateBase conn(QuicNodeType::Client);
   BbrCongestionController::BbrConfig config;
@@ -19,6 +19,15 @@ namespace test {
 
 class CongestionControlFunctionsTest : public Test {};
 
+OutstandingPacket makePacket(uint32_t size, TimePoint sendTime) {
+  RegularQuicWritePacket packet(ShortHeader(
+      ProtectionType::KeyPhaseZero,
+      ConnectionId(std::vector<uint8_t>(8, 0)),
+      0));
+  return OutstandingPacket(
+      std::move(packet), sendTime, size, false, false, size);
+}
+
 TEST_F(CongestionControlFunctionsTest, CalculatePacingRate) {
   QuicConnectionStateBase conn(QuicNodeType::Client);
   conn.udpSendPacketLen = 1;
@@ -67,6 +76,50 @@ TEST_F(CongestionControlFunctionsTest, RttSmallerThanInterval) {
       conn.transportSettings.writeConnectionDataPacketsLimit, result.burstSize);
 }
 
+TEST_F(CongestionControlFunctionsTest, CwndValidated) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.lossState.srtt = 100ms;
+  CwndValidator validator(conn);
+  auto now = Clock::now();
+  EXPECT_EQ(10000, validator.onPacketSent(makePacket(1000, now), 0, 10000));
+  EXPECT_FALSE(validator.isCwndValidated(10000));
+  EXPECT_EQ(
+      10000, validator.onPacketSent(makePacket(4000, now + 1ms), 1000, 10000));
+  EXPECT_TRUE(validator.isCwndValidated(10000));
+
+  // The largest inflight of the last period still counts in the next one,
+  // but not in the one after it.
+  validator.onPacketSent(makePacket(1000, now + 150ms), 1000, 10000);
+  EXPECT_TRUE(validator.isCwndValidated(10000));
+  validator.onPacketSent(makePacket(1000, now + 300ms), 1000, 10000);
+  EXPECT_FALSE(validator.isCwndValidated(10000));
+}
+
+TEST_F(CongestionControlFunctionsTest, CwndIdleRestart) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.lossState.srtt = 10ms;
+  conn.lossState.rttvar = 1ms;
+  auto cwnd = 100 * conn.udpSendPacketLen;
+  auto restartCwnd =
+      conn.transportSettings.initCwndInMss * conn.udpSendPacketLen;
+  CwndValidator validator(conn);
+  auto now = Clock::now();
+  EXPECT_EQ(cwnd, validator.onPacketSent(makePacket(1000, now), 0, cwnd));
+  // Not idle for long enough, or with bytes still in flight.
+  EXPECT_EQ(
+      cwnd, validator.onPacketSent(makePacket(1000, now + 10ms), 0, cwnd));
+  EXPECT_EQ(
+      cwnd, validator.onPacketSent(makePacket(1000, now + 100ms), 1000, cwnd));
+  EXPECT_EQ(
+      restartCwnd,
+      validator.onPacketSent(makePacket(1000, now + 200ms), 0, cwnd));
+  // A window at most the restart window stays as it is.
+  auto smallCwnd = restartCwnd / 2;
+  EXPECT_EQ(
+      smallCwnd,
+      validator.onPacketSent(makePacket(1000, now + 400ms), 0, smallCwnd));
+}
+
 
 } // namespace test
 } // namespace quic
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/CongestionControllerFactory.h>
+
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include <quic/state/StateData.h>
+#include <quic/state/test/Mocks.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+class PathCongestionControlPolicyTest : public Test {
+ public:
+  void SetUp() override {
+    auto controller = std::make_unique<NiceMock<MockCongestionController>>();
+    controller_ = controller.get();
+    conn_.congestionController = std::move(controller);
+    ON_CALL(*controller_, type())
+        .WillByDefault(Return(CongestionControlType::Cubic));
+    ON_CALL(*controller_, getCongestionWindow())
+        .WillByDefault(Return(100 * 1000));
+    conn_.lossState.totalBytesSent = kPathPolicyMinBytesSent;
+    conn_.lossState.srtt = 100ms;
+    conn_.lossState.mrtt = 100ms;
+  }
+
+ protected:
+  QuicConnectionStateBase conn_{QuicNodeType::Server};
+  MockCongestionController* controller_;
+  PathCongestionControlPolicy policy_{1000 * 1000, 0.02};
+};
+
+TEST_F(PathCongestionControlPolicyTest, KeepCubicOnSmallPath) {
+  EXPECT_FALSE(policy_.selectCongestionController(conn_).hasValue());
+}
+
+TEST_F(PathCongestionControlPolicyTest, BbrOnHighBdp) {
+  ON_CALL(*controller_, getCongestionWindow())
+      .WillByDefault(Return(2000 * 1000));
+  EXPECT_EQ(
+      CongestionControlType::BBR, policy_.selectCongestionController(conn_));
+
+  // Nothing is decided before enough was sent.
+  conn_.lossState.totalBytesSent = kPathPolicyMinBytesSent - 1;
+  EXPECT_FALSE(policy_.selectCongestionController(conn_).hasValue());
+}
+
+TEST_F(PathCongestionControlPolicyTest, BbrOnLoss) {
+  conn_.lossState.totalBytesRetransmitted = kPathPolicyMinBytesSent / 20;
+  EXPECT_EQ(
+      CongestionControlType::BBR, policy_.selectCongestionController(conn_));
+}
+
+TEST_F(PathCongestionControlPolicyTest, BackToCubicWithHysteresis) {
+  ON_CALL(*controller_, type())
+      .WillByDefault(Return(CongestionControlType::BBR));
+  // 800KB per 100ms of min rtt is still above half of the threshold.
+  ON_CALL(*controller_, getBandwidthEstimate())
+      .WillByDefault(Return(8000 * 1000));
+  EXPECT_FALSE(policy_.selectCongestionController(conn_).hasValue());
+
+  ON_CALL(*controller_, getBandwidthEstimate())
+      .WillByDefault(Return(4000 * 1000));
+  EXPECT_EQ(
+      CongestionControlType::Cubic,
+      policy_.selectCongestionController(conn_));
+}
+
+TEST_F(PathCongestionControlPolicyTest, OtherControllersLeftAlone) {
+  ON_CALL(*controller_, type())
+      .WillByDefault(Return(CongestionControlType::Copa));
+  ON_CALL(*controller_, getCongestionWindow())
+      .WillByDefault(Return(2000 * 1000));
+  EXPECT_FALSE(policy_.selectCongestionController(conn_).hasValue());
+}
+
+TEST(CongestionControllerFactoryTest, MakeFromCwnd) {
+  QuicConnectionStateBase conn(QuicNodeType::Server);
+  auto initCwndInMss = conn.transportSettings.initCwndInMss;
+  auto initCwndBytes = 50 * conn.udpSendPacketLen;
+  DefaultCongestionControllerFactory factory;
+  for (auto type : {CongestionControlType::NewReno,
+                    CongestionControlType::Cubic,
+                    CongestionControlType::Copa,
+                    CongestionControlType::BBR,
+                    CongestionControlType::BBR2,
+                    CongestionControlType::Prague}) {
+    auto controller =
+        factory.makeCongestionControllerFromCwnd(conn, type, initCwndBytes);
+    ASSERT_NE(nullptr, controller);
+    EXPECT_EQ(type, controller->type());
+    EXPECT_EQ(initCwndBytes, controller->getCongestionWindow());
+    EXPECT_EQ(
+        initCwndInMss * conn.udpSendPacketLen,
+        factory.makeCongestionController(conn, type)->getCongestionWindow());
+  }
+  EXPECT_EQ(initCwndInMss, conn.transportSettings.initCwndInMss);
+}
+
+} // namespace test
+} // namespace quic
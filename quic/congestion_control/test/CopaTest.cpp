@@ -10,6 +10,7 @@
 
 #include <folly/portability/GTest.h>
 #include <quic/common/test/TestUtils.h>
+#include <quic/state/test/Mocks.h>
 
 using namespace testing;
 
@@ -52,7 +53,7 @@ class CopaTest : public Test {
     ack.largestAckedPacket = largestAcked;
     ack.ackTime = ackTime;
     ack.ackedBytes = ackedSize;
-    ack.ackedPackets.push_back(createPacket(
+    ack.ackedPackets.emplace_back(createPacket(
         largestAcked,
         ackedSize,
         ackedSize /* incorrect totalSent but works for this test */));
@@ -435,6 +436,123 @@ TEST_F(CopaTest, TestVelocity) {
   lastCwnd = copa.getCongestionWindow();
 }
 
+TEST_F(CopaTest, CompetitiveMode) {
+  QuicServerConnectionState conn;
+  conn.transportSettings.copaModeSwitching = true;
+  Copa copa(conn);
+  auto qLogger = std::make_shared<FileQLogger>();
+  conn.qLogger = qLogger;
+  auto now = Clock::now();
+  exitSlowStart(copa, conn, now);
+  auto packetSize = conn.udpSendPacketLen;
+  EXPECT_FALSE(copa.inCompetitiveMode());
+
+  // Sends a packet for each one acked, so that the inflight stays the same.
+  PacketNum packetNum = 20;
+  auto sendAndAck = [&](TimePoint ackTime) {
+    copa.onPacketSent(createPacket(packetNum, packetSize, packetSize));
+    copa.onPacketAckOrLoss(
+        createAckEvent(packetNum++, packetSize, ackTime), folly::none);
+  };
+
+  // The queue stays at 100ms of the 150ms rtt, as behind a buffer-filling
+  // flow. The queue last came close to empty 100ms before the end of the
+  // slow start.
+  for (int i = 0; i < 8; i++) {
+    now += 50ms;
+    sendAndAck(now);
+    EXPECT_FALSE(copa.inCompetitiveMode());
+  }
+  now += 50ms;
+  sendAndAck(now);
+  EXPECT_TRUE(copa.inCompetitiveMode());
+  EXPECT_DOUBLE_EQ(copa.getLatencyFactor(), 0.5);
+  std::vector<int> indices =
+      getQLogEventIndices(QLogEventType::CongestionMetricUpdate, qLogger);
+  auto tmp = std::move(qLogger->logs[indices.back()]);
+  auto event = dynamic_cast<QLogCongestionMetricUpdateEvent*>(tmp.get());
+  EXPECT_EQ(event->congestionEvent, kCopaCompetitiveMode);
+
+  // Without loss the latencyFactor keeps going down.
+  for (int i = 0; i < 40; i++) {
+    now += 50ms;
+    sendAndAck(now);
+  }
+  EXPECT_TRUE(copa.inCompetitiveMode());
+  auto latencyFactor = copa.getLatencyFactor();
+  EXPECT_LT(latencyFactor, 0.25);
+
+  // A loss doubles it, once per rtt.
+  copa.onPacketAckOrLoss(folly::none, createLossEvent({{51, 10}}));
+  EXPECT_DOUBLE_EQ(copa.getLatencyFactor(), 2 * latencyFactor);
+  copa.onPacketAckOrLoss(folly::none, createLossEvent({{52, 10}}));
+  EXPECT_DOUBLE_EQ(copa.getLatencyFactor(), 2 * latencyFactor);
+
+  // The queue drains, back to the default mode.
+  now += 50ms;
+  conn.lossState.lrtt = 50ms;
+  sendAndAck(now);
+  EXPECT_FALSE(copa.inCompetitiveMode());
+  EXPECT_DOUBLE_EQ(copa.getLatencyFactor(), 0.5);
+}
+
+TEST_F(CopaTest, NoCompetitiveModeByDefault) {
+  QuicServerConnectionState conn;
+  Copa copa(conn);
+  auto now = Clock::now();
+  exitSlowStart(copa, conn, now);
+  auto packetSize = conn.udpSendPacketLen;
+  for (PacketNum packetNum = 20; packetNum < 40; packetNum++) {
+    now += 50ms;
+    copa.onPacketSent(createPacket(packetNum, packetSize, packetSize));
+    copa.onPacketAckOrLoss(
+        createAckEvent(packetNum, packetSize, now), folly::none);
+  }
+  EXPECT_FALSE(copa.inCompetitiveMode());
+  EXPECT_DOUBLE_EQ(copa.getLatencyFactor(), 0.5);
+}
+
+TEST_F(CopaTest, PacingOnStandingRtt) {
+  QuicServerConnectionState conn;
+  conn.transportSettings.copaModeSwitching = true;
+  auto mockPacer = std::make_unique<MockPacer>();
+  auto rawPacer = mockPacer.get();
+  conn.pacer = std::move(mockPacer);
+  Copa copa(conn);
+  auto packetSize = conn.udpSendPacketLen;
+  copa.onPacketSent(createPacket(1, packetSize, packetSize));
+
+  conn.lossState.lrtt = 50ms;
+  conn.lossState.srtt = 80ms;
+  EXPECT_CALL(*rawPacer, refreshPacingRate(_, _))
+      .WillOnce(Invoke([&](uint64_t cwndBytes, std::chrono::microseconds rtt) {
+        EXPECT_EQ(cwndBytes, copa.getCongestionWindow() * kCopaPacingGain);
+        EXPECT_EQ(rtt, 50ms);
+      }));
+  copa.onPacketAckOrLoss(
+      createAckEvent(1, packetSize, Clock::now()), folly::none);
+}
+
+TEST_F(CopaTest, PacingOnSrttByDefault) {
+  QuicServerConnectionState conn;
+  auto mockPacer = std::make_unique<MockPacer>();
+  auto rawPacer = mockPacer.get();
+  conn.pacer = std::move(mockPacer);
+  Copa copa(conn);
+  auto packetSize = conn.udpSendPacketLen;
+  copa.onPacketSent(createPacket(1, packetSize, packetSize));
+
+  conn.lossState.lrtt = 50ms;
+  conn.lossState.srtt = 80ms;
+  EXPECT_CALL(*rawPacer, refreshPacingRate(_, _))
+      .WillOnce(Invoke([&](uint64_t cwndBytes, std::chrono::microseconds rtt) {
+        EXPECT_EQ(cwndBytes, copa.getCongestionWindow() * kCopaPacingGain);
+        EXPECT_EQ(rtt, 80ms);
+      }));
+  copa.onPacketAckOrLoss(
+      createAckEvent(1, packetSize, Clock::now()), folly::none);
+}
+
 TEST_F(CopaTest, NoLargestAckedPacketNoCrash) {
   QuicServerConnectionState conn;
   Copa copa(conn);
@@ -303,5 +303,68 @@ TEST_F(CubicTest, PacingGain) {
   auto event = dynamic_cast<QLogTransportStateUpdateEvent*>(tmp.get());
   EXPECT_EQ(event->update, kRecalculateTimeToOrigin);
 }
+
+TEST_F(CubicTest, SpuriousLossUndo) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  Cubic cubic(conn);
+  auto initCwnd = cubic.getCongestionWindow();
+  auto packet0 = makeTestingWritePacket(0, 1000, 1000);
+  auto packet1 = makeTestingWritePacket(1, 1000, 2000);
+  cubic.onPacketSent(packet0);
+  cubic.onPacketSent(packet1);
+  CongestionController::LossEvent loss;
+  loss.addLostPacket(packet0);
+  loss.addLostPacket(packet1);
+  auto lossTime = loss.lossTime;
+  cubic.onPacketAckOrLoss(folly::none, std::move(loss));
+  EXPECT_EQ(CubicStates::FastRecovery, cubic.state());
+  EXPECT_GT(initCwnd, cubic.getCongestionWindow());
+
+  // A packet of an older loss event does not count.
+  cubic.onSpuriousLoss(lossTime - 1ms);
+  cubic.onSpuriousLoss(lossTime);
+  EXPECT_EQ(CubicStates::FastRecovery, cubic.state());
+  // Both lost packets were only reordered.
+  cubic.onSpuriousLoss(lossTime);
+  EXPECT_EQ(CubicStates::Hystart, cubic.state());
+  EXPECT_EQ(initCwnd, cubic.getCongestionWindow());
+}
+
+TEST_F(CubicTest, CwndValidationNoGrowthWhenUnused) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.transportSettings.cwndValidation = true;
+  Cubic cubic(conn);
+  auto initCwnd = cubic.getCongestionWindow();
+  auto packet = makeTestingWritePacket(0, 100, 100);
+  cubic.onPacketSent(packet);
+  cubic.onPacketAckOrLoss(
+      makeAck(0, 100, Clock::now(), packet.time), folly::none);
+  EXPECT_EQ(initCwnd, cubic.getCongestionWindow());
+}
+
+TEST_F(CubicTest, CwndValidationIdleRestart) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.transportSettings.cwndValidation = true;
+  conn.lossState.srtt = 10ms;
+  auto mockPacer = std::make_unique<NiceMock<MockPacer>>();
+  auto rawPacer = mockPacer.get();
+  conn.pacer = std::move(mockPacer);
+  Cubic cubic(conn);
+  auto initCwnd = cubic.getCongestionWindow();
+  auto sendTime = Clock::now();
+  auto packet = makeTestingWritePacket(0, initCwnd, initCwnd, false, sendTime);
+  cubic.onPacketSent(packet);
+  cubic.onPacketAckOrLoss(
+      makeAck(0, initCwnd, Clock::now(), packet.time), folly::none);
+  EXPECT_LT(initCwnd, cubic.getCongestionWindow());
+
+  // The pacer spreads the restart window.
+  EXPECT_CALL(*rawPacer, refreshPacingRate(_, 10ms));
+  cubic.onPacketSent(
+      makeTestingWritePacket(1, 100, initCwnd + 100, false, sendTime + 1s));
+  EXPECT_EQ(initCwnd, cubic.getCongestionWindow());
+  EXPECT_EQ(CubicStates::Hystart, cubic.state());
+}
+
 } // namespace test
 } // namespace quic
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/HystartPlusPlus.h>
+#include <folly/portability/GTest.h>
+#include <quic/api/test/MockQuicStats.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/congestion_control/NewReno.h>
+#include <quic/congestion_control/Pacer.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+class HystartPlusPlusTest : public Test {
+ public:
+  // Acks count packets sent at the start of the given round trip, after
+  // the rtt. Returns the bytes that the cwnd grew by.
+  uint64_t ackRound(
+      HystartPlusPlus& hystart,
+      uint64_t round,
+      std::chrono::microseconds rtt,
+      size_t count) {
+    uint64_t growth = 0;
+    for (size_t i = 0; i < count; i++) {
+      growth += hystart.onAckEvent(makeRoundAck(round, rtt));
+    }
+    return growth;
+  }
+
+  CongestionController::AckEvent makeRoundAck(
+      uint64_t round,
+      std::chrono::microseconds rtt) {
+    auto sentTime = start_ + std::chrono::milliseconds(100 * round);
+    auto ack = makeAck(packetNum_++, 1000, sentTime + rtt, sentTime);
+    ack.mrttSample = rtt;
+    return ack;
+  }
+
+ protected:
+  TimePoint start_{Clock::now()};
+  PacketNum packetNum_{0};
+};
+
+TEST_F(HystartPlusPlusTest, StableRttStaysInSlowStart) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  HystartPlusPlus hystart(conn);
+  for (uint64_t round = 0; round < 10; round++) {
+    EXPECT_EQ(8000, ackRound(hystart, round, 50ms, 8));
+  }
+  EXPECT_EQ(HystartPlusPlus::Phase::SlowStart, hystart.phase());
+}
+
+TEST_F(HystartPlusPlusTest, RttIncreaseExitsAfterConservativeSlowStart) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  HystartPlusPlus hystart(conn);
+  EXPECT_EQ(8000, ackRound(hystart, 0, 50ms, 8));
+  // The min RTT goes up by more than the threshold, 50ms / 8.
+  EXPECT_EQ(8000, ackRound(hystart, 1, 60ms, 8));
+  EXPECT_EQ(HystartPlusPlus::Phase::ConservativeSlowStart, hystart.phase());
+
+  for (uint64_t round = 2; round < 2 + kHystartPlusPlusCssRounds - 1;
+       round++) {
+    EXPECT_EQ(
+        8000 / kHystartPlusPlusCssGrowthDivisor,
+        ackRound(hystart, round, 60ms, 8));
+    EXPECT_EQ(HystartPlusPlus::Phase::ConservativeSlowStart, hystart.phase());
+  }
+  EXPECT_EQ(0, ackRound(hystart, 1 + kHystartPlusPlusCssRounds, 60ms, 1));
+  EXPECT_EQ(HystartPlusPlus::Phase::Exited, hystart.phase());
+}
+
+TEST_F(HystartPlusPlusTest, SpuriousRttIncreaseResumesSlowStart) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  HystartPlusPlus hystart(conn);
+  ackRound(hystart, 0, 50ms, 8);
+  ackRound(hystart, 1, 60ms, 8);
+  EXPECT_EQ(HystartPlusPlus::Phase::ConservativeSlowStart, hystart.phase());
+  // The RTT is back below the one that started CSS.
+  EXPECT_EQ(
+      8000 / kHystartPlusPlusCssGrowthDivisor,
+      ackRound(hystart, 2, 50ms, 8));
+  EXPECT_EQ(HystartPlusPlus::Phase::SlowStart, hystart.phase());
+  EXPECT_EQ(1000, ackRound(hystart, 2, 50ms, 1));
+}
+
+TEST_F(HystartPlusPlusTest, UnpacedGrowthIsCapped) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  HystartPlusPlus hystart(conn);
+  auto sentTime = Clock::now();
+  auto ack =
+      makeAck(0, 20 * conn.udpSendPacketLen, sentTime + 50ms, sentTime);
+  EXPECT_EQ(
+      kHystartPlusPlusUnpacedBurstInMss * conn.udpSendPacketLen,
+      hystart.onAckEvent(ack));
+}
+
+TEST_F(HystartPlusPlusTest, PacedGrowthIsNotCapped) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.pacer = std::make_unique<DefaultPacer>(conn, kMinCwndInMss);
+  HystartPlusPlus hystart(conn);
+  auto sentTime = Clock::now();
+  auto ack =
+      makeAck(0, 20 * conn.udpSendPacketLen, sentTime + 50ms, sentTime);
+  EXPECT_EQ(20 * conn.udpSendPacketLen, hystart.onAckEvent(ack));
+}
+
+TEST_F(HystartPlusPlusTest, NewRenoReportsExit) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  conn.transportSettings.hystartPlusPlus = true;
+  MockQuicStats stats;
+  conn.infoCallback = &stats;
+  NewReno reno(conn);
+  for (PacketNum packetNum = 0; packetNum < 60; packetNum++) {
+    reno.onPacketSent(
+        makeTestingWritePacket(packetNum, 1000, 1000 * (packetNum + 1)));
+  }
+
+  EXPECT_CALL(
+      stats,
+      onSlowStartExit(QuicTransportStatsCallback::SlowStartExitReason::
+                          CONSERVATIVE_SLOW_START))
+      .Times(1);
+  std::vector<std::chrono::microseconds> rtts = {50ms, 60ms};
+  for (uint8_t i = 0; i < kHystartPlusPlusCssRounds - 1; i++) {
+    rtts.push_back(60ms);
+  }
+  for (uint64_t round = 0; round < rtts.size(); round++) {
+    for (size_t i = 0; i < 8; i++) {
+      reno.onPacketAckOrLoss(makeRoundAck(round, rtts[round]), folly::none);
+    }
+    EXPECT_TRUE(reno.inSlowStart());
+  }
+  reno.onPacketAckOrLoss(makeRoundAck(rtts.size(), 60ms), folly::none);
+  EXPECT_FALSE(reno.inSlowStart());
+}
+
+} // namespace test
+} // namespace quic
@@ -43,8 +43,8 @@ CongestionController::AckEvent createAckEvent(
   ack.largestAckedPacket = largestAcked;
   ack.ackTime = Clock::now();
   ack.ackedBytes = ackedSize;
-  ack.ackedPackets.emplace_back(
-      std::move(packet), packetSentTime, ackedSize, false, false, ackedSize);
+  ack.ackedPackets.emplace_back(OutstandingPacket(
+      std::move(packet), packetSentTime, ackedSize, false, false, ackedSize));
   return ack;
 }
 
@@ -96,6 +96,40 @@ TEST_F(NewRenoTest, TestLoss) {
   EXPECT_EQ(reno.getBytesInFlight(), 0);
 }
 
+TEST_F(NewRenoTest, CwndValidationNoGrowthWhenUnused) {
+  QuicServerConnectionState conn;
+  conn.transportSettings.cwndValidation = true;
+  NewReno reno(conn);
+  auto cwnd = reno.getCongestionWindow();
+  auto packet = createPacket(1, 100, Clock::now());
+  reno.onPacketSent(packet);
+  reno.onPacketAckOrLoss(createAckEvent(1, 100, packet.time), folly::none);
+  EXPECT_EQ(cwnd, reno.getCongestionWindow());
+
+  packet = createPacket(2, cwnd, Clock::now());
+  reno.onPacketSent(packet);
+  reno.onPacketAckOrLoss(createAckEvent(2, cwnd, packet.time), folly::none);
+  EXPECT_EQ(2 * cwnd, reno.getCongestionWindow());
+}
+
+TEST_F(NewRenoTest, CwndValidationIdleRestart) {
+  QuicServerConnectionState conn;
+  conn.transportSettings.cwndValidation = true;
+  conn.lossState.srtt = 10ms;
+  NewReno reno(conn);
+  auto initialCwnd = reno.getCongestionWindow();
+  auto sendTime = Clock::now();
+  auto packet = createPacket(1, initialCwnd, sendTime);
+  reno.onPacketSent(packet);
+  reno.onPacketAckOrLoss(
+      createAckEvent(1, initialCwnd, packet.time), folly::none);
+  EXPECT_EQ(2 * initialCwnd, reno.getCongestionWindow());
+
+  reno.onPacketSent(createPacket(2, 100, sendTime + 1s));
+  EXPECT_EQ(initialCwnd, reno.getCongestionWindow());
+  EXPECT_TRUE(reno.inSlowStart());
+}
+
 TEST_F(NewRenoTest, SendMoreThanWritable) {
   QuicServerConnectionState conn;
   NewReno reno(conn);
@@ -175,6 +209,27 @@ TEST_F(NewRenoTest, TestSteadyStateAck) {
           ((kDefaultUDPSendPacketLen * ackedSize) / newWritableBytes2));
 }
 
+TEST_F(NewRenoTest, TestSteadyStateAckLargePackets) {
+  QuicServerConnectionState conn;
+  // The increase is in packets of the size in use, not the default one.
+  conn.udpSendPacketLen = 9000;
+  NewReno reno(conn);
+  conn.lossState.largestSent = 5;
+  reno.onPacketSent(createPacket(4, 10, Clock::now()));
+  reno.onPacketAckOrLoss(folly::none, createLossEvent({std::make_pair(4, 10)}));
+  EXPECT_FALSE(reno.inSlowStart());
+
+  auto writableBytes = reno.getWritableBytes();
+  uint64_t ackedSize = 9000;
+  auto packet = createPacket(6, ackedSize, Clock::now());
+  reno.onPacketSent(packet);
+  reno.onPacketAckOrLoss(
+      createAckEvent(6, ackedSize, packet.time), folly::none);
+  EXPECT_EQ(
+      reno.getWritableBytes(),
+      writableBytes + (conn.udpSendPacketLen * ackedSize) / writableBytes);
+}
+
 TEST_F(NewRenoTest, TestWritableBytes) {
   QuicServerConnectionState conn;
   NewReno reno(conn);
@@ -223,5 +278,22 @@ TEST_F(NewRenoTest, RemoveBytesWithoutLossOrAck) {
   reno.onRemoveBytesFromInflight(2);
   EXPECT_EQ(reno.getWritableBytes(), originalWritableBytes - ackedSize + 2);
 }
+
+TEST_F(NewRenoTest, SpuriousLossUndo) {
+  QuicServerConnectionState conn;
+  NewReno reno(conn);
+  auto initCwnd = reno.getCongestionWindow();
+  reno.onPacketSent(createPacket(1, 1000, Clock::now()));
+  auto loss = createLossEvent({std::make_pair(1, 1000)});
+  auto lossTime = loss.lossTime;
+  reno.onPacketAckOrLoss(folly::none, std::move(loss));
+  EXPECT_FALSE(reno.inSlowStart());
+  EXPECT_GT(initCwnd, reno.getCongestionWindow());
+
+  reno.onSpuriousLoss(lossTime);
+  EXPECT_TRUE(reno.inSlowStart());
+  EXPECT_EQ(initCwnd, reno.getCongestionWindow());
+}
+
 } // namespace test
 } // namespace quic
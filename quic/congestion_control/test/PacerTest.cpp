@@ -125,5 +125,95 @@ TEST_F(PacerTest, AppLimited) {
   EXPECT_EQ(12, pacer.updateAndGetWriteBatchSize(Clock::now()));
 }
 
+TEST_F(PacerTest, TxTimeHandsOverCwnd) {
+  TxTimePacer txTimePacer(conn, conn.transportSettings.minCwndInMss);
+  txTimePacer.refreshPacingRate(100 * conn.udpSendPacketLen, 100ms);
+  EXPECT_EQ(0us, txTimePacer.getTimeUntilNextWrite());
+  EXPECT_EQ(100, txTimePacer.updateAndGetWriteBatchSize(Clock::now()));
+  EXPECT_EQ(100, txTimePacer.getCachedWriteBatchSize());
+}
+
+TEST_F(PacerTest, TxTimeSpacesPackets) {
+  TxTimePacer txTimePacer(conn, conn.transportSettings.minCwndInMss);
+  txTimePacer.refreshPacingRate(100 * conn.udpSendPacketLen, 100ms);
+  auto currentTime = Clock::now();
+  auto first = txTimePacer.getPacketTxTime(currentTime);
+  auto second = txTimePacer.getPacketTxTime(currentTime);
+  ASSERT_TRUE(first.hasValue());
+  ASSERT_TRUE(second.hasValue());
+  EXPECT_EQ(currentTime, *first);
+  EXPECT_EQ(currentTime + 1ms, *second);
+
+  // After being idle the next packet leaves right away
+  auto later = currentTime + 1s;
+  EXPECT_EQ(later, *txTimePacer.getPacketTxTime(later));
+}
+
+TEST_F(PacerTest, TxTimeAppLimited) {
+  conn.transportSettings.writeConnectionDataPacketsLimit = 12;
+  TxTimePacer txTimePacer(conn, conn.transportSettings.minCwndInMss);
+  txTimePacer.refreshPacingRate(100 * conn.udpSendPacketLen, 100ms);
+  txTimePacer.setAppLimited(true);
+  EXPECT_EQ(12, txTimePacer.updateAndGetWriteBatchSize(Clock::now()));
+  EXPECT_FALSE(txTimePacer.getPacketTxTime(Clock::now()).hasValue());
+}
+
+TEST_F(PacerTest, DefaultPacerNoTxTime) {
+  EXPECT_FALSE(pacer.getPacketTxTime(Clock::now()).hasValue());
+}
+
+TEST_F(PacerTest, TickScaledQuantum) {
+  conn.transportSettings.pacingTimerTickInterval = 1ms;
+  EXPECT_EQ(4, tickScaledPacerQuantum(conn, 200, 50ms));
+  EXPECT_EQ(kMinPacerQuantumPackets, tickScaledPacerQuantum(conn, 10, 100ms));
+  EXPECT_EQ(
+      conn.transportSettings.maxBurstPackets,
+      tickScaledPacerQuantum(conn, 1000, 10ms));
+}
+
+TEST_F(PacerTest, TokenBucketCarriesCredit) {
+  TokenBucketPacer tokenBucketPacer(conn, conn.transportSettings.minCwndInMss);
+  tokenBucketPacer.setQuantumPolicy(
+      [](const QuicConnectionStateBase&, uint64_t, std::chrono::microseconds) {
+        return 10;
+      });
+  // A packet every ms
+  tokenBucketPacer.refreshPacingRate(100 * conn.udpSendPacketLen, 100ms);
+  auto currentTime = Clock::now();
+  EXPECT_EQ(10, tokenBucketPacer.updateAndGetWriteBatchSize(currentTime));
+  tokenBucketPacer.onPacedWriteScheduled(currentTime);
+  EXPECT_EQ(10ms, tokenBucketPacer.getTimeUntilNextWrite());
+
+  // The half packet of credit left by a late timer is used by the next burst.
+  EXPECT_EQ(
+      10, tokenBucketPacer.updateAndGetWriteBatchSize(currentTime + 10500us));
+  tokenBucketPacer.onPacedWriteScheduled(currentTime + 10500us);
+  EXPECT_EQ(9500us, tokenBucketPacer.getTimeUntilNextWrite());
+  EXPECT_EQ(
+      10, tokenBucketPacer.updateAndGetWriteBatchSize(currentTime + 20ms));
+}
+
+TEST_F(PacerTest, TokenBucketBoundsLateBursts) {
+  TokenBucketPacer tokenBucketPacer(conn, conn.transportSettings.minCwndInMss);
+  tokenBucketPacer.setQuantumPolicy(
+      [](const QuicConnectionStateBase&, uint64_t, std::chrono::microseconds) {
+        return 10;
+      });
+  tokenBucketPacer.refreshPacingRate(100 * conn.udpSendPacketLen, 100ms);
+  auto currentTime = Clock::now();
+  tokenBucketPacer.updateAndGetWriteBatchSize(currentTime);
+  EXPECT_EQ(
+      10 * kPacerMaxCreditQuanta,
+      tokenBucketPacer.updateAndGetWriteBatchSize(currentTime + 1s));
+  EXPECT_EQ(
+      10 * kPacerMaxCreditQuanta, tokenBucketPacer.getCachedWriteBatchSize());
+
+  tokenBucketPacer.setAppLimited(true);
+  EXPECT_EQ(0us, tokenBucketPacer.getTimeUntilNextWrite());
+  EXPECT_EQ(
+      conn.transportSettings.writeConnectionDataPacketsLimit,
+      tokenBucketPacer.updateAndGetWriteBatchSize(currentTime + 2s));
+}
+
 } // namespace test
 } // namespace quic
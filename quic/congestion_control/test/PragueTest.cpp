@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/Prague.h>
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+class PragueTest : public Test {};
+
+TEST_F(PragueTest, InitStates) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  Prague prague(conn);
+  EXPECT_EQ(CongestionControlType::Prague, prague.type());
+  EXPECT_TRUE(prague.inSlowStart());
+  EXPECT_EQ(
+      1000 * conn.transportSettings.initCwndInMss,
+      prague.getCongestionWindow());
+  EXPECT_EQ(kPragueInitialAlpha, prague.getAlpha());
+  EXPECT_EQ(EcnCodepoint::Ect1, ecnMarkingFor(prague.type()));
+}
+
+TEST_F(PragueTest, FactoryMakesPrague) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  DefaultCongestionControllerFactory factory;
+  auto cc =
+      factory.makeCongestionController(conn, CongestionControlType::Prague);
+  ASSERT_NE(nullptr, cc);
+  EXPECT_EQ(CongestionControlType::Prague, cc->type());
+}
+
+TEST_F(PragueTest, CeMarksReduceCwndOncePerRoundTrip) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  conn.udpSendPacketLen = 1000;
+  Prague prague(conn);
+  auto initCwnd = prague.getCongestionWindow();
+  for (PacketNum packetNum = 0; packetNum < 4; packetNum++) {
+    prague.onPacketSent(
+        makeTestingWritePacket(packetNum, 1000, 1000 * (packetNum + 1)));
+  }
+
+  // The first ack starts a round trip, and grows the cwnd in slow start.
+  auto start = Clock::now();
+  prague.onPacketAckOrLoss(makeAck(0, 1000, start + 10ms, start), folly::none);
+  EXPECT_EQ(initCwnd + 1000, prague.getCongestionWindow());
+
+  // A marked packet sent after that ends the round trip, and the cwnd is
+  // reduced by alpha / 2.
+  auto ack = makeAck(1, 1000, start + 30ms, start + 20ms);
+  ack.ecnCeMarked = 1;
+  prague.onPacketAckOrLoss(std::move(ack), folly::none);
+  EXPECT_EQ(kPragueInitialAlpha, prague.getAlpha());
+  auto cwnd = prague.getCongestionWindow();
+  EXPECT_EQ((initCwnd + 1000) / 2, cwnd);
+  EXPECT_FALSE(prague.inSlowStart());
+
+  // More marks in the same round trip neither reduce nor grow the cwnd.
+  ack = makeAck(2, 1000, start + 31ms, start + 21ms);
+  ack.ecnCeMarked = 1;
+  prague.onPacketAckOrLoss(std::move(ack), folly::none);
+  EXPECT_EQ(cwnd, prague.getCongestionWindow());
+
+  // Half of the packets of the next round trip were marked.
+  prague.onPacketAckOrLoss(
+      makeAck(3, 1000, start + 50ms, start + 40ms), folly::none);
+  EXPECT_FLOAT_EQ(
+      (1 - kPragueAlphaGain) * kPragueInitialAlpha + kPragueAlphaGain * 0.5f,
+      prague.getAlpha());
+  // Without marks the cwnd grows like Reno.
+  EXPECT_EQ(cwnd + 1000 * 1000 / cwnd, prague.getCongestionWindow());
+}
+
+} // namespace test
+} // namespace quic
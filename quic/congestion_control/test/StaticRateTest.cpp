@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/congestion_control/StaticRate.h>
+
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/state/test/Mocks.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+namespace {
+OutstandingPacket createPacket(PacketNum packetNum, uint32_t size) {
+  RegularQuicWritePacket packet(ShortHeader(
+      ProtectionType::KeyPhaseZero, getTestConnectionId(), packetNum));
+  return OutstandingPacket(
+      std::move(packet), Clock::now(), size, false, false, size);
+}
+} // namespace
+
+TEST(StaticRateTest, PacesAtRate) {
+  QuicConnectionStateBase conn(QuicNodeType::Server);
+  auto mockPacer = std::make_unique<MockPacer>();
+  auto rawPacer = mockPacer.get();
+  conn.pacer = std::move(mockPacer);
+  conn.transportSettings.staticRateBytesPerSec = 1000 * 1000;
+  StaticRate staticRate(conn);
+
+  EXPECT_CALL(*rawPacer, refreshPacingRate(1000 * 1000, 1s)).Times(1);
+  staticRate.onPacketSent(createPacket(0, 1000));
+  staticRate.onPacketSent(createPacket(1, 1000));
+  EXPECT_EQ(staticRate.getBandwidthEstimate(), 1000 * 1000);
+
+  conn.transportSettings.staticRateBytesPerSec = 2 * 1000 * 1000;
+  EXPECT_CALL(*rawPacer, refreshPacingRate(2 * 1000 * 1000, 1s)).Times(1);
+  staticRate.onPacketSent(createPacket(2, 1000));
+  staticRate.onPacketSent(createPacket(3, 1000));
+}
+
+TEST(StaticRateTest, NoRate) {
+  QuicConnectionStateBase conn(QuicNodeType::Server);
+  auto mockPacer = std::make_unique<MockPacer>();
+  auto rawPacer = mockPacer.get();
+  conn.pacer = std::move(mockPacer);
+  conn.lossState.srtt = 100ms;
+  StaticRate staticRate(conn);
+
+  EXPECT_CALL(*rawPacer, refreshPacingRate(_, _)).Times(0);
+  staticRate.onPacketSent(createPacket(0, 1000));
+  EXPECT_EQ(
+      staticRate.getCongestionWindow(),
+      conn.transportSettings.maxCwndInMss * conn.udpSendPacketLen);
+}
+
+TEST(StaticRateTest, CwndGuard) {
+  QuicConnectionStateBase conn(QuicNodeType::Server);
+  conn.transportSettings.staticRateBytesPerSec = 1000 * 1000;
+  StaticRate staticRate(conn);
+  auto maxCwnd = conn.transportSettings.maxCwndInMss * conn.udpSendPacketLen;
+  // No rtt to size it by yet.
+  EXPECT_EQ(staticRate.getCongestionWindow(), maxCwnd);
+
+  conn.lossState.srtt = 100ms;
+  EXPECT_EQ(
+      staticRate.getCongestionWindow(),
+      1000 * 1000 * kStaticRateCwndGuardRtts / 10);
+
+  conn.lossState.srtt = 1us;
+  EXPECT_EQ(
+      staticRate.getCongestionWindow(),
+      conn.transportSettings.minCwndInMss * conn.udpSendPacketLen);
+
+  conn.lossState.srtt = 100s;
+  EXPECT_EQ(staticRate.getCongestionWindow(), maxCwnd);
+
+  conn.lossState.srtt = 100ms;
+  conn.transportSettings.staticRateCwndGuard = false;
+  EXPECT_EQ(staticRate.getCongestionWindow(), maxCwnd);
+}
+
+TEST(StaticRateTest, AckAndLoss) {
+  QuicConnectionStateBase conn(QuicNodeType::Server);
+  conn.transportSettings.staticRateBytesPerSec = 1000 * 1000;
+  conn.lossState.srtt = 100ms;
+  StaticRate staticRate(conn);
+  auto cwnd = staticRate.getCongestionWindow();
+
+  auto packet0 = createPacket(0, 1000);
+  auto packet1 = createPacket(1, 1000);
+  staticRate.onPacketSent(packet0);
+  staticRate.onPacketSent(packet1);
+  EXPECT_EQ(staticRate.getBytesInFlight(), 2000);
+  EXPECT_EQ(staticRate.getWritableBytes(), cwnd - 2000);
+
+  CongestionController::AckEvent ack;
+  ack.largestAckedPacket = 0;
+  ack.ackedBytes = 1000;
+  ack.ackedPackets.emplace_back(packet0);
+  staticRate.onPacketAckOrLoss(ack, folly::none);
+  EXPECT_EQ(staticRate.getWritableBytes(), cwnd - 1000);
+
+  // The loss does not change the cwnd, only the bytes in flight.
+  CongestionController::LossEvent loss;
+  loss.addLostPacket(packet1);
+  staticRate.onPacketAckOrLoss(folly::none, loss);
+  EXPECT_EQ(staticRate.getBytesInFlight(), 0);
+  EXPECT_EQ(staticRate.getCongestionWindow(), cwnd);
+}
+
+} // namespace test
+} // namespace quic
@@ -18,7 +18,8 @@ namespace {
 folly::Optional<uint64_t> calculateNewWindowUpdate(
     uint64_t curReadOffset,
     uint64_t curAdvertisedOffset,
-    uint64_t windowSize,
+    uint64_t& windowSize,
+    uint64_t maxWindowSize,
     const std::chrono::microseconds& srtt,
     const TransportSettings& transportSettings,
     const folly::Optional<TimePoint>& lastSendTime,
@@ -39,6 +40,13 @@ folly::Optional<uint64_t> calculateNewWindowUpdate(
           transportSettings.flowControlWindowFrequency <
       windowSize;
   if (enoughWindowElapsed) {
+    if (transportSettings.autotuneReceiveWindows && lastSendTime &&
+        windowSize < maxWindowSize) {
+      // Half the window went by before the time for an update, so it is the
+      // window that limits the peer.
+      windowSize = std::min(maxWindowSize, windowSize * 2);
+      nextAdvertisedOffset = curReadOffset + windowSize;
+    }
     return nextAdvertisedOffset;
   }
   return folly::none;
@@ -73,6 +81,7 @@ bool maybeSendConnWindowUpdate(
       flowControlState.sumCurReadOffset,
       flowControlState.advertisedMaxOffset,
       flowControlState.windowSize,
+      conn.transportSettings.maxAutotuneConnectionWindowSize,
       conn.lossState.srtt,
       conn.transportSettings,
       flowControlState.timeOfLastFlowControlUpdate,
@@ -100,14 +109,37 @@ bool maybeSendStreamWindowUpdate(
   if (stream.conn.streamManager->pendingWindowUpdate(stream.id)) {
     return false;
   }
+  if (stream.finalReadOffset &&
+      flowControlState.advertisedMaxOffset >= *stream.finalReadOffset) {
+    // The peer may already send all that is left of the stream.
+    return false;
+  }
+  auto& transportSettings = stream.conn.transportSettings;
+  auto windowSize = flowControlState.windowSize;
   auto newAdvertisedOffset = calculateNewWindowUpdate(
       stream.currentReadOffset,
       flowControlState.advertisedMaxOffset,
       flowControlState.windowSize,
+      std::min(
+          transportSettings.maxAutotuneStreamWindowSize,
+          transportSettings.maxAutotuneConnectionWindowSize),
       stream.conn.lossState.srtt,
-      stream.conn.transportSettings,
+      transportSettings,
       flowControlState.timeOfLastFlowControlUpdate,
       updateTime);
+  if (flowControlState.windowSize > windowSize) {
+    // The connection window has to keep up, or it would be what blocks the
+    // stream next.
+    auto& connWindowSize = stream.conn.flowControlState.windowSize;
+    connWindowSize = std::max(
+        connWindowSize,
+        std::min(
+            transportSettings.maxAutotuneConnectionWindowSize,
+            flowControlState.windowSize * 3 / 2));
+    VLOG(10) << "Autotuned window stream=" << stream.id
+             << " window=" << flowControlState.windowSize
+             << " connWindow=" << connWindowSize;
+  }
   if (newAdvertisedOffset) {
     VLOG(10) << "Queued flow control update for stream=" << stream.id
              << " offset=" << *newAdvertisedOffset;
@@ -405,6 +437,15 @@ void onBlockedLost(QuicStreamState& stream) {
   maybeWriteBlockAfterSocketWrite(stream);
 }
 
+bool shouldPiggybackConnWindowUpdate(const QuicConnectionStateBase& conn) {
+  const auto& flowControlState = conn.flowControlState;
+  auto nextAdvertisedOffset =
+      flowControlState.sumCurReadOffset + flowControlState.windowSize;
+  return nextAdvertisedOffset > flowControlState.advertisedMaxOffset &&
+      nextAdvertisedOffset - flowControlState.advertisedMaxOffset >=
+      flowControlState.windowSize / kMaxDataPiggybackDivisor;
+}
+
 void updateFlowControlList(QuicStreamState& stream) {
   stream.conn.streamManager->queueFlowControlUpdated(stream.id);
 }
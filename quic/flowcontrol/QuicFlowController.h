@@ -116,6 +116,12 @@ uint64_t getRecvStreamFlowControlBytes(const QuicStreamState& stream);
  */
 uint64_t getRecvConnFlowControlBytes(const QuicConnectionStateBase& conn);
 
+/**
+ * Returns true if a connection window update is worth sending along with the
+ * stream window updates of a packet, although it is not due yet.
+ */
+bool shouldPiggybackConnWindowUpdate(const QuicConnectionStateBase& conn);
+
 /**
  * Updates the flow control list with the stream. Callers should ensure that
  * this is only invoked when the flow control changes.
@@ -221,6 +221,79 @@ TEST_F(QuicFlowControlTest, MaybeSendStreamWindowUpdateTimeElapsed) {
   EXPECT_TRUE(conn_.streamManager->pendingWindowUpdate(stream.id));
 }
 
+TEST_F(QuicFlowControlTest, AutotuneStreamWindow) {
+  conn_.transportSettings.autotuneReceiveWindows = true;
+  conn_.transportSettings.maxAutotuneStreamWindowSize = 800;
+  conn_.flowControlState.windowSize = 500;
+  StreamId id = 3;
+  QuicStreamState stream(id, conn_);
+  stream.currentReadOffset = 100;
+  stream.flowControlState.windowSize = 500;
+  stream.flowControlState.advertisedMaxOffset = 400;
+
+  conn_.lossState.srtt = 100us;
+  stream.flowControlState.timeOfLastFlowControlUpdate = Clock::now();
+  stream.currentReadOffset += 200;
+  EXPECT_CALL(*transportInfoCb_, onStreamFlowControlUpdate()).Times(1);
+  maybeSendStreamWindowUpdate(
+      stream, *stream.flowControlState.timeOfLastFlowControlUpdate + 100us);
+  EXPECT_TRUE(conn_.streamManager->pendingWindowUpdate(stream.id));
+  EXPECT_EQ(stream.flowControlState.windowSize, 800);
+  EXPECT_EQ(generateMaxStreamDataFrame(stream).maximumData, 1100);
+  EXPECT_EQ(conn_.flowControlState.windowSize, 1200);
+}
+
+TEST_F(QuicFlowControlTest, AutotuneConnWindowOnlyWhenWindowLimited) {
+  conn_.transportSettings.autotuneReceiveWindows = true;
+  conn_.transportSettings.maxAutotuneConnectionWindowSize = 700;
+  conn_.flowControlState.windowSize = 500;
+  conn_.flowControlState.advertisedMaxOffset = 400;
+  conn_.flowControlState.sumCurReadOffset = 300;
+
+  conn_.lossState.srtt = 100us;
+  conn_.flowControlState.timeOfLastFlowControlUpdate = Clock::now();
+  // Updates sent because time went by do not grow the window.
+  EXPECT_CALL(*transportInfoCb_, onConnFlowControlUpdate()).Times(2);
+  maybeSendConnWindowUpdate(
+      conn_, *conn_.flowControlState.timeOfLastFlowControlUpdate + 300us);
+  EXPECT_TRUE(conn_.pendingEvents.connWindowUpdate);
+  EXPECT_EQ(conn_.flowControlState.windowSize, 500);
+
+  onConnWindowUpdateSent(
+      conn_,
+      1,
+      generateMaxDataFrame(conn_).maximumData,
+      *conn_.flowControlState.timeOfLastFlowControlUpdate + 300us);
+  conn_.flowControlState.sumCurReadOffset += 300;
+  maybeSendConnWindowUpdate(
+      conn_, *conn_.flowControlState.timeOfLastFlowControlUpdate + 100us);
+  EXPECT_TRUE(conn_.pendingEvents.connWindowUpdate);
+  EXPECT_EQ(conn_.flowControlState.windowSize, 700);
+  EXPECT_EQ(generateMaxDataFrame(conn_).maximumData, 1300);
+}
+
+TEST_F(QuicFlowControlTest, NoStreamWindowUpdateWhenFinAllowed) {
+  StreamId id = 3;
+  QuicStreamState stream(id, conn_);
+  stream.currentReadOffset = 300;
+  stream.flowControlState.windowSize = 500;
+  stream.flowControlState.advertisedMaxOffset = 400;
+  stream.finalReadOffset = 350;
+
+  EXPECT_CALL(*transportInfoCb_, onStreamFlowControlUpdate()).Times(0);
+  maybeSendStreamWindowUpdate(stream, Clock::now());
+  EXPECT_FALSE(conn_.streamManager->pendingWindowUpdate(stream.id));
+}
+
+TEST_F(QuicFlowControlTest, PiggybackConnWindowUpdate) {
+  conn_.flowControlState.windowSize = 400;
+  conn_.flowControlState.advertisedMaxOffset = 400;
+  conn_.flowControlState.sumCurReadOffset = 99;
+  EXPECT_FALSE(shouldPiggybackConnWindowUpdate(conn_));
+  conn_.flowControlState.sumCurReadOffset = 100;
+  EXPECT_TRUE(shouldPiggybackConnWindowUpdate(conn_));
+}
+
 TEST_F(QuicFlowControlTest, DontSendStreamWindowUpdateTwice) {
   StreamId id = 3;
   QuicStreamState stream(id, conn_);
@@ -57,6 +57,31 @@ class Aead {
       const folly::IOBuf* associatedData,
       uint64_t seqNum) const = 0;
 
+  /**
+   * Encrypts plaintext in place. When plaintext is a single unshared buffer
+   * with at least getCipherOverhead() bytes of tailroom, the ciphertext and
+   * the tag are written into it and no new buffer is allocated. Otherwise
+   * this behaves like encrypt. Will throw on error.
+   */
+  virtual std::unique_ptr<folly::IOBuf> encryptInPlace(
+      std::unique_ptr<folly::IOBuf>&& plaintext,
+      const folly::IOBuf* associatedData,
+      uint64_t seqNum) const {
+    return encrypt(std::move(plaintext), associatedData, seqNum);
+  }
+
+  /**
+   * Decrypts ciphertext in place. When ciphertext is not shared, the
+   * plaintext overwrites it and no new buffer is allocated. Otherwise this
+   * behaves like tryDecrypt.
+   */
+  virtual folly::Optional<std::unique_ptr<folly::IOBuf>> tryDecryptInPlace(
+      std::unique_ptr<folly::IOBuf>&& ciphertext,
+      const folly::IOBuf* associatedData,
+      uint64_t seqNum) const {
+    return tryDecrypt(std::move(ciphertext), associatedData, seqNum);
+  }
+
   /**
    * Returns the number of bytes the aead will add to the plaintext (size of
    * ciphertext - size of plaintext).
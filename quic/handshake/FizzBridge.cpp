@@ -8,6 +8,9 @@
 
 #include <quic/handshake/FizzBridge.h>
 
+#include <fizz/protocol/Protocol.h>
+#include <quic/handshake/HandshakeLayer.h>
+
 namespace quic {
 
 EncryptionLevel getEncryptionLevelFromFizz(
@@ -26,4 +29,26 @@ EncryptionLevel getEncryptionLevelFromFizz(
   folly::assume_unreachable();
 }
 
+std::unique_ptr<Aead> deriveNextOneRttAead(
+    const fizz::Factory& factory,
+    fizz::CipherSuite cipher,
+    std::vector<uint8_t>& trafficSecret) {
+  auto deriver = factory.makeKeyDeriver(cipher);
+  auto nextSecret = deriver->expandLabel(
+      folly::range(trafficSecret),
+      kQuicKeyUpdateLabel,
+      folly::IOBuf::create(0),
+      deriver->hashLength());
+  auto nextSecretRange = nextSecret->coalesce();
+  trafficSecret.assign(nextSecretRange.begin(), nextSecretRange.end());
+  auto keyScheduler = factory.makeKeyScheduler(cipher);
+  return FizzAead::wrap(fizz::Protocol::deriveRecordAeadWithLabel(
+      factory,
+      *keyScheduler,
+      cipher,
+      folly::range(trafficSecret),
+      kQuicKeyLabel,
+      kQuicIVLabel));
+}
+
 } // namespace quic
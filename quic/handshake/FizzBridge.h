@@ -9,12 +9,14 @@
 #pragma once
 
 #include <fizz/crypto/aead/Aead.h>
+#include <fizz/protocol/Factory.h>
 #include <fizz/protocol/Types.h>
 #include <quic/QuicConstants.h>
 #include <quic/handshake/Aead.h>
 
 #include <memory>
 #include <utility>
+#include <vector>
 
 namespace quic {
 
@@ -30,7 +32,10 @@ class FizzAead final : public Aead {
   }
 
   /**
-   * Simply forward all calls to fizz::Aead.
+   * Simply forward all calls to fizz::Aead. fizz keeps its cipher context
+   * keyed for the lifetime of the aead and builds each nonce from the
+   * sequence number in a stack buffer, so there is no per-packet setup left
+   * to hoist out of these calls.
    */
   std::unique_ptr<folly::IOBuf> encrypt(
       std::unique_ptr<folly::IOBuf>&& plaintext,
@@ -50,8 +55,24 @@ class FizzAead final : public Aead {
       uint64_t seqNum) const override {
     return fizzAead->tryDecrypt(std::move(ciphertext), associatedData, seqNum);
   }
+  /**
+   * fizz already works in place on unshared buffers, and writes the tag into
+   * the tailroom when there is enough of it.
+   */
+  std::unique_ptr<folly::IOBuf> encryptInPlace(
+      std::unique_ptr<folly::IOBuf>&& plaintext,
+      const folly::IOBuf* associatedData,
+      uint64_t seqNum) const override {
+    return fizzAead->encrypt(std::move(plaintext), associatedData, seqNum);
+  }
+  folly::Optional<std::unique_ptr<folly::IOBuf>> tryDecryptInPlace(
+      std::unique_ptr<folly::IOBuf>&& ciphertext,
+      const folly::IOBuf* associatedData,
+      uint64_t seqNum) const override {
+    return fizzAead->tryDecrypt(std::move(ciphertext), associatedData, seqNum);
+  }
   size_t getCipherOverhead() const override {
-    return fizzAead->getCipherOverhead();
+    return cipherOverhead_;
   }
 
   // For testing.
@@ -61,11 +82,24 @@ class FizzAead final : public Aead {
 
  private:
   std::unique_ptr<fizz::Aead> fizzAead;
+  // The overhead is asked for every packet that is written, and does not
+  // change once the aead has its key.
+  size_t cipherOverhead_;
   FizzAead(std::unique_ptr<fizz::Aead> fizzAeadIn)
-      : fizzAead(std::move(fizzAeadIn)) {}
+      : fizzAead(std::move(fizzAeadIn)),
+        cipherOverhead_(fizzAead->getCipherOverhead()) {}
 };
 
 EncryptionLevel getEncryptionLevelFromFizz(
     const fizz::EncryptionLevel encryptionLevel);
 
+/**
+ * Moves the 1-RTT traffic secret on to the next key phase and returns the
+ * aead of the new secret.
+ */
+std::unique_ptr<Aead> deriveNextOneRttAead(
+    const fizz::Factory& factory,
+    fizz::CipherSuite cipher,
+    std::vector<uint8_t>& trafficSecret);
+
 } // namespace quic
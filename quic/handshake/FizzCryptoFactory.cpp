@@ -60,10 +60,15 @@ std::unique_ptr<Aead> FizzCryptoFactory::makeInitialAead(
 
 std::unique_ptr<PacketNumberCipher> FizzCryptoFactory::makePacketNumberCipher(
     folly::ByteRange baseSecret) const {
-  auto pnCipher = factory_->makePacketNumberCipher(
-      fizz::CipherSuite::TLS_AES_128_GCM_SHA256);
-  auto deriver =
-      factory_->makeKeyDeriver(fizz::CipherSuite::TLS_AES_128_GCM_SHA256);
+  return makePacketNumberCipher(
+      baseSecret, fizz::CipherSuite::TLS_AES_128_GCM_SHA256);
+}
+
+std::unique_ptr<PacketNumberCipher> FizzCryptoFactory::makePacketNumberCipher(
+    folly::ByteRange baseSecret,
+    fizz::CipherSuite cipher) const {
+  auto pnCipher = factory_->makePacketNumberCipher(cipher);
+  auto deriver = factory_->makeKeyDeriver(cipher);
   auto pnKey = deriver->expandLabel(
       baseSecret, kQuicPNLabel, folly::IOBuf::create(0), pnCipher->keyLength());
   pnCipher->setKey(pnKey->coalesce());
@@ -31,6 +31,14 @@ class FizzCryptoFactory : public CryptoFactory {
   std::unique_ptr<PacketNumberCipher> makePacketNumberCipher(
       folly::ByteRange baseSecret) const override;
 
+  /**
+   * Makes the header cipher of the negotiated cipher suite, as the one above
+   * is the one of the initial packets.
+   */
+  std::unique_ptr<PacketNumberCipher> makePacketNumberCipher(
+      folly::ByteRange baseSecret,
+      fizz::CipherSuite cipher) const;
+
  private:
   QuicFizzFactory* factory_{nullptr};
 };
@@ -8,23 +8,55 @@
 
 #pragma once
 
+#include <folly/Optional.h>
 #include <folly/io/async/DelayedDestruction.h>
 
 #include <quic/QuicConstants.h>
 #include <quic/codec/PacketNumberCipher.h>
 #include <quic/codec/Types.h>
+#include <quic/handshake/Aead.h>
 
 namespace quic {
 
 constexpr folly::StringPiece kQuicKeyLabel = "quic key";
 constexpr folly::StringPiece kQuicIVLabel = "quic iv";
 constexpr folly::StringPiece kQuicPNLabel = "quic hp";
+constexpr folly::StringPiece kQuicKeyUpdateLabel = "quic ku";
+
+/**
+ * Timings of a TLS handshake. The time between the start and the end of the
+ * handshake that is not processing time was spent waiting for the peer.
+ */
+struct HandshakeTimings {
+  // When the first handshake message was sent or received.
+  folly::Optional<TimePoint> startTime;
+  // When the 1-rtt keys were derived.
+  folly::Optional<TimePoint> keysDerivedTime;
+  // When the handshake was established.
+  folly::Optional<TimePoint> establishedTime;
+  // Time spent in fizz processing handshake messages and their actions.
+  std::chrono::microseconds processingTime{0};
+};
 
 class Handshake : public folly::DelayedDestruction {
  public:
   virtual const folly::Optional<std::string>& getApplicationProtocol()
       const = 0;
 
+  /**
+   * The 1-RTT ciphers of the next key phase, RFC 9001 section 6. Every call
+   * derives one more generation from the traffic secret, so the caller
+   * keeps each cipher until its key phase comes. nullptr until the 1-RTT
+   * secrets are available.
+   */
+  virtual std::unique_ptr<Aead> getNextOneRttReadCipher() {
+    return nullptr;
+  }
+
+  virtual std::unique_ptr<Aead> getNextOneRttWriteCipher() {
+    return nullptr;
+  }
+
  protected:
   virtual ~Handshake() = default;
 };
@@ -8,6 +8,15 @@
 
 #include <quic/handshake/QuicFizzFactory.h>
 
+#include <folly/CpuId.h>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <sys/auxv.h>
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#endif
+
 namespace {
 
 class QuicPlaintextReadRecordLayer : public fizz::PlaintextReadRecordLayer {
@@ -109,9 +118,36 @@ std::unique_ptr<PacketNumberCipher> QuicFizzFactory::makePacketNumberCipher(
   switch (cipher) {
     case fizz::CipherSuite::TLS_AES_128_GCM_SHA256:
       return std::make_unique<Aes128PacketNumberCipher>();
+    case fizz::CipherSuite::TLS_CHACHA20_POLY1305_SHA256:
+      return std::make_unique<ChaCha20PacketNumberCipher>();
     default:
       throw std::runtime_error("Packet number cipher not implemented");
   }
 }
 
+bool hasAesHardwareSupport() {
+  static const bool hasAes = [] {
+#if FOLLY_X64
+    return folly::CpuId().aes();
+#elif defined(__aarch64__) && defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#elif defined(__aarch64__) && defined(__APPLE__)
+    // Every 64 bit Apple CPU has the ARMv8 crypto extensions.
+    return true;
+#else
+    return false;
+#endif
+  }();
+  return hasAes;
+}
+
+std::vector<fizz::CipherSuite> getPreferredCipherSuites() {
+  if (hasAesHardwareSupport()) {
+    return {fizz::CipherSuite::TLS_AES_128_GCM_SHA256,
+            fizz::CipherSuite::TLS_CHACHA20_POLY1305_SHA256};
+  }
+  return {fizz::CipherSuite::TLS_CHACHA20_POLY1305_SHA256,
+          fizz::CipherSuite::TLS_AES_128_GCM_SHA256};
+}
+
 } // namespace quic
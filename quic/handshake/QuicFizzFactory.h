@@ -11,6 +11,8 @@
 #include <fizz/protocol/OpenSSLFactory.h>
 #include <quic/codec/PacketNumberCipher.h>
 
+#include <vector>
+
 namespace quic {
 
 constexpr folly::StringPiece kQuicHkdfLabelPrefix = "quic ";
@@ -34,4 +36,16 @@ class QuicFizzFactory : public fizz::OpenSSLFactory {
       fizz::CipherSuite cipher) const;
 };
 
+/**
+ * Whether this CPU has AES instructions, AES-NI on x86 or the ARMv8 crypto
+ * extensions.
+ */
+bool hasAesHardwareSupport();
+
+/**
+ * The cipher suites QUIC supports, best first for this CPU: AES-GCM when it
+ * has AES instructions, ChaCha20-Poly1305 otherwise, as on most ARM phones.
+ */
+std::vector<fizz::CipherSuite> getPreferredCipherSuites();
+
 } // namespace quic
@@ -30,6 +30,7 @@ enum class TransportParameterId : uint16_t {
   max_ack_delay = 0x000b,
   disable_migration = 0x000c,
   preferred_address = 0x000d,
+  max_datagram_frame_size = 0x0020, // RFC 9221
 };
 
 struct TransportParameter {
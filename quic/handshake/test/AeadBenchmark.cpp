@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/String.h>
+#include <folly/init/Init.h>
+#include <glog/logging.h>
+#include <quic/handshake/FizzBridge.h>
+#include <quic/handshake/FizzCryptoFactory.h>
+
+#include <memory>
+#include <string>
+
+using namespace quic;
+
+namespace {
+
+// A packet that only carries an ack, and a full one.
+constexpr size_t kSmallPacketLen = 40;
+constexpr size_t kFullPacketLen = kDefaultUDPSendPacketLen;
+// About the size of a short header.
+constexpr size_t kHeaderLen = 13;
+
+// The aead of the client initial packets. It is AES-128-GCM, the cipher of
+// most 1-RTT keys, so its per-packet cost is the one of the steady state.
+std::unique_ptr<Aead> makeAead() {
+  static QuicFizzFactory fizzFactory;
+  FizzCryptoFactory cryptoFactory(&fizzFactory);
+  auto connId = folly::unhexlify("c654efd8a31b4792");
+  return cryptoFactory.getClientInitialCipher(
+      ConnectionId(std::vector<uint8_t>(connId.begin(), connId.end())),
+      QuicVersion::MVFST);
+}
+
+const fizz::Aead& getFizzAead(const Aead& aead) {
+  return *static_cast<const FizzAead&>(aead).getFizzAead();
+}
+
+// Each iteration copies the payload into a new buffer, as the packet
+// builder does, so that the aead can work in place.
+template <typename AeadType>
+void encrypt(const AeadType& aead, size_t iters, size_t packetLen) {
+  std::string payload;
+  std::unique_ptr<folly::IOBuf> header;
+  BENCHMARK_SUSPEND {
+    payload.assign(packetLen - kHeaderLen, 'a');
+    header = folly::IOBuf::copyBuffer(std::string(kHeaderLen, 'h'));
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto ciphertext = aead.encrypt(
+        folly::IOBuf::copyBuffer(
+            payload.data(), payload.size(), 0, aead.getCipherOverhead()),
+        header.get(),
+        i);
+    folly::doNotOptimizeAway(ciphertext->length());
+  }
+}
+
+template <typename AeadType>
+void tryDecrypt(const AeadType& aead, size_t iters, size_t packetLen) {
+  std::unique_ptr<folly::IOBuf> ciphertext;
+  std::unique_ptr<folly::IOBuf> header;
+  BENCHMARK_SUSPEND {
+    header = folly::IOBuf::copyBuffer(std::string(kHeaderLen, 'h'));
+    ciphertext = aead.encrypt(
+        folly::IOBuf::copyBuffer(std::string(packetLen - kHeaderLen, 'a')),
+        header.get(),
+        0);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto plaintext = aead.tryDecrypt(
+        folly::IOBuf::copyBuffer(ciphertext->data(), ciphertext->length()),
+        header.get(),
+        0);
+    CHECK(plaintext.hasValue());
+    folly::doNotOptimizeAway((*plaintext)->length());
+  }
+}
+
+// The overhead is asked for every packet the write path builds.
+template <typename AeadType>
+void cipherOverhead(const AeadType& aead, size_t iters) {
+  size_t overhead = 0;
+  for (size_t i = 0; i < iters; i++) {
+    overhead += aead.getCipherOverhead();
+    folly::doNotOptimizeAway(overhead);
+  }
+}
+
+void fizzEncrypt(size_t iters, size_t packetLen) {
+  std::unique_ptr<Aead> aead;
+  BENCHMARK_SUSPEND {
+    aead = makeAead();
+  }
+  encrypt(getFizzAead(*aead), iters, packetLen);
+}
+
+void quicEncrypt(size_t iters, size_t packetLen) {
+  std::unique_ptr<Aead> aead;
+  BENCHMARK_SUSPEND {
+    aead = makeAead();
+  }
+  encrypt(*aead, iters, packetLen);
+}
+
+void fizzTryDecrypt(size_t iters, size_t packetLen) {
+  std::unique_ptr<Aead> aead;
+  BENCHMARK_SUSPEND {
+    aead = makeAead();
+  }
+  tryDecrypt(getFizzAead(*aead), iters, packetLen);
+}
+
+void quicTryDecrypt(size_t iters, size_t packetLen) {
+  std::unique_ptr<Aead> aead;
+  BENCHMARK_SUSPEND {
+    aead = makeAead();
+  }
+  tryDecrypt(*aead, iters, packetLen);
+}
+
+} // namespace
+
+// The fizz aead is the baseline, the quic aead wraps it and is what the
+// transport calls.
+BENCHMARK_NAMED_PARAM(fizzEncrypt, SmallPacket, kSmallPacketLen)
+BENCHMARK_RELATIVE_NAMED_PARAM(quicEncrypt, SmallPacket, kSmallPacketLen)
+BENCHMARK_NAMED_PARAM(fizzEncrypt, FullPacket, kFullPacketLen)
+BENCHMARK_RELATIVE_NAMED_PARAM(quicEncrypt, FullPacket, kFullPacketLen)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(fizzTryDecrypt, SmallPacket, kSmallPacketLen)
+BENCHMARK_RELATIVE_NAMED_PARAM(quicTryDecrypt, SmallPacket, kSmallPacketLen)
+BENCHMARK_NAMED_PARAM(fizzTryDecrypt, FullPacket, kFullPacketLen)
+BENCHMARK_RELATIVE_NAMED_PARAM(quicTryDecrypt, FullPacket, kFullPacketLen)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(FizzCipherOverhead, iters) {
+  std::unique_ptr<Aead> aead;
+  BENCHMARK_SUSPEND {
+    aead = makeAead();
+  }
+  cipherOverhead(getFizzAead(*aead), iters);
+}
+
+BENCHMARK_RELATIVE(QuicCipherOverhead, iters) {
+  std::unique_ptr<Aead> aead;
+  BENCHMARK_SUSPEND {
+    aead = makeAead();
+  }
+  cipherOverhead(*aead, iters);
+}
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
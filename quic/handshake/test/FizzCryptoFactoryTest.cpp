@@ -57,6 +57,8 @@ class FizzCryptoFactoryTest : public Test {
         .WillRepeatedly(Return(fizz::AESGCM128::kKeyLength));
     EXPECT_CALL(*mockAead, ivLength())
         .WillRepeatedly(Return(fizz::AESGCM128::kIVLength));
+    EXPECT_CALL(*mockAead, getCipherOverhead())
+        .WillRepeatedly(Return(fizz::AESGCM128::kTagLength));
     return mockAead;
   }
 
@@ -98,6 +100,18 @@ TEST_F(FizzCryptoFactoryTest, TestDraft17ClearTextCipher) {
   EXPECT_EQ(trafficIvHex, expectedIv);
 }
 
+TEST_F(FizzCryptoFactoryTest, TestCipherOverhead) {
+  auto connid = folly::unhexlify("c654efd8a31b4792");
+  ConnectionId destinationConnid(
+      std::vector<uint8_t>(connid.begin(), connid.end()));
+  QuicTestFizzFactory fizzFactory;
+  fizzFactory.setMockAead(createMockAead());
+  FizzCryptoFactory cryptoFactory(&fizzFactory);
+  auto aead = cryptoFactory.getClientInitialCipher(
+      destinationConnid, QuicVersion::MVFST_OLD);
+  EXPECT_EQ(aead->getCipherOverhead(), fizz::AESGCM128::kTagLength);
+}
+
 TEST_F(FizzCryptoFactoryTest, TestPacketEncryptionKey) {
   QuicTestFizzFactory fizzFactory;
   fizzFactory.setMockPacketNumberCipher(createMockPacketNumberCipher());
@@ -127,5 +141,27 @@ TEST_F(FizzCryptoFactoryTest, TestPacketEncryptionKey) {
   EXPECT_EQ(secretHex2, expectedKey2);
 }
 
+// RFC 9001 appendix A.5.
+TEST_F(FizzCryptoFactoryTest, TestChaCha20PacketNumberCipher) {
+  QuicFizzFactory fizzFactory;
+  FizzCryptoFactory cryptoFactory(&fizzFactory);
+  auto secret = folly::unhexlify(
+      "9ac312a7f877468ebe69422748ad00a15443f18203a07d6060f688f30f21632b");
+  auto packetCipher = cryptoFactory.makePacketNumberCipher(
+      folly::range(secret), fizz::CipherSuite::TLS_CHACHA20_POLY1305_SHA256);
+  auto sample = folly::unhexlify("5e5cd55c41f69080575d7999c25a5bfb");
+  auto mask = packetCipher->mask(folly::range(sample));
+  EXPECT_EQ("aefefe7d03", folly::hexlify(folly::range(mask).subpiece(0, 5)));
+}
+
+TEST_F(FizzCryptoFactoryTest, TestPreferredCipherSuites) {
+  auto ciphers = getPreferredCipherSuites();
+  ASSERT_EQ(2, ciphers.size());
+  EXPECT_EQ(
+      hasAesHardwareSupport() ? fizz::CipherSuite::TLS_AES_128_GCM_SHA256
+                              : fizz::CipherSuite::TLS_CHACHA20_POLY1305_SHA256,
+      ciphers.front());
+}
+
 } // namespace test
 } // namespace quic
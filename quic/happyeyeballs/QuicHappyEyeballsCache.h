@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/net/NetOps.h>
+
+#include <string>
+#include <unordered_map>
+
+namespace quic {
+
+/**
+ * Remembers the address family that won happy eyeballs for a host, so that
+ * the next connection to it tries that family first.
+ */
+class QuicHappyEyeballsCache {
+ public:
+  virtual ~QuicHappyEyeballsCache() = default;
+
+  virtual folly::Optional<sa_family_t> getFamily(const std::string&) = 0;
+  virtual void putFamily(const std::string&, sa_family_t) = 0;
+};
+
+/**
+ * Basic cache that stores the families in a hash map. There is no bound on
+ * the size of this cache.
+ */
+class BasicQuicHappyEyeballsCache : public QuicHappyEyeballsCache {
+ public:
+  ~BasicQuicHappyEyeballsCache() override = default;
+
+  folly::Optional<sa_family_t> getFamily(const std::string& host) override {
+    auto result = cache_.find(host);
+    if (result != cache_.end()) {
+      return result->second;
+    }
+    return folly::none;
+  }
+
+  void putFamily(const std::string& host, sa_family_t family) override {
+    cache_[host] = family;
+  }
+
+ private:
+  std::unordered_map<std::string, sa_family_t> cache_;
+};
+
+} // namespace quic
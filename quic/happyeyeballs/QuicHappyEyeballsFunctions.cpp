@@ -9,6 +9,7 @@
 #include <quic/happyeyeballs/QuicHappyEyeballsFunctions.h>
 
 #include <quic/logging/QuicLogger.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/StateData.h>
 
 #include <folly/SocketAddress.h>
@@ -89,7 +90,9 @@ void startHappyEyeballs(
     connection.happyEyeballsState.connAttemptDelayTimeout =
         &connAttemptDelayTimeout;
 
-    evb->timer().scheduleTimeout(&connAttemptDelayTimeout, connAttempDelay);
+    if (connAttempDelay.count() > 0) {
+      evb->timer().scheduleTimeout(&connAttemptDelayTimeout, connAttempDelay);
+    }
 
     try {
       happyEyeballsSetUpSocket(
@@ -102,6 +105,12 @@ void startHappyEyeballs(
       // If second socket bind throws exception, give it up
       connAttemptDelayTimeout.cancelTimeout();
       connection.happyEyeballsState.finished = true;
+      return;
+    }
+    if (connAttempDelay.count() == 0) {
+      // The first Initial goes out on both sockets.
+      QUIC_TRACE(happy_eyeballs, connection, "race");
+      happyEyeballsStartSecondSocket(connection.happyEyeballsState);
     }
   } else if (connection.happyEyeballsState.v6PeerAddress.isInitialized()) {
     connection.originalPeerAddress =
@@ -128,34 +137,8 @@ void happyEyeballsSetUpSocket(
   } else {
     socket.bind(folly::SocketAddress("::", 0));
   }
-  if (transportSettings.turnoffPMTUD) {
-    // TODO: Clean this up or move this into AsyncUDPSocket once we have a
-    // better idea of how to handle PMTU
-#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
-    if (socket.address().getFamily() == AF_INET) {
-      int v4 = IP_PMTUDISC_PROBE;
-      folly::netops::setsockopt(
-          socket.getNetworkSocket(),
-          IPPROTO_IP,
-          IP_MTU_DISCOVER,
-          &v4,
-          sizeof(v4));
-    }
-#endif
-#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
-    if (socket.address().getFamily() == AF_INET6) {
-      int v6 = IPV6_PMTUDISC_PROBE;
-      folly::netops::setsockopt(
-          socket.getNetworkSocket(),
-          IPPROTO_IPV6,
-          IPV6_MTU_DISCOVER,
-          &v6,
-          sizeof(v6));
-    }
-#endif
-  } else {
-    socket.dontFragment(true);
-  }
+  // The path MTU probes of pathMtuDiscovery rely on the DF bit.
+  setSocketDontFragment(socket, transportSettings.turnoffPMTUD);
   if (transportSettings.connectUDP) {
     socket.connect(peerAddress);
   }
@@ -35,8 +35,8 @@ class FileQLogger : public QLogger {
   void addPacket(const RegularQuicWritePacket& writePacket, uint64_t packetSize)
       override;
   void addConnectionClose(
-      std::string error,
-      std::string reason,
+      folly::StringPiece error,
+      folly::StringPiece reason,
       bool drainConnection,
       bool sendCloseImmediately) override;
   void addTransportSummary(
@@ -53,25 +53,26 @@ class FileQLogger : public QLogger {
   void addCongestionMetricUpdate(
       uint64_t bytesInFlight,
       uint64_t currentCwnd,
-      std::string congestionEvent,
-      std::string state = "",
-      std::string recoveryState = "") override;
+      folly::StringPiece congestionEvent,
+      folly::StringPiece state = "",
+      folly::StringPiece recoveryState = "") override;
   void addPacingMetricUpdate(
       uint64_t pacingBurstSizeIn,
       std::chrono::microseconds pacingIntervalIn) override;
-  void addAppIdleUpdate(std::string idleEvent, bool idle) override;
-  void addPacketDrop(size_t packetSize, std::string dropReasonIn) override;
+  void addAppIdleUpdate(folly::StringPiece idleEvent, bool idle) override;
+  void addPacketDrop(size_t packetSize, folly::StringPiece dropReasonIn)
+      override;
   void addDatagramReceived(uint64_t dataLen) override;
   void addLossAlarm(
       PacketNum largestSent,
       uint64_t alarmCount,
       uint64_t outstandingPackets,
-      std::string type) override;
+      folly::StringPiece type) override;
   void addPacketsLost(
       PacketNum largestLostPacketNum,
       uint64_t lostBytes,
       uint64_t lostPackets) override;
-  void addTransportStateUpdate(std::string update) override;
+  void addTransportStateUpdate(folly::StringPiece update) override;
   void addPacketBuffered(
       PacketNum packetNum,
       ProtectionType protectionType,
@@ -83,8 +84,23 @@ class FileQLogger : public QLogger {
       std::chrono::microseconds mrtt,
       std::chrono::microseconds srtt,
       std::chrono::microseconds ackDelay) override;
-  void addStreamStateUpdate(StreamId id, std::string update) override;
+  void addStreamStateUpdate(StreamId id, folly::StringPiece update) override;
+  void addHandshakeSummary(
+      std::chrono::microseconds handshakeTime,
+      std::chrono::microseconds keysDerivedTime,
+      std::chrono::microseconds processingTime,
+      uint64_t cryptoBytesSent,
+      uint64_t cryptoBytesRecvd) override;
+  void addWriteBatch(
+      uint64_t numPackets,
+      uint64_t numBytes,
+      folly::StringPiece flushReason,
+      bool wouldBlock) override;
   void outputLogsToFile(const std::string& path, bool prettyJson);
   folly::dynamic toDynamic() const;
+
+ protected:
+  // Called with every event, keeps it in logs.
+  virtual void handleEvent(std::unique_ptr<QLogEvent> event);
 };
 } // namespace quic
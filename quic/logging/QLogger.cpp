@@ -41,7 +41,7 @@ std::unique_ptr<QLogPacketEvent> QLogger::createPacketEvent(
   for (const auto& quicFrame : regularPacket.frames) {
     folly::variant_match(
         quicFrame,
-        [&](const PaddingFrame& /* unused */) { ++numPaddingFrames; },
+        [&](const PaddingFrame& frame) { numPaddingFrames += frame.numFrames; },
         [&](const RstStreamFrame& frame) {
           event->frames.push_back(std::make_unique<RstStreamFrameLog>(
               frame.streamId, frame.errorCode, frame.offset));
@@ -105,6 +105,16 @@ std::unique_ptr<QLogPacketEvent> QLogger::createPacketEvent(
           event->frames.push_back(std::make_unique<CryptoFrameLog>(
               frame.offset, frame.data->length()));
         },
+        [&](const ReadDatagramFrame& frame) {
+          event->frames.push_back(std::make_unique<DatagramFrameLog>(
+              frame.data ? frame.data->computeChainDataLength() : 0));
+        },
+        [&](const RepairFrame& frame) {
+          event->frames.push_back(std::make_unique<RepairFrameLog>(
+              frame.streamId,
+              frame.frames.size(),
+              frame.data ? frame.data->computeChainDataLength() : 0));
+        },
         [&](const ReadNewTokenFrame& /* unused */) {
           event->frames.push_back(std::make_unique<ReadNewTokenFrameLog>());
         },
@@ -132,6 +142,13 @@ std::unique_ptr<QLogPacketEvent> QLogger::createPacketEvent(
           event->frames.push_back(std::make_unique<NewConnectionIdFrameLog>(
               frame.sequenceNumber, frame.token));
         },
+        [&](const AckFrequencyFrame& frame) {
+          event->frames.push_back(std::make_unique<AckFrequencyFrameLog>(
+              frame.sequenceNumber,
+              frame.packetTolerance,
+              frame.updateMaxAckDelay,
+              frame.ignoreOrder));
+        },
         [&](const auto& /* unused */) {
           // Ignore other frames.
         });
@@ -166,7 +183,7 @@ std::unique_ptr<QLogPacketEvent> QLogger::createPacketEvent(
   for (const auto& quicFrame : writePacket.frames) {
     folly::variant_match(
         quicFrame,
-        [&](const PaddingFrame& /* unused */) { ++numPaddingFrames; },
+        [&](const PaddingFrame& frame) { numPaddingFrames += frame.numFrames; },
         [&](const RstStreamFrame& frame) {
           event->frames.push_back(std::make_unique<RstStreamFrameLog>(
               frame.streamId, frame.errorCode, frame.offset));
@@ -230,6 +247,14 @@ std::unique_ptr<QLogPacketEvent> QLogger::createPacketEvent(
           event->frames.push_back(std::make_unique<CryptoFrameLog>(
               frame.offset, frame.data->length()));
         },
+        [&](const WriteDatagramFrame& frame) {
+          event->frames.push_back(
+              std::make_unique<DatagramFrameLog>(frame.len));
+        },
+        [&](const WriteRepairFrame& frame) {
+          event->frames.push_back(std::make_unique<RepairFrameLog>(
+              frame.streamId, frame.numFrames, frame.len));
+        },
         [&](const ReadNewTokenFrame& /* unused */) {
           event->frames.push_back(std::make_unique<ReadNewTokenFrameLog>());
         },
@@ -257,6 +282,13 @@ std::unique_ptr<QLogPacketEvent> QLogger::createPacketEvent(
           event->frames.push_back(std::make_unique<NewConnectionIdFrameLog>(
               frame.sequenceNumber, frame.token));
         },
+        [&](const AckFrequencyFrame& frame) {
+          event->frames.push_back(std::make_unique<AckFrequencyFrameLog>(
+              frame.sequenceNumber,
+              frame.packetTolerance,
+              frame.updateMaxAckDelay,
+              frame.ignoreOrder));
+        },
         [&](const auto& /* unused */) {
           // Ignore other frames.
         });
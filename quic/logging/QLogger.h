@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <folly/Range.h>
 #include <quic/logging/QLoggerTypes.h>
 
 namespace quic {
@@ -33,8 +34,8 @@ class QLogger {
       const RegularQuicWritePacket& writePacket,
       uint64_t packetSize) = 0;
   virtual void addConnectionClose(
-      std::string error,
-      std::string reason,
+      folly::StringPiece error,
+      folly::StringPiece reason,
       bool drainConnection,
       bool sendCloseImmediately) = 0;
   virtual void addTransportSummary(
@@ -51,25 +52,27 @@ class QLogger {
   virtual void addCongestionMetricUpdate(
       uint64_t bytesInFlight,
       uint64_t currentCwnd,
-      std::string congestionEvent,
-      std::string state = "",
-      std::string recoveryState = "") = 0;
+      folly::StringPiece congestionEvent,
+      folly::StringPiece state = "",
+      folly::StringPiece recoveryState = "") = 0;
   virtual void addPacingMetricUpdate(
       uint64_t pacingBurstSizeIn,
       std::chrono::microseconds pacingIntervalIn) = 0;
-  virtual void addAppIdleUpdate(std::string idleEvent, bool idle) = 0;
-  virtual void addPacketDrop(size_t packetSize, std::string dropReasonIn) = 0;
+  virtual void addAppIdleUpdate(folly::StringPiece idleEvent, bool idle) = 0;
+  virtual void addPacketDrop(
+      size_t packetSize,
+      folly::StringPiece dropReasonIn) = 0;
   virtual void addDatagramReceived(uint64_t dataLen) = 0;
   virtual void addLossAlarm(
       PacketNum largestSent,
       uint64_t alarmCount,
       uint64_t outstandingPackets,
-      std::string type) = 0;
+      folly::StringPiece type) = 0;
   virtual void addPacketsLost(
       PacketNum largestLostPacketNum,
       uint64_t lostBytes,
       uint64_t lostPackets) = 0;
-  virtual void addTransportStateUpdate(std::string update) = 0;
+  virtual void addTransportStateUpdate(folly::StringPiece update) = 0;
   virtual void addPacketBuffered(
       PacketNum packetNum,
       ProtectionType protectionType,
@@ -84,7 +87,18 @@ class QLogger {
       std::chrono::microseconds ackDelay) = 0;
   virtual void addStreamStateUpdate(
       quic::StreamId streamId,
-      std::string update) = 0;
+      folly::StringPiece update) = 0;
+  virtual void addHandshakeSummary(
+      std::chrono::microseconds handshakeTime,
+      std::chrono::microseconds keysDerivedTime,
+      std::chrono::microseconds processingTime,
+      uint64_t cryptoBytesSent,
+      uint64_t cryptoBytesRecvd) = 0;
+  virtual void addWriteBatch(
+      uint64_t numPackets,
+      uint64_t numBytes,
+      folly::StringPiece flushReason,
+      bool wouldBlock) = 0;
   std::unique_ptr<QLogPacketEvent> createPacketEvent(
       const RegularQuicPacket& regularPacket,
       uint64_t packetSize);
@@ -33,8 +33,13 @@ constexpr auto kCopaInit = "copa init";
 constexpr auto kCongestionPacketSent = "congestion on packet sent";
 constexpr auto kCopaCheckAndUpdateDirection = "copa check and update direction";
 constexpr auto kCongestionPacketLoss = "congestion packet loss";
+constexpr auto kCongestionSpuriousLossUndo = "congestion spurious loss undo";
 constexpr auto kCongestionAppLimited = "congestion app limited";
 constexpr auto kCongestionAppUnlimited = "congestion app unlimited";
+constexpr auto kCwndNotValidated = "cwnd not validated";
+constexpr auto kCongestionIdleRestart = "congestion idle restart";
+constexpr auto kCopaCompetitiveMode = "copa competitive mode";
+constexpr auto kCopaDefaultMode = "copa default mode";
 constexpr uint64_t kDefaultCwnd = 12320;
 constexpr auto kAppIdle = "app idle";
 constexpr auto kMaxBuffered = "max buffered";
@@ -46,6 +51,7 @@ constexpr auto kUdpTruncated = "udp truncated";
 constexpr auto kNoData = "no data";
 constexpr auto kUnexpectedProtectionLevel = "unexpected protection level";
 constexpr auto kBufferUnavailable = "buffer unavailable";
+constexpr auto kPendingPacketPoolFull = "pending packet pool full";
 constexpr auto kReset = "reset";
 constexpr auto kPtoAlarm = "pto alarm";
 constexpr auto kHandshakeAlarm = "handshake alarm";
@@ -59,6 +65,12 @@ constexpr auto kDerivedOneRttWriteCipher = "derived 1-rtt write cipher";
 constexpr auto kZeroRttRejected = "zerortt rejected";
 constexpr auto kZeroRttAccepted = "zerortt accepted";
 constexpr auto kZeroRttAttempted = "zerortt attempted";
+constexpr auto kPathMtuRaised = "path mtu raised to ";
+constexpr auto kPathMtuSearchComplete = "path mtu search complete";
+constexpr auto kPathMtuBlackHole = "path mtu black hole";
+constexpr auto kKeyUpdateStarted = "key update started";
+constexpr auto kKeyUpdateFollowed = "key update followed";
+constexpr auto kHandshakeSpacesDiscarded = "handshake spaces discarded";
 constexpr auto kRecalculateTimeToOrigin = "recalculate time to origin";
 constexpr auto kAbort = "abort";
 constexpr auto kQLogVersion = "draft-00";
@@ -73,6 +85,12 @@ constexpr auto kQLogVersionField = "qlog_version";
 constexpr auto kQLogTitleField = "title";
 constexpr auto kQLogDescriptionField = "description";
 constexpr auto kQLogTraceCountField = "trace_count";
+constexpr auto kQLogFormatField = "qlog_format";
+constexpr auto kQLogStreamingFormat = "JSON-SEQ";
+// Bytes of serialized events a StreamingQLogger buffers before writing them
+// out, and at most, including those still being written.
+constexpr size_t kQLogStreamingFlushThreshold = 64 * 1024;
+constexpr size_t kDefaultQLogStreamingMaxBufferedBytes = 1024 * 1024;
 constexpr auto kEOM = "eom";
 constexpr auto kStreamBlocked = "stream blocked";
 constexpr auto kOnHeaders = "on headers";
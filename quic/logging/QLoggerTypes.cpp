@@ -122,6 +122,22 @@ folly::dynamic CryptoFrameLog::toDynamic() const {
   return d;
 }
 
+folly::dynamic DatagramFrameLog::toDynamic() const {
+  folly::dynamic d = folly::dynamic::object();
+  d["frame_type"] = toString(FrameType::DATAGRAM_LEN);
+  d["len"] = len;
+  return d;
+}
+
+folly::dynamic RepairFrameLog::toDynamic() const {
+  folly::dynamic d = folly::dynamic::object();
+  d["frame_type"] = toString(FrameType::REPAIR);
+  d["stream_id"] = streamId;
+  d["num_frames"] = numFrames;
+  d["len"] = len;
+  return d;
+}
+
 folly::dynamic StopSendingFrameLog::toDynamic() const {
   folly::dynamic d = folly::dynamic::object();
   d["frame_type"] = toString(FrameType::STOP_SENDING);
@@ -161,6 +177,16 @@ folly::dynamic PathResponseFrameLog::toDynamic() const {
   return d;
 }
 
+folly::dynamic AckFrequencyFrameLog::toDynamic() const {
+  folly::dynamic d = folly::dynamic::object();
+  d["frame_type"] = toString(FrameType::ACK_FREQUENCY);
+  d["sequence_number"] = sequenceNumber;
+  d["packet_tolerance"] = packetTolerance;
+  d["update_max_ack_delay"] = updateMaxAckDelay.count();
+  d["ignore_order"] = ignoreOrder;
+  return d;
+}
+
 folly::dynamic NewConnectionIdFrameLog::toDynamic() const {
   folly::dynamic d = folly::dynamic::object();
   d["frame_type"] = toString(FrameType::NEW_CONNECTION_ID);
@@ -684,6 +710,75 @@ folly::dynamic QLogStreamStateUpdateEvent::toDynamic() const {
   return d;
 }
 
+QLogHandshakeSummaryEvent::QLogHandshakeSummaryEvent(
+    std::chrono::microseconds handshakeTimeIn,
+    std::chrono::microseconds keysDerivedTimeIn,
+    std::chrono::microseconds processingTimeIn,
+    uint64_t cryptoBytesSentIn,
+    uint64_t cryptoBytesRecvdIn,
+    std::chrono::microseconds refTimeIn)
+    : handshakeTime{handshakeTimeIn},
+      keysDerivedTime{keysDerivedTimeIn},
+      processingTime{processingTimeIn},
+      cryptoBytesSent{cryptoBytesSentIn},
+      cryptoBytesRecvd{cryptoBytesRecvdIn} {
+  eventType = QLogEventType::HandshakeSummary;
+  refTime = refTimeIn;
+}
+
+folly::dynamic QLogHandshakeSummaryEvent::toDynamic() const {
+  // creating a folly::dynamic array to hold the information corresponding to
+  // the event fields relative_time, category, event_type, trigger, data
+  folly::dynamic d = folly::dynamic::array(
+      folly::to<std::string>(refTime.count()),
+      "TRANSPORT",
+      toString(eventType),
+      "DEFAULT");
+  folly::dynamic data = folly::dynamic::object();
+
+  data["handshake_time"] = handshakeTime.count();
+  data["keys_derived_time"] = keysDerivedTime.count();
+  data["processing_time"] = processingTime.count();
+  data["crypto_bytes_sent"] = cryptoBytesSent;
+  data["crypto_bytes_recvd"] = cryptoBytesRecvd;
+
+  d.push_back(std::move(data));
+  return d;
+}
+
+QLogWriteBatchEvent::QLogWriteBatchEvent(
+    uint64_t numPacketsIn,
+    uint64_t numBytesIn,
+    std::string flushReasonIn,
+    bool wouldBlockIn,
+    std::chrono::microseconds refTimeIn)
+    : numPackets{numPacketsIn},
+      numBytes{numBytesIn},
+      flushReason{std::move(flushReasonIn)},
+      wouldBlock{wouldBlockIn} {
+  eventType = QLogEventType::WriteBatch;
+  refTime = refTimeIn;
+}
+
+folly::dynamic QLogWriteBatchEvent::toDynamic() const {
+  // creating a folly::dynamic array to hold the information corresponding to
+  // the event fields relative_time, category, event_type, trigger, data
+  folly::dynamic d = folly::dynamic::array(
+      folly::to<std::string>(refTime.count()),
+      "TRANSPORT",
+      toString(eventType),
+      "DEFAULT");
+  folly::dynamic data = folly::dynamic::object();
+
+  data["num_packets"] = numPackets;
+  data["num_bytes"] = numBytes;
+  data["flush_reason"] = flushReason;
+  data["would_block"] = wouldBlock;
+
+  d.push_back(std::move(data));
+  return d;
+}
+
 std::string toString(QLogEventType type) {
   switch (type) {
     case QLogEventType::PacketSent:
@@ -718,6 +813,10 @@ std::string toString(QLogEventType type) {
       return "METRIC_UPDATE";
     case QLogEventType::StreamStateUpdate:
       return "STREAM_STATE_UPDATE";
+    case QLogEventType::HandshakeSummary:
+      return "HANDSHAKE_SUMMARY";
+    case QLogEventType::WriteBatch:
+      return "WRITE_BATCH";
   }
   LOG(WARNING) << "toString has unhandled QLog event type";
   return "UNKNOWN";
@@ -155,11 +155,11 @@ class StreamDataBlockedFrameLog : public QLogFrame {
 
 class ReadAckFrameLog : public QLogFrame {
  public:
-  std::vector<AckBlock> ackBlocks;
+  ReadAckBlocks ackBlocks;
   std::chrono::microseconds ackDelay;
 
   ReadAckFrameLog(
-      const std::vector<AckBlock>& ackBlocksIn,
+      const ReadAckBlocks& ackBlocksIn,
       std::chrono::microseconds ackDelayIn)
       : ackBlocks{ackBlocksIn}, ackDelay{ackDelayIn} {}
   ~ReadAckFrameLog() override = default;
@@ -168,11 +168,11 @@ class ReadAckFrameLog : public QLogFrame {
 
 class WriteAckFrameLog : public QLogFrame {
  public:
-  IntervalSet<PacketNum> ackBlocks;
+  WriteAckBlocks ackBlocks;
   std::chrono::microseconds ackDelay;
 
   WriteAckFrameLog(
-      IntervalSet<PacketNum> ackBlocksIn,
+      WriteAckBlocks ackBlocksIn,
       std::chrono::microseconds ackDelayIn)
       : ackBlocks{ackBlocksIn}, ackDelay{ackDelayIn} {}
   ~WriteAckFrameLog() override = default;
@@ -208,6 +208,27 @@ class CryptoFrameLog : public QLogFrame {
   folly::dynamic toDynamic() const override;
 };
 
+class DatagramFrameLog : public QLogFrame {
+ public:
+  uint64_t len;
+
+  explicit DatagramFrameLog(uint64_t lenIn) : len{lenIn} {}
+  ~DatagramFrameLog() override = default;
+  folly::dynamic toDynamic() const override;
+};
+
+class RepairFrameLog : public QLogFrame {
+ public:
+  StreamId streamId;
+  uint64_t numFrames;
+  uint64_t len;
+
+  RepairFrameLog(StreamId streamIdIn, uint64_t numFramesIn, uint64_t lenIn)
+      : streamId{streamIdIn}, numFrames{numFramesIn}, len{lenIn} {}
+  ~RepairFrameLog() override = default;
+  folly::dynamic toDynamic() const override;
+};
+
 class StopSendingFrameLog : public QLogFrame {
  public:
   StreamId streamId;
@@ -276,6 +297,26 @@ class NewConnectionIdFrameLog : public QLogFrame {
   folly::dynamic toDynamic() const override;
 };
 
+class AckFrequencyFrameLog : public QLogFrame {
+ public:
+  uint64_t sequenceNumber;
+  uint64_t packetTolerance;
+  std::chrono::microseconds updateMaxAckDelay;
+  bool ignoreOrder;
+
+  AckFrequencyFrameLog(
+      uint64_t sequenceNumberIn,
+      uint64_t packetToleranceIn,
+      std::chrono::microseconds updateMaxAckDelayIn,
+      bool ignoreOrderIn)
+      : sequenceNumber{sequenceNumberIn},
+        packetTolerance{packetToleranceIn},
+        updateMaxAckDelay{updateMaxAckDelayIn},
+        ignoreOrder{ignoreOrderIn} {}
+  ~AckFrequencyFrameLog() override = default;
+  folly::dynamic toDynamic() const override;
+};
+
 class ReadNewTokenFrameLog : public QLogFrame {
  public:
   ReadNewTokenFrameLog() = default;
@@ -310,6 +351,8 @@ enum class QLogEventType : uint32_t {
   PacketAck,
   MetricUpdate,
   StreamStateUpdate,
+  HandshakeSummary,
+  WriteBatch,
 };
 
 std::string toString(QLogEventType type);
@@ -555,6 +598,40 @@ class QLogStreamStateUpdateEvent : public QLogEvent {
   folly::dynamic toDynamic() const override;
 };
 
+class QLogHandshakeSummaryEvent : public QLogEvent {
+ public:
+  QLogHandshakeSummaryEvent(
+      std::chrono::microseconds handshakeTime,
+      std::chrono::microseconds keysDerivedTime,
+      std::chrono::microseconds processingTime,
+      uint64_t cryptoBytesSent,
+      uint64_t cryptoBytesRecvd,
+      std::chrono::microseconds refTime);
+  ~QLogHandshakeSummaryEvent() override = default;
+  std::chrono::microseconds handshakeTime;
+  std::chrono::microseconds keysDerivedTime;
+  std::chrono::microseconds processingTime;
+  uint64_t cryptoBytesSent;
+  uint64_t cryptoBytesRecvd;
+  folly::dynamic toDynamic() const override;
+};
+
+class QLogWriteBatchEvent : public QLogEvent {
+ public:
+  QLogWriteBatchEvent(
+      uint64_t numPackets,
+      uint64_t numBytes,
+      std::string flushReason,
+      bool wouldBlock,
+      std::chrono::microseconds refTime);
+  ~QLogWriteBatchEvent() override = default;
+  uint64_t numPackets;
+  uint64_t numBytes;
+  std::string flushReason;
+  bool wouldBlock;
+  folly::dynamic toDynamic() const override;
+};
+
 std::string toString(QLogEventType type);
 
 } // namespace quic
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/logging/StreamingQLogger.h>
+
+#include <folly/File.h>
+#include <folly/FileUtil.h>
+#include <folly/json.h>
+
+#include <fcntl.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+namespace quic {
+
+namespace {
+// Starts every JSON-SEQ record.
+constexpr char kRecordSeparator = 0x1e;
+} // namespace
+
+struct StreamingQLogger::Sink {
+  explicit Sink(folly::File fileIn) : file(std::move(fileIn)) {}
+
+  // Writes the queued chunks in order, until there are none left.
+  void drain() {
+    while (true) {
+      std::string chunk;
+      {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (chunks.empty()) {
+          draining = false;
+          return;
+        }
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+      }
+      if (folly::writeFull(file.fd(), chunk.data(), chunk.size()) < 0) {
+        LOG(ERROR) << "Error: Can't write qlog records, errno=" << errno;
+      }
+      queuedBytes -= chunk.size();
+    }
+  }
+
+  folly::File file;
+  std::mutex mutex;
+  std::deque<std::string> chunks;
+  // Whether a drain is scheduled or running
+  bool draining{false};
+  std::atomic<size_t> queuedBytes{0};
+};
+
+StreamingQLogger::StreamingQLogger(
+    std::string path,
+    folly::Executor* executor,
+    size_t maxBufferedBytes,
+    std::string protocolTypeIn,
+    std::string vantagePointIn)
+    : FileQLogger(std::move(protocolTypeIn), std::move(vantagePointIn)),
+      path_(std::move(path)),
+      executor_(executor),
+      maxBufferedBytes_(maxBufferedBytes) {}
+
+StreamingQLogger::~StreamingQLogger() {
+  flush();
+}
+
+void StreamingQLogger::handleEvent(std::unique_ptr<QLogEvent> event) {
+  appendRecord(event->toDynamic());
+}
+
+void StreamingQLogger::appendRecord(const folly::dynamic& record) {
+  auto json = folly::toJson(record);
+  size_t queuedBytes = sink_ ? sink_->queuedBytes.load() : 0;
+  // the record separator and the newline
+  size_t recordSize = json.size() + 2;
+  if (buffer_.size() + queuedBytes + recordSize > maxBufferedBytes_) {
+    droppedEvents_++;
+    return;
+  }
+  buffer_ += kRecordSeparator;
+  buffer_ += json;
+  buffer_ += '\n';
+  if (buffer_.size() >= kQLogStreamingFlushThreshold) {
+    flush();
+  }
+}
+
+bool StreamingQLogger::openSink() {
+  std::string outputPath =
+      folly::to<std::string>(path_, "/", dcid->hex(), ".qlog");
+  int fd = folly::openNoInt(
+      outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    LOG(ERROR) << "Error: Can't write to provided path: " << path_;
+    return false;
+  }
+  LOG(INFO) << "Streaming QLogger JSON-SEQ to file: " << outputPath;
+  sink_ = std::make_shared<Sink>(folly::File(fd, true));
+
+  folly::dynamic commonFieldsObj = folly::dynamic::object;
+  commonFieldsObj["reference_time"] = "0";
+  commonFieldsObj["dcid"] = dcid->hex();
+  commonFieldsObj["scid"] = scid.hasValue() ? scid->hex() : "";
+  commonFieldsObj["protocol_type"] = protocolType;
+  folly::dynamic traceObj = folly::dynamic::object;
+  traceObj["vantage_point"] =
+      folly::dynamic::object("type", vantagePoint)("name", vantagePoint);
+  traceObj["title"] = kQLogTraceTitle;
+  traceObj["description"] = kQLogTraceDescription;
+  traceObj["configuration"] =
+      folly::dynamic::object("time_offset", 0)("time_units", kQLogTimeUnits);
+  traceObj["common_fields"] = std::move(commonFieldsObj);
+  traceObj["event_fields"] = folly::dynamic::array(
+      "relative_time", "CATEGORY", "EVENT_TYPE", "TRIGGER", "DATA");
+  folly::dynamic header = folly::dynamic::object;
+  header[kQLogVersionField] = kQLogVersion;
+  header[kQLogFormatField] = kQLogStreamingFormat;
+  header[kQLogTitleField] = kQLogTitle;
+  header[kQLogDescriptionField] = kQLogDescription;
+  header["trace"] = std::move(traceObj);
+
+  // The header goes first, even if it does not fit with the events.
+  std::string events = std::move(buffer_);
+  buffer_ = folly::to<std::string>(
+      kRecordSeparator, folly::toJson(header), '\n', events);
+  return true;
+}
+
+void StreamingQLogger::flush() {
+  if (buffer_.empty()) {
+    return;
+  }
+  if (!sink_) {
+    if (!dcid.hasValue()) {
+      // keep buffering until there is a file name
+      return;
+    }
+    if (!openSink()) {
+      // drop the records rather than trying every flush
+      sink_ = std::make_shared<Sink>(folly::File());
+    }
+  }
+  if (!sink_->file) {
+    buffer_.clear();
+    return;
+  }
+  sink_->queuedBytes += buffer_.size();
+  bool scheduleDrain;
+  {
+    std::lock_guard<std::mutex> guard(sink_->mutex);
+    sink_->chunks.push_back(std::move(buffer_));
+    scheduleDrain = !sink_->draining;
+    sink_->draining = true;
+  }
+  buffer_.clear();
+  if (!scheduleDrain) {
+    return;
+  }
+  if (executor_) {
+    executor_->add([sink = sink_] { sink->drain(); });
+  } else {
+    sink_->drain();
+  }
+}
+
+uint64_t StreamingQLogger::droppedEvents() const {
+  return droppedEvents_;
+}
+} // namespace quic
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Executor.h>
+#include <quic/logging/FileQLogger.h>
+
+#include <memory>
+#include <string>
+
+namespace quic {
+
+/**
+ * A qlog that is written out while the connection runs, instead of kept in
+ * memory until outputLogsToFile.
+ *
+ * Every event is serialized as soon as it is logged, as one JSON-SEQ record
+ * (RFC 7464), and the event itself freed. The records are appended to
+ * <path>/<dcid>.qlog once kQLogStreamingFlushThreshold bytes are buffered,
+ * or on flush(), from the executor if there is one, otherwise inline. The
+ * first record is the header of the trace. Records are only written once the
+ * dcid is known.
+ *
+ * At most maxBufferedBytes of records are held, including those the executor
+ * is still writing. Events past that are dropped and counted, so that a slow
+ * disk never grows the memory of the connection.
+ *
+ * logs stays empty, and toDynamic has no events.
+ */
+class StreamingQLogger : public FileQLogger {
+ public:
+  explicit StreamingQLogger(
+      std::string path,
+      folly::Executor* executor = nullptr,
+      size_t maxBufferedBytes = kDefaultQLogStreamingMaxBufferedBytes,
+      std::string protocolTypeIn = kHTTP3ProtocolType,
+      std::string vantagePointIn = kQLogServerVantagePoint);
+
+  // Flushes the records that are left.
+  ~StreamingQLogger() override;
+
+  /**
+   * Hands the buffered records to the executor to write out, or writes them
+   * if there is none.
+   */
+  void flush();
+
+  // Number of events dropped because maxBufferedBytes were buffered.
+  uint64_t droppedEvents() const;
+
+ protected:
+  void handleEvent(std::unique_ptr<QLogEvent> event) override;
+
+ private:
+  // The file, and the records queued for it. Shared with the writes in
+  // flight on the executor.
+  struct Sink;
+
+  void appendRecord(const folly::dynamic& record);
+  bool openSink();
+
+  std::string path_;
+  folly::Executor* executor_;
+  size_t maxBufferedBytes_;
+  // Records that are not handed to the sink yet
+  std::string buffer_;
+  std::shared_ptr<Sink> sink_;
+  uint64_t droppedEvents_{0};
+};
+} // namespace quic
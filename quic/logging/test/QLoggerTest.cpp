@@ -8,11 +8,15 @@
 
 #include <quic/logging/QLogger.h>
 
+#include <folly/FileUtil.h>
+#include <folly/String.h>
+#include <folly/experimental/TestUtil.h>
 #include <folly/json.h>
 #include <gtest/gtest.h>
 #include <quic/common/test/TestUtils.h>
 #include <quic/congestion_control/Bbr.h>
 #include <quic/logging/FileQLogger.h>
+#include <quic/logging/StreamingQLogger.h>
 
 using namespace testing;
 
@@ -261,6 +265,33 @@ TEST_F(QLoggerTest, StreamStateUpdateEvent) {
   EXPECT_EQ(gotEvent->update, kAbort);
 }
 
+TEST_F(QLoggerTest, HandshakeSummaryEvent) {
+  FileQLogger q;
+  q.addHandshakeSummary(300us, 100us, 20us, 1200, 3000);
+
+  std::unique_ptr<QLogEvent> p = std::move(q.logs[0]);
+  auto gotEvent = dynamic_cast<QLogHandshakeSummaryEvent*>(p.get());
+
+  EXPECT_EQ(gotEvent->handshakeTime, 300us);
+  EXPECT_EQ(gotEvent->keysDerivedTime, 100us);
+  EXPECT_EQ(gotEvent->processingTime, 20us);
+  EXPECT_EQ(gotEvent->cryptoBytesSent, 1200);
+  EXPECT_EQ(gotEvent->cryptoBytesRecvd, 3000);
+}
+
+TEST_F(QLoggerTest, WriteBatchEvent) {
+  FileQLogger q;
+  q.addWriteBatch(10, 12000, "MAX_BUFS", true);
+
+  std::unique_ptr<QLogEvent> p = std::move(q.logs[0]);
+  auto gotEvent = dynamic_cast<QLogWriteBatchEvent*>(p.get());
+
+  EXPECT_EQ(gotEvent->numPackets, 10);
+  EXPECT_EQ(gotEvent->numBytes, 12000);
+  EXPECT_EQ(gotEvent->flushReason, "MAX_BUFS");
+  EXPECT_TRUE(gotEvent->wouldBlock);
+}
+
 TEST_F(QLoggerTest, PacketPaddingFrameEvent) {
   FileQLogger q;
   auto packet = createPacketWithPaddingFrames();
@@ -1063,6 +1094,32 @@ TEST_F(QLoggerTest, StreamStateUpdateFollyDynamic) {
   EXPECT_EQ(expected, gotEvents);
 }
 
+TEST_F(QLoggerTest, HandshakeSummaryFollyDynamic) {
+  folly::dynamic expected = folly::parseJson(
+      R"([
+    [
+      "0",
+      "TRANSPORT",
+      "HANDSHAKE_SUMMARY",
+      "DEFAULT",
+      {
+        "handshake_time": 300,
+        "keys_derived_time": 100,
+        "processing_time": 20,
+        "crypto_bytes_sent": 1200,
+        "crypto_bytes_recvd": 3000
+      }
+    ]
+])");
+
+  FileQLogger q;
+  q.addHandshakeSummary(300us, 100us, 20us, 1200, 3000);
+  folly::dynamic gotDynamic = q.toDynamic();
+  gotDynamic["traces"][0]["events"][0][0] = "0"; // hardcode reference time
+  folly::dynamic gotEvents = gotDynamic["traces"][0]["events"];
+  EXPECT_EQ(expected, gotEvents);
+}
+
 TEST_F(QLoggerTest, PaddingFramesFollyDynamic) {
   folly::dynamic expected = folly::parseJson(
       R"([
@@ -1096,4 +1153,48 @@ TEST_F(QLoggerTest, PaddingFramesFollyDynamic) {
   EXPECT_EQ(expected, gotEvents);
 }
 
+TEST_F(QLoggerTest, StreamingQLoggerWritesRecords) {
+  folly::test::TemporaryDirectory dir;
+  auto dcid = getTestConnectionId(1);
+  {
+    StreamingQLogger q(dir.path().string());
+    q.addTransportStateUpdate("before dcid");
+    q.dcid = dcid;
+    q.addPacket(createPacketWithPaddingFrames(), 100);
+    EXPECT_TRUE(q.logs.empty());
+    // the rest is flushed when the logger goes away
+    q.flush();
+    q.addTransportStateUpdate("after flush");
+  }
+
+  std::string contents;
+  ASSERT_TRUE(folly::readFile(
+      folly::to<std::string>(dir.path().string(), "/", dcid.hex(), ".qlog")
+          .c_str(),
+      contents));
+  std::vector<std::string> records;
+  folly::split('\x1e', contents, records);
+  ASSERT_EQ(5, records.size());
+  EXPECT_TRUE(records[0].empty());
+  auto header = folly::parseJson(records[1]);
+  EXPECT_EQ(kQLogStreamingFormat, header[kQLogFormatField].asString());
+  EXPECT_EQ(dcid.hex(), header["trace"]["common_fields"]["dcid"].asString());
+  EXPECT_EQ(
+      "before dcid", folly::parseJson(records[2])[4]["update"].asString());
+  EXPECT_EQ("PACKET_SENT", folly::parseJson(records[3])[2].asString());
+  EXPECT_EQ(
+      "after flush", folly::parseJson(records[4])[4]["update"].asString());
+}
+
+TEST_F(QLoggerTest, StreamingQLoggerDropsPastBound) {
+  folly::test::TemporaryDirectory dir;
+  StreamingQLogger q(dir.path().string(), nullptr, 100);
+  // Without a dcid nothing is written out.
+  for (int i = 0; i < 10; i++) {
+    q.addTransportStateUpdate("update");
+  }
+  EXPECT_GT(q.droppedEvents(), 0);
+  EXPECT_LT(q.droppedEvents(), 10);
+}
+
 } // namespace quic::test
@@ -82,6 +82,11 @@ void markPacketLoss(
             onConnWindowUpdateLost(conn);
           }
         },
+        [&](MaxStreamsFrame& frame) {
+          // As with MaxData, a clone may carry a newer limit, so only the
+          // loss of the latest one matters.
+          conn.streamManager->onStreamLimitUpdateLost(frame);
+        },
         // For other frame types, we only process them if the packet is not a
         // processed clone.
         [&](WriteStreamFrame& frame) {
@@ -92,13 +97,8 @@ void markPacketLoss(
           if (!stream) {
             return;
           }
-          auto bufferItr = std::lower_bound(
-              stream->retransmissionBuffer.begin(),
-              stream->retransmissionBuffer.end(),
-              frame.offset,
-              [](const auto& buffer, const auto& offset) {
-                return buffer.offset < offset;
-              });
+          auto bufferItr =
+              stream->retransmissionBuffer.lower_bound(frame.offset);
           if (bufferItr == stream->retransmissionBuffer.end()) {
             // It's possible that the stream was reset or data on the stream was
             // skipped while we discovered that its packet was lost so we might
@@ -110,16 +110,8 @@ void markPacketLoss(
           if (!ackFrameMatchesRetransmitBuffer(*stream, frame, *bufferItr)) {
             return;
           }
-          stream->lossBuffer.insert(
-              std::upper_bound(
-                  stream->lossBuffer.begin(),
-                  stream->lossBuffer.end(),
-                  bufferItr->offset,
-                  [](const auto& offset, const auto& buffer) {
-                    return offset < buffer.offset;
-                  }),
-              std::move(*bufferItr));
-          stream->retransmissionBuffer.erase(bufferItr);
+          stream->lossBuffer.insertCoalesced(
+              stream->retransmissionBuffer.extract(bufferItr));
           conn.streamManager->updateLossStreams(*stream);
         },
         [&](WriteCryptoFrame& frame) {
@@ -134,29 +126,16 @@ void markPacketLoss(
           auto cryptoStream =
               getCryptoStream(*conn.cryptoState, encryptionLevel);
 
-          auto bufferItr = std::lower_bound(
-              cryptoStream->retransmissionBuffer.begin(),
-              cryptoStream->retransmissionBuffer.end(),
-              frame.offset,
-              [](const auto& buffer, const auto& offset) {
-                return buffer.offset < offset;
-              });
+          auto bufferItr =
+              cryptoStream->retransmissionBuffer.lower_bound(frame.offset);
           if (bufferItr == cryptoStream->retransmissionBuffer.end()) {
             // It's possible that the stream was reset while we discovered that
             // it's packet was lost so we might not have the offset.
             return;
           }
           DCHECK_EQ(bufferItr->offset, frame.offset);
-          cryptoStream->lossBuffer.insert(
-              std::upper_bound(
-                  cryptoStream->lossBuffer.begin(),
-                  cryptoStream->lossBuffer.end(),
-                  bufferItr->offset,
-                  [](const auto& offset, const auto& buffer) {
-                    return offset < buffer.offset;
-                  }),
-              std::move(*bufferItr));
-          cryptoStream->retransmissionBuffer.erase(bufferItr);
+          cryptoStream->lossBuffer.insertCoalesced(
+              cryptoStream->retransmissionBuffer.extract(bufferItr));
         },
         [&](RstStreamFrame& frame) {
           if (processed) {
@@ -14,6 +14,8 @@
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/logging/QLoggerConstants.h>
 #include <quic/logging/QuicLogger.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/QuicStateFunctions.h>
 #include <quic/state/SimpleFrameFunctions.h>
 #include <quic/state/StateData.h>
@@ -79,7 +81,7 @@ calculateAlarmDuration(const QuicConnectionStateBase& conn) {
     alarmMethod = LossState::AlarmMethod::EarlyRetransmitOrReordering;
   } else if (conn.outstandingHandshakePacketsCount > 0) {
     if (conn.lossState.srtt == 0us) {
-      alarmDuration = kDefaultInitialRtt * 2;
+      alarmDuration = conn.transportSettings.initialRtt * 2;
     } else {
       alarmDuration = conn.lossState.srtt * 2;
     }
@@ -212,14 +214,18 @@ folly::Optional<CongestionController::LossEvent> detectLossPackets(
     TimePoint lossTime,
     PacketNumberSpace pnSpace) {
   getLossTime(conn, pnSpace).clear();
+  // The reordering window is an eighth of the RTT by default.
   std::chrono::microseconds delayUntilLost =
-      std::max(conn.lossState.srtt, conn.lossState.lrtt) * 9 / 8;
+      std::max(conn.lossState.srtt, conn.lossState.lrtt) *
+      (8 + conn.lossState.reorderingWindowMult) / 8;
   VLOG(10) << __func__ << " outstanding=" << conn.outstandingPackets.size()
            << " largestAcked=" << largestAcked
            << " delayUntilLost=" << delayUntilLost.count() << "us"
            << " " << conn;
   CongestionController::LossEvent lossEvent(lossTime);
   // Note that time based loss detection is also within the same PNSpace.
+  // Packets are lost oldest first, so only the packets that are lost now and
+  // the one after them are looked at, and never the packets of other spaces.
   auto iter = getFirstOutstandingPacket(conn, pnSpace);
   bool shouldSetTimer = false;
   while (iter != conn.outstandingPackets.end()) {
@@ -230,13 +236,6 @@ folly::Optional<CongestionController::LossEvent> detectLossPackets(
     if (currentPacketNum >= largestAcked) {
       break;
     }
-    auto currentPacketNumberSpace = folly::variant_match(
-        pkt.packet.header,
-        [](const auto& h) { return h.getPacketNumberSpace(); });
-    if (currentPacketNumberSpace != pnSpace) {
-      iter++;
-      continue;
-    }
     bool lost = (lossTime - pkt.time) > delayUntilLost;
     lost = lost ||
         (largestAcked - currentPacketNum) > conn.lossState.reorderingThreshold;
@@ -246,9 +245,26 @@ folly::Optional<CongestionController::LossEvent> detectLossPackets(
       shouldSetTimer = true;
       break;
     }
-    if (!pkt.pureAck) {
+    if (conn.pathMtuState.phase !=
+        QuicConnectionStateBase::PathMtuState::Phase::Disabled) {
+      onPathMtuPacketLost(conn, pkt, lossTime);
+    }
+    // A lost path MTU probe only means that it is too large for the path, it
+    // is not a congestion signal.
+    if (!pkt.pureAck && !pkt.isPathMtuProbe) {
       lossEvent.addLostPacket(pkt);
-    } else {
+      if (conn.transportSettings.adaptiveReordering) {
+        auto& lostPackets = conn.lossState.recentlyLostPackets;
+        if (lostPackets.size() >= kMaxRecentlyLostPackets) {
+          lostPackets.pop_front();
+        }
+        lostPackets.push_back(RecentlyLostPacket{currentPacketNum,
+                                                 pnSpace,
+                                                 lossTime,
+                                                 largestAcked -
+                                                     currentPacketNum});
+      }
+    } else if (pkt.pureAck) {
       DCHECK_GT(conn.outstandingPureAckPacketsCount, 0);
       --conn.outstandingPureAckPacketsCount;
     }
@@ -272,12 +288,14 @@ folly::Optional<CongestionController::LossEvent> detectLossPackets(
     VLOG(10) << __func__ << " lost packetNum=" << currentPacketNum
              << " pureAck=" << pkt.pureAck << " handshake=" << pkt.isHandshake
              << " " << conn;
-    iter = conn.outstandingPackets.erase(iter);
+    iter = getNextOutstandingPacket(
+        conn, pnSpace, conn.outstandingPackets.erase(iter));
   }
 
   auto earliest = getFirstOutstandingPacket(conn, pnSpace);
   for (; earliest != conn.outstandingPackets.end();
-       earliest = getNextOutstandingPacket(conn, pnSpace, earliest + 1)) {
+       earliest =
+           getNextOutstandingPacket(conn, pnSpace, std::next(earliest))) {
     if (!earliest->pureAck &&
         (!earliest->associatedEvent ||
          conn.outstandingPacketEvents.count(*earliest->associatedEvent))) {
@@ -309,6 +327,13 @@ folly::Optional<CongestionController::LossEvent> detectLossPackets(
         lossEvent.lostPackets);
 
     conn.lossState.rtxCount += lossEvent.lostPackets;
+    if (conn.transportSettings.adaptiveReordering &&
+        ++conn.lossState.lossEventsSinceWindowWidened >=
+            kReorderingWindowResetLossEvents) {
+      conn.lossState.reorderingWindowMult = 1;
+      conn.lossState.reorderingThreshold = kReorderingThreshold;
+      conn.lossState.lossEventsSinceWindowWidened = 0;
+    }
     if (conn.congestionController) {
       return lossEvent;
     }
@@ -405,6 +430,8 @@ void onLossDetectionAlarm(
           conn,
           *lossEvent->smallestLostSentTime,
           *lossEvent->largestLostSentTime);
+      ScopedAllocationAccounting congestionControlAccounting(
+          conn, ConnectionAllocationUsage::Subsystem::CongestionControl);
       conn.congestionController->onPacketAckOrLoss(
           folly::none, std::move(lossEvent));
     }
@@ -448,6 +475,7 @@ folly::Optional<CongestionController::LossEvent> handleAckForLoss(
     conn.lossState.ptoCount = 0;
     conn.lossState.handshakeAlarmCount = 0;
     largestAcked = std::max(largestAcked, *ack.largestAckedPacket);
+    getAckState(conn, pnSpace).ackedByPeer = true;
   }
   auto lossEvent = detectLossPackets(
       conn,
@@ -507,8 +535,8 @@ void markZeroRttPacketsLost(
       iter = conn.outstandingPackets.erase(iter);
       iter = getNextOutstandingPacket(conn, PacketNumberSpace::AppData, iter);
     } else {
-      iter =
-          getNextOutstandingPacket(conn, PacketNumberSpace::AppData, iter + 1);
+      iter = getNextOutstandingPacket(
+          conn, PacketNumberSpace::AppData, std::next(iter));
     }
   }
   conn.lossState.rtxCount += lossEvent.lostPackets;
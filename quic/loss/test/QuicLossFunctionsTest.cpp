@@ -390,6 +390,48 @@ TEST_F(QuicLossFunctionsTest, TestMarkPacketLoss) {
   EXPECT_TRUE(eq(buf, buffer.data.move()));
 }
 
+TEST_F(QuicLossFunctionsTest, TestMarkPacketLossCoalescesStreamData) {
+  folly::EventBase evb;
+  MockAsyncUDPSocket socket(&evb);
+  auto conn = createConn();
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  auto stream = conn->streamManager->createNextBidirectionalStream().value();
+  auto buf = buildRandomInputData(20);
+  folly::IOBufQueue queue{folly::IOBufQueue::cacheChainLength()};
+  queue.append(buf->clone());
+  for (bool eof : {false, true}) {
+    writeDataToQuicStream(*stream, queue.split(10), eof);
+    writeQuicDataToSocket(
+        socket,
+        *conn,
+        *conn->clientConnectionId,
+        *conn->serverConnectionId,
+        *aead,
+        *headerCipher,
+        *conn->version,
+        conn->transportSettings.writeConnectionDataPacketsLimit);
+  }
+  ASSERT_EQ(2, conn->outstandingPackets.size());
+  EXPECT_EQ(2, stream->retransmissionBuffer.size());
+
+  // Lost out of order, the second half is merged into the first.
+  for (auto packetIt = conn->outstandingPackets.rbegin();
+       packetIt != conn->outstandingPackets.rend();
+       ++packetIt) {
+    auto packetNum = folly::variant_match(
+        packetIt->packet.header,
+        [](const auto& h) { return h.getPacketSequenceNum(); });
+    markPacketLoss(*conn, packetIt->packet, false, packetNum);
+  }
+  EXPECT_EQ(stream->retransmissionBuffer.size(), 0);
+  ASSERT_EQ(stream->lossBuffer.size(), 1);
+  auto& buffer = stream->lossBuffer.front();
+  EXPECT_EQ(buffer.offset, 0);
+  EXPECT_TRUE(buffer.eof);
+  IOBufEqualTo eq;
+  EXPECT_TRUE(eq(buf, buffer.data.move()));
+}
+
 TEST_F(QuicLossFunctionsTest, TestMarkCryptoLostAfterCancelRetransmission) {
   folly::EventBase evb;
   MockAsyncUDPSocket socket(&evb);
@@ -482,10 +524,10 @@ TEST_F(QuicLossFunctionsTest, TestReorderingThreshold) {
   EXPECT_EQ(6, conn->outstandingHandshakePacketsCount);
   EXPECT_EQ(3, conn->outstandingPureAckPacketsCount);
   // Assume some packets are already acked
-  for (auto iter =
-           getFirstOutstandingPacket(*conn, PacketNumberSpace::Handshake) + 2;
-       iter <
-       getFirstOutstandingPacket(*conn, PacketNumberSpace::Handshake) + 5;
+  auto firstHandshakeOpIter =
+      getFirstOutstandingPacket(*conn, PacketNumberSpace::Handshake);
+  for (auto iter = std::next(firstHandshakeOpIter, 2);
+       iter != std::next(firstHandshakeOpIter, 5);
        iter++) {
     if (iter->isHandshake) {
       conn->outstandingHandshakePacketsCount--;
@@ -494,10 +536,8 @@ TEST_F(QuicLossFunctionsTest, TestReorderingThreshold) {
       conn->outstandingPureAckPacketsCount--;
     }
   }
-  auto firstHandshakeOpIter =
-      getFirstOutstandingPacket(*conn, PacketNumberSpace::Handshake);
   conn->outstandingPackets.erase(
-      firstHandshakeOpIter + 2, firstHandshakeOpIter + 5);
+      std::next(firstHandshakeOpIter, 2), std::next(firstHandshakeOpIter, 5));
   // Ack for packet 9 arrives
   auto lossEvent = detectLossPackets<decltype(testingLossMarkFunc)>(
       *conn,
@@ -761,9 +801,10 @@ TEST_F(QuicLossFunctionsTest, TestTimeReordering) {
   // Some packets are already acked
   conn->lossState.srtt = 400ms;
   conn->lossState.lrtt = 350ms;
+  auto firstAppDataOpIter =
+      getFirstOutstandingPacket(*conn, PacketNumberSpace::AppData);
   conn->outstandingPackets.erase(
-      getFirstOutstandingPacket(*conn, PacketNumberSpace::AppData) + 2,
-      getFirstOutstandingPacket(*conn, PacketNumberSpace::AppData) + 5);
+      std::next(firstAppDataOpIter, 2), std::next(firstAppDataOpIter, 5));
   auto lossEvent = detectLossPackets<decltype(testingLossMarkFunc(lostPacket))>(
       *conn,
       largestSent,
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/CongestionStateCache.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace quic {
+
+folly::IPAddress congestionStateSubnet(const folly::IPAddress& peer) {
+  if (peer.isIPv4Mapped()) {
+    return peer.createIPv4().mask(kCongestionStateIPv4PrefixLen);
+  }
+  return peer.mask(
+      peer.isV4() ? kCongestionStateIPv4PrefixLen
+                  : kCongestionStateIPv6PrefixLen);
+}
+
+void applyCongestionState(
+    const CachedCongestionState& state,
+    TransportSettings& transportSettings) {
+  uint64_t bdpInMss = 0;
+  if (state.srtt.count() > 0) {
+    bdpInMss = state.cwndBytes * state.mrtt.count() / state.srtt.count() /
+        kDefaultUDPSendPacketLen;
+  }
+  auto maxInitCwndInMss =
+      std::min(kMaxWarmStartCwndInMss, transportSettings.maxCwndInMss);
+  transportSettings.initCwndInMss = std::max(
+      transportSettings.initCwndInMss, std::min(bdpInMss, maxInitCwndInMss));
+  if (state.srtt.count() > 0) {
+    transportSettings.initialRtt = state.srtt;
+  }
+}
+
+CongestionStateCache::CongestionStateCache(
+    size_t numSlots,
+    std::chrono::seconds maxAge)
+    : numSlots_(numSlots),
+      maxAge_(maxAge),
+      slots_(std::make_unique<Slot[]>(numSlots)) {
+  CHECK_GT(numSlots_, 0);
+}
+
+std::shared_ptr<const CachedCongestionState> CongestionStateCache::get(
+    const folly::IPAddress& peer,
+    TimePoint now) const {
+  auto subnet = congestionStateSubnet(peer);
+  auto entry = slotOf(subnet).load(std::memory_order_acquire);
+  if (entry && entry->subnet == subnet && now - entry->updateTime <= maxAge_) {
+    return entry;
+  }
+  return nullptr;
+}
+
+void CongestionStateCache::update(
+    const folly::IPAddress& peer,
+    std::chrono::microseconds srtt,
+    std::chrono::microseconds mrtt,
+    uint64_t cwndBytes,
+    TimePoint now) {
+  auto subnet = congestionStateSubnet(peer);
+  auto& slot = slotOf(subnet);
+  slot.store(
+      std::make_shared<const CachedCongestionState>(
+          CachedCongestionState{subnet, srtt, mrtt, cwndBytes, now}),
+      std::memory_order_release);
+}
+
+CongestionStateCache::Slot& CongestionStateCache::slotOf(
+    const folly::IPAddress& subnet) const {
+  return slots_[std::hash<folly::IPAddress>()(subnet) % numSlots_];
+}
+
+} // namespace quic
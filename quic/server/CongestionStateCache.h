@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+#include <quic/state/TransportSettings.h>
+
+#include <folly/IPAddress.h>
+#include <folly/concurrency/AtomicSharedPtr.h>
+
+#include <chrono>
+#include <memory>
+
+namespace quic {
+
+/**
+ * The congestion state a connection from a subnet ended with.
+ */
+struct CachedCongestionState {
+  folly::IPAddress subnet;
+  std::chrono::microseconds srtt;
+  std::chrono::microseconds mrtt;
+  uint64_t cwndBytes;
+  TimePoint updateTime;
+};
+
+/**
+ * Returns the subnet that the congestion state of a peer is shared within.
+ */
+folly::IPAddress congestionStateSubnet(const folly::IPAddress& peer);
+
+/**
+ * Warm starts the connection that the settings are for from the cached
+ * state. The initial cwnd becomes the bandwidth the state was recorded at
+ * times its min RTT, which is never below the configured initial cwnd nor
+ * above kMaxWarmStartCwndInMss, and the handshake alarm assumes its srtt.
+ */
+void applyCongestionState(
+    const CachedCongestionState& state,
+    TransportSettings& transportSettings);
+
+/**
+ * A cache of the congestion state of recent connections, meant to be shared
+ * by all the workers of a server, so that new connections from the same
+ * subnet do not spend their whole life in slow start.
+ *
+ * Like AppTokenCache, it has a fixed number of slots, and a subnet can only
+ * be in the slot its hash picks. Each slot is its own atomic shared pointer,
+ * so lookups and updates never take a lock. States older than the max age
+ * are not returned.
+ */
+class CongestionStateCache {
+ public:
+  explicit CongestionStateCache(
+      size_t numSlots = kDefaultCongestionStateCacheSize,
+      std::chrono::seconds maxAge = kDefaultCongestionStateMaxAge);
+
+  /**
+   * Returns the state recorded for the subnet of the peer if it is in the
+   * cache and recent enough, or nullptr.
+   */
+  std::shared_ptr<const CachedCongestionState> get(
+      const folly::IPAddress& peer,
+      TimePoint now = Clock::now()) const;
+
+  /**
+   * Records the state that a connection from the peer ended with, taking over
+   * the slot from whichever subnet was there.
+   */
+  void update(
+      const folly::IPAddress& peer,
+      std::chrono::microseconds srtt,
+      std::chrono::microseconds mrtt,
+      uint64_t cwndBytes,
+      TimePoint now = Clock::now());
+
+  size_t numSlots() const {
+    return numSlots_;
+  }
+
+ private:
+  using Slot = folly::atomic_shared_ptr<const CachedCongestionState>;
+
+  Slot& slotOf(const folly::IPAddress& subnet) const;
+
+  size_t numSlots_;
+  std::chrono::seconds maxAge_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+} // namespace quic
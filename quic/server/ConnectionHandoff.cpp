@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/ConnectionHandoff.h>
+
+#include <quic/server/handshake/AppToken.h>
+#include <quic/state/QuicPacingFunctions.h>
+
+#include <fizz/record/Types.h>
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+namespace quic {
+
+namespace {
+// Bumped whenever the encoding changes, so that processes running different
+// versions reject each other's connections rather than misread them.
+constexpr uint8_t kConnectionHandoffStateVersion = 2;
+
+void writeBytes(const uint8_t* data, size_t len, folly::io::Appender& out) {
+  fizz::detail::writeBuf<uint8_t>(folly::IOBuf::wrapBuffer(data, len), out);
+}
+
+std::vector<uint8_t> readBytes(folly::io::Cursor& cursor) {
+  Buf buf;
+  fizz::detail::readBuf<uint8_t>(buf, cursor);
+  auto range = buf->coalesce();
+  return std::vector<uint8_t>(range.begin(), range.end());
+}
+
+void writeAddress(
+    const folly::SocketAddress& address,
+    folly::io::Appender& out) {
+  fizz::detail::write(address.getIPAddress(), out);
+  fizz::detail::write<uint16_t>(address.getPort(), out);
+}
+
+folly::SocketAddress readAddress(folly::io::Cursor& cursor) {
+  folly::IPAddress ip;
+  uint16_t port;
+  fizz::detail::read(ip, cursor);
+  fizz::detail::read(port, cursor);
+  return folly::SocketAddress(ip, port);
+}
+
+bool isAtRest(const QuicServerConnectionState& conn) {
+  const auto& crypto = *conn.cryptoState;
+  return conn.state == ServerState::Open && conn.outstandingPackets.empty() &&
+      conn.streamManager->streamCount() == 0 &&
+      conn.pendingEvents.frames.empty() && conn.pendingEvents.resets.empty() &&
+      !conn.pendingEvents.connWindowUpdate &&
+      !conn.streamManager->hasStreamLimitUpdates() &&
+      !conn.outstandingPathValidation && !conn.writableBytesLimit &&
+      crypto.oneRttStream.writeBuffer.empty() &&
+      crypto.oneRttStream.lossBuffer.empty();
+}
+} // namespace
+
+folly::Optional<ConnectionHandoffState> getConnectionHandoffState(
+    const QuicServerConnectionState& conn) {
+  auto handshake = conn.serverHandshakeLayer;
+  if (!handshake || !handshake->isHandshakeDone() || !conn.version ||
+      !conn.clientConnectionId || !conn.serverConnectionId ||
+      !conn.oneRttWriteCipher || !conn.readCodec ||
+      !conn.congestionController) {
+    return folly::none;
+  }
+  auto secrets = handshake->getOneRttSecrets();
+  if (!secrets || !isAtRest(conn)) {
+    return folly::none;
+  }
+  // The secrets are those of key phase zero, the keys of later phases would
+  // have to be derived again on the other side.
+  if (conn.keyUpdateState.numKeyUpdates > 0 ||
+      conn.readCodec->getKeyPhase() != ProtectionType::KeyPhaseZero) {
+    return folly::none;
+  }
+  // Extensions negotiated by the handshake are not carried over.
+  if (conn.partialReliabilityEnabled || conn.peerMinAckDelay ||
+      conn.datagramState.maxWriteFrameSize > 0) {
+    return folly::none;
+  }
+  ConnectionHandoffState state;
+  state.version = *conn.version;
+  state.clientConnectionId = *conn.clientConnectionId;
+  state.serverConnectionId = *conn.serverConnectionId;
+  state.originalPeerAddress = conn.originalPeerAddress;
+  state.peerAddress = conn.peerAddress;
+  state.secrets = std::move(*secrets);
+  state.applicationProtocol = handshake->getApplicationProtocol();
+
+  const auto& ackState = conn.ackStates.appDataAckState;
+  state.nextPacketNum = ackState.nextPacketNum;
+  state.largestAckedByPeer = ackState.largestAckedByPeer;
+  state.ackedByPeer = ackState.ackedByPeer;
+  state.largestReceivedPacketNum = ackState.largestReceivedPacketNum;
+
+  const auto& flowControl = conn.flowControlState;
+  state.advertisedMaxOffset = flowControl.advertisedMaxOffset;
+  state.peerAdvertisedMaxOffset = flowControl.peerAdvertisedMaxOffset;
+  state.sumCurReadOffset = flowControl.sumCurReadOffset;
+  state.sumMaxObservedOffset = flowControl.sumMaxObservedOffset;
+  state.sumCurWriteOffset = flowControl.sumCurWriteOffset;
+  state.peerAdvertisedInitialMaxStreamOffsetBidiLocal =
+      flowControl.peerAdvertisedInitialMaxStreamOffsetBidiLocal;
+  state.peerAdvertisedInitialMaxStreamOffsetBidiRemote =
+      flowControl.peerAdvertisedInitialMaxStreamOffsetBidiRemote;
+  state.peerAdvertisedInitialMaxStreamOffsetUni =
+      flowControl.peerAdvertisedInitialMaxStreamOffsetUni;
+
+  state.streamIds = conn.streamManager->getStreamIdState();
+
+  state.peerAckDelayExponent = conn.peerAckDelayExponent;
+  state.peerIdleTimeout = conn.peerIdleTimeout;
+  state.udpSendPacketLen = conn.udpSendPacketLen;
+
+  state.cwndBytes = conn.congestionController->getCongestionWindow();
+  state.srtt = conn.lossState.srtt;
+  state.rttvar = conn.lossState.rttvar;
+  state.mrtt = conn.lossState.mrtt;
+  return state;
+}
+
+void restoreConnectionHandoffState(
+    QuicServerConnectionState& conn,
+    const ConnectionHandoffState& state) {
+  CHECK(!conn.readCodec);
+  CHECK(conn.congestionControllerFactory);
+  conn.version = state.version;
+  conn.clientConnectionId = state.clientConnectionId;
+  conn.serverConnectionId = state.serverConnectionId;
+  conn.originalPeerAddress = state.originalPeerAddress;
+  conn.peerAddress = state.peerAddress;
+  if (conn.qLogger) {
+    conn.qLogger->scid = conn.serverConnectionId;
+    conn.qLogger->dcid = conn.clientConnectionId;
+  }
+
+  conn.peerAckDelayExponent = state.peerAckDelayExponent;
+  conn.peerIdleTimeout = state.peerIdleTimeout;
+  conn.udpSendPacketLen = state.udpSendPacketLen;
+
+  auto handshake = conn.serverHandshakeLayer;
+  handshake->restoreOneRttSecrets(state.secrets, state.applicationProtocol);
+  conn.readCodec = std::make_unique<QuicReadCodec>(QuicNodeType::Server);
+  conn.readCodec->setClientConnectionId(state.clientConnectionId);
+  conn.readCodec->setServerConnectionId(state.serverConnectionId);
+  conn.readCodec->setCodecParameters(
+      CodecParameters(conn.peerAckDelayExponent, state.version));
+  conn.readCodec->setOneRttReadCipher(handshake->getOneRttReadCipher());
+  conn.readCodec->setOneRttHeaderCipher(
+      handshake->getOneRttReadHeaderCipher());
+  conn.oneRttWriteCipher = handshake->getOneRttWriteCipher();
+  conn.oneRttWriteHeaderCipher = handshake->getOneRttWriteHeaderCipher();
+  conn.readCodec->onHandshakeDone(Clock::now());
+  // The handshake was reported by the process that ran it.
+  conn.handshakeDoneReported = true;
+  updatePacingOnKeyEstablished(conn);
+
+  auto& ackState = conn.ackStates.appDataAckState;
+  ackState.nextPacketNum = state.nextPacketNum;
+  ackState.largestAckedByPeer = state.largestAckedByPeer;
+  ackState.ackedByPeer = state.ackedByPeer;
+  ackState.largestReceivedPacketNum = state.largestReceivedPacketNum;
+
+  auto& flowControl = conn.flowControlState;
+  flowControl.advertisedMaxOffset = state.advertisedMaxOffset;
+  flowControl.peerAdvertisedMaxOffset = state.peerAdvertisedMaxOffset;
+  flowControl.sumCurReadOffset = state.sumCurReadOffset;
+  flowControl.sumMaxObservedOffset = state.sumMaxObservedOffset;
+  flowControl.sumCurWriteOffset = state.sumCurWriteOffset;
+  flowControl.peerAdvertisedInitialMaxStreamOffsetBidiLocal =
+      state.peerAdvertisedInitialMaxStreamOffsetBidiLocal;
+  flowControl.peerAdvertisedInitialMaxStreamOffsetBidiRemote =
+      state.peerAdvertisedInitialMaxStreamOffsetBidiRemote;
+  flowControl.peerAdvertisedInitialMaxStreamOffsetUni =
+      state.peerAdvertisedInitialMaxStreamOffsetUni;
+
+  conn.streamManager->restoreStreamIdState(state.streamIds);
+
+  conn.lossState.srtt = state.srtt;
+  conn.lossState.rttvar = state.rttvar;
+  conn.lossState.mrtt = state.mrtt;
+  // Nothing is in flight, so the controller can be replaced by one that
+  // starts from the cwnd the connection had.
+  conn.transportSettings.initCwndInMss = std::max(
+      kMinCwndInMss,
+      std::min(
+          state.cwndBytes / conn.udpSendPacketLen,
+          conn.transportSettings.maxCwndInMss));
+  conn.congestionController =
+      conn.congestionControllerFactory->makeCongestionController(
+          conn, conn.transportSettings.defaultCongestionController);
+}
+
+Buf encodeConnectionHandoffState(const ConnectionHandoffState& state) {
+  auto buf = folly::IOBuf::create(kDefaultUDPSendPacketLen);
+  folly::io::Appender appender(buf.get(), kDefaultUDPSendPacketLen);
+  fizz::detail::write(kConnectionHandoffStateVersion, appender);
+  fizz::detail::write(static_cast<uint32_t>(state.version), appender);
+  writeBytes(
+      state.clientConnectionId.data(),
+      state.clientConnectionId.size(),
+      appender);
+  writeBytes(
+      state.serverConnectionId.data(),
+      state.serverConnectionId.size(),
+      appender);
+  writeAddress(state.originalPeerAddress, appender);
+  writeAddress(state.peerAddress, appender);
+
+  fizz::detail::write(static_cast<uint16_t>(state.secrets.cipher), appender);
+  writeBytes(
+      state.secrets.readSecret.data(),
+      state.secrets.readSecret.size(),
+      appender);
+  writeBytes(
+      state.secrets.writeSecret.data(),
+      state.secrets.writeSecret.size(),
+      appender);
+  auto alpn = state.applicationProtocol.value_or("");
+  writeBytes(
+      reinterpret_cast<const uint8_t*>(alpn.data()), alpn.size(), appender);
+
+  fizz::detail::write<uint64_t>(state.nextPacketNum, appender);
+  fizz::detail::write<uint64_t>(state.largestAckedByPeer, appender);
+  fizz::detail::write<uint8_t>(state.ackedByPeer, appender);
+  fizz::detail::write<uint8_t>(
+      state.largestReceivedPacketNum.hasValue(), appender);
+  fizz::detail::write<uint64_t>(
+      state.largestReceivedPacketNum.value_or(0), appender);
+
+  for (auto value :
+       {state.advertisedMaxOffset,
+        state.peerAdvertisedMaxOffset,
+        state.sumCurReadOffset,
+        state.sumMaxObservedOffset,
+        state.sumCurWriteOffset,
+        state.peerAdvertisedInitialMaxStreamOffsetBidiLocal,
+        state.peerAdvertisedInitialMaxStreamOffsetBidiRemote,
+        state.peerAdvertisedInitialMaxStreamOffsetUni}) {
+    fizz::detail::write<uint64_t>(value, appender);
+  }
+
+  const auto& ids = state.streamIds;
+  for (auto id :
+       {ids.nextAcceptablePeerBidirectionalStreamId,
+        ids.nextAcceptablePeerUnidirectionalStreamId,
+        ids.nextAcceptableLocalBidirectionalStreamId,
+        ids.nextAcceptableLocalUnidirectionalStreamId,
+        ids.nextBidirectionalStreamId,
+        ids.nextUnidirectionalStreamId,
+        ids.maxLocalBidirectionalStreamId,
+        ids.maxLocalUnidirectionalStreamId,
+        ids.maxRemoteBidirectionalStreamId,
+        ids.maxRemoteUnidirectionalStreamId}) {
+    fizz::detail::write<uint64_t>(id, appender);
+  }
+
+  fizz::detail::write<uint64_t>(state.peerAckDelayExponent, appender);
+  fizz::detail::write<uint64_t>(state.peerIdleTimeout.count(), appender);
+  fizz::detail::write<uint64_t>(state.udpSendPacketLen, appender);
+
+  fizz::detail::write<uint64_t>(state.cwndBytes, appender);
+  fizz::detail::write<uint64_t>(state.srtt.count(), appender);
+  fizz::detail::write<uint64_t>(state.rttvar.count(), appender);
+  fizz::detail::write<uint64_t>(state.mrtt.count(), appender);
+  return buf;
+}
+
+folly::Optional<ConnectionHandoffState> decodeConnectionHandoffState(
+    const folly::IOBuf& buf) {
+  ConnectionHandoffState state;
+  folly::io::Cursor cursor(&buf);
+  try {
+    uint8_t encodingVersion;
+    fizz::detail::read(encodingVersion, cursor);
+    if (encodingVersion != kConnectionHandoffStateVersion) {
+      return folly::none;
+    }
+    uint32_t version;
+    fizz::detail::read(version, cursor);
+    state.version = static_cast<QuicVersion>(version);
+    state.clientConnectionId = ConnectionId(readBytes(cursor));
+    state.serverConnectionId = ConnectionId(readBytes(cursor));
+    state.originalPeerAddress = readAddress(cursor);
+    state.peerAddress = readAddress(cursor);
+
+    uint16_t cipher;
+    fizz::detail::read(cipher, cursor);
+    state.secrets.cipher = static_cast<fizz::CipherSuite>(cipher);
+    state.secrets.readSecret = readBytes(cursor);
+    state.secrets.writeSecret = readBytes(cursor);
+    auto alpn = readBytes(cursor);
+    if (!alpn.empty()) {
+      state.applicationProtocol = std::string(alpn.begin(), alpn.end());
+    }
+
+    uint64_t value;
+    auto readValue = [&]() {
+      fizz::detail::read(value, cursor);
+      return value;
+    };
+    state.nextPacketNum = readValue();
+    state.largestAckedByPeer = readValue();
+    uint8_t ackedByPeer;
+    fizz::detail::read(ackedByPeer, cursor);
+    state.ackedByPeer = ackedByPeer;
+    uint8_t hasLargestReceived;
+    fizz::detail::read(hasLargestReceived, cursor);
+    readValue();
+    if (hasLargestReceived) {
+      state.largestReceivedPacketNum = value;
+    }
+
+    for (auto field :
+         {&state.advertisedMaxOffset,
+          &state.peerAdvertisedMaxOffset,
+          &state.sumCurReadOffset,
+          &state.sumMaxObservedOffset,
+          &state.sumCurWriteOffset,
+          &state.peerAdvertisedInitialMaxStreamOffsetBidiLocal,
+          &state.peerAdvertisedInitialMaxStreamOffsetBidiRemote,
+          &state.peerAdvertisedInitialMaxStreamOffsetUni}) {
+      *field = readValue();
+    }
+
+    auto& ids = state.streamIds;
+    for (auto id :
+         {&ids.nextAcceptablePeerBidirectionalStreamId,
+          &ids.nextAcceptablePeerUnidirectionalStreamId,
+          &ids.nextAcceptableLocalBidirectionalStreamId,
+          &ids.nextAcceptableLocalUnidirectionalStreamId,
+          &ids.nextBidirectionalStreamId,
+          &ids.nextUnidirectionalStreamId,
+          &ids.maxLocalBidirectionalStreamId,
+          &ids.maxLocalUnidirectionalStreamId,
+          &ids.maxRemoteBidirectionalStreamId,
+          &ids.maxRemoteUnidirectionalStreamId}) {
+      *id = readValue();
+    }
+
+    state.peerAckDelayExponent = readValue();
+    state.peerIdleTimeout = std::chrono::milliseconds(readValue());
+    state.udpSendPacketLen = readValue();
+
+    state.cwndBytes = readValue();
+    state.srtt = std::chrono::microseconds(readValue());
+    state.rttvar = std::chrono::microseconds(readValue());
+    state.mrtt = std::chrono::microseconds(readValue());
+  } catch (const std::exception&) {
+    return folly::none;
+  }
+  // The ack delay exponent is a byte in the codec and must not be zero.
+  if (state.peerAckDelayExponent == 0 ||
+      state.peerAckDelayExponent > kMaxAckDelayExponent ||
+      state.udpSendPacketLen == 0) {
+    return folly::none;
+  }
+  return state;
+}
+
+} // namespace quic
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+#include <quic/codec/QuicConnectionId.h>
+#include <quic/server/handshake/ServerHandshake.h>
+#include <quic/server/state/ServerStateMachine.h>
+
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+
+#include <chrono>
+#include <string>
+
+namespace quic {
+
+/**
+ * The state of an established connection that another process needs to
+ * carry it on, so that a restarting server can hand its connections off to
+ * the process that takes over its sockets instead of forwarding their packets
+ * until they drain.
+ *
+ * Only connections at rest are handed off: the handshake is done, nothing is
+ * in flight and no stream is open, so that what is left is the keys, the
+ * packet numbers, the flow control offsets, the stream ids and the
+ * congestion state. The other connections stay and are forwarded to as
+ * before.
+ */
+struct ConnectionHandoffState {
+  QuicVersion version;
+  ConnectionId clientConnectionId;
+  ConnectionId serverConnectionId;
+  folly::SocketAddress originalPeerAddress;
+  folly::SocketAddress peerAddress;
+
+  ServerHandshake::OneRttSecrets secrets;
+  folly::Optional<std::string> applicationProtocol;
+
+  // The AppData packet number space.
+  PacketNum nextPacketNum{0};
+  PacketNum largestAckedByPeer{0};
+  bool ackedByPeer{false};
+  folly::Optional<PacketNum> largestReceivedPacketNum;
+
+  // The connection flow control.
+  uint64_t advertisedMaxOffset{0};
+  uint64_t peerAdvertisedMaxOffset{0};
+  uint64_t sumCurReadOffset{0};
+  uint64_t sumMaxObservedOffset{0};
+  uint64_t sumCurWriteOffset{0};
+  uint64_t peerAdvertisedInitialMaxStreamOffsetBidiLocal{0};
+  uint64_t peerAdvertisedInitialMaxStreamOffsetBidiRemote{0};
+  uint64_t peerAdvertisedInitialMaxStreamOffsetUni{0};
+
+  QuicStreamManager::StreamIdState streamIds;
+
+  // The transport parameters of the peer.
+  uint64_t peerAckDelayExponent{kDefaultAckDelayExponent};
+  std::chrono::milliseconds peerIdleTimeout{kMaxIdleTimeout};
+  uint64_t udpSendPacketLen{kDefaultUDPSendPacketLen};
+
+  // The congestion state.
+  uint64_t cwndBytes{0};
+  std::chrono::microseconds srtt{0};
+  std::chrono::microseconds rttvar{0};
+  std::chrono::microseconds mrtt{0};
+};
+
+/**
+ * Returns the state to hand the connection off with, or none if the
+ * connection is not at rest.
+ */
+folly::Optional<ConnectionHandoffState> getConnectionHandoffState(
+    const QuicServerConnectionState& conn);
+
+/**
+ * Sets up a connection that has not read any packet from the handed off
+ * state. The transport settings of the connection must already be set, as
+ * the congestion controller is made from them.
+ */
+void restoreConnectionHandoffState(
+    QuicServerConnectionState& conn,
+    const ConnectionHandoffState& state);
+
+Buf encodeConnectionHandoffState(const ConnectionHandoffState& state);
+
+folly::Optional<ConnectionHandoffState> decodeConnectionHandoffState(
+    const folly::IOBuf& buf);
+
+} // namespace quic
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/ConnectionIdPool.h>
+
+namespace quic {
+
+ConnectionIdPool::ConnectionIdPool(folly::EventBase* evb, size_t capacity)
+    : evb_(evb), capacity_(capacity) {}
+
+ConnectionIdPool::~ConnectionIdPool() {
+  cancelLoopCallback();
+}
+
+folly::Optional<IssuedConnectionId> ConnectionIdPool::take(
+    ConnectionIdAlgo& connIdAlgo,
+    const ServerConnectionIdParams& params,
+    const StatelessResetSecret& secret,
+    const folly::SocketAddress& serverAddr) {
+  if (!matches(connIdAlgo, params, secret, serverAddr)) {
+    ids_.clear();
+    connIdAlgo_ = &connIdAlgo;
+    params_ = params;
+    secret_ = secret;
+    serverAddr_ = serverAddr;
+    generator_.emplace(secret_, serverAddr_.getFullyQualified());
+    scheduleFill();
+    return folly::none;
+  }
+  if (ids_.empty()) {
+    scheduleFill();
+    return folly::none;
+  }
+  auto issued = std::move(ids_.front());
+  ids_.pop_front();
+  scheduleFill();
+  return issued;
+}
+
+void ConnectionIdPool::fill() {
+  if (!connIdAlgo_ || !params_ || !generator_) {
+    return;
+  }
+  while (ids_.size() < capacity_) {
+    auto connId = connIdAlgo_->encodeConnectionId(*params_);
+    auto token = generator_->generateToken(connId);
+    ids_.push_back(IssuedConnectionId{std::move(connId), token});
+  }
+}
+
+void ConnectionIdPool::clear() {
+  cancelLoopCallback();
+  ids_.clear();
+  connIdAlgo_ = nullptr;
+  params_.clear();
+  generator_.clear();
+}
+
+void ConnectionIdPool::runLoopCallback() noexcept {
+  fill();
+}
+
+bool ConnectionIdPool::matches(
+    const ConnectionIdAlgo& connIdAlgo,
+    const ServerConnectionIdParams& params,
+    const StatelessResetSecret& secret,
+    const folly::SocketAddress& serverAddr) const {
+  return connIdAlgo_ == &connIdAlgo && params_ &&
+      params_->version == params.version && params_->hostId == params.hostId &&
+      params_->processId == params.processId &&
+      params_->workerId == params.workerId && secret_ == secret &&
+      serverAddr_ == serverAddr;
+}
+
+void ConnectionIdPool::scheduleFill() {
+  if (ids_.size() < capacity_ && !isLoopCallbackScheduled()) {
+    evb_->runInLoop(this);
+  }
+}
+
+} // namespace quic
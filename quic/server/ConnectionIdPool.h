@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/SocketAddress.h>
+#include <folly/io/async/EventBase.h>
+#include <quic/codec/ConnectionIdAlgo.h>
+#include <quic/server/handshake/StatelessResetGenerator.h>
+
+#include <deque>
+
+namespace quic {
+
+/**
+ * A server chosen connection id and its stateless reset token.
+ */
+struct IssuedConnectionId {
+  ConnectionId connId;
+  StatelessResetToken token;
+};
+
+/**
+ * Connection ids of a server worker that are encoded, and whose stateless
+ * reset tokens are computed, ahead of the connections that use them. The
+ * pool is refilled at the end of the event loop iteration it was taken from,
+ * once the packets of the iteration are processed, so that a handshake does
+ * not wait for the random bytes of the id and the HKDF of its token.
+ *
+ * The ids are only valid for the ConnectionIdAlgo, params, secret and
+ * address they were made with. A take with any other drops the pool and
+ * makes the next ones with those.
+ */
+class ConnectionIdPool : private folly::EventBase::LoopCallback {
+ public:
+  ConnectionIdPool(folly::EventBase* evb, size_t capacity);
+
+  ~ConnectionIdPool() override;
+
+  ConnectionIdPool(const ConnectionIdPool&) = delete;
+  ConnectionIdPool& operator=(const ConnectionIdPool&) = delete;
+
+  /**
+   * Returns a connection id made with these, or none if the pool does not
+   * have one, in which case the caller makes its own.
+   */
+  folly::Optional<IssuedConnectionId> take(
+      ConnectionIdAlgo& connIdAlgo,
+      const ServerConnectionIdParams& params,
+      const StatelessResetSecret& secret,
+      const folly::SocketAddress& serverAddr);
+
+  /**
+   * Fills the pool up to its capacity.
+   */
+  void fill();
+
+  /**
+   * Drops the connection ids, and what they were made with.
+   */
+  void clear();
+
+  size_t size() const {
+    return ids_.size();
+  }
+
+ private:
+  void runLoopCallback() noexcept override;
+
+  bool matches(
+      const ConnectionIdAlgo& connIdAlgo,
+      const ServerConnectionIdParams& params,
+      const StatelessResetSecret& secret,
+      const folly::SocketAddress& serverAddr) const;
+
+  void scheduleFill();
+
+  folly::EventBase* evb_;
+  size_t capacity_;
+  ConnectionIdAlgo* connIdAlgo_{nullptr};
+  folly::Optional<ServerConnectionIdParams> params_;
+  StatelessResetSecret secret_;
+  folly::SocketAddress serverAddr_;
+  folly::Optional<StatelessResetGenerator> generator_;
+  std::deque<IssuedConnectionId> ids_;
+};
+
+} // namespace quic
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/ConnectionIdSteering.h>
+
+#include <folly/net/NetOps.h>
+#include <folly/portability/Sockets.h>
+#include <quic/codec/QuicConnectionId.h>
+
+#ifdef __linux__
+#include <linux/filter.h>
+#endif
+
+#include <array>
+
+namespace quic {
+
+bool attachConnectionIdSteering(
+    FOLLY_MAYBE_UNUSED folly::NetworkSocket fd,
+    FOLLY_MAYBE_UNUSED size_t numWorkers) {
+#if defined(__linux__) && defined(SO_ATTACH_REUSEPORT_CBPF)
+  if (numWorkers == 0) {
+    return false;
+  }
+  // The program runs on the UDP payload and returns the index of a socket
+  // in the group. An index past the last socket makes the kernel fall back
+  // to its hash. The worker id is bits 18-25 of the connection id, which
+  // starts right after the first byte of short header packets.
+  constexpr uint32_t kFallback = 0xffffffff;
+  std::array<sock_filter, 17> filter = {{
+      // Enough data for the first 4 bytes of the connection id
+      BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+      BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 1 + kMinConnectionIdSize, 0, 14),
+      // Short header
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x80, 12, 0),
+      // Version bits of the connection id
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xc0),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, kShortVersionId << 6, 0, 9),
+      // Worker id
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 3),
+      BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0x3f),
+      BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 2),
+      BPF_STMT(BPF_MISC | BPF_TAX, 0),
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 4),
+      BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 6),
+      BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+      BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, static_cast<uint32_t>(numWorkers)),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+      // The jumps above land here when the packet has no worker id.
+      BPF_STMT(BPF_RET | BPF_K, kFallback),
+  }};
+  sock_fprog prog;
+  prog.len = filter.size();
+  prog.filter = filter.data();
+  return folly::netops::setsockopt(
+             fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) ==
+      0;
+#else
+  return false;
+#endif
+}
+
+} // namespace quic
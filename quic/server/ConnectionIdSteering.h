@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/net/NetworkSocket.h>
+
+#include <cstddef>
+
+namespace quic {
+
+/**
+ * Attaches a classic BPF program to the SO_REUSEPORT group of the socket
+ * that picks the socket of the worker encoded in the destination connection
+ * id of short header packets, the same one getWorkerToRouteTo() would
+ * forward them to. Other packets keep the kernel's 4-tuple hash.
+ *
+ * Only valid for the connection ids of DefaultConnectionIdAlgo, and when
+ * the n-th socket of the group belongs to the worker with id n. Returns
+ * false when the kernel does not support it.
+ */
+bool attachConnectionIdSteering(folly::NetworkSocket fd, size_t numWorkers);
+
+} // namespace quic
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/KeepaliveScheduler.h>
+
+#include <algorithm>
+
+namespace quic {
+
+KeepaliveScheduler::KeepaliveScheduler(
+    folly::EventBase* evb,
+    std::chrono::milliseconds interval)
+    : folly::AsyncTimeout(evb),
+      interval_(interval),
+      tick_(std::max(
+          interval / kKeepaliveWheelSlots,
+          std::chrono::milliseconds(1))),
+      slots_(kKeepaliveWheelSlots) {}
+
+KeepaliveScheduler::~KeepaliveScheduler() {
+  cancelTimeout();
+}
+
+void KeepaliveScheduler::addConnection(std::weak_ptr<Connection> connection) {
+  auto now = Clock::now();
+  if (!isScheduled()) {
+    currentSlotTime_ = now;
+    scheduleTimeout(tick_);
+  }
+  schedule(std::move(connection), now + interval_);
+}
+
+void KeepaliveScheduler::schedule(
+    std::weak_ptr<Connection> connection,
+    TimePoint due) {
+  uint64_t ticks = 1;
+  if (due > currentSlotTime_) {
+    ticks = (due - currentSlotTime_ + tick_ - std::chrono::nanoseconds(1)) /
+        tick_;
+  }
+  ticks = std::min<uint64_t>(std::max<uint64_t>(ticks, 1), slots_.size() - 1);
+  slots_[(currentSlot_ + ticks) % slots_.size()].push_back(
+      std::move(connection));
+  numConnections_++;
+}
+
+void KeepaliveScheduler::timeoutExpired() noexcept {
+  auto now = Clock::now();
+  currentSlot_ = (currentSlot_ + 1) % slots_.size();
+  currentSlotTime_ = now;
+  auto dueConnections = std::move(slots_[currentSlot_]);
+  slots_[currentSlot_].clear();
+  numConnections_ -= dueConnections.size();
+  for (auto& weakConnection : dueConnections) {
+    auto connection = weakConnection.lock();
+    if (!connection) {
+      continue;
+    }
+    // The wheel is only as precise as a tick.
+    auto lastActivity = connection->getLastActivityTime();
+    if (lastActivity && now - *lastActivity < interval_ - tick_) {
+      schedule(std::move(weakConnection), *lastActivity + interval_);
+      continue;
+    }
+    if (connection->writeKeepalive()) {
+      schedule(std::move(weakConnection), now + interval_);
+    }
+  }
+  if (numConnections_ > 0) {
+    scheduleTimeout(tick_);
+  }
+}
+
+} // namespace quic
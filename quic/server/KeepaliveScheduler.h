@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <quic/QuicConstants.h>
+
+#include <memory>
+#include <vector>
+
+namespace quic {
+
+/**
+ * Sends the keepalive PINGs of the connections of a server worker from one
+ * coarse timing wheel, rather than from a timer and a write loop of each
+ * connection. The wheel is as long as the keepalive interval, and each of
+ * its slots holds the connections that are due in it. A connection that has
+ * had no activity for the interval when its slot comes up gets a PING, the
+ * others move to the slot they are due in. A connection is dropped from the
+ * wheel once it is gone or closed.
+ */
+class KeepaliveScheduler : private folly::AsyncTimeout {
+ public:
+  class Connection {
+   public:
+    virtual ~Connection() = default;
+
+    /**
+     * The time the connection last sent or received a packet, if it did.
+     */
+    virtual folly::Optional<TimePoint> getLastActivityTime() const = 0;
+
+    /**
+     * Sends a PING. Returns false if the connection is closed, after which
+     * it gets no more keepalives.
+     */
+    virtual bool writeKeepalive() noexcept = 0;
+  };
+
+  KeepaliveScheduler(
+      folly::EventBase* evb,
+      std::chrono::milliseconds interval);
+
+  ~KeepaliveScheduler() override;
+
+  KeepaliveScheduler(const KeepaliveScheduler&) = delete;
+  KeepaliveScheduler& operator=(const KeepaliveScheduler&) = delete;
+
+  void addConnection(std::weak_ptr<Connection> connection);
+
+  size_t getNumConnections() const {
+    return numConnections_;
+  }
+
+ private:
+  void timeoutExpired() noexcept override;
+
+  void schedule(std::weak_ptr<Connection> connection, TimePoint due);
+
+  const std::chrono::milliseconds interval_;
+  const std::chrono::milliseconds tick_;
+  std::vector<std::vector<std::weak_ptr<Connection>>> slots_;
+  size_t currentSlot_{0};
+  TimePoint currentSlotTime_;
+  size_t numConnections_{0};
+};
+
+} // namespace quic
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/QLoggerFactory.h>
+
+#include <folly/Random.h>
+
+namespace quic {
+
+SampledQLoggerFactory::SampledQLoggerFactory(
+    QLoggerMaker makeQLogger,
+    uint32_t sampleOneIn)
+    : makeQLogger_(std::move(makeQLogger)), sampleOneIn_(sampleOneIn) {}
+
+void SampledQLoggerFactory::addDebugSubnet(folly::CIDRNetwork subnet) {
+  debugSubnets_.push_back(std::move(subnet));
+}
+
+bool SampledQLoggerFactory::isDebugClient(
+    const folly::IPAddress& client) const {
+  // v4 clients can arrive on a dual stack socket as v4-mapped v6 addresses
+  auto address = client.isIPv4Mapped() ? client.createIPv4() : client;
+  for (const auto& subnet : debugSubnets_) {
+    if (address.inSubnet(subnet.first, subnet.second)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::shared_ptr<QLogger> SampledQLoggerFactory::make(
+    const folly::SocketAddress& client,
+    const ConnectionId& clientConnectionId) {
+  bool sampled = sampleOneIn_ > 0 && folly::Random::oneIn(sampleOneIn_);
+  if (!sampled && !isDebugClient(client.getIPAddress())) {
+    return nullptr;
+  }
+  return makeQLogger_(client, clientConnectionId);
+}
+
+} // namespace quic
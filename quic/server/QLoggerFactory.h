@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/codec/QuicConnectionId.h>
+#include <quic/logging/QLogger.h>
+
+#include <folly/Function.h>
+#include <folly/IPAddress.h>
+#include <folly/SocketAddress.h>
+
+#include <memory>
+#include <vector>
+
+namespace quic {
+
+/**
+ * Interface to decide which connections are traced.
+ * If the application sets one on the server, the worker calls 'make' for
+ * each accepted connection, and attaches the QLogger it returns. Connections
+ * it returns nullptr for have no QLogger, and so create no events at all.
+ */
+class QLoggerFactory {
+ public:
+  virtual ~QLoggerFactory() = default;
+
+  virtual std::shared_ptr<QLogger> make(
+      const folly::SocketAddress& client,
+      const ConnectionId& clientConnectionId) = 0;
+};
+
+/**
+ * Traces one in sampleOneIn connections, picked at random, and all the
+ * connections from the debug subnets, so that tracing can be always on in
+ * production at a bounded cost. A sampleOneIn of 0 only traces the debug
+ * subnets.
+ */
+class SampledQLoggerFactory : public QLoggerFactory {
+ public:
+  using QLoggerMaker = folly::Function<std::shared_ptr<QLogger>(
+      const folly::SocketAddress&,
+      const ConnectionId&)>;
+
+  SampledQLoggerFactory(QLoggerMaker makeQLogger, uint32_t sampleOneIn);
+
+  ~SampledQLoggerFactory() override = default;
+
+  /**
+   * Traces every connection from the subnet.
+   * This must be called before the server starts.
+   */
+  void addDebugSubnet(folly::CIDRNetwork subnet);
+
+  std::shared_ptr<QLogger> make(
+      const folly::SocketAddress& client,
+      const ConnectionId& clientConnectionId) override;
+
+ private:
+  bool isDebugClient(const folly::IPAddress& client) const;
+
+  QLoggerMaker makeQLogger_;
+  uint32_t sampleOneIn_;
+  std::vector<folly::CIDRNetwork> debugSubnets_;
+};
+
+} // namespace quic
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/QuicIoUringUDPSocket.h>
+
+#include <folly/portability/Sockets.h>
+#include <glog/logging.h>
+
+#if defined(MVFST_HAVE_LIBURING) && defined(__linux__)
+#include <liburing.h>
+#include <netinet/udp.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#define MVFST_IO_URING_ENABLED 1
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace quic {
+
+#ifdef MVFST_IO_URING_ENABLED
+namespace {
+constexpr size_t kMaxIoUringIovecs = 64;
+
+// Everything a queued sendmsg needs to stay alive until it completes.
+struct SendSlot {
+  std::unique_ptr<folly::IOBuf> buf;
+  struct msghdr msg;
+  struct sockaddr_storage addr;
+  struct iovec iov[kMaxIoUringIovecs];
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+};
+} // namespace
+
+struct QuicIoUringBackend::Ring {
+  struct io_uring ring;
+  std::vector<SendSlot> slots;
+  std::vector<size_t> freeSlots;
+  size_t queued{0};
+  size_t inflight{0};
+  // Signalled by the kernel for every completion.
+  int eventFd{-1};
+  bool valid{false};
+
+  explicit Ring(size_t numEntries) : slots(numEntries) {
+    if (io_uring_queue_init(numEntries, &ring, 0) != 0) {
+      LOG(WARNING) << "io_uring_queue_init failed, errno=" << errno;
+      return;
+    }
+    eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0 || io_uring_register_eventfd(&ring, eventFd) != 0) {
+      // Without the eventfd the completions could only be found by polling.
+      LOG(WARNING) << "io_uring_register_eventfd failed, errno=" << errno;
+      if (eventFd >= 0) {
+        ::close(eventFd);
+        eventFd = -1;
+      }
+      io_uring_queue_exit(&ring);
+      return;
+    }
+    valid = true;
+    freeSlots.reserve(numEntries);
+    for (size_t i = 0; i < numEntries; ++i) {
+      freeSlots.push_back(numEntries - i - 1);
+    }
+  }
+
+  ~Ring() {
+    if (!valid) {
+      return;
+    }
+    submitAndReap(inflight + queued);
+    io_uring_unregister_eventfd(&ring);
+    io_uring_queue_exit(&ring);
+    ::close(eventFd);
+  }
+
+  // Resets the eventfd so it only becomes readable on the next completion.
+  void drainEventFd() {
+    eventfd_t value;
+    ::eventfd_read(eventFd, &value);
+  }
+
+  void reapCompletions() {
+    struct io_uring_cqe* cqe = nullptr;
+    while (inflight > 0 && io_uring_peek_cqe(&ring, &cqe) == 0 && cqe) {
+      auto index =
+          static_cast<size_t>(reinterpret_cast<uintptr_t>(
+              io_uring_cqe_get_data(cqe)));
+      if (cqe->res < 0) {
+        VLOG(4) << "io_uring sendmsg failed, error=" << -cqe->res;
+      }
+      io_uring_cqe_seen(&ring, cqe);
+      slots[index].buf.reset();
+      freeSlots.push_back(index);
+      --inflight;
+    }
+  }
+
+  void submitAndReap(size_t waitFor) {
+    if (queued > 0 || waitFor > 0) {
+      int ret = io_uring_submit_and_wait(&ring, waitFor);
+      if (ret < 0) {
+        VLOG(4) << "io_uring_submit failed, error=" << -ret;
+      } else {
+        inflight += queued;
+        queued = 0;
+      }
+    }
+    reapCompletions();
+  }
+};
+#else
+struct QuicIoUringBackend::Ring {
+  bool valid{false};
+};
+#endif
+
+class QuicIoUringBackend::CompletionHandler : public folly::EventHandler {
+ public:
+  CompletionHandler(folly::EventBase* evb, int fd, QuicIoUringBackend* backend)
+      : folly::EventHandler(evb, folly::NetworkSocket::fromFd(fd)),
+        backend_(backend) {}
+
+  ~CompletionHandler() override {
+    unregisterHandler();
+  }
+
+  void handlerReady(uint16_t /* events */) noexcept override {
+#ifdef MVFST_IO_URING_ENABLED
+    backend_->ring_->drainEventFd();
+    backend_->ring_->reapCompletions();
+#else
+    (void)backend_;
+#endif
+  }
+
+ private:
+  QuicIoUringBackend* backend_;
+};
+
+QuicIoUringBackend::QuicIoUringBackend(
+    folly::EventBase* evb,
+    size_t numEntries)
+    : evb_(evb) {
+#ifdef MVFST_IO_URING_ENABLED
+  ring_ = std::make_unique<Ring>(numEntries);
+  if (ring_->valid) {
+    completionHandler_ =
+        std::make_unique<CompletionHandler>(evb_, ring_->eventFd, this);
+    completionHandler_->registerHandler(
+        folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  }
+#else
+  (void)numEntries;
+  ring_ = std::make_unique<Ring>();
+#endif
+}
+
+QuicIoUringBackend::~QuicIoUringBackend() {
+  cancelLoopCallback();
+}
+
+bool QuicIoUringBackend::valid() const {
+  return ring_->valid;
+}
+
+size_t QuicIoUringBackend::numInflight() const {
+#ifdef MVFST_IO_URING_ENABLED
+  return ring_->inflight + ring_->queued;
+#else
+  return 0;
+#endif
+}
+
+bool QuicIoUringBackend::sendmsg(
+    folly::NetworkSocket fd,
+    const folly::SocketAddress& address,
+    std::unique_ptr<folly::IOBuf> buf,
+    int gso) {
+#ifdef MVFST_IO_URING_ENABLED
+  if (!ring_->valid || buf->countChainElements() > kMaxIoUringIovecs) {
+    return false;
+  }
+  if (ring_->freeSlots.empty()) {
+    // Wait for at least one in flight send to free up its slot.
+    ring_->submitAndReap(1);
+    if (ring_->freeSlots.empty()) {
+      return false;
+    }
+  }
+  auto sqe = io_uring_get_sqe(&ring_->ring);
+  if (!sqe) {
+    ring_->submitAndReap(0);
+    sqe = io_uring_get_sqe(&ring_->ring);
+    if (!sqe) {
+      return false;
+    }
+  }
+  auto index = ring_->freeSlots.back();
+  ring_->freeSlots.pop_back();
+  auto& slot = ring_->slots[index];
+  slot.buf = std::move(buf);
+  memset(&slot.msg, 0, sizeof(slot.msg));
+  auto addrLen = address.getAddress(&slot.addr);
+  size_t iovLen = 0;
+  for (auto& range : *slot.buf) {
+    if (range.empty()) {
+      continue;
+    }
+    slot.iov[iovLen].iov_base = const_cast<uint8_t*>(range.data());
+    slot.iov[iovLen].iov_len = range.size();
+    ++iovLen;
+  }
+  slot.msg.msg_name = &slot.addr;
+  slot.msg.msg_namelen = addrLen;
+  slot.msg.msg_iov = slot.iov;
+  slot.msg.msg_iovlen = iovLen;
+  if (gso > 0) {
+    slot.msg.msg_control = slot.control;
+    slot.msg.msg_controllen = sizeof(slot.control);
+    struct cmsghdr* cm = CMSG_FIRSTHDR(&slot.msg);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    auto segSize = static_cast<uint16_t>(gso);
+    memcpy(CMSG_DATA(cm), &segSize, sizeof(segSize));
+  }
+  io_uring_prep_sendmsg(sqe, fd.toFd(), &slot.msg, 0);
+  io_uring_sqe_set_data(
+      sqe, reinterpret_cast<void*>(static_cast<uintptr_t>(index)));
+  ++ring_->queued;
+  if (!isLoopCallbackScheduled()) {
+    evb_->runInLoop(this);
+  }
+  return true;
+#else
+  (void)fd;
+  (void)address;
+  (void)buf;
+  (void)gso;
+  return false;
+#endif
+}
+
+void QuicIoUringBackend::submit() {
+#ifdef MVFST_IO_URING_ENABLED
+  if (ring_->valid) {
+    ring_->submitAndReap(0);
+  }
+#endif
+}
+
+void QuicIoUringBackend::runLoopCallback() noexcept {
+  // Whatever does not complete right away is reaped by the CompletionHandler.
+  submit();
+}
+
+QuicIoUringUDPSocket::QuicIoUringUDPSocket(
+    folly::EventBase* evb,
+    std::shared_ptr<QuicIoUringBackend> backend)
+    : folly::AsyncUDPSocket(evb), backend_(std::move(backend)) {}
+
+ssize_t QuicIoUringUDPSocket::write(
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf) {
+  return writeGSO(address, buf, 0);
+}
+
+ssize_t QuicIoUringUDPSocket::writeGSO(
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf,
+    int gso) {
+  if (!backend_->valid()) {
+    return folly::AsyncUDPSocket::writeGSO(address, buf, gso);
+  }
+  auto len = buf->computeChainDataLength();
+  if (!backend_->sendmsg(getNetworkSocket(), address, buf->clone(), gso)) {
+    return folly::AsyncUDPSocket::writeGSO(address, buf, gso);
+  }
+  return len;
+}
+
+int QuicIoUringUDPSocket::writem(
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>* bufs,
+    size_t count) {
+  if (!backend_->valid()) {
+    return folly::AsyncUDPSocket::writem(address, bufs, count);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (!backend_->sendmsg(getNetworkSocket(), address, bufs[i]->clone(), 0)) {
+      // The ring is full, write the rest directly.
+      int ret = folly::AsyncUDPSocket::writem(address, bufs + i, count - i);
+      return ret < 0 ? (i == 0 ? ret : static_cast<int>(i))
+                     : static_cast<int>(i) + ret;
+    }
+  }
+  return static_cast<int>(count);
+}
+
+} // namespace quic
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+
+namespace quic {
+
+constexpr size_t kDefaultIoUringEntries = 256;
+
+/**
+ * An io_uring submission and completion ring shared by all the sockets of an
+ * EventBase. Sends are queued on the ring and submitted together once per
+ * loop iteration. Completions are reaped when the ring signals them on its
+ * eventfd, so the EventBase sleeps while sends are in flight. When mvfst is
+ * built without liburing, or the kernel does not support io_uring, the ring
+ * is not valid and the sockets fall back to regular writes.
+ */
+class QuicIoUringBackend : public folly::EventBase::LoopCallback {
+ public:
+  QuicIoUringBackend(folly::EventBase* evb, size_t numEntries);
+
+  ~QuicIoUringBackend() override;
+
+  bool valid() const;
+
+  /**
+   * Queues a sendmsg of buf to address on fd. If gso is positive, buf is sent
+   * as a GSO buffer of gso sized segments. Returns false if the send could
+   * not be queued.
+   */
+  bool sendmsg(
+      folly::NetworkSocket fd,
+      const folly::SocketAddress& address,
+      std::unique_ptr<folly::IOBuf> buf,
+      int gso);
+
+  /**
+   * Submits the queued sends and reaps the completed ones.
+   */
+  void submit();
+
+  size_t numInflight() const;
+
+  // folly::EventBase::LoopCallback
+  void runLoopCallback() noexcept override;
+
+ private:
+  struct Ring;
+  class CompletionHandler;
+
+  folly::EventBase* evb_;
+  std::unique_ptr<Ring> ring_;
+  std::unique_ptr<CompletionHandler> completionHandler_;
+};
+
+/**
+ * AsyncUDPSocket that sends through a QuicIoUringBackend. Writes are reported
+ * as successful once they are queued; errors that the kernel hits afterwards
+ * are treated as losses. Reads still go through AsyncUDPSocket.
+ */
+class QuicIoUringUDPSocket : public folly::AsyncUDPSocket {
+ public:
+  QuicIoUringUDPSocket(
+      folly::EventBase* evb,
+      std::shared_ptr<QuicIoUringBackend> backend);
+
+  ~QuicIoUringUDPSocket() override = default;
+
+  ssize_t write(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf) override;
+
+  ssize_t writeGSO(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf,
+      int gso) override;
+
+  int writem(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>* bufs,
+      size_t count) override;
+
+ private:
+  std::shared_ptr<QuicIoUringBackend> backend_;
+};
+
+} // namespace quic
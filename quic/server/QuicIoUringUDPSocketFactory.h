@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+
+#include <quic/server/QuicIoUringUDPSocket.h>
+#include <quic/server/QuicUDPSocketFactory.h>
+
+namespace quic {
+
+/**
+ * Makes sockets that send through one io_uring per EventBase. Can be used
+ * both as the listener socket factory (reusePort = true) and as the factory
+ * for the sockets of accepted connections, which share the listening fd.
+ */
+class QuicIoUringUDPSocketFactory : public QuicUDPSocketFactory {
+ public:
+  explicit QuicIoUringUDPSocketFactory(
+      bool reusePort,
+      size_t ringEntries = kDefaultIoUringEntries)
+      : reusePort_(reusePort), ringEntries_(ringEntries) {}
+
+  ~QuicIoUringUDPSocketFactory() override {}
+
+  std::unique_ptr<folly::AsyncUDPSocket> make(folly::EventBase* evb, int fd)
+      override {
+    auto sock =
+        std::make_unique<QuicIoUringUDPSocket>(evb, getBackend(evb));
+    if (fd != -1) {
+      sock->setFD(
+          folly::NetworkSocket::fromFd(fd),
+          folly::AsyncUDPSocket::FDOwnership::SHARED);
+      sock->dontFragment(true);
+    } else if (reusePort_) {
+      sock->setReusePort(true);
+    }
+    return sock;
+  }
+
+ private:
+  std::shared_ptr<QuicIoUringBackend> getBackend(folly::EventBase* evb) {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto backend = backends_[evb].lock();
+    if (!backend) {
+      backend = std::make_shared<QuicIoUringBackend>(evb, ringEntries_);
+      backends_[evb] = backend;
+    }
+    return backend;
+  }
+
+  bool reusePort_;
+  size_t ringEntries_;
+  std::mutex lock_;
+  // The sockets keep their EventBase's ring alive.
+  std::unordered_map<folly::EventBase*, std::weak_ptr<QuicIoUringBackend>>
+      backends_;
+};
+} // namespace quic
@@ -10,13 +10,20 @@
 
 #include <folly/Random.h>
 #include <folly/io/async/EventBaseManager.h>
+#include <folly/net/NetOps.h>
 #include <quic/codec/DefaultConnectionIdAlgo.h>
 #include <quic/codec/QuicHeaderCodec.h>
+#include <quic/server/ConnectionIdSteering.h>
 #include <quic/server/QuicReusePortUDPSocketFactory.h>
 #include <quic/server/QuicServer.h>
 #include <quic/server/QuicServerTransport.h>
 #include <quic/server/QuicSharedUDPSocketFactory.h>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace quic {
 
 namespace {
@@ -29,6 +36,17 @@ size_t getWorkerToRouteTo(
   return connIdAlgo->parseConnectionId(routingData.destinationConnId).workerId %
       numWorkers;
 }
+
+bool pinThreadToCpu(FOLLY_MAYBE_UNUSED size_t cpu) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+  return false;
+#endif
+}
 } // namespace
 
 QuicServer::QuicServer() {
@@ -60,6 +78,57 @@ void QuicServer::setCongestionControllerFactory(
   ccFactory_ = std::move(ccFactory);
 }
 
+void QuicServer::setCongestionControlPolicy(
+    std::shared_ptr<CongestionControlPolicy> policy) {
+  CHECK(!initialized_)
+      << " Congestion Control Policy must be set before the server is "
+      << "initialized.";
+  ccPolicy_ = std::move(policy);
+}
+
+void QuicServer::setHandshakeExecutor(
+    std::shared_ptr<folly::Executor> executor) {
+  CHECK(!initialized_)
+      << " Handshake executor must be set before the server is initialized.";
+  handshakeExecutor_ = std::move(executor);
+}
+
+void QuicServer::setAppTokenCache(
+    std::shared_ptr<AppTokenCache> appTokenCache) {
+  CHECK(!initialized_)
+      << " App token cache must be set before the server is initialized.";
+  appTokenCache_ = std::move(appTokenCache);
+}
+
+void QuicServer::setCongestionStateCache(
+    std::shared_ptr<CongestionStateCache> congestionStateCache) {
+  CHECK(!initialized_) << " Congestion state cache must be set before the "
+                          "server is initialized.";
+  congestionStateCache_ = std::move(congestionStateCache);
+}
+
+void QuicServer::setLoopHealthMonitoring(
+    LoopHealthMonitor::Thresholds thresholds,
+    LoopHealthAlertFn alertFn) {
+  CHECK(!initialized_) << " Loop health monitoring must be set before the "
+                          "server is initialized.";
+  loopHealthThresholds_ = thresholds;
+  loopHealthAlertFn_ = std::move(alertFn);
+}
+
+void QuicServer::setQLoggerFactory(
+    std::shared_ptr<QLoggerFactory> qLoggerFactory) {
+  CHECK(!initialized_)
+      << " QLogger factory must be set before the server is initialized.";
+  qLoggerFactory_ = std::move(qLoggerFactory);
+}
+
+void QuicServer::setWorkerCpus(std::vector<size_t> cpus) {
+  CHECK(!initialized_) << " Worker cpus must be set before the server is "
+                          "initialized.";
+  workerCpus_ = std::move(cpus);
+}
+
 void QuicServer::setSupportedVersion(const std::vector<QuicVersion>& versions) {
   supportedVersions_ = versions;
 }
@@ -87,6 +156,16 @@ void QuicServer::start(const folly::SocketAddress& address, size_t maxWorkers) {
   std::vector<folly::EventBase*> evbs;
   for (size_t i = 0; i < numWorkers; ++i) {
     auto scopedEvb = std::make_unique<folly::ScopedEventBaseThread>();
+    if (!workerCpus_.empty()) {
+      // Pinned before the worker allocates anything, which then lands on
+      // the cpu's NUMA node.
+      auto cpu = workerCpus_[i % workerCpus_.size()];
+      scopedEvb->getEventBase()->runInEventBaseThreadAndWait([cpu] {
+        if (!pinThreadToCpu(cpu)) {
+          LOG(WARNING) << "Failed to pin worker thread to cpu=" << cpu;
+        }
+      });
+    }
     workerEvbs_.push_back(std::move(scopedEvb));
     if (evbObserver_) {
       workerEvbs_.back()->getEventBase()->runInEventBaseThreadAndWait([&] {
@@ -118,6 +197,13 @@ void QuicServer::initialize(
     transportSettings_.statelessResetTokenSecret = secret;
   }
 
+  // setting default retry token secret if not set
+  if (!transportSettings_.retryTokenSecret) {
+    std::array<uint8_t, kRetryTokenSecretLength> secret;
+    folly::Random::secureRandom(secret.data(), secret.size());
+    transportSettings_.retryTokenSecret = secret;
+  }
+
   // it the connid algo factory is not set, use default impl
   if (!connIdAlgoFactory_) {
     connIdAlgoFactory_ = std::make_unique<DefaultConnectionIdAlgoFactory>();
@@ -162,6 +248,23 @@ void QuicServer::initializeWorkers(
     }
     worker->setConnectionIdAlgo(connIdAlgoFactory_->make());
     worker->setCongestionControllerFactory(ccFactory_);
+    worker->setCongestionControlPolicy(ccPolicy_);
+    worker->setHandshakeExecutor(handshakeExecutor_);
+    worker->setAppTokenCache(appTokenCache_);
+    worker->setCongestionStateCache(congestionStateCache_);
+    if (loopHealthThresholds_) {
+      LoopHealthMonitor::AlertCallback alertCallback;
+      if (loopHealthAlertFn_) {
+        alertCallback = [alertFn = loopHealthAlertFn_, workerEvb](
+                            LoopHealthMonitor::Metric metric,
+                            std::chrono::microseconds value) {
+          alertFn(workerEvb, metric, value);
+        };
+      }
+      worker->setLoopHealthMonitor(std::make_shared<LoopHealthMonitor>(
+          *loopHealthThresholds_, std::move(alertCallback)));
+    }
+    worker->setQLoggerFactory(qLoggerFactory_);
     worker->setWorkerId(workers_.size());
     worker->setTransportSettingsOverrideFn(transportSettingsOverrideFn_);
     workers_.push_back(std::move(worker));
@@ -223,6 +326,16 @@ void QuicServer::bindWorkersToSocket(
             worker->setSocket(std::move(workerSocket));
             worker->bind(address);
           }
+          // The sockets join the reuseport group in the order of the
+          // workers, which taken over sockets do not guarantee.
+          if (idx == (numWorkers - 1) &&
+              self->transportSettings_.steerPacketsByConnectionId &&
+              self->listeningFDs_.empty() &&
+              !attachConnectionIdSteering(
+                  folly::NetworkSocket::fromFd(worker->getFD()), numWorkers)) {
+            LOG(WARNING) << "Failed to steer packets by connection id for "
+                         << "address=" << address;
+          }
           if (idx == (numWorkers - 1)) {
             VLOG(4) << "Initialized all workers in the eventbase";
             self->initialized_ = true;
@@ -327,16 +440,30 @@ void QuicServer::routeDataToWorker(
   auto& worker = workers_[workerToRunOn];
   VLOG_IF(4, !worker->getEventBase()->isInEventBaseThread())
       << " Routing to worker in different EVB, to workerId=" << workerToRunOn;
+  // Packets are handed over through the worker's queue, so that a burst of
+  // them costs a single wakeup of the worker instead of one closure each.
+  auto result = worker->queueForwardedPacket(
+      client, std::move(routingData), std::move(networkData));
+  if (result == QuicServerWorker::ForwardedPacketResult::DROPPED) {
+    VLOG(4) << "Dropping data since the queue of workerId=" << workerToRunOn
+            << " is full";
+    if (workerPtr_) {
+      QUIC_STATS(
+          workerPtr_->getTransportInfoCallback(),
+          onPacketDropped,
+          QuicTransportStatsCallback::PacketDropReason::WORKER_QUEUE_FULL);
+    }
+    return;
+  }
+  if (result != QuicServerWorker::ForwardedPacketResult::NEEDS_DISPATCH) {
+    return;
+  }
   worker->getEventBase()->runInEventBaseThread(
-      [server = this->shared_from_this(),
-       cl = client,
-       routingData = std::move(routingData),
-       w = worker.get(),
-       buf = std::move(networkData)]() mutable {
+      [server = this->shared_from_this(), w = worker.get()]() mutable {
         if (server->shutdown_) {
           return;
         }
-        w->dispatchPacketData(cl, std::move(routingData), std::move(buf));
+        w->dispatchForwardedPackets();
       });
 }
 
@@ -369,6 +496,11 @@ void QuicServer::shutdown(LocalErrorCode error) {
         !worker->getEventBase()->isInEventBaseThread());
   }
   shutdown_ = true;
+  if (connectionHandoffHandler_) {
+    auto evb = workers_.front()->getEventBase();
+    evb->runImmediatelyOrRunInEventBaseThreadAndWait(
+        [&] { connectionHandoffHandler_.reset(); });
+  }
   for (auto& worker : workers_) {
     worker->getEventBase()->runInEventBaseThreadAndWait([&] {
       worker->shutdownAllConnections(error);
@@ -480,9 +612,8 @@ void QuicServer::setEventBaseObserver(
   }
   workerEvbs_.front()->getEventBase()->runInEventBaseThreadAndWait(
       [&] { evbObserver_ = observer; });
-  runOnAllWorkers([observer](auto worker) {
-    worker->getEventBase()->setObserver(observer);
-  });
+  runOnAllWorkers(
+      [observer](auto worker) { worker->setEventBaseObserver(observer); });
 };
 
 void QuicServer::startPacketForwarding(const folly::SocketAddress& destAddr) {
@@ -515,12 +646,85 @@ void QuicServer::stopPacketForwarding(std::chrono::milliseconds delay) {
   }
 }
 
+size_t QuicServer::handOffConnections(int fd) {
+  if (!initialized_ || shutdown_) {
+    return 0;
+  }
+  auto sendState = [fd](const folly::IOBuf& buf) {
+    auto data = buf.cloneCoalesced();
+    auto ret = folly::netops::send(
+        folly::NetworkSocket::fromFd(fd),
+        data->data(),
+        data->length(),
+        MSG_NOSIGNAL);
+    return ret == static_cast<ssize_t>(data->length());
+  };
+  size_t numHandedOff = 0;
+  for (auto& worker : workers_) {
+    DCHECK(
+        !worker->getEventBase()->isRunning() ||
+        !worker->getEventBase()->isInEventBaseThread());
+    worker->getEventBase()->runInEventBaseThreadAndWait(
+        [&] { numHandedOff += worker->handOffConnections(sendState); });
+  }
+  VLOG(4) << "Handed off " << numHandedOff << " connections";
+  return numHandedOff;
+}
+
+void QuicServer::acceptConnectionHandoffs(int fd) {
+  CHECK(!workers_.empty());
+  if (shutdown_) {
+    return;
+  }
+  auto evb = workers_.front()->getEventBase();
+  evb->runImmediatelyOrRunInEventBaseThreadAndWait([&] {
+    connectionHandoffHandler_ = std::make_unique<ConnectionHandoffHandler>(
+        evb,
+        folly::NetworkSocket::fromFd(::dup(fd)),
+        // The handler is destroyed at shutdown, before the server is.
+        [this](ConnectionHandoffState state) mutable {
+          if (shutdown_) {
+            return;
+          }
+          // The same worker that the packets of the connection are routed to.
+          auto workerId =
+              connIdAlgo_->parseConnectionId(state.serverConnectionId)
+                  .workerId %
+              workers_.size();
+          auto& worker = workers_[workerId];
+          worker->getEventBase()->runInEventBaseThread(
+              [&worker,
+               self = shared_from_this(),
+               state = std::move(state)]() mutable {
+                if (self->shutdown_) {
+                  return;
+                }
+                worker->acceptConnectionHandoff(state);
+              });
+        });
+  });
+}
+
 void QuicServer::setTransportStatsCallbackFactory(
     std::unique_ptr<QuicTransportStatsCallbackFactory> statsFactory) {
   CHECK(statsFactory);
   transportStatsFactory_ = std::move(statsFactory);
 }
 
+void QuicServer::enableTransportStats() {
+  CHECK(!initialized_);
+  transportStatsAggregator_ = std::make_shared<TransportStatsAggregator>();
+  transportStatsFactory_ = std::make_unique<TransportStatsAggregatorFactory>(
+      transportStatsAggregator_);
+}
+
+TransportStatsSnapshot QuicServer::getTransportStats() const {
+  if (!transportStatsAggregator_) {
+    return TransportStatsSnapshot();
+  }
+  return transportStatsAggregator_->getSnapshot();
+}
+
 void QuicServer::setConnectionIdAlgoFactory(
     std::unique_ptr<ConnectionIdAlgoFactory> connIdAlgoFactory) {
   CHECK(!initialized_);
@@ -21,6 +21,7 @@
 #include <quic/server/QuicServerTransportFactory.h>
 #include <quic/server/QuicServerWorker.h>
 #include <quic/server/QuicUDPSocketFactory.h>
+#include <quic/server/TransportStatsAggregator.h>
 #include <quic/state/QuicTransportStatsCallback.h>
 
 namespace quic {
@@ -97,6 +98,73 @@ class QuicServer : public QuicServerWorker::WorkerCallback,
   void setCongestionControllerFactory(
       std::shared_ptr<CongestionControllerFactory> ccFactory);
 
+  /**
+   * Set the policy that switches the congestion controller of each
+   * connection as its path is observed, e.g. PathCongestionControlPolicy.
+   * This must be set before the server is started.
+   */
+  void setCongestionControlPolicy(
+      std::shared_ptr<CongestionControlPolicy> policy);
+
+  /**
+   * Set the executor, typically a CPU thread pool, that the key exchange and
+   * signing of new connections' TLS handshakes run on. The handshakes resume
+   * on their worker's event base once done.
+   * This must be set before the server is started.
+   */
+  void setHandshakeExecutor(std::shared_ptr<folly::Executor> executor);
+
+  /**
+   * Set the cache of decoded app tokens shared by all the workers, so that a
+   * resumed connection does not decode its token again whichever worker it
+   * lands on.
+   * This must be set before the server is started.
+   */
+  void setAppTokenCache(std::shared_ptr<AppTokenCache> appTokenCache);
+
+  /**
+   * Set the cache of congestion state shared by all the workers, so that new
+   * connections from a subnet that was recently connected from start with a
+   * larger cwnd, whichever worker they land on.
+   * This must be set before the server is started.
+   */
+  void setCongestionStateCache(
+      std::shared_ptr<CongestionStateCache> congestionStateCache);
+
+  using LoopHealthAlertFn = std::function<void(
+      folly::EventBase*,
+      LoopHealthMonitor::Metric,
+      std::chrono::microseconds)>;
+
+  /**
+   * Gives every worker a LoopHealthMonitor with the thresholds. The alert
+   * function is called from the thread of the worker, with its event base,
+   * for each sample above a threshold.
+   * This must be set before the server is started.
+   */
+  void setLoopHealthMonitoring(
+      LoopHealthMonitor::Thresholds thresholds,
+      LoopHealthAlertFn alertFn = nullptr);
+
+  /**
+   * Set the factory that decides, for each accepted connection, whether it
+   * gets a QLogger, for instance by sampling or by client address. Without
+   * one connections have no QLogger.
+   * This must be set before the server is started.
+   */
+  void setQLoggerFactory(std::shared_ptr<QLoggerFactory> qLoggerFactory);
+
+  /**
+   * Pin the worker threads that start(address, maxWorkers) spawns, worker i
+   * to cpus[i % cpus.size()]. Listing the cpus in the order of the NIC
+   * receive queues whose interrupts they serve keeps each worker next to its
+   * queue, and on its NUMA node. The memory that the workers allocate once
+   * running, such as their connections and buffers, then comes from that
+   * node as well.
+   * This must be set before the server is started.
+   */
+  void setWorkerCpus(std::vector<size_t> cpus);
+
   /**
    * Set list of supported QUICVersion for this server. These versions will be
    * used during the 'Version-Negotiation' phase with the client.
@@ -240,6 +308,28 @@ class QuicServer : public QuicServerWorker::WorkerCallback,
    */
   void stopPacketForwarding(std::chrono::milliseconds delay);
 
+  /**
+   * Hands the connections at rest off to the server taking over, so that it
+   * carries them on instead of forwarding their packets to this server until
+   * they drain. fd is a connected Unix socket of type SOCK_SEQPACKET, which
+   * the other server reads with acceptConnectionHandoffs. The state of each
+   * connection is written to it as one message, and the connections written
+   * are closed without telling their peers. The connections that are not at
+   * rest stay, and their packets are forwarded as before.
+   * Returns the number of connections handed off. It waits for the workers,
+   * so it cannot be called on a worker's thread. fd stays owned by the
+   * caller.
+   */
+  size_t handOffConnections(int fd);
+
+  /**
+   * Carries on the connections that the server being taken over hands off
+   * through fd, which is read until the other server closes its end. Quic
+   * server calls ::dup for the fd.
+   * NOTE: it must be called after start()
+   */
+  void acceptConnectionHandoffs(int fd);
+
   /**
    * Set takenover socket fds for the quic server from another process.
    * Quic server calls ::dup for each fd and will not bind to the address for
@@ -285,6 +375,19 @@ class QuicServer : public QuicServerWorker::WorkerCallback,
   void setTransportStatsCallbackFactory(
       std::unique_ptr<QuicTransportStatsCallbackFactory> statsFactory);
 
+  /**
+   * Installs the built-in stats, counters and histograms kept per worker
+   * that getTransportStats() merges, in place of any stats callback
+   * factory. It must be called before 'start()' or 'initialize(..)'.
+   */
+  void enableTransportStats();
+
+  /**
+   * Returns the stats of all the workers merged, without locking. Empty when
+   * the built-in stats are not enabled.
+   */
+  TransportStatsSnapshot getTransportStats() const;
+
   /**
    * Factory to create per worker ConnectionIdAlgo instance
    * NOTE: it must be set before calling 'start()' or 'initialize(..)'
@@ -342,6 +445,21 @@ class QuicServer : public QuicServerWorker::WorkerCallback,
   std::unique_ptr<QuicUDPSocketFactory> socketFactory_;
   // factory used to create specific instance of Congestion control algorithm
   std::shared_ptr<CongestionControllerFactory> ccFactory_;
+  // switches the congestion controllers of the connections, if any
+  std::shared_ptr<CongestionControlPolicy> ccPolicy_;
+  // executor the expensive part of the TLS handshakes run on, if any
+  std::shared_ptr<folly::Executor> handshakeExecutor_;
+  // decoded app tokens shared by the workers, if any
+  std::shared_ptr<AppTokenCache> appTokenCache_;
+  // congestion state of recent connections shared by the workers, if any
+  std::shared_ptr<CongestionStateCache> congestionStateCache_;
+  // thresholds of the per worker loop health monitors, if monitored
+  folly::Optional<LoopHealthMonitor::Thresholds> loopHealthThresholds_;
+  LoopHealthAlertFn loopHealthAlertFn_;
+  // decides which connections are traced, if any
+  std::shared_ptr<QLoggerFactory> qLoggerFactory_;
+  // cpus the worker threads are pinned to, if any
+  std::vector<size_t> workerCpus_;
 
   std::shared_ptr<folly::EventBaseObserver> evbObserver_;
   folly::Optional<std::string> healthCheckToken_;
@@ -352,6 +470,11 @@ class QuicServer : public QuicServerWorker::WorkerCallback,
   bool rejectNewConnections_{false};
   // factory to create per worker QuicTransportStatsCallback
   std::unique_ptr<QuicTransportStatsCallbackFactory> transportStatsFactory_;
+  // reads the connections handed off by another server, on the evb of the
+  // first worker
+  std::unique_ptr<ConnectionHandoffHandler> connectionHandoffHandler_;
+  // the built-in stats, if enabled
+  std::shared_ptr<TransportStatsAggregator> transportStatsAggregator_;
   // factory to create per worker ConnectionIdAlgo
   std::unique_ptr<ConnectionIdAlgoFactory> connIdAlgoFactory_;
   // Impl of ConnectionIdAlgo to make routing decisions from ConnectionId
@@ -7,6 +7,7 @@
  */
 
 #include <folly/io/Cursor.h>
+#include <folly/net/NetOps.h>
 #include <folly/system/ThreadId.h>
 #include <quic/QuicConstants.h>
 
@@ -33,6 +34,7 @@ TakeoverHandlerCallback::TakeoverHandlerCallback(
       socket_(std::move(socket)) {}
 
 TakeoverHandlerCallback::~TakeoverHandlerCallback() {
+  readHandler_.reset();
   if (socket_) {
     socket_->pauseRead();
     socket_.reset();
@@ -42,10 +44,25 @@ TakeoverHandlerCallback::~TakeoverHandlerCallback() {
 void TakeoverHandlerCallback::bind() {
   CHECK(socket_);
   socket_->bind(address_);
-  socket_->resumeRead(this);
+  if (transportSettings_.batchTakeoverPackets) {
+    batchReader_ = std::make_unique<QuicBatchReader>(
+        transportSettings_.maxRecvBatchSize,
+        transportSettings_.maxRecvPacketSize +
+            kMaxBufSizeForTakeoverEncapsulation,
+        false /* groEnabled */);
+    readHandler_ = std::make_unique<BatchReadHandler>(
+        this, socket_->getEventBase(), socket_->getNetworkSocket());
+    readHandler_->registerHandler(
+        folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  } else {
+    socket_->resumeRead(this);
+  }
 }
 
 void TakeoverHandlerCallback::pause() {
+  if (readHandler_) {
+    readHandler_->unregisterHandler();
+  }
   if (socket_) {
     socket_->pauseRead();
   }
@@ -77,12 +94,44 @@ void TakeoverHandlerCallback::onDataAvailable(
   // of it immediately so that if we return early,
   // we've flushed it.
   Buf data = std::move(readBuffer_);
-  QUIC_STATS(worker_->getInfoCallback(), onForwardedPacketReceived);
   if (truncated) {
     // This is an error, drop the packet.
+    QUIC_STATS(worker_->getInfoCallback(), onForwardedPacketReceived);
     return;
   }
   data->append(len);
+  onForwardedPacket(client, std::move(data));
+}
+
+void TakeoverHandlerCallback::readBatch() noexcept {
+  if (!socket_ || !batchReader_) {
+    return;
+  }
+  int ret = batchReader_->read(
+      socket_->getNetworkSocket(),
+      [&](const folly::SocketAddress& client,
+          Buf data,
+          EcnCodepoint /* ecn */,
+          folly::Optional<TimePoint> /* receiveTime */,
+          const folly::Optional<folly::IPAddress>& /* localAddress */) {
+        onForwardedPacket(client, std::move(data));
+      });
+  if (ret < 0) {
+    onReadError(folly::AsyncSocketException(
+        folly::AsyncSocketException::INTERNAL_ERROR,
+        "recvmmsg failed",
+        errno));
+    return;
+  }
+  if (ret > 0) {
+    QUIC_STATS(worker_->getInfoCallback(), onReadBatch, ret);
+  }
+}
+
+void TakeoverHandlerCallback::onForwardedPacket(
+    const folly::SocketAddress& client,
+    Buf data) {
+  QUIC_STATS(worker_->getInfoCallback(), onForwardedPacketReceived);
   takeoverPktHandler_.processForwardedPacket(client, std::move(data));
 }
 
@@ -90,6 +139,9 @@ void TakeoverHandlerCallback::onReadError(
     const folly::AsyncSocketException& ex) noexcept {
   folly::DelayedDestruction::DestructorGuard dg(this);
   VLOG(4) << "Error on TakeoverHandlerCallback " << ex.what();
+  if (readHandler_) {
+    readHandler_->unregisterHandler();
+  }
   if (socket_) {
     socket_->pauseRead();
     // delete the socket_ in the next loop
@@ -110,6 +162,10 @@ void TakeoverPacketHandler::setDestination(
   packetForwardingEnabled_ = true;
 }
 
+void TakeoverPacketHandler::enableBatching(size_t maxBatchSize) {
+  maxBatchSize_ = maxBatchSize;
+}
+
 void TakeoverPacketHandler::forwardPacketToAnotherServer(
     const folly::SocketAddress& peerAddress,
     Buf data,
@@ -150,6 +206,15 @@ void TakeoverPacketHandler::forwardPacket(Buf writeBuffer) {
     localAddress.setFromHostPort("::1", 0);
     pktForwardingSocket_->bind(localAddress);
   }
+  if (maxBatchSize_ > 0 && !pktForwardingBatcher_) {
+    pktForwardingBatcher_ = std::make_unique<EgressBatcher>(
+        worker_->getEventBase(), *pktForwardingSocket_, maxBatchSize_);
+  }
+  if (pktForwardingBatcher_) {
+    pktForwardingBatcher_->write(
+        *pktForwardingSocket_, pktForwardDestAddr_, std::move(writeBuffer));
+    return;
+  }
   pktForwardingSocket_->write(pktForwardDestAddr_, std::move(writeBuffer));
 }
 
@@ -224,6 +289,69 @@ void TakeoverPacketHandler::processForwardedPacket(
 
 void TakeoverPacketHandler::stop() {
   packetForwardingEnabled_ = false;
+  if (pktForwardingBatcher_) {
+    // Send what this loop iteration forwarded so far.
+    pktForwardingBatcher_->flush();
+    pktForwardingBatcher_.reset();
+  }
   pktForwardingSocket_.reset();
 }
+ConnectionHandoffHandler::ConnectionHandoffHandler(
+    folly::EventBase* evb,
+    folly::NetworkSocket fd,
+    Callback callback)
+    : folly::EventHandler(evb, fd), fd_(fd), callback_(std::move(callback)) {
+  registerHandler(folly::EventHandler::READ | folly::EventHandler::PERSIST);
+}
+
+ConnectionHandoffHandler::~ConnectionHandoffHandler() {
+  close();
+}
+
+void ConnectionHandoffHandler::handlerReady(uint16_t /* events */) noexcept {
+  while (fd_ != folly::NetworkSocket()) {
+    if (!readBuffer_) {
+      readBuffer_ = folly::IOBuf::create(kMaxConnectionHandoffStateSize);
+    }
+    auto ret = folly::netops::recv(
+        fd_,
+        readBuffer_->writableData(),
+        kMaxConnectionHandoffStateSize,
+        MSG_DONTWAIT | MSG_TRUNC);
+    if (ret < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        VLOG(4) << "Error reading handed off connections errno=" << errno;
+        close();
+      }
+      return;
+    }
+    if (ret == 0) {
+      VLOG(4) << "Connection handoff complete";
+      close();
+      return;
+    }
+    if (static_cast<size_t>(ret) > kMaxConnectionHandoffStateSize) {
+      VLOG(4) << "Dropping truncated connection handoff of size=" << ret;
+      continue;
+    }
+    Buf data = std::move(readBuffer_);
+    data->append(ret);
+    auto state = decodeConnectionHandoffState(*data);
+    if (!state) {
+      VLOG(4) << "Dropping connection handoff that could not be decoded";
+      continue;
+    }
+    callback_(std::move(*state));
+  }
+}
+
+void ConnectionHandoffHandler::close() {
+  if (fd_ == folly::NetworkSocket()) {
+    return;
+  }
+  unregisterHandler();
+  folly::netops::close(fd_);
+  fd_ = folly::NetworkSocket();
+}
+
 } // namespace quic
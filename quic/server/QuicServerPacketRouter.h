@@ -10,9 +10,13 @@
 #include <unordered_map>
 
 #include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/io/async/EventHandler.h>
 
 #include <quic/QuicConstants.h>
+#include <quic/api/QuicBatchReader.h>
+#include <quic/api/QuicBatchWriter.h>
 #include <quic/codec/ConnectionIdAlgo.h>
+#include <quic/server/ConnectionHandoff.h>
 #include <quic/server/QuicServerTransportFactory.h>
 #include <quic/server/QuicUDPSocketFactory.h>
 #include <quic/state/QuicTransportStatsCallback.h>
@@ -75,6 +79,12 @@ class TakeoverPacketHandler {
 
   void setDestination(const folly::SocketAddress& destAddr);
 
+  /**
+   * Queues the forwarded packets and sends them together at the end of the
+   * event loop iteration, or once maxBatchSize of them are queued.
+   */
+  void enableBatching(size_t maxBatchSize);
+
   void forwardPacketToAnotherServer(
       const folly::SocketAddress& peerAddress,
       Buf data,
@@ -100,6 +110,9 @@ class TakeoverPacketHandler {
   QuicServerWorker* worker_;
   folly::SocketAddress pktForwardDestAddr_;
   std::unique_ptr<folly::AsyncUDPSocket> pktForwardingSocket_;
+  // Only set when batching is enabled, refers to pktForwardingSocket_.
+  std::unique_ptr<EgressBatcher> pktForwardingBatcher_;
+  size_t maxBatchSize_{0};
   bool packetForwardingEnabled_{false};
   QuicUDPSocketFactory* socketFactory_{nullptr};
 };
@@ -142,6 +155,30 @@ class TakeoverHandlerCallback : public folly::AsyncUDPSocket::ReadCallback,
   void onReadClosed() noexcept override;
 
  private:
+  /**
+   * Reads the forwarded packets with recvmmsg, when batchTakeoverPackets is
+   * set. The socket is then only used for binding.
+   */
+  class BatchReadHandler : public folly::EventHandler {
+   public:
+    BatchReadHandler(
+        TakeoverHandlerCallback* callback,
+        folly::EventBase* evb,
+        folly::NetworkSocket fd)
+        : folly::EventHandler(evb, fd), callback_(callback) {}
+
+    void handlerReady(uint16_t /* events */) noexcept override {
+      callback_->readBatch();
+    }
+
+   private:
+    TakeoverHandlerCallback* callback_;
+  };
+
+  void readBatch() noexcept;
+
+  void onForwardedPacket(const folly::SocketAddress& client, Buf data);
+
   QuicServerWorker* worker_;
   // QuicServerWorker owns Packethandler
   TakeoverPacketHandler& takeoverPktHandler_;
@@ -150,5 +187,34 @@ class TakeoverHandlerCallback : public folly::AsyncUDPSocket::ReadCallback,
   folly::SocketAddress address_;
   std::unique_ptr<folly::AsyncUDPSocket> socket_;
   Buf readBuffer_;
+  // Only set when batchTakeoverPackets is set.
+  std::unique_ptr<QuicBatchReader> batchReader_;
+  std::unique_ptr<BatchReadHandler> readHandler_;
+};
+
+/**
+ * Reads the connections that another server hands off from a Unix socket of
+ * type SOCK_SEQPACKET, one state per message, until the other server closes
+ * its end. The handler owns the socket.
+ */
+class ConnectionHandoffHandler : public folly::EventHandler {
+ public:
+  using Callback = folly::Function<void(ConnectionHandoffState)>;
+
+  ConnectionHandoffHandler(
+      folly::EventBase* evb,
+      folly::NetworkSocket fd,
+      Callback callback);
+
+  ~ConnectionHandoffHandler() override;
+
+  void handlerReady(uint16_t events) noexcept override;
+
+ private:
+  void close();
+
+  folly::NetworkSocket fd_;
+  Callback callback_;
+  Buf readBuffer_;
 };
 } // namespace quic
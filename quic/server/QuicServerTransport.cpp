@@ -8,9 +8,14 @@
 
 #include <quic/server/QuicServerTransport.h>
 
+#include <folly/ScopeGuard.h>
+
+#include <quic/common/BlockCache.h>
+#include <quic/common/BufferAllocator.h>
 #include <quic/server/handshake/AppToken.h>
 #include <quic/server/handshake/DefaultAppTokenValidator.h>
 #include <quic/server/handshake/StatelessResetGenerator.h>
+#include <quic/state/KeyUpdate.h>
 
 namespace quic {
 
@@ -49,12 +54,19 @@ QuicServerTransport::Ptr QuicServerTransport::make(
     std::unique_ptr<folly::AsyncUDPSocket> sock,
     ConnectionCallback& cb,
     std::shared_ptr<const fizz::server::FizzServerContext> ctx) {
-  return std::make_shared<QuicServerTransport>(evb, std::move(sock), cb, ctx);
+  // Transports of closed connections leave their memory to the next ones.
+  return std::allocate_shared<QuicServerTransport>(
+      BlockCacheAllocator<QuicServerTransport, QuicServerTransport>(),
+      evb,
+      std::move(sock),
+      cb,
+      ctx);
 }
 
 void QuicServerTransport::setRoutingCallback(
     RoutingCallback* callback) noexcept {
   routingCb_ = callback;
+  reportedMemoryUsage_ = 0;
 }
 
 void QuicServerTransport::setOriginalPeerAddress(
@@ -85,6 +97,79 @@ void QuicServerTransport::setConnectionIdAlgo(
   }
 }
 
+void QuicServerTransport::setEgressBatcher(
+    EgressBatcher* egressBatcher) noexcept {
+  if (conn_) {
+    conn_->egressBatcher = egressBatcher;
+  }
+}
+
+void QuicServerTransport::setZeroCopySender(
+    ZeroCopySender* zeroCopySender) noexcept {
+  if (conn_) {
+    conn_->zeroCopySender = zeroCopySender;
+  }
+}
+
+void QuicServerTransport::setEncryptionPipeline(
+    EncryptionPipeline* encryptionPipeline) noexcept {
+  if (conn_) {
+    conn_->encryptionPipeline = encryptionPipeline;
+  }
+}
+
+void QuicServerTransport::setBufferAllocator(
+    BufferAllocator* bufferAllocator) noexcept {
+  if (conn_) {
+    conn_->bufferAllocator = bufferAllocator;
+  }
+}
+
+void QuicServerTransport::setPendingPacketPool(
+    PendingPacketPool* pendingPacketPool) noexcept {
+  if (serverConn_) {
+    serverConn_->pendingPacketPool = pendingPacketPool;
+  }
+}
+
+void QuicServerTransport::setConnectionIdPool(
+    ConnectionIdPool* connectionIdPool) noexcept {
+  if (serverConn_) {
+    serverConn_->connectionIdPool = connectionIdPool;
+  }
+}
+
+void QuicServerTransport::setTransportParametersCache(
+    ServerTransportParametersCache* transportParametersCache) noexcept {
+  if (serverConn_) {
+    serverConn_->transportParametersCache = transportParametersCache;
+  }
+}
+
+void QuicServerTransport::disableEcn() noexcept {
+  if (conn_) {
+    conn_->transportSettings.enableEcn = false;
+    if (conn_->ecnState == QuicConnectionStateBase::EcnState::Enabled) {
+      // The marked packets still in flight are not validated any more.
+      conn_->ecnState = QuicConnectionStateBase::EcnState::Disabled;
+    }
+  }
+}
+
+void QuicServerTransport::setWriteBudgetScheduler(
+    WriteBudgetScheduler* writeBudgetScheduler) noexcept {
+  if (serverConn_) {
+    serverConn_->writeBudgetScheduler = writeBudgetScheduler;
+  }
+}
+
+void QuicServerTransport::setWriteShare(uint32_t weight, bool bulk) noexcept {
+  if (serverConn_) {
+    serverConn_->writeShare.weight = weight;
+    serverConn_->writeShare.bulk = bulk;
+  }
+}
+
 void QuicServerTransport::setCongestionControllerFactory(
     std::shared_ptr<CongestionControllerFactory> ccFactory) {
   CHECK(ccFactory);
@@ -94,14 +179,36 @@ void QuicServerTransport::setCongestionControllerFactory(
   }
 }
 
+void QuicServerTransport::setHandshakeExecutor(
+    folly::Executor* handshakeExecutor) {
+  serverConn_->serverHandshakeLayer->setHandshakeExecutor(handshakeExecutor);
+}
+
+void QuicServerTransport::setAppTokenCache(
+    std::shared_ptr<AppTokenCache> appTokenCache) {
+  appTokenCache_ = std::move(appTokenCache);
+}
+
 void QuicServerTransport::onReadData(
     const folly::SocketAddress& peer,
     NetworkData&& networkData) {
+  if (networkData.localAddress && !conn_->localAddress) {
+    // The peer keeps getting its packets from the address it first sent to.
+    conn_->localAddress = networkData.localAddress;
+  }
   ServerEvents::ReadData readData;
   readData.peer = peer;
   readData.networkData = std::move(networkData);
   onServerReadData(*serverConn_, readData);
   processPendingData(true);
+  if (conn_->ecnState == QuicConnectionStateBase::EcnState::Failed &&
+      conn_->transportSettings.enableEcn) {
+    // The worker stops marking the packets of all its connections.
+    conn_->transportSettings.enableEcn = false;
+    if (routingCb_) {
+      routingCb_->onEcnValidationFailed();
+    }
+  }
 
   if (closeState_ == CloseState::CLOSED) {
     return;
@@ -111,21 +218,122 @@ void QuicServerTransport::onReadData(
     routingCb_->onConnectionIdAvailable(
         shared_from_this(), *conn_->serverConnectionId);
   }
+  maybeResumeCongestionState();
   maybeWriteNewSessionTicket();
+  maybeWriteCongestionStateTicket();
   maybeNotifyConnectionIdBound();
   maybeNotifyTransportReady();
+  maybeUseDedicatedSocket();
+  reportMemoryUsage();
 }
 
-void QuicServerTransport::accept() {
+void QuicServerTransport::initializeConnection() {
   setIdleTimer();
   updateFlowControlStateWithSettings(
       conn_->flowControlState, conn_->transportSettings);
+  if (conn_->transportSettings.batchMaxStreamsCredit) {
+    conn_->streamManager->setMaxRemoteBidirectionalStreams(
+        conn_->transportSettings.advertisedInitialMaxStreamsBidi);
+    conn_->streamManager->setMaxRemoteUnidirectionalStreams(
+        conn_->transportSettings.advertisedInitialMaxStreamsUni);
+  }
+  // The worker only leaves ECN enabled if its socket marks the packets.
+  if (conn_->transportSettings.enableEcn) {
+    conn_->ecnState = QuicConnectionStateBase::EcnState::Enabled;
+    conn_->ecnMarking =
+        ecnMarkingFor(conn_->transportSettings.defaultCongestionController);
+  }
+}
+
+void QuicServerTransport::accept() {
+  initializeConnection();
+  serverConn_->serverHandshakeLayer->setCertificateCompression(
+      conn_->transportSettings.certificateCompression);
   serverConn_->serverHandshakeLayer->initialize(
       evb_,
       ctx_,
       this,
       std::make_unique<DefaultAppTokenValidator>(
-          serverConn_, std::move(earlyDataAppParamsValidator_)));
+          serverConn_,
+          std::move(earlyDataAppParamsValidator_),
+          appTokenCache_));
+}
+
+void QuicServerTransport::acceptHandoff(const ConnectionHandoffState& state) {
+  initializeConnection();
+  restoreConnectionHandoffState(*serverConn_, state);
+  // The process that ran the handshake wrote the tickets.
+  newSessionTicketWritten_ = true;
+  congestionStateTicketWritten_ = true;
+  notifiedRouting_ = true;
+  notifiedConnIdBound_ = true;
+  maybeNotifyTransportReady();
+}
+
+folly::Optional<ConnectionHandoffState>
+QuicServerTransport::getConnectionHandoffState() const {
+  if (closeState_ != CloseState::OPEN) {
+    return folly::none;
+  }
+  return quic::getConnectionHandoffState(*serverConn_);
+}
+
+void QuicServerTransport::closeForHandoff() {
+  // An abandoned connection is neither drained nor closed on the wire.
+  closeImpl(
+      std::make_pair(
+          QuicErrorCode(LocalErrorCode::CONNECTION_ABANDONED),
+          std::string("Connection handed off")),
+      false,
+      false);
+}
+
+folly::Optional<TimePoint> QuicServerTransport::getLastActivityTime() const {
+  const auto& lastReceived =
+      conn_->ackStates.appDataAckState.largestRecvdPacketTime;
+  auto lastSent = conn_->lossState.lastRetransmittablePacketSentTime;
+  if (lastReceived) {
+    return std::max(*lastReceived, lastSent);
+  }
+  if (lastSent == TimePoint()) {
+    return folly::none;
+  }
+  return lastSent;
+}
+
+bool QuicServerTransport::writeKeepalive() noexcept {
+  if (closeState_ != CloseState::OPEN) {
+    return false;
+  }
+  if (!socket_ || !conn_->oneRttWriteCipher || !conn_->clientConnectionId ||
+      !serverConn_->serverHandshakeLayer->isHandshakeDone() ||
+      !conn_->outstandingPackets.empty()) {
+    return true;
+  }
+  FOLLY_MAYBE_UNUSED auto self = sharedGuard();
+  try {
+    CHECK(conn_->oneRttWriteHeaderCipher);
+    auto written = writePingToSocket(
+        *socket_,
+        *conn_,
+        *conn_->clientConnectionId,
+        *conn_->oneRttWriteCipher,
+        *conn_->oneRttWriteHeaderCipher,
+        kKeepalivePacketSize,
+        false);
+    setLossDetectionAlarm(*conn_, *this);
+    if (written > 0) {
+      // As in writeSocketData, the first packet after quiescence.
+      setIdleTimer();
+      conn_->receivedNewPacketBeforeWrite = false;
+    }
+  } catch (const std::exception& ex) {
+    VLOG(4) << __func__ << " error=" << ex.what() << " " << *this;
+    closeImpl(std::make_pair(
+        QuicErrorCode(TransportErrorCode::INTERNAL_ERROR),
+        std::string(ex.what())));
+  }
+  return closeState_ == CloseState::OPEN;
 }
 
 void QuicServerTransport::writeData() {
@@ -179,9 +387,10 @@ void QuicServerTransport::writeData() {
     return;
   }
 
-  if (UNLIKELY(!conn_->initialWriteCipher)) {
+  if (UNLIKELY(!conn_->initialWriteCipher && !conn_->oneRttWriteCipher)) {
     // This would be possible if we read a packet from the network which
-    // could not be parsed later.
+    // could not be parsed later. A handed off connection only has the 1-RTT
+    // keys.
     return;
   }
 
@@ -189,52 +398,98 @@ void QuicServerTransport::writeData() {
       (isConnectionPaced(*conn_)
            ? conn_->pacer->updateAndGetWriteBatchSize(Clock::now())
            : conn_->transportSettings.writeConnectionDataPacketsLimit);
-  CryptoStreamScheduler initialScheduler(
-      *conn_, *getCryptoStream(*conn_->cryptoState, EncryptionLevel::Initial));
-  CryptoStreamScheduler handshakeScheduler(
-      *conn_,
-      *getCryptoStream(*conn_->cryptoState, EncryptionLevel::Handshake));
-  if (initialScheduler.hasData() ||
-      (conn_->ackStates.initialAckState.needsToSendAckImmediately &&
-       hasAcksToSchedule(conn_->ackStates.initialAckState))) {
-    CHECK(conn_->initialWriteCipher);
-    CHECK(conn_->initialHeaderCipher);
-    packetLimit -= writeCryptoAndAckDataToSocket(
-        *socket_,
-        *conn_,
-        srcConnId /* src */,
-        destConnId /* dst */,
-        LongHeader::Types::Initial,
-        *conn_->initialWriteCipher,
-        *conn_->initialHeaderCipher,
-        version,
-        packetLimit);
+  auto writeBudgetScheduler =
+      isConnectionPaced(*conn_) ? nullptr : serverConn_->writeBudgetScheduler;
+  if (writeBudgetScheduler && conn_->congestionController) {
+    packetLimit = writeBudgetScheduler->getPacketLimit(
+        serverConn_->writeShare,
+        conn_->congestionController->getWritableBytes() /
+        conn_->udpSendPacketLen);
   }
-  if (!packetLimit) {
-    return;
-  }
-  if (handshakeScheduler.hasData() ||
-      (conn_->ackStates.handshakeAckState.needsToSendAckImmediately &&
-       hasAcksToSchedule(conn_->ackStates.handshakeAckState))) {
-    CHECK(conn_->handshakeWriteCipher);
-    CHECK(conn_->handshakeWriteHeaderCipher);
-    packetLimit -= writeCryptoAndAckDataToSocket(
-        *socket_,
-        *conn_,
-        srcConnId /* src */,
-        destConnId /* dst */,
-        LongHeader::Types::Handshake,
-        *conn_->handshakeWriteCipher,
-        *conn_->handshakeWriteHeaderCipher,
-        version,
-        packetLimit);
+  auto budgetedPacketLimit = packetLimit;
+  SCOPE_EXIT {
+    // Send the packets left over for coalescing once all levels are written.
+    writeCoalescedPacketsToSocket(*socket_, *conn_);
+    if (!conn_->amplificationBlockedSince &&
+        isWritableBytesLimitReached(*conn_) &&
+        hasNonAckDataToWrite(*conn_) != WriteDataReason::NO_WRITE) {
+      conn_->amplificationBlockedSince = Clock::now();
+    }
+    if (writeBudgetScheduler) {
+      writeBudgetScheduler->onPacketsWritten(
+          budgetedPacketLimit - packetLimit);
+    }
+    reportMemoryUsage();
+  };
+  const auto& initialStream =
+      *getCryptoStream(*conn_->cryptoState, EncryptionLevel::Initial);
+  const auto& handshakeStream =
+      *getCryptoStream(*conn_->cryptoState, EncryptionLevel::Handshake);
+  CryptoStreamScheduler initialScheduler(*conn_, initialStream);
+  CryptoStreamScheduler handshakeScheduler(*conn_, handshakeStream);
+  auto writeInitial = [&] {
+    if (initialScheduler.hasData() ||
+        (conn_->ackStates.initialAckState.needsToSendAckImmediately &&
+         hasAcksToSchedule(conn_->ackStates.initialAckState))) {
+      CHECK(conn_->initialWriteCipher);
+      CHECK(conn_->initialHeaderCipher);
+      packetLimit -= writeCryptoAndAckDataToSocket(
+          *socket_,
+          *conn_,
+          srcConnId /* src */,
+          destConnId /* dst */,
+          LongHeader::Types::Initial,
+          *conn_->initialWriteCipher,
+          *conn_->initialHeaderCipher,
+          version,
+          packetLimit);
+    }
+  };
+  auto writeHandshake = [&] {
+    if (handshakeScheduler.hasData() ||
+        (conn_->ackStates.handshakeAckState.needsToSendAckImmediately &&
+         hasAcksToSchedule(conn_->ackStates.handshakeAckState))) {
+      CHECK(conn_->handshakeWriteCipher);
+      CHECK(conn_->handshakeWriteHeaderCipher);
+      packetLimit -= writeCryptoAndAckDataToSocket(
+          *socket_,
+          *conn_,
+          srcConnId /* src */,
+          destConnId /* dst */,
+          LongHeader::Types::Handshake,
+          *conn_->handshakeWriteCipher,
+          *conn_->handshakeWriteHeaderCipher,
+          version,
+          packetLimit);
+    }
+  };
+  // The client has most likely received the Initial data that was declared
+  // lost, while it cannot do without the Handshake data that was never sent.
+  bool handshakeFirst =
+      conn_->transportSettings.amplificationAwareHandshakeScheduling &&
+      conn_->writableBytesLimit && conn_->handshakeWriteCipher &&
+      initialStream.writeBuffer.empty() && !initialStream.lossBuffer.empty() &&
+      !handshakeStream.writeBuffer.empty();
+  if (handshakeFirst) {
+    writeHandshake();
+    if (!packetLimit) {
+      return;
+    }
   }
+  writeInitial();
   if (!packetLimit) {
     return;
   }
+  if (!handshakeFirst) {
+    writeHandshake();
+    if (!packetLimit) {
+      return;
+    }
+  }
+  maybeInitiateKeyUpdate(*conn_);
   if (conn_->oneRttWriteCipher) {
     CHECK(conn_->oneRttWriteHeaderCipher);
-    writeQuicDataToSocket(
+    auto written = writeQuicDataToSocket(
         *socket_,
         *conn_,
         srcConnId /* src */,
@@ -243,6 +498,7 @@ void QuicServerTransport::writeData() {
         *conn_->oneRttWriteHeaderCipher,
         version,
         packetLimit);
+    packetLimit -= std::min(written, packetLimit);
   }
 }
 
@@ -251,6 +507,8 @@ void QuicServerTransport::closeTransport() {
   // Clear out pending data.
   serverConn_->pendingZeroRttData.reset();
   serverConn_->pendingOneRttData.reset();
+  serverConn_->pendingZeroRttBytes = 0;
+  serverConn_->pendingOneRttBytes = 0;
   onServerClose(*serverConn_);
 }
 
@@ -258,6 +516,8 @@ void QuicServerTransport::unbindConnection() {
   if (routingCb_) {
     auto routingCb = routingCb_;
     routingCb_ = nullptr;
+    routingCb->onMemoryUsageChanged(reportedMemoryUsage_, 0);
+    reportedMemoryUsage_ = 0;
     CHECK(conn_->clientConnectionId);
     routingCb->onConnectionUnbound(
         std::make_pair(getOriginalPeerAddress(), *conn_->clientConnectionId),
@@ -273,6 +533,24 @@ std::shared_ptr<QuicTransportBase> QuicServerTransport::sharedGuard() {
   return shared_from_this();
 }
 
+void QuicServerTransport::reportMemoryUsage() {
+  if (!routingCb_) {
+    return;
+  }
+  auto usage = getMemoryUsage().total();
+  if (usage != reportedMemoryUsage_) {
+    routingCb_->onMemoryUsageChanged(reportedMemoryUsage_, usage);
+    reportedMemoryUsage_ = usage;
+  }
+}
+
+ConnectionMemoryUsage QuicServerTransport::getMemoryUsage() const {
+  auto usage = QuicTransportBase::getMemoryUsage();
+  usage.pendingPacketBytes =
+      serverConn_->pendingZeroRttBytes + serverConn_->pendingOneRttBytes;
+  return usage;
+}
+
 void QuicServerTransport::setClientConnectionId(
     const ConnectionId& clientConnectionId) {
   conn_->clientConnectionId.assign(clientConnectionId);
@@ -291,6 +569,7 @@ void QuicServerTransport::onCryptoEventAvailable() noexcept {
     if (closeState_ == CloseState::CLOSED) {
       return;
     }
+    maybeResumeCongestionState();
     maybeWriteNewSessionTicket();
     maybeNotifyConnectionIdBound();
     writeSocketData();
@@ -320,8 +599,11 @@ void QuicServerTransport::processPendingData(bool async) {
     // It's possible that 0-rtt packets are received after CFIN, we are not
     // dealing with that much level of reordering.
     serverConn_->pendingZeroRttData.reset();
+    serverConn_->pendingZeroRttBytes = 0;
+    serverConn_->pendingOneRttBytes = 0;
   } else if (conn_->readCodec && conn_->readCodec->getZeroRttReadCipher()) {
     pendingData = std::move(serverConn_->pendingZeroRttData);
+    serverConn_->pendingZeroRttBytes = 0;
   }
   if (pendingData) {
     // Move the pending data out so that we don't ever add new data to the
@@ -362,32 +644,91 @@ void QuicServerTransport::maybeWriteNewSessionTicket() {
     }
     QUIC_TRACE(fst_trace, *conn_, "write nst");
     newSessionTicketWritten_ = true;
-    AppToken appToken;
-    appToken.transportParams = createTicketTransportParameters(
-        conn_->transportSettings.idleTimeout.count(),
-        conn_->transportSettings.maxRecvPacketSize,
-        conn_->transportSettings.advertisedInitialConnectionWindowSize,
-        conn_->transportSettings.advertisedInitialBidiLocalStreamWindowSize,
-        conn_->transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
-        conn_->transportSettings.advertisedInitialUniStreamWindowSize,
-        std::numeric_limits<uint32_t>::max(),
-        std::numeric_limits<uint32_t>::max());
-    appToken.sourceAddresses = serverConn_->tokenSourceAddresses;
-    appToken.version = conn_->version;
-    // If a client connects to server for the first time and doesn't attempt
-    // early data, tokenSourceAddresses will not be set because
-    // validateAndUpdateSourceAddressToken is not called in this case.
-    // So checking if source address token is empty here and adding peerAddr
-    // if so.
-    // TODO accumulate recent source tokens
-    if (appToken.sourceAddresses.empty()) {
-      appToken.sourceAddresses.push_back(conn_->peerAddress.getIPAddress());
-    }
-    if (earlyDataAppParamsGetter_) {
-      appToken.appParams = earlyDataAppParamsGetter_();
-    }
-    serverConn_->serverHandshakeLayer->writeNewSessionTicket(appToken);
+    writeNewSessionTicket();
+  }
+}
+
+void QuicServerTransport::maybeResumeCongestionState() {
+  if (congestionStateResumed_ ||
+      !conn_->transportSettings.resumeCongestionState ||
+      !serverConn_->serverHandshakeLayer->isHandshakeDone()) {
+    return;
+  }
+  congestionStateResumed_ = true;
+  auto encodedToken = serverConn_->serverHandshakeLayer->getResumedAppToken();
+  if (!encodedToken) {
+    return;
+  }
+  auto appToken = appTokenCache_ ? appTokenCache_->getOrDecode(*encodedToken)
+                                 : decodeAppTokenForValidation(*encodedToken);
+  if (!appToken || !appToken->congestionState) {
+    return;
+  }
+  // Only a connection from an address the ticket was issued to is likely to
+  // be on the same path, and worth resuming the congestion state of.
+  const auto& sourceAddresses = appToken->sourceAddresses;
+  if (std::find(
+          sourceAddresses.begin(),
+          sourceAddresses.end(),
+          conn_->peerAddress.getIPAddress()) == sourceAddresses.end()) {
+    VLOG(10) << "Not resuming the congestion state of another address "
+             << *this;
+    return;
+  }
+  updateCongestionStateFromTicket(*serverConn_, *appToken->congestionState);
+}
+
+void QuicServerTransport::maybeWriteCongestionStateTicket() {
+  if (!newSessionTicketWritten_ || congestionStateTicketWritten_ ||
+      !conn_->transportSettings.resumeCongestionState ||
+      !conn_->congestionController) {
+    return;
+  }
+  auto initCwnd =
+      conn_->transportSettings.initCwndInMss * conn_->udpSendPacketLen;
+  if (conn_->congestionController->getCongestionWindow() >=
+      kCongestionStateTicketCwndGrowth * initCwnd) {
+    QUIC_TRACE(fst_trace, *conn_, "write congestion state nst");
+    congestionStateTicketWritten_ = true;
+    writeNewSessionTicket();
+  }
+}
+
+void QuicServerTransport::writeNewSessionTicket() {
+  AppToken appToken;
+  appToken.transportParams = createTicketTransportParameters(
+      conn_->transportSettings.idleTimeout.count(),
+      conn_->transportSettings.maxRecvPacketSize,
+      conn_->transportSettings.advertisedInitialConnectionWindowSize,
+      conn_->transportSettings.advertisedInitialBidiLocalStreamWindowSize,
+      conn_->transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
+      conn_->transportSettings.advertisedInitialUniStreamWindowSize,
+      std::numeric_limits<uint32_t>::max(),
+      std::numeric_limits<uint32_t>::max());
+  appToken.sourceAddresses = serverConn_->tokenSourceAddresses;
+  appToken.version = conn_->version;
+  // If a client connects to server for the first time and doesn't attempt
+  // early data, tokenSourceAddresses will not be set because
+  // validateAndUpdateSourceAddressToken is not called in this case.
+  // So checking if source address token is empty here and adding peerAddr
+  // if so.
+  // TODO accumulate recent source tokens
+  if (appToken.sourceAddresses.empty()) {
+    appToken.sourceAddresses.push_back(conn_->peerAddress.getIPAddress());
+  }
+  if (earlyDataAppParamsGetter_) {
+    appToken.appParams = earlyDataAppParamsGetter_();
+  }
+  if (conn_->transportSettings.resumeCongestionState &&
+      conn_->congestionController && conn_->lossState.srtt.count() > 0) {
+    appToken.congestionState = TicketCongestionState{
+        conn_->lossState.srtt,
+        conn_->lossState.mrtt,
+        conn_->congestionController->getCongestionWindow(),
+        std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch())};
   }
+  serverConn_->serverHandshakeLayer->writeNewSessionTicket(appToken);
 }
 
 void QuicServerTransport::maybeNotifyConnectionIdBound() {
@@ -399,6 +740,79 @@ void QuicServerTransport::maybeNotifyConnectionIdBound() {
   }
 }
 
+void QuicServerTransport::maybeUseDedicatedSocket() {
+  if (sharedSocket_ && conn_->peerAddress != dedicatedSocketPeer_) {
+    // The socket is connected to the old address, the packets to the new
+    // one leave through the shared socket again.
+    VLOG(4) << "Peer address changed, back to the shared socket " << *this;
+    socket_->pauseRead();
+    socket_->close();
+    socket_ = std::move(sharedSocket_);
+    return;
+  }
+  auto threshold = conn_->transportSettings.dedicatedSocketMinBytesSent;
+  // The ECN codepoints of the packets read from the socket of the connection
+  // are not reported, so ECN connections stay on the shared socket.
+  if (threshold == 0 || dedicatedSocketRequested_ || !routingCb_ ||
+      closeState_ != CloseState::OPEN || !conn_->oneRttWriteCipher ||
+      conn_->ecnState == QuicConnectionStateBase::EcnState::Enabled ||
+      conn_->lossState.totalBytesSent < threshold) {
+    return;
+  }
+  dedicatedSocketRequested_ = true;
+  auto sock =
+      routingCb_->makeDedicatedSocket(conn_->peerAddress, conn_->localAddress);
+  if (!sock) {
+    return;
+  }
+  VLOG(4) << "Moving to a socket of its own " << *this;
+  dedicatedSocketPeer_ = conn_->peerAddress;
+  sharedSocket_ = std::move(socket_);
+  socket_ = std::move(sock);
+  // Both send on the fd of the worker.
+  conn_->egressBatcher = nullptr;
+  conn_->zeroCopySender = nullptr;
+  socket_->resumeRead(&dedicatedSocketReader_);
+}
+
+void QuicServerTransport::DedicatedSocketReader::getReadBuffer(
+    void** buf,
+    size_t* len) noexcept {
+  auto& conn = *transport_.conn_;
+  auto size = conn.transportSettings.maxRecvPacketSize;
+  readBuffer_ = conn.bufferAllocator ? conn.bufferAllocator->getBuffer(size)
+                                     : folly::IOBuf::create(size);
+  *buf = readBuffer_->writableData();
+  *len = size;
+}
+
+void QuicServerTransport::DedicatedSocketReader::onDataAvailable(
+    const folly::SocketAddress& client,
+    size_t len,
+    bool truncated) noexcept {
+  auto receiveTime = Clock::now();
+  Buf data = std::move(readBuffer_);
+  if (truncated) {
+    return;
+  }
+  data->append(len);
+  // The packet may close the connection.
+  auto self = transport_.sharedGuard();
+  if (transport_.routingCb_) {
+    transport_.routingCb_->onDedicatedSocketData(
+        client, std::move(data), receiveTime);
+  } else {
+    transport_.onNetworkData(
+        client, NetworkData(std::move(data), receiveTime));
+  }
+}
+
+void QuicServerTransport::DedicatedSocketReader::onReadError(
+    const folly::AsyncSocketException& ex) noexcept {
+  VLOG(4) << "Read error on the socket of " << transport_ << ": "
+          << ex.what();
+}
+
 void QuicServerTransport::maybeNotifyTransportReady() {
   if (!transportReadyNotified_ && connCallback_ && hasWriteCipher()) {
     if (conn_->qLogger) {
@@ -12,6 +12,9 @@
 #include <quic/api/QuicTransportFunctions.h>
 #include <quic/codec/ConnectionIdAlgo.h>
 #include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/server/ConnectionHandoff.h>
+#include <quic/server/KeepaliveScheduler.h>
+#include <quic/server/handshake/AppTokenCache.h>
 #include <quic/server/handshake/ServerTransportParametersExtension.h>
 #include <quic/server/state/ServerStateMachine.h>
 #include <quic/state/QuicTransportStatsCallback.h>
@@ -21,6 +24,7 @@ namespace quic {
 class QuicServerTransport
     : public QuicTransportBase,
       public ServerHandshake::HandshakeCallback,
+      public KeepaliveScheduler::Connection,
       public std::enable_shared_from_this<QuicServerTransport> {
  public:
   using Ptr = std::shared_ptr<QuicServerTransport>;
@@ -43,6 +47,35 @@ class QuicServerTransport
     virtual void onConnectionUnbound(
         const SourceIdentity& address,
         folly::Optional<ConnectionId> connectionId) noexcept = 0;
+
+    // Called when the connection has sent enough to get a socket of its own,
+    // connected to peer, and bound to localAddress if the connection knows
+    // which local address the peer sends to. Returns nullptr to keep the
+    // shared socket.
+    virtual std::unique_ptr<folly::AsyncUDPSocket> makeDedicatedSocket(
+        const folly::SocketAddress& /* peer */,
+        const folly::Optional<folly::IPAddress>& /* localAddress */) noexcept {
+      return nullptr;
+    }
+
+    // Called with the packets read from the socket of the connection, which
+    // are routed like the ones read from the shared socket.
+    virtual void onDedicatedSocketData(
+        const folly::SocketAddress& /* peer */,
+        Buf /* data */,
+        const TimePoint& /* receiveTime */) noexcept {}
+
+    // Called when the acks of the connection failed ECN validation. The
+    // socket is shared, so its marking can only be cleared for all the
+    // connections at once.
+    virtual void onEcnValidationFailed() noexcept {}
+
+    // Called when the memory held by the connection, as returned by
+    // getMemoryUsage, changed from previousBytes to bytes. It is reported
+    // after the connection reads and writes, and as 0 once it is unbound.
+    virtual void onMemoryUsageChanged(
+        uint64_t /* previousBytes */,
+        uint64_t /* bytes */) noexcept {}
   };
 
   static QuicServerTransport::Ptr make(
@@ -87,6 +120,68 @@ class QuicServerTransport
   void setCongestionControllerFactory(
       std::shared_ptr<CongestionControllerFactory> factory) override;
 
+  /**
+   * Set the batcher that the packets of this connection are handed to instead
+   * of being written to the socket directly.
+   */
+  void setEgressBatcher(EgressBatcher* egressBatcher) noexcept;
+  void setZeroCopySender(ZeroCopySender* zeroCopySender) noexcept;
+
+  /**
+   * Set the helper threads that the 1-RTT packets of this connection are
+   * encrypted on.
+   */
+  void setEncryptionPipeline(EncryptionPipeline* encryptionPipeline) noexcept;
+
+  /**
+   * Set the allocator that the packets of this connection are built in.
+   */
+  void setBufferAllocator(BufferAllocator* bufferAllocator) noexcept;
+
+  /**
+   * Set the pool that the packets which cannot be decrypted yet are buffered
+   * in.
+   */
+  void setPendingPacketPool(PendingPacketPool* pendingPacketPool) noexcept;
+
+  void setConnectionIdPool(ConnectionIdPool* connectionIdPool) noexcept;
+
+  /**
+   * Set the cache of the encoded transport parameters of the worker's
+   * settings.
+   */
+  void setTransportParametersCache(
+      ServerTransportParametersCache* transportParametersCache) noexcept;
+
+  void setWriteBudgetScheduler(
+      WriteBudgetScheduler* writeBudgetScheduler) noexcept;
+
+  /**
+   * Stops expecting ECN marks on the packets of the connection, for when the
+   * socket no longer marks them.
+   */
+  void disableEcn() noexcept;
+
+  /**
+   * Set how this connection shares the write budget of the worker with its
+   * other connections, for example to keep the bulk traffic of one tenant
+   * from delaying the interactive traffic of another. It has no effect if
+   * the worker has no write budget.
+   */
+  void setWriteShare(uint32_t weight, bool bulk) noexcept;
+
+  /**
+   * Set the executor that the expensive part of the TLS handshake runs on.
+   * This must be set before the transport accepts the connection.
+   */
+  void setHandshakeExecutor(folly::Executor* handshakeExecutor);
+
+  /**
+   * Set the cache that the app tokens of resumed connections are decoded
+   * through. This must be set before the transport accepts the connection.
+   */
+  void setAppTokenCache(std::shared_ptr<AppTokenCache> appTokenCache);
+
   virtual void setClientConnectionId(const ConnectionId& clientConnectionId);
 
   // From QuicTransportBase
@@ -97,12 +192,46 @@ class QuicServerTransport
   void unbindConnection() override;
   bool hasWriteCipher() const override;
   std::shared_ptr<QuicTransportBase> sharedGuard() override;
+  ConnectionMemoryUsage getMemoryUsage() const override;
 
   const fizz::server::FizzServerContext& getCtx() {
     return *ctx_;
   }
 
   virtual void accept();
+
+  /**
+   * Accepts a connection that another process handed off, in place of
+   * accept(). The connection is established from the start, and is routed by
+   * its server connection id without the routing callback being told.
+   */
+  virtual void acceptHandoff(const ConnectionHandoffState& state);
+
+  /**
+   * Returns the state to hand the connection off with, or none if it is not
+   * at rest.
+   */
+  folly::Optional<ConnectionHandoffState> getConnectionHandoffState() const;
+
+  /**
+   * Closes the connection after it was handed off, without telling the peer
+   * which carries on with the other process.
+   */
+  void closeForHandoff();
+
+  /**
+   * The time the connection last sent or received a packet, if it did.
+   */
+  folly::Optional<TimePoint> getLastActivityTime() const override;
+
+  /**
+   * Sends a PING straight to the socket, without going through the write
+   * loop and its frame scheduler and flow control checks. Nothing is sent
+   * before the handshake is done, or while packets are in flight since their
+   * acks keep the connection alive as well.
+   */
+  bool writeKeepalive() noexcept override;
+
   void setShedConnection() {
     shedConnection_ = true;
   }
@@ -115,18 +244,62 @@ class QuicServerTransport
   virtual void onCryptoEventAvailable() noexcept override;
 
  private:
+  void initializeConnection();
   void processPendingData(bool async);
+  // Warm starts a resumed connection from the congestion state in its ticket
+  // once the handshake is done, whether it sent early data or not.
+  void maybeResumeCongestionState();
   void maybeWriteNewSessionTicket();
+  // Writes a second ticket with the congestion state once the cwnd has grown
+  // enough for it to be worth resuming.
+  void maybeWriteCongestionStateTicket();
+  void writeNewSessionTicket();
   void maybeNotifyConnectionIdBound();
   void maybeNotifyTransportReady();
+  // Moves the connection to a socket of its own once it has sent
+  // dedicatedSocketMinBytesSent, and back to the shared socket if the peer
+  // address changes.
+  void maybeUseDedicatedSocket();
+  void reportMemoryUsage();
+
+  class DedicatedSocketReader : public folly::AsyncUDPSocket::ReadCallback {
+   public:
+    explicit DedicatedSocketReader(QuicServerTransport& transport)
+        : transport_(transport) {}
+
+    void getReadBuffer(void** buf, size_t* len) noexcept override;
+
+    void onDataAvailable(
+        const folly::SocketAddress& client,
+        size_t len,
+        bool truncated) noexcept override;
+
+    void onReadError(const folly::AsyncSocketException& ex) noexcept override;
+
+    void onReadClosed() noexcept override {}
+
+   private:
+    QuicServerTransport& transport_;
+    Buf readBuffer_;
+  };
 
  private:
   RoutingCallback* routingCb_{nullptr};
   std::shared_ptr<const fizz::server::FizzServerContext> ctx_;
+  std::shared_ptr<AppTokenCache> appTokenCache_;
   bool notifiedRouting_{false};
   bool notifiedConnIdBound_{false};
   bool newSessionTicketWritten_{false};
+  bool congestionStateTicketWritten_{false};
+  bool congestionStateResumed_{false};
   bool shedConnection_{false};
+  bool dedicatedSocketRequested_{false};
+  // The memory usage last given to the routing callback.
+  uint64_t reportedMemoryUsage_{0};
+  // The worker socket, kept while the connection uses a socket of its own.
+  std::unique_ptr<folly::AsyncUDPSocket> sharedSocket_;
+  folly::SocketAddress dedicatedSocketPeer_;
+  DedicatedSocketReader dedicatedSocketReader_{*this};
   QuicServerConnectionState* serverConn_;
 };
 } // namespace quic
@@ -9,10 +9,13 @@
 #include <folly/io/Cursor.h>
 #include <folly/system/ThreadId.h>
 #include <quic/QuicConstants.h>
+#include <quic/api/QuicSocketTimestamps.h>
+#include <quic/common/LoopTime.h>
 #include <quic/common/Timers.h>
 
 #include <quic/server/QuicServerWorker.h>
 #include <quic/server/handshake/StatelessResetGenerator.h>
+#include <quic/state/PathMtuDiscovery.h>
 
 namespace quic {
 
@@ -28,13 +31,18 @@ void QuicServerWorker::setSocket(
     std::unique_ptr<folly::AsyncUDPSocket> socket) {
   socket_ = std::move(socket);
   evb_ = socket_->getEventBase();
+  // A socket taken over from another process is bound already.
+  if (socket_->isBound()) {
+    setSocketDontFragment(*socket_, transportSettings_.turnoffPMTUD);
+  }
 }
 
 void QuicServerWorker::bind(const folly::SocketAddress& address) {
   DCHECK(!supportedVersions_.empty());
   CHECK(socket_);
   socket_->bind(address);
-  socket_->dontFragment(true);
+  // The path MTU probes of pathMtuDiscovery rely on the DF bit.
+  setSocketDontFragment(*socket_, transportSettings_.turnoffPMTUD);
 }
 
 void QuicServerWorker::setTransportSettingsOverrideFn(
@@ -56,6 +64,10 @@ QuicTransportStatsCallback* QuicServerWorker::getTransportInfoCallback() const
 void QuicServerWorker::setConnectionIdAlgo(
     std::unique_ptr<ConnectionIdAlgo> connIdAlgo) noexcept {
   CHECK(connIdAlgo);
+  if (connectionIdPool_) {
+    // The pooled ids refer to the algo being replaced.
+    connectionIdPool_->clear();
+  }
   connIdAlgo_ = std::move(connIdAlgo);
 }
 
@@ -65,13 +77,199 @@ void QuicServerWorker::setCongestionControllerFactory(
   ccFactory_ = ccFactory;
 }
 
+void QuicServerWorker::setCongestionControlPolicy(
+    std::shared_ptr<CongestionControlPolicy> policy) {
+  ccPolicy_ = std::move(policy);
+}
+
+void QuicServerWorker::setHandshakeExecutor(
+    std::shared_ptr<folly::Executor> executor) {
+  handshakeExecutor_ = std::move(executor);
+}
+
+void QuicServerWorker::setAppTokenCache(
+    std::shared_ptr<AppTokenCache> appTokenCache) {
+  appTokenCache_ = std::move(appTokenCache);
+}
+
+void QuicServerWorker::setCongestionStateCache(
+    std::shared_ptr<CongestionStateCache> congestionStateCache) {
+  congestionStateCache_ = std::move(congestionStateCache);
+}
+
+void QuicServerWorker::setQLoggerFactory(
+    std::shared_ptr<QLoggerFactory> qLoggerFactory) {
+  qLoggerFactory_ = std::move(qLoggerFactory);
+}
+
+void QuicServerWorker::setLoopHealthMonitor(
+    LoopHealthMonitor::SharedPtr loopHealthMonitor) {
+  loopHealthMonitor_ = std::move(loopHealthMonitor);
+}
+
+LoopHealthMonitor* QuicServerWorker::getLoopHealthMonitor() const {
+  return loopHealthMonitor_.get();
+}
+
+void QuicServerWorker::setBufferAllocator(
+    std::shared_ptr<BufferAllocator> bufferAllocator) {
+  bufferAllocator_ = std::move(bufferAllocator);
+}
+
 void QuicServerWorker::start() {
   CHECK(socket_);
   if (transportSettings_.pacingEnabled && !pacingTimer_) {
     pacingTimer_ = TimerHighRes::newTimer(
         evb_, transportSettings_.pacingTimerTickInterval);
   }
-  socket_->resumeRead(this);
+  if (transportSettings_.batchWritesAcrossConnections && !egressBatcher_) {
+    egressBatcher_ = std::make_unique<EgressBatcher>(
+        evb_, *socket_, transportSettings_.maxBatchSize);
+  }
+  if (transportSettings_.pacingEnabled &&
+      transportSettings_.sharedPacingScheduler && !pacingScheduler_) {
+    pacingScheduler_ = std::make_shared<PacingScheduler>(pacingTimer_);
+    // The connections paced in a wakeup leave in the same batches.
+    pacingScheduler_->setDrainCallback([this] {
+      if (egressBatcher_) {
+        egressBatcher_->flush();
+      }
+    });
+  }
+  if (transportSettings_.pacingEnabled && transportSettings_.pacingUseTxTime &&
+      !TxTimePacketBatchWriter::enableTxTime(socket_->getNetworkSocket())) {
+    LOG(WARNING) << "SO_TXTIME not supported, worker=" << this;
+    transportSettings_.pacingUseTxTime = false;
+  }
+  if (transportSettings_.zeroCopySend && !zeroCopySender_) {
+    zeroCopySender_ = std::make_unique<ZeroCopySender>(*socket_);
+    if (!zeroCopySender_->enabled()) {
+      LOG(WARNING) << "MSG_ZEROCOPY not supported, worker=" << this;
+      zeroCopySender_.reset();
+    }
+  }
+  if (transportSettings_.maxPendingPacketBytes > 0 && !pendingPacketPool_) {
+    pendingPacketPool_ = std::make_unique<PendingPacketPool>(
+        kPendingPacketSlabSize, transportSettings_.maxPendingPacketBytes);
+  }
+  if (transportSettings_.writeLoopPacketBudget > 0 && !writeBudgetScheduler_) {
+    writeBudgetScheduler_ = std::make_unique<WriteBudgetScheduler>(
+        evb_,
+        transportSettings_.writeLoopPacketBudget,
+        transportSettings_.writeLoopTimeBudget,
+        transportSettings_.writeConnectionDataPacketsLimit);
+  }
+  if (transportSettings_.sharedCongestionControl && ccFactory_ &&
+      !sharedCongestionManager_) {
+    sharedCongestionManager_ =
+        std::make_shared<SharedCongestionManager>(ccFactory_);
+  }
+  if (transportSettings_.keepaliveInterval.count() > 0 &&
+      !keepaliveScheduler_) {
+    keepaliveScheduler_ = std::make_unique<KeepaliveScheduler>(
+        evb_, transportSettings_.keepaliveInterval);
+  }
+  if (transportSettings_.hibernateIdleConnectionsAfter.count() > 0 &&
+      !hibernationTimeout_) {
+    hibernationTimeout_ = std::make_unique<HibernationTimeout>(this, evb_);
+    hibernationTimeout_->scheduleTimeout(
+        transportSettings_.hibernateIdleConnectionsAfter);
+  }
+  if (transportSettings_.connectionIdPoolSize > 0 && !connectionIdPool_) {
+    connectionIdPool_ = std::make_unique<ConnectionIdPool>(
+        evb_, transportSettings_.connectionIdPoolSize);
+  }
+  if (transportSettings_.encryptionPipelineThreads > 0 &&
+      !encryptionPipeline_) {
+    encryptionPipeline_ = std::make_unique<EncryptionPipeline>(
+        transportSettings_.encryptionPipelineThreads,
+        kEncryptionPipelineDepth);
+  }
+  if (transportSettings_.hugePageBufferBytes > 0 && !bufferAllocator_) {
+    bufferAllocator_ = std::make_shared<HugePageBufferAllocator>(
+        transportSettings_.hugePageBufferBytes);
+  }
+  bool groEnabled = false;
+  if (transportSettings_.enableUdpGRO) {
+    groEnabled = QuicBatchReader::enableGRO(socket_->getNetworkSocket());
+    if (!groEnabled) {
+      LOG(WARNING) << "UDP GRO not supported, worker=" << this;
+    }
+  }
+  if (transportSettings_.enableEcn) {
+    auto family = socket_->address().getFamily();
+    auto marking =
+        ecnMarkingFor(transportSettings_.defaultCongestionController);
+    if (!setEcnMarking(socket_->getNetworkSocket(), family, marking) ||
+        !QuicBatchReader::enableEcn(socket_->getNetworkSocket(), family)) {
+      LOG(WARNING) << "ECN not supported, worker=" << this;
+      setEcnMarking(socket_->getNetworkSocket(), family, EcnCodepoint::NotEct);
+      transportSettings_.enableEcn = false;
+    }
+  }
+  if (transportSettings_.kernelTimestamps &&
+      !enableRxTimestamps(
+          socket_->getNetworkSocket(),
+          transportSettings_.hardwareTimestamps)) {
+    LOG(WARNING) << "SO_TIMESTAMPING not supported, worker=" << this;
+    transportSettings_.kernelTimestamps = false;
+  }
+  if ((infoCallback_ || loopHealthMonitor_ ||
+       transportSettings_.overloadRetryLoopTime.count() > 0 ||
+       transportSettings_.overloadRejectLoopTime.count() > 0 ||
+       transportSettings_.overloadDropLoopTime.count() > 0) &&
+      !loopTimeObserver_) {
+    loopTimeObserver_ =
+        std::make_shared<LoopTimeObserver>(this, evb_->getObserver());
+    evb_->setObserver(loopTimeObserver_);
+  }
+  if (transportSettings_.busyPollBudget.count() > 0 &&
+      !QuicBatchReader::enableBusyPoll(
+          socket_->getNetworkSocket(), transportSettings_.busyPollBudget)) {
+    // Spinning in user space still saves the wakeups.
+    LOG(WARNING) << "SO_BUSY_POLL not supported, worker=" << this;
+  }
+  if (transportSettings_.recvQueueStats &&
+      !QuicBatchReader::enableRxQueueOverflow(socket_->getNetworkSocket())) {
+    LOG(WARNING) << "SO_RXQ_OVFL not supported, worker=" << this;
+    transportSettings_.recvQueueStats = false;
+  }
+  if (transportSettings_.usePacketInfo &&
+      !QuicBatchReader::enablePacketInfo(
+          socket_->getNetworkSocket(), socket_->address().getFamily())) {
+    LOG(WARNING) << "Packet info not supported, worker=" << this;
+    transportSettings_.usePacketInfo = false;
+  }
+  if (groEnabled || transportSettings_.enableEcn ||
+      transportSettings_.kernelTimestamps || transportSettings_.usePacketInfo ||
+      transportSettings_.recvQueueStats ||
+      transportSettings_.shouldUseRecvmmsgForBatchRecv ||
+      transportSettings_.busyPollBudget.count() > 0) {
+    // Batched reads go straight to the socket with recvmmsg, so that the
+    // ancillary data carrying the GRO segment size, the ECN codepoint, the
+    // receive time, the destination address and the kernel drops is visible
+    // to us. The AsyncUDPSocket is then only used for writing.
+    batchReader_ = std::make_unique<QuicBatchReader>(
+        transportSettings_.maxRecvBatchSize,
+        groEnabled ? kMaxGROBufferSize : transportSettings_.maxRecvPacketSize,
+        groEnabled,
+        transportSettings_.enableEcn,
+        transportSettings_.kernelTimestamps,
+        transportSettings_.usePacketInfo,
+        transportSettings_.recvQueueStats);
+    batchReader_->setBufferAllocator(bufferAllocator_.get());
+    readHandler_ = std::make_unique<BatchReadHandler>(
+        this, evb_, socket_->getNetworkSocket());
+    readHandler_->registerHandler(
+        folly::EventHandler::READ | folly::EventHandler::PERSIST);
+  } else {
+    if (zeroCopySender_) {
+      // Readability of the error queue wakes up the read of the socket, the
+      // completions have to be taken off it there.
+      socket_->setErrMessageCallback(this);
+    }
+    socket_->resumeRead(this);
+  }
   VLOG(10) << "Registered read on worker=" << this
            << " thread=" << folly::getCurrentThreadID()
            << " processId=" << (int)processId_;
@@ -79,6 +277,9 @@ void QuicServerWorker::start() {
 
 void QuicServerWorker::pauseRead() {
   CHECK(socket_);
+  if (readHandler_) {
+    readHandler_->unregisterHandler();
+  }
   socket_->pauseRead();
 }
 
@@ -93,7 +294,19 @@ const folly::SocketAddress& QuicServerWorker::getAddress() const {
 }
 
 void QuicServerWorker::getReadBuffer(void** buf, size_t* len) noexcept {
-  readBuffer_ = folly::IOBuf::create(transportSettings_.maxRecvPacketSize);
+  if (bufferAllocator_) {
+    readBuffer_ =
+        bufferAllocator_->getBuffer(transportSettings_.maxRecvPacketSize);
+  } else if (transportSettings_.readBufferPoolSize > 0) {
+    if (!readBufferPool_) {
+      readBufferPool_ = std::make_unique<BufferPool>(
+          transportSettings_.maxRecvPacketSize,
+          transportSettings_.readBufferPoolSize);
+    }
+    readBuffer_ = readBufferPool_->getBuffer();
+  } else {
+    readBuffer_ = folly::IOBuf::create(transportSettings_.maxRecvPacketSize);
+  }
   *buf = readBuffer_->writableData();
   *len = transportSettings_.maxRecvPacketSize;
 }
@@ -105,6 +318,7 @@ void QuicServerWorker::onDataAvailable(
   // TODO: we can get better receive time accuracy than this, with
   // SO_TIMESTAMP or SIOCGSTAMP.
   auto packetReceiveTime = Clock::now();
+  ScopedLoopTime loopTime(packetReceiveTime);
   VLOG(10) << "Worker=" << this
            << " Received data on thread=" << folly::getCurrentThreadID()
            << " processId=" << (int)processId_;
@@ -122,10 +336,113 @@ void QuicServerWorker::onDataAvailable(
   handleNetworkData(client, std::move(data), packetReceiveTime);
 }
 
+int QuicServerWorker::readBatchFromSocket() noexcept {
+  if (shutdown_ || !socket_ || !batchReader_) {
+    return 0;
+  }
+  // Keep track of the time the batch was read, the packets without a kernel
+  // receive time share it.
+  auto packetReceiveTime = Clock::now();
+  ScopedLoopTime loopTime(packetReceiveTime);
+  readingPacketTrains_ = transportSettings_.processPacketTrains;
+  if (zeroCopySender_ && zeroCopySender_->numPendingBuffers() > 0) {
+    // The completions waiting in the error queue keep the socket readable.
+    zeroCopySender_->reapCompletions();
+  }
+  int ret = batchReader_->read(
+      socket_->getNetworkSocket(),
+      [&](const folly::SocketAddress& client,
+          Buf data,
+          EcnCodepoint ecn,
+          folly::Optional<TimePoint> receiveTime,
+          const folly::Optional<folly::IPAddress>& localAddress) {
+        auto len = data->length();
+        QUIC_STATS(infoCallback_, onPacketReceived);
+        QUIC_STATS(infoCallback_, onRead, len);
+        handleNetworkData(
+            client,
+            std::move(data),
+            receiveTime.value_or(packetReceiveTime),
+            ecn,
+            localAddress);
+      });
+  readingPacketTrains_ = false;
+  auto trainTransports = std::move(packetTrainTransports_);
+  packetTrainTransports_.clear();
+  for (auto& transport : trainTransports) {
+    transport->endNetworkDataTrain();
+  }
+  if (ret < 0) {
+    onReadError(folly::AsyncSocketException(
+        folly::AsyncSocketException::INTERNAL_ERROR,
+        "recvmmsg failed",
+        errno));
+    return ret;
+  }
+  if (ret > 0) {
+    QUIC_STATS(infoCallback_, onReadBatch, ret);
+  }
+  if (ret > 0 && transportSettings_.recvQueueStats) {
+    updateRecvQueueStats(packetReceiveTime);
+  }
+  if (ret > 0 && transportSettings_.busyPollBudget.count() > 0 &&
+      !busyPollCallback_.isLoopCallbackScheduled()) {
+    evb_->runInLoop(&busyPollCallback_);
+  }
+  return ret;
+}
+
+void QuicServerWorker::updateRecvQueueStats(TimePoint now) noexcept {
+  auto fd = socket_->getNetworkSocket();
+  // The count wraps around, as the kernel's does.
+  uint32_t drops = batchReader_->rxQueueDrops() - lastRxQueueDrops_;
+  lastRxQueueDrops_ = batchReader_->rxQueueDrops();
+  if (drops > 0) {
+    QUIC_STATS(infoCallback_, onKernelPacketsDropped, drops);
+  }
+  if (drops > 0 && transportSettings_.maxRecvBufferSize > 0) {
+    if (now - recvBufferDropsWindowStart_ > kRecvBufferGrowthInterval) {
+      recvBufferDropsWindowStart_ = now;
+      recvBufferDropsInWindow_ = 0;
+    }
+    recvBufferDropsInWindow_ += drops;
+    if (recvBufferDropsInWindow_ >= kRecvBufferGrowthDrops) {
+      recvBufferDropsWindowStart_ = now;
+      recvBufferDropsInWindow_ = 0;
+      auto size = QuicBatchReader::growRecvBuffer(
+          fd, transportSettings_.maxRecvBufferSize);
+      if (size) {
+        LOG(INFO) << "Grew the receive buffer to " << *size
+                  << " after kernel drops, worker=" << this;
+      }
+    }
+  }
+  if (now - lastRecvBufferSample_ >= kRecvBufferSampleInterval) {
+    lastRecvBufferSample_ = now;
+    auto usage = QuicBatchReader::getRecvBufferUsage(fd);
+    if (usage) {
+      QUIC_STATS(
+          infoCallback_, onRecvBufferOccupancy, usage->usedBytes, usage->size);
+    }
+  }
+}
+
+void QuicServerWorker::BusyPollCallback::runLoopCallback() noexcept {
+  auto deadline = Clock::now() + worker_->transportSettings_.busyPollBudget;
+  while (!worker_->shutdown_ && Clock::now() < deadline) {
+    // A read that gets packets schedules the next round itself.
+    if (worker_->readBatchFromSocket() != 0) {
+      return;
+    }
+  }
+}
+
 void QuicServerWorker::handleNetworkData(
     const folly::SocketAddress& client,
     Buf data,
-    const TimePoint& packetReceiveTime) noexcept {
+    const TimePoint& packetReceiveTime,
+    EcnCodepoint ecn,
+    const folly::Optional<folly::IPAddress>& localAddress) noexcept {
   try {
     if (shutdown_) {
       VLOG(4) << "Packet received after shutdown, dropping";
@@ -167,7 +484,8 @@ void QuicServerWorker::handleNetworkData(
       return forwardNetworkData(
           client,
           std::move(routingData),
-          NetworkData(std::move(data), packetReceiveTime));
+          NetworkData(
+              std::move(data), packetReceiveTime, ecn, localAddress));
     }
 
     folly::Expected<ParsedLongHeaderInvariant, TransportErrorCode>
@@ -182,17 +500,26 @@ void QuicServerWorker::handleNetworkData(
     bool isUsingClientConnId =
         isInitial || longHeaderType == LongHeader::Types::ZeroRtt;
 
-    folly::Optional<std::pair<VersionNegotiationPacket, Buf>>
-        versionNegotiationPacket;
-    if (rejectNewConnections_ && isInitial) {
-      VersionNegotiationPacketBuilder builder(
-          parsedLongHeader->invariant.dstConnId,
-          parsedLongHeader->invariant.srcConnId,
-          std::vector<QuicVersion>{QuicVersion::MVFST_INVALID});
-      versionNegotiationPacket =
-          folly::make_optional(std::move(builder).buildPacket());
-    }
-    if (!versionNegotiationPacket) {
+    // The versions to negotiate, if the packet is answered with a version
+    // negotiation packet.
+    const std::vector<QuicVersion>* negotiationVersions = nullptr;
+    auto overloadLevel = isInitial ? getOverloadLevel() : OverloadLevel::NONE;
+    if (overloadLevel == OverloadLevel::DROP) {
+      // Nothing about the connection is looked at, so that the established
+      // ones keep the worker's time.
+      VLOG(4) << "Dropping initial of overloaded worker client=" << client;
+      QUIC_STATS(
+          infoCallback_, onPacketDropped, PacketDropReason::WORKER_OVERLOADED);
+      return;
+    }
+    if (isInitial &&
+        (rejectNewConnections_ || overloadLevel == OverloadLevel::REJECT ||
+         isOverMemoryBudget())) {
+      static const std::vector<QuicVersion> kRejectVersions{
+          QuicVersion::MVFST_INVALID};
+      negotiationVersions = &kRejectVersions;
+    }
+    if (!negotiationVersions) {
       bool negotiationNeeded =
           std::find(
               supportedVersions_.begin(),
@@ -205,21 +532,31 @@ void QuicServerWorker::handleNetworkData(
         return;
       }
       if (negotiationNeeded) {
-        VersionNegotiationPacketBuilder builder(
-            parsedLongHeader->invariant.dstConnId,
-            parsedLongHeader->invariant.srcConnId,
-            supportedVersions_);
-        versionNegotiationPacket =
-            folly::make_optional(std::move(builder).buildPacket());
+        negotiationVersions = &supportedVersions_;
       }
     }
-    if (versionNegotiationPacket) {
+    if (negotiationVersions) {
+      if (!statelessResponder_.allowResponse()) {
+        VLOG(4) << "Not sending version negotiation to client=" << client
+                << ", rate limited";
+        QUIC_STATS(
+            infoCallback_,
+            onPacketDropped,
+            PacketDropReason::STATELESS_RESPONSE_RATE_LIMITED);
+        return;
+      }
+      auto versionNegotiationPacket =
+          statelessResponder_.buildVersionNegotiationPacket(
+              parsedLongHeader->invariant.dstConnId,
+              parsedLongHeader->invariant.srcConnId,
+              *negotiationVersions);
       VLOG(4) << "Version negotiation sent to client=" << client;
-      auto len = versionNegotiationPacket->second->computeChainDataLength();
+      auto len = versionNegotiationPacket->computeChainDataLength();
       QUIC_STATS(infoCallback_, onWrite, len);
       QUIC_STATS(infoCallback_, onPacketProcessed);
       QUIC_STATS(infoCallback_, onPacketSent);
-      socket_->write(client, std::move(versionNegotiationPacket->second));
+      writeFromSource(
+          *socket_, client, versionNegotiationPacket, localAddress);
       return;
     }
 
@@ -239,7 +576,8 @@ void QuicServerWorker::handleNetworkData(
     return forwardNetworkData(
         client,
         std::move(routingData),
-        NetworkData(std::move(data), packetReceiveTime));
+        NetworkData(
+            std::move(data), packetReceiveTime, ecn, localAddress));
   } catch (const std::exception& ex) {
     // Drop the packet.
     QUIC_STATS(infoCallback_, onPacketDropped, PacketDropReason::PARSE_ERROR);
@@ -304,6 +642,39 @@ void QuicServerWorker::setPacingTimer(
   pacingTimer_ = std::move(pacingTimer);
 }
 
+QuicServerWorker::ForwardedPacketResult QuicServerWorker::queueForwardedPacket(
+    const folly::SocketAddress& client,
+    RoutingData&& routingData,
+    NetworkData&& networkData) {
+  if (numForwardedPackets_.fetch_add(1) >= kMaxForwardedPacketsQueued) {
+    numForwardedPackets_.fetch_sub(1);
+    return ForwardedPacketResult::DROPPED;
+  }
+  ForwardedPacket packet;
+  packet.client = client;
+  packet.routingData = std::move(routingData);
+  packet.networkData = std::move(networkData);
+  forwardedPackets_.enqueue(std::move(packet));
+  return forwardedPacketsScheduled_.exchange(true)
+      ? ForwardedPacketResult::QUEUED
+      : ForwardedPacketResult::NEEDS_DISPATCH;
+}
+
+void QuicServerWorker::dispatchForwardedPackets() noexcept {
+  DCHECK(evb_->isInEventBaseThread());
+  // Cleared first, a packet queued after the last dequeue below schedules
+  // another run.
+  forwardedPacketsScheduled_.store(false);
+  ForwardedPacket packet;
+  while (forwardedPackets_.try_dequeue(packet)) {
+    numForwardedPackets_.fetch_sub(1);
+    dispatchPacketData(
+        packet.client,
+        std::move(*packet.routingData),
+        std::move(packet.networkData));
+  }
+}
+
 void QuicServerWorker::dispatchPacketData(
     const folly::SocketAddress& client,
     RoutingData&& routingData,
@@ -316,6 +687,12 @@ void QuicServerWorker::dispatchPacketData(
     transport = cit->second;
     VLOG(10) << "Found existing connection for CID="
              << routingData.destinationConnId.hex() << " " << *transport;
+  } else if (
+      !hibernatedConnections_.empty() &&
+      (transport =
+           wakeHibernatedConnection(routingData.destinationConnId))) {
+    VLOG(4) << "Woke hibernated connection for CID="
+            << routingData.destinationConnId.hex() << " " << *transport;
   } else if (routingData.headerForm != HeaderForm::Long) {
     // Drop the packet if the header form is not long
     VLOG(3) << "Dropping non-long header packet with no connid match CID="
@@ -360,36 +737,11 @@ void QuicServerWorker::dispatchPacketData(
               infoCallback_, onPacketDropped, PacketDropReason::INVALID_PACKET);
           return;
         }
-        // create 'accepting' transport
-        auto sock = makeSocket(getEventBase());
-        auto trans = transportFactory_->make(
-            getEventBase(), std::move(sock), client, ctx_);
-        trans->setPacingTimer(pacingTimer_);
-        trans->setRoutingCallback(this);
-        trans->setSupportedVersions(supportedVersions_);
-        trans->setOriginalPeerAddress(client);
-        trans->setCongestionControllerFactory(ccFactory_);
-        if (transportSettingsOverrideFn_) {
-          folly::Optional<TransportSettings> overridenTransportSettings =
-              transportSettingsOverrideFn_(
-                  transportSettings_, client.getIPAddress());
-          if (overridenTransportSettings) {
-            trans->setTransportSettings(*overridenTransportSettings);
-          } else {
-            trans->setTransportSettings(transportSettings_);
-          }
-        } else {
-          trans->setTransportSettings(transportSettings_);
-        }
-        trans->setConnectionIdAlgo(connIdAlgo_.get());
-        trans->setClientConnectionId(*routingData.sourceConnId);
-        // parameters to create server chosen connection id
-        ServerConnectionIdParams serverConnIdParams(
-            hostId_, static_cast<uint8_t>(processId_), workerId_);
-        trans->setServerConnectionIdParams(std::move(serverConnIdParams));
-        if (infoCallback_) {
-          trans->setTransportInfoCallback(infoCallback_.get());
+        if (maybeSendRetry(client, routingData, networkData)) {
+          return;
         }
+        // create 'accepting' transport
+        auto trans = makeTransport(client, *routingData.sourceConnId);
         trans->accept();
         auto result = sourceAddressMap_.emplace(std::make_pair(
             std::make_pair(client, *routingData.sourceConnId), trans));
@@ -408,6 +760,14 @@ void QuicServerWorker::dispatchPacketData(
   }
   if (LIKELY(!dropPacket)) {
     DCHECK(transport->getEventBase()->isInEventBaseThread());
+    if (readingPacketTrains_ &&
+        std::find(
+            packetTrainTransports_.begin(),
+            packetTrainTransports_.end(),
+            transport) == packetTrainTransports_.end()) {
+      transport->beginNetworkDataTrain();
+      packetTrainTransports_.push_back(transport);
+    }
     transport->onNetworkData(client, std::move(networkData));
     return;
   }
@@ -463,6 +823,101 @@ void QuicServerWorker::dispatchPacketData(
   QUIC_STATS(infoCallback_, onPacketForwarded);
 }
 
+QuicServerTransport::Ptr QuicServerWorker::makeTransport(
+    const folly::SocketAddress& client,
+    const ConnectionId& clientConnectionId) {
+  auto sock = makeSocket(getEventBase());
+  auto trans = transportFactory_->make(
+      getEventBase(), std::move(sock), client, ctx_);
+  trans->setPacingTimer(pacingTimer_);
+  if (pacingScheduler_) {
+    trans->setPacingScheduler(pacingScheduler_);
+  }
+  if (writeBudgetScheduler_) {
+    trans->setWriteBudgetScheduler(writeBudgetScheduler_.get());
+  }
+  if (keepaliveScheduler_) {
+    keepaliveScheduler_->addConnection(trans);
+  }
+  if (loopHealthMonitor_) {
+    trans->setLoopHealthMonitor(loopHealthMonitor_);
+  }
+  trans->setRoutingCallback(this);
+  trans->setSupportedVersions(supportedVersions_);
+  trans->setOriginalPeerAddress(client);
+  if (sharedCongestionManager_) {
+    trans->setCongestionControllerFactory(sharedCongestionManager_);
+  } else {
+    trans->setCongestionControllerFactory(ccFactory_);
+  }
+  if (ccPolicy_) {
+    trans->setCongestionControlPolicy(ccPolicy_);
+  }
+  if (handshakeExecutor_) {
+    trans->setHandshakeExecutor(handshakeExecutor_.get());
+  }
+  if (appTokenCache_) {
+    trans->setAppTokenCache(appTokenCache_);
+  }
+  folly::Optional<TransportSettings> overridenTransportSettings;
+  if (transportSettingsOverrideFn_) {
+    overridenTransportSettings = transportSettingsOverrideFn_(
+        transportSettings_, client.getIPAddress());
+  }
+  auto cachedState = congestionStateCache_
+      ? congestionStateCache_->get(client.getIPAddress())
+      : nullptr;
+  if (cachedState) {
+    if (!overridenTransportSettings) {
+      overridenTransportSettings = transportSettings_;
+    }
+    applyCongestionState(*cachedState, *overridenTransportSettings);
+    VLOG(4) << "Warm starting connection from client=" << client
+            << " initCwndInMss=" << overridenTransportSettings->initCwndInMss;
+  }
+  if (overridenTransportSettings) {
+    trans->setTransportSettings(*overridenTransportSettings);
+  } else {
+    trans->setTransportSettings(transportSettings_);
+  }
+  trans->setConnectionIdAlgo(connIdAlgo_.get());
+  if (egressBatcher_) {
+    trans->setEgressBatcher(egressBatcher_.get());
+  }
+  if (zeroCopySender_) {
+    trans->setZeroCopySender(zeroCopySender_.get());
+  }
+  if (encryptionPipeline_) {
+    trans->setEncryptionPipeline(encryptionPipeline_.get());
+  }
+  if (bufferAllocator_) {
+    trans->setBufferAllocator(bufferAllocator_.get());
+  }
+  if (pendingPacketPool_) {
+    trans->setPendingPacketPool(pendingPacketPool_.get());
+  }
+  if (connectionIdPool_) {
+    trans->setConnectionIdPool(connectionIdPool_.get());
+  }
+  trans->setTransportParametersCache(&transportParametersCache_);
+  trans->setClientConnectionId(clientConnectionId);
+  if (qLoggerFactory_) {
+    auto qLogger =
+        qLoggerFactory_->make(client, clientConnectionId);
+    if (qLogger) {
+      trans->setQLogger(std::move(qLogger));
+    }
+  }
+  // parameters to create server chosen connection id
+  ServerConnectionIdParams serverConnIdParams(
+      hostId_, static_cast<uint8_t>(processId_), workerId_);
+  trans->setServerConnectionIdParams(std::move(serverConnIdParams));
+  if (infoCallback_) {
+    trans->setTransportInfoCallback(infoCallback_.get());
+  }
+  return trans;
+}
+
 void QuicServerWorker::sendResetPacket(
     const HeaderForm& headerForm,
     const folly::SocketAddress& client,
@@ -476,19 +931,90 @@ void QuicServerWorker::sendResetPacket(
   uint16_t maxResetPacketSize = std::min<uint16_t>(
       std::max<uint16_t>(kMinStatelessPacketSize, packetSize),
       kDefaultUDPSendPacketLen);
-  CHECK(transportSettings_.statelessResetTokenSecret.hasValue());
-  StatelessResetGenerator generator(
-      *transportSettings_.statelessResetTokenSecret,
-      getAddress().getFullyQualified());
-  StatelessResetToken token = generator.generateToken(connId);
-  StatelessResetPacketBuilder builder(maxResetPacketSize, token);
-  auto resetData = std::move(builder).buildPacket();
-  socket_->write(client, std::move(resetData));
-  QUIC_STATS(infoCallback_, onWrite, resetData->computeChainDataLength());
+  if (!statelessResponder_.allowResponse()) {
+    // The packet was already counted as dropped.
+    VLOG(4) << "Not sending stateless reset to client=" << client
+            << ", rate limited";
+    return;
+  }
+  if (!statelessResetGenerator_) {
+    CHECK(transportSettings_.statelessResetTokenSecret.hasValue());
+    statelessResetGenerator_.emplace(
+        *transportSettings_.statelessResetTokenSecret,
+        getAddress().getFullyQualified());
+  }
+  auto resetData = statelessResponder_.buildResetPacket(
+      *statelessResetGenerator_, connId, maxResetPacketSize);
+  auto resetLen = resetData->computeChainDataLength();
+  writeFromSource(*socket_, client, resetData, networkData.localAddress);
+  QUIC_STATS(infoCallback_, onWrite, resetLen);
   QUIC_STATS(infoCallback_, onPacketSent);
   QUIC_STATS(infoCallback_, onStatelessReset);
 }
 
+bool QuicServerWorker::maybeSendRetry(
+    const folly::SocketAddress& client,
+    const RoutingData& routingData,
+    const NetworkData& networkData) {
+  // The connections whose client has not switched to the server chosen
+  // connection id yet are the ones still handshaking.
+  if (!retryTokenGenerator_) {
+    return false;
+  }
+  if (getOverloadLevel() < OverloadLevel::RETRY &&
+      (transportSettings_.retryPendingHandshakeThreshold == 0 ||
+       sourceAddressMap_.size() <
+           transportSettings_.retryPendingHandshakeThreshold)) {
+    return false;
+  }
+  folly::io::Cursor cursor(networkData.data.get());
+  uint8_t initialByte = cursor.readBE<uint8_t>();
+  auto parsedHeader = parseLongHeader(initialByte, cursor);
+  if (!parsedHeader || !parsedHeader->parsedLongHeader) {
+    QUIC_STATS(
+        infoCallback_, onPacketDropped, PacketDropReason::INVALID_PACKET);
+    return true;
+  }
+  const auto& header = parsedHeader->parsedLongHeader->header;
+  if (header.hasToken()) {
+    if (retryTokenGenerator_->validateToken(
+            *header.getToken(),
+            client.getIPAddress(),
+            routingData.destinationConnId)) {
+      return false;
+    }
+    VLOG(4) << "Dropping initial with invalid retry token from client="
+            << client;
+    QUIC_STATS(
+        infoCallback_, onPacketDropped, PacketDropReason::INVALID_RETRY_TOKEN);
+    return true;
+  }
+
+  ServerConnectionIdParams connIdParams(
+      hostId_, static_cast<uint8_t>(processId_), workerId_);
+  auto retryConnId = connIdAlgo_->encodeConnectionId(connIdParams);
+  LongHeader retryHeader(
+      LongHeader::Types::Retry,
+      retryConnId,
+      *routingData.sourceConnId,
+      0 /* packetNum */,
+      header.getVersion(),
+      retryTokenGenerator_->generateToken(client.getIPAddress(), retryConnId),
+      routingData.destinationConnId);
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen, std::move(retryHeader), 0 /* largestAcked */);
+  auto packet = std::move(builder).buildPacket();
+  auto retryData = std::move(packet.header);
+  retryData->prependChain(std::move(packet.body));
+  VLOG(4) << "Retry sent to client=" << client;
+  QUIC_STATS(infoCallback_, onWrite, retryData->computeChainDataLength());
+  QUIC_STATS(infoCallback_, onRetrySent);
+  QUIC_STATS(infoCallback_, onPacketProcessed);
+  QUIC_STATS(infoCallback_, onPacketSent);
+  writeFromSource(*socket_, client, retryData, networkData.localAddress);
+  return true;
+}
+
 void QuicServerWorker::allowBeingTakenOver(
     std::unique_ptr<folly::AsyncUDPSocket> socket,
     const folly::SocketAddress& address) {
@@ -507,6 +1033,9 @@ void QuicServerWorker::allowBeingTakenOver(
 void QuicServerWorker::startPacketForwarding(
     const folly::SocketAddress& destAddr) {
   packetForwardingEnabled_ = true;
+  if (transportSettings_.batchTakeoverPackets) {
+    takeoverPktHandler_.enableBatching(transportSettings_.maxBatchSize);
+  }
   takeoverPktHandler_.setDestination(destAddr);
 }
 
@@ -515,6 +1044,123 @@ void QuicServerWorker::stopPacketForwarding() {
   takeoverPktHandler_.stop();
 }
 
+size_t QuicServerWorker::handOffConnections(
+    folly::Function<bool(const folly::IOBuf&)> sendState) {
+  if (shutdown_) {
+    return 0;
+  }
+  // Closing a connection takes it out of the map.
+  std::vector<QuicServerTransport::Ptr> transports;
+  transports.reserve(connectionIdMap_.size());
+  for (auto& it : connectionIdMap_) {
+    transports.push_back(it.second);
+  }
+  size_t numHandedOff = 0;
+  for (auto& transport : transports) {
+    auto state = transport->getConnectionHandoffState();
+    if (!state) {
+      continue;
+    }
+    auto buf = encodeConnectionHandoffState(*state);
+    if (!sendState(*buf)) {
+      VLOG(2) << "Failed to hand off connection " << *transport;
+      continue;
+    }
+    transport->closeForHandoff();
+    numHandedOff++;
+  }
+  VLOG(4) << "Handed off " << numHandedOff << " of " << transports.size()
+          << " connections, workerId=" << (uint32_t)workerId_;
+  return numHandedOff;
+}
+
+bool QuicServerWorker::acceptConnectionHandoff(
+    const ConnectionHandoffState& state) {
+  if (shutdown_ || connectionIdMap_.count(state.serverConnectionId)) {
+    return false;
+  }
+  CHECK(transportFactory_);
+  auto transport =
+      makeTransport(state.originalPeerAddress, state.clientConnectionId);
+  transport->acceptHandoff(state);
+  onConnectionIdAvailable(transport, state.serverConnectionId);
+  VLOG(4) << "Accepted handed off connection " << *transport;
+  return true;
+}
+
+void QuicServerWorker::hibernateIdleConnections() {
+  auto hibernateAfter = transportSettings_.hibernateIdleConnectionsAfter;
+  if (shutdown_ || hibernateAfter.count() == 0) {
+    return;
+  }
+  auto now = Clock::now();
+  for (auto it = hibernatedConnections_.begin();
+       it != hibernatedConnections_.end();) {
+    if (it->second.idleDeadline <= now) {
+      // Their transport would have closed silently by now as well.
+      it = hibernatedConnections_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // Closing a connection takes it out of the map, and a connection is in
+  // it once for each of its connection ids.
+  std::vector<std::pair<QuicServerTransport::Ptr, TimePoint>> idle;
+  for (auto& it : connectionIdMap_) {
+    auto lastActivity = it.second->getLastActivityTime();
+    if (lastActivity && now - *lastActivity >= hibernateAfter) {
+      idle.emplace_back(it.second, *lastActivity);
+    }
+  }
+  size_t numHibernated = 0;
+  for (auto& transportAndTime : idle) {
+    auto& transport = transportAndTime.first;
+    auto state = transport->getConnectionHandoffState();
+    if (!state) {
+      continue;
+    }
+    auto idleTimeout = transportSettings_.idleTimeout;
+    if (state->peerIdleTimeout.count() > 0) {
+      idleTimeout = std::min(idleTimeout, state->peerIdleTimeout);
+    }
+    auto serverConnectionId = state->serverConnectionId;
+    HibernatedConnection hibernated;
+    hibernated.state = encodeConnectionHandoffState(*state);
+    hibernated.idleDeadline = transportAndTime.second + idleTimeout;
+    transport->closeForHandoff();
+    hibernatedConnections_[serverConnectionId] = std::move(hibernated);
+    numHibernated++;
+  }
+  VLOG_IF(4, numHibernated > 0)
+      << "Hibernated " << numHibernated << " connections, "
+      << hibernatedConnections_.size()
+      << " are hibernated, workerId=" << (uint32_t)workerId_;
+}
+
+QuicServerTransport::Ptr QuicServerWorker::wakeHibernatedConnection(
+    const ConnectionId& connId) {
+  auto it = hibernatedConnections_.find(connId);
+  if (it == hibernatedConnections_.end()) {
+    return nullptr;
+  }
+  auto stateBuf = std::move(it->second.state);
+  hibernatedConnections_.erase(it);
+  auto state = decodeConnectionHandoffState(*stateBuf);
+  if (!state || !acceptConnectionHandoff(*state)) {
+    LOG(ERROR) << "Failed to wake hibernated connection CID=" << connId.hex();
+    return nullptr;
+  }
+  auto cit = connectionIdMap_.find(connId);
+  return cit != connectionIdMap_.end() ? cit->second : nullptr;
+}
+
+void QuicServerWorker::HibernationTimeout::timeoutExpired() noexcept {
+  worker_->hibernateIdleConnections();
+  // Connections are hibernated at most half a period late.
+  auto period = worker_->transportSettings_.hibernateIdleConnectionsAfter / 2;
+  scheduleTimeout(std::max(period, std::chrono::milliseconds(1)));
+}
+
 void QuicServerWorker::onReadError(
     const folly::AsyncSocketException& ex) noexcept {
   VLOG(4) << "QuicServer readerr: " << ex.what();
@@ -529,6 +1175,18 @@ void QuicServerWorker::onReadClosed() noexcept {
   shutdownAllConnections(LocalErrorCode::SHUTTING_DOWN);
 }
 
+void QuicServerWorker::errMessage(const cmsghdr& cmsg) noexcept {
+  if (zeroCopySender_) {
+    zeroCopySender_->onErrMessage(cmsg);
+  }
+}
+
+void QuicServerWorker::errMessageError(
+    const folly::AsyncSocketException& ex) noexcept {
+  VLOG(4) << "Error reading the error queue, worker=" << this << " "
+          << ex.what();
+}
+
 int QuicServerWorker::getTakeoverHandlerSocketFD() {
   CHECK(takeoverCB_);
   return takeoverCB_->getSocketFD();
@@ -583,12 +1241,87 @@ void QuicServerWorker::setFizzContext(
 void QuicServerWorker::setTransportSettings(
     TransportSettings transportSettings) {
   transportSettings_ = transportSettings;
+  statelessResetGenerator_.clear();
+  statelessResponder_.clearResetTokens();
+  statelessResponder_.setMaxResponsesPerSecond(
+      transportSettings_.maxStatelessResponsesPerSecond);
+  if (transportSettings_.retryTokenSecret) {
+    retryTokenGenerator_.emplace(*transportSettings_.retryTokenSecret);
+  } else {
+    retryTokenGenerator_.clear();
+  }
 }
 
 void QuicServerWorker::rejectNewConnections(bool rejectNewConnections) {
   rejectNewConnections_ = rejectNewConnections;
 }
 
+void QuicServerWorker::setMemoryBudget(uint64_t memoryBudget) {
+  memoryBudget_ = memoryBudget;
+}
+
+uint64_t QuicServerWorker::getMemoryUsage() const {
+  return memoryUsage_;
+}
+
+bool QuicServerWorker::isOverMemoryBudget() const {
+  return memoryBudget_ != 0 && memoryUsage_ > memoryBudget_;
+}
+
+void QuicServerWorker::onLoopSample(std::chrono::microseconds busyTime) {
+  QUIC_STATS(infoCallback_, onLoopBusyTime, busyTime);
+  if (loopHealthMonitor_) {
+    loopHealthMonitor_->onSample(
+        LoopHealthMonitor::Metric::LoopBusyTime, busyTime);
+  }
+  loopBusyTime_ =
+      loopBusyTime_ * (kOverloadLoopTimeAlpha - 1) / kOverloadLoopTimeAlpha +
+      busyTime / kOverloadLoopTimeAlpha;
+  auto reached = [this](std::chrono::microseconds threshold) {
+    return threshold.count() > 0 && loopBusyTime_ >= threshold;
+  };
+  OverloadLevel overloadLevel = OverloadLevel::NONE;
+  if (reached(transportSettings_.overloadDropLoopTime)) {
+    overloadLevel = OverloadLevel::DROP;
+  } else if (reached(transportSettings_.overloadRejectLoopTime)) {
+    overloadLevel = OverloadLevel::REJECT;
+  } else if (reached(transportSettings_.overloadRetryLoopTime)) {
+    overloadLevel = OverloadLevel::RETRY;
+  }
+  if (overloadLevel != overloadLevel_) {
+    VLOG(2) << "Overload level=" << static_cast<int>(overloadLevel)
+            << " loopBusyTime=" << loopBusyTime_.count()
+            << "us worker=" << this;
+    overloadLevel_ = overloadLevel;
+  }
+}
+
+QuicServerWorker::OverloadLevel QuicServerWorker::getOverloadLevel() const {
+  return overloadLevel_;
+}
+
+void QuicServerWorker::setEventBaseObserver(
+    std::shared_ptr<folly::EventBaseObserver> observer) {
+  if (loopTimeObserver_) {
+    loopTimeObserver_->observer_ = std::move(observer);
+    return;
+  }
+  evb_->setObserver(std::move(observer));
+}
+
+uint32_t QuicServerWorker::LoopTimeObserver::getSampleRate() const {
+  return observer_ ? observer_->getSampleRate() : kOverloadLoopSampleRate;
+}
+
+void QuicServerWorker::LoopTimeObserver::loopSample(
+    int64_t busyTime,
+    int64_t idleTime) {
+  worker_->onLoopSample(std::chrono::microseconds(busyTime));
+  if (observer_) {
+    observer_->loopSample(busyTime, idleTime);
+  }
+}
+
 void QuicServerWorker::enablePartialReliability(bool enabled) {
   transportSettings_.partialReliabilityEnabled = enabled;
 }
@@ -610,6 +1343,65 @@ std::unique_ptr<folly::AsyncUDPSocket> QuicServerWorker::makeSocket(
   return socketFactory_->make(evb, fd);
 }
 
+std::unique_ptr<folly::AsyncUDPSocket> QuicServerWorker::makeDedicatedSocket(
+    const folly::SocketAddress& peer,
+    const folly::Optional<folly::IPAddress>& localAddress) noexcept {
+  if (shutdown_ || !socket_) {
+    return nullptr;
+  }
+  auto local = socket_->address();
+  if (localAddress) {
+    // The listening socket is bound to the wildcard address.
+    local = folly::SocketAddress(*localAddress, local.getPort());
+  }
+  auto sock = socketFactory_->makeConnected(evb_, local, peer);
+  if (sock && transportSettings_.pacingEnabled &&
+      transportSettings_.pacingUseTxTime &&
+      !TxTimePacketBatchWriter::enableTxTime(sock->getNetworkSocket())) {
+    // The connection would keep pacing with SO_TXTIME without it.
+    return nullptr;
+  }
+  return sock;
+}
+
+void QuicServerWorker::onDedicatedSocketData(
+    const folly::SocketAddress& peer,
+    Buf data,
+    const TimePoint& receiveTime) noexcept {
+  ScopedLoopTime loopTime(receiveTime);
+  QUIC_STATS(infoCallback_, onPacketReceived);
+  QUIC_STATS(infoCallback_, onRead, data->length());
+  handleNetworkData(peer, std::move(data), receiveTime);
+}
+
+void QuicServerWorker::onMemoryUsageChanged(
+    uint64_t previousBytes,
+    uint64_t bytes) noexcept {
+  DCHECK_GE(memoryUsage_, previousBytes);
+  memoryUsage_ = memoryUsage_ - previousBytes + bytes;
+}
+
+void QuicServerWorker::onEcnValidationFailed() noexcept {
+  if (!transportSettings_.enableEcn) {
+    return;
+  }
+  LOG(WARNING) << "ECN validation failed, clearing the marking of worker="
+               << this;
+  transportSettings_.enableEcn = false;
+  if (socket_) {
+    setEcnMarking(
+        socket_->getNetworkSocket(),
+        socket_->address().getFamily(),
+        EcnCodepoint::NotEct);
+  }
+  for (auto& it : sourceAddressMap_) {
+    it.second->disableEcn();
+  }
+  for (auto& it : connectionIdMap_) {
+    it.second->disableEcn();
+  }
+}
+
 const QuicServerWorker::ConnIdToTransportMap&
 QuicServerWorker::getConnectionIdMap() const {
   return connectionIdMap_;
@@ -657,6 +1449,21 @@ void QuicServerWorker::onConnectionUnbound(
     const QuicServerTransport::SourceIdentity& source,
     folly::Optional<ConnectionId> connectionId) noexcept {
   VLOG(4) << "Removing from sourceAddressMap_ address=" << source.first;
+  if (congestionStateCache_) {
+    auto it = sourceAddressMap_.find(source);
+    if (it != sourceAddressMap_.end()) {
+      auto info = it->second->getTransportInfo();
+      // Connections that never got an RTT sample have nothing to share.
+      if (info.srtt.count() > 0 &&
+          info.congestionWindow != std::numeric_limits<uint64_t>::max()) {
+        congestionStateCache_->update(
+            source.first.getIPAddress(),
+            info.srtt,
+            info.mrtt,
+            info.congestionWindow);
+      }
+    }
+  }
   // TODO: verify we are removing the right transport
   sourceAddressMap_.erase(source);
   if (connectionId) {
@@ -667,6 +1474,54 @@ void QuicServerWorker::onConnectionUnbound(
   }
 }
 
+void QuicServerWorker::closeAllConnectionsIncrementally(
+    LocalErrorCode error,
+    folly::Function<void()> onClosed) {
+  VLOG(4) << "QuicServer close all connections incrementally."
+          << " addressMap=" << sourceAddressMap_.size()
+          << " connectionIdMap=" << connectionIdMap_.size();
+  rejectNewConnections_ = true;
+  closeError_ = error;
+  onConnectionsClosed_ = std::move(onClosed);
+  // A connection is in both maps once it has a connection id.
+  std::unordered_set<QuicServerTransport*> transports;
+  connectionsToClose_.clear();
+  connectionsToClose_.reserve(sourceAddressMap_.size());
+  for (auto& it : sourceAddressMap_) {
+    if (transports.insert(it.second.get()).second) {
+      connectionsToClose_.push_back(it.second);
+    }
+  }
+  for (auto& it : connectionIdMap_) {
+    if (transports.insert(it.second.get()).second) {
+      connectionsToClose_.push_back(it.second);
+    }
+  }
+  if (!incrementalCloseCallback_.isLoopCallbackScheduled()) {
+    evb_->runInLoop(&incrementalCloseCallback_);
+  }
+}
+
+void QuicServerWorker::IncrementalCloseCallback::runLoopCallback() noexcept {
+  auto& connections = worker_->connectionsToClose_;
+  for (size_t i = 0; i < kMaxConnectionsClosedPerLoop && !connections.empty();
+       i++) {
+    auto transport = std::move(connections.back());
+    connections.pop_back();
+    transport->closeNow(std::make_pair(
+        QuicErrorCode(worker_->closeError_), std::string("shutting down")));
+  }
+  if (!connections.empty()) {
+    // Run again in the next iteration, after its I/O.
+    worker_->evb_->runInLoop(this);
+    return;
+  }
+  if (worker_->onConnectionsClosed_) {
+    auto onClosed = std::move(worker_->onConnectionsClosed_);
+    onClosed();
+  }
+}
+
 void QuicServerWorker::shutdownAllConnections(LocalErrorCode error) {
   VLOG(4) << "QuicServer shutdown all connections."
           << " addressMap=" << sourceAddressMap_.size()
@@ -675,6 +1530,13 @@ void QuicServerWorker::shutdownAllConnections(LocalErrorCode error) {
     return;
   }
   shutdown_ = true;
+  // Everything is closed below at once.
+  incrementalCloseCallback_.cancelLoopCallback();
+  connectionsToClose_.clear();
+  onConnectionsClosed_ = nullptr;
+  if (readHandler_) {
+    readHandler_->unregisterHandler();
+  }
   if (socket_) {
     socket_->pauseRead();
   }
@@ -682,8 +1544,29 @@ void QuicServerWorker::shutdownAllConnections(LocalErrorCode error) {
     takeoverCB_->pause();
   }
   callback_ = nullptr;
+  if (loopTimeObserver_ && evb_->getObserver() == loopTimeObserver_) {
+    evb_->setObserver(loopTimeObserver_->observer_);
+  }
+  loopTimeObserver_.reset();
+  if (pacingScheduler_) {
+    // Closed connections may outlive the worker and keep the scheduler.
+    pacingScheduler_->setDrainCallback(nullptr);
+  }
+  if (egressBatcher_) {
+    // The close packets of the connections below are written directly, the
+    // batcher goes away with the socket.
+    egressBatcher_->flush();
+  }
   for (auto& it : sourceAddressMap_) {
     auto transport = it.second;
+    transport->setEgressBatcher(nullptr);
+    transport->setZeroCopySender(nullptr);
+    transport->setEncryptionPipeline(nullptr);
+    transport->setBufferAllocator(nullptr);
+    transport->setPendingPacketPool(nullptr);
+    transport->setConnectionIdPool(nullptr);
+    transport->setTransportParametersCache(nullptr);
+    transport->setWriteBudgetScheduler(nullptr);
     transport->setRoutingCallback(nullptr);
     transport->setTransportInfoCallback(nullptr);
     transport->closeNow(
@@ -691,6 +1574,14 @@ void QuicServerWorker::shutdownAllConnections(LocalErrorCode error) {
   }
   for (auto& it : connectionIdMap_) {
     auto transport = it.second;
+    transport->setEgressBatcher(nullptr);
+    transport->setZeroCopySender(nullptr);
+    transport->setEncryptionPipeline(nullptr);
+    transport->setBufferAllocator(nullptr);
+    transport->setPendingPacketPool(nullptr);
+    transport->setConnectionIdPool(nullptr);
+    transport->setTransportParametersCache(nullptr);
+    transport->setWriteBudgetScheduler(nullptr);
     transport->setRoutingCallback(nullptr);
     transport->setTransportInfoCallback(nullptr);
     transport->closeNow(
@@ -699,10 +1590,23 @@ void QuicServerWorker::shutdownAllConnections(LocalErrorCode error) {
   }
   sourceAddressMap_.clear();
   connectionIdMap_.clear();
+  // The connections were detached above, they do not report any more.
+  memoryUsage_ = 0;
   takeoverPktHandler_.stop();
   if (infoCallback_) {
     infoCallback_.reset();
   }
+  egressBatcher_.reset();
+  connectionIdPool_.reset();
+  writeBudgetScheduler_.reset();
+  sharedCongestionManager_.reset();
+  keepaliveScheduler_.reset();
+  hibernationTimeout_.reset();
+  hibernatedConnections_.clear();
+  if (zeroCopySender_ && socket_) {
+    socket_->setErrMessageCallback(nullptr);
+  }
+  zeroCopySender_.reset();
   socket_.reset();
   takeoverCB_.reset();
 }
@@ -7,21 +7,45 @@
  */
 
 #pragma once
+#include <atomic>
 #include <unordered_map>
+#include <unordered_set>
 
+#include <folly/concurrency/UnboundedQueue.h>
+#include <folly/container/F14Map.h>
+#include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
 
+#include <quic/api/QuicBatchReader.h>
+#include <quic/api/QuicBatchWriter.h>
+#include <quic/api/QuicEncryptionPipeline.h>
 #include <quic/codec/ConnectionIdAlgo.h>
+#include <quic/common/BufferAllocator.h>
+#include <quic/common/BufferPool.h>
+#include <quic/common/LoopHealthMonitor.h>
+#include <quic/common/PacingScheduler.h>
+#include <quic/common/PendingPacketPool.h>
 #include <quic/common/Timers.h>
 #include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/server/CongestionStateCache.h>
+#include <quic/server/ConnectionIdPool.h>
+#include <quic/server/KeepaliveScheduler.h>
+#include <quic/server/QLoggerFactory.h>
 #include <quic/server/QuicServerPacketRouter.h>
 #include <quic/server/QuicServerTransportFactory.h>
 #include <quic/server/QuicUDPSocketFactory.h>
+#include <quic/server/SharedCongestionManager.h>
+#include <quic/server/StatelessResponder.h>
+#include <quic/server/WriteBudgetScheduler.h>
+#include <quic/server/handshake/RetryTokenGenerator.h>
 #include <quic/state/QuicTransportStatsCallback.h>
 
 namespace quic {
 
 class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
+                         public folly::AsyncUDPSocket::ErrMessageCallback,
                          public QuicServerTransport::RoutingCallback {
  public:
   using TransportSettingsOverrideFn =
@@ -114,6 +138,35 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
 
   TakeoverProtocolVersion getTakeoverProtocolVersion() const noexcept;
 
+  /**
+   * Hands the connections at rest off to the process taking over, so that
+   * their packets do not have to be forwarded until they drain. The state of
+   * each connection is passed to sendState, and the connections it returns
+   * true for are closed without telling the peer. Returns the number of
+   * connections handed off.
+   */
+  size_t handOffConnections(
+      folly::Function<bool(const folly::IOBuf&)> sendState);
+
+  /**
+   * Carries on a connection that another process handed off. Returns false
+   * if the worker is shut down or already has the connection id.
+   */
+  bool acceptConnectionHandoff(const ConnectionHandoffState& state);
+
+  /**
+   * Hibernates the connections at rest that have been idle for at least
+   * TransportSettings::hibernateIdleConnectionsAfter. They are closed as for
+   * a handoff, and their state is kept by the worker until their next packet
+   * makes a transport for them again, or until their idle timeout. Runs
+   * periodically once the worker is started with the setting.
+   */
+  void hibernateIdleConnections();
+
+  size_t getNumHibernatedConnections() const {
+    return hibernatedConnections_.size();
+  }
+
   /*
    * Sets the id of the server, that is later used in the routing of the packets
    * The id will be used to set a bit in the ConnectionId for routing.
@@ -160,6 +213,44 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
    */
   void rejectNewConnections(bool rejectNewConnections);
 
+  /**
+   * Reject new connections during handshake while the connections of this
+   * worker hold more than memoryBudget bytes. A budget of 0 disables this.
+   */
+  void setMemoryBudget(uint64_t memoryBudget);
+
+  enum class OverloadLevel : uint8_t {
+    NONE,
+    // New connections have to validate their address with a Retry first.
+    RETRY,
+    // New connections are rejected with a version negotiation packet.
+    REJECT,
+    // The Initials of new connections are dropped without an answer.
+    DROP,
+  };
+
+  /**
+   * Adds the busy time of an event loop iteration to the smoothed loop time
+   * of this worker, from which its overload level is set by the thresholds
+   * of the transport settings. Once started with any of them set, the worker
+   * samples its own event loop.
+   */
+  void onLoopSample(std::chrono::microseconds busyTime);
+
+  OverloadLevel getOverloadLevel() const;
+
+  /**
+   * Sets the EventBaseObserver of the worker's event base. It keeps being
+   * called while the worker samples the event loop for its overload level.
+   */
+  void setEventBaseObserver(std::shared_ptr<folly::EventBaseObserver> observer);
+
+  /**
+   * Returns the memory held by all the connections of this worker, as of
+   * their last read or write.
+   */
+  uint64_t getMemoryUsage() const;
+
   /**
    * Enable/disable partial reliability on connection settings.
    */
@@ -199,6 +290,59 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
   void setCongestionControllerFactory(
       std::shared_ptr<CongestionControllerFactory> factory);
 
+  /**
+   * Set the policy that switches the congestion controller of each
+   * connection, nullptr for none.
+   */
+  void setCongestionControlPolicy(
+      std::shared_ptr<CongestionControlPolicy> policy);
+
+  /**
+   * Set the executor that new connections run the expensive part of their
+   * TLS handshake on, so that it does not block the worker's event base.
+   * This must be set before the server starts (and accepts connections)
+   */
+  void setHandshakeExecutor(std::shared_ptr<folly::Executor> executor);
+
+  /**
+   * Set the cache, usually shared with the other workers, that new
+   * connections decode the app tokens of their tickets through.
+   * This must be set before the server starts (and accepts connections)
+   */
+  void setAppTokenCache(std::shared_ptr<AppTokenCache> appTokenCache);
+
+  /**
+   * Set the cache, usually shared with the other workers, that connections
+   * record their congestion state in when they end, and that new connections
+   * from the same subnet are warm started from.
+   * This must be set before the server starts (and accepts connections)
+   */
+  void setCongestionStateCache(
+      std::shared_ptr<CongestionStateCache> congestionStateCache);
+
+  /**
+   * Set the factory that decides which new connections get a QLogger.
+   * This must be set before the server starts (and accepts connections)
+   */
+  void setQLoggerFactory(std::shared_ptr<QLoggerFactory> qLoggerFactory);
+
+  /**
+   * Set the monitor of the worker's event loop, which its connections report
+   * their read and write delays to.
+   * This must be set before the server starts (and accepts connections)
+   */
+  void setLoopHealthMonitor(LoopHealthMonitor::SharedPtr loopHealthMonitor);
+
+  LoopHealthMonitor* getLoopHealthMonitor() const;
+
+  /**
+   * Set the allocator the receive buffers of the worker and the packets of
+   * its connections come from, instead of the HugePageBufferAllocator set up
+   * by hugePageBufferBytes.
+   * This must be set before the server starts (and accepts connections)
+   */
+  void setBufferAllocator(std::shared_ptr<BufferAllocator> bufferAllocator);
+
   // Read callback
   void getReadBuffer(void** buf, size_t* len) noexcept override;
 
@@ -231,26 +375,72 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
       const QuicServerTransport::SourceIdentity& source,
       folly::Optional<ConnectionId> connectionId) noexcept override;
 
+  std::unique_ptr<folly::AsyncUDPSocket> makeDedicatedSocket(
+      const folly::SocketAddress& peer,
+      const folly::Optional<folly::IPAddress>& localAddress) noexcept override;
+
+  void onDedicatedSocketData(
+      const folly::SocketAddress& peer,
+      Buf data,
+      const TimePoint& receiveTime) noexcept override;
+
+  /**
+   * Clears the ECN marking of the socket and disables ECN on all the
+   * connections, the current ones and the ones to come, as the marking
+   * cannot be set per connection.
+   */
+  void onEcnValidationFailed() noexcept override;
+
+  void onMemoryUsageChanged(uint64_t previousBytes, uint64_t bytes) noexcept
+      override;
+
   void onReadError(const folly::AsyncSocketException& ex) noexcept override;
 
   void onReadClosed() noexcept override;
 
+  // Only registered with zeroCopySend, for the completions of the sends.
+  void errMessage(const cmsghdr& cmsg) noexcept override;
+
+  void errMessageError(const folly::AsyncSocketException& ex) noexcept override;
+
   void dispatchPacketData(
       const folly::SocketAddress& client,
       RoutingData&& routingData,
       NetworkData&& networkData) noexcept;
 
-  using ConnIdToTransportMap = std::
-      unordered_map<ConnectionId, QuicServerTransport::Ptr, ConnectionIdHash>;
+  enum class ForwardedPacketResult : uint8_t {
+    QUEUED,
+    // The caller has to run dispatchForwardedPackets() on the worker's
+    // event base. Packets queued meanwhile are dispatched by that same run.
+    NEEDS_DISPATCH,
+    // The queue is full, the packet was dropped.
+    DROPPED,
+  };
+
+  /**
+   * Queues a packet routed to this worker from another thread, up to
+   * kMaxForwardedPacketsQueued of them. Thread safe.
+   */
+  ForwardedPacketResult queueForwardedPacket(
+      const folly::SocketAddress& client,
+      RoutingData&& routingData,
+      NetworkData&& networkData);
+
+  // Dispatches all the queued packets, on the worker's event base.
+  void dispatchForwardedPackets() noexcept;
+
+  // Every packet looks its connection up in these, they are open addressing
+  // maps so that a lookup does not chase the nodes of a bucket.
+  using ConnIdToTransportMap = folly::
+      F14FastMap<ConnectionId, QuicServerTransport::Ptr, ConnectionIdHash>;
 
   struct SourceIdentityHash {
     size_t operator()(const QuicServerTransport::SourceIdentity& sid) const {
       return folly::hash::hash_combine(
-          folly::hash::fnv32_buf(sid.second.data(), sid.second.size()),
-          sid.first.hash());
+          ConnectionIdHash()(sid.second), sid.first.hash());
     }
   };
-  using SrcToTransportMap = std::unordered_map<
+  using SrcToTransportMap = folly::F14FastMap<
       QuicServerTransport::SourceIdentity,
       QuicServerTransport::Ptr,
       SourceIdentityHash>;
@@ -261,6 +451,18 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
 
   void shutdownAllConnections(LocalErrorCode error);
 
+  /**
+   * Closes all the connections, kMaxConnectionsClosedPerLoop of them per
+   * event loop iteration, so that the worker keeps processing the packets of
+   * the others meanwhile. New connections are rejected. The connections
+   * unbind themselves from the worker as usual. Calls onClosed once the
+   * last one is closed. The worker keeps running, shutdownAllConnections()
+   * still has to be called to stop it.
+   */
+  void closeAllConnectionsIncrementally(
+      LocalErrorCode error,
+      folly::Function<void()> onClosed);
+
   // for unit test
   folly::AsyncUDPSocket::ReadCallback* getTakeoverHandlerCallback() {
     return takeoverCB_.get();
@@ -270,7 +472,10 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
   void handleNetworkData(
       const folly::SocketAddress& client,
       Buf data,
-      const TimePoint& receiveTime) noexcept;
+      const TimePoint& receiveTime,
+      EcnCodepoint ecn = EcnCodepoint::NotEct,
+      const folly::Optional<folly::IPAddress>& localAddress =
+          folly::none) noexcept;
 
   /**
    * Try handling the data as a health check.
@@ -298,6 +503,20 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
   }
 
  private:
+  /**
+   * Returns true if the connections of this worker use more memory than the
+   * memory budget.
+   */
+  bool isOverMemoryBudget() const;
+
+  /**
+   * Creates a transport for a connection from the client, with everything
+   * that the worker shares with its connections set.
+   */
+  QuicServerTransport::Ptr makeTransport(
+      const folly::SocketAddress& client,
+      const ConnectionId& clientConnectionId);
+
   /**
    * Creates accepting socket from this server's listening address.
    * This socket is powered by the same underlying eventbase
@@ -315,12 +534,71 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
       folly::EventBase* evb,
       int fd) const;
 
+  /**
+   * Reads up to transportSettings_.maxRecvBatchSize datagrams from the
+   * listening socket with a single recvmmsg call and hands them to
+   * handleNetworkData. Used instead of the AsyncUDPSocket read callback when
+   * batched reads or GRO are enabled.
+   */
+  int readBatchFromSocket() noexcept;
+
+  /**
+   * Reports the packets the kernel dropped since the last batch and, every
+   * kRecvBufferSampleInterval, the receive buffer occupancy. Grows the
+   * receive buffer when the drops go on, see maxRecvBufferSize.
+   */
+  void updateRecvQueueStats(TimePoint now) noexcept;
+
+  /**
+   * Keeps reading the socket after a batch of packets, for up to
+   * transportSettings_.busyPollBudget or until more packets arrive. It runs
+   * at the end of the loop iteration, once the connections have written.
+   */
+  class BusyPollCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit BusyPollCallback(QuicServerWorker* worker) : worker_(worker) {}
+
+    void runLoopCallback() noexcept override;
+
+   private:
+    QuicServerWorker* worker_;
+  };
+
+  class BatchReadHandler : public folly::EventHandler {
+   public:
+    BatchReadHandler(
+        QuicServerWorker* worker,
+        folly::EventBase* evb,
+        folly::NetworkSocket fd)
+        : folly::EventHandler(evb, fd), worker_(worker) {}
+
+    void handlerReady(uint16_t /* events */) noexcept override {
+      worker_->readBatchFromSocket();
+    }
+
+   private:
+    QuicServerWorker* worker_;
+  };
+
   void sendResetPacket(
       const HeaderForm& headerForm,
       const folly::SocketAddress& client,
       const NetworkData& networkData,
       const ConnectionId& connId);
 
+  /**
+   * Once the number of handshakes in progress reaches the Retry threshold,
+   * or the worker is overloaded, an Initial only creates a connection if it
+   * carries a valid Retry token.
+   * Initials without a token are answered with a Retry packet, and the ones
+   * with an invalid token are dropped. Returns true if the Initial must not
+   * create a connection.
+   */
+  bool maybeSendRetry(
+      const folly::SocketAddress& client,
+      const RoutingData& routingData,
+      const NetworkData& networkData);
+
   std::unique_ptr<folly::AsyncUDPSocket> socket_;
   std::shared_ptr<WorkerCallback> callback_;
   folly::EventBase* evb_{nullptr};
@@ -329,17 +607,139 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
   QuicUDPSocketFactory* socketFactory_;
   QuicServerTransportFactory* transportFactory_;
   std::shared_ptr<CongestionControllerFactory> ccFactory_{nullptr};
+  std::shared_ptr<CongestionControlPolicy> ccPolicy_;
+  // Wraps ccFactory_ with sharedCongestionControl
+  std::shared_ptr<SharedCongestionManager> sharedCongestionManager_;
+  std::shared_ptr<folly::Executor> handshakeExecutor_;
+  std::shared_ptr<AppTokenCache> appTokenCache_;
+  std::shared_ptr<CongestionStateCache> congestionStateCache_;
+  LoopHealthMonitor::SharedPtr loopHealthMonitor_;
+  std::shared_ptr<QLoggerFactory> qLoggerFactory_;
 
   ConnIdToTransportMap connectionIdMap_;
   SrcToTransportMap sourceAddressMap_;
 
+  struct ForwardedPacket {
+    folly::SocketAddress client;
+    // Always set, optional only to be default constructible.
+    folly::Optional<RoutingData> routingData;
+    NetworkData networkData;
+  };
+  // Packets routed from the other workers. Many producers, the worker as
+  // the only consumer.
+  folly::UMPSCQueue<ForwardedPacket, false /* MayBlock */> forwardedPackets_;
+  std::atomic<bool> forwardedPacketsScheduled_{false};
+  std::atomic<size_t> numForwardedPackets_{0};
+
   Buf readBuffer_;
+  // Recycles readBuffer_ once the packet it carried has been processed.
+  std::unique_ptr<BufferPool> readBufferPool_;
+  // Only set when hugePageBufferBytes is not zero or an allocator was
+  // plugged in. Takes precedence over readBufferPool_.
+  std::shared_ptr<BufferAllocator> bufferAllocator_;
+  // Only set when batchWritesAcrossConnections is enabled.
+  std::unique_ptr<EgressBatcher> egressBatcher_;
+  // Only set when zeroCopySend is enabled and supported by the socket.
+  std::unique_ptr<ZeroCopySender> zeroCopySender_;
+  // Only set when encryptionPipelineThreads is not zero.
+  std::unique_ptr<EncryptionPipeline> encryptionPipeline_;
+  // Bounds the packets buffered by all the connections until their keys are
+  // available. Only set when maxPendingPacketBytes is not zero.
+  std::unique_ptr<PendingPacketPool> pendingPacketPool_;
+  // Only set when connectionIdPoolSize is not zero.
+  std::unique_ptr<ConnectionIdPool> connectionIdPool_;
+  ServerTransportParametersCache transportParametersCache_;
+  std::unique_ptr<WriteBudgetScheduler> writeBudgetScheduler_;
+  // Only set when keepaliveInterval is not zero.
+  std::unique_ptr<KeepaliveScheduler> keepaliveScheduler_;
+  // Only set when hibernateIdleConnectionsAfter is not zero.
+  std::unique_ptr<HibernationTimeout> hibernationTimeout_;
+  struct HibernatedConnection {
+    // The encoded ConnectionHandoffState.
+    Buf state;
+    TimePoint idleDeadline;
+  };
+  std::unordered_map<ConnectionId, HibernatedConnection, ConnectionIdHash>
+      hibernatedConnections_;
+  // Only set when reading in batches with recvmmsg.
+  std::unique_ptr<QuicBatchReader> batchReader_;
+  std::unique_ptr<BatchReadHandler> readHandler_;
+  // Only used with recvQueueStats.
+  uint32_t lastRxQueueDrops_{0};
+  TimePoint lastRecvBufferSample_;
+  TimePoint recvBufferDropsWindowStart_;
+  uint64_t recvBufferDropsInWindow_{0};
+  // The connections that got packets in the batch being read, when they are
+  // processed as trains.
+  bool readingPacketTrains_{false};
+  std::vector<QuicServerTransport::Ptr> packetTrainTransports_;
+
+  class IncrementalCloseCallback : public folly::EventBase::LoopCallback {
+   public:
+    explicit IncrementalCloseCallback(QuicServerWorker* worker)
+        : worker_(worker) {}
+
+    void runLoopCallback() noexcept override;
+
+   private:
+    QuicServerWorker* worker_;
+  };
+
+  // Samples the event loop of the worker, then hands the samples on to the
+  // observer that was set on the event base, if any.
+  class LoopTimeObserver : public folly::EventBaseObserver {
+   public:
+    LoopTimeObserver(
+        QuicServerWorker* worker,
+        std::shared_ptr<folly::EventBaseObserver> observer)
+        : worker_(worker), observer_(std::move(observer)) {}
+
+    uint32_t getSampleRate() const override;
+
+    void loopSample(int64_t busyTime, int64_t idleTime) override;
+
+    QuicServerWorker* worker_;
+    std::shared_ptr<folly::EventBaseObserver> observer_;
+  };
+
+  class HibernationTimeout : public folly::AsyncTimeout {
+   public:
+    HibernationTimeout(QuicServerWorker* worker, folly::EventBase* evb)
+        : folly::AsyncTimeout(evb), worker_(worker) {}
+
+    void timeoutExpired() noexcept override;
+
+   private:
+    QuicServerWorker* worker_;
+  };
+
+  // Makes a transport from the state of a hibernated connection, returns
+  // null if the connection id is not one of theirs.
+  QuicServerTransport::Ptr wakeHibernatedConnection(
+      const ConnectionId& connId);
+
+  IncrementalCloseCallback incrementalCloseCallback_{this};
+  // Connections left to close by closeAllConnectionsIncrementally()
+  std::vector<QuicServerTransport::Ptr> connectionsToClose_;
+  LocalErrorCode closeError_{LocalErrorCode::SHUTTING_DOWN};
+  folly::Function<void()> onConnectionsClosed_;
+  BusyPollCallback busyPollCallback_{this};
   bool shutdown_{false};
   std::vector<QuicVersion> supportedVersions_;
   std::shared_ptr<const fizz::server::FizzServerContext> ctx_;
   TransportSettings transportSettings_;
   folly::Optional<Buf> healthCheckToken_;
   bool rejectNewConnections_{false};
+  uint64_t memoryBudget_{0};
+  // Memory usage of the connections, as they last reported it.
+  uint64_t memoryUsage_{0};
+  folly::Optional<RetryTokenGenerator> retryTokenGenerator_;
+  // Made on the first reset, once the address of the socket is known.
+  folly::Optional<StatelessResetGenerator> statelessResetGenerator_;
+  StatelessResponder statelessResponder_{0};
+  std::shared_ptr<LoopTimeObserver> loopTimeObserver_;
+  std::chrono::microseconds loopBusyTime_{0};
+  OverloadLevel overloadLevel_{OverloadLevel::NONE};
   uint8_t workerId_{0};
   std::unique_ptr<ConnectionIdAlgo> connIdAlgo_;
   uint16_t hostId_{0};
@@ -353,6 +753,7 @@ class QuicServerWorker : public folly::AsyncUDPSocket::ReadCallback,
   bool packetForwardingEnabled_{false};
   using PacketDropReason = QuicTransportStatsCallback::PacketDropReason;
   TimerHighRes::SharedPtr pacingTimer_;
+  PacingScheduler::SharedPtr pacingScheduler_;
 
   // Used to override certain transport parameters, given the client address
   TransportSettingsOverrideFn transportSettingsOverrideFn_;
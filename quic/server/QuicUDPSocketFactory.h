@@ -9,6 +9,7 @@
 #pragma once
 
 #include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/net/NetOps.h>
 
 namespace quic {
 
@@ -19,5 +20,37 @@ class QuicUDPSocketFactory {
   virtual std::unique_ptr<folly::AsyncUDPSocket> make(
       folly::EventBase* evb,
       int fd) = 0;
+
+  /**
+   * Makes a socket of its own for the connection with peer, bound to local,
+   * the address of the listening socket, and connected to peer. Returns
+   * nullptr if it cannot, for example because the listening socket does not
+   * use SO_REUSEPORT.
+   */
+  virtual std::unique_ptr<folly::AsyncUDPSocket> makeConnected(
+      folly::EventBase* evb,
+      const folly::SocketAddress& local,
+      const folly::SocketAddress& peer) {
+    auto sock = std::make_unique<folly::AsyncUDPSocket>(evb);
+    try {
+      sock->setReusePort(true);
+      sock->bind(local);
+    } catch (const std::exception& ex) {
+      VLOG(4) << "Cannot bind a connected socket to " << local << ": "
+              << ex.what();
+      return nullptr;
+    }
+    sockaddr_storage addr;
+    socklen_t addrLen = peer.getAddress(&addr);
+    if (folly::netops::connect(
+            sock->getNetworkSocket(),
+            reinterpret_cast<sockaddr*>(&addr),
+            addrLen) != 0) {
+      VLOG(4) << "Cannot connect a socket to " << peer << " errno=" << errno;
+      return nullptr;
+    }
+    sock->dontFragment(true);
+    return sock;
+  }
 };
 } // namespace quic
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/SharedCongestionManager.h>
+
+#include <quic/server/CongestionStateCache.h>
+#include <quic/state/StateData.h>
+
+#include <glog/logging.h>
+
+#include <algorithm>
+
+namespace quic {
+
+namespace {
+
+/**
+ * Runs the controller of a connection, and caps it to the share of its
+ * group.
+ */
+class SharedCongestionController : public CongestionController {
+ public:
+  SharedCongestionController(
+      QuicConnectionStateBase& conn,
+      std::unique_ptr<CongestionController> controller,
+      std::shared_ptr<SharedCongestionGroup> group)
+      : conn_(conn),
+        controller_(std::move(controller)),
+        group_(std::move(group)) {
+    group_->addMember(member());
+  }
+
+  ~SharedCongestionController() override {
+    group_->removeMember(controller_.get());
+  }
+
+  void onRemoveBytesFromInflight(uint64_t bytes) override {
+    removeBytesInFlight(bytes);
+    controller_->onRemoveBytesFromInflight(bytes);
+  }
+
+  void onPacketSent(const OutstandingPacket& packet) override {
+    bytesInFlight_ += packet.encodedSize;
+    controller_->onPacketSent(packet);
+  }
+
+  void onPacketAckOrLoss(
+      folly::Optional<AckEvent> ack,
+      folly::Optional<LossEvent> loss) override {
+    if (ack) {
+      removeBytesInFlight(ack->ackedBytes);
+    }
+    if (loss) {
+      removeBytesInFlight(loss->lostBytes);
+    }
+    controller_->onPacketAckOrLoss(std::move(ack), std::move(loss));
+    auto share = group_->getShare(member());
+    if (conn_.pacer && share < controller_->getCongestionWindow()) {
+      // Pace the share rather than the whole window of the controller.
+      conn_.pacer->refreshPacingRate(share, conn_.lossState.srtt);
+    }
+  }
+
+  uint64_t getWritableBytes() const override {
+    auto share = group_->getShare(member());
+    return std::min(
+        controller_->getWritableBytes(),
+        share > bytesInFlight_ ? share - bytesInFlight_ : 0);
+  }
+
+  uint64_t getCongestionWindow() const override {
+    return std::min(
+        controller_->getCongestionWindow(), group_->getShare(member()));
+  }
+
+  void setConnectionEmulation(uint8_t num) override {
+    controller_->setConnectionEmulation(num);
+  }
+
+  void setAppIdle(bool idle, TimePoint eventTime) override {
+    controller_->setAppIdle(idle, eventTime);
+  }
+
+  void setAppLimited() override {
+    controller_->setAppLimited();
+  }
+
+  CongestionControlType type() const override {
+    return controller_->type();
+  }
+
+  void onSpuriousLoss(TimePoint lossTime) override {
+    controller_->onSpuriousLoss(lossTime);
+  }
+
+  bool isAppLimited() const override {
+    return controller_->isAppLimited();
+  }
+
+  uint64_t getBandwidthEstimate() const override {
+    return controller_->getBandwidthEstimate();
+  }
+
+ private:
+  SharedCongestionGroup::Member member() const {
+    return SharedCongestionGroup::Member{&conn_, controller_.get()};
+  }
+
+  void removeBytesInFlight(uint64_t bytes) {
+    bytesInFlight_ -= std::min(bytesInFlight_, bytes);
+  }
+
+  QuicConnectionStateBase& conn_;
+  std::unique_ptr<CongestionController> controller_;
+  std::shared_ptr<SharedCongestionGroup> group_;
+  uint64_t bytesInFlight_{0};
+};
+} // namespace
+
+void SharedCongestionGroup::addMember(const Member& member) {
+  members_.push_back(member);
+}
+
+void SharedCongestionGroup::removeMember(
+    const CongestionController* controller) {
+  members_.erase(
+      std::remove_if(
+          members_.begin(),
+          members_.end(),
+          [&](const Member& member) {
+            return member.controller == controller;
+          }),
+      members_.end());
+}
+
+uint64_t SharedCongestionGroup::getShare(const Member& member) const {
+  uint64_t window = 0;
+  uint64_t activeMembers = 1;
+  for (const auto& other : members_) {
+    window = std::max(window, other.controller->getCongestionWindow());
+    if (other.controller != member.controller &&
+        !other.controller->isAppLimited()) {
+      activeMembers++;
+    }
+  }
+  return std::max(
+      window / activeMembers, kMinCwndInMss * member.conn->udpSendPacketLen);
+}
+
+SharedCongestionManager::SharedCongestionManager(
+    std::shared_ptr<CongestionControllerFactory> factory)
+    : factory_(std::move(factory)) {
+  CHECK(factory_);
+}
+
+std::unique_ptr<CongestionController>
+SharedCongestionManager::makeCongestionController(
+    QuicConnectionStateBase& conn,
+    CongestionControlType type) {
+  return addToGroup(conn, factory_->makeCongestionController(conn, type));
+}
+
+std::unique_ptr<CongestionController>
+SharedCongestionManager::makeCongestionControllerFromCwnd(
+    QuicConnectionStateBase& conn,
+    CongestionControlType type,
+    uint64_t initCwndBytes) {
+  return addToGroup(
+      conn,
+      factory_->makeCongestionControllerFromCwnd(conn, type, initCwndBytes));
+}
+
+std::unique_ptr<CongestionController> SharedCongestionManager::addToGroup(
+    QuicConnectionStateBase& conn,
+    std::unique_ptr<CongestionController> controller) {
+  const auto& peer = conn.peerAddress.isInitialized()
+      ? conn.peerAddress
+      : conn.originalPeerAddress;
+  if (!controller || !peer.isInitialized()) {
+    return controller;
+  }
+  auto& entry = groups_[congestionStateSubnet(peer.getIPAddress())];
+  auto group = entry.lock();
+  if (!group) {
+    group = std::make_shared<SharedCongestionGroup>();
+    entry = group;
+    if (groups_.size() > pruneSize_) {
+      for (auto it = groups_.begin(); it != groups_.end();) {
+        it = it->second.expired() ? groups_.erase(it) : std::next(it);
+      }
+      pruneSize_ =
+          std::max(kSharedCongestionGroupsPruneSize, 2 * groups_.size());
+    }
+  }
+  return std::make_unique<SharedCongestionController>(
+      conn, std::move(controller), std::move(group));
+}
+
+std::shared_ptr<SharedCongestionGroup> SharedCongestionManager::getGroup(
+    const folly::IPAddress& peer) const {
+  auto it = groups_.find(congestionStateSubnet(peer));
+  return it != groups_.end() ? it->second.lock() : nullptr;
+}
+
+} // namespace quic
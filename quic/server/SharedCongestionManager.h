@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/congestion_control/CongestionControllerFactory.h>
+
+#include <folly/IPAddress.h>
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace quic {
+
+/**
+ * The connections of a group share one congestion window. It is the largest
+ * window of any of their own controllers, as the network would give to a
+ * single connection, and is split evenly among the members that are not
+ * app limited.
+ */
+class SharedCongestionGroup {
+ public:
+  struct Member {
+    const QuicConnectionStateBase* conn;
+    const CongestionController* controller;
+  };
+
+  void addMember(const Member& member);
+
+  void removeMember(const CongestionController* controller);
+
+  /**
+   * The share of the window of the member with this controller, never less
+   * than kMinCwndInMss packets of its connection.
+   */
+  uint64_t getShare(const Member& member) const;
+
+  size_t numMembers() const {
+    return members_.size();
+  }
+
+ private:
+  std::vector<Member> members_;
+};
+
+/**
+ * A congestion controller factory that groups the connections a worker has
+ * with the same subnet, see congestionStateSubnet(), so that parallel
+ * connections from one client behave like a single one at the bottleneck
+ * instead of competing with each other.
+ *
+ * The controllers of the wrapped factory keep running for each connection,
+ * but what each may send, and the pacing rate it refreshes, are capped to
+ * its share of the window of its group. Like the rest of a worker it is
+ * only used from the worker's thread.
+ */
+class SharedCongestionManager : public CongestionControllerFactory {
+ public:
+  explicit SharedCongestionManager(
+      std::shared_ptr<CongestionControllerFactory> factory);
+
+  ~SharedCongestionManager() override = default;
+
+  std::unique_ptr<CongestionController> makeCongestionController(
+      QuicConnectionStateBase& conn,
+      CongestionControlType type) override;
+
+  std::unique_ptr<CongestionController> makeCongestionControllerFromCwnd(
+      QuicConnectionStateBase& conn,
+      CongestionControlType type,
+      uint64_t initCwndBytes) override;
+
+  /**
+   * The group of connections of the subnet of the peer, or nullptr if there
+   * are none.
+   */
+  std::shared_ptr<SharedCongestionGroup> getGroup(
+      const folly::IPAddress& peer) const;
+
+ private:
+  // Puts the controller of the connection in the group of its subnet.
+  std::unique_ptr<CongestionController> addToGroup(
+      QuicConnectionStateBase& conn,
+      std::unique_ptr<CongestionController> controller);
+
+  std::shared_ptr<CongestionControllerFactory> factory_;
+  // The groups are owned by the controllers of their members.
+  std::unordered_map<folly::IPAddress, std::weak_ptr<SharedCongestionGroup>>
+      groups_;
+  // The groups of gone connections are dropped once there are more than this
+  size_t pruneSize_{kSharedCongestionGroupsPruneSize};
+};
+
+} // namespace quic
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/StatelessResponder.h>
+
+#include <folly/Random.h>
+#include <folly/io/Cursor.h>
+
+namespace quic {
+
+StatelessResponder::StatelessResponder(
+    uint32_t maxResponsesPerSecond,
+    size_t maxCachedResetTokens)
+    : maxResponsesPerSecond_(maxResponsesPerSecond),
+      responseCredit_(maxResponsesPerSecond),
+      resetTokens_(std::max<size_t>(1, maxCachedResetTokens)) {}
+
+bool StatelessResponder::allowResponse(TimePoint now) {
+  if (maxResponsesPerSecond_ == 0) {
+    return true;
+  }
+  if (lastCreditUpdate_ && now > *lastCreditUpdate_) {
+    auto elapsed =
+        std::chrono::duration<double>(now - *lastCreditUpdate_).count();
+    responseCredit_ = std::min<double>(
+        maxResponsesPerSecond_,
+        responseCredit_ + elapsed * maxResponsesPerSecond_);
+  }
+  if (!lastCreditUpdate_ || now > *lastCreditUpdate_) {
+    lastCreditUpdate_ = now;
+  }
+  if (responseCredit_ < 1) {
+    return false;
+  }
+  responseCredit_ -= 1;
+  return true;
+}
+
+void StatelessResponder::setMaxResponsesPerSecond(
+    uint32_t maxResponsesPerSecond) {
+  maxResponsesPerSecond_ = maxResponsesPerSecond;
+  responseCredit_ = maxResponsesPerSecond;
+  lastCreditUpdate_.clear();
+}
+
+StatelessResetToken StatelessResponder::getResetToken(
+    const StatelessResetGenerator& generator,
+    const ConnectionId& connId) {
+  auto it = resetTokens_.find(connId);
+  if (it != resetTokens_.end()) {
+    return it->second;
+  }
+  auto token = generator.generateToken(connId);
+  resetTokens_.set(connId, token);
+  return token;
+}
+
+void StatelessResponder::clearResetTokens() {
+  resetTokens_.clear();
+}
+
+Buf StatelessResponder::buildResetPacket(
+    const StatelessResetGenerator& generator,
+    const ConnectionId& connId,
+    uint16_t packetSize) {
+  auto token = getResetToken(generator, connId);
+  CHECK_GT(packetSize, token.size());
+  size_t randomOctetLength = packetSize - token.size() - 1;
+  // Twice the largest random part, so that the resets copy from different
+  // offsets of it.
+  size_t poolSize = 2 * kDefaultUDPSendPacketLen;
+  if (randomPool_.size() < poolSize ||
+      randomPoolUses_ >= kStatelessResetRandomPoolUses) {
+    randomPool_.resize(poolSize);
+    folly::Random::secureRandom(randomPool_.data(), randomPool_.size());
+    randomPoolUses_ = 0;
+  }
+  ++randomPoolUses_;
+  randomOctetLength = std::min(randomOctetLength, randomPool_.size());
+  size_t offset =
+      folly::Random::rand32(randomPool_.size() - randomOctetLength + 1);
+
+  auto packet = folly::IOBuf::create(packetSize);
+  auto data = packet->writableData();
+  data[0] = ShortHeader::kFixedBitMask;
+  memcpy(data + 1, randomPool_.data() + offset, randomOctetLength);
+  memcpy(data + 1 + randomOctetLength, token.data(), token.size());
+  packet->append(1 + randomOctetLength + token.size());
+  return packet;
+}
+
+Buf StatelessResponder::buildVersionNegotiationPacket(
+    const ConnectionId& sourceConnectionId,
+    const ConnectionId& destinationConnectionId,
+    const std::vector<QuicVersion>& versions) {
+  const auto& encoded = getEncodedVersions(versions);
+  size_t headerSize = sizeof(uint8_t) + sizeof(QuicVersionType) +
+      sizeof(uint8_t) + destinationConnectionId.size() + sizeof(uint8_t) +
+      sourceConnectionId.size();
+  // The versions that do not fit in a packet are left out, as the builder
+  // does.
+  size_t versionsSize = std::min(
+      encoded.size(),
+      (kDefaultUDPSendPacketLen - headerSize) / sizeof(QuicVersionType) *
+          sizeof(QuicVersionType));
+
+  auto packet = folly::IOBuf::create(headerSize + versionsSize);
+  folly::io::Appender appender(packet.get(), 0);
+  // See VersionNegotiationPacketBuilder::generateRandomPacketType.
+  appender.writeBE<uint8_t>(kHeaderFormMask);
+  appender.writeBE(
+      static_cast<QuicVersionType>(QuicVersion::VERSION_NEGOTIATION));
+  appender.writeBE<uint8_t>(destinationConnectionId.size());
+  appender.push(destinationConnectionId.data(), destinationConnectionId.size());
+  appender.writeBE<uint8_t>(sourceConnectionId.size());
+  appender.push(sourceConnectionId.data(), sourceConnectionId.size());
+  appender.push(encoded.data(), versionsSize);
+  return packet;
+}
+
+const std::vector<uint8_t>& StatelessResponder::getEncodedVersions(
+    const std::vector<QuicVersion>& versions) {
+  for (const auto& versionsTemplate : versionsTemplates_) {
+    if (versionsTemplate.versions == versions) {
+      return versionsTemplate.encoded;
+    }
+  }
+  VersionsTemplate versionsTemplate;
+  versionsTemplate.versions = versions;
+  for (auto version : versions) {
+    auto encodedVersion =
+        folly::Endian::big(static_cast<QuicVersionType>(version));
+    auto bytes = reinterpret_cast<const uint8_t*>(&encodedVersion);
+    versionsTemplate.encoded.insert(
+        versionsTemplate.encoded.end(), bytes, bytes + sizeof(encodedVersion));
+  }
+  versionsTemplates_.push_back(std::move(versionsTemplate));
+  return versionsTemplates_.back().encoded;
+}
+
+} // namespace quic
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/container/EvictingCacheMap.h>
+#include <quic/QuicConstants.h>
+#include <quic/codec/QuicConnectionId.h>
+#include <quic/server/handshake/StatelessResetGenerator.h>
+
+#include <vector>
+
+namespace quic {
+
+/**
+ * Builds the stateless resets and version negotiation packets of a server
+ * worker without going through the packet builders, and limits how many of
+ * them the worker sends.
+ *
+ * Scans and the stale packets that reach a restarted server can make a
+ * worker send many of these, so the parts that do not depend on the packet
+ * being answered are computed once: the reset tokens are cached per
+ * connection id, the random bytes of the resets are copied from a pool that
+ * is refilled every kStatelessResetRandomPoolUses resets, and the version
+ * list of a version negotiation packet is encoded once per list. Building a
+ * response is then one allocation and a few copies.
+ */
+class StatelessResponder {
+ public:
+  /**
+   * maxResponsesPerSecond bounds the responses of allowResponse, with bursts
+   * of up to a second worth of them. 0 does not limit them.
+   */
+  StatelessResponder(
+      uint32_t maxResponsesPerSecond,
+      size_t maxCachedResetTokens = kMaxCachedStatelessResetTokens);
+
+  /**
+   * Returns whether another response can be sent now, and counts it if so.
+   */
+  bool allowResponse(TimePoint now = Clock::now());
+
+  void setMaxResponsesPerSecond(uint32_t maxResponsesPerSecond);
+
+  /**
+   * The token of the connection id, from the cache or the generator. The
+   * cache is only valid for one generator, clearResetTokens() has to be
+   * called when it changes.
+   */
+  StatelessResetToken getResetToken(
+      const StatelessResetGenerator& generator,
+      const ConnectionId& connId);
+
+  void clearResetTokens();
+
+  /**
+   * Builds a stateless reset of packetSize bytes for connId, in the same
+   * format as StatelessResetPacketBuilder.
+   */
+  Buf buildResetPacket(
+      const StatelessResetGenerator& generator,
+      const ConnectionId& connId,
+      uint16_t packetSize);
+
+  /**
+   * Builds the same packet as VersionNegotiationPacketBuilder.
+   */
+  Buf buildVersionNegotiationPacket(
+      const ConnectionId& sourceConnectionId,
+      const ConnectionId& destinationConnectionId,
+      const std::vector<QuicVersion>& versions);
+
+ private:
+  struct VersionsTemplate {
+    std::vector<QuicVersion> versions;
+    std::vector<uint8_t> encoded;
+  };
+
+  const std::vector<uint8_t>& getEncodedVersions(
+      const std::vector<QuicVersion>& versions);
+
+  uint32_t maxResponsesPerSecond_;
+  double responseCredit_{0};
+  folly::Optional<TimePoint> lastCreditUpdate_;
+
+  folly::EvictingCacheMap<ConnectionId, StatelessResetToken, ConnectionIdHash>
+      resetTokens_;
+
+  std::vector<uint8_t> randomPool_;
+  size_t randomPoolUses_{0};
+
+  // Servers only answer with a couple of version lists, the supported one
+  // and the one rejecting new connections.
+  std::vector<VersionsTemplate> versionsTemplates_;
+};
+
+} // namespace quic
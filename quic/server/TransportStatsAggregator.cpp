@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/TransportStatsAggregator.h>
+
+#include <folly/lang/Align.h>
+
+#include <algorithm>
+
+namespace quic {
+
+namespace {
+constexpr size_t kNumCounters =
+    static_cast<size_t>(TransportStatsCounter::MAX);
+constexpr size_t kNumDropReasons =
+    static_cast<size_t>(QuicTransportStatsCallback::PacketDropReason::MAX);
+constexpr size_t kNumFlushReasons = static_cast<size_t>(
+    QuicTransportStatsCallback::WriteBatchFlushReason::MAX);
+constexpr size_t kNumDistributions =
+    static_cast<size_t>(TransportStatsDistribution::MAX);
+
+// Only the worker's thread writes to its block, so a load and a store are
+// enough.
+inline void addTo(std::atomic<uint64_t>& value, uint64_t n) noexcept {
+  value.store(
+      value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline uint64_t read(const std::atomic<uint64_t>& value) noexcept {
+  return value.load(std::memory_order_relaxed);
+}
+} // namespace
+
+struct TransportStatsAggregator::WorkerBlock {
+  struct Histogram {
+    std::array<std::atomic<uint64_t>, kTransportStatsHistogramBuckets>
+        buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+
+    void add(uint64_t value) noexcept {
+      addTo(buckets[TransportStatsHistogram::bucketOf(value)], 1);
+      addTo(count, 1);
+      addTo(sum, value);
+    }
+
+    void readInto(TransportStatsHistogram& histogram) const noexcept {
+      for (size_t i = 0; i < buckets.size(); i++) {
+        histogram.buckets[i] = read(buckets[i]);
+      }
+      histogram.count = read(count);
+      histogram.sum = read(sum);
+    }
+  };
+
+  // Set before the block is published, never changed after.
+  WorkerBlock* next{nullptr};
+  // Keeps the stats off the cache lines of whatever is allocated next to the
+  // block.
+  char leadingPadding[folly::hardware_destructive_interference_size];
+  std::array<std::atomic<uint64_t>, kNumCounters> counters{};
+  std::array<std::atomic<uint64_t>, kNumDropReasons> packetsDropped{};
+  std::array<std::atomic<uint64_t>, kNumFlushReasons> writeBatchFlushes{};
+  std::array<Histogram, kNumDistributions> distributions;
+  char trailingPadding[folly::hardware_destructive_interference_size];
+
+  void readInto(TransportStatsSnapshot& snapshot) const noexcept {
+    for (size_t i = 0; i < counters.size(); i++) {
+      snapshot.counters[i] = read(counters[i]);
+    }
+    for (size_t i = 0; i < packetsDropped.size(); i++) {
+      snapshot.packetsDropped[i] = read(packetsDropped[i]);
+    }
+    for (size_t i = 0; i < writeBatchFlushes.size(); i++) {
+      snapshot.writeBatchFlushes[i] = read(writeBatchFlushes[i]);
+    }
+    for (size_t i = 0; i < distributions.size(); i++) {
+      distributions[i].readInto(snapshot.distributions[i]);
+    }
+  }
+};
+
+namespace {
+class WorkerTransportStats : public QuicTransportStatsCallback {
+ public:
+  WorkerTransportStats(
+      std::shared_ptr<const TransportStatsAggregator> aggregator,
+      TransportStatsAggregator::WorkerBlock& block)
+      : aggregator_(std::move(aggregator)), block_(block) {}
+
+  void onPacketReceived() override {
+    count(TransportStatsCounter::PACKETS_RECEIVED);
+  }
+
+  void onDuplicatedPacketReceived() override {
+    count(TransportStatsCounter::DUPLICATED_PACKETS_RECEIVED);
+  }
+
+  void onOutOfOrderPacketReceived() override {
+    count(TransportStatsCounter::OUT_OF_ORDER_PACKETS_RECEIVED);
+  }
+
+  void onPacketProcessed() override {
+    count(TransportStatsCounter::PACKETS_PROCESSED);
+  }
+
+  void onPacketSent() override {
+    count(TransportStatsCounter::PACKETS_SENT);
+  }
+
+  void onPacketRetransmission() override {
+    count(TransportStatsCounter::PACKETS_RETRANSMITTED);
+  }
+
+  void onPacketDropped(PacketDropReason reason) override {
+    count(TransportStatsCounter::PACKETS_DROPPED);
+    auto index = static_cast<size_t>(reason);
+    if (index < kNumDropReasons) {
+      addTo(block_.packetsDropped[index], 1);
+    }
+  }
+
+  void onPacketForwarded() override {
+    count(TransportStatsCounter::PACKETS_FORWARDED);
+  }
+
+  void onForwardedPacketReceived() override {
+    count(TransportStatsCounter::FORWARDED_PACKETS_RECEIVED);
+  }
+
+  void onForwardedPacketProcessed() override {
+    count(TransportStatsCounter::FORWARDED_PACKETS_PROCESSED);
+  }
+
+  void onNewConnection() override {
+    count(TransportStatsCounter::NEW_CONNECTIONS);
+  }
+
+  void onConnectionClose(folly::Optional<ConnectionCloseReason>) override {
+    count(TransportStatsCounter::CONNECTIONS_CLOSED);
+  }
+
+  void onNewQuicStream() override {
+    count(TransportStatsCounter::NEW_STREAMS);
+  }
+
+  void onQuicStreamClosed() override {
+    count(TransportStatsCounter::STREAMS_CLOSED);
+  }
+
+  void onQuicStreamReset() override {
+    count(TransportStatsCounter::STREAMS_RESET);
+  }
+
+  void onConnFlowControlUpdate() override {
+    count(TransportStatsCounter::CONN_FLOW_CONTROL_UPDATES);
+  }
+
+  void onConnFlowControlBlocked() override {
+    count(TransportStatsCounter::CONN_FLOW_CONTROL_BLOCKED);
+  }
+
+  void onStatelessReset() override {
+    count(TransportStatsCounter::STATELESS_RESETS);
+  }
+
+  void onStreamFlowControlUpdate() override {
+    count(TransportStatsCounter::STREAM_FLOW_CONTROL_UPDATES);
+  }
+
+  void onStreamFlowControlBlocked() override {
+    count(TransportStatsCounter::STREAM_FLOW_CONTROL_BLOCKED);
+  }
+
+  void onCwndBlocked() override {
+    count(TransportStatsCounter::CWND_BLOCKED);
+  }
+
+  void onPTO() override {
+    count(TransportStatsCounter::PTOS);
+  }
+
+  void onSpuriousLoss() override {
+    count(TransportStatsCounter::SPURIOUS_LOSSES);
+  }
+
+  void onRead(size_t bufSize) override {
+    count(TransportStatsCounter::BYTES_READ, bufSize);
+    sample(TransportStatsDistribution::READ_BYTES, bufSize);
+  }
+
+  void onWrite(size_t bufSize) override {
+    count(TransportStatsCounter::BYTES_WRITTEN, bufSize);
+    sample(TransportStatsDistribution::WRITE_BYTES, bufSize);
+  }
+
+  void onHandshakeDone(
+      std::chrono::microseconds handshakeTime,
+      std::chrono::microseconds,
+      uint64_t,
+      uint64_t) override {
+    count(TransportStatsCounter::HANDSHAKES_DONE);
+    sample(TransportStatsDistribution::HANDSHAKE_TIME_US, handshakeTime);
+  }
+
+  void onRetrySent() override {
+    count(TransportStatsCounter::RETRIES_SENT);
+  }
+
+  void onSlowStartExit(SlowStartExitReason) override {
+    count(TransportStatsCounter::SLOW_START_EXITS);
+  }
+
+  void onRttSample(std::chrono::microseconds rtt) override {
+    sample(TransportStatsDistribution::RTT_US, rtt);
+  }
+
+  void onCwndSample(uint64_t cwndBytes) override {
+    sample(TransportStatsDistribution::CWND_BYTES, cwndBytes);
+  }
+
+  void onWriteBatch(
+      size_t numPackets,
+      size_t numBytes,
+      WriteBatchFlushReason reason) override {
+    sample(TransportStatsDistribution::WRITE_BATCH_PACKETS, numPackets);
+    sample(TransportStatsDistribution::WRITE_BATCH_BYTES, numBytes);
+    auto index = static_cast<size_t>(reason);
+    if (index < kNumFlushReasons) {
+      addTo(block_.writeBatchFlushes[index], 1);
+    }
+  }
+
+  void onStreamWriteDelivered(
+      std::chrono::microseconds queueingTime,
+      std::chrono::microseconds networkTime) override {
+    sample(TransportStatsDistribution::DELIVERY_QUEUEING_TIME_US, queueingTime);
+    sample(TransportStatsDistribution::DELIVERY_NETWORK_TIME_US, networkTime);
+  }
+
+  void onGSOWrite(size_t numSegments) override {
+    sample(TransportStatsDistribution::GSO_SEGMENTS, numSegments);
+  }
+
+  void onAmplificationBlocked(std::chrono::microseconds blockedTime) override {
+    count(TransportStatsCounter::AMPLIFICATION_BLOCKED_US, blockedTime.count());
+  }
+
+  void onMetricsHistory(
+      const std::vector<TransportMetricsSample>& samples) override {
+    count(TransportStatsCounter::METRICS_HISTORY_SAMPLES, samples.size());
+  }
+
+  void onWriteWouldBlock() override {
+    count(TransportStatsCounter::WRITES_WOULD_BLOCK);
+  }
+
+  void onReadBatch(size_t numPackets) override {
+    sample(TransportStatsDistribution::READ_BATCH_PACKETS, numPackets);
+  }
+
+  void onKernelPacketsDropped(uint64_t numPackets) override {
+    count(TransportStatsCounter::KERNEL_PACKETS_DROPPED, numPackets);
+  }
+
+  void onRecvBufferOccupancy(uint64_t usedBytes, uint64_t size) override {
+    if (size > 0) {
+      sample(
+          TransportStatsDistribution::RECV_BUFFER_OCCUPANCY_PERCENT,
+          usedBytes * 100 / size);
+    }
+  }
+
+  void onLoopBusyTime(std::chrono::microseconds busyTime) override {
+    sample(TransportStatsDistribution::LOOP_BUSY_TIME_US, busyTime);
+  }
+
+ private:
+  void count(TransportStatsCounter counter, uint64_t n = 1) noexcept {
+    addTo(block_.counters[static_cast<size_t>(counter)], n);
+  }
+
+  void sample(TransportStatsDistribution distribution, uint64_t value) {
+    block_.distributions[static_cast<size_t>(distribution)].add(value);
+  }
+
+  void sample(
+      TransportStatsDistribution distribution,
+      std::chrono::microseconds value) {
+    sample(
+        distribution,
+        value.count() > 0 ? static_cast<uint64_t>(value.count()) : 0);
+  }
+
+  std::shared_ptr<const TransportStatsAggregator> aggregator_;
+  TransportStatsAggregator::WorkerBlock& block_;
+};
+} // namespace
+
+uint64_t TransportStatsSnapshot::get(TransportStatsCounter counter) const {
+  return counters[static_cast<size_t>(counter)];
+}
+
+uint64_t TransportStatsSnapshot::get(
+    QuicTransportStatsCallback::PacketDropReason reason) const {
+  return packetsDropped[static_cast<size_t>(reason)];
+}
+
+uint64_t TransportStatsSnapshot::get(
+    QuicTransportStatsCallback::WriteBatchFlushReason reason) const {
+  return writeBatchFlushes[static_cast<size_t>(reason)];
+}
+
+const TransportStatsHistogram& TransportStatsSnapshot::get(
+    TransportStatsDistribution distribution) const {
+  return distributions[static_cast<size_t>(distribution)];
+}
+
+void TransportStatsSnapshot::merge(const TransportStatsSnapshot& other) {
+  for (size_t i = 0; i < counters.size(); i++) {
+    counters[i] += other.counters[i];
+  }
+  for (size_t i = 0; i < packetsDropped.size(); i++) {
+    packetsDropped[i] += other.packetsDropped[i];
+  }
+  for (size_t i = 0; i < writeBatchFlushes.size(); i++) {
+    writeBatchFlushes[i] += other.writeBatchFlushes[i];
+  }
+  for (size_t i = 0; i < distributions.size(); i++) {
+    distributions[i].merge(other.distributions[i]);
+  }
+}
+
+TransportStatsAggregator::~TransportStatsAggregator() {
+  auto block = head_.load(std::memory_order_acquire);
+  while (block) {
+    auto next = block->next;
+    delete block;
+    block = next;
+  }
+}
+
+std::unique_ptr<QuicTransportStatsCallback>
+TransportStatsAggregator::makeWorkerStats() {
+  auto block = new WorkerBlock();
+  block->next = head_.load(std::memory_order_relaxed);
+  while (!head_.compare_exchange_weak(
+      block->next,
+      block,
+      std::memory_order_release,
+      std::memory_order_relaxed)) {
+  }
+  return std::make_unique<WorkerTransportStats>(shared_from_this(), *block);
+}
+
+std::vector<TransportStatsSnapshot>
+TransportStatsAggregator::getWorkerSnapshots() const {
+  std::vector<TransportStatsSnapshot> snapshots;
+  for (auto block = head_.load(std::memory_order_acquire); block;
+       block = block->next) {
+    snapshots.emplace_back();
+    block->readInto(snapshots.back());
+  }
+  // The blocks are kept newest first.
+  std::reverse(snapshots.begin(), snapshots.end());
+  return snapshots;
+}
+
+TransportStatsSnapshot TransportStatsAggregator::getSnapshot() const {
+  TransportStatsSnapshot merged;
+  TransportStatsSnapshot worker;
+  for (auto block = head_.load(std::memory_order_acquire); block;
+       block = block->next) {
+    block->readInto(worker);
+    merged.merge(worker);
+  }
+  return merged;
+}
+
+TransportStatsAggregatorFactory::TransportStatsAggregatorFactory(
+    std::shared_ptr<TransportStatsAggregator> aggregator)
+    : aggregator_(std::move(aggregator)) {
+  CHECK(aggregator_);
+}
+
+std::unique_ptr<QuicTransportStatsCallback>
+TransportStatsAggregatorFactory::make(folly::EventBase*) {
+  return aggregator_->makeWorkerStats();
+}
+
+} // namespace quic
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/common/TransportStatsHistogram.h>
+#include <quic/state/QuicTransportStatsCallback.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace quic {
+
+enum class TransportStatsCounter : uint8_t {
+  PACKETS_RECEIVED,
+  DUPLICATED_PACKETS_RECEIVED,
+  OUT_OF_ORDER_PACKETS_RECEIVED,
+  PACKETS_PROCESSED,
+  PACKETS_SENT,
+  PACKETS_RETRANSMITTED,
+  PACKETS_DROPPED,
+  PACKETS_FORWARDED,
+  FORWARDED_PACKETS_RECEIVED,
+  FORWARDED_PACKETS_PROCESSED,
+  NEW_CONNECTIONS,
+  CONNECTIONS_CLOSED,
+  NEW_STREAMS,
+  STREAMS_CLOSED,
+  STREAMS_RESET,
+  CONN_FLOW_CONTROL_UPDATES,
+  CONN_FLOW_CONTROL_BLOCKED,
+  STATELESS_RESETS,
+  STREAM_FLOW_CONTROL_UPDATES,
+  STREAM_FLOW_CONTROL_BLOCKED,
+  CWND_BLOCKED,
+  PTOS,
+  SPURIOUS_LOSSES,
+  BYTES_READ,
+  BYTES_WRITTEN,
+  HANDSHAKES_DONE,
+  RETRIES_SENT,
+  SLOW_START_EXITS,
+  WRITES_WOULD_BLOCK,
+  KERNEL_PACKETS_DROPPED,
+  AMPLIFICATION_BLOCKED_US,
+  METRICS_HISTORY_SAMPLES,
+  // NOTE: MAX should always be at the end
+  MAX
+};
+
+enum class TransportStatsDistribution : uint8_t {
+  RTT_US,
+  CWND_BYTES,
+  READ_BYTES,
+  WRITE_BYTES,
+  READ_BATCH_PACKETS,
+  WRITE_BATCH_PACKETS,
+  WRITE_BATCH_BYTES,
+  GSO_SEGMENTS,
+  DELIVERY_QUEUEING_TIME_US,
+  DELIVERY_NETWORK_TIME_US,
+  LOOP_BUSY_TIME_US,
+  HANDSHAKE_TIME_US,
+  RECV_BUFFER_OCCUPANCY_PERCENT,
+  // NOTE: MAX should always be at the end
+  MAX
+};
+
+struct TransportStatsSnapshot {
+  std::array<uint64_t, static_cast<size_t>(TransportStatsCounter::MAX)>
+      counters{};
+  std::array<
+      uint64_t,
+      static_cast<size_t>(QuicTransportStatsCallback::PacketDropReason::MAX)>
+      packetsDropped{};
+  std::array<
+      uint64_t,
+      static_cast<size_t>(
+          QuicTransportStatsCallback::WriteBatchFlushReason::MAX)>
+      writeBatchFlushes{};
+  std::array<
+      TransportStatsHistogram,
+      static_cast<size_t>(TransportStatsDistribution::MAX)>
+      distributions;
+
+  uint64_t get(TransportStatsCounter counter) const;
+
+  uint64_t get(QuicTransportStatsCallback::PacketDropReason reason) const;
+
+  uint64_t get(QuicTransportStatsCallback::WriteBatchFlushReason reason) const;
+
+  const TransportStatsHistogram& get(
+      TransportStatsDistribution distribution) const;
+
+  void merge(const TransportStatsSnapshot& other);
+};
+
+/**
+ * Built-in stats for the server, installed with
+ * QuicServer::enableTransportStats().
+ *
+ * Each worker gets its own block of counters and histograms, padded so that
+ * no cache line is shared with another worker's. Only the worker's thread
+ * writes to its block, with relaxed loads and stores rather than atomic
+ * read-modify-writes, so recording an event is a virtual call and an add to
+ * memory that stays in the worker's cache. Snapshots can be taken from any
+ * thread without locking: they read every block with relaxed loads and
+ * merge them. The counters of a snapshot are each exact at some point of
+ * the read, but not necessarily at the same one.
+ */
+class TransportStatsAggregator
+    : public std::enable_shared_from_this<TransportStatsAggregator> {
+ public:
+  TransportStatsAggregator() = default;
+
+  ~TransportStatsAggregator();
+
+  TransportStatsAggregator(const TransportStatsAggregator&) = delete;
+  TransportStatsAggregator& operator=(const TransportStatsAggregator&) =
+      delete;
+
+  // Makes the stats callback of a new worker.
+  std::unique_ptr<QuicTransportStatsCallback> makeWorkerStats();
+
+  std::vector<TransportStatsSnapshot> getWorkerSnapshots() const;
+
+  // Merged stats of all the workers
+  TransportStatsSnapshot getSnapshot() const;
+
+  struct WorkerBlock;
+
+ private:
+  // Blocks are only ever added, and freed with the aggregator, which the
+  // callbacks keep alive.
+  std::atomic<WorkerBlock*> head_{nullptr};
+};
+
+class TransportStatsAggregatorFactory
+    : public QuicTransportStatsCallbackFactory {
+ public:
+  explicit TransportStatsAggregatorFactory(
+      std::shared_ptr<TransportStatsAggregator> aggregator);
+
+  std::unique_ptr<QuicTransportStatsCallback> make(
+      folly::EventBase* evb) override;
+
+ private:
+  std::shared_ptr<TransportStatsAggregator> aggregator_;
+};
+
+} // namespace quic
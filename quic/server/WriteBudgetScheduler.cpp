@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/WriteBudgetScheduler.h>
+
+#include <algorithm>
+
+namespace quic {
+
+WriteBudgetScheduler::WriteBudgetScheduler(
+    folly::EventBase* evb,
+    uint64_t loopPacketBudget,
+    std::chrono::microseconds loopTimeBudget,
+    uint64_t minPacketsPerConnection)
+    : evb_(evb),
+      loopPacketBudget_(loopPacketBudget),
+      loopTimeBudget_(loopTimeBudget),
+      minPacketsPerConnection_(std::max<uint64_t>(minPacketsPerConnection, 1)) {
+}
+
+WriteBudgetScheduler::~WriteBudgetScheduler() {
+  cancelLoopCallback();
+}
+
+uint64_t WriteBudgetScheduler::getPacketLimit(
+    ConnectionWriteShare& share,
+    uint64_t cwndPackets) {
+  auto now = Clock::now();
+  if (!firstWriteTime_) {
+    firstWriteTime_ = now;
+    // The loop is over once the callbacks of this iteration ran.
+    evb_->runInLoop(this);
+  }
+  uint64_t weight = std::max<uint32_t>(share.weight, 1);
+  auto weightLeft =
+      std::max(activeWeight_, writersWeight_ + weight) - writersWeight_;
+  writersWeight_ += weight;
+  if (loopTimeBudget_.count() > 0 && now - *firstWriteTime_ > loopTimeBudget_) {
+    if (share.bulk && !share.deferred) {
+      share.deferred = true;
+      return 0;
+    }
+    share.deferred = false;
+    return minPacketsPerConnection_;
+  }
+  share.deferred = false;
+  auto packetsLeft = loopPacketBudget_ > packetsWritten_
+      ? loopPacketBudget_ - packetsWritten_
+      : 0;
+  auto weightedShare = std::min(packetsLeft * weight / weightLeft, cwndPackets);
+  return std::max(weightedShare, minPacketsPerConnection_);
+}
+
+void WriteBudgetScheduler::onPacketsWritten(uint64_t packets) {
+  packetsWritten_ += packets;
+}
+
+void WriteBudgetScheduler::runLoopCallback() noexcept {
+  activeWeight_ = writersWeight_;
+  writersWeight_ = 0;
+  packetsWritten_ = 0;
+  firstWriteTime_ = folly::none;
+}
+
+} // namespace quic
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/io/async/EventBase.h>
+#include <quic/QuicConstants.h>
+
+namespace quic {
+
+/**
+ * How a connection shares the write budget of its worker.
+ */
+struct ConnectionWriteShare {
+  // The share of the budget relative to the other connections
+  uint32_t weight{1};
+  // A bulk connection gives way to the others once the time budget of a loop
+  // is spent, and writes in the next loop instead. It is not held back two
+  // loops in a row.
+  bool bulk{false};
+  bool deferred{false};
+};
+
+/**
+ * The packets that the connections of a server worker write in an event
+ * loop iteration, instead of a fixed number per connection. The budget of a
+ * loop is split among the connections that write in it by their weights,
+ * the total of which is taken to be that of the loop before. Each connection
+ * gets its weight's share of what is left, up to what its congestion window
+ * lets it send, so that the budget one connection cannot use goes to the
+ * ones after it.
+ *
+ * Once the connections of a loop have been writing for longer than the time
+ * budget, the bulk connections in that loop wait for the next one, and the
+ * others only get the minimum, so that a loop with many connections stays
+ * short. Apart from that no connection gets less than the minimum, so that
+ * each makes progress.
+ */
+class WriteBudgetScheduler : private folly::EventBase::LoopCallback {
+ public:
+  WriteBudgetScheduler(
+      folly::EventBase* evb,
+      uint64_t loopPacketBudget,
+      std::chrono::microseconds loopTimeBudget,
+      uint64_t minPacketsPerConnection);
+
+  ~WriteBudgetScheduler() override;
+
+  WriteBudgetScheduler(const WriteBudgetScheduler&) = delete;
+  WriteBudgetScheduler& operator=(const WriteBudgetScheduler&) = delete;
+
+  /**
+   * Returns the packets a connection may write now, given the packets its
+   * congestion window has room for. Returns 0 for a bulk connection that
+   * waits for the next loop.
+   */
+  uint64_t getPacketLimit(ConnectionWriteShare& share, uint64_t cwndPackets);
+
+  /**
+   * Called with the packets the connection wrote after getPacketLimit.
+   */
+  void onPacketsWritten(uint64_t packets);
+
+  uint64_t getActiveWeight() const {
+    return activeWeight_;
+  }
+
+ private:
+  void runLoopCallback() noexcept override;
+
+  folly::EventBase* evb_;
+  const uint64_t loopPacketBudget_;
+  const std::chrono::microseconds loopTimeBudget_;
+  const uint64_t minPacketsPerConnection_;
+  // Total weight of the connections that wrote in the last loop
+  uint64_t activeWeight_{0};
+  // Total weight of the connections that wrote in this loop, and the packets
+  // they wrote
+  uint64_t writersWeight_{0};
+  uint64_t packetsWritten_{0};
+  folly::Optional<TimePoint> firstWriteTime_;
+};
+
+} // namespace quic
@@ -67,6 +67,13 @@ fizz::Buf encodeAppToken(const AppToken& appToken) {
     fizz::detail::write(appToken.version.value(), appender);
   }
   fizz::detail::writeBuf<uint16_t>(appToken.appParams, appender);
+  if (appToken.congestionState) {
+    const auto& state = *appToken.congestionState;
+    fizz::detail::write<uint64_t>(state.srtt.count(), appender);
+    fizz::detail::write<uint64_t>(state.mrtt.count(), appender);
+    fizz::detail::write<uint64_t>(state.cwndBytes, appender);
+    fizz::detail::write<uint64_t>(state.issueTime.count(), appender);
+  }
   return buf;
 }
 
@@ -88,6 +95,20 @@ folly::Optional<AppToken> decodeAppToken(const folly::IOBuf& buf) {
     fizz::detail::read(v, cursor);
     appToken.version = v;
     fizz::detail::readBuf<uint16_t>(appToken.appParams, cursor);
+    // Tickets issued without a congestion state end here.
+    if (cursor.isAtEnd()) {
+      return appToken;
+    }
+    uint64_t srtt, mrtt, cwndBytes, issueTime;
+    fizz::detail::read(srtt, cursor);
+    fizz::detail::read(mrtt, cursor);
+    fizz::detail::read(cwndBytes, cursor);
+    fizz::detail::read(issueTime, cursor);
+    appToken.congestionState = TicketCongestionState{
+        std::chrono::microseconds(srtt),
+        std::chrono::microseconds(mrtt),
+        cwndBytes,
+        std::chrono::seconds(issueTime)};
   } catch (const std::exception& ex) {
     return folly::none;
   }
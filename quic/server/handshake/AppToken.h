@@ -15,6 +15,7 @@
 #include <folly/IPAddress.h>
 #include <folly/Optional.h>
 
+#include <chrono>
 #include <cstdint>
 #include <vector>
 
@@ -30,11 +31,24 @@ class IOBuf;
 
 namespace quic {
 
+/**
+ * A snapshot of the congestion state of the connection that issued a ticket,
+ * which the connections resuming with it can be warm started from.
+ */
+struct TicketCongestionState {
+  std::chrono::microseconds srtt;
+  std::chrono::microseconds mrtt;
+  uint64_t cwndBytes;
+  // When the snapshot was taken, since the epoch of the system clock.
+  std::chrono::seconds issueTime;
+};
+
 struct AppToken {
   TicketTransportParameters transportParams;
   std::vector<folly::IPAddress> sourceAddresses;
   folly::Optional<QuicVersion> version;
   Buf appParams;
+  folly::Optional<TicketCongestionState> congestionState;
 };
 
 TicketTransportParameters createTicketTransportParameters(
@@ -57,6 +71,31 @@ class FailingAppTokenValidator : public fizz::server::AppTokenValidator {
   }
 };
 
+/**
+ * An AppTokenValidator of a connection whose validate() may run on the
+ * handshake executor, while the worker owns the connection, which may be
+ * closed before validate() returns. validate() then does not touch the
+ * connection: it reads what prepareValidation() took from it, and leaves
+ * what it found in the token for applyValidatedAppToken(). ServerHandshake
+ * calls both on the executor of the connection, before it hands a ClientHello
+ * to fizz and once fizz is done with it.
+ */
+class ConnectionAppTokenValidator : public fizz::server::AppTokenValidator {
+ public:
+  ~ConnectionAppTokenValidator() override = default;
+
+  /**
+   * Takes from the connection what the next validate() needs.
+   */
+  virtual void prepareValidation() {}
+
+  /**
+   * Applies to the connection what the last validate() found, if it was not
+   * applied yet.
+   */
+  virtual void applyValidatedAppToken() = 0;
+};
+
 } // namespace quic
 
 namespace fizz {
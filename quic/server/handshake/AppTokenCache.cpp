@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/AppTokenCache.h>
+
+#include <quic/server/handshake/AppToken.h>
+
+#include <glog/logging.h>
+
+namespace quic {
+
+std::shared_ptr<const DecodedAppToken> decodeAppTokenForValidation(
+    const folly::IOBuf& encodedToken) {
+  auto appToken = decodeAppToken(encodedToken);
+  if (!appToken) {
+    return nullptr;
+  }
+  auto decoded = std::make_shared<DecodedAppToken>();
+  decoded->encodedToken = encodedToken.clone();
+  decoded->version = appToken->version;
+  decoded->sourceAddresses = std::move(appToken->sourceAddresses);
+  decoded->appParams = std::move(appToken->appParams);
+  decoded->congestionState = appToken->congestionState;
+
+  // TODO T33454954 Simplify ticket transport params. see comments in D9324131
+  // Currenly only initialMaxData, initialMaxStreamData, ackDelayExponent, and
+  // maxRecvPacketSize are written into the ticket. In case new parameters
+  // are added for making early data decision (although not likely), the token
+  // is not valid if number of parameters is not
+  // kExpectedNumOfParamsInTheTicket.
+  const auto& params = appToken->transportParams.parameters;
+  if (params.size() != kExpectedNumOfParamsInTheTicket) {
+    return decoded;
+  }
+  auto idleTimeout =
+      getIntegerParameter(TransportParameterId::idle_timeout, params);
+  auto maxRecvPacketSize =
+      getIntegerParameter(TransportParameterId::max_packet_size, params);
+  auto initialMaxData =
+      getIntegerParameter(TransportParameterId::initial_max_data, params);
+  auto initialMaxStreamDataBidiLocal = getIntegerParameter(
+      TransportParameterId::initial_max_stream_data_bidi_local, params);
+  auto initialMaxStreamDataBidiRemote = getIntegerParameter(
+      TransportParameterId::initial_max_stream_data_bidi_remote, params);
+  auto initialMaxStreamDataUni = getIntegerParameter(
+      TransportParameterId::initial_max_stream_data_uni, params);
+  auto initialMaxStreamsBidi = getIntegerParameter(
+      TransportParameterId::initial_max_streams_bidi, params);
+  auto initialMaxStreamsUni = getIntegerParameter(
+      TransportParameterId::initial_max_streams_uni, params);
+  if (!idleTimeout || !maxRecvPacketSize || !initialMaxData ||
+      !initialMaxStreamDataBidiLocal || !initialMaxStreamDataBidiRemote ||
+      !initialMaxStreamDataUni || !initialMaxStreamsBidi ||
+      !initialMaxStreamsUni) {
+    return decoded;
+  }
+  decoded->transportParams = TicketTransportParameterValues{
+      *idleTimeout,
+      *maxRecvPacketSize,
+      *initialMaxData,
+      *initialMaxStreamDataBidiLocal,
+      *initialMaxStreamDataBidiRemote,
+      *initialMaxStreamDataUni,
+      *initialMaxStreamsBidi,
+      *initialMaxStreamsUni};
+  return decoded;
+}
+
+AppTokenCache::AppTokenCache(size_t numSlots)
+    : numSlots_(numSlots), slots_(std::make_unique<Slot[]>(numSlots)) {
+  CHECK_GT(numSlots_, 0);
+}
+
+std::shared_ptr<const DecodedAppToken> AppTokenCache::get(
+    const folly::IOBuf& encodedToken) const {
+  auto entry = slotOf(encodedToken).load(std::memory_order_acquire);
+  if (entry && folly::IOBufEqualTo()(*entry->encodedToken, encodedToken)) {
+    return entry;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<const DecodedAppToken> AppTokenCache::getOrDecode(
+    const folly::IOBuf& encodedToken) {
+  auto entry = get(encodedToken);
+  if (entry) {
+    return entry;
+  }
+  entry = decodeAppTokenForValidation(encodedToken);
+  if (entry) {
+    slotOf(encodedToken).store(entry, std::memory_order_release);
+  }
+  return entry;
+}
+
+AppTokenCache::Slot& AppTokenCache::slotOf(
+    const folly::IOBuf& encodedToken) const {
+  return slots_[folly::IOBufHash()(encodedToken) % numSlots_];
+}
+
+} // namespace quic
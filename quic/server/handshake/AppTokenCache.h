@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+#include <quic/codec/Types.h>
+#include <quic/server/handshake/AppToken.h>
+
+#include <folly/IPAddress.h>
+#include <folly/Optional.h>
+#include <folly/concurrency/AtomicSharedPtr.h>
+
+#include <memory>
+#include <vector>
+
+namespace quic {
+
+/**
+ * The transport parameters of a ticket that a resumed connection is validated
+ * against.
+ */
+struct TicketTransportParameterValues {
+  uint64_t idleTimeout;
+  uint64_t maxRecvPacketSize;
+  uint64_t initialMaxData;
+  uint64_t initialMaxStreamDataBidiLocal;
+  uint64_t initialMaxStreamDataBidiRemote;
+  uint64_t initialMaxStreamDataUni;
+  uint64_t initialMaxStreamsBidi;
+  uint64_t initialMaxStreamsUni;
+};
+
+/**
+ * An app token decoded for validation. It does not depend on the connection
+ * being resumed, so it can be shared by all of them.
+ */
+struct DecodedAppToken {
+  // The token as it was in the ticket.
+  Buf encodedToken;
+  folly::Optional<QuicVersion> version;
+  // folly::none if the ticket does not have exactly the expected parameters.
+  folly::Optional<TicketTransportParameterValues> transportParams;
+  std::vector<folly::IPAddress> sourceAddresses;
+  Buf appParams;
+  folly::Optional<TicketCongestionState> congestionState;
+};
+
+/**
+ * Decodes an app token. Returns nullptr if it cannot be decoded.
+ */
+std::shared_ptr<const DecodedAppToken> decodeAppTokenForValidation(
+    const folly::IOBuf& encodedToken);
+
+/**
+ * A cache of decoded app tokens, meant to be shared by all the workers of a
+ * server, so that a client resuming on any worker does not have its token
+ * decoded again.
+ *
+ * The cache has a fixed number of slots, and a token can only be in the slot
+ * its hash picks, which it takes over from the token that was there. Each
+ * slot is its own atomic shared pointer, so lookups and insertions never
+ * take a lock, and workers only contend when they touch the same slot. The
+ * entries are immutable once inserted. Tokens that cannot be decoded are not
+ * cached.
+ */
+class AppTokenCache {
+ public:
+  explicit AppTokenCache(size_t numSlots = kDefaultAppTokenCacheSize);
+
+  /**
+   * Returns the decoded token if it is in the cache, or nullptr.
+   */
+  std::shared_ptr<const DecodedAppToken> get(
+      const folly::IOBuf& encodedToken) const;
+
+  /**
+   * Returns the decoded token, decoding and caching it if it was not in the
+   * cache. Returns nullptr if it cannot be decoded.
+   */
+  std::shared_ptr<const DecodedAppToken> getOrDecode(
+      const folly::IOBuf& encodedToken);
+
+  size_t numSlots() const {
+    return numSlots_;
+  }
+
+ private:
+  using Slot = folly::atomic_shared_ptr<const DecodedAppToken>;
+
+  Slot& slotOf(const folly::IOBuf& encodedToken) const;
+
+  size_t numSlots_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+} // namespace quic
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/BatchingSelfCert.h>
+
+#include <glog/logging.h>
+
+namespace quic {
+
+SignatureBatcher::SignatureBatcher(size_t maxBatchSize, BatchSignFn signFn)
+    : maxBatchSize_(maxBatchSize), signFn_(std::move(signFn)) {
+  CHECK_GT(maxBatchSize_, 0);
+}
+
+Buf SignatureBatcher::sign(
+    const fizz::SelfCert& cert,
+    fizz::SignatureScheme scheme,
+    fizz::CertificateVerifyContext context,
+    folly::ByteRange toBeSigned) {
+  PendingRequest pending(Request{&cert, scheme, context, toBeSigned});
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_.push_back(&pending);
+  while (!pending.done) {
+    if (signing_) {
+      batchDone_.wait(lock);
+    } else {
+      signNextBatch(lock);
+    }
+  }
+  if (pending.error) {
+    std::rethrow_exception(pending.error);
+  }
+  return std::move(pending.signature);
+}
+
+size_t SignatureBatcher::pendingRequests() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return queue_.size();
+}
+
+std::vector<Buf> SignatureBatcher::signEach(
+    const std::vector<const Request*>& batch) {
+  std::vector<Buf> signatures;
+  signatures.reserve(batch.size());
+  for (const auto request : batch) {
+    signatures.push_back(request->cert->sign(
+        request->scheme, request->context, request->toBeSigned));
+  }
+  return signatures;
+}
+
+void SignatureBatcher::signNextBatch(std::unique_lock<std::mutex>& lock) {
+  std::vector<PendingRequest*> batch;
+  while (!queue_.empty() && batch.size() < maxBatchSize_) {
+    batch.push_back(queue_.front());
+    queue_.pop_front();
+  }
+  signing_ = true;
+  lock.unlock();
+
+  std::vector<const Request*> requests;
+  requests.reserve(batch.size());
+  for (const auto pending : batch) {
+    requests.push_back(&pending->request);
+  }
+  std::vector<Buf> signatures;
+  std::exception_ptr error;
+  try {
+    signatures = signFn_(requests);
+    if (signatures.size() != requests.size()) {
+      throw std::runtime_error("Batch signer returned wrong signature count");
+    }
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  lock.lock();
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (error) {
+      batch[i]->error = error;
+    } else {
+      batch[i]->signature = std::move(signatures[i]);
+    }
+    batch[i]->done = true;
+  }
+  signing_ = false;
+  batchDone_.notify_all();
+}
+
+BatchingSelfCert::BatchingSelfCert(
+    std::shared_ptr<const fizz::SelfCert> cert,
+    std::shared_ptr<SignatureBatcher> batcher)
+    : cert_(std::move(cert)), batcher_(std::move(batcher)) {
+  CHECK(cert_);
+  CHECK(batcher_);
+}
+
+std::string BatchingSelfCert::getIdentity() const {
+  return cert_->getIdentity();
+}
+
+std::vector<std::string> BatchingSelfCert::getAltIdentities() const {
+  return cert_->getAltIdentities();
+}
+
+std::vector<fizz::SignatureScheme> BatchingSelfCert::getSigSchemes() const {
+  return cert_->getSigSchemes();
+}
+
+fizz::CertificateMsg BatchingSelfCert::getCertMessage(
+    Buf certificateRequestContext) const {
+  return cert_->getCertMessage(std::move(certificateRequestContext));
+}
+
+fizz::CompressedCertificate BatchingSelfCert::getCompressedCert(
+    fizz::CertificateCompressionAlgorithm algo) const {
+  return cert_->getCompressedCert(algo);
+}
+
+Buf BatchingSelfCert::sign(
+    fizz::SignatureScheme scheme,
+    fizz::CertificateVerifyContext context,
+    folly::ByteRange toBeSigned) const {
+  return batcher_->sign(*cert_, scheme, context, toBeSigned);
+}
+
+folly::ssl::X509UniquePtr BatchingSelfCert::getX509() const {
+  return cert_->getX509();
+}
+} // namespace quic
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <fizz/protocol/Certificate.h>
+#include <folly/Function.h>
+#include <quic/QuicConstants.h>
+#include <quic/codec/Types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace quic {
+
+/**
+ * Groups the CertificateVerify signatures requested concurrently by different
+ * connections, from any thread, so that they can be handed to a signer that
+ * signs several inputs at once, e.g. a multi-buffer RSA or ECDSA
+ * implementation.
+ *
+ * There is no timer. While a batch is being signed, the requests that come in
+ * are queued, and one of the waiting threads signs them as the next batch
+ * once it is done. A request made while nothing is being signed is signed
+ * right away.
+ *
+ * Fizz signs synchronously, so sign() blocks the calling thread until its
+ * signature is ready. It is meant to be used with the server's handshake
+ * executor, whose threads can block.
+ */
+class SignatureBatcher {
+ public:
+  struct Request {
+    const fizz::SelfCert* cert;
+    fizz::SignatureScheme scheme;
+    fizz::CertificateVerifyContext context;
+    folly::ByteRange toBeSigned;
+  };
+
+  /**
+   * Signs all the requests, and returns their signatures in the same order.
+   */
+  using BatchSignFn =
+      folly::Function<std::vector<Buf>(const std::vector<const Request*>&)>;
+
+  /**
+   * The default signer signs the requests one by one with their certificate.
+   */
+  explicit SignatureBatcher(
+      size_t maxBatchSize = kDefaultMaxSignatureBatchSize,
+      BatchSignFn signFn = signEach);
+
+  Buf sign(
+      const fizz::SelfCert& cert,
+      fizz::SignatureScheme scheme,
+      fizz::CertificateVerifyContext context,
+      folly::ByteRange toBeSigned);
+
+  /**
+   * Returns the number of requests waiting for a batch to start.
+   */
+  size_t pendingRequests() const;
+
+  static std::vector<Buf> signEach(const std::vector<const Request*>& batch);
+
+ private:
+  struct PendingRequest {
+    explicit PendingRequest(Request requestIn) : request(requestIn) {}
+
+    Request request;
+    Buf signature;
+    std::exception_ptr error;
+    bool done{false};
+  };
+
+  /**
+   * Signs the next batch of queued requests. Called with the lock held, which
+   * is released while signing.
+   */
+  void signNextBatch(std::unique_lock<std::mutex>& lock);
+
+  size_t maxBatchSize_;
+  BatchSignFn signFn_;
+  mutable std::mutex mutex_;
+  std::condition_variable batchDone_;
+  std::deque<PendingRequest*> queue_;
+  bool signing_{false};
+};
+
+/**
+ * A certificate that signs through a SignatureBatcher, which may be shared by
+ * all the certificates of all the server's workers. Everything else is
+ * forwarded to the wrapped certificate.
+ */
+class BatchingSelfCert : public fizz::SelfCert {
+ public:
+  BatchingSelfCert(
+      std::shared_ptr<const fizz::SelfCert> cert,
+      std::shared_ptr<SignatureBatcher> batcher);
+
+  ~BatchingSelfCert() override = default;
+
+  std::string getIdentity() const override;
+
+  std::vector<std::string> getAltIdentities() const override;
+
+  std::vector<fizz::SignatureScheme> getSigSchemes() const override;
+
+  fizz::CertificateMsg getCertMessage(
+      Buf certificateRequestContext = nullptr) const override;
+
+  fizz::CompressedCertificate getCompressedCert(
+      fizz::CertificateCompressionAlgorithm algo) const override;
+
+  Buf sign(
+      fizz::SignatureScheme scheme,
+      fizz::CertificateVerifyContext context,
+      folly::ByteRange toBeSigned) const override;
+
+  folly::ssl::X509UniquePtr getX509() const override;
+
+ private:
+  std::shared_ptr<const fizz::SelfCert> cert_;
+  std::shared_ptr<SignatureBatcher> batcher_;
+};
+} // namespace quic
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/CachingSelfCert.h>
+
+#include <glog/logging.h>
+
+namespace quic {
+
+namespace {
+Buf cloneOrNull(const Buf& buf) {
+  return buf ? buf->clone() : nullptr;
+}
+
+fizz::CertificateMsg cloneCertMessage(const fizz::CertificateMsg& msg) {
+  fizz::CertificateMsg copy;
+  copy.certificate_request_context =
+      cloneOrNull(msg.certificate_request_context);
+  copy.certificate_list.reserve(msg.certificate_list.size());
+  for (const auto& entry : msg.certificate_list) {
+    fizz::CertificateEntry entryCopy;
+    entryCopy.cert_data = cloneOrNull(entry.cert_data);
+    entryCopy.extensions.reserve(entry.extensions.size());
+    for (const auto& extension : entry.extensions) {
+      fizz::Extension extensionCopy;
+      extensionCopy.extension_type = extension.extension_type;
+      extensionCopy.extension_data = cloneOrNull(extension.extension_data);
+      entryCopy.extensions.push_back(std::move(extensionCopy));
+    }
+    copy.certificate_list.push_back(std::move(entryCopy));
+  }
+  return copy;
+}
+} // namespace
+
+CachingSelfCert::CachingSelfCert(
+    std::shared_ptr<const fizz::SelfCert> cert,
+    const std::vector<fizz::CertificateCompressionAlgorithm>& compressionAlgos)
+    : cert_(std::move(cert)) {
+  CHECK(cert_);
+  certMessage_ = cert_->getCertMessage();
+  compressedCerts_.reserve(compressionAlgos.size());
+  for (auto algo : compressionAlgos) {
+    compressedCerts_.push_back(cert_->getCompressedCert(algo));
+  }
+}
+
+std::string CachingSelfCert::getIdentity() const {
+  return cert_->getIdentity();
+}
+
+std::vector<std::string> CachingSelfCert::getAltIdentities() const {
+  return cert_->getAltIdentities();
+}
+
+std::vector<fizz::SignatureScheme> CachingSelfCert::getSigSchemes() const {
+  return cert_->getSigSchemes();
+}
+
+fizz::CertificateMsg CachingSelfCert::getCertMessage(
+    Buf certificateRequestContext) const {
+  if (certificateRequestContext && !certificateRequestContext->empty()) {
+    return cert_->getCertMessage(std::move(certificateRequestContext));
+  }
+  return cloneCertMessage(certMessage_);
+}
+
+fizz::CompressedCertificate CachingSelfCert::getCompressedCert(
+    fizz::CertificateCompressionAlgorithm algo) const {
+  for (const auto& compressedCert : compressedCerts_) {
+    if (compressedCert.algorithm == algo) {
+      fizz::CompressedCertificate copy;
+      copy.algorithm = compressedCert.algorithm;
+      copy.uncompressed_length = compressedCert.uncompressed_length;
+      copy.compressed_certificate_message =
+          cloneOrNull(compressedCert.compressed_certificate_message);
+      return copy;
+    }
+  }
+  return cert_->getCompressedCert(algo);
+}
+
+Buf CachingSelfCert::sign(
+    fizz::SignatureScheme scheme,
+    fizz::CertificateVerifyContext context,
+    folly::ByteRange toBeSigned) const {
+  return cert_->sign(scheme, context, toBeSigned);
+}
+
+folly::ssl::X509UniquePtr CachingSelfCert::getX509() const {
+  return cert_->getX509();
+}
+} // namespace quic
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <fizz/protocol/Certificate.h>
+#include <quic/codec/Types.h>
+
+#include <vector>
+
+namespace quic {
+
+/**
+ * A certificate that builds its Certificate message, and its compressed
+ * forms for the given algorithms, once, and hands every handshake a copy
+ * that shares their buffers. The message only depends on the certificate
+ * chain, yet a fizz::SelfCertImpl DER encodes the whole chain again for each
+ * handshake it is used in.
+ *
+ * Nothing changes after construction, so one instance can be shared by all
+ * the workers. Everything else is forwarded to the wrapped certificate.
+ */
+class CachingSelfCert : public fizz::SelfCert {
+ public:
+  explicit CachingSelfCert(
+      std::shared_ptr<const fizz::SelfCert> cert,
+      const std::vector<fizz::CertificateCompressionAlgorithm>&
+          compressionAlgos = {});
+
+  ~CachingSelfCert() override = default;
+
+  std::string getIdentity() const override;
+
+  std::vector<std::string> getAltIdentities() const override;
+
+  std::vector<fizz::SignatureScheme> getSigSchemes() const override;
+
+  /**
+   * Only a message with an empty certificate request context, which is
+   * what the server sends during the handshake, comes from the cache.
+   */
+  fizz::CertificateMsg getCertMessage(
+      Buf certificateRequestContext = nullptr) const override;
+
+  fizz::CompressedCertificate getCompressedCert(
+      fizz::CertificateCompressionAlgorithm algo) const override;
+
+  Buf sign(
+      fizz::SignatureScheme scheme,
+      fizz::CertificateVerifyContext context,
+      folly::ByteRange toBeSigned) const override;
+
+  folly::ssl::X509UniquePtr getX509() const override;
+
+ private:
+  std::shared_ptr<const fizz::SelfCert> cert_;
+  fizz::CertificateMsg certMessage_;
+  std::vector<fizz::CompressedCertificate> compressedCerts_;
+};
+} // namespace quic
@@ -32,101 +32,99 @@ DefaultAppTokenValidator::DefaultAppTokenValidator(
     folly::Function<bool(
         const folly::Optional<std::string>& alpn,
         const std::unique_ptr<folly::IOBuf>& appParams) const>
-        earlyDataAppParamsValidator)
+        earlyDataAppParamsValidator,
+    std::shared_ptr<AppTokenCache> appTokenCache)
     : conn_(conn),
-      earlyDataAppParamsValidator_(std::move(earlyDataAppParamsValidator)) {}
+      earlyDataAppParamsValidator_(std::move(earlyDataAppParamsValidator)),
+      appTokenCache_(std::move(appTokenCache)) {}
+
+void DefaultAppTokenValidator::prepareValidation() {
+  const auto& settings = conn_->transportSettings;
+  Inputs inputs;
+  inputs.version = conn_->version;
+  if (conn_->peerAddress.isInitialized()) {
+    inputs.peerAddress = conn_->peerAddress.getIPAddress();
+  }
+  inputs.sourceTokenMatchingPolicy = settings.zeroRttSourceTokenMatchingPolicy;
+  inputs.idleTimeout = settings.idleTimeout;
+  inputs.maxRecvPacketSize = settings.maxRecvPacketSize;
+  inputs.initialConnectionWindowSize =
+      settings.advertisedInitialConnectionWindowSize;
+  inputs.initialBidiLocalStreamWindowSize =
+      settings.advertisedInitialBidiLocalStreamWindowSize;
+  inputs.initialBidiRemoteStreamWindowSize =
+      settings.advertisedInitialBidiRemoteStreamWindowSize;
+  inputs.initialUniStreamWindowSize =
+      settings.advertisedInitialUniStreamWindowSize;
+  inputs.initialMaxStreamsBidi = settings.advertisedInitialMaxStreamsBidi;
+  inputs.initialMaxStreamsUni = settings.advertisedInitialMaxStreamsUni;
+  inputs_ = std::move(inputs);
+}
 
 bool DefaultAppTokenValidator::validate(
     const fizz::server::ResumptionState& resumptionState) const {
-  conn_->transportParamsMatching = false;
-  conn_->sourceTokenMatching = false;
+  // This can run on the handshake executor, where the connection may already
+  // be gone. Only what prepareValidation() took from it is read here.
+  if (!inputs_) {
+    LOG(DFATAL) << "App token validated without prepareValidation()";
+    return false;
+  }
+  const auto& inputs = *inputs_;
+  inputs_->validation = Validation();
+  auto& validation = *inputs_->validation;
 
   if (!resumptionState.appToken) {
     VLOG(10) << "App token does not exist";
     return false;
   }
 
-  auto appToken = decodeAppToken(*resumptionState.appToken);
+  auto appToken = appTokenCache_
+      ? appTokenCache_->getOrDecode(*resumptionState.appToken)
+      : decodeAppTokenForValidation(*resumptionState.appToken);
   if (!appToken) {
     VLOG(10) << "Failed to decode app token";
     return false;
   }
 
-  if (conn_->version != appToken->version) {
+  if (inputs.version != appToken->version) {
     VLOG(10) << "QuicVersion mismatch";
     return false;
   }
 
-  auto& params = appToken->transportParams.parameters;
-
-  // TODO T33454954 Simplify ticket transport params. see comments in D9324131
-  // Currenly only initialMaxData, initialMaxStreamData, ackDelayExponent, and
-  // maxRecvPacketSize are written into the ticket. In case new parameters
-  // are added for making early data decision (although not likely), this
-  // validator fails the check if number of parameters is not
-  // kExpectedNumOfParamsInTheTicket.
-  if (params.size() != kExpectedNumOfParamsInTheTicket) {
-    VLOG(10) << "Unexpected number of parameters in the ticket";
+  if (!appToken->transportParams) {
+    VLOG(10) << "Unexpected parameters in the ticket";
     return false;
   }
+  const auto& params = *appToken->transportParams;
 
-  auto ticketIdleTimeout =
-      getIntegerParameter(TransportParameterId::idle_timeout, params);
-  if (!ticketIdleTimeout ||
-      conn_->transportSettings.idleTimeout !=
-          std::chrono::milliseconds(*ticketIdleTimeout)) {
+  if (inputs.idleTimeout != std::chrono::milliseconds(params.idleTimeout)) {
     VLOG(10) << "Changed idle timeout";
     return false;
   }
 
-  auto ticketPacketSize =
-      getIntegerParameter(TransportParameterId::max_packet_size, params);
-  if (!ticketPacketSize ||
-      conn_->transportSettings.maxRecvPacketSize < *ticketPacketSize) {
+  if (inputs.maxRecvPacketSize < params.maxRecvPacketSize) {
     VLOG(10) << "Decreased max receive packet size";
     return false;
   }
 
   // if the current max data is less than the one advertised previously we
   // reject the early data
-  auto ticketMaxData =
-      getIntegerParameter(TransportParameterId::initial_max_data, params);
-  if (!ticketMaxData ||
-      conn_->transportSettings.advertisedInitialConnectionWindowSize <
-          *ticketMaxData) {
+  if (inputs.initialConnectionWindowSize < params.initialMaxData) {
     VLOG(10) << "Decreased max data";
     return false;
   }
 
-  auto ticketMaxStreamDataBidiLocal = getIntegerParameter(
-      TransportParameterId::initial_max_stream_data_bidi_local, params);
-  auto ticketMaxStreamDataBidiRemote = getIntegerParameter(
-      TransportParameterId::initial_max_stream_data_bidi_remote, params);
-  auto ticketMaxStreamDataUni = getIntegerParameter(
-      TransportParameterId::initial_max_stream_data_uni, params);
-  if (!ticketMaxStreamDataBidiLocal ||
-      conn_->transportSettings.advertisedInitialBidiLocalStreamWindowSize <
-          *ticketMaxStreamDataBidiLocal ||
-      !ticketMaxStreamDataBidiRemote ||
-      conn_->transportSettings.advertisedInitialBidiRemoteStreamWindowSize <
-          *ticketMaxStreamDataBidiRemote ||
-      !ticketMaxStreamDataUni ||
-      conn_->transportSettings.advertisedInitialUniStreamWindowSize <
-          *ticketMaxStreamDataUni) {
+  if (inputs.initialBidiLocalStreamWindowSize <
+          params.initialMaxStreamDataBidiLocal ||
+      inputs.initialBidiRemoteStreamWindowSize <
+          params.initialMaxStreamDataBidiRemote ||
+      inputs.initialUniStreamWindowSize < params.initialMaxStreamDataUni) {
     VLOG(10) << "Decreased max stream data";
     return false;
   }
 
-  auto ticketMaxStreamsBidi = getIntegerParameter(
-      TransportParameterId::initial_max_streams_bidi, params);
-  auto ticketMaxStreamsUni = getIntegerParameter(
-      TransportParameterId::initial_max_streams_uni, params);
-  if (!ticketMaxStreamsBidi ||
-      conn_->transportSettings.advertisedInitialMaxStreamsBidi <
-          *ticketMaxStreamsBidi ||
-      !ticketMaxStreamsUni ||
-      conn_->transportSettings.advertisedInitialMaxStreamsUni <
-          *ticketMaxStreamsUni) {
+  if (inputs.initialMaxStreamsBidi < params.initialMaxStreamsBidi ||
+      inputs.initialMaxStreamsUni < params.initialMaxStreamsUni) {
     VLOG(10) << "Decreased max stream data";
     return false;
   }
@@ -134,10 +132,13 @@ bool DefaultAppTokenValidator::validate(
   // TODO max ack delay, is this really necessary?
   // spec says disable_migration should also be in the ticket. It shouldn't.
 
-  conn_->transportParamsMatching = true;
+  validation.transportParamsMatching = true;
+  validation.appToken = appToken;
 
-  if (!validateAndUpdateSourceToken(
-          *conn_, std::move(appToken->sourceAddresses))) {
+  if (!isSourceTokenAccepted(
+          inputs.peerAddress,
+          inputs.sourceTokenMatchingPolicy,
+          appToken->sourceAddresses)) {
     VLOG(10) << "No exact match from source address token";
     return false;
   }
@@ -151,18 +152,40 @@ bool DefaultAppTokenValidator::validate(
     return false;
   }
 
+  validation.accepted = true;
+  return true;
+}
+
+void DefaultAppTokenValidator::applyValidatedAppToken() {
+  if (!inputs_ || !inputs_->validation) {
+    return;
+  }
+  auto validation = std::move(*inputs_->validation);
+  inputs_ = folly::none;
+  conn_->transportParamsMatching = validation.transportParamsMatching;
+  conn_->sourceTokenMatching = false;
+  if (!validation.appToken) {
+    return;
+  }
+  const auto& appToken = *validation.appToken;
+  if (!validateAndUpdateSourceToken(*conn_, appToken.sourceAddresses)) {
+    return;
+  }
+
+  if (!validation.accepted) {
+    return;
+  }
+  const auto& params = *appToken.transportParams;
   updateTransportParamsFromTicket(
       *conn_,
-      *ticketIdleTimeout,
-      *ticketPacketSize,
-      *ticketMaxData,
-      *ticketMaxStreamDataBidiLocal,
-      *ticketMaxStreamDataBidiRemote,
-      *ticketMaxStreamDataUni,
-      *ticketMaxStreamsBidi,
-      *ticketMaxStreamsUni);
-
-  return true;
+      params.idleTimeout,
+      params.maxRecvPacketSize,
+      params.initialMaxData,
+      params.initialMaxStreamDataBidiLocal,
+      params.initialMaxStreamDataBidiRemote,
+      params.initialMaxStreamDataUni,
+      params.initialMaxStreamsBidi,
+      params.initialMaxStreamsUni);
 }
 
 } // namespace quic
@@ -11,9 +11,13 @@
 #include <fizz/server/State.h>
 
 #include <folly/Function.h>
+#include <folly/IPAddress.h>
 #include <folly/Optional.h>
 #include <folly/io/IOBuf.h>
+#include <quic/QuicConstants.h>
+#include <quic/server/handshake/AppTokenCache.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -26,23 +30,61 @@ struct ResumptionState;
 namespace quic {
 struct QuicServerConnectionState;
 
-class DefaultAppTokenValidator : public fizz::server::AppTokenValidator {
+class DefaultAppTokenValidator : public ConnectionAppTokenValidator {
  public:
+  /**
+   * If appTokenCache is set, the app tokens are decoded through it, so that
+   * they are only decoded once for all the connections sharing the cache.
+   */
   explicit DefaultAppTokenValidator(
       QuicServerConnectionState* conn,
       folly::Function<bool(
           const folly::Optional<std::string>& alpn,
           const std::unique_ptr<folly::IOBuf>& appParams) const>
-          earlyDataAppParamsValidator);
+          earlyDataAppParamsValidator,
+      std::shared_ptr<AppTokenCache> appTokenCache = nullptr);
+
+  void prepareValidation() override;
 
   bool validate(const fizz::server::ResumptionState&) const override;
 
+  void applyValidatedAppToken() override;
+
  private:
+  // What validate() found, the connection is only changed once it is applied.
+  struct Validation {
+    bool transportParamsMatching{false};
+    // Set once the transport parameters of the token matched.
+    std::shared_ptr<const DecodedAppToken> appToken;
+    // Whether validate() accepted the early data.
+    bool accepted{false};
+  };
+
+  // What validate() reads from the connection, taken by prepareValidation().
+  struct Inputs {
+    folly::Optional<QuicVersion> version;
+    folly::IPAddress peerAddress;
+    ZeroRttSourceTokenMatchingPolicy sourceTokenMatchingPolicy;
+    std::chrono::milliseconds idleTimeout;
+    uint64_t maxRecvPacketSize;
+    uint64_t initialConnectionWindowSize;
+    uint64_t initialBidiLocalStreamWindowSize;
+    uint64_t initialBidiRemoteStreamWindowSize;
+    uint64_t initialUniStreamWindowSize;
+    uint64_t initialMaxStreamsBidi;
+    uint64_t initialMaxStreamsUni;
+    // Written by validate(), wherever it runs, and taken on the executor of
+    // the connection by applyValidatedAppToken().
+    folly::Optional<Validation> validation;
+  };
+
   QuicServerConnectionState* conn_;
   folly::Function<bool(
       const folly::Optional<std::string>& alpn,
       const std::unique_ptr<folly::IOBuf>& appParams) const>
       earlyDataAppParamsValidator_;
+  std::shared_ptr<AppTokenCache> appTokenCache_;
+  mutable folly::Optional<Inputs> inputs_;
 };
 
 } // namespace quic
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/RetryTokenGenerator.h>
+
+#include <folly/io/Cursor.h>
+#include <openssl/crypto.h>
+
+namespace {
+constexpr folly::StringPiece kSalt{"Retry token"};
+
+uint64_t epochOf(std::chrono::system_clock::time_point now) {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             now.time_since_epoch())
+             .count() /
+      quic::kRetryTokenKeyRotationInterval.count();
+}
+} // namespace
+
+namespace quic {
+
+RetryTokenGenerator::RetryTokenGenerator(RetryTokenSecret secret) {
+  extractedSecret_ = hkdf_.extract(kSalt, folly::range(secret));
+}
+
+Buf RetryTokenGenerator::generateToken(
+    const folly::IPAddress& clientAddress,
+    const ConnectionId& connId,
+    std::chrono::system_clock::time_point now) const {
+  auto epoch = epochOf(now);
+  auto mac = computeMac(epoch, clientAddress, connId);
+  auto token = folly::IOBuf::create(sizeof(epoch) + kRetryTokenMacLength);
+  folly::io::Appender appender(token.get(), 0);
+  appender.writeBE<uint64_t>(epoch);
+  appender.push(mac->coalesce());
+  return token;
+}
+
+bool RetryTokenGenerator::validateToken(
+    const folly::IOBuf& token,
+    const folly::IPAddress& clientAddress,
+    const ConnectionId& connId,
+    std::chrono::system_clock::time_point now) const {
+  if (token.computeChainDataLength() !=
+      sizeof(uint64_t) + kRetryTokenMacLength) {
+    return false;
+  }
+  folly::io::Cursor cursor(&token);
+  auto epoch = cursor.readBE<uint64_t>();
+  auto currentEpoch = epochOf(now);
+  if (epoch != currentEpoch && epoch + 1 != currentEpoch) {
+    return false;
+  }
+  std::array<uint8_t, kRetryTokenMacLength> mac;
+  cursor.pull(mac.data(), mac.size());
+  auto expectedMac = computeMac(epoch, clientAddress, connId);
+  return CRYPTO_memcmp(
+             mac.data(), expectedMac->coalesce().data(), mac.size()) == 0;
+}
+
+std::unique_ptr<folly::IOBuf> RetryTokenGenerator::computeMac(
+    uint64_t epoch,
+    const folly::IPAddress& clientAddress,
+    const ConnectionId& connId) const {
+  uint64_t epochBE = folly::Endian::big(epoch);
+  auto key = hkdf_.expand(
+      folly::range(extractedSecret_),
+      *folly::IOBuf::wrapBuffer(&epochBE, sizeof(epochBE)),
+      kRetryTokenSecretLength);
+  auto info = toData(connId);
+  info.prependChain(folly::IOBuf::wrapBuffer(
+      clientAddress.bytes(), clientAddress.byteCount()));
+  return hkdf_.expand(key->coalesce(), info, kRetryTokenMacLength);
+}
+
+} // namespace quic
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <fizz/crypto/Hkdf.h>
+#include <fizz/crypto/Sha256.h>
+#include <folly/IPAddress.h>
+#include <quic/codec/Types.h>
+
+#include <chrono>
+
+namespace quic {
+
+using RetryTokenSecret = std::array<uint8_t, kRetryTokenSecretLength>;
+
+/**
+ * Mints and validates the address validation tokens that the server sends in
+ * Retry packets.
+ *
+ * A token is only valid for the client address it was sent to and for the
+ * connection id that the server chose in the Retry, which the client uses as
+ * the destination of its next Initial. Time is split into epochs of
+ * kRetryTokenKeyRotationInterval, and every epoch has its own key derived from
+ * the RetryTokenSecret. A token is accepted during the epoch it was minted in
+ * and the next one.
+ *
+ * PRK = HKDF-Extract(Salt, secret)
+ * key = HKDF-Expand(PRK, epoch, secretLength)
+ * Token = Concat(epoch, HKDF-Expand(key, Concat(connId, address), macLength))
+ *
+ * Validating a token does not need any state other than the secret, so
+ * spoofed Initials can be rejected without allocating anything for them.
+ */
+class RetryTokenGenerator {
+ public:
+  explicit RetryTokenGenerator(RetryTokenSecret secret);
+
+  Buf generateToken(
+      const folly::IPAddress& clientAddress,
+      const ConnectionId& connId,
+      std::chrono::system_clock::time_point now =
+          std::chrono::system_clock::now()) const;
+
+  bool validateToken(
+      const folly::IOBuf& token,
+      const folly::IPAddress& clientAddress,
+      const ConnectionId& connId,
+      std::chrono::system_clock::time_point now =
+          std::chrono::system_clock::now()) const;
+
+ private:
+  std::unique_ptr<folly::IOBuf> computeMac(
+      uint64_t epoch,
+      const folly::IPAddress& clientAddress,
+      const ConnectionId& connId) const;
+
+  fizz::HkdfImpl<fizz::Sha256> hkdf_;
+  std::vector<uint8_t> extractedSecret_;
+};
+} // namespace quic
@@ -36,20 +36,36 @@ void ServerHandshake::initialize(
   executor_ = executor;
   auto ctx = std::make_shared<fizz::server::FizzServerContext>(*context);
   ctx->setFactory(std::make_shared<QuicFizzFactory>());
-  ctx->setSupportedCiphers({{fizz::CipherSuite::TLS_AES_128_GCM_SHA256}});
+  // A single tier, so that the client's order decides: it knows whether it
+  // has AES instructions.
+  ctx->setSupportedCiphers({getPreferredCipherSuites()});
   ctx->setVersionFallbackEnabled(false);
   // Since Draft-17, client won't sent EOED
   ctx->setOmitEarlyRecordLayer(true);
+  if (certificateCompression_) {
+    ctx->setSupportedCompressionAlgorithms(
+        {fizz::CertificateCompressionAlgorithm::zlib});
+  }
   context_ = std::move(ctx);
   callback_ = callback;
 
   if (validator) {
+    connAppTokenValidator_ =
+        dynamic_cast<ConnectionAppTokenValidator*>(validator.get());
     state_.appTokenValidator() = std::move(validator);
   } else {
     state_.appTokenValidator() = std::make_unique<FailingAppTokenValidator>();
   }
 }
 
+void ServerHandshake::setHandshakeExecutor(folly::Executor* handshakeExecutor) {
+  handshakeExecutor_ = handshakeExecutor;
+}
+
+void ServerHandshake::setCertificateCompression(bool certificateCompression) {
+  certificateCompression_ = certificateCompression;
+}
+
 void ServerHandshake::doHandshake(
     std::unique_ptr<folly::IOBuf> data,
     EncryptionLevel encryptionLevel) {
@@ -58,6 +74,9 @@ void ServerHandshake::doHandshake(
   };
   inHandshakeStack_ = true;
   waitForData_ = false;
+  if (!timings_.startTime) {
+    timings_.startTime = Clock::now();
+  }
   switch (encryptionLevel) {
     case EncryptionLevel::Initial:
       initialReadBuf_.append(std::move(data));
@@ -177,6 +196,10 @@ ServerHandshake::Phase ServerHandshake::getPhase() const {
   return phase_;
 }
 
+const HandshakeTimings& ServerHandshake::getHandshakeTimings() const {
+  return timings_;
+}
+
 folly::Optional<ClientTransportParameters>
 ServerHandshake::getClientTransportParams() {
   return transportParams_->getClientTransportParams();
@@ -190,6 +213,13 @@ const fizz::server::State& ServerHandshake::getState() const {
   return state_;
 }
 
+const folly::IOBuf* ServerHandshake::getResumedAppToken() const {
+  if (state_.pskType() != fizz::PskType::Resumption) {
+    return nullptr;
+  }
+  return state_.appToken().get();
+}
+
 const std::shared_ptr<const fizz::server::FizzServerContext>
 ServerHandshake::getContext() const {
   return context_;
@@ -197,7 +227,65 @@ ServerHandshake::getContext() const {
 
 const folly::Optional<std::string>& ServerHandshake::getApplicationProtocol()
     const {
-  return state_.alpn();
+  return restoredApplicationProtocol_ ? restoredApplicationProtocol_
+                                      : state_.alpn();
+}
+
+std::unique_ptr<Aead> ServerHandshake::getNextOneRttReadCipher() {
+  if (oneRttReadSecret_.empty() || !oneRttSecrets_) {
+    return nullptr;
+  }
+  // A restored connection has no fizz context, the factory is the same.
+  QuicFizzFactory fizzFactory;
+  return deriveNextOneRttAead(
+      fizzFactory, oneRttSecrets_->cipher, oneRttReadSecret_);
+}
+
+std::unique_ptr<Aead> ServerHandshake::getNextOneRttWriteCipher() {
+  if (oneRttWriteSecret_.empty() || !oneRttSecrets_) {
+    return nullptr;
+  }
+  QuicFizzFactory fizzFactory;
+  return deriveNextOneRttAead(
+      fizzFactory, oneRttSecrets_->cipher, oneRttWriteSecret_);
+}
+
+folly::Optional<ServerHandshake::OneRttSecrets>
+ServerHandshake::getOneRttSecrets() const {
+  if (!oneRttSecrets_ || oneRttSecrets_->readSecret.empty() ||
+      oneRttSecrets_->writeSecret.empty()) {
+    return folly::none;
+  }
+  return oneRttSecrets_;
+}
+
+void ServerHandshake::restoreOneRttSecrets(
+    const OneRttSecrets& secrets,
+    folly::Optional<std::string> applicationProtocol) {
+  QuicFizzFactory fizzFactory;
+  FizzCryptoFactory cryptoFactory(&fizzFactory);
+  auto keyScheduler = fizzFactory.makeKeyScheduler(secrets.cipher);
+  auto makeAead = [&](const std::vector<uint8_t>& secret) {
+    return FizzAead::wrap(fizz::Protocol::deriveRecordAeadWithLabel(
+        fizzFactory,
+        *keyScheduler,
+        secrets.cipher,
+        folly::range(secret),
+        kQuicKeyLabel,
+        kQuicIVLabel));
+  };
+  oneRttReadCipher_ = makeAead(secrets.readSecret);
+  oneRttWriteCipher_ = makeAead(secrets.writeSecret);
+  oneRttReadHeaderCipher_ = cryptoFactory.makePacketNumberCipher(
+      folly::range(secrets.readSecret), secrets.cipher);
+  oneRttWriteHeaderCipher_ = cryptoFactory.makePacketNumberCipher(
+      folly::range(secrets.writeSecret), secrets.cipher);
+  oneRttReadSecret_ = secrets.readSecret;
+  oneRttWriteSecret_ = secrets.writeSecret;
+  oneRttSecrets_ = secrets;
+  restoredApplicationProtocol_ = std::move(applicationProtocol);
+  phase_ = Phase::Established;
+  handshakeDone_ = true;
 }
 
 void ServerHandshake::onError(
@@ -257,9 +345,18 @@ void ServerHandshake::processActions(
   // actionGuard_ and potentially processing another action.
   folly::DelayedDestruction::DestructorGuard dg(this);
 
+  if (connAppTokenValidator_) {
+    // The validation may have run on handshakeExecutor_, the connection is
+    // only changed here, on executor_.
+    connAppTokenValidator_->applyValidatedAppToken();
+  }
+  auto processingStart = Clock::now();
   for (auto& action : actions) {
     boost::apply_visitor(visitor_, action);
   }
+  timings_.processingTime +=
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - processingStart);
 
   actionGuard_.clear();
   if (callback_ && !inHandshakeStack_ && handshakeEventAvailable_) {
@@ -284,10 +381,18 @@ void ServerHandshake::processPendingEvents() {
     folly::Optional<fizz::server::ServerStateMachine::ProcessingActions>
         actions;
     actionGuard_ = folly::DelayedDestruction::DestructorGuard(this);
+    auto processingStart = Clock::now();
     if (!waitForData_) {
       switch (state_.readRecordLayer()->getEncryptionLevel()) {
         case fizz::EncryptionLevel::Plaintext:
-          actions = machine_.processSocketData(state_, initialReadBuf_);
+          if (connAppTokenValidator_) {
+            connAppTokenValidator_->prepareValidation();
+          }
+          if (handshakeExecutor_ && !initialReadBuf_.empty()) {
+            actions = processSocketDataOnHandshakeExecutor(initialReadBuf_);
+          } else {
+            actions = machine_.processSocketData(state_, initialReadBuf_);
+          }
           break;
         case fizz::EncryptionLevel::Handshake:
           actions = machine_.processSocketData(state_, handshakeReadBuf_);
@@ -311,10 +416,57 @@ void ServerHandshake::processPendingEvents() {
       actionGuard_.clear();
       return;
     }
+    timings_.processingTime +=
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            Clock::now() - processingStart);
     startActions(std::move(*actions));
   }
 }
 
+fizz::server::AsyncActions
+ServerHandshake::processSocketDataOnHandshakeExecutor(
+    folly::IOBufQueue& readBuf) {
+  // The state machine does not change state_ itself, it returns the changes
+  // as actions which are applied on executor_. The data is moved out of
+  // readBuf so that packets arriving meanwhile can still be queued.
+  auto data = std::make_shared<folly::IOBufQueue>(
+      folly::IOBufQueue::cacheChainLength());
+  data->append(readBuf.move());
+  // Measured on handshakeExecutor_ and added to timings_ on executor_.
+  auto processingTime = std::make_shared<std::chrono::microseconds>(0);
+  return folly::via(
+             handshakeExecutor_,
+             [this, data, processingTime]()
+                 -> folly::Future<fizz::server::Actions> {
+               auto processingStart = Clock::now();
+               auto actions = machine_.processSocketData(state_, *data);
+               *processingTime =
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       Clock::now() - processingStart);
+               return folly::variant_match(
+                   actions,
+                   [](folly::Future<fizz::server::Actions>& futureActions) {
+                     return std::move(futureActions);
+                   },
+                   [](fizz::server::Actions& immediateActions) {
+                     return folly::makeFuture(std::move(immediateActions));
+                   });
+             })
+      .via(executor_)
+      .then([this, data, processingTime, &readBuf](
+                fizz::server::Actions actions) {
+        timings_.processingTime += *processingTime;
+        if (!data->empty()) {
+          // The unconsumed data goes in front of the data that arrived while
+          // it was being processed.
+          auto arrived = readBuf.move();
+          readBuf.append(data->move());
+          readBuf.append(std::move(arrived));
+        }
+        return actions;
+      });
+}
+
 ServerHandshake::ActionMoveVisitor::ActionMoveVisitor(ServerHandshake& server)
     : server_(server) {}
 
@@ -342,6 +494,7 @@ void ServerHandshake::ActionMoveVisitor::operator()(
   // client finished. At this point we can write any post handshake data and
   // crypto data with the 1-rtt keys.
   server_.phase_ = Phase::Established;
+  server_.timings_.establishedTime = Clock::now();
   if (originalPhase != Phase::Handshake) {
     // We already derived the zero rtt keys as well as the one rtt write
     // keys.
@@ -403,7 +556,7 @@ void ServerHandshake::ActionMoveVisitor::operator()(
   QuicFizzFactory fizzFactory;
   FizzCryptoFactory cryptoFactory(&fizzFactory);
   auto headerCipher = cryptoFactory.makePacketNumberCipher(
-      folly::range(secretAvailable.secret.secret));
+      folly::range(secretAvailable.secret.secret), *server_.state_.cipher());
   folly::variant_match(
       secretAvailable.secret.type,
       [&](fizz::EarlySecrets earlySecrets) {
@@ -429,14 +582,23 @@ void ServerHandshake::ActionMoveVisitor::operator()(
         }
       },
       [&](fizz::AppTrafficSecrets appSecrets) {
+        if (!server_.oneRttSecrets_) {
+          server_.oneRttSecrets_ =
+              OneRttSecrets{*server_.state_.cipher(), {}, {}};
+        }
         switch (appSecrets) {
           case fizz::AppTrafficSecrets::ClientAppTraffic:
             server_.oneRttReadCipher_ = FizzAead::wrap(std::move(aead));
             server_.oneRttReadHeaderCipher_ = std::move(headerCipher);
+            server_.oneRttReadSecret_ = secretAvailable.secret.secret;
+            server_.oneRttSecrets_->readSecret = secretAvailable.secret.secret;
             break;
           case fizz::AppTrafficSecrets::ServerAppTraffic:
             server_.oneRttWriteCipher_ = FizzAead::wrap(std::move(aead));
             server_.oneRttWriteHeaderCipher_ = std::move(headerCipher);
+            server_.oneRttWriteSecret_ = secretAvailable.secret.secret;
+            server_.oneRttSecrets_->writeSecret = secretAvailable.secret.secret;
+            server_.timings_.keysDerivedTime = Clock::now();
             break;
         }
       },
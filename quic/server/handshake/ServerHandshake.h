@@ -68,6 +68,16 @@ class ServerHandshake : public Handshake {
    */
   enum class Phase { Handshake, KeysDerived, Established };
 
+  /**
+   * The key phase zero 1-RTT traffic secrets of the client and the server,
+   * which all the 1-RTT keys of the connection are derived from.
+   */
+  struct OneRttSecrets {
+    fizz::CipherSuite cipher;
+    std::vector<uint8_t> readSecret;
+    std::vector<uint8_t> writeSecret;
+  };
+
   explicit ServerHandshake(QuicCryptoState& cryptoState);
 
   /**
@@ -88,6 +98,21 @@ class ServerHandshake : public Handshake {
       HandshakeCallback* callback,
       std::unique_ptr<fizz::server::AppTokenValidator> validator = nullptr);
 
+  /**
+   * Runs the processing of the client's Initial crypto data, which does the
+   * key exchange and signs the CertificateVerify, on the given executor
+   * instead of the one passed to initialize. The resulting actions are still
+   * applied on the executor passed to initialize.
+   */
+  void setHandshakeExecutor(folly::Executor* handshakeExecutor);
+
+  /**
+   * Offers to compress the certificate with zlib when the client supports it.
+   * Must be called before initialize, and the certificates of the context must
+   * have a zlib compressor.
+   */
+  void setCertificateCompression(bool certificateCompression);
+
   /**
    * Performs the handshake, after a handshake you should check whether or
    * not an event is available.
@@ -169,6 +194,12 @@ class ServerHandshake : public Handshake {
 
   virtual Phase getPhase() const;
 
+  /**
+   * Returns when the handshake reached each phase and how long fizz spent
+   * processing it so far.
+   */
+  const HandshakeTimings& getHandshakeTimings() const;
+
   /**
    * Returns the negotiated transport parameters from the client.
    */
@@ -184,6 +215,12 @@ class ServerHandshake : public Handshake {
    */
   const fizz::server::State& getState() const;
 
+  /**
+   * Returns the app token of the ticket the connection resumed from, or
+   * nullptr if it did not resume.
+   */
+  virtual const folly::IOBuf* getResumedAppToken() const;
+
   /**
    * Returns the context used by the ServerHandshake.
    */
@@ -195,6 +232,23 @@ class ServerHandshake : public Handshake {
    */
   const folly::Optional<std::string>& getApplicationProtocol() const override;
 
+  std::unique_ptr<Aead> getNextOneRttReadCipher() override;
+  std::unique_ptr<Aead> getNextOneRttWriteCipher() override;
+
+  /**
+   * Returns the 1-RTT secrets once both are derived.
+   */
+  folly::Optional<OneRttSecrets> getOneRttSecrets() const;
+
+  /**
+   * Installs the 1-RTT secrets of a connection handed off by another process
+   * in place of running the handshake. The handshake is then done, and the
+   * 1-RTT ciphers are returned by their getters as after a handshake.
+   */
+  void restoreOneRttSecrets(
+      const OneRttSecrets& secrets,
+      folly::Optional<std::string> applicationProtocol);
+
   class ActionMoveVisitor : public boost::static_visitor<> {
    public:
     explicit ActionMoveVisitor(ServerHandshake& server);
@@ -244,10 +298,22 @@ class ServerHandshake : public Handshake {
    */
   void processPendingEvents();
 
+  /**
+   * Processes the data in readBuf on handshakeExecutor_ and resumes on
+   * executor_. Any data that is not consumed is put back in readBuf.
+   */
+  fizz::server::AsyncActions processSocketDataOnHandshakeExecutor(
+      folly::IOBufQueue& readBuf);
+
   fizz::server::State state_;
   fizz::server::ServerStateMachine machine_;
   folly::Optional<folly::DelayedDestruction::DestructorGuard> actionGuard_;
   folly::Executor* executor_;
+  folly::Executor* handshakeExecutor_{nullptr};
+  // The app token validator in state_, if it defers its changes to the
+  // connection.
+  ConnectionAppTokenValidator* connAppTokenValidator_{nullptr};
+  bool certificateCompression_{false};
   std::shared_ptr<const fizz::server::FizzServerContext> context_;
   using PendingEvent = boost::variant<fizz::WriteNewSessionTicket>;
   std::deque<PendingEvent> pendingEvents_;
@@ -270,6 +336,14 @@ class ServerHandshake : public Handshake {
   std::unique_ptr<Aead> oneRttWriteCipher_;
   std::unique_ptr<Aead> zeroRttReadCipher_;
 
+  // The 1-RTT traffic secrets, of the last key phase derived.
+  std::vector<uint8_t> oneRttReadSecret_;
+  std::vector<uint8_t> oneRttWriteSecret_;
+  // The 1-RTT traffic secrets of key phase zero, and their cipher suite.
+  folly::Optional<OneRttSecrets> oneRttSecrets_;
+  // The ALPN of a restored connection, which has no fizz state to hold it.
+  folly::Optional<std::string> restoredApplicationProtocol_;
+
   std::unique_ptr<PacketNumberCipher> oneRttReadHeaderCipher_;
   std::unique_ptr<PacketNumberCipher> oneRttWriteHeaderCipher_;
   std::unique_ptr<PacketNumberCipher> handshakeReadHeaderCipher_;
@@ -281,6 +355,7 @@ class ServerHandshake : public Handshake {
   bool handshakeEventAvailable_{false};
 
   Phase phase_{Phase::Handshake};
+  HandshakeTimings timings_;
 
   std::shared_ptr<ServerTransportParametersExtension> transportParams_;
 }; // namespace quic
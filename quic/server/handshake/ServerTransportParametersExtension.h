@@ -12,8 +12,195 @@
 #include <quic/handshake/TransportParameters.h>
 #include <quic/server/handshake/StatelessResetGenerator.h>
 
+#include <cstring>
+#include <memory>
+#include <tuple>
+
 namespace quic {
 
+/**
+ * The transport parameters a server sends that only depend on its transport
+ * settings.
+ */
+struct StaticServerTransportParameters {
+  uint64_t initialMaxData{0};
+  uint64_t initialMaxStreamDataBidiLocal{0};
+  uint64_t initialMaxStreamDataBidiRemote{0};
+  uint64_t initialMaxStreamDataUni{0};
+  uint64_t initialMaxStreamsBidi{0};
+  uint64_t initialMaxStreamsUni{0};
+  std::chrono::milliseconds idleTimeout{0};
+  uint64_t ackDelayExponent{0};
+  uint64_t maxRecvPacketSize{0};
+  TransportPartialReliabilitySetting partialReliability{false};
+  folly::Optional<std::chrono::microseconds> minAckDelay;
+  uint64_t maxDatagramFrameSize{0};
+  bool fecEnabled{false};
+
+  auto tie() const {
+    return std::tie(
+        initialMaxData,
+        initialMaxStreamDataBidiLocal,
+        initialMaxStreamDataBidiRemote,
+        initialMaxStreamDataUni,
+        initialMaxStreamsBidi,
+        initialMaxStreamsUni,
+        idleTimeout,
+        ackDelayExponent,
+        maxRecvPacketSize,
+        partialReliability,
+        minAckDelay,
+        maxDatagramFrameSize,
+        fecEnabled);
+  }
+
+  bool operator==(const StaticServerTransportParameters& other) const {
+    return tie() == other.tie();
+  }
+
+  bool operator!=(const StaticServerTransportParameters& other) const {
+    return !(*this == other);
+  }
+};
+
+/**
+ * The encoded parameter list of StaticServerTransportParameters, with room
+ * for the stateless reset token of a connection. Encoding a connection's
+ * parameters is then a single allocation and copy, with the versions in
+ * front and the token patched in.
+ */
+class EncodedServerTransportParameters {
+ public:
+  explicit EncodedServerTransportParameters(
+      StaticServerTransportParameters params)
+      : params_(std::move(params)) {
+    std::vector<TransportParameter> parameters;
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_stream_data_bidi_local,
+        params_.initialMaxStreamDataBidiLocal));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_stream_data_bidi_remote,
+        params_.initialMaxStreamDataBidiRemote));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_stream_data_uni,
+        params_.initialMaxStreamDataUni));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_data, params_.initialMaxData));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_streams_bidi,
+        params_.initialMaxStreamsBidi));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_streams_uni,
+        params_.initialMaxStreamsUni));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::idle_timeout, params_.idleTimeout.count()));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::ack_delay_exponent, params_.ackDelayExponent));
+    parameters.push_back(encodeIntegerParameter(
+        TransportParameterId::max_packet_size, params_.maxRecvPacketSize));
+    // The length of the list, and the id and length of the token value.
+    tokenOffset_ = sizeof(uint16_t) * 3;
+    for (const auto& parameter : parameters) {
+      tokenOffset_ += sizeof(parameter.parameter) + sizeof(uint16_t) +
+          parameter.value->computeChainDataLength();
+    }
+    TransportParameter statelessReset;
+    statelessReset.parameter = TransportParameterId::stateless_reset_token;
+    statelessReset.value = folly::IOBuf::create(sizeof(StatelessResetToken));
+    memset(
+        statelessReset.value->writableData(), 0, sizeof(StatelessResetToken));
+    statelessReset.value->append(sizeof(StatelessResetToken));
+    parameters.push_back(std::move(statelessReset));
+
+    uint64_t partialReliabilitySetting = 0;
+    if (kPartialReliabilityBuilt && params_.partialReliability) {
+      partialReliabilitySetting = 1;
+    }
+    parameters.push_back(encodeIntegerParameter(
+        static_cast<TransportParameterId>(kPartialReliabilityParameterId),
+        partialReliabilitySetting));
+
+    if (params_.minAckDelay) {
+      parameters.push_back(encodeIntegerParameter(
+          static_cast<TransportParameterId>(kMinAckDelayParameterId),
+          params_.minAckDelay->count()));
+    }
+
+    if (params_.maxDatagramFrameSize > 0) {
+      parameters.push_back(encodeIntegerParameter(
+          TransportParameterId::max_datagram_frame_size,
+          params_.maxDatagramFrameSize));
+    }
+
+    if (params_.fecEnabled) {
+      parameters.push_back(encodeIntegerParameter(
+          static_cast<TransportParameterId>(kFecParameterId), 1));
+    }
+
+    encoded_ = folly::IOBuf::create(0);
+    folly::io::Appender appender(encoded_.get(), 40);
+    fizz::detail::writeVector<uint16_t>(parameters, appender);
+    encoded_->coalesce();
+  }
+
+  const StaticServerTransportParameters& getParameters() const {
+    return params_;
+  }
+
+  /**
+   * The transport parameters extension of a connection.
+   */
+  fizz::Extension encode(
+      const folly::Optional<QuicVersion>& negotiatedVersion,
+      const std::vector<QuicVersion>& supportedVersions,
+      const StatelessResetToken& token) const {
+    size_t versionsSize = 0;
+    if (negotiatedVersion) {
+      versionsSize = sizeof(QuicVersion) + sizeof(uint8_t) +
+          sizeof(QuicVersion) * supportedVersions.size();
+    }
+    fizz::Extension ext;
+    ext.extension_type = fizz::ExtensionType::quic_transport_parameters;
+    ext.extension_data =
+        folly::IOBuf::create(versionsSize + encoded_->length());
+    folly::io::Appender appender(ext.extension_data.get(), 0);
+    if (negotiatedVersion) {
+      fizz::detail::write(negotiatedVersion.value(), appender);
+      fizz::detail::writeVector<uint8_t>(supportedVersions, appender);
+    }
+    appender.push(encoded_->data(), encoded_->length());
+    auto parameters = ext.extension_data->writableData() +
+        ext.extension_data->length() - encoded_->length();
+    memcpy(parameters + tokenOffset_, token.data(), token.size());
+    return ext;
+  }
+
+ private:
+  StaticServerTransportParameters params_;
+  // The encoded list, with a zero token at tokenOffset_.
+  Buf encoded_;
+  size_t tokenOffset_{0};
+};
+
+/**
+ * Keeps the encoded parameters of the last settings a worker accepted a
+ * connection with, and encodes them again when the settings change.
+ */
+class ServerTransportParametersCache {
+ public:
+  std::shared_ptr<const EncodedServerTransportParameters> get(
+      const StaticServerTransportParameters& params) {
+    if (!encoded_ || encoded_->getParameters() != params) {
+      encoded_ =
+          std::make_shared<const EncodedServerTransportParameters>(params);
+    }
+    return encoded_;
+  }
+
+ private:
+  std::shared_ptr<const EncodedServerTransportParameters> encoded_;
+};
+
 class ServerTransportParametersExtension : public fizz::ServerExtensions {
  public:
   ServerTransportParametersExtension(
@@ -29,19 +216,37 @@ class ServerTransportParametersExtension : public fizz::ServerExtensions {
       uint64_t ackDelayExponent,
       uint64_t maxRecvPacketSize,
       TransportPartialReliabilitySetting partialReliability,
+      const StatelessResetToken& token,
+      folly::Optional<std::chrono::microseconds> minAckDelay = folly::none,
+      uint64_t maxDatagramFrameSize = 0,
+      bool fecEnabled = false)
+      : ServerTransportParametersExtension(
+            negotiatedVersion,
+            supportedVersions,
+            std::make_shared<const EncodedServerTransportParameters>(
+                StaticServerTransportParameters{initialMaxData,
+                                                initialMaxStreamDataBidiLocal,
+                                                initialMaxStreamDataBidiRemote,
+                                                initialMaxStreamDataUni,
+                                                initialMaxStreamsBidi,
+                                                initialMaxStreamsUni,
+                                                idleTimeout,
+                                                ackDelayExponent,
+                                                maxRecvPacketSize,
+                                                partialReliability,
+                                                minAckDelay,
+                                                maxDatagramFrameSize,
+                                                fecEnabled}),
+            token) {}
+
+  ServerTransportParametersExtension(
+      folly::Optional<QuicVersion> negotiatedVersion,
+      const std::vector<QuicVersion>& supportedVersions,
+      std::shared_ptr<const EncodedServerTransportParameters> encodedParams,
       const StatelessResetToken& token)
       : negotiatedVersion_(negotiatedVersion),
         supportedVersions_(supportedVersions),
-        initialMaxData_(initialMaxData),
-        initialMaxStreamDataBidiLocal_(initialMaxStreamDataBidiLocal),
-        initialMaxStreamDataBidiRemote_(initialMaxStreamDataBidiRemote),
-        initialMaxStreamDataUni_(initialMaxStreamDataUni),
-        initialMaxStreamsBidi_(initialMaxStreamsBidi),
-        initialMaxStreamsUni_(initialMaxStreamsUni),
-        idleTimeout_(idleTimeout),
-        ackDelayExponent_(ackDelayExponent),
-        maxRecvPacketSize_(maxRecvPacketSize),
-        partialReliability_(partialReliability),
+        encodedParams_(std::move(encodedParams)),
         token_(token) {}
 
   ~ServerTransportParametersExtension() override = default;
@@ -62,46 +267,8 @@ class ServerTransportParametersExtension : public fizz::ServerExtensions {
     }
 
     std::vector<fizz::Extension> exts;
-
-    ServerTransportParameters params;
-    params.negotiated_version = negotiatedVersion_;
-    params.supported_versions = supportedVersions_;
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_stream_data_bidi_local,
-        initialMaxStreamDataBidiLocal_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_stream_data_bidi_remote,
-        initialMaxStreamDataBidiRemote_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_stream_data_uni,
-        initialMaxStreamDataUni_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_data, initialMaxData_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_streams_bidi,
-        initialMaxStreamsBidi_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_streams_uni, initialMaxStreamsUni_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::idle_timeout, idleTimeout_.count()));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::ack_delay_exponent, ackDelayExponent_));
-    params.parameters.push_back(encodeIntegerParameter(
-        TransportParameterId::max_packet_size, maxRecvPacketSize_));
-    TransportParameter statelessReset;
-    statelessReset.parameter = TransportParameterId::stateless_reset_token;
-    statelessReset.value = folly::IOBuf::copyBuffer(token_);
-    params.parameters.push_back(std::move(statelessReset));
-
-    uint64_t partialReliabilitySetting = 0;
-    if (partialReliability_) {
-      partialReliabilitySetting = 1;
-    }
-    params.parameters.push_back(encodeIntegerParameter(
-        static_cast<TransportParameterId>(kPartialReliabilityParameterId),
-        partialReliabilitySetting));
-
-    exts.push_back(encodeExtension(params));
+    exts.push_back(
+        encodedParams_->encode(negotiatedVersion_, supportedVersions_, token_));
     return exts;
   }
 
@@ -112,16 +279,7 @@ class ServerTransportParametersExtension : public fizz::ServerExtensions {
  private:
   folly::Optional<QuicVersion> negotiatedVersion_;
   std::vector<QuicVersion> supportedVersions_;
-  uint64_t initialMaxData_;
-  uint64_t initialMaxStreamDataBidiLocal_;
-  uint64_t initialMaxStreamDataBidiRemote_;
-  uint64_t initialMaxStreamDataUni_;
-  uint64_t initialMaxStreamsBidi_;
-  uint64_t initialMaxStreamsUni_;
-  std::chrono::milliseconds idleTimeout_;
-  uint64_t ackDelayExponent_;
-  uint64_t maxRecvPacketSize_;
-  TransportPartialReliabilitySetting partialReliability_;
+  std::shared_ptr<const EncodedServerTransportParameters> encodedParams_;
   folly::Optional<ClientTransportParameters> clientTransportParameters_;
   StatelessResetToken token_;
 };
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/StrikeRegisterReplayCache.h>
+
+#include <folly/Random.h>
+#include <folly/hash/SpookyHashV2.h>
+#include <glog/logging.h>
+
+namespace quic {
+
+StrikeRegisterReplayCache::StrikeRegisterReplayCache(
+    std::chrono::seconds bucketInterval,
+    size_t numBuckets,
+    size_t bitsPerBucket,
+    size_t numHashes)
+    : start_(std::chrono::steady_clock::now()),
+      bucketInterval_(bucketInterval),
+      bitsPerBucket_(bitsPerBucket),
+      numWords_((bitsPerBucket + 63) / 64),
+      numHashes_(numHashes),
+      seed1_(folly::Random::secureRand64()),
+      seed2_(folly::Random::secureRand64()),
+      buckets_(numBuckets) {
+  CHECK_GT(bucketInterval_.count(), 0);
+  CHECK_GT(numBuckets, 0);
+  CHECK_GT(bitsPerBucket_, 0);
+  CHECK_GT(numHashes_, 0);
+  for (auto& bucket : buckets_) {
+    bucket.words = std::make_unique<std::atomic<uint64_t>[]>(numWords_);
+  }
+}
+
+folly::Future<fizz::server::ReplayCacheResult> StrikeRegisterReplayCache::check(
+    folly::ByteRange identifier) {
+  return folly::makeFuture(
+      check(identifier, std::chrono::steady_clock::now()));
+}
+
+fizz::server::ReplayCacheResult StrikeRegisterReplayCache::check(
+    folly::ByteRange identifier,
+    std::chrono::steady_clock::time_point now) {
+  uint64_t interval = now > start_ ? (now - start_) / bucketInterval_ : 0;
+  auto bits = bitsOf(identifier);
+  bool seen = false;
+  for (uint64_t age = 1; age < buckets_.size() && age <= interval; ++age) {
+    auto& bucket = buckets_[(interval - age) % buckets_.size()];
+    // Buckets store interval + 1, so that 0 means never used.
+    if (bucket.interval.load(std::memory_order_acquire) ==
+            interval - age + 1 &&
+        isSet(bucket, bits)) {
+      seen = true;
+      break;
+    }
+  }
+  // Remember the identifier even if it was seen, so that it stays in the
+  // cache for as long as it is being replayed.
+  if (testAndSet(currentBucket(interval), bits)) {
+    seen = true;
+  }
+  return seen ? fizz::server::ReplayCacheResult::MaybeReplay
+              : fizz::server::ReplayCacheResult::NotReplay;
+}
+
+StrikeRegisterReplayCache::Bucket& StrikeRegisterReplayCache::currentBucket(
+    uint64_t interval) {
+  auto& bucket = buckets_[interval % buckets_.size()];
+  if (bucket.interval.load(std::memory_order_acquire) >= interval + 1) {
+    return bucket;
+  }
+  std::lock_guard<std::mutex> guard(rotationMutex_);
+  // Another check may have moved the bucket on while we waited.
+  if (bucket.interval.load(std::memory_order_relaxed) < interval + 1) {
+    for (size_t i = 0; i < numWords_; ++i) {
+      bucket.words[i].store(0, std::memory_order_relaxed);
+    }
+    bucket.interval.store(interval + 1, std::memory_order_release);
+  }
+  return bucket;
+}
+
+bool StrikeRegisterReplayCache::isSet(
+    const Bucket& bucket,
+    const std::vector<size_t>& bits) const {
+  for (auto bit : bits) {
+    auto word = bucket.words[bit / 64].load(std::memory_order_relaxed);
+    if ((word & (uint64_t(1) << (bit % 64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool StrikeRegisterReplayCache::testAndSet(
+    Bucket& bucket,
+    const std::vector<size_t>& bits) {
+  bool allSet = true;
+  for (auto bit : bits) {
+    uint64_t mask = uint64_t(1) << (bit % 64);
+    auto prev =
+        bucket.words[bit / 64].fetch_or(mask, std::memory_order_relaxed);
+    if ((prev & mask) == 0) {
+      allSet = false;
+    }
+  }
+  return allSet;
+}
+
+std::vector<size_t> StrikeRegisterReplayCache::bitsOf(
+    folly::ByteRange identifier) const {
+  uint64_t h1 = seed1_;
+  uint64_t h2 = seed2_;
+  folly::hash::SpookyHashV2::Hash128(
+      identifier.data(), identifier.size(), &h1, &h2);
+  // Derive the hashes from the two halves, with an odd step so that they do
+  // not repeat.
+  h2 |= 1;
+  std::vector<size_t> bits;
+  bits.reserve(numHashes_);
+  for (size_t i = 0; i < numHashes_; ++i) {
+    bits.push_back((h1 + i * h2) % bitsPerBucket_);
+  }
+  return bits;
+}
+
+} // namespace quic
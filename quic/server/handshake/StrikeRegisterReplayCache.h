@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <fizz/server/ReplayCache.h>
+#include <quic/QuicConstants.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace quic {
+
+/**
+ * A replay cache for 0-RTT that remembers the ClientHellos seen recently in
+ * bounded memory. It is meant to be set on the FizzServerContext shared by
+ * all the workers with setEarlyDataSettings, so that a ClientHello replayed
+ * to another worker is caught as well.
+ *
+ * Time is split into buckets of bucketInterval, and the last numBuckets of
+ * them are kept, which must cover the ticket age window that the server
+ * accepts early data in. Each bucket is a bloom filter of bitsPerBucket bits,
+ * so the memory used does not depend on the number of ClientHellos. Checking
+ * a ClientHello sets its bits in the current bucket with atomic operations
+ * and only reads the older ones, so checks never take a lock. The lock is
+ * only taken to clear the oldest bucket when time moves to a new one.
+ *
+ * As a bloom filter can have false positives, a hit is reported as
+ * MaybeReplay, which makes fizz reject the early data and fall back to a full
+ * 1-RTT handshake rather than fail the connection.
+ */
+class StrikeRegisterReplayCache : public fizz::server::ReplayCache {
+ public:
+  explicit StrikeRegisterReplayCache(
+      std::chrono::seconds bucketInterval = kDefaultReplayCacheBucketInterval,
+      size_t numBuckets = kDefaultReplayCacheNumBuckets,
+      size_t bitsPerBucket = kDefaultReplayCacheBitsPerBucket,
+      size_t numHashes = kDefaultReplayCacheNumHashes);
+
+  ~StrikeRegisterReplayCache() override = default;
+
+  folly::Future<fizz::server::ReplayCacheResult> check(
+      folly::ByteRange identifier) override;
+
+  /**
+   * Checks the identifier as if it was seen at the given time, and remembers
+   * it.
+   */
+  fizz::server::ReplayCacheResult check(
+      folly::ByteRange identifier,
+      std::chrono::steady_clock::time_point now);
+
+ private:
+  struct Bucket {
+    // The interval this bucket holds, since the cache was created.
+    std::atomic<uint64_t> interval{0};
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+  };
+
+  /**
+   * Returns the bucket for the given interval, clearing it first if it still
+   * held an older one.
+   */
+  Bucket& currentBucket(uint64_t interval);
+
+  bool isSet(const Bucket& bucket, const std::vector<size_t>& bits) const;
+
+  /**
+   * Sets the bits in the bucket, and returns whether they were all set
+   * already.
+   */
+  bool testAndSet(Bucket& bucket, const std::vector<size_t>& bits);
+
+  std::vector<size_t> bitsOf(folly::ByteRange identifier) const;
+
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::seconds bucketInterval_;
+  size_t bitsPerBucket_;
+  size_t numWords_;
+  size_t numHashes_;
+  // Random seeds, so that identifiers cannot be crafted to collide.
+  uint64_t seed1_;
+  uint64_t seed2_;
+  std::vector<Bucket> buckets_;
+  std::mutex rotationMutex_;
+};
+
+} // namespace quic
@@ -250,5 +250,48 @@ TEST(AppTokenTest, TestEncodeAndDecodeIPv6AndIPv4AddressesWithAppToken) {
   expectAppTokenEqual(decodeAppToken(*buf), appToken);
 }
 
+TEST(AppTokenTest, TestEncodeAndDecodeWithCongestionState) {
+  AppToken appToken;
+  appToken.transportParams = createTicketTransportParameters(
+      kDefaultIdleTimeout.count(),
+      kDefaultUDPReadBufferSize,
+      kDefaultConnectionWindowSize,
+      kDefaultStreamWindowSize,
+      kDefaultStreamWindowSize,
+      kDefaultStreamWindowSize,
+      std::numeric_limits<uint32_t>::max(),
+      std::numeric_limits<uint32_t>::max());
+  appToken.sourceAddresses = {folly::IPAddress("1.2.3.4")};
+  appToken.version = QuicVersion::MVFST;
+  appToken.appParams = folly::IOBuf::copyBuffer("QPACK Params");
+  appToken.congestionState = TicketCongestionState{
+      std::chrono::microseconds(100000),
+      std::chrono::microseconds(80000),
+      150000,
+      std::chrono::seconds(1234567890)};
+  Buf buf = encodeAppToken(appToken);
+
+  auto decodedAppToken = decodeAppToken(*buf);
+  expectAppTokenEqual(decodedAppToken, appToken);
+  ASSERT_TRUE(decodedAppToken->congestionState.hasValue());
+  EXPECT_EQ(
+      decodedAppToken->congestionState->srtt, appToken.congestionState->srtt);
+  EXPECT_EQ(
+      decodedAppToken->congestionState->mrtt, appToken.congestionState->mrtt);
+  EXPECT_EQ(
+      decodedAppToken->congestionState->cwndBytes,
+      appToken.congestionState->cwndBytes);
+  EXPECT_EQ(
+      decodedAppToken->congestionState->issueTime,
+      appToken.congestionState->issueTime);
+
+  // Tickets issued before the congestion state was added still decode.
+  appToken.congestionState = folly::none;
+  buf = encodeAppToken(appToken);
+  decodedAppToken = decodeAppToken(*buf);
+  expectAppTokenEqual(decodedAppToken, appToken);
+  EXPECT_FALSE(decodedAppToken->congestionState.hasValue());
+}
+
 } // namespace test
 } // namespace quic
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/BatchingSelfCert.h>
+
+#include <folly/portability/GTest.h>
+#include <folly/synchronization/Baton.h>
+#include <quic/common/test/TestUtils.h>
+
+#include <thread>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+namespace {
+const folly::StringPiece kToBeSigned = "client hello transcript";
+
+Buf signWith(const fizz::SelfCert& cert) {
+  return cert.sign(
+      fizz::SignatureScheme::ecdsa_secp256r1_sha256,
+      fizz::CertificateVerifyContext::Server,
+      folly::ByteRange(kToBeSigned));
+}
+} // namespace
+
+TEST(BatchingSelfCertTest, ForwardsToWrappedCert) {
+  auto cert = readCert();
+  BatchingSelfCert batchingCert(cert, std::make_shared<SignatureBatcher>());
+  EXPECT_EQ(batchingCert.getIdentity(), cert->getIdentity());
+  EXPECT_EQ(batchingCert.getSigSchemes(), cert->getSigSchemes());
+  auto signature = signWith(batchingCert);
+  ASSERT_TRUE(signature);
+  EXPECT_FALSE(signature->empty());
+}
+
+TEST(BatchingSelfCertTest, ConcurrentRequestsAreBatched) {
+  std::vector<size_t> batchSizes;
+  folly::Baton<> firstBatchStarted;
+  folly::Baton<> releaseFirstBatch;
+  auto batcher = std::make_shared<SignatureBatcher>(
+      kDefaultMaxSignatureBatchSize,
+      [&](const std::vector<const SignatureBatcher::Request*>& batch) {
+        if (batchSizes.empty()) {
+          firstBatchStarted.post();
+          releaseFirstBatch.wait();
+        }
+        batchSizes.push_back(batch.size());
+        std::vector<Buf> signatures;
+        for (const auto request : batch) {
+          EXPECT_EQ(request->toBeSigned, folly::ByteRange(kToBeSigned));
+          signatures.push_back(folly::IOBuf::copyBuffer("signature"));
+        }
+        return signatures;
+      });
+  BatchingSelfCert batchingCert(readCert(), batcher);
+
+  std::vector<std::thread> threads;
+  threads.emplace_back([&] { EXPECT_TRUE(signWith(batchingCert)); });
+  firstBatchStarted.wait();
+  // These are queued while the first request is being signed.
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back([&] { EXPECT_TRUE(signWith(batchingCert)); });
+  }
+  while (batcher->pendingRequests() < 3) {
+    std::this_thread::yield();
+  }
+  releaseFirstBatch.post();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(batchSizes, std::vector<size_t>({1, 3}));
+  EXPECT_EQ(batcher->pendingRequests(), 0);
+}
+
+TEST(BatchingSelfCertTest, SignerErrorReachesAllRequests) {
+  auto batcher = std::make_shared<SignatureBatcher>(
+      kDefaultMaxSignatureBatchSize,
+      [](const std::vector<const SignatureBatcher::Request*>&)
+          -> std::vector<Buf> { throw std::runtime_error("no key"); });
+  BatchingSelfCert batchingCert(readCert(), batcher);
+  EXPECT_THROW(signWith(batchingCert), std::runtime_error);
+  EXPECT_EQ(batcher->pendingRequests(), 0);
+}
+} // namespace test
+} // namespace quic
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/CachingSelfCert.h>
+
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+TEST(CachingSelfCertTest, ForwardsToWrappedCert) {
+  auto cert = readCert();
+  CachingSelfCert cachingCert(cert);
+  EXPECT_EQ(cachingCert.getIdentity(), cert->getIdentity());
+  EXPECT_EQ(cachingCert.getSigSchemes(), cert->getSigSchemes());
+  auto signature = cachingCert.sign(
+      fizz::SignatureScheme::ecdsa_secp256r1_sha256,
+      fizz::CertificateVerifyContext::Server,
+      folly::ByteRange(folly::StringPiece("client hello transcript")));
+  ASSERT_TRUE(signature);
+  EXPECT_FALSE(signature->empty());
+}
+
+TEST(CachingSelfCertTest, CertMessageSharesCachedChain) {
+  auto cert = readCert();
+  CachingSelfCert cachingCert(cert);
+  auto expected = cert->getCertMessage();
+  auto first = cachingCert.getCertMessage();
+  auto second = cachingCert.getCertMessage();
+  ASSERT_EQ(first.certificate_list.size(), expected.certificate_list.size());
+  ASSERT_EQ(second.certificate_list.size(), expected.certificate_list.size());
+  folly::IOBufEqualTo eq;
+  for (size_t i = 0; i < expected.certificate_list.size(); i++) {
+    EXPECT_TRUE(eq(
+        first.certificate_list[i].cert_data,
+        expected.certificate_list[i].cert_data));
+    // Not encoded again.
+    EXPECT_EQ(
+        first.certificate_list[i].cert_data->data(),
+        second.certificate_list[i].cert_data->data());
+  }
+}
+
+TEST(CachingSelfCertTest, CertMessageWithRequestContext) {
+  auto cert = readCert();
+  CachingSelfCert cachingCert(cert);
+  auto msg = cachingCert.getCertMessage(folly::IOBuf::copyBuffer("context"));
+  ASSERT_TRUE(msg.certificate_request_context);
+  EXPECT_TRUE(folly::IOBufEqualTo()(
+      msg.certificate_request_context, folly::IOBuf::copyBuffer("context")));
+  EXPECT_EQ(
+      msg.certificate_list.size(),
+      cert->getCertMessage().certificate_list.size());
+}
+} // namespace test
+} // namespace quic
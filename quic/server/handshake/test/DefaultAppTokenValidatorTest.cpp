@@ -47,7 +47,90 @@ TEST(DefaultAppTokenValidatorTest, TestValidParams) {
   auto appParamsValidator = [](const folly::Optional<std::string>&,
                                const Buf&) { return true; };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_TRUE(validator.validate(resState));
+  validator.applyValidatedAppToken();
+}
+
+TEST(DefaultAppTokenValidatorTest, TestValidatesPreparedConnection) {
+  QuicServerConnectionState conn;
+  conn.peerAddress = folly::SocketAddress("1.2.3.4", 443);
+  conn.version = QuicVersion::MVFST;
+
+  AppToken appToken;
+  appToken.transportParams = createTicketTransportParameters(
+      conn.transportSettings.idleTimeout.count(),
+      conn.transportSettings.maxRecvPacketSize,
+      conn.transportSettings.advertisedInitialConnectionWindowSize,
+      conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize,
+      conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
+      conn.transportSettings.advertisedInitialUniStreamWindowSize,
+      conn.transportSettings.advertisedInitialMaxStreamsBidi,
+      conn.transportSettings.advertisedInitialMaxStreamsUni);
+  appToken.version = conn.version;
+  ResumptionState resState;
+  resState.appToken = encodeAppToken(appToken);
+
+  DefaultAppTokenValidator validator(&conn, nullptr);
+  // validate() only reads what was taken from the connection beforehand, as
+  // it may run on the handshake executor.
+  validator.prepareValidation();
+  conn.version = QuicVersion::MVFST_OLD;
+  conn.transportSettings.idleTimeout += std::chrono::seconds(1);
+  EXPECT_TRUE(validator.validate(resState));
+  EXPECT_FALSE(conn.transportParamsMatching);
+  validator.applyValidatedAppToken();
+  EXPECT_TRUE(*conn.transportParamsMatching);
+}
+
+TEST(DefaultAppTokenValidatorTest, TestValidParamsWithCache) {
+  auto cache = std::make_shared<AppTokenCache>();
+  QuicServerConnectionState conn;
+  conn.peerAddress = folly::SocketAddress("1.2.3.4", 443);
+  conn.version = QuicVersion::MVFST;
+
+  AppToken appToken;
+  appToken.transportParams = createTicketTransportParameters(
+      conn.transportSettings.idleTimeout.count(),
+      conn.transportSettings.maxRecvPacketSize,
+      conn.transportSettings.advertisedInitialConnectionWindowSize,
+      conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize,
+      conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
+      conn.transportSettings.advertisedInitialUniStreamWindowSize,
+      conn.transportSettings.advertisedInitialMaxStreamsBidi,
+      conn.transportSettings.advertisedInitialMaxStreamsUni);
+  appToken.sourceAddresses = {conn.peerAddress.getIPAddress()};
+  appToken.version = conn.version;
+  ResumptionState resState;
+  resState.appToken = encodeAppToken(appToken);
+  EXPECT_EQ(cache->get(*resState.appToken), nullptr);
+
+  auto appParamsValidator = [](const folly::Optional<std::string>&,
+                               const Buf&) { return true; };
+  DefaultAppTokenValidator validator(
+      &conn, std::move(appParamsValidator), cache);
+  validator.prepareValidation();
+  EXPECT_TRUE(validator.validate(resState));
+  validator.applyValidatedAppToken();
+  auto cached = cache->get(*resState.appToken);
+  ASSERT_NE(cached, nullptr);
+  EXPECT_EQ(cached->sourceAddresses, appToken.sourceAddresses);
+
+  // Another connection resuming with the same token reuses the decoded one.
+  QuicServerConnectionState conn2;
+  conn2.peerAddress = conn.peerAddress;
+  conn2.version = QuicVersion::MVFST;
+  DefaultAppTokenValidator validator2(&conn2, nullptr, cache);
+  validator2.prepareValidation();
+  EXPECT_TRUE(validator2.validate(resState));
+  validator2.applyValidatedAppToken();
+  EXPECT_TRUE(conn2.sourceTokenMatching);
+  EXPECT_EQ(cache->get(*resState.appToken), cached);
+
+  // Tokens that cannot be decoded are not cached.
+  auto garbage = folly::IOBuf::copyBuffer("garbage");
+  EXPECT_EQ(cache->getOrDecode(*garbage), nullptr);
+  EXPECT_EQ(cache->get(*garbage), nullptr);
 }
 
 TEST(
@@ -76,8 +159,16 @@ TEST(
   auto appParamsValidator = [](const folly::Optional<std::string>&,
                                const Buf&) { return true; };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_TRUE(validator.validate(resState));
+  // The connection only changes once the validation is applied.
+  EXPECT_EQ(
+      conn.transportSettings.advertisedInitialConnectionWindowSize,
+      initialMaxData);
+  EXPECT_FALSE(conn.transportParamsMatching);
+  validator.applyValidatedAppToken();
 
+  EXPECT_TRUE(*conn.transportParamsMatching);
   EXPECT_EQ(
       conn.transportSettings.advertisedInitialConnectionWindowSize,
       initialMaxData - 1);
@@ -85,6 +176,45 @@ TEST(
   EXPECT_EQ(conn.flowControlState.advertisedMaxOffset, initialMaxData - 1);
 }
 
+TEST(DefaultAppTokenValidatorTest, TestCongestionStateLeftToHandshakeDone) {
+  QuicServerConnectionState conn;
+  conn.peerAddress = folly::SocketAddress("1.2.3.4", 443);
+  conn.version = QuicVersion::MVFST;
+  conn.transportSettings.resumeCongestionState = true;
+  conn.congestionControllerFactory =
+      std::make_shared<DefaultCongestionControllerFactory>();
+
+  AppToken appToken;
+  appToken.transportParams = createTicketTransportParameters(
+      conn.transportSettings.idleTimeout.count(),
+      conn.transportSettings.maxRecvPacketSize,
+      conn.transportSettings.advertisedInitialConnectionWindowSize,
+      conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize,
+      conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
+      conn.transportSettings.advertisedInitialUniStreamWindowSize,
+      conn.transportSettings.advertisedInitialMaxStreamsBidi,
+      conn.transportSettings.advertisedInitialMaxStreamsUni);
+  appToken.sourceAddresses = {conn.peerAddress.getIPAddress()};
+  appToken.version = conn.version;
+  appToken.congestionState = TicketCongestionState{
+      std::chrono::milliseconds(100),
+      std::chrono::milliseconds(50),
+      300 * kDefaultUDPSendPacketLen,
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now().time_since_epoch())};
+  ResumptionState resState;
+  resState.appToken = encodeAppToken(appToken);
+
+  // The transport resumes the congestion state of every resumed connection
+  // once the handshake is done, not only of those that send early data.
+  DefaultAppTokenValidator validator(&conn, nullptr);
+  validator.prepareValidation();
+  EXPECT_TRUE(validator.validate(resState));
+  validator.applyValidatedAppToken();
+  EXPECT_TRUE(*conn.sourceTokenMatching);
+  EXPECT_EQ(conn.transportSettings.initCwndInMss, kInitCwndInMss);
+}
+
 TEST(DefaultAppTokenValidatorTest, TestInvalidNullAppToken) {
   QuicServerConnectionState conn;
   conn.peerAddress = folly::SocketAddress("1.2.3.4", 443);
@@ -97,7 +227,9 @@ TEST(DefaultAppTokenValidatorTest, TestInvalidNullAppToken) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestNoVersionMismatch) {
@@ -122,7 +254,9 @@ TEST(DefaultAppTokenValidatorTest, TestNoVersionMismatch) {
   auto appParamsValidator = [](const folly::Optional<std::string>&,
                                const Buf&) { return true; };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_TRUE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestVersionMismatch) {
@@ -150,7 +284,9 @@ TEST(DefaultAppTokenValidatorTest, TestVersionMismatch) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestInvalidEmptyTransportParams) {
@@ -169,7 +305,9 @@ TEST(DefaultAppTokenValidatorTest, TestInvalidEmptyTransportParams) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestInvalidMissingParams) {
@@ -205,7 +343,9 @@ TEST(DefaultAppTokenValidatorTest, TestInvalidMissingParams) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestInvalidRedundantParameter) {
@@ -234,7 +374,9 @@ TEST(DefaultAppTokenValidatorTest, TestInvalidRedundantParameter) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestInvalidDecreasedInitialMaxStreamData) {
@@ -261,7 +403,9 @@ TEST(DefaultAppTokenValidatorTest, TestInvalidDecreasedInitialMaxStreamData) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestChangedIdleTimeout) {
@@ -288,7 +432,9 @@ TEST(DefaultAppTokenValidatorTest, TestChangedIdleTimeout) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestDecreasedInitialMaxStreams) {
@@ -315,7 +461,9 @@ TEST(DefaultAppTokenValidatorTest, TestDecreasedInitialMaxStreams) {
     return true;
   };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 TEST(DefaultAppTokenValidatorTest, TestInvalidAppParams) {
@@ -341,7 +489,9 @@ TEST(DefaultAppTokenValidatorTest, TestInvalidAppParams) {
   auto appParamsValidator = [](const folly::Optional<std::string>&,
                                const Buf&) { return false; };
   DefaultAppTokenValidator validator(&conn, std::move(appParamsValidator));
+  validator.prepareValidation();
   EXPECT_FALSE(validator.validate(resState));
+  validator.applyValidatedAppToken();
 }
 
 class SourceAddressTokenTest : public Test {
@@ -369,7 +519,9 @@ class SourceAddressTokenTest : public Test {
     auto appParamsValidator = [=](const folly::Optional<std::string>&,
                                   const Buf&) { return acceptZeroRtt; };
     DefaultAppTokenValidator validator(&conn_, std::move(appParamsValidator));
+    validator.prepareValidation();
     EXPECT_EQ(validator.validate(resState), acceptZeroRtt);
+    validator.applyValidatedAppToken();
   }
 
  protected:
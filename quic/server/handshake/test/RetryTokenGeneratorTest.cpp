@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/RetryTokenGenerator.h>
+#include <folly/Random.h>
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+class RetryTokenGeneratorTest : public Test {
+ public:
+  void SetUp() override {
+    RetryTokenSecret secret;
+    folly::Random::secureRandom(secret.data(), secret.size());
+    generator_ = std::make_unique<RetryTokenGenerator>(secret);
+  }
+
+ protected:
+  std::unique_ptr<RetryTokenGenerator> generator_;
+  folly::IPAddress address_{"1.2.3.4"};
+  ConnectionId connId_{{0x14, 0x35, 0x22, 0x11}};
+  std::chrono::system_clock::time_point now_{std::chrono::hours(1000)};
+};
+
+TEST_F(RetryTokenGeneratorTest, ValidToken) {
+  auto token = generator_->generateToken(address_, connId_, now_);
+  EXPECT_EQ(
+      token->computeChainDataLength(), sizeof(uint64_t) + kRetryTokenMacLength);
+  EXPECT_TRUE(generator_->validateToken(*token, address_, connId_, now_));
+}
+
+TEST_F(RetryTokenGeneratorTest, DifferentAddressOrConnId) {
+  auto token = generator_->generateToken(address_, connId_, now_);
+  EXPECT_FALSE(generator_->validateToken(
+      *token, folly::IPAddress("1.2.3.5"), connId_, now_));
+  EXPECT_FALSE(generator_->validateToken(
+      *token, address_, ConnectionId({0x14, 0x35, 0x22, 0x12}), now_));
+}
+
+TEST_F(RetryTokenGeneratorTest, DifferentSecret) {
+  auto token = generator_->generateToken(address_, connId_, now_);
+  RetryTokenSecret otherSecret;
+  folly::Random::secureRandom(otherSecret.data(), otherSecret.size());
+  RetryTokenGenerator otherGenerator(otherSecret);
+  EXPECT_FALSE(otherGenerator.validateToken(*token, address_, connId_, now_));
+}
+
+TEST_F(RetryTokenGeneratorTest, KeyRotation) {
+  auto token = generator_->generateToken(address_, connId_, now_);
+  // Still valid with the next key, but not with the one after.
+  EXPECT_TRUE(generator_->validateToken(
+      *token, address_, connId_, now_ + kRetryTokenKeyRotationInterval));
+  EXPECT_FALSE(generator_->validateToken(
+      *token, address_, connId_, now_ + 2 * kRetryTokenKeyRotationInterval));
+  EXPECT_FALSE(generator_->validateToken(
+      *token, address_, connId_, now_ - kRetryTokenKeyRotationInterval));
+}
+
+TEST_F(RetryTokenGeneratorTest, MalformedToken) {
+  auto token = generator_->generateToken(address_, connId_, now_);
+  token->coalesce();
+  token->writableData()[token->length() - 1] ^= 1;
+  EXPECT_FALSE(generator_->validateToken(*token, address_, connId_, now_));
+  EXPECT_FALSE(generator_->validateToken(
+      *folly::IOBuf::copyBuffer("short"), address_, connId_, now_));
+}
+} // namespace test
+} // namespace quic
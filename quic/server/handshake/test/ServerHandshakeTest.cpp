@@ -11,13 +11,19 @@
 
 #include <condition_variable>
 #include <mutex>
+#include <thread>
 
 #include <fizz/client/test/Mocks.h>
+#include <fizz/compression/CertDecompressionManager.h>
+#include <fizz/compression/ZlibCertificateCompressor.h>
+#include <fizz/compression/ZlibCertificateDecompressor.h>
 #include <fizz/crypto/test/TestUtil.h>
 #include <fizz/protocol/clock/test/Mocks.h>
 #include <fizz/protocol/test/Mocks.h>
 #include <fizz/server/test/Mocks.h>
 
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/ManualExecutor.h>
 #include <folly/io/async/SSLContext.h>
 #include <folly/io/async/ScopedEventBaseThread.h>
 #include <folly/io/async/test/MockAsyncTransport.h>
@@ -358,6 +364,20 @@ TEST_F(ServerHandshakeTest, TestHandshakeSuccess) {
   EXPECT_TRUE(handshakeSuccess);
 }
 
+TEST_F(ServerHandshakeTest, TestHandshakeTimings) {
+  clientServerRound();
+  auto& timings = handshake->getHandshakeTimings();
+  ASSERT_TRUE(timings.startTime.hasValue());
+  ASSERT_TRUE(timings.keysDerivedTime.hasValue());
+  EXPECT_FALSE(timings.establishedTime.hasValue());
+  EXPECT_GE(*timings.keysDerivedTime, *timings.startTime);
+  serverClientRound();
+  clientServerRound();
+  ASSERT_TRUE(timings.establishedTime.hasValue());
+  EXPECT_GE(*timings.establishedTime, *timings.keysDerivedTime);
+  EXPECT_GT(timings.processingTime.count(), 0);
+}
+
 TEST_F(ServerHandshakeTest, TestHandshakeSuccessIgnoreNonHandshake) {
   fizz::WriteToSocket write;
   fizz::TLSContent content;
@@ -393,6 +413,36 @@ TEST_F(ServerHandshakeTest, TestMalformedHandshakeMessage) {
   EXPECT_TRUE(ex);
 }
 
+class ServerHandshakeExecutorTest : public ServerHandshakeTest {
+ public:
+  ~ServerHandshakeExecutorTest() override = default;
+
+  void initialize() override {
+    handshake->initialize(&evb, serverCtx, &serverCallback);
+    handshake->setHandshakeExecutor(&handshakeExecutor);
+  }
+
+  folly::ManualExecutor handshakeExecutor;
+};
+
+TEST_F(ServerHandshakeExecutorTest, TestHandshakeSuccess) {
+  clientServerRound();
+  // The ClientHello is only processed once the handshake executor runs.
+  EXPECT_EQ(handshakeWriteCipher, nullptr);
+  EXPECT_GT(handshakeExecutor.run(), 0);
+  evb.loop();
+  EXPECT_NE(handshakeWriteCipher, nullptr);
+  EXPECT_EQ(handshake->getPhase(), ServerHandshake::Phase::Handshake);
+  serverClientRound();
+  clientServerRound();
+  EXPECT_EQ(handshake->getPhase(), ServerHandshake::Phase::Established);
+  if (ex) {
+    std::rethrow_exception(ex);
+  }
+  expectOneRttCipher(true);
+  EXPECT_TRUE(handshakeSuccess);
+}
+
 class AsyncRejectingTicketCipher : public fizz::server::TicketCipher {
  public:
   ~AsyncRejectingTicketCipher() override = default;
@@ -453,6 +503,49 @@ class AsyncRejectingTicketCipher : public fizz::server::TicketCipher {
   bool error_{false};
 };
 
+class ServerHandshakeCertCompressionTest : public ServerHandshakeTest {
+ public:
+  ~ServerHandshakeCertCompressionTest() override = default;
+
+  void setupClientAndServerContext() override {
+    auto decompressionManager =
+        std::make_shared<fizz::CertDecompressionManager>();
+    decompressionManager->setDecompressors(
+        {std::make_shared<fizz::ZlibCertificateDecompressor>()});
+    clientCtx->setCertDecompressionManager(std::move(decompressionManager));
+
+    std::vector<folly::ssl::X509UniquePtr> certs;
+    certs.emplace_back(fizz::test::getCert(fizz::test::kP256Certificate));
+    auto cert = std::make_shared<fizz::SelfCertImpl<fizz::KeyType::P256>>(
+        fizz::test::getPrivateKey(fizz::test::kP256Key),
+        std::move(certs),
+        std::vector<std::shared_ptr<fizz::CertificateCompressor>>{
+            std::make_shared<fizz::ZlibCertificateCompressor>(9)});
+    auto certManager = std::make_unique<fizz::server::CertManager>();
+    certManager->addCert(std::move(cert), true);
+    serverCtx->setCertManager(std::move(certManager));
+  }
+
+  void initialize() override {
+    handshake->setCertificateCompression(true);
+    handshake->initialize(&evb, serverCtx, &serverCallback);
+  }
+};
+
+TEST_F(ServerHandshakeCertCompressionTest, TestHandshakeSuccess) {
+  clientServerRound();
+  serverClientRound();
+  clientServerRound();
+  EXPECT_EQ(handshake->getPhase(), ServerHandshake::Phase::Established);
+  if (ex) {
+    std::rethrow_exception(ex);
+  }
+  EXPECT_TRUE(handshakeSuccess);
+  EXPECT_EQ(
+      clientState.serverCertCompAlgo(),
+      fizz::CertificateCompressionAlgorithm::zlib);
+}
+
 class ServerHandshakeWriteNSTTest : public ServerHandshakeTest {
  public:
   void setupClientAndServerContext() override {
@@ -837,5 +930,65 @@ TEST_F(ServerHandshakeZeroRttTest, TestRejectZeroRttInvalidToken) {
   EXPECT_EQ(handshake->getPhase(), ServerHandshake::Phase::Established);
   expectOneRttCipher(true);
 }
+
+// Records the threads it prepares, validates and applies its validation on.
+class ThreadRecordingAppTokenValidator : public ConnectionAppTokenValidator {
+ public:
+  ~ThreadRecordingAppTokenValidator() override = default;
+
+  void prepareValidation() override {
+    if (!prepareThread) {
+      prepareThread = std::this_thread::get_id();
+    }
+  }
+
+  bool validate(const fizz::server::ResumptionState&) const override {
+    validateThread = std::this_thread::get_id();
+    return true;
+  }
+
+  void applyValidatedAppToken() override {
+    if (validateThread && !applyThread) {
+      applyThread = std::this_thread::get_id();
+    }
+  }
+
+  folly::Optional<std::thread::id> prepareThread;
+  mutable folly::Optional<std::thread::id> validateThread;
+  folly::Optional<std::thread::id> applyThread;
+};
+
+class ServerHandshakeZeroRttExecutorTest
+    : public ServerHandshakeZeroRttDefaultAppTokenValidatorTest {
+  void initialize() override {
+    auto validator = std::make_unique<ThreadRecordingAppTokenValidator>();
+    validator_ = validator.get();
+    handshake->initialize(
+        &evb, serverCtx, &serverCallback, std::move(validator));
+    handshake->setHandshakeExecutor(&handshakeExecutor);
+  }
+
+ protected:
+  folly::CPUThreadPoolExecutor handshakeExecutor{1};
+  ThreadRecordingAppTokenValidator* validator_;
+};
+
+TEST_F(ServerHandshakeZeroRttExecutorTest, TestValidationAppliedOnEventBase) {
+  clientServerRound();
+  // Returns once the actions of the ClientHello are back on the event base.
+  evb.loop();
+  ASSERT_TRUE(validator_->prepareThread.hasValue());
+  EXPECT_EQ(*validator_->prepareThread, std::this_thread::get_id());
+  ASSERT_TRUE(validator_->validateThread.hasValue());
+  EXPECT_NE(*validator_->validateThread, std::this_thread::get_id());
+  ASSERT_TRUE(validator_->applyThread.hasValue());
+  EXPECT_EQ(*validator_->applyThread, std::this_thread::get_id());
+  EXPECT_EQ(handshake->getPhase(), ServerHandshake::Phase::KeysDerived);
+  expectZeroRttCipher(true, false);
+  serverClientRound();
+  clientServerRound();
+  EXPECT_EQ(handshake->getPhase(), ServerHandshake::Phase::Established);
+  expectZeroRttCipher(true, true);
+}
 } // namespace test
 } // namespace quic
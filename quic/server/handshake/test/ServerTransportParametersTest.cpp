@@ -105,5 +105,72 @@ TEST(ServerTransportParametersTest, TestGetExtensionsMissingClientParams) {
       generateStatelessResetToken());
   EXPECT_THROW(ext.getExtensions(TestMessages::clientHello()), FizzException);
 }
+
+TEST(ServerTransportParametersTest, TestCachedEncoding) {
+  StaticServerTransportParameters params;
+  params.initialMaxData = kDefaultConnectionWindowSize;
+  params.initialMaxStreamDataBidiLocal = kDefaultStreamWindowSize;
+  params.initialMaxStreamDataBidiRemote = kDefaultStreamWindowSize;
+  params.initialMaxStreamDataUni = kDefaultStreamWindowSize;
+  params.initialMaxStreamsBidi = std::numeric_limits<uint32_t>::max();
+  params.initialMaxStreamsUni = std::numeric_limits<uint32_t>::max();
+  params.idleTimeout = kDefaultIdleTimeout;
+  params.ackDelayExponent = kDefaultAckDelayExponent;
+  params.maxRecvPacketSize = kDefaultUDPSendPacketLen;
+  params.minAckDelay = kDefaultMinAckDelay;
+
+  ServerTransportParametersCache cache;
+  auto encoded = cache.get(params);
+  EXPECT_EQ(encoded, cache.get(params));
+
+  // Every connection gets its own token in the same encoding.
+  for (int i = 0; i < 2; ++i) {
+    auto token = generateStatelessResetToken();
+    token[0] = static_cast<uint8_t>(i);
+    ServerTransportParametersExtension cachedExt(
+        QuicVersion::MVFST_OLD,
+        {MVFST1, QuicVersion::MVFST_OLD},
+        encoded,
+        token);
+    ServerTransportParametersExtension ext(
+        QuicVersion::MVFST_OLD,
+        {MVFST1, QuicVersion::MVFST_OLD},
+        params.initialMaxData,
+        params.initialMaxStreamDataBidiLocal,
+        params.initialMaxStreamDataBidiRemote,
+        params.initialMaxStreamDataUni,
+        params.initialMaxStreamsBidi,
+        params.initialMaxStreamsUni,
+        params.idleTimeout,
+        params.ackDelayExponent,
+        params.maxRecvPacketSize,
+        params.partialReliability,
+        token,
+        params.minAckDelay);
+    auto chlo = getClientHello(QuicVersion::MVFST_OLD);
+    auto cachedExtensions = cachedExt.getExtensions(chlo);
+    auto extensions = ext.getExtensions(chlo);
+    ASSERT_EQ(1, cachedExtensions.size());
+    EXPECT_TRUE(folly::IOBufEqualTo()(
+        extensions[0].extension_data, cachedExtensions[0].extension_data));
+
+    auto serverParams =
+        getExtension<ServerTransportParameters>(cachedExtensions);
+    ASSERT_TRUE(serverParams.hasValue());
+    EXPECT_EQ(QuicVersion::MVFST_OLD, *serverParams->negotiated_version);
+    EXPECT_EQ(
+        token, *getStatelessResetTokenParameter(serverParams->parameters));
+    EXPECT_EQ(
+        kDefaultConnectionWindowSize,
+        *getIntegerParameter(
+            TransportParameterId::initial_max_data, serverParams->parameters));
+  }
+
+  // New settings are encoded again.
+  params.idleTimeout = kDefaultIdleTimeout * 2;
+  auto reencoded = cache.get(params);
+  EXPECT_NE(encoded, reencoded);
+  EXPECT_TRUE(params == reencoded->getParameters());
+}
 } // namespace test
 } // namespace quic
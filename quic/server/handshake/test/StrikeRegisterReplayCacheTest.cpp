@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/handshake/StrikeRegisterReplayCache.h>
+
+#include <folly/Conv.h>
+#include <folly/Range.h>
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+using fizz::server::ReplayCacheResult;
+
+namespace quic {
+namespace test {
+
+class StrikeRegisterReplayCacheTest : public Test {
+ protected:
+  std::chrono::steady_clock::time_point now_{
+      std::chrono::steady_clock::now()};
+  StrikeRegisterReplayCache cache_{std::chrono::seconds(10), 3, 1 << 16, 4};
+};
+
+TEST_F(StrikeRegisterReplayCacheTest, DetectsReplay) {
+  auto hello = folly::StringPiece("clienthello");
+  EXPECT_EQ(cache_.check(folly::ByteRange(hello), now_),
+            ReplayCacheResult::NotReplay);
+  EXPECT_EQ(cache_.check(folly::ByteRange(hello), now_),
+            ReplayCacheResult::MaybeReplay);
+}
+
+TEST_F(StrikeRegisterReplayCacheTest, DistinctIdentifiers) {
+  for (int i = 0; i < 1000; ++i) {
+    auto hello = folly::to<std::string>("clienthello", i);
+    EXPECT_EQ(cache_.check(folly::ByteRange(folly::StringPiece(hello)), now_),
+              ReplayCacheResult::NotReplay);
+  }
+}
+
+TEST_F(StrikeRegisterReplayCacheTest, ReplayInOlderBucket) {
+  auto hello = folly::StringPiece("clienthello");
+  cache_.check(folly::ByteRange(hello), now_);
+  EXPECT_EQ(cache_.check(
+                folly::ByteRange(hello), now_ + std::chrono::seconds(25)),
+            ReplayCacheResult::MaybeReplay);
+}
+
+TEST_F(StrikeRegisterReplayCacheTest, ForgetsAfterWindow) {
+  auto hello = folly::StringPiece("clienthello");
+  cache_.check(folly::ByteRange(hello), now_);
+  auto other = folly::StringPiece("otherhello");
+  // Moving time on rotates out the bucket the first hello was in.
+  cache_.check(folly::ByteRange(other), now_ + std::chrono::seconds(30));
+  EXPECT_EQ(cache_.check(
+                folly::ByteRange(hello), now_ + std::chrono::seconds(31)),
+            ReplayCacheResult::NotReplay);
+}
+
+} // namespace test
+} // namespace quic
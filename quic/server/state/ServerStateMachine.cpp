@@ -13,6 +13,10 @@
 #include <quic/handshake/FizzCryptoFactory.h>
 #include <quic/handshake/TransportParameters.h>
 #include <quic/logging/QLoggerConstants.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/DatagramHandlers.h>
+#include <quic/state/FecHandlers.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/QuicPacingFunctions.h>
 #include <quic/state/QuicStreamFunctions.h>
 #include <quic/state/QuicTransportStatsCallback.h>
@@ -65,20 +69,59 @@ void resetCongestionAndRttState(QuicServerConnectionState& conn) {
 void recoverOrResetCongestionAndRttState(
     QuicServerConnectionState& conn,
     const folly::SocketAddress& peerAddress) {
-  auto& lastState = conn.migrationState.lastCongestionAndRtt;
-  if (lastState && lastState->peerAddress == peerAddress &&
-      (Clock::now() - lastState->recordTime <=
-       kTimeToRetainLastCongestionAndRttState)) {
+  auto& previousStates = conn.migrationState.previousCongestionAndRtt;
+  auto now = Clock::now();
+  previousStates.erase(
+      std::remove_if(
+          previousStates.begin(),
+          previousStates.end(),
+          [&](const auto& state) {
+            return now - state.recordTime >
+                kTimeToRetainLastCongestionAndRttState;
+          }),
+      previousStates.end());
+  auto it = std::find_if(
+      previousStates.begin(), previousStates.end(), [&](const auto& state) {
+        return state.peerAddress == peerAddress;
+      });
+  if (it != previousStates.end()) {
     // recover from matched non-stale state
-    conn.congestionController = std::move(lastState->congestionController);
-    conn.lossState.srtt = lastState->srtt;
-    conn.lossState.lrtt = lastState->lrtt;
-    conn.lossState.rttvar = lastState->rttvar;
-    conn.migrationState.lastCongestionAndRtt = folly::none;
+    conn.congestionController = std::move(it->congestionController);
+    conn.lossState.srtt = it->srtt;
+    conn.lossState.lrtt = it->lrtt;
+    conn.lossState.rttvar = it->rttvar;
+    previousStates.erase(it);
   } else {
     resetCongestionAndRttState(conn);
   }
 }
+
+StaticServerTransportParameters getStaticTransportParameters(
+    const TransportSettings& transportSettings) {
+  StaticServerTransportParameters params;
+  params.initialMaxData =
+      transportSettings.advertisedInitialConnectionWindowSize;
+  params.initialMaxStreamDataBidiLocal =
+      transportSettings.advertisedInitialBidiLocalStreamWindowSize;
+  params.initialMaxStreamDataBidiRemote =
+      transportSettings.advertisedInitialBidiRemoteStreamWindowSize;
+  params.initialMaxStreamDataUni =
+      transportSettings.advertisedInitialUniStreamWindowSize;
+  params.initialMaxStreamsBidi =
+      transportSettings.advertisedInitialMaxStreamsBidi;
+  params.initialMaxStreamsUni =
+      transportSettings.advertisedInitialMaxStreamsUni;
+  params.idleTimeout = transportSettings.idleTimeout;
+  params.ackDelayExponent = transportSettings.ackDelayExponent;
+  params.maxRecvPacketSize = transportSettings.maxRecvPacketSize;
+  params.partialReliability = transportSettings.partialReliabilityEnabled;
+  if (transportSettings.ackFrequencyEnabled) {
+    params.minAckDelay = kDefaultMinAckDelay;
+  }
+  params.maxDatagramFrameSize = transportSettings.maxDatagramFrameSize;
+  params.fecEnabled = transportSettings.fecEnabled;
+  return params;
+}
 } // namespace
 
 void processClientInitialParams(
@@ -110,6 +153,14 @@ void processClientInitialParams(
   auto partialReliability = getIntegerParameter(
       static_cast<TransportParameterId>(kPartialReliabilityParameterId),
       clientParams.parameters);
+  auto minAckDelay = getIntegerParameter(
+      static_cast<TransportParameterId>(kMinAckDelayParameterId),
+      clientParams.parameters);
+  auto maxDatagramFrameSize = getIntegerParameter(
+      TransportParameterId::max_datagram_frame_size, clientParams.parameters);
+  auto fec = getIntegerParameter(
+      static_cast<TransportParameterId>(kFecParameterId),
+      clientParams.parameters);
   if (!packetSize || *packetSize == 0) {
     packetSize = kDefaultMaxUDPPayload;
   }
@@ -153,13 +204,23 @@ void processClientInitialParams(
   if (conn.transportSettings.canIgnorePathMTU) {
     conn.udpSendPacketLen = *packetSize;
   }
+  startPathMtuDiscovery(conn, *packetSize);
 
+#ifndef MVFST_NO_PARTIAL_RELIABILITY
   if (partialReliability && *partialReliability != 0 &&
       conn.transportSettings.partialReliabilityEnabled) {
     conn.partialReliabilityEnabled = true;
   }
+#endif
   VLOG(10) << "conn.partialReliabilityEnabled="
            << conn.partialReliabilityEnabled;
+
+  if (minAckDelay && conn.transportSettings.ackFrequencyEnabled) {
+    conn.peerMinAckDelay = std::chrono::microseconds(*minAckDelay);
+  }
+  conn.datagramState.maxWriteFrameSize = maxDatagramFrameSize.value_or(0);
+  conn.fecState.enabled =
+      conn.transportSettings.fecEnabled && fec.value_or(0) == 1;
 }
 
 void updateHandshakeState(QuicServerConnectionState& conn) {
@@ -246,6 +307,10 @@ void updateHandshakeState(QuicServerConnectionState& conn) {
   }
   if (handshakeLayer->isHandshakeDone()) {
     conn.readCodec->onHandshakeDone(Clock::now());
+    if (!conn.handshakeDoneReported) {
+      conn.handshakeDoneReported = true;
+      reportHandshakeDone(conn, handshakeLayer->getHandshakeTimings());
+    }
   }
 }
 
@@ -290,9 +355,27 @@ bool validateAndUpdateSourceToken(
   return acceptZeroRtt;
 }
 
+bool isSourceTokenAccepted(
+    const folly::IPAddress& peerAddress,
+    ZeroRttSourceTokenMatchingPolicy policy,
+    const std::vector<folly::IPAddress>& sourceAddresses) {
+  if (std::find(sourceAddresses.begin(), sourceAddresses.end(), peerAddress) !=
+      sourceAddresses.end()) {
+    return true;
+  }
+  return policy == ZeroRttSourceTokenMatchingPolicy::LIMIT_IF_NO_EXACT_MATCH;
+}
+
 void updateWritableByteLimitOnRecvPacket(QuicServerConnectionState& conn) {
   // When we receive a packet we increase the limit again. The reasoning this is
   // that a peer can do the same by opening a new connection.
+  if (conn.amplificationBlockedSince) {
+    auto blockedTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - *conn.amplificationBlockedSince);
+    conn.totalAmplificationBlockedTime += blockedTime;
+    conn.amplificationBlockedSince = folly::none;
+    QUIC_STATS(conn.infoCallback, onAmplificationBlocked, blockedTime);
+  }
   if (conn.writableBytesLimit) {
     conn.writableBytesLimit = *conn.writableBytesLimit +
         conn.transportSettings.limitedCwndInMss * conn.udpSendPacketLen;
@@ -327,6 +410,55 @@ void updateTransportParamsFromTicket(
   conn.transportSettings.advertisedInitialMaxStreamsUni = initialMaxStreamsUni;
 }
 
+void updateCongestionStateFromTicket(
+    QuicServerConnectionState& conn,
+    const TicketCongestionState& congestionState) {
+  if (!conn.transportSettings.resumeCongestionState ||
+      !conn.congestionControllerFactory || !conn.congestionController) {
+    return;
+  }
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+      std::chrono::system_clock::now().time_since_epoch());
+  if (congestionState.issueTime > now ||
+      now - congestionState.issueTime > kMaxResumedCongestionStateAge) {
+    VLOG(10) << "Stale congestion state in the ticket " << conn;
+    return;
+  }
+  CachedCongestionState state{
+      conn.peerAddress.getIPAddress(),
+      congestionState.srtt,
+      congestionState.mrtt,
+      congestionState.cwndBytes / kResumedCongestionStateCwndDivisor,
+      Clock::now()};
+  applyCongestionState(state, conn.transportSettings);
+  if (conn.congestionController->getCongestionWindow() >=
+      conn.transportSettings.initCwndInMss * conn.udpSendPacketLen) {
+    // The handshake already took the cwnd past the resumed one.
+    return;
+  }
+  auto congestionController =
+      conn.congestionControllerFactory->makeCongestionController(
+          conn, conn.congestionController->type());
+  if (!congestionController) {
+    return;
+  }
+  // The new controller starts from the new initial cwnd, with the packets
+  // of the handshake that are still in flight.
+  for (const auto& packet : conn.outstandingPackets) {
+    if (!packet.pureAck && !packet.isPathMtuProbe) {
+      congestionController->onPacketSent(packet);
+    }
+  }
+  conn.congestionController = std::move(congestionController);
+  if (conn.pacer) {
+    conn.pacer->refreshPacingRate(
+        conn.congestionController->getCongestionWindow(),
+        conn.lossState.srtt);
+  }
+  VLOG(10) << "Resumed congestion state initCwndInMss="
+           << conn.transportSettings.initCwndInMss << " " << conn;
+}
+
 void onConnectionMigration(
     QuicServerConnectionState& conn,
     const folly::SocketAddress& newPeerAddress) {
@@ -346,6 +478,11 @@ void onConnectionMigration(
   }
   ++conn.migrationState.numMigrations;
 
+  // The current peer address is not validated yet if its path challenge is
+  // outstanding or still waiting to be written.
+  bool currentPeerUnvalidated =
+      conn.outstandingPathValidation || conn.pendingEvents.pathChallenge;
+
   auto& previousPeerAddresses = conn.migrationState.previousPeerAddresses;
   auto it = std::find(
       previousPeerAddresses.begin(),
@@ -357,11 +494,17 @@ void onConnectionMigration(
     folly::Random::secureRandom(&pathData, sizeof(pathData));
     conn.pendingEvents.pathChallenge = PathChallengeFrame(pathData);
 
-    // Limit amount of bytes that can be sent to unvalidated source
-    conn.writableBytesLimit =
+    // Limit amount of bytes that can be sent to unvalidated source. Data is
+    // sent within the limit while the path is validated, and every packet
+    // received from the peer raises it.
+    conn.writableBytesLimit = conn.lossState.totalBytesSent +
         conn.transportSettings.limitedCwndInMss * conn.udpSendPacketLen;
   } else {
+    // Back on a validated path, which needs neither a limit nor a challenge
+    // if the migration away from it had not been validated yet.
     previousPeerAddresses.erase(it);
+    conn.pendingEvents.pathChallenge = folly::none;
+    conn.writableBytesLimit = folly::none;
   }
 
   // At this point, path validation scheduled, writable bytes limit set
@@ -369,7 +512,7 @@ void onConnectionMigration(
   bool isNATRebinding = maybeNATRebinding(newPeerAddress, conn.peerAddress);
 
   // Cancel current path validation if any
-  if (conn.outstandingPathValidation) {
+  if (currentPeerUnvalidated) {
     conn.pendingEvents.schedulePathValidationTimeout = false;
     conn.outstandingPathValidation = folly::none;
 
@@ -387,7 +530,7 @@ void onConnectionMigration(
       // remember its congestion state and rtt stats
       CongestionAndRttState state = moveCurrentCongestionAndRttState(conn);
       recoverOrResetCongestionAndRttState(conn, newPeerAddress);
-      conn.migrationState.lastCongestionAndRtt = std::move(state);
+      conn.migrationState.previousCongestionAndRtt.push_back(std::move(state));
     }
   }
 
@@ -471,29 +614,34 @@ void onServerReadDataFromOpen(
     // serverConnIdParams must be set by the QuicServerTransport
     CHECK(conn.serverConnIdParams);
 
-    conn.serverConnectionId =
-        conn.connIdAlgo->encodeConnectionId(*conn.serverConnIdParams);
-    StatelessResetGenerator generator(
-        conn.transportSettings.statelessResetTokenSecret.value(),
-        conn.serverAddr.getFullyQualified());
-    StatelessResetToken token =
-        generator.generateToken(*conn.serverConnectionId);
+    folly::Optional<IssuedConnectionId> issued;
+    if (conn.connectionIdPool) {
+      issued = conn.connectionIdPool->take(
+          *conn.connIdAlgo,
+          *conn.serverConnIdParams,
+          conn.transportSettings.statelessResetTokenSecret.value(),
+          conn.serverAddr);
+    }
+    if (!issued) {
+      auto connId =
+          conn.connIdAlgo->encodeConnectionId(*conn.serverConnIdParams);
+      StatelessResetGenerator generator(
+          conn.transportSettings.statelessResetTokenSecret.value(),
+          conn.serverAddr.getFullyQualified());
+      auto resetToken = generator.generateToken(connId);
+      issued = IssuedConnectionId{std::move(connId), resetToken};
+    }
+    conn.serverConnectionId = std::move(issued->connId);
+    StatelessResetToken token = issued->token;
     QUIC_STATS(conn.infoCallback, onStatelessReset);
+    auto staticParams = getStaticTransportParameters(conn.transportSettings);
+    auto encodedParams = conn.transportParametersCache
+        ? conn.transportParametersCache->get(staticParams)
+        : std::make_shared<const EncodedServerTransportParameters>(
+              std::move(staticParams));
     conn.serverHandshakeLayer->accept(
         std::make_shared<ServerTransportParametersExtension>(
-            version,
-            conn.supportedVersions,
-            conn.transportSettings.advertisedInitialConnectionWindowSize,
-            conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize,
-            conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
-            conn.transportSettings.advertisedInitialUniStreamWindowSize,
-            conn.transportSettings.advertisedInitialMaxStreamsBidi,
-            conn.transportSettings.advertisedInitialMaxStreamsUni,
-            conn.transportSettings.idleTimeout,
-            conn.transportSettings.ackDelayExponent,
-            conn.transportSettings.maxRecvPacketSize,
-            conn.transportSettings.partialReliabilityEnabled,
-            token));
+            version, conn.supportedVersions, std::move(encodedParams), token));
     QuicFizzFactory fizzFactory;
     FizzCryptoFactory cryptoFactory(&fizzFactory);
     conn.readCodec = std::make_unique<QuicReadCodec>(QuicNodeType::Server);
@@ -524,8 +672,14 @@ void onServerReadDataFromOpen(
        !udpData.empty() && processedPackets < kMaxNumCoalescedPackets;
        processedPackets++) {
     size_t dataSize = udpData.chainLength();
-    auto parsedPacket = conn.readCodec->parsePacket(udpData, conn.ackStates);
+    auto parsedPacket = [&] {
+      ScopedAllocationAccounting codecAccounting(
+          conn, ConnectionAllocationUsage::Subsystem::Codec);
+      return conn.readCodec->parsePacket(udpData, conn.ackStates);
+    }();
     size_t packetSize = dataSize - udpData.chainLength();
+    // NONE once the packet is buffered until its keys are available.
+    PacketDropReason dropReason = PacketDropReason::PARSE_ERROR;
     bool parseSuccess = folly::variant_match(
         parsedPacket,
         [&](QuicPacket&) { return true; },
@@ -566,14 +720,34 @@ void onServerReadDataFromOpen(
               conn.qLogger->addPacketDrop(packetSize, kMaxBuffered);
             }
             QUIC_TRACE(packet_drop, conn, "max_buffered");
+            dropReason = PacketDropReason::MAX_BUFFERED;
             return false;
           }
 
+          bool zeroRtt =
+              originalData->protectionType == ProtectionType::ZeroRtt;
           auto& pendingData =
-              originalData->protectionType == ProtectionType::ZeroRtt
-              ? conn.pendingZeroRttData
-              : conn.pendingOneRttData;
+              zeroRtt ? conn.pendingZeroRttData : conn.pendingOneRttData;
           if (pendingData) {
+            // Only the bytes of the packet are kept rather than the whole
+            // receive buffer it was read into.
+            Buf packet;
+            if (conn.pendingPacketPool) {
+              packet =
+                  conn.pendingPacketPool->copyPacket(*originalData->packet);
+            } else {
+              auto range = originalData->packet->coalesce();
+              packet = folly::IOBuf::copyBuffer(range.data(), range.size());
+            }
+            if (!packet) {
+              VLOG(10) << "drop because pending packet pool full " << conn;
+              if (conn.qLogger) {
+                conn.qLogger->addPacketDrop(packetSize, kPendingPacketPoolFull);
+              }
+              QUIC_TRACE(packet_drop, conn, "pending_packet_pool_full");
+              dropReason = PacketDropReason::PENDING_PACKET_POOL_FULL;
+              return false;
+            }
             QUIC_TRACE(
                 packet_buffered,
                 conn,
@@ -586,12 +760,15 @@ void onServerReadDataFromOpen(
                   originalData->protectionType,
                   packetSize);
             }
+            auto& pendingBytes =
+                zeroRtt ? conn.pendingZeroRttBytes : conn.pendingOneRttBytes;
+            pendingBytes += packet->computeChainDataLength();
             ServerEvents::ReadData pendingReadData;
             pendingReadData.peer = readData.peer;
             pendingReadData.networkData = NetworkData(
-                std::move(originalData->packet),
-                readData.networkData.receiveTimePoint);
+                std::move(packet), readData.networkData.receiveTimePoint);
             pendingData->emplace_back(std::move(pendingReadData));
+            dropReason = PacketDropReason::NONE;
             VLOG(10) << "Adding pending data to "
                      << toString(originalData->protectionType)
                      << " buffer size=" << pendingData->size() << " " << conn;
@@ -603,6 +780,7 @@ void onServerReadDataFromOpen(
               conn.qLogger->addPacketDrop(packetSize, kBufferUnavailable);
             }
             QUIC_TRACE(packet_drop, conn, "buffer_unavailable");
+            dropReason = PacketDropReason::BUFFER_UNAVAILABLE;
           }
           return false;
         },
@@ -615,16 +793,16 @@ void onServerReadDataFromOpen(
           return false;
         });
     if (!parseSuccess) {
+      if (dropReason == PacketDropReason::NONE) {
+        continue;
+      }
       // We were unable to parse the packet, drop for now.
       VLOG(10) << "Not able to parse QUIC packet " << conn;
       if (conn.qLogger) {
         conn.qLogger->addPacketDrop(
-            packetSize,
-            QuicTransportStatsCallback::toString(
-                PacketDropReason::PARSE_ERROR));
+            packetSize, QuicTransportStatsCallback::toString(dropReason));
       }
-      QUIC_STATS(
-          conn.infoCallback, onPacketDropped, PacketDropReason::PARSE_ERROR);
+      QUIC_STATS(conn.infoCallback, onPacketDropped, dropReason);
       continue;
     }
     auto& packet = boost::get<QuicPacket>(parsedPacket);
@@ -735,7 +913,10 @@ void onServerReadDataFromOpen(
 
     auto& ackState = getAckState(conn, packetNumberSpace);
     auto outOfOrder = updateLargestReceivedPacketNum(
-        ackState, packetNum, readData.networkData.receiveTimePoint);
+        ackState,
+        packetNum,
+        readData.networkData.receiveTimePoint,
+        conn.transportSettings.maxAckBlocks);
     DCHECK(hasReceivedPackets(conn));
 
     bool pktHasRetransmittableData = false;
@@ -796,6 +977,9 @@ void onServerReadDataFromOpen(
                                 << frame.ackBlocks.back().end << " " << conn;
                         commonAckVisitorForAckFrame(ackState, frame);
                       },
+                      [&](const QuicSimpleFrame& frame) {
+                        updateSimpleFrameOnAck(conn, frame);
+                      },
                       [&](const auto& /*frame*/) {
                         // Ignore other frames.
                       });
@@ -840,7 +1024,11 @@ void onServerReadDataFromOpen(
             auto stream = conn.streamManager->getStream(frame.streamId);
             // Ignore data from closed streams that we don't have the
             // state for any more.
-            if (stream) {
+            if (!stream) {
+              return;
+            }
+            onStreamFrameReceived(conn, frame);
+            if (!receiveInOrderStreamData(*stream, frame)) {
               invokeStreamReceiveStateMachine(conn, *stream, frame);
             }
           },
@@ -901,10 +1089,11 @@ void onServerReadDataFromOpen(
           [&](StreamsBlockedFrame& blocked) {
             // peer wishes to open a stream, but is unable to due to the maximum
             // stream limit set by us
-            // TODO implement the handler
             isNonProbingPacket = true;
             VLOG(10) << "Server received streams blocked limit="
                      << blocked.streamLimit << ", " << conn;
+            conn.streamManager->grantRemoteStreamCredit(
+                blocked.isForBidirectionalStream());
           },
           [&](ConnectionCloseFrame& connFrame) {
             isNonProbingPacket = true;
@@ -939,6 +1128,21 @@ void onServerReadDataFromOpen(
                 "Peer closed", TransportErrorCode::NO_ERROR);
           },
           [&](PaddingFrame&) {},
+          [&](ReadDatagramFrame& datagramFrame) {
+            VLOG(10) << "Server received datagram packetNum=" << packetNum
+                     << " " << conn;
+            pktHasRetransmittableData = true;
+            isNonProbingPacket = true;
+            handleDatagram(conn, datagramFrame);
+          },
+          [&](RepairFrame& repairFrame) {
+            VLOG(10) << "Server received repair frame stream="
+                     << repairFrame.streamId << " packetNum=" << packetNum
+                     << " " << conn;
+            pktHasRetransmittableData = true;
+            isNonProbingPacket = true;
+            handleRepairFrame(conn, repairFrame);
+          },
           [&](QuicSimpleFrame& simpleFrame) {
             pktHasRetransmittableData = true;
             isNonProbingPacket |= updateSimpleFrameOnPacketReceived(
@@ -985,7 +1189,12 @@ void onServerReadDataFromOpen(
     auto data = readDataFromCryptoStream(
         *getCryptoStream(*conn.cryptoState, encryptionLevel));
     if (data) {
-      conn.serverHandshakeLayer->doHandshake(std::move(data), encryptionLevel);
+      {
+        ScopedAllocationAccounting handshakeAccounting(
+            conn, ConnectionAllocationUsage::Phase::Handshake);
+        conn.serverHandshakeLayer->doHandshake(
+            std::move(data), encryptionLevel);
+      }
 
       try {
         updateHandshakeState(conn);
@@ -1010,6 +1219,7 @@ void onServerReadDataFromOpen(
         outOfOrder,
         pktHasRetransmittableData,
         pktHasCryptoData);
+    updateEcnCountsOnRecvPacket(conn, ackState, readData.networkData.ecn);
     QUIC_STATS(conn.infoCallback, onPacketProcessed);
   }
   VLOG_IF(4, !udpData.empty())
@@ -1056,7 +1266,11 @@ void onServerReadDataFromClosed(
         PacketDropReason::SERVER_STATE_CLOSED);
     return;
   }
-  auto parsedPacket = conn.readCodec->parsePacket(udpData, conn.ackStates);
+  auto parsedPacket = [&] {
+    ScopedAllocationAccounting codecAccounting(
+        conn, ConnectionAllocationUsage::Subsystem::Codec);
+    return conn.readCodec->parsePacket(udpData, conn.ackStates);
+  }();
   bool parseSuccess = folly::variant_match(
       parsedPacket,
       [&](QuicPacket&) { return true; },
@@ -14,11 +14,16 @@
 
 #include <quic/QuicException.h>
 #include <quic/codec/Types.h>
+#include <quic/common/BlockCache.h>
+#include <quic/common/PendingPacketPool.h>
 #include <quic/congestion_control/CongestionControllerFactory.h>
 #include <quic/congestion_control/QuicCubic.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/logging/QuicLogger.h>
 #include <quic/loss/QuicLossFunctions.h>
+#include <quic/server/CongestionStateCache.h>
+#include <quic/server/ConnectionIdPool.h>
+#include <quic/server/WriteBudgetScheduler.h>
 #include <quic/server/handshake/ServerHandshake.h>
 #include <quic/state/AckHandlers.h>
 #include <quic/state/QPRFunctions.h>
@@ -74,13 +79,25 @@ struct ConnectionMigrationState {
   // Previous validated peer addresses, not containing current peer address
   std::vector<folly::SocketAddress> previousPeerAddresses;
 
-  // Congestion state and rtt stats of last validated peer
-  folly::Optional<CongestionAndRttState> lastCongestionAndRtt;
+  // Congestion state and rtt stats of the validated peers the connection
+  // migrated away from, the most recent one last. Migrating back to one of
+  // them restores its state. kMaxNumMigrationsAllowed bounds their number.
+  std::vector<CongestionAndRttState> previousCongestionAndRtt;
 };
 
 struct QuicServerConnectionState : public QuicConnectionStateBase {
   ~QuicServerConnectionState() override = default;
 
+  // A server that accepts connections at a high rate reuses the memory of
+  // the states of the closed ones.
+  static void* operator new(size_t size) {
+    return BlockCache<QuicServerConnectionState>::allocate(size);
+  }
+
+  static void operator delete(void* p, size_t size) noexcept {
+    BlockCache<QuicServerConnectionState>::deallocate(p, size);
+  }
+
   ServerState state;
 
   // Data which we cannot read yet, because the handshake has not completed.
@@ -88,6 +105,21 @@ struct QuicServerConnectionState : public QuicConnectionStateBase {
   std::unique_ptr<std::vector<ServerEvents::ReadData>> pendingZeroRttData;
   // One rtt protected packets
   std::unique_ptr<std::vector<ServerEvents::ReadData>> pendingOneRttData;
+  // Bytes of the packets in pendingZeroRttData and pendingOneRttData.
+  uint64_t pendingZeroRttBytes{0};
+  uint64_t pendingOneRttBytes{0};
+  // The pool the pending packets are copied into, shared by the connections
+  // of the worker. The packets are copied trimmed to their length otherwise.
+  PendingPacketPool* pendingPacketPool{nullptr};
+  // The server connection ids made ahead by the worker, if it has a pool.
+  ConnectionIdPool* connectionIdPool{nullptr};
+  // The transport parameters encoded by the worker for its settings.
+  ServerTransportParametersCache* transportParametersCache{nullptr};
+  // The packets the connections of the worker write in a loop, if it has a
+  // budget for them.
+  WriteBudgetScheduler* writeBudgetScheduler{nullptr};
+  // How this connection shares that budget with the others.
+  ConnectionWriteShare writeShare;
 
   // Current state of connection migration
   ConnectionMigrationState migrationState;
@@ -113,10 +145,13 @@ struct QuicServerConnectionState : public QuicConnectionStateBase {
   // Server address of VIP. Currently used as input for stateless reset token.
   folly::SocketAddress serverAddr;
 
+  // Whether the completed handshake was reported to the stats and the qlog.
+  bool handshakeDoneReported{false};
+
   QuicServerConnectionState() : QuicConnectionStateBase(QuicNodeType::Server) {
     state = ServerState::Open;
     // Create the crypto stream.
-    cryptoState = std::make_unique<QuicCryptoState>();
+    cryptoState = std::make_unique<QuicCryptoState>(&cryptoBufferBytes);
     congestionController = std::make_unique<Cubic>(*this);
     // TODO: this is wrong, it should be the handshake finish time. But i need
     // a relatively sane time now to make the timestamps all sane.
@@ -165,6 +200,19 @@ bool validateAndUpdateSourceToken(
     QuicServerConnectionState& conn,
     std::vector<folly::IPAddress> sourceAddresses);
 
+/**
+ * Whether validateAndUpdateSourceToken would accept 0-RTT for the source
+ * address token of a peer at peerAddress, without changing the connection.
+ */
+bool isSourceTokenAccepted(
+    const folly::IPAddress& peerAddress,
+    ZeroRttSourceTokenMatchingPolicy policy,
+    const std::vector<folly::IPAddress>& sourceAddresses);
+
+/**
+ * Raises writableBytesLimit for a packet received from the peer, which also
+ * ends the time the connection was blocked on it.
+ */
 void updateWritableByteLimitOnRecvPacket(QuicServerConnectionState& conn);
 
 void updateTransportParamsFromTicket(
@@ -178,6 +226,16 @@ void updateTransportParamsFromTicket(
     uint64_t initialMaxStreamsBidi,
     uint64_t initialMaxStreamsUni);
 
+/**
+ * Warm starts the connection from the congestion state in its ticket, if
+ * resumeCongestionState is set and the state is recent enough. Meant for
+ * when the handshake is done, the packets in flight by then are handed over
+ * to the new congestion controller.
+ */
+void updateCongestionStateFromTicket(
+    QuicServerConnectionState& conn,
+    const TicketCongestionState& congestionState);
+
 void onConnectionMigration(
     QuicServerConnectionState& conn,
     const folly::SocketAddress& newPeerAddress);
@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+/**
+ * Measures the CPU a QuicServerTransport spends per packet of a client that
+ * sends hostile patterns. The client is not a transport: it builds 1-rtt
+ * packets by hand and hands them to onNetworkData after a fake handshake
+ * with no-op ciphers, so the time of an iteration is the read, the frame
+ * processing and the writes of the server for one packet. The packets are
+ * built outside of the measured time. The benchmarks are:
+ *
+ * - AckWithManyRanges: an ACK frame of kAckRanges ranges of one packet.
+ * - TinyOutOfOrderStreamFrames: kFramesPerPacket STREAM frames of a byte,
+ *   in decreasing offsets with a gap between each, so that none of them can
+ *   be read and the read buffer of the stream only grows.
+ * - StreamCreation: kStreamsPerPacket new bidirectional streams per packet,
+ *   up to advertisedInitialMaxStreamsBidi, with a new connection then.
+ * - PathChallengeFlood: a packet of PATH_CHALLENGE frames.
+ * - ConnectionIdChurn: a packet of NEW_CONNECTION_ID frames, each retiring
+ *   all the connection ids before it.
+ * - SparsePacketNumbers: a PING every other packet number, so that each
+ *   packet adds a range to the acks of the server.
+ *
+ * A cost that grows with the number of iterations, rather than staying flat,
+ * is a data structure that needs a bound.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/test/MockAsyncUDPSocket.h>
+
+#include <quic/api/test/Mocks.h>
+#include <quic/codec/DefaultConnectionIdAlgo.h>
+#include <quic/codec/QuicPacketBuilder.h>
+#include <quic/codec/QuicWriteCodec.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/handshake/FizzCryptoFactory.h>
+#include <quic/server/test/Mocks.h>
+#include <quic/server/test/QuicServerTransportTestUtil.h>
+#include <quic/state/QuicStreamManager.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+namespace {
+
+constexpr size_t kAckRanges = 256;
+constexpr size_t kFramesPerPacket = 128;
+constexpr size_t kStreamsPerPacket = 64;
+constexpr uint64_t kMaxStreamsBidi = 10000;
+
+/**
+ * A client of a QuicServerTransport on an event base of its own.
+ */
+class HostileClient {
+ public:
+  explicit HostileClient(TransportSettings settings = TransportSettings()) {
+    auto sock =
+        std::make_unique<NiceMock<folly::test::MockAsyncUDPSocket>>(&evb_);
+    ON_CALL(*sock, write(_, _))
+        .WillByDefault(Invoke([](const folly::SocketAddress&,
+                                 const std::unique_ptr<folly::IOBuf>& buf) {
+          return buf->computeChainDataLength();
+        }));
+    ON_CALL(*sock, address()).WillByDefault(ReturnRef(serverAddr_));
+    server_ = std::make_shared<TestingQuicServerTransport>(
+        &evb_, std::move(sock), connCallback_, createServerCtx());
+    server_->setCongestionControllerFactory(
+        std::make_shared<DefaultCongestionControllerFactory>());
+    server_->setRoutingCallback(&routingCallback_);
+    server_->setSupportedVersions({QuicVersion::MVFST});
+    server_->setOriginalPeerAddress(clientAddr_);
+    server_->setServerConnectionIdParams(ServerConnectionIdParams(0, 0, 1));
+    settings.statelessResetTokenSecret = getRandSecret();
+    server_->setTransportSettings(settings);
+    auto handshake =
+        new NiceMock<FakeServerHandshake>(server_->getNonConstConn());
+    server_->getNonConstConn().handshakeLayer.reset(handshake);
+    server_->getNonConstConn().serverHandshakeLayer = handshake;
+    server_->setConnectionIdAlgo(&connIdAlgo_);
+    server_->setClientConnectionId(clientConnectionId_);
+    server_->accept();
+    recvClientHello();
+    recvClientFinished();
+    CHECK(server_->getConn().oneRttWriteCipher);
+    serverConnectionId_ = *server_->getConn().serverConnectionId;
+  }
+
+  const QuicServerConnectionState& getConn() const {
+    return server_->getConn();
+  }
+
+  /**
+   * Builds the next 1-rtt packet with the frames written by writeFrames.
+   */
+  template <typename WriteFrames>
+  Buf buildPacket(WriteFrames&& writeFrames, PacketNum packetNumGap = 0) {
+    nextPacketNum_ += packetNumGap;
+    ShortHeader header(
+        ProtectionType::KeyPhaseZero, serverConnectionId_, nextPacketNum_++);
+    RegularQuicPacketBuilder builder(
+        kDefaultUDPSendPacketLen, std::move(header), 0 /* largestAcked */);
+    writeFrames(builder);
+    auto buf = packetToBuf(std::move(builder).buildPacket());
+    buf->coalesce();
+    return buf;
+  }
+
+  /**
+   * Hands the packet to the server and runs the writes it schedules.
+   */
+  void deliver(Buf packet) {
+    server_->onNetworkData(
+        clientAddr_, NetworkData(std::move(packet), Clock::now()));
+    evb_.loopOnce(EVLOOP_NONBLOCK);
+  }
+
+ private:
+  void recvClientHello() {
+    QuicFizzFactory fizzFactory;
+    FizzCryptoFactory cryptoFactory(&fizzFactory);
+    auto aead = cryptoFactory.getClientInitialCipher(
+        initialDestinationConnectionId_, QuicVersion::MVFST);
+    auto headerCipher = cryptoFactory.makeClientInitialHeaderCipher(
+        initialDestinationConnectionId_, QuicVersion::MVFST);
+    auto chlo = folly::IOBuf::copyBuffer("CHLO");
+    deliver(packetToBufCleartext(
+        createInitialCryptoPacket(
+            clientConnectionId_,
+            initialDestinationConnectionId_,
+            0 /* packetNum */,
+            QuicVersion::MVFST,
+            *chlo,
+            *aead,
+            0 /* largestAcked */),
+        *aead,
+        *headerCipher,
+        0 /* packetNum */));
+  }
+
+  void recvClientFinished() {
+    auto aead = createNoOpAead();
+    auto headerCipher = createNoOpHeaderCipher();
+    auto finished = folly::IOBuf::copyBuffer("FINISHED");
+    deliver(packetToBufCleartext(
+        createCryptoPacket(
+            clientConnectionId_,
+            *server_->getConn().serverConnectionId,
+            0 /* packetNum */,
+            QuicVersion::MVFST,
+            ProtectionType::Handshake,
+            *finished,
+            *aead,
+            0 /* largestAcked */),
+        *aead,
+        *headerCipher,
+        0 /* packetNum */));
+    // The fake handshake gives the 1-rtt keys in a loop callback.
+    evb_.loopOnce(EVLOOP_NONBLOCK);
+  }
+
+  folly::EventBase evb_;
+  folly::SocketAddress clientAddr_{"127.0.0.1", 1000};
+  folly::SocketAddress serverAddr_{"1.2.3.4", 8080};
+  ConnectionId clientConnectionId_{getTestConnectionId()};
+  ConnectionId initialDestinationConnectionId_{getTestConnectionId(1)};
+  ConnectionId serverConnectionId_{getTestConnectionId()};
+  NiceMock<MockConnectionCallback> connCallback_;
+  NiceMock<MockRoutingCallback> routingCallback_;
+  DefaultConnectionIdAlgo connIdAlgo_;
+  std::shared_ptr<TestingQuicServerTransport> server_;
+  PacketNum nextPacketNum_{0};
+};
+
+void writeOneByteStreamFrame(
+    PacketBuilderInterface& builder,
+    StreamId id,
+    uint64_t offset) {
+  auto dataLen = writeStreamFrameHeader(builder, id, offset, 1, 1, false);
+  CHECK(dataLen);
+  writeStreamFrameData(builder, folly::IOBuf::copyBuffer("a"), 1);
+}
+
+} // namespace
+
+BENCHMARK(AckWithManyRanges, iters) {
+  folly::Optional<HostileClient> client;
+  IntervalSet<PacketNum> acks;
+  BENCHMARK_SUSPEND {
+    client.emplace();
+    for (PacketNum i = 0; i < kAckRanges; i++) {
+      acks.insert(2 * i);
+    }
+  }
+  for (size_t i = 0; i < iters; i++) {
+    Buf packet;
+    BENCHMARK_SUSPEND {
+      packet = client->buildPacket([&](PacketBuilderInterface& builder) {
+        AckFrameMetaData ackData(acks, 0us, kDefaultAckDelayExponent);
+        CHECK(writeAckFrame(ackData, builder));
+      });
+    }
+    client->deliver(std::move(packet));
+  }
+}
+
+BENCHMARK(TinyOutOfOrderStreamFrames, iters) {
+  // Every other byte of each stream, up to the flow control windows.
+  constexpr uint64_t kPacketBytes = 2 * kFramesPerPacket;
+  const TransportSettings settings;
+  folly::Optional<HostileClient> client;
+  StreamId streamId = 0;
+  uint64_t offset = 0;
+  uint64_t connBytes = 0;
+  for (size_t i = 0; i < iters; i++) {
+    Buf packet;
+    BENCHMARK_SUSPEND {
+      if (!client ||
+          connBytes + kPacketBytes >
+              settings.advertisedInitialConnectionWindowSize) {
+        client.clear();
+        client.emplace();
+        streamId = 0;
+        offset = 0;
+        connBytes = 0;
+      } else if (
+          offset + kPacketBytes >
+          settings.advertisedInitialBidiRemoteStreamWindowSize) {
+        streamId += detail::kStreamIncrement;
+        offset = 0;
+      }
+      packet = client->buildPacket([&](PacketBuilderInterface& builder) {
+        // Offset 0 is never sent, nothing can be read.
+        for (size_t frame = kFramesPerPacket; frame > 0; frame--) {
+          writeOneByteStreamFrame(builder, streamId, offset + 2 * frame - 1);
+        }
+      });
+      offset += kPacketBytes;
+      connBytes += kPacketBytes;
+    }
+    client->deliver(std::move(packet));
+  }
+}
+
+BENCHMARK(StreamCreation, iters) {
+  folly::Optional<HostileClient> client;
+  TransportSettings settings;
+  settings.advertisedInitialMaxStreamsBidi = kMaxStreamsBidi;
+  uint64_t streams = kMaxStreamsBidi;
+  for (size_t i = 0; i < iters; i++) {
+    Buf packet;
+    BENCHMARK_SUSPEND {
+      if (streams + kStreamsPerPacket > kMaxStreamsBidi) {
+        client.clear();
+        client.emplace(settings);
+        streams = 0;
+      }
+      packet = client->buildPacket([&](PacketBuilderInterface& builder) {
+        for (size_t stream = 0; stream < kStreamsPerPacket; stream++) {
+          writeOneByteStreamFrame(
+              builder, streams++ * detail::kStreamIncrement, 0);
+        }
+      });
+    }
+    client->deliver(std::move(packet));
+  }
+}
+
+BENCHMARK(PathChallengeFlood, iters) {
+  folly::Optional<HostileClient> client;
+  uint64_t pathData = 0;
+  BENCHMARK_SUSPEND {
+    client.emplace();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    Buf packet;
+    BENCHMARK_SUSPEND {
+      packet = client->buildPacket([&](PacketBuilderInterface& builder) {
+        while (writeSimpleFrame(PathChallengeFrame(pathData), builder)) {
+          pathData++;
+        }
+      });
+    }
+    client->deliver(std::move(packet));
+  }
+}
+
+BENCHMARK(ConnectionIdChurn, iters) {
+  folly::Optional<HostileClient> client;
+  uint64_t sequenceNumber = 1;
+  BENCHMARK_SUSPEND {
+    client.emplace();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    Buf packet;
+    BENCHMARK_SUSPEND {
+      packet = client->buildPacket([&](PacketBuilderInterface& builder) {
+        StatelessResetToken token{};
+        while (writeSimpleFrame(
+            NewConnectionIdFrame(
+                sequenceNumber,
+                sequenceNumber,
+                getTestConnectionId(sequenceNumber & 0xffff),
+                token),
+            builder)) {
+          sequenceNumber++;
+        }
+      });
+    }
+    client->deliver(std::move(packet));
+  }
+}
+
+BENCHMARK(SparsePacketNumbers, iters) {
+  folly::Optional<HostileClient> client;
+  BENCHMARK_SUSPEND {
+    client.emplace();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    Buf packet;
+    BENCHMARK_SUSPEND {
+      packet = client->buildPacket(
+          [](PacketBuilderInterface& builder) {
+            writeFrame(PingFrame(), builder);
+          },
+          1 /* packetNumGap */);
+    }
+    client->deliver(std::move(packet));
+  }
+}
+
+} // namespace test
+} // namespace quic
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/CongestionStateCache.h>
+
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+TEST(CongestionStateCacheTest, SharedWithinSubnet) {
+  CongestionStateCache cache;
+  auto now = Clock::now();
+  EXPECT_EQ(nullptr, cache.get(folly::IPAddress("1.2.3.4"), now));
+  cache.update(folly::IPAddress("1.2.3.4"), 100ms, 80ms, 50000, now);
+
+  auto state = cache.get(folly::IPAddress("1.2.3.200"), now);
+  ASSERT_NE(nullptr, state);
+  EXPECT_EQ(folly::IPAddress("1.2.3.0"), state->subnet);
+  EXPECT_EQ(100ms, state->srtt);
+  EXPECT_EQ(80ms, state->mrtt);
+  EXPECT_EQ(50000, state->cwndBytes);
+  EXPECT_NE(nullptr, cache.get(folly::IPAddress("::ffff:1.2.3.5"), now));
+  EXPECT_EQ(nullptr, cache.get(folly::IPAddress("1.2.4.4"), now));
+
+  cache.update(folly::IPAddress("2001:db8::1"), 10ms, 10ms, 20000, now);
+  EXPECT_NE(nullptr, cache.get(folly::IPAddress("2001:db8::ff:1"), now));
+  EXPECT_EQ(nullptr, cache.get(folly::IPAddress("2001:db8:0:1::1"), now));
+}
+
+TEST(CongestionStateCacheTest, StaleStatesAreIgnored) {
+  CongestionStateCache cache(16, 10s);
+  auto now = Clock::now();
+  cache.update(folly::IPAddress("1.2.3.4"), 100ms, 80ms, 50000, now);
+  EXPECT_NE(nullptr, cache.get(folly::IPAddress("1.2.3.4"), now + 10s));
+  EXPECT_EQ(nullptr, cache.get(folly::IPAddress("1.2.3.4"), now + 11s));
+}
+
+TEST(CongestionStateCacheTest, ApplyCongestionStateIsBounded) {
+  TransportSettings settings;
+  // 150 packets in flight at twice the min RTT is a BDP of 75 packets.
+  CachedCongestionState state{folly::IPAddress("1.2.3.0"),
+                              100ms,
+                              50ms,
+                              150 * kDefaultUDPSendPacketLen,
+                              Clock::now()};
+  applyCongestionState(state, settings);
+  EXPECT_EQ(75, settings.initCwndInMss);
+  EXPECT_EQ(100ms, settings.initialRtt);
+
+  TransportSettings largeSettings;
+  state.mrtt = state.srtt;
+  applyCongestionState(state, largeSettings);
+  EXPECT_EQ(kMaxWarmStartCwndInMss, largeSettings.initCwndInMss);
+
+  // A path that did worse than the default does not shrink the initial cwnd.
+  TransportSettings smallSettings;
+  state.cwndBytes = 2 * kDefaultUDPSendPacketLen;
+  applyCongestionState(state, smallSettings);
+  EXPECT_EQ(kInitCwndInMss, smallSettings.initCwndInMss);
+}
+
+} // namespace test
+} // namespace quic
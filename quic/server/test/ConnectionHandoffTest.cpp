@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/ConnectionHandoff.h>
+
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+namespace {
+ConnectionHandoffState makeState() {
+  ConnectionHandoffState state;
+  state.version = QuicVersion::MVFST;
+  state.clientConnectionId = ConnectionId(std::vector<uint8_t>{1, 2, 3, 4});
+  state.serverConnectionId =
+      ConnectionId(std::vector<uint8_t>{5, 6, 7, 8, 9, 10, 11, 12});
+  state.originalPeerAddress = folly::SocketAddress("1.2.3.4", 1234);
+  state.peerAddress = folly::SocketAddress("::1", 4321);
+  state.secrets.cipher = fizz::CipherSuite::TLS_AES_128_GCM_SHA256;
+  state.secrets.readSecret = std::vector<uint8_t>(32, 0xaa);
+  state.secrets.writeSecret = std::vector<uint8_t>(32, 0xbb);
+  state.applicationProtocol = std::string("h3");
+  state.nextPacketNum = 100;
+  state.largestAckedByPeer = 99;
+  state.ackedByPeer = true;
+  state.largestReceivedPacketNum = 80;
+  state.advertisedMaxOffset = 1000;
+  state.peerAdvertisedMaxOffset = 2000;
+  state.sumCurReadOffset = 300;
+  state.sumMaxObservedOffset = 400;
+  state.sumCurWriteOffset = 500;
+  state.peerAdvertisedInitialMaxStreamOffsetBidiLocal = 10;
+  state.peerAdvertisedInitialMaxStreamOffsetBidiRemote = 20;
+  state.peerAdvertisedInitialMaxStreamOffsetUni = 30;
+  state.streamIds.nextAcceptablePeerBidirectionalStreamId = 4;
+  state.streamIds.nextAcceptablePeerUnidirectionalStreamId = 6;
+  state.streamIds.nextBidirectionalStreamId = 5;
+  state.streamIds.nextUnidirectionalStreamId = 7;
+  state.streamIds.maxLocalBidirectionalStreamId = 401;
+  state.streamIds.maxRemoteUnidirectionalStreamId = 402;
+  state.peerAckDelayExponent = 5;
+  state.peerIdleTimeout = 30000ms;
+  state.udpSendPacketLen = 1350;
+  state.cwndBytes = 50000;
+  state.srtt = 20ms;
+  state.rttvar = 5ms;
+  state.mrtt = 15ms;
+  return state;
+}
+} // namespace
+
+TEST(ConnectionHandoffTest, EncodeDecode) {
+  auto state = makeState();
+  auto buf = encodeConnectionHandoffState(state);
+  EXPECT_LE(buf->computeChainDataLength(), kMaxConnectionHandoffStateSize);
+  auto decoded = decodeConnectionHandoffState(*buf);
+  ASSERT_TRUE(decoded.hasValue());
+  EXPECT_EQ(decoded->version, state.version);
+  EXPECT_EQ(decoded->clientConnectionId, state.clientConnectionId);
+  EXPECT_EQ(decoded->serverConnectionId, state.serverConnectionId);
+  EXPECT_EQ(decoded->originalPeerAddress, state.originalPeerAddress);
+  EXPECT_EQ(decoded->peerAddress, state.peerAddress);
+  EXPECT_EQ(decoded->secrets.cipher, state.secrets.cipher);
+  EXPECT_EQ(decoded->secrets.readSecret, state.secrets.readSecret);
+  EXPECT_EQ(decoded->secrets.writeSecret, state.secrets.writeSecret);
+  EXPECT_EQ(decoded->applicationProtocol, state.applicationProtocol);
+  EXPECT_EQ(decoded->nextPacketNum, state.nextPacketNum);
+  EXPECT_EQ(decoded->largestAckedByPeer, state.largestAckedByPeer);
+  EXPECT_TRUE(decoded->ackedByPeer);
+  EXPECT_EQ(decoded->largestReceivedPacketNum, state.largestReceivedPacketNum);
+  EXPECT_EQ(decoded->advertisedMaxOffset, state.advertisedMaxOffset);
+  EXPECT_EQ(decoded->peerAdvertisedMaxOffset, state.peerAdvertisedMaxOffset);
+  EXPECT_EQ(decoded->sumCurReadOffset, state.sumCurReadOffset);
+  EXPECT_EQ(decoded->sumMaxObservedOffset, state.sumMaxObservedOffset);
+  EXPECT_EQ(decoded->sumCurWriteOffset, state.sumCurWriteOffset);
+  EXPECT_EQ(
+      decoded->peerAdvertisedInitialMaxStreamOffsetUni,
+      state.peerAdvertisedInitialMaxStreamOffsetUni);
+  EXPECT_EQ(
+      decoded->streamIds.nextAcceptablePeerBidirectionalStreamId,
+      state.streamIds.nextAcceptablePeerBidirectionalStreamId);
+  EXPECT_EQ(
+      decoded->streamIds.nextUnidirectionalStreamId,
+      state.streamIds.nextUnidirectionalStreamId);
+  EXPECT_EQ(
+      decoded->streamIds.maxLocalBidirectionalStreamId,
+      state.streamIds.maxLocalBidirectionalStreamId);
+  EXPECT_EQ(
+      decoded->streamIds.maxRemoteUnidirectionalStreamId,
+      state.streamIds.maxRemoteUnidirectionalStreamId);
+  EXPECT_EQ(decoded->peerAckDelayExponent, state.peerAckDelayExponent);
+  EXPECT_EQ(decoded->peerIdleTimeout, state.peerIdleTimeout);
+  EXPECT_EQ(decoded->udpSendPacketLen, state.udpSendPacketLen);
+  EXPECT_EQ(decoded->cwndBytes, state.cwndBytes);
+  EXPECT_EQ(decoded->srtt, state.srtt);
+  EXPECT_EQ(decoded->rttvar, state.rttvar);
+  EXPECT_EQ(decoded->mrtt, state.mrtt);
+}
+
+TEST(ConnectionHandoffTest, EncodeDecodeNoneReceived) {
+  auto state = makeState();
+  state.largestReceivedPacketNum = folly::none;
+  state.applicationProtocol = folly::none;
+  auto decoded =
+      decodeConnectionHandoffState(*encodeConnectionHandoffState(state));
+  ASSERT_TRUE(decoded.hasValue());
+  EXPECT_FALSE(decoded->largestReceivedPacketNum.hasValue());
+  EXPECT_FALSE(decoded->applicationProtocol.hasValue());
+}
+
+TEST(ConnectionHandoffTest, DecodeTruncated) {
+  auto buf = encodeConnectionHandoffState(makeState());
+  buf->coalesce();
+  buf->trimEnd(1);
+  EXPECT_FALSE(decodeConnectionHandoffState(*buf).hasValue());
+}
+
+TEST(ConnectionHandoffTest, DecodeWrongVersion) {
+  auto buf = encodeConnectionHandoffState(makeState());
+  buf->coalesce();
+  buf->writableData()[0] ^= 0xff;
+  EXPECT_FALSE(decodeConnectionHandoffState(*buf).hasValue());
+}
+
+TEST(ConnectionHandoffTest, DecodeBadTransportParameters) {
+  auto state = makeState();
+  state.peerAckDelayExponent = kMaxAckDelayExponent + 1;
+  EXPECT_FALSE(
+      decodeConnectionHandoffState(*encodeConnectionHandoffState(state))
+          .hasValue());
+  state = makeState();
+  state.udpSendPacketLen = 0;
+  EXPECT_FALSE(
+      decodeConnectionHandoffState(*encodeConnectionHandoffState(state))
+          .hasValue());
+}
+
+TEST(ConnectionHandoffTest, NotEstablished) {
+  QuicServerConnectionState conn;
+  conn.version = QuicVersion::MVFST;
+  conn.clientConnectionId = ConnectionId(std::vector<uint8_t>{1, 2, 3, 4});
+  conn.serverConnectionId = ConnectionId(std::vector<uint8_t>{5, 6, 7, 8});
+  EXPECT_FALSE(getConnectionHandoffState(conn).hasValue());
+}
+
+} // namespace test
+} // namespace quic
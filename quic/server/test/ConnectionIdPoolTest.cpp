@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/ConnectionIdPool.h>
+
+#include <folly/portability/GTest.h>
+#include <quic/codec/DefaultConnectionIdAlgo.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+class ConnectionIdPoolTest : public Test {
+ public:
+  void SetUp() override {
+    secret_.fill(0x42);
+  }
+
+ protected:
+  folly::EventBase evb_;
+  DefaultConnectionIdAlgo connIdAlgo_;
+  ServerConnectionIdParams params_{1, 0, 2};
+  StatelessResetSecret secret_;
+  folly::SocketAddress serverAddr_{"1.2.3.4", 443};
+  ConnectionIdPool pool_{&evb_, 4};
+};
+
+TEST_F(ConnectionIdPoolTest, FillAfterFirstTake) {
+  EXPECT_FALSE(pool_.take(connIdAlgo_, params_, secret_, serverAddr_));
+  EXPECT_EQ(0, pool_.size());
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(4, pool_.size());
+
+  StatelessResetGenerator generator(secret_, serverAddr_.getFullyQualified());
+  auto issued = pool_.take(connIdAlgo_, params_, secret_, serverAddr_);
+  ASSERT_TRUE(issued.hasValue());
+  EXPECT_EQ(3, pool_.size());
+  EXPECT_EQ(generator.generateToken(issued->connId), issued->token);
+  auto parsed = connIdAlgo_.parseConnectionId(issued->connId);
+  EXPECT_EQ(params_.hostId, parsed.hostId);
+  EXPECT_EQ(params_.processId, parsed.processId);
+  EXPECT_EQ(params_.workerId, parsed.workerId);
+
+  // Refilled at the end of the loop.
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(4, pool_.size());
+}
+
+TEST_F(ConnectionIdPoolTest, UniqueIds) {
+  pool_.take(connIdAlgo_, params_, secret_, serverAddr_);
+  pool_.fill();
+  std::vector<ConnectionId> connIds;
+  while (auto issued = pool_.take(connIdAlgo_, params_, secret_, serverAddr_)) {
+    for (const auto& connId : connIds) {
+      EXPECT_NE(connId, issued->connId);
+    }
+    connIds.push_back(issued->connId);
+  }
+  EXPECT_EQ(4, connIds.size());
+}
+
+TEST_F(ConnectionIdPoolTest, ParamsChange) {
+  pool_.take(connIdAlgo_, params_, secret_, serverAddr_);
+  pool_.fill();
+  EXPECT_EQ(4, pool_.size());
+
+  ServerConnectionIdParams otherParams(1, 1, 2);
+  EXPECT_FALSE(pool_.take(connIdAlgo_, otherParams, secret_, serverAddr_));
+  EXPECT_EQ(0, pool_.size());
+  pool_.fill();
+  auto issued = pool_.take(connIdAlgo_, otherParams, secret_, serverAddr_);
+  ASSERT_TRUE(issued.hasValue());
+  EXPECT_EQ(1, connIdAlgo_.parseConnectionId(issued->connId).processId);
+
+  folly::SocketAddress otherAddr("5.6.7.8", 443);
+  EXPECT_FALSE(pool_.take(connIdAlgo_, otherParams, secret_, otherAddr));
+  pool_.fill();
+  issued = pool_.take(connIdAlgo_, otherParams, secret_, otherAddr);
+  ASSERT_TRUE(issued.hasValue());
+  StatelessResetGenerator generator(secret_, otherAddr.getFullyQualified());
+  EXPECT_EQ(generator.generateToken(issued->connId), issued->token);
+
+  StatelessResetSecret otherSecret;
+  otherSecret.fill(0x24);
+  EXPECT_FALSE(pool_.take(connIdAlgo_, otherParams, otherSecret, otherAddr));
+}
+
+TEST_F(ConnectionIdPoolTest, Clear) {
+  pool_.take(connIdAlgo_, params_, secret_, serverAddr_);
+  pool_.clear();
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(0, pool_.size());
+  pool_.fill();
+  EXPECT_EQ(0, pool_.size());
+  EXPECT_FALSE(pool_.take(connIdAlgo_, params_, secret_, serverAddr_));
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/ConnectionIdSteering.h>
+
+#include <folly/SocketAddress.h>
+#include <folly/portability/GTest.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+#include <quic/codec/DefaultConnectionIdAlgo.h>
+
+#include <thread>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+class ConnectionIdSteeringTest : public Test {
+ public:
+  void SetUp() override {
+    folly::SocketAddress address("127.0.0.1", 0);
+    for (size_t i = 0; i < kNumWorkers; i++) {
+      int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+      ASSERT_GE(fd, 0);
+      int one = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+      sockaddr_storage addr;
+      auto len = address.getAddress(&addr);
+      ASSERT_EQ(0, ::bind(fd, reinterpret_cast<sockaddr*>(&addr), len));
+      // The other sockets join the group of the first one.
+      address.setFromLocalAddress(folly::NetworkSocket::fromFd(fd));
+      fds_.push_back(fd);
+    }
+    address_ = address;
+    clientFd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ASSERT_GE(clientFd_, 0);
+  }
+
+  void TearDown() override {
+    for (auto fd : fds_) {
+      ::close(fd);
+    }
+    ::close(clientFd_);
+  }
+
+  // Sends the packet and returns the index of the socket that got it.
+  folly::Optional<size_t> send(const std::vector<uint8_t>& packet) {
+    sockaddr_storage addr;
+    auto len = address_.getAddress(&addr);
+    ::sendto(
+        clientFd_,
+        packet.data(),
+        packet.size(),
+        0,
+        reinterpret_cast<sockaddr*>(&addr),
+        len);
+    for (int attempt = 0; attempt < 100; attempt++) {
+      for (size_t i = 0; i < fds_.size(); i++) {
+        uint8_t buf[128];
+        if (::recv(fds_[i], buf, sizeof(buf), 0) > 0) {
+          return i;
+        }
+      }
+      std::this_thread::sleep_for(1ms);
+    }
+    return folly::none;
+  }
+
+  std::vector<uint8_t> shortHeaderPacket(uint8_t workerId) {
+    DefaultConnectionIdAlgo algo;
+    ServerConnectionIdParams params(0x1234, 1, workerId);
+    auto connId = algo.encodeConnectionId(params);
+    std::vector<uint8_t> packet = {0x40};
+    packet.insert(packet.end(), connId.data(), connId.data() + connId.size());
+    packet.resize(32);
+    return packet;
+  }
+
+ protected:
+  static constexpr size_t kNumWorkers = 4;
+  std::vector<int> fds_;
+  int clientFd_{-1};
+  folly::SocketAddress address_;
+};
+
+TEST_F(ConnectionIdSteeringTest, ShortHeaderGoesToOwningWorker) {
+  if (!attachConnectionIdSteering(
+          folly::NetworkSocket::fromFd(fds_[0]), kNumWorkers)) {
+    LOG(WARNING) << "SO_ATTACH_REUSEPORT_CBPF not supported";
+    return;
+  }
+  for (uint8_t workerId = 0; workerId < 2 * kNumWorkers; workerId++) {
+    EXPECT_EQ(workerId % kNumWorkers, send(shortHeaderPacket(workerId)));
+  }
+  // Long header packets still get to one of the sockets.
+  std::vector<uint8_t> longHeader(32, 0xc0);
+  EXPECT_TRUE(send(longHeader).hasValue());
+}
+
+} // namespace test
+} // namespace quic
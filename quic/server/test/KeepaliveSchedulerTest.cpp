@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/KeepaliveScheduler.h>
+
+#include <folly/portability/GTest.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+namespace {
+class FakeConnection : public KeepaliveScheduler::Connection {
+ public:
+  folly::Optional<TimePoint> getLastActivityTime() const override {
+    if (active) {
+      return Clock::now();
+    }
+    return lastActivity;
+  }
+
+  bool writeKeepalive() noexcept override {
+    keepalives++;
+    lastActivity = Clock::now();
+    return open;
+  }
+
+  folly::Optional<TimePoint> lastActivity;
+  bool active{false};
+  bool open{true};
+  size_t keepalives{0};
+};
+} // namespace
+
+class KeepaliveSchedulerTest : public Test {
+ protected:
+  void runFor(std::chrono::milliseconds duration) {
+    evb_.runAfterDelay([&] { evb_.terminateLoopSoon(); }, duration.count());
+    evb_.loop();
+  }
+
+  folly::EventBase evb_;
+  KeepaliveScheduler scheduler_{&evb_, 32ms};
+};
+
+TEST_F(KeepaliveSchedulerTest, IdleConnectionGetsKeepalives) {
+  auto connection = std::make_shared<FakeConnection>();
+  connection->lastActivity = Clock::now();
+  scheduler_.addConnection(connection);
+  EXPECT_EQ(1, scheduler_.getNumConnections());
+  runFor(110ms);
+  EXPECT_GE(connection->keepalives, 2);
+  EXPECT_LE(connection->keepalives, 4);
+  EXPECT_EQ(1, scheduler_.getNumConnections());
+}
+
+TEST_F(KeepaliveSchedulerTest, ActiveConnectionGetsNone) {
+  auto connection = std::make_shared<FakeConnection>();
+  connection->active = true;
+  scheduler_.addConnection(connection);
+  runFor(100ms);
+  EXPECT_EQ(0, connection->keepalives);
+  EXPECT_EQ(1, scheduler_.getNumConnections());
+}
+
+TEST_F(KeepaliveSchedulerTest, ClosedConnectionsAreDropped) {
+  auto closed = std::make_shared<FakeConnection>();
+  closed->open = false;
+  auto gone = std::make_shared<FakeConnection>();
+  scheduler_.addConnection(closed);
+  scheduler_.addConnection(gone);
+  gone.reset();
+  EXPECT_EQ(2, scheduler_.getNumConnections());
+  runFor(100ms);
+  EXPECT_EQ(1, closed->keepalives);
+  EXPECT_EQ(0, scheduler_.getNumConnections());
+}
+
+} // namespace test
+} // namespace quic
@@ -108,5 +108,27 @@ class MockRoutingCallback : public QuicServerTransport::RoutingCallback {
       void(
           const QuicServerTransport::SourceIdentity&,
           folly::Optional<ConnectionId>));
+
+  GMOCK_METHOD0_(, noexcept, , onEcnValidationFailed, void());
+
+  std::unique_ptr<folly::AsyncUDPSocket> makeDedicatedSocket(
+      const folly::SocketAddress& peer,
+      const folly::Optional<folly::IPAddress>& localAddress) noexcept override {
+    return std::unique_ptr<folly::AsyncUDPSocket>(
+        _makeDedicatedSocket(peer, localAddress));
+  }
+  MOCK_METHOD2(
+      _makeDedicatedSocket,
+      folly::AsyncUDPSocket*(
+          const folly::SocketAddress&,
+          const folly::Optional<folly::IPAddress>&));
+
+  // Adds up the reported memory usage like the worker does.
+  void onMemoryUsageChanged(uint64_t previousBytes, uint64_t bytes) noexcept
+      override {
+    memoryUsage = memoryUsage - previousBytes + bytes;
+  }
+
+  uint64_t memoryUsage{0};
 };
 } // namespace quic
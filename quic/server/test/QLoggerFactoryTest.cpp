@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/QLoggerFactory.h>
+
+#include <folly/portability/GTest.h>
+#include <quic/logging/FileQLogger.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+namespace {
+SampledQLoggerFactory::QLoggerMaker countingMaker(size_t& made) {
+  return [&made](const folly::SocketAddress&, const ConnectionId&) {
+    made++;
+    return std::make_shared<FileQLogger>();
+  };
+}
+} // namespace
+
+TEST(QLoggerFactoryTest, DebugSubnetsAreAlwaysTraced) {
+  size_t made = 0;
+  SampledQLoggerFactory factory(countingMaker(made), 0);
+  factory.addDebugSubnet(folly::IPAddress::createNetwork("10.0.0.0/8"));
+  ConnectionId connId(std::vector<uint8_t>{1, 2, 3, 4});
+
+  EXPECT_EQ(
+      nullptr, factory.make(folly::SocketAddress("1.2.3.4", 443), connId));
+  EXPECT_NE(
+      nullptr, factory.make(folly::SocketAddress("10.1.2.3", 443), connId));
+  EXPECT_NE(
+      nullptr,
+      factory.make(folly::SocketAddress("::ffff:10.1.2.3", 443), connId));
+  EXPECT_EQ(2, made);
+}
+
+TEST(QLoggerFactoryTest, SampleOneIn) {
+  size_t made = 0;
+  SampledQLoggerFactory everyFactory(countingMaker(made), 1);
+  ConnectionId connId(std::vector<uint8_t>{1, 2, 3, 4});
+  for (int i = 0; i < 10; i++) {
+    EXPECT_NE(
+        nullptr,
+        everyFactory.make(folly::SocketAddress("1.2.3.4", 443), connId));
+  }
+  EXPECT_EQ(10, made);
+}
+
+} // namespace test
+} // namespace quic
@@ -21,6 +21,11 @@
 #include <quic/server/handshake/StatelessResetGenerator.h>
 #include <quic/server/test/Mocks.h>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 using namespace testing;
 using namespace folly;
 
@@ -298,6 +303,42 @@ TEST_F(QuicServerWorkerTest, NoConnFoundTestReset) {
       QuicTransportStatsCallback::PacketDropReason::CONNECTION_NOT_FOUND);
 }
 
+TEST_F(QuicServerWorkerTest, ForwardedPacketsDispatchedInOneRun) {
+  EXPECT_CALL(*socketPtr_, address()).WillRepeatedly(ReturnRef(fakeAddress_));
+  worker_->stopPacketForwarding();
+  EXPECT_CALL(
+      *transportInfoCb_,
+      onPacketDropped(
+          QuicTransportStatsCallback::PacketDropReason::CONNECTION_NOT_FOUND))
+      .Times(2);
+  EXPECT_CALL(*socketPtr_, write(_, _)).WillRepeatedly(Return(0));
+  auto data = folly::IOBuf::copyBuffer("data");
+  auto queuePacket = [&] {
+    RoutingData routingData(
+        HeaderForm::Short,
+        false,
+        false,
+        getTestConnectionId(hostId_),
+        folly::none);
+    return worker_->queueForwardedPacket(
+        kClientAddr,
+        std::move(routingData),
+        NetworkData(data->clone(), Clock::now()));
+  };
+  using Result = QuicServerWorker::ForwardedPacketResult;
+  // Only the first packet asks for the worker to be woken up.
+  EXPECT_EQ(Result::NEEDS_DISPATCH, queuePacket());
+  EXPECT_EQ(Result::QUEUED, queuePacket());
+  worker_->dispatchForwardedPackets();
+  eventbase_.loop();
+
+  EXPECT_EQ(Result::NEEDS_DISPATCH, queuePacket());
+  for (size_t i = 1; i < kMaxForwardedPacketsQueued; i++) {
+    EXPECT_EQ(Result::QUEUED, queuePacket());
+  }
+  EXPECT_EQ(Result::DROPPED, queuePacket());
+}
+
 TEST_F(QuicServerWorkerTest, QuicServerNewConnection) {
   EXPECT_CALL(*socketPtr_, address()).WillRepeatedly(ReturnRef(fakeAddress_));
   auto connId = getTestConnectionId(hostId_);
@@ -394,6 +435,16 @@ TEST_F(QuicServerWorkerTest, QuicServerNewConnection) {
       0);
 }
 
+TEST_F(QuicServerWorkerTest, MemoryUsageFromConnectionReports) {
+  worker_->onMemoryUsageChanged(0, 1000);
+  worker_->onMemoryUsageChanged(0, 500);
+  EXPECT_EQ(1500, worker_->getMemoryUsage());
+  worker_->onMemoryUsageChanged(1000, 200);
+  EXPECT_EQ(700, worker_->getMemoryUsage());
+  worker_->onMemoryUsageChanged(500, 0);
+  EXPECT_EQ(200, worker_->getMemoryUsage());
+}
+
 TEST_F(QuicServerWorkerTest, InitialPacketTooSmall) {
   auto data = createData(kMinInitialPacketSize - 100);
   auto connId = getTestConnectionId(hostId_);
@@ -490,6 +541,29 @@ TEST_F(QuicServerWorkerTest, ShutdownQuicServer) {
   t.join();
 }
 
+TEST_F(QuicServerWorkerTest, CloseAllConnectionsIncrementally) {
+  auto connId = getTestConnectionId(hostId_);
+  createQuicConnection(kClientAddr, connId);
+
+  EXPECT_CALL(*transportInfoCb_, onNewConnection());
+  worker_->onConnectionIdAvailable(transport_, connId);
+
+  // The connection is in both maps but is closed once.
+  EXPECT_CALL(
+      *transport_,
+      closeNow(Eq(std::make_pair(
+          QuicErrorCode(LocalErrorCode::SHUTTING_DOWN),
+          std::string("shutting down")))))
+      .Times(1);
+  bool closed = false;
+  worker_->closeAllConnectionsIncrementally(
+      LocalErrorCode::SHUTTING_DOWN, [&] { closed = true; });
+  EXPECT_FALSE(closed);
+  eventbase_.loopOnce();
+  EXPECT_TRUE(closed);
+  Mock::VerifyAndClearExpectations(transport_.get());
+}
+
 TEST_F(QuicServerWorkerTest, PacketAfterShutdown) {
   std::thread t([&] { eventbase_.loopForever(); });
   worker_->shutdownAllConnections(LocalErrorCode::SHUTTING_DOWN);
@@ -578,6 +652,179 @@ auto createInitialStream(
       pktHeaderType);
 }
 
+Buf createPaddedInitial(
+    ConnectionId srcConnId,
+    ConnectionId destConnId,
+    Buf token = nullptr) {
+  LongHeader header(
+      LongHeader::Types::Initial,
+      srcConnId,
+      destConnId,
+      1 /* packetNum */,
+      QuicVersion::MVFST,
+      std::move(token));
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen, std::move(header), 0 /* largestAcked */);
+  while (builder.remainingSpaceInPkt() > 0) {
+    writeFrame(PaddingFrame(), builder);
+  }
+  return packetToBuf(std::move(builder).buildPacket());
+}
+
+TEST_F(QuicServerWorkerTest, RetryWhenManyPendingHandshakes) {
+  TransportSettings settings;
+  settings.statelessResetTokenSecret = getRandSecret();
+  settings.retryTokenSecret = getRandSecret();
+  settings.retryPendingHandshakeThreshold = 1;
+  worker_->setTransportSettings(settings);
+  // Below the threshold connections are created right away.
+  createQuicConnection(kClientAddr, getTestConnectionId(hostId_));
+
+  folly::SocketAddress clientAddr2("2.3.4.5", 2345);
+  ConnectionId clientConnId({2, 4, 5, 6});
+  ConnectionId originalConnId({3, 4, 5, 6, 7, 8, 9, 10});
+  auto initial = createPaddedInitial(clientConnId, originalConnId);
+  ASSERT_GE(initial->computeChainDataLength(), kMinInitialPacketSize);
+
+  Buf retryToken;
+  folly::Optional<ConnectionId> retryConnId;
+  EXPECT_CALL(*factory_, _make(_, _, _, _)).Times(0);
+  EXPECT_CALL(*socketPtr_, write(clientAddr2, _))
+      .WillOnce(Invoke([&](const folly::SocketAddress&,
+                           const std::unique_ptr<folly::IOBuf>& buf) {
+        QuicReadCodec codec(QuicNodeType::Client);
+        AckStates ackStates;
+        auto packetQueue = bufToQueue(buf->clone());
+        auto codecResult = codec.parsePacket(packetQueue, ackStates);
+        auto quicPacket = boost::get<QuicPacket>(&codecResult);
+        auto regularPacket = boost::get<RegularQuicPacket>(quicPacket);
+        auto& header = boost::get<LongHeader>(regularPacket->header);
+        EXPECT_EQ(header.getHeaderType(), LongHeader::Types::Retry);
+        EXPECT_EQ(header.getDestinationConnId(), clientConnId);
+        EXPECT_EQ(*header.getOriginalDstConnId(), originalConnId);
+        retryConnId = header.getSourceConnId();
+        retryToken = header.getToken()->clone();
+        return buf->computeChainDataLength();
+      }));
+  RoutingData routingData(
+      HeaderForm::Long, true, true, originalConnId, clientConnId);
+  worker_->dispatchPacketData(
+      clientAddr2,
+      std::move(routingData),
+      NetworkData(initial->clone(), Clock::now()));
+  ASSERT_TRUE(retryConnId);
+  ASSERT_TRUE(retryToken);
+  EXPECT_EQ(worker_->getSrcToTransportMap().size(), 1);
+
+  // A token sent to another client address is not accepted.
+  auto spoofed = createPaddedInitial(
+      clientConnId, *retryConnId, retryToken->clone());
+  EXPECT_CALL(
+      *transportInfoCb_,
+      onPacketDropped(PacketDropReason::INVALID_RETRY_TOKEN));
+  RoutingData spoofedRoutingData(
+      HeaderForm::Long, true, true, *retryConnId, clientConnId);
+  worker_->dispatchPacketData(
+      folly::SocketAddress("3.4.5.6", 3456),
+      std::move(spoofedRoutingData),
+      NetworkData(spoofed->clone(), Clock::now()));
+  EXPECT_EQ(worker_->getSrcToTransportMap().size(), 1);
+
+  // The Initial that echoes the token creates the connection.
+  MockConnectionCallback connCb;
+  auto mockSock =
+      std::make_unique<folly::test::MockAsyncUDPSocket>(&eventbase_);
+  EXPECT_CALL(*mockSock, address()).WillRepeatedly(ReturnRef(fakeAddress_));
+  MockQuicTransport::Ptr transport2 = std::make_shared<MockQuicTransport>(
+      worker_->getEventBase(), std::move(mockSock), connCb, nullptr);
+  EXPECT_CALL(*transport2, getEventBase()).WillRepeatedly(Return(&eventbase_));
+  auto validated = createPaddedInitial(
+      clientConnId, *retryConnId, std::move(retryToken));
+  expectConnectionCreation(clientAddr2, *retryConnId, transport2);
+  EXPECT_CALL(*transport2, onNetworkData(clientAddr2, BufMatches(*validated)));
+  RoutingData validatedRoutingData(
+      HeaderForm::Long, true, true, *retryConnId, clientConnId);
+  worker_->dispatchPacketData(
+      clientAddr2,
+      std::move(validatedRoutingData),
+      NetworkData(validated->clone(), Clock::now()));
+  EXPECT_EQ(
+      worker_->getSrcToTransportMap().count(
+          std::make_pair(clientAddr2, clientConnId)),
+      1);
+  eventbase_.loop();
+
+  worker_->onConnectionUnbound(
+      std::make_pair(kClientAddr, getTestConnectionId(hostId_)), folly::none);
+  worker_->onConnectionUnbound(
+      std::make_pair(clientAddr2, clientConnId), folly::none);
+}
+
+TEST_F(QuicServerWorkerTest, OverloadLevelFollowsLoopTime) {
+  TransportSettings settings;
+  settings.statelessResetTokenSecret = getRandSecret();
+  settings.retryTokenSecret = getRandSecret();
+  settings.overloadRetryLoopTime = std::chrono::microseconds(1000);
+  settings.overloadRejectLoopTime = std::chrono::microseconds(2000);
+  settings.overloadDropLoopTime = std::chrono::microseconds(4000);
+  worker_->setTransportSettings(settings);
+  using OverloadLevel = QuicServerWorker::OverloadLevel;
+  EXPECT_EQ(worker_->getOverloadLevel(), OverloadLevel::NONE);
+
+  // The samples are smoothed, a single slow iteration only counts for an
+  // eighth.
+  worker_->onLoopSample(std::chrono::microseconds(8000));
+  EXPECT_EQ(worker_->getOverloadLevel(), OverloadLevel::RETRY);
+
+  folly::SocketAddress clientAddr2("2.3.4.5", 2345);
+  ConnectionId clientConnId({2, 4, 5, 6});
+  ConnectionId originalConnId({3, 4, 5, 6, 7, 8, 9, 10});
+  auto initial = createPaddedInitial(clientConnId, originalConnId);
+  EXPECT_CALL(*factory_, _make(_, _, _, _)).Times(0);
+  EXPECT_CALL(*transportInfoCb_, onRetrySent());
+  EXPECT_CALL(*socketPtr_, write(clientAddr2, _))
+      .WillOnce(Return(kDefaultUDPSendPacketLen));
+  RoutingData routingData(
+      HeaderForm::Long, true, true, originalConnId, clientConnId);
+  worker_->dispatchPacketData(
+      clientAddr2,
+      std::move(routingData),
+      NetworkData(initial->clone(), Clock::now()));
+  Mock::VerifyAndClearExpectations(socketPtr_);
+
+  worker_->onLoopSample(std::chrono::microseconds(16000));
+  EXPECT_EQ(worker_->getOverloadLevel(), OverloadLevel::REJECT);
+  EXPECT_CALL(*socketPtr_, write(clientAddr2, _))
+      .WillOnce(Invoke([&](const folly::SocketAddress&,
+                           const std::unique_ptr<folly::IOBuf>& buf) {
+        QuicReadCodec codec(QuicNodeType::Server);
+        AckStates ackStates;
+        auto packetQueue = bufToQueue(buf->clone());
+        auto codecResult = codec.parsePacket(packetQueue, ackStates);
+        auto quicPacket = boost::get<QuicPacket>(&codecResult);
+        auto versionPacket = boost::get<VersionNegotiationPacket>(quicPacket);
+        EXPECT_EQ(versionPacket->destinationConnectionId, clientConnId);
+        EXPECT_EQ(versionPacket->versions[0], QuicVersion::MVFST_INVALID);
+        return buf->computeChainDataLength();
+      }));
+  worker_->handleNetworkData(clientAddr2, initial->clone(), Clock::now());
+  Mock::VerifyAndClearExpectations(socketPtr_);
+
+  worker_->onLoopSample(std::chrono::microseconds(32000));
+  EXPECT_EQ(worker_->getOverloadLevel(), OverloadLevel::DROP);
+  EXPECT_CALL(*socketPtr_, write(_, _)).Times(0);
+  EXPECT_CALL(
+      *transportInfoCb_,
+      onPacketDropped(PacketDropReason::WORKER_OVERLOADED));
+  worker_->handleNetworkData(clientAddr2, initial->clone(), Clock::now());
+
+  for (int i = 0; i < 64; i++) {
+    worker_->onLoopSample(std::chrono::microseconds(0));
+  }
+  EXPECT_EQ(worker_->getOverloadLevel(), OverloadLevel::NONE);
+  eventbase_.loop();
+}
+
 std::unique_ptr<folly::IOBuf> writeTestDataOnWorkersBuf(
     ConnectionId srcConnId,
     ConnectionId destConnId,
@@ -912,6 +1159,58 @@ TEST_F(QuicServerWorkerTakeoverTest, QuicServerTakeoverProcessForwardedPkt) {
   writeSock.release();
 }
 
+TEST_F(QuicServerWorkerTakeoverTest, QuicServerTakeoverBatchedForwarding) {
+  ConnectionId connId = createConnIdForServer(ProcessId::ZERO),
+               clientConnId = getTestConnectionId(clientHostId_);
+  takeoverWorker_->setProcessId(ProcessId::ONE);
+  TransportSettings settings;
+  settings.batchTakeoverPackets = true;
+  takeoverWorker_->setTransportSettings(settings);
+  size_t len{0};
+  auto data = writeTestDataOnWorkersBuf(
+      clientConnId,
+      connId,
+      len,
+      takeoverWorker_.get(),
+      LongHeader::Types::Handshake);
+  takeoverWorker_->startPacketForwarding(folly::SocketAddress("0", 0));
+
+  auto writeSock = std::make_unique<folly::test::MockAsyncUDPSocket>(&evb_);
+  EXPECT_CALL(*takeoverSocketFactory_, _make(_, _))
+      .WillOnce(Return(writeSock.get()));
+  EXPECT_CALL(*writeSock, bind(_));
+  EXPECT_CALL(*writeSock, getNetworkSocket())
+      .WillRepeatedly(Return(folly::NetworkSocket()));
+  auto workerCb = [&](const folly::SocketAddress& client,
+                      std::unique_ptr<RoutingData>& routingData,
+                      std::unique_ptr<NetworkData>& networkData) {
+    takeoverWorker_->dispatchPacketData(
+        client, std::move(*routingData.get()), std::move(*networkData.get()));
+  };
+  EXPECT_CALL(*takeoverWorkerCb_, routeDataToWorkerLong(_, _, _))
+      .WillOnce(Invoke(workerCb));
+  EXPECT_CALL(*transportInfoCb_, onPacketReceived());
+  EXPECT_CALL(*transportInfoCb_, onRead(len));
+  EXPECT_CALL(*transportInfoCb_, onPacketForwarded()).Times(1);
+  // The packet is queued until the end of the loop iteration.
+  EXPECT_CALL(*writeSock, write(_, _)).Times(0);
+  takeoverWorker_->onDataAvailable(clientAddr, len, false);
+  Mock::VerifyAndClearExpectations(writeSock.get());
+
+  EXPECT_CALL(*writeSock, write(_, _))
+      .WillOnce(Invoke([&](const SocketAddress& /* unused */,
+                           const std::unique_ptr<folly::IOBuf>& writtenData) {
+        // the writtenData contains actual client address + time of ack + data
+        EXPECT_FALSE(eq(*data, *writtenData));
+        return writtenData->computeChainDataLength();
+      }));
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  takeoverWorker_->stopPacketForwarding();
+  // release this resource since MockQuicUDPSocketFactory::_make() hands its
+  // ownership to it's caller (i.e. QuicServerWorker)
+  writeSock.release();
+}
+
 TEST_F(QuicServerWorkerTakeoverTest, QuicServerTakeoverCbReadClose) {
   folly::AsyncUDPSocket::ReadCallback* takeoverCb =
       takeoverWorker_->getTakeoverHandlerCallback();
@@ -1487,6 +1786,23 @@ struct UDPReader : public folly::AsyncUDPSocket::ReadCallback {
   EventBase* evb_;
 };
 
+TEST_F(QuicServerTest, WorkerThreadsPinnedToCpus) {
+  server_->setWorkerCpus({0});
+  initializeServer({});
+  for (auto evb : server_->getWorkerEvbs()) {
+    evb->runInEventBaseThreadAndWait([] {
+#ifdef __linux__
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      ASSERT_EQ(
+          0, pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus));
+      EXPECT_EQ(1, CPU_COUNT(&cpus));
+      EXPECT_TRUE(CPU_ISSET(0, &cpus));
+#endif
+    });
+  }
+}
+
 TEST_F(QuicServerTest, NetworkTestVersionNegotiation) {
   folly::SocketAddress addr("::1", 0);
   server_->start(addr, 2);
@@ -1627,6 +1943,42 @@ TEST_F(QuicServerTest, NetworkTestHealthCheck) {
   EXPECT_THROW(reader->readOne().get(20ms), folly::FutureTimeout);
 }
 
+TEST_F(QuicServerTest, NetworkTestHealthCheckBatchedRecv) {
+  folly::SocketAddress addr("::1", 0);
+  std::string healthCheckToken = "health";
+  std::string notHealthCheckToken = "health2";
+
+  transportSettings_.shouldUseRecvmmsgForBatchRecv = true;
+  transportSettings_.maxRecvBatchSize = 4;
+  server_->setTransportSettings(transportSettings_);
+  server_->setHealthCheckToken(healthCheckToken);
+
+  server_->start(addr, 1);
+  server_->waitUntilInitialized();
+  auto serverAddr = server_->getAddress();
+
+  folly::SocketAddress addr2("::1", 0);
+
+  std::unique_ptr<UDPReader> reader = std::make_unique<UDPReader>();
+  reader->start(evbThread_.getEventBase(), addr2);
+
+  SCOPE_EXIT {
+    server_->shutdown();
+    evbThread_.getEventBase()->runInEventBaseThreadAndWait(
+        [&] { reader->getSocket().close(); });
+  };
+  // Queue up several datagrams back to back so that the worker can pick them
+  // up in a single wakeup. Only the last one expects a response.
+  auto response = reader->readOne();
+  for (int i = 0; i < 3; ++i) {
+    reader->getSocket().write(
+        serverAddr, IOBuf::copyBuffer(notHealthCheckToken));
+  }
+  reader->getSocket().write(serverAddr, IOBuf::copyBuffer(healthCheckToken));
+  auto serverData = std::move(response).get(1000ms);
+  EXPECT_EQ(serverData->moveToFbString().toStdString(), std::string("OK"));
+}
+
 void QuicServerTest::testReset(Buf packet) {
   folly::SocketAddress addr("::1", 0);
   server_->start(addr, 2);
@@ -21,8 +21,10 @@
 #include <quic/congestion_control/CongestionControllerFactory.h>
 #include <quic/handshake/FizzCryptoFactory.h>
 #include <quic/logging/FileQLogger.h>
+#include <quic/server/handshake/AppToken.h>
 #include <quic/server/handshake/ServerHandshake.h>
 #include <quic/server/test/Mocks.h>
+#include <quic/server/test/QuicServerTransportTestUtil.h>
 #include <quic/state/QuicStreamFunctions.h>
 
 #include <folly/io/async/test/MockAsyncUDPSocket.h>
@@ -37,149 +39,6 @@ namespace {
 using PacketDropReason = QuicTransportStatsCallback::PacketDropReason;
 } // namespace
 
-class FakeServerHandshake : public ServerHandshake {
- public:
-  explicit FakeServerHandshake(
-      QuicServerConnectionState& conn,
-      bool chloSync = false,
-      bool cfinSync = false)
-      : ServerHandshake(*conn.cryptoState),
-        conn_(conn),
-        chloSync_(chloSync),
-        cfinSync_(cfinSync) {}
-
-  void accept(std::shared_ptr<ServerTransportParametersExtension>) override {}
-
-  MOCK_METHOD1(writeNewSessionTicket, void(const AppToken&));
-
-  void doHandshake(std::unique_ptr<IOBuf> data, EncryptionLevel) override {
-    IOBufEqualTo eq;
-    auto chlo = folly::IOBuf::copyBuffer("CHLO");
-    auto clientFinished = IOBuf::copyBuffer("FINISHED");
-    if (eq(data, chlo)) {
-      if (chloSync_) {
-        // Do NOT invoke onCryptoEventAvailable callback
-        // Fall through and let the ServerStateMachine to process the event
-        writeDataToQuicStream(
-            *getCryptoStream(*conn_.cryptoState, EncryptionLevel::Initial),
-            IOBuf::copyBuffer("SHLO"));
-        if (allowZeroRttKeys_) {
-          validateAndUpdateSourceToken(conn_, sourceAddrs_);
-          phase_ = Phase::KeysDerived;
-          setEarlyKeys();
-        }
-        setHandshakeKeys();
-      } else {
-        // Asynchronously schedule the callback
-        executor_->add([&] {
-          writeDataToQuicStream(
-              *getCryptoStream(*conn_.cryptoState, EncryptionLevel::Initial),
-              IOBuf::copyBuffer("SHLO"));
-          if (allowZeroRttKeys_) {
-            validateAndUpdateSourceToken(conn_, sourceAddrs_);
-            phase_ = Phase::KeysDerived;
-            setEarlyKeys();
-          }
-          setHandshakeKeys();
-          if (callback_) {
-            callback_->onCryptoEventAvailable();
-          }
-        });
-      }
-    } else if (eq(data, clientFinished)) {
-      if (cfinSync_) {
-        // Do NOT invoke onCryptoEventAvailable callback
-        // Fall through and let the ServerStateMachine to process the event
-        setOneRttKeys();
-        phase_ = Phase::Established;
-        handshakeDone_ = true;
-      } else {
-        // Asynchronously schedule the callback
-        executor_->add([&] {
-          setOneRttKeys();
-          phase_ = Phase::Established;
-          handshakeDone_ = true;
-          if (callback_) {
-            callback_->onCryptoEventAvailable();
-          }
-        });
-      }
-    }
-  }
-
-  Optional<ClientTransportParameters> getClientTransportParams() override {
-    std::vector<TransportParameter> transportParams;
-    // TODO Split out into individual flow control parameters.
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_stream_data_bidi_local,
-        kDefaultStreamWindowSize));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_stream_data_bidi_remote,
-        kDefaultStreamWindowSize));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_stream_data_uni,
-        kDefaultStreamWindowSize));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_streams_bidi,
-        kDefaultMaxStreamsBidirectional));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_streams_uni,
-        kDefaultMaxStreamsUnidirectional));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::initial_max_data, kDefaultConnectionWindowSize));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::idle_timeout, kDefaultIdleTimeout.count()));
-    transportParams.push_back(encodeIntegerParameter(
-        TransportParameterId::max_packet_size, maxRecvPacketSize));
-    return ClientTransportParameters{QuicVersion::MVFST,
-                                     std::move(transportParams)};
-  }
-
-  void setEarlyKeys() {
-    oneRttWriteCipher_ = createNoOpAead();
-    oneRttWriteHeaderCipher_ = createNoOpHeaderCipher();
-    zeroRttReadCipher_ = createNoOpAead();
-    zeroRttReadHeaderCipher_ = createNoOpHeaderCipher();
-  }
-
-  void setOneRttKeys() {
-    // Mimic ServerHandshake behavior.
-    // oneRttWriteCipher would already be set during ReportEarlyHandshakeSuccess
-    if (!allowZeroRttKeys_) {
-      oneRttWriteCipher_ = createNoOpAead();
-      oneRttWriteHeaderCipher_ = createNoOpHeaderCipher();
-    }
-    oneRttReadCipher_ = createNoOpAead();
-    oneRttReadHeaderCipher_ = createNoOpHeaderCipher();
-  }
-
-  void setHandshakeKeys() {
-    handshakeWriteCipher_ = createNoOpAead();
-    handshakeWriteHeaderCipher_ = createNoOpHeaderCipher();
-    handshakeReadCipher_ = createNoOpAead();
-    handshakeReadHeaderCipher_ = createNoOpHeaderCipher();
-  }
-
-  void setHandshakeDone(bool done) {
-    handshakeDone_ = done;
-  }
-
-  void allowZeroRttKeys() {
-    allowZeroRttKeys_ = true;
-  }
-
-  void setSourceTokens(std::vector<folly::IPAddress> srcAddrs) {
-    sourceAddrs_ = srcAddrs;
-  }
-
-  QuicServerConnectionState& conn_;
-  bool chloSync_{false};
-  bool cfinSync_{false};
-  uint64_t maxRecvPacketSize{2 * 1024};
-  bool allowZeroRttKeys_{false};
-  std::vector<folly::IPAddress> sourceAddrs_;
-};
-
 template <class FrameType>
 bool verifyFramePresent(
     std::vector<std::unique_ptr<folly::IOBuf>>& socketWrites,
@@ -201,68 +60,6 @@ bool verifyFramePresent(
   return false;
 }
 
-class TestingQuicServerTransport : public QuicServerTransport {
- public:
-  TestingQuicServerTransport(
-      folly::EventBase* evb,
-      std::unique_ptr<folly::AsyncUDPSocket> sock,
-      ConnectionCallback& cb,
-      std::shared_ptr<const fizz::server::FizzServerContext> ctx)
-      : QuicServerTransport(evb, std::move(sock), cb, ctx) {}
-
-  const QuicServerConnectionState& getConn() const {
-    return *dynamic_cast<QuicServerConnectionState*>(conn_.get());
-  }
-
-  QuicServerConnectionState& getNonConstConn() {
-    return *dynamic_cast<QuicServerConnectionState*>(conn_.get());
-  }
-
-  AsyncUDPSocket& getSocket() {
-    return *socket_;
-  }
-
-  auto& idleTimeout() {
-    return idleTimeout_;
-  }
-
-  auto& drainTimeout() {
-    return drainTimeout_;
-  }
-
-  auto& ackTimeout() {
-    return ackTimeout_;
-  }
-
-  auto& lossTimeout() {
-    return lossTimeout_;
-  }
-
-  auto& pathValidationTimeout() {
-    return pathValidationTimeout_;
-  }
-
-  bool isClosed() {
-    return closeState_ == CloseState::CLOSED;
-  }
-
-  bool isDraining() {
-    return drainTimeout_.isScheduled();
-  }
-
-  void triggerCryptoEvent() {
-    onCryptoEventAvailable();
-  }
-
-  auto& writeLooper() {
-    return writeLooper_;
-  }
-
-  auto& readLooper() {
-    return readLooper_;
-  }
-};
-
 class QuicServerTransportTest : public Test {
  public:
   void SetUp() override {
@@ -559,6 +356,14 @@ class QuicServerTransportTest : public Test {
     evb.loopOnce(EVLOOP_NONBLOCK);
   }
 
+  // The state of the path the connection last migrated away from.
+  const CongestionAndRttState& lastCongestionAndRtt() {
+    const auto& states =
+        server->getConn().migrationState.previousCongestionAndRtt;
+    CHECK(!states.empty());
+    return states.back();
+  }
+
   Buf getCryptoStreamData() {
     CHECK(!serverWrites.empty());
     auto cryptoBuf = IOBuf::create(0);
@@ -750,6 +555,96 @@ TEST_F(QuicServerTransportTest, IdleTimerResetOnRecvNewData) {
   EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
 }
 
+TEST_F(QuicServerTransportTest, LastActivityTime) {
+  auto& conn = server->getNonConstConn();
+  auto received = Clock::now();
+  conn.ackStates.appDataAckState.largestRecvdPacketTime = received;
+  conn.lossState.lastRetransmittablePacketSentTime =
+      received - std::chrono::seconds(1);
+  EXPECT_EQ(received, server->getLastActivityTime());
+  auto sent = received + std::chrono::seconds(1);
+  conn.lossState.lastRetransmittablePacketSentTime = sent;
+  EXPECT_EQ(sent, server->getLastActivityTime());
+}
+
+TEST_F(QuicServerTransportTest, MoveToDedicatedSocket) {
+  server->getNonConstConn().transportSettings.dedicatedSocketMinBytesSent =
+      server->getConn().lossState.totalBytesSent + 1;
+  auto dedicatedSock = std::make_unique<folly::test::MockAsyncUDPSocket>(&evb);
+  std::vector<Buf> dedicatedWrites;
+  EXPECT_CALL(*dedicatedSock, write(_, _))
+      .WillRepeatedly(Invoke([&](const SocketAddress&,
+                                 const std::unique_ptr<folly::IOBuf>& buf) {
+        dedicatedWrites.push_back(buf->clone());
+        return buf->computeChainDataLength();
+      }));
+  EXPECT_CALL(*dedicatedSock, resumeRead(_));
+
+  // Not moved until the connection has sent enough.
+  EXPECT_CALL(routingCallback, _makeDedicatedSocket(_, _)).Times(0);
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  recvEncryptedStream(streamId, *IOBuf::copyBuffer("hello"));
+  Mock::VerifyAndClearExpectations(&routingCallback);
+
+  server->writeChain(streamId, IOBuf::copyBuffer("world"), false, false);
+  loopForWrites();
+  EXPECT_FALSE(serverWrites.empty());
+  EXPECT_CALL(routingCallback, _makeDedicatedSocket(clientAddr, _))
+      .WillOnce(Return(dedicatedSock.release()));
+  recvEncryptedStream(streamId, *IOBuf::copyBuffer("again"), 5);
+
+  serverWrites.clear();
+  server->writeChain(streamId, IOBuf::copyBuffer("data"), false, false);
+  loopForWrites();
+  EXPECT_TRUE(serverWrites.empty());
+  EXPECT_FALSE(dedicatedWrites.empty());
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
+TEST_F(QuicServerTransportTest, EcnValidationFailureReachesTheWorker) {
+  auto& conn = server->getNonConstConn();
+  conn.transportSettings.enableEcn = true;
+  conn.ecnState = QuicConnectionStateBase::EcnState::Failed;
+  EXPECT_CALL(routingCallback, onEcnValidationFailed()).Times(1);
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  recvEncryptedStream(streamId, *IOBuf::copyBuffer("hello"));
+  EXPECT_FALSE(conn.transportSettings.enableEcn);
+
+  // The worker is only told once.
+  recvEncryptedStream(streamId, *IOBuf::copyBuffer("world"), 5);
+  Mock::VerifyAndClearExpectations(&routingCallback);
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
+TEST_F(QuicServerTransportTest, MemoryUsageReachesTheWorker) {
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  recvEncryptedStream(streamId, *IOBuf::copyBuffer("hello"));
+  server->writeChain(streamId, IOBuf::copyBuffer("world"), false, false);
+  loopForWrites();
+  auto usage = server->getMemoryUsage().total();
+  EXPECT_GT(usage, 0);
+  EXPECT_EQ(usage, routingCallback.memoryUsage);
+
+  // An unbound connection no longer counts for the worker.
+  EXPECT_CALL(routingCallback, onConnectionUnbound(_, _)).Times(1);
+  server->unbindConnection();
+  EXPECT_EQ(0, routingCallback.memoryUsage);
+  server->setRoutingCallback(nullptr);
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
+TEST_F(QuicServerTransportTest, DisableEcn) {
+  auto& conn = server->getNonConstConn();
+  conn.transportSettings.enableEcn = true;
+  conn.ecnState = QuicConnectionStateBase::EcnState::Enabled;
+  server->disableEcn();
+  EXPECT_FALSE(conn.transportSettings.enableEcn);
+  EXPECT_EQ(QuicConnectionStateBase::EcnState::Disabled, conn.ecnState);
+}
+
 TEST_F(QuicServerTransportTest, IdleTimerNotResetOnDuplicatePacket) {
   EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
   StreamId streamId = server->createBidirectionalStream().value();
@@ -766,6 +661,54 @@ TEST_F(QuicServerTransportTest, IdleTimerNotResetOnDuplicatePacket) {
   EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
 }
 
+TEST_F(QuicServerTransportTest, PacketTrainResetsIdleTimerAtTheEnd) {
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  server->getNonConstConn().receivedNewPacketBeforeWrite = false;
+
+  server->idleTimeout().cancelTimeout();
+  ASSERT_FALSE(server->idleTimeout().isScheduled());
+  server->beginNetworkDataTrain();
+  auto first = IOBuf::copyBuffer("hello");
+  auto second = IOBuf::copyBuffer("world");
+  recvEncryptedStream(streamId, *first);
+  recvEncryptedStream(streamId, *second, first->computeChainDataLength());
+  // The frames are applied, the rest waits for the end of the train.
+  auto stream = server->getNonConstConn().streamManager->getStream(streamId);
+  EXPECT_EQ(
+      first->computeChainDataLength() + second->computeChainDataLength(),
+      stream->maxOffsetObserved);
+  EXPECT_FALSE(server->idleTimeout().isScheduled());
+  EXPECT_FALSE(server->getConn().receivedNewPacketBeforeWrite);
+
+  server->endNetworkDataTrain();
+  EXPECT_TRUE(server->idleTimeout().isScheduled());
+  EXPECT_TRUE(server->getConn().receivedNewPacketBeforeWrite);
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
+TEST_F(QuicServerTransportTest, PacketTrainWithBatchHeaderProtectionRemoval) {
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  server->getNonConstConn().transportSettings.batchHeaderProtectionRemoval =
+      true;
+
+  server->beginNetworkDataTrain();
+  auto first = IOBuf::copyBuffer("hello");
+  auto second = IOBuf::copyBuffer("world");
+  recvEncryptedStream(streamId, *first);
+  recvEncryptedStream(streamId, *second, first->computeChainDataLength());
+  // The packets are held until the end of the train.
+  auto stream = server->getNonConstConn().streamManager->getStream(streamId);
+  EXPECT_EQ(0, stream->maxOffsetObserved);
+
+  server->endNetworkDataTrain();
+  EXPECT_EQ(
+      first->computeChainDataLength() + second->computeChainDataLength(),
+      stream->maxOffsetObserved);
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
 TEST_F(QuicServerTransportTest, IdleTimerNotResetWhenDataOutstanding) {
   // Clear the receivedNewPacketBeforeWrite flag, since we may reveice from
   // client during the SetUp of the test case.
@@ -780,6 +723,25 @@ TEST_F(QuicServerTransportTest, IdleTimerNotResetWhenDataOutstanding) {
   ASSERT_FALSE(server->idleTimeout().isScheduled());
 }
 
+TEST_F(QuicServerTransportTest, IdleTimerRefreshedWithoutReschedule) {
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  ASSERT_TRUE(server->idleTimeout().isScheduled());
+  auto deadline = server->idleDeadline();
+
+  auto expected = IOBuf::copyBuffer("hello");
+  recvEncryptedStream(streamId, *expected);
+  ASSERT_TRUE(server->idleTimeout().isScheduled());
+  EXPECT_GE(server->idleDeadline(), deadline);
+
+  // The timeout firing before the deadline schedules it again.
+  server->idleTimeout().cancelTimeout();
+  server->idleTimeout().timeoutExpired();
+  EXPECT_FALSE(server->isClosed());
+  EXPECT_TRUE(server->idleTimeout().isScheduled());
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
 TEST_F(QuicServerTransportTest, TimeoutsNotSetAfterClose) {
   StreamId streamId = server->createBidirectionalStream().value();
 
@@ -806,6 +768,7 @@ TEST_F(QuicServerTransportTest, TimeoutsNotSetAfterClose) {
 }
 
 TEST_F(QuicServerTransportTest, IdleTimeoutExpired) {
+  server->idleDeadline() = Clock::now();
   server->idleTimeout().timeoutExpired();
 
   EXPECT_FALSE(server->idleTimeout().isScheduled());
@@ -819,6 +782,7 @@ TEST_F(QuicServerTransportTest, IdleTimeoutExpired) {
 }
 
 TEST_F(QuicServerTransportTest, RecvDataAfterIdleTimeout) {
+  server->idleDeadline() = Clock::now();
   server->idleTimeout().timeoutExpired();
 
   EXPECT_FALSE(server->idleTimeout().isScheduled());
@@ -2040,8 +2004,9 @@ TEST_F(QuicServerTransportTest, MigrateToUnvalidatedPeer) {
   EXPECT_TRUE(server->getConn().pendingEvents.pathChallenge);
   EXPECT_EQ(
       *server->getConn().writableBytesLimit,
-      server->getConn().transportSettings.limitedCwndInMss *
-          server->getConn().udpSendPacketLen);
+      server->getConn().lossState.totalBytesSent +
+          server->getConn().transportSettings.limitedCwndInMss *
+              server->getConn().udpSendPacketLen);
   EXPECT_EQ(server->getConn().peerAddress, newPeer);
   EXPECT_EQ(server->getConn().migrationState.previousPeerAddresses.size(), 1);
   EXPECT_EQ(
@@ -2052,17 +2017,12 @@ TEST_F(QuicServerTransportTest, MigrateToUnvalidatedPeer) {
   EXPECT_EQ(server->getConn().lossState.rttvar, 0us);
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
-  EXPECT_EQ(
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
 
   loopForWrites();
   EXPECT_FALSE(server->getConn().pendingEvents.pathChallenge);
@@ -2092,6 +2052,27 @@ TEST_F(QuicServerTransportTest, MigrateToUnvalidatedPeer) {
   EXPECT_FALSE(server->getConn().writableBytesLimit);
 }
 
+TEST_F(QuicServerTransportTest, AmplificationBlockedTimeEndsOnRecvPacket) {
+  EXPECT_CALL(*transportInfoCb_, onNewQuicStream()).Times(1);
+  StreamId streamId = server->createBidirectionalStream().value();
+  auto& conn = server->getNonConstConn();
+  conn.writableBytesLimit = conn.lossState.totalBytesSent;
+
+  server->writeChain(streamId, IOBuf::copyBuffer("hello"), false, false);
+  loopForWrites();
+  EXPECT_TRUE(isWritableBytesLimitReached(conn));
+  ASSERT_TRUE(conn.amplificationBlockedSince);
+
+  EXPECT_CALL(*transportInfoCb_, onAmplificationBlocked(_)).Times(1);
+  recvEncryptedStream(streamId, *IOBuf::copyBuffer("world"));
+  EXPECT_FALSE(conn.amplificationBlockedSince);
+  EXPECT_FALSE(isWritableBytesLimitReached(conn));
+  EXPECT_EQ(
+      server->getTransportInfo().amplificationBlockedTime,
+      conn.totalAmplificationBlockedTime);
+  EXPECT_CALL(*transportInfoCb_, onQuicStreamClosed());
+}
+
 TEST_F(QuicServerTransportTest, IgnoreInvalidPathResponse) {
   server->getNonConstConn().transportSettings.disableMigration = false;
   auto data = IOBuf::copyBuffer("bad data");
@@ -2114,8 +2095,9 @@ TEST_F(QuicServerTransportTest, IgnoreInvalidPathResponse) {
   EXPECT_TRUE(server->getConn().pendingEvents.pathChallenge);
   EXPECT_EQ(
       *server->getConn().writableBytesLimit,
-      server->getConn().transportSettings.limitedCwndInMss *
-          server->getConn().udpSendPacketLen);
+      server->getConn().lossState.totalBytesSent +
+          server->getConn().transportSettings.limitedCwndInMss *
+              server->getConn().udpSendPacketLen);
   EXPECT_EQ(server->getConn().peerAddress, newPeer);
   EXPECT_EQ(server->getConn().migrationState.previousPeerAddresses.size(), 1);
   EXPECT_EQ(
@@ -2173,8 +2155,9 @@ TEST_F(QuicServerTransportTest, ReceivePathResponseFromDifferentPeerAddress) {
   EXPECT_TRUE(server->getConn().pendingEvents.pathChallenge);
   EXPECT_EQ(
       *server->getConn().writableBytesLimit,
-      server->getConn().transportSettings.limitedCwndInMss *
-          server->getConn().udpSendPacketLen);
+      server->getConn().lossState.totalBytesSent +
+          server->getConn().transportSettings.limitedCwndInMss *
+              server->getConn().udpSendPacketLen);
   EXPECT_EQ(server->getConn().peerAddress, newPeer);
   EXPECT_EQ(server->getConn().migrationState.previousPeerAddresses.size(), 1);
   EXPECT_EQ(
@@ -2274,8 +2257,8 @@ TEST_F(QuicServerTransportTest, MigrateToValidatedPeer) {
   state.srtt = 1000us;
   state.lrtt = 2000us;
   state.rttvar = 3000us;
-  server->getNonConstConn().migrationState.lastCongestionAndRtt =
-      std::move(state);
+  server->getNonConstConn().migrationState.previousCongestionAndRtt.push_back(
+      std::move(state));
 
   auto data = IOBuf::copyBuffer("bad data");
   auto packetData = packetToBuf(createStreamPacket(
@@ -2291,12 +2274,10 @@ TEST_F(QuicServerTransportTest, MigrateToValidatedPeer) {
 
   auto peerAddress = server->getConn().peerAddress;
   auto lastCongestionController =
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get();
-  auto lastSrtt = server->getConn().migrationState.lastCongestionAndRtt->srtt;
-  auto lastLrtt = server->getConn().migrationState.lastCongestionAndRtt->lrtt;
-  auto lastRttvar =
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar;
+      lastCongestionAndRtt().congestionController.get();
+  auto lastSrtt = lastCongestionAndRtt().srtt;
+  auto lastLrtt = lastCongestionAndRtt().lrtt;
+  auto lastRttvar = lastCongestionAndRtt().rttvar;
   auto congestionController = server->getConn().congestionController.get();
   auto srtt = server->getConn().lossState.srtt;
   auto lrtt = server->getConn().lossState.lrtt;
@@ -2316,22 +2297,15 @@ TEST_F(QuicServerTransportTest, MigrateToValidatedPeer) {
   EXPECT_EQ(server->getConn().lossState.rttvar, lastRttvar);
   EXPECT_EQ(
       server->getConn().congestionController.get(), lastCongestionController);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
-  EXPECT_EQ(
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
 }
 
-TEST_F(
-    QuicServerTransportTest,
-    MigrateToUnvalidatedPeerOverwritesCachedRttState) {
+TEST_F(QuicServerTransportTest, MigrateToUnvalidatedPeerKeepsCachedRttState) {
   server->getNonConstConn().transportSettings.disableMigration = false;
   folly::SocketAddress newPeer("100.101.102.103", 23456);
   server->getNonConstConn().migrationState.previousPeerAddresses.push_back(
@@ -2345,8 +2319,8 @@ TEST_F(
   state.srtt = 1000us;
   state.lrtt = 2000us;
   state.rttvar = 3000us;
-  server->getNonConstConn().migrationState.lastCongestionAndRtt =
-      std::move(state);
+  server->getNonConstConn().migrationState.previousCongestionAndRtt.push_back(
+      std::move(state));
 
   auto data = IOBuf::copyBuffer("bad data");
   auto packetData = packetToBuf(createStreamPacket(
@@ -2383,17 +2357,110 @@ TEST_F(
   EXPECT_EQ(server->getConn().lossState.rttvar, 0us);
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
+  ASSERT_EQ(
+      server->getConn().migrationState.previousCongestionAndRtt.size(), 2);
   EXPECT_EQ(
       server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
+          .migrationState.previousCongestionAndRtt.front()
+          .peerAddress,
+      newPeer);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
+}
+
+TEST_F(QuicServerTransportTest, MigrateBackToEarlierValidatedPeer) {
+  // Wi-Fi to cellular and back, after another network in between.
+  server->getNonConstConn().transportSettings.disableMigration = false;
+  folly::SocketAddress wifiPeer("100.101.102.103", 23456);
+  folly::SocketAddress otherPeer("200.101.102.103", 2345);
+  std::vector<CongestionController*> cachedControllers;
+  for (const auto& peer : {wifiPeer, otherPeer}) {
+    server->getNonConstConn().migrationState.previousPeerAddresses.push_back(
+        peer);
+    CongestionAndRttState state;
+    state.peerAddress = peer;
+    state.recordTime = Clock::now();
+    state.congestionController = ccFactory_->makeCongestionController(
+        server->getNonConstConn(),
+        server->getConn().transportSettings.defaultCongestionController);
+    cachedControllers.push_back(state.congestionController.get());
+    state.srtt = 1000us;
+    state.lrtt = 2000us;
+    state.rttvar = 3000us;
+    server->getNonConstConn().migrationState.previousCongestionAndRtt.push_back(
+        std::move(state));
+  }
+  auto congestionController = server->getConn().congestionController.get();
+
+  auto data = IOBuf::copyBuffer("bad data");
+  auto packetData = packetToBuf(createStreamPacket(
+      *clientConnectionId,
+      *server->getConn().serverConnectionId,
+      clientNextAppDataPacketNum++,
+      2,
+      *data,
+      0 /* cipherOverhead */,
+      0 /* largestAcked */));
+  deliverData(std::move(packetData), false, &wifiPeer);
+
+  EXPECT_FALSE(server->getConn().pendingEvents.pathChallenge);
+  EXPECT_FALSE(server->getConn().writableBytesLimit);
+  EXPECT_EQ(server->getConn().peerAddress, wifiPeer);
+  EXPECT_EQ(server->getConn().congestionController.get(), cachedControllers[0]);
+  EXPECT_EQ(server->getConn().lossState.srtt, 1000us);
+  const auto& states =
+      server->getConn().migrationState.previousCongestionAndRtt;
+  ASSERT_EQ(states.size(), 2);
+  EXPECT_EQ(states.front().peerAddress, otherPeer);
+  EXPECT_EQ(states.front().congestionController.get(), cachedControllers[1]);
+  EXPECT_EQ(states.back().peerAddress, clientAddr);
+  EXPECT_EQ(states.back().congestionController.get(), congestionController);
+}
+
+TEST_F(QuicServerTransportTest, MigrateBackWhilePathValidationOutstanding) {
+  server->getNonConstConn().transportSettings.disableMigration = false;
+  auto data = IOBuf::copyBuffer("bad data");
+  auto congestionController = server->getConn().congestionController.get();
+
+  folly::SocketAddress newPeer("100.101.102.103", 23456);
+  deliverData(
+      packetToBuf(createStreamPacket(
+          *clientConnectionId,
+          *server->getConn().serverConnectionId,
+          clientNextAppDataPacketNum++,
+          2,
+          *data,
+          0 /* cipherOverhead */,
+          0 /* largestAcked */)),
+      false,
+      &newPeer);
+  // Data is sent to the new peer while its path is validated.
+  ASSERT_TRUE(server->getConn().writableBytesLimit);
+  EXPECT_GT(
+      *server->getConn().writableBytesLimit,
+      server->getConn().lossState.totalBytesSent);
+  EXPECT_TRUE(server->getConn().pendingEvents.pathChallenge);
+
+  deliverData(
+      packetToBuf(createStreamPacket(
+          *clientConnectionId,
+          *server->getConn().serverConnectionId,
+          clientNextAppDataPacketNum++,
+          2,
+          *data,
+          0 /* cipherOverhead */,
+          0 /* largestAcked */)),
+      false,
+      &clientAddr);
+  EXPECT_EQ(server->getConn().peerAddress, clientAddr);
+  EXPECT_FALSE(server->getConn().pendingEvents.pathChallenge);
+  EXPECT_FALSE(server->getConn().outstandingPathValidation);
+  EXPECT_FALSE(server->getConn().writableBytesLimit);
+  EXPECT_EQ(server->getConn().congestionController.get(), congestionController);
 }
 
 TEST_F(QuicServerTransportTest, MigrateToStaleValidatedPeer) {
@@ -2410,8 +2477,8 @@ TEST_F(QuicServerTransportTest, MigrateToStaleValidatedPeer) {
   state.srtt = 1000us;
   state.lrtt = 2000us;
   state.rttvar = 3000us;
-  server->getNonConstConn().migrationState.lastCongestionAndRtt =
-      std::move(state);
+  server->getNonConstConn().migrationState.previousCongestionAndRtt.push_back(
+      std::move(state));
 
   auto data = IOBuf::copyBuffer("bad data");
   auto packetData = packetToBuf(createStreamPacket(
@@ -2445,17 +2512,12 @@ TEST_F(QuicServerTransportTest, MigrateToStaleValidatedPeer) {
   EXPECT_EQ(server->getConn().lossState.rttvar, 0us);
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
-  EXPECT_EQ(
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
 }
 
 TEST_F(
@@ -2494,17 +2556,12 @@ TEST_F(
   EXPECT_EQ(server->getConn().lossState.rttvar, 0us);
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
-  EXPECT_EQ(
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
 
   auto packetData2 = packetToBuf(createStreamPacket(
       *clientConnectionId,
@@ -2529,17 +2586,12 @@ TEST_F(
   EXPECT_EQ(server->getConn().lossState.rttvar, 0us);
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
-  EXPECT_EQ(
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
 }
 
 TEST_F(
@@ -2578,17 +2630,12 @@ TEST_F(
   EXPECT_EQ(server->getConn().lossState.rttvar, 0us);
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().peerAddress, clientAddr);
   EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->peerAddress,
-      clientAddr);
-  EXPECT_EQ(
-      server->getConn()
-          .migrationState.lastCongestionAndRtt->congestionController.get(),
-      congestionController);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->srtt, srtt);
-  EXPECT_EQ(server->getConn().migrationState.lastCongestionAndRtt->lrtt, lrtt);
-  EXPECT_EQ(
-      server->getConn().migrationState.lastCongestionAndRtt->rttvar, rttvar);
+      lastCongestionAndRtt().congestionController.get(), congestionController);
+  EXPECT_EQ(lastCongestionAndRtt().srtt, srtt);
+  EXPECT_EQ(lastCongestionAndRtt().lrtt, lrtt);
+  EXPECT_EQ(lastCongestionAndRtt().rttvar, rttvar);
 
   auto packetData2 = packetToBuf(createStreamPacket(
       *clientConnectionId,
@@ -2608,7 +2655,8 @@ TEST_F(
   EXPECT_EQ(server->getConn().lossState.lrtt, lrtt);
   EXPECT_EQ(server->getConn().lossState.rttvar, rttvar);
   EXPECT_EQ(server->getConn().congestionController.get(), congestionController);
-  EXPECT_FALSE(server->getConn().migrationState.lastCongestionAndRtt);
+  EXPECT_TRUE(
+      server->getConn().migrationState.previousCongestionAndRtt.empty());
 }
 
 TEST_F(QuicServerTransportTest, ClientPortChangeNATRebinding) {
@@ -2640,7 +2688,8 @@ TEST_F(QuicServerTransportTest, ClientPortChangeNATRebinding) {
   EXPECT_NE(
       server->getConn().lossState.rttvar, std::chrono::microseconds::zero());
   EXPECT_EQ(server->getConn().congestionController.get(), congestionController);
-  EXPECT_FALSE(server->getConn().migrationState.lastCongestionAndRtt);
+  EXPECT_TRUE(
+      server->getConn().migrationState.previousCongestionAndRtt.empty());
 }
 
 TEST_F(QuicServerTransportTest, ClientAddressChangeNATRebinding) {
@@ -2669,7 +2718,8 @@ TEST_F(QuicServerTransportTest, ClientAddressChangeNATRebinding) {
   EXPECT_NE(server->getConn().lossState.lrtt, 0us);
   EXPECT_NE(server->getConn().lossState.rttvar, 0us);
   EXPECT_EQ(server->getConn().congestionController.get(), congestionController);
-  EXPECT_FALSE(server->getConn().migrationState.lastCongestionAndRtt);
+  EXPECT_TRUE(
+      server->getConn().migrationState.previousCongestionAndRtt.empty());
 }
 
 TEST_F(
@@ -2704,7 +2754,8 @@ TEST_F(
       server->getConn().lossState.rttvar, std::chrono::microseconds::zero());
   EXPECT_NE(server->getConn().congestionController.get(), nullptr);
   EXPECT_NE(server->getConn().congestionController.get(), congestionController);
-  EXPECT_TRUE(server->getConn().migrationState.lastCongestionAndRtt);
+  EXPECT_FALSE(
+      server->getConn().migrationState.previousCongestionAndRtt.empty());
 
   auto newCC = server->getConn().congestionController.get();
   folly::SocketAddress newPeer2("200.0.0.200", 12345);
@@ -2730,7 +2781,8 @@ TEST_F(
   EXPECT_EQ(
       server->getConn().lossState.rttvar, std::chrono::microseconds::zero());
   EXPECT_EQ(server->getConn().congestionController.get(), newCC);
-  EXPECT_TRUE(server->getConn().migrationState.lastCongestionAndRtt);
+  EXPECT_FALSE(
+      server->getConn().migrationState.previousCongestionAndRtt.empty());
 }
 
 class QuicUnencryptedServerTransportTest : public QuicServerTransportTest {
@@ -2863,7 +2915,10 @@ TEST_F(QuicUnencryptedServerTransportTest, TestPendingZeroRttData) {
         0 /* cipherOverhead */,
         0 /* largestAcked */,
         std::make_pair(LongHeader::Types::ZeroRtt, QuicVersion::MVFST)));
-    EXPECT_CALL(*transportInfoCb_, onPacketDropped(_));
+    // Buffered packets are not dropped.
+    EXPECT_CALL(
+        *transportInfoCb_, onPacketDropped(PacketDropReason::MAX_BUFFERED))
+        .Times(i < expectedPendingLen ? 0 : 1);
     deliverData(std::move(packetData));
   }
   EXPECT_EQ(server->getConn().streamManager->streamCount(), 0);
@@ -2874,6 +2929,46 @@ TEST_F(QuicUnencryptedServerTransportTest, TestPendingZeroRttData) {
   EXPECT_TRUE(server->getConn().pendingZeroRttData->empty());
 }
 
+TEST_F(QuicUnencryptedServerTransportTest, TestPendingDataPool) {
+  auto data = IOBuf::copyBuffer("bad data");
+  std::vector<Buf> packets;
+  for (size_t i = 0; i < 5; ++i) {
+    packets.push_back(packetToBuf(createStreamPacket(
+        *clientConnectionId,
+        server->getConn().serverConnectionId.value_or(getTestConnectionId(1)),
+        clientNextAppDataPacketNum++,
+        static_cast<StreamId>(i),
+        *data,
+        0 /* cipherOverhead */,
+        0 /* largestAcked */,
+        std::make_pair(LongHeader::Types::ZeroRtt, QuicVersion::MVFST))));
+  }
+  auto packetLen = packets[0]->computeChainDataLength();
+  // The pool is shared with the other connections of the worker and only has
+  // room for three of the packets.
+  PendingPacketPool pool(kPendingPacketSlabSize, 3 * packetLen);
+  server->setPendingPacketPool(&pool);
+  for (size_t i = 0; i < packets.size(); ++i) {
+    EXPECT_CALL(
+        *transportInfoCb_,
+        onPacketDropped(PacketDropReason::PENDING_PACKET_POOL_FULL))
+        .Times(i < 3 ? 0 : 1);
+    deliverData(std::move(packets[i]));
+  }
+  auto& pendingData = *server->getConn().pendingZeroRttData;
+  ASSERT_EQ(pendingData.size(), 3);
+  for (const auto& pendingPacket : pendingData) {
+    EXPECT_EQ(
+        pendingPacket.networkData.data->capacity(),
+        pendingPacket.networkData.data->length());
+  }
+  EXPECT_EQ(pool.getBufferedBytes(), 3 * packetLen);
+
+  server->getNonConstConn().pendingZeroRttData->clear();
+  EXPECT_EQ(pool.getBufferedBytes(), 0);
+  server->setPendingPacketPool(nullptr);
+}
+
 TEST_F(QuicUnencryptedServerTransportTest, TestPendingOneRttData) {
   recvClientHello();
   auto data = IOBuf::copyBuffer("bad data");
@@ -2889,7 +2984,10 @@ TEST_F(QuicUnencryptedServerTransportTest, TestPendingOneRttData) {
         *data,
         0 /* cipherOverhead */,
         0 /* largestAcked */));
-    EXPECT_CALL(*transportInfoCb_, onPacketDropped(_));
+    // Buffered packets are not dropped.
+    EXPECT_CALL(
+        *transportInfoCb_, onPacketDropped(PacketDropReason::MAX_BUFFERED))
+        .Times(i < expectedPendingLen ? 0 : 1);
     deliverData(std::move(packetData));
   }
   EXPECT_EQ(server->getConn().streamManager->streamCount(), 0);
@@ -3519,5 +3617,70 @@ TEST_P(
   }
   testSetupConnection();
 }
+
+class QuicServerTransportResumeCongestionStateTest
+    : public QuicServerTransportTest,
+      public WithParamInterface<bool> {
+ public:
+  void initializeServerHandshake() override {
+    QuicServerTransportTest::initializeServerHandshake();
+    auto& conn = server->getNonConstConn();
+    conn.transportSettings.resumeCongestionState = true;
+    AppToken appToken;
+    appToken.transportParams = createTicketTransportParameters(
+        conn.transportSettings.idleTimeout.count(),
+        conn.transportSettings.maxRecvPacketSize,
+        conn.transportSettings.advertisedInitialConnectionWindowSize,
+        conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize,
+        conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize,
+        conn.transportSettings.advertisedInitialUniStreamWindowSize,
+        conn.transportSettings.advertisedInitialMaxStreamsBidi,
+        conn.transportSettings.advertisedInitialMaxStreamsUni);
+    // The param is whether the ticket was issued to the client address.
+    appToken.sourceAddresses = {GetParam() ? clientAddr.getIPAddress()
+                                           : folly::IPAddress("1.2.3.5")};
+    appToken.version = QuicVersion::MVFST;
+    // 300 packets in flight at twice the min RTT, of which half is resumed.
+    appToken.congestionState = TicketCongestionState{
+        std::chrono::milliseconds(100),
+        std::chrono::milliseconds(50),
+        300 * kDefaultUDPSendPacketLen,
+        std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch())};
+    fakeHandshake->setResumedAppToken(encodeAppToken(appToken));
+  }
+};
+
+INSTANTIATE_TEST_CASE_P(
+    QuicServerTransportResumeCongestionStateTests,
+    QuicServerTransportResumeCongestionStateTest,
+    Values(true, false));
+
+TEST_P(QuicServerTransportResumeCongestionStateTest, ResumeWithoutEarlyData) {
+  auto& conn = server->getConn();
+  if (!GetParam()) {
+    EXPECT_EQ(conn.transportSettings.initCwndInMss, kInitCwndInMss);
+    EXPECT_EQ(
+        conn.congestionController->getCongestionWindow(),
+        kInitCwndInMss * conn.udpSendPacketLen);
+    return;
+  }
+  EXPECT_EQ(conn.transportSettings.initCwndInMss, 75);
+  EXPECT_EQ(conn.transportSettings.initialRtt, std::chrono::milliseconds(100));
+  EXPECT_EQ(
+      conn.congestionController->getCongestionWindow(),
+      75 * conn.udpSendPacketLen);
+  // The packets of the handshake that were in flight when the controller was
+  // replaced still count against its cwnd.
+  uint64_t bytesInFlight = 0;
+  for (const auto& packet : conn.outstandingPackets) {
+    if (!packet.pureAck) {
+      bytesInFlight += packet.encodedSize;
+    }
+  }
+  EXPECT_EQ(
+      conn.congestionController->getWritableBytes(),
+      75 * conn.udpSendPacketLen - bytesInFlight);
+}
 } // namespace test
 } // namespace quic
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <gmock/gmock.h>
+
+#include <quic/common/test/TestUtils.h>
+#include <quic/server/QuicServerTransport.h>
+#include <quic/server/handshake/ServerHandshake.h>
+#include <quic/state/QuicStreamFunctions.h>
+
+namespace quic {
+namespace test {
+
+/**
+ * A server handshake without crypto: "CHLO" in the initial crypto stream is
+ * answered with "SHLO" and the handshake keys, and "FINISHED" in the
+ * handshake crypto stream gives the 1-rtt keys. All the keys are no-op.
+ */
+class FakeServerHandshake : public ServerHandshake {
+ public:
+  explicit FakeServerHandshake(
+      QuicServerConnectionState& conn,
+      bool chloSync = false,
+      bool cfinSync = false)
+      : ServerHandshake(*conn.cryptoState),
+        conn_(conn),
+        chloSync_(chloSync),
+        cfinSync_(cfinSync) {}
+
+  void accept(std::shared_ptr<ServerTransportParametersExtension>) override {}
+
+  MOCK_METHOD1(writeNewSessionTicket, void(const AppToken&));
+
+  void doHandshake(std::unique_ptr<folly::IOBuf> data, EncryptionLevel)
+      override {
+    folly::IOBufEqualTo eq;
+    auto chlo = folly::IOBuf::copyBuffer("CHLO");
+    auto clientFinished = folly::IOBuf::copyBuffer("FINISHED");
+    if (eq(data, chlo)) {
+      if (chloSync_) {
+        // Do NOT invoke onCryptoEventAvailable callback
+        // Fall through and let the ServerStateMachine to process the event
+        writeDataToQuicStream(
+            *getCryptoStream(*conn_.cryptoState, EncryptionLevel::Initial),
+            folly::IOBuf::copyBuffer("SHLO"));
+        if (allowZeroRttKeys_) {
+          validateAndUpdateSourceToken(conn_, sourceAddrs_);
+          phase_ = Phase::KeysDerived;
+          setEarlyKeys();
+        }
+        setHandshakeKeys();
+      } else {
+        // Asynchronously schedule the callback
+        executor_->add([&] {
+          writeDataToQuicStream(
+              *getCryptoStream(*conn_.cryptoState, EncryptionLevel::Initial),
+              folly::IOBuf::copyBuffer("SHLO"));
+          if (allowZeroRttKeys_) {
+            validateAndUpdateSourceToken(conn_, sourceAddrs_);
+            phase_ = Phase::KeysDerived;
+            setEarlyKeys();
+          }
+          setHandshakeKeys();
+          if (callback_) {
+            callback_->onCryptoEventAvailable();
+          }
+        });
+      }
+    } else if (eq(data, clientFinished)) {
+      if (cfinSync_) {
+        // Do NOT invoke onCryptoEventAvailable callback
+        // Fall through and let the ServerStateMachine to process the event
+        setOneRttKeys();
+        phase_ = Phase::Established;
+        handshakeDone_ = true;
+      } else {
+        // Asynchronously schedule the callback
+        executor_->add([&] {
+          setOneRttKeys();
+          phase_ = Phase::Established;
+          handshakeDone_ = true;
+          if (callback_) {
+            callback_->onCryptoEventAvailable();
+          }
+        });
+      }
+    }
+  }
+
+  folly::Optional<ClientTransportParameters> getClientTransportParams()
+      override {
+    std::vector<TransportParameter> transportParams;
+    // TODO Split out into individual flow control parameters.
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_stream_data_bidi_local,
+        kDefaultStreamWindowSize));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_stream_data_bidi_remote,
+        kDefaultStreamWindowSize));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_stream_data_uni,
+        kDefaultStreamWindowSize));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_streams_bidi,
+        kDefaultMaxStreamsBidirectional));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_streams_uni,
+        kDefaultMaxStreamsUnidirectional));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::initial_max_data, kDefaultConnectionWindowSize));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::idle_timeout, kDefaultIdleTimeout.count()));
+    transportParams.push_back(encodeIntegerParameter(
+        TransportParameterId::max_packet_size, maxRecvPacketSize));
+    return ClientTransportParameters{QuicVersion::MVFST,
+                                     std::move(transportParams)};
+  }
+
+  void setEarlyKeys() {
+    oneRttWriteCipher_ = createNoOpAead();
+    oneRttWriteHeaderCipher_ = createNoOpHeaderCipher();
+    zeroRttReadCipher_ = createNoOpAead();
+    zeroRttReadHeaderCipher_ = createNoOpHeaderCipher();
+  }
+
+  void setOneRttKeys() {
+    // Mimic ServerHandshake behavior.
+    // oneRttWriteCipher would already be set during ReportEarlyHandshakeSuccess
+    if (!allowZeroRttKeys_) {
+      oneRttWriteCipher_ = createNoOpAead();
+      oneRttWriteHeaderCipher_ = createNoOpHeaderCipher();
+    }
+    oneRttReadCipher_ = createNoOpAead();
+    oneRttReadHeaderCipher_ = createNoOpHeaderCipher();
+  }
+
+  void setHandshakeKeys() {
+    handshakeWriteCipher_ = createNoOpAead();
+    handshakeWriteHeaderCipher_ = createNoOpHeaderCipher();
+    handshakeReadCipher_ = createNoOpAead();
+    handshakeReadHeaderCipher_ = createNoOpHeaderCipher();
+  }
+
+  void setHandshakeDone(bool done) {
+    handshakeDone_ = done;
+  }
+
+  void allowZeroRttKeys() {
+    allowZeroRttKeys_ = true;
+  }
+
+  void setSourceTokens(std::vector<folly::IPAddress> srcAddrs) {
+    sourceAddrs_ = srcAddrs;
+  }
+
+  const folly::IOBuf* getResumedAppToken() const override {
+    return resumedAppToken_.get();
+  }
+
+  void setResumedAppToken(Buf appToken) {
+    resumedAppToken_ = std::move(appToken);
+  }
+
+  QuicServerConnectionState& conn_;
+  bool chloSync_{false};
+  bool cfinSync_{false};
+  uint64_t maxRecvPacketSize{2 * 1024};
+  bool allowZeroRttKeys_{false};
+  std::vector<folly::IPAddress> sourceAddrs_;
+  Buf resumedAppToken_;
+};
+
+/**
+ * Gives the tests access to the state and the timers of the transport.
+ */
+class TestingQuicServerTransport : public QuicServerTransport {
+ public:
+  TestingQuicServerTransport(
+      folly::EventBase* evb,
+      std::unique_ptr<folly::AsyncUDPSocket> sock,
+      ConnectionCallback& cb,
+      std::shared_ptr<const fizz::server::FizzServerContext> ctx)
+      : QuicServerTransport(evb, std::move(sock), cb, ctx) {}
+
+  const QuicServerConnectionState& getConn() const {
+    return *dynamic_cast<QuicServerConnectionState*>(conn_.get());
+  }
+
+  QuicServerConnectionState& getNonConstConn() {
+    return *dynamic_cast<QuicServerConnectionState*>(conn_.get());
+  }
+
+  folly::AsyncUDPSocket& getSocket() {
+    return *socket_;
+  }
+
+  auto& idleTimeout() {
+    return idleTimeout_;
+  }
+
+  auto& idleDeadline() {
+    return idleDeadline_;
+  }
+
+  auto& drainTimeout() {
+    return drainTimeout_;
+  }
+
+  auto& ackTimeout() {
+    return ackTimeout_;
+  }
+
+  auto& lossTimeout() {
+    return lossTimeout_;
+  }
+
+  auto& pathValidationTimeout() {
+    return pathValidationTimeout_;
+  }
+
+  bool isClosed() {
+    return closeState_ == CloseState::CLOSED;
+  }
+
+  bool isDraining() {
+    return drainTimeout_.isScheduled();
+  }
+
+  void triggerCryptoEvent() {
+    onCryptoEventAvailable();
+  }
+
+  auto& writeLooper() {
+    return writeLooper_;
+  }
+
+  auto& readLooper() {
+    return readLooper_;
+  }
+};
+
+} // namespace test
+} // namespace quic
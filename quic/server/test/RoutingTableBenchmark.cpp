@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+/**
+ * Measures the lookup of the connection of a packet in the routing tables of
+ * a server worker with kNumConnections connections, the first thing done for
+ * every packet a worker reads. The connection ids are the ones
+ * DefaultConnectionIdAlgo makes and are looked up in random order, so that
+ * most lookups miss the caches as they do under load. The tables of the
+ * worker are compared with node-based maps hashed with FNV, which they used
+ * to be.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/Random.h>
+#include <folly/init/Init.h>
+#include <quic/codec/DefaultConnectionIdAlgo.h>
+#include <quic/server/QuicServerWorker.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr size_t kNumConnections = 1000000;
+
+struct FnvConnectionIdHash {
+  size_t operator()(const quic::ConnectionId& connId) const {
+    return folly::hash::fnv32_buf(connId.data(), connId.size());
+  }
+};
+
+using NodeConnIdMap = std::unordered_map<
+    quic::ConnectionId,
+    quic::QuicServerTransport::Ptr,
+    FnvConnectionIdHash>;
+
+std::vector<quic::ConnectionId> makeConnectionIds(size_t numIds) {
+  // The ids of one worker, random apart from their routing bits.
+  quic::DefaultConnectionIdAlgo connIdAlgo;
+  quic::ServerConnectionIdParams params(1, 1, 3);
+  std::vector<quic::ConnectionId> connIds;
+  connIds.reserve(numIds);
+  for (size_t i = 0; i < numIds; i++) {
+    connIds.push_back(connIdAlgo.encodeConnectionId(params));
+  }
+  return connIds;
+}
+
+const std::vector<quic::ConnectionId>& connectionIds() {
+  static const auto connIds = makeConnectionIds(kNumConnections);
+  return connIds;
+}
+
+// The ids in another order than the one they were inserted in.
+const std::vector<quic::ConnectionId>& shuffledConnectionIds() {
+  static const auto connIds = [] {
+    auto ids = connectionIds();
+    std::shuffle(ids.begin(), ids.end(), folly::ThreadLocalPRNG());
+    return ids;
+  }();
+  return connIds;
+}
+
+template <typename Map>
+const Map& routingTable() {
+  static const auto map = [] {
+    Map table;
+    table.reserve(kNumConnections);
+    for (const auto& connId : connectionIds()) {
+      table.emplace(connId, nullptr);
+    }
+    return table;
+  }();
+  return map;
+}
+
+template <typename Map>
+void lookUp(size_t iters, bool hit) {
+  const Map* table = nullptr;
+  std::vector<quic::ConnectionId> misses;
+  BENCHMARK_SUSPEND {
+    table = &routingTable<Map>();
+    if (!hit) {
+      misses = makeConnectionIds(1024);
+    }
+  }
+  const auto& connIds = hit ? shuffledConnectionIds() : misses;
+  size_t found = 0;
+  for (size_t i = 0; i < iters; i++) {
+    found += table->count(connIds[i % connIds.size()]);
+  }
+  folly::doNotOptimizeAway(found);
+}
+
+} // namespace
+
+BENCHMARK(NodeMapLookupHit, iters) {
+  lookUp<NodeConnIdMap>(iters, true);
+}
+
+BENCHMARK_RELATIVE(WorkerMapLookupHit, iters) {
+  lookUp<quic::QuicServerWorker::ConnIdToTransportMap>(iters, true);
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK(NodeMapLookupMiss, iters) {
+  lookUp<NodeConnIdMap>(iters, false);
+}
+
+BENCHMARK_RELATIVE(WorkerMapLookupMiss, iters) {
+  lookUp<quic::QuicServerWorker::ConnIdToTransportMap>(iters, false);
+}
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/SharedCongestionManager.h>
+
+#include <folly/portability/GMock.h>
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/server/state/ServerStateMachine.h>
+#include <quic/state/test/Mocks.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+class TestCongestionControllerFactory : public CongestionControllerFactory {
+ public:
+  std::unique_ptr<CongestionController> makeCongestionController(
+      QuicConnectionStateBase&,
+      CongestionControlType) override {
+    auto controller = std::make_unique<NiceMock<MockCongestionController>>();
+    controllers.push_back(controller.get());
+    return std::move(controller);
+  }
+
+  std::vector<MockCongestionController*> controllers;
+};
+
+class SharedCongestionManagerTest : public Test {
+ public:
+  void SetUp() override {
+    factory_ = std::make_shared<TestCongestionControllerFactory>();
+    manager_ = std::make_unique<SharedCongestionManager>(factory_);
+  }
+
+  // Makes the controller of a connection from the peer, with the window and
+  // writable bytes of its own controller.
+  std::unique_ptr<CongestionController> makeController(
+      QuicServerConnectionState& conn,
+      const std::string& peer,
+      uint64_t cwnd,
+      bool appLimited = false) {
+    conn.peerAddress = folly::SocketAddress(peer, 1234);
+    auto controller = manager_->makeCongestionController(
+        conn, CongestionControlType::Cubic);
+    auto mock = factory_->controllers.back();
+    ON_CALL(*mock, getCongestionWindow()).WillByDefault(Return(cwnd));
+    ON_CALL(*mock, getWritableBytes()).WillByDefault(Return(cwnd));
+    ON_CALL(*mock, isAppLimited()).WillByDefault(Return(appLimited));
+    return controller;
+  }
+
+ protected:
+  std::shared_ptr<TestCongestionControllerFactory> factory_;
+  std::unique_ptr<SharedCongestionManager> manager_;
+};
+
+TEST_F(SharedCongestionManagerTest, SubnetSharesWindow) {
+  QuicServerConnectionState conn1;
+  QuicServerConnectionState conn2;
+  auto controller1 = makeController(conn1, "1.2.3.4", 100000);
+  auto controller2 = makeController(conn2, "1.2.3.200", 40000);
+  ASSERT_NE(nullptr, manager_->getGroup(folly::IPAddress("1.2.3.4")));
+  EXPECT_EQ(
+      2, manager_->getGroup(folly::IPAddress("1.2.3.4"))->numMembers());
+
+  // The largest window is split between the two.
+  EXPECT_EQ(50000, controller1->getCongestionWindow());
+  EXPECT_EQ(40000, controller2->getCongestionWindow());
+
+  OutstandingPacket packet(
+      createNewPacket(0, PacketNumberSpace::AppData),
+      Clock::now(),
+      10000,
+      false,
+      false,
+      10000);
+  controller1->onPacketSent(packet);
+  EXPECT_EQ(40000, controller1->getWritableBytes());
+  EXPECT_EQ(40000, controller2->getWritableBytes());
+}
+
+TEST_F(SharedCongestionManagerTest, OtherSubnetNotShared) {
+  QuicServerConnectionState conn1;
+  QuicServerConnectionState conn2;
+  auto controller1 = makeController(conn1, "1.2.3.4", 100000);
+  auto controller2 = makeController(conn2, "5.6.7.8", 40000);
+  EXPECT_EQ(100000, controller1->getCongestionWindow());
+  EXPECT_EQ(40000, controller2->getCongestionWindow());
+}
+
+TEST_F(SharedCongestionManagerTest, AppLimitedMembersTakeNoShare) {
+  QuicServerConnectionState conn1;
+  QuicServerConnectionState conn2;
+  auto controller1 = makeController(conn1, "1.2.3.4", 100000);
+  auto controller2 = makeController(conn2, "1.2.3.5", 40000, true);
+  EXPECT_EQ(100000, controller1->getCongestionWindow());
+  EXPECT_EQ(40000, controller2->getCongestionWindow());
+}
+
+TEST_F(SharedCongestionManagerTest, ShareNotBelowMinCwnd) {
+  QuicServerConnectionState conn1;
+  QuicServerConnectionState conn2;
+  auto controller1 = makeController(conn1, "1.2.3.4", conn1.udpSendPacketLen);
+  auto controller2 = makeController(conn2, "1.2.3.5", conn2.udpSendPacketLen);
+  auto group = manager_->getGroup(folly::IPAddress("1.2.3.4"));
+  ASSERT_NE(nullptr, group);
+  EXPECT_EQ(
+      kMinCwndInMss * conn1.udpSendPacketLen,
+      group->getShare({&conn1, factory_->controllers[0]}));
+}
+
+TEST_F(SharedCongestionManagerTest, PacingRateOfShare) {
+  QuicServerConnectionState conn1;
+  QuicServerConnectionState conn2;
+  auto pacer = std::make_unique<NiceMock<MockPacer>>();
+  auto rawPacer = pacer.get();
+  conn1.pacer = std::move(pacer);
+  conn1.lossState.srtt = 50ms;
+  auto controller1 = makeController(conn1, "1.2.3.4", 100000);
+  auto controller2 = makeController(conn2, "1.2.3.5", 100000);
+  EXPECT_CALL(*rawPacer, refreshPacingRate(50000, 50ms));
+  controller1->onPacketAckOrLoss(folly::none, folly::none);
+}
+
+TEST_F(SharedCongestionManagerTest, GroupGoneWithConnections) {
+  QuicServerConnectionState conn1;
+  QuicServerConnectionState conn2;
+  auto controller1 = makeController(conn1, "1.2.3.4", 100000);
+  auto controller2 = makeController(conn2, "1.2.3.5", 40000);
+  controller1.reset();
+  EXPECT_EQ(40000, controller2->getCongestionWindow());
+  EXPECT_EQ(
+      1, manager_->getGroup(folly::IPAddress("1.2.3.4"))->numMembers());
+  controller2.reset();
+  EXPECT_EQ(nullptr, manager_->getGroup(folly::IPAddress("1.2.3.4")));
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/StatelessResponder.h>
+
+#include <folly/io/IOBuf.h>
+#include <folly/portability/GTest.h>
+#include <quic/codec/QuicPacketBuilder.h>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+namespace {
+StatelessResetSecret makeSecret() {
+  StatelessResetSecret secret;
+  secret.fill(0x42);
+  return secret;
+}
+} // namespace
+
+TEST(StatelessResponderTest, ResetPacket) {
+  StatelessResponder responder(0);
+  StatelessResetGenerator generator(makeSecret(), "1.2.3.4:443");
+  ConnectionId connId(std::vector<uint8_t>{1, 2, 3, 4, 5, 6, 7, 8});
+  auto packet = responder.buildResetPacket(generator, connId, 100);
+  ASSERT_EQ(100, packet->computeChainDataLength());
+  packet->coalesce();
+  EXPECT_EQ(ShortHeader::kFixedBitMask, packet->data()[0]);
+  auto token = generator.generateToken(connId);
+  EXPECT_EQ(
+      0,
+      memcmp(
+          packet->data() + packet->length() - token.size(),
+          token.data(),
+          token.size()));
+
+  // Two resets of the same connection id do not share their random bytes.
+  auto other = responder.buildResetPacket(generator, connId, 100);
+  other->coalesce();
+  EXPECT_NE(
+      0,
+      memcmp(
+          packet->data() + 1, other->data() + 1, 100 - token.size() - 1));
+}
+
+TEST(StatelessResponderTest, ResetTokenCache) {
+  StatelessResponder responder(0, 1);
+  StatelessResetGenerator generator(makeSecret(), "1.2.3.4:443");
+  StatelessResetGenerator otherGenerator(makeSecret(), "5.6.7.8:443");
+  ConnectionId connId(std::vector<uint8_t>{1, 2, 3, 4});
+  ConnectionId otherConnId(std::vector<uint8_t>{5, 6, 7, 8});
+  EXPECT_EQ(
+      generator.generateToken(connId),
+      responder.getResetToken(generator, connId));
+  // The cached token is returned for any generator.
+  EXPECT_EQ(
+      generator.generateToken(connId),
+      responder.getResetToken(otherGenerator, connId));
+  // Evicts the first entry.
+  EXPECT_EQ(
+      generator.generateToken(otherConnId),
+      responder.getResetToken(generator, otherConnId));
+  EXPECT_EQ(
+      otherGenerator.generateToken(connId),
+      responder.getResetToken(otherGenerator, connId));
+  responder.clearResetTokens();
+  EXPECT_EQ(
+      otherGenerator.generateToken(otherConnId),
+      responder.getResetToken(otherGenerator, otherConnId));
+}
+
+TEST(StatelessResponderTest, VersionNegotiationPacket) {
+  StatelessResponder responder(0);
+  ConnectionId srcConnId(std::vector<uint8_t>{1, 2, 3, 4, 5, 6, 7, 8});
+  ConnectionId dstConnId(std::vector<uint8_t>{9, 10, 11, 12});
+  std::vector<QuicVersion> versions{
+      QuicVersion::MVFST, QuicVersion::QUIC_DRAFT};
+  std::vector<QuicVersion> rejectVersions{QuicVersion::MVFST_INVALID};
+  folly::IOBufEqualTo eq;
+  for (int i = 0; i < 2; ++i) {
+    VersionNegotiationPacketBuilder builder(srcConnId, dstConnId, versions);
+    auto expected = std::move(builder).buildPacket().second;
+    EXPECT_TRUE(eq(
+        *expected,
+        *responder.buildVersionNegotiationPacket(
+            srcConnId, dstConnId, versions)));
+    VersionNegotiationPacketBuilder rejectBuilder(
+        srcConnId, dstConnId, rejectVersions);
+    auto expectedReject = std::move(rejectBuilder).buildPacket().second;
+    EXPECT_TRUE(eq(
+        *expectedReject,
+        *responder.buildVersionNegotiationPacket(
+            srcConnId, dstConnId, rejectVersions)));
+  }
+}
+
+TEST(StatelessResponderTest, RateLimit) {
+  StatelessResponder responder(2);
+  auto now = Clock::now();
+  EXPECT_TRUE(responder.allowResponse(now));
+  EXPECT_TRUE(responder.allowResponse(now));
+  EXPECT_FALSE(responder.allowResponse(now));
+  EXPECT_FALSE(responder.allowResponse(now + 100ms));
+  EXPECT_TRUE(responder.allowResponse(now + 600ms));
+  EXPECT_FALSE(responder.allowResponse(now + 600ms));
+  // The credit does not grow over a second worth of responses.
+  now += 10s;
+  EXPECT_TRUE(responder.allowResponse(now));
+  EXPECT_TRUE(responder.allowResponse(now));
+  EXPECT_FALSE(responder.allowResponse(now));
+}
+
+TEST(StatelessResponderTest, NoRateLimit) {
+  StatelessResponder responder(0);
+  auto now = Clock::now();
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(responder.allowResponse(now));
+  }
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/TransportStatsAggregator.h>
+
+#include <folly/portability/GTest.h>
+
+#include <limits>
+#include <thread>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+using PacketDropReason = QuicTransportStatsCallback::PacketDropReason;
+using FlushReason = QuicTransportStatsCallback::WriteBatchFlushReason;
+
+TEST(TransportStatsAggregatorTest, MergesWorkers) {
+  auto aggregator = std::make_shared<TransportStatsAggregator>();
+  TransportStatsAggregatorFactory factory(aggregator);
+  auto worker1 = factory.make(nullptr);
+  auto worker2 = factory.make(nullptr);
+
+  worker1->onPacketReceived();
+  worker1->onRead(1200);
+  worker1->onPacketDropped(PacketDropReason::PARSE_ERROR);
+  worker1->onRttSample(40ms);
+  worker2->onPacketReceived();
+  worker2->onRead(100);
+  worker2->onWriteBatch(16, 16 * 1200, FlushReason::MAX_BUFS);
+
+  auto workers = aggregator->getWorkerSnapshots();
+  ASSERT_EQ(2, workers.size());
+  EXPECT_EQ(1200, workers[0].get(TransportStatsCounter::BYTES_READ));
+  EXPECT_EQ(100, workers[1].get(TransportStatsCounter::BYTES_READ));
+
+  auto snapshot = aggregator->getSnapshot();
+  EXPECT_EQ(2, snapshot.get(TransportStatsCounter::PACKETS_RECEIVED));
+  EXPECT_EQ(1300, snapshot.get(TransportStatsCounter::BYTES_READ));
+  EXPECT_EQ(1, snapshot.get(TransportStatsCounter::PACKETS_DROPPED));
+  EXPECT_EQ(1, snapshot.get(PacketDropReason::PARSE_ERROR));
+  EXPECT_EQ(0, snapshot.get(PacketDropReason::DECRYPTION_ERROR));
+
+  const auto& reads = snapshot.get(TransportStatsDistribution::READ_BYTES);
+  EXPECT_EQ(2, reads.count);
+  EXPECT_EQ(1300, reads.sum);
+  EXPECT_EQ(1, reads.buckets[TransportStatsHistogram::bucketOf(100)]);
+  EXPECT_EQ(1, reads.buckets[TransportStatsHistogram::bucketOf(1200)]);
+  EXPECT_EQ(40000, snapshot.get(TransportStatsDistribution::RTT_US).sum);
+  EXPECT_EQ(
+      1, snapshot.get(TransportStatsDistribution::WRITE_BATCH_PACKETS).count);
+  const auto& batchBytes =
+      snapshot.get(TransportStatsDistribution::WRITE_BATCH_BYTES);
+  EXPECT_EQ(16 * 1200, batchBytes.sum);
+  EXPECT_EQ(1, snapshot.get(FlushReason::MAX_BUFS));
+  EXPECT_EQ(0, snapshot.get(FlushReason::SIZE_MISMATCH));
+
+  // The snapshots outlive the callbacks.
+  worker1.reset();
+  worker2.reset();
+  auto after = aggregator->getSnapshot();
+  EXPECT_EQ(2, after.get(TransportStatsCounter::PACKETS_RECEIVED));
+}
+
+TEST(TransportStatsAggregatorTest, HistogramPercentile) {
+  EXPECT_EQ(0, TransportStatsHistogram::bucketOf(0));
+  EXPECT_EQ(1, TransportStatsHistogram::bucketOf(1));
+  EXPECT_EQ(11, TransportStatsHistogram::bucketOf(1200));
+  EXPECT_EQ(
+      kTransportStatsHistogramBuckets - 1,
+      TransportStatsHistogram::bucketOf(std::numeric_limits<uint64_t>::max()));
+
+  TransportStatsHistogram histogram;
+  EXPECT_EQ(0, histogram.percentile(50));
+  // 90 small values and 10 large ones
+  histogram.buckets[TransportStatsHistogram::bucketOf(100)] = 90;
+  histogram.buckets[TransportStatsHistogram::bucketOf(5000)] = 10;
+  EXPECT_EQ(127, histogram.percentile(50));
+  EXPECT_EQ(127, histogram.percentile(90));
+  EXPECT_EQ(8191, histogram.percentile(99));
+  EXPECT_EQ(8191, histogram.percentile(100));
+}
+
+TEST(TransportStatsAggregatorTest, SnapshotWhileWorkersWrite) {
+  auto aggregator = std::make_shared<TransportStatsAggregator>();
+  constexpr size_t kNumWorkers = 4;
+  constexpr uint64_t kNumPackets = 10000;
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < kNumWorkers; i++) {
+    workers.emplace_back([stats = aggregator->makeWorkerStats()] {
+      for (uint64_t packet = 0; packet < kNumPackets; packet++) {
+        stats->onPacketSent();
+        stats->onWrite(1000);
+      }
+    });
+  }
+  uint64_t lastSent = 0;
+  for (size_t i = 0; i < 100; i++) {
+    auto sent =
+        aggregator->getSnapshot().get(TransportStatsCounter::PACKETS_SENT);
+    EXPECT_GE(sent, lastSent);
+    lastSent = sent;
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  auto snapshot = aggregator->getSnapshot();
+  EXPECT_EQ(
+      kNumWorkers * kNumPackets,
+      snapshot.get(TransportStatsCounter::PACKETS_SENT));
+  EXPECT_EQ(
+      kNumWorkers * kNumPackets * 1000,
+      snapshot.get(TransportStatsCounter::BYTES_WRITTEN));
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/server/WriteBudgetScheduler.h>
+
+#include <folly/portability/GTest.h>
+
+#include <thread>
+
+using namespace testing;
+using namespace std::chrono_literals;
+
+namespace quic {
+namespace test {
+
+class WriteBudgetSchedulerTest : public Test {
+ protected:
+  void write(
+      uint64_t cwndPackets,
+      uint64_t expectedLimit,
+      ConnectionWriteShare share = ConnectionWriteShare()) {
+    auto limit = scheduler_.getPacketLimit(share, cwndPackets);
+    EXPECT_EQ(expectedLimit, limit);
+    scheduler_.onPacketsWritten(std::min(limit, cwndPackets));
+  }
+
+  void writeAll(size_t connections) {
+    ConnectionWriteShare share;
+    for (size_t i = 0; i < connections; ++i) {
+      scheduler_.getPacketLimit(share, 0);
+    }
+  }
+
+  folly::EventBase evb_;
+  WriteBudgetScheduler scheduler_{&evb_, 100, 0us, 5};
+};
+
+TEST_F(WriteBudgetSchedulerTest, SingleConnectionGetsTheBudget) {
+  write(1000, 100);
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(1, scheduler_.getActiveWeight());
+  write(1000, 100);
+}
+
+TEST_F(WriteBudgetSchedulerTest, SplitAmongActiveConnections) {
+  writeAll(4);
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(4, scheduler_.getActiveWeight());
+  write(1000, 25);
+  write(1000, 25);
+  write(1000, 25);
+  write(1000, 25);
+}
+
+TEST_F(WriteBudgetSchedulerTest, UnusedShareGoesToTheNext) {
+  writeAll(4);
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  // Limited by its window, the first leaves 90 packets for the other three.
+  write(10, 10);
+  write(1000, 30);
+  write(1000, 30);
+  write(1000, 30);
+}
+
+TEST_F(WriteBudgetSchedulerTest, NeverBelowTheMinimum) {
+  write(0, 5);
+  write(1000, 100);
+  write(1000, 5);
+}
+
+TEST_F(WriteBudgetSchedulerTest, SplitByWeight) {
+  ConnectionWriteShare heavy;
+  heavy.weight = 3;
+  write(0, 5, heavy);
+  writeAll(1);
+  evb_.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(4, scheduler_.getActiveWeight());
+  write(1000, 75, heavy);
+  write(1000, 25);
+}
+
+TEST(WriteBudgetSchedulerTimeTest, TimeBudget) {
+  folly::EventBase evb;
+  WriteBudgetScheduler scheduler(&evb, 100, 1ms, 5);
+  ConnectionWriteShare share;
+  for (int i = 0; i < 2; ++i) {
+    scheduler.getPacketLimit(share, 0);
+  }
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(50, scheduler.getPacketLimit(share, 1000));
+  std::this_thread::sleep_for(2ms);
+  EXPECT_EQ(5, scheduler.getPacketLimit(share, 1000));
+}
+
+TEST(WriteBudgetSchedulerTimeTest, BulkWaitsForTheNextLoop) {
+  folly::EventBase evb;
+  WriteBudgetScheduler scheduler(&evb, 100, 1ms, 5);
+  ConnectionWriteShare interactive;
+  ConnectionWriteShare bulk;
+  bulk.bulk = true;
+  EXPECT_EQ(100, scheduler.getPacketLimit(bulk, 1000));
+  std::this_thread::sleep_for(2ms);
+  EXPECT_EQ(5, scheduler.getPacketLimit(interactive, 1000));
+  EXPECT_EQ(0, scheduler.getPacketLimit(bulk, 1000));
+  EXPECT_TRUE(bulk.deferred);
+  evb.loopOnce(EVLOOP_NONBLOCK);
+
+  // Over the time budget again, but it waited in the last loop.
+  scheduler.getPacketLimit(interactive, 1000);
+  std::this_thread::sleep_for(2ms);
+  EXPECT_EQ(5, scheduler.getPacketLimit(bulk, 1000));
+  EXPECT_FALSE(bulk.deferred);
+}
+
+} // namespace test
+} // namespace quic
@@ -11,10 +11,121 @@
 #include <folly/Overload.h>
 #include <quic/logging/QuicLogger.h>
 #include <quic/loss/QuicLossFunctions.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/PathMtuDiscovery.h>
 #include <quic/state/QuicStateFunctions.h>
 
 namespace quic {
 
+namespace {
+/**
+ * Validates the ECN counts of an ack against the ECT marked packets it newly
+ * acks, and returns the number of packets it newly reports as CE
+ * marked. ECN fails on the connection if the counts are missing, decrease, or
+ * do not account for all the marked packets.
+ */
+uint64_t processEcnCounts(
+    QuicConnectionStateBase& conn,
+    AckState& ackState,
+    const ReadAckFrame& frame,
+    uint64_t ecnMarkedPacketsAcked) {
+  // Reordered acks may carry smaller counts, only the ones that increase the
+  // largest acked packet are validated.
+  if (ackState.peerEcnLargestAcked &&
+      frame.largestAcked <= *ackState.peerEcnLargestAcked) {
+    return 0;
+  }
+  const auto& prevCounts = ackState.peerEcnCounts;
+  bool valid;
+  if (!frame.ecnCounts) {
+    valid = ecnMarkedPacketsAcked == 0;
+  } else {
+    const auto& counts = *frame.ecnCounts;
+    // Nothing is sent with the other ECT codepoint.
+    bool ect1 = conn.ecnMarking == EcnCodepoint::Ect1;
+    uint64_t marked = ect1 ? counts.ect1 : counts.ect0;
+    uint64_t prevMarked = ect1 ? prevCounts.ect1 : prevCounts.ect0;
+    uint64_t other = ect1 ? counts.ect0 : counts.ect1;
+    uint64_t prevOther = ect1 ? prevCounts.ect0 : prevCounts.ect1;
+    valid = marked >= prevMarked && counts.ce >= prevCounts.ce &&
+        other == prevOther &&
+        (marked - prevMarked) + (counts.ce - prevCounts.ce) >=
+            ecnMarkedPacketsAcked;
+  }
+  if (!valid) {
+    VLOG(4) << __func__ << " ECN validation failed " << conn;
+    conn.ecnState = QuicConnectionStateBase::EcnState::Failed;
+    return 0;
+  }
+  if (!frame.ecnCounts) {
+    return 0;
+  }
+  uint64_t ceMarked = frame.ecnCounts->ce - prevCounts.ce;
+  ackState.peerEcnCounts = *frame.ecnCounts;
+  ackState.peerEcnLargestAcked = frame.largestAcked;
+  return ceMarked;
+}
+
+/**
+ * Finds the recently lost packets that the ack reports as received. Each one
+ * widens the reordering window enough for its reordering to be tolerated
+ * next time, and is passed to the congestion controller to undo its loss.
+ * Packets are only remembered for a few RTTs after their loss, a reordered
+ * packet is acked well before then.
+ */
+void detectSpuriousLosses(
+    QuicConnectionStateBase& conn,
+    PacketNumberSpace pnSpace,
+    const ReadAckFrame& frame,
+    TimePoint ackReceiveTime) {
+  auto& lossState = conn.lossState;
+  auto lifetime = std::max(lossState.srtt, lossState.lrtt) *
+      kRecentlyLostPacketLifetimeRtts;
+  while (!lossState.recentlyLostPackets.empty() &&
+         lossState.recentlyLostPackets.front().lossTime + lifetime <
+             ackReceiveTime) {
+    lossState.recentlyLostPackets.pop_front();
+  }
+  bool spuriousLoss = false;
+  auto lostPacketIt = lossState.recentlyLostPackets.begin();
+  while (lostPacketIt != lossState.recentlyLostPackets.end()) {
+    auto packetNum = lostPacketIt->packetNum;
+    bool acked = lostPacketIt->pnSpace == pnSpace &&
+        std::any_of(frame.ackBlocks.begin(),
+                    frame.ackBlocks.end(),
+                    [packetNum](const auto& ackBlock) {
+                      return ackBlock.startPacket <= packetNum &&
+                          packetNum <= ackBlock.endPacket;
+                    });
+    if (!acked) {
+      lostPacketIt++;
+      continue;
+    }
+    VLOG(10) << __func__ << " spurious loss packetNum=" << packetNum
+             << " space=" << pnSpace << " " << conn;
+    spuriousLoss = true;
+    ++lossState.spuriousLossCount;
+    QUIC_STATS(conn.infoCallback, onSpuriousLoss);
+    lossState.reorderingThreshold = std::max(
+        lossState.reorderingThreshold,
+        static_cast<uint32_t>(std::min<PacketNum>(
+            lostPacketIt->reorderingDistance, kMaxReorderingThreshold)));
+    if (conn.congestionController) {
+      conn.congestionController->onSpuriousLoss(lostPacketIt->lossTime);
+    }
+    lostPacketIt = lossState.recentlyLostPackets.erase(lostPacketIt);
+  }
+  if (spuriousLoss) {
+    // The time window grows by an eighth of the RTT per ack that shows
+    // spurious losses rather than per packet, as losses come in bursts.
+    lossState.reorderingWindowMult =
+        std::min<uint8_t>(lossState.reorderingWindowMult + 1,
+                          kMaxReorderingWindowMult);
+    lossState.lossEventsSinceWindowWidened = 0;
+  }
+}
+} // namespace
+
 void processAckFrame(
     QuicConnectionStateBase& conn,
     PacketNumberSpace pnSpace,
@@ -27,23 +138,28 @@ void processAckFrame(
   // TODO: send error if we get an ack for a packet we've not sent t18721184
   CongestionController::AckEvent ack;
   ack.ackTime = ackReceiveTime;
-  auto currentPacketItStart = getFirstOutstandingPacket(conn, pnSpace);
   uint64_t handshakePacketAcked = 0;
   uint64_t pureAckPacketsAcked = 0;
   uint64_t clonedPacketsAcked = 0;
+  uint64_t ecnMarkedPacketsAcked = 0;
+  // Only the packet numbers in this range can still be outstanding.
+  auto outstandingRange = conn.outstandingPackets.packetNumRange(pnSpace);
+  // Size the acked packets once for the most packets this ack may remove,
+  // rather than growing the vector while collecting them.
+  uint64_t maxPacketsAcked = 0;
+  for (const auto& ackBlock : frame.ackBlocks) {
+    auto first = std::max(ackBlock.startPacket, outstandingRange.first);
+    auto last = std::min(ackBlock.endPacket + 1, outstandingRange.second);
+    if (first < last) {
+      maxPacketsAcked += last - first;
+    }
+  }
+  ack.ackedPackets.reserve(std::min<uint64_t>(
+      maxPacketsAcked, conn.outstandingPackets.size()));
   for (auto ackBlockIt = frame.ackBlocks.crbegin();
        ackBlockIt != frame.ackBlocks.crend();
        ackBlockIt++) {
-    auto packetIt = std::lower_bound(
-        currentPacketItStart,
-        conn.outstandingPackets.end(),
-        ackBlockIt->startPacket,
-        [&](const auto& packetWithTime, const auto& val) {
-          return folly::variant_match(
-              packetWithTime.packet.header,
-              [&val](const auto& h) { return h.getPacketSequenceNum() < val; });
-        });
-    if (packetIt == conn.outstandingPackets.end()) {
+    if (ackBlockIt->startPacket >= outstandingRange.second) {
       // This means that all the packets are less than the start packet.
       // Since we iterate the ACK blocks in order of start packets, our work
       // here is done.
@@ -58,79 +174,81 @@ void processAckFrame(
 
     // TODO: only process ACKs from packets which are sent from a greater than
     // or equal to crypto protection level.
-    auto packetItEnd = packetIt;
-    while (packetItEnd != conn.outstandingPackets.end()) {
-      auto currentPacketNum = folly::variant_match(
-          packetItEnd->packet.header,
-          [](const auto& h) { return h.getPacketSequenceNum(); });
-      auto currentPacketNumberSpace = folly::variant_match(
-          packetItEnd->packet.header,
-          [](const auto& h) { return h.getPacketNumberSpace(); });
-      if (pnSpace != currentPacketNumberSpace) {
-        packetItEnd++;
+    auto firstPacketNum =
+        std::max(ackBlockIt->startPacket, outstandingRange.first);
+    auto lastPacketNum =
+        std::min(ackBlockIt->endPacket + 1, outstandingRange.second);
+    // Skip straight to the packets of the block that are still outstanding,
+    // so that the packets already acked or lost cost next to nothing.
+    for (auto currentPacketNum =
+             conn.outstandingPackets.nextPacketNum(pnSpace, firstPacketNum);
+         currentPacketNum < lastPacketNum;
+         currentPacketNum = conn.outstandingPackets.nextPacketNum(
+             pnSpace, currentPacketNum + 1)) {
+      auto packetIt = conn.outstandingPackets.find(pnSpace, currentPacketNum);
+      if (packetIt == conn.outstandingPackets.end()) {
         continue;
       }
-      if (currentPacketNum > ackBlockIt->endPacket) {
-        break;
-      }
       VLOG(10) << __func__ << " acked packetNum=" << currentPacketNum
-               << " space=" << currentPacketNumberSpace
-               << " handshake=" << (int)packetItEnd->isHandshake
-               << " pureAck=" << (int)packetItEnd->pureAck << " " << conn;
-      if (packetItEnd->isHandshake) {
+               << " space=" << pnSpace
+               << " handshake=" << (int)packetIt->isHandshake
+               << " pureAck=" << (int)packetIt->pureAck << " " << conn;
+      if (packetIt->isHandshake) {
         ++handshakePacketAcked;
       }
-      if (!packetItEnd->pureAck) {
-        ack.ackedBytes += packetItEnd->encodedSize;
-      } else {
+      if (packetIt->pureAck) {
         ++pureAckPacketsAcked;
+      } else if (!packetIt->isPathMtuProbe) {
+        ack.ackedBytes += packetIt->encodedSize;
+      }
+      if (conn.pathMtuState.phase !=
+          QuicConnectionStateBase::PathMtuState::Phase::Disabled) {
+        onPathMtuPacketAcked(conn, *packetIt, ackReceiveTime);
       }
-      if (packetItEnd->associatedEvent) {
+      if (packetIt->associatedEvent) {
         ++clonedPacketsAcked;
       }
+      if (packetIt->ecnMarked) {
+        ++ecnMarkedPacketsAcked;
+      }
       // Update RTT if current packet is the largestAcked in the frame:
       auto ackReceiveTimeOrNow =
-          ackReceiveTime > packetItEnd->time ? ackReceiveTime : Clock::now();
+          ackReceiveTime > packetIt->time ? ackReceiveTime : Clock::now();
       auto rttSample = std::chrono::duration_cast<std::chrono::microseconds>(
-          ackReceiveTimeOrNow - packetItEnd->time);
-      if (currentPacketNum == frame.largestAcked && !packetItEnd->pureAck) {
+          ackReceiveTimeOrNow - packetIt->time);
+      if (currentPacketNum == frame.largestAcked && !packetIt->pureAck) {
         updateRtt(conn, rttSample, frame.ackDelay);
       }
       if (conn.qLogger) {
-        conn.qLogger->addPacketAck(currentPacketNumberSpace, currentPacketNum);
+        conn.qLogger->addPacketAck(pnSpace, currentPacketNum);
       }
-      QUIC_TRACE(
-          packet_acked,
-          conn,
-          toString(currentPacketNumberSpace),
-          currentPacketNum);
+      QUIC_TRACE(packet_acked, conn, toString(pnSpace), currentPacketNum);
       // Only invoke AckVisitor if the packet doesn't have an associated
       // PacketEvent; or the PacketEvent is in conn.outstandingPacketEvents
-      if (!packetItEnd->associatedEvent ||
-          conn.outstandingPacketEvents.count(*packetItEnd->associatedEvent)) {
-        for (auto& packetFrame : packetItEnd->packet.frames) {
-          ackVisitor(*packetItEnd, packetFrame, frame);
+      if (!packetIt->associatedEvent ||
+          conn.outstandingPacketEvents.count(*packetIt->associatedEvent)) {
+        for (auto& packetFrame : packetIt->packet.frames) {
+          ackVisitor(*packetIt, packetFrame, frame);
         }
         // Remove this PacketEvent from the outstandingPacketEvents set
-        if (packetItEnd->associatedEvent) {
-          conn.outstandingPacketEvents.erase(*packetItEnd->associatedEvent);
+        if (packetIt->associatedEvent) {
+          conn.outstandingPacketEvents.erase(*packetIt->associatedEvent);
         }
       }
       ack.largestAckedPacket = std::max(
           ack.largestAckedPacket.value_or(currentPacketNum), currentPacketNum);
-      if (ackReceiveTime > packetItEnd->time) {
+      if (ackReceiveTime > packetIt->time) {
         ack.mrttSample =
             std::min(ack.mrttSample.value_or(rttSample), rttSample);
       }
-      conn.lossState.totalBytesAcked += packetItEnd->encodedSize;
+      conn.lossState.totalBytesAcked += packetIt->encodedSize;
       conn.lossState.totalBytesSentAtLastAck = conn.lossState.totalBytesSent;
       conn.lossState.totalBytesAckedAtLastAck = conn.lossState.totalBytesAcked;
-      conn.lossState.lastAckedPacketSentTime = packetItEnd->time;
+      conn.lossState.lastAckedPacketSentTime = packetIt->time;
       conn.lossState.lastAckedTime = ackReceiveTime;
-      ack.ackedPackets.push_back(std::move(*packetItEnd));
-      packetItEnd = conn.outstandingPackets.erase(packetItEnd);
+      ack.ackedPackets.emplace_back(*packetIt);
+      conn.outstandingPackets.erase(packetIt);
     }
-    currentPacketItStart = packetItEnd;
   }
   DCHECK_GE(conn.outstandingHandshakePacketsCount, handshakePacketAcked);
   conn.outstandingHandshakePacketsCount -= handshakePacketAcked;
@@ -143,6 +261,13 @@ void processAckFrame(
   DCHECK_GE(
       updatedOustandingPacketsCount, conn.outstandingHandshakePacketsCount);
   DCHECK_GE(updatedOustandingPacketsCount, conn.outstandingClonedPacketsCount);
+  if (!conn.lossState.recentlyLostPackets.empty()) {
+    detectSpuriousLosses(conn, pnSpace, frame, ackReceiveTime);
+  }
+  if (conn.ecnState == QuicConnectionStateBase::EcnState::Enabled) {
+    ack.ecnCeMarked = processEcnCounts(
+        conn, getAckState(conn, pnSpace), frame, ecnMarkedPacketsAcked);
+  }
   auto lossEvent = handleAckForLoss(conn, lossVisitor, ack, pnSpace);
   if (conn.congestionController &&
       (ack.largestAckedPacket.hasValue() || lossEvent)) {
@@ -153,8 +278,16 @@ void processAckFrame(
           *lossEvent->smallestLostSentTime,
           *lossEvent->largestLostSentTime);
     }
-    conn.congestionController->onPacketAckOrLoss(
-        std::move(ack), std::move(lossEvent));
+    {
+      ScopedAllocationAccounting congestionControlAccounting(
+          conn, ConnectionAllocationUsage::Subsystem::CongestionControl);
+      conn.congestionController->onPacketAckOrLoss(
+          std::move(ack), std::move(lossEvent));
+    }
+    QUIC_STATS(
+        conn.infoCallback,
+        onCwndSample,
+        conn.congestionController->getCongestionWindow());
   }
 }
 
@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <quic/codec/QuicWriteCodec.h>
 #include <quic/codec/Types.h>
 #include <quic/common/IntervalSet.h>
 
@@ -28,18 +29,31 @@ struct AckState {
   // Count of outstanding packets received with only non-retransmittable data.
   uint64_t numNonRxPacketsRecvd{0};
   // Count of oustanding packets received with retransmittable data.
-  uint8_t numRxPacketsRecvd{0};
+  uint64_t numRxPacketsRecvd{0};
   // The receive time of the largest ack packet
   folly::Optional<TimePoint> largestRecvdPacketTime;
   // Latest packet number acked by peer
   // TODO: 0 is a legit PacketNum now, we need to make this optional:
   PacketNum largestAckedByPeer{0};
+  // Whether the peer acked any packet of this space, largestAckedByPeer is
+  // only meaningful once it did.
+  bool ackedByPeer{false};
   // Largest received packet numbers on the connection.
   folly::Optional<PacketNum> largestReceivedPacketNum;
   // Largest received packet number at the time we sent our last close message.
   folly::Optional<PacketNum> largestReceivedAtLastCloseSent;
   // Next PacketNum we will send for packet in this packet number space
   PacketNum nextPacketNum{0};
+  // The encoded blocks of the last ack frame written from acks. The ack
+  // scheduler only has const access to the ack state, hence mutable.
+  mutable AckBlocksCache ackBlocksCache;
+  // ECN codepoints of the packets received in this space, reported to the
+  // peer in ACK_ECN frames.
+  EcnCounts ecnCounts;
+  // Largest ECN counts reported by the peer in this space, and the largest
+  // acked packet of the ack that carried them.
+  EcnCounts peerEcnCounts;
+  folly::Optional<PacketNum> peerEcnLargestAcked;
 };
 
 struct AckStates {
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/common/AllocationCounter.h>
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+/**
+ * Counts the heap allocations made in its scope towards the connection's
+ * ConnectionAllocationUsage, if TransportSettings::allocationAccounting is
+ * on. A phase scope starts counting to the State subsystem of the phase,
+ * and a subsystem scope moves the counting of the running phase to the
+ * subsystem. The phase and subsystem that were running are restored when
+ * the scope ends, so that nothing is counted twice.
+ */
+class ScopedAllocationAccounting {
+ public:
+  using Phase = ConnectionAllocationUsage::Phase;
+  using Subsystem = ConnectionAllocationUsage::Subsystem;
+
+  ScopedAllocationAccounting(QuicConnectionStateBase& conn, Phase phase)
+      : conn_(conn) {
+    if (!conn_.transportSettings.allocationAccounting) {
+      return;
+    }
+    enter();
+    conn_.allocationUsage.calls[static_cast<size_t>(phase)]++;
+    conn_.allocationPhase = phase;
+    conn_.allocationSubsystem = Subsystem::State;
+  }
+
+  // Does nothing outside of a phase.
+  ScopedAllocationAccounting(
+      QuicConnectionStateBase& conn,
+      Subsystem subsystem)
+      : conn_(conn) {
+    if (!conn_.allocationPhase) {
+      return;
+    }
+    enter();
+    conn_.allocationSubsystem = subsystem;
+  }
+
+  ~ScopedAllocationAccounting() {
+    if (!enabled_) {
+      return;
+    }
+    charge();
+    conn_.allocationPhase = previousPhase_;
+    conn_.allocationSubsystem = previousSubsystem_;
+  }
+
+  ScopedAllocationAccounting(const ScopedAllocationAccounting&) = delete;
+  ScopedAllocationAccounting& operator=(const ScopedAllocationAccounting&) =
+      delete;
+
+ private:
+  void enter() noexcept {
+    enabled_ = true;
+    charge();
+    previousPhase_ = conn_.allocationPhase;
+    previousSubsystem_ = conn_.allocationSubsystem;
+  }
+
+  // Adds the allocations since the last charge to the running subsystem.
+  void charge() noexcept {
+    auto allocations = getThreadAllocations();
+    auto bytes = getThreadAllocatedBytes();
+    if (conn_.allocationPhase) {
+      auto& counts = conn_.allocationUsage.at(
+          *conn_.allocationPhase, conn_.allocationSubsystem);
+      counts.allocations += allocations - conn_.allocationsAtCharge;
+      counts.bytes += bytes - conn_.allocatedBytesAtCharge;
+    }
+    conn_.allocationsAtCharge = allocations;
+    conn_.allocatedBytesAtCharge = bytes;
+  }
+
+  QuicConnectionStateBase& conn_;
+  folly::Optional<Phase> previousPhase_;
+  Subsystem previousSubsystem_{Subsystem::State};
+  bool enabled_{false};
+};
+
+} // namespace quic
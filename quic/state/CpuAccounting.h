@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/chrono/Hardware.h>
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+/**
+ * Counts the cycles spent in its scope towards a phase of the connection's
+ * ConnectionCpuUsage, if TransportSettings::cpuAccounting is on. The phase
+ * that was running when the scope was entered is paused until it ends, so
+ * that nested phases are not counted twice.
+ */
+class ScopedCpuAccounting {
+ public:
+  ScopedCpuAccounting(
+      QuicConnectionStateBase& conn,
+      ConnectionCpuUsage::Phase phase)
+      : conn_(conn) {
+    if (!conn_.transportSettings.cpuAccounting) {
+      return;
+    }
+    enabled_ = true;
+    auto now = folly::hardware_timestamp();
+    previous_ = conn_.cpuPhase;
+    charge(now);
+    conn_.cpuUsage.calls[static_cast<size_t>(phase)]++;
+    conn_.cpuPhase = phase;
+    conn_.cpuPhaseStartCycles = now;
+  }
+
+  ~ScopedCpuAccounting() {
+    if (!enabled_) {
+      return;
+    }
+    auto now = folly::hardware_timestamp();
+    charge(now);
+    conn_.cpuPhase = previous_;
+    conn_.cpuPhaseStartCycles = now;
+  }
+
+  ScopedCpuAccounting(const ScopedCpuAccounting&) = delete;
+  ScopedCpuAccounting& operator=(const ScopedCpuAccounting&) = delete;
+
+ private:
+  // Adds the cycles since the running phase started or resumed to it.
+  void charge(uint64_t now) noexcept {
+    if (conn_.cpuPhase) {
+      conn_.cpuUsage.cycles[static_cast<size_t>(*conn_.cpuPhase)] +=
+          now - conn_.cpuPhaseStartCycles;
+    }
+  }
+
+  QuicConnectionStateBase& conn_;
+  folly::Optional<ConnectionCpuUsage::Phase> previous_;
+  bool enabled_{false};
+};
+
+} // namespace quic
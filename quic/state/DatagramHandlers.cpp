@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/DatagramHandlers.h>
+
+namespace quic {
+
+void handleDatagram(QuicConnectionStateBase& conn, ReadDatagramFrame& frame) {
+  auto dataLength = frame.data ? frame.data->computeChainDataLength() : 0;
+  // The limit also counts the frame type and length, only the payload is
+  // checked to not depend on how the peer encoded them.
+  if (conn.transportSettings.maxDatagramFrameSize == 0 ||
+      dataLength > conn.transportSettings.maxDatagramFrameSize) {
+    throw QuicTransportException(
+        "Received unexpected datagram",
+        TransportErrorCode::PROTOCOL_VIOLATION,
+        FrameType::DATAGRAM);
+  }
+  if (conn.transportSettings.datagramReadBufferSize == 0) {
+    return;
+  }
+  auto& readBuffer = conn.datagramState.readBuffer;
+  if (readBuffer.size() >= conn.transportSettings.datagramReadBufferSize) {
+    VLOG(10) << "Dropping oldest received datagram " << conn;
+    readBuffer.pop_front();
+  }
+  readBuffer.push_back(std::move(frame.data));
+  conn.datagramState.readAvailable = true;
+}
+
+uint64_t getDatagramSizeLimit(const QuicConnectionStateBase& conn) {
+  auto maxFrameSize = conn.datagramState.maxWriteFrameSize;
+  if (maxFrameSize <= sizeof(uint8_t) + sizeof(uint16_t)) {
+    return 0;
+  }
+  auto packetLimit = conn.udpSendPacketLen > kMaxDatagramPacketOverhead
+      ? conn.udpSendPacketLen - kMaxDatagramPacketOverhead
+      : 0;
+  return std::min<uint64_t>(
+      maxFrameSize - sizeof(uint8_t) - sizeof(uint16_t), packetLimit);
+}
+} // namespace quic
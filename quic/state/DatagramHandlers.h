@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/codec/Types.h>
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+/**
+ * Processing upon receipt of a DATAGRAM frame. The datagram is kept until
+ * the app reads it, at the expense of the oldest one once the read buffer
+ * is full.
+ *
+ * @throws QuicTransportException if datagrams of that size were not
+ * advertised.
+ */
+void handleDatagram(QuicConnectionStateBase& conn, ReadDatagramFrame& frame);
+
+/**
+ * Largest datagram payload that the peer accepts and that fits in a packet,
+ * 0 if the peer does not accept datagrams.
+ */
+uint64_t getDatagramSizeLimit(const QuicConnectionStateBase& conn);
+} // namespace quic
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/FecHandlers.h>
+
+#include <quic/state/QuicStateFunctions.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace quic {
+
+namespace {
+
+uint64_t getRepairFrameSize(
+    StreamId streamId,
+    const std::vector<FecProtectedFrame>& frames,
+    uint64_t dataLength) {
+  uint64_t size =
+      QuicInteger(static_cast<uint8_t>(FrameType::REPAIR)).getSize() +
+      QuicInteger(streamId).getSize() + sizeof(uint8_t) +
+      QuicInteger(frames.size()).getSize() +
+      QuicInteger(dataLength).getSize() + dataLength;
+  for (const auto& frame : frames) {
+    size += QuicInteger(frame.offset).getSize() +
+        QuicInteger(frame.len).getSize();
+  }
+  return size;
+}
+
+// XORs data into the front of buf, up to the length of buf.
+void xorInto(folly::IOBuf& buf, const folly::IOBuf& data) {
+  auto out = buf.writableData();
+  auto end = out + buf.length();
+  for (auto range : data) {
+    for (auto byte : range) {
+      if (out == end) {
+        return;
+      }
+      *out++ ^= byte;
+    }
+  }
+}
+
+void queueRepairGroup(QuicConnectionStateBase& conn) {
+  auto& fecState = conn.fecState;
+  if (!fecState.group) {
+    return;
+  }
+  if (fecState.pendingRepairs.size() >= kMaxPendingRepairFrames) {
+    VLOG(10) << "Dropping oldest pending repair frame " << conn;
+    fecState.pendingRepairs.pop_front();
+  }
+  fecState.pendingRepairs.push_back(std::move(*fecState.group));
+  fecState.group.clear();
+}
+} // namespace
+
+void onStreamFrameSent(
+    QuicConnectionStateBase& conn,
+    const QuicStreamState& stream,
+    const WriteStreamFrame& frame) {
+  auto& fecState = conn.fecState;
+  if (!fecState.enabled) {
+    return;
+  }
+  // The data was just moved there from the write buffer.
+  auto buffer = stream.retransmissionBuffer.find(frame.offset);
+  if (buffer == stream.retransmissionBuffer.end()) {
+    return;
+  }
+  auto& group = fecState.group;
+  if (group && group->streamId != frame.streamId) {
+    queueRepairGroup(conn);
+  }
+  // The REPAIR frame has to fit in a packet of its own.
+  auto sizeLimit = conn.udpSendPacketLen > kMaxRepairPacketOverhead
+      ? conn.udpSendPacketLen - kMaxRepairPacketOverhead
+      : 0;
+  if (group) {
+    group->frames.emplace_back(frame.offset, frame.len);
+    auto dataLength = std::max<uint64_t>(group->data->length(), frame.len);
+    bool fits = dataLength <= group->data->length() + group->data->tailroom() &&
+        getRepairFrameSize(group->streamId, group->frames, dataLength) <=
+            sizeLimit;
+    group->frames.pop_back();
+    if (!fits) {
+      queueRepairGroup(conn);
+    }
+  }
+  if (!group) {
+    if (getRepairFrameSize(
+            frame.streamId, {FecProtectedFrame(frame.offset, frame.len)},
+            frame.len) > sizeLimit) {
+      VLOG(10) << "Stream frame too large to protect stream="
+               << frame.streamId << " offset=" << frame.offset << " "
+               << conn;
+      return;
+    }
+    group.emplace(
+        frame.streamId,
+        std::vector<FecProtectedFrame>(),
+        false,
+        folly::IOBuf::create(sizeLimit));
+  }
+  // Shorter frames are padded with zeros.
+  auto& data = *group->data;
+  if (frame.len > data.length()) {
+    auto padding = frame.len - data.length();
+    std::memset(data.writableTail(), 0, padding);
+    data.append(padding);
+  }
+  if (buffer->data.front()) {
+    xorInto(data, *buffer->data.front());
+  }
+  group->frames.emplace_back(frame.offset, frame.len);
+  group->fin = frame.fin;
+  if (frame.fin ||
+      group->frames.size() >=
+          std::max<uint64_t>(conn.transportSettings.fecGroupSize, 1) ||
+      stream.writeBuffer.empty()) {
+    queueRepairGroup(conn);
+  }
+}
+
+void onStreamFrameReceived(
+    QuicConnectionStateBase& conn,
+    const ReadStreamFrame& frame) {
+  if (!conn.fecState.enabled) {
+    return;
+  }
+  auto& receivedFrames = conn.fecState.receivedFrames;
+  if (receivedFrames.size() >= kMaxFecReceivedFrames) {
+    receivedFrames.pop_front();
+  }
+  receivedFrames.push_back(frame);
+}
+
+void handleRepairFrame(QuicConnectionStateBase& conn, RepairFrame& frame) {
+  if (!conn.transportSettings.fecEnabled) {
+    throw QuicTransportException(
+        "Received unexpected repair frame",
+        TransportErrorCode::PROTOCOL_VIOLATION,
+        FrameType::REPAIR);
+  }
+  const auto& receivedFrames = conn.fecState.receivedFrames;
+  std::vector<const ReadStreamFrame*> received;
+  folly::Optional<size_t> lostIndex;
+  for (size_t i = 0; i < frame.frames.size(); i++) {
+    const auto& protectedFrame = frame.frames[i];
+    auto it = std::find_if(
+        receivedFrames.begin(),
+        receivedFrames.end(),
+        [&](const ReadStreamFrame& receivedFrame) {
+          return receivedFrame.streamId == frame.streamId &&
+              receivedFrame.offset == protectedFrame.offset &&
+              (receivedFrame.data
+                   ? receivedFrame.data->computeChainDataLength()
+                   : 0) == protectedFrame.len;
+        });
+    if (it != receivedFrames.end()) {
+      received.push_back(&*it);
+    } else if (lostIndex) {
+      // XOR repairs one lost frame only.
+      return;
+    } else {
+      lostIndex = i;
+    }
+  }
+  if (!lostIndex) {
+    return;
+  }
+  const auto& lost = frame.frames[*lostIndex];
+  auto stream = conn.streamManager->getStream(frame.streamId);
+  if (!stream ||
+      (lost.len > 0 && lost.offset + lost.len <= stream->currentReadOffset)) {
+    // The frame was read already, it was received before the ones kept.
+    return;
+  }
+  auto dataLength = frame.data ? frame.data->computeChainDataLength() : 0;
+  if (dataLength < lost.len) {
+    throw QuicTransportException(
+        "Repair data too short",
+        TransportErrorCode::FRAME_ENCODING_ERROR,
+        FrameType::REPAIR);
+  }
+  auto data = folly::IOBuf::create(lost.len);
+  if (lost.len > 0) {
+    folly::io::Cursor cursor(frame.data.get());
+    cursor.pull(data->writableData(), lost.len);
+    data->append(lost.len);
+  }
+  for (const auto receivedFrame : received) {
+    if (receivedFrame->data) {
+      xorInto(*data, *receivedFrame->data);
+    }
+  }
+  bool fin = frame.fin && *lostIndex == frame.frames.size() - 1;
+  VLOG(10) << "Rebuilt lost stream frame stream=" << frame.streamId
+           << " offset=" << lost.offset << " len=" << lost.len
+           << " fin=" << fin << " " << conn;
+  invokeStreamReceiveStateMachine(
+      conn,
+      *stream,
+      ReadStreamFrame(frame.streamId, lost.offset, std::move(data), fin));
+}
+} // namespace quic
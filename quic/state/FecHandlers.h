@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/codec/Types.h>
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+/**
+ * Adds a STREAM frame of new data that was just sent to the REPAIR frame
+ * being built, if both ends accept them. The REPAIR frame is queued once it
+ * protects fecGroupSize frames, once the frame has the FIN, or once the
+ * write buffer of the stream is drained, so that the tail of a write is
+ * always protected.
+ */
+void onStreamFrameSent(
+    QuicConnectionStateBase& conn,
+    const QuicStreamState& stream,
+    const WriteStreamFrame& frame);
+
+/**
+ * Keeps a received STREAM frame, without copying its data, if both ends
+ * accept REPAIR frames.
+ */
+void onStreamFrameReceived(
+    QuicConnectionStateBase& conn,
+    const ReadStreamFrame& frame);
+
+/**
+ * Processing upon receipt of a REPAIR frame. When exactly one of the
+ * protected frames was not received, it is rebuilt from the others and
+ * handled like a received STREAM frame.
+ *
+ * @throws QuicTransportException if REPAIR frames were not advertised.
+ */
+void handleRepairFrame(QuicConnectionStateBase& conn, RepairFrame& frame);
+} // namespace quic
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/KeyUpdate.h>
+
+#include <quic/logging/QLoggerConstants.h>
+#include <quic/logging/QuicLogger.h>
+
+namespace quic {
+
+namespace {
+void rotateWriteKeys(QuicConnectionStateBase& conn) {
+  auto& state = conn.keyUpdateState;
+  CHECK(state.nextOneRttWriteCipher);
+  conn.oneRttWriteCipher = std::move(state.nextOneRttWriteCipher);
+  state.writePhase = state.writePhase == ProtectionType::KeyPhaseZero
+      ? ProtectionType::KeyPhaseOne
+      : ProtectionType::KeyPhaseZero;
+  state.firstPacketNumInPhase = folly::none;
+  state.packetsWrittenInPhase = 0;
+  ++state.numKeyUpdates;
+}
+} // namespace
+
+void updateKeyPhaseOnRead(QuicConnectionStateBase& conn) {
+  if (!conn.oneRttWriteCipher || !conn.readCodec ||
+      !conn.readCodec->getOneRttReadCipher()) {
+    return;
+  }
+  auto& state = conn.keyUpdateState;
+  if (conn.readCodec->getKeyPhase() == state.writePhase) {
+    state.localUpdatePending = false;
+  } else if (!state.localUpdatePending && state.nextOneRttWriteCipher) {
+    VLOG(4) << __func__ << " following the peer's key update " << conn;
+    rotateWriteKeys(conn);
+    if (conn.qLogger) {
+      conn.qLogger->addTransportStateUpdate(kKeyUpdateFollowed);
+    }
+  }
+  if (!conn.handshakeLayer) {
+    return;
+  }
+  if (!state.nextOneRttWriteCipher) {
+    state.nextOneRttWriteCipher =
+        conn.handshakeLayer->getNextOneRttWriteCipher();
+  }
+  if (!conn.readCodec->getNextOneRttReadCipher()) {
+    conn.readCodec->setNextOneRttReadCipher(
+        conn.handshakeLayer->getNextOneRttReadCipher());
+  }
+}
+
+bool maybeInitiateKeyUpdate(QuicConnectionStateBase& conn) {
+  auto& state = conn.keyUpdateState;
+  auto interval = conn.transportSettings.keyUpdatePacketInterval;
+  if (interval == 0 || state.packetsWrittenInPhase < interval ||
+      state.localUpdatePending || !state.nextOneRttWriteCipher ||
+      !conn.readCodec->getNextOneRttReadCipher() ||
+      !conn.readCodec->getHandshakeDoneTime()) {
+    return false;
+  }
+  if (!state.firstPacketNumInPhase ||
+      conn.ackStates.appDataAckState.largestAckedByPeer <
+          *state.firstPacketNumInPhase) {
+    return false;
+  }
+  VLOG(4) << __func__ << " after " << state.packetsWrittenInPhase
+          << " packets " << conn;
+  rotateWriteKeys(conn);
+  state.localUpdatePending = true;
+  if (conn.qLogger) {
+    conn.qLogger->addTransportStateUpdate(kKeyUpdateStarted);
+  }
+  return true;
+}
+
+void onKeyPhasePacketWritten(
+    QuicConnectionStateBase& conn,
+    PacketNum packetNum) {
+  auto& state = conn.keyUpdateState;
+  if (!state.firstPacketNumInPhase) {
+    state.firstPacketNumInPhase = packetNum;
+  }
+  ++state.packetsWrittenInPhase;
+}
+} // namespace quic
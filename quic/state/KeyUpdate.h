@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/state/StateData.h>
+
+namespace quic {
+
+/**
+ * Called once the packets of a read are processed. If the read codec moved
+ * to the peer's next key phase the write keys follow it, or the key update
+ * this endpoint started is complete. Then the ciphers of the next key phase
+ * that are not derived yet are derived, so that they are at hand when the
+ * key phase flips again.
+ */
+void updateKeyPhaseOnRead(QuicConnectionStateBase& conn);
+
+/**
+ * Starts a key update if keyUpdatePacketInterval packets were written with
+ * the current keys. The handshake has to be done, an earlier key update
+ * complete and a packet written with the current keys acked. This swaps
+ * oneRttWriteCipher, so it has to be called before the 1-RTT packets of a
+ * write are built. Returns true if the update started.
+ */
+bool maybeInitiateKeyUpdate(QuicConnectionStateBase& conn);
+
+void onKeyPhasePacketWritten(
+    QuicConnectionStateBase& conn,
+    PacketNum packetNum);
+} // namespace quic
@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/Overload.h>
+#include <folly/lang/Bits.h>
+#include <glog/logging.h>
+#include <quic/codec/Types.h>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <iterator>
+#include <type_traits>
+
+namespace quic {
+
+/**
+ * Holds the packets that were sent and not acked or lost yet, sorted by packet
+ * number.
+ *
+ * Packets are kept in a deque of slots. Erasing a packet only leaves a
+ * tombstone in its slot, and the tombstones at either end of the deque are
+ * dropped, so erasing from the middle of the store is O(1) and iterators to
+ * the other packets stay valid. Every packet number space also keeps an
+ * index from packet number to slot, which makes looking up a packet from an
+ * ack O(1), and a bitmap of its outstanding packet numbers, with which an ack
+ * block skips the packets that were already acked or lost 64 at a time.
+ *
+ * Packets are normally sent, and so added, in increasing packet number order.
+ * Adding a packet in front of an existing one is supported, but is linear in
+ * the number of packets and invalidates iterators.
+ */
+template <typename Packet>
+class OutstandingPacketStore {
+ public:
+  template <typename Value>
+  class Iterator : public boost::iterator_facade<
+                       Iterator<Value>,
+                       Value,
+                       boost::bidirectional_traversal_tag> {
+    friend class boost::iterator_core_access;
+    friend class OutstandingPacketStore;
+    template <typename>
+    friend class Iterator;
+
+    using Store = std::conditional_t<
+        std::is_const<Value>::value,
+        const OutstandingPacketStore,
+        OutstandingPacketStore>;
+
+   public:
+    Iterator() = default;
+
+    template <
+        typename Other,
+        typename = std::enable_if_t<std::is_convertible<Other*, Value*>::value>>
+    /* implicit */ Iterator(const Iterator<Other>& other)
+        : store_(other.store_), slot_(other.slot_) {}
+
+   private:
+    Iterator(Store* store, uint64_t slot) : store_(store), slot_(slot) {}
+
+    Value& dereference() const {
+      return *store_->slotAt(slot_);
+    }
+
+    template <typename Other>
+    bool equal(const Iterator<Other>& other) const {
+      return slot_ == other.slot_;
+    }
+
+    void increment() {
+      slot_ = store_->nextLiveSlot(slot_ + 1);
+    }
+
+    void decrement() {
+      slot_ = store_->prevLiveSlot(slot_);
+    }
+
+    Store* store_{nullptr};
+    // Position of the packet, counted from the first packet ever stored.
+    uint64_t slot_{0};
+  };
+
+  using value_type = Packet;
+  using iterator = Iterator<Packet>;
+  using const_iterator = Iterator<const Packet>;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  /**
+   * Adds a packet at its position in packet number order.
+   */
+  iterator insert(Packet packet) {
+    auto slot = endSlot();
+    auto packetNum = folly::variant_match(
+        packet.packet.header,
+        [](const auto& h) { return h.getPacketSequenceNum(); });
+    while (slot != firstSlot_) {
+      auto prev = prevLiveSlot(slot);
+      if (slots_[prev - firstSlot_]->packetNum < packetNum) {
+        break;
+      }
+      slot = prev;
+    }
+    if (slot == endSlot()) {
+      return pushBack(std::move(packet));
+    }
+    return insertBefore(slot, std::move(packet));
+  }
+
+  /**
+   * Adds a packet after all the others, which must not have a larger packet
+   * number.
+   */
+  void push_back(Packet packet) {
+    pushBack(std::move(packet));
+  }
+
+  template <typename... Args>
+  Packet& emplace_back(Args&&... args) {
+    return *pushBack(Packet(std::forward<Args>(args)...));
+  }
+
+  /**
+   * Removes the packet pointed to by itr and returns an iterator to the next
+   * one.
+   */
+  iterator erase(const_iterator itr) {
+    auto slot = itr.slot_;
+    auto& entry = slots_[slot - firstSlot_];
+    DCHECK(entry.hasValue());
+    // The packet may have been moved from, so use the number kept aside.
+    auto& index = indexes_[static_cast<size_t>(entry->pnSpace)];
+    if (index.lookup(entry->packetNum) == slot + 1) {
+      index.remove(entry->packetNum);
+    }
+    DCHECK_GT(index.numPackets, 0);
+    index.numPackets--;
+    frameBytes_ -= entry->frameBytes;
+    entry.clear();
+    size_--;
+    // Drop the tombstones at both ends.
+    while (!slots_.empty() && !slots_.front().hasValue()) {
+      slots_.pop_front();
+      firstSlot_++;
+    }
+    while (!slots_.empty() && !slots_.back().hasValue()) {
+      slots_.pop_back();
+    }
+    return iterator(this, nextLiveSlot(slot + 1));
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    // Erasing never moves the other packets, so last stays valid.
+    auto lastSlot = last.slot_;
+    iterator itr(this, first.slot_);
+    while (itr.slot_ < lastSlot && itr != end()) {
+      itr = erase(itr);
+    }
+    return itr;
+  }
+
+  void pop_back() {
+    erase(std::prev(end()));
+  }
+
+  /**
+   * Returns the packet with the given number in the given space, or end().
+   */
+  iterator find(PacketNumberSpace pnSpace, PacketNum packetNum) {
+    return iterator(this, findSlot(pnSpace, packetNum));
+  }
+
+  const_iterator find(PacketNumberSpace pnSpace, PacketNum packetNum) const {
+    return const_iterator(this, findSlot(pnSpace, packetNum));
+  }
+
+  /**
+   * Returns the first packet of the given space, or end(). Each space keeps
+   * track of where its first packet is, so that this does not walk over the
+   * packets of the other spaces every time, and is O(1) amortized.
+   */
+  iterator firstInSpace(PacketNumberSpace pnSpace) {
+    return iterator(this, firstSlotInSpace(pnSpace));
+  }
+
+  const_iterator firstInSpace(PacketNumberSpace pnSpace) const {
+    return const_iterator(this, firstSlotInSpace(pnSpace));
+  }
+
+  /**
+   * Returns the first packet of the given space from from on, or end().
+   */
+  iterator nextInSpace(PacketNumberSpace pnSpace, const_iterator from) {
+    return iterator(this, nextSlotInSpace(pnSpace, from.slot_));
+  }
+
+  const_iterator nextInSpace(PacketNumberSpace pnSpace, const_iterator from)
+      const {
+    return const_iterator(this, nextSlotInSpace(pnSpace, from.slot_));
+  }
+
+  /**
+   * Returns the smallest and one past the largest packet number that may be
+   * outstanding in the given space. Packet numbers outside of this range
+   * are not in the store.
+   */
+  std::pair<PacketNum, PacketNum> packetNumRange(
+      PacketNumberSpace pnSpace) const {
+    const auto& index = indexes_[static_cast<size_t>(pnSpace)];
+    return {index.firstPacketNum,
+            index.firstPacketNum + index.slots.size()};
+  }
+
+  /**
+   * Returns the smallest packet number from packetNum on that is outstanding
+   * in the given space, or the end of packetNumRange if there is none.
+   */
+  PacketNum nextPacketNum(PacketNumberSpace pnSpace, PacketNum packetNum)
+      const {
+    return indexes_[static_cast<size_t>(pnSpace)].nextFrom(packetNum);
+  }
+
+  /**
+   * Returns the n-th packet. This is linear in n, as it has to skip over the
+   * tombstones.
+   */
+  Packet& operator[](size_t n) {
+    return *std::next(begin(), n);
+  }
+
+  const Packet& operator[](size_t n) const {
+    return *std::next(begin(), n);
+  }
+
+  Packet& front() {
+    return slots_.front()->packet;
+  }
+
+  const Packet& front() const {
+    return slots_.front()->packet;
+  }
+
+  Packet& back() {
+    return slots_.back()->packet;
+  }
+
+  const Packet& back() const {
+    return slots_.back()->packet;
+  }
+
+  iterator begin() {
+    return iterator(this, firstSlot_);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, firstSlot_);
+  }
+
+  iterator end() {
+    return iterator(this, endSlot());
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, endSlot());
+  }
+
+  reverse_iterator rbegin() {
+    return reverse_iterator(end());
+  }
+
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+
+  reverse_iterator rend() {
+    return reverse_iterator(begin());
+  }
+
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  /**
+   * Returns the bytes held by the packets and by the frames they were added
+   * with.
+   */
+  uint64_t memoryUsage() const {
+    return size_ * sizeof(Packet) + frameBytes_;
+  }
+
+  void clear() {
+    slots_.clear();
+    for (auto& index : indexes_) {
+      index.slots.clear();
+      index.firstPacketNum = 0;
+      index.words.clear();
+      index.firstWordPacketNum = 0;
+      index.numPackets = 0;
+      index.firstSlot = 0;
+    }
+    firstSlot_ = 0;
+    size_ = 0;
+    frameBytes_ = 0;
+  }
+
+ private:
+  static constexpr size_t kNumPacketNumberSpaces = 3;
+  static constexpr PacketNum kBitsPerWord = 64;
+
+  // Maps the packet numbers of one packet number space to slots.
+  struct PacketNumIndex {
+    PacketNum firstPacketNum{0};
+    // slot + 1 of each packet number, or 0 if it is not outstanding.
+    std::deque<uint64_t> slots;
+    // A bit for each outstanding packet number, the first word starting at
+    // firstWordPacketNum, a multiple of kBitsPerWord.
+    PacketNum firstWordPacketNum{0};
+    std::deque<uint64_t> words;
+    // The packets of the space, and a slot no later than the first of them,
+    // moved up to it whenever it is looked for.
+    size_t numPackets{0};
+    mutable uint64_t firstSlot{0};
+
+    bool contains(PacketNum packetNum) const {
+      return packetNum >= firstPacketNum &&
+          packetNum - firstPacketNum < slots.size();
+    }
+
+    uint64_t lookup(PacketNum packetNum) const {
+      return contains(packetNum) ? slots[packetNum - firstPacketNum] : 0;
+    }
+
+    uint64_t& operator[](PacketNum packetNum) {
+      if (slots.empty()) {
+        firstPacketNum = packetNum;
+      }
+      while (packetNum < firstPacketNum) {
+        slots.push_front(0);
+        firstPacketNum--;
+      }
+      while (packetNum - firstPacketNum >= slots.size()) {
+        slots.push_back(0);
+      }
+      return slots[packetNum - firstPacketNum];
+    }
+
+    void add(PacketNum packetNum, uint64_t slot) {
+      (*this)[packetNum] = slot + 1;
+      PacketNum wordPacketNum = packetNum - (packetNum % kBitsPerWord);
+      if (words.empty()) {
+        firstWordPacketNum = wordPacketNum;
+      }
+      while (wordPacketNum < firstWordPacketNum) {
+        words.push_front(0);
+        firstWordPacketNum -= kBitsPerWord;
+      }
+      auto wordIndex = (wordPacketNum - firstWordPacketNum) / kBitsPerWord;
+      while (wordIndex >= words.size()) {
+        words.push_back(0);
+      }
+      words[wordIndex] |= bitOf(packetNum);
+    }
+
+    void remove(PacketNum packetNum) {
+      slots[packetNum - firstPacketNum] = 0;
+      words[(packetNum - firstWordPacketNum) / kBitsPerWord] &=
+          ~bitOf(packetNum);
+      while (!slots.empty() && slots.front() == 0) {
+        slots.pop_front();
+        firstPacketNum++;
+      }
+      while (!slots.empty() && slots.back() == 0) {
+        slots.pop_back();
+      }
+      while (!words.empty() && words.front() == 0) {
+        words.pop_front();
+        firstWordPacketNum += kBitsPerWord;
+      }
+      while (!words.empty() && words.back() == 0) {
+        words.pop_back();
+      }
+    }
+
+    PacketNum nextFrom(PacketNum packetNum) const {
+      PacketNum end = firstPacketNum + slots.size();
+      if (packetNum < firstPacketNum) {
+        packetNum = firstPacketNum;
+      }
+      if (packetNum >= end) {
+        return end;
+      }
+      auto wordIndex = (packetNum - firstWordPacketNum) / kBitsPerWord;
+      // Ignore the packet numbers below packetNum in its own word.
+      uint64_t word = words[wordIndex] & ~(bitOf(packetNum) - 1);
+      while (word == 0) {
+        // The last word has the last outstanding packet number.
+        word = words[++wordIndex];
+      }
+      return firstWordPacketNum + wordIndex * kBitsPerWord +
+          folly::findFirstSet(word) - 1;
+    }
+
+    static uint64_t bitOf(PacketNum packetNum) {
+      return uint64_t(1) << (packetNum % kBitsPerWord);
+    }
+  };
+
+  struct Entry {
+    explicit Entry(Packet packetIn)
+        : packet(std::move(packetIn)),
+          pnSpace(folly::variant_match(
+              packet.packet.header,
+              [](const auto& h) { return h.getPacketNumberSpace(); })),
+          packetNum(folly::variant_match(
+              packet.packet.header,
+              [](const auto& h) { return h.getPacketSequenceNum(); })),
+          frameBytes(
+              packet.packet.frames.capacity() *
+              sizeof(packet.packet.frames[0])) {}
+
+    Packet packet;
+    PacketNumberSpace pnSpace;
+    PacketNum packetNum;
+    uint64_t frameBytes;
+  };
+
+  uint64_t endSlot() const {
+    return firstSlot_ + slots_.size();
+  }
+
+  Packet* slotAt(uint64_t slot) {
+    return &slots_[slot - firstSlot_]->packet;
+  }
+
+  const Packet* slotAt(uint64_t slot) const {
+    return &slots_[slot - firstSlot_]->packet;
+  }
+
+  uint64_t nextLiveSlot(uint64_t slot) const {
+    if (slot < firstSlot_) {
+      slot = firstSlot_;
+    }
+    while (slot < endSlot() && !slots_[slot - firstSlot_].hasValue()) {
+      slot++;
+    }
+    return std::min(slot, endSlot());
+  }
+
+  uint64_t prevLiveSlot(uint64_t slot) const {
+    DCHECK_GT(slot, firstSlot_);
+    do {
+      slot--;
+    } while (!slots_[slot - firstSlot_].hasValue());
+    return slot;
+  }
+
+  bool isInSpace(uint64_t slot, PacketNumberSpace pnSpace) const {
+    const auto& entry = slots_[slot - firstSlot_];
+    return entry.hasValue() && entry->pnSpace == pnSpace;
+  }
+
+  uint64_t firstSlotInSpace(PacketNumberSpace pnSpace) const {
+    const auto& index = indexes_[static_cast<size_t>(pnSpace)];
+    if (index.numPackets == 0) {
+      return endSlot();
+    }
+    auto slot = std::max(index.firstSlot, firstSlot_);
+    while (slot < endSlot() && !isInSpace(slot, pnSpace)) {
+      slot++;
+    }
+    index.firstSlot = slot;
+    return slot;
+  }
+
+  uint64_t nextSlotInSpace(PacketNumberSpace pnSpace, uint64_t slot) const {
+    const auto& index = indexes_[static_cast<size_t>(pnSpace)];
+    if (index.numPackets == 0) {
+      return endSlot();
+    }
+    if (slot <= index.firstSlot) {
+      return firstSlotInSpace(pnSpace);
+    }
+    slot = std::max(slot, firstSlot_);
+    while (slot < endSlot() && !isInSpace(slot, pnSpace)) {
+      slot++;
+    }
+    return std::min(slot, endSlot());
+  }
+
+  uint64_t findSlot(PacketNumberSpace pnSpace, PacketNum packetNum) const {
+    auto entry = indexes_[static_cast<size_t>(pnSpace)].lookup(packetNum);
+    return entry ? entry - 1 : endSlot();
+  }
+
+  iterator pushBack(Packet packet) {
+    auto slot = endSlot();
+    slots_.emplace_back(Entry(std::move(packet)));
+    addToIndex(*slots_.back(), slot);
+    size_++;
+    frameBytes_ += slots_.back()->frameBytes;
+    return iterator(this, slot);
+  }
+
+  iterator insertBefore(uint64_t slot, Packet packet) {
+    // Every packet from slot onwards moves back by one.
+    for (auto& index : indexes_) {
+      for (auto& entry : index.slots) {
+        if (entry > slot) {
+          entry++;
+        }
+      }
+      if (index.firstSlot >= slot) {
+        index.firstSlot++;
+      }
+    }
+    auto itr = slots_.emplace(
+        slots_.begin() + (slot - firstSlot_), Entry(std::move(packet)));
+    addToIndex(**itr, slot);
+    size_++;
+    frameBytes_ += (*itr)->frameBytes;
+    return iterator(this, slot);
+  }
+
+  void addToIndex(const Entry& entry, uint64_t slot) {
+    auto& index = indexes_[static_cast<size_t>(entry.pnSpace)];
+    index.add(entry.packetNum, slot);
+    if (index.numPackets == 0 || slot < index.firstSlot) {
+      index.firstSlot = slot;
+    }
+    index.numPackets++;
+  }
+
+  std::deque<folly::Optional<Entry>> slots_;
+  // Position of the first slot, counted from the first packet ever stored.
+  uint64_t firstSlot_{0};
+  size_t size_{0};
+  uint64_t frameBytes_{0};
+  std::array<PacketNumIndex, kNumPacketNumberSpaces> indexes_;
+};
+
+} // namespace quic
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/PathMtuDiscovery.h>
+
+#include <quic/logging/QLoggerConstants.h>
+#include <quic/logging/QuicLogger.h>
+
+#include <folly/net/NetOps.h>
+#include <folly/portability/Sockets.h>
+
+namespace quic {
+
+void setSocketDontFragment(folly::AsyncUDPSocket& socket, bool ignorePathMtu) {
+  if (!ignorePathMtu) {
+    socket.dontFragment(true);
+    return;
+  }
+  // TODO: Clean this up or move this into AsyncUDPSocket once we have a
+  // better idea of how to handle PMTU
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+  if (socket.address().getFamily() == AF_INET) {
+    int v4 = IP_PMTUDISC_PROBE;
+    folly::netops::setsockopt(
+        socket.getNetworkSocket(),
+        IPPROTO_IP,
+        IP_MTU_DISCOVER,
+        &v4,
+        sizeof(v4));
+  }
+#endif
+#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
+  if (socket.address().getFamily() == AF_INET6) {
+    int v6 = IPV6_PMTUDISC_PROBE;
+    folly::netops::setsockopt(
+        socket.getNetworkSocket(),
+        IPPROTO_IPV6,
+        IPV6_MTU_DISCOVER,
+        &v6,
+        sizeof(v6));
+  }
+#endif
+}
+
+namespace {
+using Phase = QuicConnectionStateBase::PathMtuState::Phase;
+
+void maybeCompleteSearch(QuicConnectionStateBase& conn, TimePoint now) {
+  auto& state = conn.pathMtuState;
+  if (state.searchHigh >= state.searchLow + kPathMtuSearchGranularity) {
+    return;
+  }
+  VLOG(4) << __func__ << " udpSendPacketLen=" << conn.udpSendPacketLen << " "
+          << conn;
+  state.phase = Phase::SearchComplete;
+  state.nextSearchTime = now + conn.transportSettings.pathMtuRaiseInterval;
+  if (conn.qLogger) {
+    conn.qLogger->addTransportStateUpdate(kPathMtuSearchComplete);
+  }
+}
+
+void onProbeAcked(QuicConnectionStateBase& conn, TimePoint ackTime) {
+  auto& state = conn.pathMtuState;
+  VLOG(4) << __func__ << " probeSize=" << state.probeSize << " " << conn;
+  state.probePacketNum = folly::none;
+  state.probeLosses = 0;
+  state.searchLow = std::max(state.searchLow, state.probeSize);
+  state.searchHigh = std::max(state.searchHigh, state.searchLow);
+  if (state.probeSize > conn.udpSendPacketLen) {
+    conn.udpSendPacketLen = state.probeSize;
+    if (conn.qLogger) {
+      conn.qLogger->addTransportStateUpdate(
+          folly::to<std::string>(kPathMtuRaised, conn.udpSendPacketLen));
+    }
+  }
+  maybeCompleteSearch(conn, ackTime);
+}
+
+void onProbeLost(QuicConnectionStateBase& conn, TimePoint lossTime) {
+  auto& state = conn.pathMtuState;
+  VLOG(4) << __func__ << " probeSize=" << state.probeSize << " " << conn;
+  state.probePacketNum = folly::none;
+  if (++state.probeLosses < kPathMtuMaxProbes) {
+    return;
+  }
+  state.probeLosses = 0;
+  state.searchHigh = std::max(state.searchLow, state.probeSize - 1);
+  maybeCompleteSearch(conn, lossTime);
+}
+
+void onBlackHole(QuicConnectionStateBase& conn, TimePoint lossTime) {
+  auto& state = conn.pathMtuState;
+  VLOG(4) << __func__ << " udpSendPacketLen=" << conn.udpSendPacketLen << " "
+          << conn;
+  ++state.blackHoles;
+  // The sizes from the base up to the one that failed are searched again,
+  // the outcome of an outstanding probe no longer matters.
+  state.phase = Phase::Searching;
+  state.searchLow = state.basePacketSize;
+  state.searchHigh = conn.udpSendPacketLen - 1;
+  state.probePacketNum = folly::none;
+  state.probeLosses = 0;
+  state.largePacketsLost = 0;
+  conn.udpSendPacketLen = state.basePacketSize;
+  if (conn.qLogger) {
+    conn.qLogger->addTransportStateUpdate(kPathMtuBlackHole);
+  }
+  maybeCompleteSearch(conn, lossTime);
+}
+
+PacketNum getPacketNum(const OutstandingPacket& packet) {
+  return folly::variant_match(
+      packet.packet.header,
+      [](const auto& h) { return h.getPacketSequenceNum(); });
+}
+} // namespace
+
+void startPathMtuDiscovery(
+    QuicConnectionStateBase& conn,
+    uint64_t peerMaxPacketSize) {
+  if (!conn.transportSettings.pathMtuDiscovery) {
+    return;
+  }
+  auto& state = conn.pathMtuState;
+  state.basePacketSize = conn.udpSendPacketLen;
+  state.maxPacketSize = std::min(
+      peerMaxPacketSize, conn.transportSettings.pathMtuMaxPacketSize);
+  state.searchLow = conn.udpSendPacketLen;
+  state.searchHigh = std::max(state.maxPacketSize, state.searchLow);
+  state.phase = Phase::Searching;
+  maybeCompleteSearch(conn, Clock::now());
+}
+
+bool shouldSendPathMtuProbe(
+    const QuicConnectionStateBase& conn,
+    TimePoint now) {
+  const auto& state = conn.pathMtuState;
+  if (state.phase == Phase::Disabled || state.probePacketNum ||
+      !conn.oneRttWriteCipher || conn.writableBytesLimit) {
+    return false;
+  }
+  if (state.phase == Phase::SearchComplete) {
+    return now >= state.nextSearchTime &&
+        state.maxPacketSize >=
+        conn.udpSendPacketLen + kPathMtuSearchGranularity;
+  }
+  return true;
+}
+
+uint64_t getNextPathMtuProbeSize(QuicConnectionStateBase& conn, TimePoint now) {
+  auto& state = conn.pathMtuState;
+  if (state.phase == Phase::SearchComplete &&
+      now >= state.nextSearchTime) {
+    state.phase = Phase::Searching;
+    state.searchLow = conn.udpSendPacketLen;
+    state.searchHigh = std::max(state.maxPacketSize, state.searchLow);
+    state.probeLosses = 0;
+  }
+  // The lost probes of a size are sent again before the search moves below
+  // it.
+  if (state.probeLosses) {
+    return state.probeSize;
+  }
+  return state.searchLow + (state.searchHigh - state.searchLow + 1) / 2;
+}
+
+void onPathMtuProbeSent(
+    QuicConnectionStateBase& conn,
+    PacketNum packetNum,
+    uint64_t probeSize) {
+  auto& state = conn.pathMtuState;
+  state.probePacketNum = packetNum;
+  state.probeSize = probeSize;
+  ++state.probesSent;
+}
+
+void onPathMtuPacketAcked(
+    QuicConnectionStateBase& conn,
+    const OutstandingPacket& packet,
+    TimePoint ackTime) {
+  auto& state = conn.pathMtuState;
+  if (packet.isPathMtuProbe) {
+    if (state.probePacketNum == getPacketNum(packet)) {
+      onProbeAcked(conn, ackTime);
+    }
+    return;
+  }
+  if (packet.encodedSize > state.basePacketSize) {
+    state.largePacketsLost = 0;
+  }
+}
+
+void onPathMtuPacketLost(
+    QuicConnectionStateBase& conn,
+    const OutstandingPacket& packet,
+    TimePoint lossTime) {
+  auto& state = conn.pathMtuState;
+  if (packet.isPathMtuProbe) {
+    if (state.probePacketNum == getPacketNum(packet)) {
+      onProbeLost(conn, lossTime);
+    }
+    return;
+  }
+  // Packets sent before a fall back to the base size do not count again.
+  if (packet.encodedSize <= state.basePacketSize ||
+      conn.udpSendPacketLen <= state.basePacketSize) {
+    return;
+  }
+  if (++state.largePacketsLost >= kPathMtuBlackHoleThreshold) {
+    onBlackHole(conn, lossTime);
+  }
+}
+} // namespace quic
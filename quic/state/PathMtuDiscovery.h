@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/state/StateData.h>
+
+#include <folly/io/async/AsyncUDPSocket.h>
+
+namespace quic {
+
+/**
+ * Sets the DF bit on the packets of the bound socket, so that a probe
+ * larger than the path MTU is dropped on the way instead of fragmented, and
+ * then acked as if the path carried it. If ignorePathMtu is set, as with
+ * turnoffPMTUD, the kernel does not lower the size it sends by the path MTU
+ * it learns (IP_PMTUDISC_PROBE), otherwise it does (IP_PMTUDISC_DO).
+ */
+void setSocketDontFragment(folly::AsyncUDPSocket& socket, bool ignorePathMtu);
+
+/**
+ * Starts the search for a larger udpSendPacketLen once the max_packet_size
+ * of the peer is known, if pathMtuDiscovery is enabled. The search is a
+ * binary search between udpSendPacketLen and the smaller of the peer's limit
+ * and pathMtuMaxPacketSize.
+ */
+void startPathMtuDiscovery(
+    QuicConnectionStateBase& conn,
+    uint64_t peerMaxPacketSize);
+
+/**
+ * Whether a path MTU probe should be written. Probes need the 1-RTT keys and
+ * a validated peer address, and only one is outstanding at a time.
+ */
+bool shouldSendPathMtuProbe(
+    const QuicConnectionStateBase& conn,
+    TimePoint now);
+
+/**
+ * The size of the next probe, starting the search over if it converged and
+ * the raise interval is up.
+ */
+uint64_t getNextPathMtuProbeSize(QuicConnectionStateBase& conn, TimePoint now);
+
+void onPathMtuProbeSent(
+    QuicConnectionStateBase& conn,
+    PacketNum packetNum,
+    uint64_t probeSize);
+
+/**
+ * Called with the packets that are acked and lost while the search is on.
+ * An acked probe raises udpSendPacketLen to its size, lost probes lower the
+ * upper bound of the search. Once enough packets larger than the base size
+ * are lost without any of them acked, udpSendPacketLen falls back to the
+ * base size and the search starts over below the size that failed.
+ */
+void onPathMtuPacketAcked(
+    QuicConnectionStateBase& conn,
+    const OutstandingPacket& packet,
+    TimePoint ackTime);
+
+void onPathMtuPacketLost(
+    QuicConnectionStateBase& conn,
+    const OutstandingPacket& packet,
+    TimePoint lossTime);
+} // namespace quic
@@ -7,6 +7,7 @@
  */
 
 #include <quic/state/QPRFunctions.h>
+#include <quic/common/LoopTime.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/state/QuicStreamFunctions.h>
 #include <quic/state/QuicStreamUtilities.h>
@@ -14,24 +15,23 @@
 namespace quic {
 namespace {
 
-// shrink the buffers until offset, either by popping up or trimming from start
-void shrinkBuffers(std::deque<StreamBuffer>& buffers, uint64_t offset) {
-  while (!buffers.empty()) {
-    auto curr = buffers.begin();
-    if (curr->offset >= offset) {
-      // the buffers are supposed to be sorted, so we are done here
-      break;
-    }
-    size_t currSize = curr->data.chainLength();
-    if (curr->offset + currSize <= offset) {
-      buffers.pop_front();
-    } else {
-      uint64_t amount = offset - curr->offset;
-      curr->data.trimStartAtMost(amount);
-      curr->offset += amount;
-      break;
-    }
+// shrink the buffers until offset, by erasing the buffers that end before it
+// at once and trimming the one that straddles it
+void shrinkBuffers(StreamBufferList& buffers, uint64_t offset) {
+  // the buffers are sorted and do not overlap, so only the last buffer that
+  // starts before offset may go past it
+  auto last = buffers.lower_bound(offset);
+  if (last == buffers.begin()) {
+    return;
+  }
+  auto straddling = std::prev(last);
+  if (straddling->offset + straddling->data.chainLength() > offset) {
+    uint64_t amount = offset - straddling->offset;
+    buffers.onDataTrimmed(straddling->data.trimStartAtMost(amount));
+    straddling->offset += amount;
+    last = straddling;
   }
+  buffers.erase(buffers.begin(), last);
 }
 
 void shrinkRetransmittableBuffers(
@@ -66,7 +66,7 @@ void shrinkReadBuffer(QuicStreamState* stream) {
   shrinkBuffers(stream->readBuffer, stream->currentReadOffset);
 
   // pretends we read stream.currentReadOffset - lastReadOffset bytes
-  updateFlowControlOnRead(*stream, lastReadOffset, Clock::now());
+  updateFlowControlOnRead(*stream, lastReadOffset, LoopTime::now());
   // may become readable after shrink
   stream->conn.streamManager->updateReadableStreams(*stream);
   stream->conn.streamManager->updatePeekableStreams(*stream);
@@ -201,6 +201,58 @@ folly::Optional<uint64_t> advanceMinimumRetransmittableOffset(
   return minimumStreamOffset;
 }
 
+std::vector<std::pair<StreamId, uint64_t>> expireStreamData(
+    QuicConnectionStateBase& conn,
+    TimePoint now) {
+  std::vector<std::pair<StreamId, uint64_t>> expired;
+  auto& streamManager = *conn.streamManager;
+  // advancing the offsets may change the set
+  std::vector<StreamId> expiringStreams(
+      streamManager.expiringStreams().begin(),
+      streamManager.expiringStreams().end());
+  for (auto id : expiringStreams) {
+    auto stream = streamManager.findStream(id);
+    if (!stream || !stream->dataExpiry) {
+      streamManager.removeExpiringStream(id);
+      continue;
+    }
+    auto& deadlines = stream->dataExpiry->deadlines;
+    folly::Optional<uint64_t> expiredOffset;
+    while (!deadlines.empty() && deadlines.front().second <= now) {
+      expiredOffset = deadlines.front().first;
+      deadlines.pop_front();
+    }
+    if (deadlines.empty()) {
+      streamManager.removeExpiringStream(id);
+    }
+    if (!expiredOffset) {
+      continue;
+    }
+    // data that was all acked already needs no frame
+    bool unacked = stream->currentWriteOffset < *expiredOffset ||
+        (!stream->retransmissionBuffer.empty() &&
+         stream->retransmissionBuffer.front().offset < *expiredOffset) ||
+        (!stream->lossBuffer.empty() &&
+         stream->lossBuffer.front().offset < *expiredOffset);
+    if (!unacked) {
+      continue;
+    }
+    auto newOffset =
+        advanceMinimumRetransmittableOffset(stream, *expiredOffset);
+    if (newOffset) {
+      expired.emplace_back(id, *newOffset);
+    }
+    if (stream->minimumRetransmittableOffset < *expiredOffset &&
+        (!stream->finalWriteOffset ||
+         stream->minimumRetransmittableOffset < *stream->finalWriteOffset)) {
+      // held back by the peer's flow control, try again with the next write
+      deadlines.emplace_front(*expiredOffset, now);
+      streamManager.addExpiringStream(id);
+    }
+  }
+  return expired;
+}
+
 void onRecvExpiredStreamDataFrame(
     QuicStreamState* stream,
     const ExpiredStreamDataFrame& frame) {
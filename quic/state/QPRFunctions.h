@@ -35,6 +35,16 @@ folly::Optional<uint64_t> advanceMinimumRetransmittableOffset(
     QuicStreamState* stream,
     uint64_t minimumRetransmittableOffset);
 
+/**
+ * Expires the data of the streams with a data expiry that was written before
+ * now - expiry and is not acked yet, queueing one ExpiredStreamDataFrame
+ * per stream for the next write. Returns the streams that expired data, with
+ * their new minimum retransmittable offset.
+ */
+std::vector<std::pair<StreamId, uint64_t>> expireStreamData(
+    QuicConnectionStateBase& conn,
+    TimePoint now);
+
 /**
  * processing upon receipt of ExpiredStreamDataFrame
  */
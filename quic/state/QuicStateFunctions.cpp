@@ -9,6 +9,7 @@
 #include <quic/state/QuicStateFunctions.h>
 
 #include <quic/common/TimeUtil.h>
+#include <quic/logging/QLoggerConstants.h>
 #include <quic/logging/QuicLogger.h>
 
 namespace {
@@ -52,6 +53,7 @@ void updateRtt(
     conn.lossState.srtt = conn.lossState.srtt * (kRttAlpha - 1) / kRttAlpha +
         rttSample / kRttAlpha;
   }
+  QUIC_STATS(conn.infoCallback, onRttSample, rttSample);
   if (conn.qLogger) {
     conn.qLogger->addMetricUpdate(
         rttSample, conn.lossState.mrtt, conn.lossState.srtt, ackDelay);
@@ -72,9 +74,15 @@ void updateAckSendStateOnRecvPacket(
     bool pktHasRetransmittableData,
     bool pktHasCryptoData) {
   DCHECK(!pktHasCryptoData || pktHasRetransmittableData);
-  uint8_t thresh =
+  uint64_t rxThresh = conn.transportSettings.rxPacketsBeforeAckThreshold;
+  // The peer can only change how often we ack application data.
+  if (conn.ackFrequency && &ackState == &conn.ackStates.appDataAckState) {
+    rxThresh = conn.ackFrequency->packetTolerance;
+    pktOutOfOrder = pktOutOfOrder && !conn.ackFrequency->ignoreOrder;
+  }
+  uint64_t thresh =
       ((pktHasRetransmittableData || ackState.numRxPacketsRecvd)
-           ? kRxPacketsPendingBeforeAckThresh
+           ? rxThresh
            : kNonRxPacketsPendingBeforeAckThresh);
   if (pktHasRetransmittableData) {
     if (pktHasCryptoData || pktOutOfOrder ||
@@ -119,6 +127,30 @@ void updateAckSendStateOnRecvPacket(
   }
 }
 
+void updateEcnCountsOnRecvPacket(
+    QuicConnectionStateBase& conn,
+    AckState& ackState,
+    EcnCodepoint ecn) {
+  switch (ecn) {
+    case EcnCodepoint::NotEct:
+      return;
+    case EcnCodepoint::Ect0:
+      ackState.ecnCounts.ect0++;
+      return;
+    case EcnCodepoint::Ect1:
+      ackState.ecnCounts.ect1++;
+      return;
+    case EcnCodepoint::Ce:
+      ackState.ecnCounts.ce++;
+      VLOG(10) << conn << " ack immediately because of CE mark";
+      conn.pendingEvents.scheduleAckTimeout = false;
+      ackState.needsToSendAckImmediately = true;
+      ackState.numRxPacketsRecvd = 0;
+      ackState.numNonRxPacketsRecvd = 0;
+      return;
+  }
+}
+
 void updateAckStateOnAckTimeout(QuicConnectionStateBase& conn) {
   VLOG(10) << conn << " ack immediately due to ack timeout";
   conn.ackStates.appDataAckState.needsToSendAckImmediately = true;
@@ -198,23 +230,17 @@ void increaseNextPacketNum(
   getAckState(conn, pnSpace).nextPacketNum++;
 }
 
-std::deque<OutstandingPacket>::iterator getFirstOutstandingPacket(
+OutstandingPackets::iterator getFirstOutstandingPacket(
     QuicConnectionStateBase& conn,
     PacketNumberSpace packetNumberSpace) {
-  return getNextOutstandingPacket(
-      conn, packetNumberSpace, conn.outstandingPackets.begin());
+  return conn.outstandingPackets.firstInSpace(packetNumberSpace);
 }
 
-std::deque<OutstandingPacket>::iterator getNextOutstandingPacket(
+OutstandingPackets::iterator getNextOutstandingPacket(
     QuicConnectionStateBase& conn,
     PacketNumberSpace packetNumberSpace,
-    std::deque<OutstandingPacket>::iterator from) {
-  return std::find_if(from, conn.outstandingPackets.end(), [=](const auto& op) {
-    return packetNumberSpace ==
-        folly::variant_match(op.packet.header, [](const auto& h) {
-             return h.getPacketNumberSpace();
-           });
-  });
+    OutstandingPackets::iterator from) {
+  return conn.outstandingPackets.nextInSpace(packetNumberSpace, from);
 }
 
 bool hasReceivedPacketsAtLastCloseSent(
@@ -276,6 +302,114 @@ folly::Optional<TimePoint>& getLossTime(
   folly::assume_unreachable();
 }
 
+ConnectionMemoryUsage getConnectionMemoryUsage(
+    const QuicConnectionStateBase& conn) {
+  ConnectionMemoryUsage usage;
+  // The write buffers of the streams are counted by the flow control.
+  usage.streamBufferBytes =
+      conn.streamBufferBytes + conn.flowControlState.sumCurStreamBufferLen;
+  usage.cryptoBufferBytes = conn.cryptoBufferBytes;
+  if (conn.cryptoState) {
+    usage.cryptoBufferBytes +=
+        conn.cryptoState->initialStream.writeBuffer.chainLength() +
+        conn.cryptoState->handshakeStream.writeBuffer.chainLength() +
+        conn.cryptoState->oneRttStream.writeBuffer.chainLength();
+  }
+  usage.outstandingPacketBytes = conn.outstandingPackets.memoryUsage();
+  return usage;
+}
+
+namespace {
+bool hasPendingCryptoData(const QuicCryptoStream& stream) {
+  return !stream.writeBuffer.empty() || !stream.retransmissionBuffer.empty() ||
+      !stream.lossBuffer.empty();
+}
+
+void releaseCryptoStreamBuffers(QuicCryptoStream& stream) {
+  // Assigning rather than clearing frees the containers. The offsets stay,
+  // they are reported with the transport info.
+  stream.readBuffer = StreamBufferList();
+  stream.writeBuffer =
+      folly::IOBufQueue(folly::IOBufQueue::cacheChainLength());
+  stream.retransmissionBuffer = StreamBufferList();
+  stream.lossBuffer = StreamBufferList();
+}
+} // namespace
+
+bool maybeDiscardHandshakeSpaces(QuicConnectionStateBase& conn) {
+  if (conn.handshakeSpacesDiscarded ||
+      !conn.transportSettings.discardHandshakeSpaces || !conn.readCodec ||
+      !conn.readCodec->getHandshakeDoneTime() || !conn.oneRttWriteCipher ||
+      !conn.readCodec->getOneRttReadCipher() || !conn.cryptoState) {
+    return false;
+  }
+  if (!conn.ackStates.appDataAckState.ackedByPeer ||
+      conn.outstandingHandshakePacketsCount > 0 ||
+      hasPendingCryptoData(conn.cryptoState->initialStream) ||
+      hasPendingCryptoData(conn.cryptoState->handshakeStream)) {
+    return false;
+  }
+  VLOG(10) << __func__ << " " << conn;
+  conn.ackStates.initialAckState = AckState();
+  conn.ackStates.handshakeAckState = AckState();
+  releaseCryptoStreamBuffers(conn.cryptoState->initialStream);
+  releaseCryptoStreamBuffers(conn.cryptoState->handshakeStream);
+  conn.lossState.initialLossTime = folly::none;
+  conn.lossState.handshakeLossTime = folly::none;
+  conn.initialWriteCipher.reset();
+  conn.initialHeaderCipher.reset();
+  conn.handshakeWriteCipher.reset();
+  conn.handshakeWriteHeaderCipher.reset();
+  conn.readCodec->setInitialReadCipher(nullptr);
+  conn.readCodec->setInitialHeaderCipher(nullptr);
+  conn.readCodec->setHandshakeReadCipher(nullptr);
+  conn.readCodec->setHandshakeHeaderCipher(nullptr);
+  conn.handshakeSpacesDiscarded = true;
+  if (conn.qLogger) {
+    conn.qLogger->addTransportStateUpdate(kHandshakeSpacesDiscarded);
+  }
+  return true;
+}
+
+void reportHandshakeDone(
+    QuicConnectionStateBase& conn,
+    const HandshakeTimings& timings) {
+  if (!timings.startTime || !timings.establishedTime) {
+    return;
+  }
+  auto sinceStart = [&timings](const folly::Optional<TimePoint>& time) {
+    return time ? std::chrono::duration_cast<std::chrono::microseconds>(
+                      *time - *timings.startTime)
+                : std::chrono::microseconds(0);
+  };
+  uint64_t cryptoBytesSent = 0;
+  uint64_t cryptoBytesRecvd = 0;
+  if (conn.cryptoState) {
+    for (const auto* stream : {&conn.cryptoState->initialStream,
+                               &conn.cryptoState->handshakeStream,
+                               &conn.cryptoState->oneRttStream}) {
+      cryptoBytesSent += stream->currentWriteOffset;
+      cryptoBytesRecvd += stream->maxOffsetObserved;
+    }
+  }
+  auto handshakeTime = sinceStart(timings.establishedTime);
+  QUIC_STATS(
+      conn.infoCallback,
+      onHandshakeDone,
+      handshakeTime,
+      timings.processingTime,
+      cryptoBytesSent,
+      cryptoBytesRecvd);
+  if (conn.qLogger) {
+    conn.qLogger->addHandshakeSummary(
+        handshakeTime,
+        sinceStart(timings.keysDerivedTime),
+        timings.processingTime,
+        cryptoBytesSent,
+        cryptoBytesRecvd);
+  }
+}
+
 std::pair<folly::Optional<TimePoint>, PacketNumberSpace> earliestLossTimer(
     const QuicConnectionStateBase& conn) noexcept {
   return minOptional(
@@ -14,6 +14,9 @@
 #include <quic/state/StateData.h>
 #include <quic/state/stream/StreamStateMachine.h>
 
+#include <algorithm>
+#include <limits>
+
 namespace quic {
 
 void updateAckSendStateOnRecvPacket(
@@ -23,6 +26,15 @@ void updateAckSendStateOnRecvPacket(
     bool pktHasRetransmittableData,
     bool pktHasCryptoData);
 
+/**
+ * Counts the ECN codepoint of a received packet. A CE marked packet is acked
+ * immediately, so that the peer can react to the congestion quickly.
+ */
+void updateEcnCountsOnRecvPacket(
+    QuicConnectionStateBase& conn,
+    AckState& ackState,
+    EcnCodepoint ecn);
+
 void updateAckStateOnAckTimeout(QuicConnectionStateBase& conn);
 
 void updateAckSendStateOnSentPacketWithAcks(
@@ -75,13 +87,15 @@ void increaseNextPacketNum(
 
 /**
  * Update largestReceivedPacketNum in ackState with packetNum. Return if the
- * current packetNum is received out of order.
+ * current packetNum is received out of order. Only the maxAckBlocks ranges
+ * of the largest packet numbers are kept in the acks.
  */
 template <typename ClockType = quic::Clock>
 bool updateLargestReceivedPacketNum(
     AckState& ackState,
     PacketNum packetNum,
-    TimePoint receivedTime) {
+    TimePoint receivedTime,
+    uint64_t maxAckBlocks = std::numeric_limits<uint64_t>::max()) {
   PacketNum expectedNextPacket = 0;
   if (ackState.largestReceivedPacketNum) {
     expectedNextPacket = *ackState.largestReceivedPacketNum + 1;
@@ -89,6 +103,10 @@ bool updateLargestReceivedPacketNum(
   ackState.largestReceivedPacketNum = std::max<PacketNum>(
       ackState.largestReceivedPacketNum.value_or(packetNum), packetNum);
   ackState.acks.insert(packetNum);
+  while (ackState.acks.size() > std::max<uint64_t>(maxAckBlocks, 1)) {
+    // These would never be written in an ack frame.
+    ackState.acks.pop_front();
+  }
   if (ackState.largestReceivedPacketNum == packetNum) {
     ackState.largestRecvdPacketTime = receivedTime;
   }
@@ -96,11 +114,11 @@ bool updateLargestReceivedPacketNum(
   return expectedNextPacket != packetNum;
 }
 
-std::deque<OutstandingPacket>::iterator getNextOutstandingPacket(
+OutstandingPackets::iterator getNextOutstandingPacket(
     QuicConnectionStateBase& conn,
     PacketNumberSpace packetNumberSpace,
-    std::deque<OutstandingPacket>::iterator from);
-std::deque<OutstandingPacket>::iterator getFirstOutstandingPacket(
+    OutstandingPackets::iterator from);
+OutstandingPackets::iterator getFirstOutstandingPacket(
     QuicConnectionStateBase& conn,
     PacketNumberSpace packetNumberSpace);
 
@@ -121,4 +139,29 @@ folly::Optional<TimePoint>& getLossTime(
 
 std::pair<folly::Optional<TimePoint>, PacketNumberSpace> earliestLossTimer(
     const QuicConnectionStateBase& conn) noexcept;
+
+/**
+ * Returns the memory held by the streams and the outstanding packets of the
+ * connection, from the counts that are kept as their buffers change, without
+ * walking them.
+ */
+ConnectionMemoryUsage getConnectionMemoryUsage(
+    const QuicConnectionStateBase& conn);
+
+/**
+ * Releases the ack states, crypto stream buffers and keys of the Initial and
+ * Handshake packet number spaces once neither end needs them any more: the
+ * handshake is done, the peer acked a 1-RTT packet, and nothing in those
+ * spaces is outstanding or left to send. The packets of those spaces are
+ * dropped from then on. Returns whether they were released by this call.
+ */
+bool maybeDiscardHandshakeSpaces(QuicConnectionStateBase& conn);
+
+/**
+ * Reports the timings of a completed handshake and the crypto data it
+ * exchanged to the stats callback and the qlog of the connection.
+ */
+void reportHandshakeDone(
+    QuicConnectionStateBase& conn,
+    const HandshakeTimings& timings);
 } // namespace quic
@@ -8,12 +8,14 @@
 
 #include <quic/state/QuicStreamFunctions.h>
 #include <quic/QuicException.h>
+#include <quic/common/LoopTime.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 #include <quic/logging/QuicLogger.h>
 #include <quic/state/QuicStreamUtilities.h>
 
 #include <folly/io/Cursor.h>
 #include <algorithm>
+#include <cstring>
 
 namespace {
 void prependToBuf(quic::Buf& buf, quic::Buf toAppend) {
@@ -23,6 +25,22 @@ void prependToBuf(quic::Buf& buf, quic::Buf toAppend) {
     buf = std::move(toAppend);
   }
 }
+
+// Copies data to the end of queue, into the tailroom of its last buffer as
+// long as that one is not shared, so that small writes do not each add a
+// buffer to the chain.
+void coalesceIntoQueue(folly::IOBufQueue& queue, const folly::IOBuf& data) {
+  for (auto range : data) {
+    while (!range.empty()) {
+      auto space =
+          queue.preallocate(1, quic::kStreamWriteCoalescingBufferSize);
+      auto len = std::min<size_t>(range.size(), space.second);
+      memcpy(space.first, range.data(), len);
+      queue.postallocate(len);
+      range.advance(len);
+    }
+  }
+}
 } // namespace
 
 namespace quic {
@@ -37,12 +55,33 @@ void writeDataToQuicStream(QuicStreamState& stream, Buf data, bool eof) {
     // write a blocked frame first time the stream becomes blocked
     maybeWriteBlockAfterAPIWrite(stream);
   }
-  stream.writeBuffer.append(std::move(data));
+  if (len > 0 &&
+      len <= stream.conn.transportSettings.streamWriteCoalescingThreshold) {
+    coalesceIntoQueue(stream.writeBuffer, *data);
+  } else {
+    stream.writeBuffer.append(std::move(data));
+  }
   if (eof) {
     auto bufferSize =
         stream.writeBuffer.front() ? stream.writeBuffer.chainLength() : 0;
     stream.finalWriteOffset = stream.currentWriteOffset + bufferSize;
   }
+  if (len > 0 && stream.dataExpiry && stream.dataExpiry->expiry) {
+    stream.dataExpiry->deadlines.emplace_back(
+        stream.currentWriteOffset + stream.writeBuffer.chainLength(),
+        LoopTime::now() + *stream.dataExpiry->expiry);
+    stream.conn.streamManager->addExpiringStream(stream.id);
+  }
+  if (len > 0 && stream.conn.transportSettings.trackDeliveryLatency) {
+    if (!stream.pendingDelivery) {
+      stream.pendingDelivery =
+          std::make_unique<QuicStreamState::PendingDeliveryState>();
+    }
+    stream.pendingDelivery->writes.push_back(
+        {stream.currentWriteOffset + stream.writeBuffer.chainLength(),
+         LoopTime::now(),
+         folly::none});
+  }
   updateFlowControlOnWriteToStream(stream, len);
   stream.conn.streamManager->updateWritableStreams(stream);
 }
@@ -56,7 +95,6 @@ void appendDataToReadBufferCommon(
     StreamBuffer buffer,
     folly::Function<void(uint64_t, uint64_t)>&& connFlowControlVisitor) {
   auto& readBuffer = stream.readBuffer;
-  auto it = readBuffer.begin();
 
   auto bufferEndOffset = buffer.offset + buffer.data.chainLength();
 
@@ -108,16 +146,35 @@ void appendDataToReadBufferCommon(
   }
 
   // Nothing in the buffer, just append it.
-  if (it == readBuffer.end()) {
+  if (readBuffer.empty()) {
+    readBuffer.emplace_back(std::move(buffer));
+    return;
+  }
+
+  // Data usually arrives in order, so check the tail before searching.
+  auto& tail = readBuffer.back();
+  auto tailEnd = tail.offset + tail.data.chainLength();
+  if (buffer.offset > tailEnd) {
     readBuffer.emplace_back(std::move(buffer));
     return;
+  } else if (buffer.offset == tailEnd) {
+    readBuffer.onDataAppended(buffer.data.chainLength());
+    tail.data.append(buffer.data.move());
+    return;
+  }
+
+  // Only the buffer starting at or right before the new one can be the first
+  // to overlap with it, the ones before that end before it starts.
+  auto it = readBuffer.upper_bound(buffer.offset);
+  if (it != readBuffer.begin()) {
+    --it;
   }
 
   // Start overlap will point to the first buffer that overlaps with the
   // current buffer and End overlap will point to the last buffer that overlaps.
   // They must always be set together.
-  folly::Optional<std::deque<StreamBuffer>::iterator> startOverlap;
-  folly::Optional<std::deque<StreamBuffer>::iterator> endOverlap;
+  folly::Optional<StreamBufferList::iterator> startOverlap;
+  folly::Optional<StreamBufferList::iterator> endOverlap;
 
   StreamBuffer* current = &buffer;
   bool currentAlreadyInserted = false;
@@ -139,8 +196,13 @@ void appendDataToReadBufferCommon(
         current->offset <= it->offset && currentEnd >= it->offset &&
         currentEnd <= itEnd) {
       // Left overlap. Done.
-      it->data.trimStartAtMost(currentEnd - it->offset);
+      readBuffer.onDataTrimmed(
+          it->data.trimStartAtMost(currentEnd - it->offset));
       if (it->data.chainLength() > 0) {
+        if (!currentAlreadyInserted) {
+          // The data leaves the list until current is inserted.
+          readBuffer.onDataTrimmed(it->data.chainLength());
+        }
         current->data.append(it->data.move());
       }
       if (!startOverlap) {
@@ -166,6 +228,7 @@ void appendDataToReadBufferCommon(
         currentEnd > itEnd) {
       // Right overlap. Not done.
       current->data.trimStartAtMost(itEnd - current->offset);
+      readBuffer.onDataAppended(current->data.chainLength());
       it->data.append(current->data.move());
       current = &(*it);
       currentAlreadyInserted = true;
@@ -207,6 +270,38 @@ void appendDataToReadBuffer(QuicStreamState& stream, StreamBuffer buffer) {
       });
 }
 
+bool receiveInOrderStreamData(QuicStreamState& stream, ReadStreamFrame& frame) {
+  if (frame.fin || !frame.data || frame.offset != stream.maxOffsetObserved ||
+      frame.offset < stream.currentReadOffset || stream.finalReadOffset ||
+      !matchesStates<StreamReceiveStateData, StreamReceiveStates::Open>(
+          stream.recv.state)) {
+    return false;
+  }
+  auto& readBuffer = stream.readBuffer;
+  if (!readBuffer.empty() &&
+      readBuffer.back().offset + readBuffer.back().data.chainLength() !=
+          frame.offset) {
+    return false;
+  }
+  auto len = frame.data->computeChainDataLength();
+  if (len == 0) {
+    return false;
+  }
+  auto bufferEndOffset = frame.offset + len;
+  updateFlowControlOnStreamData(
+      stream, stream.maxOffsetObserved, bufferEndOffset);
+  stream.maxOffsetObserved = bufferEndOffset;
+  if (readBuffer.empty()) {
+    readBuffer.emplace_back(std::move(frame.data), frame.offset, false);
+  } else {
+    readBuffer.back().data.append(std::move(frame.data));
+    readBuffer.onDataAppended(len);
+  }
+  stream.conn.streamManager->updateReadableStreams(stream);
+  stream.conn.streamManager->updatePeekableStreams(stream);
+  return true;
+}
+
 void appendDataToReadBuffer(QuicCryptoStream& stream, StreamBuffer buffer) {
   appendDataToReadBufferCommon(
       stream, std::move(buffer), [](uint64_t, uint64_t) {});
@@ -239,9 +334,13 @@ std::pair<Buf, bool> readDataInOrderFromReadBuffer(
     std::unique_ptr<folly::IOBuf> splice;
     if (sinkData) {
       curr->data.trimStart(toRead);
+    } else if (toRead == currSize) {
+      // Hand over the whole chain without walking it to split.
+      splice = curr->data.move();
     } else {
       splice = curr->data.split(toRead);
     }
+    stream.readBuffer.onDataTrimmed(toRead);
     curr->offset += toRead;
     if (curr->data.chainLength() == 0) {
       eof = curr->eof;
@@ -282,7 +381,7 @@ std::pair<Buf, bool> readDataFromQuicStream(
   std::tie(data, eof) = readDataInOrderFromReadBuffer(stream, amount);
   // Update flow control before handling eof as eof is not subject to flow
   // control
-  updateFlowControlOnRead(stream, lastReadOffset, Clock::now());
+  updateFlowControlOnRead(stream, lastReadOffset, LoopTime::now());
   eof = stream.finalReadOffset &&
       stream.currentReadOffset == *stream.finalReadOffset;
   if (eof) {
@@ -326,7 +425,7 @@ void consumeDataFromQuicStream(QuicStreamState& stream, uint64_t amount) {
   readDataInOrderFromReadBuffer(stream, amount, true /* sinkData */);
   // Update flow control before handling eof as eof is not subject to flow
   // control
-  updateFlowControlOnRead(stream, lastReadOffset, Clock::now());
+  updateFlowControlOnRead(stream, lastReadOffset, LoopTime::now());
   eof = stream.finalReadOffset &&
       stream.currentReadOffset == *stream.finalReadOffset;
   if (eof) {
@@ -386,6 +485,46 @@ uint64_t getStreamNextOffsetToDeliver(const QuicStreamState& stream) {
   return minOffsetToDeliver;
 }
 
+void updateDeliveryLatencyOnSent(QuicStreamState& stream, TimePoint sentTime) {
+  auto pendingDelivery = stream.pendingDelivery.get();
+  if (!pendingDelivery) {
+    return;
+  }
+  auto& writes = pendingDelivery->writes;
+  while (pendingDelivery->numSent < writes.size() &&
+         writes[pendingDelivery->numSent].endOffset <=
+             stream.currentWriteOffset) {
+    writes[pendingDelivery->numSent++].sentTime = sentTime;
+  }
+}
+
+void updateDeliveryLatencyOnAck(QuicStreamState& stream) {
+  auto pendingDelivery = stream.pendingDelivery.get();
+  if (!pendingDelivery || pendingDelivery->numSent == 0) {
+    return;
+  }
+  auto deliveredOffset = getStreamNextOffsetToDeliver(stream);
+  auto now = LoopTime::now();
+  auto& writes = pendingDelivery->writes;
+  while (pendingDelivery->numSent > 0 &&
+         writes.front().endOffset <= deliveredOffset) {
+    const auto& write = writes.front();
+    auto queueingTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        *write.sentTime - write.writeTime);
+    auto networkTime = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - *write.sentTime);
+    stream.deliveryLatency.add(queueingTime, networkTime);
+    stream.conn.deliveryLatency.add(queueingTime, networkTime);
+    QUIC_STATS(
+        stream.conn.infoCallback,
+        onStreamWriteDelivered,
+        queueingTime,
+        networkTime);
+    writes.pop_front();
+    pendingDelivery->numSent--;
+  }
+}
+
 void cancelHandshakeCryptoStreamRetransmissions(QuicCryptoState& cryptoState) {
   // Cancel any retransmissions we might want to do for the crypto stream.
   // This does not include data that is already deemed as lost, or data that
@@ -416,13 +555,7 @@ void processCryptoStreamAck(
     QuicCryptoStream& cryptoStream,
     uint64_t offset,
     uint64_t len) {
-  auto ackedBuffer = std::lower_bound(
-      cryptoStream.retransmissionBuffer.begin(),
-      cryptoStream.retransmissionBuffer.end(),
-      offset,
-      [](const auto& buffer, const auto& offset) {
-        return buffer.offset < offset;
-      });
+  auto ackedBuffer = cryptoStream.retransmissionBuffer.lower_bound(offset);
 
   if (ackedBuffer == cryptoStream.retransmissionBuffer.end() ||
       ackedBuffer->offset != offset || ackedBuffer->data.chainLength() != len) {
@@ -480,4 +613,95 @@ bool ackFrameMatchesRetransmitBuffer(
   }
   return match;
 }
+
+void setStreamSendRateLimit(
+    QuicStreamState& stream,
+    uint64_t bytesPerSec,
+    uint64_t burstBytes,
+    TimePoint now) {
+  auto& streamManager = *stream.conn.streamManager;
+  if (bytesPerSec == 0) {
+    stream.sendRateLimit.reset();
+    streamManager.removeRateLimitedStream(stream.id);
+    streamManager.updateWritableStreams(stream);
+    return;
+  }
+  if (!stream.sendRateLimit) {
+    stream.sendRateLimit =
+        std::make_unique<QuicStreamState::SendRateLimitState>();
+    stream.sendRateLimit->tokens = burstBytes;
+    stream.sendRateLimit->lastRefill = now;
+  } else {
+    // What was earned so far is at the old rate.
+    refillStreamSendRate(stream, now);
+  }
+  auto& limit = *stream.sendRateLimit;
+  limit.bytesPerSec = bytesPerSec;
+  limit.burstBytes = std::max<uint64_t>(burstBytes, 1);
+  limit.tokens = std::min(limit.tokens, limit.burstBytes);
+  if (limit.tokens == 0) {
+    streamManager.addRateLimitedStream(stream.id);
+  } else {
+    streamManager.removeRateLimitedStream(stream.id);
+  }
+  streamManager.updateWritableStreams(stream);
+}
+
+void refillStreamSendRate(QuicStreamState& stream, TimePoint now) {
+  if (!stream.sendRateLimit) {
+    return;
+  }
+  auto& limit = *stream.sendRateLimit;
+  if (now > limit.lastRefill) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - limit.lastRefill);
+    auto earned = static_cast<uint64_t>(
+        static_cast<double>(elapsed.count()) * limit.bytesPerSec / 1000000);
+    if (limit.tokens + earned >= limit.burstBytes) {
+      limit.tokens = limit.burstBytes;
+      limit.lastRefill = now;
+    } else {
+      // Only the time of the whole bytes earned, the rest counts towards the
+      // next refill.
+      limit.tokens += earned;
+      limit.lastRefill += std::chrono::microseconds(
+          earned * 1000000 / limit.bytesPerSec);
+    }
+  }
+  if (limit.tokens > 0) {
+    stream.conn.streamManager->removeRateLimitedStream(stream.id);
+    stream.conn.streamManager->updateWritableStreams(stream);
+  }
+}
+
+void consumeStreamSendRate(
+    QuicStreamState& stream,
+    uint64_t bytes,
+    TimePoint sentTime) {
+  if (!stream.sendRateLimit) {
+    return;
+  }
+  refillStreamSendRate(stream, sentTime);
+  auto& limit = *stream.sendRateLimit;
+  limit.tokens -= std::min(limit.tokens, bytes);
+  if (limit.tokens == 0) {
+    stream.conn.streamManager->addRateLimitedStream(stream.id);
+  }
+}
+
+TimePoint getStreamSendRateRefillTime(
+    const QuicStreamState& stream,
+    uint64_t minBytes) {
+  CHECK(stream.sendRateLimit);
+  const auto& limit = *stream.sendRateLimit;
+  auto needed = std::min(minBytes, limit.burstBytes);
+  if (limit.tokens >= needed) {
+    return limit.lastRefill;
+  }
+  // Rounded up, so that the tokens are there by then.
+  return limit.lastRefill +
+      std::chrono::microseconds(
+             ((needed - limit.tokens) * 1000000 + limit.bytesPerSec - 1) /
+             limit.bytesPerSec);
+}
 } // namespace quic
@@ -35,6 +35,18 @@ void writeDataToQuicStream(QuicCryptoStream& stream, Buf data);
  */
 void appendDataToReadBuffer(QuicStreamState& stream, StreamBuffer buffer);
 
+/**
+ * The fast path for the data that arrives in order on an open stream: the
+ * next bytes after all that was received so far, without a FIN. Appends
+ * them to the read buffer and updates the readable and peekable streams
+ * without going through the receive state machine and the checks of
+ * appendDataToReadBuffer, none of which apply. Returns false and leaves the
+ * frame untouched for any other data, which the state machine then handles.
+ *
+ * @throws QuicTransportException on a flow control error.
+ */
+bool receiveInOrderStreamData(QuicStreamState& stream, ReadStreamFrame& frame);
+
 /**
  * Process data received from the network to add it to the crypto stream.
  * appendDataToReadBuffer handles any reordered or non contiguous data.
@@ -63,7 +75,7 @@ Buf readDataFromCryptoStream(QuicCryptoStream& stream, uint64_t amount = 0);
  * Invokes provided callback on the existing data.
  * Does not affect stream state (as opposed to read).
  */
-using PeekIterator = std::deque<StreamBuffer>::const_iterator;
+using PeekIterator = StreamBufferList::const_iterator;
 void peekDataFromQuicStream(
     QuicStreamState& state,
     const folly::Function<void(StreamId id, const folly::Range<PeekIterator>&)
@@ -97,6 +109,18 @@ uint64_t getLargestWriteOffsetSeen(const QuicStreamState& stream);
  */
 uint64_t getStreamNextOffsetToDeliver(const QuicStreamState& stream);
 
+/**
+ * Record the time the sent writes of the stream were last sent at, after new
+ * data of it was sent at sentTime.
+ */
+void updateDeliveryLatencyOnSent(QuicStreamState& stream, TimePoint sentTime);
+
+/**
+ * Count the latency of the writes of the stream that are delivered after an
+ * ack, to the stream, the connection and the stats callback.
+ */
+void updateDeliveryLatencyOnAck(QuicStreamState& stream);
+
 /**
  * Common functions for merging data into the read buffer for a Quic stream like
  * object. Callers should provide a connFlowControlVisitor which will be invoked
@@ -147,4 +171,38 @@ bool ackFrameMatchesRetransmitBuffer(
     const QuicStreamState& stream,
     const WriteStreamFrame& ackFrame,
     const StreamBuffer& buf);
+
+/**
+ * Limits the new data the stream writes to bytesPerSec, in bursts of up to
+ * burstBytes, or removes the limit when bytesPerSec is 0. The bucket of a
+ * stream that was not limited starts full.
+ */
+void setStreamSendRateLimit(
+    QuicStreamState& stream,
+    uint64_t bytesPerSec,
+    uint64_t burstBytes,
+    TimePoint now);
+
+/**
+ * Adds the tokens the stream earned since the last refill, up to its burst,
+ * and makes it writable again if it had run out of them.
+ */
+void refillStreamSendRate(QuicStreamState& stream, TimePoint now);
+
+/**
+ * Takes the new bytes the stream wrote at sentTime from its tokens. Out of
+ * tokens, the stream is in the rate limited streams until a refill.
+ */
+void consumeStreamSendRate(
+    QuicStreamState& stream,
+    uint64_t bytes,
+    TimePoint sentTime);
+
+/**
+ * The time at which the stream will have earned minBytes tokens, or its
+ * whole burst if that is less.
+ */
+TimePoint getStreamSendRateRefillTime(
+    const QuicStreamState& stream,
+    uint64_t minBytes);
 } // namespace quic
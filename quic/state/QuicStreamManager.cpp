@@ -8,6 +8,7 @@
 
 #include "quic/state/QuicStreamManager.h"
 
+#include <quic/common/LoopTime.h>
 #include <quic/state/QuicStreamUtilities.h>
 
 namespace quic {
@@ -39,7 +40,7 @@ static void updateHolBlockedTime(QuicStreamState& stream) {
     if (stream.lastHolbTime) {
       stream.totalHolbTime +=
           std::chrono::duration_cast<std::chrono::microseconds>(
-              Clock::now() - *stream.lastHolbTime);
+              LoopTime::now() - *stream.lastHolbTime);
       stream.lastHolbTime = folly::none;
     }
     return;
@@ -51,7 +52,7 @@ static void updateHolBlockedTime(QuicStreamState& stream) {
     return;
   }
   // If we were previously not HOL blocked, we are now.
-  stream.lastHolbTime = Clock::now();
+  stream.lastHolbTime = LoopTime::now();
   stream.holbCount++;
 }
 
@@ -93,12 +94,7 @@ static LocalErrorCode openStreamIfNotClosed(
 }
 
 QuicStreamState* QuicStreamManager::findStream(StreamId streamId) {
-  auto lookup = streams_.find(streamId);
-  if (lookup == streams_.end()) {
-    return nullptr;
-  } else {
-    return &lookup->second;
-  }
+  return streams_.find(streamId);
 }
 
 void QuicStreamManager::setMaxLocalBidirectionalStreams(
@@ -131,6 +127,175 @@ void QuicStreamManager::setMaxLocalUnidirectionalStreams(
   }
 }
 
+void QuicStreamManager::setMaxRemoteBidirectionalStreams(uint64_t maxStreams) {
+  setMaxRemoteStreams(true, maxStreams);
+}
+
+void QuicStreamManager::setMaxRemoteUnidirectionalStreams(
+    uint64_t maxStreams) {
+  setMaxRemoteStreams(false, maxStreams);
+}
+
+void QuicStreamManager::setMaxRemoteStreams(
+    bool bidirectional,
+    uint64_t maxStreams) {
+  if (maxStreams > kMaxMaxStreams) {
+    throw QuicTransportException(
+        "Attempt to set maxStreams beyond the max allowed.",
+        TransportErrorCode::STREAM_LIMIT_ERROR);
+  }
+  auto& credit = remoteStreamCredit(bidirectional);
+  credit.window = maxStreams;
+  credit.lastGrantTime = LoopTime::now();
+  if (bidirectional) {
+    maxRemoteBidirectionalStreamId_ =
+        maxStreams * detail::kStreamIncrement +
+        initialPeerBidirectionalStreamId_;
+  } else {
+    maxRemoteUnidirectionalStreamId_ =
+        maxStreams * detail::kStreamIncrement +
+        initialPeerUnidirectionalStreamId_;
+  }
+}
+
+uint64_t QuicStreamManager::remoteStreamLimit(bool bidirectional) const {
+  return bidirectional
+      ? (maxRemoteBidirectionalStreamId_ - initialPeerBidirectionalStreamId_) /
+          detail::kStreamIncrement
+      : (maxRemoteUnidirectionalStreamId_ -
+         initialPeerUnidirectionalStreamId_) /
+          detail::kStreamIncrement;
+}
+
+void QuicStreamManager::grantRemoteStreamCredit(bool bidirectional) {
+  maybeGrantRemoteStreamCredit(bidirectional, true /* force */);
+}
+
+void QuicStreamManager::maybeGrantRemoteStreamCredit(
+    bool bidirectional,
+    bool force) {
+  auto& credit = remoteStreamCredit(bidirectional);
+  if (credit.window == 0) {
+    return;
+  }
+  auto limit = remoteStreamLimit(bidirectional);
+  // Only the streams that are gone are granted again, so that the peer never
+  // has more than the window open.
+  auto newLimit = std::min(credit.numRetired + credit.window, kMaxMaxStreams);
+  if (newLimit <= limit) {
+    return;
+  }
+  auto numOpened = bidirectional
+      ? (nextAcceptablePeerBidirectionalStreamId_ -
+         initialPeerBidirectionalStreamId_) /
+          detail::kStreamIncrement
+      : (nextAcceptablePeerUnidirectionalStreamId_ -
+         initialPeerUnidirectionalStreamId_) /
+          detail::kStreamIncrement;
+  auto now = LoopTime::now();
+  if (!force) {
+    // The streams the peer opens by the time the next batch reaches it.
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - credit.lastGrantTime);
+    auto srtt = conn_.lossState.srtt == 0us ? kDefaultInitialRtt
+                                            : conn_.lossState.srtt;
+    uint64_t batch = credit.window;
+    if (elapsed.count() > 0) {
+      batch = (numOpened - credit.numOpenedAtLastGrant) *
+          kStreamCreditBatchRtts * srtt.count() / elapsed.count();
+    }
+    batch = std::max(batch, credit.window / kMinStreamCreditBatchDivisor);
+    batch = std::min(batch, credit.window);
+    if (newLimit - limit < batch && limit - numOpened >= batch) {
+      return;
+    }
+  }
+  VLOG(10) << "Granting peer " << (bidirectional ? "bidi" : "uni")
+           << " streams=" << newLimit << " " << conn_;
+  if (bidirectional) {
+    maxRemoteBidirectionalStreamId_ = newLimit * detail::kStreamIncrement +
+        initialPeerBidirectionalStreamId_;
+  } else {
+    maxRemoteUnidirectionalStreamId_ = newLimit * detail::kStreamIncrement +
+        initialPeerUnidirectionalStreamId_;
+  }
+  credit.numOpenedAtLastGrant = numOpened;
+  credit.lastGrantTime = now;
+  credit.updatePending = true;
+}
+
+folly::Optional<MaxStreamsFrame> QuicStreamManager::streamLimitUpdate(
+    bool bidirectional) const {
+  const auto& credit = bidirectional ? remoteBidirectionalStreamCredit_
+                                     : remoteUnidirectionalStreamCredit_;
+  if (!credit.updatePending) {
+    return folly::none;
+  }
+  return MaxStreamsFrame(remoteStreamLimit(bidirectional), bidirectional);
+}
+
+void QuicStreamManager::onStreamLimitUpdateSent(const MaxStreamsFrame& frame) {
+  if (frame.maxStreams >= remoteStreamLimit(frame.isForBidirectional)) {
+    remoteStreamCredit(frame.isForBidirectional).updatePending = false;
+  }
+}
+
+void QuicStreamManager::onStreamLimitUpdateLost(const MaxStreamsFrame& frame) {
+  if (frame.maxStreams == remoteStreamLimit(frame.isForBidirectional)) {
+    remoteStreamCredit(frame.isForBidirectional).updatePending = true;
+  }
+}
+
+QuicStreamManager::StreamIdState QuicStreamManager::getStreamIdState() const {
+  StreamIdState state;
+  state.nextAcceptablePeerBidirectionalStreamId =
+      nextAcceptablePeerBidirectionalStreamId_;
+  state.nextAcceptablePeerUnidirectionalStreamId =
+      nextAcceptablePeerUnidirectionalStreamId_;
+  state.nextAcceptableLocalBidirectionalStreamId =
+      nextAcceptableLocalBidirectionalStreamId_;
+  state.nextAcceptableLocalUnidirectionalStreamId =
+      nextAcceptableLocalUnidirectionalStreamId_;
+  state.nextBidirectionalStreamId = nextBidirectionalStreamId_;
+  state.nextUnidirectionalStreamId = nextUnidirectionalStreamId_;
+  state.maxLocalBidirectionalStreamId = maxLocalBidirectionalStreamId_;
+  state.maxLocalUnidirectionalStreamId = maxLocalUnidirectionalStreamId_;
+  state.maxRemoteBidirectionalStreamId = maxRemoteBidirectionalStreamId_;
+  state.maxRemoteUnidirectionalStreamId = maxRemoteUnidirectionalStreamId_;
+  return state;
+}
+
+void QuicStreamManager::restoreStreamIdState(const StreamIdState& state) {
+  CHECK(streams_.empty());
+  nextAcceptablePeerBidirectionalStreamId_ =
+      state.nextAcceptablePeerBidirectionalStreamId;
+  nextAcceptablePeerUnidirectionalStreamId_ =
+      state.nextAcceptablePeerUnidirectionalStreamId;
+  nextAcceptableLocalBidirectionalStreamId_ =
+      state.nextAcceptableLocalBidirectionalStreamId;
+  nextAcceptableLocalUnidirectionalStreamId_ =
+      state.nextAcceptableLocalUnidirectionalStreamId;
+  nextBidirectionalStreamId_ = state.nextBidirectionalStreamId;
+  nextUnidirectionalStreamId_ = state.nextUnidirectionalStreamId;
+  maxLocalBidirectionalStreamId_ = state.maxLocalBidirectionalStreamId;
+  maxLocalUnidirectionalStreamId_ = state.maxLocalUnidirectionalStreamId;
+  maxRemoteBidirectionalStreamId_ = state.maxRemoteBidirectionalStreamId;
+  maxRemoteUnidirectionalStreamId_ = state.maxRemoteUnidirectionalStreamId;
+  // With no stream open, all the peer streams that were opened are retired.
+  remoteBidirectionalStreamCredit_.numRetired =
+      (nextAcceptablePeerBidirectionalStreamId_ -
+       initialPeerBidirectionalStreamId_) /
+      detail::kStreamIncrement;
+  remoteUnidirectionalStreamCredit_.numRetired =
+      (nextAcceptablePeerUnidirectionalStreamId_ -
+       initialPeerUnidirectionalStreamId_) /
+      detail::kStreamIncrement;
+  remoteBidirectionalStreamCredit_.numOpenedAtLastGrant =
+      remoteBidirectionalStreamCredit_.numRetired;
+  remoteUnidirectionalStreamCredit_.numOpenedAtLastGrant =
+      remoteUnidirectionalStreamCredit_.numRetired;
+}
+
 // We create local streams lazily. If a local stream was created
 // but not allocated yet, this will allocate a stream.
 // This will return nullptr if a stream is closed or un-opened.
@@ -140,12 +305,9 @@ QuicStreamManager::getOrCreateOpenedLocalStream(StreamId streamId) {
       std::find(openLocalStreams_.begin(), openLocalStreams_.end(), streamId);
   if (streamIdx != openLocalStreams_.end()) {
     // Open a lazily created stream.
-    auto it = streams_.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(streamId),
-        std::forward_as_tuple(streamId, conn_));
+    auto& stream = streams_.emplace(streamId, conn_);
     QUIC_STATS(conn_.infoCallback, onNewQuicStream);
-    return &it.first->second;
+    return &stream;
   }
   return nullptr;
 }
@@ -156,9 +318,9 @@ QuicStreamState* QuicStreamManager::getStream(StreamId streamId) {
     updateAppIdleState();
     return stream;
   }
-  auto it = streams_.find(streamId);
-  if (it != streams_.end()) {
-    return &it->second;
+  auto existingStream = streams_.find(streamId);
+  if (existingStream) {
+    return existingStream;
   }
   auto stream = getOrCreateOpenedLocalStream(streamId);
   auto nextAcceptableStreamId = isUnidirectionalStream(streamId)
@@ -214,19 +376,16 @@ QuicStreamManager::getOrCreatePeerStream(StreamId streamId) {
   }
 
   auto peerStream = streams_.find(streamId);
-  if (peerStream != streams_.end()) {
-    return &peerStream->second;
+  if (peerStream) {
+    return peerStream;
   }
   auto streamIdx =
       std::find(openPeerStreams_.begin(), openPeerStreams_.end(), streamId);
   if (streamIdx != openPeerStreams_.end()) {
     // Stream was already open, create the state for it lazily.
-    auto it = streams_.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(streamId),
-        std::forward_as_tuple(streamId, conn_));
+    auto& stream = streams_.emplace(streamId, conn_);
     QUIC_STATS(conn_.infoCallback, onNewQuicStream);
-    return &it.first->second;
+    return &stream;
   }
 
   auto previousPeerStreams = openPeerStreams_;
@@ -254,12 +413,9 @@ QuicStreamManager::getOrCreatePeerStream(StreamId streamId) {
       std::make_move_iterator(previousPeerStreams.end()),
       std::back_inserter(newPeerStreams_));
 
-  auto it = streams_.emplace(
-      std::piecewise_construct,
-      std::forward_as_tuple(streamId),
-      std::forward_as_tuple(streamId, conn_));
+  auto& stream = streams_.emplace(streamId, conn_);
   QUIC_STATS(conn_.infoCallback, onNewQuicStream);
-  return &it.first->second;
+  return &stream;
 }
 
 folly::Expected<QuicStreamState*, LocalErrorCode>
@@ -273,7 +429,7 @@ QuicStreamManager::createStream(StreamId streamId) {
         "Attempted creating non-server stream on server",
         TransportErrorCode::STREAM_STATE_ERROR);
   }
-  if (streams_.count(streamId) > 0) {
+  if (streams_.contains(streamId)) {
     throw QuicTransportException(
         "Creating an active stream", TransportErrorCode::STREAM_STATE_ERROR);
   }
@@ -293,30 +449,29 @@ QuicStreamManager::createStream(StreamId streamId) {
   if (openedResult != LocalErrorCode::NO_ERROR) {
     return folly::makeUnexpected(openedResult);
   }
-  auto it = streams_.emplace(
-      std::piecewise_construct,
-      std::forward_as_tuple(streamId),
-      std::forward_as_tuple(streamId, conn_));
+  auto& stream = streams_.emplace(streamId, conn_);
   QUIC_STATS(conn_.infoCallback, onNewQuicStream);
   updateAppIdleState();
-  return &it.first->second;
+  return &stream;
 }
 
 void QuicStreamManager::removeClosedStream(StreamId streamId) {
-  auto it = streams_.find(streamId);
-  if (it == streams_.end()) {
+  auto stream = streams_.find(streamId);
+  if (!stream) {
     VLOG(10) << "Trying to remove already closed stream=" << streamId;
     return;
   }
   VLOG(10) << "Removing closed stream=" << streamId;
-  bool inTerminalStates = it->second.inTerminalStates();
+  bool inTerminalStates = stream->inTerminalStates();
   DCHECK(inTerminalStates);
   readableStreams_.erase(streamId);
   peekableStreams_.erase(streamId);
-  writableStreams_.erase(streamId);
+  removeWritable(streamId);
   blockedStreams_.erase(streamId);
   deliverableStreams_.erase(streamId);
   windowUpdates_.erase(streamId);
+  expiringStreams_.erase(streamId);
+  rateLimitedStreams_.erase(streamId);
   auto itr = std::find(lossStreams_.begin(), lossStreams_.end(), streamId);
   if (itr != lossStreams_.end()) {
     lossStreams_.erase(itr);
@@ -325,16 +480,19 @@ void QuicStreamManager::removeClosedStream(StreamId streamId) {
   if (stopItr != stopSendingStreams_.end()) {
     stopSendingStreams_.erase(stopItr);
   }
-  if (it->second.isControl) {
+  if (stream->isControl) {
     DCHECK_GT(numControlStreams_, 0);
     numControlStreams_--;
   }
-  streams_.erase(it);
+  streams_.erase(streamId);
   QUIC_STATS(conn_.infoCallback, onQuicStreamClosed);
   auto streamItr =
       std::find(openPeerStreams_.begin(), openPeerStreams_.end(), streamId);
   if (streamItr != openPeerStreams_.end()) {
     openPeerStreams_.erase(streamItr);
+    auto bidirectional = isBidirectionalStream(streamId);
+    remoteStreamCredit(bidirectional).numRetired++;
+    maybeGrantRemoteStreamCredit(bidirectional, false /* force */);
   } else {
     streamItr =
         std::find(openLocalStreams_.begin(), openLocalStreams_.end(), streamId);
@@ -384,6 +542,40 @@ void QuicStreamManager::updateWritableStreams(QuicStreamState& stream) {
   }
 }
 
+void QuicStreamManager::addWritable(StreamId streamId) {
+  writableStreams_.insert(streamId);
+  auto stream = streams_.find(streamId);
+  auto priority = stream ? stream->priority : StreamPriority();
+  writableStreamsByUrgency_[priority.urgency].insert(streamId);
+  if (!priority.incremental) {
+    writableSequentialStreams_[priority.urgency].insert(streamId);
+  }
+}
+
+void QuicStreamManager::removeWritable(StreamId streamId) {
+  if (writableStreams_.erase(streamId) == 0) {
+    return;
+  }
+  auto stream = streams_.find(streamId);
+  auto priority = stream ? stream->priority : StreamPriority();
+  writableStreamsByUrgency_[priority.urgency].erase(streamId);
+  writableSequentialStreams_[priority.urgency].erase(streamId);
+}
+
+void QuicStreamManager::setStreamPriority(
+    QuicStreamState& stream,
+    StreamPriority priority) {
+  // Move the stream to the sets of its new urgency.
+  bool writable = writableContains(stream.id);
+  if (writable) {
+    removeWritable(stream.id);
+  }
+  stream.priority = priority;
+  if (writable) {
+    addWritable(stream.id);
+  }
+}
+
 void QuicStreamManager::updatePeekableStreams(QuicStreamState& stream) {
   auto itr = peekableStreams_.find(stream.id);
   if (!stream.hasPeekableData() || stream.streamReadError.hasValue()) {
@@ -414,7 +606,7 @@ void QuicStreamManager::updateAppIdleState() {
   }
   isAppIdle_ = !currentNonCtrlStreams;
   if (conn_.congestionController) {
-    conn_.congestionController->setAppIdle(isAppIdle_, Clock::now());
+    conn_.congestionController->setAppIdle(isAppIdle_, LoopTime::now());
   }
 }
 
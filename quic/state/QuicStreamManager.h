@@ -11,6 +11,9 @@
 #include <quic/QuicConstants.h>
 #include <quic/codec/Types.h>
 #include <quic/state/StreamData.h>
+#include <quic/state/StreamIdSet.h>
+#include <quic/state/StreamTable.h>
+#include <array>
 #include <deque>
 #include <map>
 #include <numeric>
@@ -39,6 +42,8 @@ class QuicStreamManager {
       nextUnidirectionalStreamId_ = 0x03;
       initialBidirectionalStreamId_ = 0x01;
       initialUnidirectionalStreamId_ = 0x03;
+      initialPeerBidirectionalStreamId_ = 0x00;
+      initialPeerUnidirectionalStreamId_ = 0x02;
     } else {
       nextAcceptablePeerBidirectionalStreamId_ = 0x01;
       nextAcceptablePeerUnidirectionalStreamId_ = 0x03;
@@ -48,6 +53,8 @@ class QuicStreamManager {
       nextUnidirectionalStreamId_ = 0x02;
       initialBidirectionalStreamId_ = 0x00;
       initialUnidirectionalStreamId_ = 0x02;
+      initialPeerBidirectionalStreamId_ = 0x01;
+      initialPeerUnidirectionalStreamId_ = 0x03;
     }
   }
   /*
@@ -174,9 +181,7 @@ class QuicStreamManager {
    * Call the given function on every currently open stream's state.
    */
   void streamStateForEach(const std::function<void(QuicStreamState&)>& f) {
-    for (auto& s : streams_) {
-      f(s.second);
-    }
+    streams_.forEach(f);
   }
 
   const auto& lossStreams() const {
@@ -215,26 +220,49 @@ class QuicStreamManager {
   }
 
   /*
-   * Add a writable stream id.
+   * Returns the writable streams with the given urgency.
    */
-  void addWritable(StreamId streamId) {
-    writableStreams_.insert(streamId);
+  const StreamIdSet& writableStreamsWithUrgency(uint8_t urgency) const {
+    return writableStreamsByUrgency_[urgency];
   }
 
   /*
-   * Remove a writable stream id.
+   * Returns the writable streams with the given urgency that are not
+   * incremental.
    */
-  void removeWritable(StreamId streamId) {
-    writableStreams_.erase(streamId);
+  const StreamIdSet& writableSequentialStreamsWithUrgency(
+      uint8_t urgency) const {
+    return writableSequentialStreams_[urgency];
   }
 
+  /*
+   * Add a writable stream id.
+   */
+  void addWritable(StreamId streamId);
+
+  /*
+   * Remove a writable stream id.
+   */
+  void removeWritable(StreamId streamId);
+
   /*
    * Clear the writable streams.
    */
   void clearWritable() {
     writableStreams_.clear();
+    for (auto& streams : writableStreamsByUrgency_) {
+      streams.clear();
+    }
+    for (auto& streams : writableSequentialStreams_) {
+      streams.clear();
+    }
   }
 
+  /*
+   * Sets the scheduling priority of the stream.
+   */
+  void setStreamPriority(QuicStreamState& stream, StreamPriority priority);
+
   /*
    * Returns a const reference to the underlying blocked streams container.
    */
@@ -277,6 +305,80 @@ class QuicStreamManager {
       uint64_t maxStreams,
       bool force = false);
 
+  /*
+   * Limit the peer to maxStreams bidirectional streams open at once. The
+   * credit of the peer streams that are closed and removed is granted back in
+   * MAX_STREAMS frames, in batches sized to the rate the peer opens streams
+   * at. Must be called before the peer opens any stream.
+   */
+  void setMaxRemoteBidirectionalStreams(uint64_t maxStreams);
+
+  /*
+   * The same for the unidirectional streams of the peer.
+   */
+  void setMaxRemoteUnidirectionalStreams(uint64_t maxStreams);
+
+  /*
+   * Grant the peer the credit of its closed streams of the type right away,
+   * as when it is blocked on the limit.
+   */
+  void grantRemoteStreamCredit(bool bidirectional);
+
+  /*
+   * Returns the number of streams of the type the peer may open in total.
+   */
+  uint64_t remoteStreamLimit(bool bidirectional) const;
+
+  /*
+   * Returns the MAX_STREAMS frame for the type if a new limit is yet to be
+   * sent.
+   */
+  folly::Optional<MaxStreamsFrame> streamLimitUpdate(bool bidirectional) const;
+
+  /*
+   * Returns whether a new limit of either type is yet to be sent.
+   */
+  bool hasStreamLimitUpdates() const {
+    return remoteBidirectionalStreamCredit_.updatePending ||
+        remoteUnidirectionalStreamCredit_.updatePending;
+  }
+
+  /*
+   * Called when a MAX_STREAMS frame is sent.
+   */
+  void onStreamLimitUpdateSent(const MaxStreamsFrame& frame);
+
+  /*
+   * Called when a MAX_STREAMS frame is lost. It is sent again unless a newer
+   * limit was granted since.
+   */
+  void onStreamLimitUpdateLost(const MaxStreamsFrame& frame);
+
+  /*
+   * The stream ids that are used up and allowed on the connection. This is
+   * all that is left of the streams of the connection once they are closed.
+   */
+  struct StreamIdState {
+    StreamId nextAcceptablePeerBidirectionalStreamId{0};
+    StreamId nextAcceptablePeerUnidirectionalStreamId{0};
+    StreamId nextAcceptableLocalBidirectionalStreamId{0};
+    StreamId nextAcceptableLocalUnidirectionalStreamId{0};
+    StreamId nextBidirectionalStreamId{0};
+    StreamId nextUnidirectionalStreamId{0};
+    StreamId maxLocalBidirectionalStreamId{0};
+    StreamId maxLocalUnidirectionalStreamId{0};
+    StreamId maxRemoteBidirectionalStreamId{0};
+    StreamId maxRemoteUnidirectionalStreamId{0};
+  };
+
+  StreamIdState getStreamIdState() const;
+
+  /*
+   * Continue from the stream ids of a connection that was handed off by
+   * another process. Must be called before any stream is opened.
+   */
+  void restoreStreamIdState(const StreamIdState& state);
+
   /*
    * Returns a const reference to the underlying stream window updates
    * container.
@@ -420,6 +522,37 @@ class QuicStreamManager {
     dataExpiredStreams_.clear();
   }
 
+  /*
+   * Returns the streams that have data expiring with time.
+   */
+  const StreamIdSet& expiringStreams() const {
+    return expiringStreams_;
+  }
+
+  void addExpiringStream(StreamId streamId) {
+    expiringStreams_.insert(streamId);
+  }
+
+  void removeExpiringStream(StreamId streamId) {
+    expiringStreams_.erase(streamId);
+  }
+
+  /*
+   * Returns the streams that are out of send rate tokens, and wait for them
+   * to refill.
+   */
+  const StreamIdSet& rateLimitedStreams() const {
+    return rateLimitedStreams_;
+  }
+
+  void addRateLimitedStream(StreamId streamId) {
+    rateLimitedStreams_.insert(streamId);
+  }
+
+  void removeRateLimitedStream(StreamId streamId) {
+    rateLimitedStreams_.erase(streamId);
+  }
+
   // TODO figure out a better interface here.
   /*
    * Returns a mutable reference to the underlying readable streams container.
@@ -579,6 +712,31 @@ class QuicStreamManager {
 
   QuicStreamState* FOLLY_NULLABLE getOrCreatePeerStream(StreamId streamId);
 
+  // The stream credit granted to the peer for one type of its streams.
+  struct RemoteStreamCredit {
+    // Number of peer streams that may be open at once, zero when the credit
+    // is not managed.
+    uint64_t window{0};
+    // Number of peer streams that were closed and removed.
+    uint64_t numRetired{0};
+    // Number of peer streams opened when credit was last granted, and when.
+    uint64_t numOpenedAtLastGrant{0};
+    TimePoint lastGrantTime;
+    // Whether the current limit is yet to be sent.
+    bool updatePending{false};
+  };
+
+  RemoteStreamCredit& remoteStreamCredit(bool bidirectional) {
+    return bidirectional ? remoteBidirectionalStreamCredit_
+                         : remoteUnidirectionalStreamCredit_;
+  }
+
+  void setMaxRemoteStreams(bool bidirectional, uint64_t maxStreams);
+
+  // Raises the limit of the peer to the credit of its retired streams once
+  // that is at least a batch, or the peer would run out before the next one.
+  void maybeGrantRemoteStreamCredit(bool bidirectional, bool force);
+
   QuicConnectionStateBase& conn_;
   QuicNodeType nodeType_;
 
@@ -616,6 +774,14 @@ class QuicStreamManager {
 
   StreamId initialUnidirectionalStreamId_{0};
 
+  StreamId initialPeerBidirectionalStreamId_{0};
+
+  StreamId initialPeerUnidirectionalStreamId_{0};
+
+  RemoteStreamCredit remoteBidirectionalStreamCredit_;
+
+  RemoteStreamCredit remoteUnidirectionalStreamCredit_;
+
   uint64_t numControlStreams_{0};
 
   // Streams that are opened by the peer on the connection. Ordered by id.
@@ -624,19 +790,26 @@ class QuicStreamManager {
   // Streams that are opened locally on the connection. Ordered by id.
   std::deque<StreamId> openLocalStreams_;
 
-  // A map of streams that are active.
-  std::map<StreamId, QuicStreamState> streams_;
+  // The streams that are active, indexed by id.
+  StreamTable streams_;
 
   std::deque<StreamId> newPeerStreams_;
 
   // List of streams that have pending reads
-  std::set<StreamId> readableStreams_;
+  StreamIdSet readableStreams_;
 
   // List of streams that have pending peeks
-  std::set<StreamId> peekableStreams_;
+  StreamIdSet peekableStreams_;
 
   // List of streams that have writable data
-  std::set<StreamId> writableStreams_;
+  StreamIdSet writableStreams_;
+
+  // The writable streams by urgency, so that priority scheduling only looks
+  // at the streams it writes.
+  std::array<StreamIdSet, kMaxStreamUrgency + 1> writableStreamsByUrgency_;
+
+  // The writable streams by urgency that are not incremental.
+  std::array<StreamIdSet, kMaxStreamUrgency + 1> writableSequentialStreams_;
 
   // List of streams that were blocked
   std::unordered_map<StreamId, StreamDataBlockedFrame> blockedStreams_;
@@ -645,23 +818,29 @@ class QuicStreamManager {
   std::unordered_map<StreamId, ApplicationErrorCode> stopSendingStreams_;
 
   // List of streams that have expired data
-  std::set<StreamId> dataExpiredStreams_;
+  StreamIdSet dataExpiredStreams_;
 
   // List of streams that have rejected data
-  std::set<StreamId> dataRejectedStreams_;
+  StreamIdSet dataRejectedStreams_;
+
+  // Streams with a data expiry and written data that has yet to expire
+  StreamIdSet expiringStreams_;
+
+  // Streams out of send rate tokens
+  StreamIdSet rateLimitedStreams_;
 
   // Streams that may be able to callback DeliveryCallback
-  std::set<StreamId> deliverableStreams_;
+  StreamIdSet deliverableStreams_;
 
   // Streams that had their stream window change and potentially need a window
   // update sent
-  std::unordered_set<StreamId> windowUpdates_;
+  StreamIdSet windowUpdates_;
 
   // Streams that had their flow control updated
-  std::set<StreamId> flowControlUpdated_;
+  StreamIdSet flowControlUpdated_;
 
   // Streams that are closed but we still have state for
-  std::set<StreamId> closedStreams_;
+  StreamIdSet closedStreams_;
 
   // Data structure to keep track of stream that have detected lost data
   std::vector<StreamId> lossStreams_;
@@ -11,6 +11,8 @@
 #include <folly/Optional.h>
 #include <folly/functional/Invoke.h>
 #include <folly/io/async/EventBase.h>
+#include <quic/state/TransportMetricsHistory.h>
+#include <chrono>
 #include <string>
 
 namespace quic {
@@ -39,6 +41,13 @@ class QuicTransportStatsCallback {
     WORKER_NOT_INITIALIZED,
     SERVER_SHUTDOWN,
     INITIAL_CONNID_SMALL,
+    INVALID_RETRY_TOKEN,
+    WORKER_QUEUE_FULL,
+    WORKER_OVERLOADED,
+    MAX_BUFFERED,
+    BUFFER_UNAVAILABLE,
+    PENDING_PACKET_POOL_FULL,
+    STATELESS_RESPONSE_RATE_LIMITED,
     // NOTE: MAX should always be at the end
     MAX
   };
@@ -51,6 +60,29 @@ class QuicTransportStatsCallback {
     MAX
   };
 
+  enum class SlowStartExitReason : uint8_t {
+    LOSS,
+    SSTHRESH,
+    ACK_TRAIN,
+    DELAY_INCREASE,
+    CONSERVATIVE_SLOW_START,
+    // NOTE: MAX should always be at the end
+    MAX
+  };
+
+  // why a batch of packets was written to the socket
+  enum class WriteBatchFlushReason : uint8_t {
+    // the next packet could not join the batch, e.g. a GSO batch only takes
+    // packets of the same size
+    SIZE_MISMATCH,
+    // the batch was full
+    MAX_BUFS,
+    // the connection had nothing more to write
+    END_OF_WRITE,
+    // NOTE: MAX should always be at the end
+    MAX
+  };
+
   virtual ~QuicTransportStatsCallback() = default;
 
   // packet level metrics
@@ -103,11 +135,76 @@ class QuicTransportStatsCallback {
   // retransmission timeout counter
   virtual void onPTO() = 0;
 
+  // a packet declared lost was acked after all
+  virtual void onSpuriousLoss() = 0;
+
   // metrics to track bytes read from / written to wire
   virtual void onRead(size_t bufSize) = 0;
 
   virtual void onWrite(size_t bufSize) = 0;
 
+  // handshake metrics: the time from the first to the last handshake message,
+  // the part of it spent processing the handshake, and the crypto data sent
+  // and received
+  virtual void onHandshakeDone(
+      std::chrono::microseconds handshakeTime,
+      std::chrono::microseconds processingTime,
+      uint64_t cryptoBytesSent,
+      uint64_t cryptoBytesRecvd) = 0;
+
+  // server sent a Retry to a client to validate its address
+  virtual void onRetrySent() = 0;
+
+  // the congestion controller left slow start, so that premature exits can be
+  // told apart by why they happened
+  virtual void onSlowStartExit(SlowStartExitReason reason) = 0;
+
+  // samples for distributions: the RTT of each acked packet that updated the
+  // RTT estimate, the cwnd after each processed ack, the number of packets
+  // in each batch written to or read from the socket, and the busy time of
+  // the sampled event loops
+  virtual void onRttSample(std::chrono::microseconds rtt) = 0;
+
+  virtual void onCwndSample(uint64_t cwndBytes) = 0;
+
+  virtual void onWriteBatch(
+      size_t numPackets,
+      size_t numBytes,
+      WriteBatchFlushReason reason) = 0;
+
+  // the time a write to a stream waited to be sent and then took to be acked,
+  // for each write once it is delivered, see DeliveryLatency
+  virtual void onStreamWriteDelivered(
+      std::chrono::microseconds queueingTime,
+      std::chrono::microseconds networkTime) = 0;
+
+  // the number of packets in each GSO buffer written to the socket
+  virtual void onGSOWrite(size_t numSegments) = 0;
+
+  // the time the server had data to send but had used up what it may send to
+  // an unvalidated peer address, once a packet from the peer ends it
+  virtual void onAmplificationBlocked(
+      std::chrono::microseconds blockedTime) = 0;
+
+  // the history of the metrics of a connection when it closes, oldest first,
+  // with TransportSettings::metricsHistorySize
+  virtual void onMetricsHistory(
+      const std::vector<TransportMetricsSample>& samples) = 0;
+
+  // a batch could not be written because the socket buffer was full
+  virtual void onWriteWouldBlock() = 0;
+
+  virtual void onReadBatch(size_t numPackets) = 0;
+
+  // packets the kernel dropped since the last report because the receive
+  // buffer of the socket was full
+  virtual void onKernelPacketsDropped(uint64_t numPackets) = 0;
+
+  // bytes queued in the receive buffer of the socket, out of its size
+  virtual void onRecvBufferOccupancy(uint64_t usedBytes, uint64_t size) = 0;
+
+  virtual void onLoopBusyTime(std::chrono::microseconds busyTime) = 0;
+
   static const char* toString(ConnectionCloseReason reason) {
     switch (reason) {
       case ConnectionCloseReason::NONE:
@@ -123,6 +220,40 @@ class QuicTransportStatsCallback {
     }
   }
 
+  static const char* toString(SlowStartExitReason reason) {
+    switch (reason) {
+      case SlowStartExitReason::LOSS:
+        return "LOSS";
+      case SlowStartExitReason::SSTHRESH:
+        return "SSTHRESH";
+      case SlowStartExitReason::ACK_TRAIN:
+        return "ACK_TRAIN";
+      case SlowStartExitReason::DELAY_INCREASE:
+        return "DELAY_INCREASE";
+      case SlowStartExitReason::CONSERVATIVE_SLOW_START:
+        return "CONSERVATIVE_SLOW_START";
+      case SlowStartExitReason::MAX:
+        return "MAX";
+      default:
+        throw std::runtime_error("Undefined SlowStartExitReason passed");
+    }
+  }
+
+  static const char* toString(WriteBatchFlushReason reason) {
+    switch (reason) {
+      case WriteBatchFlushReason::SIZE_MISMATCH:
+        return "SIZE_MISMATCH";
+      case WriteBatchFlushReason::MAX_BUFS:
+        return "MAX_BUFS";
+      case WriteBatchFlushReason::END_OF_WRITE:
+        return "END_OF_WRITE";
+      case WriteBatchFlushReason::MAX:
+        return "MAX";
+      default:
+        throw std::runtime_error("Undefined WriteBatchFlushReason passed");
+    }
+  }
+
   static const char* toString(PacketDropReason reason) {
     switch (reason) {
       case PacketDropReason::NONE:
@@ -151,6 +282,20 @@ class QuicTransportStatsCallback {
         return "SERVER_SHUTDOWN";
       case PacketDropReason::INITIAL_CONNID_SMALL:
         return "INITIAL_CONNID_SMALL";
+      case PacketDropReason::INVALID_RETRY_TOKEN:
+        return "INVALID_RETRY_TOKEN";
+      case PacketDropReason::WORKER_QUEUE_FULL:
+        return "WORKER_QUEUE_FULL";
+      case PacketDropReason::WORKER_OVERLOADED:
+        return "WORKER_OVERLOADED";
+      case PacketDropReason::MAX_BUFFERED:
+        return "MAX_BUFFERED";
+      case PacketDropReason::BUFFER_UNAVAILABLE:
+        return "BUFFER_UNAVAILABLE";
+      case PacketDropReason::PENDING_PACKET_POOL_FULL:
+        return "PENDING_PACKET_POOL_FULL";
+      case PacketDropReason::STATELESS_RESPONSE_RATE_LIMITED:
+        return "STATELESS_RESPONSE_RATE_LIMITED";
       case PacketDropReason::MAX:
         return "MAX";
       default:
@@ -9,18 +9,36 @@
 #include "SimpleFrameFunctions.h"
 
 #include <boost/variant/get.hpp>
+#include <algorithm>
 #include <quic/state/QuicStateFunctions.h>
 #include <quic/state/QuicStreamFunctions.h>
 
 namespace quic {
+namespace {
+bool isAckFrequencyFrame(const QuicSimpleFrame& frame) {
+  return boost::get<AckFrequencyFrame>(&frame) != nullptr;
+}
+} // namespace
+
 void sendSimpleFrame(QuicConnectionStateBase& conn, QuicSimpleFrame frame) {
   conn.pendingEvents.frames.emplace_back(std::move(frame));
 }
 
 void updateSimpleFrameOnAck(
-    QuicConnectionStateBase& /*conn*/,
-    const QuicSimpleFrame& /*frame*/) {
-  // TODO implement.
+    QuicConnectionStateBase& conn,
+    const QuicSimpleFrame& frame) {
+  folly::variant_match(
+      frame,
+      [&](const AckFrequencyFrame& frame) {
+        // The peer now delays its acks for up to the requested max ack delay,
+        // which the PTO has to account for. Acks of older requests are stale.
+        if (frame.sequenceNumber + 1 == conn.nextAckFrequencySequenceNumber) {
+          conn.lossState.maxAckDelay = frame.updateMaxAckDelay;
+        }
+      },
+      [&](const auto& /* frame */) {
+        // TODO implement.
+      });
 }
 
 folly::Optional<QuicSimpleFrame> updateSimpleFrameOnPacketClone(
@@ -63,6 +81,13 @@ folly::Optional<QuicSimpleFrame> updateSimpleFrameOnPacketClone(
       [&](const NewConnectionIdFrame& frame)
           -> folly::Optional<QuicSimpleFrame> {
         return QuicSimpleFrame(frame);
+      },
+      [&](const AckFrequencyFrame& frame) -> folly::Optional<QuicSimpleFrame> {
+        // Only the latest ack frequency request is worth sending again.
+        if (frame.sequenceNumber + 1 != conn.nextAckFrequencySequenceNumber) {
+          return folly::none;
+        }
+        return QuicSimpleFrame(frame);
       });
 }
 
@@ -124,6 +149,14 @@ void updateSimpleFrameOnPacketLoss(
       },
       [&](const NewConnectionIdFrame& frame) {
         conn.pendingEvents.frames.push_back(frame);
+      },
+      [&](const AckFrequencyFrame& frame) {
+        // A newer request, if any, is already pending or in flight.
+        auto& frames = conn.pendingEvents.frames;
+        if (frame.sequenceNumber + 1 == conn.nextAckFrequencySequenceNumber &&
+            std::none_of(frames.begin(), frames.end(), isAckFrequencyFrame)) {
+          frames.push_back(frame);
+        }
       });
 }
 
@@ -176,7 +209,63 @@ bool updateSimpleFrameOnPacketReceived(
       [&](const NewConnectionIdFrame&) {
         // TODO junqiw
         return false;
+      },
+      [&](const AckFrequencyFrame& frame) {
+        onRecvAckFrequencyFrame(conn, frame);
+        return true;
       });
 }
 
+bool requestAckFrequency(
+    QuicConnectionStateBase& conn,
+    uint64_t packetTolerance,
+    std::chrono::microseconds maxAckDelay,
+    bool ignoreOrder) {
+  if (!conn.peerMinAckDelay) {
+    return false;
+  }
+  DCHECK_GT(packetTolerance, 0);
+  maxAckDelay = std::max(maxAckDelay, *conn.peerMinAckDelay);
+  // A new request replaces the one that has not been sent yet.
+  auto& frames = conn.pendingEvents.frames;
+  frames.erase(
+      std::remove_if(frames.begin(), frames.end(), isAckFrequencyFrame),
+      frames.end());
+  frames.emplace_back(AckFrequencyFrame(
+      conn.nextAckFrequencySequenceNumber++,
+      packetTolerance,
+      maxAckDelay,
+      ignoreOrder));
+  return true;
+}
+
+void onRecvAckFrequencyFrame(
+    QuicConnectionStateBase& conn,
+    const AckFrequencyFrame& frame) {
+  if (!conn.transportSettings.ackFrequencyEnabled) {
+    throw QuicTransportException(
+        "Received ACK_FREQUENCY frame without negotiating it",
+        TransportErrorCode::PROTOCOL_VIOLATION,
+        FrameType::ACK_FREQUENCY);
+  }
+  if (frame.packetTolerance == 0) {
+    throw QuicTransportException(
+        "Invalid packet tolerance in ACK_FREQUENCY frame",
+        TransportErrorCode::PROTOCOL_VIOLATION,
+        FrameType::ACK_FREQUENCY);
+  }
+  if (frame.updateMaxAckDelay < kDefaultMinAckDelay) {
+    throw QuicTransportException(
+        "Ack delay in ACK_FREQUENCY frame below min ack delay",
+        TransportErrorCode::PROTOCOL_VIOLATION,
+        FrameType::ACK_FREQUENCY);
+  }
+  // Frames may arrive out of order, only the newest one counts.
+  if (conn.ackFrequency &&
+      frame.sequenceNumber <= conn.ackFrequency->sequenceNumber) {
+    return;
+  }
+  conn.ackFrequency = frame;
+}
+
 } // namespace quic
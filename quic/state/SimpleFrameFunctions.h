@@ -58,4 +58,23 @@ bool updateSimpleFrameOnPacketReceived(
     const QuicSimpleFrame& frameIn,
     PacketNum packetNum,
     bool fromChangedPeerAddress);
+
+/*
+ * Ask the peer to ack every packetTolerance packets with retransmittable data,
+ * or after maxAckDelay, whichever comes first. If ignoreOrder is set the peer
+ * does not ack out of order packets immediately. Returns false if the peer
+ * does not support ACK_FREQUENCY frames.
+ */
+bool requestAckFrequency(
+    QuicConnectionStateBase& conn,
+    uint64_t packetTolerance,
+    std::chrono::microseconds maxAckDelay,
+    bool ignoreOrder);
+
+/*
+ * Update the ack frequency the peer asked us to use.
+ */
+void onRecvAckFrequencyFrame(
+    QuicConnectionStateBase& conn,
+    const AckFrequencyFrame& frame);
 } // namespace quic
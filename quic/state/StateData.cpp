@@ -11,29 +11,74 @@
 
 namespace quic {
 
+#ifdef MVFST_NO_PARTIAL_RELIABILITY
+constexpr bool QuicConnectionStateBase::partialReliabilityEnabled;
+#endif
+
 QuicStreamState::QuicStreamState(StreamId idIn, QuicConnectionStateBase& connIn)
     : conn(connIn), id(idIn) {
+  readBuffer.countBytesIn(&conn.streamBufferBytes);
+  retransmissionBuffer.countBytesIn(&conn.streamBufferBytes);
+  lossBuffer.countBytesIn(&conn.streamBufferBytes);
+  setInitialState();
+}
+
+void QuicStreamState::reset(StreamId idIn) {
+  readBuffer.clear();
+  writeBuffer.move();
+  retransmissionBuffer.clear();
+  lossBuffer.clear();
+  currentWriteOffset = 0;
+  minimumRetransmittableOffset = 0;
+  dataExpiry.reset();
+  sendRateLimit.reset();
+  pendingDelivery.reset();
+  deliveryLatency = DeliveryLatency();
+  currentReadOffset = 0;
+  currentReceiveOffset = 0;
+  maxOffsetObserved = 0;
+  finalReadOffset = folly::none;
+
+  id = idIn;
+  finalWriteOffset = folly::none;
+  flowControlState = StreamFlowControlState();
+  streamReadError = folly::none;
+  streamWriteError = folly::none;
+  send.state = StreamSendStates::Open();
+  recv.state = StreamReceiveStates::Open();
+  latestMaxStreamDataPacket = folly::none;
+  isControl = false;
+  lastHolbTime = folly::none;
+  totalHolbTime = 0us;
+  holbCount = 0;
+  writeBufferAboveHighWatermark = false;
+  priority = StreamPriority();
+  schedulingDeficit = 0;
+  setInitialState();
+}
+
+void QuicStreamState::setInitialState() {
   // Note: this will set a windowSize for a locally-initiated unidirectional
   // stream even though that value is meaningless.
-  flowControlState.windowSize = isUnidirectionalStream(idIn)
+  flowControlState.windowSize = isUnidirectionalStream(id)
       ? conn.transportSettings.advertisedInitialUniStreamWindowSize
-      : isLocalStream(connIn.nodeType, idIn)
+      : isLocalStream(conn.nodeType, id)
           ? conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize
           : conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize;
-  flowControlState.advertisedMaxOffset = isUnidirectionalStream(idIn)
+  flowControlState.advertisedMaxOffset = isUnidirectionalStream(id)
       ? conn.transportSettings.advertisedInitialUniStreamWindowSize
-      : isLocalStream(connIn.nodeType, idIn)
+      : isLocalStream(conn.nodeType, id)
           ? conn.transportSettings.advertisedInitialBidiLocalStreamWindowSize
           : conn.transportSettings.advertisedInitialBidiRemoteStreamWindowSize;
   // Note: this will set a peerAdvertisedMaxOffset for a peer-initiated
   // unidirectional stream even though that value is meaningless.
-  flowControlState.peerAdvertisedMaxOffset = isUnidirectionalStream(idIn)
+  flowControlState.peerAdvertisedMaxOffset = isUnidirectionalStream(id)
       ? conn.flowControlState.peerAdvertisedInitialMaxStreamOffsetUni
-      : isLocalStream(connIn.nodeType, idIn)
+      : isLocalStream(conn.nodeType, id)
           ? conn.flowControlState.peerAdvertisedInitialMaxStreamOffsetBidiRemote
           : conn.flowControlState.peerAdvertisedInitialMaxStreamOffsetBidiLocal;
-  if (isUnidirectionalStream(idIn)) {
-    if (isLocalStream(connIn.nodeType, idIn)) {
+  if (isUnidirectionalStream(id)) {
+    if (isLocalStream(conn.nodeType, id)) {
       recv.state = StreamReceiveStates::Invalid();
     } else {
       send.state = StreamSendStates::Invalid();
@@ -21,12 +21,15 @@
 #include <quic/handshake/HandshakeLayer.h>
 #include <quic/logging/QLogger.h>
 #include <quic/state/AckStates.h>
+#include <quic/state/OutstandingPacketStore.h>
 #include <quic/state/QuicStreamManager.h>
 #include <quic/state/QuicTransportStatsCallback.h>
 #include <quic/state/StateMachine.h>
 #include <quic/state/StreamData.h>
 #include <quic/state/TransportSettings.h>
+#include <array>
 #include <chrono>
+#include <deque>
 #include <list>
 #include <map>
 #include <numeric>
@@ -39,10 +42,21 @@ namespace quic {
 struct NetworkData {
   Buf data;
   TimePoint receiveTimePoint;
+  // ECN codepoint of the IP header the data was received with.
+  EcnCodepoint ecn{EcnCodepoint::NotEct};
+  // Destination address of the IP header, if the socket reports it.
+  folly::Optional<folly::IPAddress> localAddress;
 
   NetworkData() = default;
-  NetworkData(Buf&& buf, const TimePoint& receiveTime)
-      : data(std::move(buf)), receiveTimePoint(receiveTime) {}
+  NetworkData(
+      Buf&& buf,
+      const TimePoint& receiveTime,
+      EcnCodepoint ecnIn = EcnCodepoint::NotEct,
+      folly::Optional<folly::IPAddress> localAddressIn = folly::none)
+      : data(std::move(buf)),
+        receiveTimePoint(receiveTime),
+        ecn(ecnIn),
+        localAddress(std::move(localAddressIn)) {}
 };
 
 /**
@@ -62,6 +76,13 @@ struct NetworkData {
  */
 using PacketEvent = PacketNum;
 
+/**
+ * The frames of an outstanding packet are kept as the QuicWriteFrames that
+ * were written rather than as a packed summary: the packet rebuilder, the
+ * ack and loss visitors and qlog all walk them as such. What a packet costs
+ * is mostly the size of the largest frame variant, kept small by the vector
+ * backed blocks of WriteAckFrame, times the number of its frames.
+ */
 struct OutstandingPacket {
   // Structure representing the frames that are outstanding including the header
   // that was sent.
@@ -74,6 +95,14 @@ struct OutstandingPacket {
   bool isHandshake;
   // Whether this packet is pure ack
   bool pureAck;
+  // Whether the packet is sent when congestion controller is in app-limited
+  // state. Kept next to the other flags so that it packs into their padding.
+  bool isAppLimited{false};
+  // Whether this packet was sent marked with an ECT codepoint.
+  bool ecnMarked{false};
+  // Whether this packet is a path MTU probe. Probes are left out of the
+  // congestion controller, their loss only means that they are too large.
+  bool isPathMtuProbe{false};
   // Total sent bytes on this connection including this packet itself when this
   // packet is sent.
   uint64_t totalBytesSent;
@@ -104,12 +133,6 @@ struct OutstandingPacket {
   // folly::none if the packet isn't a clone and hasn't been cloned.
   folly::Optional<PacketEvent> associatedEvent;
 
-  /**
-   * Whether the packet is sent when congestion controller is in app-limited
-   * state.
-   */
-  bool isAppLimited{false};
-
   OutstandingPacket(
       RegularQuicWritePacket packetIn,
       TimePoint timeIn,
@@ -125,6 +148,8 @@ struct OutstandingPacket {
         totalBytesSent(totalBytesSentIn) {}
 };
 
+using OutstandingPackets = OutstandingPacketStore<OutstandingPacket>;
+
 struct Pacer {
   virtual ~Pacer() = default;
 
@@ -165,6 +190,14 @@ struct Pacer {
   virtual uint64_t getCachedWriteBatchSize() const = 0;
 
   virtual void setAppLimited(bool limited) = 0;
+
+  /**
+   * API for Transport to get the departure time of the next packet, when the
+   * pacing is left to the kernel with SO_TXTIME. Returns none if the packet
+   * can leave right away.
+   */
+  virtual folly::Optional<TimePoint> getPacketTxTime(
+      TimePoint currentTime) = 0;
 };
 
 struct PacingRate {
@@ -229,6 +262,30 @@ struct CongestionController {
     }
   };
 
+  /**
+   * What the congestion controllers need of an acked packet. The acked
+   * OutstandingPackets are dropped with their frames as soon as they are
+   * processed, instead of being moved into the AckEvent.
+   */
+  struct AckPacket {
+    TimePoint time;
+    uint32_t encodedSize;
+    bool isHandshake;
+    bool pureAck;
+    bool isAppLimited;
+    uint64_t totalBytesSent;
+    folly::Optional<OutstandingPacket::LastAckedPacketInfo> lastAckedPacketInfo;
+
+    explicit AckPacket(const OutstandingPacket& packet)
+        : time(packet.time),
+          encodedSize(packet.encodedSize),
+          isHandshake(packet.isHandshake),
+          pureAck(packet.pureAck),
+          isAppLimited(packet.isAppLimited),
+          totalBytesSent(packet.totalBytesSent),
+          lastAckedPacketInfo(packet.lastAckedPacketInfo) {}
+  };
+
   struct AckEvent {
     /**
      * The reason that this is an optional type, is that we construct an
@@ -242,8 +299,11 @@ struct CongestionController {
     // includes ack delay.
     folly::Optional<std::chrono::microseconds> mrttSample;
 
-    // OutstandingPackets acked in this ack event
-    std::vector<OutstandingPacket> ackedPackets;
+    // Packets acked in this ack event, in increasing packet number order
+    std::vector<AckPacket> ackedPackets;
+    // Number of packets newly reported as CE marked by the ack. Only set when
+    // the ECN counts of the ack are validated.
+    uint64_t ecnCeMarked{0};
   };
 
   virtual ~CongestionController() = default;
@@ -291,6 +351,23 @@ struct CongestionController {
   virtual void setAppLimited() = 0;
   virtual CongestionControlType type() const = 0;
 
+  /**
+   * Notify congestion controller that a packet of the loss event with this
+   * lossTime has been acked after all. Only called with
+   * TransportSettings::adaptiveReordering. Controllers may undo the
+   * reduction of the cwnd the loss caused once all the packets it counted
+   * turn out to be spurious.
+   */
+  virtual void onSpuriousLoss(TimePoint /* lossTime */) {}
+
+  /**
+   * The estimate of the delivery rate of the path, in bytes per second, or 0
+   * if the congestion controller does not estimate it.
+   */
+  virtual uint64_t getBandwidthEstimate() const {
+    return 0;
+  }
+
   /**
    * Whether the congestion controller thinks it's currently in app-limited
    * state.
@@ -303,6 +380,20 @@ struct QuicCryptoStream : public QuicStreamLike {
 };
 
 struct QuicCryptoState {
+  QuicCryptoState() = default;
+
+  /**
+   * Counts the bytes in the read, retransmission and loss buffers of the
+   * streams in *bufferedBytes, which must outlive them.
+   */
+  explicit QuicCryptoState(uint64_t* bufferedBytes) {
+    for (auto* stream : {&initialStream, &handshakeStream, &oneRttStream}) {
+      stream->readBuffer.countBytesIn(bufferedBytes);
+      stream->retransmissionBuffer.countBytesIn(bufferedBytes);
+      stream->lossBuffer.countBytesIn(bufferedBytes);
+    }
+  }
+
   // Stream to exchange the initial cryptographic material.
   QuicCryptoStream initialStream;
 
@@ -332,6 +423,19 @@ using Resets = std::unordered_map<StreamId, RstStreamFrame>;
 
 using FrameList = std::vector<QuicSimpleFrame>;
 
+/**
+ * A packet declared lost, kept with TransportSettings::adaptiveReordering
+ * until an ack shows the loss was spurious or newer losses push it out.
+ */
+struct RecentlyLostPacket {
+  PacketNum packetNum;
+  PacketNumberSpace pnSpace;
+  // The lossTime of the LossEvent the packet was in
+  TimePoint lossTime;
+  // How far behind the largest acked packet it was when declared lost
+  PacketNum reorderingDistance;
+};
+
 struct LossState {
   enum class AlarmMethod { EarlyRetransmitOrReordering, Handshake, PTO };
   // Smooth rtt
@@ -353,6 +457,16 @@ struct LossState {
   PacketNum largestSent{0};
   // Reordering threshold used
   uint32_t reorderingThreshold{kReorderingThreshold};
+  // Packets are declared lost once they are older than the RTT plus this many
+  // eighths of it.
+  uint8_t reorderingWindowMult{1};
+  // Loss events since a spurious loss last widened the reordering window
+  uint16_t lossEventsSinceWindowWidened{0};
+  // Oldest first, only kept with TransportSettings::adaptiveReordering
+  std::deque<RecentlyLostPacket> recentlyLostPackets;
+  // Total number of packets declared lost that were acked later. Only counted
+  // with TransportSettings::adaptiveReordering.
+  uint32_t spuriousLossCount{0};
   // Timer for time reordering detection or early retransmit alarm.
   folly::Optional<TimePoint> initialLossTime, handshakeLossTime,
       appDataLossTime;
@@ -396,9 +510,119 @@ struct LossState {
   TimePoint lastRetransmittablePacketSentTime;
 };
 
+/**
+ * Approximate memory held by the buffers and the packet state of a
+ * connection, in bytes.
+ */
+struct ConnectionMemoryUsage {
+  // Data in the read, write, retransmission and loss buffers of the streams.
+  uint64_t streamBufferBytes{0};
+  // Data in the buffers of the crypto streams.
+  uint64_t cryptoBufferBytes{0};
+  // Packets that were sent and are not acked or declared lost yet.
+  uint64_t outstandingPacketBytes{0};
+  // Packets that were received before their keys were available.
+  uint64_t pendingPacketBytes{0};
+
+  uint64_t total() const {
+    return streamBufferBytes + cryptoBufferBytes + outstandingPacketBytes +
+        pendingPacketBytes;
+  }
+};
+
+/**
+ * CPU cycles spent by a connection, counted with the time stamp counter when
+ * TransportSettings::cpuAccounting is on. The cycles of a phase do not
+ * include those of the phases run from it, such as the writes done by a
+ * loss timeout.
+ */
+struct ConnectionCpuUsage {
+  enum class Phase : uint8_t {
+    Read,
+    Write,
+    LossTimeout,
+    AckTimeout,
+    // NOTE: MAX should always be at the end
+    MAX
+  };
+
+  std::array<uint64_t, static_cast<size_t>(Phase::MAX)> cycles{};
+  // Times each phase was entered
+  std::array<uint64_t, static_cast<size_t>(Phase::MAX)> calls{};
+
+  uint64_t totalCycles() const {
+    return std::accumulate(cycles.begin(), cycles.end(), uint64_t(0));
+  }
+};
+
+/**
+ * Heap allocations made by a connection when
+ * TransportSettings::allocationAccounting is on and mvfst is built with
+ * MVFST_COUNT_ALLOCATIONS. They are counted to the phase and the subsystem
+ * that made them. Allocations outside the codec, congestion control and
+ * logging are counted to State, which for the handshake includes the TLS
+ * stack.
+ */
+struct ConnectionAllocationUsage {
+  enum class Phase : uint8_t {
+    Read,
+    Write,
+    Handshake,
+    // NOTE: MAX should always be at the end
+    MAX
+  };
+
+  enum class Subsystem : uint8_t {
+    State,
+    Codec,
+    CongestionControl,
+    Logging,
+    // NOTE: MAX should always be at the end
+    MAX
+  };
+
+  struct Counts {
+    uint64_t allocations{0};
+    uint64_t bytes{0};
+  };
+
+  std::array<
+      std::array<Counts, static_cast<size_t>(Subsystem::MAX)>,
+      static_cast<size_t>(Phase::MAX)>
+      counts{};
+  // Times each phase was entered
+  std::array<uint64_t, static_cast<size_t>(Phase::MAX)> calls{};
+
+  Counts& at(Phase phase, Subsystem subsystem) {
+    return counts[static_cast<size_t>(phase)]
+                 [static_cast<size_t>(subsystem)];
+  }
+
+  const Counts& at(Phase phase, Subsystem subsystem) const {
+    return counts[static_cast<size_t>(phase)]
+                 [static_cast<size_t>(subsystem)];
+  }
+
+  Counts total() const {
+    Counts total;
+    for (const auto& phaseCounts : counts) {
+      for (const auto& subsystemCounts : phaseCounts) {
+        total.allocations += subsystemCounts.allocations;
+        total.bytes += subsystemCounts.bytes;
+      }
+    }
+    return total;
+  }
+};
+
 class Logger;
 class CongestionControllerFactory;
 class LoopDetectorCallback;
+class EgressBatcher;
+class ZeroCopySender;
+class EncryptionPipeline;
+class BufferAllocator;
+class TxTimestamper;
 
 struct QuicConnectionStateBase {
   virtual ~QuicConnectionStateBase() = default;
@@ -408,6 +632,12 @@ struct QuicConnectionStateBase {
   // Type of node owning this connection (client or server).
   QuicNodeType nodeType;
 
+  // Bytes in the read, retransmission and loss buffers of the streams and of
+  // the crypto streams, kept up to date by the buffers as they change. These
+  // come before the streams, which must not outlive them.
+  uint64_t streamBufferBytes{0};
+  uint64_t cryptoBufferBytes{0};
+
   std::unique_ptr<Handshake, folly::DelayedDestruction::Destructor>
       handshakeLayer;
 
@@ -425,15 +655,80 @@ struct QuicConnectionStateBase {
 
   std::unique_ptr<QuicStreamManager> streamManager;
 
-  // When server receives early data attempt without valid source address token,
-  // server will limit bytes in flight to avoid amplification attack.
-  // This limit should be cleared and set back to max after CFIN is received.
-  folly::Optional<uint32_t> writableBytesLimit;
+  // The state read or written for every packet comes first, so that it
+  // shares as few cache lines as possible. StateDataTest checks the order.
+
+  LossState lossState;
+
+  // This contains the ack and packet number related states for all three
+  // packet number space.
+  AckStates ackStates;
+
+  struct ConnectionFlowControlState {
+    // The size of the connection flow control window.
+    uint64_t windowSize{0};
+    // The max data we have advertised to the peer.
+    uint64_t advertisedMaxOffset{0};
+    // The max data the peer has advertised on the connection.
+    // This is set to 0 initially so that we can't send any data until we know
+    // the peer's flow control offset.
+    uint64_t peerAdvertisedMaxOffset{0};
+    // The sum of the min(read offsets) of all the streams on the conn.
+    uint64_t sumCurReadOffset{0};
+    // The sum of the max(offset) observed on all the streams on the conn.
+    uint64_t sumMaxObservedOffset{0};
+    // The sum of write offsets of all the streams, only including the offsets
+    // written on the wire.
+    uint64_t sumCurWriteOffset{0};
+    // The sum of length of data in all the stream buffers.
+    uint64_t sumCurStreamBufferLen{0};
+    // The packet number in which we got the last largest max data.
+    folly::Optional<PacketNum> largestMaxOffsetReceived;
+    // The following are advertised by the peer, and are set to zero initially
+    // so that we cannot send any data until we know the peer values.
+    // The initial max stream offset for peer-initiated bidirectional streams.
+    uint64_t peerAdvertisedInitialMaxStreamOffsetBidiLocal{0};
+    // The initial max stream offset for local-initiated bidirectional streams.
+    uint64_t peerAdvertisedInitialMaxStreamOffsetBidiRemote{0};
+    // The initial max stream offset for unidirectional streams.
+    uint64_t peerAdvertisedInitialMaxStreamOffsetUni{0};
+    // Time at which the last flow control update was sent by the transport.
+    folly::Optional<TimePoint> timeOfLastFlowControlUpdate;
+  };
+
+  // Current state of flow control.
+  ConnectionFlowControlState flowControlState;
+
+  struct PendingEvents {
+    Resets resets;
+
+    folly::Optional<PathChallengeFrame> pathChallenge;
+
+    FrameList frames;
+
+    // true: schedule timeout if not scheduled
+    // false: cancel scheduled timeout
+    bool schedulePathValidationTimeout{false};
+
+    // If we should schedule a new Ack timeout, if it's not already scheduled
+    bool scheduleAckTimeout{false};
+
+    // Whether a connection level window update is due to send
+    bool connWindowUpdate{false};
+
+    // If there is a pending loss detection alarm update
+    bool setLossDetectionAlarm{false};
+
+    // Number of probing packets to send after PTO
+    uint8_t numProbePackets{0};
+  };
+
+  PendingEvents pendingEvents;
 
   // TODO: We really really should wrap outstandingPackets, all its associated
   // counters and the outstandingPacketEvents into one class.
   // Sent packets which have not been acked. These are sorted by PacketNum.
-  std::deque<OutstandingPacket> outstandingPackets;
+  OutstandingPackets outstandingPackets;
 
   // All PacketEvents of this connection. If a OutstandingPacket doesn't have an
   // associatedEvent or if it's not in this set, there is no need to process its
@@ -450,9 +745,96 @@ struct QuicConnectionStateBase {
   // Number of packets are clones or cloned.
   uint64_t outstandingClonedPacketsCount{0};
 
+  // When server receives early data attempt without valid source address token,
+  // server will limit bytes in flight to avoid amplification attack.
+  // This limit should be cleared and set back to max after CFIN is received.
+  // The same limit applies to a migrated to peer address until it is
+  // validated. It is compared to lossState.totalBytesSent.
+  folly::Optional<uint64_t> writableBytesLimit;
+
+  // Time spent with data to send but no room left under writableBytesLimit,
+  // and since when if that is the case now. It ends when a packet from the
+  // peer raises the limit.
+  std::chrono::microseconds totalAmplificationBlockedTime{0us};
+  folly::Optional<TimePoint> amplificationBlockedSince;
+
+  // The max UDP packet size we will be sending, limited by both the received
+  // max_packet_size in Transport Parameters and PMTU
+  uint64_t udpSendPacketLen{kDefaultUDPSendPacketLen};
+
+  struct PacketSchedulingState {
+    StreamId lastScheduledStream{0};
+  };
+
+  // The stream frame scheduler only has const access to the connection,
+  // hence mutable.
+  mutable PacketSchedulingState schedulingState;
+
   // The read codec to decrypt and decode packets.
   std::unique_ptr<QuicReadCodec> readCodec;
 
+  // One rtt write header cipher.
+  std::unique_ptr<PacketNumberCipher> oneRttWriteHeaderCipher;
+
+  // Write cipher for 1-RTT data
+  std::unique_ptr<Aead> oneRttWriteCipher;
+
+  // Whether or not we received a new packet before a write.
+  bool receivedNewPacketBeforeWrite{false};
+
+  // Whether a connection can be paced based on its handshake and close states.
+  // For example, we may not want to pace a connection that's still handshaking.
+  bool canBePaced{false};
+
+  // Whether or not both ends agree to use partial reliability. A constant
+  // when it is compiled out, so that the branches on it fold away.
+#ifdef MVFST_NO_PARTIAL_RELIABILITY
+  static constexpr bool partialReliabilityEnabled{false};
+#else
+  bool partialReliabilityEnabled{false};
+#endif
+
+  enum class EcnState : uint8_t {
+    // Packets are not marked.
+    Disabled,
+    // Packets are marked with ecnMarking, and the ECN counts in the acks are
+    // validated and passed to the congestion controller.
+    Enabled,
+    // The acks failed ECN validation, their ECN counts are ignored.
+    Failed,
+  };
+  EcnState ecnState{EcnState::Disabled};
+  // The ECT codepoint the packets are marked with.
+  EcnCodepoint ecnMarking{EcnCodepoint::Ect0};
+
+  // If set, the packets of this connection are handed to this batcher, which
+  // sends them together with the packets of the other connections sharing
+  // the socket. Owned by the server worker.
+  EgressBatcher* egressBatcher{nullptr};
+
+  // If set, the packets of this connection are sent with MSG_ZEROCOPY through
+  // this sender. Owned by whoever owns the socket.
+  ZeroCopySender* zeroCopySender{nullptr};
+
+  // If set, the 1-RTT packets of this connection are encrypted on the helper
+  // threads of this pipeline. Owned by the server worker.
+  EncryptionPipeline* encryptionPipeline{nullptr};
+
+  // If set, the packets of this connection are built in buffers from this
+  // allocator. Owned by the server worker.
+  BufferAllocator* bufferAllocator{nullptr};
+
+  // If set, the send times of the outstanding packets are moved to the
+  // kernel timestamps this reads. Owned by whoever owns the socket.
+  TxTimestamper* txTimestamper{nullptr};
+
+  // Long header packets that were written but not sent yet, so that the
+  // packets of the next encryption level can share their datagram.
+  Buf pendingCoalescedPackets;
+
+  // The state below is only touched once in a while, or by some of the
+  // packets.
+
   // Initial header cipher.
   std::unique_ptr<PacketNumberCipher> initialHeaderCipher;
 
@@ -462,11 +844,28 @@ struct QuicConnectionStateBase {
   // Zero rtt write header cipher.
   std::unique_ptr<PacketNumberCipher> zeroRttWriteHeaderCipher;
 
-  // One rtt write header cipher.
-  std::unique_ptr<PacketNumberCipher> oneRttWriteHeaderCipher;
+  struct KeyUpdateState {
+    // The key phase of the 1-RTT packets written with oneRttWriteCipher.
+    ProtectionType writePhase{ProtectionType::KeyPhaseZero};
+    // The write cipher of the next key phase. It is derived ahead of time,
+    // so that a key update does not wait for HKDF.
+    std::unique_ptr<Aead> nextOneRttWriteCipher;
+    // The first packet written with oneRttWriteCipher. A key update can only
+    // start once it is acked.
+    folly::Optional<PacketNum> firstPacketNumInPhase;
+    // The number of packets written with oneRttWriteCipher.
+    uint64_t packetsWrittenInPhase{0};
+    // Whether this endpoint started a key update that the peer has not
+    // followed yet.
+    bool localUpdatePending{false};
+    uint64_t numKeyUpdates{0};
+  };
 
-  // Write cipher for 1-RTT data
-  std::unique_ptr<Aead> oneRttWriteCipher;
+  KeyUpdateState keyUpdateState;
+
+  // Whether the ack states, crypto stream buffers and keys of the Initial
+  // and Handshake packet number spaces were released.
+  bool handshakeSpacesDiscarded{false};
 
   // Write cipher for packets with initial keys.
   std::unique_ptr<Aead> initialWriteCipher;
@@ -505,6 +904,11 @@ struct QuicConnectionStateBase {
   // Current peer address.
   folly::SocketAddress peerAddress;
 
+  // Address the packets are sent from, when the socket is bound to the
+  // wildcard address. It is the destination address of the first packet of
+  // the peer. Unset lets the kernel pick one.
+  folly::Optional<folly::IPAddress> localAddress;
+
   // Local error on the connection.
   folly::Optional<std::pair<QuicErrorCode, std::string>> localConnectionError;
 
@@ -514,80 +918,6 @@ struct QuicConnectionStateBase {
   // Before deadline, transport may treat ENETUNREACH as non-fatal error
   folly::Optional<TimePoint> continueOnNetworkUnreachableDeadline;
 
-  // Supported versions in order of preference. Only meaningful to clients.
-  // TODO: move to client only conn state.
-  std::vector<QuicVersion> supportedVersions;
-
-  // Whether or not we received a new packet before a write.
-  bool receivedNewPacketBeforeWrite{false};
-
-  struct PendingEvents {
-    Resets resets;
-
-    folly::Optional<PathChallengeFrame> pathChallenge;
-
-    FrameList frames;
-
-    // true: schedule timeout if not scheduled
-    // false: cancel scheduled timeout
-    bool schedulePathValidationTimeout{false};
-
-    // If we should schedule a new Ack timeout, if it's not already scheduled
-    bool scheduleAckTimeout{false};
-
-    // Whether a connection level window update is due to send
-    bool connWindowUpdate{false};
-
-    // If there is a pending loss detection alarm update
-    bool setLossDetectionAlarm{false};
-
-    // Number of probing packets to send after PTO
-    uint8_t numProbePackets{0};
-  };
-
-  PendingEvents pendingEvents;
-
-  LossState lossState;
-
-  // This contains the ack and packet number related states for all three
-  // packet number space.
-  AckStates ackStates;
-
-  struct ConnectionFlowControlState {
-    // The size of the connection flow control window.
-    uint64_t windowSize{0};
-    // The max data we have advertised to the peer.
-    uint64_t advertisedMaxOffset{0};
-    // The max data the peer has advertised on the connection.
-    // This is set to 0 initially so that we can't send any data until we know
-    // the peer's flow control offset.
-    uint64_t peerAdvertisedMaxOffset{0};
-    // The sum of the min(read offsets) of all the streams on the conn.
-    uint64_t sumCurReadOffset{0};
-    // The sum of the max(offset) observed on all the streams on the conn.
-    uint64_t sumMaxObservedOffset{0};
-    // The sum of write offsets of all the streams, only including the offsets
-    // written on the wire.
-    uint64_t sumCurWriteOffset{0};
-    // The sum of length of data in all the stream buffers.
-    uint64_t sumCurStreamBufferLen{0};
-    // The packet number in which we got the last largest max data.
-    folly::Optional<PacketNum> largestMaxOffsetReceived;
-    // The following are advertised by the peer, and are set to zero initially
-    // so that we cannot send any data until we know the peer values.
-    // The initial max stream offset for peer-initiated bidirectional streams.
-    uint64_t peerAdvertisedInitialMaxStreamOffsetBidiLocal{0};
-    // The initial max stream offset for local-initiated bidirectional streams.
-    uint64_t peerAdvertisedInitialMaxStreamOffsetBidiRemote{0};
-    // The initial max stream offset for unidirectional streams.
-    uint64_t peerAdvertisedInitialMaxStreamOffsetUni{0};
-    // Time at which the last flow control update was sent by the transport.
-    folly::Optional<TimePoint> timeOfLastFlowControlUpdate;
-  };
-
-  // Current state of flow control.
-  ConnectionFlowControlState flowControlState;
-
   // The outstanding path challenge
   folly::Optional<PathChallengeFrame> outstandingPathValidation;
 
@@ -601,16 +931,6 @@ struct QuicConnectionStateBase {
   // until the handshake sets the timeout.
   std::chrono::milliseconds peerIdleTimeout{kMaxIdleTimeout};
 
-  // The max UDP packet size we will be sending, limited by both the received
-  // max_packet_size in Transport Parameters and PMTU
-  uint64_t udpSendPacketLen{kDefaultUDPSendPacketLen};
-
-  struct PacketSchedulingState {
-    StreamId lastScheduledStream{0};
-  };
-
-  PacketSchedulingState schedulingState;
-
   // The packet number of the latest packet that contains a MaxDataFrame sent
   // out by us.
   folly::Optional<PacketNum> latestMaxDataPacket;
@@ -624,6 +944,117 @@ struct QuicConnectionStateBase {
   // Track stats for various server events
   QuicTransportStatsCallback* infoCallback{nullptr};
 
+  // The latency of the writes delivered on all the streams of the
+  // connection, see DeliveryLatency.
+  DeliveryLatency deliveryLatency;
+
+  ConnectionCpuUsage cpuUsage;
+  // The phase being accounted for, and the cycle counter when it started or
+  // resumed
+  folly::Optional<ConnectionCpuUsage::Phase> cpuPhase;
+  uint64_t cpuPhaseStartCycles{0};
+
+  ConnectionAllocationUsage allocationUsage;
+  // The phase and subsystem being accounted for, and the thread's counters
+  // when they were last charged
+  folly::Optional<ConnectionAllocationUsage::Phase> allocationPhase;
+  ConnectionAllocationUsage::Subsystem allocationSubsystem{
+      ConnectionAllocationUsage::Subsystem::State};
+  uint64_t allocationsAtCharge{0};
+  uint64_t allocatedBytesAtCharge{0};
+
+  // Min ack delay advertised by the peer. Only set if the peer accepts
+  // ACK_FREQUENCY frames.
+  folly::Optional<std::chrono::microseconds> peerMinAckDelay;
+
+  // The latest ACK_FREQUENCY frame received from the peer.
+  folly::Optional<AckFrequencyFrame> ackFrequency;
+
+  // Sequence number of the next ACK_FREQUENCY frame to send.
+  uint64_t nextAckFrequencySequenceNumber{0};
+
+  struct DatagramState {
+    // Largest DATAGRAM frame the peer accepts, 0 if it accepts none.
+    uint64_t maxWriteFrameSize{0};
+    // Received datagrams not read by the app yet.
+    std::deque<Buf> readBuffer;
+    // Whether datagrams were received since the app was last told.
+    bool readAvailable{false};
+    // Datagrams to send. They are never retransmitted, so they are gone once
+    // written into a packet.
+    std::deque<Buf> writeBuffer;
+  };
+
+  DatagramState datagramState;
+
+  struct FecState {
+    // Whether both ends accept REPAIR frames, so that they are sent, and
+    // received STREAM frames are kept to rebuild lost ones from them.
+    bool enabled{false};
+    // The new STREAM frames of a stream sent since the last REPAIR frame,
+    // and the XOR of their data.
+    folly::Optional<RepairFrame> group;
+    // REPAIR frames to send. They are never retransmitted, so they are gone
+    // once written into a packet.
+    std::deque<RepairFrame> pendingRepairs;
+    // Recently received STREAM frames, the oldest are dropped first.
+    std::deque<ReadStreamFrame> receivedFrames;
+  };
+
+  FecState fecState;
+
+  struct PathMtuState {
+    enum class Phase : uint8_t {
+      // Path MTU discovery is off, or the peer parameters are not known yet.
+      Disabled,
+      // Probing for a larger udpSendPacketLen.
+      Searching,
+      // The search converged, it starts over at nextSearchTime.
+      SearchComplete,
+    };
+    Phase phase{Phase::Disabled};
+    // The packet size every path is assumed to support, udpSendPacketLen
+    // falls back to it on a black hole.
+    uint64_t basePacketSize{kDefaultUDPSendPacketLen};
+    // The largest packet size the peer accepts and that is probed for.
+    uint64_t maxPacketSize{kDefaultUDPSendPacketLen};
+    // The largest size known to work, and the largest one not known to fail.
+    uint64_t searchLow{kDefaultUDPSendPacketLen};
+    uint64_t searchHigh{kDefaultUDPSendPacketLen};
+    // The outstanding probe, at most one is sent at a time.
+    folly::Optional<PacketNum> probePacketNum;
+    uint64_t probeSize{0};
+    // Probes of probeSize lost so far.
+    uint8_t probeLosses{0};
+    TimePoint nextSearchTime;
+    // Lost packets larger than basePacketSize since one was last acked.
+    uint32_t largePacketsLost{0};
+    uint32_t probesSent{0};
+    uint32_t blackHoles{0};
+  };
+
+  PathMtuState pathMtuState;
+
+  // Debug information. Currently only used to debug busy loop of Transport
+  // WriteLooper.
+  struct DebugState {
+    bool needsWriteLoopDetect{false};
+    uint64_t currentEmptyLoopCount{0};
+    WriteDataReason writeDataReason{WriteDataReason::NO_WRITE};
+    NoWriteReason noWriteReason{NoWriteReason::WRITE_OK};
+    std::string schedulerName;
+  };
+
+  DebugState debugState;
+
+  std::shared_ptr<LoopDetectorCallback> loopDetectorCallback;
+
+  // Only clients use the state below, and only while connecting.
+
+  // Supported versions in order of preference. Only meaningful to clients.
+  // TODO: move to client only conn state.
+  std::vector<QuicVersion> supportedVersions;
+
   struct HappyEyeballsState {
     // Delay timer
     folly::HHWheelTimer::Callback* connAttemptDelayTimeout{nullptr};
@@ -653,27 +1084,6 @@ struct QuicConnectionStateBase {
   };
 
   HappyEyeballsState happyEyeballsState;
-
-  // Whether a connection can be paced based on its handshake and close states.
-  // For example, we may not want to pace a connection that's still handshaking.
-  bool canBePaced{false};
-
-  // Whether or not both ends agree to use partial reliability
-  bool partialReliabilityEnabled{false};
-
-  // Debug information. Currently only used to debug busy loop of Transport
-  // WriteLooper.
-  struct DebugState {
-    bool needsWriteLoopDetect{false};
-    uint64_t currentEmptyLoopCount{0};
-    WriteDataReason writeDataReason{WriteDataReason::NO_WRITE};
-    NoWriteReason noWriteReason{NoWriteReason::WRITE_OK};
-    std::string schedulerName;
-  };
-
-  DebugState debugState;
-
-  std::shared_ptr<LoopDetectorCallback> loopDetectorCallback;
 };
 
 std::ostream& operator<<(std::ostream& os, const QuicConnectionStateBase& st);
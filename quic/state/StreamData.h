@@ -8,10 +8,15 @@
 
 #pragma once
 
+#include <glog/logging.h>
 #include <quic/QuicConstants.h>
 #include <quic/codec/Types.h>
 #include <quic/state/StateMachine.h>
 
+#include <algorithm>
+#include <deque>
+#include <memory>
+
 namespace quic {
 
 struct StreamBuffer {
@@ -30,12 +35,398 @@ struct StreamBuffer {
   StreamBuffer& operator=(StreamBuffer&& other) = default;
 };
 
+/**
+ * A list of StreamBuffers kept sorted by offset.
+ *
+ * The send side keeps one buffer per written stream frame, rather than
+ * fixed-size chunks with their sent, acked and lost ranges in an
+ * IntervalSet: the scheduler, the packet rebuilder and the partial
+ * reliability skips clone the data of a frame straight out of its buffer,
+ * and an ack erases a whole buffer, so only writing part of a lost buffer
+ * splits data.
+ *
+ * This has the interface of the deque it is built on, so iteration and
+ * positional insertion work as before, and adds lookups by offset. Those are
+ * binary searches, so finding the buffer of an acked, lost or retransmitted
+ * frame does not scan the list. Positional insertion must keep the list
+ * sorted.
+ *
+ * The deque is only allocated once a buffer is added, most streams never
+ * lose data, and one way streams never use one of their read or
+ * retransmission lists. Clearing the list keeps the deque.
+ *
+ * The bytes of the data in the list can be counted in a total of the
+ * connection, see countBytesIn. Adding and removing buffers updates it, data
+ * added to or removed from a buffer of the list in place has to be counted
+ * with onDataAppended and onDataTrimmed.
+ */
+class StreamBufferList {
+ public:
+  using Container = std::deque<StreamBuffer>;
+  using value_type = StreamBuffer;
+  using iterator = Container::iterator;
+  using const_iterator = Container::const_iterator;
+  using reverse_iterator = Container::reverse_iterator;
+  using const_reverse_iterator = Container::const_reverse_iterator;
+
+  StreamBufferList() = default;
+  StreamBufferList(StreamBufferList&& other) = default;
+
+  /**
+   * Takes the buffers of other. The bytes move from the total of other to the
+   * total of this list, which keeps counting in it.
+   */
+  StreamBufferList& operator=(StreamBufferList&& other) {
+    if (this != &other) {
+      countRemoved(begin(), end());
+      other.countRemoved(other.begin(), other.end());
+      buffers_ = std::move(other.buffers_);
+      countAdded(begin(), end());
+    }
+    return *this;
+  }
+
+  ~StreamBufferList() {
+    countRemoved(begin(), end());
+  }
+
+  /**
+   * Counts the bytes of the data in the list in *total from now on. The list
+   * must not outlive it.
+   */
+  void countBytesIn(uint64_t* total) {
+    countRemoved(begin(), end());
+    totalBytes_ = total;
+    countAdded(begin(), end());
+  }
+
+  /**
+   * Counts bytes appended to the data of a buffer of the list in place.
+   */
+  void onDataAppended(uint64_t bytes) {
+    if (totalBytes_) {
+      *totalBytes_ += bytes;
+    }
+  }
+
+  /**
+   * Counts bytes trimmed or moved out of the data of a buffer of the list in
+   * place.
+   */
+  void onDataTrimmed(uint64_t bytes) {
+    if (totalBytes_) {
+      DCHECK_GE(*totalBytes_, bytes);
+      *totalBytes_ -= bytes;
+    }
+  }
+
+  /**
+   * Adds the buffer after all the buffers that start at or before it.
+   */
+  iterator insert(StreamBuffer&& buffer) {
+    auto pos = upper_bound(buffer.offset);
+    return insert(pos, std::move(buffer));
+  }
+
+  /**
+   * Adds the buffer like insert, but merged with the buffers right before and
+   * after it when their data is contiguous with its. Returns the buffer that
+   * holds its data.
+   */
+  iterator insertCoalesced(StreamBuffer&& buffer) {
+    auto pos = upper_bound(buffer.offset);
+    iterator merged;
+    if (pos != begin() && continues(*std::prev(pos), buffer)) {
+      merged = std::prev(pos);
+      onDataAppended(buffer.data.chainLength());
+      merged->data.append(buffer.data.move());
+      merged->eof = buffer.eof;
+    } else {
+      merged = insert(pos, std::move(buffer));
+    }
+    auto next = std::next(merged);
+    if (next != end() && continues(*merged, *next)) {
+      // The data stays in the list, the emptied buffer counts for nothing.
+      merged->data.append(next->data.move());
+      merged->eof = next->eof;
+      // Erasing from the middle of the deque invalidates the iterators.
+      auto index = merged - begin();
+      erase(next);
+      merged = begin() + index;
+    }
+    return merged;
+  }
+
+  iterator insert(const_iterator pos, StreamBuffer&& buffer) {
+    onDataAppended(buffer.data.chainLength());
+    if (!buffers_) {
+      // pos can only be the end of the empty list
+      auto& list = allocated();
+      return list.insert(list.cend(), std::move(buffer));
+    }
+    return buffers_->insert(pos, std::move(buffer));
+  }
+
+  template <typename... Args>
+  iterator emplace(const_iterator pos, Args&&... args) {
+    iterator itr;
+    if (!buffers_) {
+      auto& list = allocated();
+      itr = list.emplace(list.cend(), std::forward<Args>(args)...);
+    } else {
+      itr = buffers_->emplace(pos, std::forward<Args>(args)...);
+    }
+    onDataAppended(itr->data.chainLength());
+    return itr;
+  }
+
+  template <typename... Args>
+  StreamBuffer& emplace_back(Args&&... args) {
+    allocated().emplace_back(std::forward<Args>(args)...);
+    onDataAppended(buffers_->back().data.chainLength());
+    return buffers_->back();
+  }
+
+  void push_back(StreamBuffer&& buffer) {
+    onDataAppended(buffer.data.chainLength());
+    allocated().push_back(std::move(buffer));
+  }
+
+  iterator erase(const_iterator pos) {
+    onDataTrimmed(pos->data.chainLength());
+    return buffers_->erase(pos);
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    if (first == last) {
+      return buffers().erase(first, last);
+    }
+    countRemoved(first, last);
+    return buffers_->erase(first, last);
+  }
+
+  /**
+   * Removes the buffer pointed to by pos from the list and returns it.
+   */
+  StreamBuffer extract(iterator pos) {
+    StreamBuffer buffer(std::move(*pos));
+    buffers_->erase(pos);
+    onDataTrimmed(buffer.data.chainLength());
+    return buffer;
+  }
+
+  void pop_front() {
+    onDataTrimmed(buffers_->front().data.chainLength());
+    buffers_->pop_front();
+  }
+
+  /**
+   * Returns the first buffer that starts at offset, or end().
+   */
+  iterator find(uint64_t offset) {
+    auto itr = lower_bound(offset);
+    return itr != end() && itr->offset == offset ? itr : end();
+  }
+
+  const_iterator find(uint64_t offset) const {
+    auto itr = lower_bound(offset);
+    return itr != end() && itr->offset == offset ? itr : end();
+  }
+
+  /**
+   * Returns the first buffer that does not start before offset.
+   */
+  iterator lower_bound(uint64_t offset) {
+    return std::lower_bound(begin(), end(), offset, &startsBefore);
+  }
+
+  const_iterator lower_bound(uint64_t offset) const {
+    return std::lower_bound(begin(), end(), offset, &startsBefore);
+  }
+
+  /**
+   * Returns the first buffer that starts after offset.
+   */
+  iterator upper_bound(uint64_t offset) {
+    return std::upper_bound(begin(), end(), offset, &startsAfter);
+  }
+
+  const_iterator upper_bound(uint64_t offset) const {
+    return std::upper_bound(begin(), end(), offset, &startsAfter);
+  }
+
+  StreamBuffer& operator[](size_t index) {
+    return (*buffers_)[index];
+  }
+
+  const StreamBuffer& operator[](size_t index) const {
+    return (*buffers_)[index];
+  }
+
+  StreamBuffer& at(size_t index) {
+    return buffers().at(index);
+  }
+
+  const StreamBuffer& at(size_t index) const {
+    return buffers().at(index);
+  }
+
+  StreamBuffer& front() {
+    return buffers_->front();
+  }
+
+  const StreamBuffer& front() const {
+    return buffers_->front();
+  }
+
+  StreamBuffer& back() {
+    return buffers_->back();
+  }
+
+  const StreamBuffer& back() const {
+    return buffers_->back();
+  }
+
+  iterator begin() {
+    return buffers().begin();
+  }
+
+  const_iterator begin() const {
+    return buffers().begin();
+  }
+
+  const_iterator cbegin() const {
+    return buffers().cbegin();
+  }
+
+  iterator end() {
+    return buffers().end();
+  }
+
+  const_iterator end() const {
+    return buffers().end();
+  }
+
+  const_iterator cend() const {
+    return buffers().cend();
+  }
+
+  reverse_iterator rbegin() {
+    return buffers().rbegin();
+  }
+
+  const_reverse_iterator rbegin() const {
+    return buffers().rbegin();
+  }
+
+  reverse_iterator rend() {
+    return buffers().rend();
+  }
+
+  const_reverse_iterator rend() const {
+    return buffers().rend();
+  }
+
+  size_t size() const {
+    return buffers_ ? buffers_->size() : 0;
+  }
+
+  bool empty() const {
+    return !buffers_ || buffers_->empty();
+  }
+
+  void clear() {
+    if (buffers_) {
+      countRemoved(begin(), end());
+      buffers_->clear();
+    }
+  }
+
+ private:
+  void countAdded(const_iterator first, const_iterator last) {
+    if (totalBytes_) {
+      for (; first != last; ++first) {
+        *totalBytes_ += first->data.chainLength();
+      }
+    }
+  }
+
+  void countRemoved(const_iterator first, const_iterator last) {
+    if (totalBytes_) {
+      for (; first != last; ++first) {
+        onDataTrimmed(first->data.chainLength());
+      }
+    }
+  }
+
+  // Whether next starts right where the data of buffer ends.
+  static bool continues(const StreamBuffer& buffer, const StreamBuffer& next) {
+    return !buffer.eof &&
+        buffer.offset + buffer.data.chainLength() == next.offset;
+  }
+
+  static bool startsBefore(const StreamBuffer& buffer, uint64_t offset) {
+    return buffer.offset < offset;
+  }
+
+  static bool startsAfter(uint64_t offset, const StreamBuffer& buffer) {
+    return offset < buffer.offset;
+  }
+
+  // The buffers, or an empty deque shared by the lists that have none yet.
+  // The shared deque is never modified, only iterated.
+  Container& buffers() const {
+    return buffers_ ? *buffers_ : emptyBuffers();
+  }
+
+  static Container& emptyBuffers() {
+    static Container empty;
+    return empty;
+  }
+
+  Container& allocated() {
+    if (!buffers_) {
+      buffers_ = std::make_unique<Container>();
+    }
+    return *buffers_;
+  }
+
+  std::unique_ptr<Container> buffers_;
+  uint64_t* totalBytes_{nullptr};
+};
+
+/**
+ * Scheduling priority of a stream. Which fields are used depends on the
+ * StreamSchedulingPolicy of the connection.
+ */
+struct StreamPriority {
+  // Lower is more urgent, from 0 to kMaxStreamUrgency.
+  uint8_t urgency{kDefaultStreamUrgency};
+  // Whether the stream can share the connection with other streams of the
+  // same urgency, rather than being written to completion first.
+  bool incremental{false};
+  // Share of the connection relative to other streams, from 1 to
+  // kMaxStreamWeight.
+  uint16_t weight{kDefaultStreamWeight};
+
+  StreamPriority() = default;
+
+  StreamPriority(uint8_t urgencyIn, bool incrementalIn, uint16_t weightIn)
+      : urgency(urgencyIn), incremental(incrementalIn), weight(weightIn) {}
+
+  bool operator==(const StreamPriority& rhs) const {
+    return urgency == rhs.urgency && incremental == rhs.incremental &&
+        weight == rhs.weight;
+  }
+};
+
 struct QuicStreamLike {
   virtual ~QuicStreamLike() = default;
 
   // List of bytes that have been read and buffered. We need to buffer
-  // bytes in case we get bytes out of order.
-  std::deque<StreamBuffer> readBuffer;
+  // bytes in case we get bytes out of order. These are sorted in order of
+  // start offset and never overlap or touch each other.
+  StreamBufferList readBuffer;
 
   // List of bytes that have been written to the QUIC layer.
   folly::IOBufQueue writeBuffer{folly::IOBufQueue::cacheChainLength()};
@@ -45,11 +436,12 @@ struct QuicStreamLike {
   // We need to buffer these because these might be retransmitted
   // in the future.
   // These are sorted in order of start offset.
-  std::deque<StreamBuffer> retransmissionBuffer;
+  StreamBufferList retransmissionBuffer;
 
   // Stores a list of buffers which have been marked as loss by loss detector.
   // Each one represents one StreamFrame that was written.
-  std::deque<StreamBuffer> lossBuffer;
+  // These are sorted in order of start offset.
+  StreamBufferList lossBuffer;
 
   // Current offset of the start bytes in the write buffer.
   // This changes when we pop stuff off the writeBuffer.
@@ -61,6 +453,55 @@ struct QuicStreamLike {
   // N.B. used in QUIC partial reliability
   uint64_t minimumRetransmittableOffset{0};
 
+  struct DataExpiryState {
+    // How long written data stays worth sending, set with
+    // QuicSocket::setStreamDataExpiry. Data still unacked once it is older
+    // than that is expired, as with sendDataExpired.
+    folly::Optional<std::chrono::milliseconds> expiry;
+
+    // The end offset of each write since expiry was set, with the time it
+    // expires at, oldest first.
+    std::deque<std::pair<uint64_t, TimePoint>> deadlines;
+  };
+
+  // Only allocated once the app sets an expiry.
+  // N.B. used in QUIC partial reliability
+  std::unique_ptr<DataExpiryState> dataExpiry;
+
+  struct SendRateLimitState {
+    // Token bucket of the new data of the stream, set with
+    // QuicSocket::setStreamSendRateLimit.
+    uint64_t bytesPerSec;
+    uint64_t burstBytes;
+    // The new bytes the stream may write now. Retransmissions take none.
+    uint64_t tokens;
+    TimePoint lastRefill;
+  };
+
+  // Only allocated once the app limits the send rate of the stream.
+  std::unique_ptr<SendRateLimitState> sendRateLimit;
+
+  struct PendingDeliveryState {
+    struct Write {
+      uint64_t endOffset;
+      TimePoint writeTime;
+      // When the last byte of the write was first sent.
+      folly::Optional<TimePoint> sentTime;
+    };
+
+    // The writes yet to be delivered, oldest first.
+    std::deque<Write> writes;
+    // Number of writes at the front whose last byte was sent.
+    size_t numSent{0};
+  };
+
+  // Only allocated with TransportSettings::trackDeliveryLatency, at the first
+  // write.
+  std::unique_ptr<PendingDeliveryState> pendingDelivery;
+
+  // The latency of the writes of the stream delivered so far.
+  DeliveryLatency deliveryLatency;
+
   // Offset of the next expected bytes that we need to read from
   // the read buffer.
   uint64_t currentReadOffset{0};
@@ -134,11 +575,38 @@ inline std::string streamStateToString(const StreamReceiveStateData& state) {
       [](const StreamReceiveStates::Invalid&) { return "Invalid"; });
 }
 
+/**
+ * Time that the writes to streams took to be delivered, counted when
+ * TransportSettings::trackDeliveryLatency is on. The queueing time of a write
+ * is from when the app wrote it to when its last byte was first sent, which
+ * includes the time it waited on the cwnd or flow control. The network time
+ * is from then until all of it was acked.
+ */
+struct DeliveryLatency {
+  uint64_t writesDelivered{0};
+  std::chrono::microseconds totalQueueingTime{0us};
+  std::chrono::microseconds totalNetworkTime{0us};
+
+  void add(
+      std::chrono::microseconds queueingTime,
+      std::chrono::microseconds networkTime) {
+    writesDelivered++;
+    totalQueueingTime += queueingTime;
+    totalNetworkTime += networkTime;
+  }
+};
+
 struct QuicStreamState : public QuicStreamLike {
   virtual ~QuicStreamState() override = default;
 
   QuicStreamState(StreamId id, QuicConnectionStateBase& conn);
 
+  /**
+   * Makes the state that of a new stream of the same connection, as if it
+   * had just been constructed, but keeps the memory of its buffers.
+   */
+  void reset(StreamId id);
+
   // Connection that this stream is associated with.
   QuicConnectionStateBase& conn;
 
@@ -191,6 +659,20 @@ struct QuicStreamState : public QuicStreamLike {
   // lastHolbTime indicates whether the stream is HOL blocked at the moment.
   uint32_t holbCount{0};
 
+  // Whether the write buffer reached streamWriteBufferHighWatermark, and has
+  // yet to drain down to streamWriteBufferLowWatermark. The stream is not
+  // reported write ready in between.
+  bool writeBufferAboveHighWatermark{false};
+
+  // Scheduling priority, set by the app via setStreamPriority. Only change it
+  // through QuicStreamManager::setStreamPriority, which keeps the writable
+  // streams by urgency up to date.
+  StreamPriority priority;
+
+  // Bytes the stream may still write in the current round of weighted
+  // round-robin scheduling.
+  uint64_t schedulingDeficit{0};
+
   // Returns true if both send and receive state machines are in a terminal
   // state
   bool inTerminalStates() const {
@@ -218,6 +700,10 @@ struct QuicStreamState : public QuicStreamLike {
 
   bool hasWritableData() const {
     if (!writeBuffer.empty()) {
+      if (sendRateLimit && sendRateLimit->tokens == 0) {
+        // Waiting for the send rate limit to refill.
+        return false;
+      }
       return flowControlState.peerAdvertisedMaxOffset - currentWriteOffset > 0;
     }
     if (finalWriteOffset) {
@@ -235,5 +721,9 @@ struct QuicStreamState : public QuicStreamLike {
   bool hasPeekableData() const {
     return readBuffer.size() > 0;
   }
+
+ private:
+  // Sets the flow control windows and the state machines for the stream id.
+  void setInitialState();
 };
 } // namespace quic
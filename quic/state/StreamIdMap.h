@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <quic/codec/Types.h>
+
+#include <array>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <tuple>
+#include <utility>
+
+namespace quic {
+
+/**
+ * A map keyed by stream id, laid out like the StreamTable: each of the four
+ * stream types has a deque of slots indexed by (id >> 2), offset by the index
+ * of its first slot, so that finding the value of a stream is a single
+ * indexed access rather than a hash lookup. Empty slots at either end are
+ * dropped.
+ *
+ * It has the part of the interface of std::unordered_map that the transport
+ * uses for its per-stream callbacks. As there, references to the values stay
+ * valid until their stream is erased. Iterators are only invalidated by
+ * erasing their own stream, and iterate in stream type and then stream id
+ * order.
+ */
+template <typename T>
+class StreamIdMap {
+ public:
+  // Only the value may be modified through an iterator.
+  using value_type = std::pair<StreamId, T>;
+
+ private:
+  static constexpr size_t kNumStreamTypes = 4;
+  static constexpr StreamId kEnd = std::numeric_limits<StreamId>::max();
+
+  template <typename Value, typename Map>
+  class Iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename StreamIdMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Value*;
+    using reference = Value&;
+
+    Iterator() = default;
+
+    Iterator(Map* map, StreamId id) : map_(map), id_(id) {}
+
+    // An iterator converts to a const_iterator.
+    template <typename OtherValue, typename OtherMap>
+    /* implicit */ Iterator(const Iterator<OtherValue, OtherMap>& other)
+        : map_(other.map_), id_(other.id_) {}
+
+    Value& operator*() const {
+      return **map_->findSlot(id_);
+    }
+
+    Value* operator->() const {
+      return &**this;
+    }
+
+    Iterator& operator++() {
+      id_ = map_->findFrom(typeOf(id_), indexOf(id_) + 1);
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      auto current = *this;
+      ++*this;
+      return current;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return id_ == other.id_;
+    }
+
+    bool operator!=(const Iterator& other) const {
+      return id_ != other.id_;
+    }
+
+   private:
+    template <typename, typename>
+    friend class Iterator;
+
+    Map* map_{nullptr};
+    StreamId id_{kEnd};
+  };
+
+ public:
+  using iterator = Iterator<value_type, StreamIdMap>;
+  using const_iterator = Iterator<const value_type, const StreamIdMap>;
+
+  StreamIdMap() = default;
+
+  StreamIdMap(const StreamIdMap&) = default;
+  StreamIdMap& operator=(const StreamIdMap&) = default;
+
+  StreamIdMap(StreamIdMap&& other) noexcept
+      : entriesByType_(std::move(other.entriesByType_)), size_(other.size_) {
+    other.clear();
+  }
+
+  StreamIdMap& operator=(StreamIdMap&& other) noexcept {
+    entriesByType_ = std::move(other.entriesByType_);
+    size_ = other.size_;
+    other.clear();
+    return *this;
+  }
+
+  iterator find(StreamId id) {
+    return findSlot(id) ? iterator(this, id) : end();
+  }
+
+  const_iterator find(StreamId id) const {
+    return findSlot(id) ? const_iterator(this, id) : end();
+  }
+
+  size_t count(StreamId id) const {
+    return findSlot(id) ? 1 : 0;
+  }
+
+  /**
+   * Creates the value of the stream from args unless it already has one.
+   * Returns the value of the stream and whether it was created.
+   */
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(StreamId id, Args&&... args) {
+    auto& slot = makeSlot(id);
+    if (slot) {
+      return std::make_pair(iterator(this, id), false);
+    }
+    slot.emplace(
+        std::piecewise_construct,
+        std::forward_as_tuple(id),
+        std::forward_as_tuple(std::forward<Args>(args)...));
+    size_++;
+    return std::make_pair(iterator(this, id), true);
+  }
+
+  T& operator[](StreamId id) {
+    return emplace(id).first->second;
+  }
+
+  /**
+   * Removes the value of the stream. Returns the number of values removed.
+   */
+  size_t erase(StreamId id) {
+    auto& entries = entriesByType_[typeOf(id)];
+    auto index = indexOf(id);
+    if (index < entries.firstIndex ||
+        index - entries.firstIndex >= entries.slots.size()) {
+      return 0;
+    }
+    auto& slot = entries.slots[index - entries.firstIndex];
+    if (!slot) {
+      return 0;
+    }
+    slot.reset();
+    size_--;
+    // Shrink the window to the streams that are still there.
+    while (!entries.slots.empty() && !entries.slots.front()) {
+      entries.slots.pop_front();
+      entries.firstIndex++;
+    }
+    while (!entries.slots.empty() && !entries.slots.back()) {
+      entries.slots.pop_back();
+    }
+    return 1;
+  }
+
+  void erase(const_iterator it) {
+    erase(it->first);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  void clear() {
+    for (auto& entries : entriesByType_) {
+      entries.slots.clear();
+      entries.firstIndex = 0;
+    }
+    size_ = 0;
+  }
+
+  iterator begin() {
+    return iterator(this, findFrom(0, 0));
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, findFrom(0, 0));
+  }
+
+  iterator end() {
+    return iterator(this, kEnd);
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, kEnd);
+  }
+
+ private:
+  static size_t typeOf(StreamId id) {
+    return id & (kNumStreamTypes - 1);
+  }
+
+  static StreamId indexOf(StreamId id) {
+    return id >> 2;
+  }
+
+  struct Entries {
+    // index of the stream in the first slot
+    StreamId firstIndex{0};
+    std::deque<folly::Optional<value_type>> slots;
+  };
+
+  const folly::Optional<value_type>* findSlot(StreamId id) const {
+    const auto& entries = entriesByType_[typeOf(id)];
+    auto index = indexOf(id);
+    if (index < entries.firstIndex ||
+        index - entries.firstIndex >= entries.slots.size()) {
+      return nullptr;
+    }
+    const auto& slot = entries.slots[index - entries.firstIndex];
+    return slot ? &slot : nullptr;
+  }
+
+  folly::Optional<value_type>* findSlot(StreamId id) {
+    return const_cast<folly::Optional<value_type>*>(
+        static_cast<const StreamIdMap*>(this)->findSlot(id));
+  }
+
+  folly::Optional<value_type>& makeSlot(StreamId id) {
+    auto& entries = entriesByType_[typeOf(id)];
+    auto index = indexOf(id);
+    if (entries.slots.empty()) {
+      entries.firstIndex = index;
+    }
+    // Grow the window of slots to include index.
+    while (index < entries.firstIndex) {
+      entries.slots.emplace_front();
+      entries.firstIndex--;
+    }
+    while (index - entries.firstIndex >= entries.slots.size()) {
+      entries.slots.emplace_back();
+    }
+    return entries.slots[index - entries.firstIndex];
+  }
+
+  // The id of the first stream with a value from the index of the type on,
+  // or kEnd if there is none.
+  StreamId findFrom(size_t type, StreamId index) const {
+    for (; type < kNumStreamTypes; ++type, index = 0) {
+      const auto& entries = entriesByType_[type];
+      auto pos = index > entries.firstIndex ? index - entries.firstIndex : 0;
+      for (; pos < entries.slots.size(); ++pos) {
+        if (entries.slots[pos]) {
+          return entries.slots[pos]->first;
+        }
+      }
+    }
+    return kEnd;
+  }
+
+  std::array<Entries, kNumStreamTypes> entriesByType_;
+  size_t size_{0};
+};
+
+} // namespace quic
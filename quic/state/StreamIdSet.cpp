@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/StreamIdSet.h>
+
+#include <folly/lang/Bits.h>
+
+namespace quic {
+
+constexpr StreamId StreamIdSet::kEnd;
+constexpr StreamId StreamIdSet::kBitsPerWord;
+
+bool StreamIdSet::insert(StreamId id) {
+  StreamId wordId = id - (id % kBitsPerWord);
+  if (words_.empty()) {
+    firstId_ = wordId;
+  }
+  // Grow the window of words to include id.
+  while (wordId < firstId_) {
+    words_.push_front(0);
+    firstId_ -= kBitsPerWord;
+  }
+  auto index = (wordId - firstId_) / kBitsPerWord;
+  while (index >= words_.size()) {
+    words_.push_back(0);
+  }
+  auto& word = words_[index];
+  if (word & bitOf(id)) {
+    return false;
+  }
+  word |= bitOf(id);
+  size_++;
+  return true;
+}
+
+size_t StreamIdSet::erase(StreamId id) {
+  if (!contains(id)) {
+    return 0;
+  }
+  words_[(id - firstId_) / kBitsPerWord] &= ~bitOf(id);
+  size_--;
+  // Shrink the window to the ids that are still there.
+  while (!words_.empty() && words_.front() == 0) {
+    words_.pop_front();
+    firstId_ += kBitsPerWord;
+  }
+  while (!words_.empty() && words_.back() == 0) {
+    words_.pop_back();
+  }
+  return 1;
+}
+
+StreamId StreamIdSet::nextFrom(StreamId id) const {
+  if (id < firstId_) {
+    id = firstId_;
+  }
+  auto index = (id - firstId_) / kBitsPerWord;
+  if (index >= words_.size()) {
+    return kEnd;
+  }
+  // Ignore the bits of the ids below id in its own word.
+  uint64_t word = words_[index] & ~(bitOf(id) - 1);
+  while (word == 0) {
+    if (++index >= words_.size()) {
+      return kEnd;
+    }
+    word = words_[index];
+  }
+  return firstId_ + index * kBitsPerWord + folly::findFirstSet(word) - 1;
+}
+
+} // namespace quic
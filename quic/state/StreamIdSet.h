@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/codec/Types.h>
+
+#include <boost/iterator/iterator_facade.hpp>
+
+#include <deque>
+#include <limits>
+
+namespace quic {
+
+/**
+ * An ordered set of stream ids, stored as a bitmap.
+ *
+ * Stream ids are dense, so the set keeps one bit per id between the smallest
+ * and the largest id it contains, in 64 bit words. Inserting or erasing an id
+ * inside that window only flips a bit and does not allocate. Iteration is in
+ * increasing id order like std::set.
+ *
+ * Iterators hold the id they point to rather than a position in the bitmap,
+ * so they stay valid when other ids are inserted or erased.
+ */
+class StreamIdSet {
+ public:
+  using key_type = StreamId;
+  using value_type = StreamId;
+
+  class const_iterator : public boost::iterator_facade<
+                             const_iterator,
+                             const StreamId,
+                             boost::forward_traversal_tag,
+                             StreamId> {
+    friend class boost::iterator_core_access;
+
+   public:
+    const_iterator() = default;
+
+    const_iterator(const StreamIdSet* set, StreamId id) : set_(set), id_(id) {}
+
+   private:
+    StreamId dereference() const {
+      return id_;
+    }
+
+    bool equal(const const_iterator& other) const {
+      return id_ == other.id_;
+    }
+
+    void increment() {
+      id_ = set_->nextFrom(id_ + 1);
+    }
+
+    const StreamIdSet* set_{nullptr};
+    StreamId id_{kEnd};
+  };
+
+  using iterator = const_iterator;
+
+  /**
+   * Adds the id to the set. Returns false if it was already there.
+   */
+  bool insert(StreamId id);
+
+  bool emplace(StreamId id) {
+    return insert(id);
+  }
+
+  /**
+   * Removes the id from the set. Returns the number of ids removed.
+   */
+  size_t erase(StreamId id);
+
+  /**
+   * Removes the id pointed to by itr and returns an iterator to the next id.
+   */
+  const_iterator erase(const_iterator itr) {
+    auto next = std::next(itr);
+    erase(*itr);
+    return next;
+  }
+
+  bool contains(StreamId id) const {
+    if (id < firstId_) {
+      return false;
+    }
+    auto index = (id - firstId_) / kBitsPerWord;
+    return index < words_.size() && (words_[index] & bitOf(id)) != 0;
+  }
+
+  size_t count(StreamId id) const {
+    return contains(id) ? 1 : 0;
+  }
+
+  const_iterator find(StreamId id) const {
+    return contains(id) ? const_iterator(this, id) : end();
+  }
+
+  /**
+   * Returns an iterator to the first id that is not less than id.
+   */
+  const_iterator lower_bound(StreamId id) const {
+    return const_iterator(this, nextFrom(id));
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, nextFrom(firstId_));
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, kEnd);
+  }
+
+  const_iterator cbegin() const {
+    return begin();
+  }
+
+  const_iterator cend() const {
+    return end();
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  void clear() {
+    words_.clear();
+    firstId_ = 0;
+    size_ = 0;
+  }
+
+ private:
+  static constexpr StreamId kEnd = std::numeric_limits<StreamId>::max();
+  static constexpr StreamId kBitsPerWord = 64;
+
+  static uint64_t bitOf(StreamId id) {
+    return uint64_t(1) << (id % kBitsPerWord);
+  }
+
+  /**
+   * Returns the smallest id in the set that is not less than id, or kEnd.
+   */
+  StreamId nextFrom(StreamId id) const;
+
+  // id of the lowest bit of the first word, always a multiple of kBitsPerWord
+  StreamId firstId_{0};
+  std::deque<uint64_t> words_;
+  size_t size_{0};
+};
+
+} // namespace quic
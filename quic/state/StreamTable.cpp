@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/StreamTable.h>
+
+namespace quic {
+
+QuicStreamState& StreamTable::emplace(
+    StreamId id,
+    QuicConnectionStateBase& conn) {
+  auto& streams = streamsByType_[typeOf(id)];
+  auto index = indexOf(id);
+  if (streams.slots.empty()) {
+    streams.firstIndex = index;
+  }
+  // Grow the window of slots to include index.
+  while (index < streams.firstIndex) {
+    streams.slots.emplace_front();
+    streams.firstIndex--;
+  }
+  while (index - streams.firstIndex >= streams.slots.size()) {
+    streams.slots.emplace_back();
+  }
+  auto& slot = streams.slots[index - streams.firstIndex];
+  DCHECK(!slot) << "Stream already exists, id=" << id;
+  if (!recycledStates_.empty() && &recycledStates_.back()->conn == &conn) {
+    slot = std::move(recycledStates_.back());
+    recycledStates_.pop_back();
+    slot->reset(id);
+  } else {
+    slot = std::make_unique<QuicStreamState>(id, conn);
+  }
+  size_++;
+  return *slot;
+}
+
+bool StreamTable::erase(StreamId id) {
+  auto& streams = streamsByType_[typeOf(id)];
+  auto index = indexOf(id);
+  if (index < streams.firstIndex ||
+      index - streams.firstIndex >= streams.slots.size()) {
+    return false;
+  }
+  auto& slot = streams.slots[index - streams.firstIndex];
+  if (!slot) {
+    return false;
+  }
+  if (recycledStates_.size() < kMaxRecycledStreamStates) {
+    recycledStates_.push_back(std::move(slot));
+  } else {
+    slot.reset();
+  }
+  size_--;
+  // Shrink the window to the streams that are still there.
+  while (!streams.slots.empty() && !streams.slots.front()) {
+    streams.slots.pop_front();
+    streams.firstIndex++;
+  }
+  while (!streams.slots.empty() && !streams.slots.back()) {
+    streams.slots.pop_back();
+  }
+  return true;
+}
+
+void StreamTable::clear() {
+  for (auto& streams : streamsByType_) {
+    streams.slots.clear();
+    streams.firstIndex = 0;
+  }
+  size_ = 0;
+  recycledStates_.clear();
+}
+
+} // namespace quic
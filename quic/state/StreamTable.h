@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/codec/Types.h>
+#include <quic/state/StreamData.h>
+
+#include <array>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace quic {
+
+/**
+ * Holds the state of the streams of a connection, indexed by stream id.
+ *
+ * The ids of each of the four stream types are dense, so every type has a
+ * deque of slots indexed by (id >> 2), offset by the index of its first
+ * slot, which makes lookups O(1). Empty slots at either end are dropped, so
+ * a type only spans the ids between its oldest and newest streams. The
+ * states never move once created, pointers to them stay valid until their
+ * stream is erased.
+ *
+ * The states of erased streams are kept, up to kMaxRecycledStreamStates, and
+ * reset in place for the next streams, so that a connection opening and
+ * closing a stream per request does not allocate a state and its buffers
+ * every time.
+ */
+class StreamTable {
+ public:
+  StreamTable() = default;
+
+  StreamTable(const StreamTable&) = delete;
+  StreamTable& operator=(const StreamTable&) = delete;
+
+  /**
+   * Returns the state of the stream, or nullptr if there is none.
+   */
+  QuicStreamState* find(StreamId id) const {
+    const auto& streams = streamsByType_[typeOf(id)];
+    auto index = indexOf(id);
+    if (index < streams.firstIndex ||
+        index - streams.firstIndex >= streams.slots.size()) {
+      return nullptr;
+    }
+    return streams.slots[index - streams.firstIndex].get();
+  }
+
+  bool contains(StreamId id) const {
+    return find(id) != nullptr;
+  }
+
+  /**
+   * Creates the state of a stream that is not in the table yet.
+   */
+  QuicStreamState& emplace(StreamId id, QuicConnectionStateBase& conn);
+
+  /**
+   * Removes the state of the stream. Returns false if there was none.
+   */
+  bool erase(StreamId id);
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+  void clear();
+
+  /**
+   * Calls f on the state of every stream, ordered by stream type and then by
+   * stream id.
+   */
+  template <typename F>
+  void forEach(F&& f) const {
+    for (const auto& streams : streamsByType_) {
+      for (const auto& slot : streams.slots) {
+        if (slot) {
+          f(*slot);
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kNumStreamTypes = 4;
+
+  static size_t typeOf(StreamId id) {
+    return id & (kNumStreamTypes - 1);
+  }
+
+  static StreamId indexOf(StreamId id) {
+    return id >> 2;
+  }
+
+  struct Streams {
+    // index of the stream in the first slot
+    StreamId firstIndex{0};
+    std::deque<std::unique_ptr<QuicStreamState>> slots;
+  };
+
+  std::array<Streams, kNumStreamTypes> streamsByType_;
+  size_t size_{0};
+  // States of erased streams, to be reused
+  std::vector<std::unique_ptr<QuicStreamState>> recycledStates_;
+};
+
+} // namespace quic
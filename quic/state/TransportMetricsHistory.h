@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <quic/QuicConstants.h>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace quic {
+
+struct TransportMetricsSample {
+  // when the ack that the sample follows was received
+  TimePoint time;
+  std::chrono::microseconds srtt{0us};
+  std::chrono::microseconds lrtt{0us};
+  uint64_t congestionWindow{0};
+  uint64_t bytesInFlight{0};
+  // see QuicSocket::ConnectionMetrics::deliveryRate
+  uint64_t deliveryRate{0};
+  // LossState::rtxCount when the sample was taken
+  uint32_t packetsRetransmitted{0};
+};
+
+/**
+ * The last samples of the metrics of a connection, in a ring buffer of a
+ * fixed capacity. The buffer is allocated with the first sample, and once it
+ * is full each sample replaces the oldest one without allocating.
+ */
+class TransportMetricsHistory {
+ public:
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  /**
+   * Drops the samples when the capacity changes.
+   */
+  void setCapacity(size_t capacity) {
+    if (capacity != capacity_) {
+      capacity_ = capacity;
+      clear();
+    }
+  }
+
+  size_t size() const {
+    return samples_.size();
+  }
+
+  bool empty() const {
+    return samples_.empty();
+  }
+
+  void add(const TransportMetricsSample& sample) {
+    if (capacity_ == 0) {
+      return;
+    }
+    if (samples_.size() < capacity_) {
+      samples_.reserve(capacity_);
+      samples_.push_back(sample);
+      return;
+    }
+    samples_[oldest_] = sample;
+    oldest_ = (oldest_ + 1) % capacity_;
+  }
+
+  const TransportMetricsSample* newest() const {
+    if (samples_.empty()) {
+      return nullptr;
+    }
+    return &samples_[(oldest_ + samples_.size() - 1) % samples_.size()];
+  }
+
+  /**
+   * The samples, oldest first.
+   */
+  std::vector<TransportMetricsSample> samples() const {
+    std::vector<TransportMetricsSample> result;
+    result.reserve(samples_.size());
+    result.insert(result.end(), samples_.begin() + oldest_, samples_.end());
+    result.insert(result.end(), samples_.begin(), samples_.begin() + oldest_);
+    return result;
+  }
+
+  void clear() {
+    samples_.clear();
+    samples_.shrink_to_fit();
+    oldest_ = 0;
+  }
+
+ private:
+  size_t capacity_{0};
+  std::vector<TransportMetricsSample> samples_;
+  // index of the oldest sample once the buffer is full
+  size_t oldest_{0};
+};
+
+} // namespace quic
@@ -26,18 +26,53 @@ struct TransportSettings {
   uint64_t advertisedInitialMaxStreamsUni{std::numeric_limits<uint32_t>::max()};
   // Maximum number of packets to buffer while cipher is unavailable.
   uint32_t maxPacketsToBuffer{kDefaultMaxBufferedPackets};
+  // Maximum number of bytes of the packets a server worker buffers across
+  // all its connections while their ciphers are unavailable. Zero removes
+  // the cap.
+  uint64_t maxPendingPacketBytes{kDefaultMaxPendingPacketBytes};
   // Idle timeout to advertise to the peer.
   std::chrono::milliseconds idleTimeout{kDefaultIdleTimeout};
   // Ack delay exponent to use.
   uint64_t ackDelayExponent{kDefaultAckDelayExponent};
+  // Maximum number of ack ranges to send in an ack frame. Older ranges are
+  // dropped from the ack state once there are more than this many.
+  uint64_t maxAckBlocks{kDefaultMaxAckBlocks};
+  // Number of packets with retransmittable data to receive before sending an
+  // ack, unless the peer asks for another value with an ACK_FREQUENCY frame.
+  uint64_t rxPacketsBeforeAckThreshold{kRxPacketsPendingBeforeAckThresh};
+  // Order in which streams are written into packets.
+  StreamSchedulingPolicy streamSchedulingPolicy{
+      StreamSchedulingPolicy::RoundRobin};
   // Default congestion controller type.
   CongestionControlType defaultCongestionController{
       CongestionControlType::Cubic};
   // Param to determine sensitivity of CongestionController to latency. Only
   // used by COPA.
   folly::Optional<double> latencyFactor;
-  // The max UDP packet size we are willing to receive.
+  // Let Copa switch to its competitive mode when the queue does not drain,
+  // as it does behind a buffer-filling flow such as Cubic, and adapt its
+  // latencyFactor to keep its share. It stays at latencyFactor otherwise.
+  // Copa then also paces over its standing rtt rather than srtt.
+  bool copaModeSwitching{false};
+  // Rate the StaticRate congestion controller paces at, in bytes per second.
+  // Zero leaves the connection to its cwnd.
+  uint64_t staticRateBytesPerSec{0};
+  // Bound the cwnd of StaticRate by the rate times the srtt, rather than
+  // by maxCwndInMss alone, see StaticRate.
+  bool staticRateCwndGuard{true};
+  // The max UDP packet size we are willing to receive. It is sent to the peer
+  // as max_packet_size and sizes the read buffers, so it has to be raised
+  // on both sides for packets larger than kDefaultUDPReadBufferSize, such as
+  // those of a 9000 byte MTU path.
   uint64_t maxRecvPacketSize{kDefaultUDPReadBufferSize};
+  // Number of released receive buffers the server worker and the client keep
+  // around for reuse. Zero allocates a new buffer for every read.
+  uint32_t readBufferPoolSize{0};
+  // Bytes of 2MB huge page slabs each server worker carves the receive
+  // buffers and the packet buffers of its connections out of, see
+  // HugePageBufferAllocator. The size classes fit best with a
+  // maxRecvPacketSize of 1500 or 9216. Zero uses the global allocator.
+  uint64_t hugePageBufferBytes{0};
   // Can we ignore the path mtu when sending a packet. This is useful for
   // testing.
   bool canIgnorePathMTU{false};
@@ -45,16 +80,62 @@ struct TransportSettings {
   // only be used in environments where you know your IP address does not
   // change. See AsyncUDPSocket::connect for the caveats.
   bool connectUDP{false};
+  // Starts a 1-RTT key update after this many packets were written with the
+  // same keys, 0 never. The peer has to support key updates.
+  uint64_t keyUpdatePacketInterval{0};
+  // Whether the state of the Initial and Handshake packet number spaces is
+  // released once the handshake is done and the peer acked a 1-RTT packet.
+  // Packets in those spaces are dropped after that.
+  bool discardHandshakeSpaces{false};
+  // Server only. Connections at rest, as for a handoff, that have neither
+  // sent nor received a packet for this long are hibernated by the worker:
+  // only their encoded handoff state is kept, and a transport is made from
+  // it again on their next packet. Zero never hibernates.
+  std::chrono::milliseconds hibernateIdleConnectionsAfter{0};
+  // Server only. The worker sends a PING on the connections, once their
+  // handshake is done, that have neither sent nor received a packet for this
+  // long. They are sent from a timing wheel of the worker rather than by the
+  // write loop of each connection. Zero sends no keepalives.
+  std::chrono::milliseconds keepaliveInterval{0};
+  // How long the client waits for a response on the first address family
+  // before happy eyeballs also sends on the second one. By default this is
+  // kHappyEyeballsV4Delay, or kHappyEyeballsConnAttemptDelayWithCache when
+  // the family is cached. Zero races the Initials on both families from the
+  // start, the handshake is the same on the two sockets.
+  folly::Optional<std::chrono::milliseconds> happyEyeballsConnAttemptDelay;
   // Maximum number of consecutive PTOs before the connection is torn down.
   uint16_t maxNumPTOs{kDefaultMaxNumPTO};
   // Whether to turn off PMTUD on the socket
   bool turnoffPMTUD{false};
+  // Whether to search for a larger udpSendPacketLen with padded PING probes
+  // once the handshake is done (DPLPMTUD, RFC 8899). Probes go up to the
+  // max_packet_size of the peer and pathMtuMaxPacketSize, and the packet size
+  // falls back to the default when larger packets keep getting lost.
+  bool pathMtuDiscovery{false};
+  uint64_t pathMtuMaxPacketSize{kDefaultMaxUDPPayload};
+  std::chrono::seconds pathMtuRaiseInterval{kDefaultPathMtuRaiseInterval};
   // Whether to listen to socket error
   bool enableSocketErrMsgCallback{true};
   // Whether pacing is enabled.
   bool pacingEnabled{false};
+  // Whether to stamp every paced packet with its departure time through
+  // SO_TXTIME and leave the pacing to the fq qdisc, instead of releasing
+  // bursts from the pacing timer. Falls back to timer pacing when the socket
+  // does not support SO_TXTIME.
+  bool pacingUseTxTime{false};
+  // Whether to pace with TokenBucketPacer, whose bursts scale with the rate
+  // and which makes up for late pacing timers, instead of DefaultPacer.
+  bool pacingUseTokenBucket{false};
   // The maximum number of packets to burst out during pacing
   uint64_t maxBurstPackets{kDefaultMaxBurstPackets};
+  // Whether the connections of a server worker share one pacing scheduler,
+  // which writes for all the connections due at a tick in a single wakeup,
+  // instead of each one having a timeout on the pacing timer.
+  bool sharedPacingScheduler{false};
+  // Whether the connections of a server worker from the same subnet share
+  // one congestion window, so that parallel connections from a client do
+  // not overshoot the bottleneck together. See SharedCongestionManager.
+  bool sharedCongestionControl{false};
   // Pacing timer tick interval
   std::chrono::microseconds pacingTimerTickInterval{
       kDefaultPacingTimerTickInterval};
@@ -65,17 +146,171 @@ struct TransportSettings {
   // writeConnectionDataToSocket.
   uint64_t writeConnectionDataPacketsLimit{
       kDefaultWriteConnectionDataPacketLimit};
+  // Packets that the connections of a server worker write in an event loop
+  // iteration, split among them by the congestion window they have open,
+  // instead of writeConnectionDataPacketsLimit each. Each connection still
+  // writes at least writeConnectionDataPacketsLimit packets. 0 disables it.
+  uint64_t writeLoopPacketBudget{0};
+  // With writeLoopPacketBudget, once the connections of a loop have been
+  // writing for this long the others only write
+  // writeConnectionDataPacketsLimit packets. 0 for no bound.
+  std::chrono::microseconds writeLoopTimeBudget{0};
   // Frequency of sending flow control updates. We can send one update every
   // flowControlRttFrequency * RTT if the flow control changes.
   uint16_t flowControlRttFrequency{2};
   // Frequency of sending flow control updates. We can send one update every
   // flowControlWindowFrequency * window if the flow control changes.
   uint16_t flowControlWindowFrequency{2};
+  // At most this many bytes of a file written with writeFile() are in the
+  // write buffer of its stream.
+  uint64_t fileWriteChunkSize{kDefaultFileWriteChunkSize};
+  // Largest DATAGRAM frame advertised to the peer, 0 to not accept any.
+  uint64_t maxDatagramFrameSize{0};
+  // Received datagrams kept until the app reads them, and datagrams kept
+  // until they can be sent. The oldest ones are dropped past these.
+  size_t datagramReadBufferSize{kDefaultMaxDatagramsBuffered};
+  size_t datagramWriteBufferSize{kDefaultMaxDatagramsBuffered};
+  // Accept REPAIR frames, and send them when the peer does too, so that a
+  // lost STREAM frame at the tail of a write is rebuilt by the receiver
+  // instead of retransmitted after a PTO. Each REPAIR frame protects up to
+  // fecGroupSize new STREAM frames of a stream.
+  bool fecEnabled{false};
+  uint64_t fecGroupSize{kDefaultFecGroupSize};
+  // Whether to double a receive window whenever half of it is read within
+  // flowControlRttFrequency * RTT of the last update, since the window and
+  // not the congestion window then limits the peer. The connection window,
+  // which bounds the memory the peer can make us buffer, is capped by
+  // maxAutotuneConnectionWindowSize and kept at least 1.5 times the window of
+  // any stream.
+  bool autotuneReceiveWindows{false};
+  uint64_t maxAutotuneStreamWindowSize{kDefaultMaxAutotuneStreamWindowSize};
+  uint64_t maxAutotuneConnectionWindowSize{
+      kDefaultMaxAutotuneConnectionWindowSize};
   // batching mode
   QuicBatchingMode batchingMode{QuicBatchingMode::BATCHING_MODE_NONE};
   // maximum number of packets we can batch. This does not apply to
   // BATCHING_MODE_NONE
   uint32_t maxBatchSize{kDefaultQuicMaxBatchSize};
+  // Whether the server worker should collect the packets of all its
+  // connections written in the same event loop iteration and send them
+  // together with sendmmsg. Overrides batchingMode on the server.
+  bool batchWritesAcrossConnections{false};
+  // Whether the 1-RTT packets of a write but the last are padded to
+  // udpSendPacketLen when what is left to send does not fit, so that a
+  // smaller packet does not end the GSO buffer early. Only with the GSO
+  // batching modes or zeroCopySend.
+  bool padGSOSegments{false};
+  // Whether the server holds the peer to advertisedInitialMaxStreamsBidi and
+  // advertisedInitialMaxStreamsUni streams open at once, and grants the
+  // credit of its closed streams back in MAX_STREAMS frames batched by the
+  // rate it opens streams at.
+  bool batchMaxStreamsCredit{false};
+  // Whether a server being taken over sends the packets it forwards to the
+  // new server in batches of up to maxBatchSize with sendmmsg, once per event
+  // loop iteration, and the new server reads them with recvmmsg in batches of
+  // up to maxRecvBatchSize.
+  bool batchTakeoverPackets{false};
+  // Whether the server steers short header packets straight to the socket
+  // of the worker that owns their connection id with a reuseport BPF
+  // program, instead of forwarding them between workers. Only for the
+  // connection ids of DefaultConnectionIdAlgo.
+  bool steerPacketsByConnectionId{false};
+  // Whether to send packets with MSG_ZEROCOPY, batched with GSO when the
+  // socket supports it. Packet buffers are then kept until the kernel reports
+  // their completion. Ignored with batchWritesAcrossConnections.
+  bool zeroCopySend{false};
+  // Bytes a server connection sends before it moves to a UDP socket of its
+  // own, bound to the listening address with SO_REUSEPORT and connected to
+  // the peer, so that its writes skip the route lookup and the contention on
+  // the worker socket. The listening sockets must use SO_REUSEPORT, and the
+  // kernel may then hash the packets of other connections to the new socket,
+  // from where they are routed like the ones of the shared socket. The
+  // connection leaves the egress batcher and zero copy sends. Zero keeps
+  // every connection on the shared socket.
+  uint64_t dedicatedSocketMinBytesSent{0};
+  // Helper threads a server worker encrypts the 1-RTT packets of its
+  // connections on, while it builds the next packets of the same write. A
+  // connection always uses the same thread, so one connection can use up to
+  // two cores. Zero encrypts on the worker.
+  uint32_t encryptionPipelineThreads{0};
+  // Bytes a connection sends before its packets go to the helper threads, so
+  // that the short connections are not slowed by the handoff.
+  uint64_t encryptionPipelineMinBytesSent{0};
+  // Whether a server worker reads the destination address of every packet
+  // from IP_PKTINFO or IPV6_PKTINFO, and its connections send from the
+  // address their peer sent to, so that a worker bound to the wildcard
+  // address serves all the addresses of the host. Connections that send
+  // from an address of their own do not use zero copy sends. The packets
+  // forwarded by a server being taken over carry no destination address.
+  bool usePacketInfo{false};
+  // Whether packets reference the stream data they carry instead of copying it
+  // into the packet body. The plaintext is then only read by the AEAD, which
+  // writes the ciphertext into a new buffer instead of encrypting in place.
+  bool zeroCopyStreamData{false};
+  // Stream writes of at most this many bytes are copied to the end of the
+  // write buffer of the stream instead of being chained to it, so that a
+  // chatty app does not leave packetization walking long chains of tiny
+  // buffers. Zero chains every write.
+  uint64_t streamWriteCoalescingThreshold{0};
+  // Whether to send the long header packets of a write in the same datagram
+  // as the packets of the next encryption level, when they fit.
+  bool coalescePackets{false};
+  // Whether the server worker should drain the listening socket with recvmmsg
+  // after each read notification instead of reading a single datagram.
+  bool shouldUseRecvmmsgForBatchRecv{false};
+  // Maximum number of datagrams read per read notification when
+  // shouldUseRecvmmsgForBatchRecv is set. Capped at kMaxQuicRecvBatchSize.
+  uint32_t maxRecvBatchSize{kDefaultQuicMaxRecvBatchSize};
+  // Whether the packets of a batch read that belong to the same connection
+  // are processed as one train, so that the ack, timer and write work after
+  // a read is done once per connection and batch instead of once per packet.
+  bool processPacketTrains{false};
+  // Whether the packets of a train are held until its end, so that the read
+  // codec removes the header protection of all of them with the masks it
+  // computes in a single call. Only used with processPacketTrains.
+  bool batchHeaderProtectionRemoval{false};
+  // Whether to enable UDP generic receive offload on the server worker
+  // sockets. Coalesced datagrams are split back into individual packets. This
+  // implies reading in batches with recvmmsg.
+  bool enableUdpGRO{false};
+  // Low latency receive mode. Sets SO_BUSY_POLL to this on the sockets, so
+  // that reads poll the NIC queue. A server worker also keeps reading its
+  // socket for this long after each batch of packets before it waits in
+  // epoll again, which implies reading in batches with recvmmsg. This costs
+  // up to that much cpu per read. 0 disables it.
+  std::chrono::microseconds busyPollBudget{0};
+  // Whether to mark the sent packets ECT(0), or ECT(1) for L4S controllers,
+  // and report the ECN codepoints of the received ones in ACK_ECN frames. A
+  // connection whose acks fail ECN validation ignores the ECN counts from
+  // then on, and the client stops marking. The server can only read the ECN
+  // codepoints when reading in batches with recvmmsg, which this implies.
+  bool enableEcn{false};
+  // Whether to take the receive times of the packets from the kernel,
+  // instead of reading the clock once the event loop gets to them, so that
+  // the RTT samples leave out the time they waited. The server reads them
+  // with SO_TIMESTAMPING, which implies reading in batches with recvmmsg,
+  // and the client with SIOCGSTAMPNS. Not supported with happy eyeballs.
+  bool kernelTimestamps{false};
+  // Whether kernelTimestamps prefers the timestamps of the NIC, for devices
+  // that have hardware timestamping turned on. A client then also moves the
+  // send times of its packets to when the NIC sent them, unless its socket
+  // is written with sendmmsg, MSG_ZEROCOPY or SO_TXTIME.
+  bool hardwareTimestamps{false};
+  // Whether the server worker turns on SO_RXQ_OVFL on its socket and reports
+  // the packets the kernel dropped because the receive buffer was full with
+  // onKernelPacketsDropped, along with samples of the receive buffer
+  // occupancy from SO_MEMINFO. It implies reading in batches with recvmmsg.
+  bool recvQueueStats{false};
+  // Largest receive buffer, as SO_RCVBUF reports it, that the worker grows
+  // its socket to with recvQueueStats. The buffer doubles whenever the kernel
+  // drops kRecvBufferGrowthDrops packets within kRecvBufferGrowthInterval,
+  // within the net.core.rmem_max limit. Zero never changes the buffer.
+  uint32_t maxRecvBufferSize{0};
+  // Write a snapshot of the congestion state into the session tickets of the
+  // server, and warm start connections that resume with one from the same
+  // address it was issued to. The jump is limited to half of the BDP of the
+  // snapshot, as in careful resume, and to kMaxWarmStartCwndInMss.
+  bool resumeCongestionState{false};
   // Sets network unreachable to be a non fatal error. In some environments,
   // EHOSTUNREACH or ENETUNREACH could just be because the routing table is
   // being setup. This option makes those non fatal connection errors.
@@ -90,6 +325,20 @@ struct TransportSettings {
   std::chrono::milliseconds continueOnNetworkUnreachableDuration{150};
   // Initial congestion window in MSS
   uint64_t initCwndInMss{kInitCwndInMss};
+  // Use HyStart++ for the slow start of Cubic and NewReno, which goes through
+  // a conservative slow start before the exit. Cubic uses its classic
+  // HyStart otherwise, and NewReno only leaves slow start on loss.
+  bool hystartPlusPlus{false};
+  // Validate the cwnd of Cubic and NewReno as in RFC 7661: it only grows
+  // while the connection uses at least half of it, and restarts from the
+  // initial window after an idle period, see CwndValidator.
+  bool cwndValidation{false};
+  // RTT assumed by the handshake alarm until the first RTT sample
+  std::chrono::microseconds initialRtt{kDefaultInitialRtt};
+  // Remember the packets declared lost, and when an ack shows a loss was
+  // spurious, widen the reordering window of loss detection and let the
+  // congestion controller undo the cwnd reduction.
+  bool adaptiveReordering{false};
   // Minimum congestion window in MSS
   uint64_t minCwndInMss{kMinCwndInMss};
   // Maximum congestion window in MSS
@@ -101,8 +350,18 @@ struct TransportSettings {
   // the callback registered through notifyPendingWriteOnConnection() will
   // not be called
   uint64_t totalBufferSpaceAvailable{kDefaultBufferSpaceAvailable};
+  // Once the buffered bytes reached totalBufferSpaceAvailable, write ready
+  // callbacks wait for them to drain down to this amount.
+  uint64_t connWriteBufferLowWatermark{kDefaultBufferSpaceAvailable};
+  // Streams with this many unsent bytes buffered are not reported write
+  // ready until the buffer drains down to the low watermark. With both set
+  // to about a BDP, apps keep the pipe full without over buffering.
+  uint64_t streamWriteBufferHighWatermark{kDefaultBufferSpaceAvailable};
+  uint64_t streamWriteBufferLowWatermark{kDefaultBufferSpaceAvailable};
   // Whether or not to advertise partial reliability capability
   bool partialReliabilityEnabled{false};
+  // Whether or not to advertise support for ACK_FREQUENCY frames
+  bool ackFrequencyEnabled{false};
   // Whether the endpoint allows peer to migrate to new address
   bool disableMigration{true};
   // Whether or not the socket should gracefully drain on close
@@ -110,6 +369,55 @@ struct TransportSettings {
   // default stateless reset secret for stateless reset token
   folly::Optional<std::array<uint8_t, kStatelessResetTokenSecretLength>>
       statelessResetTokenSecret;
+  // Most stateless resets and version negotiation packets a server worker
+  // sends per second, the packets over it are dropped without a response. 0
+  // does not limit them.
+  uint32_t maxStatelessResponsesPerSecond{0};
+  // Number of server connection ids, with their stateless reset tokens, that
+  // a server worker makes ahead of the connections that use them. The pool
+  // is refilled at the end of each event loop iteration. 0 disables it.
+  uint32_t connectionIdPoolSize{0};
+  // secret that the keys of the address validation tokens sent in Retry
+  // packets are derived from
+  folly::Optional<std::array<uint8_t, kRetryTokenSecretLength>>
+      retryTokenSecret;
+  // Number of handshakes in progress on a server worker from which new
+  // connections have to validate their address with a Retry first. 0 means
+  // that Retry packets are never sent.
+  uint64_t retryPendingHandshakeThreshold{0};
+  // Smoothed busy time of the event loop iterations of a server worker from
+  // which new connections have to validate their address with a Retry, are
+  // rejected with a version negotiation packet, and have their Initials
+  // dropped without an answer. Established connections are not affected. 0
+  // disables a level.
+  std::chrono::microseconds overloadRetryLoopTime{0};
+  std::chrono::microseconds overloadRejectLoopTime{0};
+  std::chrono::microseconds overloadDropLoopTime{0};
+  // Whether to negotiate TLS certificate compression (RFC 8879) with zlib.
+  // The client accepts compressed certificates, and the server offers to send
+  // them, which needs its certificates to be created with a zlib compressor.
+  bool certificateCompression{false};
+  // Whether to count the CPU cycles each connection spends reading, writing
+  // and handling its timers, see ConnectionCpuUsage.
+  bool cpuAccounting{false};
+  // Whether to count the heap allocations each connection makes reading,
+  // writing and handshaking, see ConnectionAllocationUsage.
+  bool allocationAccounting{false};
+  // Whether to time the delivery of each write to a stream, from the write
+  // to when its last byte was first sent and from then until it was acked,
+  // see DeliveryLatency.
+  bool trackDeliveryLatency{false};
+  // Whether the server writes the new Handshake crypto data ahead of the
+  // Initial crypto data it sends again while writableBytesLimit applies, so
+  // that the limit goes to what moves the handshake on first.
+  bool amplificationAwareHandshakeScheduling{false};
+  // The number of samples of the metrics each connection keeps, see
+  // QuicSocket::getMetricsHistory. Zero keeps none.
+  size_t metricsHistorySize{0};
+  // Samples are taken after the acks of a read loop, at most one per
+  // interval of ack time.
+  std::chrono::milliseconds metricsHistoryInterval{
+      kDefaultMetricsHistoryInterval};
 };
 
 } // namespace quic
@@ -86,13 +86,8 @@ inline void Handler<
         QuicStreamState& stream) {
   // Clean up the acked buffers from the retransmissionBuffer.
 
-  auto ackedBuffer = std::lower_bound(
-      stream.retransmissionBuffer.begin(),
-      stream.retransmissionBuffer.end(),
-      ack.ackedFrame.offset,
-      [](const auto& buffer, const auto& offset) {
-        return buffer.offset < offset;
-      });
+  auto ackedBuffer =
+      stream.retransmissionBuffer.lower_bound(ack.ackedFrame.offset);
 
   if (ackedBuffer != stream.retransmissionBuffer.end()) {
     if (ackFrameMatchesRetransmitBuffer(stream, ack.ackedFrame, *ackedBuffer)) {
@@ -111,6 +106,7 @@ inline void Handler<
 
   // This stream may be able to invoke some deliveryCallbacks:
   stream.conn.streamManager->addDeliverable(stream.id);
+  updateDeliveryLatencyOnAck(stream);
 
   // Check for whether or not we have ACKed all bytes until our FIN.
   if (allBytesTillFinAcked(stream)) {
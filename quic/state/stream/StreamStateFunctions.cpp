@@ -7,6 +7,7 @@
  */
 
 #include <quic/state/stream/StreamStateFunctions.h>
+#include <quic/common/LoopTime.h>
 #include <quic/flowcontrol/QuicFlowController.h>
 
 namespace quic {
@@ -53,7 +54,7 @@ void onResetQuicStream(QuicStreamState& stream, RstStreamFrame&& frame) {
     auto lastReadOffset = stream.currentReadOffset;
     stream.currentReadOffset = frame.offset;
     stream.maxOffsetObserved = frame.offset;
-    updateFlowControlOnRead(stream, lastReadOffset, Clock::now());
+    updateFlowControlOnRead(stream, lastReadOffset, LoopTime::now());
   }
   stream.conn.streamManager->updateReadableStreams(stream);
   stream.conn.streamManager->updateWritableStreams(stream);
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <quic/server/state/ServerStateMachine.h>
+#include <quic/state/AckHandlers.h>
+
+#include <limits>
+
+namespace {
+
+constexpr quic::PacketNum kPacketsInFlight = 10000;
+
+// Sends packetsInFlight packets, packetNumStep apart, so that the packet
+// numbers in between look like packets that were acked already.
+void sendPackets(
+    quic::QuicServerConnectionState& conn,
+    quic::PacketNum packetNumStep,
+    quic::PacketNum packetsInFlight = kPacketsInFlight) {
+  quic::ConnectionId connId(std::vector<uint8_t>(8, 0));
+  auto sentTime = quic::Clock::now();
+  for (quic::PacketNum i = 0; i < packetsInFlight; i++) {
+    auto packetNum = i * packetNumStep;
+    quic::RegularQuicWritePacket packet(quic::ShortHeader(
+        quic::ProtectionType::KeyPhaseZero, connId, packetNum));
+    conn.outstandingPackets.emplace_back(
+        std::move(packet), sentTime, 1000, false, false, 1000 * (i + 1));
+  }
+  // No loss detection, only the acks are measured.
+  conn.lossState.srtt = std::chrono::seconds(10);
+  conn.lossState.reorderingThreshold =
+      std::numeric_limits<decltype(conn.lossState.reorderingThreshold)>::max();
+}
+
+void ack(quic::QuicServerConnectionState& conn, quic::ReadAckFrame& frame) {
+  quic::processAckFrame(
+      conn,
+      quic::PacketNumberSpace::AppData,
+      frame,
+      [](const auto&, const auto&, const auto&) {},
+      [](auto&, auto&, bool, quic::PacketNum) {},
+      quic::Clock::now());
+}
+
+// An ack of the newest packet only, as acks in order are.
+void ackNewest(size_t iters, size_t packetsInFlight) {
+  for (size_t i = 0; i < iters; i++) {
+    std::unique_ptr<quic::QuicServerConnectionState> conn;
+    quic::ReadAckFrame frame;
+    BENCHMARK_SUSPEND {
+      conn = std::make_unique<quic::QuicServerConnectionState>();
+      sendPackets(*conn, 1, packetsInFlight);
+      frame.largestAcked = packetsInFlight - 1;
+      frame.ackBlocks.emplace_back(frame.largestAcked, frame.largestAcked);
+    }
+    ack(*conn, frame);
+    BENCHMARK_SUSPEND {
+      conn.reset();
+    }
+  }
+}
+
+// An ack of all the packets in flight at once, as after a delayed ack.
+void ackAll(size_t iters, size_t packetsInFlight) {
+  for (size_t i = 0; i < iters; i++) {
+    std::unique_ptr<quic::QuicServerConnectionState> conn;
+    quic::ReadAckFrame frame;
+    BENCHMARK_SUSPEND {
+      conn = std::make_unique<quic::QuicServerConnectionState>();
+      sendPackets(*conn, 1, packetsInFlight);
+      frame.largestAcked = packetsInFlight - 1;
+      frame.ackBlocks.emplace_back(0, frame.largestAcked);
+    }
+    ack(*conn, frame);
+    BENCHMARK_SUSPEND {
+      conn.reset();
+    }
+  }
+}
+
+} // namespace
+
+// An ack of a few packets of a large window, as is common on a fast path.
+BENCHMARK(AckSparseBlocksOf10kInFlight, iters) {
+  for (size_t i = 0; i < iters; i++) {
+    std::unique_ptr<quic::QuicServerConnectionState> conn;
+    quic::ReadAckFrame frame;
+    BENCHMARK_SUSPEND {
+      conn = std::make_unique<quic::QuicServerConnectionState>();
+      sendPackets(*conn, 1);
+      frame.largestAcked = kPacketsInFlight - 1;
+      for (quic::PacketNum block = 0; block < 10; block++) {
+        auto packetNum = frame.largestAcked - block * 1000;
+        frame.ackBlocks.emplace_back(packetNum, packetNum);
+      }
+    }
+    ack(*conn, frame);
+    BENCHMARK_SUSPEND {
+      conn.reset();
+    }
+  }
+}
+
+// An ack with a block that covers far more packets than are outstanding,
+// most of which were acked by earlier acks, as after reordering or a loss.
+BENCHMARK(AckWideBlockOf10kInFlight, iters) {
+  for (size_t i = 0; i < iters; i++) {
+    std::unique_ptr<quic::QuicServerConnectionState> conn;
+    quic::ReadAckFrame frame;
+    BENCHMARK_SUSPEND {
+      conn = std::make_unique<quic::QuicServerConnectionState>();
+      sendPackets(*conn, 100);
+      frame.largestAcked = (kPacketsInFlight - 1) * 100;
+      frame.ackBlocks.emplace_back(0, frame.largestAcked);
+    }
+    ack(*conn, frame);
+    BENCHMARK_SUSPEND {
+      conn.reset();
+    }
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(ackNewest, 10InFlight, 10)
+BENCHMARK_NAMED_PARAM(ackNewest, 100InFlight, 100)
+BENCHMARK_NAMED_PARAM(ackNewest, 1000InFlight, 1000)
+BENCHMARK_NAMED_PARAM(ackNewest, 10000InFlight, 10000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(ackAll, 10InFlight, 10)
+BENCHMARK_NAMED_PARAM(ackAll, 100InFlight, 100)
+BENCHMARK_NAMED_PARAM(ackAll, 1000InFlight, 1000)
+BENCHMARK_NAMED_PARAM(ackAll, 10000InFlight, 10000)
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
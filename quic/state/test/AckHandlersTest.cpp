@@ -945,6 +945,59 @@ TEST_P(AckHandlersTest, UpdatePendingAckStates) {
   EXPECT_EQ(111 + 1357, conn.lossState.totalBytesAcked);
 }
 
+TEST_P(AckHandlersTest, EcnValidation) {
+  QuicServerConnectionState conn;
+  conn.ecnState = QuicConnectionStateBase::EcnState::Enabled;
+  auto mockController = std::make_unique<MockCongestionController>();
+  auto rawController = mockController.get();
+  conn.congestionController = std::move(mockController);
+  for (PacketNum packetNum = 0; packetNum < 3; packetNum++) {
+    auto regularPacket = createNewPacket(packetNum, GetParam());
+    conn.outstandingPackets.emplace_back(
+        std::move(regularPacket), Clock::now(), 100, false, false, 100);
+    conn.outstandingPackets.back().ecnMarked = true;
+  }
+
+  // Both of the newly acked packets are accounted for, one of them was CE
+  // marked on the way.
+  ReadAckFrame ackFrame;
+  ackFrame.largestAcked = 1;
+  ackFrame.ackBlocks.emplace_back(0, 1);
+  ackFrame.ecnCounts.emplace();
+  ackFrame.ecnCounts->ect0 = 1;
+  ackFrame.ecnCounts->ce = 1;
+  EXPECT_CALL(*rawController, onPacketAckOrLoss(_, _))
+      .WillOnce(Invoke([&](auto ackEvent, auto) {
+        EXPECT_EQ(1, ackEvent->ecnCeMarked);
+      }));
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [&](const auto&, const auto&, const auto&) {},
+      [&](auto&, auto&, bool, auto) {},
+      Clock::now());
+  EXPECT_EQ(QuicConnectionStateBase::EcnState::Enabled, conn.ecnState);
+  EXPECT_EQ(*ackFrame.ecnCounts, getAckState(conn, GetParam()).peerEcnCounts);
+
+  // The counts don't grow with the newly acked packet, which fails ECN.
+  ackFrame.largestAcked = 2;
+  ackFrame.ackBlocks.clear();
+  ackFrame.ackBlocks.emplace_back(0, 2);
+  EXPECT_CALL(*rawController, onPacketAckOrLoss(_, _))
+      .WillOnce(Invoke([&](auto ackEvent, auto) {
+        EXPECT_EQ(0, ackEvent->ecnCeMarked);
+      }));
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [&](const auto&, const auto&, const auto&) {},
+      [&](auto&, auto&, bool, auto) {},
+      Clock::now());
+  EXPECT_EQ(QuicConnectionStateBase::EcnState::Failed, conn.ecnState);
+}
+
 TEST_F(AckHandlersTest, PureAckDoesNotUpdateRtt) {
   QuicServerConnectionState conn;
   conn.congestionController = nullptr;
@@ -1004,6 +1057,128 @@ TEST_F(AckHandlersTest, PureAckDoesNotUpdateRtt) {
   EXPECT_TRUE(conn.outstandingPackets.empty());
 }
 
+TEST_P(AckHandlersTest, SpuriousLossWidensReorderingWindow) {
+  QuicServerConnectionState conn;
+  conn.transportSettings.adaptiveReordering = true;
+  auto mockCongestionController = std::make_unique<MockCongestionController>();
+  auto rawCongestionController = mockCongestionController.get();
+  conn.congestionController = std::move(mockCongestionController);
+  // Get the time based loss detection out of the way
+  conn.lossState.srtt = 10s;
+
+  auto sentTime = Clock::now();
+  for (PacketNum packetNum = 0; packetNum < 10; packetNum++) {
+    auto regularPacket = createNewPacket(packetNum, GetParam());
+    conn.outstandingPackets.emplace_back(OutstandingPacket(
+        std::move(regularPacket), sentTime, 1, false, false, packetNum));
+  }
+  ReadAckFrame ackFrame;
+  ackFrame.largestAcked = 9;
+  ackFrame.ackBlocks.emplace_back(4, 9);
+  std::vector<PacketNum> lostPackets;
+  EXPECT_CALL(*rawCongestionController, onPacketAckOrLoss(_, _)).Times(1);
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [](const auto&, const auto&, const auto&) {},
+      testLossHandler(lostPackets),
+      Clock::now());
+  EXPECT_EQ(4, lostPackets.size());
+  EXPECT_EQ(4, conn.lossState.recentlyLostPackets.size());
+  EXPECT_EQ(0, conn.lossState.spuriousLossCount);
+
+  // Packets 0 to 2 were only reordered.
+  ackFrame.ackBlocks.emplace_back(0, 2);
+  EXPECT_CALL(*rawCongestionController, onSpuriousLoss(_)).Times(3);
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [](const auto&, const auto&, const auto&) {},
+      testLossHandler(lostPackets),
+      Clock::now());
+  EXPECT_EQ(3, conn.lossState.spuriousLossCount);
+  EXPECT_EQ(9, conn.lossState.reorderingThreshold);
+  EXPECT_EQ(2, conn.lossState.reorderingWindowMult);
+  ASSERT_EQ(1, conn.lossState.recentlyLostPackets.size());
+  EXPECT_EQ(3, conn.lossState.recentlyLostPackets.front().packetNum);
+
+  // Packet 3 is forgotten by the time it is acked.
+  ackFrame.ackBlocks.clear();
+  ackFrame.ackBlocks.emplace_back(0, 9);
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [](const auto&, const auto&, const auto&) {},
+      testLossHandler(lostPackets),
+      Clock::now() + 1min);
+  EXPECT_EQ(3, conn.lossState.spuriousLossCount);
+  EXPECT_TRUE(conn.lossState.recentlyLostPackets.empty());
+}
+
+TEST_P(AckHandlersTest, SparseAcksAmongManyOutstanding) {
+  QuicServerConnectionState conn;
+  auto mockCongestionController = std::make_unique<MockCongestionController>();
+  auto rawCongestionController = mockCongestionController.get();
+  conn.congestionController = std::move(mockCongestionController);
+  // Get the loss detection out of the way
+  conn.lossState.srtt = 10s;
+  conn.lossState.reorderingThreshold = 100000;
+
+  constexpr PacketNum kNumPackets = 10000;
+  auto sentTime = Clock::now();
+  for (PacketNum packetNum = 0; packetNum < kNumPackets; packetNum++) {
+    auto regularPacket = createNewPacket(packetNum, GetParam());
+    conn.outstandingPackets.emplace_back(OutstandingPacket(
+        std::move(regularPacket), sentTime, 1, false, false, packetNum));
+  }
+  std::vector<PacketNum> ackedPackets;
+  EXPECT_CALL(*rawCongestionController, onPacketAckOrLoss(_, _))
+      .WillRepeatedly(Invoke([&](auto ack, auto) {
+        for (const auto& packet : ack->ackedPackets) {
+          ackedPackets.push_back(folly::variant_match(
+              packet.packet.header,
+              [](const auto& h) { return h.getPacketSequenceNum(); }));
+        }
+      }));
+  // Every 100th packet.
+  ReadAckFrame ackFrame;
+  ackFrame.largestAcked = kNumPackets - 101;
+  for (PacketNum packetNum = kNumPackets - 101; packetNum < kNumPackets;
+       packetNum -= 100) {
+    ackFrame.ackBlocks.emplace_back(packetNum, packetNum);
+  }
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [](const auto&, const auto&, const auto&) {},
+      [](auto&, auto&, bool, PacketNum) {},
+      Clock::now());
+  EXPECT_EQ(99, ackedPackets.size());
+  EXPECT_EQ(kNumPackets - 99, conn.outstandingPackets.size());
+
+  // An ack of everything then only acks what is still outstanding, in order.
+  ackedPackets.clear();
+  ackFrame.largestAcked = kNumPackets - 1;
+  ackFrame.ackBlocks.clear();
+  ackFrame.ackBlocks.emplace_back(0, kNumPackets - 1);
+  processAckFrame(
+      conn,
+      GetParam(),
+      ackFrame,
+      [](const auto&, const auto&, const auto&) {},
+      [](auto&, auto&, bool, PacketNum) {},
+      Clock::now());
+  EXPECT_EQ(kNumPackets - 99, ackedPackets.size());
+  EXPECT_TRUE(std::is_sorted(ackedPackets.begin(), ackedPackets.end()));
+  EXPECT_EQ(ackedPackets.end(),
+            std::find(ackedPackets.begin(), ackedPackets.end(), 99));
+  EXPECT_TRUE(conn.outstandingPackets.empty());
+}
+
 INSTANTIATE_TEST_CASE_P(
     AckHandlersTests,
     AckHandlersTest,
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/FecHandlers.h>
+
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/server/state/ServerStateMachine.h>
+#include <quic/state/QuicStateFunctions.h>
+#include <quic/state/QuicStreamFunctions.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+class FecHandlersTest : public Test {
+ public:
+  void SetUp() override {
+    conn_.transportSettings.fecEnabled = true;
+    conn_.fecState.enabled = true;
+    conn_.flowControlState.advertisedMaxOffset = kDefaultConnectionWindowSize;
+    conn_.streamManager->setMaxLocalBidirectionalStreams(
+        kDefaultMaxStreamsBidirectional);
+    stream_ = conn_.streamManager->createNextBidirectionalStream().value();
+  }
+
+  // Sends data at offset as if it was written into a packet.
+  void sendFrame(const std::string& data, uint64_t offset, bool fin) {
+    stream_->retransmissionBuffer.insert(
+        StreamBuffer(folly::IOBuf::copyBuffer(data), offset, fin));
+    onStreamFrameSent(
+        conn_,
+        *stream_,
+        WriteStreamFrame(stream_->id, offset, data.size(), fin));
+  }
+
+  void receiveFrame(const std::string& data, uint64_t offset, bool fin) {
+    ReadStreamFrame frame(
+        stream_->id, offset, folly::IOBuf::copyBuffer(data), fin);
+    onStreamFrameReceived(conn_, frame);
+    invokeStreamReceiveStateMachine(conn_, *stream_, std::move(frame));
+  }
+
+  RepairFrame makeRepairFrame() {
+    // "abcd" ^ "efgh" ^ "ij\0\0"
+    std::string data = "abcd";
+    std::string other = "efgh";
+    std::string last = std::string("ij") + '\0' + '\0';
+    for (size_t i = 0; i < data.size(); i++) {
+      data[i] ^= other[i] ^ last[i];
+    }
+    return RepairFrame(
+        stream_->id,
+        {FecProtectedFrame(0, 4),
+         FecProtectedFrame(4, 4),
+         FecProtectedFrame(8, 2)},
+        true,
+        folly::IOBuf::copyBuffer(data));
+  }
+
+ protected:
+  QuicServerConnectionState conn_;
+  QuicStreamState* stream_{nullptr};
+};
+
+TEST_F(FecHandlersTest, RepairFrameProtectsGroup) {
+  conn_.transportSettings.fecGroupSize = 3;
+  stream_->writeBuffer.append(folly::IOBuf::copyBuffer("more"));
+  sendFrame("abcd", 0, false);
+  sendFrame("efgh", 4, false);
+  EXPECT_TRUE(conn_.fecState.pendingRepairs.empty());
+  sendFrame("ij", 8, true);
+  ASSERT_EQ(conn_.fecState.pendingRepairs.size(), 1);
+  EXPECT_EQ(conn_.fecState.pendingRepairs.front(), makeRepairFrame());
+  EXPECT_FALSE(conn_.fecState.group.hasValue());
+}
+
+TEST_F(FecHandlersTest, RepairFrameAtTailOfWrite) {
+  conn_.transportSettings.fecGroupSize = 3;
+  sendFrame("abcd", 0, false);
+  // Nothing is left to write, the frame is the tail of the data.
+  ASSERT_EQ(conn_.fecState.pendingRepairs.size(), 1);
+  const auto& repair = conn_.fecState.pendingRepairs.front();
+  EXPECT_EQ(repair.frames, std::vector<FecProtectedFrame>{{0, 4}});
+  EXPECT_FALSE(repair.fin);
+  EXPECT_TRUE(folly::IOBufEqualTo()(
+      repair.data, folly::IOBuf::copyBuffer("abcd")));
+}
+
+TEST_F(FecHandlersTest, NoRepairFramesUnlessEnabled) {
+  conn_.fecState.enabled = false;
+  sendFrame("abcd", 0, true);
+  EXPECT_TRUE(conn_.fecState.pendingRepairs.empty());
+  receiveFrame("abcd", 0, false);
+  EXPECT_TRUE(conn_.fecState.receivedFrames.empty());
+}
+
+TEST_F(FecHandlersTest, RebuildLostFrame) {
+  receiveFrame("abcd", 0, false);
+  receiveFrame("ij", 8, true);
+  auto repair = makeRepairFrame();
+  handleRepairFrame(conn_, repair);
+  auto result = readDataFromQuicStream(*stream_);
+  EXPECT_TRUE(folly::IOBufEqualTo()(
+      result.first, folly::IOBuf::copyBuffer("abcdefghij")));
+  EXPECT_TRUE(result.second);
+}
+
+TEST_F(FecHandlersTest, RebuildLostTailFrame) {
+  receiveFrame("abcd", 0, false);
+  receiveFrame("efgh", 4, false);
+  auto repair = makeRepairFrame();
+  handleRepairFrame(conn_, repair);
+  auto result = readDataFromQuicStream(*stream_);
+  EXPECT_TRUE(folly::IOBufEqualTo()(
+      result.first, folly::IOBuf::copyBuffer("abcdefghij")));
+  EXPECT_TRUE(result.second);
+}
+
+TEST_F(FecHandlersTest, TwoLostFramesNotRebuilt) {
+  receiveFrame("abcd", 0, false);
+  auto repair = makeRepairFrame();
+  handleRepairFrame(conn_, repair);
+  auto result = readDataFromQuicStream(*stream_);
+  EXPECT_TRUE(folly::IOBufEqualTo()(
+      result.first, folly::IOBuf::copyBuffer("abcd")));
+  EXPECT_FALSE(result.second);
+}
+
+TEST_F(FecHandlersTest, UnexpectedRepairFrame) {
+  conn_.transportSettings.fecEnabled = false;
+  auto repair = makeRepairFrame();
+  EXPECT_THROW(handleRepairFrame(conn_, repair), QuicTransportException);
+}
+
+} // namespace test
+} // namespace quic
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/KeyUpdate.h>
+
+#include <folly/portability/GTest.h>
+#include <quic/common/test/TestUtils.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+class KeyUpdateTest : public Test {
+ public:
+  void SetUp() override {
+    conn_.transportSettings.keyUpdatePacketInterval = 10;
+    conn_.oneRttWriteCipher = createNoOpAead();
+    conn_.readCodec = std::make_unique<QuicReadCodec>(QuicNodeType::Server);
+    conn_.readCodec->setOneRttReadCipher(createNoOpAead());
+    conn_.readCodec->onHandshakeDone(Clock::now());
+    setNextCiphers();
+  }
+
+  void setNextCiphers() {
+    conn_.keyUpdateState.nextOneRttWriteCipher = createNoOpAead();
+    conn_.readCodec->setNextOneRttReadCipher(createNoOpAead());
+  }
+
+  void writePackets(size_t numPackets) {
+    for (size_t i = 0; i < numPackets; i++) {
+      onKeyPhasePacketWritten(conn_, nextPacketNum_++);
+    }
+  }
+
+ protected:
+  QuicConnectionStateBase conn_{QuicNodeType::Server};
+  PacketNum nextPacketNum_{0};
+};
+
+TEST_F(KeyUpdateTest, PacketsWritten) {
+  writePackets(3);
+  EXPECT_EQ(0, *conn_.keyUpdateState.firstPacketNumInPhase);
+  EXPECT_EQ(3, conn_.keyUpdateState.packetsWrittenInPhase);
+}
+
+TEST_F(KeyUpdateTest, Disabled) {
+  conn_.transportSettings.keyUpdatePacketInterval = 0;
+  writePackets(100);
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 99;
+  EXPECT_FALSE(maybeInitiateKeyUpdate(conn_));
+  EXPECT_EQ(ProtectionType::KeyPhaseZero, conn_.keyUpdateState.writePhase);
+}
+
+TEST_F(KeyUpdateTest, InitiateAfterInterval) {
+  writePackets(9);
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 0;
+  EXPECT_FALSE(maybeInitiateKeyUpdate(conn_));
+
+  writePackets(1);
+  auto nextWriteCipher = conn_.keyUpdateState.nextOneRttWriteCipher.get();
+  EXPECT_TRUE(maybeInitiateKeyUpdate(conn_));
+  auto& state = conn_.keyUpdateState;
+  EXPECT_EQ(ProtectionType::KeyPhaseOne, state.writePhase);
+  EXPECT_EQ(nextWriteCipher, conn_.oneRttWriteCipher.get());
+  EXPECT_EQ(nullptr, state.nextOneRttWriteCipher);
+  EXPECT_TRUE(state.localUpdatePending);
+  EXPECT_FALSE(state.firstPacketNumInPhase.hasValue());
+  EXPECT_EQ(0, state.packetsWrittenInPhase);
+  EXPECT_EQ(1, state.numKeyUpdates);
+}
+
+TEST_F(KeyUpdateTest, InitiateWaitsForAckInCurrentPhase) {
+  writePackets(10);
+  EXPECT_FALSE(maybeInitiateKeyUpdate(conn_));
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 0;
+  EXPECT_TRUE(maybeInitiateKeyUpdate(conn_));
+}
+
+TEST_F(KeyUpdateTest, InitiateWaitsForHandshakeDone) {
+  conn_.readCodec = std::make_unique<QuicReadCodec>(QuicNodeType::Server);
+  conn_.readCodec->setOneRttReadCipher(createNoOpAead());
+  conn_.readCodec->setNextOneRttReadCipher(createNoOpAead());
+  writePackets(10);
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 0;
+  EXPECT_FALSE(maybeInitiateKeyUpdate(conn_));
+}
+
+TEST_F(KeyUpdateTest, InitiateWaitsForPreviousUpdate) {
+  writePackets(10);
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 0;
+  EXPECT_TRUE(maybeInitiateKeyUpdate(conn_));
+  setNextCiphers();
+  writePackets(10);
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 10;
+  // The peer has not answered in key phase one yet.
+  EXPECT_FALSE(maybeInitiateKeyUpdate(conn_));
+  EXPECT_EQ(1, conn_.keyUpdateState.numKeyUpdates);
+}
+
+TEST_F(KeyUpdateTest, InitiatedUpdateCompletesOnRead) {
+  writePackets(10);
+  conn_.ackStates.appDataAckState.largestAckedByPeer = 0;
+  EXPECT_TRUE(maybeInitiateKeyUpdate(conn_));
+  // The read codec is still in key phase zero, the write keys stay.
+  auto writeCipher = conn_.oneRttWriteCipher.get();
+  updateKeyPhaseOnRead(conn_);
+  EXPECT_EQ(writeCipher, conn_.oneRttWriteCipher.get());
+  EXPECT_TRUE(conn_.keyUpdateState.localUpdatePending);
+
+  auto connId = getTestConnectionId();
+  auto data = folly::IOBuf::copyBuffer("hello");
+  auto packet = createStreamPacket(
+      connId,
+      connId,
+      5,
+      2,
+      *data,
+      0 /* cipherOverhead */,
+      0 /* largestAcked */,
+      folly::none,
+      true,
+      ProtectionType::KeyPhaseOne);
+  conn_.readCodec->setOneRttHeaderCipher(createNoOpHeaderCipher());
+  auto packetQueue = bufToQueue(packetToBuf(packet));
+  conn_.readCodec->parsePacket(packetQueue, conn_.ackStates);
+  EXPECT_EQ(ProtectionType::KeyPhaseOne, conn_.readCodec->getKeyPhase());
+  updateKeyPhaseOnRead(conn_);
+  EXPECT_FALSE(conn_.keyUpdateState.localUpdatePending);
+  EXPECT_EQ(writeCipher, conn_.oneRttWriteCipher.get());
+  EXPECT_EQ(1, conn_.keyUpdateState.numKeyUpdates);
+}
+
+TEST_F(KeyUpdateTest, FollowPeerUpdate) {
+  writePackets(3);
+  auto connId = getTestConnectionId();
+  auto data = folly::IOBuf::copyBuffer("hello");
+  auto packet = createStreamPacket(
+      connId,
+      connId,
+      5,
+      2,
+      *data,
+      0 /* cipherOverhead */,
+      0 /* largestAcked */,
+      folly::none,
+      true,
+      ProtectionType::KeyPhaseOne);
+  conn_.readCodec->setOneRttHeaderCipher(createNoOpHeaderCipher());
+  auto packetQueue = bufToQueue(packetToBuf(packet));
+  conn_.readCodec->parsePacket(packetQueue, conn_.ackStates);
+
+  auto nextWriteCipher = conn_.keyUpdateState.nextOneRttWriteCipher.get();
+  updateKeyPhaseOnRead(conn_);
+  auto& state = conn_.keyUpdateState;
+  EXPECT_EQ(ProtectionType::KeyPhaseOne, state.writePhase);
+  EXPECT_EQ(nextWriteCipher, conn_.oneRttWriteCipher.get());
+  EXPECT_FALSE(state.localUpdatePending);
+  EXPECT_EQ(0, state.packetsWrittenInPhase);
+  EXPECT_EQ(1, state.numKeyUpdates);
+}
+
+} // namespace test
+} // namespace quic
@@ -24,12 +24,13 @@ class MockCongestionController : public CongestionController {
       void(folly::Optional<AckEvent>, folly::Optional<LossEvent>));
   MOCK_CONST_METHOD0(getWritableBytes, uint64_t());
   MOCK_CONST_METHOD0(getCongestionWindow, uint64_t());
-  MOCK_METHOD0(onSpuriousLoss, void());
+  MOCK_METHOD1(onSpuriousLoss, void(TimePoint));
   GMOCK_METHOD1_(, , , setConnectionEmulation, void(uint8_t));
   MOCK_CONST_METHOD0(type, CongestionControlType());
   GMOCK_METHOD2_(, , , setAppIdle, void(bool, TimePoint));
   MOCK_METHOD0(setAppLimited, void());
   MOCK_CONST_METHOD0(isAppLimited, bool());
+  MOCK_CONST_METHOD0(getBandwidthEstimate, uint64_t());
 };
 
 class MockPacer : public Pacer {
@@ -40,6 +41,7 @@ class MockPacer : public Pacer {
   MOCK_METHOD1(updateAndGetWriteBatchSize, uint64_t(TimePoint));
   MOCK_CONST_METHOD0(getCachedWriteBatchSize, uint64_t());
   MOCK_METHOD1(setAppLimited, void(bool));
+  MOCK_METHOD1(getPacketTxTime, folly::Optional<TimePoint>(TimePoint));
 };
 } // namespace test
 } // namespace quic
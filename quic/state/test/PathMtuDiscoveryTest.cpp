@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/PathMtuDiscovery.h>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/net/NetOps.h>
+#include <folly/portability/GTest.h>
+#include <folly/portability/Sockets.h>
+#include <quic/common/test/TestUtils.h>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+using Phase = QuicConnectionStateBase::PathMtuState::Phase;
+
+class PathMtuDiscoveryTest : public Test {
+ public:
+  void SetUp() override {
+    conn_.transportSettings.pathMtuDiscovery = true;
+    conn_.oneRttWriteCipher = createNoOpAead();
+  }
+
+  OutstandingPacket makePacket(uint32_t encodedSize, bool isPathMtuProbe) {
+    OutstandingPacket packet(
+        createNewPacket(nextPacketNum_++, PacketNumberSpace::AppData),
+        Clock::now(),
+        encodedSize,
+        false,
+        false,
+        0);
+    packet.isPathMtuProbe = isPathMtuProbe;
+    return packet;
+  }
+
+  OutstandingPacket sendProbe() {
+    EXPECT_TRUE(shouldSendPathMtuProbe(conn_, Clock::now()));
+    auto probeSize = getNextPathMtuProbeSize(conn_, Clock::now());
+    auto probe = makePacket(static_cast<uint32_t>(probeSize), true);
+    onPathMtuProbeSent(conn_, nextPacketNum_ - 1, probeSize);
+    EXPECT_FALSE(shouldSendPathMtuProbe(conn_, Clock::now()));
+    return probe;
+  }
+
+ protected:
+  QuicConnectionStateBase conn_{QuicNodeType::Server};
+  PacketNum nextPacketNum_{0};
+};
+
+TEST_F(PathMtuDiscoveryTest, Disabled) {
+  conn_.transportSettings.pathMtuDiscovery = false;
+  startPathMtuDiscovery(conn_, kDefaultMaxUDPPayload);
+  EXPECT_EQ(Phase::Disabled, conn_.pathMtuState.phase);
+  EXPECT_FALSE(shouldSendPathMtuProbe(conn_, Clock::now()));
+}
+
+TEST_F(PathMtuDiscoveryTest, NoProbesBeforeAddressValidation) {
+  startPathMtuDiscovery(conn_, kDefaultMaxUDPPayload);
+  conn_.writableBytesLimit = 3 * kDefaultUDPSendPacketLen;
+  EXPECT_FALSE(shouldSendPathMtuProbe(conn_, Clock::now()));
+  conn_.writableBytesLimit = folly::none;
+  conn_.oneRttWriteCipher = nullptr;
+  EXPECT_FALSE(shouldSendPathMtuProbe(conn_, Clock::now()));
+}
+
+TEST_F(PathMtuDiscoveryTest, PeerLimitAlreadyReached) {
+  startPathMtuDiscovery(conn_, kDefaultUDPSendPacketLen);
+  EXPECT_EQ(Phase::SearchComplete, conn_.pathMtuState.phase);
+  EXPECT_FALSE(shouldSendPathMtuProbe(conn_, Clock::now()));
+}
+
+TEST_F(PathMtuDiscoveryTest, SearchConverges) {
+  // The path takes up to 3000 bytes, the peer accepts up to 4096.
+  constexpr uint64_t kPathMtu = 3000;
+  startPathMtuDiscovery(conn_, 4096);
+  EXPECT_EQ(Phase::Searching, conn_.pathMtuState.phase);
+  size_t probes = 0;
+  while (conn_.pathMtuState.phase == Phase::Searching) {
+    ASSERT_LT(probes++, 100);
+    auto probe = sendProbe();
+    if (probe.encodedSize <= kPathMtu) {
+      onPathMtuPacketAcked(conn_, probe, Clock::now());
+      EXPECT_EQ(probe.encodedSize, conn_.udpSendPacketLen);
+    } else {
+      onPathMtuPacketLost(conn_, probe, Clock::now());
+      EXPECT_LE(conn_.udpSendPacketLen, kPathMtu);
+    }
+  }
+  EXPECT_EQ(Phase::SearchComplete, conn_.pathMtuState.phase);
+  EXPECT_LE(conn_.udpSendPacketLen, kPathMtu);
+  EXPECT_GT(conn_.udpSendPacketLen + kPathMtuSearchGranularity, kPathMtu);
+  EXPECT_EQ(probes, conn_.pathMtuState.probesSent);
+}
+
+TEST_F(PathMtuDiscoveryTest, SizeFailsAfterMaxProbes) {
+  startPathMtuDiscovery(conn_, 4096);
+  auto firstProbe = sendProbe();
+  for (uint8_t i = 1; i < kPathMtuMaxProbes; ++i) {
+    onPathMtuPacketLost(conn_, firstProbe, Clock::now());
+    auto probe = sendProbe();
+    EXPECT_EQ(firstProbe.encodedSize, probe.encodedSize);
+    firstProbe = std::move(probe);
+  }
+  onPathMtuPacketLost(conn_, firstProbe, Clock::now());
+  EXPECT_EQ(firstProbe.encodedSize - 1, conn_.pathMtuState.searchHigh);
+  EXPECT_LT(sendProbe().encodedSize, firstProbe.encodedSize);
+  EXPECT_EQ(kDefaultUDPSendPacketLen, conn_.udpSendPacketLen);
+}
+
+TEST_F(PathMtuDiscoveryTest, SearchStartsOverAfterRaiseInterval) {
+  startPathMtuDiscovery(conn_, 4096);
+  while (conn_.pathMtuState.phase == Phase::Searching) {
+    onPathMtuPacketLost(conn_, sendProbe(), Clock::now());
+  }
+  auto nextSearchTime = conn_.pathMtuState.nextSearchTime;
+  EXPECT_FALSE(shouldSendPathMtuProbe(conn_, Clock::now()));
+  EXPECT_TRUE(shouldSendPathMtuProbe(conn_, nextSearchTime));
+  getNextPathMtuProbeSize(conn_, nextSearchTime);
+  EXPECT_EQ(Phase::Searching, conn_.pathMtuState.phase);
+  EXPECT_EQ(4096, conn_.pathMtuState.searchHigh);
+}
+
+TEST_F(PathMtuDiscoveryTest, BlackHole) {
+  startPathMtuDiscovery(conn_, 4096);
+  auto probe = sendProbe();
+  onPathMtuPacketAcked(conn_, probe, Clock::now());
+  auto raisedLen = conn_.udpSendPacketLen;
+  ASSERT_GT(raisedLen, kDefaultUDPSendPacketLen);
+
+  // Small losses and acked large packets don't count.
+  onPathMtuPacketLost(
+      conn_, makePacket(kDefaultUDPSendPacketLen, false), Clock::now());
+  for (uint32_t i = 1; i < kPathMtuBlackHoleThreshold; ++i) {
+    onPathMtuPacketLost(conn_, makePacket(raisedLen, false), Clock::now());
+  }
+  onPathMtuPacketAcked(conn_, makePacket(raisedLen, false), Clock::now());
+  for (uint32_t i = 1; i < kPathMtuBlackHoleThreshold; ++i) {
+    onPathMtuPacketLost(conn_, makePacket(raisedLen, false), Clock::now());
+  }
+  EXPECT_EQ(raisedLen, conn_.udpSendPacketLen);
+  EXPECT_EQ(0, conn_.pathMtuState.blackHoles);
+
+  onPathMtuPacketLost(conn_, makePacket(raisedLen, false), Clock::now());
+  EXPECT_EQ(kDefaultUDPSendPacketLen, conn_.udpSendPacketLen);
+  EXPECT_EQ(1, conn_.pathMtuState.blackHoles);
+  EXPECT_EQ(Phase::Searching, conn_.pathMtuState.phase);
+  EXPECT_EQ(raisedLen - 1, conn_.pathMtuState.searchHigh);
+  EXPECT_LT(sendProbe().encodedSize, raisedLen);
+
+  // The large packets still in flight are not another black hole.
+  for (uint32_t i = 0; i < kPathMtuBlackHoleThreshold; ++i) {
+    onPathMtuPacketLost(conn_, makePacket(raisedLen, false), Clock::now());
+  }
+  EXPECT_EQ(1, conn_.pathMtuState.blackHoles);
+}
+
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+// What the kernel does about fragmentation on the socket.
+int getMtuDiscover(folly::AsyncUDPSocket& socket) {
+  int value = -1;
+  socklen_t len = sizeof(value);
+  folly::netops::getsockopt(
+      socket.getNetworkSocket(), IPPROTO_IP, IP_MTU_DISCOVER, &value, &len);
+  return value;
+}
+
+TEST(PathMtuDiscoverySocketTest, DontFragment) {
+  folly::EventBase evb;
+  folly::AsyncUDPSocket socket(&evb);
+  socket.bind(folly::SocketAddress("127.0.0.1", 0));
+  socket.dontFragment(false);
+  setSocketDontFragment(socket, false);
+  EXPECT_EQ(IP_PMTUDISC_DO, getMtuDiscover(socket));
+  // The probes still go out with DF when the kernel ignores the path MTU.
+  setSocketDontFragment(socket, true);
+  EXPECT_EQ(IP_PMTUDISC_PROBE, getMtuDiscover(socket));
+}
+#endif
+
+} // namespace test
+} // namespace quic
@@ -11,6 +11,7 @@
 
 #include <quic/server/state/ServerStateMachine.h>
 #include <quic/state/QPRFunctions.h>
+#include <quic/state/QuicStreamFunctions.h>
 
 using namespace folly;
 using namespace testing;
@@ -132,6 +133,61 @@ TEST_F(QPRFunctionsTest, AdvanceMinimumRetransmittableOffset) {
       [&](auto&) {});
 }
 
+TEST_F(QPRFunctionsTest, ExpireStreamData) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  auto ackedStream =
+      conn.streamManager->createNextBidirectionalStream().value();
+  stream->dataExpiry = std::make_unique<QuicStreamState::DataExpiryState>();
+  stream->dataExpiry->expiry = std::chrono::milliseconds(100);
+  ackedStream->dataExpiry =
+      std::make_unique<QuicStreamState::DataExpiryState>();
+  ackedStream->dataExpiry->expiry = std::chrono::milliseconds(100);
+  auto now = Clock::now();
+  writeDataToQuicStream(*stream, IOBuf::copyBuffer("aaaaaaaaaa"), false);
+  writeDataToQuicStream(*stream, IOBuf::copyBuffer("bbbbbbbbbb"), false);
+  writeDataToQuicStream(*ackedStream, IOBuf::copyBuffer("aaaaaaaaaa"), false);
+  EXPECT_EQ(2, conn.streamManager->expiringStreams().size());
+  // The first write of stream was sent, the second was not.
+  stream->writeBuffer.trimStart(10);
+  stream->currentWriteOffset = 10;
+  stream->retransmissionBuffer.emplace_back(
+      StreamBuffer(IOBuf::copyBuffer("aaaaaaaaaa"), 0));
+  // All of ackedStream was acked.
+  ackedStream->writeBuffer.move();
+  ackedStream->currentWriteOffset = 10;
+
+  EXPECT_TRUE(expireStreamData(conn, now).empty());
+  auto expired = expireStreamData(conn, now + std::chrono::seconds(1));
+  ASSERT_EQ(1, expired.size());
+  EXPECT_EQ(stream->id, expired[0].first);
+  EXPECT_EQ(20, expired[0].second);
+  EXPECT_EQ(20, stream->minimumRetransmittableOffset);
+  EXPECT_EQ(20, stream->currentWriteOffset);
+  EXPECT_TRUE(stream->retransmissionBuffer.empty());
+  EXPECT_EQ(0, stream->writeBuffer.chainLength());
+  EXPECT_EQ(0, ackedStream->minimumRetransmittableOffset);
+  EXPECT_TRUE(conn.streamManager->expiringStreams().empty());
+  ASSERT_EQ(1, conn.pendingEvents.frames.size());
+  auto& frame =
+      boost::get<ExpiredStreamDataFrame>(conn.pendingEvents.frames[0]);
+  EXPECT_EQ(stream->id, frame.streamId);
+  EXPECT_EQ(20, frame.minimumStreamOffset);
+}
+
+TEST_F(QPRFunctionsTest, ShrinkBuffersTrimsStraddlingBuffer) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  stream->currentWriteOffset = 30;
+  auto buf = IOBuf::copyBuffer("aaaaaaaaaa");
+  stream->retransmissionBuffer.emplace_back(StreamBuffer(buf->clone(), 0));
+  stream->retransmissionBuffer.emplace_back(StreamBuffer(buf->clone(), 10));
+  stream->retransmissionBuffer.emplace_back(StreamBuffer(buf->clone(), 20));
+  advanceMinimumRetransmittableOffset(stream, 15);
+  ASSERT_EQ(2, stream->retransmissionBuffer.size());
+  EXPECT_EQ(15, stream->retransmissionBuffer.front().offset);
+  EXPECT_EQ(5, stream->retransmissionBuffer.front().data.chainLength());
+  EXPECT_EQ(20, stream->retransmissionBuffer.back().offset);
+}
+
 TEST_F(QPRFunctionsTest, RecvMinStreamDataFrame) {
   auto stream = conn.streamManager->createNextBidirectionalStream().value();
 
@@ -12,6 +12,9 @@
 #include <quic/common/test/TestUtils.h>
 #include <quic/server/state/ServerStateMachine.h>
 #include <quic/state/QuicStateFunctions.h>
+#include <quic/state/QuicStreamFunctions.h>
+#include <quic/state/SimpleFrameFunctions.h>
+#include <quic/state/stream/StreamStateFunctions.h>
 #include <quic/state/test/Mocks.h>
 
 using namespace testing;
@@ -78,6 +81,21 @@ TEST_P(UpdateLargestReceivedPacketNumTest, ReceiveOld) {
       currentLargestReceived);
 }
 
+TEST_P(UpdateLargestReceivedPacketNumTest, KeepsNewestAckBlocks) {
+  QuicServerConnectionState conn;
+  auto& ackState = getAckState(conn, GetParam());
+  for (PacketNum packetNum = 0; packetNum < 10; packetNum += 2) {
+    updateLargestReceivedPacketNum(ackState, packetNum, Clock::now(), 3);
+  }
+  ASSERT_EQ(3, ackState.acks.size());
+  EXPECT_EQ(4, ackState.acks.front().start);
+  EXPECT_EQ(8, ackState.acks.back().end);
+  // An old packet that does not fit is not kept either.
+  updateLargestReceivedPacketNum(ackState, 1, Clock::now(), 3);
+  ASSERT_EQ(3, ackState.acks.size());
+  EXPECT_EQ(4, ackState.acks.front().start);
+}
+
 INSTANTIATE_TEST_CASE_P(
     UpdateLargestReceivedPacketNumTests,
     UpdateLargestReceivedPacketNumTest,
@@ -163,6 +181,85 @@ TEST_P(UpdateAckStateTest, TestUpdateAckState) {
   EXPECT_FALSE(conn.pendingEvents.scheduleAckTimeout);
 }
 
+TEST_F(UpdateAckStateTest, UpdateAckStateWithAckFrequency) {
+  QuicServerConnectionState conn;
+  conn.ackFrequency = AckFrequencyFrame(0, 3, 5ms, true);
+  auto pnSpace = PacketNumberSpace::AppData;
+  auto& ackState = getAckState(conn, pnSpace);
+  updateAckState(conn, pnSpace, 10, true, false, Clock::now());
+  EXPECT_FALSE(ackState.needsToSendAckImmediately);
+  EXPECT_TRUE(conn.pendingEvents.scheduleAckTimeout);
+
+  // Out of order packets do not trigger an immediate ack.
+  updateAckState(conn, pnSpace, 5, true, false, Clock::now());
+  EXPECT_FALSE(ackState.needsToSendAckImmediately);
+  EXPECT_EQ(ackState.numRxPacketsRecvd, 2);
+
+  updateAckState(conn, pnSpace, 11, true, false, Clock::now());
+  EXPECT_TRUE(verifyToAckImmediately(conn, ackState));
+
+  // The peer's request only applies to application data.
+  auto& handshakeAckState = getAckState(conn, PacketNumberSpace::Handshake);
+  updateAckState(
+      conn, PacketNumberSpace::Handshake, 10, true, false, Clock::now());
+  updateAckState(
+      conn, PacketNumberSpace::Handshake, 5, true, false, Clock::now());
+  EXPECT_TRUE(verifyToAckImmediately(conn, handshakeAckState));
+}
+
+TEST_F(UpdateAckStateTest, RecvAckFrequencyFrame) {
+  QuicServerConnectionState conn;
+  AckFrequencyFrame frame(1, 4, 10ms, false);
+  EXPECT_THROW(onRecvAckFrequencyFrame(conn, frame), QuicTransportException);
+
+  conn.transportSettings.ackFrequencyEnabled = true;
+  onRecvAckFrequencyFrame(conn, frame);
+  ASSERT_TRUE(conn.ackFrequency.hasValue());
+  EXPECT_EQ(*conn.ackFrequency, frame);
+
+  // Stale frames are ignored.
+  onRecvAckFrequencyFrame(conn, AckFrequencyFrame(0, 2, 10ms, false));
+  EXPECT_EQ(*conn.ackFrequency, frame);
+
+  EXPECT_THROW(
+      onRecvAckFrequencyFrame(conn, AckFrequencyFrame(2, 0, 10ms, false)),
+      QuicTransportException);
+  EXPECT_THROW(
+      onRecvAckFrequencyFrame(conn, AckFrequencyFrame(2, 2, 10us, false)),
+      QuicTransportException);
+}
+
+TEST_F(UpdateAckStateTest, RequestAckFrequency) {
+  QuicServerConnectionState conn;
+  EXPECT_FALSE(requestAckFrequency(conn, 10, 20ms, false));
+  EXPECT_TRUE(conn.pendingEvents.frames.empty());
+
+  conn.peerMinAckDelay = 1ms;
+  EXPECT_TRUE(requestAckFrequency(conn, 10, 20ms, false));
+  EXPECT_TRUE(requestAckFrequency(conn, 20, 100us, true));
+  // Only the latest request is pending, with the delay raised to the min.
+  ASSERT_EQ(conn.pendingEvents.frames.size(), 1);
+  auto frame =
+      boost::get<AckFrequencyFrame>(conn.pendingEvents.frames.front());
+  EXPECT_EQ(frame, AckFrequencyFrame(1, 20, 1ms, true));
+  EXPECT_EQ(conn.nextAckFrequencySequenceNumber, 2);
+
+  // A lost frame is only sent again if it is the latest request.
+  conn.pendingEvents.frames.clear();
+  updateSimpleFrameOnPacketLoss(conn, AckFrequencyFrame(0, 10, 20ms, false));
+  EXPECT_TRUE(conn.pendingEvents.frames.empty());
+  updateSimpleFrameOnPacketLoss(conn, frame);
+  EXPECT_EQ(conn.pendingEvents.frames.size(), 1);
+
+  // Once the latest request is acked the peer may delay its acks for as long
+  // as requested.
+  conn.lossState.maxAckDelay = 25ms;
+  updateSimpleFrameOnAck(conn, AckFrequencyFrame(0, 10, 20ms, false));
+  EXPECT_EQ(conn.lossState.maxAckDelay, 25ms);
+  updateSimpleFrameOnAck(conn, frame);
+  EXPECT_EQ(conn.lossState.maxAckDelay, 1ms);
+}
+
 TEST_F(UpdateAckStateTest, UpdateAckStateOnAckTimeout) {
   QuicConnectionStateBase conn(QuicNodeType::Client);
   auto& initialAckState = getAckState(conn, PacketNumberSpace::Initial);
@@ -298,6 +395,24 @@ TEST_P(UpdateAckStateTest, UpdateAckSendStateOnRecvPacketsNonRxOutOfOrder) {
   EXPECT_FALSE(verifyToScheduleAckTimeout(conn));
 }
 
+TEST_P(UpdateAckStateTest, UpdateEcnCountsOnRecvPacket) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  auto& ackState = getAckState(conn, GetParam());
+  updateAckSendStateOnRecvPacket(conn, ackState, false, true, false);
+  updateEcnCountsOnRecvPacket(conn, ackState, EcnCodepoint::Ect0);
+  updateEcnCountsOnRecvPacket(conn, ackState, EcnCodepoint::NotEct);
+  EXPECT_EQ(1, ackState.ecnCounts.ect0);
+  EXPECT_FALSE(verifyToAckImmediately(conn, ackState));
+  EXPECT_TRUE(verifyToScheduleAckTimeout(conn));
+  // A CE mark is acked right away.
+  updateAckSendStateOnRecvPacket(conn, ackState, false, true, false);
+  updateEcnCountsOnRecvPacket(conn, ackState, EcnCodepoint::Ce);
+  EXPECT_EQ(1, ackState.ecnCounts.ce);
+  EXPECT_EQ(0, ackState.ecnCounts.ect1);
+  EXPECT_TRUE(verifyToAckImmediately(conn, ackState));
+  EXPECT_FALSE(verifyToScheduleAckTimeout(conn));
+}
+
 INSTANTIATE_TEST_CASE_P(
     UpdateAckStateTests,
     UpdateAckStateTest,
@@ -499,6 +614,60 @@ TEST_F(QuicStateFunctionsTest, GetOutstandingPackets) {
       getLastOutstandingPacket(conn, PacketNumberSpace::AppData)->encodedSize);
 }
 
+TEST_F(QuicStateFunctionsTest, GetOutstandingPacketsAfterErase) {
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  for (uint32_t size = 1; size <= 3; size++) {
+    conn.outstandingPackets.emplace_back(
+        makeTestLongPacket(LongHeader::Types::Handshake),
+        Clock::now(),
+        size,
+        false,
+        false,
+        0);
+    conn.outstandingPackets.emplace_back(
+        makeTestShortPacket(), Clock::now(), 10 * size, false, false, 0);
+  }
+  EXPECT_EQ(conn.outstandingPackets.end(),
+            getFirstOutstandingPacket(conn, PacketNumberSpace::Initial));
+  auto first = getFirstOutstandingPacket(conn, PacketNumberSpace::AppData);
+  EXPECT_EQ(10, first->encodedSize);
+  auto second =
+      getNextOutstandingPacket(conn, PacketNumberSpace::AppData, first);
+  EXPECT_EQ(first, second);
+  second = getNextOutstandingPacket(
+      conn, PacketNumberSpace::AppData, std::next(first));
+  EXPECT_EQ(20, second->encodedSize);
+
+  conn.outstandingPackets.erase(first);
+  EXPECT_EQ(
+      20,
+      getFirstOutstandingPacket(conn, PacketNumberSpace::AppData)->encodedSize);
+  EXPECT_EQ(
+      1,
+      getFirstOutstandingPacket(conn, PacketNumberSpace::Handshake)
+          ->encodedSize);
+  conn.outstandingPackets.erase(
+      getFirstOutstandingPacket(conn, PacketNumberSpace::Handshake));
+  EXPECT_EQ(
+      2,
+      getFirstOutstandingPacket(conn, PacketNumberSpace::Handshake)
+          ->encodedSize);
+
+  conn.outstandingPackets.insert(OutstandingPacket(
+      makeTestLongPacket(LongHeader::Types::Initial),
+      Clock::now(),
+      100,
+      false,
+      false,
+      0));
+  EXPECT_EQ(
+      100,
+      getFirstOutstandingPacket(conn, PacketNumberSpace::Initial)->encodedSize);
+  EXPECT_EQ(
+      20,
+      getFirstOutstandingPacket(conn, PacketNumberSpace::AppData)->encodedSize);
+}
+
 TEST_F(QuicStateFunctionsTest, UpdateLargestReceivePacketsAtLatCloseSent) {
   QuicConnectionStateBase conn(QuicNodeType::Client);
   EXPECT_FALSE(conn.ackStates.initialAckState.largestReceivedAtLastCloseSent);
@@ -557,6 +726,90 @@ TEST_F(QuicStateFunctionsTest, EarliestLossTimer) {
   EXPECT_EQ(currentTime, earliestLossTimer(conn).first.value());
 }
 
+TEST_F(QuicStateFunctionsTest, ConnectionMemoryUsage) {
+  QuicServerConnectionState conn;
+  conn.streamManager->setMaxLocalBidirectionalStreams(
+      kDefaultMaxStreamsBidirectional);
+  EXPECT_EQ(0, getConnectionMemoryUsage(conn).total());
+
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  writeDataToQuicStream(*stream, folly::IOBuf::copyBuffer("hello"), false);
+  stream->retransmissionBuffer.emplace_back(
+      folly::IOBuf::copyBuffer("world"), 0);
+  stream->readBuffer.emplace_back(folly::IOBuf::copyBuffer("!"), 0);
+  conn.cryptoState->initialStream.writeBuffer.append(
+      folly::IOBuf::copyBuffer("crypto"));
+  conn.cryptoState->handshakeStream.lossBuffer.emplace_back(
+      folly::IOBuf::copyBuffer("lost"), 0);
+  conn.outstandingPackets.emplace_back(
+      makeTestShortPacket(), Clock::now(), 100, false, false, 0);
+
+  auto usage = getConnectionMemoryUsage(conn);
+  EXPECT_EQ(11, usage.streamBufferBytes);
+  EXPECT_EQ(10, usage.cryptoBufferBytes);
+  EXPECT_GE(usage.outstandingPacketBytes, sizeof(OutstandingPacket));
+  EXPECT_EQ(0, usage.pendingPacketBytes);
+  EXPECT_EQ(
+      usage.streamBufferBytes + usage.cryptoBufferBytes +
+          usage.outstandingPacketBytes,
+      usage.total());
+
+  // The counts follow the buffers and packets as they go away.
+  stream->retransmissionBuffer.clear();
+  conn.cryptoState->handshakeStream.lossBuffer.pop_front();
+  conn.outstandingPackets.pop_back();
+  usage = getConnectionMemoryUsage(conn);
+  EXPECT_EQ(6, usage.streamBufferBytes);
+  EXPECT_EQ(6, usage.cryptoBufferBytes);
+  EXPECT_EQ(0, usage.outstandingPacketBytes);
+  resetQuicStream(*stream, GenericApplicationErrorCode::UNKNOWN);
+  EXPECT_EQ(0, getConnectionMemoryUsage(conn).streamBufferBytes);
+}
+
+TEST_F(QuicStateFunctionsTest, DiscardHandshakeSpaces) {
+  QuicServerConnectionState conn;
+  conn.transportSettings.discardHandshakeSpaces = true;
+  conn.readCodec = std::make_unique<QuicReadCodec>(QuicNodeType::Server);
+  conn.readCodec->setInitialReadCipher(createNoOpAead());
+  conn.readCodec->setHandshakeReadCipher(createNoOpAead());
+  conn.initialWriteCipher = createNoOpAead();
+  conn.handshakeWriteCipher = createNoOpAead();
+  conn.ackStates.initialAckState.acks.insert(0, 2);
+  conn.ackStates.handshakeAckState.acks.insert(0, 3);
+  conn.cryptoState->handshakeStream.writeBuffer.append(
+      folly::IOBuf::copyBuffer("finished"));
+  conn.cryptoState->handshakeStream.currentWriteOffset = 10;
+  // Not before the handshake is done.
+  EXPECT_FALSE(maybeDiscardHandshakeSpaces(conn));
+
+  conn.readCodec->onHandshakeDone(Clock::now());
+  conn.readCodec->setOneRttReadCipher(createNoOpAead());
+  conn.oneRttWriteCipher = createNoOpAead();
+  conn.ackStates.appDataAckState.ackedByPeer = true;
+  // Nor while there is crypto data to send.
+  EXPECT_FALSE(maybeDiscardHandshakeSpaces(conn));
+  conn.cryptoState->handshakeStream.writeBuffer.move();
+  // Nor before the peer acked a 1-RTT packet.
+  conn.ackStates.appDataAckState.ackedByPeer = false;
+  EXPECT_FALSE(maybeDiscardHandshakeSpaces(conn));
+
+  // Packet 0 being acked is enough.
+  conn.ackStates.appDataAckState.ackedByPeer = true;
+  conn.ackStates.appDataAckState.largestAckedByPeer = 0;
+  EXPECT_TRUE(maybeDiscardHandshakeSpaces(conn));
+  EXPECT_TRUE(conn.handshakeSpacesDiscarded);
+  EXPECT_TRUE(conn.ackStates.initialAckState.acks.empty());
+  EXPECT_TRUE(conn.ackStates.handshakeAckState.acks.empty());
+  EXPECT_EQ(nullptr, conn.initialWriteCipher);
+  EXPECT_EQ(nullptr, conn.handshakeWriteCipher);
+  EXPECT_EQ(nullptr, conn.readCodec->getInitialCipher());
+  EXPECT_EQ(nullptr, conn.readCodec->getHandshakeReadCipher());
+  EXPECT_NE(nullptr, conn.readCodec->getOneRttReadCipher());
+  EXPECT_NE(nullptr, conn.oneRttWriteCipher);
+  EXPECT_EQ(10, conn.cryptoState->handshakeStream.currentWriteOffset);
+  EXPECT_FALSE(maybeDiscardHandshakeSpaces(conn));
+}
+
 INSTANTIATE_TEST_CASE_P(
     QuicStateFunctionsTests,
     QuicStateFunctionsTest,
@@ -12,6 +12,7 @@
 #include <quic/state/QuicStreamFunctions.h>
 
 #include <quic/client/state/ClientStateMachine.h>
+#include <quic/common/LoopTime.h>
 #include <quic/common/test/TestUtils.h>
 #include <quic/server/state/ServerStateMachine.h>
 
@@ -106,6 +107,27 @@ TEST_F(QuicStreamFunctionsTest, TestWriteStream) {
   EXPECT_TRUE(eq(stream->writeBuffer.move(), buf1));
 }
 
+TEST_F(QuicStreamFunctionsTest, TestWriteStreamCoalescing) {
+  conn.transportSettings.streamWriteCoalescingThreshold = 20;
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  auto buf1 = IOBuf::copyBuffer("I just met you");
+  auto buf2 = IOBuf::copyBuffer("and this is crazy");
+  auto buf3 = IOBuf::copyBuffer("but here's my number, so call me maybe");
+
+  writeDataToQuicStream(*stream, buf1->clone(), false);
+  writeDataToQuicStream(*stream, buf2->clone(), false);
+  // The small writes share a buffer, the large one is chained.
+  EXPECT_EQ(stream->writeBuffer.front()->countChainElements(), 1);
+  writeDataToQuicStream(*stream, buf3->clone(), false);
+  EXPECT_EQ(stream->writeBuffer.front()->countChainElements(), 2);
+
+  IOBufEqualTo eq;
+  buf1->prependChain(std::move(buf2));
+  buf1->prependChain(std::move(buf3));
+  EXPECT_EQ(stream->writeBuffer.chainLength(), buf1->computeChainDataLength());
+  EXPECT_TRUE(eq(stream->writeBuffer.move(), buf1));
+}
+
 TEST_F(QuicStreamFunctionsTest, TestReadDataWrittenInOrder) {
   auto stream = conn.streamManager->createNextBidirectionalStream().value();
   auto streamLastMaxOffset = stream->maxOffsetObserved;
@@ -144,6 +166,38 @@ TEST_F(QuicStreamFunctionsTest, TestReadDataWrittenInOrder) {
   EXPECT_TRUE(readData4.second);
 }
 
+TEST_F(QuicStreamFunctionsTest, TestReceiveInOrderStreamData) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  auto connLastMaxOffset = conn.flowControlState.sumMaxObservedOffset;
+  ReadStreamFrame frame1(stream->id, 0, IOBuf::copyBuffer("Hey"), false);
+  EXPECT_TRUE(receiveInOrderStreamData(*stream, frame1));
+  ReadStreamFrame frame2(stream->id, 3, IOBuf::copyBuffer(" you"), false);
+  EXPECT_TRUE(receiveInOrderStreamData(*stream, frame2));
+  EXPECT_EQ(1, stream->readBuffer.size());
+  EXPECT_EQ(7, stream->maxOffsetObserved);
+  EXPECT_EQ(7, conn.flowControlState.sumMaxObservedOffset - connLastMaxOffset);
+  EXPECT_TRUE(conn.streamManager->readableStreams().count(stream->id));
+
+  // Data after a gap, data that was already received and the FIN are left
+  // to the state machine.
+  ReadStreamFrame gap(stream->id, 10, IOBuf::copyBuffer("!"), false);
+  EXPECT_FALSE(receiveInOrderStreamData(*stream, gap));
+  ASSERT_TRUE(gap.data);
+  ReadStreamFrame old(stream->id, 1, IOBuf::copyBuffer("ey"), false);
+  EXPECT_FALSE(receiveInOrderStreamData(*stream, old));
+  ReadStreamFrame fin(stream->id, 7, IOBuf::copyBuffer("!"), true);
+  EXPECT_FALSE(receiveInOrderStreamData(*stream, fin));
+  EXPECT_EQ(7, stream->maxOffsetObserved);
+
+  auto readData = readDataFromQuicStream(*stream, 10);
+  EXPECT_EQ("Hey you", readData.first->moveToFbString().toStdString());
+  EXPECT_FALSE(readData.second);
+  ReadStreamFrame frame3(stream->id, 7, IOBuf::copyBuffer("!"), false);
+  EXPECT_TRUE(receiveInOrderStreamData(*stream, frame3));
+  EXPECT_EQ(1, stream->readBuffer.size());
+  EXPECT_EQ(7, stream->readBuffer.front().offset);
+}
+
 TEST_F(QuicStreamFunctionsTest, TestPeekAndConsumeContiguousData) {
   auto stream = conn.streamManager->createNextBidirectionalStream().value();
   auto streamLastMaxOffset = stream->maxOffsetObserved;
@@ -643,6 +697,28 @@ TEST_F(QuicStreamFunctionsTest, TestInsertVariations) {
   EXPECT_TRUE(stream->readBuffer.empty());
 }
 
+TEST_F(QuicStreamFunctionsTest, TestManyOutOfOrderFragments) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  std::string data = "I just met you and this is crazy";
+  // Every other byte arrives in reverse order, then the gaps get filled.
+  for (size_t i = data.size(); i-- > 0;) {
+    if (i % 2 == 1) {
+      appendDataToReadBuffer(
+          *stream, StreamBuffer(IOBuf::copyBuffer(data.substr(i, 1)), i));
+    }
+  }
+  EXPECT_EQ(stream->readBuffer.size(), data.size() / 2);
+  for (size_t i = 0; i < data.size(); i += 2) {
+    appendDataToReadBuffer(
+        *stream, StreamBuffer(IOBuf::copyBuffer(data.substr(i, 1)), i));
+  }
+  EXPECT_EQ(stream->readBuffer.size(), 1);
+
+  auto readData = readDataFromQuicStream(*stream, 100);
+  EXPECT_EQ(data, readData.first->moveToFbString().toStdString());
+  EXPECT_TRUE(stream->readBuffer.empty());
+}
+
 TEST_F(QuicStreamFunctionsTest, TestAppendAlreadyReadData) {
   auto stream = conn.streamManager->createNextBidirectionalStream().value();
   auto buf1 = IOBuf::copyBuffer("I just met you and this is crazy");
@@ -1978,5 +2054,113 @@ TEST_F(
       id /* streamId */, 0 /* offset */, 5 /* length */, true /* eof */);
   EXPECT_TRUE(ackFrameMatchesRetransmitBuffer(stream, ackFrame, buf));
 }
+
+TEST_F(QuicStreamFunctionsTest, SendRateLimitConsumeAndRefill) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  writeDataToQuicStream(*stream, IOBuf::copyBuffer("hello world"), false);
+  auto now = Clock::now();
+  // 1000 bytes per second, in bursts of 10 bytes.
+  setStreamSendRateLimit(*stream, 1000, 10, now);
+  ASSERT_TRUE(stream->sendRateLimit);
+  EXPECT_EQ(10, stream->sendRateLimit->tokens);
+  EXPECT_TRUE(conn.streamManager->writableStreams().count(stream->id));
+
+  consumeStreamSendRate(*stream, 4, now);
+  EXPECT_EQ(6, stream->sendRateLimit->tokens);
+  consumeStreamSendRate(*stream, 20, now);
+  EXPECT_EQ(0, stream->sendRateLimit->tokens);
+  EXPECT_TRUE(conn.streamManager->rateLimitedStreams().count(stream->id));
+  EXPECT_FALSE(stream->hasWritableData());
+  conn.streamManager->updateWritableStreams(*stream);
+  EXPECT_FALSE(conn.streamManager->writableStreams().count(stream->id));
+
+  // A byte per millisecond.
+  EXPECT_EQ(
+      now + std::chrono::milliseconds(5),
+      getStreamSendRateRefillTime(*stream, 5));
+  EXPECT_EQ(
+      now + std::chrono::milliseconds(10),
+      getStreamSendRateRefillTime(*stream, 1500));
+  refillStreamSendRate(*stream, now + std::chrono::microseconds(3500));
+  EXPECT_EQ(3, stream->sendRateLimit->tokens);
+  EXPECT_FALSE(conn.streamManager->rateLimitedStreams().count(stream->id));
+  EXPECT_TRUE(conn.streamManager->writableStreams().count(stream->id));
+  // The half byte earned is not lost.
+  refillStreamSendRate(*stream, now + std::chrono::microseconds(4000));
+  EXPECT_EQ(4, stream->sendRateLimit->tokens);
+  // No more than the burst.
+  refillStreamSendRate(*stream, now + std::chrono::seconds(1));
+  EXPECT_EQ(10, stream->sendRateLimit->tokens);
+}
+
+TEST_F(QuicStreamFunctionsTest, SendRateLimitRemove) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  writeDataToQuicStream(*stream, IOBuf::copyBuffer("hello"), false);
+  auto now = Clock::now();
+  setStreamSendRateLimit(*stream, 1000, 2, now);
+  consumeStreamSendRate(*stream, 2, now);
+  conn.streamManager->updateWritableStreams(*stream);
+  EXPECT_FALSE(conn.streamManager->writableStreams().count(stream->id));
+
+  setStreamSendRateLimit(*stream, 0, 2, now);
+  EXPECT_FALSE(stream->sendRateLimit);
+  EXPECT_FALSE(conn.streamManager->rateLimitedStreams().count(stream->id));
+  EXPECT_TRUE(conn.streamManager->writableStreams().count(stream->id));
+  // Without a limit nothing is consumed.
+  consumeStreamSendRate(*stream, 5, now);
+  EXPECT_FALSE(stream->sendRateLimit);
+}
+
+TEST_F(QuicStreamFunctionsTest, DeliveryLatency) {
+  conn.transportSettings.trackDeliveryLatency = true;
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  auto start = Clock::now();
+  {
+    ScopedLoopTime loopTime(start);
+    writeDataToQuicStream(*stream, IOBuf::copyBuffer("hello"), false);
+    writeDataToQuicStream(*stream, IOBuf::copyBuffer("world"), false);
+  }
+  // The first write and half of the second one are sent.
+  stream->writeBuffer.split(8);
+  stream->currentWriteOffset = 8;
+  stream->retransmissionBuffer.emplace_back(IOBuf::copyBuffer("hellowor"), 0);
+  updateDeliveryLatencyOnSent(*stream, start + 10ms);
+  {
+    // Nothing is delivered before the ack.
+    ScopedLoopTime loopTime(start + 20ms);
+    updateDeliveryLatencyOnAck(*stream);
+    EXPECT_EQ(stream->deliveryLatency.writesDelivered, 0);
+  }
+
+  stream->writeBuffer.move();
+  stream->currentWriteOffset = 10;
+  stream->retransmissionBuffer.emplace_back(IOBuf::copyBuffer("ld"), 8);
+  updateDeliveryLatencyOnSent(*stream, start + 30ms);
+  stream->retransmissionBuffer.erase(stream->retransmissionBuffer.begin());
+  {
+    ScopedLoopTime loopTime(start + 50ms);
+    updateDeliveryLatencyOnAck(*stream);
+  }
+  EXPECT_EQ(stream->deliveryLatency.writesDelivered, 1);
+  EXPECT_EQ(stream->deliveryLatency.totalQueueingTime, 10ms);
+  EXPECT_EQ(stream->deliveryLatency.totalNetworkTime, 40ms);
+
+  stream->retransmissionBuffer.clear();
+  {
+    ScopedLoopTime loopTime(start + 60ms);
+    updateDeliveryLatencyOnAck(*stream);
+  }
+  EXPECT_EQ(stream->deliveryLatency.writesDelivered, 2);
+  EXPECT_EQ(stream->deliveryLatency.totalQueueingTime, 40ms);
+  EXPECT_EQ(stream->deliveryLatency.totalNetworkTime, 70ms);
+  EXPECT_EQ(conn.deliveryLatency.writesDelivered, 2);
+  EXPECT_TRUE(stream->pendingDelivery->writes.empty());
+}
+
+TEST_F(QuicStreamFunctionsTest, DeliveryLatencyNotTrackedByDefault) {
+  auto stream = conn.streamManager->createNextBidirectionalStream().value();
+  writeDataToQuicStream(*stream, IOBuf::copyBuffer("hello"), false);
+  EXPECT_FALSE(stream->pendingDelivery);
+}
 } // namespace test
 } // namespace quic
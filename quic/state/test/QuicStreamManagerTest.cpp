@@ -9,6 +9,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <quic/common/LoopTime.h>
 #include <quic/server/state/ServerStateMachine.h>
 #include <quic/state/QuicStreamManager.h>
 #include <quic/state/test/Mocks.h>
@@ -178,5 +179,245 @@ TEST_F(QuicStreamManagerTest, TestAppIdleCloseControlStream) {
   manager.removeClosedStream(stream->id);
   EXPECT_TRUE(manager.isAppIdle());
 }
+
+TEST_F(QuicStreamManagerTest, StreamTableSlidingWindow) {
+  StreamTable table;
+  EXPECT_TRUE(table.empty());
+  EXPECT_EQ(table.find(0), nullptr);
+
+  auto& stream8 = table.emplace(8, conn);
+  auto& stream4 = table.emplace(4, conn);
+  table.emplace(17, conn);
+  EXPECT_EQ(table.size(), 3);
+  EXPECT_EQ(table.find(8), &stream8);
+  EXPECT_EQ(table.find(4), &stream4);
+  EXPECT_TRUE(table.contains(17));
+  EXPECT_FALSE(table.contains(0));
+  EXPECT_FALSE(table.contains(12));
+  EXPECT_FALSE(table.contains(13));
+
+  // Growing the window must not move the existing states.
+  table.emplace(40, conn);
+  EXPECT_EQ(table.find(8), &stream8);
+  EXPECT_EQ(table.find(4), &stream4);
+
+  std::vector<StreamId> ids;
+  table.forEach([&](QuicStreamState& stream) { ids.push_back(stream.id); });
+  EXPECT_EQ(ids, std::vector<StreamId>({4, 8, 40, 17}));
+
+  EXPECT_TRUE(table.erase(4));
+  EXPECT_FALSE(table.erase(4));
+  EXPECT_FALSE(table.erase(12));
+  EXPECT_TRUE(table.erase(40));
+  EXPECT_EQ(table.size(), 2);
+  EXPECT_EQ(table.find(8), &stream8);
+  EXPECT_FALSE(table.contains(40));
+
+  table.clear();
+  EXPECT_TRUE(table.empty());
+  EXPECT_FALSE(table.contains(8));
+  EXPECT_FALSE(table.contains(17));
+}
+
+TEST_F(QuicStreamManagerTest, StreamTableRecyclesStates) {
+  StreamTable table;
+  auto& stream = table.emplace(8, conn);
+  stream.currentWriteOffset = 10;
+  stream.writeBuffer.append(folly::IOBuf::copyBuffer("aaaaaaaaaa"));
+  stream.retransmissionBuffer.emplace_back(
+      folly::IOBuf::copyBuffer("aaaaaaaaaa"), 0);
+  stream.flowControlState.peerAdvertisedMaxOffset = 1000;
+  stream.priority = StreamPriority(0, true, 1);
+  stream.send.state = StreamSendStates::Closed();
+  stream.recv.state = StreamReceiveStates::Closed();
+  EXPECT_TRUE(table.erase(8));
+
+  // A peer initiated unidirectional stream reuses the state.
+  auto& recycled = table.emplace(14, conn);
+  QuicStreamState fresh(14, conn);
+  EXPECT_EQ(&recycled, &stream);
+  EXPECT_EQ(recycled.id, 14);
+  EXPECT_EQ(recycled.currentWriteOffset, 0);
+  EXPECT_TRUE(recycled.writeBuffer.empty());
+  EXPECT_TRUE(recycled.retransmissionBuffer.empty());
+  EXPECT_EQ(
+      recycled.flowControlState.peerAdvertisedMaxOffset,
+      fresh.flowControlState.peerAdvertisedMaxOffset);
+  EXPECT_EQ(
+      recycled.flowControlState.advertisedMaxOffset,
+      fresh.flowControlState.advertisedMaxOffset);
+  EXPECT_EQ(recycled.priority, StreamPriority());
+  EXPECT_TRUE(
+      (matchesStates<StreamSendStateData, StreamSendStates::Invalid>(
+          recycled.send.state)));
+  EXPECT_TRUE((matchesStates<StreamReceiveStateData, StreamReceiveStates::Open>(
+      recycled.recv.state)));
+}
+
+TEST_F(QuicStreamManagerTest, StreamIdSetOrderedIteration) {
+  StreamIdSet ids;
+  EXPECT_TRUE(ids.empty());
+  EXPECT_EQ(ids.begin(), ids.end());
+
+  EXPECT_TRUE(ids.insert(200));
+  EXPECT_TRUE(ids.insert(3));
+  EXPECT_TRUE(ids.insert(65));
+  EXPECT_FALSE(ids.insert(65));
+  EXPECT_EQ(ids.size(), 3);
+  EXPECT_EQ(ids.count(3), 1);
+  EXPECT_EQ(ids.count(4), 0);
+  EXPECT_EQ(
+      std::vector<StreamId>(ids.begin(), ids.end()),
+      std::vector<StreamId>({3, 65, 200}));
+
+  EXPECT_EQ(*ids.lower_bound(4), 65);
+  EXPECT_EQ(*ids.lower_bound(65), 65);
+  EXPECT_EQ(ids.lower_bound(201), ids.end());
+
+  // Iterators stay valid when the id they point to is erased.
+  auto itr = ids.find(65);
+  ASSERT_NE(itr, ids.end());
+  itr = ids.erase(itr);
+  EXPECT_EQ(*itr, 200);
+  EXPECT_EQ(ids.erase(3), 1);
+  EXPECT_EQ(ids.erase(3), 0);
+  EXPECT_EQ(*ids.begin(), 200);
+  EXPECT_EQ(ids.size(), 1);
+
+  ids.clear();
+  EXPECT_TRUE(ids.empty());
+  EXPECT_FALSE(ids.contains(200));
+}
+
+TEST_F(QuicStreamManagerTest, WritableStreamsByUrgency) {
+  auto& manager = *conn.streamManager;
+  auto stream = manager.createNextBidirectionalStream().value();
+  auto sequential = stream->id;
+  auto incremental = manager.createNextBidirectionalStream().value()->id;
+  manager.setStreamPriority(
+      *manager.getStream(incremental), StreamPriority(0, true, 16));
+
+  manager.addWritable(sequential);
+  manager.addWritable(incremental);
+  EXPECT_TRUE(manager.writableStreamsWithUrgency(kDefaultStreamUrgency)
+                  .contains(sequential));
+  EXPECT_TRUE(manager.writableSequentialStreamsWithUrgency(
+                         kDefaultStreamUrgency)
+                  .contains(sequential));
+  EXPECT_TRUE(manager.writableStreamsWithUrgency(0).contains(incremental));
+  EXPECT_TRUE(manager.writableSequentialStreamsWithUrgency(0).empty());
+
+  // Writable streams move with their priority.
+  manager.setStreamPriority(*stream, StreamPriority(7, true, 16));
+  EXPECT_TRUE(
+      manager.writableStreamsWithUrgency(kDefaultStreamUrgency).empty());
+  EXPECT_TRUE(manager.writableSequentialStreamsWithUrgency(
+                         kDefaultStreamUrgency)
+                  .empty());
+  EXPECT_TRUE(manager.writableStreamsWithUrgency(7).contains(sequential));
+
+  manager.removeWritable(sequential);
+  EXPECT_TRUE(manager.writableStreamsWithUrgency(7).empty());
+  manager.clearWritable();
+  EXPECT_TRUE(manager.writableStreamsWithUrgency(0).empty());
+  EXPECT_FALSE(manager.hasWritable());
+}
+
+void closePeerStream(QuicStreamManager& manager, StreamId id) {
+  auto stream = manager.getStream(id);
+  stream->send.state = StreamSendStates::Closed();
+  stream->recv.state = StreamReceiveStates::Closed();
+  manager.removeClosedStream(id);
+}
+
+TEST_F(QuicStreamManagerTest, RemoteStreamCreditGrantedInBatches) {
+  auto& manager = *conn.streamManager;
+  auto start = Clock::now();
+  {
+    ScopedLoopTime loopTime(start);
+    manager.setMaxRemoteBidirectionalStreams(16);
+  }
+  EXPECT_EQ(manager.remoteStreamLimit(true), 16);
+  ScopedLoopTime loopTime(start + 10s);
+  // Half the window in 10s, the batch is the minimum of 16 / 8 streams.
+  for (StreamId id = 0; id < 8 * detail::kStreamIncrement;
+       id += detail::kStreamIncrement) {
+    manager.getStream(id);
+  }
+  closePeerStream(manager, 0);
+  EXPECT_FALSE(manager.hasStreamLimitUpdates());
+  EXPECT_EQ(manager.remoteStreamLimit(true), 16);
+
+  closePeerStream(manager, 4);
+  EXPECT_TRUE(manager.hasStreamLimitUpdates());
+  EXPECT_FALSE(manager.streamLimitUpdate(false).hasValue());
+  auto update = manager.streamLimitUpdate(true);
+  ASSERT_TRUE(update.hasValue());
+  EXPECT_EQ(*update, MaxStreamsFrame(18, true));
+  manager.getStream(17 * detail::kStreamIncrement);
+  EXPECT_THROW(
+      manager.getStream(18 * detail::kStreamIncrement),
+      QuicTransportException);
+
+  manager.onStreamLimitUpdateSent(*update);
+  EXPECT_FALSE(manager.hasStreamLimitUpdates());
+  manager.onStreamLimitUpdateLost(*update);
+  EXPECT_TRUE(manager.hasStreamLimitUpdates());
+  manager.onStreamLimitUpdateSent(*update);
+
+  // A lost older limit is not sent again.
+  closePeerStream(manager, 8);
+  closePeerStream(manager, 12);
+  EXPECT_EQ(manager.remoteStreamLimit(true), 20);
+  manager.onStreamLimitUpdateSent(*manager.streamLimitUpdate(true));
+  manager.onStreamLimitUpdateLost(*update);
+  EXPECT_FALSE(manager.hasStreamLimitUpdates());
+}
+
+TEST_F(QuicStreamManagerTest, RemoteStreamCreditBatchFollowsOpenRate) {
+  auto& manager = *conn.streamManager;
+  conn.lossState.srtt = 50ms;
+  auto start = Clock::now();
+  {
+    ScopedLoopTime loopTime(start);
+    manager.setMaxRemoteUnidirectionalStreams(64);
+  }
+  ScopedLoopTime loopTime(start + 100ms);
+  // 32 streams in 100ms is 32 streams in 2 rtts.
+  for (StreamId id = 2; id < 32 * detail::kStreamIncrement;
+       id += detail::kStreamIncrement) {
+    manager.getStream(id);
+  }
+  for (StreamId id = 2; id < 31 * detail::kStreamIncrement;
+       id += detail::kStreamIncrement) {
+    closePeerStream(manager, id);
+  }
+  EXPECT_FALSE(manager.hasStreamLimitUpdates());
+  closePeerStream(manager, 2 + 31 * detail::kStreamIncrement);
+  EXPECT_EQ(*manager.streamLimitUpdate(false), MaxStreamsFrame(96, false));
+}
+
+TEST_F(QuicStreamManagerTest, RemoteStreamCreditGrantedWhenBlocked) {
+  auto& manager = *conn.streamManager;
+  manager.setMaxRemoteBidirectionalStreams(16);
+  manager.getStream(0);
+  manager.grantRemoteStreamCredit(true);
+  // Nothing was retired yet.
+  EXPECT_FALSE(manager.hasStreamLimitUpdates());
+  closePeerStream(manager, 0);
+  manager.grantRemoteStreamCredit(true);
+  EXPECT_EQ(*manager.streamLimitUpdate(true), MaxStreamsFrame(17, true));
+}
+
+TEST_F(QuicStreamManagerTest, RemoteStreamCreditNotManagedByDefault) {
+  auto& manager = *conn.streamManager;
+  auto limit = manager.remoteStreamLimit(true);
+  manager.getStream(0);
+  closePeerStream(manager, 0);
+  manager.grantRemoteStreamCredit(true);
+  EXPECT_FALSE(manager.hasStreamLimitUpdates());
+  EXPECT_EQ(manager.remoteStreamLimit(true), limit);
+}
+
 } // namespace test
 } // namespace quic
@@ -10,8 +10,12 @@
 #include <gtest/gtest.h>
 
 #include <quic/common/test/TestUtils.h>
+#include <quic/state/AllocationAccounting.h>
+#include <quic/state/CpuAccounting.h>
 #include <quic/state/StateData.h>
 
+#include <thread>
+
 using namespace quic;
 using namespace testing;
 
@@ -22,6 +26,24 @@ namespace test {
 
 class StateDataTest : public Test {};
 
+OutstandingPacket makeOutstandingPacket(
+    PacketNum packetNum,
+    LongHeader::Types type = LongHeader::Types::Handshake) {
+  RegularQuicWritePacket packet(LongHeader(
+      type,
+      getTestConnectionId(1),
+      getTestConnectionId(),
+      packetNum,
+      kVersion));
+  return OutstandingPacket(packet, Clock::now(), 100, false, false, 100);
+}
+
+PacketNum packetNumOf(const OutstandingPacket& packet) {
+  return folly::variant_match(
+      packet.packet.header,
+      [](const auto& h) { return h.getPacketSequenceNum(); });
+}
+
 TEST_F(StateDataTest, EmptyLossEvent) {
   CongestionController::LossEvent loss;
   EXPECT_EQ(0, loss.lostBytes);
@@ -68,5 +90,282 @@ TEST_F(StateDataTest, MultipleLostPacketsEvent) {
   EXPECT_EQ(1234 + 1357, loss.lostBytes);
   EXPECT_EQ(110, *loss.largestLostPacketNum);
 }
+TEST_F(StateDataTest, OutstandingPacketsEraseFromMiddle) {
+  OutstandingPackets packets;
+  for (PacketNum packetNum = 0; packetNum < 10; packetNum++) {
+    packets.insert(makeOutstandingPacket(packetNum));
+  }
+  EXPECT_EQ(10, packets.size());
+
+  auto third = packets.find(PacketNumberSpace::Handshake, 3);
+  ASSERT_NE(third, packets.end());
+  EXPECT_EQ(3, packetNumOf(*third));
+  auto fifth = packets.find(PacketNumberSpace::Handshake, 5);
+  auto next = packets.erase(packets.find(PacketNumberSpace::Handshake, 4));
+  // Erasing leaves the other packets in place.
+  EXPECT_EQ(next, fifth);
+  EXPECT_EQ(3, packetNumOf(*third));
+  EXPECT_EQ(packets.find(PacketNumberSpace::Handshake, 4), packets.end());
+  EXPECT_EQ(packets.find(PacketNumberSpace::Initial, 3), packets.end());
+  EXPECT_EQ(9, packets.size());
+
+  packets.erase(packets.begin());
+  packets.pop_back();
+  EXPECT_EQ(1, packetNumOf(packets.front()));
+  EXPECT_EQ(8, packetNumOf(packets.back()));
+  std::vector<PacketNum> packetNums;
+  for (const auto& packet : packets) {
+    packetNums.push_back(packetNumOf(packet));
+  }
+  EXPECT_EQ(packetNums, std::vector<PacketNum>({1, 2, 3, 5, 6, 7, 8}));
+  packetNums.clear();
+  for (auto itr = packets.rbegin(); itr != packets.rend(); ++itr) {
+    packetNums.push_back(packetNumOf(*itr));
+  }
+  EXPECT_EQ(packetNums, std::vector<PacketNum>({8, 7, 6, 5, 3, 2, 1}));
+
+  auto range = packets.packetNumRange(PacketNumberSpace::Handshake);
+  EXPECT_EQ(1, range.first);
+  EXPECT_EQ(9, range.second);
+}
+
+TEST_F(StateDataTest, OutstandingPacketsInsertOutOfOrder) {
+  OutstandingPackets packets;
+  packets.insert(makeOutstandingPacket(1, LongHeader::Types::Initial));
+  packets.insert(makeOutstandingPacket(4, LongHeader::Types::Initial));
+  packets.insert(makeOutstandingPacket(2, LongHeader::Types::Handshake));
+  packets.insert(makeOutstandingPacket(0, LongHeader::Types::Handshake));
+
+  std::vector<PacketNum> packetNums;
+  for (const auto& packet : packets) {
+    packetNums.push_back(packetNumOf(packet));
+  }
+  EXPECT_EQ(packetNums, std::vector<PacketNum>({0, 1, 2, 4}));
+  // The lookups still find the packets that moved.
+  EXPECT_EQ(4, packetNumOf(*packets.find(PacketNumberSpace::Initial, 4)));
+  EXPECT_EQ(2, packetNumOf(*packets.find(PacketNumberSpace::Handshake, 2)));
+
+  packets.clear();
+  EXPECT_TRUE(packets.empty());
+  EXPECT_EQ(packets.begin(), packets.end());
+}
+
+TEST_F(StateDataTest, StreamBufferListLookupByOffset) {
+  StreamBufferList buffers;
+  buffers.insert(StreamBuffer(folly::IOBuf::copyBuffer("world"), 5));
+  buffers.insert(StreamBuffer(folly::IOBuf::copyBuffer("hello"), 0));
+  buffers.insert(StreamBuffer(folly::IOBuf::copyBuffer("!"), 10, true));
+
+  std::vector<uint64_t> offsets;
+  for (const auto& buffer : buffers) {
+    offsets.push_back(buffer.offset);
+  }
+  EXPECT_EQ(offsets, std::vector<uint64_t>({0, 5, 10}));
+
+  EXPECT_EQ(5, buffers.find(5)->offset);
+  EXPECT_EQ(buffers.end(), buffers.find(3));
+  EXPECT_EQ(5, buffers.lower_bound(3)->offset);
+  EXPECT_EQ(10, buffers.upper_bound(5)->offset);
+  EXPECT_EQ(buffers.end(), buffers.lower_bound(11));
+
+  buffers.erase(buffers.find(5));
+  EXPECT_EQ(2, buffers.size());
+  EXPECT_EQ(0, buffers.front().offset);
+  EXPECT_TRUE(buffers.back().eof);
+}
+
+TEST_F(StateDataTest, StreamBufferListUnallocated) {
+  StreamBufferList buffers;
+  EXPECT_TRUE(buffers.empty());
+  EXPECT_EQ(0, buffers.size());
+  EXPECT_EQ(buffers.begin(), buffers.end());
+  EXPECT_EQ(buffers.end(), buffers.find(0));
+  EXPECT_EQ(buffers.end(), buffers.upper_bound(0));
+  buffers.erase(buffers.begin(), buffers.end());
+  buffers.clear();
+
+  // Inserting at a position of the empty list allocates it.
+  buffers.emplace(
+      buffers.lower_bound(5), folly::IOBuf::copyBuffer("world"), 5);
+  buffers.insert(
+      buffers.lower_bound(0),
+      StreamBuffer(folly::IOBuf::copyBuffer("hello"), 0));
+  ASSERT_EQ(2, buffers.size());
+  EXPECT_EQ(0, buffers.front().offset);
+  EXPECT_EQ(5, buffers.back().offset);
+  buffers.clear();
+  EXPECT_TRUE(buffers.empty());
+  EXPECT_EQ(buffers.begin(), buffers.end());
+}
+
+TEST_F(StateDataTest, StreamBufferListInsertCoalesced) {
+  StreamBufferList buffers;
+  buffers.insertCoalesced(StreamBuffer(folly::IOBuf::copyBuffer("world"), 5));
+  buffers.insertCoalesced(StreamBuffer(folly::IOBuf::copyBuffer("!"), 20));
+  // Fills the gap before the first buffer.
+  auto merged = buffers.insertCoalesced(
+      StreamBuffer(folly::IOBuf::copyBuffer("hello"), 0));
+  EXPECT_EQ(0, merged->offset);
+  ASSERT_EQ(2, buffers.size());
+  // Joins the buffers on both sides of it.
+  merged = buffers.insertCoalesced(
+      StreamBuffer(folly::IOBuf::copyBuffer(" again!!!!"), 10));
+  ASSERT_EQ(1, buffers.size());
+  EXPECT_EQ(buffers.begin(), merged);
+  EXPECT_EQ(21, merged->data.chainLength());
+  // Nothing is merged after the end of the stream.
+  merged->eof = true;
+  buffers.insertCoalesced(StreamBuffer(folly::IOBuf::copyBuffer("?"), 21));
+  ASSERT_EQ(2, buffers.size());
+  EXPECT_EQ(
+      "helloworld again!!!!!",
+      buffers.front().data.move()->moveToFbString().toStdString());
+  EXPECT_EQ(21, buffers.back().offset);
+}
+
+TEST_F(StateDataTest, StreamBufferListCountsBytes) {
+  uint64_t total = 0;
+  StreamBufferList buffers;
+  buffers.countBytesIn(&total);
+  buffers.insert(StreamBuffer(folly::IOBuf::copyBuffer("hello"), 0));
+  buffers.emplace_back(folly::IOBuf::copyBuffer("!"), 20, true);
+  buffers.insertCoalesced(StreamBuffer(folly::IOBuf::copyBuffer("world"), 5));
+  EXPECT_EQ(11, total);
+
+  // Data trimmed in place is counted by the caller.
+  buffers.front().data.trimStart(2);
+  buffers.front().offset += 2;
+  buffers.onDataTrimmed(2);
+  EXPECT_EQ(9, total);
+  auto extracted = buffers.extract(buffers.begin());
+  EXPECT_EQ(8, extracted.data.chainLength());
+  EXPECT_EQ(1, total);
+
+  // Assigning moves the bytes to the total of the list assigned to.
+  uint64_t otherTotal = 0;
+  {
+    StreamBufferList other;
+    other.countBytesIn(&otherTotal);
+    other.push_back(std::move(extracted));
+    EXPECT_EQ(8, otherTotal);
+    other = std::move(buffers);
+    EXPECT_EQ(1, otherTotal);
+    EXPECT_EQ(0, total);
+    buffers.emplace_back(folly::IOBuf::copyBuffer("again"), 30);
+    EXPECT_EQ(5, total);
+  }
+  EXPECT_EQ(0, otherTotal);
+  buffers.clear();
+  EXPECT_EQ(0, total);
+}
+
+TEST_F(StateDataTest, CpuAccounting) {
+  using Phase = ConnectionCpuUsage::Phase;
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  { ScopedCpuAccounting accounting(conn, Phase::Read); }
+  EXPECT_EQ(0, conn.cpuUsage.calls[static_cast<size_t>(Phase::Read)]);
+
+  conn.transportSettings.cpuAccounting = true;
+  {
+    ScopedCpuAccounting read(conn, Phase::Read);
+    {
+      ScopedCpuAccounting write(conn, Phase::Write);
+      EXPECT_EQ(Phase::Write, *conn.cpuPhase);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(Phase::Read, *conn.cpuPhase);
+  }
+  EXPECT_FALSE(conn.cpuPhase.hasValue());
+  EXPECT_EQ(1, conn.cpuUsage.calls[static_cast<size_t>(Phase::Read)]);
+  EXPECT_EQ(1, conn.cpuUsage.calls[static_cast<size_t>(Phase::Write)]);
+  EXPECT_EQ(0, conn.cpuUsage.calls[static_cast<size_t>(Phase::AckTimeout)]);
+  EXPECT_GT(conn.cpuUsage.cycles[static_cast<size_t>(Phase::Write)], 0);
+  EXPECT_EQ(
+      conn.cpuUsage.cycles[static_cast<size_t>(Phase::Read)] +
+          conn.cpuUsage.cycles[static_cast<size_t>(Phase::Write)],
+      conn.cpuUsage.totalCycles());
+}
+
+TEST_F(StateDataTest, AllocationAccounting) {
+  using Phase = ConnectionAllocationUsage::Phase;
+  using Subsystem = ConnectionAllocationUsage::Subsystem;
+  QuicConnectionStateBase conn(QuicNodeType::Client);
+  { ScopedAllocationAccounting accounting(conn, Phase::Read); }
+  EXPECT_EQ(0, conn.allocationUsage.calls[static_cast<size_t>(Phase::Read)]);
+  { ScopedAllocationAccounting accounting(conn, Subsystem::Codec); }
+  EXPECT_FALSE(conn.allocationPhase.hasValue());
+
+  conn.transportSettings.allocationAccounting = true;
+  {
+    ScopedAllocationAccounting read(conn, Phase::Read);
+    {
+      ScopedAllocationAccounting codec(conn, Subsystem::Codec);
+      EXPECT_EQ(Subsystem::Codec, conn.allocationSubsystem);
+      auto buf = folly::IOBuf::create(100);
+      {
+        ScopedAllocationAccounting handshake(conn, Phase::Handshake);
+        EXPECT_EQ(Phase::Handshake, *conn.allocationPhase);
+        EXPECT_EQ(Subsystem::State, conn.allocationSubsystem);
+      }
+      EXPECT_EQ(Phase::Read, *conn.allocationPhase);
+      EXPECT_EQ(Subsystem::Codec, conn.allocationSubsystem);
+    }
+    EXPECT_EQ(Subsystem::State, conn.allocationSubsystem);
+  }
+  EXPECT_FALSE(conn.allocationPhase.hasValue());
+  EXPECT_EQ(1, conn.allocationUsage.calls[static_cast<size_t>(Phase::Read)]);
+  EXPECT_EQ(
+      1, conn.allocationUsage.calls[static_cast<size_t>(Phase::Handshake)]);
+  EXPECT_EQ(0, conn.allocationUsage.calls[static_cast<size_t>(Phase::Write)]);
+  const auto& codecCounts =
+      conn.allocationUsage.at(Phase::Read, Subsystem::Codec);
+  if (allocationCountingEnabled()) {
+    EXPECT_GT(codecCounts.allocations, 0);
+    EXPECT_GE(codecCounts.bytes, 100);
+  } else {
+    EXPECT_EQ(0, codecCounts.allocations);
+  }
+  EXPECT_EQ(
+      codecCounts.allocations, conn.allocationUsage.total().allocations);
+}
+
+template <typename T>
+size_t offsetInConn(const QuicConnectionStateBase& conn, const T& field) {
+  return reinterpret_cast<const char*>(&field) -
+      reinterpret_cast<const char*>(&conn);
+}
+
+TEST_F(StateDataTest, PerPacketStateComesFirst) {
+  QuicConnectionStateBase conn(QuicNodeType::Server);
+  // The end of the state read or written for every packet.
+  auto hotEnd = offsetInConn(conn, conn.pendingCoalescedPackets) +
+      sizeof(conn.pendingCoalescedPackets);
+  for (auto hot :
+       {offsetInConn(conn, conn.lossState),
+        offsetInConn(conn, conn.ackStates),
+        offsetInConn(conn, conn.flowControlState),
+        offsetInConn(conn, conn.pendingEvents),
+        offsetInConn(conn, conn.outstandingPackets),
+        offsetInConn(conn, conn.udpSendPacketLen),
+        offsetInConn(conn, conn.readCodec),
+        offsetInConn(conn, conn.oneRttWriteCipher)}) {
+    EXPECT_LT(hot, hotEnd);
+  }
+  for (auto cold :
+       {offsetInConn(conn, conn.transportSettings),
+        offsetInConn(conn, conn.keyUpdateState),
+        offsetInConn(conn, conn.qLogger),
+        offsetInConn(conn, conn.cpuUsage),
+        offsetInConn(conn, conn.pathMtuState),
+        offsetInConn(conn, conn.debugState),
+        offsetInConn(conn, conn.supportedVersions),
+        offsetInConn(conn, conn.happyEyeballsState)}) {
+    EXPECT_GE(cold, hotEnd);
+  }
+  // The state that only clients use while connecting is last.
+  EXPECT_GT(
+      offsetInConn(conn, conn.happyEyeballsState),
+      offsetInConn(conn, conn.debugState));
+}
 } // namespace test
 } // namespace quic
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <quic/server/state/ServerStateMachine.h>
+#include <quic/state/QuicStreamFunctions.h>
+
+#include <limits>
+#include <vector>
+
+namespace {
+
+constexpr uint64_t kChunkSize = 1000;
+// Chunks that arrive before the app reads the stream.
+constexpr size_t kChunksPerWindow = 64;
+
+enum class ChunkOrder {
+  InOrder,
+  // Each window from its last chunk to its first.
+  Reversed,
+  // The even chunks of each window, then the odd ones that fill the gaps.
+  Interleaved,
+  // Each chunk twice, as with spurious retransmissions.
+  Duplicated,
+};
+
+std::vector<uint64_t> makeChunkIndices(ChunkOrder order) {
+  std::vector<uint64_t> indices;
+  for (uint64_t i = 0; i < kChunksPerWindow; i++) {
+    switch (order) {
+      case ChunkOrder::InOrder:
+        indices.push_back(i);
+        break;
+      case ChunkOrder::Reversed:
+        indices.push_back(kChunksPerWindow - 1 - i);
+        break;
+      case ChunkOrder::Interleaved:
+        indices.push_back(
+            i < kChunksPerWindow / 2 ? 2 * i
+                                     : 2 * (i - kChunksPerWindow / 2) + 1);
+        break;
+      case ChunkOrder::Duplicated:
+        indices.push_back(i / 2);
+        break;
+    }
+  }
+  return indices;
+}
+
+// Appends a chunk per iteration to the read buffer of a stream that is read
+// once per window.
+void appendData(size_t iters, ChunkOrder order) {
+  quic::QuicServerConnectionState conn;
+  quic::QuicStreamState* stream = nullptr;
+  auto indices = makeChunkIndices(order);
+  auto chunk = folly::IOBuf::create(kChunkSize);
+  size_t pos = 0;
+  uint64_t windowOffset = 0;
+  BENCHMARK_SUSPEND {
+    conn.streamManager->setMaxLocalBidirectionalStreams(1);
+    stream = conn.streamManager->createNextBidirectionalStream().value();
+    // Flow control is not what is measured.
+    conn.flowControlState.advertisedMaxOffset =
+        std::numeric_limits<uint64_t>::max();
+    stream->flowControlState.advertisedMaxOffset =
+        std::numeric_limits<uint64_t>::max();
+    chunk->append(kChunkSize);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    BENCHMARK_SUSPEND {
+      if (pos == indices.size()) {
+        // The app read the window.
+        stream->readBuffer.clear();
+        windowOffset += kChunksPerWindow * kChunkSize;
+        stream->currentReadOffset = windowOffset;
+        pos = 0;
+      }
+    }
+    quic::appendDataToReadBuffer(
+        *stream,
+        quic::StreamBuffer(
+            chunk->clone(), windowOffset + indices[pos++] * kChunkSize));
+  }
+}
+
+} // namespace
+
+BENCHMARK_NAMED_PARAM(appendData, InOrder, ChunkOrder::InOrder)
+BENCHMARK_NAMED_PARAM(appendData, Reversed, ChunkOrder::Reversed)
+BENCHMARK_NAMED_PARAM(appendData, Interleaved, ChunkOrder::Interleaved)
+BENCHMARK_NAMED_PARAM(appendData, Duplicated, ChunkOrder::Duplicated)
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
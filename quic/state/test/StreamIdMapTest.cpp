@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/StreamIdMap.h>
+
+#include <folly/portability/GTest.h>
+
+#include <vector>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+TEST(StreamIdMapTest, EmplaceFindErase) {
+  StreamIdMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.emplace(8, 1).second);
+  EXPECT_FALSE(map.emplace(8, 2).second);
+  EXPECT_TRUE(map.emplace(0, 3).second);
+  EXPECT_TRUE(map.emplace(5, 4).second);
+  EXPECT_EQ(3, map.size());
+  ASSERT_NE(map.find(8), map.end());
+  EXPECT_EQ(8, map.find(8)->first);
+  EXPECT_EQ(1, map.find(8)->second);
+  EXPECT_EQ(map.find(4), map.end());
+  EXPECT_EQ(map.find(9), map.end());
+  EXPECT_EQ(0, map.count(12));
+
+  auto& value = map.find(8)->second;
+  EXPECT_EQ(1, map.erase(0));
+  EXPECT_EQ(0, map.erase(0));
+  // Erasing other streams keeps the values in place.
+  EXPECT_EQ(&value, &map.find(8)->second);
+  map.erase(map.find(8));
+  EXPECT_EQ(map.find(8), map.end());
+  EXPECT_EQ(1, map.size());
+  map[5]++;
+  EXPECT_EQ(5, map[5]);
+  EXPECT_EQ(0, map[1]);
+  EXPECT_EQ(2, map.size());
+}
+
+TEST(StreamIdMapTest, IterateByTypeAndId) {
+  StreamIdMap<int> map;
+  for (StreamId id : {13, 2, 4, 1, 0, 400}) {
+    map[id] = 1;
+  }
+  std::vector<StreamId> ids;
+  for (const auto& entry : map) {
+    ids.push_back(entry.first);
+  }
+  EXPECT_EQ(std::vector<StreamId>({0, 4, 400, 1, 13, 2}), ids);
+
+  auto it = map.find(400);
+  map.erase(0);
+  map.erase(4);
+  map[404] = 2;
+  // The iterator of a stream survives changes to the others.
+  EXPECT_EQ(400, it->first);
+  ++it;
+  EXPECT_EQ(404, it->first);
+
+  auto moved = std::move(map);
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+  EXPECT_EQ(5, moved.size());
+  moved.clear();
+  EXPECT_EQ(moved.begin(), moved.end());
+}
+
+} // namespace test
+} // namespace quic
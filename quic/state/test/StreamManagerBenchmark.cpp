@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <quic/server/state/ServerStateMachine.h>
+#include <quic/state/QuicStreamManager.h>
+
+#include <deque>
+#include <vector>
+
+namespace {
+
+void setupConnection(quic::QuicServerConnectionState& conn) {
+  conn.flowControlState.peerAdvertisedInitialMaxStreamOffsetBidiLocal =
+      quic::kDefaultStreamWindowSize;
+  conn.flowControlState.peerAdvertisedInitialMaxStreamOffsetBidiRemote =
+      quic::kDefaultStreamWindowSize;
+  conn.streamManager->setMaxLocalBidirectionalStreams(quic::kMaxMaxStreams);
+}
+
+void closeStream(
+    quic::QuicServerConnectionState& conn,
+    quic::QuicStreamState& stream) {
+  stream.send.state = quic::StreamSendStates::Closed();
+  stream.recv.state = quic::StreamReceiveStates::Closed();
+  conn.streamManager->removeClosedStream(stream.id);
+}
+
+std::vector<quic::StreamId> openStreams(
+    quic::QuicServerConnectionState& conn,
+    size_t numStreams) {
+  std::vector<quic::StreamId> ids;
+  for (size_t i = 0; i < numStreams; i++) {
+    ids.push_back(
+        conn.streamManager->createNextBidirectionalStream().value()->id);
+  }
+  return ids;
+}
+
+// Finds the stream of each frame of a packet, among numStreams open ones.
+void findStream(size_t iters, size_t numStreams) {
+  quic::QuicServerConnectionState conn;
+  std::vector<quic::StreamId> ids;
+  BENCHMARK_SUSPEND {
+    setupConnection(conn);
+    ids = openStreams(conn, numStreams);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    // Not in id order, as streams of different requests would be.
+    auto id = ids[(i * 7919) % ids.size()];
+    folly::doNotOptimizeAway(conn.streamManager->findStream(id));
+  }
+}
+
+// A stream becoming readable and read, among numStreams open ones.
+void updateReadable(size_t iters, size_t numStreams) {
+  quic::QuicServerConnectionState conn;
+  std::vector<quic::StreamId> ids;
+  auto data = folly::IOBuf::copyBuffer("data");
+  BENCHMARK_SUSPEND {
+    setupConnection(conn);
+    ids = openStreams(conn, numStreams);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto stream = conn.streamManager->findStream(ids[i % ids.size()]);
+    stream->readBuffer.emplace_back(data->clone(), stream->currentReadOffset);
+    conn.streamManager->updateReadableStreams(*stream);
+    stream->readBuffer.clear();
+    conn.streamManager->updateReadableStreams(*stream);
+  }
+}
+
+// A stream becoming writable and written, among numStreams open ones.
+void updateWritable(size_t iters, size_t numStreams) {
+  quic::QuicServerConnectionState conn;
+  std::vector<quic::StreamId> ids;
+  auto data = folly::IOBuf::copyBuffer("data");
+  BENCHMARK_SUSPEND {
+    setupConnection(conn);
+    ids = openStreams(conn, numStreams);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto stream = conn.streamManager->findStream(ids[i % ids.size()]);
+    stream->writeBuffer.append(data->clone());
+    conn.streamManager->updateWritableStreams(*stream);
+    stream->writeBuffer.move();
+    conn.streamManager->updateWritableStreams(*stream);
+  }
+}
+
+} // namespace
+
+// A stream per request, each closed before the next one is opened.
+BENCHMARK(OpenCloseStream, iters) {
+  quic::QuicServerConnectionState conn;
+  BENCHMARK_SUSPEND {
+    setupConnection(conn);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    auto stream = conn.streamManager->createNextBidirectionalStream().value();
+    closeStream(conn, *stream);
+  }
+}
+
+// Concurrent requests, with a window of streams open at any time.
+BENCHMARK(OpenCloseConcurrentStreams, iters) {
+  constexpr size_t kConcurrentStreams = 16;
+  quic::QuicServerConnectionState conn;
+  std::deque<quic::QuicStreamState*> openStreams;
+  BENCHMARK_SUSPEND {
+    setupConnection(conn);
+  }
+  for (size_t i = 0; i < iters; i++) {
+    openStreams.push_back(
+        conn.streamManager->createNextBidirectionalStream().value());
+    if (openStreams.size() == kConcurrentStreams) {
+      closeStream(conn, *openStreams.front());
+      openStreams.pop_front();
+    }
+  }
+}
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(findStream, 10Streams, 10)
+BENCHMARK_NAMED_PARAM(findStream, 1000Streams, 1000)
+BENCHMARK_NAMED_PARAM(findStream, 100000Streams, 100000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(updateReadable, 10Streams, 10)
+BENCHMARK_NAMED_PARAM(updateReadable, 1000Streams, 1000)
+BENCHMARK_NAMED_PARAM(updateReadable, 100000Streams, 100000)
+
+BENCHMARK_DRAW_LINE();
+
+BENCHMARK_NAMED_PARAM(updateWritable, 10Streams, 10)
+BENCHMARK_NAMED_PARAM(updateWritable, 1000Streams, 1000)
+BENCHMARK_NAMED_PARAM(updateWritable, 100000Streams, 100000)
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
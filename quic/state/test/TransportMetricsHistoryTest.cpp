@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/state/TransportMetricsHistory.h>
+
+#include <folly/portability/GTest.h>
+
+#include <vector>
+
+using namespace testing;
+
+namespace quic {
+namespace test {
+
+namespace {
+TransportMetricsSample makeSample(uint64_t congestionWindow) {
+  TransportMetricsSample sample;
+  sample.congestionWindow = congestionWindow;
+  return sample;
+}
+
+std::vector<uint64_t> congestionWindows(
+    const TransportMetricsHistory& history) {
+  std::vector<uint64_t> windows;
+  for (const auto& sample : history.samples()) {
+    windows.push_back(sample.congestionWindow);
+  }
+  return windows;
+}
+} // namespace
+
+TEST(TransportMetricsHistoryTest, NoCapacity) {
+  TransportMetricsHistory history;
+  history.add(makeSample(1));
+  EXPECT_TRUE(history.empty());
+  EXPECT_EQ(nullptr, history.newest());
+  EXPECT_TRUE(history.samples().empty());
+}
+
+TEST(TransportMetricsHistoryTest, WrapsAround) {
+  TransportMetricsHistory history;
+  history.setCapacity(3);
+  history.add(makeSample(1));
+  history.add(makeSample(2));
+  EXPECT_EQ(std::vector<uint64_t>({1, 2}), congestionWindows(history));
+  EXPECT_EQ(2, history.newest()->congestionWindow);
+
+  for (uint64_t i = 3; i <= 7; i++) {
+    history.add(makeSample(i));
+    EXPECT_EQ(i, history.newest()->congestionWindow);
+  }
+  EXPECT_EQ(3, history.size());
+  EXPECT_EQ(std::vector<uint64_t>({5, 6, 7}), congestionWindows(history));
+}
+
+TEST(TransportMetricsHistoryTest, SetCapacity) {
+  TransportMetricsHistory history;
+  history.setCapacity(2);
+  history.add(makeSample(1));
+  // The same capacity keeps the samples.
+  history.setCapacity(2);
+  EXPECT_EQ(1, history.size());
+
+  history.setCapacity(4);
+  EXPECT_TRUE(history.empty());
+  EXPECT_EQ(4, history.capacity());
+  history.add(makeSample(2));
+  EXPECT_EQ(std::vector<uint64_t>({2}), congestionWindows(history));
+}
+
+} // namespace test
+} // namespace quic
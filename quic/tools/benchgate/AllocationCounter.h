@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace quic {
+namespace benchgate {
+
+/**
+ * Number of heap allocations the calling thread has made so far. Linking
+ * AllocationCounter.cpp into a binary replaces its allocation functions:
+ * the malloc family with glibc, which also covers operator new and the
+ * IOBuf buffers, and only operator new elsewhere.
+ */
+uint64_t getThreadAllocations();
+
+} // namespace benchgate
+} // namespace quic
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/tools/benchgate/BenchGate.h>
+
+#include <glog/logging.h>
+#include <quic/tools/benchgate/AllocationCounter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace quic {
+namespace benchgate {
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kMaxIterations = 1 << 30;
+
+std::chrono::nanoseconds timeRun(GateCase& gateCase, size_t iters) {
+  auto start = Clock::now();
+  gateCase.run(iters);
+  return Clock::now() - start;
+}
+} // namespace
+
+double GateResult::median() const {
+  if (nsPerOp.empty()) {
+    return 0;
+  }
+  auto sorted = nsPerOp;
+  std::sort(sorted.begin(), sorted.end());
+  auto mid = sorted.size() / 2;
+  return sorted.size() % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+double GateResult::mean() const {
+  if (nsPerOp.empty()) {
+    return 0;
+  }
+  return std::accumulate(nsPerOp.begin(), nsPerOp.end(), 0.0) / nsPerOp.size();
+}
+
+double GateResult::stddev() const {
+  if (nsPerOp.size() < 2) {
+    return 0;
+  }
+  auto average = mean();
+  double sumOfSquares = 0;
+  for (auto value : nsPerOp) {
+    sumOfSquares += (value - average) * (value - average);
+  }
+  return std::sqrt(sumOfSquares / (nsPerOp.size() - 1));
+}
+
+std::vector<GateResult> runGate(
+    std::vector<GateCase>& cases,
+    const GateOptions& options) {
+  std::vector<GateResult> results;
+  for (auto& gateCase : cases) {
+    GateResult result;
+    result.name = gateCase.name;
+    // The calibration doubles as the warm up.
+    size_t iters = 1;
+    while (timeRun(gateCase, iters) < options.minRunTime &&
+           iters < kMaxIterations) {
+      iters *= 2;
+    }
+    result.iterations = iters;
+
+    auto allocations = getThreadAllocations();
+    gateCase.run(iters);
+    result.allocsPerOp =
+        static_cast<double>(getThreadAllocations() - allocations) / iters;
+
+    for (size_t i = 0; i < options.repetitions; i++) {
+      auto elapsed = timeRun(gateCase, iters);
+      result.nsPerOp.push_back(static_cast<double>(elapsed.count()) / iters);
+    }
+    VLOG(1) << result.name << ": " << result.median() << "ns/op, "
+            << result.allocsPerOp << " allocs/op";
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+folly::dynamic resultsToDynamic(const std::vector<GateResult>& results) {
+  folly::dynamic cases = folly::dynamic::object;
+  for (const auto& result : results) {
+    folly::dynamic samples = folly::dynamic::array;
+    for (auto value : result.nsPerOp) {
+      samples.push_back(value);
+    }
+    cases[result.name] = folly::dynamic::object(
+        "iterations", result.iterations)("ns_per_op", std::move(samples))(
+        "median_ns", result.median())("mean_ns", result.mean())(
+        "stddev_ns", result.stddev())("allocs_per_op", result.allocsPerOp);
+  }
+  return folly::dynamic::object("cases", std::move(cases));
+}
+
+std::vector<GateResult> resultsFromDynamic(const folly::dynamic& dynamic) {
+  std::vector<GateResult> results;
+  for (const auto& item : dynamic["cases"].items()) {
+    GateResult result;
+    result.name = item.first.asString();
+    result.iterations = item.second["iterations"].asInt();
+    for (const auto& value : item.second["ns_per_op"]) {
+      result.nsPerOp.push_back(value.asDouble());
+    }
+    result.allocsPerOp = item.second["allocs_per_op"].asDouble();
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+std::vector<GateComparison> compareToBaseline(
+    const std::vector<GateResult>& results,
+    const std::vector<GateResult>& baseline,
+    const GateThresholds& thresholds) {
+  std::unordered_map<std::string, const GateResult*> baselineCases;
+  for (const auto& result : baseline) {
+    baselineCases.emplace(result.name, &result);
+  }
+  std::vector<GateComparison> comparisons;
+  for (const auto& result : results) {
+    auto it = baselineCases.find(result.name);
+    if (it == baselineCases.end()) {
+      continue;
+    }
+    const auto& base = *it->second;
+    GateComparison comparison;
+    comparison.name = result.name;
+    comparison.baselineMedian = base.median();
+    comparison.median = result.median();
+    comparison.change = comparison.baselineMedian > 0
+        ? comparison.median / comparison.baselineMedian - 1
+        : 0;
+    // Welch's t statistic of the means
+    auto variance = std::pow(result.stddev(), 2) / result.nsPerOp.size() +
+        std::pow(base.stddev(), 2) / base.nsPerOp.size();
+    auto difference = result.mean() - base.mean();
+    if (variance > 0) {
+      comparison.tStatistic = difference / std::sqrt(variance);
+    } else {
+      comparison.tStatistic = difference > 0
+          ? std::numeric_limits<double>::infinity()
+          : 0;
+    }
+    comparison.baselineAllocsPerOp = base.allocsPerOp;
+    comparison.allocsPerOp = result.allocsPerOp;
+    comparison.slower = comparison.change > thresholds.maxSlowdown &&
+        comparison.tStatistic > thresholds.minTStatistic;
+    comparison.moreAllocations = result.allocsPerOp >
+        base.allocsPerOp + thresholds.maxExtraAllocsPerOp;
+    comparisons.push_back(comparison);
+  }
+  return comparisons;
+}
+
+} // namespace benchgate
+} // namespace quic
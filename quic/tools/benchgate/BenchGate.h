@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/dynamic.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace quic {
+namespace benchgate {
+
+struct GateCase {
+  std::string name;
+  // Runs the operation iters times. The state it needs is set up before.
+  folly::Function<void(size_t iters)> run;
+};
+
+struct GateOptions {
+  // Timed runs of each case, for the statistics.
+  size_t repetitions{15};
+  // The iterations of a run are calibrated to take at least this long.
+  std::chrono::milliseconds minRunTime{50};
+};
+
+struct GateResult {
+  std::string name;
+  size_t iterations{0};
+  // Nanoseconds per operation of each run.
+  std::vector<double> nsPerOp;
+  double allocsPerOp{0};
+
+  double median() const;
+  double mean() const;
+  double stddev() const;
+};
+
+std::vector<GateResult> runGate(
+    std::vector<GateCase>& cases,
+    const GateOptions& options);
+
+folly::dynamic resultsToDynamic(const std::vector<GateResult>& results);
+
+// Throws folly::TypeError for a malformed baseline.
+std::vector<GateResult> resultsFromDynamic(const folly::dynamic& dynamic);
+
+struct GateThresholds {
+  // Relative change of the median time a regression needs to be over.
+  double maxSlowdown{0.05};
+  // Welch's t statistic it needs to be over, so that noise does not fail
+  // the gate.
+  double minTStatistic{3.0};
+  // Allocations are deterministic, so any extra one fails the gate.
+  double maxExtraAllocsPerOp{0.01};
+};
+
+struct GateComparison {
+  std::string name;
+  double baselineMedian;
+  double median;
+  // Relative change of the median
+  double change;
+  double tStatistic;
+  double baselineAllocsPerOp;
+  double allocsPerOp;
+  bool slower;
+  bool moreAllocations;
+
+  bool regressed() const {
+    return slower || moreAllocations;
+  }
+};
+
+/**
+ * Compares the cases that are in both the results and the baseline.
+ */
+std::vector<GateComparison> compareToBaseline(
+    const std::vector<GateResult>& results,
+    const std::vector<GateResult>& baseline,
+    const GateThresholds& thresholds);
+
+} // namespace benchgate
+} // namespace quic
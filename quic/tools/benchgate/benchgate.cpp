@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <glog/logging.h>
+
+#include <folly/Benchmark.h>
+#include <folly/FileUtil.h>
+#include <folly/init/Init.h>
+#include <folly/json.h>
+#include <folly/portability/GFlags.h>
+
+#include <quic/codec/Decode.h>
+#include <quic/codec/PacketNumberCipher.h>
+#include <quic/codec/QuicPacketBuilder.h>
+#include <quic/codec/QuicWriteCodec.h>
+#include <quic/congestion_control/QuicCubic.h>
+#include <quic/tools/benchgate/BenchGate.h>
+
+#include <algorithm>
+#include <iostream>
+
+DEFINE_string(output, "", "File to write the JSON results to, or stdout");
+DEFINE_string(baseline, "", "JSON results of a previous run to compare to");
+DEFINE_string(filter, "", "Only run the cases with this in their name");
+DEFINE_uint64(repetitions, 15, "Timed runs of each case");
+DEFINE_uint64(min_run_ms, 50, "Minimum time of each run");
+DEFINE_double(max_slowdown, 0.05, "Relative slowdown that fails the gate");
+DEFINE_double(min_t, 3.0, "Welch's t a slowdown needs to fail the gate");
+DEFINE_double(
+    max_extra_allocs,
+    0.01,
+    "Extra allocations per operation that fail the gate");
+
+using namespace quic;
+using namespace quic::benchgate;
+
+namespace {
+
+constexpr StreamId kStreamId = 4;
+constexpr PacketNum kPacketNum = 1000;
+constexpr size_t kStreamDataLen = 1000;
+
+PacketHeader makeHeader() {
+  return ShortHeader(
+      ProtectionType::KeyPhaseZero,
+      ConnectionId(std::vector<uint8_t>(kDefaultConnectionIdSize, 0x11)),
+      kPacketNum);
+}
+
+RegularQuicPacketBuilder makeBuilder() {
+  RegularQuicPacketBuilder builder(
+      kDefaultUDPSendPacketLen, makeHeader(), 0, QuicVersion::MVFST);
+  builder.setCipherOverhead(kCipherOverheadHeuristic);
+  return builder;
+}
+
+void writeAck(PacketBuilderInterface& builder, size_t numBlocks) {
+  IntervalSet<PacketNum> acks;
+  for (size_t i = 0; i < numBlocks; i++) {
+    acks.insert(kPacketNum + i * 12, kPacketNum + i * 12 + 9);
+  }
+  AckFrameMetaData meta(
+      acks, std::chrono::microseconds(100), kDefaultAckDelayExponent);
+  CHECK(writeAckFrame(meta, builder));
+}
+
+// A data packet as the server sends them: an ack and a full stream frame.
+void writeDataPacket(
+    PacketBuilderInterface& builder,
+    const folly::IOBuf& data) {
+  writeAck(builder, 4);
+  writeFrame(MaxDataFrame(1000000), builder);
+  auto dataLen = writeStreamFrameHeader(
+      builder,
+      kStreamId,
+      10000,
+      data.computeChainDataLength(),
+      data.computeChainDataLength(),
+      false);
+  CHECK(dataLen);
+  writeStreamFrameData(builder, data.clone(), *dataLen);
+}
+
+Buf makeData() {
+  return folly::IOBuf::copyBuffer(std::string(kStreamDataLen, 'a'));
+}
+
+Buf buildBody(folly::Function<void(PacketBuilderInterface&)> writer) {
+  auto builder = makeBuilder();
+  writer(builder);
+  auto body = std::move(builder).buildPacket().body;
+  body->coalesce();
+  return body;
+}
+
+GateCase parseFramesCase(
+    std::string name,
+    folly::Function<void(PacketBuilderInterface&)> writer) {
+  auto body = std::shared_ptr<folly::IOBuf>(buildBody(std::move(writer)));
+  return {std::move(name), [body](size_t iters) {
+            PacketHeader header = makeHeader();
+            CodecParameters params(
+                kDefaultAckDelayExponent, QuicVersion::MVFST);
+            for (size_t i = 0; i < iters; i++) {
+              folly::io::Cursor cursor(body.get());
+              auto frame = parseFrame(cursor, header, params);
+              folly::doNotOptimizeAway(frame);
+            }
+          }};
+}
+
+std::vector<GateCase> makeCases() {
+  std::vector<GateCase> cases;
+  cases.push_back(
+      parseFramesCase("ParseAck", [](auto& builder) { writeAck(builder, 1); }));
+  cases.push_back(parseFramesCase(
+      "ParseAck32Blocks", [](auto& builder) { writeAck(builder, 32); }));
+  cases.push_back(parseFramesCase("ParseStreamFrame", [](auto& builder) {
+    auto data = makeData();
+    auto dataLen = writeStreamFrameHeader(
+        builder, kStreamId, 0, kStreamDataLen, kStreamDataLen, false);
+    writeStreamFrameData(builder, std::move(data), *dataLen);
+  }));
+
+  auto data = std::shared_ptr<folly::IOBuf>(makeData());
+  auto packet = std::shared_ptr<folly::IOBuf>(
+      buildBody([&](auto& builder) { writeDataPacket(builder, *data); }));
+  cases.push_back({"DecodeDataPacket", [packet](size_t iters) {
+                     PacketHeader header = makeHeader();
+                     CodecParameters params(
+                         kDefaultAckDelayExponent, QuicVersion::MVFST);
+                     for (size_t i = 0; i < iters; i++) {
+                       folly::io::Cursor cursor(packet.get());
+                       auto decoded = decodeRegularPacket(
+                           PacketHeader(header), params, cursor);
+                       folly::doNotOptimizeAway(decoded);
+                     }
+                   }});
+  cases.push_back({"BuildDataPacket", [data](size_t iters) {
+                     for (size_t i = 0; i < iters; i++) {
+                       auto builder = makeBuilder();
+                       writeDataPacket(builder, *data);
+                       auto built = std::move(builder).buildPacket();
+                       folly::doNotOptimizeAway(built);
+                     }
+                   }});
+
+  auto cipher = std::shared_ptr<PacketNumberCipher>(
+      std::make_unique<Aes128PacketNumberCipher>());
+  std::vector<uint8_t> key(cipher->keyLength(), 0x22);
+  cipher->setKey(folly::range(key));
+  cases.push_back({"EncryptShortHeader", [cipher](size_t iters) {
+                     Sample sample{};
+                     uint8_t initialByte = 0x43;
+                     std::array<uint8_t, kMaxPacketNumEncodingSize> pn{};
+                     for (size_t i = 0; i < iters; i++) {
+                       sample[0] = static_cast<uint8_t>(i);
+                       cipher->encryptShortHeader(
+                           folly::range(sample),
+                           folly::MutableByteRange(&initialByte, 1),
+                           folly::range(pn));
+                       folly::doNotOptimizeAway(initialByte);
+                     }
+                   }});
+
+  // Sending and acking a packet, as the transport calls the controller.
+  cases.push_back({"CubicSendAndAck", [](size_t iters) {
+                     QuicConnectionStateBase conn(QuicNodeType::Server);
+                     conn.udpSendPacketLen = kDefaultUDPSendPacketLen;
+                     Cubic cubic(conn);
+                     auto sentTime = Clock::now();
+                     for (size_t i = 0; i < iters; i++) {
+                       OutstandingPacket sent(
+                           RegularQuicWritePacket(makeHeader()),
+                           sentTime,
+                           kDefaultUDPSendPacketLen,
+                           false,
+                           false,
+                           (i + 1) * kDefaultUDPSendPacketLen);
+                       cubic.onPacketSent(sent);
+                       CongestionController::AckEvent ack;
+                       ack.ackTime = sentTime + std::chrono::milliseconds(10);
+                       ack.largestAckedPacket = i;
+                       ack.ackedBytes = kDefaultUDPSendPacketLen;
+                       ack.ackedPackets.emplace_back(sent);
+                       cubic.onPacketAckOrLoss(std::move(ack), folly::none);
+                     }
+                   }});
+  return cases;
+}
+
+void writeOutput(const std::string& json) {
+  if (FLAGS_output.empty()) {
+    std::cout << json << std::endl;
+  } else if (!folly::writeFile(json, FLAGS_output.c_str())) {
+    LOG(FATAL) << "Failed to write " << FLAGS_output;
+  }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+#if FOLLY_HAVE_LIBGFLAGS
+  // Enable glog logging to stderr by default.
+  gflags::SetCommandLineOptionWithMode(
+      "logtostderr", "1", gflags::SET_FLAGS_DEFAULT);
+#endif
+  gflags::ParseCommandLineFlags(&argc, &argv, false);
+  folly::Init init(&argc, &argv);
+
+  auto cases = makeCases();
+  cases.erase(
+      std::remove_if(
+          cases.begin(),
+          cases.end(),
+          [](const GateCase& gateCase) {
+            return gateCase.name.find(FLAGS_filter) == std::string::npos;
+          }),
+      cases.end());
+  GateOptions options;
+  options.repetitions = std::max<uint64_t>(FLAGS_repetitions, 2);
+  options.minRunTime = std::chrono::milliseconds(FLAGS_min_run_ms);
+  auto results = runGate(cases, options);
+  writeOutput(folly::toPrettyJson(resultsToDynamic(results)));
+
+  if (FLAGS_baseline.empty()) {
+    return 0;
+  }
+  std::string baselineJson;
+  if (!folly::readFile(FLAGS_baseline.c_str(), baselineJson)) {
+    LOG(FATAL) << "Failed to read " << FLAGS_baseline;
+  }
+  GateThresholds thresholds;
+  thresholds.maxSlowdown = FLAGS_max_slowdown;
+  thresholds.minTStatistic = FLAGS_min_t;
+  thresholds.maxExtraAllocsPerOp = FLAGS_max_extra_allocs;
+  auto comparisons = compareToBaseline(
+      results,
+      resultsFromDynamic(folly::parseJson(baselineJson)),
+      thresholds);
+  bool regressed = false;
+  for (const auto& comparison : comparisons) {
+    LOG(INFO) << (comparison.regressed() ? "REGRESSED " : "ok ")
+              << comparison.name << ": " << comparison.baselineMedian
+              << "ns -> " << comparison.median << "ns ("
+              << comparison.change * 100 << "%, t=" << comparison.tStatistic
+              << "), allocs/op " << comparison.baselineAllocsPerOp << " -> "
+              << comparison.allocsPerOp;
+    regressed |= comparison.regressed();
+  }
+  return regressed ? 1 : 0;
+}
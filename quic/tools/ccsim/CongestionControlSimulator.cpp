@@ -0,0 +1,457 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/tools/ccsim/CongestionControlSimulator.h>
+
+#include <folly/Conv.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/congestion_control/Pacer.h>
+#include <quic/logging/QLoggerConstants.h>
+#include <quic/loss/QuicLossFunctions.h>
+#include <quic/state/QuicStateFunctions.h>
+
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+namespace quic {
+namespace ccsim {
+
+namespace {
+std::chrono::microseconds micros(TimePoint::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration);
+}
+} // namespace
+
+BottleneckLink::BottleneckLink(const BottleneckLinkConfig& config)
+    : config_(config), random_(config.seed) {}
+
+folly::Optional<std::chrono::microseconds> BottleneckLink::send(
+    std::chrono::microseconds sentTime,
+    uint32_t size) {
+  if (config_.lossRate > 0 && uniform_(random_) < config_.lossRate) {
+    return folly::none;
+  }
+  if (config_.rateBytesPerSec == 0) {
+    return sentTime + config_.rtt / 2;
+  }
+  while (!queue_.empty() && queue_.front().first <= sentTime) {
+    queuedBytes_ -= queue_.front().second;
+    queue_.pop_front();
+  }
+  if (queuedBytes_ + size > config_.queueBytes) {
+    return folly::none;
+  }
+  auto departure = std::max(sentTime, lastDeparture_) +
+      std::chrono::microseconds(size * 1000 * 1000 / config_.rateBytesPerSec);
+  lastDeparture_ = departure;
+  queue_.emplace_back(departure, size);
+  queuedBytes_ += size;
+  return departure + config_.rtt / 2;
+}
+
+std::chrono::microseconds BottleneckLink::getAckDelay() const {
+  return config_.rtt / 2;
+}
+
+QLogTrace QLogTrace::fromQLog(const folly::dynamic& qlog) {
+  QLogTrace trace;
+  std::unordered_map<uint64_t, size_t> packetIndices;
+  const auto& traces = qlog["traces"];
+  if (!traces.isArray() || traces.empty()) {
+    throw std::runtime_error("qlog has no trace");
+  }
+  size_t numAcked = 0;
+  for (const auto& event : traces[0]["events"]) {
+    // relative_time, category, event_type, trigger, data
+    std::chrono::microseconds time(folly::to<int64_t>(event[0].asString()));
+    const auto& type = event[2].asString();
+    const auto& data = event[4];
+    if (!data.isObject() ||
+        data.getDefault("packet_type", "").asString() !=
+        kShortHeaderPacketType) {
+      continue;
+    }
+    if (type == "PACKET_SENT") {
+      const auto& header = data["header"];
+      packetIndices.emplace(
+          header["packet_number"].asInt(), trace.packets.size());
+      trace.packets.push_back(
+          {time, folly::to<uint32_t>(header["packet_size"].asInt()),
+           folly::none});
+    } else if (type == "PACKET_RECEIVED") {
+      for (const auto& frame : data["frames"]) {
+        if (frame["frame_type"].asString() != "ACK") {
+          continue;
+        }
+        for (const auto& range : frame["acked_ranges"]) {
+          for (auto packetNum = range[0].asInt();
+               packetNum <= range[1].asInt();
+               packetNum++) {
+            auto it = packetIndices.find(packetNum);
+            if (it == packetIndices.end()) {
+              continue;
+            }
+            auto& packet = trace.packets[it->second];
+            if (!packet.ackTime) {
+              packet.ackTime = time;
+              numAcked++;
+            }
+          }
+        }
+      }
+    }
+  }
+  if (numAcked == 0) {
+    throw std::runtime_error("qlog has no acked 1-rtt packet");
+  }
+  return trace;
+}
+
+TraceLink::TraceLink(const QLogTrace& trace)
+    : minRtt_(std::chrono::microseconds::max()) {
+  for (const auto& packet : trace.packets) {
+    lost_.push_back(!packet.ackTime);
+    if (packet.ackTime) {
+      minRtt_ = std::min(minRtt_, *packet.ackTime - packet.sentTime);
+    }
+  }
+  CHECK(minRtt_ != std::chrono::microseconds::max());
+  for (const auto& packet : trace.packets) {
+    if (packet.ackTime) {
+      opportunities_.emplace_back(*packet.ackTime - minRtt_, packet.size);
+    }
+  }
+  std::sort(opportunities_.begin(), opportunities_.end());
+  period_ = opportunities_.back().first + minRtt_;
+  opportunityLeft_ = opportunities_.front().second;
+}
+
+folly::Optional<std::chrono::microseconds> TraceLink::send(
+    std::chrono::microseconds sentTime,
+    uint32_t size) {
+  if (lost_[nextPacket_++ % lost_.size()]) {
+    return folly::none;
+  }
+  auto next = [&] {
+    if (++nextOpportunity_ == opportunities_.size()) {
+      nextOpportunity_ = 0;
+      offset_ += period_;
+    }
+    opportunityLeft_ = opportunities_[nextOpportunity_].second;
+  };
+  while (true) {
+    auto time = opportunities_[nextOpportunity_].first + offset_;
+    if (time < sentTime) {
+      // Nothing was queued to use it.
+      next();
+      continue;
+    }
+    auto used = std::min(opportunityLeft_, size);
+    opportunityLeft_ -= used;
+    size -= used;
+    if (opportunityLeft_ == 0) {
+      next();
+    }
+    if (size == 0) {
+      return time + minRtt_ / 2;
+    }
+  }
+}
+
+std::chrono::microseconds TraceLink::getAckDelay() const {
+  return minRtt_ / 2;
+}
+
+/**
+ * DefaultPacer that remembers the pacing rate the controller last set.
+ */
+class CongestionControlSimulator::RecordingPacer : public Pacer {
+ public:
+  RecordingPacer(const QuicConnectionStateBase& conn, uint64_t minCwndInMss)
+      : pacer_(conn, minCwndInMss) {}
+
+  void refreshPacingRate(uint64_t cwndBytes, std::chrono::microseconds rtt)
+      override {
+    pacingRate_ = rtt.count() > 0 ? cwndBytes * 1000 * 1000 / rtt.count() : 0;
+    pacer_.refreshPacingRate(cwndBytes, rtt);
+  }
+
+  void onPacedWriteScheduled(TimePoint currentTime) override {
+    pacer_.onPacedWriteScheduled(currentTime);
+  }
+
+  std::chrono::microseconds getTimeUntilNextWrite() const override {
+    return pacer_.getTimeUntilNextWrite();
+  }
+
+  uint64_t updateAndGetWriteBatchSize(TimePoint currentTime) override {
+    return pacer_.updateAndGetWriteBatchSize(currentTime);
+  }
+
+  uint64_t getCachedWriteBatchSize() const override {
+    return pacer_.getCachedWriteBatchSize();
+  }
+
+  void setAppLimited(bool limited) override {
+    pacer_.setAppLimited(limited);
+  }
+
+  folly::Optional<TimePoint> getPacketTxTime(TimePoint currentTime) override {
+    return pacer_.getPacketTxTime(currentTime);
+  }
+
+  uint64_t getPacingRate() const {
+    return pacingRate_;
+  }
+
+ private:
+  DefaultPacer pacer_;
+  uint64_t pacingRate_{0};
+};
+
+CongestionControlSimulator::CongestionControlSimulator(
+    const SimulatorConfig& config,
+    std::unique_ptr<LinkModel> link)
+    : config_(config),
+      link_(std::move(link)),
+      conn_(QuicNodeType::Server) {
+  conn_.udpSendPacketLen = config_.packetSize;
+  conn_.transportSettings.defaultCongestionController = config_.type;
+  conn_.transportSettings.pacingEnabled = config_.pacingEnabled;
+  if (config_.pacingEnabled) {
+    // Same as the transport
+    auto minCwndInMss = config_.type == CongestionControlType::BBR ||
+            config_.type == CongestionControlType::BBR2
+        ? kMinCwndInMssForBbr
+        : conn_.transportSettings.minCwndInMss;
+    auto pacer = std::make_unique<RecordingPacer>(conn_, minCwndInMss);
+    pacer_ = pacer.get();
+    conn_.pacer = std::move(pacer);
+  }
+  conn_.congestionController =
+      DefaultCongestionControllerFactory().makeCongestionController(
+          conn_, config_.type);
+  if (!conn_.congestionController) {
+    throw std::invalid_argument("No congestion controller to simulate");
+  }
+}
+
+CongestionControlSimulator::~CongestionControlSimulator() = default;
+
+std::vector<SimulatorSample> CongestionControlSimulator::run() {
+  start_ = Clock::now();
+  auto end = start_ + config_.duration;
+  schedule(start_ + config_.sampleInterval, EventType::Sample);
+  trySend(start_);
+  while (!events_.empty() && events_.begin()->first <= end) {
+    auto time = events_.begin()->first;
+    auto event = events_.begin()->second;
+    events_.erase(events_.begin());
+    std::this_thread::sleep_until(time);
+    switch (event.type) {
+      case EventType::Ack:
+        onAck(time, event.packetNum);
+        break;
+      case EventType::Send:
+        sendScheduled_ = false;
+        trySend(time);
+        break;
+      case EventType::LossTimer:
+        onLossTimer(time);
+        break;
+      case EventType::Sample:
+        sample(time);
+        break;
+    }
+  }
+  return std::move(samples_);
+}
+
+void CongestionControlSimulator::schedule(
+    TimePoint time,
+    EventType type,
+    PacketNum packetNum) {
+  events_.emplace(time, Event{type, packetNum});
+}
+
+void CongestionControlSimulator::trySend(TimePoint now) {
+  auto& congestionController = *conn_.congestionController;
+  if (!pacer_) {
+    while (congestionController.getWritableBytes() > 0) {
+      sendPacket(now);
+    }
+    return;
+  }
+  if (sendScheduled_ || congestionController.getWritableBytes() == 0) {
+    return;
+  }
+  auto batchSize = pacer_->updateAndGetWriteBatchSize(now);
+  for (uint64_t i = 0;
+       i < batchSize && congestionController.getWritableBytes() > 0;
+       i++) {
+    sendPacket(now);
+  }
+  if (congestionController.getWritableBytes() > 0) {
+    auto interval = pacer_->getTimeUntilNextWrite();
+    pacer_->onPacedWriteScheduled(now);
+    schedule(now + interval, EventType::Send);
+    sendScheduled_ = true;
+  }
+}
+
+void CongestionControlSimulator::sendPacket(TimePoint now) {
+  auto packetNum = nextPacketNum_++;
+  RegularQuicWritePacket packet(ShortHeader(
+      ProtectionType::KeyPhaseZero,
+      ConnectionId(std::vector<uint8_t>(kDefaultConnectionIdSize)),
+      packetNum));
+  OutstandingPacket pkt(
+      std::move(packet),
+      now,
+      config_.packetSize,
+      false,
+      false,
+      conn_.lossState.totalBytesSent + config_.packetSize);
+  pkt.isAppLimited = conn_.congestionController->isAppLimited();
+  if (conn_.lossState.lastAckedTime.hasValue() &&
+      conn_.lossState.lastAckedPacketSentTime.hasValue()) {
+    pkt.lastAckedPacketInfo.emplace(
+        *conn_.lossState.lastAckedPacketSentTime,
+        *conn_.lossState.lastAckedTime,
+        conn_.lossState.totalBytesSentAtLastAck,
+        conn_.lossState.totalBytesAckedAtLastAck);
+  }
+  conn_.lossState.largestSent = packetNum;
+  conn_.congestionController->onPacketSent(pkt);
+  conn_.lossState.totalBytesSent += config_.packetSize;
+  inflightBytes_ += config_.packetSize;
+
+  auto arrival = link_->send(micros(now - start_), config_.packetSize);
+  if (arrival) {
+    schedule(
+        start_ + *arrival + link_->getAckDelay(), EventType::Ack, packetNum);
+  }
+  outstanding_.emplace(packetNum, std::move(pkt));
+  scheduleLossTimer(now);
+}
+
+void CongestionControlSimulator::onAck(TimePoint now, PacketNum packetNum) {
+  auto it = outstanding_.find(packetNum);
+  if (it == outstanding_.end()) {
+    // Already declared lost
+    return;
+  }
+  const auto& packet = it->second;
+  auto rttSample = micros(now - packet.time);
+  updateRtt(conn_, rttSample, 0us);
+
+  CongestionController::AckEvent ack;
+  ack.ackTime = now;
+  ack.largestAckedPacket = packetNum;
+  ack.ackedBytes = packet.encodedSize;
+  ack.mrttSample = rttSample;
+  ack.ackedPackets.emplace_back(packet);
+  conn_.lossState.totalBytesAcked += packet.encodedSize;
+  conn_.lossState.totalBytesSentAtLastAck = conn_.lossState.totalBytesSent;
+  conn_.lossState.totalBytesAckedAtLastAck = conn_.lossState.totalBytesAcked;
+  conn_.lossState.lastAckedPacketSentTime = packet.time;
+  conn_.lossState.lastAckedTime = now;
+  inflightBytes_ -= packet.encodedSize;
+  ackedBytes_ += packet.encodedSize;
+  outstanding_.erase(it);
+  largestAcked_ = std::max(packetNum, largestAcked_.value_or(packetNum));
+
+  // Packet and time threshold loss detection, as in detectLossPackets.
+  auto delayUntilLost =
+      std::max(conn_.lossState.srtt, conn_.lossState.lrtt) *
+      (8 + conn_.lossState.reorderingWindowMult) / 8;
+  CongestionController::LossEvent loss(now);
+  for (auto lostIt = outstanding_.begin();
+       lostIt != outstanding_.end() && lostIt->first < *largestAcked_;) {
+    if (*largestAcked_ - lostIt->first >= kReorderingThreshold ||
+        now - lostIt->second.time > delayUntilLost) {
+      declareLost(loss, lostIt->second);
+      lostIt = outstanding_.erase(lostIt);
+    } else {
+      ++lostIt;
+    }
+  }
+  conn_.congestionController->onPacketAckOrLoss(
+      std::move(ack),
+      loss.lostPackets > 0 ? folly::make_optional(std::move(loss))
+                           : folly::none);
+  scheduleLossTimer(now);
+  trySend(now);
+}
+
+std::chrono::microseconds CongestionControlSimulator::getLossTimeout() const {
+  return conn_.lossState.srtt == 0us ? 2 * kDefaultInitialRtt
+                                     : calculatePTO(conn_);
+}
+
+void CongestionControlSimulator::scheduleLossTimer(TimePoint now) {
+  if (outstanding_.empty()) {
+    return;
+  }
+  auto deadline = std::max(
+      now, outstanding_.begin()->second.time + getLossTimeout());
+  if (!lossTimer_ || deadline < *lossTimer_) {
+    lossTimer_ = deadline;
+    schedule(deadline, EventType::LossTimer);
+  }
+}
+
+void CongestionControlSimulator::onLossTimer(TimePoint now) {
+  if (!lossTimer_ || now < *lossTimer_) {
+    // Replaced by an earlier timer
+    return;
+  }
+  lossTimer_.clear();
+  auto timeout = getLossTimeout();
+  CongestionController::LossEvent loss(now);
+  for (auto it = outstanding_.begin();
+       it != outstanding_.end() && now - it->second.time >= timeout;) {
+    declareLost(loss, it->second);
+    it = outstanding_.erase(it);
+  }
+  if (loss.lostPackets > 0) {
+    conn_.congestionController->onPacketAckOrLoss(folly::none, std::move(loss));
+  }
+  scheduleLossTimer(now);
+  trySend(now);
+}
+
+void CongestionControlSimulator::declareLost(
+    CongestionController::LossEvent& loss,
+    const OutstandingPacket& packet) {
+  loss.addLostPacket(packet);
+  inflightBytes_ -= packet.encodedSize;
+  lostPackets_++;
+}
+
+void CongestionControlSimulator::sample(TimePoint now) {
+  const auto& lossState = conn_.lossState;
+  samples_.push_back(
+      {micros(now - start_),
+       conn_.congestionController->getCongestionWindow(),
+       inflightBytes_,
+       pacer_ ? pacer_->getPacingRate() : 0,
+       lossState.srtt,
+       lossState.lrtt,
+       lossState.mrtt == std::chrono::microseconds::max() ? 0us
+                                                          : lossState.mrtt,
+       ackedBytes_,
+       lostPackets_});
+  ackedBytes_ = 0;
+  lostPackets_ = 0;
+  schedule(now + config_.sampleInterval, EventType::Sample);
+}
+
+} // namespace ccsim
+} // namespace quic
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Optional.h>
+#include <folly/dynamic.h>
+#include <quic/QuicConstants.h>
+#include <quic/state/StateData.h>
+
+#include <deque>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace quic {
+namespace ccsim {
+
+/**
+ * The path between the simulated sender and receiver. The times are
+ * relative to the start of the simulation.
+ */
+class LinkModel {
+ public:
+  virtual ~LinkModel() = default;
+
+  /**
+   * Time the packet sent at sentTime reaches the receiver, or none if the
+   * link drops it.
+   */
+  virtual folly::Optional<std::chrono::microseconds> send(
+      std::chrono::microseconds sentTime,
+      uint32_t size) = 0;
+
+  /**
+   * Time the ack of a packet takes back to the sender.
+   */
+  virtual std::chrono::microseconds getAckDelay() const = 0;
+};
+
+struct BottleneckLinkConfig {
+  uint64_t rateBytesPerSec{100 * 1000 * 1000 / 8};
+  std::chrono::microseconds rtt{40000};
+  // Drop tail limit of the queue in front of the bottleneck.
+  uint64_t queueBytes{500 * 1000};
+  double lossRate{0};
+  uint64_t seed{0};
+};
+
+/**
+ * A drop tail queue drained at a constant rate, with half of the rtt of
+ * propagation delay each way, and random loss on top.
+ */
+class BottleneckLink : public LinkModel {
+ public:
+  explicit BottleneckLink(const BottleneckLinkConfig& config);
+
+  folly::Optional<std::chrono::microseconds> send(
+      std::chrono::microseconds sentTime,
+      uint32_t size) override;
+
+  std::chrono::microseconds getAckDelay() const override;
+
+ private:
+  BottleneckLinkConfig config_;
+  std::mt19937_64 random_;
+  std::uniform_real_distribution<double> uniform_{0, 1};
+  // Departure times and sizes of the packets in the queue.
+  std::deque<std::pair<std::chrono::microseconds, uint32_t>> queue_;
+  uint64_t queuedBytes_{0};
+  std::chrono::microseconds lastDeparture_{0};
+};
+
+/**
+ * The packets a connection sent, read from a qlog of the sender.
+ */
+struct QLogTrace {
+  struct Packet {
+    std::chrono::microseconds sentTime;
+    uint32_t size;
+    // None for the packets that were never acked.
+    folly::Optional<std::chrono::microseconds> ackTime;
+  };
+
+  // The 1-rtt packets of the trace, in sent order.
+  std::vector<Packet> packets;
+
+  /**
+   * Reads the PACKET_SENT events and the acks of the PACKET_RECEIVED events
+   * of the first trace. Throws std::runtime_error if the qlog has no acked
+   * 1-rtt packet.
+   */
+  static QLogTrace fromQLog(const folly::dynamic& qlog);
+};
+
+/**
+ * Replays the path a trace went through. The trace's acks mark when the
+ * bottleneck delivered how many bytes, like the delivery opportunities of a
+ * cellular trace: the capacity of the link follows them, and is lost when
+ * nothing is queued. The packets see the min rtt of the trace as propagation
+ * delay. The nth packet sent is dropped if the nth packet of the trace was
+ * lost. The trace repeats when the simulation outlasts it.
+ *
+ * The opportunities are only as many as the traced connection used, so a
+ * controller faster than the traced one cannot go over its throughput.
+ */
+class TraceLink : public LinkModel {
+ public:
+  explicit TraceLink(const QLogTrace& trace);
+
+  folly::Optional<std::chrono::microseconds> send(
+      std::chrono::microseconds sentTime,
+      uint32_t size) override;
+
+  std::chrono::microseconds getAckDelay() const override;
+
+ private:
+  // Times the bottleneck delivered some bytes, and how many.
+  std::vector<std::pair<std::chrono::microseconds, uint32_t>> opportunities_;
+  std::vector<bool> lost_;
+  std::chrono::microseconds minRtt_;
+  std::chrono::microseconds period_;
+  size_t nextOpportunity_{0};
+  uint32_t opportunityLeft_{0};
+  // Added to the times of the opportunities for each repetition.
+  std::chrono::microseconds offset_{0};
+  size_t nextPacket_{0};
+};
+
+struct SimulatorConfig {
+  CongestionControlType type{CongestionControlType::Cubic};
+  std::chrono::microseconds duration{10 * 1000 * 1000};
+  std::chrono::microseconds sampleInterval{10000};
+  uint16_t packetSize{kDefaultUDPSendPacketLen};
+  bool pacingEnabled{false};
+};
+
+// The state of the sender at the end of each sample interval.
+struct SimulatorSample {
+  std::chrono::microseconds time;
+  uint64_t cwndBytes;
+  uint64_t inflightBytes;
+  // Bytes per second, 0 without pacing.
+  uint64_t pacingRate;
+  std::chrono::microseconds srtt;
+  std::chrono::microseconds lrtt;
+  std::chrono::microseconds mrtt;
+  // Acked and lost during the interval.
+  uint64_t ackedBytes;
+  uint64_t lostPackets;
+};
+
+/**
+ * Drives a congestion controller with a bulk sender over a LinkModel. The
+ * receiver acks every packet as it arrives; the sender detects losses with
+ * the packet and time thresholds of the transport, and declares a PTO worth
+ * of unacked packets lost in place of sending probes.
+ *
+ * The events run on the wall clock, since some controllers stamp their
+ * recovery periods and round trips with Clock::now(): simulating ten
+ * seconds takes ten seconds.
+ */
+class CongestionControlSimulator {
+ public:
+  CongestionControlSimulator(
+      const SimulatorConfig& config,
+      std::unique_ptr<LinkModel> link);
+
+  ~CongestionControlSimulator();
+
+  std::vector<SimulatorSample> run();
+
+ private:
+  class RecordingPacer;
+
+  enum class EventType : uint8_t { Ack, Send, LossTimer, Sample };
+
+  struct Event {
+    EventType type;
+    PacketNum packetNum;
+  };
+
+  void schedule(TimePoint time, EventType type, PacketNum packetNum = 0);
+
+  void trySend(TimePoint now);
+
+  void sendPacket(TimePoint now);
+
+  void onAck(TimePoint now, PacketNum packetNum);
+
+  void onLossTimer(TimePoint now);
+
+  void declareLost(
+      CongestionController::LossEvent& loss,
+      const OutstandingPacket& packet);
+
+  // The PTO, after which unacked packets are declared lost.
+  std::chrono::microseconds getLossTimeout() const;
+
+  void scheduleLossTimer(TimePoint now);
+
+  void sample(TimePoint now);
+
+  SimulatorConfig config_;
+  std::unique_ptr<LinkModel> link_;
+  QuicConnectionStateBase conn_;
+  // Set when pacing is enabled, owned by conn_.
+  RecordingPacer* pacer_{nullptr};
+  std::multimap<TimePoint, Event> events_;
+  std::map<PacketNum, OutstandingPacket> outstanding_;
+  TimePoint start_;
+  PacketNum nextPacketNum_{0};
+  folly::Optional<PacketNum> largestAcked_;
+  uint64_t inflightBytes_{0};
+  bool sendScheduled_{false};
+  folly::Optional<TimePoint> lossTimer_;
+  uint64_t ackedBytes_{0};
+  uint64_t lostPackets_{0};
+  std::vector<SimulatorSample> samples_;
+};
+
+} // namespace ccsim
+} // namespace quic
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <glog/logging.h>
+
+#include <folly/FileUtil.h>
+#include <folly/init/Init.h>
+#include <folly/json.h>
+#include <folly/portability/GFlags.h>
+
+#include <quic/tools/ccsim/CongestionControlSimulator.h>
+
+#include <fstream>
+#include <iostream>
+
+DEFINE_string(congestion, "cubic", "newreno/cubic/bbr/bbr2/prague/copa");
+DEFINE_bool(pacing, false, "Pace the sender");
+DEFINE_uint64(duration_ms, 10000, "Simulated time");
+DEFINE_uint64(sample_interval_ms, 10, "Interval of the output samples");
+DEFINE_uint32(packet_size, quic::kDefaultUDPSendPacketLen, "Packet size");
+DEFINE_string(
+    trace,
+    "",
+    "qlog of a sender to replay the path of, instead of the bottleneck link");
+DEFINE_uint64(rate_mbps, 100, "Bottleneck rate, 0 for none");
+DEFINE_uint64(rtt_ms, 40, "Round trip propagation delay");
+DEFINE_uint64(queue_bytes, 500 * 1000, "Drop tail queue of the bottleneck");
+DEFINE_double(loss, 0, "Random loss rate of the bottleneck link");
+DEFINE_uint64(seed, 0, "Seed of the random loss");
+DEFINE_string(output, "", "CSV file to write the samples to, or stdout");
+
+using namespace quic;
+using namespace quic::ccsim;
+
+CongestionControlType flagsToCongestionControlType(
+    const std::string& congestionControlType) {
+  if (congestionControlType == "cubic") {
+    return CongestionControlType::Cubic;
+  } else if (congestionControlType == "newreno") {
+    return CongestionControlType::NewReno;
+  } else if (congestionControlType == "bbr") {
+    return CongestionControlType::BBR;
+  } else if (congestionControlType == "bbr2") {
+    return CongestionControlType::BBR2;
+  } else if (congestionControlType == "prague") {
+    return CongestionControlType::Prague;
+  } else if (congestionControlType == "copa") {
+    return CongestionControlType::Copa;
+  }
+  throw std::invalid_argument(folly::to<std::string>(
+      "Unknown congestion controller ", congestionControlType));
+}
+
+std::unique_ptr<LinkModel> flagsToLinkModel() {
+  if (!FLAGS_trace.empty()) {
+    std::string qlog;
+    if (!folly::readFile(FLAGS_trace.c_str(), qlog)) {
+      throw std::runtime_error("Failed to read " + FLAGS_trace);
+    }
+    auto trace = QLogTrace::fromQLog(folly::parseJson(qlog));
+    LOG(INFO) << "Replaying " << trace.packets.size() << " packets of "
+              << FLAGS_trace;
+    return std::make_unique<TraceLink>(trace);
+  }
+  BottleneckLinkConfig config;
+  config.rateBytesPerSec = FLAGS_rate_mbps * 1000 * 1000 / 8;
+  config.rtt = std::chrono::milliseconds(FLAGS_rtt_ms);
+  config.queueBytes = FLAGS_queue_bytes;
+  config.lossRate = FLAGS_loss;
+  config.seed = FLAGS_seed;
+  return std::make_unique<BottleneckLink>(config);
+}
+
+void writeSamples(
+    std::ostream& out,
+    const std::vector<SimulatorSample>& samples,
+    std::chrono::microseconds interval) {
+  out << "time_us,cwnd_bytes,inflight_bytes,pacing_rate_bps,srtt_us,lrtt_us,"
+      << "mrtt_us,throughput_bps,lost_packets\n";
+  for (const auto& sample : samples) {
+    out << sample.time.count() << ',' << sample.cwndBytes << ','
+        << sample.inflightBytes << ',' << sample.pacingRate * 8 << ','
+        << sample.srtt.count() << ',' << sample.lrtt.count() << ','
+        << sample.mrtt.count() << ','
+        << sample.ackedBytes * 8 * 1000 * 1000 / interval.count() << ','
+        << sample.lostPackets << '\n';
+  }
+}
+
+int main(int argc, char* argv[]) {
+#if FOLLY_HAVE_LIBGFLAGS
+  // Enable glog logging to stderr by default.
+  gflags::SetCommandLineOptionWithMode(
+      "logtostderr", "1", gflags::SET_FLAGS_DEFAULT);
+#endif
+  gflags::ParseCommandLineFlags(&argc, &argv, false);
+  folly::Init init(&argc, &argv);
+
+  SimulatorConfig config;
+  config.type = flagsToCongestionControlType(FLAGS_congestion);
+  config.duration = std::chrono::milliseconds(FLAGS_duration_ms);
+  config.sampleInterval = std::chrono::milliseconds(
+      std::max<uint64_t>(FLAGS_sample_interval_ms, 1));
+  config.packetSize = FLAGS_packet_size;
+  config.pacingEnabled = FLAGS_pacing;
+  CongestionControlSimulator simulator(config, flagsToLinkModel());
+  auto samples = simulator.run();
+
+  if (FLAGS_output.empty()) {
+    writeSamples(std::cout, samples, config.sampleInterval);
+  } else {
+    std::ofstream out(FLAGS_output);
+    writeSamples(out, samples, config.sampleInterval);
+  }
+  return 0;
+}
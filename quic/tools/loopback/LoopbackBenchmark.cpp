@@ -0,0 +1,690 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+/**
+ * Runs a QuicClientTransport against QuicServerTransports on a single event
+ * base, over sockets that hand the datagrams to each other in memory. There
+ * is no kernel on the path, so the time of every benchmark is the CPU time
+ * of mvfst, fizz and folly only. The benchmarks are:
+ *
+ * - ConnectionSetup: one iteration is a full handshake, from the start of
+ *   the client to its onTransportReady, so the iterations per second are the
+ *   connection setup rate.
+ * - bulkTransferKiB: one iteration is one KiB sent on a single stream, so
+ *   the time per iteration is the per-KiB cost of a bulk transfer and the
+ *   iterations per second its throughput. It runs with the default packet
+ *   size and with the packets of a 9000 byte MTU path, which both endpoints
+ *   are set up to send without path MTU discovery.
+ * - Rpc: one iteration is a request and a response on its own stream, with
+ *   kConcurrentRpcs of them in flight.
+ */
+
+#include <folly/Benchmark.h>
+#include <folly/init/Init.h>
+#include <folly/io/async/AsyncUDPSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <glog/logging.h>
+
+#include <quic/client/QuicClientTransport.h>
+#include <quic/codec/Decode.h>
+#include <quic/codec/DefaultConnectionIdAlgo.h>
+#include <quic/common/test/TestUtils.h>
+#include <quic/congestion_control/CongestionControllerFactory.h>
+#include <quic/server/QuicServerTransport.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace quic {
+namespace loopback {
+
+constexpr size_t kBulkWriteSize = 64 * 1024;
+constexpr size_t kRequestSize = 100;
+constexpr size_t kResponseSize = 2000;
+constexpr size_t kConcurrentRpcs = 100;
+// The UDP payload of a 9000 byte MTU IPv6 path.
+constexpr uint64_t kJumboPacketLen = 8952;
+
+TransportSettings makeTransportSettings(uint64_t packetLen) {
+  TransportSettings settings;
+  if (packetLen > kDefaultUDPSendPacketLen) {
+    // Each side sends packets up to the max_packet_size of the other.
+    settings.maxRecvPacketSize = packetLen;
+    settings.canIgnorePathMTU = true;
+  }
+  return settings;
+}
+
+Buf copyData(folly::io::Cursor& cursor, size_t len) {
+  auto copy = folly::IOBuf::create(len);
+  cursor.pull(copy->writableTail(), len);
+  copy->append(len);
+  return copy;
+}
+
+// Returns len bytes, chained from clones of block.
+Buf makeData(const folly::IOBuf& block, size_t len) {
+  auto data = folly::IOBuf::create(0);
+  while (len > 0) {
+    auto part = block.clone();
+    part->trimEnd(part->length() - std::min(len, part->length()));
+    len -= part->length();
+    data->prependChain(std::move(part));
+  }
+  return data;
+}
+
+/**
+ * Carries the datagrams between the endpoints. The datagrams that are sent
+ * during a loop iteration are delivered in the next one, as if they went
+ * through a NIC with no delay and no loss.
+ */
+class LoopbackNetwork : public folly::EventBase::LoopCallback {
+ public:
+  class Endpoint {
+   public:
+    virtual ~Endpoint() = default;
+
+    virtual void deliver(const folly::SocketAddress& peer, Buf data) = 0;
+  };
+
+  explicit LoopbackNetwork(folly::EventBase* evb) : evb_(evb) {}
+
+  ~LoopbackNetwork() override {
+    cancelLoopCallback();
+  }
+
+  void attach(const folly::SocketAddress& address, Endpoint* endpoint) {
+    endpoints_[address] = endpoint;
+  }
+
+  void detach(const folly::SocketAddress& address) {
+    endpoints_.erase(address);
+  }
+
+  void send(
+      const folly::SocketAddress& from,
+      const folly::SocketAddress& to,
+      Buf data) {
+    datagrams_.push_back(Datagram{from, to, std::move(data)});
+    if (!isLoopCallbackScheduled()) {
+      evb_->runInLoop(this);
+    }
+  }
+
+  void runLoopCallback() noexcept override {
+    auto datagrams = std::move(datagrams_);
+    datagrams_.clear();
+    for (auto& datagram : datagrams) {
+      auto it = endpoints_.find(datagram.to);
+      if (it != endpoints_.end()) {
+        it->second->deliver(datagram.from, std::move(datagram.data));
+      }
+    }
+  }
+
+ private:
+  struct Datagram {
+    folly::SocketAddress from;
+    folly::SocketAddress to;
+    Buf data;
+  };
+
+  folly::EventBase* evb_;
+  std::unordered_map<folly::SocketAddress, Endpoint*> endpoints_;
+  std::vector<Datagram> datagrams_;
+};
+
+/**
+ * An AsyncUDPSocket without a file descriptor, which sends through a
+ * LoopbackNetwork. Sends copy the data, as the kernel would. A bound socket
+ * receives the datagrams sent to its address through its read callback;
+ * sockets that are not bound only send, like the sockets of the server
+ * transports, whose reads go through the worker.
+ */
+class LoopbackUDPSocket : public folly::AsyncUDPSocket,
+                          public LoopbackNetwork::Endpoint {
+ public:
+  LoopbackUDPSocket(
+      folly::EventBase* evb,
+      LoopbackNetwork& network,
+      folly::SocketAddress address)
+      : folly::AsyncUDPSocket(evb),
+        network_(network),
+        address_(std::move(address)) {}
+
+  ~LoopbackUDPSocket() override {
+    close();
+  }
+
+  void bind(const folly::SocketAddress& /* address */) override {
+    network_.attach(address_, this);
+    bound_ = true;
+  }
+
+  const folly::SocketAddress& address() const override {
+    return address_;
+  }
+
+  bool isBound() const override {
+    return bound_;
+  }
+
+  ssize_t write(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf) override {
+    auto len = buf->computeChainDataLength();
+    folly::io::Cursor cursor(buf.get());
+    network_.send(address_, address, copyData(cursor, len));
+    return len;
+  }
+
+  ssize_t writeGSO(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf,
+      int gso) override {
+    if (gso <= 0) {
+      return write(address, buf);
+    }
+    auto len = buf->computeChainDataLength();
+    folly::io::Cursor cursor(buf.get());
+    while (!cursor.isAtEnd()) {
+      auto segmentLen = std::min<size_t>(gso, cursor.totalLength());
+      network_.send(address_, address, copyData(cursor, segmentLen));
+    }
+    return len;
+  }
+
+  int writem(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>* bufs,
+      size_t count) override {
+    for (size_t i = 0; i < count; i++) {
+      write(address, bufs[i]);
+    }
+    return count;
+  }
+
+  void resumeRead(ReadCallback* callback) override {
+    readCallback_ = callback;
+  }
+
+  void pauseRead() override {
+    readCallback_ = nullptr;
+  }
+
+  void close() override {
+    readCallback_ = nullptr;
+    if (bound_) {
+      network_.detach(address_);
+      bound_ = false;
+    }
+  }
+
+  void setErrMessageCallback(ErrMessageCallback*) override {}
+
+  void dontFragment(bool) override {}
+
+  void setReuseAddr(bool) override {}
+
+  int connect(const folly::SocketAddress&) override {
+    return 0;
+  }
+
+  void deliver(const folly::SocketAddress& peer, Buf data) override {
+    if (!readCallback_) {
+      return;
+    }
+    void* buf = nullptr;
+    size_t bufLen = 0;
+    readCallback_->getReadBuffer(&buf, &bufLen);
+    auto len = data->computeChainDataLength();
+    folly::io::Cursor cursor(data.get());
+    cursor.pull(buf, std::min(len, bufLen));
+    readCallback_->onDataAvailable(peer, std::min(len, bufLen), len > bufLen);
+  }
+
+ private:
+  LoopbackNetwork& network_;
+  folly::SocketAddress address_;
+  ReadCallback* readCallback_{nullptr};
+  bool bound_{false};
+};
+
+/**
+ * Server side of the streams: the bytes that are received are counted, and a
+ * response of kResponseSize bytes is sent on every bidirectional stream that
+ * the peer finishes.
+ */
+class ServerHandler : public QuicSocket::ConnectionCallback,
+                      public QuicSocket::ReadCallback {
+ public:
+  ServerHandler(const folly::IOBuf& block, uint64_t& bytesReceived)
+      : block_(block), bytesReceived_(bytesReceived) {}
+
+  void setQuicSocket(std::shared_ptr<QuicSocket> socket) {
+    sock_ = std::move(socket);
+  }
+
+  void onNewBidirectionalStream(StreamId id) noexcept override {
+    sock_->setReadCallback(id, this);
+  }
+
+  void onNewUnidirectionalStream(StreamId id) noexcept override {
+    sock_->setReadCallback(id, this);
+  }
+
+  void onStopSending(StreamId, ApplicationErrorCode) noexcept override {}
+
+  void onConnectionEnd() noexcept override {}
+
+  void onConnectionError(
+      std::pair<QuicErrorCode, std::string> error) noexcept override {
+    LOG(FATAL) << "Server connection error=" << toString(error.first) << " "
+               << error.second;
+  }
+
+  void readAvailable(StreamId id) noexcept override {
+    auto readData = sock_->read(id, 0);
+    if (readData.hasError()) {
+      LOG(FATAL) << "Server failed read from stream=" << id
+                 << ", error=" << toString(readData.error());
+    }
+    if (readData->first) {
+      bytesReceived_ += readData->first->computeChainDataLength();
+    }
+    if (readData->second && sock_->isBidirectionalStream(id)) {
+      sock_->writeChain(id, makeData(block_, kResponseSize), true, false);
+    }
+  }
+
+  void readError(
+      StreamId id,
+      std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+          error) noexcept override {
+    LOG(FATAL) << "Server read error on stream=" << id
+               << " error=" << toString(error);
+  }
+
+ private:
+  std::shared_ptr<QuicSocket> sock_;
+  const folly::IOBuf& block_;
+  uint64_t& bytesReceived_;
+};
+
+/**
+ * Does what the worker does for the server transports: creates one for the
+ * initial packet of each new client address and hands it the datagrams of
+ * that address.
+ */
+class LoopbackServer : public LoopbackNetwork::Endpoint,
+                       public QuicServerTransport::RoutingCallback {
+ public:
+  LoopbackServer(
+      folly::EventBase* evb,
+      LoopbackNetwork& network,
+      folly::SocketAddress address,
+      const folly::IOBuf& block,
+      uint64_t packetLen)
+      : evb_(evb),
+        network_(network),
+        address_(std::move(address)),
+        block_(block),
+        ctx_(test::createServerCtx()),
+        ccFactory_(std::make_shared<DefaultCongestionControllerFactory>()),
+        transportSettings_(makeTransportSettings(packetLen)) {
+    transportSettings_.statelessResetTokenSecret = test::getRandSecret();
+    network_.attach(address_, this);
+  }
+
+  ~LoopbackServer() override {
+    network_.detach(address_);
+    closeAll();
+  }
+
+  const folly::SocketAddress& getAddress() const {
+    return address_;
+  }
+
+  uint64_t getBytesReceived() const {
+    return bytesReceived_;
+  }
+
+  void closeAll() {
+    for (auto& connection : connections_) {
+      connection.second.transport->setRoutingCallback(nullptr);
+      connection.second.transport->closeNow(folly::none);
+    }
+    connections_.clear();
+  }
+
+  void deliver(const folly::SocketAddress& peer, Buf data) override {
+    auto it = connections_.find(peer);
+    if (it == connections_.end()) {
+      folly::io::Cursor cursor(data.get());
+      auto initialByte = cursor.readBE<uint8_t>();
+      auto parsed = parseLongHeaderInvariant(initialByte, cursor);
+      if (parsed.hasError()) {
+        return;
+      }
+      it = connections_
+               .emplace(peer, makeConnection(peer, parsed->invariant.srcConnId))
+               .first;
+    }
+    it->second.transport->onNetworkData(
+        peer, NetworkData(std::move(data), Clock::now()));
+  }
+
+  void onConnectionIdAvailable(
+      QuicServerTransport::Ptr,
+      ConnectionId) noexcept override {}
+
+  void onConnectionIdBound(QuicServerTransport::Ptr) noexcept override {}
+
+  void onConnectionUnbound(
+      const QuicServerTransport::SourceIdentity& source,
+      folly::Optional<ConnectionId>) noexcept override {
+    // Destroyed on the next loop, the transport is still on the stack.
+    auto it = connections_.find(source.first);
+    if (it != connections_.end()) {
+      auto connection = std::make_shared<Connection>(std::move(it->second));
+      connections_.erase(it);
+      evb_->runInLoop([connection] {});
+    }
+  }
+
+ private:
+  struct Connection {
+    std::unique_ptr<ServerHandler> handler;
+    QuicServerTransport::Ptr transport;
+  };
+
+  Connection makeConnection(
+      const folly::SocketAddress& peer,
+      const ConnectionId& clientConnectionId) {
+    Connection connection;
+    connection.handler =
+        std::make_unique<ServerHandler>(block_, bytesReceived_);
+    auto sock = std::make_unique<LoopbackUDPSocket>(evb_, network_, address_);
+    connection.transport = QuicServerTransport::make(
+        evb_, std::move(sock), *connection.handler, ctx_);
+    connection.handler->setQuicSocket(connection.transport);
+    auto& transport = *connection.transport;
+    transport.setRoutingCallback(this);
+    transport.setOriginalPeerAddress(peer);
+    transport.setCongestionControllerFactory(ccFactory_);
+    transport.setTransportSettings(transportSettings_);
+    transport.setConnectionIdAlgo(&connIdAlgo_);
+    transport.setClientConnectionId(clientConnectionId);
+    transport.setServerConnectionIdParams(ServerConnectionIdParams(0, 0, 0));
+    transport.accept();
+    return connection;
+  }
+
+  folly::EventBase* evb_;
+  LoopbackNetwork& network_;
+  folly::SocketAddress address_;
+  const folly::IOBuf& block_;
+  std::shared_ptr<fizz::server::FizzServerContext> ctx_;
+  std::shared_ptr<CongestionControllerFactory> ccFactory_;
+  DefaultConnectionIdAlgo connIdAlgo_;
+  TransportSettings transportSettings_;
+  std::unordered_map<folly::SocketAddress, Connection> connections_;
+  uint64_t bytesReceived_{0};
+};
+
+/**
+ * Client side: sends kBulkWriteSize writes on a stream as long as there are
+ * bytes left to send, and keeps kConcurrentRpcs requests in flight as long
+ * as there are requests left to send.
+ */
+class ClientHandler : public QuicSocket::ConnectionCallback,
+                      public QuicSocket::ReadCallback,
+                      public QuicSocket::WriteCallback {
+ public:
+  explicit ClientHandler(const folly::IOBuf& block) : block_(block) {}
+
+  void setQuicSocket(std::shared_ptr<QuicSocket> socket) {
+    sock_ = std::move(socket);
+  }
+
+  bool isReady() const {
+    return ready_;
+  }
+
+  size_t getRpcsDone() const {
+    return rpcsDone_;
+  }
+
+  void sendBulk(uint64_t len) {
+    bulkLeft_ = len;
+    auto stream = sock_->createUnidirectionalStream();
+    CHECK(stream.hasValue());
+    sock_->notifyPendingWriteOnStream(*stream, this);
+  }
+
+  void sendRpcs(size_t numRpcs) {
+    rpcsLeft_ = numRpcs;
+    rpcsDone_ = 0;
+    for (size_t i = 0; i < kConcurrentRpcs && rpcsLeft_ > 0; i++) {
+      sendRpc();
+    }
+  }
+
+  void onNewBidirectionalStream(StreamId) noexcept override {}
+
+  void onNewUnidirectionalStream(StreamId) noexcept override {}
+
+  void onStopSending(StreamId, ApplicationErrorCode) noexcept override {}
+
+  void onConnectionEnd() noexcept override {}
+
+  void onConnectionError(
+      std::pair<QuicErrorCode, std::string> error) noexcept override {
+    LOG(FATAL) << "Client connection error=" << toString(error.first) << " "
+               << error.second;
+  }
+
+  void onTransportReady() noexcept override {
+    ready_ = true;
+  }
+
+  void readAvailable(StreamId id) noexcept override {
+    auto readData = sock_->read(id, 0);
+    if (readData.hasError()) {
+      LOG(FATAL) << "Client failed read from stream=" << id
+                 << ", error=" << toString(readData.error());
+    }
+    if (readData->second) {
+      rpcsDone_++;
+      if (rpcsLeft_ > 0) {
+        sendRpc();
+      }
+    }
+  }
+
+  void readError(
+      StreamId id,
+      std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+          error) noexcept override {
+    LOG(FATAL) << "Client read error on stream=" << id
+               << " error=" << toString(error);
+  }
+
+  void onStreamWriteReady(StreamId id, uint64_t maxToSend) noexcept override {
+    auto len = std::min<uint64_t>({bulkLeft_, maxToSend, kBulkWriteSize});
+    bulkLeft_ -= len;
+    auto res =
+        sock_->writeChain(id, makeData(block_, len), bulkLeft_ == 0, true);
+    if (res.hasError()) {
+      LOG(FATAL) << "Client write error: " << toString(res.error());
+    }
+    if (bulkLeft_ > 0) {
+      sock_->notifyPendingWriteOnStream(id, this);
+    }
+  }
+
+  void onStreamWriteError(
+      StreamId id,
+      std::pair<QuicErrorCode, folly::Optional<folly::StringPiece>>
+          error) noexcept override {
+    LOG(FATAL) << "Client write error on stream=" << id
+               << " error=" << toString(error);
+  }
+
+ private:
+  void sendRpc() {
+    rpcsLeft_--;
+    auto stream = sock_->createBidirectionalStream();
+    CHECK(stream.hasValue());
+    sock_->setReadCallback(*stream, this);
+    sock_->writeChain(*stream, makeData(block_, kRequestSize), true, false);
+  }
+
+  std::shared_ptr<QuicSocket> sock_;
+  const folly::IOBuf& block_;
+  bool ready_{false};
+  uint64_t bulkLeft_{0};
+  size_t rpcsLeft_{0};
+  size_t rpcsDone_{0};
+};
+
+class Loopback {
+ public:
+  explicit Loopback(uint64_t packetLen = kDefaultUDPSendPacketLen)
+      : packetLen_(packetLen),
+        block_(folly::IOBuf::create(kBulkWriteSize)),
+        network_(&evb_),
+        server_(
+            &evb_,
+            network_,
+            folly::SocketAddress("127.0.0.1", 443),
+            *block_,
+            packetLen) {
+    memset(block_->writableData(), 'a', kBulkWriteSize);
+    block_->append(kBulkWriteSize);
+  }
+
+  ~Loopback() {
+    closeClient();
+    server_.closeAll();
+    evb_.loopOnce(EVLOOP_NONBLOCK);
+  }
+
+  // Connects a new client, from a new address.
+  void connect() {
+    closeClient();
+    clientHandler_ = std::make_unique<ClientHandler>(*block_);
+    auto sock = std::make_unique<LoopbackUDPSocket>(
+        &evb_, network_, folly::SocketAddress("127.0.0.2", nextClientPort_++));
+    client_ = std::make_shared<QuicClientTransport>(&evb_, std::move(sock));
+    client_->setHostname("Fizz");
+    client_->setCertificateVerifier(test::createTestCertificateVerifier());
+    client_->setCongestionControllerFactory(
+        std::make_shared<DefaultCongestionControllerFactory>());
+    client_->setTransportSettings(makeTransportSettings(packetLen_));
+    client_->addNewPeerAddress(server_.getAddress());
+    clientHandler_->setQuicSocket(client_);
+    client_->start(clientHandler_.get());
+    loopUntil([&] { return clientHandler_->isReady(); });
+  }
+
+  void closeClient() {
+    if (client_) {
+      client_->closeNow(folly::none);
+      client_.reset();
+    }
+  }
+
+  ClientHandler& clientHandler() {
+    return *clientHandler_;
+  }
+
+  LoopbackServer& server() {
+    return server_;
+  }
+
+  template <typename Predicate>
+  void loopUntil(Predicate done) {
+    while (!done()) {
+      evb_.loopOnce();
+    }
+  }
+
+ private:
+  uint64_t packetLen_;
+  folly::EventBase evb_;
+  Buf block_;
+  LoopbackNetwork network_;
+  LoopbackServer server_;
+  std::shared_ptr<QuicClientTransport> client_;
+  std::unique_ptr<ClientHandler> clientHandler_;
+  // Wraps around after 64K connections, by which time the connections of
+  // the address are long closed.
+  uint16_t nextClientPort_{1};
+};
+
+} // namespace loopback
+} // namespace quic
+
+using quic::loopback::Loopback;
+
+void bulkTransferKiB(size_t iters, uint64_t packetLen) {
+  folly::Optional<Loopback> loopback;
+  uint64_t len = iters * 1024;
+  BENCHMARK_SUSPEND {
+    loopback.emplace(packetLen);
+    loopback->connect();
+  }
+  loopback->clientHandler().sendBulk(len);
+  loopback->loopUntil(
+      [&] { return loopback->server().getBytesReceived() >= len; });
+  BENCHMARK_SUSPEND {
+    loopback.clear();
+  }
+}
+
+BENCHMARK(ConnectionSetup, iters) {
+  folly::Optional<Loopback> loopback;
+  BENCHMARK_SUSPEND {
+    loopback.emplace();
+  }
+  for (size_t i = 0; i < iters; i++) {
+    loopback->connect();
+    BENCHMARK_SUSPEND {
+      loopback->closeClient();
+      loopback->server().closeAll();
+    }
+  }
+  BENCHMARK_SUSPEND {
+    loopback.clear();
+  }
+}
+
+BENCHMARK_NAMED_PARAM(bulkTransferKiB, Default, quic::kDefaultUDPSendPacketLen)
+BENCHMARK_NAMED_PARAM(bulkTransferKiB, Jumbo, quic::loopback::kJumboPacketLen)
+
+BENCHMARK(Rpc, iters) {
+  folly::Optional<Loopback> loopback;
+  BENCHMARK_SUSPEND {
+    loopback.emplace();
+    loopback->connect();
+  }
+  loopback->clientHandler().sendRpcs(iters);
+  loopback->loopUntil(
+      [&] { return loopback->clientHandler().getRpcsDone() >= iters; });
+  BENCHMARK_SUSPEND {
+    loopback.clear();
+  }
+}
+
+int main(int argc, char** argv) {
+  folly::init(&argc, &argv);
+  folly::runBenchmarks();
+  return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#include <quic/tools/tperf/NetworkEmulator.h>
+
+#include <folly/io/Cursor.h>
+
+namespace quic {
+namespace tperf {
+
+namespace {
+// Finer than the pacing timer, since the emulated delays are what is being
+// measured.
+constexpr std::chrono::microseconds kEmulatorTimerTickInterval{100};
+} // namespace
+
+bool NetworkEmulatorConfig::enabled() const {
+  return delay.count() > 0 || jitter.count() > 0 || lossRate > 0 ||
+      geGoodToBad > 0 || reorderRate > 0 || rateBytesPerSec > 0;
+}
+
+NetworkEmulator::NetworkEmulator(
+    folly::EventBase* evb,
+    const NetworkEmulatorConfig& config,
+    uint64_t seed,
+    SendFn send)
+    : config_(config),
+      send_(std::move(send)),
+      timer_(TimerHighRes::newTimer(evb, kEmulatorTimerTickInterval)),
+      random_(seed),
+      tokens_(config.burstBytes),
+      lastRefill_(Clock::now()) {}
+
+NetworkEmulator::~NetworkEmulator() {
+  // Before the timer goes away with the members.
+  cancelTimeout();
+}
+
+bool NetworkEmulator::shouldDrop() {
+  if (config_.geGoodToBad > 0) {
+    if (geBad_) {
+      geBad_ = uniform_(random_) >= config_.geBadToGood;
+    } else {
+      geBad_ = uniform_(random_) < config_.geGoodToBad;
+    }
+    if (uniform_(random_) < (geBad_ ? config_.geLossBad : config_.geLossGood)) {
+      return true;
+    }
+  }
+  return config_.lossRate > 0 && uniform_(random_) < config_.lossRate;
+}
+
+folly::Optional<TimePoint> NetworkEmulator::departureTime(
+    size_t len,
+    TimePoint now) {
+  if (config_.rateBytesPerSec == 0) {
+    return now;
+  }
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::microseconds>(now - lastRefill_);
+  lastRefill_ = now;
+  tokens_ = std::min<double>(
+      config_.burstBytes,
+      tokens_ + elapsed.count() * config_.rateBytesPerSec / 1e6);
+  // The tokens go negative for the bytes that are queued behind the bucket.
+  if (len - tokens_ > config_.queueBytes) {
+    return folly::none;
+  }
+  tokens_ -= len;
+  if (tokens_ >= 0) {
+    return now;
+  }
+  return now +
+      std::chrono::microseconds(
+             static_cast<int64_t>(-tokens_ * 1e6 / config_.rateBytesPerSec));
+}
+
+std::chrono::microseconds NetworkEmulator::linkDelay() {
+  if (config_.jitter.count() == 0) {
+    return config_.delay;
+  }
+  std::uniform_int_distribution<int64_t> jitter(
+      -config_.jitter.count(), config_.jitter.count());
+  return std::max(
+      std::chrono::microseconds::zero(),
+      config_.delay + std::chrono::microseconds(jitter(random_)));
+}
+
+void NetworkEmulator::send(const folly::SocketAddress& address, Buf packet) {
+  if (shouldDrop()) {
+    numDropped_++;
+    return;
+  }
+  auto now = Clock::now();
+  auto departure = departureTime(packet->computeChainDataLength(), now);
+  if (!departure) {
+    numDropped_++;
+    return;
+  }
+  auto arrival = *departure;
+  // Like netem, a reordered packet goes out without the delay. The others
+  // keep their order, whatever the jitter.
+  if (config_.reorderRate == 0 || uniform_(random_) >= config_.reorderRate) {
+    arrival = std::max(arrival + linkDelay(), lastArrival_);
+    lastArrival_ = arrival;
+  }
+  if (arrival <= now && pending_.empty()) {
+    send_(address, std::move(packet));
+    return;
+  }
+  pending_.emplace(arrival, Packet{address, std::move(packet)});
+  scheduleNext();
+}
+
+void NetworkEmulator::timeoutExpired() noexcept {
+  auto now = Clock::now();
+  while (!pending_.empty() && pending_.begin()->first <= now) {
+    auto packet = std::move(pending_.begin()->second);
+    pending_.erase(pending_.begin());
+    send_(packet.address, std::move(packet.data));
+  }
+  scheduleNext();
+}
+
+void NetworkEmulator::scheduleNext() {
+  if (pending_.empty()) {
+    return;
+  }
+  auto timeout = std::max(
+      std::chrono::microseconds::zero(),
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          pending_.begin()->first - Clock::now()));
+  if (isScheduled() && getTimeRemaining() <= timeout) {
+    return;
+  }
+  cancelTimeout();
+  timer_->scheduleTimeout(this, timeout);
+}
+
+EmulatedUDPSocket::EmulatedUDPSocket(
+    folly::EventBase* evb,
+    const NetworkEmulatorConfig& config,
+    uint64_t seed)
+    : folly::AsyncUDPSocket(evb),
+      emulator_(std::make_shared<NetworkEmulator>(
+          evb,
+          config,
+          seed,
+          [this](const folly::SocketAddress& address, Buf packet) {
+            // The socket may have been closed while the packet was queued.
+            if (getNetworkSocket() != folly::NetworkSocket()) {
+              folly::AsyncUDPSocket::write(address, packet);
+            }
+          })) {}
+
+EmulatedUDPSocket::EmulatedUDPSocket(
+    folly::EventBase* evb,
+    std::shared_ptr<NetworkEmulator> emulator)
+    : folly::AsyncUDPSocket(evb), emulator_(std::move(emulator)) {}
+
+ssize_t EmulatedUDPSocket::write(
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf) {
+  auto len = buf->computeChainDataLength();
+  emulator_->send(address, buf->clone());
+  return len;
+}
+
+ssize_t EmulatedUDPSocket::writeGSO(
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>& buf,
+    int gso) {
+  auto len = buf->computeChainDataLength();
+  if (gso <= 0) {
+    emulator_->send(address, buf->clone());
+    return len;
+  }
+  folly::io::Cursor cursor(buf.get());
+  while (!cursor.isAtEnd()) {
+    Buf packet;
+    cursor.clone(packet, std::min<size_t>(gso, cursor.totalLength()));
+    emulator_->send(address, std::move(packet));
+  }
+  return len;
+}
+
+int EmulatedUDPSocket::writem(
+    const folly::SocketAddress& address,
+    const std::unique_ptr<folly::IOBuf>* bufs,
+    size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    emulator_->send(address, bufs[i]->clone());
+  }
+  return count;
+}
+
+EmulatedUDPSocketFactory::EmulatedUDPSocketFactory(
+    NetworkEmulatorConfig config)
+    : config_(std::move(config)), nextSeed_(config_.seed) {}
+
+std::shared_ptr<NetworkEmulator> EmulatedUDPSocketFactory::getSharedLink(
+    folly::EventBase* evb,
+    int fd) {
+  std::lock_guard<std::mutex> lock(sharedLinksMutex_);
+  auto& link = sharedLinks_[evb];
+  if (!link.emulator) {
+    link.socket = std::make_unique<folly::AsyncUDPSocket>(evb);
+    link.socket->setFD(
+        folly::NetworkSocket::fromFd(fd),
+        folly::AsyncUDPSocket::FDOwnership::SHARED);
+    link.socket->dontFragment(true);
+    link.emulator = std::make_shared<NetworkEmulator>(
+        evb,
+        config_,
+        nextSeed_++,
+        [socket = link.socket.get()](
+            const folly::SocketAddress& address, Buf packet) {
+          socket->write(address, packet);
+        });
+  }
+  return link.emulator;
+}
+
+std::unique_ptr<folly::AsyncUDPSocket> EmulatedUDPSocketFactory::make(
+    folly::EventBase* evb,
+    int fd) {
+  std::unique_ptr<EmulatedUDPSocket> sock;
+  if (config_.sharedLink && fd != -1) {
+    sock = std::make_unique<EmulatedUDPSocket>(evb, getSharedLink(evb, fd));
+  } else {
+    sock = std::make_unique<EmulatedUDPSocket>(evb, config_, nextSeed_++);
+  }
+  if (fd != -1) {
+    sock->setFD(
+        folly::NetworkSocket::fromFd(fd),
+        folly::AsyncUDPSocket::FDOwnership::SHARED);
+    sock->dontFragment(true);
+  }
+  return sock;
+}
+
+} // namespace tperf
+} // namespace quic
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ */
+
+#pragma once
+
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <folly/io/async/AsyncUDPSocket.h>
+#include <quic/QuicConstants.h>
+#include <quic/codec/Types.h>
+#include <quic/common/Timers.h>
+#include <quic/server/QuicUDPSocketFactory.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+
+namespace quic {
+namespace tperf {
+
+struct NetworkEmulatorConfig {
+  // Fixed one way delay, and the bound of the uniform jitter around it.
+  std::chrono::microseconds delay{0};
+  std::chrono::microseconds jitter{0};
+  // Probability that a packet is lost, independently of the others.
+  double lossRate{0};
+  // Gilbert-Elliott loss: probabilities of going from the good state to the
+  // bad one and back on each packet, and of losing a packet in each state.
+  // Off when geGoodToBad is 0.
+  double geGoodToBad{0};
+  double geBadToGood{1};
+  double geLossGood{0};
+  double geLossBad{1};
+  // Probability that a packet skips the delay, and so overtakes the
+  // packets that are still in flight.
+  double reorderRate{0};
+  // Token bucket of the link, off when rate is 0. Packets that do not fit
+  // in the bucket wait in a queue of up to queueBytes, and are dropped
+  // beyond it.
+  uint64_t rateBytesPerSec{0};
+  uint64_t burstBytes{16 * 1024};
+  uint64_t queueBytes{256 * 1024};
+  uint64_t seed{0};
+  // Whether the server transports of a worker share one link, and so its
+  // rate, queue and loss, like flows through a bottleneck. Each transport
+  // has a link of its own otherwise.
+  bool sharedLink{false};
+
+  bool enabled() const;
+};
+
+/**
+ * Emulates the egress link of a socket: each packet that is sent is dropped,
+ * or handed to send after the queueing and the delay of the link. All the
+ * randomness comes from a generator seeded by the config, so that runs can
+ * be reproduced.
+ */
+class NetworkEmulator : public TimerHighRes::Callback {
+ public:
+  using SendFn = folly::Function<void(const folly::SocketAddress&, Buf)>;
+
+  NetworkEmulator(
+      folly::EventBase* evb,
+      const NetworkEmulatorConfig& config,
+      uint64_t seed,
+      SendFn send);
+
+  ~NetworkEmulator() override;
+
+  void send(const folly::SocketAddress& address, Buf packet);
+
+  uint64_t getNumDropped() const {
+    return numDropped_;
+  }
+
+  void timeoutExpired() noexcept override;
+
+  void callbackCanceled() noexcept override {}
+
+ private:
+  bool shouldDrop();
+
+  // Time the packet leaves the token bucket, or none if the queue is full.
+  folly::Optional<TimePoint> departureTime(size_t len, TimePoint now);
+
+  std::chrono::microseconds linkDelay();
+
+  void scheduleNext();
+
+  struct Packet {
+    folly::SocketAddress address;
+    Buf data;
+  };
+
+  NetworkEmulatorConfig config_;
+  SendFn send_;
+  TimerHighRes::SharedPtr timer_;
+  std::mt19937_64 random_;
+  std::uniform_real_distribution<double> uniform_{0, 1};
+  std::multimap<TimePoint, Packet> pending_;
+  TimePoint lastArrival_;
+  double tokens_;
+  TimePoint lastRefill_;
+  bool geBad_{false};
+  uint64_t numDropped_{0};
+};
+
+/**
+ * AsyncUDPSocket whose writes go through a NetworkEmulator. GSO buffers are
+ * split in their packets, which go through the emulator, and the socket,
+ * one by one.
+ */
+class EmulatedUDPSocket : public folly::AsyncUDPSocket {
+ public:
+  EmulatedUDPSocket(
+      folly::EventBase* evb,
+      const NetworkEmulatorConfig& config,
+      uint64_t seed);
+
+  // Sends through a link that other sockets may share.
+  EmulatedUDPSocket(
+      folly::EventBase* evb,
+      std::shared_ptr<NetworkEmulator> emulator);
+
+  ssize_t write(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf) override;
+
+  ssize_t writeGSO(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>& buf,
+      int gso) override;
+
+  int writem(
+      const folly::SocketAddress& address,
+      const std::unique_ptr<folly::IOBuf>* bufs,
+      size_t count) override;
+
+ private:
+  std::shared_ptr<NetworkEmulator> emulator_;
+};
+
+/**
+ * Makes the sockets of the server transports, sharing the fd of the
+ * listener like QuicSharedUDPSocketFactory, with an emulator each. With
+ * sharedLink, the sockets of a worker share an emulator instead, which sends
+ * through a socket of its own on the same fd, so that it outlives the
+ * transports.
+ */
+class EmulatedUDPSocketFactory : public QuicUDPSocketFactory {
+ public:
+  explicit EmulatedUDPSocketFactory(NetworkEmulatorConfig config);
+
+  std::unique_ptr<folly::AsyncUDPSocket> make(folly::EventBase* evb, int fd)
+      override;
+
+ private:
+  struct SharedLink {
+    std::unique_ptr<folly::AsyncUDPSocket> socket;
+    std::shared_ptr<NetworkEmulator> emulator;
+  };
+
+  std::shared_ptr<NetworkEmulator> getSharedLink(
+      folly::EventBase* evb,
+      int fd);
+
+  NetworkEmulatorConfig config_;
+  // Seeds of the sockets, made from any worker.
+  std::atomic<uint64_t> nextSeed_;
+  // The links of the workers, by event base. They go away with the server.
+  std::mutex sharedLinksMutex_;
+  std::unordered_map<folly::EventBase*, SharedLink> sharedLinks_;
+};
+
+} // namespace tperf
+} // namespace quic
@@ -9,41 +9,106 @@
 #include <glog/logging.h>
 
 #include <fizz/crypto/Utils.h>
+#include <folly/String.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
 #include <folly/init/Init.h>
 #include <folly/io/async/HHWheelTimer.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/json.h>
 #include <folly/portability/GFlags.h>
 
 #include <quic/client/QuicClientTransport.h>
+#include <quic/common/TransportStatsHistogram.h>
 #include <quic/common/test/TestUtils.h>
+#include <quic/logging/StreamingQLogger.h>
+#include <quic/server/QLoggerFactory.h>
 #include <quic/server/QuicServer.h>
 #include <quic/server/QuicServerTransport.h>
 #include <quic/server/QuicSharedUDPSocketFactory.h>
+#include <quic/tools/tperf/NetworkEmulator.h>
+
+#include <iostream>
+#include <thread>
+#include <unordered_map>
 
 namespace quic {
 namespace tperf {
 
-class ServerSingleStreamHandler : public quic::QuicSocket::ConnectionCallback,
-                                  public quic::QuicSocket::ReadCallback,
-                                  public quic::QuicSocket::WriteCallback {
+enum class TPerfTest : uint8_t {
+  // The server pushes data on unidirectional streams.
+  Bulk,
+  // The client sends requests on bidirectional streams and the server
+  // answers each of them.
+  Rpc,
+  // The client connects, and closes the connection once it is ready.
+  Churn,
+};
+
+TPerfTest parseTest(const std::string& test) {
+  if (test == "bulk") {
+    return TPerfTest::Bulk;
+  } else if (test == "rpc") {
+    return TPerfTest::Rpc;
+  } else if (test == "churn") {
+    return TPerfTest::Churn;
+  }
+  throw std::invalid_argument(
+      folly::to<std::string>("Unknown tperf test ", test));
+}
+
+const char* toString(TPerfTest test) {
+  switch (test) {
+    case TPerfTest::Bulk:
+      return "bulk";
+    case TPerfTest::Rpc:
+      return "rpc";
+    case TPerfTest::Churn:
+      return "churn";
+  }
+  return "unknown";
+}
+
+Buf makeBuffer(uint64_t size) {
+  auto buf = folly::IOBuf::create(size);
+  memset(buf->writableData(), 'a', size);
+  buf->append(size);
+  return buf;
+}
+
+class ServerStreamHandler : public quic::QuicSocket::ConnectionCallback,
+                            public quic::QuicSocket::ReadCallback,
+                            public quic::QuicSocket::WriteCallback {
  public:
   using StreamData = std::pair<folly::IOBufQueue, bool>;
 
-  explicit ServerSingleStreamHandler(
+  ServerStreamHandler(
       folly::EventBase* evbIn,
-      uint64_t blockSize)
-      : evb_(evbIn), blockSize_(blockSize) {}
+      TPerfTest test,
+      uint64_t blockSize,
+      uint64_t numStreams,
+      uint64_t responseSize)
+      : evb_(evbIn),
+        test_(test),
+        blockSize_(blockSize),
+        numStreams_(numStreams),
+        response_(makeBuffer(responseSize)) {}
 
   void setQuicSocket(std::shared_ptr<quic::QuicSocket> socket) {
     sock_ = socket;
   }
 
+  // The handler is kept alive by itself until the connection ends.
+  void setSelf(std::shared_ptr<ServerStreamHandler> self) {
+    self_ = std::move(self);
+  }
+
   void onNewBidirectionalStream(quic::StreamId id) noexcept override {
-    LOG(INFO) << "Got bidirectional stream id=" << id;
+    VLOG(5) << "Got bidirectional stream id=" << id;
     sock_->setReadCallback(id, this);
   }
 
   void onNewUnidirectionalStream(quic::StreamId id) noexcept override {
-    LOG(INFO) << "Got unidirectional stream id=" << id;
+    VLOG(5) << "Got unidirectional stream id=" << id;
     sock_->setReadCallback(id, this);
   }
 
@@ -54,24 +119,34 @@ class ServerSingleStreamHandler : public quic::QuicSocket::ConnectionCallback,
   }
 
   void onConnectionEnd() noexcept override {
-    LOG(INFO) << "Socket closed";
+    VLOG(5) << "Socket closed";
+    release();
   }
 
   void onConnectionError(
       std::pair<quic::QuicErrorCode, std::string> error) noexcept override {
-    LOG(ERROR) << "Socket error=" << toString(error.first);
+    VLOG(5) << "Socket error=" << toString(error.first);
+    release();
   }
 
   void onTransportReady() noexcept override {
-    LOG(INFO) << "Starting sends to client.";
-    auto stream = sock_->createUnidirectionalStream();
-    CHECK(stream.hasValue());
-    sock_->notifyPendingWriteOnStream(stream.value(), this);
+    if (test_ != TPerfTest::Bulk) {
+      return;
+    }
+    LOG(INFO) << "Starting sends to client on " << numStreams_ << " streams.";
+    for (uint64_t i = 0; i < numStreams_; i++) {
+      auto stream = sock_->createUnidirectionalStream();
+      CHECK(stream.hasValue());
+      sock_->notifyPendingWriteOnStream(stream.value(), this);
+    }
   }
 
   void notifyDataForStream(quic::StreamId id) {
-    evb_->runInEventBaseThread([&, id]() {
-      auto res = sock_->notifyPendingWriteOnStream(id, this);
+    evb_->runInEventBaseThread([self = self_, id]() {
+      if (!self || self->closed_) {
+        return;
+      }
+      auto res = self->sock_->notifyPendingWriteOnStream(id, self.get());
       if (res.hasError()) {
         LOG(FATAL) << quic::toString(res.error());
       }
@@ -79,7 +154,21 @@ class ServerSingleStreamHandler : public quic::QuicSocket::ConnectionCallback,
   }
 
   void readAvailable(quic::StreamId id) noexcept override {
-    LOG(INFO) << "read available for stream id=" << id;
+    VLOG(10) << "read available for stream id=" << id;
+    auto readData = sock_->read(id, 0);
+    if (readData.hasError()) {
+      LOG(ERROR) << "Failed read from stream=" << id
+                 << ", error=" << quic::toString(readData.error());
+      return;
+    }
+    // Answers the request once all of it is in.
+    if (readData->second && sock_->isBidirectionalStream(id)) {
+      auto res = sock_->writeChain(id, response_->clone(), true, false);
+      if (res.hasError()) {
+        LOG(ERROR) << "Failed response on stream=" << id
+                   << ", error=" << quic::toString(res.error());
+      }
+    }
   }
 
   void readError(
@@ -122,17 +211,35 @@ class ServerSingleStreamHandler : public quic::QuicSocket::ConnectionCallback,
   }
 
  private:
+  void release() {
+    closed_ = true;
+    // The transport is still calling us.
+    evb_->runInLoop([self = std::move(self_)] {});
+  }
+
   std::shared_ptr<quic::QuicSocket> sock_;
+  std::shared_ptr<ServerStreamHandler> self_;
   folly::EventBase* evb_;
+  TPerfTest test_;
   uint64_t blockSize_;
+  uint64_t numStreams_;
+  Buf response_;
+  bool closed_{false};
 };
 
 class TPerfServerTransportFactory : public quic::QuicServerTransportFactory {
  public:
   ~TPerfServerTransportFactory() override = default;
 
-  explicit TPerfServerTransportFactory(uint64_t blockSize)
-      : blockSize_(blockSize) {}
+  TPerfServerTransportFactory(
+      TPerfTest test,
+      uint64_t blockSize,
+      uint64_t numStreams,
+      uint64_t responseSize)
+      : test_(test),
+        blockSize_(blockSize),
+        numStreams_(numStreams),
+        responseSize_(responseSize) {}
 
   quic::QuicServerTransport::Ptr make(
       folly::EventBase* evb,
@@ -141,85 +248,280 @@ class TPerfServerTransportFactory : public quic::QuicServerTransportFactory {
       std::shared_ptr<const fizz::server::FizzServerContext>
           ctx) noexcept override {
     CHECK_EQ(evb, sock->getEventBase());
-    auto serverHandler =
-        std::make_unique<ServerSingleStreamHandler>(evb, blockSize_);
+    auto serverHandler = std::make_shared<ServerStreamHandler>(
+        evb, test_, blockSize_, numStreams_, responseSize_);
     auto transport = quic::QuicServerTransport::make(
         evb, std::move(sock), *serverHandler, ctx);
-    auto settings = transport->getTransportSettings();
     serverHandler->setQuicSocket(transport);
-    LOG(ERROR) << "pushing a handler!";
-    handlers_.push_back(std::move(serverHandler));
+    serverHandler->setSelf(serverHandler);
     return transport;
   }
 
-  std::vector<std::unique_ptr<ServerSingleStreamHandler>> handlers_;
+ private:
+  TPerfTest test_;
   uint64_t blockSize_;
+  uint64_t numStreams_;
+  uint64_t responseSize_;
+};
+
+// Whether tperf paces the connections of the congestion controller.
+bool pacedCongestionControl(quic::CongestionControlType type) {
+  return type == quic::CongestionControlType::BBR ||
+      type == quic::CongestionControlType::BBR2 ||
+      type == quic::CongestionControlType::Prague ||
+      type == quic::CongestionControlType::Copa ||
+      type == quic::CongestionControlType::StaticRate;
+}
+
+QuicBatchingMode parseBatchingMode(const std::string& batching) {
+  if (batching == "none") {
+    return QuicBatchingMode::BATCHING_MODE_NONE;
+  } else if (batching == "gso") {
+    return QuicBatchingMode::BATCHING_MODE_GSO;
+  } else if (batching == "sendmmsg") {
+    return QuicBatchingMode::BATCHING_MODE_SENDMMSG;
+  } else if (batching == "sendmmsg_gso") {
+    return QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO;
+  }
+  throw std::invalid_argument(
+      folly::to<std::string>("Unknown batching mode ", batching));
+}
+
+const char* toString(QuicBatchingMode batchingMode) {
+  switch (batchingMode) {
+    case QuicBatchingMode::BATCHING_MODE_NONE:
+      return "none";
+    case QuicBatchingMode::BATCHING_MODE_GSO:
+      return "gso";
+    case QuicBatchingMode::BATCHING_MODE_SENDMMSG:
+      return "sendmmsg";
+    case QuicBatchingMode::BATCHING_MODE_SENDMMSG_GSO:
+      return "sendmmsg_gso";
+  }
+  return "unknown";
+}
+
+struct TPerfServerOptions {
+  TPerfTest test{TPerfTest::Bulk};
+  uint64_t blockSize{4096};
+  uint64_t numStreams{1};
+  uint64_t responseSize{0};
+  // 0 for one worker per hardware thread
+  size_t numWorkers{0};
+  // Cpus to pin the workers to, none if empty
+  std::vector<size_t> workerCpus;
+  uint64_t writesPerLoop{5};
+  quic::CongestionControlType congestionControlType{
+      quic::CongestionControlType::NewReno};
+  folly::Optional<quic::CongestionControlType> competingType;
+  bool copaModeSwitching{true};
+  uint64_t staticRateBytesPerSec{0};
+  // none to pace the controllers that pacedCongestionControl lists
+  folly::Optional<bool> pacing;
+  QuicBatchingMode batchingMode{QuicBatchingMode::BATCHING_MODE_NONE};
+  uint32_t maxBatchSize{16};
+  // Stream receive window of the server, 0 for the transport default
+  uint64_t window{0};
+  bool autotuneWindow{false};
+  // Directory to write the qlogs of the sampled connections to, none if
+  // empty
+  std::string qlogDir;
+  uint32_t qlogSampleOneIn{0};
+  NetworkEmulatorConfig emulator;
 };
 
 class TPerfServer {
  public:
-  explicit TPerfServer(
+  TPerfServer(
       const std::string& host,
       uint16_t port,
-      uint64_t blockSize,
-      uint64_t writesPerLoop,
-      quic::CongestionControlType congestionControlType,
-      bool gso)
-      : host_(host), port_(port), server_(QuicServer::createQuicServer()) {
+      const TPerfServerOptions& options)
+      : host_(host),
+        port_(port),
+        // The connections only compete for a link they all go through.
+        maxWorkers_(options.emulator.sharedLink ? 1 : options.numWorkers),
+        pacing_(options.pacing),
+        server_(QuicServer::createQuicServer()) {
     server_->setQuicServerTransportFactory(
-        std::make_unique<TPerfServerTransportFactory>(blockSize));
+        std::make_unique<TPerfServerTransportFactory>(
+            options.test,
+            options.blockSize,
+            options.numStreams,
+            options.responseSize));
+    if (options.emulator.enabled()) {
+      // Only the sockets of the transports, the worker still answers
+      // version negotiation and resets straight away.
+      server_->setQuicUDPSocketFactory(
+          std::make_unique<EmulatedUDPSocketFactory>(options.emulator));
+    }
     server_->setFizzContext(quic::test::createServerCtx());
+    if (!options.workerCpus.empty()) {
+      server_->setWorkerCpus(options.workerCpus);
+    }
+    if (!options.qlogDir.empty()) {
+      // The qlogs are written from a thread of their own, off the workers.
+      qlogExecutor_ = std::make_unique<folly::CPUThreadPoolExecutor>(1);
+      server_->setQLoggerFactory(std::make_shared<SampledQLoggerFactory>(
+          [dir = options.qlogDir, executor = qlogExecutor_.get()](
+              const folly::SocketAddress&,
+              const ConnectionId& clientConnectionId)
+              -> std::shared_ptr<QLogger> {
+            return std::make_shared<StreamingQLogger>(
+                folly::to<std::string>(
+                    dir, "/", clientConnectionId.hex(), ".qlog"),
+                executor);
+          },
+          options.qlogSampleOneIn));
+    }
     quic::TransportSettings settings;
-    settings.writeConnectionDataPacketsLimit = writesPerLoop;
-    settings.defaultCongestionController = congestionControlType;
-    if (congestionControlType == quic::CongestionControlType::BBR) {
-      settings.pacingEnabled = true;
+    settings.writeConnectionDataPacketsLimit = options.writesPerLoop;
+    settings.defaultCongestionController = options.congestionControlType;
+    settings.pacingEnabled = pacingEnabled(options.congestionControlType);
+    settings.copaModeSwitching = options.copaModeSwitching;
+    settings.staticRateBytesPerSec = options.staticRateBytesPerSec;
+    settings.batchingMode = options.batchingMode;
+    if (options.batchingMode != QuicBatchingMode::BATCHING_MODE_NONE) {
+      settings.maxBatchSize = options.maxBatchSize;
     }
-    if (gso) {
-      settings.batchingMode = QuicBatchingMode::BATCHING_MODE_GSO;
-      settings.maxBatchSize = 16;
+    if (options.window) {
+      settings.advertisedInitialBidiLocalStreamWindowSize = options.window;
+      settings.advertisedInitialBidiRemoteStreamWindowSize = options.window;
+      settings.advertisedInitialUniStreamWindowSize = options.window;
+      settings.advertisedInitialConnectionWindowSize = 10 * options.window;
     }
+    settings.autotuneReceiveWindows = options.autotuneWindow;
     server_->setTransportSettings(settings);
+    if (options.competingType) {
+      // Every other connection runs the competing controller.
+      auto numConnections = std::make_shared<std::atomic<uint64_t>>(0);
+      server_->setTransportSettingsOverrideFn(
+          [numConnections, type = *options.competingType, this](
+              const quic::TransportSettings& serverSettings,
+              const folly::IPAddress&)
+              -> folly::Optional<quic::TransportSettings> {
+            if ((*numConnections)++ % 2 == 0) {
+              return folly::none;
+            }
+            auto competingSettings = serverSettings;
+            competingSettings.defaultCongestionController = type;
+            competingSettings.pacingEnabled = pacingEnabled(type);
+            return competingSettings;
+          });
+    }
+    LOG(INFO) << "tperf server batching=" << toString(options.batchingMode)
+              << " pacing=" << settings.pacingEnabled
+              << " qlog_sample_one_in=" << options.qlogSampleOneIn;
   }
 
   void start() {
     // Create a SocketAddress and the default or passed in host.
     folly::SocketAddress addr1(host_.c_str(), port_);
     addr1.setFromHostPort(host_, port_);
-    server_->start(addr1, 0);
-    LOG(INFO) << "tperf server started at: " << addr1.describe();
+    server_->start(addr1, maxWorkers_);
+    LOG(INFO) << "tperf server started at: " << addr1.describe() << " with "
+              << (maxWorkers_ ? folly::to<std::string>(maxWorkers_)
+                              : std::string("one per cpu"))
+              << " workers";
     eventbase_.loopForever();
   }
 
  private:
+  bool pacingEnabled(quic::CongestionControlType type) const {
+    return pacing_.value_or(pacedCongestionControl(type));
+  }
+
   std::string host_;
   uint16_t port_;
+  size_t maxWorkers_;
+  folly::Optional<bool> pacing_;
   folly::EventBase eventbase_;
+  // Outlives the server, whose connections hand it their qlogs.
+  std::unique_ptr<folly::CPUThreadPoolExecutor> qlogExecutor_;
   std::shared_ptr<quic::QuicServer> server_;
 };
 
-class TPerfClient : public quic::QuicSocket::ConnectionCallback,
-                    public quic::QuicSocket::ReadCallback,
-                    public quic::QuicSocket::WriteCallback,
-                    public folly::HHWheelTimer::Callback {
+struct TPerfClientOptions {
+  TPerfTest test{TPerfTest::Bulk};
+  uint64_t numStreams{1};
+  uint64_t requestSize{0};
+  uint64_t window{0};
+  bool autotuneWindow{false};
+  NetworkEmulatorConfig emulator;
+};
+
+// What the connections of a client thread have done.
+struct TPerfStats {
+  uint64_t receivedBytes{0};
+  uint64_t rpcs{0};
+  uint64_t handshakes{0};
+  uint64_t errors{0};
+  // Microseconds from the request to the end of the response for rpc, and
+  // from the start of the connection to onTransportReady for churn.
+  TransportStatsHistogram latency;
+
+  void merge(const TPerfStats& other) {
+    receivedBytes += other.receivedBytes;
+    rpcs += other.rpcs;
+    handshakes += other.handshakes;
+    errors += other.errors;
+    latency.merge(other.latency);
+  }
+};
+
+/**
+ * One client connection, used from the thread of its event base. For churn,
+ * the connection is replaced by a new one every time it is ready.
+ */
+class TPerfClientConnection : public quic::QuicSocket::ConnectionCallback,
+                              public quic::QuicSocket::ReadCallback,
+                              public folly::EventBase::LoopCallback {
  public:
-  TPerfClient(
-      const std::string& host,
-      uint16_t port,
-      int32_t duration,
-      uint64_t window)
-      : host_(host), port_(port), duration_(duration), window_(window) {}
+  TPerfClientConnection(
+      folly::EventBase* evb,
+      folly::SocketAddress addr,
+      const TPerfClientOptions& options,
+      TPerfStats& stats,
+      uint64_t emulatorSeed)
+      : evb_(evb),
+        addr_(std::move(addr)),
+        options_(options),
+        stats_(stats),
+        request_(makeBuffer(options.requestSize)),
+        emulatorSeed_(emulatorSeed) {}
 
-  void timeoutExpired() noexcept override {
-    quicClient_->closeNow(folly::none);
-    constexpr double bytesPerMegabit = 131072;
-    LOG(INFO) << "Received " << receivedBytes_ << " bytes in "
-              << duration_.count() << " seconds.";
-    LOG(INFO) << (receivedBytes_ / bytesPerMegabit) / duration_.count()
-              << "Mb/s";
+  void start() {
+    std::unique_ptr<folly::AsyncUDPSocket> sock;
+    if (options_.emulator.enabled()) {
+      // A new seed for every churn reconnect.
+      sock = std::make_unique<EmulatedUDPSocket>(
+          evb_, options_.emulator, emulatorSeed_++);
+    } else {
+      sock = std::make_unique<folly::AsyncUDPSocket>(evb_);
+    }
+    quicClient_ =
+        std::make_shared<quic::QuicClientTransport>(evb_, std::move(sock));
+    quicClient_->setHostname("tperf");
+    quicClient_->setCertificateVerifier(test::createTestCertificateVerifier());
+    quicClient_->addNewPeerAddress(addr_);
+    auto settings = quicClient_->getTransportSettings();
+    settings.advertisedInitialUniStreamWindowSize = options_.window;
+    settings.advertisedInitialConnectionWindowSize = 10 * options_.window;
+    settings.autotuneReceiveWindows = options_.autotuneWindow;
+    quicClient_->setTransportSettings(settings);
+
+    VLOG(5) << "TPerfClient connecting to " << addr_.describe();
+    connectStart_ = Clock::now();
+    quicClient_->start(this);
   }
 
-  virtual void callbackCanceled() noexcept override {}
+  void stop() {
+    stopped_ = true;
+    cancelLoopCallback();
+    if (quicClient_) {
+      quicClient_->closeNow(folly::none);
+      quicClient_.reset();
+    }
+  }
 
   void readAvailable(quic::StreamId streamId) noexcept override {
     auto readData = quicClient_->read(streamId, 0);
@@ -228,13 +530,29 @@ class TPerfClient : public quic::QuicSocket::ConnectionCallback,
                  << ", error=" << (uint32_t)readData.error();
     }
 
-    receivedBytes_ += readData->first->computeChainDataLength();
+    if (readData->first) {
+      stats_.receivedBytes += readData->first->computeChainDataLength();
+    }
+    if (readData->second && options_.test == TPerfTest::Rpc) {
+      auto it = requestStarts_.find(streamId);
+      if (it != requestStarts_.end()) {
+        stats_.latency.add(microsSince(it->second));
+        requestStarts_.erase(it);
+      }
+      stats_.rpcs++;
+      if (!stopped_) {
+        sendRequest();
+      }
+    }
   }
 
   void readError(
       quic::StreamId streamId,
       std::pair<quic::QuicErrorCode, folly::Optional<folly::StringPiece>>
           error) noexcept override {
+    if (stopped_) {
+      return;
+    }
     LOG(ERROR) << "TPerfClient failed read from stream=" << streamId
                << ", error=" << toString(error);
     // A read error only terminates the ingress portion of the stream state.
@@ -243,18 +561,32 @@ class TPerfClient : public quic::QuicSocket::ConnectionCallback,
   }
 
   void onNewBidirectionalStream(quic::StreamId id) noexcept override {
-    LOG(INFO) << "TPerfClient: new bidirectional stream=" << id;
+    VLOG(5) << "TPerfClient: new bidirectional stream=" << id;
     quicClient_->setReadCallback(id, this);
   }
 
   void onNewUnidirectionalStream(quic::StreamId id) noexcept override {
-    LOG(INFO) << "TPerfClient: new unidirectional stream=" << id;
-    eventBase_.timer().scheduleTimeout(this, duration_);
+    VLOG(5) << "TPerfClient: new unidirectional stream=" << id;
     quicClient_->setReadCallback(id, this);
   }
 
   void onTransportReady() noexcept override {
-    LOG(INFO) << "TPerfClient: onTransportReady";
+    VLOG(5) << "TPerfClient: onTransportReady";
+    stats_.handshakes++;
+    switch (options_.test) {
+      case TPerfTest::Bulk:
+        break;
+      case TPerfTest::Rpc:
+        for (uint64_t i = 0; i < options_.numStreams; i++) {
+          sendRequest();
+        }
+        break;
+      case TPerfTest::Churn:
+        stats_.latency.add(microsSince(connectStart_));
+        // Reconnects once the transport is off the stack.
+        evb_->runInLoop(this);
+        break;
+    }
   }
 
   void onStopSending(
@@ -265,60 +597,185 @@ class TPerfClient : public quic::QuicSocket::ConnectionCallback,
 
   void onConnectionEnd() noexcept override {
     LOG(INFO) << "TPerfClient connection end";
-
-    eventBase_.terminateLoopSoon();
   }
 
   void onConnectionError(
       std::pair<quic::QuicErrorCode, std::string> error) noexcept override {
+    if (stopped_) {
+      return;
+    }
     LOG(ERROR) << "TPerfClient error: " << toString(error.first);
-    eventBase_.terminateLoopSoon();
+    stats_.errors++;
   }
 
-  void onStreamWriteReady(
-      quic::StreamId id,
-      uint64_t maxToSend) noexcept override {
-    LOG(INFO) << "TPerfClient stream" << id
-              << " is write ready with maxToSend=" << maxToSend;
+  void runLoopCallback() noexcept override {
+    quicClient_->closeNow(folly::none);
+    start();
   }
 
-  void onStreamWriteError(
-      quic::StreamId id,
-      std::pair<quic::QuicErrorCode, folly::Optional<folly::StringPiece>>
-          error) noexcept override {
-    LOG(ERROR) << "TPerfClient write error with stream=" << id
-               << " error=" << toString(error);
+ private:
+  void sendRequest() {
+    auto stream = quicClient_->createBidirectionalStream();
+    if (stream.hasError()) {
+      LOG(ERROR) << "TPerfClient failed to create stream, error="
+                 << quic::toString(stream.error());
+      return;
+    }
+    quicClient_->setReadCallback(*stream, this);
+    requestStarts_.emplace(*stream, Clock::now());
+    auto res =
+        quicClient_->writeChain(*stream, request_->clone(), true, false);
+    if (res.hasError()) {
+      LOG(ERROR) << "TPerfClient failed request on stream=" << *stream
+                 << ", error=" << quic::toString(res.error());
+    }
   }
 
-  void start() {
-    folly::SocketAddress addr(host_.c_str(), port_);
+  static uint64_t microsSince(TimePoint start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               Clock::now() - start)
+        .count();
+  }
 
-    auto sock = std::make_unique<folly::AsyncUDPSocket>(&eventBase_);
-    quicClient_ = std::make_shared<quic::QuicClientTransport>(
-        &eventBase_, std::move(sock));
-    quicClient_->setHostname("tperf");
-    quicClient_->setCertificateVerifier(test::createTestCertificateVerifier());
-    quicClient_->addNewPeerAddress(addr);
-    auto settings = quicClient_->getTransportSettings();
-    settings.advertisedInitialUniStreamWindowSize = window_;
-    settings.advertisedInitialConnectionWindowSize = 10 * window_;
-    quicClient_->setTransportSettings(settings);
+  folly::EventBase* evb_;
+  folly::SocketAddress addr_;
+  const TPerfClientOptions& options_;
+  TPerfStats& stats_;
+  Buf request_;
+  uint64_t emulatorSeed_;
+  std::shared_ptr<quic::QuicClientTransport> quicClient_;
+  std::unordered_map<quic::StreamId, TimePoint> requestStarts_;
+  TimePoint connectStart_;
+  bool stopped_{false};
+};
 
-    LOG(INFO) << "TPerfClient connecting to " << addr.describe();
-    quicClient_->start(this);
-    eventBase_.loopForever();
+/**
+ * Runs numConnections connections spread over numThreads event base
+ * threads for the duration of the test, then reports what they did.
+ */
+class TPerfClient {
+ public:
+  TPerfClient(
+      const std::string& host,
+      uint16_t port,
+      int32_t duration,
+      uint64_t numConnections,
+      uint64_t numThreads,
+      TPerfClientOptions options)
+      : host_(host),
+        port_(port),
+        duration_(duration),
+        numConnections_(numConnections),
+        options_(options) {
+    for (uint64_t i = 0; i < std::max<uint64_t>(numThreads, 1); i++) {
+      threads_.push_back(std::make_unique<ClientThread>());
+    }
   }
 
-  ~TPerfClient() override = default;
+  folly::dynamic start() {
+    folly::SocketAddress addr(host_.c_str(), port_);
+    LOG(INFO) << "TPerfClient running " << toString(options_.test)
+              << " with " << numConnections_ << " connections on "
+              << threads_.size() << " threads to " << addr.describe();
+    auto begin = Clock::now();
+    for (uint64_t i = 0; i < numConnections_; i++) {
+      auto& thread = *threads_[i % threads_.size()];
+      auto evb = thread.evbThread.getEventBase();
+      evb->runInEventBaseThreadAndWait([&] {
+        thread.connections.push_back(std::make_unique<TPerfClientConnection>(
+            evb,
+            addr,
+            options_,
+            thread.stats,
+            // Apart from the server's, which count up from the seed.
+            options_.emulator.seed + ((i + 1) << 32)));
+        thread.connections.back()->start();
+      });
+    }
+    std::this_thread::sleep_for(duration_);
+    TPerfStats stats;
+    for (auto& thread : threads_) {
+      thread->evbThread.getEventBase()->runInEventBaseThreadAndWait([&] {
+        for (auto& connection : thread->connections) {
+          connection->stop();
+        }
+        stats.merge(thread->stats);
+      });
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - begin);
+    return report(stats, elapsed);
+  }
 
  private:
+  struct ClientThread {
+    folly::ScopedEventBaseThread evbThread;
+    std::vector<std::unique_ptr<TPerfClientConnection>> connections;
+    TPerfStats stats;
+
+    ~ClientThread() {
+      evbThread.getEventBase()->runInEventBaseThreadAndWait(
+          [&] { connections.clear(); });
+    }
+  };
+
+  folly::dynamic report(
+      const TPerfStats& stats,
+      std::chrono::microseconds elapsed) const {
+    constexpr double bytesPerMegabit = 131072;
+    double seconds = std::max(elapsed.count(), int64_t(1)) / 1e6;
+    LOG(INFO) << "Received " << stats.receivedBytes << " bytes in " << seconds
+              << " seconds.";
+    LOG(INFO) << (stats.receivedBytes / bytesPerMegabit) / seconds << "Mb/s";
+    if (options_.test == TPerfTest::Rpc) {
+      LOG(INFO) << stats.rpcs / seconds << " requests/s, p50="
+                << stats.latency.percentile(50)
+                << "us p90=" << stats.latency.percentile(90)
+                << "us p99=" << stats.latency.percentile(99)
+                << "us p999=" << stats.latency.percentile(99.9) << "us";
+    } else if (options_.test == TPerfTest::Churn) {
+      LOG(INFO) << stats.handshakes / seconds << " handshakes/s, p50="
+                << stats.latency.percentile(50)
+                << "us p90=" << stats.latency.percentile(90)
+                << "us p99=" << stats.latency.percentile(99)
+                << "us p999=" << stats.latency.percentile(99.9) << "us";
+    }
+
+    folly::dynamic latency = folly::dynamic::object(
+        "count", stats.latency.count)(
+        "mean_us",
+        stats.latency.count ? stats.latency.sum / stats.latency.count : 0)(
+        "p50_us", stats.latency.percentile(50))(
+        "p90_us", stats.latency.percentile(90))(
+        "p99_us", stats.latency.percentile(99))(
+        "p999_us", stats.latency.percentile(99.9));
+    // Upper bounds and counts of the log2 buckets that are not empty
+    folly::dynamic buckets = folly::dynamic::array;
+    for (size_t i = 0; i < stats.latency.buckets.size(); i++) {
+      if (stats.latency.buckets[i] != 0) {
+        uint64_t upper = i == 0 ? 0 : (uint64_t(1) << i) - 1;
+        buckets.push_back(
+            folly::dynamic::array(upper, stats.latency.buckets[i]));
+      }
+    }
+    latency["buckets"] = std::move(buckets);
+    return folly::dynamic::object("test", toString(options_.test))(
+        "connections", numConnections_)("threads", threads_.size())(
+        "streams", options_.numStreams)("request_size", options_.requestSize)(
+        "duration_s", seconds)("received_bytes", stats.receivedBytes)(
+        "throughput_mbps", (stats.receivedBytes / bytesPerMegabit) / seconds)(
+        "rpcs", stats.rpcs)("rpcs_per_s", stats.rpcs / seconds)(
+        "handshakes", stats.handshakes)(
+        "handshakes_per_s", stats.handshakes / seconds)(
+        "errors", stats.errors)("latency", std::move(latency));
+  }
+
   std::string host_;
   uint16_t port_;
-  std::shared_ptr<quic::QuicClientTransport> quicClient_;
-  folly::EventBase eventBase_;
-  size_t receivedBytes_{0};
   std::chrono::seconds duration_;
-  uint64_t window_;
+  uint64_t numConnections_;
+  TPerfClientOptions options_;
+  std::vector<std::unique_ptr<ClientThread>> threads_;
 };
 
 } // namespace tperf
@@ -327,6 +784,11 @@ class TPerfClient : public quic::QuicSocket::ConnectionCallback,
 DEFINE_string(host, "::1", "TPerf server hostname/IP");
 DEFINE_int32(port, 6666, "TPerf server port");
 DEFINE_string(mode, "server", "Mode to run in: 'client' or 'server'");
+DEFINE_string(
+    test,
+    "bulk",
+    "Load to run, 'bulk', 'rpc' or 'churn'. The server and the client should "
+    "run the same one");
 DEFINE_int32(duration, 10, "Duration of test in seconds");
 DEFINE_uint64(
     block_size,
@@ -334,11 +796,126 @@ DEFINE_uint64(
     "Amount of data written to stream each iteration");
 DEFINE_uint64(writes_per_loop, 5, "Amount of socket writes per event loop");
 DEFINE_uint64(window, 64 * 1024, "Flow control window size");
-DEFINE_string(congestion, "newreno", "newreno/cubic/bbr/none");
-DEFINE_bool(gso, false, "Enable GSO writes to the socket");
+DEFINE_uint64(
+    server_window,
+    0,
+    "Flow control window size of the server, 0 for the transport default");
+DEFINE_bool(
+    autotune_window,
+    false,
+    "Grow the flow control windows of the client and the server when they "
+    "limit the throughput");
+DEFINE_string(
+    congestion,
+    "newreno",
+    "newreno/cubic/bbr/bbr2/prague/copa/staticrate/none");
+DEFINE_string(
+    competing_congestion,
+    "",
+    "Congestion controller of every other server connection, if any");
+DEFINE_bool(
+    copa_mode_switching,
+    true,
+    "Let copa switch to its competitive mode behind buffer-filling flows");
+DEFINE_uint64(static_rate_mbps, 0, "Rate of the staticrate controller");
+DEFINE_bool(gso, false, "Enable GSO writes to the socket, as --batching=gso");
+DEFINE_string(
+    batching,
+    "none",
+    "How the server batches its socket writes, "
+    "none/gso/sendmmsg/sendmmsg_gso");
+DEFINE_uint32(max_batch_size, 16, "Packets per batched socket write");
+DEFINE_string(
+    pacing,
+    "auto",
+    "Pace the server connections, 'on', 'off' or 'auto' for the congestion "
+    "controllers that need it");
+DEFINE_uint64(
+    workers,
+    0,
+    "Server worker threads, 0 for one per cpu. The shared emulated link "
+    "uses one");
+DEFINE_string(
+    worker_cpus,
+    "",
+    "Comma separated cpus to pin the server workers to, worker i to the "
+    "i-th");
+DEFINE_string(
+    qlog_dir,
+    "",
+    "Directory to write the qlogs of the sampled server connections to");
+DEFINE_uint32(
+    qlog_sample_one_in,
+    0,
+    "Server connections that get a qlog, one in this many, with --qlog_dir");
+DEFINE_uint64(connections, 1, "Number of parallel client connections");
+DEFINE_uint64(client_threads, 1, "Threads the client connections run on");
+DEFINE_uint64(
+    streams,
+    1,
+    "Streams the server pushes on per connection for bulk, requests in "
+    "flight per connection for rpc");
+DEFINE_uint64(request_size, 100, "Size of the rpc requests");
+DEFINE_uint64(response_size, 4096, "Size of the rpc responses");
+DEFINE_bool(json, false, "Print the client results as JSON to stdout");
+DEFINE_uint64(emu_delay_us, 0, "Emulated one way delay of the sent packets");
+DEFINE_uint64(emu_jitter_us, 0, "Emulated uniform jitter around the delay");
+DEFINE_double(emu_loss, 0, "Emulated random loss rate of the sent packets");
+DEFINE_double(
+    emu_ge_p,
+    0,
+    "Gilbert-Elliott probability of going from the good to the bad state");
+DEFINE_double(
+    emu_ge_r,
+    1,
+    "Gilbert-Elliott probability of going from the bad to the good state");
+DEFINE_double(emu_ge_loss_good, 0, "Gilbert-Elliott loss rate when good");
+DEFINE_double(emu_ge_loss_bad, 1, "Gilbert-Elliott loss rate when bad");
+DEFINE_double(emu_reorder, 0, "Rate of packets sent without the delay");
+DEFINE_uint64(emu_rate_mbps, 0, "Emulated bandwidth of the link, 0 for none");
+DEFINE_uint64(emu_burst_bytes, 16 * 1024, "Token bucket size of the link");
+DEFINE_uint64(
+    emu_queue_bytes,
+    256 * 1024,
+    "Bytes queued behind the token bucket before dropping");
+DEFINE_uint64(emu_seed, 0, "Seed of the emulated delay, loss and reordering");
+DEFINE_bool(
+    emu_shared_link,
+    false,
+    "Server connections share the emulated link, on a single worker");
 
 using namespace quic::tperf;
 
+NetworkEmulatorConfig flagsToNetworkEmulatorConfig() {
+  NetworkEmulatorConfig config;
+  config.delay = std::chrono::microseconds(FLAGS_emu_delay_us);
+  config.jitter = std::chrono::microseconds(FLAGS_emu_jitter_us);
+  config.lossRate = FLAGS_emu_loss;
+  config.geGoodToBad = FLAGS_emu_ge_p;
+  config.geBadToGood = FLAGS_emu_ge_r;
+  config.geLossGood = FLAGS_emu_ge_loss_good;
+  config.geLossBad = FLAGS_emu_ge_loss_bad;
+  config.reorderRate = FLAGS_emu_reorder;
+  config.rateBytesPerSec = FLAGS_emu_rate_mbps * 1000 * 1000 / 8;
+  config.burstBytes = FLAGS_emu_burst_bytes;
+  config.queueBytes = FLAGS_emu_queue_bytes;
+  config.seed = FLAGS_emu_seed;
+  config.sharedLink = FLAGS_emu_shared_link;
+  return config;
+}
+
+folly::Optional<bool> flagsToPacing(const std::string& pacing) {
+  if (pacing == "on") {
+    return true;
+  } else if (pacing == "off") {
+    return false;
+  } else if (pacing == "auto") {
+    return folly::none;
+  }
+  throw std::invalid_argument(
+      folly::to<std::string>("Unknown pacing ", pacing));
+}
+
 quic::CongestionControlType flagsToCongestionControlType(
     const std::string& congestionControlType) {
   if (congestionControlType == "cubic") {
@@ -347,8 +924,14 @@ quic::CongestionControlType flagsToCongestionControlType(
     return quic::CongestionControlType::NewReno;
   } else if (congestionControlType == "bbr") {
     return quic::CongestionControlType::BBR;
+  } else if (congestionControlType == "bbr2") {
+    return quic::CongestionControlType::BBR2;
+  } else if (congestionControlType == "prague") {
+    return quic::CongestionControlType::Prague;
   } else if (congestionControlType == "copa") {
     return quic::CongestionControlType::Copa;
+  } else if (congestionControlType == "staticrate") {
+    return quic::CongestionControlType::StaticRate;
   } else if (congestionControlType == "none") {
     return quic::CongestionControlType::None;
   }
@@ -366,18 +949,64 @@ int main(int argc, char* argv[]) {
   folly::Init init(&argc, &argv);
   fizz::CryptoUtils::init();
 
+  auto test = parseTest(FLAGS_test);
+  auto emulator = flagsToNetworkEmulatorConfig();
   if (FLAGS_mode == "server") {
-    TPerfServer server(
-        FLAGS_host,
-        FLAGS_port,
-        FLAGS_block_size,
-        FLAGS_writes_per_loop,
-        flagsToCongestionControlType(FLAGS_congestion),
-        FLAGS_gso);
+    TPerfServerOptions options;
+    options.test = test;
+    options.blockSize = FLAGS_block_size;
+    options.numStreams = FLAGS_streams;
+    options.responseSize = FLAGS_response_size;
+    options.numWorkers = FLAGS_workers;
+    if (!FLAGS_worker_cpus.empty()) {
+      std::vector<folly::StringPiece> cpus;
+      folly::split(',', FLAGS_worker_cpus, cpus);
+      for (auto cpu : cpus) {
+        options.workerCpus.push_back(folly::to<size_t>(cpu));
+      }
+    }
+    options.writesPerLoop = FLAGS_writes_per_loop;
+    options.congestionControlType =
+        flagsToCongestionControlType(FLAGS_congestion);
+    if (!FLAGS_competing_congestion.empty()) {
+      options.competingType =
+          flagsToCongestionControlType(FLAGS_competing_congestion);
+    }
+    options.copaModeSwitching = FLAGS_copa_mode_switching;
+    options.staticRateBytesPerSec = FLAGS_static_rate_mbps * 1000 * 1000 / 8;
+    options.pacing = flagsToPacing(FLAGS_pacing);
+    options.batchingMode = parseBatchingMode(FLAGS_batching);
+    if (FLAGS_gso &&
+        options.batchingMode == QuicBatchingMode::BATCHING_MODE_NONE) {
+      options.batchingMode = QuicBatchingMode::BATCHING_MODE_GSO;
+    }
+    options.maxBatchSize = FLAGS_max_batch_size;
+    options.window = FLAGS_server_window;
+    options.autotuneWindow = FLAGS_autotune_window;
+    options.qlogDir = FLAGS_qlog_dir;
+    options.qlogSampleOneIn = FLAGS_qlog_sample_one_in;
+    options.emulator = emulator;
+    TPerfServer server(FLAGS_host, FLAGS_port, options);
     server.start();
   } else if (FLAGS_mode == "client") {
-    TPerfClient client(FLAGS_host, FLAGS_port, FLAGS_duration, FLAGS_window);
-    client.start();
+    TPerfClientOptions options;
+    options.test = test;
+    options.numStreams = FLAGS_streams;
+    options.requestSize = FLAGS_request_size;
+    options.window = FLAGS_window;
+    options.autotuneWindow = FLAGS_autotune_window;
+    options.emulator = emulator;
+    TPerfClient client(
+        FLAGS_host,
+        FLAGS_port,
+        FLAGS_duration,
+        FLAGS_connections,
+        FLAGS_client_threads,
+        options);
+    auto result = client.start();
+    if (FLAGS_json) {
+      std::cout << folly::toPrettyJson(result) << std::endl;
+    }
   }
   return 0;
 }